@@ -0,0 +1,290 @@
+// LanderBatchCompute.metal
+// GPU lander batch: LanderBatch's 2D step and the descent autopilot, many steps per dispatch
+
+#include <metal_stdlib>
+using namespace metal;
+
+// LanderBatch::ResolveCollisions
+constant float kSafeVerticalVelocity = 2.0f;
+constant float kSafeHorizontalVelocity = 1.0f;
+
+// DescentController
+constant float kMaxTilt = 30.0f;
+constant float kTurnPerStep = 2.0f;
+constant float kTouchdownSinkRate = 0.5f;
+
+// LanderBatchState
+constant uchar kFlying = 0;
+constant uchar kLanded = 1;
+constant uchar kCrashed = 2;
+
+// Integrators.h policy (LANDER_INTEGRATOR): 0 semi-implicit Euler, 1
+// velocity Verlet, 2 RK4
+constant int kIntegrator [[function_constant(0)]];
+
+// Matches LanderBatchGpuParams in LanderBatchGpu.cpp
+struct LanderBatchGpuParams {
+    float deltaTime;
+    float gravity;
+    float maxThrustAccel;
+    float angularAccel;         // deg/s² at a full RCS command
+    float landerHalfHeight;
+    float fuelConsumptionRate;
+    float rcsFuelRate;          // kg/s of a full RCS couple
+    float terrainHeight;        // Pixels (screen-space flip)
+    float pixelsPerMeter;       // Units
+    float metersPerPixel;
+    uint segmentCount;
+    uint landerCount;
+    uint stepCount;             // Steps this dispatch
+    uint firstStep;             // Steps taken before it
+    uint useController;         // Fly the descent autopilot before each step
+};
+
+// Matches DescentControllerGains
+struct DescentGains {
+    float thrustGain;
+    float descentGain;
+    float tiltGain;
+};
+
+// Terrain segments (LanderSegmentTable), screen pixels sorted by x1
+struct Segments {
+    constant float* x1;
+    constant float* y1;
+    constant float* x2;
+    constant float* y2;
+    constant uchar* landingPad;
+    uint count;
+    float terrainHeight;
+    float pixelsPerMeter;
+    float metersPerPixel;
+};
+
+// LanderKernels::SinCosDegrees: the same reduction and polynomials
+static void SinCosDegrees(float degrees, thread float& sinOut, thread float& cosOut) {
+    const float quadrant = rint(degrees * (1.0f / 90.0f));
+    const int q = int(quadrant);
+    const float r = (degrees - quadrant * 90.0f) * (M_PI_F / 180.0f);
+
+    const float r2 = r * r;
+    const float s = r + r * r2 * (-1.0f / 6.0f + r2 * (1.0f / 120.0f + r2 * (-1.0f / 5040.0f)));
+    const float c = 1.0f + r2 * (-1.0f / 2.0f + r2 * (1.0f / 24.0f + r2 * (-1.0f / 720.0f + r2 * (1.0f / 40320.0f))));
+
+    const float sinValue = (q & 1) ? c : s;
+    const float cosValue = (q & 1) ? s : c;
+    sinOut = (q & 2) ? -sinValue : sinValue;
+    cosOut = ((q + 1) & 2) ? -cosValue : cosValue;
+}
+
+// LanderBatch::SurfaceHeight: the last segment starting at or before x,
+// the end segments continuing past the terrain's edges
+static float SurfaceHeight(const Segments segments, float x) {
+    if (segments.count == 0) {
+        return 0.0f;
+    }
+    const float screenX = x * segments.pixelsPerMeter;
+    uint low = 0;
+    uint high = segments.count;
+    while (low < high) {
+        const uint middle = (low + high) / 2;
+        if (segments.x1[middle] <= screenX) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    const uint segment = low > 0 ? low - 1 : 0;
+
+    const float width = segments.x2[segment] - segments.x1[segment];
+    float t = width > 0.0f ? (screenX - segments.x1[segment]) / width : 0.0f;
+    t = min(max(t, 0.0f), 1.0f);
+    const float screenY = segments.y1[segment] + t * (segments.y2[segment] - segments.y1[segment]);
+    return (segments.terrainHeight - screenY) * segments.metersPerPixel;
+}
+
+// One step of the build's integrator under a constant acceleration
+static void Integrate(thread float& posX, thread float& posY, thread float& velX, thread float& velY,
+                      float ax, float ay, float dt) {
+    if (kIntegrator == 1) {
+        // Velocity Verlet
+        const float halfDt = dt * 0.5f;
+        posX = posX + (velX + ax * halfDt) * dt;
+        posY = posY + (velY + ay * halfDt) * dt;
+        velX = velX + (ax + ax) * halfDt;
+        velY = velY + (ay + ay) * halfDt;
+    } else if (kIntegrator == 2) {
+        // RK4 with the same acceleration at every stage
+        const float halfDt = dt * 0.5f;
+        const float sixthDt = dt * (1.0f / 6.0f);
+        const float vx2 = velX + ax * halfDt;
+        const float vy2 = velY + ay * halfDt;
+        const float vx3 = velX + ax * halfDt;
+        const float vy3 = velY + ay * halfDt;
+        const float vx4 = velX + ax * dt;
+        const float vy4 = velY + ay * dt;
+        const float sumVX = velX + 2.0f * (vx2 + vx3) + vx4;
+        const float sumVY = velY + 2.0f * (vy2 + vy3) + vy4;
+        const float sumAX = ax + 2.0f * (ax + ax) + ax;
+        const float sumAY = ay + 2.0f * (ay + ay) + ay;
+        posX = posX + sumVX * sixthDt;
+        posY = posY + sumVY * sixthDt;
+        velX = velX + sumAX * sixthDt;
+        velY = velY + sumAY * sixthDt;
+    } else {
+        // Semi-implicit Euler
+        velX = velX + ax * dt;
+        velY = velY + ay * dt;
+        posX = posX + velX * dt;
+        posY = posY + velY * dt;
+    }
+}
+
+// RcsThrusters::CommandForTurn
+static float CommandForTurn(float degrees, float spin, float angularAccel, float deltaTime) {
+    if (angularAccel <= 0.0f || deltaTime <= 0.0f) {
+        return 0.0f;
+    }
+    const float braking = sqrt(2.0f * angularAccel * fabs(degrees));
+    const float rate = copysign(min(fabs(degrees) / deltaTime, braking), degrees);
+    return min(max((rate - spin) / (angularAccel * deltaTime), -1.0f), 1.0f);
+}
+
+// Every lander is one thread and runs params.stepCount whole batch steps
+// (LanderBatch::ApplyController with DescentController, then
+// LanderBatch::Step) on its own state, kept in registers in between. The
+// state buffers are shared with the CPU, which reads them in place once
+// the command buffer completes. endStep gets the step a lander stopped
+// flying on (counted from 1; 0 while it still flies).
+kernel void lander_batch_step(constant LanderBatchGpuParams& params [[buffer(0)]],
+                              device float* posXs [[buffer(1)]],
+                              device float* posYs [[buffer(2)]],
+                              device float* velXs [[buffer(3)]],
+                              device float* velYs [[buffer(4)]],
+                              device float* rotations [[buffer(5)]],
+                              device float* spins [[buffer(6)]],
+                              device float* fuels [[buffer(7)]],
+                              device float* thrustLevels [[buffer(8)]],
+                              device float* rcsCommands [[buffer(9)]],
+                              device uchar* states [[buffer(10)]],
+                              device float* touchdownVelXs [[buffer(11)]],
+                              device float* touchdownVelYs [[buffer(12)]],
+                              device uint* endSteps [[buffer(13)]],
+                              const device DescentGains* gains [[buffer(14)]],
+                              constant float* segmentX1 [[buffer(15)]],
+                              constant float* segmentY1 [[buffer(16)]],
+                              constant float* segmentX2 [[buffer(17)]],
+                              constant float* segmentY2 [[buffer(18)]],
+                              constant uchar* segmentPads [[buffer(19)]],
+                              uint index [[thread_position_in_grid]]) {
+    if (index >= params.landerCount || states[index] != kFlying) {
+        return;
+    }
+    const Segments segments = { segmentX1, segmentY1, segmentX2, segmentY2, segmentPads,
+                                params.segmentCount, params.terrainHeight, params.pixelsPerMeter,
+                                params.metersPerPixel };
+    const float dt = params.deltaTime;
+
+    float posX = posXs[index];
+    float posY = posYs[index];
+    float velX = velXs[index];
+    float velY = velYs[index];
+    float rotation = rotations[index];
+    float spin = spins[index];
+    float fuel = fuels[index];
+    float thrustLevel = thrustLevels[index];
+    float rcsCommand = rcsCommands[index];
+    uchar state = kFlying;
+    float touchdownVelX = 0.0f;
+    float touchdownVelY = 0.0f;
+    uint endStep = 0;
+
+    for (uint step = 0; step < params.stepCount && state == kFlying; step++) {
+        if (params.useController != 0) {
+            // DescentController's command (ComputeCommand), applied as
+            // LanderBatch::ApplyThrust and FireRcs do
+            const DescentGains lander = gains[index];
+            const float altitude = posY - params.landerHalfHeight - SurfaceHeight(segments, posX);
+            const float targetTilt = min(max(lander.tiltGain * velX, -kMaxTilt), kMaxTilt);
+            const float tilt = rotation > 180.0f ? rotation - 360.0f : rotation;
+            const float turn = min(max(targetTilt - tilt, -kTurnPerStep), kTurnPerStep);
+
+            const float hoverThrottle = params.maxThrustAccel > 0.0f ? params.gravity / params.maxThrustAccel : 1.0f;
+            const float targetVelY = -(kTouchdownSinkRate + lander.descentGain * max(altitude, 0.0f));
+            const float tiltCos = max(precise::cos(tilt * (M_PI_F / 180.0f)), 0.5f);
+            const float throttle = hoverThrottle / tiltCos + lander.thrustGain * (targetVelY - velY);
+            const float command = min(max(throttle, 0.0f), 1.0f);
+
+            thrustLevel = fuel <= 0.0f ? 0.0f : min(max(command, 0.0f), 1.0f);
+            rcsCommand = fuel <= 0.0f ? 0.0f : CommandForTurn(turn, spin, params.angularAccel, dt);
+        }
+
+        // Gravity and thrust along the step's starting attitude
+        float sinValue, cosValue;
+        SinCosDegrees(rotation, sinValue, cosValue);
+        const float thrustAccel = params.maxThrustAccel * thrustLevel;
+        Integrate(posX, posY, velX, velY, -sinValue * thrustAccel, cosValue * thrustAccel - params.gravity, dt);
+
+        // Then the RCS's spin and turn
+        spin = spin + rcsCommand * params.angularAccel * dt;
+        rotation = rotation + spin * dt;
+        rotation = rotation < 0.0f ? rotation + 360.0f : rotation;
+        rotation = rotation >= 360.0f ? rotation - 360.0f : rotation;
+
+        // Fuel for the controls held through the step
+        if ((thrustLevel > 0.0f || rcsCommand != 0.0f) && fuel > 0.0f) {
+            fuel = max(0.0f, fuel - params.fuelConsumptionRate * thrustLevel * dt -
+                             params.rcsFuelRate * fabs(rcsCommand) * dt);
+            if (fuel <= 0.0f) {
+                thrustLevel = 0.0f;
+                rcsCommand = 0.0f;
+            }
+        }
+
+        // The first segment the bottom has sunk into (LanderKernels::Collide2D)
+        const float bottomY = posY - params.landerHalfHeight;
+        const float screenX = posX * segments.pixelsPerMeter;
+        bool found = false;
+        bool onPad = false;
+        float collisionHeight = 0.0f;
+        for (uint s = 0; s < segments.count; s++) {
+            const bool inRange = (screenX >= segments.x1[s]) & (screenX <= segments.x2[s]);
+            const float segmentPct = (screenX - segments.x1[s]) / (segments.x2[s] - segments.x1[s]);
+            const float segmentY = segments.y1[s] + segmentPct * (segments.y2[s] - segments.y1[s]);
+            const float terrainHeightMeters = (segments.terrainHeight - segmentY) * segments.metersPerPixel;
+            const bool hit = inRange & (bottomY <= terrainHeightMeters);
+            collisionHeight = (hit & !found) ? terrainHeightMeters : collisionHeight;
+            found |= hit;
+            onPad |= inRange & (segments.landingPad[s] != 0);
+        }
+
+        // Touchdown settles the lander on the surface
+        if (found) {
+            posY = collisionHeight + params.landerHalfHeight;
+            const bool safe = fabs(velY) <= kSafeVerticalVelocity && fabs(velX) <= kSafeHorizontalVelocity;
+            state = (onPad && safe) ? kLanded : kCrashed;
+            touchdownVelX = velX;
+            touchdownVelY = velY;
+            velX = 0.0f;
+            velY = 0.0f;
+            spin = 0.0f;
+            endStep = params.firstStep + step + 1;
+        }
+    }
+
+    posXs[index] = posX;
+    posYs[index] = posY;
+    velXs[index] = velX;
+    velYs[index] = velY;
+    rotations[index] = rotation;
+    spins[index] = spin;
+    fuels[index] = fuel;
+    thrustLevels[index] = thrustLevel;
+    rcsCommands[index] = rcsCommand;
+    states[index] = state;
+    if (state != kFlying) {
+        touchdownVelXs[index] = touchdownVelX;
+        touchdownVelYs[index] = touchdownVelY;
+        endSteps[index] = endStep;
+    }
+}
@@ -1,21 +1,45 @@
 #include <metal_stdlib>
+#include <metal_raytracing>
 using namespace metal;
 
-// Vertex input structure - must match the C++ Vertex struct
+// Shader variant (ShaderVariant in Renderer3D_Metal.h): every pipeline is
+// compiled with one shading path, and only the landing pad variant reads
+// and interpolates the pad flag. kWritesMotion adds the motion vector
+// attachment the temporal upscaler reads; kReceivesShadows samples the
+// shadow maps. kPointLights loops over every point light; with deferred
+// lighting kWritesGBuffer writes the surface to tile memory instead.
+// kOcclusionCulling has terrain_cull_chunks test against the Hi-Z pyramid.
+// kRayTracedShadows traces the terrain's shadow instead of sampling its map;
+// kHorizonShadows looks it up in the baked horizon map.
+constant bool kIsLander [[function_constant(0)]];
+constant bool kHasLandingPad [[function_constant(1)]];
+constant bool kWritesMotion [[function_constant(2)]];
+constant bool kReceivesShadows [[function_constant(3)]];
+constant bool kPointLights [[function_constant(4)]];
+constant bool kWritesGBuffer [[function_constant(5)]];
+constant bool kOcclusionCulling [[function_constant(6)]];
+constant bool kRayTracedShadows [[function_constant(7)]];
+constant bool kHorizonShadows [[function_constant(8)]];
+
+// Vertex input structure - must match the C++ PackedVertex struct and the
+// vertex descriptor in Renderer3D_Metal::CreateRenderPipeline
 struct VertexIn {
-    float3 position [[attribute(0)]];
-    float3 normal [[attribute(1)]];
-    float isLandingPad [[attribute(2)]];
-    float entityType [[attribute(3)]];
+    float4 position [[attribute(0)]];   // snorm16 relative to the position range; w = terrain morph target y
+    float2 octNormal [[attribute(1)]];  // Octahedral-encoded normal, snorm16
+    uint flags [[attribute(2), function_constant(kHasLandingPad)]];   // kVertexFlag* bits
+    float occlusion [[attribute(3)]];   // Terrain's baked ambient occlusion, unorm8 (0 = open sky)
 };
 
+// PackedVertex::flags bits
+constant uint kVertexFlagLandingPad = 1u << 0;
+
 // Vertex output structure
 struct VertexOut {
     float4 position [[position]];
     float3 fragmentPosition;
     float3 normal;
-    float isLandingPad;
-    float entityType;
+    float occlusion;          // Share of the ambient light the terrain hides
+    float isLandingPad [[function_constant(kHasLandingPad)]];
 };
 
 // Uniform structures - must match the C++ structs
@@ -23,55 +47,897 @@ struct VertexUniforms {
     float4x4 modelMatrix;
     float4x4 viewMatrix;
     float4x4 projectionMatrix;
+    float4 positionOrigin;   // Decode: position = origin + snorm * extent
+    float4 positionExtent;
+    float4 lodMorph;         // Terrain morph: x = start distance, y = 1 / length (0 = off)
+    float4 cameraPosition;
 };
 
+// Unfold an octahedral-encoded unit vector
+float3 decodeOctahedral(float2 e) {
+    float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Must match the C++ FragmentUniforms struct
 struct FragmentUniforms {
     float3 lightPosition;
     float3 ambientLight;
     float3 cameraPosition;
+    float4x4 terrainShadowMatrix;   // World to shadow map texture coordinates and depth
+    float4x4 landerShadowMatrix;
+    float4 shadowParams;            // x, y = depth bias of each map; z, w = 1 if each map holds casters
+    float4 shadowTexelSize;         // x, y = one texel of each map
+    float4 sunDirection;            // Ray-traced shadows: xyz towards the light; w = ray length, 0 = unshadowed
+    float4 horizonMap;              // Horizon shadows: xy = world x, z of the map's corner; zw = map per meter, 0 = none
+};
+
+// Must match GpuPointLight and PointLightUniforms in Renderer3D_Metal.cpp
+struct PointLight {
+    float4 positionRadius;            // xyz meters; w = radius the light fades out at
+    float4 color;                     // Linear RGB, intensity included
+};
+
+struct PointLightUniforms {
+    uint count;
+    PointLight lights[64];            // Renderer3D_Metal::kMaxPointLights
+};
+
+// Motion vector matrices - must match the C++ MotionUniforms struct
+struct MotionUniforms {
+    float4x4 viewProjection;          // Unjittered
+    float4x4 previousViewProjection;  // Unjittered, last frame
+    float4x4 previousFromCurrent;     // World position now to last frame's (moving objects)
 };
 
+// Packed vertex against a position range and LOD morph (x = start
+// distance, y = 1 / length), shared by vertex_main and the terrain chunk
+// vertex functions
+static VertexOut packedVertex(const VertexIn vertices, constant VertexUniforms& uniforms,
+                              float3 positionOrigin, float3 positionExtent, float2 lodMorph) {
+    VertexOut out;
+    
+    // Decode the packed position and transform it
+    float3 position = positionOrigin + vertices.position.xyz * positionExtent;
+    float4 worldPosition = uniforms.modelMatrix * float4(position, 1.0);
+    
+    // Terrain LOD: blend towards the next level's surface near the end of
+    // this level's range so chunks meet the coarser level without popping
+    float morphY = positionOrigin.y + vertices.position.w * positionExtent.y;
+    float morph = saturate((distance(worldPosition.xyz, uniforms.cameraPosition.xyz) - lodMorph.x) * lodMorph.y);
+    position.y = mix(position.y, morphY, morph);
+    worldPosition = uniforms.modelMatrix * float4(position, 1.0);
+    out.fragmentPosition = worldPosition.xyz;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * worldPosition;
+    
+    // Calculate normal in world space
+    float3x3 normalMatrix = float3x3(uniforms.modelMatrix[0].xyz,
+                                     uniforms.modelMatrix[1].xyz,
+                                     uniforms.modelMatrix[2].xyz);
+    out.normal = normalize(normalMatrix * decodeOctahedral(vertices.octNormal));
+    out.occlusion = vertices.occlusion;
+    
+    // Expand the flags for the fragment shader
+    if (kHasLandingPad) {
+        out.isLandingPad = (vertices.flags & kVertexFlagLandingPad) ? 1.0 : 0.0;
+    }
+    
+    return out;
+}
+
 // Vertex shader function
 vertex VertexOut vertex_main(const VertexIn vertices [[stage_in]],
                              constant VertexUniforms& uniforms [[buffer(1)]]) {
+    return packedVertex(vertices, uniforms, uniforms.positionOrigin.xyz, uniforms.positionExtent.xyz,
+                        uniforms.lodMorph.xy);
+}
+
+// Instanced landers: the model matrix comes from the instance, the rest of
+// the uniforms are shared. Must match the C++ LanderInstance struct.
+struct LanderInstance {
+    float4x4 modelMatrix;
+};
+
+vertex VertexOut lander_instance_vertex(const VertexIn vertices [[stage_in]],
+                                        uint instanceId [[instance_id]],
+                                        constant VertexUniforms& uniforms [[buffer(1)]],
+                                        const device LanderInstance* instances [[buffer(2)]]) {
     VertexOut out;
     
-    // Calculate position
-    float4 worldPosition = uniforms.modelMatrix * float4(vertices.position, 1.0);
+    float4x4 modelMatrix = instances[instanceId].modelMatrix;
+    float3 position = uniforms.positionOrigin.xyz + vertices.position.xyz * uniforms.positionExtent.xyz;
+    float4 worldPosition = modelMatrix * float4(position, 1.0);
+    out.fragmentPosition = worldPosition.xyz;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * worldPosition;
+    
+    float3x3 normalMatrix = float3x3(modelMatrix[0].xyz, modelMatrix[1].xyz, modelMatrix[2].xyz);
+    out.normal = normalize(normalMatrix * decodeOctahedral(vertices.octNormal));
+    out.occlusion = 0.0;
+    
+    return out;
+}
+
+// GPU terrain culling: terrain_cull_chunks runs one thread per quadtree
+// chunk, repeats Renderer3D_Metal::SelectTerrainChunks' decision for it and
+// encodes its draws into the indirect command buffer. Buffers are bound per
+// command, so terrain_chunk_vertex reads its chunk's position range and
+// morph from the same tables. Must match the C++ structs in
+// Renderer3D_Metal.cpp.
+#define TERRAIN_MAX_LEVELS 16
+
+struct TerrainCullChunk {
+    float4 boundsMin;
+    float4 boundsMax;
+    float4 positionOrigin;   // Packed position range, as in VertexUniforms
+    float4 positionExtent;
+    int level;
+    int parent;              // -1 for the root
+    int children[4];         // -1 if absent
+    uint firstVertex;
+    uint command;            // First of the chunk's two commands in a frame's range
+};
+
+struct TerrainCullUniforms {
+    float4 planes[6];        // ax + by + cz + d >= 0 inside
+    float4 cameraPosition;
+    float lodRanges[TERRAIN_MAX_LEVELS];
+    float morphStart[TERRAIN_MAX_LEVELS];
+    float morphScale[TERRAIN_MAX_LEVELS];   // 1 / morph length (0 = no morph)
+    uint chunkCount;
+    uint commandBase;        // This frame's range in the command buffer
+    uint quadrantIndexCount;
+    uint padding;
+    float4x4 occlusionViewProjection;   // The frame the Hi-Z pyramid holds
+    float2 occlusionSize;    // Its depth in pixels
+    uint occlusionLevels;    // 0 = no pyramid yet
+    uint occlusionPadding;
+};
+
+struct TerrainCommands {
+    command_buffer commands;
+};
+
+vertex VertexOut terrain_chunk_vertex(const VertexIn vertices [[stage_in]],
+                                      constant VertexUniforms& uniforms [[buffer(1)]],
+                                      const device TerrainCullChunk& chunk [[buffer(2)]],
+                                      constant TerrainCullUniforms& cull [[buffer(3)]]) {
+    return packedVertex(vertices, uniforms, chunk.positionOrigin.xyz, chunk.positionExtent.xyz,
+                        float2(cull.morphStart[chunk.level], cull.morphScale[chunk.level]));
+}
+
+// CPU-selected chunks read the same tables through one argument buffer
+// bound for the whole terrain, so a draw binds nothing and names its chunk
+// by base instance (instance_id includes it). Must match
+// Renderer3D_Metal::BindTerrainTable.
+struct TerrainChunkTable {
+    const device TerrainCullChunk* chunks [[id(0)]];
+    constant TerrainCullUniforms* levels [[id(1)]];
+};
+
+vertex VertexOut terrain_table_vertex(const VertexIn vertices [[stage_in]],
+                                      uint chunkIndex [[instance_id]],
+                                      constant VertexUniforms& uniforms [[buffer(1)]],
+                                      constant TerrainChunkTable& table [[buffer(2)]]) {
+    TerrainCullChunk chunk = table.chunks[chunkIndex];
+    return packedVertex(vertices, uniforms, chunk.positionOrigin.xyz, chunk.positionExtent.xyz,
+                        float2(table.levels->morphStart[chunk.level], table.levels->morphScale[chunk.level]));
+}
+
+// Same tests as BoxIntersectsFrustum and BoxIntersectsSphere
+static bool chunkInFrustum(constant TerrainCullUniforms& cull, TerrainCullChunk chunk) {
+    for (int i = 0; i < 6; i++) {
+        float4 plane = cull.planes[i];
+        float3 corner = select(chunk.boundsMin.xyz, chunk.boundsMax.xyz, plane.xyz >= 0.0);
+        if (dot(plane.xyz, corner) + plane.w < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool chunkInRange(constant TerrainCullUniforms& cull, TerrainCullChunk chunk, float radius) {
+    float3 offset = cull.cameraPosition.xyz - clamp(cull.cameraPosition.xyz, chunk.boundsMin.xyz, chunk.boundsMax.xyz);
+    return dot(offset, offset) <= radius * radius;
+}
+
+// Hi-Z occlusion: the box's nearest depth against the farthest depth the
+// pyramid holds over its screen rectangle, read from the level at which the
+// rectangle spans at most two texels a side. The pyramid is last frame's,
+// so the box is projected with last frame's camera.
+static bool chunkOccluded(constant TerrainCullUniforms& cull, texture2d<float, access::read> hiz,
+                          float3 boundsMin, float3 boundsMax) {
+    if (cull.occlusionLevels == 0) return false;
+    float2 ndcMin = float2(INFINITY);
+    float2 ndcMax = float2(-INFINITY);
+    float nearest = 1.0;
+    for (uint i = 0; i < 8; i++) {
+        float3 corner = select(boundsMin, boundsMax, bool3(i & 1, i & 2, i & 4));
+        float4 clip = cull.occlusionViewProjection * float4(corner, 1.0);
+        if (clip.w <= 1e-4) return false;   // Reaches behind that camera
+        float3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+    
+    // Depth pixels have y down; level 0 texels cover 2x2 of them
+    float2 pixelMin = saturate(float2(ndcMin.x, -ndcMax.y) * 0.5 + 0.5) * cull.occlusionSize;
+    float2 pixelMax = saturate(float2(ndcMax.x, -ndcMin.y) * 0.5 + 0.5) * cull.occlusionSize;
+    float2 extent = (pixelMax - pixelMin) * 0.5;
+    uint level = uint(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    if (level >= cull.occlusionLevels) return false;
+    uint2 lastTexel = uint2(hiz.get_width(level), hiz.get_height(level)) - 1;
+    uint2 texelMin = min(uint2(pixelMin) >> (level + 1), lastTexel);
+    uint2 texelMax = min(uint2(pixelMax) >> (level + 1), lastTexel);
+    float farthest = max(max(hiz.read(texelMin, level).r, hiz.read(uint2(texelMax.x, texelMin.y), level).r),
+                         max(hiz.read(uint2(texelMin.x, texelMax.y), level).r, hiz.read(texelMax, level).r));
+    return nearest > farthest;
+}
+
+kernel void terrain_cull_chunks(constant TerrainCullUniforms& cull [[buffer(0)]],
+                                const device TerrainCullChunk* chunks [[buffer(1)]],
+                                const device uchar* vertices [[buffer(2)]],
+                                const device ushort* indices [[buffer(3)]],
+                                constant VertexUniforms& uniforms [[buffer(4)]],
+                                constant FragmentUniforms& lighting [[buffer(5)]],
+                                device TerrainCommands& icb [[buffer(6)]],
+                                constant MotionUniforms& motion [[buffer(7)]],
+                                texture2d<float, access::read> hiz [[texture(0), function_constant(kOcclusionCulling)]],
+                                uint index [[thread_position_in_grid]]) {
+    if (index >= cull.chunkCount) return;
+    TerrainCullChunk chunk = chunks[index];
+    
+    // The recursion reaches a chunk if every ancestor is visible, is within
+    // its finer level's range and has this branch within it too
+    bool reached = chunkInFrustum(cull, chunk);
+    TerrainCullChunk branch = chunk;
+    while (reached && branch.parent >= 0) {
+        TerrainCullChunk parent = chunks[branch.parent];
+        float range = cull.lodRanges[parent.level - 1];
+        reached = chunkInFrustum(cull, parent) && chunkInRange(cull, parent, range) && chunkInRange(cull, branch, range);
+        branch = parent;
+    }
+    
+    // Drawn whole beyond the next finer level's range, otherwise only the
+    // visible quadrants that are not refined further. Occlusion only drops
+    // what would be drawn: a hidden ancestor may still have visible parts.
+    int quadrantMask = 0;
+    if (reached) {
+        if (chunk.level == 0 || !chunkInRange(cull, chunk, cull.lodRanges[chunk.level - 1])) {
+            bool occluded = kOcclusionCulling && chunkOccluded(cull, hiz, chunk.boundsMin.xyz, chunk.boundsMax.xyz);
+            quadrantMask = occluded ? 0 : 0xF;
+        } else {
+            for (int quadrant = 0; quadrant < 4; quadrant++) {
+                if (chunk.children[quadrant] < 0) continue;
+                TerrainCullChunk child = chunks[chunk.children[quadrant]];
+                if (!chunkInRange(cull, child, cull.lodRanges[chunk.level - 1]) && chunkInFrustum(cull, child) &&
+                    !(kOcclusionCulling && chunkOccluded(cull, hiz, child.boundsMin.xyz, child.boundsMax.xyz))) {
+                    quadrantMask |= 1 << quadrant;
+                }
+            }
+        }
+    }
+    
+    // One command per run of consecutive quadrants, at most two per chunk;
+    // unused commands are reset so they draw nothing
+    int first = 0;
+    for (uint run = 0; run < 2; run++) {
+        render_command draw(icb.commands, cull.commandBase + chunk.command + run);
+        while (first < 4 && !(quadrantMask & (1 << first))) first++;
+        if (first == 4) {
+            draw.reset();
+            continue;
+        }
+        int runEnd = first + 1;
+        while (runEnd < 4 && (quadrantMask & (1 << runEnd))) runEnd++;
+        
+        draw.set_vertex_buffer(vertices, 0);
+        draw.set_vertex_buffer(&uniforms, 1);
+        draw.set_vertex_buffer(chunks + index, 2);
+        draw.set_vertex_buffer(&cull, 3);
+        draw.set_fragment_buffer(&lighting, 0);
+        draw.set_fragment_buffer(&motion, 1);
+        draw.draw_indexed_primitives(primitive_type::triangle_strip,
+                                     uint(runEnd - first) * cull.quadrantIndexCount,
+                                     indices + first * cull.quadrantIndexCount,
+                                     1, chunk.firstVertex, 0);
+        first = runEnd;
+    }
+}
+
+// Hi-Z pyramid: each texel holds the farthest depth of the 2x2 texels under
+// it, and of the next column or row too where it is the last of an odd
+// level below, so a rectangle's texels always cover all of it. Level 0
+// reduces the scene depth itself.
+static void reductionFootprint(uint2 position, uint2 size, uint2 sourceSize, thread uint2& first, thread uint2& last) {
+    first = min(position * 2, sourceSize - 1);
+    bool2 isLast = position == size - 1;
+    bool2 extend = bool2(isLast.x && (sourceSize.x & 1), isLast.y && (sourceSize.y & 1));
+    last = min(select(position * 2 + 1, position * 2 + 2, extend), sourceSize - 1);
+}
+
+kernel void hiz_reduce_depth(depth2d<float, access::read> depth [[texture(0)]],
+                             texture2d<float, access::write> level [[texture(1)]],
+                             uint2 position [[thread_position_in_grid]]) {
+    uint2 size = uint2(level.get_width(), level.get_height());
+    if (any(position >= size)) return;
+    uint2 first, last;
+    reductionFootprint(position, size, uint2(depth.get_width(), depth.get_height()), first, last);
+    float farthest = 0.0;
+    for (uint y = first.y; y <= last.y; y++) {
+        for (uint x = first.x; x <= last.x; x++) {
+            farthest = max(farthest, depth.read(uint2(x, y)));
+        }
+    }
+    level.write(float4(farthest), position);
+}
+
+kernel void hiz_reduce(texture2d<float, access::read> source [[texture(0)]],
+                       texture2d<float, access::write> level [[texture(1)]],
+                       uint2 position [[thread_position_in_grid]]) {
+    uint2 size = uint2(level.get_width(), level.get_height());
+    if (any(position >= size)) return;
+    uint2 first, last;
+    reductionFootprint(position, size, uint2(source.get_width(), source.get_height()), first, last);
+    float farthest = 0.0;
+    for (uint y = first.y; y <= last.y; y++) {
+        for (uint x = first.x; x <= last.x; x++) {
+            farthest = max(farthest, source.read(uint2(x, y)).r);
+        }
+    }
+    level.write(float4(farthest), position);
+}
+
+// Height texture terrain: every chunk draws the same patch of
+// (chunkCells + 1)^2 samples, instanced, and reads its samples from the
+// terrain textures. Must match the C++ structs in Renderer3D_Metal.cpp.
+struct TerrainMapUniforms {
+    float originX;
+    float originZ;
+    float cellWidth;
+    float cellLength;
+    int gridSize;
+    int chunkCells;
+    int padding[2];
+};
+
+struct TerrainInstance {
+    int cellX;
+    int cellZ;
+    int level;
+    float morphStart;
+    float morphScale;   // 1 / morph length (0 = no morph)
+    float padding[3];
+};
+
+// Heights are HeightGrid samples, R16Unorm scaled to the range of their
+// tile: ranges holds (min, max - min) in meters per HEIGHT_GRID_TILE_SIZE^2
+// samples. Must match HeightGrid::kTileSize.
+#define HEIGHT_GRID_TILE_SIZE 32
+
+static float terrainHeight(texture2d<float, access::read> heights, texture2d<float, access::read> ranges,
+                           uint2 texel) {
+    float2 range = ranges.read(texel / HEIGHT_GRID_TILE_SIZE).rg;
+    return range.x + heights.read(texel).r * range.y;
+}
+
+// Grid coordinates of patch sample (i, j), clamped to the patch and the grid
+static uint2 terrainSample(constant TerrainMapUniforms& map, TerrainInstance chunk, int i, int j) {
+    int levelStep = 1 << chunk.level;
+    i = clamp(i, 0, map.chunkCells);
+    j = clamp(j, 0, map.chunkCells);
+    return uint2(min(chunk.cellX + i * levelStep, map.gridSize), min(chunk.cellZ + j * levelStep, map.gridSize));
+}
+
+// Sample (i, j) of an instance's patch: position morphed towards the next
+// level with distance from the camera, and normal. The caller adds the
+// flags and ambient occlusion from texel.
+static VertexOut terrainMapSample(constant VertexUniforms& uniforms, constant TerrainMapUniforms& map,
+                                  TerrainInstance chunk, int i, int j,
+                                  texture2d<float, access::read> heights,
+                                  texture2d<float, access::read> normals,
+                                  texture2d<float, access::read> ranges,
+                                  thread uint2& texel) {
+    VertexOut out;
+    
+    texel = terrainSample(map, chunk, i, j);
+    float3 position = float3(map.originX + float(texel.x) * map.cellWidth,
+                             terrainHeight(heights, ranges, texel),
+                             map.originZ + float(texel.y) * map.cellLength);
+    
+    // Same morph targets as Renderer3D_Metal::BuildTerrainVertices: odd
+    // samples move onto the next level's edge or quad diagonal
+    float morphY = position.y;
+    if ((i & 1) && !(j & 1)) {
+        morphY = 0.5 * (terrainHeight(heights, ranges, terrainSample(map, chunk, i - 1, j)) +
+                        terrainHeight(heights, ranges, terrainSample(map, chunk, i + 1, j)));
+    } else if (!(i & 1) && (j & 1)) {
+        morphY = 0.5 * (terrainHeight(heights, ranges, terrainSample(map, chunk, i, j - 1)) +
+                        terrainHeight(heights, ranges, terrainSample(map, chunk, i, j + 1)));
+    } else if ((i & 1) && (j & 1)) {
+        morphY = 0.5 * (terrainHeight(heights, ranges, terrainSample(map, chunk, i + 1, j - 1)) +
+                        terrainHeight(heights, ranges, terrainSample(map, chunk, i - 1, j + 1)));
+    }
+    
+    float4 worldPosition = uniforms.modelMatrix * float4(position, 1.0);
+    float morph = saturate((distance(worldPosition.xyz, uniforms.cameraPosition.xyz) - chunk.morphStart) *
+                           chunk.morphScale);
+    position.y = mix(position.y, morphY, morph);
+    worldPosition = uniforms.modelMatrix * float4(position, 1.0);
+    out.fragmentPosition = worldPosition.xyz;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * worldPosition;
+    
+    float3x3 normalMatrix = float3x3(uniforms.modelMatrix[0].xyz,
+                                     uniforms.modelMatrix[1].xyz,
+                                     uniforms.modelMatrix[2].xyz);
+    out.normal = normalize(normalMatrix * decodeOctahedral(normals.read(texel).xy));
+    return out;
+}
+
+vertex VertexOut terrain_map_vertex(uint vertexId [[vertex_id]],
+                                    uint instanceId [[instance_id]],
+                                    constant VertexUniforms& uniforms [[buffer(1)]],
+                                    constant TerrainMapUniforms& map [[buffer(2)]],
+                                    const device TerrainInstance* instances [[buffer(3)]],
+                                    texture2d<float, access::read> heights [[texture(0)]],
+                                    texture2d<float, access::read> normals [[texture(1)]],
+                                    texture2d<uint, access::read> flags [[texture(2)]],
+                                    texture2d<float, access::read> ranges [[texture(3)]]) {
+    int patchStride = map.chunkCells + 1;
+    uint2 texel;
+    VertexOut out = terrainMapSample(uniforms, map, instances[instanceId], int(vertexId) % patchStride,
+                                     int(vertexId) / patchStride, heights, normals, ranges, texel);
+    
+    uint2 bits = flags.read(texel).rg;
+    out.occlusion = float(bits.y) / 255.0;
+    if (kHasLandingPad) {
+        out.isLandingPad = (bits.x & kVertexFlagLandingPad) ? 1.0 : 0.0;
+    }
+    
+    return out;
+}
+
+// Mesh shader terrain: the same patches, split into meshlets of
+// TERRAIN_MESHLET_CELLS^2 cells. terrain_meshlet_object runs a thread per
+// meshlet of a selected chunk and passes on the ones left after the
+// selection's quadrants, the frustum and the normal cone;
+// terrain_meshlet_mesh emits each of those from the height textures. Must
+// match the C++ structs and constants in Renderer3D_Metal.
+#define TERRAIN_MESHLET_CELLS 4
+#define TERRAIN_MESHLETS_PER_SIDE 4
+#define TERRAIN_MESHLETS_PER_CHUNK (TERRAIN_MESHLETS_PER_SIDE * TERRAIN_MESHLETS_PER_SIDE)
+#define TERRAIN_MESHLET_VERTICES ((TERRAIN_MESHLET_CELLS + 1) * (TERRAIN_MESHLET_CELLS + 1))
+#define TERRAIN_MESHLET_TRIANGLES (2 * TERRAIN_MESHLET_CELLS * TERRAIN_MESHLET_CELLS)
+
+struct TerrainMeshlet {
+    float4 boundsMin;       // w = cone cutoff
+    float4 boundsMax;
+    float4 coneAxis;        // w = 0 if every triangle is degenerate
+};
+
+struct TerrainMeshCull {
+    float4 planes[6];       // ax + by + cz + d >= 0 inside
+    float4 cameraPosition;
+};
+
+struct TerrainMeshChunk {
+    int cellX;
+    int cellZ;
+    int level;
+    float morphStart;
+    float morphScale;       // 1 / morph length (0 = no morph)
+    uint firstMeshlet;
+    uint quadrantMask;      // Quadrants (x, z) = 00, 10, 01, 11 the selection draws
+    uint padding;
+};
+
+struct TerrainMeshletPayload {
+    uint chunk;
+    ushort meshlets[TERRAIN_MESHLETS_PER_CHUNK];
+};
+
+static bool meshletVisible(constant TerrainMeshCull& cull, TerrainMeshChunk chunk, TerrainMeshlet meshlet,
+                           uint index) {
+    uint quadrant = uint((index % TERRAIN_MESHLETS_PER_SIDE) >= TERRAIN_MESHLETS_PER_SIDE / 2) |
+                    (uint((index / TERRAIN_MESHLETS_PER_SIDE) >= TERRAIN_MESHLETS_PER_SIDE / 2) << 1);
+    if (meshlet.coneAxis.w == 0.0 || !(chunk.quadrantMask & (1u << quadrant))) {
+        return false;
+    }
+    
+    // Same test as chunkInFrustum
+    for (int i = 0; i < 6; i++) {
+        float4 plane = cull.planes[i];
+        float3 corner = select(meshlet.boundsMin.xyz, meshlet.boundsMax.xyz, plane.xyz >= 0.0);
+        if (dot(plane.xyz, corner) + plane.w < 0.0) {
+            return false;
+        }
+    }
+    
+    // Back-facing from everywhere in the bounding sphere. The cone is of
+    // the unmorphed triangles, so it only holds before any vertex morphs.
+    float3 center = 0.5 * (meshlet.boundsMin.xyz + meshlet.boundsMax.xyz);
+    float radius = 0.5 * length(meshlet.boundsMax.xyz - meshlet.boundsMin.xyz);
+    float3 view = center - cull.cameraPosition.xyz;
+    float viewDistance = length(view);
+    bool morphs = chunk.morphScale > 0.0 && viewDistance + radius > chunk.morphStart;
+    return morphs || dot(view, meshlet.coneAxis.xyz) < meshlet.boundsMin.w * viewDistance + radius;
+}
+
+[[object]]
+void terrain_meshlet_object(object_data TerrainMeshletPayload& payload [[payload]],
+                            mesh_grid_properties grid,
+                            constant TerrainMeshCull& cull [[buffer(0)]],
+                            const device TerrainMeshChunk* chunks [[buffer(1)]],
+                            const device TerrainMeshlet* meshlets [[buffer(2)]],
+                            uint chunkIndex [[threadgroup_position_in_grid]],
+                            uint lane [[thread_index_in_threadgroup]]) {
+    TerrainMeshChunk chunk = chunks[chunkIndex];
+    bool visible = meshletVisible(cull, chunk, meshlets[chunk.firstMeshlet + lane], lane);
+    
+    // The threadgroup is one SIMD group, so the survivors compact in place
+    uint slot = simd_prefix_exclusive_sum(uint(visible));
+    if (visible) {
+        payload.meshlets[slot] = ushort(lane);
+    }
+    uint visibleCount = simd_sum(uint(visible));
+    if (lane == 0) {
+        payload.chunk = chunkIndex;
+        grid.set_threadgroups_per_grid(uint3(visibleCount, 1, 1));
+    }
+}
+
+using TerrainMeshletOutput = metal::mesh<VertexOut, void, TERRAIN_MESHLET_VERTICES, TERRAIN_MESHLET_TRIANGLES,
+                                         topology::triangle>;
+
+// A thread per triangle, the first TERRAIN_MESHLET_VERTICES of them also
+// emitting a vertex. Quads split on the (x+1, z) - (x, z+1) diagonal, as
+// the instanced strips do.
+[[mesh]]
+void terrain_meshlet_mesh(TerrainMeshletOutput output,
+                          const object_data TerrainMeshletPayload& payload [[payload]],
+                          constant VertexUniforms& uniforms [[buffer(1)]],
+                          constant TerrainMapUniforms& map [[buffer(2)]],
+                          const device TerrainMeshChunk* chunks [[buffer(3)]],
+                          texture2d<float, access::read> heights [[texture(0)]],
+                          texture2d<float, access::read> normals [[texture(1)]],
+                          texture2d<uint, access::read> flags [[texture(2)]],
+                          texture2d<float, access::read> ranges [[texture(3)]],
+                          uint meshletSlot [[threadgroup_position_in_grid]],
+                          uint lane [[thread_index_in_threadgroup]]) {
+    TerrainMeshChunk meshChunk = chunks[payload.chunk];
+    uint meshlet = payload.meshlets[meshletSlot];
+    int firstI = int(meshlet % TERRAIN_MESHLETS_PER_SIDE) * TERRAIN_MESHLET_CELLS;
+    int firstJ = int(meshlet / TERRAIN_MESHLETS_PER_SIDE) * TERRAIN_MESHLET_CELLS;
+    const int stride = TERRAIN_MESHLET_CELLS + 1;
+    
+    if (lane < TERRAIN_MESHLET_VERTICES) {
+        TerrainInstance chunk;
+        chunk.cellX = meshChunk.cellX;
+        chunk.cellZ = meshChunk.cellZ;
+        chunk.level = meshChunk.level;
+        chunk.morphStart = meshChunk.morphStart;
+        chunk.morphScale = meshChunk.morphScale;
+        
+        uint2 texel;
+        VertexOut out = terrainMapSample(uniforms, map, chunk, firstI + int(lane) % stride,
+                                         firstJ + int(lane) / stride, heights, normals, ranges, texel);
+        uint2 bits = flags.read(texel).rg;
+        out.occlusion = float(bits.y) / 255.0;
+        if (kHasLandingPad) {
+            out.isLandingPad = (bits.x & kVertexFlagLandingPad) ? 1.0 : 0.0;
+        }
+        output.set_vertex(lane, out);
+    }
+    
+    if (lane < TERRAIN_MESHLET_TRIANGLES) {
+        uint cell = lane / 2;
+        uint v00 = (cell / TERRAIN_MESHLET_CELLS) * stride + cell % TERRAIN_MESHLET_CELLS;
+        uint v10 = v00 + 1;
+        uint v01 = v00 + stride;
+        uint v11 = v01 + 1;
+        uint3 triangle = (lane & 1) ? uint3(v10, v01, v11) : uint3(v00, v01, v10);
+        output.set_index(lane * 3 + 0, triangle.x);
+        output.set_index(lane * 3 + 1, triangle.y);
+        output.set_index(lane * 3 + 2, triangle.z);
+    }
+    
+    if (lane == 0) {
+        output.set_primitive_count(TERRAIN_MESHLET_TRIANGLES);
+    }
+}
+
+// Near-field tessellation: the cells of up to 16 full-resolution chunks
+// around the lander, two triangle patches per cell. Must match the C++
+// struct in Renderer3D_Metal.cpp.
+#define TERRAIN_MAX_NEAR_FIELD_CHUNKS 16
+
+struct TerrainTessUniforms {
+    float originX;
+    float originZ;
+    float cellWidth;
+    float cellLength;
+    float focusX;
+    float focusZ;
+    float radius;
+    float maxFactor;
+    int gridSize;
+    int chunkCells;
+    int chunkCount;
+    int padding;
+    int chunkX[TERRAIN_MAX_NEAR_FIELD_CHUNKS];
+    int chunkZ[TERRAIN_MAX_NEAR_FIELD_CHUNKS];
+};
+
+// Same layout as MTLTriangleTessellationFactorsHalf
+struct TriangleTessFactors {
+    half edgeTessellationFactor[3];
+    half insideTessellationFactor;
+};
+
+// Grid coordinates of a patch's corners; false past the grid edge
+static bool nearFieldPatch(constant TerrainTessUniforms& tess, uint patchId, thread float2* corners) {
+    uint cellsPerChunk = uint(tess.chunkCells * tess.chunkCells);
+    uint chunkIndex = patchId / (2 * cellsPerChunk);
+    uint cell = (patchId / 2) % cellsPerChunk;
+    int x0 = tess.chunkX[chunkIndex] + int(cell) % tess.chunkCells;
+    int z0 = tess.chunkZ[chunkIndex] + int(cell) / tess.chunkCells;
+    float2 c00 = float2(x0, z0);
+    float2 c11 = c00 + 1.0;
+    if (patchId & 1) {
+        corners[0] = c11;
+        corners[1] = float2(c00.x, c11.y);
+        corners[2] = float2(c11.x, c00.y);
+    } else {
+        corners[0] = c00;
+        corners[1] = float2(c11.x, c00.y);
+        corners[2] = float2(c00.x, c11.y);
+    }
+    return x0 < tess.gridSize && z0 < tess.gridSize;
+}
+
+static bool inNearField(constant TerrainTessUniforms& tess, int cellX, int cellZ) {
+    for (int i = 0; i < tess.chunkCount; i++) {
+        if (tess.chunkX[i] == cellX && tess.chunkZ[i] == cellZ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Factor of the edge a-b. It depends on the edge alone, so both patches
+// sharing it agree; edges between a near-field chunk and one drawn from
+// the grid stay whole.
+static float nearFieldEdgeFactor(constant TerrainTessUniforms& tess, float2 a, float2 b) {
+    int cells = tess.chunkCells;
+    float2 mid = 0.5 * (a + b);
+    if (a.x == b.x && int(a.x) % cells == 0) {
+        int chunkZ = int(floor(mid.y / float(cells))) * cells;
+        if (!inNearField(tess, int(a.x) - cells, chunkZ) || !inNearField(tess, int(a.x), chunkZ)) {
+            return 1.0;
+        }
+    }
+    if (a.y == b.y && int(a.y) % cells == 0) {
+        int chunkX = int(floor(mid.x / float(cells))) * cells;
+        if (!inNearField(tess, chunkX, int(a.y) - cells) || !inNearField(tess, chunkX, int(a.y))) {
+            return 1.0;
+        }
+    }
+    
+    float2 world = float2(tess.originX + mid.x * tess.cellWidth, tess.originZ + mid.y * tess.cellLength);
+    float d = distance(world, float2(tess.focusX, tess.focusZ));
+    return mix(tess.maxFactor, 1.0, saturate(d / tess.radius));
+}
+
+// One thread per patch
+kernel void terrain_tess_factors(constant TerrainTessUniforms& tess [[buffer(0)]],
+                                 device TriangleTessFactors* factors [[buffer(1)]],
+                                 uint patchId [[thread_position_in_grid]]) {
+    uint patchCount = uint(tess.chunkCount * tess.chunkCells * tess.chunkCells * 2);
+    if (patchId >= patchCount) {
+        return;
+    }
+    
+    // A zero factor culls patches past the grid edge
+    float2 corners[3];
+    if (!nearFieldPatch(tess, patchId, corners)) {
+        factors[patchId].edgeTessellationFactor[0] = 0.0h;
+        factors[patchId].edgeTessellationFactor[1] = 0.0h;
+        factors[patchId].edgeTessellationFactor[2] = 0.0h;
+        factors[patchId].insideTessellationFactor = 0.0h;
+        return;
+    }
+    
+    // Edge i is the one opposite corner i
+    float inside = 1.0;
+    for (int i = 0; i < 3; i++) {
+        float factor = nearFieldEdgeFactor(tess, corners[(i + 1) % 3], corners[(i + 2) % 3]);
+        factors[patchId].edgeTessellationFactor[i] = half(factor);
+        inside = max(inside, factor);
+    }
+    factors[patchId].insideTessellationFactor = half(inside);
+}
+
+// Catmull-Rom weights and their derivatives at t in [0, 1]
+static float4 catmullRomWeights(float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5 * float4(-t3 + 2.0 * t2 - t, 3.0 * t3 - 5.0 * t2 + 2.0, -3.0 * t3 + 4.0 * t2 + t, t3 - t2);
+}
+
+static float4 catmullRomSlopes(float t) {
+    float t2 = t * t;
+    return 0.5 * float4(-3.0 * t2 + 4.0 * t - 1.0, 9.0 * t2 - 10.0 * t, -9.0 * t2 + 8.0 * t + 1.0, 3.0 * t2 - 2.0 * t);
+}
+
+// Bicubic height and its grid-space gradient at grid position p. It passes
+// through the samples, so patch corners land exactly on the grid.
+static float3 bicubicHeight(texture2d<float, access::read> heights, texture2d<float, access::read> ranges,
+                            int gridSize, float2 p) {
+    int2 base = clamp(int2(floor(p)), int2(0), int2(gridSize - 1));
+    float2 t = p - float2(base);
+    float4 wx = catmullRomWeights(t.x);
+    float4 wz = catmullRomWeights(t.y);
+    float4 sx = catmullRomSlopes(t.x);
+    float4 sz = catmullRomSlopes(t.y);
+    
+    float4 rowHeights;
+    float4 rowSlopes;
+    for (int j = 0; j < 4; j++) {
+        float4 row;
+        for (int i = 0; i < 4; i++) {
+            uint2 texel = uint2(clamp(base + int2(i - 1, j - 1), int2(0), int2(gridSize)));
+            row[i] = terrainHeight(heights, ranges, texel);
+        }
+        rowHeights[j] = dot(wx, row);
+        rowSlopes[j] = dot(sx, row);
+    }
+    return float3(dot(wz, rowHeights), dot(wz, rowSlopes), dot(sz, rowHeights));
+}
+
+[[patch(triangle, 3)]]
+vertex VertexOut terrain_tess_vertex(uint patchId [[patch_id]],
+                                     float3 barycentric [[position_in_patch]],
+                                     constant VertexUniforms& uniforms [[buffer(1)]],
+                                     constant TerrainTessUniforms& tess [[buffer(2)]],
+                                     texture2d<float, access::read> heights [[texture(0)]],
+                                     texture2d<uint, access::read> flags [[texture(2)]],
+                                     texture2d<float, access::read> ranges [[texture(3)]]) {
+    VertexOut out;
+    
+    float2 corners[3];
+    nearFieldPatch(tess, patchId, corners);
+    float2 p = barycentric.x * corners[0] + barycentric.y * corners[1] + barycentric.z * corners[2];
+    
+    // Height and slopes per meter
+    float3 surface = bicubicHeight(heights, ranges, tess.gridSize, p);
+    float3 position = float3(tess.originX + p.x * tess.cellWidth, surface.x, tess.originZ + p.y * tess.cellLength);
+    float3 normal = normalize(float3(-surface.y / tess.cellWidth, 1.0, -surface.z / tess.cellLength));
+    
+    float4 worldPosition = uniforms.modelMatrix * float4(position, 1.0);
     out.fragmentPosition = worldPosition.xyz;
     out.position = uniforms.projectionMatrix * uniforms.viewMatrix * worldPosition;
     
-    // Calculate normal in world space
     float3x3 normalMatrix = float3x3(uniforms.modelMatrix[0].xyz,
                                      uniforms.modelMatrix[1].xyz,
                                      uniforms.modelMatrix[2].xyz);
-    out.normal = normalize(normalMatrix * vertices.normal);
+    out.normal = normalize(normalMatrix * normal);
     
-    // Pass through other attributes
-    out.isLandingPad = vertices.isLandingPad;
-    out.entityType = vertices.entityType;
+    // Occlusion blended between the cell's samples, so it doesn't step
+    // across the finer triangles
+    int2 cell = clamp(int2(floor(p)), int2(0), int2(tess.gridSize - 1));
+    float2 blend = saturate(p - float2(cell));
+    float4 occlusion = float4(flags.read(uint2(cell)).g, flags.read(uint2(cell + int2(1, 0))).g,
+                              flags.read(uint2(cell + int2(0, 1))).g, flags.read(uint2(cell + int2(1, 1))).g);
+    float2 rows = mix(occlusion.xz, occlusion.yw, blend.x);
+    out.occlusion = mix(rows.x, rows.y, blend.y) / 255.0;
+    
+    if (kHasLandingPad) {
+        uint2 nearest = uint2(clamp(int2(round(p)), int2(0), int2(tess.gridSize)));
+        out.isLandingPad = (flags.read(nearest).r & kVertexFlagLandingPad) ? 1.0 : 0.0;
+    }
     
     return out;
 }
 
+// Scene pass outputs: shaded color, and with kWritesMotion the offset in
+// texture coordinates from this pixel to where its surface was last frame.
+// With kWritesGBuffer, what deferred_lighting needs of the surface, in
+// memoryless attachments (position.w = 1 marks a drawn pixel).
+struct SceneFragmentOut {
+    float4 color [[color(0)]];
+    float2 motion [[color(1), function_constant(kWritesMotion)]];
+    float4 albedo [[color(2), function_constant(kWritesGBuffer)]];
+    float4 normal [[color(3), function_constant(kWritesGBuffer)]];
+    float4 position [[color(4), function_constant(kWritesGBuffer)]];
+};
+
+// Diffuse light from one point light, fading to nothing at its radius
+static float3 pointLighting(PointLight light, float3 position, float3 normal, float3 albedo) {
+    float3 toLight = light.positionRadius.xyz - position;
+    float distance = length(toLight);
+    float falloff = saturate(1.0 - distance / light.positionRadius.w);
+    float lambert = max(dot(normal, toLight / max(distance, 1.0e-4)), 0.0);
+    return light.color.rgb * albedo * (falloff * falloff * lambert);
+}
+
+// Fraction of light reaching a world position past one shadow map: four
+// hardware-filtered comparisons half a texel apart. Outside the map is lit.
+static float shadowVisibility(depth2d<float> map, float4x4 shadowMatrix, float3 position,
+                              float bias, float texelSize) {
+    constexpr sampler shadowSampler(filter::linear, address::clamp_to_edge, compare_func::less_equal);
+    float4 projected = shadowMatrix * float4(position, 1.0);
+    float2 uv = projected.xy;
+    if (any(uv < 0.0) || any(uv > 1.0) || projected.z > 1.0) {
+        return 1.0;
+    }
+    float reference = projected.z - bias;
+    float offset = 0.5 * texelSize;
+    float lit = map.sample_compare(shadowSampler, uv + float2(-offset, -offset), reference) +
+                map.sample_compare(shadowSampler, uv + float2(offset, -offset), reference) +
+                map.sample_compare(shadowSampler, uv + float2(-offset, offset), reference) +
+                map.sample_compare(shadowSampler, uv + float2(offset, offset), reference);
+    return lit * 0.25;
+}
+
+// 0 if the terrain blocks the ray towards the light, else 1. The ray starts
+// a little off the surface along its normal, so it doesn't hit the
+// triangle it leaves; any hit will do.
+static float tracedVisibility(raytracing::primitive_acceleration_structure structure, float3 position,
+                              float3 normal, float4 sunDirection) {
+    raytracing::ray r(position + normal * 0.05, sunDirection.xyz, 0.0, sunDirection.w);
+    raytracing::intersector<raytracing::triangle_data> query;
+    query.assume_geometry_type(raytracing::geometry_type::triangle);
+    query.accept_any_intersection(true);
+    return query.intersect(r, structure).type == raytracing::intersection_type::none ? 1.0 : 0.0;
+}
+
+// Fraction of the sun above the terrain's horizon (Terrain::GetHorizonData)
+// in its azimuth, interpolated between the two nearest of the eight baked
+// directions (Terrain::kHorizonDirections).
+// The sun's disc spans about half a degree, which softens the edge. Off the
+// map is lit.
+static float horizonVisibility(texture2d_array<float> horizons, float4 map, float3 position, float3 toLight) {
+    constexpr sampler horizonSampler(filter::linear, address::clamp_to_edge);
+    float2 uv = (position.xz - map.xy) * map.zw;
+    if (any(uv < 0.0) || any(uv > 1.0)) {
+        return 1.0;
+    }
+    float4 directions[2] = { horizons.sample(horizonSampler, uv, 0), horizons.sample(horizonSampler, uv, 1) };
+    float slot = fract(atan2(toLight.z, toLight.x) * (0.5 / M_PI_F)) * 8.0;
+    uint first = uint(slot) & 7u;
+    uint second = (first + 1u) & 7u;
+    float horizon = mix(directions[first >> 2][first & 3u], directions[second >> 2][second & 3u], fract(slot));
+    return smoothstep(horizon - 0.005, horizon + 0.005, toLight.y);
+}
+
 // Fragment shader function
-fragment float4 fragment_main(VertexOut in [[stage_in]],
-                              constant FragmentUniforms& uniforms [[buffer(0)]]) {
+fragment SceneFragmentOut fragment_main(VertexOut in [[stage_in]],
+                                        constant FragmentUniforms& uniforms [[buffer(0)]],
+                                        constant MotionUniforms& motion [[buffer(1), function_constant(kWritesMotion)]],
+                                        depth2d<float> terrainShadow [[texture(0), function_constant(kReceivesShadows)]],
+                                        depth2d<float> landerShadow [[texture(1), function_constant(kReceivesShadows)]],
+                                        constant PointLightUniforms& pointLights [[buffer(2), function_constant(kPointLights)]],
+                                        raytracing::primitive_acceleration_structure terrainStructure
+                                            [[buffer(3), function_constant(kRayTracedShadows)]],
+                                        texture2d_array<float> horizons [[texture(2), function_constant(kHorizonShadows)]]) {
     // Normalize vectors
     float3 norm = normalize(in.normal);
     float3 lightDir = normalize(uniforms.lightPosition - in.fragmentPosition);
     
-    // Ambient light
-    float3 ambient = uniforms.ambientLight;
+    // Ambient light, less what the terrain around hides of the sky
+    float3 ambient = uniforms.ambientLight * (1.0 - saturate(in.occlusion));
     
     // Diffuse light
     float diff = max(dot(norm, lightDir), 0.0);
     float3 diffuse = diff * float3(1.0, 1.0, 1.0);
     
-    // Object color based on entity type and properties
+    // Object color for the variant; the other paths are compiled out
     float3 objectColor;
     
-    if (in.entityType > 0.5) {
+    if (kIsLander) {
         // Lander is red
         objectColor = float3(1.0, 0.0, 0.0);
     } else {
@@ -79,7 +945,12 @@ fragment float4 fragment_main(VertexOut in [[stage_in]],
         float heightFactor = fract(in.fragmentPosition.y * 0.5);
         float noiseFactor = fract(sin(dot(floor(in.fragmentPosition.xz * 10.0), float2(12.9898, 78.233))) * 43758.5453);
         
-        if (in.isLandingPad > 0.5) {
+        bool onLandingPad = false;
+        if (kHasLandingPad) {
+            onLandingPad = in.isLandingPad > 0.5;
+        }
+        
+        if (onLandingPad) {
             // Landing pad - bluish grey and flatter texture
             objectColor = float3(0.6, 0.6, 0.7) + noiseFactor * 0.05;
         } else {
@@ -88,8 +959,359 @@ fragment float4 fragment_main(VertexOut in [[stage_in]],
         }
     }
     
+    // Direct light is blocked by whichever map holds something nearer the
+    // light (the terrain's is cached, the lander's redrawn every frame), by
+    // the terrain along a traced ray, or by the terrain's baked horizon
+    float shadow = 1.0;
+    if (kReceivesShadows) {
+        if (kRayTracedShadows) {
+            if (uniforms.sunDirection.w > 0.0 && dot(norm, uniforms.sunDirection.xyz) > 0.0) {
+                shadow = tracedVisibility(terrainStructure, in.fragmentPosition, norm, uniforms.sunDirection);
+            }
+        } else if (kHorizonShadows) {
+            if (!kIsLander && uniforms.horizonMap.z > 0.0) {
+                shadow = horizonVisibility(horizons, uniforms.horizonMap, in.fragmentPosition, lightDir);
+            }
+        } else if (uniforms.shadowParams.z > 0.0) {
+            shadow = shadowVisibility(terrainShadow, uniforms.terrainShadowMatrix, in.fragmentPosition,
+                                      uniforms.shadowParams.x, uniforms.shadowTexelSize.x);
+        }
+        if (uniforms.shadowParams.w > 0.0) {
+            shadow = min(shadow, shadowVisibility(landerShadow, uniforms.landerShadowMatrix, in.fragmentPosition,
+                                                  uniforms.shadowParams.y, uniforms.shadowTexelSize.y));
+        }
+    }
+    
     // Combine lights
-    float3 result = (ambient + diffuse) * objectColor;
+    float3 result = (ambient + diffuse * shadow) * objectColor;
+    if (kPointLights) {
+        for (uint i = 0; i < pointLights.count; i++) {
+            result += pointLighting(pointLights.lights[i], in.fragmentPosition, norm, objectColor);
+        }
+    }
+    
+    SceneFragmentOut out;
+    out.color = float4(result, 1.0);
+    if (kWritesGBuffer) {
+        out.albedo = float4(objectColor, 1.0);
+        out.normal = float4(norm, 0.0);
+        out.position = float4(in.fragmentPosition, 1.0);
+    }
+    
+    // Motion from the interpolated world position, which is exact for every
+    // vertex function, so they need no extra outputs. Both projections are
+    // unjittered; NDC y points up, texture y down.
+    if (kWritesMotion) {
+        float4 current = motion.viewProjection * float4(in.fragmentPosition, 1.0);
+        float4 previous = motion.previousViewProjection * (motion.previousFromCurrent * float4(in.fragmentPosition, 1.0));
+        out.motion = (previous.xy / previous.w - current.xy / current.w) * float2(0.5, -0.5);
+    }
+    
+    return out;
+}
+
+// Deferred point lights. The tile shader runs once the opaque scene is in
+// tile memory: it bounds the tile's drawn positions, keeps the lights whose
+// sphere touches the bounds, and leaves their indices in threadgroup
+// memory for the full-screen draw that follows in the same pass.
+
+// Must match TileLights in Renderer3D_Metal.cpp. Bounds are floats mapped
+// to uints that order the same way, so atomics can reduce them.
+struct TileLights {
+    atomic_uint boundsMin[3];
+    atomic_uint boundsMax[3];
+    atomic_uint count;
+    ushort indices[64];               // Renderer3D_Metal::kMaxPointLights
+};
+
+static uint orderedFloat(float value) {
+    uint bits = as_type<uint>(value);
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+static float unorderedFloat(uint bits) {
+    return as_type<float>((bits & 0x80000000u) ? bits & 0x7FFFFFFFu : ~bits);
+}
+
+struct GBufferPosition {
+    float4 position [[color(4)]];
+};
+
+kernel void cull_point_lights(imageblock<GBufferPosition, imageblock_layout_implicit> gbuffer,
+                              constant PointLightUniforms& pointLights [[buffer(0)]],
+                              threadgroup TileLights& tile [[threadgroup(0)]],
+                              ushort2 pixel [[thread_position_in_threadgroup]],
+                              ushort thread [[thread_index_in_threadgroup]],
+                              ushort2 tileSize [[threads_per_threadgroup]]) {
+    if (thread == 0) {
+        for (int axis = 0; axis < 3; axis++) {
+            atomic_store_explicit(&tile.boundsMin[axis], 0xFFFFFFFFu, memory_order_relaxed);
+            atomic_store_explicit(&tile.boundsMax[axis], 0u, memory_order_relaxed);
+        }
+        atomic_store_explicit(&tile.count, 0u, memory_order_relaxed);
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    
+    // Each SIMD group reduces its pixels before touching the shared bounds
+    float4 position = gbuffer.read(pixel).position;
+    bool drawn = position.w > 0.0;
+    float3 low = drawn ? position.xyz : float3(INFINITY);
+    float3 high = drawn ? position.xyz : float3(-INFINITY);
+    low = float3(simd_min(low.x), simd_min(low.y), simd_min(low.z));
+    high = float3(simd_max(high.x), simd_max(high.y), simd_max(high.z));
+    if (simd_is_first() && simd_any(drawn)) {
+        for (int axis = 0; axis < 3; axis++) {
+            atomic_fetch_min_explicit(&tile.boundsMin[axis], orderedFloat(low[axis]), memory_order_relaxed);
+            atomic_fetch_max_explicit(&tile.boundsMax[axis], orderedFloat(high[axis]), memory_order_relaxed);
+        }
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
     
-    return float4(result, 1.0);
-}
\ No newline at end of file
+    // Nothing drawn leaves the bounds as initialized, inverted
+    if (atomic_load_explicit(&tile.boundsMin[0], memory_order_relaxed) >
+        atomic_load_explicit(&tile.boundsMax[0], memory_order_relaxed)) {
+        return;
+    }
+    float3 boundsMin, boundsMax;
+    for (int axis = 0; axis < 3; axis++) {
+        boundsMin[axis] = unorderedFloat(atomic_load_explicit(&tile.boundsMin[axis], memory_order_relaxed));
+        boundsMax[axis] = unorderedFloat(atomic_load_explicit(&tile.boundsMax[axis], memory_order_relaxed));
+    }
+    for (uint i = thread; i < pointLights.count; i += tileSize.x * tileSize.y) {
+        float4 light = pointLights.lights[i].positionRadius;
+        float3 nearest = clamp(light.xyz, boundsMin, boundsMax);
+        if (distance_squared(nearest, light.xyz) < light.w * light.w) {
+            uint slot = atomic_fetch_add_explicit(&tile.count, 1u, memory_order_relaxed);
+            tile.indices[slot] = ushort(i);
+        }
+    }
+}
+
+struct FullScreenOut {
+    float4 position [[position]];
+};
+
+// One triangle covering the viewport, no vertex buffer
+vertex FullScreenOut deferred_lighting_vertex(uint vertexId [[vertex_id]]) {
+    float2 corner = float2((vertexId << 1) & 2, vertexId & 2);
+    FullScreenOut out;
+    out.position = float4(corner * 2.0 - 1.0, 0.0, 1.0);
+    return out;
+}
+
+// Adds the tile's lights to the lit scene (blended additively), reading
+// the G-buffer as it is in tile memory
+fragment float4 deferred_lighting(FullScreenOut in [[stage_in]],
+                                  float4 albedo [[color(2)]],
+                                  float4 normal [[color(3)]],
+                                  float4 position [[color(4)]],
+                                  constant PointLightUniforms& pointLights [[buffer(2)]],
+                                  threadgroup TileLights& tile [[threadgroup(0)]]) {
+    if (position.w <= 0.0) {
+        return float4(0.0);
+    }
+    float3 lit = float3(0.0);
+    uint count = atomic_load_explicit(&tile.count, memory_order_relaxed);
+    for (uint i = 0; i < count; i++) {
+        lit += pointLighting(pointLights.lights[tile.indices[i]], position.xyz, normal.xyz, albedo.rgb);
+    }
+    return float4(lit, 0.0);
+}
+
+// Stretches a rate-mapped scene over the drawable (on the lighting pass's
+// full-screen triangle): each screen pixel samples the physical pixel the
+// rate map put it at, filtered across the coarser zones
+fragment float4 variable_rate_resolve(FullScreenOut in [[stage_in]],
+                                      texture2d<float> scene [[texture(0)]],
+                                      constant rasterization_rate_map_data* rateMap [[buffer(0)]]) {
+    constexpr sampler pixelSampler(coord::pixel, address::clamp_to_edge, filter::linear);
+    rasterization_rate_map_decoder decoder(*rateMap);
+    float2 physical = decoder.map_screen_to_physical_coordinates(in.position.xy);
+    return scene.sample(pixelSampler, physical);
+}
+
+// Sky pass: stars and the Earth, computed per pixel from the view direction
+// on a full-screen triangle drawn after the opaque scene. Matches
+// SkyUniforms in Renderer3D_Metal.cpp.
+struct SkyUniforms {
+    float4 cameraRight;       // World-space camera axes (the view's rows)
+    float4 cameraUp;
+    float4 cameraForward;
+    float4 projection;        // P00, P11, P20, P21 of the (jittered) projection
+    float4 earthDirection;    // xyz unit; w = cosine of the disc's angular radius
+    float4 sunDirection;      // xyz unit, towards the sun
+    float4 params;            // x = radians per pixel; y = star brightness
+};
+
+struct SkyOut {
+    float4 position [[position]];
+    float2 ndc;
+};
+
+struct SkyFragmentOut {
+    float4 color [[color(0)]];
+    float2 motion [[color(1), function_constant(kWritesMotion)]];
+};
+
+// The lighting pass's triangle at the far plane, so the depth test keeps
+// the sky behind everything drawn
+vertex SkyOut sky_vertex(uint vertexId [[vertex_id]]) {
+    float2 corner = float2((vertexId << 1) & 2, vertexId & 2);
+    SkyOut out;
+    out.ndc = corner * 2.0 - 1.0;
+    out.position = float4(out.ndc, 1.0, 1.0);
+    return out;
+}
+
+// Well-mixed 32-bit hash (lowbias32)
+static uint skyHash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float skyUnit(uint x) {
+    return float(skyHash(x) >> 8) * (1.0 / 16777216.0);
+}
+
+// Stars: every cell of a kStarCells^2 grid on each cube face holds at most
+// one, placed, sized and colored by the cell's hash, so the field is fixed
+// in the world and needs no texture. A star stays inside its cell's middle,
+// so only the pixel's own cell can reach it.
+constant uint kStarCells = 256;
+constant float kStarDensity = 0.04;     // Share of cells with a star
+
+static float3 starLight(float3 direction, float pixelAngle, float brightness) {
+    float3 magnitude = abs(direction);
+    uint face;
+    float2 uv;
+    if (magnitude.x >= magnitude.y && magnitude.x >= magnitude.z) {
+        face = direction.x > 0.0 ? 0u : 1u;
+        uv = direction.yz / magnitude.x;
+    } else if (magnitude.y >= magnitude.z) {
+        face = direction.y > 0.0 ? 2u : 3u;
+        uv = direction.xz / magnitude.y;
+    } else {
+        face = direction.z > 0.0 ? 4u : 5u;
+        uv = direction.xy / magnitude.z;
+    }
+    float2 grid = (uv * 0.5 + 0.5) * float(kStarCells);
+    uint2 cell = min(uint2(grid), uint2(kStarCells - 1));
+    uint seed = skyHash((face * kStarCells + cell.y) * kStarCells + cell.x);
+    if (skyUnit(seed) >= kStarDensity) {
+        return float3(0.0);
+    }
+    
+    // The star's direction, back from its place in the cell
+    float2 place = float2(cell) + 0.2 + 0.6 * float2(skyUnit(seed + 1u), skyUnit(seed + 2u));
+    float2 starUV = place / float(kStarCells) * 2.0 - 1.0;
+    float3 star;
+    float side = (face & 1u) ? -1.0 : 1.0;
+    if (face < 2u) {
+        star = float3(side, starUV.x, starUV.y);
+    } else if (face < 4u) {
+        star = float3(starUV.x, side, starUV.y);
+    } else {
+        star = float3(starUV.x, starUV.y, side);
+    }
+    star = normalize(star);
+    
+    // About a pixel across whatever the resolution, so stars neither
+    // shimmer nor swell; most are faint, a few bright
+    float sigma = 0.6 * pixelAngle;
+    float distance = length(direction - star);
+    float falloff = exp(-0.5 * distance * distance / (sigma * sigma));
+    float intensity = pow(skyUnit(seed + 3u), 6.0) * brightness;
+    float3 tint = mix(float3(0.7, 0.8, 1.0), float3(1.0, 0.8, 0.6), skyUnit(seed + 4u));
+    return tint * intensity * falloff;
+}
+
+// The Earth: a sphere lit by the sun, with a thin atmosphere at the limb
+// and a faint glow around the disc; blocks the stars behind it
+static float3 earthLight(float3 direction, float4 earth, float3 sun, float pixelAngle, thread float& coverage) {
+    float cosine = dot(direction, earth.xyz);
+    float angle = acos(clamp(cosine, -1.0, 1.0));
+    float radius = acos(earth.w);
+    coverage = saturate((radius - angle) / pixelAngle + 0.5);
+    
+    // The sphere's visible normal at this pixel: r = 0 at the centre, 1 at
+    // the limb
+    float3 across = direction - earth.xyz * cosine;
+    float r = saturate(angle / radius);
+    float3 normal = normalize(across * (r / max(length(across), 1.0e-6)) - earth.xyz * sqrt(1.0 - r * r));
+    float day = saturate(dot(normal, sun));
+    
+    // Oceans under a band of cheap procedural cloud
+    float clouds = smoothstep(0.3, 0.9, sin(normal.x * 23.0 + sin(normal.y * 17.0)) *
+                                        sin(normal.z * 19.0 + normal.y * 11.0) + 0.4);
+    float3 surface = mix(float3(0.05, 0.18, 0.45), float3(0.9), clouds);
+    float3 atmosphere = float3(0.3, 0.55, 1.0) * pow(r, 6.0);
+    float3 disc = (surface + atmosphere) * day + float3(0.004, 0.006, 0.01);
+    
+    // Scattered light just outside the limb, on the lit side
+    float lit = saturate(dot(normalize(across + earth.xyz * 1.0e-6), sun) * 0.5 + 0.5);
+    float glow = 0.05 * lit * exp(-max(angle - radius, 0.0) / (0.15 * radius));
+    return disc * coverage + float3(0.3, 0.5, 1.0) * glow * (1.0 - coverage);
+}
+
+fragment SkyFragmentOut sky_fragment(SkyOut in [[stage_in]],
+                                     constant SkyUniforms& sky [[buffer(4)]],
+                                     constant MotionUniforms& motion [[buffer(1), function_constant(kWritesMotion)]]) {
+    // Undo the projection for the view-space ray at z = -1, then into
+    // world space
+    float2 view = (in.ndc + sky.projection.zw) / sky.projection.xy;
+    float3 direction = normalize(sky.cameraRight.xyz * view.x + sky.cameraUp.xyz * view.y +
+                                 sky.cameraForward.xyz);
+    
+    float coverage = 0.0;
+    float3 color = earthLight(direction, sky.earthDirection, sky.sunDirection.xyz, sky.params.x, coverage);
+    color += starLight(direction, sky.params.x, sky.params.y) * (1.0 - coverage);
+    
+    SkyFragmentOut out;
+    out.color = float4(color, 1.0);
+    
+    // A direction is a point at infinity (w = 0): only the camera's
+    // rotation moves it
+    if (kWritesMotion) {
+        float4 current = motion.viewProjection * float4(direction, 0.0);
+        float4 previous = motion.previousViewProjection * float4(direction, 0.0);
+        out.motion = (previous.xy / previous.w - current.xy / current.w) * float2(0.5, -0.5);
+    }
+    return out;
+}
+
+// Debug overlay vertex - must match the C++ OverlayVertex struct (32 bytes)
+struct OverlayVertex {
+    packed_float2 position;   // Pixels from the top-left of the window
+    packed_float4 color;
+    packed_float2 texCoord;   // Glyph atlas texel (its solid cell for plain rectangles)
+};
+
+struct OverlayOut {
+    float4 position [[position]];
+    float4 color;
+    float2 texCoord;
+};
+
+// Overlay vertex shader: pixel coordinates to clip space, no vertex descriptor
+vertex OverlayOut overlay_vertex(uint vertexId [[vertex_id]],
+                                 const device OverlayVertex* vertices [[buffer(0)]],
+                                 constant float2& viewportSize [[buffer(1)]]) {
+    OverlayOut out;
+    float2 ndc = float2(vertices[vertexId].position) / viewportSize * 2.0 - 1.0;
+    out.position = float4(ndc.x, -ndc.y, 0.0, 1.0);
+    out.color = float4(vertices[vertexId].color);
+    out.texCoord = float2(vertices[vertexId].texCoord);
+    return out;
+}
+
+// Overlay fragment shader: alpha-blended color, masked by the atlas texel
+// (nearest, so glyphs stay crisp at any scale)
+fragment float4 overlay_fragment(OverlayOut in [[stage_in]],
+                                 texture2d<float, access::read> atlas [[texture(0)]]) {
+    float coverage = atlas.read(uint2(in.texCoord)).r;
+    return float4(in.color.rgb, in.color.a * coverage);
+}
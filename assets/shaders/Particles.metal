@@ -0,0 +1,213 @@
+// Particles.metal
+// Engine exhaust and regolith dust: emitted, aged and drawn on the GPU
+
+#include <metal_stdlib>
+using namespace metal;
+
+// Particle::kind
+constant uint kParticleExhaust = 0;
+constant uint kParticleDust = 1;
+
+// Matches GpuParticle in Renderer3D_Metal.cpp (48 bytes). A slot is free
+// once age reaches lifetime; a zeroed ring is all free.
+struct Particle {
+    packed_float3 position;   // Meters
+    float age;                // Seconds
+    packed_float3 velocity;   // m/s
+    float lifetime;
+    float size;               // Diameter in meters
+    uint kind;
+    float2 padding;
+};
+
+// Matches ParticleUniforms in Renderer3D_Metal.cpp
+struct ParticleUniforms {
+    float4 nozzle;              // xyz; w = exhaust speed (m/s)
+    float4 exhaustDirection;    // xyz unit, out of the nozzle
+    float4 velocity;            // Lander's
+    float4 plumeCenter;         // Where the engine axis meets the ground; w = radius
+    float4 originShift;         // World origin's move since the last update (xyz)
+    float4 contacts[8];         // Renderer3D_Metal::kMaxParticleContacts
+    uint head;                  // Ring slot of the first new particle
+    uint exhaustCount;          // New particles of each stream, in this order
+    uint plumeDustCount;
+    uint contactDustCount;
+    uint contactCount;
+    uint seed;
+    uint ringMask;              // Ring size - 1
+    float deltaTime;
+    float gravity;
+    float groundHeight;         // Surface under the nozzle, the plane particles stop at
+    float thrustLevel;
+    float contactStrength;      // 0 - 1, from the lander's speed at the contacts
+};
+
+// Matches ParticleDrawUniforms in Renderer3D_Metal.cpp
+struct ParticleDrawUniforms {
+    float4x4 viewProjection;
+    float pointScale;           // Pixels per meter at one meter's depth
+    float maxPointSize;
+    float2 padding;
+};
+
+// Integer hash (lowbias32) driving each thread's random stream
+static uint hashUint(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float random01(thread uint& state) {
+    state = hashUint(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+// One thread per new particle, written over the oldest slots
+kernel void particle_emit(constant ParticleUniforms& uniforms [[buffer(0)]],
+                          device Particle* particles [[buffer(1)]],
+                          uint id [[thread_position_in_grid]]) {
+    uint plumeEnd = uniforms.exhaustCount + uniforms.plumeDustCount;
+    if (id >= plumeEnd + uniforms.contactDustCount) {
+        return;
+    }
+    
+    uint rng = hashUint(id * 0x9e3779b9u ^ hashUint(uniforms.seed));
+    float angle = random01(rng) * 2.0 * M_PI_F;
+    Particle particle;
+    particle.padding = float2(0.0);
+    
+    if (id < uniforms.exhaustCount) {
+        // A narrow cone about the engine axis, carried along with the lander
+        float3 axis = uniforms.exhaustDirection.xyz;
+        float3 side = normalize(cross(axis, abs(axis.y) < 0.9 ? float3(0.0, 1.0, 0.0) : float3(1.0, 0.0, 0.0)));
+        float3 up = cross(axis, side);
+        float spread = 0.12 * sqrt(random01(rng));
+        float3 direction = normalize(axis + (side * cos(angle) + up * sin(angle)) * spread);
+        float3 velocity = uniforms.velocity.xyz + direction * uniforms.nozzle.w * mix(0.7, 1.0, random01(rng));
+        
+        // Born at a random point in the frame, so the plume has no gaps
+        float born = random01(rng) * uniforms.deltaTime;
+        particle.position = uniforms.nozzle.xyz + velocity * born;
+        particle.velocity = velocity;
+        particle.age = born;
+        particle.lifetime = mix(0.3, 0.6, random01(rng));
+        particle.size = 0.35;
+        particle.kind = kParticleExhaust;
+    } else {
+        // Dust thrown outward and up from the plume's footprint or a contact
+        float3 origin;
+        float radius;
+        float speed;
+        if (id < plumeEnd) {
+            origin = uniforms.plumeCenter.xyz;
+            radius = uniforms.plumeCenter.w * sqrt(random01(rng));
+            speed = mix(4.0, 15.0, random01(rng)) * uniforms.thrustLevel;
+        } else {
+            uint contact = (id - plumeEnd) % max(uniforms.contactCount, 1u);
+            origin = uniforms.contacts[contact].xyz;
+            radius = 0.3 * sqrt(random01(rng));
+            speed = mix(1.0, 4.0, random01(rng)) * uniforms.contactStrength;
+        }
+        float2 outward = float2(cos(angle), sin(angle));
+        particle.position = origin + float3(outward.x * radius, 0.05, outward.y * radius);
+        particle.velocity = float3(outward.x, mix(0.1, 0.4, random01(rng)), outward.y) * speed;
+        particle.age = 0.0;
+        particle.lifetime = mix(1.5, 3.5, random01(rng));
+        particle.size = 0.2;
+        particle.kind = kParticleDust;
+    }
+    
+    particles[(uniforms.head + id) & uniforms.ringMask] = particle;
+}
+
+// One thread per ring slot
+kernel void particle_update(constant ParticleUniforms& uniforms [[buffer(0)]],
+                            device Particle* particles [[buffer(1)]],
+                            uint id [[thread_position_in_grid]]) {
+    if (id > uniforms.ringMask) {
+        return;
+    }
+    Particle particle = particles[id];
+    if (particle.age >= particle.lifetime) {
+        return;
+    }
+    
+    // Exhaust gas flies straight in vacuum; dust falls
+    float dt = uniforms.deltaTime;
+    float3 position = particle.position - uniforms.originShift.xyz;
+    float3 velocity = particle.velocity;
+    if (particle.kind == kParticleDust) {
+        velocity.y -= uniforms.gravity * dt;
+    }
+    position += velocity * dt;
+    
+    if (position.y < uniforms.groundHeight) {
+        position.y = uniforms.groundHeight;
+        if (particle.kind == kParticleExhaust) {
+            // Gas reaching the surface fans out along it
+            float2 outward = position.xz - uniforms.nozzle.xz;
+            float distance = length(outward);
+            outward = distance > 1.0e-3 ? outward / distance : float2(1.0, 0.0);
+            float speed = 0.6 * length(velocity);
+            velocity = float3(outward.x * speed, 0.0, outward.y * speed);
+        } else {
+            // Dust settles where it lands
+            velocity = float3(0.0);
+        }
+    }
+    
+    particle.position = position;
+    particle.velocity = velocity;
+    particle.age += dt;
+    particles[id] = particle;
+}
+
+struct ParticleOut {
+    float4 position [[position]];
+    float pointSize [[point_size]];
+    float4 color;               // Premultiplied; alpha 0 adds
+};
+
+// One point sprite per ring slot, no vertex descriptor; free slots are
+// pushed behind the near plane
+vertex ParticleOut particle_vertex(uint vertexId [[vertex_id]],
+                                   const device Particle* particles [[buffer(0)]],
+                                   constant ParticleDrawUniforms& uniforms [[buffer(1)]]) {
+    Particle particle = particles[vertexId];
+    ParticleOut out;
+    if (particle.age >= particle.lifetime) {
+        out.position = float4(0.0, 0.0, -1.0, 1.0);
+        out.pointSize = 0.0;
+        out.color = float4(0.0);
+        return out;
+    }
+    
+    out.position = uniforms.viewProjection * float4(float3(particle.position), 1.0);
+    out.pointSize = clamp(particle.size * uniforms.pointScale / max(out.position.w, 0.1), 1.0, uniforms.maxPointSize);
+    
+    float t = particle.age / particle.lifetime;
+    if (particle.kind == kParticleExhaust) {
+        // White hot at the nozzle, cooling to orange as it thins out
+        float3 color = mix(float3(1.0, 0.85, 0.55), float3(0.9, 0.3, 0.05), t) * (1.0 - t);
+        out.color = float4(color, 0.0);
+    } else {
+        // Grey regolith, fading in quickly and out over its life
+        float alpha = 0.35 * (1.0 - t) * saturate(particle.age * 4.0);
+        out.color = float4(float3(0.55, 0.53, 0.5) * alpha, alpha);
+    }
+    return out;
+}
+
+// Round, soft-edged sprite
+fragment float4 particle_fragment(ParticleOut in [[stage_in]],
+                                  float2 pointCoord [[point_coord]]) {
+    float2 offset = pointCoord * 2.0 - 1.0;
+    float radiusSquared = dot(offset, offset);
+    if (radiusSquared > 1.0) {
+        discard_fragment();
+    }
+    return in.color * (1.0 - radiusSquared);
+}
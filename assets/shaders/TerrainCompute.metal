@@ -0,0 +1,274 @@
+// TerrainCompute.metal
+// GPU terrain generation: TerrainGenerator's noise and the CDLOD chunk vertices
+
+#include <metal_stdlib>
+using namespace metal;
+
+#define TERRAIN_MAX_OCTAVES 8
+#define TERRAIN_CHUNK_CELLS 16
+
+// Matches TerrainComputeUniforms in Renderer3D_Metal.cpp
+struct TerrainComputeUniforms {
+    // TerrainNoiseLayers
+    uint hillKeys[TERRAIN_MAX_OCTAVES];
+    uint ridgeKeys[TERRAIN_MAX_OCTAVES];
+    float octaveFrequency[TERRAIN_MAX_OCTAVES];
+    float octaveAmplitude[TERRAIN_MAX_OCTAVES];
+    uint mariaKey;
+    uint craterKey;
+
+    // TerrainNoiseParams
+    int octaves;
+    float hillFrequency;
+    float hillAmplitude;
+    float ridgeFrequency;
+    float ridgeAmplitude;
+    float mariaFrequency;
+    float mariaDepth;
+    float craterCellSize;
+    float craterDensity;
+    float craterDepth;
+
+    // TerrainGeneratedLayout
+    int gridSize;
+    float cellWidth;
+    float cellLength;
+    int padMin;
+    int padMax;
+    float blendCells;
+    float baseHeight;
+};
+
+// Matches TerrainChunkRecord in Renderer3D_Metal.cpp
+struct TerrainChunkRecord {
+    int level;
+    int cellX;
+    int cellZ;
+    uint firstVertex;
+    float origin[3];
+    float extent[3];
+};
+
+// Matches PackedVertex
+struct PackedVertex {
+    short4 position;
+    short2 normal;
+    uchar flags;
+    uchar occlusion;
+    uchar padding[2];
+};
+
+// Per-chunk results for the CPU: height range and worst morph delta, as
+// order-preserving bits
+struct TerrainChunkStats {
+    atomic_uint minHeight;
+    atomic_uint maxHeight;
+    atomic_uint maxMorphDelta;
+};
+
+constant float kCraterRimHeight = 0.2;
+constant float kCraterRimExtent2 = 1.6 * 1.6;
+constant float kCraterMinRadius = 0.2;
+constant float kCraterRadiusRange = 0.35;
+constant float kCraterCenterMin = 0.2;
+constant float kCraterCenterRange = 0.6;
+constant uchar kVertexFlagLandingPad = 1;
+
+// Same lattice hash as TerrainGenerator.cpp
+static uint hashLattice(uint key, int x, int z) {
+    uint h = key ^ (uint(x) * 0x8da6b343u) ^ (uint(z) * 0xd8163841u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+static float hashToUnit(uint h) {
+    return float(h >> 8) * (1.0 / 16777216.0);
+}
+
+static float hashByte(uint h, uint shift) {
+    return float((h >> shift) & 0xFFu) * (1.0 / 256.0);
+}
+
+static float fade(float t) {
+    return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+static float valueNoise(uint key, float2 p) {
+    float2 cell = floor(p);
+    int ix = int(cell.x);
+    int iz = int(cell.y);
+    float u = fade(p.x - cell.x);
+    float v = fade(p.y - cell.y);
+
+    float h00 = hashToUnit(hashLattice(key, ix, iz));
+    float h10 = hashToUnit(hashLattice(key, ix + 1, iz));
+    float h01 = hashToUnit(hashLattice(key, ix, iz + 1));
+    float h11 = hashToUnit(hashLattice(key, ix + 1, iz + 1));
+    return mix(mix(h00, h10, u), mix(h01, h11, u), v) * 2.0 - 1.0;
+}
+
+// TerrainGenerator::GenerateBlock for one sample
+static float terrainNoise(constant TerrainComputeUniforms& uniforms, float2 p) {
+    float hills = 0.0;
+    float ridges = 0.0;
+    for (int octave = 0; octave < uniforms.octaves; octave++) {
+        float amplitude = uniforms.octaveAmplitude[octave];
+        hills += amplitude * valueNoise(uniforms.hillKeys[octave],
+                                        p * (uniforms.hillFrequency * uniforms.octaveFrequency[octave]));
+        float ridge = 1.0 - abs(valueNoise(uniforms.ridgeKeys[octave],
+                                           p * (uniforms.ridgeFrequency * uniforms.octaveFrequency[octave])));
+        ridges += amplitude * ridge * ridge;
+    }
+
+    float basin = smoothstep(0.1, 0.6, valueNoise(uniforms.mariaKey, p * uniforms.mariaFrequency));
+
+    float cellSize = uniforms.craterCellSize;
+    float maxRadius = cellSize * (kCraterMinRadius + kCraterRadiusRange);
+    int2 home = int2(floor(p / cellSize));
+    float craters = 0.0;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            int2 cell = home + int2(dx, dz);
+            uint h = hashLattice(uniforms.craterKey, cell.x, cell.y);
+            if (hashByte(h, 0) >= uniforms.craterDensity) {
+                continue;
+            }
+            float2 center = (float2(cell) + kCraterCenterMin + kCraterCenterRange * float2(hashByte(h, 8), hashByte(h, 16))) * cellSize;
+            float radius = (kCraterMinRadius + kCraterRadiusRange * hashByte(h, 24)) * cellSize;
+            float2 offset = p - center;
+            float d2 = dot(offset, offset) / (radius * radius);
+            float rimFalloff = max(0.0, 1.0 - (d2 - 1.0) / (kCraterRimExtent2 - 1.0));
+            float profile = d2 < 1.0 ? -1.0 + (1.0 + kCraterRimHeight) * d2
+                                     : kCraterRimHeight * rimFalloff * rimFalloff;
+            craters += uniforms.craterDepth * (radius / maxRadius) * profile;
+        }
+    }
+
+    float highland = 1.0 - basin;
+    return uniforms.hillAmplitude * hills * (0.3 + 0.7 * highland) +
+           uniforms.ridgeAmplitude * (ridges - 1.0 / 3.0) * highland -
+           uniforms.mariaDepth * basin +
+           craters;
+}
+
+// One thread per height sample: noise eased to the flat landing pad, as in
+// Terrain::Generate3D
+kernel void terrain_generate_heights(constant TerrainComputeUniforms& uniforms [[buffer(0)]],
+                                     device float* heights [[buffer(1)]],
+                                     uint2 gid [[thread_position_in_grid]]) {
+    int stride = uniforms.gridSize + 1;
+    if (int(gid.x) >= stride || int(gid.y) >= stride) {
+        return;
+    }
+
+    int x = int(gid.x);
+    int z = int(gid.y);
+    float2 p = float2(float(x) * uniforms.cellWidth, float(z) * uniforms.cellLength);
+
+    int outsideX = max(0, max(uniforms.padMin - x, x - uniforms.padMax));
+    int outsideZ = max(0, max(uniforms.padMin - z, z - uniforms.padMax));
+    float t = min(1.0, float(max(outsideX, outsideZ)) / uniforms.blendCells);
+    heights[z * stride + x] = uniforms.baseHeight + terrainNoise(uniforms, p) * t * t * (3.0 - 2.0 * t);
+}
+
+static short packSnorm16(float value) {
+    return short(round(clamp(value, -1.0, 1.0) * 32767.0));
+}
+
+// Height of patch sample (i, j) of a chunk, clamped to the patch and the grid
+static float patchHeight(const device float* heights, const device TerrainChunkRecord& chunk, int gridSize,
+                         int i, int j) {
+    int levelStep = 1 << chunk.level;
+    i = clamp(i, 0, TERRAIN_CHUNK_CELLS);
+    j = clamp(j, 0, TERRAIN_CHUNK_CELLS);
+    int x = min(chunk.cellX + i * levelStep, gridSize);
+    int z = min(chunk.cellZ + j * levelStep, gridSize);
+    return heights[z * (gridSize + 1) + x];
+}
+
+static uint orderedBits(float value) {
+    uint bits = as_type<uint>(value);
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+// One thread per patch vertex (x) of each chunk (y), matching
+// Renderer3D_Metal::BuildTerrainVertices with Terrain::BuildNormals'
+// central differences; the ambient occlusion is Terrain's bake, a byte per
+// height sample
+kernel void terrain_build_vertices(constant TerrainComputeUniforms& uniforms [[buffer(0)]],
+                                   const device float* heights [[buffer(1)]],
+                                   const device TerrainChunkRecord* chunks [[buffer(2)]],
+                                   device TerrainChunkStats* stats [[buffer(3)]],
+                                   device PackedVertex* vertices [[buffer(4)]],
+                                   const device uchar* occlusion [[buffer(5)]],
+                                   uint2 gid [[thread_position_in_grid]]) {
+    const int patchStride = TERRAIN_CHUNK_CELLS + 1;
+    if (int(gid.x) >= patchStride * patchStride) {
+        return;
+    }
+
+    const device TerrainChunkRecord& chunk = chunks[gid.y];
+    const int gridSize = uniforms.gridSize;
+    const int stride = gridSize + 1;
+    const int levelStep = 1 << chunk.level;
+    int i = int(gid.x) % patchStride;
+    int j = int(gid.x) / patchStride;
+
+    int x = min(chunk.cellX + i * levelStep, gridSize);
+    int z = min(chunk.cellZ + j * levelStep, gridSize);
+    float height = heights[z * stride + x];
+
+    // Height on the next level's surface, as in BuildTerrainVertices
+    float morphHeight = height;
+    if ((i & 1) && !(j & 1)) {
+        morphHeight = 0.5 * (patchHeight(heights, chunk, gridSize, i - 1, j) +
+                             patchHeight(heights, chunk, gridSize, i + 1, j));
+    } else if (!(i & 1) && (j & 1)) {
+        morphHeight = 0.5 * (patchHeight(heights, chunk, gridSize, i, j - 1) +
+                             patchHeight(heights, chunk, gridSize, i, j + 1));
+    } else if ((i & 1) && (j & 1)) {
+        morphHeight = 0.5 * (patchHeight(heights, chunk, gridSize, i + 1, j - 1) +
+                             patchHeight(heights, chunk, gridSize, i - 1, j + 1));
+    }
+
+    int x0 = max(x - 1, 0);
+    int x1 = min(x + 1, gridSize);
+    int z0 = max(z - 1, 0);
+    int z1 = min(z + 1, gridSize);
+    float slopeX = (heights[z * stride + x1] - heights[z * stride + x0]) / (float(x1 - x0) * uniforms.cellWidth);
+    float slopeZ = (heights[z1 * stride + x] - heights[z0 * stride + x]) / (float(z1 - z0) * uniforms.cellLength);
+    float3 normal = normalize(float3(-slopeX, 1.0, -slopeZ));
+
+    // Octahedral encoding, as PackVertex
+    float2 oct = normal.xy / (abs(normal.x) + abs(normal.y) + abs(normal.z));
+    if (normal.z < 0.0) {
+        oct = (1.0 - abs(oct.yx)) * select(float2(-1.0), float2(1.0), oct >= 0.0);
+    }
+
+    float3 position = float3(float(x) * uniforms.cellWidth, height, float(z) * uniforms.cellLength);
+    float3 origin = float3(chunk.origin[0], chunk.origin[1], chunk.origin[2]);
+    float3 extent = float3(chunk.extent[0], chunk.extent[1], chunk.extent[2]);
+    float3 packedPosition = (position - origin) / extent;
+
+    bool isLandingPad = x >= uniforms.padMin && x <= uniforms.padMax &&
+                        z >= uniforms.padMin && z <= uniforms.padMax;
+
+    PackedVertex packed;
+    packed.position = short4(packSnorm16(packedPosition.x), packSnorm16(packedPosition.y),
+                             packSnorm16(packedPosition.z), packSnorm16((morphHeight - origin.y) / extent.y));
+    packed.normal = short2(packSnorm16(oct.x), packSnorm16(oct.y));
+    packed.flags = isLandingPad ? kVertexFlagLandingPad : 0;
+    packed.occlusion = occlusion[z * stride + x];
+    packed.padding[0] = packed.padding[1] = 0;
+    vertices[chunk.firstVertex + gid.x] = packed;
+
+    device TerrainChunkStats& chunkStats = stats[gid.y];
+    atomic_fetch_min_explicit(&chunkStats.minHeight, orderedBits(height), memory_order_relaxed);
+    atomic_fetch_max_explicit(&chunkStats.maxHeight, orderedBits(height), memory_order_relaxed);
+    atomic_fetch_max_explicit(&chunkStats.maxMorphDelta, as_type<uint>(abs(morphHeight - height)),
+                              memory_order_relaxed);
+}
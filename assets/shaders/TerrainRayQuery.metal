@@ -0,0 +1,105 @@
+// TerrainRayQuery.metal
+// Ray queries against the terrain's acceleration structure: ray batches and lidar sweeps
+
+#include <metal_stdlib>
+#include <metal_raytracing>
+using namespace metal;
+using namespace raytracing;
+
+// Matches TerrainQueryParams in TerrainRayTracer.cpp
+struct TerrainQueryParams {
+    float4 origin;      // Scan origin; w = max distance
+    float4 forward;
+    float4 right;       // w = tan(half the horizontal field of view)
+    float4 up;          // w = tan(half the vertical field of view)
+    uint width;
+    uint height;
+    uint rayCount;
+    uint padding;
+};
+
+// Matches TerrainRay and TerrainRayHit in TerrainRayTracer.h
+struct TerrainRay {
+    packed_float3 origin;
+    float maxDistance;
+    packed_float3 direction;
+    float padding;
+};
+
+struct TerrainRayHit {
+    float distance;     // < 0 = no hit
+    packed_float3 normal;
+};
+
+// Closest hit along the ray, with the hit triangle's normal from the
+// structure's own geometry (tiles[] holds each geometry's first triangle)
+static TerrainRayHit traceTerrain(float3 origin, float3 direction, float maxDistance,
+                                  primitive_acceleration_structure structure,
+                                  device const packed_float3* vertices,
+                                  device const uint* indices,
+                                  device const uint* tiles) {
+    TerrainRayHit result;
+    result.distance = -1.0f;
+    result.normal = packed_float3(0.0f, 1.0f, 0.0f);
+    if (!(maxDistance > 0.0f)) {
+        return result;
+    }
+
+    ray r(origin, direction, 0.0f, maxDistance);
+    intersector<triangle_data> query;
+    query.assume_geometry_type(geometry_type::triangle);
+    query.accept_any_intersection(false);
+    intersection_result<triangle_data> hit = query.intersect(r, structure);
+    if (hit.type != intersection_type::triangle) {
+        return result;
+    }
+
+    const uint triangle = tiles[hit.geometry_id] + hit.primitive_id;
+    const float3 a = vertices[indices[3 * triangle + 0]];
+    const float3 b = vertices[indices[3 * triangle + 1]];
+    const float3 c = vertices[indices[3 * triangle + 2]];
+    float3 normal = normalize(cross(b - a, c - a));
+    if (normal.y < 0.0f) {
+        normal = -normal;
+    }
+    result.distance = hit.distance;
+    result.normal = packed_float3(normal);
+    return result;
+}
+
+kernel void terrain_ray_query(constant TerrainQueryParams& params [[buffer(0)]],
+                              device const TerrainRay* rays [[buffer(1)]],
+                              device TerrainRayHit* hits [[buffer(2)]],
+                              primitive_acceleration_structure structure [[buffer(3)]],
+                              device const packed_float3* vertices [[buffer(4)]],
+                              device const uint* indices [[buffer(5)]],
+                              device const uint* tiles [[buffer(6)]],
+                              uint id [[thread_position_in_grid]]) {
+    if (id >= params.rayCount) {
+        return;
+    }
+    const TerrainRay input = rays[id];
+    hits[id] = traceTerrain(input.origin, normalize(float3(input.direction)), input.maxDistance,
+                            structure, vertices, indices, tiles);
+}
+
+kernel void terrain_lidar_scan(constant TerrainQueryParams& params [[buffer(0)]],
+                               device TerrainRayHit* hits [[buffer(2)]],
+                               primitive_acceleration_structure structure [[buffer(3)]],
+                               device const packed_float3* vertices [[buffer(4)]],
+                               device const uint* indices [[buffer(5)]],
+                               device const uint* tiles [[buffer(6)]],
+                               uint2 id [[thread_position_in_grid]]) {
+    if (id.x >= params.width || id.y >= params.height) {
+        return;
+    }
+
+    // Ray through the pixel center, -1 to 1 across the field of view, rows
+    // from the top
+    const float2 ndc = (float2(id) + 0.5f) / float2(params.width, params.height) * 2.0f - 1.0f;
+    const float3 direction = normalize(params.forward.xyz +
+                                       params.right.xyz * (ndc.x * params.right.w) -
+                                       params.up.xyz * (ndc.y * params.up.w));
+    hits[id.y * params.width + id.x] = traceTerrain(params.origin.xyz, direction, params.origin.w,
+                                                    structure, vertices, indices, tiles);
+}
@@ -0,0 +1,439 @@
+// lander_bench.cpp
+// Microbenchmarks for the simulation's hot paths (Google Benchmark)
+//
+// Run with --benchmark_out=results.json --benchmark_out_format=json (the
+// bench_json target does this) and compare two runs with Google
+// Benchmark's tools/compare.py to spot regressions between commits.
+
+#include <benchmark/benchmark.h>
+#include "core/Entity.h"
+#include "core/Log.h"
+#include "core/Physics.h"
+#include "core/SimdMath.h"
+#include "core/Terrain.h"
+#include "core/TrajectoryPredictor.h"
+#include "core/Units.h"
+#include <memory>
+#include <vector>
+
+// Window size the game builds its terrain for
+static const int kWindowWidth = 800;
+static const int kWindowHeight = 600;
+static const float kStep = 1.0f / 60.0f;
+
+// The benchmarks build and reset plenty; keep the log out of the timings
+static void QuietLog() {
+    Log::SetLevel(LogLevel::Warning);
+}
+
+// 3D terrain in meters, as Game::CreateTerrain sizes it
+static void Generate3DTerrain(Terrain& terrain) {
+    float width = Units::ToMeters(Pixels(static_cast<float>(kWindowWidth))).Value();
+    float height = Units::ToMeters(Pixels(static_cast<float>(kWindowHeight))).Value();
+    terrain.Generate3D(static_cast<int>(width), static_cast<int>(width), static_cast<int>(height));
+}
+
+// Lander positions spread over the terrain, half above and half touching
+static std::vector<float> SpreadPositions(float width, float length, float height, int count) {
+    std::vector<float> positions;
+    for (int i = 0; i < count; i++) {
+        float t = (i + 0.5f) / count;
+        positions.push_back(t * width);
+        positions.push_back((i & 1) ? height : 0.0f);
+        positions.push_back((1.0f - t) * length);
+    }
+    return positions;
+}
+
+/*
+ * Terrain
+ */
+
+static void BM_Terrain_CheckCollision2D(benchmark::State& state) {
+    QuietLog();
+    Terrain terrain;
+    terrain.Generate2D(kWindowWidth, kWindowHeight);
+    Lander lander;
+    std::vector<float> positions = SpreadPositions(Units::ToMeters(Pixels(kWindowWidth)).Value(), 0.0f,
+                                                   Units::ToMeters(Pixels(kWindowHeight)).Value(), 256);
+    
+    size_t next = 0;
+    for (auto _ : state) {
+        lander.SetPosition(positions[next], positions[next + 1]);
+        float height = 0.0f;
+        benchmark::DoNotOptimize(terrain.CheckCollision2D(&lander, height));
+        next = (next + 3) % positions.size();
+    }
+}
+BENCHMARK(BM_Terrain_CheckCollision2D);
+
+static void BM_Terrain_SweepCollision2D(benchmark::State& state) {
+    QuietLog();
+    Terrain terrain;
+    terrain.Generate2D(kWindowWidth, kWindowHeight);
+    std::vector<float> positions = SpreadPositions(Units::ToMeters(Pixels(kWindowWidth)).Value(), 0.0f,
+                                                   Units::ToMeters(Pixels(kWindowHeight)).Value(), 256);
+    
+    // 3 m drops, the most a 0.1 s step at 30 m/s covers
+    size_t next = 0;
+    for (auto _ : state) {
+        float x = positions[next];
+        float y = positions[next + 1];
+        float fraction = 0.0f;
+        float height = 0.0f;
+        benchmark::DoNotOptimize(terrain.SweepCollision2D(x, y + 1.5f, x + 0.5f, y - 1.5f, fraction, height));
+        next = (next + 3) % positions.size();
+    }
+}
+BENCHMARK(BM_Terrain_SweepCollision2D);
+
+static void BM_Terrain_CheckCollision3D(benchmark::State& state) {
+    QuietLog();
+    Terrain terrain;
+    Generate3DTerrain(terrain);
+    Lander lander;
+    std::vector<float> positions = SpreadPositions(static_cast<float>(terrain.GetWidth()),
+                                                   static_cast<float>(terrain.GetLength()),
+                                                   terrain.GetMaxHeight(), 256);
+    
+    size_t next = 0;
+    for (auto _ : state) {
+        lander.SetPosition(positions[next], positions[next + 1], positions[next + 2]);
+        float height = 0.0f;
+        benchmark::DoNotOptimize(terrain.CheckCollision3D(&lander, height));
+        next = (next + 3) % positions.size();
+    }
+}
+BENCHMARK(BM_Terrain_CheckCollision3D);
+
+static void BM_Terrain_SampleHeight(benchmark::State& state) {
+    QuietLog();
+    Terrain terrain;
+    Generate3DTerrain(terrain);
+    std::vector<float> positions = SpreadPositions(static_cast<float>(terrain.GetWidth()),
+                                                   static_cast<float>(terrain.GetLength()), 0.0f, 256);
+    
+    size_t next = 0;
+    for (auto _ : state) {
+        float height = 0.0f;
+        benchmark::DoNotOptimize(terrain.SampleHeight(positions[next], positions[next + 2], height));
+        next = (next + 3) % positions.size();
+    }
+}
+BENCHMARK(BM_Terrain_SampleHeight);
+
+// Full generation: noise, pad, collision triangles and normals
+static void BM_Terrain_Generate3D(benchmark::State& state) {
+    QuietLog();
+    Terrain terrain;
+    terrain.SetGeneratedGridSize(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        Generate3DTerrain(terrain);
+        benchmark::DoNotOptimize(terrain.GetHeightGrid().GetSamples().data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+}
+BENCHMARK(BM_Terrain_Generate3D)->Arg(64)->Arg(128)->Arg(256)->Arg(512)->Unit(benchmark::kMillisecond);
+
+// Incremental rebuild of the normals under a crater, the path every
+// terrain edit takes
+static void BM_Terrain_Deform(benchmark::State& state) {
+    QuietLog();
+    Terrain terrain;
+    terrain.SetGeneratedGridSize(static_cast<int>(state.range(0)));
+    Generate3DTerrain(terrain);
+    std::vector<float> positions = SpreadPositions(static_cast<float>(terrain.GetWidth()),
+                                                   static_cast<float>(terrain.GetLength()), 0.0f, 256);
+    
+    // Shallow enough that the terrain barely changes over a run, so every
+    // iteration rebuilds about the same area
+    size_t next = 0;
+    for (auto _ : state) {
+        terrain.Deform(positions[next], positions[next + 2], 4.0f, 1e-4f);
+        benchmark::DoNotOptimize(terrain.GetNormalData().data());
+        next = (next + 3) % positions.size();
+    }
+}
+BENCHMARK(BM_Terrain_Deform)->Arg(128)->Arg(512);
+
+/*
+ * Physics
+ */
+
+// Fly the lander from the reset position, putting it back whenever it
+// comes down
+static void RunPhysics(benchmark::State& state, bool use3D) {
+    QuietLog();
+    Terrain terrain;
+    if (use3D) {
+        Generate3DTerrain(terrain);
+    } else {
+        terrain.Generate2D(kWindowWidth, kWindowHeight);
+    }
+    
+    Lander lander;
+    lander.Reset();
+    lander.SetPosition(terrain.GetWidth() * (use3D ? 0.5f : 0.5f * Units::kMetersPerPixel), 20.0f,
+                       use3D ? terrain.GetLength() * 0.5f : 0.0f);
+    lander.ApplyThrust(0.5f);
+    
+    Physics physics;
+    physics.Set3DMode(use3D);
+    physics.Initialize();
+    physics.RegisterTerrain(&terrain);
+    physics.RegisterLander(&lander);
+    
+    for (auto _ : state) {
+        physics.Update(kStep);
+        if (lander.IsLanded() || lander.IsCrashed()) {
+            state.PauseTiming();
+            lander.Reset();
+            lander.SetPosition(terrain.GetWidth() * (use3D ? 0.5f : 0.5f * Units::kMetersPerPixel), 20.0f,
+                               use3D ? terrain.GetLength() * 0.5f : 0.0f);
+            lander.ApplyThrust(0.5f);
+            physics.RegisterLander(&lander);
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Physics_Update2D(benchmark::State& state) {
+    RunPhysics(state, false);
+}
+BENCHMARK(BM_Physics_Update2D);
+
+// One Bullet step: lander, heightfield and regolith
+static void BM_Physics_Update3D(benchmark::State& state) {
+    RunPhysics(state, true);
+}
+BENCHMARK(BM_Physics_Update3D)->Unit(benchmark::kMicrosecond);
+
+// Broadphase pair update for n boxes drifting over a 1 km square terrain,
+// spread up to 100 m above it as landers and debris would be: each
+// iteration moves every AABB, then updates the overlapping pairs
+// (arg 0: 0 = dbvt, 1 = sap, 2 = sap32; arg 1: bodies)
+static void BM_Broadphase_PairUpdate(benchmark::State& state) {
+    QuietLog();
+    const PhysicsBroadphase type = static_cast<PhysicsBroadphase>(state.range(0));
+    const int count = static_cast<int>(state.range(1));
+    const float size = 1000.0f;
+    const float ceiling = 100.0f;
+    const btVector3 halfExtents(1.0f, 1.0f, 1.0f);
+    
+    btDefaultCollisionConfiguration configuration;
+    btCollisionDispatcher dispatcher(&configuration);
+    std::unique_ptr<btBroadphaseInterface> broadphase(Physics::CreateBroadphase(
+        type, btVector3(-50.0f, -50.0f, -50.0f), btVector3(size + 50.0f, ceiling + 50.0f, size + 50.0f)));
+    
+    // The terrain: one static proxy under everything
+    btCollisionObject terrain;
+    terrain.setBroadphaseHandle(broadphase->createProxy(btVector3(0.0f, -10.0f, 0.0f), btVector3(size, 20.0f, size),
+                                                        TERRAIN_SHAPE_PROXYTYPE, &terrain,
+                                                        btBroadphaseProxy::StaticFilter,
+                                                        btBroadphaseProxy::AllFilter ^ btBroadphaseProxy::StaticFilter,
+                                                        &dispatcher));
+    
+    std::vector<btCollisionObject> bodies(static_cast<size_t>(count));
+    std::vector<btVector3> positions;
+    std::vector<float> positionData = SpreadPositions(size, size, ceiling, count);
+    for (int i = 0; i < count; i++) {
+        btVector3 position(positionData[i * 3], positionData[i * 3 + 1] + (i % 7) * 2.0f, positionData[i * 3 + 2]);
+        positions.push_back(position);
+        bodies[i].setBroadphaseHandle(broadphase->createProxy(position - halfExtents, position + halfExtents,
+                                                              BOX_SHAPE_PROXYTYPE, &bodies[i],
+                                                              btBroadphaseProxy::DefaultFilter,
+                                                              btBroadphaseProxy::AllFilter, &dispatcher));
+    }
+    broadphase->calculateOverlappingPairs(&dispatcher);
+    
+    // A tenth of a meter a step sideways, wrapping at the far edge
+    for (auto _ : state) {
+        for (int i = 0; i < count; i++) {
+            btVector3& position = positions[i];
+            position.setX(position.x() + 0.1f > size ? 0.0f : position.x() + 0.1f);
+            broadphase->setAabb(bodies[i].getBroadphaseHandle(), position - halfExtents, position + halfExtents,
+                                &dispatcher);
+        }
+        broadphase->calculateOverlappingPairs(&dispatcher);
+    }
+    state.counters["pairs"] = broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+    state.SetItemsProcessed(state.iterations() * count);
+    
+    for (btCollisionObject& body : bodies) {
+        broadphase->destroyProxy(body.getBroadphaseHandle(), &dispatcher);
+    }
+    broadphase->destroyProxy(terrain.getBroadphaseHandle(), &dispatcher);
+}
+BENCHMARK(BM_Broadphase_PairUpdate)
+    ->ArgsProduct({ { 0, 1, 2 }, { 10, 1000, 10000 } })
+    ->ArgNames({ "type", "bodies" })
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * Trajectory prediction, per Game frame
+ */
+
+// Lander 20 m up over the middle of the terrain, drifting sideways
+static void SetUpPrediction(Terrain& terrain, Lander& lander, bool use3D, float thrust) {
+    QuietLog();
+    if (use3D) {
+        Generate3DTerrain(terrain);
+    } else {
+        terrain.Generate2D(kWindowWidth, kWindowHeight);
+    }
+    lander.Reset();
+    lander.SetPosition(terrain.GetWidth() * (use3D ? 0.5f : 0.5f * Units::kMetersPerPixel), 20.0f,
+                       use3D ? terrain.GetLength() * 0.5f : 0.0f);
+    lander.GetVelocity()[0] = 0.5f;
+    lander.ApplyThrust(thrust);
+}
+
+// Engine off: the closed-form solve an input change costs (arg 1 = 3D)
+static void BM_Prediction_Ballistic(benchmark::State& state) {
+    const bool use3D = state.range(0) != 0;
+    Terrain terrain;
+    Lander lander;
+    SetUpPrediction(terrain, lander, use3D, 0.0f);
+    
+    TrajectoryPredictor predictor;
+    for (auto _ : state) {
+        predictor.Invalidate();
+        predictor.Update(lander, terrain, 1.62f, use3D, 0, kStep);
+        benchmark::DoNotOptimize(predictor.GetImpact());
+    }
+}
+BENCHMARK(BM_Prediction_Ballistic)->Arg(0)->Arg(1);
+
+// Engine on: one Update extending the path, starting over once it reaches
+// the surface (arg 1 = 3D)
+static void BM_Prediction_ThrustingUpdate(benchmark::State& state) {
+    const bool use3D = state.range(0) != 0;
+    Terrain terrain;
+    Lander lander;
+    SetUpPrediction(terrain, lander, use3D, 0.3f);
+    
+    TrajectoryPredictor predictor;
+    for (auto _ : state) {
+        predictor.Update(lander, terrain, 1.62f, use3D, 0, kStep);
+        if (predictor.HasImpact()) {
+            state.PauseTiming();
+            predictor.Invalidate();
+            state.ResumeTiming();
+        }
+    }
+}
+BENCHMARK(BM_Prediction_ThrustingUpdate)->Arg(0)->Arg(1);
+
+// Nothing changed since the last frame
+static void BM_Prediction_Cached(benchmark::State& state) {
+    Terrain terrain;
+    Lander lander;
+    SetUpPrediction(terrain, lander, false, 0.0f);
+    
+    TrajectoryPredictor predictor;
+    predictor.Update(lander, terrain, 1.62f, false, 0, kStep);
+    for (auto _ : state) {
+        predictor.Update(lander, terrain, 1.62f, false, 0, kStep);
+        benchmark::DoNotOptimize(predictor.GetImpact());
+    }
+}
+BENCHMARK(BM_Prediction_Cached);
+
+/*
+ * Entity systems
+ */
+
+// One fixed step's entity work (fuel burn, transform save, render
+// interpolation) for n landers sharing a store
+static void BM_Entities_Systems(benchmark::State& state) {
+    QuietLog();
+    EntityStore store;
+    std::vector<std::unique_ptr<Lander>> landers;
+    for (int i = 0; i < state.range(0); i++) {
+        landers.push_back(std::make_unique<Lander>(&store));
+        landers.back()->SetPosition(static_cast<float>(i), 10.0f, 0.0f);
+        landers.back()->ApplyThrust(0.5f);
+    }
+    
+    for (auto _ : state) {
+        store.SavePreviousTransforms();
+        store.UpdateFuel(1e-6f);
+        store.InterpolateRenderTransforms(0.5f);
+        benchmark::DoNotOptimize(store.Transforms().Data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Entities_Systems)->Arg(1)->Arg(1024)->Arg(16384);
+
+/*
+ * Matrix math, composed as Renderer3D_Metal's Create*Matrix does it
+ */
+
+static void BM_Matrix_Model(benchmark::State& state) {
+    const float position[3] = { 12.0f, 8.0f, -3.0f };
+    const float scale[3] = { 1.0f, 1.5f, 1.0f };
+    Quaternion orientation = SimdMath::QuaternionFromEulerDegrees(10.0f, 35.0f, 5.0f);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(orientation);
+        Matrix4x4 model = SimdMath::Multiply(SimdMath::Scale(scale[0], scale[1], scale[2]),
+                                             SimdMath::Rotation(orientation));
+        model.values[12] = position[0];
+        model.values[13] = position[1];
+        model.values[14] = position[2];
+        benchmark::DoNotOptimize(model);
+    }
+}
+BENCHMARK(BM_Matrix_Model);
+
+static void BM_Matrix_View(benchmark::State& state) {
+    float eye[3] = { 0.0f, 30.0f, 60.0f };
+    const float target[3] = { 0.0f, 0.0f, 0.0f };
+    const float up[3] = { 0.0f, 1.0f, 0.0f };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(eye);
+        Matrix4x4 view = SimdMath::LookAt(eye, target, up);
+        benchmark::DoNotOptimize(view);
+    }
+}
+BENCHMARK(BM_Matrix_View);
+
+static void BM_Matrix_Projection(benchmark::State& state) {
+    float aspect = 16.0f / 9.0f;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(aspect);
+        Matrix4x4 projection = SimdMath::Perspective(45.0f * (3.14159265f / 180.0f), aspect, 0.1f, 1000.0f);
+        benchmark::DoNotOptimize(projection);
+    }
+}
+BENCHMARK(BM_Matrix_Projection);
+
+static void BM_Matrix_ModelViewProjection(benchmark::State& state) {
+    const float eye[3] = { 0.0f, 30.0f, 60.0f };
+    const float target[3] = { 0.0f, 0.0f, 0.0f };
+    const float up[3] = { 0.0f, 1.0f, 0.0f };
+    Matrix4x4 view = SimdMath::LookAt(eye, target, up);
+    Matrix4x4 projection = SimdMath::Perspective(45.0f * (3.14159265f / 180.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    Matrix4x4 model = SimdMath::Rotation(SimdMath::QuaternionFromEulerDegrees(10.0f, 35.0f, 5.0f));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(model);
+        Matrix4x4 mvp = SimdMath::Multiply(projection, SimdMath::Multiply(view, model));
+        benchmark::DoNotOptimize(mvp);
+    }
+}
+BENCHMARK(BM_Matrix_ModelViewProjection);
+
+static void BM_Matrix_InverseAffine(benchmark::State& state) {
+    const float eye[3] = { 0.0f, 30.0f, 60.0f };
+    const float target[3] = { 0.0f, 0.0f, 0.0f };
+    const float up[3] = { 0.0f, 1.0f, 0.0f };
+    Matrix4x4 view = SimdMath::LookAt(eye, target, up);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(view);
+        Matrix4x4 inverse = SimdMath::InverseAffine(view);
+        benchmark::DoNotOptimize(inverse);
+    }
+}
+BENCHMARK(BM_Matrix_InverseAffine);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,273 @@
+// AudioEngine.cpp
+// Audio callback mixer and the simulation's side of its queue
+
+#include "AudioEngine.h"
+#include "../core/Log.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float kTwoPi = 6.28318531f;
+
+// How long parameter changes take to settle
+static const float kGlideSeconds = 0.03f;
+
+// Proximity beeps: a tone this long, repeating from every kSlowBeep seconds
+// at the alert altitude to every kFastBeep at the ground, while descending
+// faster than kAlertDescentRate
+static const float kBeepSeconds = 0.05f;
+static const float kBeepRamp = 0.004f;
+static const float kSlowBeep = 0.8f;
+static const float kFastBeep = 0.12f;
+static const float kAlertDescentRate = 0.5f;       // m/s
+static const float kBeepFrequency = 1200.0f;
+
+static void OnAudioCallback(void* userdata, Uint8* stream, int length) {
+    // SDL passes the buffer's bytes
+    AudioEngine* engine = static_cast<AudioEngine*>(userdata);
+    engine->Mix(reinterpret_cast<float*>(stream), length / static_cast<int>(sizeof(float) * engine->GetChannels()));
+}
+
+// Cubic soft clip: unity gain near zero, flattening to +-1
+static float SoftClip(float x) {
+    x = std::min(std::max(x, -1.0f), 1.0f);
+    return x * (1.5f - 0.5f * x * x);
+}
+
+AudioEngine::AudioEngine()
+    : mDropped(0)
+    , mDevice(0)
+    , mSampleRate(kSampleRate)
+    , mChannels(2)
+    , mBufferFrames(kBufferFrames)
+    , mGlide(0.0f)
+    , mRumbleGain(0.0f)
+    , mRcsGain(0.0f)
+    , mHissLow(0.0f)
+    , mHumPhase(0.0f)
+    , mBeepClock(kSlowBeep)
+    , mBeepPhase(0.0f)
+    , mNoise(0x9E3779B9u)
+{
+    std::memset(&mTarget, 0, sizeof(mTarget));
+    mTarget.altitude = -1.0f;
+    mRumbleLow[0] = mRumbleLow[1] = 0.0f;
+    for (Voice& voice : mVoices) {
+        std::memset(&voice, 0, sizeof(voice));
+    }
+}
+
+AudioEngine::~AudioEngine() {
+    Stop();
+}
+
+bool AudioEngine::Start() {
+    Stop();
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        LOG_WARNING("No audio (%s)", SDL_GetError());
+        return false;
+    }
+    
+    // Small buffers for latency; SDL converts from float if the device
+    // wants another format, and the rate and channels follow the device
+    SDL_AudioSpec desired;
+    std::memset(&desired, 0, sizeof(desired));
+    desired.freq = kSampleRate;
+    desired.format = AUDIO_F32SYS;
+    desired.channels = 2;
+    desired.samples = kBufferFrames;
+    desired.callback = OnAudioCallback;
+    desired.userdata = this;
+    SDL_AudioSpec obtained;
+    SDL_AudioDeviceID device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained,
+                                                   SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                                   SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    if (device == 0) {
+        LOG_WARNING("No audio device (%s)", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    mSampleRate = obtained.freq;
+    mChannels = std::max(1, static_cast<int>(obtained.channels));
+    mBufferFrames = obtained.samples;
+    mGlide = 1.0f - std::exp(-1.0f / (kGlideSeconds * mSampleRate));
+    mDevice = device;
+    
+    const float latencyMs = GetLatencyMs();
+    if (latencyMs > kMaxLatencyMs) {
+        LOG_WARNING("Audio buffers are %d frames (%.1f ms), over the %.0f ms target", mBufferFrames, latencyMs,
+                    kMaxLatencyMs);
+    }
+    LOG_INFO("Audio: %d Hz, %d channels, %d frame buffers (%.1f ms)", mSampleRate, mChannels, mBufferFrames,
+             latencyMs);
+    SDL_PauseAudioDevice(device, 0);
+    return true;
+}
+
+void AudioEngine::Stop() {
+    if (mDevice == 0) {
+        return;
+    }
+    
+    // Returns once the callback has finished its last buffer
+    SDL_CloseAudioDevice(mDevice);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    mDevice = 0;
+    if (mDropped > 0) {
+        LOG_INFO("Audio dropped %llu updates on a full queue", static_cast<unsigned long long>(mDropped.load()));
+    }
+}
+
+float AudioEngine::GetLatencyMs() const {
+    return 1000.0f * mBufferFrames / std::max(mSampleRate, 1);
+}
+
+void AudioEngine::SetParams(const AudioParams& params) {
+    Command command;
+    std::memset(&command, 0, sizeof(command));
+    command.type = Command::Params;
+    command.params = params;
+    if (!mCommands.Push(command)) {
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AudioEngine::PlayEvent(AudioEvent event) {
+    Command command;
+    std::memset(&command, 0, sizeof(command));
+    command.type = Command::Event;
+    command.event = event;
+    if (!mCommands.Push(command)) {
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+float AudioEngine::NextNoise() {
+    mNoise ^= mNoise << 13;
+    mNoise ^= mNoise >> 17;
+    mNoise ^= mNoise << 5;
+    return static_cast<int32_t>(mNoise) * (1.0f / 2147483648.0f);
+}
+
+void AudioEngine::StartVoice(float delay, float duration, float frequency, float sweep, float noise, float gain,
+                             float decaySeconds) {
+    // A free voice, else the one closest to finishing
+    Voice* voice = &mVoices[0];
+    for (Voice& candidate : mVoices) {
+        if (candidate.remaining <= 0.0f) {
+            voice = &candidate;
+            break;
+        }
+        if (candidate.delay + candidate.remaining < voice->delay + voice->remaining) {
+            voice = &candidate;
+        }
+    }
+    voice->delay = delay;
+    voice->remaining = duration;
+    voice->frequency = frequency;
+    voice->sweep = sweep;
+    voice->phase = 0.0f;
+    voice->noise = noise;
+    voice->gain = gain;
+    voice->decay = std::exp(-1.0f / (decaySeconds * mSampleRate));
+}
+
+void AudioEngine::PlayEventVoices(AudioEvent event) {
+    switch (event) {
+    case AudioEvent::Landed:
+        // Rising two-note chime
+        StartVoice(0.0f, 0.35f, 660.0f, 0.0f, 0.0f, 0.25f, 0.25f);
+        StartVoice(0.15f, 0.6f, 990.0f, 0.0f, 0.0f, 0.25f, 0.35f);
+        break;
+    case AudioEvent::Crashed:
+        // A noise burst over a thud falling in pitch
+        StartVoice(0.0f, 1.5f, 0.0f, 0.0f, 1.0f, 0.9f, 0.4f);
+        StartVoice(0.0f, 0.8f, 90.0f, -80.0f, 0.0f, 0.8f, 0.3f);
+        break;
+    case AudioEvent::LowFuel:
+        // Two short low beeps
+        StartVoice(0.0f, 0.12f, 440.0f, 0.0f, 0.0f, 0.2f, 1.0f);
+        StartVoice(0.2f, 0.12f, 440.0f, 0.0f, 0.0f, 0.2f, 1.0f);
+        break;
+    }
+}
+
+void AudioEngine::Mix(float* out, int frames) {
+    Command command;
+    while (mCommands.Pop(command)) {
+        if (command.type == Command::Params) {
+            mTarget = command.params;
+        } else {
+            PlayEventVoices(command.event);
+        }
+    }
+    
+    // Per-buffer settings: the rumble's cutoff rises with the thrust, and
+    // the proximity beeps speed up near the ground
+    const float dt = 1.0f / mSampleRate;
+    const float rumbleCutoff = 60.0f + 500.0f * mRumbleGain;
+    const float rumbleCoefficient = 1.0f - std::exp(-kTwoPi * rumbleCutoff * dt);
+    const float hissCoefficient = 1.0f - std::exp(-kTwoPi * 2500.0f * dt);
+    const float humFrequency = 32.0f + 28.0f * mRumbleGain;
+    const float rumbleTarget = mTarget.flying ? mTarget.thrustLevel : 0.0f;
+    const float rcsTarget = mTarget.flying ? mTarget.rcsLevel : 0.0f;
+    const bool alert = mTarget.flying && mTarget.altitude >= 0.0f && mTarget.altitude < kAlertAltitude &&
+                       mTarget.descentRate > kAlertDescentRate;
+    const float closeness = alert ? mTarget.altitude / kAlertAltitude : 1.0f;
+    const float beepPeriod = kFastBeep + (kSlowBeep - kFastBeep) * closeness;
+    
+    for (int frame = 0; frame < frames; frame++) {
+        const float noise = NextNoise();
+        mRumbleGain += (rumbleTarget - mRumbleGain) * mGlide;
+        mRcsGain += (rcsTarget - mRcsGain) * mGlide;
+        
+        // Engine: lowpassed noise, with a hum under it
+        mRumbleLow[0] += rumbleCoefficient * (noise - mRumbleLow[0]);
+        mRumbleLow[1] += rumbleCoefficient * (mRumbleLow[0] - mRumbleLow[1]);
+        mHumPhase += humFrequency * dt;
+        mHumPhase -= std::floor(mHumPhase);
+        float sample = mRumbleGain * (1.6f * mRumbleLow[1] + 0.12f * std::sin(kTwoPi * mHumPhase));
+        
+        // RCS: the noise above the hiss lowpass
+        mHissLow += hissCoefficient * (noise - mHissLow);
+        sample += 0.08f * mRcsGain * (noise - mHissLow);
+        
+        // Proximity: a ramped tone at the start of every period. Out of
+        // the alert the clock waits at the end of a period, so the first
+        // beep comes as soon as the alert does.
+        mBeepClock += dt;
+        if (mBeepClock >= beepPeriod) {
+            mBeepClock = alert ? 0.0f : beepPeriod;
+        }
+        if (alert && mBeepClock < kBeepSeconds) {
+            const float envelope = std::min(1.0f, std::min(mBeepClock, kBeepSeconds - mBeepClock) / kBeepRamp);
+            mBeepPhase += kBeepFrequency * dt;
+            mBeepPhase -= std::floor(mBeepPhase);
+            sample += 0.18f * envelope * std::sin(kTwoPi * mBeepPhase);
+        }
+        
+        // Event voices
+        for (Voice& voice : mVoices) {
+            if (voice.remaining <= 0.0f) {
+                continue;
+            }
+            if (voice.delay > 0.0f) {
+                voice.delay -= dt;
+                continue;
+            }
+            voice.phase += voice.frequency * dt;
+            voice.phase -= std::floor(voice.phase);
+            voice.frequency = std::max(0.0f, voice.frequency + voice.sweep * dt);
+            const float tone = std::sin(kTwoPi * voice.phase);
+            sample += voice.gain * (tone + voice.noise * (noise - tone));
+            voice.gain *= voice.decay;
+            voice.remaining -= dt;
+        }
+        
+        sample = SoftClip(sample);
+        for (int channel = 0; channel < mChannels; channel++) {
+            *out++ = sample;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+// AudioEngine.h
+// Engine rumble, proximity alert and event sounds synthesized in an SDL audio callback
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "../core/SpscQueue.h"
+
+enum class AudioEvent : uint8_t {
+    Landed,
+    Crashed,
+    LowFuel
+};
+
+// The lander as the sounds follow it, sent every fixed step
+struct AudioParams {
+    float thrustLevel;      // 0 - 1, 0 with the engine off
+    float rcsLevel;         // |RCS command|, 0 - 1
+    float altitude;         // Above the ground, meters (< 0 = unknown)
+    float descentRate;      // m/s, positive falling
+    bool flying;
+};
+
+// Mixes everything itself, sample by sample, inside the device's callback:
+// filtered noise and a hum for the engine, scaled by the thrust level; a
+// hiss for the RCS; beeps that speed up as a descending lander nears the
+// ground; and a few short voices for events. The simulation thread never
+// touches the mixer's state. SetParams and PlayEvent go through a
+// single-producer queue the callback drains at the start of each buffer, so
+// the callback never locks, allocates or logs, and the simulation never
+// waits on it. Parameters glide to their new values over a few
+// milliseconds, so step-rate updates don't click.
+class AudioEngine {
+public:
+    static constexpr int kSampleRate = 48000;
+    static constexpr int kBufferFrames = 256;           // 5.3 ms at 48 kHz
+    static constexpr float kMaxLatencyMs = 10.0f;       // Warned about above this
+    static constexpr float kAlertAltitude = 30.0f;      // Proximity beeps start below this, meters
+    static constexpr int kMaxVoices = 8;
+    
+    AudioEngine();
+    ~AudioEngine();
+    
+    AudioEngine(const AudioEngine&) = delete;
+    AudioEngine& operator=(const AudioEngine&) = delete;
+    
+    // Open the default output device and start the callback; false (the
+    // game runs silent) without one
+    bool Start();
+    void Stop();
+    bool IsRunning() const { return mDevice != 0; }
+    
+    // Simulation thread, one at a time. Neither blocks; with the queue full
+    // the update is dropped (the next step's replaces it anyway).
+    void SetParams(const AudioParams& params);
+    void PlayEvent(AudioEvent event);
+    uint64_t GetDroppedCommands() const { return mDropped.load(std::memory_order_relaxed); }
+    
+    // The device's buffer, as opened
+    float GetLatencyMs() const;
+    int GetChannels() const { return mChannels; }
+    
+    // Audio thread: frames of float samples, interleaved GetChannels() to a
+    // frame
+    void Mix(float* out, int frames);
+
+private:
+    struct Command {
+        enum Type : uint8_t { Params, Event } type;
+        AudioEvent event;
+        AudioParams params;
+    };
+    
+    // A sine (sweeping in frequency) mixed with noise under a decaying
+    // envelope, starting after a delay
+    struct Voice {
+        float delay;            // Seconds before it sounds
+        float remaining;        // Seconds left once sounding (<= 0 = free)
+        float frequency;        // Hz
+        float sweep;            // Hz per second
+        float phase;            // Cycles, 0 - 1
+        float noise;            // Noise share, 0 - 1
+        float gain;
+        float decay;            // Gain kept per sample
+    };
+    
+    void StartVoice(float delay, float duration, float frequency, float sweep, float noise, float gain,
+                    float decaySeconds);
+    void PlayEventVoices(AudioEvent event);
+    float NextNoise();
+    
+    SpscQueue<Command, 256> mCommands;
+    std::atomic<uint64_t> mDropped;
+    uint32_t mDevice;           // SDL_AudioDeviceID, 0 = closed
+    int mSampleRate;
+    int mChannels;
+    int mBufferFrames;
+    
+    // Audio thread only, from here on
+    AudioParams mTarget;
+    float mGlide;               // Per-sample share of the way to a target
+    float mRumbleGain;
+    float mRcsGain;
+    float mRumbleLow[2];        // Two one-pole lowpass stages over the noise
+    float mHissLow;             // Lowpass the hiss is the noise minus
+    float mHumPhase;
+    float mBeepClock;           // Seconds since the last proximity beep began
+    float mBeepPhase;
+    uint32_t mNoise;            // xorshift32 state
+    Voice mVoices[kMaxVoices];
+};
@@ -0,0 +1,235 @@
+// Camera.cpp
+// Camera rigs, spring smoothing and the view, projection and frustum
+
+#include "Camera.h"
+#include <algorithm>
+#include <cstring>
+
+static const float kDefaultFieldOfView = 45.0f * static_cast<float>(M_PI / 180.0);
+static const float kDefaultNear = 0.1f;
+static const float kDefaultFar = 1000.0f;
+static const float kOrbitRate = 0.25f;          // Radians per second
+static const float kMaxFrameTime = 0.25f;       // Longer frames don't replay every step
+
+// One step of a critically damped spring towards goal (Game Programming
+// Gems 4, "Critically Damped Ease-In/Ease-Out Smoothing"), with its
+// polynomial stand-in for the exponential decay. It never overshoots.
+static void SmoothStep(float& value, float& velocity, float goal, float smoothTime, float deltaTime) {
+    if (smoothTime <= 0.0f) {
+        value = goal;
+        velocity = 0.0f;
+        return;
+    }
+    const float omega = 2.0f / smoothTime;
+    const float x = omega * deltaTime;
+    const float decay = 1.0f / (1.0f + x + 0.48f * x * x + 0.235f * x * x * x);
+    const float change = value - goal;
+    const float temp = (velocity + omega * change) * deltaTime;
+    velocity = (velocity - omega * temp) * decay;
+    value = goal + (change + temp) * decay;
+}
+
+Camera::Camera()
+    : mMode(CameraMode::Chase)
+    , mOrbitAngle(0.0f)
+    , mTimeStep(1.0f / 120.0f)
+    , mSmoothTime(0.15f)
+    , mAccumulator(0.0f)
+    , mHasState(false)
+    , mFieldOfView(kDefaultFieldOfView)
+    , mNear(kDefaultNear)
+    , mFar(kDefaultFar)
+    , mAspect(4.0f / 3.0f)
+    , mDirty(true)
+    , mVersion(0)
+{
+    // Beside, above and behind the lander
+    SetChaseOffset(-30.0f, 20.0f, 40.0f);
+    
+    const float position[3] = { 0.0f, 100.0f, 200.0f };
+    const float target[3] = { 0.0f, 0.0f, 0.0f };
+    std::copy(position, position + 3, mPosition);
+    std::copy(target, target + 3, mTarget);
+    SetFreePose(position, target);
+    std::copy(position, position + 3, mFixedPosition);
+    std::copy(position, position + 3, mEye);
+    std::copy(target, target + 3, mLookAt);
+    std::copy(position, position + 3, mPreviousEye);
+    std::copy(target, target + 3, mPreviousLookAt);
+    std::fill(mEyeVelocity, mEyeVelocity + 3, 0.0f);
+    std::fill(mLookAtVelocity, mLookAtVelocity + 3, 0.0f);
+    mUp[0] = 0.0f;
+    mUp[1] = 1.0f;
+    mUp[2] = 0.0f;
+    UpdateMatrices();
+}
+
+void Camera::SetMode(CameraMode mode) {
+    if (mode == mMode || mode == CameraMode::Count) return;
+    mMode = mode;
+    
+    // Fixed and free start from where the camera is; orbit from its bearing
+    std::copy(mPosition, mPosition + 3, mFixedPosition);
+    if (mode == CameraMode::Free) {
+        SetFreePose(mPosition, mTarget);
+    } else if (mode == CameraMode::Orbit) {
+        mOrbitAngle = std::atan2(mPosition[0] - mTarget[0], mPosition[2] - mTarget[2]);
+    }
+}
+
+void Camera::CycleMode() {
+    SetMode(static_cast<CameraMode>((static_cast<int>(mMode) + 1) % static_cast<int>(CameraMode::Count)));
+}
+
+const char* Camera::GetModeName(CameraMode mode) {
+    switch (mode) {
+        case CameraMode::Chase: return "chase";
+        case CameraMode::Fixed: return "fixed";
+        case CameraMode::Orbit: return "orbit";
+        case CameraMode::Free: return "free";
+        default: return "unknown";
+    }
+}
+
+void Camera::SetChaseOffset(float x, float y, float z) {
+    mChaseOffset[0] = x;
+    mChaseOffset[1] = y;
+    mChaseOffset[2] = z;
+}
+
+void Camera::SetFreePose(const float* position, const float* target) {
+    std::copy(position, position + 3, mFreePosition);
+    std::copy(target, target + 3, mFreeTarget);
+}
+
+void Camera::SetLens(float fovY, float nearZ, float farZ) {
+    mFieldOfView = fovY;
+    mNear = nearZ;
+    mFar = farZ;
+    mDirty = true;
+}
+
+void Camera::SetAspect(float aspect) {
+    if (aspect <= 0.0f || aspect == mAspect) return;
+    mAspect = aspect;
+    mDirty = true;
+}
+
+void Camera::ComputeGoal(const float* subject, float* eye, float* target) const {
+    switch (mMode) {
+        case CameraMode::Chase:
+            for (int i = 0; i < 3; i++) {
+                eye[i] = subject[i] + mChaseOffset[i];
+            }
+            std::copy(subject, subject + 3, target);
+            break;
+        case CameraMode::Fixed:
+            std::copy(mFixedPosition, mFixedPosition + 3, eye);
+            std::copy(subject, subject + 3, target);
+            break;
+        case CameraMode::Orbit: {
+            const float distance = std::sqrt(mChaseOffset[0] * mChaseOffset[0] + mChaseOffset[2] * mChaseOffset[2]);
+            eye[0] = subject[0] + distance * std::sin(mOrbitAngle);
+            eye[1] = subject[1] + mChaseOffset[1];
+            eye[2] = subject[2] + distance * std::cos(mOrbitAngle);
+            std::copy(subject, subject + 3, target);
+            break;
+        }
+        default:
+            std::copy(mFreePosition, mFreePosition + 3, eye);
+            std::copy(mFreeTarget, mFreeTarget + 3, target);
+            break;
+    }
+}
+
+void Camera::Step(const float* subject) {
+    if (mMode == CameraMode::Orbit) {
+        mOrbitAngle = std::fmod(mOrbitAngle + kOrbitRate * mTimeStep, 2.0f * static_cast<float>(M_PI));
+    }
+    float eye[3];
+    float target[3];
+    ComputeGoal(subject, eye, target);
+    std::copy(mEye, mEye + 3, mPreviousEye);
+    std::copy(mLookAt, mLookAt + 3, mPreviousLookAt);
+    for (int i = 0; i < 3; i++) {
+        SmoothStep(mEye[i], mEyeVelocity[i], eye[i], mSmoothTime, mTimeStep);
+        SmoothStep(mLookAt[i], mLookAtVelocity[i], target[i], mSmoothTime, mTimeStep);
+    }
+}
+
+void Camera::Update(float deltaTime, const float* subject) {
+    if (!mHasState) {
+        Cut(subject);
+        return;
+    }
+    
+    // Whole steps at the fixed rate; the frame shows the blend of the last
+    // two, lagging the goal by under a step as the lander's interpolation does
+    mAccumulator += std::min(std::max(deltaTime, 0.0f), kMaxFrameTime);
+    while (mTimeStep > 0.0f && mAccumulator >= mTimeStep) {
+        Step(subject);
+        mAccumulator -= mTimeStep;
+    }
+    const float alpha = mTimeStep > 0.0f ? mAccumulator / mTimeStep : 1.0f;
+    
+    float position[3];
+    float target[3];
+    for (int i = 0; i < 3; i++) {
+        position[i] = mPreviousEye[i] + (mEye[i] - mPreviousEye[i]) * alpha;
+        target[i] = mPreviousLookAt[i] + (mLookAt[i] - mPreviousLookAt[i]) * alpha;
+    }
+    if (std::memcmp(position, mPosition, sizeof(position)) != 0 || std::memcmp(target, mTarget, sizeof(target)) != 0) {
+        std::copy(position, position + 3, mPosition);
+        std::copy(target, target + 3, mTarget);
+        mDirty = true;
+    }
+}
+
+void Camera::Cut(const float* subject) {
+    ComputeGoal(subject, mEye, mLookAt);
+    std::copy(mEye, mEye + 3, mPreviousEye);
+    std::copy(mLookAt, mLookAt + 3, mPreviousLookAt);
+    std::fill(mEyeVelocity, mEyeVelocity + 3, 0.0f);
+    std::fill(mLookAtVelocity, mLookAtVelocity + 3, 0.0f);
+    mAccumulator = 0.0f;
+    mHasState = true;
+    std::copy(mEye, mEye + 3, mPosition);
+    std::copy(mLookAt, mLookAt + 3, mTarget);
+    mDirty = true;
+}
+
+void Camera::ShiftOrigin(const float* shift) {
+    float* points[] = {mFreePosition, mFreeTarget, mFixedPosition, mEye, mLookAt,
+                       mPreviousEye, mPreviousLookAt, mPosition, mTarget};
+    for (float* point : points) {
+        for (int i = 0; i < 3; i++) {
+            point[i] -= shift[i];
+        }
+    }
+    mDirty = true;
+}
+
+void Camera::UpdateMatrices() {
+    if (!mDirty) return;
+    mDirty = false;
+    mViewMatrix = SimdMath::LookAt(mPosition, mTarget, mUp);
+    mProjectionMatrix = SimdMath::Perspective(mFieldOfView, mAspect, mNear, mFar);
+    mViewProjectionMatrix = SimdMath::Multiply(mProjectionMatrix, mViewMatrix);
+    ExtractFrustumPlanes(mProjectionMatrix, mViewMatrix, mFrustumPlanes);
+    mVersion++;
+}
+
+void Camera::ExtractFrustumPlanes(const Matrix4x4& projection, const Matrix4x4& view, float planes[6][4]) {
+    const Matrix4x4 clip = SimdMath::Multiply(projection, view);
+    
+    // Plane i combines rows of clip (values[column * 4 + row])
+    for (int i = 0; i < 4; i++) {
+        const float* column = clip.values + i * 4;
+        planes[0][i] = column[3] + column[0];   // Left
+        planes[1][i] = column[3] - column[0];   // Right
+        planes[2][i] = column[3] + column[1];   // Bottom
+        planes[3][i] = column[3] - column[1];   // Top
+        planes[4][i] = column[2];               // Near
+        planes[5][i] = column[3] - column[2];   // Far
+    }
+}
@@ -0,0 +1,120 @@
+// Camera.h
+// Camera rigs that follow the lander, with the matrices and frustum they are drawn with
+
+#pragma once
+
+#include "SimdMath.h"
+#include <cstdint>
+
+enum class CameraMode {
+    Chase,      // At an offset from the subject, looking at it
+    Fixed,      // Stays where it was when picked, looking at the subject
+    Orbit,      // Circles the subject at the chase offset's distance and height
+    Free,       // Holds its own position and target (SetFreePose())
+    Count
+};
+
+// The rig's eye and look-at point follow their goals through critically
+// damped springs, stepped at a fixed rate (the physics step) whatever the
+// frame rate, and blended between the last two steps for the frame, so the
+// smoothing feels the same at 30 Hz and 240 Hz. The view, projection and
+// frustum are rebuilt only when the blended pose or the lens changed;
+// GetVersion() tells the renderer when to take them.
+class Camera {
+public:
+    Camera();
+    
+    void SetMode(CameraMode mode);
+    CameraMode GetMode() const { return mMode; }
+    void CycleMode();
+    static const char* GetModeName(CameraMode mode);
+    
+    // Eye offset from the subject in chase mode (meters, world axes); orbit
+    // keeps its height and horizontal distance
+    void SetChaseOffset(float x, float y, float z);
+    
+    // Pose the free camera holds
+    void SetFreePose(const float* position, const float* target);
+    
+    // Vertical field of view (radians), clip distances and width / height
+    void SetLens(float fovY, float nearZ, float farZ);
+    void SetAspect(float aspect);
+    
+    // Seconds per smoothing step and the springs' smoothing time (about the
+    // time to close most of a gap); 0 follows the goal exactly
+    void SetTimeStep(float seconds) { mTimeStep = seconds; }
+    void SetSmoothTime(float seconds) { mSmoothTime = seconds; }
+    
+    // Advance by a frame of deltaTime seconds following subject (the
+    // lander's render position)
+    void Update(float deltaTime, const float* subject);
+    
+    // Jump to the goal for subject without smoothing, e.g. after a reset
+    void Cut(const float* subject);
+    
+    // Move every point the rig holds by -shift (meters), keeping the
+    // springs' motion, when the world's origin moves by shift
+    void ShiftOrigin(const float* shift);
+    
+    // Rebuild the matrices and frustum if the pose or lens changed
+    void UpdateMatrices();
+    
+    const float* GetPosition() const { return mPosition; }
+    const float* GetTarget() const { return mTarget; }
+    const float* GetUp() const { return mUp; }
+    const Matrix4x4& GetViewMatrix() const { return mViewMatrix; }
+    const Matrix4x4& GetProjectionMatrix() const { return mProjectionMatrix; }
+    const Matrix4x4& GetViewProjectionMatrix() const { return mViewProjectionMatrix; }
+    
+    // Planes (a, b, c, d with ax + by + cz + d >= 0 inside) of the view
+    // frustum in world space: left, right, bottom, top, near, far
+    const float (&GetFrustumPlanes() const)[6][4] { return mFrustumPlanes; }
+    
+    // Changes whenever UpdateMatrices() rebuilt the matrices
+    uint32_t GetVersion() const { return mVersion; }
+    
+    // Frustum planes from the rows of projection * view (column-major,
+    // Metal clip space with 0 <= z <= w)
+    static void ExtractFrustumPlanes(const Matrix4x4& projection, const Matrix4x4& view, float planes[6][4]);
+
+private:
+    // Where the eye and target springs are heading this step
+    void ComputeGoal(const float* subject, float* eye, float* target) const;
+    void Step(const float* subject);
+    
+    CameraMode mMode;
+    float mChaseOffset[3];
+    float mFreePosition[3];
+    float mFreeTarget[3];
+    float mFixedPosition[3];      // Captured when fixed mode was picked
+    float mOrbitAngle;            // Radians about +y, from +z
+    
+    // Springs: the last two steps' state and the eye and target velocities
+    float mEye[3];
+    float mLookAt[3];
+    float mPreviousEye[3];
+    float mPreviousLookAt[3];
+    float mEyeVelocity[3];
+    float mLookAtVelocity[3];
+    float mTimeStep;
+    float mSmoothTime;
+    float mAccumulator;           // Seconds not yet stepped
+    bool mHasState;               // False until the first Update() or Cut()
+    
+    // Lens
+    float mFieldOfView;
+    float mNear;
+    float mFar;
+    float mAspect;
+    
+    // This frame's blended pose and what was built from it
+    float mPosition[3];
+    float mTarget[3];
+    float mUp[3];
+    bool mDirty;
+    uint32_t mVersion;
+    Matrix4x4 mViewMatrix;
+    Matrix4x4 mProjectionMatrix;
+    Matrix4x4 mViewProjectionMatrix;
+    float mFrustumPlanes[6][4];
+};
@@ -0,0 +1,74 @@
+// Controller.h
+// Autopilot interfaces: one lander per call, or a whole batch per call
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// What a controller sees of one lander at the start of a fixed step
+// (meters, m/s, degrees)
+struct LanderState {
+    float position[3];
+    float velocity[3];
+    float rotation;         // Counter-clockwise, [0, 360)
+    float altitude;         // Lander bottom above the surface below it
+    float fuel;             // kg
+    float maxFuel;
+    float gravity;          // m/s²
+    float maxThrustAccel;   // m/s² at full throttle
+    float deltaTime;        // Step length (seconds)
+};
+
+// What the lander does for the step
+struct ControlCommand {
+    float thrust;           // Throttle, 0-1
+    float rotation;         // Degrees to turn, positive counter-clockwise
+};
+
+// Flies one lander. Game calls Compute inside the fixed step, before
+// Physics::Update, and applies the command in place of the player's
+// thrust and rotate input.
+class Controller {
+public:
+    virtual ~Controller() = default;
+    
+    virtual ControlCommand Compute(const LanderState& state) = 0;
+    
+    // Called when the game starts a new flight
+    virtual void OnReset() {}
+};
+
+// A batch of landers as parallel arrays, as LanderBatch stores them
+// (2D: x and y only). Shared parameters are the same for every lander.
+struct LanderStateArrays {
+    const float* posX;
+    const float* posY;
+    const float* velX;
+    const float* velY;
+    const float* rotation;
+    const float* altitude;
+    const float* fuel;
+    const uint8_t* state;   // LanderBatchState; only flying landers are read
+    float maxFuel;
+    float gravity;
+    float maxThrustAccel;
+    float deltaTime;
+};
+
+struct ControlCommandArrays {
+    float* thrust;
+    float* rotation;
+};
+
+// Flies many landers with one call: Compute fills the commands for flying
+// landers [begin, end) in a loop of its own, so a PID or a policy network
+// runs over whole arrays instead of one virtual call per lander. Ranges
+// may be computed concurrently, so Compute must not modify shared state.
+class BatchController {
+public:
+    virtual ~BatchController() = default;
+    
+    virtual void Compute(const LanderStateArrays& states, size_t begin, size_t end,
+                         const ControlCommandArrays& out) = 0;
+};
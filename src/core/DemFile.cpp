@@ -0,0 +1,568 @@
+// DemFile.cpp
+// Implementation of the memory-mapped PDS elevation raster
+
+#include "DemFile.h"
+#include "Log.h"
+#include "TerrainPack.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Attached labels are read from the start of the mapping; no real label
+// comes close to this
+static const size_t kMaxLabelBytes = 256 * 1024;
+
+static std::string TrimLabelValue(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t\r\"");
+    size_t last = value.find_last_not_of(" \t\r\"");
+    return first == std::string::npos ? std::string() : value.substr(first, last - first + 1);
+}
+
+static bool EndsWithNoCase(const std::string& text, const char* suffix) {
+    size_t length = std::strlen(suffix);
+    if (text.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (std::tolower(static_cast<unsigned char>(text[text.size() - length + i])) !=
+            std::tolower(static_cast<unsigned char>(suffix[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ReadTextFile(const std::string& path, std::string& text) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[4096];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0 && text.size() < kMaxLabelBytes) {
+        text.append(buffer, count);
+    }
+    std::fclose(file);
+    return true;
+}
+
+// Integer or based-integer label value ("16#FF7FFFFB#")
+static uint32_t ParseRawLabelValue(const std::string& value, bool isFloat) {
+    if (value.compare(0, 3, "16#") == 0) {
+        return static_cast<uint32_t>(std::strtoul(value.c_str() + 3, nullptr, 16));
+    }
+    if (isFloat) {
+        float number = std::strtof(value.c_str(), nullptr);
+        uint32_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        return bits;
+    }
+    return static_cast<uint32_t>(std::strtol(value.c_str(), nullptr, 10));
+}
+
+DemFile::DemFile()
+    : mFile(-1)
+    , mMapping(nullptr)
+    , mMappingSize(0)
+    , mData(nullptr)
+    , mWidth(0)
+    , mHeight(0)
+    , mLineBytes(0)
+    , mLinePrefixBytes(0)
+    , mSampleBytes(0)
+    , mFormat(SampleFormat::Int16)
+    , mBigEndian(false)
+    , mScale(1.0f)
+    , mOffset(0.0f)
+    , mSampleSpacing(1.0f)
+    , mHasMissing(false)
+    , mMissingRaw(0)
+    , mPackIndex(nullptr)
+{
+}
+
+DemFile::~DemFile() {
+    Close();
+}
+
+bool DemFile::Open(const char* filename) {
+    Close();
+    mFilename = filename ? filename : "";
+
+    // A .LBL names the image; otherwise the image either starts with its
+    // label or has a detached one next to it
+    std::string labelPath;
+    std::string imagePath = mFilename;
+    if (EndsWithNoCase(mFilename, ".lbl")) {
+        labelPath = mFilename;
+        imagePath.clear();
+    }
+
+    std::string detachedLabel;
+    size_t imageOffset = 0;
+    if (!labelPath.empty()) {
+        if (!ReadTextFile(labelPath, detachedLabel)) {
+            LOG_ERROR("Failed to read DEM label: %s", labelPath.c_str());
+            return false;
+        }
+        if (!ParseLabel(detachedLabel.data(), detachedLabel.size(), labelPath, imagePath, imageOffset)) {
+            Close();
+            return false;
+        }
+    }
+
+    mFile = open(imagePath.c_str(), O_RDONLY);
+    if (mFile < 0) {
+        LOG_ERROR("Failed to open DEM: %s", imagePath.c_str());
+        Close();
+        return false;
+    }
+
+    struct stat fileInfo;
+    if (fstat(mFile, &fileInfo) != 0 || fileInfo.st_size <= 0) {
+        LOG_ERROR("Failed to stat DEM: %s", imagePath.c_str());
+        Close();
+        return false;
+    }
+
+    // Map everything; pages only become resident as they are read. Reads
+    // jump between rows, so read-ahead of the whole file would be wasted.
+    mMappingSize = static_cast<size_t>(fileInfo.st_size);
+    mMapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+    if (mMapping == MAP_FAILED) {
+        mMapping = nullptr;
+        LOG_ERROR("Failed to map DEM: %s", imagePath.c_str());
+        Close();
+        return false;
+    }
+    madvise(mMapping, mMappingSize, MADV_RANDOM);
+
+    const char* start = static_cast<const char*>(mMapping);
+    if (labelPath.empty() && mMappingSize >= sizeof(kTerrainPackMagic) &&
+        std::memcmp(start, kTerrainPackMagic, sizeof(kTerrainPackMagic)) == 0) {
+        return OpenPack(imagePath);
+    }
+    if (labelPath.empty()) {
+        static const char kPdsSignature[] = "PDS_VERSION_ID";
+        if (mMappingSize >= sizeof(kPdsSignature) - 1 &&
+            std::memcmp(start, kPdsSignature, sizeof(kPdsSignature) - 1) == 0) {
+            labelPath = imagePath;
+            std::string unused;
+            if (!ParseLabel(start, std::min(mMappingSize, kMaxLabelBytes), labelPath, unused, imageOffset)) {
+                Close();
+                return false;
+            }
+        } else {
+            // IMAGE.IMG -> IMAGE.LBL or IMAGE.lbl
+            size_t dot = imagePath.find_last_of('.');
+            std::string stem = dot == std::string::npos ? imagePath : imagePath.substr(0, dot);
+            labelPath = stem + ".LBL";
+            if (!ReadTextFile(labelPath, detachedLabel)) {
+                labelPath = stem + ".lbl";
+                if (!ReadTextFile(labelPath, detachedLabel)) {
+                    LOG_ERROR("DEM has no attached label and no %s.LBL: %s", stem.c_str(), imagePath.c_str());
+                    Close();
+                    return false;
+                }
+            }
+            std::string unused;
+            if (!ParseLabel(detachedLabel.data(), detachedLabel.size(), labelPath, unused, imageOffset)) {
+                Close();
+                return false;
+            }
+        }
+    }
+
+    size_t imageBytes = mLineBytes * static_cast<size_t>(mHeight);
+    if (imageOffset > mMappingSize || imageBytes > mMappingSize - imageOffset) {
+        LOG_ERROR("DEM image (%dx%d, %zu bytes at %zu) does not fit the file (%zu bytes): %s",
+                  mWidth, mHeight, imageBytes, imageOffset, mMappingSize, imagePath.c_str());
+        Close();
+        return false;
+    }
+    mData = static_cast<const unsigned char*>(mMapping) + imageOffset;
+
+    DemTile unscanned = { 0.0f, 0.0f, false };
+    mTiles.assign(static_cast<size_t>(GetTileCountX()) * GetTileCountY(), unscanned);
+
+    LOG_INFO("Mapped DEM %s: %dx%d samples, %.2f m spacing, %zu MB",
+             imagePath.c_str(), mWidth, mHeight, mSampleSpacing, mMappingSize >> 20);
+    return true;
+}
+
+void DemFile::Close() {
+    if (mMapping) {
+        munmap(mMapping, mMappingSize);
+    }
+    if (mFile >= 0) {
+        close(mFile);
+    }
+    mFile = -1;
+    mMapping = nullptr;
+    mMappingSize = 0;
+    mData = nullptr;
+    mWidth = 0;
+    mHeight = 0;
+    mPackIndex = nullptr;
+    mTiles.clear();
+}
+
+bool DemFile::OpenPack(const std::string& path) {
+    TerrainPackHeader header;
+    if (mMappingSize < sizeof(header)) {
+        LOG_ERROR("Truncated terrain pack: %s", path.c_str());
+        Close();
+        return false;
+    }
+    std::memcpy(&header, mMapping, sizeof(header));
+    if (header.version != kTerrainPackVersion || header.headerSize != sizeof(TerrainPackHeader) ||
+        header.tileSize != kTileSize) {
+        LOG_ERROR("Terrain pack version %u (tile size %d) is not the supported %u (%d): %s",
+                  header.version, header.tileSize, kTerrainPackVersion, kTileSize, path.c_str());
+        Close();
+        return false;
+    }
+    mWidth = header.width;
+    mHeight = header.height;
+    size_t tileCount = static_cast<size_t>(GetTileCountX()) * GetTileCountY();
+    if (mWidth <= 0 || mHeight <= 0 || header.tileCountX != GetTileCountX() || header.tileCountY != GetTileCountY() ||
+        header.fileSize != mMappingSize || header.indexOffset % alignof(TerrainPackTile) != 0 ||
+        header.indexOffset > mMappingSize || tileCount > (mMappingSize - header.indexOffset) / sizeof(TerrainPackTile)) {
+        LOG_ERROR("Terrain pack header does not match the file (%zu bytes): %s", mMappingSize, path.c_str());
+        Close();
+        return false;
+    }
+
+    // Every payload inside the file, so reads need no further checks; the
+    // index also gives each tile's height range up front
+    mData = static_cast<const unsigned char*>(mMapping);
+    mPackIndex = reinterpret_cast<const TerrainPackTile*>(mData + header.indexOffset);
+    mTiles.resize(tileCount);
+    for (size_t i = 0; i < tileCount; ++i) {
+        const TerrainPackTile& tile = mPackIndex[i];
+        if (tile.offset > mMappingSize || tile.bytes > mMappingSize - tile.offset) {
+            LOG_ERROR("Terrain pack tile %zu lies outside the file: %s", i, path.c_str());
+            Close();
+            return false;
+        }
+        mTiles[i] = { tile.minHeight, tile.minHeight + tile.range, true };
+    }
+    mFormat = SampleFormat::Packed;
+    mSampleSpacing = header.sampleSpacing;
+    mScale = 1.0f;
+    mOffset = 0.0f;
+    mHasMissing = false;
+
+    LOG_INFO("Mapped terrain pack %s: %dx%d samples, %.2f m spacing, %zu MB (%.1fx smaller than floats)",
+             path.c_str(), mWidth, mHeight, mSampleSpacing, mMappingSize >> 20,
+             static_cast<double>(mWidth) * mHeight * sizeof(float) / mMappingSize);
+    return true;
+}
+
+bool DemFile::ParseLabel(const char* label, size_t length, const std::string& labelPath, std::string& imagePath,
+                         size_t& imageOffset) {
+    size_t recordBytes = 0;
+    int lines = 0;
+    int lineSamples = 0;
+    int sampleBits = 0;
+    std::string sampleType;
+    std::string imagePointer;
+    size_t linePrefixBytes = 0;
+    size_t lineSuffixBytes = 0;
+    std::string missingConstant;
+    mScale = 1.0f;
+    mOffset = 0.0f;
+    mSampleSpacing = 0.0f;
+
+    // KEY = VALUE lines; IMAGE keys only count inside OBJECT = IMAGE so that
+    // other objects' LINES etc. are ignored
+    bool inImage = false;
+    size_t position = 0;
+    while (position < length) {
+        size_t end = position;
+        while (end < length && label[end] != '\n') {
+            ++end;
+        }
+        std::string line(label + position, end - position);
+        position = end + 1;
+
+        std::string trimmed = TrimLabelValue(line);
+        if (trimmed == "END") {
+            break;
+        }
+        size_t equals = trimmed.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = TrimLabelValue(trimmed.substr(0, equals));
+        std::string value = TrimLabelValue(trimmed.substr(equals + 1));
+
+        // Drop units ("118.45 <METERS/PIXEL>") but keep them for MAP_SCALE
+        std::string unit;
+        size_t unitStart = value.find('<');
+        if (unitStart != std::string::npos) {
+            size_t unitEnd = value.find('>', unitStart);
+            unit = value.substr(unitStart + 1, unitEnd == std::string::npos ? std::string::npos : unitEnd - unitStart - 1);
+            value = TrimLabelValue(value.substr(0, unitStart));
+        }
+
+        if (key == "OBJECT") {
+            inImage = inImage || value == "IMAGE";
+        } else if (key == "END_OBJECT") {
+            if (value == "IMAGE" || value.empty()) {
+                inImage = false;
+            }
+        } else if (key == "RECORD_BYTES") {
+            recordBytes = static_cast<size_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (key == "^IMAGE") {
+            imagePointer = value;
+            if (!unit.empty()) {
+                imagePointer += " <" + unit + ">";
+            }
+        } else if (key == "MAP_SCALE") {
+            float scale = std::strtof(value.c_str(), nullptr);
+            mSampleSpacing = (unit.find("KM") != std::string::npos || unit.find("km") != std::string::npos)
+                           ? scale * 1000.0f : scale;
+        } else if (inImage) {
+            if (key == "LINES") {
+                lines = std::atoi(value.c_str());
+            } else if (key == "LINE_SAMPLES") {
+                lineSamples = std::atoi(value.c_str());
+            } else if (key == "SAMPLE_BITS") {
+                sampleBits = std::atoi(value.c_str());
+            } else if (key == "SAMPLE_TYPE") {
+                sampleType = value;
+            } else if (key == "SCALING_FACTOR") {
+                mScale = std::strtof(value.c_str(), nullptr);
+            } else if (key == "OFFSET") {
+                mOffset = std::strtof(value.c_str(), nullptr);
+            } else if (key == "LINE_PREFIX_BYTES") {
+                linePrefixBytes = static_cast<size_t>(std::strtoul(value.c_str(), nullptr, 10));
+            } else if (key == "LINE_SUFFIX_BYTES") {
+                lineSuffixBytes = static_cast<size_t>(std::strtoul(value.c_str(), nullptr, 10));
+            } else if (key == "MISSING_CONSTANT") {
+                missingConstant = value;
+            }
+        }
+    }
+
+    if (lines <= 0 || lineSamples <= 0) {
+        LOG_ERROR("DEM label has no IMAGE size: %s", labelPath.c_str());
+        return false;
+    }
+
+    // Sample encoding
+    bool isFloat = sampleType.find("REAL") != std::string::npos;
+    mBigEndian = sampleType.compare(0, 3, "MSB") == 0 || sampleType == "IEEE_REAL" ||
+                 sampleType == "INTEGER" || sampleType == "UNSIGNED_INTEGER";
+    if (isFloat && sampleBits == 32) {
+        mFormat = SampleFormat::Float32;
+    } else if (!isFloat && sampleBits == 16) {
+        mFormat = sampleType.find("UNSIGNED") != std::string::npos ? SampleFormat::UInt16 : SampleFormat::Int16;
+    } else if (!isFloat && sampleBits == 32) {
+        mFormat = SampleFormat::Int32;
+    } else {
+        LOG_ERROR("Unsupported DEM samples (%s, %d bits): %s", sampleType.c_str(), sampleBits, labelPath.c_str());
+        return false;
+    }
+    mSampleBytes = static_cast<size_t>(sampleBits / 8);
+    mHasMissing = !missingConstant.empty();
+    if (mHasMissing) {
+        mMissingRaw = ParseRawLabelValue(missingConstant, isFloat);
+        if (mSampleBytes == 2) {
+            mMissingRaw &= 0xFFFFu;
+        }
+    }
+
+    mWidth = lineSamples;
+    mHeight = lines;
+    mLinePrefixBytes = linePrefixBytes;
+    mLineBytes = linePrefixBytes + static_cast<size_t>(lineSamples) * mSampleBytes + lineSuffixBytes;
+    if (mSampleSpacing <= 0.0f) {
+        LOG_WARNING("DEM label has no MAP_SCALE, assuming 1 m samples: %s", labelPath.c_str());
+        mSampleSpacing = 1.0f;
+    }
+
+    // ^IMAGE = n (record, 1-based), n <BYTES> (byte, 1-based), "FILE" or
+    // ("FILE", n); file names are relative to the label
+    imageOffset = 0;
+    std::string pointer = imagePointer;
+    if (!pointer.empty() && pointer[0] == '(') {
+        pointer = pointer.substr(1, pointer.find(')') - 1);
+    }
+    std::string pointerFile;
+    size_t comma = pointer.find(',');
+    if (!pointer.empty() && !std::isdigit(static_cast<unsigned char>(pointer[0]))) {
+        pointerFile = TrimLabelValue(pointer.substr(0, comma));
+        pointer = comma == std::string::npos ? std::string() : TrimLabelValue(pointer.substr(comma + 1));
+    }
+    if (!pointer.empty()) {
+        size_t index = static_cast<size_t>(std::strtoul(pointer.c_str(), nullptr, 10));
+        bool bytes = pointer.find("BYTES") != std::string::npos;
+        if (index > 0) {
+            imageOffset = bytes ? index - 1 : (index - 1) * recordBytes;
+        }
+    }
+    if (!pointerFile.empty()) {
+        size_t slash = labelPath.find_last_of('/');
+        std::string directory = slash == std::string::npos ? std::string() : labelPath.substr(0, slash + 1);
+        imagePath = directory + pointerFile;
+
+        // PDS names are upper case; archives unpacked on a case-sensitive
+        // file system are often lower case
+        if (access(imagePath.c_str(), R_OK) != 0) {
+            std::transform(pointerFile.begin(), pointerFile.end(), pointerFile.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            imagePath = directory + pointerFile;
+        }
+    }
+    return true;
+}
+
+float DemFile::GetSample(int x, int y) const {
+    if (mPackIndex) {
+        float value = 0.0f;
+        ReadPackedRegion(x, y, 1, 1, 1, &value);
+        return value;
+    }
+    x = std::min(std::max(x, 0), mWidth - 1);
+    y = std::min(std::max(y, 0), mHeight - 1);
+    const unsigned char* bytes = mData + static_cast<size_t>(y) * mLineBytes + mLinePrefixBytes +
+                                 static_cast<size_t>(x) * mSampleBytes;
+
+    uint32_t raw;
+    if (mSampleBytes == 2) {
+        raw = mBigEndian ? (uint32_t(bytes[0]) << 8) | bytes[1] : (uint32_t(bytes[1]) << 8) | bytes[0];
+    } else {
+        raw = mBigEndian
+            ? (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3]
+            : (uint32_t(bytes[3]) << 24) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[1]) << 8) | bytes[0];
+    }
+    if (mHasMissing && raw == mMissingRaw) {
+        return mOffset;
+    }
+
+    float value;
+    switch (mFormat) {
+        case SampleFormat::Int16:   value = static_cast<float>(static_cast<int16_t>(raw)); break;
+        case SampleFormat::UInt16:  value = static_cast<float>(raw); break;
+        case SampleFormat::Int32:   value = static_cast<float>(static_cast<int32_t>(raw)); break;
+        case SampleFormat::Float32: std::memcpy(&value, &raw, sizeof(value)); break;
+        default:                    value = 0.0f; break;
+    }
+    return value * mScale + mOffset;
+}
+
+void DemFile::PrefetchRows(int x, int y, int width, int height) const {
+    // One madvise per row span; only the touched pages are paged in
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const unsigned char* mappingStart = static_cast<const unsigned char*>(mMapping);
+    for (int row = std::max(y, 0); row < std::min(y + height, mHeight); ++row) {
+        size_t first = static_cast<size_t>(mData - mappingStart) + static_cast<size_t>(row) * mLineBytes +
+                       mLinePrefixBytes + static_cast<size_t>(std::max(x, 0)) * mSampleBytes;
+        size_t last = first + static_cast<size_t>(std::min(width, mWidth)) * mSampleBytes;
+        size_t pageStart = first & ~(pageSize - 1);
+        madvise(static_cast<unsigned char*>(mMapping) + pageStart, std::min(last, mMappingSize) - pageStart,
+                MADV_WILLNEED);
+    }
+}
+
+bool DemFile::ReadRegion(int x, int y, int width, int height, int step, float* out) const {
+    if (!IsOpen() || width <= 0 || height <= 0 || step <= 0) {
+        return false;
+    }
+    if (mPackIndex) {
+        return ReadPackedRegion(x, y, width, height, step, out);
+    }
+
+    // Rows between samples are never touched when stepping
+    if (step == 1) {
+        PrefetchRows(x, y, width, height);
+    }
+    for (int row = 0; row < height; ++row) {
+        for (int column = 0; column < width; ++column) {
+            out[static_cast<size_t>(row) * width + column] = GetSample(x + column * step, y + row * step);
+        }
+    }
+    return true;
+}
+
+bool DemFile::ReadPackedRegion(int x, int y, int width, int height, int step, float* out) const {
+    auto clampX = [&](int column) { return std::min(std::max(x + column * step, 0), mWidth - 1); };
+    auto clampY = [&](int row) { return std::min(std::max(y + row * step, 0), mHeight - 1); };
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<float> tileHeights(static_cast<size_t>(kTileSize) * kTileSize);
+
+    // Clamped sample coordinates only grow, so each tile covers one run of
+    // rows and one run of columns
+    for (int row = 0; row < height;) {
+        const int tileY = clampY(row) / kTileSize;
+        int rowEnd = row + 1;
+        while (rowEnd < height && clampY(rowEnd) / kTileSize == tileY) {
+            ++rowEnd;
+        }
+        for (int column = 0; column < width;) {
+            const int tileX = clampX(column) / kTileSize;
+            int columnEnd = column + 1;
+            while (columnEnd < width && clampX(columnEnd) / kTileSize == tileX) {
+                ++columnEnd;
+            }
+
+            const TerrainPackTile& tile = mPackIndex[static_cast<size_t>(tileY) * GetTileCountX() + tileX];
+            const int firstX = tileX * kTileSize;
+            const int firstY = tileY * kTileSize;
+            const int tileWidth = std::min(kTileSize, mWidth - firstX);
+            const int tileHeight = std::min(kTileSize, mHeight - firstY);
+            size_t pageStart = tile.offset & ~(pageSize - 1);
+            madvise(static_cast<unsigned char*>(mMapping) + pageStart, tile.offset + tile.bytes - pageStart,
+                    MADV_WILLNEED);
+            if (!TerrainPack::DecodeTile(tile, mData + tile.offset, tileWidth, tileHeight, tileHeights.data())) {
+                LOG_ERROR("Corrupt tile %d,%d in terrain pack %s", tileX, tileY, mFilename.c_str());
+                return false;
+            }
+            for (int r = row; r < rowEnd; ++r) {
+                const float* source = tileHeights.data() + static_cast<size_t>(clampY(r) - firstY) * tileWidth;
+                float* destination = out + static_cast<size_t>(r) * width;
+                for (int c = column; c < columnEnd; ++c) {
+                    destination[c] = source[clampX(c) - firstX];
+                }
+            }
+            column = columnEnd;
+        }
+        row = rowEnd;
+    }
+    return true;
+}
+
+bool DemFile::GetTileRange(int tileX, int tileY, float& minHeight, float& maxHeight) {
+    if (!IsOpen() || tileX < 0 || tileY < 0 || tileX >= GetTileCountX() || tileY >= GetTileCountY()) {
+        return false;
+    }
+
+    DemTile& tile = mTiles[static_cast<size_t>(tileY) * GetTileCountX() + tileX];
+    if (!tile.scanned) {
+        int firstX = tileX * kTileSize;
+        int firstY = tileY * kTileSize;
+        int lastX = std::min(firstX + kTileSize, mWidth);
+        int lastY = std::min(firstY + kTileSize, mHeight);
+        tile.minHeight = tile.maxHeight = GetSample(firstX, firstY);
+        for (int y = firstY; y < lastY; ++y) {
+            for (int x = firstX; x < lastX; ++x) {
+                float height = GetSample(x, y);
+                tile.minHeight = std::min(tile.minHeight, height);
+                tile.maxHeight = std::max(tile.maxHeight, height);
+            }
+        }
+        tile.scanned = true;
+    }
+
+    minHeight = tile.minHeight;
+    maxHeight = tile.maxHeight;
+    return true;
+}
@@ -0,0 +1,111 @@
+// DemFile.h
+// Memory-mapped elevation raster (PDS .IMG, e.g. LOLA LDEM, or terrain pack) with lazy tile reads
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TerrainPackTile;
+
+// Height range of one tile, filled in the first time the tile is requested
+struct DemTile {
+    float minHeight;
+    float maxHeight;
+    bool scanned;
+};
+
+// A PDS3 image of elevation samples, mapped read-only. Nothing is decoded
+// up front: reads touch only the pages behind the requested samples, so
+// resident memory follows the area read rather than the file size.
+//
+// The label may be attached (the file starts with PDS_VERSION_ID) or in a
+// detached .LBL/.lbl file next to the image. A terrain pack (see
+// TerrainPack.h) is recognized by its magic and read the same way, each
+// read decoding just the tiles it touches.
+class DemFile {
+public:
+    static constexpr int kTileSize = 256;   // Samples per tile side in the tile index
+
+    DemFile();
+    ~DemFile();
+
+    DemFile(const DemFile&) = delete;
+    DemFile& operator=(const DemFile&) = delete;
+
+    // Parse the label and map the image; false (and closed) on failure
+    bool Open(const char* filename);
+    void Close();
+    bool IsOpen() const { return mData != nullptr; }
+    const std::string& GetFilename() const { return mFilename; }
+
+    // Raster size in samples (x = sample within a line, y = line)
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+
+    // Ground distance between samples (meters)
+    float GetSampleSpacing() const { return mSampleSpacing; }
+
+    // Height of one sample in meters (SCALING_FACTOR and OFFSET applied);
+    // coordinates are clamped to the raster. Decodes a whole tile of a
+    // pack: read regions from those.
+    float GetSample(int x, int y) const;
+
+    // Read a width x height window whose first sample is (x, y), taking
+    // every step-th sample, into out (row-major). Samples past the raster
+    // edge are clamped.
+    bool ReadRegion(int x, int y, int width, int height, int step, float* out) const;
+
+    // Tile index: kTileSize^2 sample tiles in row-major order
+    int GetTileCountX() const { return (mWidth + kTileSize - 1) / kTileSize; }
+    int GetTileCountY() const { return (mHeight + kTileSize - 1) / kTileSize; }
+    bool GetTileRange(int tileX, int tileY, float& minHeight, float& maxHeight);
+
+private:
+    enum class SampleFormat {
+        Int16,
+        UInt16,
+        Int32,
+        Float32,
+        Packed
+    };
+
+    // Label parsing: fills everything but the mapping
+    bool ParseLabel(const char* label, size_t length, const std::string& labelPath, std::string& imagePath,
+                    size_t& imageOffset);
+
+    // Hint the kernel about the rows a read is about to touch
+    void PrefetchRows(int x, int y, int width, int height) const;
+
+    // Terrain packs: check the header and index the mapping starts with,
+    // and read by decoding each touched tile once
+    bool OpenPack(const std::string& path);
+    bool ReadPackedRegion(int x, int y, int width, int height, int step, float* out) const;
+
+    std::string mFilename;
+
+    // Mapping
+    int mFile;
+    void* mMapping;
+    size_t mMappingSize;
+    const unsigned char* mData;   // First image byte within the mapping
+
+    // Raster layout
+    int mWidth;
+    int mHeight;
+    size_t mLineBytes;     // Bytes per line, including any line prefix/suffix
+    size_t mLinePrefixBytes;
+    size_t mSampleBytes;
+    SampleFormat mFormat;
+    bool mBigEndian;
+    float mScale;          // height = sample * mScale + mOffset
+    float mOffset;
+    float mSampleSpacing;
+    bool mHasMissing;
+    uint32_t mMissingRaw;  // Raw sample bits marking no data (read as mOffset)
+    const TerrainPackTile* mPackIndex;   // Within the mapping; null unless a pack
+
+    std::vector<DemTile> mTiles;
+};
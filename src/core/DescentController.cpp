@@ -0,0 +1,59 @@
+// DescentController.cpp
+// Implementation of the landing autopilot
+
+#include "DescentController.h"
+#include "LanderBatch.h"
+#include <algorithm>
+#include <cmath>
+
+// One lander's command; both paths run exactly this
+static inline ControlCommand ComputeCommand(const DescentControllerGains& gains, float velX, float velY,
+                                            float rotation, float altitude, float gravity, float maxThrustAccel) {
+    ControlCommand command;
+    
+    // Tilt against drift, as a signed angle
+    float targetTilt = std::min(std::max(gains.tiltGain * velX, -DescentController::kMaxTilt),
+                                DescentController::kMaxTilt);
+    float tilt = rotation > 180.0f ? rotation - 360.0f : rotation;
+    command.rotation = std::min(std::max(targetTilt - tilt, -DescentController::kTurnPerStep),
+                                DescentController::kTurnPerStep);
+    
+    // Track the sink rate for this altitude, leaning on the hover throttle
+    // scaled up for the tilt
+    float hoverThrottle = maxThrustAccel > 0.0f ? gravity / maxThrustAccel : 1.0f;
+    float targetVelY = -(DescentController::kTouchdownSinkRate + gains.descentGain * std::max(altitude, 0.0f));
+    float tiltCos = std::max(std::cos(tilt * static_cast<float>(M_PI / 180.0)), 0.5f);
+    float throttle = hoverThrottle / tiltCos + gains.thrustGain * (targetVelY - velY);
+    command.thrust = std::min(std::max(throttle, 0.0f), 1.0f);
+    return command;
+}
+
+DescentController::DescentController()
+    : DescentController(DescentControllerGains{ 0.4f, 0.2f, 10.0f })
+{
+}
+
+DescentController::DescentController(const DescentControllerGains& gains)
+    : mGains(gains)
+{
+}
+
+ControlCommand DescentController::Compute(const LanderState& state) {
+    return ComputeCommand(mGains, state.velocity[0], state.velocity[1], state.rotation, state.altitude,
+                          state.gravity, state.maxThrustAccel);
+}
+
+void DescentController::Compute(const LanderStateArrays& states, size_t begin, size_t end,
+                                const ControlCommandArrays& out) {
+    const bool perLander = !mLanderGains.empty();
+    for (size_t i = begin; i < end; ++i) {
+        if (states.state[i] != BATCH_FLYING) {
+            continue;
+        }
+        const DescentControllerGains& gains = perLander ? mLanderGains[i] : mGains;
+        ControlCommand command = ComputeCommand(gains, states.velX[i], states.velY[i], states.rotation[i],
+                                                states.altitude[i], states.gravity, states.maxThrustAccel);
+        out.thrust[i] = command.thrust;
+        out.rotation[i] = command.rotation;
+    }
+}
@@ -0,0 +1,41 @@
+// DescentController.h
+// Simple landing autopilot: sink rate tracking and drift control
+
+#pragma once
+
+#include "Controller.h"
+#include <vector>
+
+struct DescentControllerGains {
+    float thrustGain;    // Throttle per m/s of sink rate error
+    float descentGain;   // Target sink rate per meter of altitude (1/s)
+    float tiltGain;      // Tilt per m/s of horizontal velocity (degrees)
+};
+
+// Holds a sink rate that shrinks with altitude, throttling around hover to
+// track it, and tilts against horizontal drift. Turns at most the 2 degrees
+// per step the game's rotate input gives, so it flies what a player could.
+class DescentController : public Controller, public BatchController {
+public:
+    static constexpr float kMaxTilt = 30.0f;           // Degrees
+    static constexpr float kTurnPerStep = 2.0f;        // Degrees
+    static constexpr float kTouchdownSinkRate = 0.5f;  // m/s at the surface
+    
+    DescentController();
+    explicit DescentController(const DescentControllerGains& gains);
+    
+    void SetGains(const DescentControllerGains& gains) { mGains = gains; }
+    const DescentControllerGains& GetGains() const { return mGains; }
+    
+    // Per-lander gains for the batch path, indexed like the batch (empty =
+    // every lander uses SetGains)
+    void SetLanderGains(std::vector<DescentControllerGains> gains) { mLanderGains = std::move(gains); }
+    
+    ControlCommand Compute(const LanderState& state) override;
+    void Compute(const LanderStateArrays& states, size_t begin, size_t end,
+                 const ControlCommandArrays& out) override;
+
+private:
+    DescentControllerGains mGains;
+    std::vector<DescentControllerGains> mLanderGains;
+};
@@ -1,36 +1,89 @@
 // Entity.cpp
-// Implementation of Entity and Lander classes
+// Implementation of the Entity and Lander handles
 
 #include "Entity.h"
+#include "Log.h"
 #include "../rendering/Renderer.h" // Include full Renderer definition
 #include <algorithm>
-#include <iostream>
 
-// Initialize static ID counter
-int Entity::sNextID = 0;
+static bool SameQuaternion(const Quaternion& a, const Quaternion& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
 
 // Base Entity implementation
-Entity::Entity() 
-    : mActive(true)
-    , mID(sNextID++)
-    , mName("Entity")
+Entity::Entity(EntityStore* store)
+    : mStore(store)
 {
-    // Initialize position, rotation, and scale
-    mPosition[0] = mPosition[1] = mPosition[2] = 0.0f;
-    mRotation[0] = mRotation[1] = mRotation[2] = 0.0f;
+    if (!mStore) {
+        mOwnedStore = std::make_unique<EntityStore>();
+        mStore = mOwnedStore.get();
+    }
+    mID = mStore->Create();
     mScale[0] = mScale[1] = mScale[2] = 1.0f;
+    
+    // The store starts it at the identity, whose Euler view is all zeros
+    mRotation[0] = mRotation[1] = mRotation[2] = 0.0f;
+    mRotationSource = GetTransform().orientation;
+    mRenderRotation[0] = mRenderRotation[1] = mRenderRotation[2] = 0.0f;
+    mRenderRotationSource = GetTransform().renderOrientation;
+}
+
+Entity::~Entity() {
+    mStore->Destroy(mID);
 }
 
 void Entity::SetPosition(float x, float y, float z) {
-    mPosition[0] = x;
-    mPosition[1] = y;
-    mPosition[2] = z;
+    float* position = GetTransform().position;
+    position[0] = x;
+    position[1] = y;
+    position[2] = z;
+}
+
+void Entity::GetWorldPosition(double* position) const {
+    const double* origin = mStore->GetWorldOrigin();
+    const float* local = GetTransform().position;
+    for (int i = 0; i < 3; i++) {
+        position[i] = origin[i] + local[i];
+    }
 }
 
+void Entity::SetWorldPosition(const double* position) {
+    const double* origin = mStore->GetWorldOrigin();
+    float* local = GetTransform().position;
+    for (int i = 0; i < 3; i++) {
+        local[i] = static_cast<float>(position[i] - origin[i]);
+    }
+}
+
+// The given angles are kept as the Euler view, so a rotation set in
+// degrees reads back exactly as it was set
 void Entity::SetRotation(float x, float y, float z) {
+    Quaternion& orientation = GetTransform().orientation;
+    orientation = SimdMath::QuaternionFromEulerDegrees(x, y, z);
     mRotation[0] = x;
     mRotation[1] = y;
     mRotation[2] = z;
+    mRotationSource = orientation;
+}
+
+// Systems change orientations behind the handle's back, so the cached
+// angles are checked against the quaternion they came from
+const float* Entity::GetRotation() const {
+    const Quaternion& orientation = GetTransform().orientation;
+    if (!SameQuaternion(orientation, mRotationSource)) {
+        SimdMath::EulerDegreesFromQuaternion(orientation, mRotation);
+        mRotationSource = orientation;
+    }
+    return mRotation;
+}
+
+const float* Entity::GetRenderRotation() const {
+    const Quaternion& orientation = GetTransform().renderOrientation;
+    if (!SameQuaternion(orientation, mRenderRotationSource)) {
+        SimdMath::EulerDegreesFromQuaternion(orientation, mRenderRotation);
+        mRenderRotationSource = orientation;
+    }
+    return mRenderRotation;
 }
 
 void Entity::SetScale(float x, float y, float z) {
@@ -39,52 +92,58 @@ void Entity::SetScale(float x, float y, float z) {
     mScale[2] = z;
 }
 
+void Entity::CopyTransformFrom(const Entity& other) {
+    GetTransform() = other.GetTransform();
+    for (int i = 0; i < 3; i++) {
+        mScale[i] = other.mScale[i];
+    }
+}
+
+void Entity::SavePreviousTransform() {
+    EntityStore::SavePreviousTransform(GetTransform());
+}
+
+void Entity::InterpolateRenderTransform(float alpha) {
+    EntityStore::InterpolateRenderTransform(GetTransform(), alpha);
+}
+
 // Lander implementation
-Lander::Lander()
-    : Entity()
-    , mWidth(20.0f)         // Width in pixels
-    , mHeight(30.0f)        // Height in pixels
-    , mDepth(20.0f)         // Depth in pixels (for 3D)
-    , mMass(1000.0f)        // Mass in kg (1 metric ton)
-    , mThrustLevel(0.0f)    // Current thrust level (0-1)
-    , mThrustActive(false)  // Whether thrust is currently active
-    , mMaxThrustForce(25000.0f) // Max thrust in Newtons (25 kN)
-    , mFuel(1000.0f)        // Fuel in kg
-    , mMaxFuel(1000.0f)     // Max fuel capacity in kg
-    , mFuelConsumptionRate(10.0f) // Fuel consumption in kg/s at max thrust
-    , mLanded(false)        // Landing status
-    , mCrashed(false)       // Crash status
+Lander::Lander(EntityStore* store, const LanderConfig& config)
+    : Entity(store)
 {
-    mName = "Lander";
+    VelocityComponent motion;
+    for (int i = 0; i < 3; i++) {
+        motion.velocity[i] = 0.0f;
+        motion.acceleration[i] = 0.0f;
+    }
+    motion.spin = 0.0f;
+    mStore->Velocities().Add(mID, motion);
+    
+    PropulsionComponent propulsion;
+    propulsion.thrustLevel = 0.0f;           // Current thrust level (0-1)
+    propulsion.rcsCommand = 0.0f;            // RCS idle
+    propulsion.thrustActive = false;         // Whether thrust is currently active
+    propulsion.config = mStore->AddLanderConfig(config);
+    mStore->Propulsion().Add(mID, propulsion);
     
-    // Initialize velocity and acceleration (in m/s and m/s²)
-    mVelocity[0] = mVelocity[1] = mVelocity[2] = 0.0f;
-    mAcceleration[0] = mAcceleration[1] = mAcceleration[2] = 0.0f;
+    FuelComponent tank;
+    tank.fuel = config.maxFuel;              // Full tank, in kg
+    mStore->Fuel().Add(mID, tank);
+    
+    CollisionComponent collision;
+    collision.landed = false;
+    collision.crashed = false;
+    mStore->Collision().Add(mID, collision);
     
     // Log creation
-    std::cout << "Lander created with mass: " << mMass 
-              << " kg, max thrust: " << mMaxThrustForce 
-              << " N (TWR: " << (mMaxThrustForce / (mMass * 1.62f)) 
-              << ")" << std::endl;
+    LOG_INFO("Lander created with mass: %g kg (%g kg dry), max thrust: %g N (TWR: %g)",
+             config.dryMass.Value() + tank.fuel, config.dryMass.Value(), config.maxThrustForce,
+             config.maxThrustForce / ((config.dryMass.Value() + tank.fuel) * 1.62f));
 }
 
 void Lander::Update(float deltaTime) {
-    // This is now primarily a place for entity-specific logic
     // Main physics updates are handled by the Physics system
-    
-    // Handle fuel consumption if thrust is active
-    if (mThrustActive && mFuel > 0) {
-        // Fuel consumption is proportional to thrust level
-        float consumptionRate = mFuelConsumptionRate * mThrustLevel;
-        mFuel -= consumptionRate * deltaTime;
-        mFuel = std::max(0.0f, mFuel);
-        
-        if (mFuel <= 0) {
-            mThrustActive = false;
-            mThrustLevel = 0.0f;
-            std::cout << "Out of fuel!" << std::endl;
-        }
-    }
+    EntityStore::ConsumeFuel(GetPropulsion(), GetFuelTank(), GetConfig(), deltaTime);
 }
 
 void Lander::Render(Renderer* renderer) {
@@ -93,31 +152,29 @@ void Lander::Render(Renderer* renderer) {
 }
 
 void Lander::ApplyThrust(float amount) {
-    if (mFuel <= 0) {
-        mThrustActive = false;
-        mThrustLevel = 0.0f;
+    PropulsionComponent& propulsion = GetPropulsion();
+    if (GetFuelTank().fuel <= 0) {
+        propulsion.thrustActive = false;
+        propulsion.thrustLevel = 0.0f;
         return;
     }
     
-    mThrustLevel = std::max(0.0f, std::min(1.0f, amount));
-    mThrustActive = mThrustLevel > 0.0f;
+    propulsion.thrustLevel = std::max(0.0f, std::min(1.0f, amount));
+    propulsion.thrustActive = propulsion.thrustLevel > 0.0f;
     
-    // Debug output
-    if (mThrustActive) {
-        std::cout << "Thrust applied: " << (mThrustLevel * 100) << "%" << std::endl;
+    // Called every step while thrusting, so rate limit the debug output
+    if (propulsion.thrustActive) {
+        LOG_DEBUG_EVERY(1000, "Thrust applied: %.0f%%", propulsion.thrustLevel * 100);
     }
 }
 
-void Lander::RotateLeft(float amount) {
-    mRotation[2] += amount;
-    // Normalize rotation to 0-360 degrees
-    while (mRotation[2] >= 360.0f) mRotation[2] -= 360.0f;
-}
-
-void Lander::RotateRight(float amount) {
-    mRotation[2] -= amount;
-    // Normalize rotation to 0-360 degrees
-    while (mRotation[2] < 0.0f) mRotation[2] += 360.0f;
+void Lander::FireRcs(float command) {
+    PropulsionComponent& propulsion = GetPropulsion();
+    if (GetFuelTank().fuel <= 0) {
+        propulsion.rcsCommand = 0.0f;
+        return;
+    }
+    propulsion.rcsCommand = std::max(-1.0f, std::min(1.0f, command));
 }
 
 void Lander::Reset() {
@@ -128,22 +185,40 @@ void Lander::Reset() {
     SetRotation(0.0f, 0.0f, 0.0f);
     
     // Reset velocity and acceleration
-    mVelocity[0] = mVelocity[1] = mVelocity[2] = 0.0f;
-    mAcceleration[0] = mAcceleration[1] = mAcceleration[2] = 0.0f;
+    VelocityComponent& motion = GetMotion();
+    for (int i = 0; i < 3; i++) {
+        motion.velocity[i] = 0.0f;
+        motion.acceleration[i] = 0.0f;
+    }
+    motion.spin = 0.0f;
     
     // Reset thrust
-    mThrustLevel = 0.0f;
-    mThrustActive = false;
+    PropulsionComponent& propulsion = GetPropulsion();
+    propulsion.thrustLevel = 0.0f;
+    propulsion.thrustActive = false;
+    propulsion.rcsCommand = 0.0f;
     
     // Reset fuel
-    mFuel = mMaxFuel;
+    GetFuelTank().fuel = GetMaxFuel();
     
     // Reset landing status
-    mLanded = false;
-    mCrashed = false;
+    GetCollision().landed = false;
+    GetCollision().crashed = false;
     
     // Reset active status
-    mActive = true;
+    SetActive(true);
+    
+    LOG_INFO("Lander reset to initial state");
+}
+
+void Lander::CopyStateFrom(const Lander& other) {
+    CopyTransformFrom(other);
+    GetMotion() = other.GetMotion();
     
-    std::cout << "Lander reset to initial state" << std::endl;
+    // The config id is the other store's; this one may number its types
+    // differently
+    GetPropulsion() = other.GetPropulsion();
+    GetPropulsion().config = mStore->AddLanderConfig(other.GetConfig());
+    GetFuelTank() = other.GetFuelTank();
+    GetCollision() = other.GetCollision();
 }
\ No newline at end of file
@@ -1,119 +1,151 @@
 // Entity.h
-// Base classes for game entities
+// Entity handles over the component store
 
 #pragma once
 
-#include <vector>
-#include <string>
+#include <algorithm>
+#include <memory>
+#include "EntityStore.h"
+#include "SimdMath.h"
+#include "Units.h"
 
 // Forward declarations
 class Renderer;
 class Physics;
 
-// Common base class for all game entities
+// Handle to an entity in an EntityStore. The state lives in the store's
+// component arrays, where the systems update every entity in one pass; the
+// handle forwards to its entity's components, keeping only what no system
+// reads (the scale and the Euler views). An entity made without a store
+// gets one of its own.
 class Entity {
 public:
-    Entity();
-    virtual ~Entity() = default;
+    explicit Entity(EntityStore* store = nullptr);
+    ~Entity();
     
-    // Core entity methods
-    virtual void Update(float deltaTime) = 0;
-    virtual void Render(Renderer* renderer) = 0;
+    Entity(const Entity&) = delete;
+    Entity& operator=(const Entity&) = delete;
     
-    // Position and orientation getters/setters
+    // Position and orientation getters/setters. Pointers into the store
+    // stay valid until it adds or removes an entity.
     void SetPosition(float x, float y, float z = 0.0f);
-    const float* GetPosition() const { return mPosition; }
+    const float* GetPosition() const { return GetTransform().position; }
     
+    // The position in the world, in double precision: the store's floating
+    // origin plus the float position, which is relative to it (see
+    // EntityStore::ShiftOrigin)
+    void GetWorldPosition(double* position) const;
+    void SetWorldPosition(const double* position);
+    
+    // Orientation is a unit quaternion. The Euler angles (degrees, applied
+    // z, then x, then y like the model matrices) are derived from it when
+    // read, so code that only passes orientations around never converts.
     void SetRotation(float x, float y, float z = 0.0f);
-    const float* GetRotation() const { return mRotation; }
+    const float* GetRotation() const;
+    void SetOrientation(const Quaternion& orientation) { GetTransform().orientation = orientation; }
+    const Quaternion& GetOrientation() const { return GetTransform().orientation; }
     
     void SetScale(float x, float y, float z = 1.0f);
     const float* GetScale() const { return mScale; }
     
+    // Render interpolation between the last two fixed simulation steps (for
+    // this entity alone; EntityStore does every entity at once)
+    void SavePreviousTransform();
+    void InterpolateRenderTransform(float alpha);
+    const float* GetRenderPosition() const { return GetTransform().renderPosition; }
+    const Quaternion& GetRenderOrientation() const { return GetTransform().renderOrientation; }
+    const float* GetRenderRotation() const;
+    
     // Entity state
-    bool IsActive() const { return mActive; }
-    void SetActive(bool active) { mActive = active; }
+    bool IsActive() const { return GetTransform().active; }
+    void SetActive(bool active) { GetTransform().active = active; }
     
     // Entity identification
-    int GetID() const { return mID; }
-    const std::string& GetName() const { return mName; }
-    void SetName(const std::string& name) { mName = name; }
+    EntityId GetID() const { return mID; }
+    EntityStore& GetStore() const { return *mStore; }
 
 protected:
-    // Spatial properties
-    float mPosition[3]; // x, y, z
-    float mRotation[3]; // x, y, z (in degrees)
-    float mScale[3];    // x, y, z
+    TransformComponent& GetTransform() const { return *mStore->Transforms().Get(mID); }
     
-    // Entity state
-    bool mActive;
-    
-    // Entity identification
-    int mID;
-    std::string mName;
+    // The transform and scale of another entity
+    void CopyTransformFrom(const Entity& other);
     
-    // Auto-incrementing ID counter for unique entity IDs
-    static int sNextID;
+    EntityStore* mStore;
+    EntityId mID;
+
+private:
+    std::unique_ptr<EntityStore> mOwnedStore;    // Set when made without a store
+    float mScale[3];
+    
+    // Euler views of the orientations, each valid while the quaternion it
+    // was derived from is still the current one
+    mutable float mRotation[3];
+    mutable Quaternion mRotationSource;
+    mutable float mRenderRotation[3];
+    mutable Quaternion mRenderRotationSource;
 };
 
-// Lander entity
+// Lander entity: a transform, velocity, propulsion, fuel and collision,
+// each holding only what changes in flight. What the lander is built like
+// is its LanderConfig, one per type in the store.
 class Lander : public Entity {
 public:
-    Lander();
-    virtual ~Lander() = default;
+    explicit Lander(EntityStore* store = nullptr, const LanderConfig& config = LanderConfig::Default());
     
-    // Implement Entity methods
-    void Update(float deltaTime) override;
-    void Render(Renderer* renderer) override;
+    // The fuel system for this lander alone; Game runs EntityStore::UpdateFuel
+    void Update(float deltaTime);
+    void Render(Renderer* renderer);
     
     // Lander-specific methods
     void ApplyThrust(float amount);
-    void RotateLeft(float amount);
-    void RotateRight(float amount);
     void Reset();
     
+    // Reaction control for this step: -1 - 1, positive torques the lander
+    // counter-clockwise (RcsThrusters). Physics turns the lander by the
+    // torque; in 2D the attitude rate is the spin (deg/s).
+    void FireRcs(float command);
+    float GetRcsCommand() const { return GetPropulsion().rcsCommand; }
+    float GetSpin() const { return GetMotion().spin; }
+    void SetSpin(float spin) { GetMotion().spin = spin; }
+    
+    // Take every component of another lander, e.g. into a render snapshot
+    // with a store of its own
+    void CopyStateFrom(const Lander& other);
+    
     // Getters
-    float GetFuel() const { return mFuel; }
-    float GetMaxFuel() const { return mMaxFuel; }
-    float GetThrustLevel() const { return mThrustLevel; }
-    bool IsThrustActive() const { return mThrustActive; }
-    bool IsLanded() const { return mLanded; }
-    bool IsCrashed() const { return mCrashed; }
+    const LanderConfig& GetConfig() const { return mStore->GetLanderConfig(GetPropulsion().config); }
+    float GetFuel() const { return GetFuelTank().fuel; }
+    float GetMaxFuel() const { return GetConfig().maxFuel; }
+    float GetFuelConsumptionRate() const { return GetConfig().consumptionRate; }   // kg/s at full thrust
+    float GetThrustLevel() const { return GetPropulsion().thrustLevel; }
+    bool IsThrustActive() const { return GetPropulsion().thrustActive; }
+    bool IsLanded() const { return GetCollision().landed; }
+    bool IsCrashed() const { return GetCollision().crashed; }
     
     // Physics properties
-    float* GetVelocity() { return mVelocity; }
-    const float* GetVelocity() const { return mVelocity; }
-    float GetMass() const { return mMass; }
-    float GetWidth() const { return mWidth; }
-    float GetHeight() const { return mHeight; }
-    float GetDepth() const { return mDepth; } // For 3D
+    float* GetVelocity() { return GetMotion().velocity; }
+    const float* GetVelocity() const { return GetMotion().velocity; }
+    Kilograms GetDryMass() const { return GetConfig().dryMass; }
+    Kilograms GetMass() const { return GetDryMass() + Kilograms(GetFuel()); }           // With the fuel left
+    Kilograms GetLaunchMass() const { return GetDryMass() + Kilograms(GetMaxFuel()); }  // With a full tank
+    Meters GetWidth() const { return GetConfig().width; }
+    Meters GetHeight() const { return GetConfig().height; }
+    Meters GetDepth() const { return GetConfig().depth; } // For 3D
+    
+    // Engine thrust (N) at full throttle under gravity (m/s²): a fixed
+    // thrust-to-weight at launch mass, so the acceleration climbs as the
+    // fuel burns off
+    static constexpr float kThrustToWeight = 2.5f;
+    float GetMaxThrust(float gravity) const { return kThrustToWeight * gravity * GetLaunchMass().Value(); }
     
     // Status settings
-    void SetLanded(bool landed) { mLanded = landed; }
-    void SetCrashed(bool crashed) { mCrashed = crashed; }
+    void SetFuel(float fuel) { GetFuelTank().fuel = std::max(0.0f, std::min(GetMaxFuel(), fuel)); }
+    void SetLanded(bool landed) { GetCollision().landed = landed; }
+    void SetCrashed(bool crashed) { GetCollision().crashed = crashed; }
 
 private:
-    // Physical properties
-    float mWidth;
-    float mHeight;
-    float mDepth;  // For 3D
-    float mMass;   // kg
-    
-    // Movement properties
-    float mVelocity[3]; // vx, vy, vz
-    float mAcceleration[3]; // ax, ay, az
-    
-    // Thrust properties
-    float mThrustLevel;     // 0.0 - 1.0
-    bool mThrustActive;
-    float mMaxThrustForce;  // Newtons
-    
-    // Fuel properties
-    float mFuel;
-    float mMaxFuel;
-    float mFuelConsumptionRate;
-    
-    // Landing status
-    bool mLanded;
-    bool mCrashed;
+    VelocityComponent& GetMotion() const { return *mStore->Velocities().Get(mID); }
+    PropulsionComponent& GetPropulsion() const { return *mStore->Propulsion().Get(mID); }
+    FuelComponent& GetFuelTank() const { return *mStore->Fuel().Get(mID); }
+    CollisionComponent& GetCollision() const { return *mStore->Collision().Get(mID); }
 };
\ No newline at end of file
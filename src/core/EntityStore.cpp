@@ -0,0 +1,167 @@
+// EntityStore.cpp
+// Implementation of the entity component store and its systems
+
+#include "EntityStore.h"
+#include "Log.h"
+#include "RcsThrusters.h"
+#include <algorithm>
+
+LanderConfig LanderConfig::Default() {
+    LanderConfig config;
+    config.maxThrustForce = 25000.0f;                // Max thrust in Newtons (25 kN)
+    config.maxFuel = 1000.0f;                        // Max fuel capacity in kg
+    config.consumptionRate = 10.0f;                  // Fuel consumption in kg/s at max thrust
+    config.width = Units::ToMeters(20.0_px);         // 20 pixels wide in the 2D view
+    config.height = Units::ToMeters(30.0_px);
+    config.depth = Units::ToMeters(20.0_px);         // For 3D
+    config.dryMass = 1000.0_kg;                      // 1 metric ton dry
+    return config;
+}
+
+bool LanderConfig::operator==(const LanderConfig& other) const {
+    return maxThrustForce == other.maxThrustForce && maxFuel == other.maxFuel &&
+           consumptionRate == other.consumptionRate && width == other.width && height == other.height &&
+           depth == other.depth && dryMass == other.dryMass;
+}
+
+EntityStore::EntityStore()
+    : mNextId(0)
+{
+    mWorldOrigin[0] = mWorldOrigin[1] = mWorldOrigin[2] = 0.0;
+}
+
+EntityId EntityStore::Create() {
+    EntityId id;
+    if (!mFreeIds.empty()) {
+        id = mFreeIds.back();
+        mFreeIds.pop_back();
+    } else {
+        id = mNextId++;
+    }
+    
+    TransformComponent transform;
+    for (int i = 0; i < 3; i++) {
+        transform.position[i] = 0.0f;
+    }
+    transform.orientation = Quaternion{ 0.0f, 0.0f, 0.0f, 1.0f };
+    transform.active = true;
+    SavePreviousTransform(transform);
+    InterpolateRenderTransform(transform, 1.0f);
+    mTransforms.Add(id, transform);
+    return id;
+}
+
+void EntityStore::Destroy(EntityId id) {
+    if (!mTransforms.Has(id)) {
+        return;
+    }
+    mTransforms.Remove(id);
+    mVelocities.Remove(id);
+    mPropulsion.Remove(id);
+    mFuel.Remove(id);
+    mCollision.Remove(id);
+    mFreeIds.push_back(id);
+}
+
+LanderConfigId EntityStore::AddLanderConfig(const LanderConfig& config) {
+    // A handful of types at most, so a scan beats a map
+    for (size_t i = 0; i < mLanderConfigs.size(); i++) {
+        if (mLanderConfigs[i] == config) {
+            return static_cast<LanderConfigId>(i);
+        }
+    }
+    mLanderConfigs.push_back(config);
+    return static_cast<LanderConfigId>(mLanderConfigs.size() - 1);
+}
+
+void EntityStore::UpdateFuel(float deltaTime) {
+    // Propulsion is the smaller set (anything with an engine has a tank),
+    // so walk it and look the tank up
+    PropulsionComponent* propulsion = mPropulsion.Data();
+    for (size_t i = 0; i < mPropulsion.Size(); i++) {
+        FuelComponent* fuel = mFuel.Get(mPropulsion.GetOwner(i));
+        if (fuel) {
+            ConsumeFuel(propulsion[i], *fuel, mLanderConfigs[propulsion[i].config], deltaTime);
+        }
+    }
+}
+
+void EntityStore::ConsumeFuel(PropulsionComponent& propulsion, FuelComponent& fuel, const LanderConfig& config,
+                              float deltaTime) {
+    if ((!propulsion.thrustActive && propulsion.rcsCommand == 0.0f) || fuel.fuel <= 0) {
+        return;
+    }
+    
+    // Fuel consumption is proportional to thrust level, and each RCS
+    // thruster burns for its own throttle
+    if (propulsion.thrustActive) {
+        fuel.fuel -= config.consumptionRate * propulsion.thrustLevel * deltaTime;
+    }
+    float rcsLevels[RcsThrusters::kCount];
+    RcsThrusters::GetLevels(propulsion.rcsCommand, rcsLevels);
+    fuel.fuel -= RcsThrusters::GetFuelRate(rcsLevels) * deltaTime;
+    fuel.fuel = std::max(0.0f, fuel.fuel);
+    
+    if (fuel.fuel <= 0) {
+        propulsion.thrustActive = false;
+        propulsion.thrustLevel = 0.0f;
+        propulsion.rcsCommand = 0.0f;
+        LOG_INFO("Out of fuel!");
+    }
+}
+
+void EntityStore::SavePreviousTransforms() {
+    TransformComponent* transforms = mTransforms.Data();
+    for (size_t i = 0; i < mTransforms.Size(); i++) {
+        SavePreviousTransform(transforms[i]);
+    }
+}
+
+void EntityStore::InterpolateRenderTransforms(float alpha) {
+    TransformComponent* transforms = mTransforms.Data();
+    for (size_t i = 0; i < mTransforms.Size(); i++) {
+        InterpolateRenderTransform(transforms[i], alpha);
+    }
+}
+
+void EntityStore::SavePreviousTransform(TransformComponent& transform) {
+    for (int i = 0; i < 3; i++) {
+        transform.previousPosition[i] = transform.position[i];
+    }
+    transform.previousOrientation = transform.orientation;
+}
+
+void EntityStore::InterpolateRenderTransform(TransformComponent& transform, float alpha) {
+    for (int i = 0; i < 3; i++) {
+        transform.renderPosition[i] = transform.previousPosition[i] +
+                                      (transform.position[i] - transform.previousPosition[i]) * alpha;
+    }
+    
+    // Interpolate rotation along the shortest arc
+    transform.renderOrientation = SimdMath::QuaternionNlerp(transform.previousOrientation, transform.orientation, alpha);
+}
+
+void EntityStore::SetWorldOrigin(const double* origin) {
+    for (int i = 0; i < 3; i++) {
+        mWorldOrigin[i] = origin[i];
+    }
+}
+
+void EntityStore::ShiftOrigin(const double* shift) {
+    // In double, so each position rounds once, to the nearest float of
+    // its new, smaller value
+    auto move = [shift](float* position) {
+        for (int i = 0; i < 3; i++) {
+            position[i] = static_cast<float>(position[i] - shift[i]);
+        }
+    };
+    TransformComponent* transforms = mTransforms.Data();
+    for (size_t i = 0; i < mTransforms.Size(); i++) {
+        move(transforms[i].position);
+        move(transforms[i].previousPosition);
+        move(transforms[i].renderPosition);
+    }
+    for (int i = 0; i < 3; i++) {
+        mWorldOrigin[i] += shift[i];
+    }
+}
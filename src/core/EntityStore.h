@@ -0,0 +1,192 @@
+// EntityStore.h
+// Dense per-component arrays for entities, and the systems that run over them
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SimdMath.h"
+#include "Units.h"
+
+typedef uint32_t EntityId;
+typedef uint16_t LanderConfigId;
+
+// What a type of lander is built like: read by the steps, never written
+// by them, and kept once in the store for every lander of the type rather
+// than in each lander's components
+struct LanderConfig {
+    float maxThrustForce;           // Newtons
+    float maxFuel;                  // kg
+    float consumptionRate;          // kg/s at full thrust
+    Meters width;
+    Meters height;
+    Meters depth;                   // For 3D
+    Kilograms dryMass;              // Without the fuel
+    
+    // The lander Lander builds unless told otherwise
+    static LanderConfig Default();
+    bool operator==(const LanderConfig& other) const;
+};
+
+// Where an entity is and how it is drawn between fixed steps. The first
+// cache line is everything a fixed step reads and writes; the render
+// transform, written once a frame, has the second to itself.
+struct alignas(64) TransformComponent {
+    float position[3];              // Meters
+    bool active;
+    Quaternion orientation;
+    
+    // Transform at the previous fixed step and the interpolated render transform
+    float previousPosition[3];
+    Quaternion previousOrientation;
+    float renderPosition[3];
+    Quaternion renderOrientation;
+};
+
+struct VelocityComponent {
+    float velocity[3];              // m/s
+    float acceleration[3];          // m/s²
+    float spin;                     // 2D attitude rate, deg/s counter-clockwise
+};
+
+struct PropulsionComponent {
+    float thrustLevel;              // 0.0 - 1.0
+    float rcsCommand;               // -1 - 1, positive counter-clockwise (RcsThrusters)
+    bool thrustActive;
+    LanderConfigId config;          // EntityStore::GetLanderConfig
+};
+
+struct FuelComponent {
+    float fuel;                     // kg
+};
+
+struct CollisionComponent {
+    bool landed;
+    bool crashed;
+};
+
+// One component type for the entities that have it, packed with no gaps
+// so a system walks it front to back. Removing swaps the last element into
+// the hole, so indices (and pointers into the array) are only stable until
+// the next Add or Remove.
+template <typename T>
+class ComponentArray {
+public:
+    T& Add(EntityId id, const T& value) {
+        if (id >= mIndex.size()) {
+            mIndex.resize(id + 1, kNone);
+        }
+        if (mIndex[id] != kNone) {
+            mData[mIndex[id]] = value;
+            return mData[mIndex[id]];
+        }
+        mIndex[id] = static_cast<uint32_t>(mData.size());
+        mData.push_back(value);
+        mOwners.push_back(id);
+        return mData.back();
+    }
+    
+    void Remove(EntityId id) {
+        if (!Has(id)) {
+            return;
+        }
+        uint32_t index = mIndex[id];
+        uint32_t last = static_cast<uint32_t>(mData.size() - 1);
+        if (index != last) {
+            mData[index] = mData[last];
+            mOwners[index] = mOwners[last];
+            mIndex[mOwners[index]] = index;
+        }
+        mData.pop_back();
+        mOwners.pop_back();
+        mIndex[id] = kNone;
+    }
+    
+    bool Has(EntityId id) const { return id < mIndex.size() && mIndex[id] != kNone; }
+    T* Get(EntityId id) { return Has(id) ? &mData[mIndex[id]] : nullptr; }
+    const T* Get(EntityId id) const { return Has(id) ? &mData[mIndex[id]] : nullptr; }
+    
+    size_t Size() const { return mData.size(); }
+    T* Data() { return mData.data(); }
+    const T* Data() const { return mData.data(); }
+    EntityId GetOwner(size_t index) const { return mOwners[index]; }
+
+private:
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+    
+    std::vector<T> mData;
+    std::vector<EntityId> mOwners;  // Entity of each element
+    std::vector<uint32_t> mIndex;   // Element of each entity id, kNone without one
+};
+
+// Every entity has a transform; the other components are added by what the
+// entity is (a lander has all of them, debris would have a transform,
+// velocity and collision). Systems iterate one component array linearly
+// instead of calling a virtual Update per entity.
+class EntityStore {
+public:
+    EntityStore();
+    EntityStore(const EntityStore&) = delete;
+    EntityStore& operator=(const EntityStore&) = delete;
+    
+    // New entity with an identity transform at the origin. Ids of destroyed
+    // entities are reused.
+    EntityId Create();
+    void Destroy(EntityId id);
+    size_t GetEntityCount() const { return mTransforms.Size(); }
+    
+    ComponentArray<TransformComponent>& Transforms() { return mTransforms; }
+    const ComponentArray<TransformComponent>& Transforms() const { return mTransforms; }
+    ComponentArray<VelocityComponent>& Velocities() { return mVelocities; }
+    const ComponentArray<VelocityComponent>& Velocities() const { return mVelocities; }
+    ComponentArray<PropulsionComponent>& Propulsion() { return mPropulsion; }
+    const ComponentArray<PropulsionComponent>& Propulsion() const { return mPropulsion; }
+    ComponentArray<FuelComponent>& Fuel() { return mFuel; }
+    const ComponentArray<FuelComponent>& Fuel() const { return mFuel; }
+    ComponentArray<CollisionComponent>& Collision() { return mCollision; }
+    const ComponentArray<CollisionComponent>& Collision() const { return mCollision; }
+    
+    // Lander types: the id of config, added the first time it is seen, so
+    // landers built alike share one
+    LanderConfigId AddLanderConfig(const LanderConfig& config);
+    const LanderConfig& GetLanderConfig(LanderConfigId id) const { return mLanderConfigs[id]; }
+    
+    // Systems, each over every entity with the components it reads
+    
+    // Burn fuel for the thrust and RCS of each entity with propulsion and fuel,
+    // cutting the engine when the tank runs dry
+    void UpdateFuel(float deltaTime);
+    
+    // One entity's share of UpdateFuel
+    static void ConsumeFuel(PropulsionComponent& propulsion, FuelComponent& fuel, const LanderConfig& config,
+                            float deltaTime);
+    
+    // Render interpolation between the last two fixed simulation steps
+    void SavePreviousTransforms();
+    void InterpolateRenderTransforms(float alpha);
+    
+    static void SavePreviousTransform(TransformComponent& transform);
+    static void InterpolateRenderTransform(TransformComponent& transform, float alpha);
+
+    // Floating origin: where position (0, 0, 0) of every transform is in
+    // the world, in double-precision meters. ShiftOrigin moves it by shift
+    // and every position (current, previous and render) back by as much,
+    // so the entities stay where they are in the world while their float
+    // positions stay small and precise.
+    const double* GetWorldOrigin() const { return mWorldOrigin; }
+    void SetWorldOrigin(const double* origin);
+    void ShiftOrigin(const double* shift);
+
+private:
+    ComponentArray<TransformComponent> mTransforms;
+    ComponentArray<VelocityComponent> mVelocities;
+    ComponentArray<PropulsionComponent> mPropulsion;
+    ComponentArray<FuelComponent> mFuel;
+    ComponentArray<CollisionComponent> mCollision;
+    std::vector<LanderConfig> mLanderConfigs;
+    
+    EntityId mNextId;
+    std::vector<EntityId> mFreeIds;
+    double mWorldOrigin[3];
+};
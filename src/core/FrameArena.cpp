@@ -0,0 +1,98 @@
+// FrameArena.cpp
+// Implementation of the per-frame arena
+
+#include "FrameArena.h"
+#include "Log.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cstdlib>
+
+static size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static char* NewBlock(size_t size) {
+    void* block = std::malloc(size);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(block);
+}
+
+FrameArena::FrameArena(size_t blockSize)
+    : mBlock(nullptr)
+    , mBlockSize(AlignUp(std::max(blockSize, kAlignment), kAlignment))
+    , mUsed(0)
+    , mFrameBytes(0)
+    , mPeakBytes(0)
+{
+    mBlock = NewBlock(mBlockSize);
+    mOverflow.reserve(16);
+    MemoryTracker::Allocate(MemoryTag::FrameArena, mBlockSize);
+}
+
+FrameArena::~FrameArena() {
+    for (void* block : mOverflow) {
+        std::free(block);
+    }
+    std::free(mBlock);
+    MemoryTracker::Free(MemoryTag::FrameArena, mBlockSize);
+}
+
+void* FrameArena::Allocate(size_t size) {
+    // malloc aligns to 16, so offsets aligned to kAlignment are enough
+    size = AlignUp(std::max<size_t>(size, 1), kAlignment);
+    mFrameBytes += size;
+    if (mUsed + size <= mBlockSize) {
+        void* memory = mBlock + mUsed;
+        mUsed += size;
+        return memory;
+    }
+    
+    char* block = NewBlock(size);
+    mOverflow.push_back(block);
+    return block;
+}
+
+void FrameArena::Deallocate(void* memory, size_t size) {
+    char* start = static_cast<char*>(memory);
+    if (start >= mBlock && start + AlignUp(std::max<size_t>(size, 1), kAlignment) == mBlock + mUsed) {
+        mUsed = static_cast<size_t>(start - mBlock);
+    }
+}
+
+void FrameArena::Reset() {
+    mPeakBytes = std::max(mPeakBytes, mFrameBytes);
+    
+    // Room for the whole of this frame in one block next time
+    if (!mOverflow.empty()) {
+        for (void* block : mOverflow) {
+            std::free(block);
+        }
+        mOverflow.clear();
+        
+        size_t blockSize = mBlockSize;
+        while (blockSize < mFrameBytes) {
+            blockSize *= 2;
+        }
+        std::free(mBlock);
+        mBlock = NewBlock(blockSize);
+        MemoryTracker::Resize(MemoryTag::FrameArena, mBlockSize, blockSize);
+        mBlockSize = blockSize;
+        LOG_DEBUG("Frame arena grew to %zu KB", blockSize / 1024);
+    }
+    
+    mUsed = 0;
+    mFrameBytes = 0;
+}
+
+// Null unless HeapCounter.cpp is linked in
+static uint64_t (*sHeapAllocationCounter)() = nullptr;
+
+void FrameArena::SetHeapAllocationCounter(uint64_t (*counter)()) {
+    sHeapAllocationCounter = counter;
+}
+
+uint64_t FrameArena::GetHeapAllocationCount() {
+    return sHeapAllocationCounter ? sHeapAllocationCounter() : 0;
+}
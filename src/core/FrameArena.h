@@ -0,0 +1,102 @@
+// FrameArena.h
+// Bump allocator for transient data that lives until the end of the frame
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Allocations are carved front to back out of one block and nothing is
+// returned until Reset() at the end of the frame rewinds the whole block.
+// A frame that outgrows the block spills into overflow blocks from the
+// heap; the next Reset() frees them and regrows the block to fit, so once
+// the arena has seen the frame's peak a frame makes no heap calls at all.
+//
+// Main thread only: worker pool jobs must not allocate from it.
+class FrameArena {
+public:
+    static constexpr size_t kDefaultBlockSize = 256 * 1024;
+    static constexpr size_t kAlignment = 16;    // Of every allocation; FrameAllocator rejects types needing more
+    
+    explicit FrameArena(size_t blockSize = kDefaultBlockSize);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    
+    // Aligned to kAlignment and never null; throws std::bad_alloc like
+    // operator new
+    void* Allocate(size_t size);
+    
+    // Only the newest allocation is given back (so a vector growing by
+    // doubling reuses its old storage); anything else waits for Reset()
+    void Deallocate(void* memory, size_t size);
+    
+    // End of frame: everything allocated since the last Reset() is gone
+    void Reset();
+    
+    size_t GetBlockSize() const { return mBlockSize; }
+    size_t GetFrameBytes() const { return mFrameBytes; }   // Allocated this frame, overflow included
+    size_t GetPeakBytes() const { return mPeakBytes; }     // Most any finished frame allocated
+    
+    // Global operator new calls so far, for checking that a frame made
+    // none. Only an executable built with HeapCounter.cpp counts them (the
+    // game, in debug builds); everything else gets 0.
+    static uint64_t GetHeapAllocationCount();
+    static void SetHeapAllocationCounter(uint64_t (*counter)());
+
+private:
+    char* mBlock;
+    size_t mBlockSize;
+    size_t mUsed;                   // Bytes of mBlock handed out
+    size_t mFrameBytes;
+    size_t mPeakBytes;
+    std::vector<void*> mOverflow;   // Heap blocks of allocations mBlock couldn't hold
+};
+
+// Standard allocator on a FrameArena, shaped like std::pmr::polymorphic_allocator:
+// the arena is chosen per container and not propagated on assignment. A
+// null arena allocates from the heap, so code can run without one.
+template <typename T>
+class FrameAllocator {
+public:
+    typedef T value_type;
+    static_assert(alignof(T) <= FrameArena::kAlignment, "FrameArena can't align this type");
+    
+    FrameAllocator(FrameArena* arena) noexcept : mArena(arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) noexcept : mArena(other.GetArena()) {}
+    
+    T* allocate(size_t count) {
+        size_t size = count * sizeof(T);
+        return static_cast<T*>(mArena ? mArena->Allocate(size) : ::operator new(size));
+    }
+    
+    void deallocate(T* memory, size_t count) {
+        if (mArena) {
+            mArena->Deallocate(memory, count * sizeof(T));
+        } else {
+            ::operator delete(memory);
+        }
+    }
+    
+    FrameArena* GetArena() const noexcept { return mArena; }
+
+private:
+    FrameArena* mArena;
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) noexcept {
+    return a.GetArena() == b.GetArena();
+}
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) noexcept {
+    return a.GetArena() != b.GetArena();
+}
+
+// Scratch array for the current frame, e.g. FrameVector<float> values(arena)
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
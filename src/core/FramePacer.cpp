@@ -0,0 +1,95 @@
+// FramePacer.cpp
+// Sleep-then-spin frame pacing with GPU time feedback
+
+#include "FramePacer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// Weight of the newest frame in the smoothed times
+static const double kSmoothing = 0.1;
+
+static double Seconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+FramePacer::FramePacer()
+    : mMode(FramePacingMode::DisplaySync)
+    , mTargetInterval(1.0 / 120.0)
+    , mSpinMargin(0.001)
+    , mCpuTime(0.0)
+    , mGpuTime(0.0)
+    , mFrameTime(0.0)
+    , mStarted(false)
+{
+}
+
+void FramePacer::SetTargetFrameRate(float hz) {
+    mTargetInterval = 1.0 / std::max(1.0f, hz);
+}
+
+bool FramePacer::ParseMode(const char* text, FramePacingMode& mode) {
+    if (std::strcmp(text, "uncapped") == 0) {
+        mode = FramePacingMode::Uncapped;
+    } else if (std::strcmp(text, "vsync") == 0) {
+        mode = FramePacingMode::DisplaySync;
+    } else if (std::strcmp(text, "target") == 0) {
+        mode = FramePacingMode::TargetRate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* FramePacer::GetModeName(FramePacingMode mode) {
+    return mode == FramePacingMode::Uncapped ? "uncapped" :
+           mode == FramePacingMode::DisplaySync ? "vsync" : "target";
+}
+
+void FramePacer::EndFrame(double gpuSeconds) {
+    Clock::time_point now = Clock::now();
+    if (!mStarted) {
+        mStarted = true;
+        mFrameStart = now;
+        mDeadline = now;
+        return;
+    }
+    
+    mCpuTime += kSmoothing * (Seconds(now - mFrameStart) - mCpuTime);
+    if (gpuSeconds > 0.0) {
+        mGpuTime += kSmoothing * (gpuSeconds - mGpuTime);
+    }
+    
+    if (mMode == FramePacingMode::TargetRate) {
+        PROFILE_SCOPE("Frame Pacing");
+        
+        // An overrun frame restarts the schedule instead of building a
+        // debt the next frames would rush to pay back
+        const double interval = std::max(mTargetInterval, mGpuTime);
+        mDeadline += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+        if (mDeadline < now) {
+            mDeadline = now;
+        }
+        
+        const Clock::time_point wake =
+            mDeadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(mSpinMargin));
+        if (wake > now) {
+            std::this_thread::sleep_until(wake);
+            
+            // Grow the margin at once to a late wake-up, shrink it slowly
+            const double late = Seconds(Clock::now() - wake);
+            mSpinMargin = std::min(std::max(std::max(mSpinMargin * 0.95, late * 1.25), kMinSpinMargin),
+                                   kMaxSpinMargin);
+        }
+        while (Clock::now() < mDeadline) {
+            std::this_thread::yield();
+        }
+        now = Clock::now();
+    } else {
+        mDeadline = now;
+    }
+    
+    mFrameTime += kSmoothing * (Seconds(now - mFrameStart) - mFrameTime);
+    mFrameStart = now;
+}
@@ -0,0 +1,60 @@
+// FramePacer.h
+// Paces the windowed loop: uncapped, display-synced or at a target frame rate
+
+#pragma once
+
+#include <chrono>
+
+enum class FramePacingMode {
+    Uncapped,       // Start the next frame at once
+    DisplaySync,    // The renderer's presents wait for the display
+    TargetRate      // Sleep, then spin, to a fixed frame interval
+};
+
+// Called once per frame after present. In TargetRate mode it sleeps until
+// a margin short of the frame's deadline and spins out the rest; the
+// margin follows how late the sleeps wake, so the next frame starts on
+// time without spinning for milliseconds. When the measured GPU frame
+// time exceeds the target interval, frames are paced at the GPU's rate
+// instead, so they come evenly rather than alternating between on time
+// and late. A frame that overran its deadline starts the next interval
+// from the overrun rather than from the missed deadline.
+class FramePacer {
+public:
+    FramePacer();
+    
+    void SetMode(FramePacingMode mode) { mMode = mode; }
+    FramePacingMode GetMode() const { return mMode; }
+    void SetTargetFrameRate(float hz);
+    
+    // "uncapped", "vsync" or "target"; false for anything else
+    static bool ParseMode(const char* text, FramePacingMode& mode);
+    static const char* GetModeName(FramePacingMode mode);
+    
+    // Wait out the frame. gpuSeconds is the GPU time of the last frame the
+    // renderer saw complete (0 = unknown).
+    void EndFrame(double gpuSeconds);
+    
+    // Smoothed seconds: frame work before EndFrame, GPU time, and the
+    // whole frame from one EndFrame to the next
+    double GetCpuFrameTime() const { return mCpuTime; }
+    double GetGpuFrameTime() const { return mGpuTime; }
+    double GetFrameTime() const { return mFrameTime; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    // Sleep wake-up lateness the spin margin tracks, in seconds
+    static constexpr double kMinSpinMargin = 0.00025;
+    static constexpr double kMaxSpinMargin = 0.004;
+    
+    FramePacingMode mMode;
+    double mTargetInterval;     // Seconds
+    double mSpinMargin;
+    double mCpuTime;
+    double mGpuTime;
+    double mFrameTime;
+    bool mStarted;
+    Clock::time_point mFrameStart;  // When the last EndFrame returned
+    Clock::time_point mDeadline;    // When that frame was due to start
+};
@@ -3,32 +3,143 @@
 
 #include "../compat.h"
 #include "Game.h"
+#include "Controller.h"
 #include "Entity.h"
 #include "Physics.h"
 #include "Terrain.h"
+#include "TerrainGenerator.h"
+#include "TrajectoryPredictor.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "LatencyTracker.h"
+#include "MemoryTracker.h"
+#include "NetSession.h"
+#include "Profiler.h"
+#include "RcsThrusters.h"
+#include "ScenarioFile.h"
+#include "SnapshotBuffer.h"
+#include "TelemetryStream.h"
+#include "Log.h"
 #include "../rendering/Renderer.h"
 #include "../rendering/Renderer2D.h"
 #include "../rendering/Renderer3D_Metal.h"
+#include "../rendering/NullRenderer.h"
 #include "../input/InputHandler.h"
-#include <iostream>
+#include "../input/ScriptedInput.h"
+#include "../input/InputRecording.h"
+#include "../audio/AudioEngine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <SDL2/SDL.h>
 #include <cmath>
-#ifdef USE_METAL
-#include "../rendering/Renderer3D_Metal.h"
-#endif
+#include <algorithm>
+
+// Rewind history: a keyframe every this many snapshots, and how far the
+// rewind key goes back (seconds of flight)
+static const int kSnapshotKeyframeInterval = 32;
+static const float kRewindSeconds = 5.0f;
+
+// Frames the frame arena and caches get to settle before a frame that
+// still calls operator new is reported (debug builds)
+static const uint64_t kFrameWarmupFrames = 300;
+
+// How long a client waits for the host to answer
+static const float kNetConnectTimeout = 5.0f;
+
+// Time warp: its range, the wall time of free fall it keeps between the
+// lander and the ground, the altitude below which it is always 1x, and the
+// CPU time a warped frame's steps may take
+static const float kMaxTimeWarp = 100.0f;
+static const float kTimeWarpLeadSeconds = 2.0f;
+static const float kTimeWarpFloor = 5.0f;        // Meters
+static const uint64_t kTimeWarpBudgetNs = 8000000;
+
+// The share of the tank below which the low fuel alert sounds
+static const float kLowFuelFraction = 0.15f;
+
+// Floating origin: how far (meters, along x or z) the 3D lander may get
+// from the origin before the world is moved back under it
+static const float kOriginRebaseDistance = 2048.0f;
 
 Game::Game()
     : mGameState(GameState::READY)
     , mDifficulty(Difficulty::NORMAL)
     , m3DMode(false)
+    , mLanderBatch(nullptr)
+    , mFrontSnapshot(0)
+    , mCameraCut(true)
+    , mPipelinedRendering(false)
+    , mSimulationRequested(false)
+    , mSimulationStopping(false)
+    , mSimulationFrameTime(0)
+    , mSimulationDeltaTime(0.0f)
+    , mSimulationPending(false)
+    , mResetPending(false)
+    , mNewMapReady(false)
+    , mNewMapSeed(0)
+    , mNewMapStart(0)
+    , mPadBeaconTerrain(nullptr)
+    , mPadBeaconLayoutVersion(0)
     , mScore(0.0f)
     , mElapsedTime(0.0f)
     , mFuelUsed(0.0f)
     , mLastFrameTime(0)
+    , mFixedTimeStep(1.0f / 120.0f) // 120 Hz physics
+    , mAccumulator(0.0f)
+    , mTimeWarp(1.0f)
+    , mEffectiveTimeWarp(1.0f)
+    , mFrameIndex(0)
+    , mFrameHeapAllocations(0)
     , mWindowWidth(800)
     , mWindowHeight(600)
+    , mWorkerThreadCount(-1)
+    , mBroadphase(PhysicsBroadphase::DBVT)
+    , mAdaptiveStepping(true)
+    , mReplayInput(nullptr)
+    , mReplayWindowed(false)
+    , mChecksumInterval(120)
+    , mRandomSeed(1)
+    , mStepIndex(0)
+    , mScenario(nullptr)
+    , mHostPort(0)
+    , mNetRespawn(false)
+    , mFlightStep(0)
+    , mSnapshotInterval(12)
+    , mRewindWindow(10.0f)
+    , mInitializeStartNs(0)
+    , mFirstFramePresented(false)
+    , mTileCacheBudget(0)
+    , mTerrainGridSize(0)
+    , mWorldWidth2D(0)
+    , mWorldSegments2D(0)
+    , mViewScale2D(1.0f)
+    , mGpuTerrain(false)
+    , mTerrainTextures(false)
+    , mTerrainTessellation(false)
+    , mTerrainMeshShaders(false)
+    , mGpuTerrainCulling(false)
+    , mHiZCulling(false)
+    , mDynamicResolution(false)
+    , mTargetFrameRate(120.0f)
+    , mTemporalUpscaling(false)
+    , mVariableRasterization(false)
+    , mShadows(true)
+    , mRayTracedShadows(false)
+    , mHorizonShadows(false)
+    , mDeferredLighting(false)
+    , mParallelEncoding(false)
+    , mMaximumDrawableCount(3)
+    , mPipelineArchiveFile("assets/shaders/pipelines.binarchive")
+    , mSpikeCaptureMs(0.0f)
+    , mSpikeCaptureFrames(3)
+    , mVideoRecordings(0)
+    , mHeadless(false)
+    , mAudioEnabled(true)
+    , mFlightCount(1)
+    , mMaxFlightTime(120.0f)
     , mIsRunning(false)
-    , mPixelsPerMeter(20.0f) // Set consistent conversion factor
 {
 }
 
@@ -37,207 +148,1581 @@ Game::~Game() {
 }
 
 bool Game::Initialize() {
-    std::cout << "Initializing Lunar Lander Simulator..." << std::endl;
+    LOG_INFO("Initializing Lunar Lander Simulator...");
+    mInitializeStartNs = Profiler::Now();
+    mFirstFramePresented = false;
+    
+    // A scenario sets the terrain and mode before anything is built
+    if (!mScenarioFilename.empty() && !LoadScenario()) {
+        return false;
+    }
+    
+    // A replay dictates the mode, step size and seed it was recorded with
+    std::unique_ptr<ReplayInput> replayInput;
+    if (!mReplayFile.empty()) {
+        replayInput = std::make_unique<ReplayInput>(this);
+        if (!replayInput->Load(mReplayFile)) {
+            return false;
+        }
+        const InputRecordingHeader& header = replayInput->GetHeader();
+        m3DMode = (header.flags & InputRecordingHeader::kFlag3DMode) != 0;
+        mAdaptiveStepping = (header.flags & InputRecordingHeader::kFlagFixedSteps) == 0;
+        mFixedTimeStep = header.fixedTimeStep;
+        mRandomSeed = header.seed;
+        mChecksumInterval = static_cast<int>(header.checksumInterval);
+        mHeadless = !mReplayWindowed;
+    }
+    
+    // Network sessions step every lander as a 2D batch at the wall clock's
+    // pace, alongside the frame that draws them
+    if (!mConnectAddress.empty() || mHostPort > 0) {
+        if (m3DMode || mHeadless || replayInput) {
+            LOG_ERROR("A network session needs the 2D window (no --3d, --headless or --replay)");
+            return false;
+        }
+        if (mPipelinedRendering) {
+            LOG_WARNING("Pipelined rendering is off in a network session");
+            mPipelinedRendering = false;
+        }
+        if (mWorldWidth2D > mWindowWidth) {
+            // Peers agree on the window's terrain only
+            LOG_WARNING("A network session flies the window's terrain, ignoring the wider 2D world");
+            mWorldWidth2D = 0;
+        }
+        mNetSession = std::make_unique<NetSession>();
+        if (!mConnectAddress.empty() && !JoinNetSession()) {
+            return false;
+        }
+    }
+    
+    mStepIndex = 0;
+    mAccumulator = 0.0f;
     
-    // Create core game components
-    mLander = std::make_unique<Lander>();
-    mTerrain = std::make_unique<Terrain>();
+    // Create the worker pool first; other systems borrow it
+    mJobSystem = std::make_unique<JobSystem>(mWorkerThreadCount);
+    mFrameArena = std::make_unique<FrameArena>();
+    
+    // Create core game components; entities share one store so its
+    // systems update them together
+    mEntities = std::make_unique<EntityStore>();
+    mLander = std::make_unique<Lander>(mEntities.get(), mScenario ? ScenarioFile::GetLanderConfig(*mScenario) :
+                                                                    LanderConfig::Default());
+    mTerrain = NewTerrain();
     mPhysics = std::make_unique<Physics>();
-    mInputHandler = std::make_unique<InputHandler>(this);
+    mPhysics->SetJobSystem(mJobSystem.get());
+    mPredictor = std::make_unique<TrajectoryPredictor>();
+    mSnapshots = std::make_unique<SnapshotBuffer>();
+    if (replayInput) {
+        mReplayInput = replayInput.get();
+        mInputHandler = std::move(replayInput);
+    } else if (mHeadless) {
+        // Scripted input advances with the simulation clock
+        auto scriptedInput = std::make_unique<ScriptedInput>(mFixedTimeStep);
+        if (!mInputScript.empty() && !scriptedInput->LoadScript(mInputScript)) {
+            return false;
+        }
+        mInputHandler = std::move(scriptedInput);
+    } else {
+        mInputHandler = std::make_unique<InputHandler>(this);
+    }
 
-    // Create renderer (2D or 3D based on setting)
-    if (m3DMode) {
-        std::cout << "Using Metal 3D renderer" << std::endl;
-        mRenderer = std::make_unique<Renderer3D_Metal>();
+    // Record every poll, key press and periodic state checksum
+    if (!mRecordFile.empty() && !mReplayInput) {
+        InputRecordingHeader header;
+        header.flags = m3DMode ? InputRecordingHeader::kFlag3DMode : 0;
+        if (!mAdaptiveStepping) {
+            header.flags |= InputRecordingHeader::kFlagFixedSteps;
+        }
+        header.seed = mRandomSeed;
+        header.fixedTimeStep = mFixedTimeStep;
+        header.checksumInterval = static_cast<uint32_t>(mChecksumInterval);
+        mInputRecorder = std::make_unique<InputRecorder>();
+        if (!mInputRecorder->Open(mRecordFile, header)) {
+            return false;
+        }
+    }
+
+    // Create renderer (none when headless, otherwise 2D or 3D based on setting)
+    if (mHeadless) {
+        LOG_INFO("Running headless");
+    }
+    mRenderer = CreateRenderer(m3DMode);
+    if (!mRenderer) {
+        return false;
+    }
+    
+    // Create the physics world, then register entities with it
+    mPhysics->Set3DMode(m3DMode);
+    mPhysics->SetBroadphase(mBroadphase);
+    mPhysics->SetAdaptiveStepping(mAdaptiveStepping);
+    mPhysics->Initialize();
+    mPhysics->RegisterLander(mLander.get());
+    mPhysics->RegisterTerrain(mTerrain.get());
+    
+    // Set physics parameters based on the scenario or difficulty
+    mPhysics->SetGravity(mScenario ? mScenario->gravity : Rules::GetGravity(mDifficulty));
+    
+    // Initialize terrain
+    CreateTerrain(mTerrain.get(), mRandomSeed, true);
+    
+    // Reset game state
+    Reset();
+    
+    // Host from the world just laid out, or fly in the one joined
+    if (mNetSession && !StartNetSession()) {
+        return false;
+    }
+    
+    // Telemetry goes out at the step size the session settled on
+    if (!mTelemetryName.empty()) {
+        mTelemetry = std::make_unique<TelemetryStream>();
+        if (!mTelemetry->Create(mTelemetryName, TelemetryStream::kDefaultCapacity, mFixedTimeStep)) {
+            return false;
+        }
+    }
+    
+    // Sound for a pilot at the window; a machine without a device runs silent
+    if (mAudioEnabled && !mHeadless) {
+        mAudio = std::make_unique<AudioEngine>();
+        if (!mAudio->Start()) {
+            mAudio.reset();
+        }
+    }
+    
+    // The first frame draws the starting state
+    for (RenderSnapshot& snapshot : mRenderSnapshots) {
+        snapshot.lander = std::make_unique<Lander>();
+    }
+    CaptureRenderSnapshot(mRenderSnapshots[mFrontSnapshot]);
+    
+    mIsRunning = true;
+    mLastFrameTime = SDL_GetTicks();
+    
+    LOG_INFO("Initialization complete");
+    return true;
+}
+
+void Game::Run() {
+    LOG_INFO("Starting game loop...");
+
+    if (!mIsRunning) {
+        LOG_ERROR("Game not initialized!");
+        return;
+    }
+    
+    if (mReplayInput) {
+        RunReplay();
+        return;
+    }
+    
+    if (mHeadless) {
+        RunHeadless();
+        return;
+    }
+    
+    // Main game loop
+    mFramePacer.SetTargetFrameRate(mTargetFrameRate);
+    LOG_INFO("Frame pacing: %s", FramePacer::GetModeName(mFramePacer.GetMode()));
+    if (mPipelinedRendering) {
+        LOG_INFO("Pipelined rendering: each frame simulates while the last one renders");
+        mSimulationStopping = false;
+        mSimulationThread = std::thread(&Game::SimulationLoop, this);
+    }
+    while (mIsRunning) {
+        RunFrame();
+        EndFrame();
+        
+        // Wait for the next frame's start, inside this frame's profile
+        mFramePacer.EndFrame(mRenderer ? mRenderer->GetGpuFrameTime() : 0.0);
+        PROFILE_END_FRAME();
+    }
+    StopSimulationThread();
+}
+
+void Game::RunFrame() {
+    // One windowed frame: input, fixed steps, interpolation and render
+    PROFILE_SCOPE("Frame");
+    
+    // Calculate delta time
+    unsigned int currentTime = SDL_GetTicks();
+    float deltaTime = (currentTime - mLastFrameTime) / 1000.0f;
+    mLastFrameTime = currentTime;
+    
+    // Cap delta time so a lag spike can't queue up an unbounded number of steps
+    if (deltaTime > 0.1f) {
+        deltaTime = 0.1f;
+    }
+    
+    // Pipelined: collect the frame the simulation thread stepped while the
+    // last one rendered, and start on this one's steps before drawing it
+    if (mSimulationThread.joinable()) {
+        if (mSimulationPending) {
+            WaitForSimulation();
+            mFrontSnapshot ^= 1;
+            mSimulationPending = false;
+        }
+        
+        // With the thread idle, key callbacks, a reset it asked for and
+        // terrain streaming can change what it steps next
+        if (mInputHandler) {
+            mInputHandler->ProcessInput();
+        }
+        if (mResetPending) {
+            mResetPending = false;
+            Reset();
+        }
+        FinishNewMap(false);
+        UpdateTerrainStreaming();
+        if (mIsRunning) {
+            StartSimulation(currentTime, deltaTime);
+            mSimulationPending = true;
+        }
     } else {
-        mRenderer = std::make_unique<Renderer2D>();
+        // Pump events once per frame; key changes wait in the input
+        // source's queue for the step they happened during
+        if (mInputHandler) {
+            mInputHandler->ProcessInput();
+        }
+        FinishNewMap(false);
+        SimulateFrame(currentTime, deltaTime);
+        mFrontSnapshot ^= 1;
     }
     
-    // Initialize renderer
-    if (!mRenderer->Initialize(mWindowWidth, mWindowHeight, "Lunar Lander Simulator")) {
-        std::cerr << "Failed to initialize renderer!" << std::endl;
+    // Update camera and render at frame rate
+    UpdateCamera(deltaTime);
+    Render();
+}
+
+void Game::SimulateFrame(unsigned int currentTime, float deltaTime) {
+    // A frame's fixed steps, interpolation and prediction, captured into
+    // the back render snapshot
+    PROFILE_SCOPE("Simulation");
+    
+    // Advance the simulation in fixed steps. The steps catch the simulation
+    // up to the current time less what stays in the accumulator, so each
+    // one ends mFixedTimeStep after the last on the wall clock (divided by
+    // the time warp), and takes the input up to then.
+    const float warp = ComputeTimeWarp();
+    mEffectiveTimeWarp = warp;
+    if (mPhysics) {
+        mPhysics->SetBallisticCoasting(warp > 1.0f);
+    }
+    mAccumulator += deltaTime * warp;
+    const double stepMs = mFixedTimeStep * 1000.0 / warp;
+    double stepEndMs = currentTime - mAccumulator / warp * 1000.0;
+    const uint64_t budgetEnd = Profiler::Now() + kTimeWarpBudgetNs;
+    int steps = 0;
+    while (mAccumulator >= mFixedTimeStep) {
+        stepEndMs += stepMs;
+        if (mInputHandler) {
+            mInputHandler->AdvanceTo(static_cast<uint32_t>(std::max(stepEndMs, 0.0)));
+        }
+        ApplyInput();
+        StepSimulation();
+        mAccumulator -= mFixedTimeStep;
+        steps++;
+        
+        // A warped frame stops at its budget; the steps left are dropped,
+        // so the warp falls short instead of the frame rate
+        if (warp > 1.0f && Profiler::Now() > budgetEnd) {
+            mAccumulator = std::fmod(mAccumulator, mFixedTimeStep);
+            mEffectiveTimeWarp = std::min(warp, steps * mFixedTimeStep / std::max(deltaTime, 1e-6f));
+            break;
+        }
+    }
+    
+    // Blend the last two simulation states for rendering
+    float alpha = mAccumulator / mFixedTimeStep;
+    if (mEntities) {
+        mEntities->InterpolateRenderTransforms(alpha);
+    }
+    
+    // Touchdown marker for the state the steps left
+    UpdatePrediction();
+    
+    CaptureRenderSnapshot(mRenderSnapshots[mFrontSnapshot ^ 1]);
+}
+
+void Game::SimulationLoop() {
+    Profiler::SetThreadName("Simulation");
+    
+    for (;;) {
+        unsigned int currentTime;
+        float deltaTime;
+        {
+            std::unique_lock<std::mutex> lock(mSimulationMutex);
+            mSimulationCondition.wait(lock, [this] { return mSimulationStopping || mSimulationRequested; });
+            if (mSimulationStopping) {
+                return;
+            }
+            currentTime = mSimulationFrameTime;
+            deltaTime = mSimulationDeltaTime;
+        }
+        
+        SimulateFrame(currentTime, deltaTime);
+        
+        {
+            std::lock_guard<std::mutex> lock(mSimulationMutex);
+            mSimulationRequested = false;
+        }
+        mSimulationCondition.notify_all();
+    }
+}
+
+void Game::StartSimulation(unsigned int currentTime, float deltaTime) {
+    {
+        std::lock_guard<std::mutex> lock(mSimulationMutex);
+        mSimulationFrameTime = currentTime;
+        mSimulationDeltaTime = deltaTime;
+        mSimulationRequested = true;
+    }
+    mSimulationCondition.notify_all();
+}
+
+void Game::WaitForSimulation() {
+    PROFILE_SCOPE("Wait For Simulation");
+    std::unique_lock<std::mutex> lock(mSimulationMutex);
+    mSimulationCondition.wait(lock, [this] { return !mSimulationRequested; });
+}
+
+void Game::StopSimulationThread() {
+    if (!mSimulationThread.joinable()) {
+        return;
+    }
+    
+    // Let a frame in flight finish; its snapshot is never drawn
+    WaitForSimulation();
+    mSimulationPending = false;
+    {
+        std::lock_guard<std::mutex> lock(mSimulationMutex);
+        mSimulationStopping = true;
+    }
+    mSimulationCondition.notify_all();
+    mSimulationThread.join();
+}
+
+void Game::EndFrame() {
+    // Nothing from the frame arena outlives the frame that allocated it
+    mFrameArena->Reset();
+    mFrameIndex++;
+
+#ifndef NDEBUG
+    // Per-frame scratch belongs in the arena, so a settled frame should make
+    // no heap calls; one that did has a container to move onto it
+    uint64_t heapAllocations = FrameArena::GetHeapAllocationCount();
+    if (mFrameIndex > kFrameWarmupFrames && heapAllocations != mFrameHeapAllocations) {
+        LOG_WARNING_EVERY(10000, "Frame %llu made %llu heap allocations",
+                          static_cast<unsigned long long>(mFrameIndex),
+                          static_cast<unsigned long long>(heapAllocations - mFrameHeapAllocations));
+    }
+    mFrameHeapAllocations = heapAllocations;
+#endif
+}
+
+void Game::RunHeadless() {
+    // Step the simulation back to back with no frame pacing or rendering
+    int landed = 0;
+    int crashed = 0;
+    long long steps = 0;
+    double simulatedTime = 0.0;
+    
+    auto wallStart = std::chrono::steady_clock::now();
+    
+    // Steps run back to back already; a warp lets the lander coast
+    if (mPhysics) {
+        mPhysics->SetBallisticCoasting(mTimeWarp > 1.0f && !mInputRecorder && !mReplayInput);
+    }
+    
+    for (int flight = 0; flight < mFlightCount && mIsRunning; ++flight) {
+        if (flight > 0) {
+            Reset();
+        }
+        
+        float flightTime = 0.0f;
+        while (mIsRunning && flightTime < mMaxFlightTime &&
+               mGameState != GameState::LANDED && mGameState != GameState::CRASHED) {
+            ProcessInput();
+            StepSimulation();
+            PROFILE_END_FRAME();
+            flightTime += mFixedTimeStep;
+            steps++;
+        }
+        
+        simulatedTime += flightTime;
+        if (mGameState == GameState::LANDED) {
+            landed++;
+        } else if (mGameState == GameState::CRASHED) {
+            crashed++;
+        }
+    }
+    
+    double wallSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wallStart).count();
+    if (wallSeconds <= 0.0) {
+        wallSeconds = 1e-9;
+    }
+    
+    // Report throughput
+    LOG_INFO("Headless run: %d flights finished (%d landed, %d crashed), %lld steps",
+             landed + crashed, landed, crashed, steps);
+    LOG_INFO("Simulated %g s in %g s wall time (%g sim-s/s, %g steps/s)",
+             simulatedTime, wallSeconds, simulatedTime / wallSeconds, steps / wallSeconds);
+    
+    mIsRunning = false;
+}
+
+void Game::RunReplay() {
+    // Feed the recorded polls back step for step: as fast as possible when
+    // headless, otherwise drawing a frame after each slice of steps
+    auto wallStart = std::chrono::steady_clock::now();
+    unsigned long long frames = 0;
+    
+    if (mHeadless) {
+        while (mIsRunning && !mReplayInput->IsFinished(mStepIndex)) {
+            StepReplay();
+            PROFILE_END_FRAME();
+        }
+    } else {
+        // Each frame covers the same simulated time whatever the wall clock
+        // did, so every run of a recording draws the same frames
+        mFramePacer.SetTargetFrameRate(mTargetFrameRate);
+        const float frameTime = 1.0f / mTargetFrameRate;
+        while (mIsRunning && !mReplayInput->IsFinished(mStepIndex)) {
+            RunReplayFrame(frameTime);
+            EndFrame();
+            mFramePacer.EndFrame(mRenderer ? mRenderer->GetGpuFrameTime() : 0.0);
+            PROFILE_END_FRAME();
+            frames++;
+        }
+    }
+    
+    double wallSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wallStart).count();
+    
+    LOG_INFO("Replayed %llu steps (%llu frames) in %g s; %d checksums verified, %d mismatches",
+             static_cast<unsigned long long>(mStepIndex), frames, wallSeconds,
+             mReplayInput->GetChecksumsVerified(), mReplayInput->GetChecksumMismatches());
+    
+    mIsRunning = false;
+}
+
+void Game::RunReplayFrame(float frameTime) {
+    // One windowed replay frame: the steps the frame covers, interpolation
+    // and render, as RunFrame() does with live input
+    PROFILE_SCOPE("Frame");
+    
+    // The recording is the input; the window only needs its events pumped
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            mIsRunning = false;
+        }
+    }
+    
+    {
+        PROFILE_SCOPE("Simulation");
+        mAccumulator += frameTime;
+        while (mAccumulator >= mFixedTimeStep && !mReplayInput->IsFinished(mStepIndex)) {
+            StepReplay();
+            mAccumulator -= mFixedTimeStep;
+        }
+        
+        float alpha = std::min(mAccumulator / mFixedTimeStep, 1.0f);
+        if (mEntities) {
+            mEntities->InterpolateRenderTransforms(alpha);
+        }
+        UpdatePrediction();
+        CaptureRenderSnapshot(mRenderSnapshots[mFrontSnapshot ^ 1]);
+    }
+    mFrontSnapshot ^= 1;
+    
+    UpdateCamera(frameTime);
+    Render();
+}
+
+void Game::StepReplay() {
+    // The polls recorded before this step, then the step
+    int polls = mReplayInput->GetPollCount(mStepIndex);
+    for (int i = 0; i < polls; ++i) {
+        ProcessInput();
+    }
+    StepSimulation();
+}
+
+void Game::StepSimulation() {
+    // One fixed step, shared by the windowed, headless and replay loops
+    PROFILE_SCOPE("Update");
+    
+    if (mEntities) {
+        mEntities->SavePreviousTransforms();
+    }
+    bool flying = mGameState == GameState::FLYING;
+    const float fuelBefore = mLander ? mLander->GetFuel() : 0.0f;
+    if (mNetSession) {
+        StepNetSession();
+    } else {
+        ApplyController();
+    }
+    Update(mFixedTimeStep);
+    mStepIndex++;
+    LatencyTracker::OnStepEnd();
+    
+    // Rewind history, while the flight lasts
+    if (flying) {
+        mFlightStep++;
+        if (mGameState == GameState::FLYING && mFlightStep % mSnapshotInterval == 0) {
+            CaptureSnapshot();
+        }
+    }
+    
+    if (mTelemetry) {
+        PublishTelemetry();
+    }
+    if (mAudio) {
+        UpdateAudio(flying, fuelBefore);
+    }
+    
+    // Periodic state checksum so a replay can find where it diverges
+    if (mStepIndex % mChecksumInterval == 0 && (mInputRecorder || mReplayInput)) {
+        uint32_t checksum = ComputeStateChecksum();
+        if (mInputRecorder) {
+            mInputRecorder->RecordChecksum(mStepIndex, checksum);
+        }
+        if (mReplayInput) {
+            mReplayInput->VerifyChecksum(mStepIndex, checksum);
+        }
+    }
+}
+
+void Game::SetController(std::unique_ptr<Controller> controller) {
+    mController = std::move(controller);
+}
+
+void Game::ApplyController() {
+    if (!mController || !mLander || !mTerrain || !mPhysics || mGameState != GameState::FLYING) {
+        return;
+    }
+    
+    LanderState state;
+    const float* position = mLander->GetPosition();
+    const float* velocity = mLander->GetVelocity();
+    for (int i = 0; i < 3; i++) {
+        state.position[i] = position[i];
+        state.velocity[i] = velocity[i];
+    }
+    state.rotation = mLander->GetRotation()[2];
+    state.fuel = mLander->GetFuel();
+    state.maxFuel = mLander->GetMaxFuel();
+    state.gravity = mPhysics->GetGravity();
+    state.maxThrustAccel = mLander->GetMaxThrust(state.gravity) / mLander->GetMass().Value();   // As Physics pushes it now
+    state.deltaTime = mFixedTimeStep;
+    
+    // Height above the ground straight below (0 off the terrain's edge)
+    if (!GetAltitudeAboveGround(state.altitude)) {
+        state.altitude = 0.0f;
+    }
+    
+    ControlCommand command = mController->Compute(state);
+    mLander->ApplyThrust(command.thrust);
+    
+    // The controller asks for a turn; the RCS flies it within its torque
+    mLander->FireRcs(RcsThrusters::CommandForTurn(command.rotation, mLander->GetSpin(),
+                                                  mPhysics->GetRcsAngularAcceleration(), mFixedTimeStep));
+}
+
+void Game::PublishTelemetry() {
+    if (!mLander || !mPhysics) {
+        return;
+    }
+    TelemetrySample sample;
+    std::memset(&sample, 0, sizeof(sample));
+    sample.step = mStepIndex;
+    sample.flightTime = mFlightStep * static_cast<double>(mFixedTimeStep);
+    mLander->GetWorldPosition(sample.position);
+    const float* velocity = mLander->GetVelocity();
+    const Quaternion& orientation = mLander->GetOrientation();
+    for (int i = 0; i < 3; i++) {
+        sample.velocity[i] = velocity[i];
+    }
+    sample.orientation[0] = orientation.x;
+    sample.orientation[1] = orientation.y;
+    sample.orientation[2] = orientation.z;
+    sample.orientation[3] = orientation.w;
+    mPhysics->GetLanderAngularVelocity(sample.angularVelocity);
+    sample.fuel = mLander->GetFuel();
+    sample.maxFuel = mLander->GetMaxFuel();
+    sample.thrustLevel = mLander->GetThrustLevel();
+    sample.rcsCommand = mLander->GetRcsCommand();
+    
+    sample.flags = (m3DMode ? TELEMETRY_3D : 0) | (mGameState == GameState::FLYING ? TELEMETRY_FLYING : 0) |
+                   (mLander->IsLanded() ? TELEMETRY_LANDED : 0) | (mLander->IsCrashed() ? TELEMETRY_CRASHED : 0) |
+                   (mLander->IsThrustActive() ? TELEMETRY_THRUST : 0);
+    if (GetAltitudeAboveGround(sample.altitude)) {
+        sample.flags |= TELEMETRY_ALTITUDE;
+    }
+    
+    // The step's ground contacts by part (3D; the 2D lander has none)
+    for (const Physics::ContactEvent& contact : mPhysics->GetContactEvents()) {
+        if (contact.ground && contact.partIndex >= 0 && contact.partIndex <= Physics::kLegCount) {
+            sample.contacts |= 1u << contact.partIndex;
+        }
+        sample.contactImpulse += contact.impulse;
+    }
+    
+    mTelemetry->Publish(sample);
+}
+
+void Game::UpdateAudio(bool wasFlying, float fuelBefore) {
+    if (!mLander) {
+        return;
+    }
+    AudioParams params;
+    params.flying = mGameState == GameState::FLYING;
+    params.thrustLevel = mLander->IsThrustActive() ? mLander->GetThrustLevel() : 0.0f;
+    params.rcsLevel = std::fabs(mLander->GetRcsCommand());
+    if (!GetAltitudeAboveGround(params.altitude)) {
+        params.altitude = -1.0f;
+    }
+    params.descentRate = -mLander->GetVelocity()[1];
+    mAudio->SetParams(params);
+    
+    // Events: the flight's end, and the tank crossing the low fuel mark
+    if (wasFlying && mGameState == GameState::LANDED) {
+        mAudio->PlayEvent(AudioEvent::Landed);
+    } else if (wasFlying && mGameState == GameState::CRASHED) {
+        mAudio->PlayEvent(AudioEvent::Crashed);
+    }
+    const float lowFuel = kLowFuelFraction * mLander->GetMaxFuel();
+    if (params.flying && fuelBefore > lowFuel && mLander->GetFuel() <= lowFuel) {
+        mAudio->PlayEvent(AudioEvent::LowFuel);
+    }
+}
+
+bool Game::JoinNetSession() {
+    NetAddress address;
+    if (!NetAddress::Parse(mConnectAddress, address)) {
+        LOG_ERROR("Bad host address '%s' (host:port)", mConnectAddress.c_str());
         return false;
     }
+    NetSessionSettings settings;
+    if (!mNetSession->Connect(address, kNetConnectTimeout, settings)) {
+        return false;
+    }
+    
+    // The host's terrain and step, so both ends simulate the same world
+    mRandomSeed = settings.seed;
+    mFixedTimeStep = settings.fixedTimeStep;
+    mWindowWidth = settings.worldWidth;
+    mWindowHeight = settings.worldHeight;
+    return true;
+}
+
+bool Game::LoadScenario() {
+    mScenarioFile = std::make_unique<ScenarioFile>();
+    if (!mScenarioFile->Open(mScenarioFilename.c_str())) {
+        return false;
+    }
+    if (mScenarioName.empty()) {
+        mScenario = mScenarioFile->GetCount() > 0 ? &mScenarioFile->Get(0) : nullptr;
+    } else {
+        mScenario = mScenarioFile->Find(mScenarioName.c_str());
+    }
+    if (!mScenario) {
+        LOG_ERROR("No scenario '%s' in %s", mScenarioName.c_str(), mScenarioFilename.c_str());
+        return false;
+    }
+    
+    // The terrain it names; 2D worlds are the window's terrain, as a
+    // session's are
+    const ScenarioRecord& scenario = *mScenario;
+    m3DMode = scenario.terrain != ScenarioTerrain::Generated2D;
+    mRandomSeed = scenario.seed;
+    mHeightmapFile = scenario.terrain == ScenarioTerrain::Dem ? mScenarioFile->GetTerrainPath(scenario) : "";
+    if (scenario.gridSize > 0) {
+        mTerrainGridSize = scenario.gridSize;
+    }
+    if (!m3DMode) {
+        mWindowWidth = scenario.worldWidth;
+        mWindowHeight = scenario.worldHeight;
+    }
+    LOG_INFO("Scenario %s: %s terrain, seed %u, gravity %g m/s²", mScenarioFile->GetName(scenario),
+             scenario.terrain == ScenarioTerrain::Dem ? mHeightmapFile.c_str() : (m3DMode ? "3D" : "2D"),
+             scenario.seed, scenario.gravity);
+    return true;
+}
+
+bool Game::StartNetSession() {
+    if (mNetSession->IsConnected()) {
+        LOG_INFO("Joined a %dx%d world, seed %u", mWindowWidth, mWindowHeight, mRandomSeed);
+    } else {
+        NetSessionSettings settings;
+        settings.seed = mRandomSeed;
+        settings.fixedTimeStep = mFixedTimeStep;
+        settings.gravity = mPhysics->GetGravity();
+        settings.maxFuel = mLander->GetMaxFuel();
+        settings.fuelRate = mLander->GetFuelConsumptionRate();
+        settings.spawnX = mLander->GetPosition()[0];
+        settings.spawnY = mLander->GetPosition()[1];
+        settings.spawnVelX = mLander->GetVelocity()[0];
+        settings.spawnVelY = mLander->GetVelocity()[1];
+        settings.spawnFuel = mLander->GetFuel();
+        settings.landerWidth = mLander->GetWidth().Value();
+        settings.landerHeight = mLander->GetHeight().Value();
+        settings.worldWidth = static_cast<uint16_t>(mWindowWidth);
+        settings.worldHeight = static_cast<uint16_t>(mWindowHeight);
+        // Session landers push a fixed 2.5 g (LanderBatch), whatever the engine
+        const LanderConfig& config = mLander->GetConfig();
+        const LanderConfig defaults = LanderConfig::Default();
+        if (config.maxThrustForce != defaults.maxThrustForce || config.dryMass != defaults.dryMass) {
+            LOG_WARNING("The session flies the default engine and dry mass, not the scenario's");
+        }
+        if (mHostPort > 65535 || !mNetSession->Host(static_cast<uint16_t>(mHostPort), settings)) {
+            LOG_ERROR("Could not host on port %d", mHostPort);
+            return false;
+        }
+    }
+    mNetSession->SetTerrain(mTerrain.get());
+    SetLanderBatch(mNetSession->GetRemoteLanders());
+    return true;
+}
+
+void Game::StepNetSession() {
+    // The session steps this end's lander with the step's controls; a
+    // lander not flying waits at the spawn point
+    uint8_t actions = 0;
+    if (mGameState == GameState::FLYING && !mNetRespawn && mInputHandler) {
+        actions = kNetActionFly;
+        if (mInputHandler->IsThrustActive()) {
+            actions |= kNetActionThrust;
+        }
+        if (mInputHandler->IsRotateLeftActive()) {
+            actions |= kNetActionLeft;
+        }
+        if (mInputHandler->IsRotateRightActive()) {
+            actions |= kNetActionRight;
+        }
+    }
+    mNetRespawn = false;
+    mNetSession->Step(actions);
+    if (!mNetSession->IsConnected()) {
+        mIsRunning = false;
+    }
+}
+
+void Game::SyncNetLander() {
+    LanderBatchLander lander;
+    mNetSession->GetLocalLander(lander);
+    mLander->SetPosition(lander.x, lander.y);
+    float* velocity = mLander->GetVelocity();
+    velocity[0] = lander.velX;
+    velocity[1] = lander.velY;
+    mLander->SetRotation(0.0f, 0.0f, lander.rotation);
+    mLander->SetSpin(lander.spin);
+    mLander->SetFuel(lander.fuel);
+    mLander->ApplyThrust(lander.thrustLevel);
+    mLander->SetLanded(lander.state == BATCH_LANDED);
+    mLander->SetCrashed(lander.state == BATCH_CRASHED);
+}
+
+bool Game::GetAltitudeAboveGround(float& altitude) const {
+    if (!mLander || !mTerrain) {
+        return false;
+    }
+    const float* position = mLander->GetPosition();
+    float surface = 0.0f;
+    bool overTerrain = m3DMode ? mTerrain->SampleHeight(position[0], position[2], surface)
+                               : mTerrain->SampleHeight2D(position[0], surface);
+    if (!overTerrain) {
+        return false;
+    }
+    altitude = position[1] - mLander->GetHeight().Value() / 2 - surface;
+    return true;
+}
+
+bool Game::Rewind(float seconds) {
+    // A session's past is the host's
+    if (!mSnapshots || !mLander || !mPhysics || mNetSession) {
+        return false;
+    }
+    
+    uint64_t back = static_cast<uint64_t>(std::max(seconds, 0.0f) / mFixedTimeStep + 0.5f);
+    uint64_t target = mFlightStep > back ? mFlightStep - back : 0;
+    SimulationSnapshot snapshot;
+    uint64_t snapshotStep = 0;
+    if (!mSnapshots->Restore(target, snapshot, snapshotStep)) {
+        return false;
+    }
+    
+    // What came after is a future that no longer happens
+    mSnapshots->Truncate(snapshotStep);
+    RestoreSnapshot(snapshot);
+    LOG_INFO("Rewound %.2f s to %.2f s of flight",
+             (mFlightStep - snapshotStep) * mFixedTimeStep, snapshotStep * mFixedTimeStep);
+    mFlightStep = snapshotStep;
+    return true;
+}
+
+void Game::CaptureSnapshot() {
+    PROFILE_ZONE("Rewind Snapshot");
+    
+    SimulationSnapshot snapshot;
+    const float* position = mLander->GetPosition();
+    const float* velocity = mLander->GetVelocity();
+    for (int i = 0; i < 3; i++) {
+        snapshot.position[i] = position[i];
+        snapshot.velocity[i] = velocity[i];
+    }
+    const Quaternion& orientation = mLander->GetOrientation();
+    snapshot.orientation[0] = orientation.x;
+    snapshot.orientation[1] = orientation.y;
+    snapshot.orientation[2] = orientation.z;
+    snapshot.orientation[3] = orientation.w;
+    mPhysics->GetLanderAngularVelocity(snapshot.angularVelocity);
+    snapshot.fuel = mLander->GetFuel();
+    snapshot.thrustLevel = mLander->GetThrustLevel();
+    snapshot.flags = (mLander->IsThrustActive() ? kSnapshotThrustActive : 0) |
+                     (mLander->IsLanded() ? kSnapshotLanded : 0) |
+                     (mLander->IsCrashed() ? kSnapshotCrashed : 0) |
+                     (mLander->IsActive() ? kSnapshotActive : 0);
+    snapshot.gameState = static_cast<uint32_t>(mGameState);
+    snapshot.elapsedTime = mElapsedTime;
+    snapshot.fuelUsed = mFuelUsed;
+    snapshot.score = mScore;
+    snapshot.originCells[0] = mTerrain ? mTerrain->GetOriginShiftX() : 0;
+    snapshot.originCells[1] = mTerrain ? mTerrain->GetOriginShiftZ() : 0;
+    mSnapshots->Push(mFlightStep, snapshot);
+}
+
+void Game::RestoreSnapshot(const SimulationSnapshot& snapshot) {
+    // Taken before a move of the floating origin: the same world position
+    // relative to the origin now
+    double position[3] = {snapshot.position[0], snapshot.position[1], snapshot.position[2]};
+    if (mTerrain) {
+        position[0] += static_cast<double>(snapshot.originCells[0] - mTerrain->GetOriginShiftX()) * mTerrain->GetCellWidth();
+        position[2] += static_cast<double>(snapshot.originCells[1] - mTerrain->GetOriginShiftZ()) * mTerrain->GetCellLength();
+    }
+    mLander->SetPosition(static_cast<float>(position[0]), static_cast<float>(position[1]),
+                         static_cast<float>(position[2]));
+    float* velocity = mLander->GetVelocity();
+    for (int i = 0; i < 3; i++) {
+        velocity[i] = snapshot.velocity[i];
+    }
+    Quaternion orientation = { snapshot.orientation[0], snapshot.orientation[1],
+                               snapshot.orientation[2], snapshot.orientation[3] };
+    mLander->SetOrientation(orientation);
+    mLander->SetFuel(snapshot.fuel);
+    mLander->ApplyThrust((snapshot.flags & kSnapshotThrustActive) ? snapshot.thrustLevel : 0.0f);
+    mLander->SetLanded((snapshot.flags & kSnapshotLanded) != 0);
+    mLander->SetCrashed((snapshot.flags & kSnapshotCrashed) != 0);
+    mLander->SetActive((snapshot.flags & kSnapshotActive) != 0);
+    mPhysics->ResyncLanderBody(snapshot.angularVelocity);
+    
+    mGameState = static_cast<GameState>(snapshot.gameState);
+    mElapsedTime = snapshot.elapsedTime;
+    mFuelUsed = snapshot.fuelUsed;
+    mScore = snapshot.score;
+    
+    // Don't interpolate, predict or smooth the camera across the jump
+    mLander->SavePreviousTransform();
+    mLander->InterpolateRenderTransform(1.0f);
+    mCameraCut = true;
+    if (mPredictor) {
+        mPredictor->Invalidate();
+    }
+}
+
+void Game::UpdatePrediction() {
+    if (!mPredictor) {
+        return;
+    }
+    if (mGameState != GameState::FLYING || !mLander || !mTerrain || !mPhysics) {
+        mPredictor->Invalidate();
+        return;
+    }
+    
+    PROFILE_SCOPE("Prediction");
+    mPredictor->Update(*mLander, *mTerrain, mPhysics->GetGravity(), m3DMode, mStepIndex, mFixedTimeStep);
+}
+
+static_assert(RenderSnapshot::kMaxDebris == Physics::kDebrisPoolSize &&
+              sizeof(RenderSnapshot::debris) == sizeof(float) * Physics::kDebrisPoolSize * Physics::kDebrisPieceFloats,
+              "The snapshot holds every pooled fragment");
+
+void Game::CaptureRenderSnapshot(RenderSnapshot& snapshot) {
+    PROFILE_ZONE("Render Snapshot");
+    
+    if (!snapshot.lander) {
+        return;
+    }
+    if (mLander) {
+        snapshot.lander->CopyStateFrom(*mLander);
+    }
+    snapshot.gameState = mGameState;
+    snapshot.elapsedTime = mElapsedTime;
+    snapshot.score = mScore;
+    snapshot.altitude = snapshot.lander->GetPosition()[1];
+    GetAltitudeAboveGround(snapshot.altitude);
+
+    snapshot.hasImpact = mGameState == GameState::FLYING && mPredictor && mPredictor->HasImpact();
+    if (snapshot.hasImpact) {
+        const float* impact = mPredictor->GetImpact().position;
+        for (int i = 0; i < 3; i++) {
+            snapshot.impact[i] = impact[i];
+        }
+    }
+    
+    // Particles read Bullet's contacts, which only the simulation may touch
+    snapshot.hasParticles = m3DMode && mLander && mTerrain && mPhysics;
+    snapshot.debrisCount = 0;
+    if (!snapshot.hasParticles) {
+        return;
+    }
+    
+    // Engine axis of the interpolated lander, as Physics thrusts in 3D
+    Matrix4x4 rotation = SimdMath::Rotation(mLander->GetRenderOrientation());
+    const float* up = &rotation.values[4];
+    const float* position = mLander->GetRenderPosition();
+    float halfHeight = mLander->GetHeight().Value() / 2;
+    
+    ParticleEmitters& emitters = snapshot.emitters;
+    const float* velocity = mLander->GetVelocity();
+    for (int i = 0; i < 3; i++) {
+        emitters.nozzle[i] = position[i] - up[i] * halfHeight;
+        emitters.exhaustDirection[i] = -up[i];
+        emitters.velocity[i] = velocity[i];
+    }
+    bool burning = mGameState == GameState::FLYING && mLander->IsThrustActive();
+    emitters.thrustLevel = burning ? mLander->GetThrustLevel() : 0.0f;
+    if (!mTerrain->SampleHeight(emitters.nozzle[0], emitters.nozzle[2], emitters.groundHeight)) {
+        emitters.groundHeight = -1.0e6f;    // Off the terrain: nothing to kick up
+    }
+    PlumeImpingement plume = mPhysics->SamplePlume(emitters.nozzle, emitters.exhaustDirection, emitters.thrustLevel);
+    emitters.plumeRadius = plume.radius;
+    emitters.dustRate = plume.dustRate;
+    
+    emitters.contacts = snapshot.contacts;
+    emitters.contactCount = mPhysics->GetLanderContacts(snapshot.contacts, RenderSnapshot::kMaxContacts);
+    emitters.gravity = mPhysics->GetGravity();
+    
+    snapshot.debrisCount = mPhysics->GetDebris(snapshot.debris, RenderSnapshot::kMaxDebris);
+}
+
+void Game::RenderParticles() {
+    const RenderSnapshot& frame = GetRenderSnapshot();
+    if (frame.hasParticles) {
+        mRenderer->RenderParticles(frame.emitters);
+    }
+}
+
+// Point lights: a landing light under the lander and a beacon on each
+// corner of the landing pad
+static const float kLandingLightRadius = 40.0f;       // Meters
+static const float kLandingLightColor[3] = {1.6f, 1.45f, 1.2f};
+static const float kPadBeaconRadius = 12.0f;
+static const float kPadBeaconHeight = 1.0f;           // Above the surface
+static const float kPadBeaconColor[3] = {1.5f, 0.35f, 0.2f};
+static const float kPadBeaconPulseHz = 0.5f;
+
+void Game::UpdatePointLights() {
+    PROFILE_ZONE("Point Lights");
+    
+    // The pad only moves with the terrain's layout, so its corners are
+    // found once per layout
+    if (mPadBeaconTerrain != mTerrain.get() || mPadBeaconLayoutVersion != mTerrain->GetLayoutVersion()) {
+        mPadBeaconTerrain = mTerrain.get();
+        mPadBeaconLayoutVersion = mTerrain->GetLayoutVersion();
+        mPadBeacons.clear();
+        
+        const std::vector<unsigned char>& padCells = mTerrain->GetLandingPadCells();
+        const int gridSize = mTerrain->GetGridSize();
+        int minX = gridSize, minZ = gridSize, maxX = -1, maxZ = -1;
+        for (int z = 0; z < gridSize && !padCells.empty(); z++) {
+            for (int x = 0; x < gridSize; x++) {
+                if (padCells[z * gridSize + x] != 0) {
+                    minX = std::min(minX, x);
+                    minZ = std::min(minZ, z);
+                    maxX = std::max(maxX, x);
+                    maxZ = std::max(maxZ, z);
+                }
+            }
+        }
+        if (maxX >= 0) {
+            const int cornerX[2] = { minX, maxX + 1 };
+            const int cornerZ[2] = { minZ, maxZ + 1 };
+            for (int cx : cornerX) {
+                for (int cz : cornerZ) {
+                    PointLight beacon;
+                    beacon.position[0] = mTerrain->GetOriginX() + cx * mTerrain->GetCellWidth();
+                    beacon.position[2] = mTerrain->GetOriginZ() + cz * mTerrain->GetCellLength();
+                    if (!mTerrain->SampleHeight(beacon.position[0], beacon.position[2], beacon.position[1])) {
+                        continue;
+                    }
+                    beacon.position[1] += kPadBeaconHeight;
+                    beacon.radius = kPadBeaconRadius;
+                    mPadBeacons.push_back(beacon);
+                }
+            }
+        }
+    }
     
-    // Register entities with physics
-    mPhysics->RegisterLander(mLander.get());
-    mPhysics->RegisterTerrain(mTerrain.get());
-    mPhysics->Initialize();
-    
-    // Set physics parameters based on difficulty
-    SetDifficulty(mDifficulty);
+    // Four corners and the landing light
+    PointLight lights[5];
+    int count = 0;
     
-    // Initialize terrain
-    if (m3DMode) {
-        // For 3D mode, generate terrain with dimensions in meters
-        float terrainWidth = mWindowWidth / mPixelsPerMeter;
-        float terrainLength = mWindowWidth / mPixelsPerMeter;
-        float terrainHeight = mWindowHeight / mPixelsPerMeter;
-        mTerrain->Generate3D(terrainWidth, terrainLength, terrainHeight);
-    } else {
-        // For 2D mode, generate terrain with dimensions in pixels
-        // (Terrain class will handle conversion internally)
-        mTerrain->Generate2D(mWindowWidth, mWindowHeight);
+    // Beacons pulse together over the flight
+    const RenderSnapshot& frame = GetRenderSnapshot();
+    const Lander* lander = frame.lander.get();
+    float pulse = 0.6f + 0.4f * std::sin(frame.elapsedTime * kPadBeaconPulseHz * 2.0f * static_cast<float>(M_PI));
+    for (const PointLight& beacon : mPadBeacons) {
+        PointLight& light = lights[count++];
+        light = beacon;
+        for (int i = 0; i < 3; i++) {
+            light.color[i] = kPadBeaconColor[i] * pulse;
+        }
     }
     
-    // Reset game state
-    Reset();
-    
-    mIsRunning = true;
-    mLastFrameTime = SDL_GetTicks();
+    // The landing light shines from just below the engine, along its axis
+    if (lander->IsActive() && frame.debrisCount == 0) {
+        Matrix4x4 rotation = SimdMath::Rotation(lander->GetRenderOrientation());
+        const float* up = &rotation.values[4];
+        const float* position = lander->GetRenderPosition();
+        float offset = lander->GetHeight().Value() / 2 + 2.0f;
+        PointLight& landingLight = lights[count++];
+        for (int i = 0; i < 3; i++) {
+            landingLight.position[i] = position[i] - up[i] * offset;
+            landingLight.color[i] = kLandingLightColor[i];
+        }
+        landingLight.radius = kLandingLightRadius;
+    }
     
-    std::cout << "Initialization complete" << std::endl;
-    return true;
+    mRenderer->SetPointLights(lights, count);
 }
 
-void Game::Run() {
-    std::cout << "Starting game loop..." << std::endl;
-
-    if (!mIsRunning) {
-        std::cerr << "Game not initialized!" << std::endl;
-        return;
-    }
-    
-    // Main game loop
-    while (mIsRunning) {
-        // Calculate delta time
-        unsigned int currentTime = SDL_GetTicks();
-        float deltaTime = (currentTime - mLastFrameTime) / 1000.0f;
-        mLastFrameTime = currentTime;
-        
-        // Cap delta time to prevent physics issues on lag spikes
-        if (deltaTime > 0.1f) {
-            deltaTime = 0.1f;
+uint32_t Game::ComputeStateChecksum() const {
+    // FNV-1a over the bit patterns of the lander state and game state
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 16777619u;
         }
-        
-        // Process input, update game state, and render
-        ProcessInput();
-        Update(deltaTime);
-        Render();
-        
-        // Small delay to prevent 100% CPU usage
-        SDL_Delay(1);
+    };
+    
+    int state = static_cast<int>(mGameState);
+    mix(&state, sizeof(state));
+    
+    if (mLander) {
+        mix(mLander->GetPosition(), 3 * sizeof(float));
+        mix(mLander->GetVelocity(), 3 * sizeof(float));
+        mix(mLander->GetRotation(), 3 * sizeof(float));
+        float fuel = mLander->GetFuel();
+        mix(&fuel, sizeof(fuel));
     }
+    
+    return hash;
 }
 
 void Game::Shutdown() {
     mIsRunning = false;
+    StopSimulationThread();
+    
+    // A map still generating uses the job system and this game
+    if (mNewMapJob) {
+        mJobSystem->Wait(mNewMapJob);
+        mNewMapJob.reset();
+    }
+    
+    // Finish the recording with the total step count
+    if (mInputRecorder) {
+        mInputRecorder->Close(mStepIndex);
+        mInputRecorder.reset();
+    }
+    
+    // What the run kept resident, before teardown gives it back
+    MemoryTracker::LogReport();
+    
+    // Leave the session and report its traffic
+    if (mNetSession) {
+        mNetSession->Close();
+        mNetSession->LogStats();
+        SetLanderBatch(nullptr);
+        mNetSession.reset();
+    }
     
     // Clean up components in reverse order of creation
+    mAudio.reset();
+    mTelemetry.reset();
+    mReplayInput = nullptr;
     mInputHandler.reset();
     mRenderer.reset();
+    mStandbyRenderer.reset();
+    mPredictor.reset();
+    mSnapshots.reset();
     mPhysics.reset();
     mTerrain.reset();
+    mStandbyTerrain.reset();
     mLander.reset();
+    mEntities.reset();
+    mJobSystem.reset();
+    mFrameArena.reset();
     
     // Quit SDL
     SDL_Quit();
     
-    std::cout << "Game shut down" << std::endl;
+    LOG_INFO("Game shut down");
 }
 
 void Game::SetDifficulty(Difficulty difficulty) {
     mDifficulty = difficulty;
     
     // Adjust physics parameters based on difficulty
-    switch (mDifficulty) {
-        case Difficulty::EASY:
-            mPhysics->SetGravity(1.0f);  // Lower gravity (m/s²)
-            break;
-            
-        case Difficulty::NORMAL:
-            mPhysics->SetGravity(1.62f); // Lunar gravity (m/s²)
-            break;
-            
-        case Difficulty::HARD:
-            mPhysics->SetGravity(2.0f);  // Higher gravity (m/s²)
-            break;
-    }
+    mPhysics->SetGravity(Rules::GetGravity(mDifficulty));
     
-    // Reset the game with new settings
+    // Fly again under the new gravity, on the same map
     Reset();
     
-    std::cout << "Difficulty set to: " << 
-        (mDifficulty == Difficulty::EASY ? "Easy" : 
-         mDifficulty == Difficulty::NORMAL ? "Normal" : "Hard") << 
-        ", Gravity: " << mPhysics->GetGravity() << " m/s²" << std::endl;
+    LOG_INFO("Difficulty set to: %s, Gravity: %g m/s²", Rules::GetName(mDifficulty), mPhysics->GetGravity());
+}
+
+void Game::SetPhysicsRate(float hz) {
+    // Keep the rate in a range Bullet and the 2D integrator handle well
+    hz = std::max(10.0f, std::min(1000.0f, hz));
+    mFixedTimeStep = 1.0f / hz;
+    mAccumulator = 0.0f;
+    mCamera.SetTimeStep(mFixedTimeStep);
+    
+    LOG_INFO("Physics rate set to: %g Hz", hz);
+}
+
+void Game::SetTimeWarp(float warp) {
+    if (mNetSession || mInputRecorder || mReplayInput) {
+        LOG_WARNING("Time warp is not available while %s", mNetSession ? "in a network session" :
+                    (mInputRecorder ? "recording" : "replaying"));
+        return;
+    }
+    mTimeWarp = std::max(1.0f, std::min(kMaxTimeWarp, warp));
+    LOG_INFO("Time warp: %gx", mTimeWarp);
+}
+
+float Game::ComputeTimeWarp() const {
+    if (mTimeWarp <= 1.0f || mNetSession || mInputRecorder || mReplayInput || !mPhysics ||
+        mGameState != GameState::FLYING) {
+        return 1.0f;
+    }
+    float altitude = 0.0f;
+    const float gravity = mPhysics->GetGravity();
+    if (!GetAltitudeAboveGround(altitude) || altitude < kTimeWarpFloor || gravity <= 0.0f) {
+        return 1.0f;
+    }
+    
+    // Unpowered, the ground is fallTime away; at the warp that leaves
+    // kTimeWarpLeadSeconds of it on the wall clock
+    const float descent = -mLander->GetVelocity()[1];
+    const float fallTime = (std::sqrt(descent * descent + 2.0f * gravity * altitude) - descent) / gravity;
+    return std::max(1.0f, std::min(mTimeWarp, fallTime / kTimeWarpLeadSeconds));
 }
 
 void Game::SetRenderingMode(bool use3D) {
     // Only change if needed
-    if (m3DMode != use3D) {
+    if (m3DMode == use3D) {
+        return;
+    }
+    
+    // Before Initialize() this just picks the mode to start in
+    if (!mIsRunning) {
         m3DMode = use3D;
+        return;
+    }
+    
+    // Sessions simulate the 2D batch only
+    if (mNetSession) {
+        LOG_WARNING("3D mode is not available in a network session");
+        return;
+    }
+    
+    // A map still generating is for this mode
+    FinishNewMap(true);
+    if (m3DMode) {
+        ResetOrigin();
+    }
+    
+    // Swap in the other mode's renderer and terrain, kept from the last
+    // switch if there was one. SDL, the job system, the input source and the
+    // lander all stay, so the flight carries on in the new mode.
+    uint64_t switchStart = Profiler::Now();
+    
+    // One renderer serves both modes when headless
+    if (!mHeadless) {
+        std::unique_ptr<Renderer> renderer = std::move(mStandbyRenderer);
+        if (!renderer) {
+            renderer = CreateRenderer(use3D);
+            if (!renderer) {
+                LOG_ERROR("Staying in %s mode", m3DMode ? "3D" : "2D");
+                return;
+            }
+        }
+        renderer->SetVisible(true);
+        mRenderer->SetVisible(false);
+        std::swap(mRenderer, renderer);
         
-        // Reinitialize if the game is already running
-        if (mIsRunning) {
-            Shutdown();
-            Initialize();
+        // Keep the old renderer warm for the switch back, unless it holds
+        // memory the new one needs
+        if (renderer->CanStayResidentHidden()) {
+            mStandbyRenderer = std::move(renderer);
+        } else {
+            LOG_INFO("Releasing the hidden %s renderer to free memory", m3DMode ? "3D" : "2D");
+        }
+    }
+    
+    m3DMode = use3D;
+    
+    // Each mode has its own terrain; build this one the first time only
+    std::swap(mTerrain, mStandbyTerrain);
+    if (!mTerrain) {
+        mTerrain = NewTerrain();
+        CreateTerrain(mTerrain.get(), mRandomSeed, true);
+    }
+    
+    // Map the lander into the new mode: the 2D plane is the 3D x/y plane
+    // through the middle of the terrain
+    if (mLander) {
+        const float* position = mLander->GetPosition();
+        float* velocity = mLander->GetVelocity();
+        float z = m3DMode ? mTerrain->GetLength() * 0.5f : 0.0f;
+        mLander->SetPosition(position[0], position[1], z);
+        velocity[2] = 0.0f;
+        
+        // The new terrain may be higher under the lander than the old one
+        if (mGameState == GameState::FLYING) {
+            float terrainHeight = 0.0f;
+            float halfHeight = mLander->GetHeight().Value() / 2.0f;
+            bool below = m3DMode ? mTerrain->SampleHeight(position[0], z, terrainHeight) &&
+                                       position[1] - halfHeight <= terrainHeight
+                                 : mTerrain->CheckCollision2D(mLander.get(), terrainHeight);
+            if (below) {
+                mLander->SetPosition(position[0], terrainHeight + halfHeight + 1.0f, z);
+            }
+        }
+        
+        // Don't interpolate across the switch
+        mLander->SavePreviousTransform();
+        mLander->InterpolateRenderTransform(1.0f);
+        mCameraCut = true;
+    }
+    
+    mPhysics->SwitchMode(m3DMode, mLander.get(), mTerrain.get());
+    
+    // Snapshots are of the other mode's terrain
+    if (mSnapshots) {
+        mSnapshots->Clear();
+    }
+    
+    uint64_t now = Profiler::Now();
+    Profiler::Record("Rendering Mode Switch", switchStart, now);
+    LOG_INFO("Switched to %s mode in %.1f ms", m3DMode ? "3D" : "2D", (now - switchStart) / 1.0e6);
+}
+
+std::unique_ptr<Renderer> Game::CreateRenderer(bool use3D) {
+    std::unique_ptr<Renderer> renderer;
+    if (mHeadless) {
+        renderer = std::make_unique<NullRenderer>();
+    } else if (use3D) {
+        LOG_INFO("Using Metal 3D renderer");
+        auto metalRenderer = std::make_unique<Renderer3D_Metal>();
+        metalRenderer->SetTerrainHeightTextures(mTerrainTextures);
+        metalRenderer->SetTerrainTessellation(mTerrainTessellation);
+        metalRenderer->SetTerrainMeshShaders(mTerrainMeshShaders);
+        if (!mLanderMeshFile.empty()) {
+            metalRenderer->SetLanderMeshFile(mLanderMeshFile, mLanderMeshFile + ".lmesh");
+        }
+        metalRenderer->SetGpuTerrainCulling(mGpuTerrainCulling);
+        metalRenderer->SetHiZCulling(mHiZCulling);
+        metalRenderer->SetDynamicResolution(mDynamicResolution);
+        metalRenderer->SetTargetFrameRate(mTargetFrameRate);
+        metalRenderer->SetTemporalUpscaling(mTemporalUpscaling);
+        metalRenderer->SetVariableRasterization(mVariableRasterization);
+        metalRenderer->SetShadows(mShadows);
+        metalRenderer->SetRayTracedShadows(mRayTracedShadows);
+        metalRenderer->SetHorizonShadows(mHorizonShadows);
+        metalRenderer->SetDeferredLighting(mDeferredLighting);
+        metalRenderer->SetParallelEncoding(mParallelEncoding);
+        metalRenderer->SetMaximumDrawableCount(mMaximumDrawableCount);
+        metalRenderer->SetDisplaySync(mFramePacer.GetMode() == FramePacingMode::DisplaySync);
+        metalRenderer->SetPipelineArchiveFile(mPipelineArchiveFile);
+        metalRenderer->SetSpikeCapture(mSpikeCaptureMs, mSpikeCaptureFrames, mSpikeCaptureDirectory);
+        if (!mVideoRecordFile.empty()) {
+            // A mode switch back into 3D mustn't overwrite the last movie
+            std::string filename = mVideoRecordFile;
+            if (++mVideoRecordings > 1) {
+                const size_t dot = filename.rfind('.');
+                const size_t slash = filename.rfind('/');
+                const size_t stem = dot != std::string::npos && (slash == std::string::npos || dot > slash)
+                                        ? dot : filename.size();
+                filename.insert(stem, "-" + std::to_string(mVideoRecordings));
+            }
+            metalRenderer->SetVideoRecording(filename);
+        }
+        renderer = std::move(metalRenderer);
+    } else {
+        renderer = std::make_unique<Renderer2D>();
+    }
+    
+    // Initialize renderer
+    if (!renderer->Initialize(mWindowWidth, mWindowHeight, "Lunar Lander Simulator")) {
+        LOG_ERROR("Failed to initialize renderer!");
+        return nullptr;
+    }
+    renderer->SetJobSystem(mJobSystem.get());
+    renderer->SetFrameArena(mFrameArena.get());
+    return renderer;
+}
+
+std::unique_ptr<Terrain> Game::NewTerrain() {
+    auto terrain = std::make_unique<Terrain>(mEntities.get());
+    terrain->SetJobSystem(mJobSystem.get());
+    terrain->SetSeed(mRandomSeed);
+    terrain->SetHorizonMaps(mHorizonShadows);
+    if (mTileCacheBudget > 0) {
+        terrain->SetTileCacheBudget(mTileCacheBudget);
+    }
+    if (mTerrainGridSize > 0) {
+        terrain->SetGeneratedGridSize(mTerrainGridSize);
+    }
+    terrain->SetWorld2D(mWorldWidth2D, mWorldSegments2D);
+    return terrain;
+}
+
+void Game::CreateTerrain(Terrain* terrain, uint32_t seed, bool useGpu) {
+    if (!m3DMode) {
+        // For 2D mode, generate terrain with dimensions in pixels
+        // (Terrain class will handle conversion internally)
+        terrain->Generate2D(mWindowWidth, mWindowHeight);
+        return;
+    }
+    
+    // For 3D mode, generate terrain with dimensions in meters
+    float terrainWidth = Units::ToMeters(Pixels(static_cast<float>(mWindowWidth))).Value();
+    float terrainLength = terrainWidth;
+    float terrainHeight = Units::ToMeters(Pixels(static_cast<float>(mWindowHeight))).Value();
+    
+    // A cache is only reused for the terrain it was built from. GPU heights
+    // differ from the CPU generator's in the last bits, so they are cached
+    // separately.
+    char source[256];
+    auto describeGenerated = [&](const char* generator) {
+        int gridSize = terrain->GetGeneratedLayout(terrainWidth, terrainLength, terrainHeight).gridSize;
+        std::snprintf(source, sizeof(source), "generated v%d %s seed %u grid %d %gx%gx%g",
+                      TerrainGenerator::kVersion, generator, seed, gridSize,
+                      terrainWidth, terrainLength, terrainHeight);
+    };
+    if (mHeightmapFile.empty()) {
+        describeGenerated(useGpu && mGpuTerrain ? "gpu" : "cpu");
+    } else {
+        std::snprintf(source, sizeof(source), "dem %s", mHeightmapFile.c_str());
+    }
+    if (!mTerrainCacheFile.empty() && terrain->LoadCache(mTerrainCacheFile.c_str(), source)) {
+        return;
+    }
+    
+    bool loaded = false;
+    if (!mHeightmapFile.empty()) {
+        loaded = terrain->LoadHeightmap(mHeightmapFile.c_str());
+        if (!loaded) {
+            LOG_WARNING("Falling back to generated terrain");
         }
     }
+    if (!loaded && useGpu && mGpuTerrain) {
+        loaded = mRenderer->GenerateTerrain(terrain, terrainWidth, terrainLength, terrainHeight);
+        if (loaded) {
+            describeGenerated("gpu");
+        }
+    }
+    if (!loaded) {
+        terrain->Generate3D(terrainWidth, terrainLength, terrainHeight);
+        describeGenerated("cpu");
+    }
+    
+    if (!mTerrainCacheFile.empty()) {
+        terrain->SaveCache(mTerrainCacheFile.c_str(), source);
+    }
 }
 
 void Game::Reset() {
+    uint64_t resetStart = Profiler::Now();
+    
     // Reset game state
     mGameState = GameState::FLYING; // Start in FLYING
-    std::cout << "DEBUG: Starting in FLYING state" << std::endl;
+    LOG_DEBUG("Starting in FLYING state");
     mScore = 0.0f;
     mElapsedTime = 0.0f;
     mFuelUsed = 0.0f;
     
+    // Let the input source and autopilot restart (e.g. rewind a script)
+    if (mInputHandler) {
+        mInputHandler->OnReset();
+    }
+    if (mController) {
+        mController->OnReset();
+    }
+    if (mPredictor) {
+        mPredictor->Invalidate();
+    }
+    
+    // Each flight starts in the terrain's own frame
+    if (m3DMode) {
+        ResetOrigin();
+    }
+    
     // Reset lander
     if (mLander) {
         mLander->Reset();
         
-        // Set initial position in meters
-        float centerX = mWindowWidth / (2 * mPixelsPerMeter); // Center X in meters
-        float startHeight = 20.0f; // More height to give time for physics simulation
+        // Set initial position in meters, from the scenario or 20 m up (time
+        // for the physics to settle) over the middle of the window's terrain
+        static const float kDefaultStart[3] = { 0.0f, 20.0f, 0.0f };
+        const float* start = mScenario ? mScenario->spawn : kDefaultStart;
+        float centerX = Units::ToMeters(Pixels(mWindowWidth / 2.0f)).Value() + start[0]; // Center X in meters
+        float startHeight = start[1];
         
         if (m3DMode) {
-            float centerZ = mWindowWidth / (2 * mPixelsPerMeter); // Center Z in meters
+            // Over the middle of the terrain, where a DEM's landing pad is
+            centerX = mTerrain->GetWidth() * 0.5f + start[0];
+            float centerZ = mTerrain->GetLength() * 0.5f + start[2];
             mLander->SetPosition(centerX, startHeight, centerZ);
         } else {
             mLander->SetPosition(centerX, startHeight);
         }
         
-        // Reset velocity explicitly to prevent any issues
+        // Reset velocity explicitly to prevent any issues; a scenario may
+        // start it moving, and on less than a full tank
         float* velocity = mLander->GetVelocity();
-        velocity[0] = 0.0f;
-        velocity[1] = 0.0f;
-        if (m3DMode) velocity[2] = 0.0f;
+        velocity[0] = mScenario ? mScenario->velocity[0] : 0.0f;
+        velocity[1] = mScenario ? mScenario->velocity[1] : 0.0f;
+        if (m3DMode) velocity[2] = mScenario ? mScenario->velocity[2] : 0.0f;
+        if (mScenario) {
+            mLander->SetFuel(mScenario->fuel);
+        }
+        
+        // Don't interpolate or smooth the camera from the previous flight's position
+        mLander->SavePreviousTransform();
+        mLander->InterpolateRenderTransform(1.0f);
+        mCameraCut = true;
         
-        std::cout << "Lander reset to position: (" << centerX << ", " << startHeight << ") m" << std::endl;
+        LOG_INFO("Lander reset to position: (%g, %g) m", centerX, startHeight);
     }
     
-    // Reset terrain (regenerate if needed)
-    if (mTerrain) {
-        if (m3DMode) {
-            float terrainWidth = mWindowWidth / mPixelsPerMeter;
-            float terrainLength = mWindowWidth / mPixelsPerMeter;
-            float terrainHeight = mWindowHeight / mPixelsPerMeter;
-            mTerrain->Generate3D(terrainWidth, terrainLength, terrainHeight);
-        } else {
-            mTerrain->Generate2D(mWindowWidth, mWindowHeight);
-        }
+    // The session's lander starts over at the host's spawn point
+    if (mNetSession) {
+        mNetRespawn = true;
+    }
+    
+    // Put the pooled lander body back at the start. The terrain and its
+    // Bullet shapes are reused as they stand.
+    if (m3DMode && mPhysics) {
+        mPhysics->RegisterTerrain(mTerrain.get());
+        mPhysics->RegisterLander(mLander.get());
+    }
+    
+    // Start the rewind history with the flight's first state
+    if (mSnapshots && mLander && mPhysics) {
+        size_t snapshots = static_cast<size_t>(std::ceil(mRewindWindow / (mFixedTimeStep * mSnapshotInterval)));
+        mSnapshots->Configure(static_cast<uint32_t>(mSnapshotInterval), kSnapshotKeyframeInterval, snapshots);
+        mFlightStep = 0;
+        CaptureSnapshot();
+    }
+    Profiler::Record("Reset", resetStart, Profiler::Now());
+}
+
+void Game::NewMap() {
+    // Sessions fly the host's seed; a DEM is the only map there is
+    if (mNetSession || !mHeightmapFile.empty()) {
+        LOG_WARNING("No new map in a %s", mNetSession ? "network session" : "heightmap flight");
+        return;
+    }
+    if (mNewMapJob) {
+        return;
+    }
+    
+    // The next seed's map generates on the job system (on the CPU: the
+    // renderer belongs to the main thread) while the current one flies
+    mNewMapSeed = mRandomSeed + 1;
+    mNewMapTerrain = NewTerrain();
+    mNewMapTerrain->SetSeed(mNewMapSeed);
+    mNewMapReady = false;
+    mNewMapStart = Profiler::Now();
+    Terrain* terrain = mNewMapTerrain.get();
+    mNewMapJob = mJobSystem->Schedule([this, terrain]() {
+        CreateTerrain(terrain, mNewMapSeed, false);
+        mNewMapReady = true;
+    });
+    LOG_INFO("Generating the map for seed %u", mNewMapSeed);
+    
+    // Recordings and headless runs take it at once, so replays see the
+    // same step
+    if (mHeadless || mReplayInput || mInputRecorder) {
+        FinishNewMap(true);
+    }
+}
+
+void Game::FinishNewMap(bool wait) {
+    if (!mNewMapJob || (!wait && !mNewMapReady)) {
+        return;
+    }
+    mJobSystem->Wait(mNewMapJob);
+    mNewMapJob.reset();
+    
+    // Swap it in; the old map goes once nothing points at it. The other
+    // mode's terrain is of the old seed, so it is rebuilt on the next switch.
+    std::unique_ptr<Terrain> oldTerrain = std::move(mTerrain);
+    mTerrain = std::move(mNewMapTerrain);
+    mStandbyTerrain.reset();
+    mRandomSeed = mNewMapSeed;
+    if (mPhysics) {
+        mPhysics->RegisterTerrain(mTerrain.get());
+    }
+    if (mSnapshots) {
+        mSnapshots->Clear();
     }
+    Reset();
+    oldTerrain.reset();
+    
+    uint64_t now = Profiler::Now();
+    Profiler::Record("New Map", mNewMapStart, now);
+    LOG_INFO("New map (seed %u) ready in %.1f ms", mRandomSeed, (now - mNewMapStart) / 1.0e6);
 }
 
 void Game::ProcessInput() {
-    // Use the input handler to process input
+    // Poll and act on it at once: headless and replay steps have no wall
+    // clock to place input on
     if (mInputHandler) {
         mInputHandler->ProcessInput();
+        mInputHandler->AdvanceTo(UINT32_MAX);
+        ApplyInput();
+    }
+}
+
+void Game::ApplyInput() {
+    PROFILE_SCOPE("ProcessInput");
+    
+    // Act on the input source's current actions
+    if (mInputHandler) {
+        // Record the poll against the step it precedes
+        if (mInputRecorder) {
+            mInputRecorder->RecordPoll(mStepIndex, mInputHandler->GetActions());
+        }
         
         // Handle input based on game state
         if (mGameState == GameState::READY) {
             // Check for game start
             if (mInputHandler->IsStartActive()) {
-                std::cout << "Game started by user input - switching to FLYING state" << std::endl;
+                LOG_INFO("Game started by user input - switching to FLYING state");
                 mGameState = GameState::FLYING;
             }
-        } else if (mGameState == GameState::FLYING) {
+        } else if (mGameState == GameState::FLYING && !mController) {
             // Apply thrust if active
             if (mInputHandler->IsThrustActive()) {
                 mLander->ApplyThrust(1.0f);
-                std::cout << "Thrust applied" << std::endl;
+                LOG_DEBUG_EVERY(1000, "Thrust applied");
                 
                 // Track fuel usage
                 float originalFuel = mLander->GetFuel();
@@ -249,18 +1734,21 @@ void Game::ProcessInput() {
                 mLander->ApplyThrust(0.0f);
             }
             
-            // Handle rotation
-            if (mInputHandler->IsRotateLeftActive()) {
-                mLander->RotateLeft(2.0f);
-            }
-            
-            if (mInputHandler->IsRotateRightActive()) {
-                mLander->RotateRight(2.0f);
-            }
+            // Handle rotation: the keys fire the RCS couples, left
+            // counter-clockwise
+            const float left = mInputHandler->IsRotateLeftActive() ? 1.0f : 0.0f;
+            const float right = mInputHandler->IsRotateRightActive() ? 1.0f : 0.0f;
+            mLander->FireRcs(left - right);
         } else if (mGameState == GameState::LANDED || mGameState == GameState::CRASHED) {
             // Check for game reset
+            // A pipelined frame may be drawing the terrain Reset rebuilds,
+            // so the main thread resets between frames instead
             if (mInputHandler->IsResetActive()) {
-                Reset();
+                if (mSimulationThread.joinable()) {
+                    mResetPending = true;
+                } else {
+                    Reset();
+                }
             }
         }
         
@@ -272,32 +1760,50 @@ void Game::ProcessInput() {
 }
 
 void Game::Update(float deltaTime) {
+    // Stream DEM tiles ahead of the lander (may move the terrain window,
+    // which physics picks up before stepping) and write back the regolith,
+    // which keeps settling after a landing. Pipelined frames do this on the
+    // main thread, between their steps and the frame drawn.
+    if (!mSimulationThread.joinable()) {
+        UpdateTerrainStreaming();
+    }
+    
     // Only update physics when flying
     if (mGameState == GameState::FLYING) {
-        // Update physics
-        if (mPhysics) {
+        // Update physics; in a session the step already ran, so the lander
+        // takes its result
+        if (mNetSession) {
+            SyncNetLander();
+        } else if (mPhysics) {
+            PROFILE_SCOPE("Physics");
             mPhysics->Update(deltaTime);
         }
         
         // Update lander
         if (mLander) {
-            mLander->Update(deltaTime);
+            // Entity systems: fuel burn for everything with an engine
+            if (!mNetSession) {
+                mEntities->UpdateFuel(deltaTime);
+            }
             
     // KEEP AND MODIFY this block:
     if (mLander->IsLanded()) {
     mGameState = GameState::LANDED;
     
-    // Calculate score based on fuel remaining and landing position
-    float fuelRemaining = mLander->GetFuel() / mLander->GetMaxFuel();
-    mScore = fuelRemaining * 1000.0f;
-    
     // Get current position
     const float* position = mLander->GetPosition();
     
+    // Calculate score based on fuel remaining and the pad landed on
+    const LandingPad* pad = nullptr;
+    if (mTerrain) {
+        pad = m3DMode ? mTerrain->FindLandingPad3D(position[0], position[2])
+                      : mTerrain->FindLandingPad2D(position[0]);
+    }
+    mScore = Rules::GetLandingScore(mLander->GetFuel(), mLander->GetMaxFuel(), pad ? pad->difficulty : 1.0f);
+    
     // Print final landing statistics
-    std::cout << "Landing successful! Time: " << mElapsedTime 
-              << "s, Score: " << mScore 
-              << ", Final position: (" << position[0] << ", " << position[1] << ") m" << std::endl;
+    LOG_INFO("Landing successful! Time: %gs, Score: %g (pad %d), Final position: (%g, %g) m",
+             mElapsedTime, mScore, pad ? pad->id : -1, position[0], position[1]);
     } else if (mLander->IsCrashed()) {
     mGameState = GameState::CRASHED;
     mScore = 0.0f;
@@ -306,78 +1812,217 @@ void Game::Update(float deltaTime) {
     const float* position = mLander->GetPosition();
     
     // Print crash statistics
-    std::cout << "Crash landing! Time: " << mElapsedTime 
-              << "s, Final position: (" << position[0] << ", " << position[1] << ") m" << std::endl;
+    LOG_INFO("Crash landing! Time: %gs, Final position: (%g, %g) m",
+             mElapsedTime, position[0], position[1]);
     }
             
     }
         
         // Update elapsed time
         mElapsedTime += deltaTime;
+    } else if (mGameState == GameState::CRASHED && m3DMode && mPhysics && !mNetSession) {
+        // The wreck's debris keeps falling until it comes to rest
+        PROFILE_SCOPE("Physics");
+        mPhysics->UpdateDebris(deltaTime);
     }
     
     // Update terrain (generally static, but may have animations)
     if (mTerrain) {
         mTerrain->Update(deltaTime);
     }
+}
+
+void Game::UpdateTerrainStreaming() {
+    PROFILE_ZONE("Terrain Streaming");
+    
+    // The regolith's edits since the last frame; nothing reads the terrain
+    // while this runs
+    if (m3DMode && mPhysics) {
+        mPhysics->CommitRegolith();
+    }
     
-    // If 3D mode, update camera to follow lander
-    if (m3DMode && mRenderer && mLander) {
-    const float* landerPos = mLander->GetPosition();
+    if (mGameState == GameState::FLYING && m3DMode && mTerrain && mLander && mPhysics) {
+        mTerrain->UpdateStreaming(mLander->GetPosition(), mLander->GetVelocity(), mPhysics->GetGravity());
+    }
+    UpdateFloatingOrigin();
+}
 
-    // Add debug output
-    std::cout << "Lander position: (" 
-    << landerPos[0] << ", " << landerPos[1] << ", " << landerPos[2] 
-    << ")" << std::endl;
-        
-    // Position camera with a fixed offset to see both lander and terrain
-    mRenderer->SetCameraPosition(
-        landerPos[0] - 30.0f,     // offset to side
-        40.0f,                    // fixed height
-        landerPos[2] + 40.0f      // behind lander
-    );
+// Positions are floats relative to an origin that moves with the lander,
+// so they keep their precision however far it flies; the world position is
+// the entity store's origin (double) plus the float one. A move is whole
+// terrain cells, so the grid and everything kept per cell stay put. Not in
+// network sessions, whose peers share one frame.
+void Game::UpdateFloatingOrigin() {
+    if (mGameState != GameState::FLYING || !m3DMode || mNetSession || !mTerrain || !mTerrain->HasHeightGrid() ||
+        !mLander || !mPhysics) {
+        return;
+    }
+    const float* position = mLander->GetPosition();
+    if (std::fabs(position[0]) < kOriginRebaseDistance && std::fabs(position[2]) < kOriginRebaseDistance) {
+        return;
+    }
+    ShiftOrigin(static_cast<int>(std::lround(position[0] / mTerrain->GetCellWidth())),
+                static_cast<int>(std::lround(position[2] / mTerrain->GetCellLength())));
+}
+
+static void ShiftRenderSnapshot(RenderSnapshot& snapshot, const double* shift) {
+    if (snapshot.lander) {
+        snapshot.lander->GetStore().ShiftOrigin(shift);
+    }
+    for (int i = 0; i < 3; i++) {
+        const float d = static_cast<float>(shift[i]);
+        snapshot.impact[i] -= d;
+        snapshot.emitters.nozzle[i] -= d;
+        for (int c = 0; c < RenderSnapshot::kMaxContacts; c++) {
+            snapshot.contacts[c * 3 + i] -= d;
+        }
+        for (int p = 0; p < snapshot.debrisCount; p++) {
+            snapshot.debris[p * Physics::kDebrisPieceFloats + i] -= d;
+        }
+    }
+}
 
-    // Make sure the camera is looking directly at the lander
-    mRenderer->SetCameraTarget(
-        landerPos[0],          // X
-        landerPos[1],          // Y
-        landerPos[2]           // Z
-    );
+// Main thread, with the simulation idle and the regolith committed
+void Game::ShiftOrigin(int cellsX, int cellsZ) {
+    if (!mTerrain || !mPhysics || (cellsX == 0 && cellsZ == 0)) {
+        return;
+    }
+    PROFILE_ZONE("Shift Origin");
+    
+    const double shift[3] = {static_cast<double>(cellsX) * mTerrain->GetCellWidth(), 0.0,
+                             static_cast<double>(cellsZ) * mTerrain->GetCellLength()};
+    mPhysics->ShiftOrigin(cellsX, cellsZ);
+    MoveOrigin(shift);
+    
+    const double* origin = mEntities->GetWorldOrigin();
+    LOG_DEBUG("Moved the world origin to (%.0f, %.0f) m", origin[0], origin[2]);
+}
 
-    std::cout << "Camera position set to: (" 
-    << landerPos[0] - 30.0f << ", " 
-    << 40.0f << ", " 
-    << landerPos[2] + 40.0f << ")" << std::endl;
-        
-    // Set camera up vector
-    mRenderer->SetCameraUp(0.0f, 1.0f, 0.0f);
+// Everything but the terrain and the Bullet world
+void Game::MoveOrigin(const double* shift) {
+    const float floatShift[3] = {static_cast<float>(shift[0]), static_cast<float>(shift[1]),
+                                 static_cast<float>(shift[2])};
+    mEntities->ShiftOrigin(shift);
+    for (RenderSnapshot& snapshot : mRenderSnapshots) {
+        ShiftRenderSnapshot(snapshot, shift);
+    }
+    mCamera.ShiftOrigin(floatShift);
+    if (mRenderer) {
+        mRenderer->ShiftOrigin(floatShift);
+    }
+    if (mPredictor) {
+        mPredictor->Invalidate();
+    }
+}
+
+// Back to the terrain's own frame, e.g. before a reset or leaving 3D. A
+// terrain swapped in since the last move starts unshifted, so only the
+// rest follows.
+void Game::ResetOrigin() {
+    if (!mEntities) {
+        return;
+    }
+    if (mTerrain && (mTerrain->GetOriginShiftX() != 0 || mTerrain->GetOriginShiftZ() != 0)) {
+        ShiftOrigin(-mTerrain->GetOriginShiftX(), -mTerrain->GetOriginShiftZ());
+    }
+    const double* origin = mEntities->GetWorldOrigin();
+    if (origin[0] == 0.0 && origin[1] == 0.0 && origin[2] == 0.0) {
+        return;
+    }
+    const double shift[3] = {-origin[0], -origin[1], -origin[2]};
+    MoveOrigin(shift);
+}
+
+void Game::UpdateCamera(float deltaTime) {
+    PROFILE_ZONE("Camera");
+    
+    // If 3D mode, the camera follows the interpolated lander position
+    const Lander* lander = GetRenderSnapshot().lander.get();
+    if (m3DMode && mRenderer && lander) {
+        const float* landerPos = lander->GetRenderPosition();
+        if (mCameraCut) {
+            mCameraCut = false;
+            mCamera.Cut(landerPos);
+        } else {
+            mCamera.Update(deltaTime, landerPos);
+        }
+        mCamera.SetAspect(static_cast<float>(mRenderer->GetWidth()) / std::max(mRenderer->GetHeight(), 1));
+        mCamera.UpdateMatrices();
+        mRenderer->SetCamera(mCamera);
         
         // Set light position (sun)
-        float terrainSize = mWindowWidth / mPixelsPerMeter;
+        // Fixed in the world, so it moves back with the floating origin
+        float terrainSize = Units::ToMeters(Pixels(static_cast<float>(mWindowWidth))).Value();
+        const double* origin = mEntities->GetWorldOrigin();
         mRenderer->SetLightPosition(
-            terrainSize / 2, 
+            static_cast<float>(terrainSize / 2 - origin[0]),
             terrainSize + 25.0f, // 25 meters above terrain
-            terrainSize / 2
+            static_cast<float>(terrainSize / 2 - origin[2])
         );
         
         // Set ambient light
         mRenderer->SetAmbientLight(0.3f, 0.3f, 0.3f);
+    } else if (mRenderer && lander && mTerrain) {
+        // 2D: the view keeps the lander centered, within the world's ends
+        const float scale = mViewScale2D > 0.0f ? mViewScale2D : 1.0f;
+        const float viewWidth = mRenderer->GetWidth() / scale;
+        const float worldWidth = static_cast<float>(mTerrain->GetWidth());
+        const float landerX = Units::ToPixels(Meters(lander->GetRenderPosition()[0])).Value();
+        float left = landerX - 0.5f * viewWidth;
+        left = std::min(left, worldWidth - viewWidth);
+        left = std::max(left, 0.0f);
+        mRenderer->SetView2D(left, scale);
     }
 }
 
 void Game::Render() {
+    PROFILE_SCOPE("Render");
+    
     // Clear the screen
     if (mRenderer) {
+        // Everything of the simulation comes from the frame's snapshot
+        const RenderSnapshot& frame = GetRenderSnapshot();
+        Lander* lander = frame.lander.get();
+        
+        // Lights for the frame Clear() starts
+        if (m3DMode && lander && mTerrain) {
+            UpdatePointLights();
+        }
         mRenderer->Clear();
         
+        // A renderer can still fail here, e.g. a pipeline that finished
+        // compiling after Initialize() with an error
+        if (!mRenderer->IsInitialized()) {
+            LOG_ERROR("Renderer failed, stopping");
+            mIsRunning = false;
+            return;
+        }
+        
         // Render terrain
         if (mTerrain) {
             mTerrain->Render(mRenderer.get());
         }
         
-        // Render lander
-        if (mLander && mLander->IsActive()) {
-            mLander->Render(mRenderer.get());
+        // Render lander, or what a crash left of it
+        if (frame.debrisCount > 0) {
+            mRenderer->RenderDebris(frame.debris, frame.debrisCount);
+        } else if (lander && lander->IsActive()) {
+            lander->Render(mRenderer.get());
+        }
+        
+        // Predicted touchdown
+        if (frame.hasImpact) {
+            mRenderer->RenderPredictedImpact(frame.impact);
+        }
+        
+        // Batch landers, instanced where the renderer supports it
+        if (mLanderBatch) {
+            mRenderer->RenderLanderBatch(mLanderBatch);
+        }
+        
+        // Exhaust and dust, blended over the opaque scene
+        if (m3DMode) {
+            RenderParticles();
         }
         
         // Render UI elements
@@ -385,11 +2030,26 @@ void Game::Render() {
         mRenderer->RenderGameState(this);
         
         // Present rendered frame
-        mRenderer->Present();
+        {
+            PROFILE_SCOPE("Present");
+            mRenderer->Present();
+        }
+        
+        if (!mFirstFramePresented) {
+            mFirstFramePresented = true;
+            uint64_t now = Profiler::Now();
+            Profiler::Record("Time To First Frame", mInitializeStartNs, now);
+            LOG_INFO("Time to first frame: %.1f ms", (now - mInitializeStartNs) / 1.0e6);
+        }
     }
 }
 
 void Game::OnKeyDown(int keyCode) {
+    // Key presses bypass the action bits, so record them separately
+    if (mInputRecorder) {
+        mInputRecorder->RecordKey(mStepIndex, keyCode);
+    }
+    
     // Handle key press events
     switch (keyCode) {
         case SDLK_r:
@@ -397,6 +2057,16 @@ void Game::OnKeyDown(int keyCode) {
             Reset();
             break;
             
+        case SDLK_n:
+            // Generate the next map, flying this one meanwhile
+            NewMap();
+            break;
+        
+        case SDLK_BACKSPACE:
+            // Training rewind
+            Rewind(kRewindSeconds);
+            break;
+            
         case SDLK_ESCAPE:
             // Quit game
             mIsRunning = false;
@@ -421,10 +2091,34 @@ void Game::OnKeyDown(int keyCode) {
             // Toggle between 2D and 3D mode
             SetRenderingMode(!m3DMode);
             break;
+        
+        case SDLK_PERIOD:
+            // Faster time warp
+            SetTimeWarp(mTimeWarp * 2.0f);
+            break;
+        
+        case SDLK_COMMA:
+            // Slower time warp
+            SetTimeWarp(mTimeWarp * 0.5f);
+            break;
+        
+        case SDLK_c:
+            // Next 3D camera rig
+            mCamera.CycleMode();
+            LOG_INFO("Camera: %s", Camera::GetModeName(mCamera.GetMode()));
+            break;
     }
 }
 
 void Game::OnKeyUp(int keyCode) {
     // Handle key release events
     // No additional functionality needed here
+}
+
+void Game::OnWindowResized(int width, int height) {
+    // Only the renderer follows the window; the world keeps the size it
+    // was laid out for (mWindowWidth x mWindowHeight)
+    if (mRenderer) {
+        mRenderer->OnWindowResized(width, height);
+    }
 }
\ No newline at end of file
@@ -6,15 +6,38 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 #include "../rendering/Renderer.h" // Base renderer interface
-#include "../rendering/Renderer3D_Metal.h" // Add this line
+#include "Camera.h"
 #include "Entity.h"
+#include "FramePacer.h"
+#include "Rules.h"
 
 // Forward declarations
 class Renderer;
 class Physics;
 class Terrain;
-class InputHandler;
+class InputSource;
+class JobSystem;
+struct Job;
+class FrameArena;
+class InputRecorder;
+class ReplayInput;
+class LanderBatch;
+class Controller;
+class TrajectoryPredictor;
+class SnapshotBuffer;
+class NetSession;
+class TelemetryStream;
+class AudioEngine;
+class ScenarioFile;
+struct ScenarioRecord;
+enum class PhysicsBroadphase;
+struct SimulationSnapshot;
 
 // Game states
 enum class GameState {
@@ -24,11 +47,32 @@ enum class GameState {
     CRASHED
 };
 
-// Game difficulty levels
-enum class Difficulty {
-    EASY,
-    NORMAL,
-    HARD
+// What a frame draws of the simulation, captured after the frame's fixed
+// steps. Rendering reads only this (and the terrain), so with pipelined
+// rendering the simulation fills one snapshot while the other is drawn.
+struct RenderSnapshot {
+    static constexpr int kMaxContacts = 8;      // Bullet contact points for the particles
+    static constexpr int kMaxDebris = 48;       // Crash fragments (Physics::kDebrisPoolSize)
+    
+    std::unique_ptr<Lander> lander;     // In a store of its own, render transform included
+    GameState gameState;
+    float elapsedTime;
+    float score;
+    float altitude;                     // Above the ground, or the datum off the terrain's edge
+    
+    // Predicted touchdown, while flying
+    bool hasImpact;
+    float impact[3];
+    
+    // Exhaust and dust emitters (3D); contacts points into this snapshot
+    bool hasParticles;
+    ParticleEmitters emitters;
+    float contacts[kMaxContacts * 3];
+    
+    // Crash fragments in Physics::GetDebris's layout (3D); drawn instead
+    // of the lander once it has broken up
+    float debris[kMaxDebris * 10];
+    int debrisCount;
 };
 
 class Game {
@@ -49,42 +93,331 @@ public:
     Lander* GetLander() { return mLander.get(); }
     Terrain* GetTerrain() { return mTerrain.get(); }
     
+    // Height of the lander's bottom above the ground straight below it, in
+    // meters; false off the terrain's edge or without a lander
+    bool GetAltitudeAboveGround(float& altitude) const;
+    
     // Game config settings
     void SetDifficulty(Difficulty difficulty);
+    // Switching while running keeps the flight, SDL and the other mode's
+    // renderer and terrain, so toggling back and forth costs about a frame
     void SetRenderingMode(bool use3D);
+    
+    // A new flight on the current map: only the lander, the rewind history
+    // and the pooled Bullet lander body start over, so a retry costs no
+    // generation. NewMap() generates the next seed's map in the background
+    // while this one stays in play, and flies it once ready.
     void Reset();
+    void NewMap();
+    
+    // Fixed simulation rate (Hz); rendering interpolates between steps
+    void SetPhysicsRate(float hz);
+    float GetPhysicsRate() const { return 1.0f / mFixedTimeStep; }
+    float GetFixedTimeStep() const { return mFixedTimeStep; }
+    
+    // Time warp, 1x to 100x. A windowed frame runs that many times its
+    // fixed steps within a CPU budget, and the 3D lander coasts on its
+    // ballistic arc while the engine is off far above the ground (headless
+    // runs only get the coasting). The warp eases back to 1x as the ground
+    // nears. Not available while recording, replaying or in a session.
+    void SetTimeWarp(float warp);
+    float GetTimeWarp() const { return mTimeWarp; }
+    float GetEffectiveTimeWarp() const { return mEffectiveTimeWarp; }   // Last frame's
+    
+    // Worker threads for the job system (-1 = one per spare hardware thread)
+    void SetWorkerThreadCount(int count) { mWorkerThreadCount = count; }
+    
+    // Bullet broadphase for the 3D world (set before Initialize)
+    void SetBroadphase(PhysicsBroadphase broadphase) { mBroadphase = broadphase; }
+    
+    // Coarser 3D physics steps far above the ground (Physics::SetAdaptiveStepping;
+    // set before Initialize, and taken from a replay's header)
+    void SetAdaptiveStepping(bool enabled) { mAdaptiveStepping = enabled; }
+    JobSystem* GetJobSystem() { return mJobSystem.get(); }
+    
+    // Scratch memory for the current windowed frame, reset after it renders
+    FrameArena* GetFrameArena() { return mFrameArena.get(); }
+    
+    // Headless mode: no window, scripted input, simulation as fast as possible
+    void SetHeadless(bool headless) { mHeadless = headless; }
+    bool IsHeadless() const { return mHeadless; }
+    void SetInputScript(const std::string& filename) { mInputScript = filename; }
+    void SetFlightCount(int flights) { mFlightCount = flights > 0 ? flights : 1; }
+    void SetMaxFlightTime(float seconds) { mMaxFlightTime = seconds > 0.0f ? seconds : 1.0f; }
+    
+    // Input recording and deterministic replay. Replays run headless with
+    // the recording's seed, mode and step size, verifying state checksums;
+    // a windowed replay draws them too, a fixed slice of steps per frame.
+    void SetRecordFile(const std::string& filename) { mRecordFile = filename; }
+    void SetReplayFile(const std::string& filename) { mReplayFile = filename; }
+    void SetReplayWindowed(bool windowed) { mReplayWindowed = windowed; }
+    void SetChecksumInterval(int steps) { mChecksumInterval = steps > 0 ? steps : 1; }
+    void SetRandomSeed(uint32_t seed) { mRandomSeed = seed; }
+    
+    // Fly a compiled scenario (scenario_pack) instead of the built-in start:
+    // its terrain, seed, gravity, lander and start state, over what is set
+    // here. An empty name takes the file's first. The file stays mapped and
+    // every reset reads the scenario out of it in place.
+    void SetScenario(const std::string& filename, const std::string& name) {
+        mScenarioFilename = filename;
+        mScenarioName = name;
+    }
+    
+    // Multi-lander network session (2D): host one on a UDP port (0 = don't),
+    // or join one at "host:port" (empty = don't). The host simulates every
+    // lander; this end flies its own and draws the rest.
+    void SetHostPort(int port) { mHostPort = port; }
+    void SetConnectAddress(const std::string& address) { mConnectAddress = address; }
+    uint64_t GetStepIndex() const { return mStepIndex; }
+    
+    // 3D terrain from an elevation raster instead of the generator (empty = generate)
+    void SetHeightmapFile(const std::string& filename) { mHeightmapFile = filename; }
+    void SetTileCacheBudget(size_t bytes) { mTileCacheBudget = bytes; }
+    
+    // Load 3D terrain from this cache file when it matches the terrain
+    // source, otherwise build it and write the file (empty = no cache)
+    void SetTerrainCacheFile(const std::string& filename) { mTerrainCacheFile = filename; }
+    
+    // Generated 3D terrain: cells per side (0 = Terrain's default), and
+    // whether the renderer may generate it on the GPU
+    void SetTerrainGridSize(int cells) { mTerrainGridSize = cells; }
+    void SetGpuTerrainGeneration(bool enabled) { mGpuTerrain = enabled; }
+    
+    // 2D world: width in pixels (<= the window = the window's terrain),
+    // segments across it (0 = Terrain's default) and the view's zoom in
+    // screen pixels per terrain pixel; the view follows the lander
+    void SetWorld2D(int width, int segmentCount, float zoom) {
+        mWorldWidth2D = width;
+        mWorldSegments2D = segmentCount;
+        mViewScale2D = zoom;
+    }
+    
+    // Draw 3D terrain from height textures instead of per-chunk vertices
+    void SetTerrainHeightTextures(bool enabled) { mTerrainTextures = enabled; }
+    
+    // Tessellate the terrain around the lander (needs height textures)
+    void SetTerrainTessellation(bool enabled) { mTerrainTessellation = enabled; }
+    
+    // Draw height texture terrain as meshlets culled in an object shader
+    // (needs height textures and a Metal 3 GPU)
+    void SetTerrainMeshShaders(bool enabled) { mTerrainMeshShaders = enabled; }
+    
+    // Draw the 3D lander from an OBJ model, its optimized LOD chain cached
+    // in <filename>.lmesh (empty = the box)
+    void SetLanderMeshFile(const std::string& filename) { mLanderMeshFile = filename; }
+    
+    // Select and cull terrain chunks on the GPU (vertex buffer terrain only)
+    void SetGpuTerrainCulling(bool enabled) { mGpuTerrainCulling = enabled; }
+    
+    // Also cull GPU-culled chunks hidden behind the previous frame's depth
+    void SetHiZCulling(bool enabled) { mHiZCulling = enabled; }
+    
+    // Render the 3D scene below native resolution and upscale it, scaling
+    // to hold the target frame rate; temporal upscaling uses MetalFX's
+    // temporal scaler instead of the spatial one
+    void SetDynamicResolution(bool enabled) { mDynamicResolution = enabled; }
+    void SetTargetFrameRate(float hz) { mTargetFrameRate = hz > 0.0f ? hz : 120.0f; }
+    void SetTemporalUpscaling(bool enabled) { mTemporalUpscaling = enabled; }
+    
+    // Shade the 3D scene at full rate only around the lander, at reduced
+    // rates towards the screen edges
+    void SetVariableRasterization(bool enabled) { mVariableRasterization = enabled; }
+    
+    // Shadow maps in the 3D scene
+    void SetShadows(bool enabled) { mShadows = enabled; }
+    
+    // Trace the terrain's shadow against its acceleration structure instead
+    // of a shadow map, where the GPU ray traces
+    void SetRayTracedShadows(bool enabled) { mRayTracedShadows = enabled; }
+    
+    // Bake horizon maps with the 3D terrain and shadow it from them
+    // instead of a shadow map
+    void SetHorizonShadows(bool enabled) { mHorizonShadows = enabled; }
+    
+    // Light the landing light and pad beacons in a tile-based deferred pass
+    void SetDeferredLighting(bool enabled) { mDeferredLighting = enabled; }
+    
+    // Encode large sets of terrain chunk draws on the job system's workers
+    void SetParallelEncoding(bool enabled) { mParallelEncoding = enabled; }
+    
+    // Metal presentation: drawables in the swap queue (2 = lower latency,
+    // 3 = better throughput)
+    void SetMaximumDrawableCount(int count) { mMaximumDrawableCount = count; }
+    
+    // How the windowed loop waits between frames. Only DisplaySync makes
+    // Metal presents wait for vsync; TargetRate paces to the target frame
+    // rate. The 2D renderer always presents with vsync.
+    void SetFramePacing(FramePacingMode mode) { mFramePacer.SetMode(mode); }
+    
+    // Simulate the next frame on a thread of its own while the current one
+    // renders (windowed only). Frames take about the longer of the two
+    // instead of their sum, at a frame more input latency.
+    void SetPipelinedRendering(bool enabled) { mPipelinedRendering = enabled; }
+    
+    // What the frame being rendered shows of the simulation
+    const RenderSnapshot& GetRenderSnapshot() const { return mRenderSnapshots[mFrontSnapshot]; }
+    
+    // Compiled pipeline cache for the Metal renderer (empty = none)
+    void SetPipelineArchiveFile(const std::string& filename) { mPipelineArchiveFile = filename; }
+    
+    // Capture the frames after one slower than thresholdMs (GPU trace and
+    // CPU samples) into directory; <= 0 = off (Metal only)
+    void SetSpikeCapture(float thresholdMs, int frames, const std::string& directory) {
+        mSpikeCaptureMs = thresholdMs;
+        mSpikeCaptureFrames = frames;
+        mSpikeCaptureDirectory = directory;
+    }
+    
+    // Record the 3D view to a QuickTime movie (empty = off, Metal only);
+    // each later switch into 3D starts filename-2.mov, -3 and so on
+    void SetVideoRecording(const std::string& filename) { mVideoRecordFile = filename; }
+    
+    // Publish the lander's state every fixed step to a shared memory ring
+    // for external tools (see TelemetryStream.h; empty = off)
+    void SetTelemetryStream(const std::string& name) { mTelemetryName = name; }
+    
+    // Engine, RCS, proximity and event sounds in a window (on by default)
+    void SetAudio(bool enabled) { mAudioEnabled = enabled; }
+    
+    // Autopilot flying the lander in place of the player's thrust and
+    // rotate input; evaluated every fixed step (null = none)
+    void SetController(std::unique_ptr<Controller> controller);
+    
+    // Rewind buffer: a snapshot of the flight every `steps` fixed steps,
+    // holding at least `seconds` of it (both take effect on the next Reset)
+    void SetSnapshotInterval(int steps) { mSnapshotInterval = steps > 0 ? steps : 1; }
+    void SetRewindWindow(float seconds) { mRewindWindow = seconds > 0.0f ? seconds : 1.0f; }
+    
+    // Put the flight back the way it was about `seconds` of flight time ago
+    // (or as far as the buffer goes); false if there is nothing to go back to
+    bool Rewind(float seconds);
+    
+    // Extra landers drawn every frame, e.g. a batch run being visualised
+    // (not owned, null = none)
+    void SetLanderBatch(const LanderBatch* batch) { mLanderBatch = batch; }
     
     // Game statistics
     float GetScore() const { return mScore; }
     float GetElapsedTime() const { return mElapsedTime; }
     float GetFuelUsed() const { return mFuelUsed; }
     
-    // Physics to screen conversion
-    float GetPixelsPerMeter() const { return mPixelsPerMeter; }
-    
     // Input callbacks
     void OnKeyDown(int keyCode);
     void OnKeyUp(int keyCode);
+    void OnWindowResized(int width, int height);
     
 private:
     // Game loop functions
+    void RunFrame();
+    void SimulateFrame(unsigned int currentTime, float deltaTime);
+    void EndFrame();
+    void RunHeadless();
+    void RunReplay();
+    void RunReplayFrame(float frameTime);
+    void StepReplay();
     void ProcessInput();
+    void ApplyInput();
+    void StepSimulation();
+    void ApplyController();
+    bool LoadScenario();
+    bool JoinNetSession();
+    bool StartNetSession();
+    void StepNetSession();
+    void SyncNetLander();
+    void PublishTelemetry();
+    
+    // The step's lander state and events for the audio mixer; wasFlying and
+    // fuelBefore are from before the step
+    void UpdateAudio(bool wasFlying, float fuelBefore);
+    void UpdatePrediction();
+    void CaptureRenderSnapshot(RenderSnapshot& snapshot);
+    void RenderParticles();
+    void UpdatePointLights();
+    void UpdateTerrainStreaming();
+    void UpdateFloatingOrigin();
+    void ShiftOrigin(int cellsX, int cellsZ);   // 3D, by whole terrain cells
+    void MoveOrigin(const double* shift);
+    void ResetOrigin();
+    void CaptureSnapshot();
+    void RestoreSnapshot(const SimulationSnapshot& snapshot);
+    uint32_t ComputeStateChecksum() const;
     void Update(float deltaTime);
+    void UpdateCamera(float deltaTime);
+    float ComputeTimeWarp() const;
     void Render();
+    void CreateTerrain(Terrain* terrain, uint32_t seed, bool useGpu);   // useGpu: main thread only
+    void FinishNewMap(bool wait);   // Swap in a generated map (main thread, simulation idle)
+    std::unique_ptr<Renderer> CreateRenderer(bool use3D);   // Initialized, or null
+    std::unique_ptr<Terrain> NewTerrain();                  // Configured, not generated
+    
+    // Pipelined rendering's simulation thread
+    void SimulationLoop();
+    void StartSimulation(unsigned int currentTime, float deltaTime);
+    void WaitForSimulation();
+    void StopSimulationThread();
     
     // Game state
     GameState mGameState;
     Difficulty mDifficulty;
     bool m3DMode;
     
-    // Game entities
+    // Game entities, handles into mEntities (declared first so it outlives them)
+    std::unique_ptr<EntityStore> mEntities;
     std::unique_ptr<Lander> mLander;
     std::unique_ptr<Terrain> mTerrain;
+    std::unique_ptr<Terrain> mStandbyTerrain;     // The other mode's, kept across switches
+    const LanderBatch* mLanderBatch;
     
     // Core systems
+    std::unique_ptr<JobSystem> mJobSystem;
+    std::unique_ptr<FrameArena> mFrameArena;
     std::unique_ptr<Renderer> mRenderer;
+    std::unique_ptr<Renderer> mStandbyRenderer;   // The other mode's, hidden (null = none)
     std::unique_ptr<Physics> mPhysics;
-    std::unique_ptr<InputHandler> mInputHandler;
+    std::unique_ptr<InputSource> mInputHandler;
+    std::unique_ptr<Controller> mController;
+    std::unique_ptr<TrajectoryPredictor> mPredictor;   // Touchdown marker
+    std::unique_ptr<SnapshotBuffer> mSnapshots;        // Rewind history of the flight
+    std::unique_ptr<NetSession> mNetSession;           // Null outside a network session
+    std::unique_ptr<TelemetryStream> mTelemetry;       // Null unless publishing telemetry
+    std::string mTelemetryName;
+    std::unique_ptr<AudioEngine> mAudio;               // Null when silent
+    bool mAudioEnabled;
+    
+    // Render snapshots: the front one is drawn, the other filled next
+    RenderSnapshot mRenderSnapshots[2];
+    int mFrontSnapshot;
+    
+    // 3D view of the front snapshot's lander, on the main thread
+    Camera mCamera;
+    bool mCameraCut;              // Next frame jumps to the rig's goal (the lander jumped)
+    
+    // Pipelined rendering: the simulation thread steps a frame into the
+    // back snapshot between StartSimulation and WaitForSimulation. Only the
+    // main thread changes the terrain, renderer or game setup, and only
+    // while the thread is idle, so resets it asks for wait for that.
+    bool mPipelinedRendering;
+    std::thread mSimulationThread;
+    std::mutex mSimulationMutex;
+    std::condition_variable mSimulationCondition;
+    bool mSimulationRequested;      // Guarded by mSimulationMutex
+    bool mSimulationStopping;       // Guarded by mSimulationMutex
+    unsigned int mSimulationFrameTime;
+    float mSimulationDeltaTime;
+    bool mSimulationPending;        // Back snapshot not yet collected (main thread)
+    bool mResetPending;
+    
+    // Map generating for NewMap() (null job = none)
+    std::unique_ptr<Terrain> mNewMapTerrain;
+    std::shared_ptr<Job> mNewMapJob;
+    std::atomic<bool> mNewMapReady;
+    uint32_t mNewMapSeed;
+    uint64_t mNewMapStart;          // Profiler::Now() when asked for
+    
+    // Landing pad corner beacons of mPadBeaconTerrain at its layout version
+    std::vector<PointLight> mPadBeacons;
+    const Terrain* mPadBeaconTerrain;
+    uint32_t mPadBeaconLayoutVersion;
     
     // Game statistics
     float mScore;
@@ -93,14 +426,95 @@ private:
     
     // Timing
     unsigned int mLastFrameTime;
+    float mFixedTimeStep;     // Seconds per simulation step
+    float mAccumulator;       // Unsimulated frame time carried to the next frame
+    float mTimeWarp;          // Simulated seconds per wall second asked for
+    float mEffectiveTimeWarp; // After the ground and CPU budget limits
+    uint64_t mFrameIndex;     // Windowed frames finished
+    uint64_t mFrameHeapAllocations;   // Heap allocation count when the last frame ended (debug)
     
     // Window dimensions
     int mWindowWidth;
     int mWindowHeight;
     
-    // Physics to screen conversion
-    float mPixelsPerMeter;
+    // Job system settings
+    int mWorkerThreadCount;
+    PhysicsBroadphase mBroadphase;
+    bool mAdaptiveStepping;
+    
+    // Recording and replay
+    std::string mRecordFile;
+    std::string mReplayFile;
+    std::unique_ptr<InputRecorder> mInputRecorder;
+    ReplayInput* mReplayInput;    // Points into mInputHandler while replaying
+    bool mReplayWindowed;
+    int mChecksumInterval;
+    uint32_t mRandomSeed;
+    uint64_t mStepIndex;          // Fixed steps simulated since Initialize
+    
+    // The scenario flown, in mScenarioFile's mapping (null = the built-in start)
+    std::string mScenarioFilename;
+    std::string mScenarioName;
+    std::unique_ptr<ScenarioFile> mScenarioFile;
+    const ScenarioRecord* mScenario;
+    
+    // Network session settings; a reset respawns the session's lander on
+    // the next step
+    int mHostPort;
+    std::string mConnectAddress;
+    bool mNetRespawn;
+    
+    // Rewind: flight steps count only steps taken while flying and go back
+    // with a rewind, so snapshots are keyed by them; mStepIndex never goes
+    // back, keeping recordings and replays in step
+    uint64_t mFlightStep;
+    int mSnapshotInterval;
+    float mRewindWindow;
+    
+    // Startup timing: Initialize() start (Profiler::Now()) to the first
+    // presented frame
+    uint64_t mInitializeStartNs;
+    bool mFirstFramePresented;
+    
+    // Terrain source
+    std::string mHeightmapFile;
+    size_t mTileCacheBudget;      // DEM tile cache bytes (0 = Terrain's default)
+    std::string mTerrainCacheFile;
+    int mTerrainGridSize;
+    bool mGpuTerrain;
+    int mWorldWidth2D;
+    int mWorldSegments2D;
+    float mViewScale2D;
+    bool mTerrainTextures;
+    bool mTerrainTessellation;
+    bool mTerrainMeshShaders;
+    std::string mLanderMeshFile;
+    bool mGpuTerrainCulling;
+    bool mHiZCulling;
+    bool mDynamicResolution;
+    float mTargetFrameRate;
+    bool mTemporalUpscaling;
+    bool mVariableRasterization;
+    bool mShadows;
+    bool mRayTracedShadows;
+    bool mHorizonShadows;
+    bool mDeferredLighting;
+    bool mParallelEncoding;
+    int mMaximumDrawableCount;
+    FramePacer mFramePacer;
+    std::string mPipelineArchiveFile;
+    float mSpikeCaptureMs;
+    int mSpikeCaptureFrames;
+    std::string mSpikeCaptureDirectory;
+    std::string mVideoRecordFile;
+    int mVideoRecordings;           // 3D renderers that recorded so far
+    
+    // Headless run settings
+    bool mHeadless;
+    std::string mInputScript;
+    int mFlightCount;
+    float mMaxFlightTime;
     
-    // Game is running flag
-    bool mIsRunning;
+    // Game is running flag (the simulation thread clears it on quit)
+    std::atomic<bool> mIsRunning;
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+// HeapCounter.cpp
+// Debug-build global operator new and delete that count heap calls
+//
+// Only the game links this: replacing the allocator from lander_core would
+// hand every tool and the lander_env library the counting versions too.
+
+#include "FrameArena.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifndef NDEBUG
+
+// Debug builds replace the global allocation functions to count calls;
+// storage still comes from malloc. Release builds leave them alone.
+static std::atomic<uint64_t> sHeapAllocations(0);
+
+static uint64_t GetHeapAllocations() {
+    return sHeapAllocations.load(std::memory_order_relaxed);
+}
+
+// Constant-initialized counter, so allocations made before this runs are
+// counted too
+static const bool sCounterRegistered = (FrameArena::SetHeapAllocationCounter(GetHeapAllocations), true);
+
+static void* CountedAllocate(size_t size) {
+    sHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+static void* CountedAllocateAligned(size_t size, std::align_val_t alignment) {
+    sHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+    void* memory = nullptr;
+    if (posix_memalign(&memory, align, size ? size : 1) != 0) {
+        return nullptr;
+    }
+    return memory;
+}
+
+void* operator new(size_t size) {
+    void* memory = CountedAllocate(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    void* memory = CountedAllocate(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    void* memory = CountedAllocateAligned(size, alignment);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    void* memory = CountedAllocateAligned(size, alignment);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+
+#endif
@@ -0,0 +1,165 @@
+// HeightGrid.cpp
+// Quantization and re-quantization of the 16-bit height grid
+
+#include "HeightGrid.h"
+#include <algorithm>
+
+HeightGrid::HeightGrid()
+    : mSamplesPerSide(0)
+    , mTilesPerSide(0)
+    , mMinHeight(0.0f)
+    , mMaxHeight(0.0f)
+{
+}
+
+void HeightGrid::Assign(int samplesPerSide, const float* heights) {
+    mSamplesPerSide = samplesPerSide;
+    mTilesPerSide = (samplesPerSide + kTileSize - 1) / kTileSize;
+    mSamples.resize(static_cast<size_t>(samplesPerSide) * samplesPerSide);
+    mTileRanges.resize(static_cast<size_t>(mTilesPerSide) * mTilesPerSide);
+    
+    for (int tileZ = 0; tileZ < mTilesPerSide; tileZ++) {
+        for (int tileX = 0; tileX < mTilesPerSide; tileX++) {
+            const size_t first = static_cast<size_t>(tileZ * kTileSize) * samplesPerSide + tileX * kTileSize;
+            EncodeTile(tileX, tileZ, heights + first, samplesPerSide);
+        }
+    }
+    UpdateHeightRange();
+}
+
+void HeightGrid::Restore(int samplesPerSide, const uint16_t* samples, const HeightTileRange* tileRanges) {
+    mSamplesPerSide = samplesPerSide;
+    mTilesPerSide = (samplesPerSide + kTileSize - 1) / kTileSize;
+    mSamples.assign(samples, samples + static_cast<size_t>(samplesPerSide) * samplesPerSide);
+    mTileRanges.assign(tileRanges, tileRanges + static_cast<size_t>(mTilesPerSide) * mTilesPerSide);
+    UpdateHeightRange();
+}
+
+void HeightGrid::Clear() {
+    mSamples.clear();
+    mTileRanges.clear();
+    mSamplesPerSide = 0;
+    mTilesPerSide = 0;
+    mMinHeight = 0.0f;
+    mMaxHeight = 0.0f;
+}
+
+void HeightGrid::EncodeTile(int tileX, int tileZ, const float* heights, int stride) {
+    const int firstX = tileX * kTileSize;
+    const int firstZ = tileZ * kTileSize;
+    const int width = std::min(kTileSize, mSamplesPerSide - firstX);
+    const int length = std::min(kTileSize, mSamplesPerSide - firstZ);
+    
+    float low = heights[0];
+    float high = low;
+    for (int z = 0; z < length; z++) {
+        const float* row = heights + static_cast<size_t>(z) * stride;
+        for (int x = 0; x < width; x++) {
+            low = std::min(low, row[x]);
+            high = std::max(high, row[x]);
+        }
+    }
+    
+    // A flat tile stores zeros over a zero range
+    HeightTileRange& tile = mTileRanges[static_cast<size_t>(tileZ) * mTilesPerSide + tileX];
+    tile.minHeight = low;
+    tile.range = high - low;
+    const float toSample = tile.range > 0.0f ? kQuantizedMax / tile.range : 0.0f;
+    for (int z = 0; z < length; z++) {
+        const float* row = heights + static_cast<size_t>(z) * stride;
+        uint16_t* out = &mSamples[static_cast<size_t>(firstZ + z) * mSamplesPerSide + firstX];
+        for (int x = 0; x < width; x++) {
+            out[x] = static_cast<uint16_t>(std::min((row[x] - low) * toSample + 0.5f, kQuantizedMax));
+        }
+    }
+}
+
+HeightGridRegion HeightGrid::Write(const HeightGridRegion& region, const float* heights) {
+    const int regionWidth = region.maxX - region.minX + 1;
+    HeightGridRegion changed = region;
+    float tileHeights[kTileSize * kTileSize];
+    
+    for (int tileZ = region.minZ / kTileSize; tileZ <= region.maxZ / kTileSize; tileZ++) {
+        for (int tileX = region.minX / kTileSize; tileX <= region.maxX / kTileSize; tileX++) {
+            const int firstX = tileX * kTileSize;
+            const int firstZ = tileZ * kTileSize;
+            const int minX = std::max(region.minX, firstX);
+            const int maxX = std::min(region.maxX, firstX + kTileSize - 1);
+            const int minZ = std::max(region.minZ, firstZ);
+            const int maxZ = std::min(region.maxZ, firstZ + kTileSize - 1);
+            auto newHeight = [&](int x, int z) {
+                return heights[static_cast<size_t>(z - region.minZ) * regionWidth + (x - region.minX)];
+            };
+            
+            HeightTileRange& tile = mTileRanges[static_cast<size_t>(tileZ) * mTilesPerSide + tileX];
+            bool fits = true;
+            for (int z = minZ; z <= maxZ && fits; z++) {
+                for (int x = minX; x <= maxX; x++) {
+                    float height = newHeight(x, z);
+                    if (height < tile.minHeight || height > tile.minHeight + tile.range) {
+                        fits = false;
+                        break;
+                    }
+                }
+            }
+            
+            // In range: only the written samples change
+            if (fits) {
+                const float toSample = tile.range > 0.0f ? kQuantizedMax / tile.range : 0.0f;
+                for (int z = minZ; z <= maxZ; z++) {
+                    for (int x = minX; x <= maxX; x++) {
+                        float sample = (newHeight(x, z) - tile.minHeight) * toSample + 0.5f;
+                        mSamples[static_cast<size_t>(z) * mSamplesPerSide + x] =
+                            static_cast<uint16_t>(std::min(sample, kQuantizedMax));
+                    }
+                }
+                continue;
+            }
+            
+            // Out of range: decode the tile, overlay the new heights and
+            // quantize it again
+            const int width = std::min(kTileSize, mSamplesPerSide - firstX);
+            const int length = std::min(kTileSize, mSamplesPerSide - firstZ);
+            for (int z = 0; z < length; z++) {
+                for (int x = 0; x < width; x++) {
+                    tileHeights[z * kTileSize + x] = Get(firstX + x, firstZ + z);
+                }
+            }
+            for (int z = minZ; z <= maxZ; z++) {
+                for (int x = minX; x <= maxX; x++) {
+                    tileHeights[(z - firstZ) * kTileSize + (x - firstX)] = newHeight(x, z);
+                }
+            }
+            EncodeTile(tileX, tileZ, tileHeights, kTileSize);
+            
+            changed.minX = std::min(changed.minX, firstX);
+            changed.minZ = std::min(changed.minZ, firstZ);
+            changed.maxX = std::max(changed.maxX, firstX + width - 1);
+            changed.maxZ = std::max(changed.maxZ, firstZ + length - 1);
+        }
+    }
+    
+    UpdateHeightRange();
+    return changed;
+}
+
+void HeightGrid::Read(const HeightGridRegion& region, float* heights) const {
+    for (int z = region.minZ; z <= region.maxZ; z++) {
+        for (int x = region.minX; x <= region.maxX; x++) {
+            *heights++ = Get(x, z);
+        }
+    }
+}
+
+void HeightGrid::UpdateHeightRange() {
+    if (mTileRanges.empty()) {
+        mMinHeight = mMaxHeight = 0.0f;
+        return;
+    }
+    mMinHeight = mTileRanges[0].minHeight;
+    mMaxHeight = mTileRanges[0].minHeight + mTileRanges[0].range;
+    for (const HeightTileRange& tile : mTileRanges) {
+        mMinHeight = std::min(mMinHeight, tile.minHeight);
+        mMaxHeight = std::max(mMaxHeight, tile.minHeight + tile.range);
+    }
+}
@@ -0,0 +1,129 @@
+// HeightGrid.h
+// Square height grid stored as 16-bit samples with a height range per tile
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HEIGHT_GRID_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HEIGHT_GRID_NEON 1
+#endif
+
+// How a tile's samples decode: minHeight + q / 65535 * range. Matches what
+// the GPU reads from an R16Unorm sample and an RG32Float tile texel.
+struct HeightTileRange {
+    float minHeight;    // Meters
+    float range;        // Meters from the lowest to the highest sample
+};
+
+// Samples of a grid, inclusive on both axes
+struct HeightGridRegion {
+    int minX, minZ;
+    int maxX, maxZ;
+};
+
+// samplesPerSide^2 heights in row-major z, x order, each a uint16_t scaled
+// to the range of its kTileSize^2 tile. Half the bytes of float heights;
+// a tile spanning under 650 m of relief keeps centimetre steps.
+class HeightGrid {
+public:
+    static constexpr int kTileSize = 32;                // Samples per tile side
+    static constexpr float kQuantizedMax = 65535.0f;
+    
+    HeightGrid();
+    
+    // Quantize samplesPerSide^2 heights, each tile to its own range
+    void Assign(int samplesPerSide, const float* heights);
+    
+    // Take samples and tile ranges as GetSamples()/GetTileRanges() gave them
+    void Restore(int samplesPerSide, const uint16_t* samples, const HeightTileRange* tileRanges);
+    
+    void Clear();
+    
+    // Store heights for the samples of region, row-major with the region's
+    // width per row. A tile whose range can't hold its new heights is
+    // re-quantized whole, moving its other samples by up to half a step;
+    // returns the samples that changed, grown to cover those tiles.
+    HeightGridRegion Write(const HeightGridRegion& region, const float* heights);
+    
+    float Get(int x, int z) const {
+        const HeightTileRange& tile = mTileRanges[TileIndex(x, z)];
+        const uint16_t sample = mSamples[static_cast<size_t>(z) * mSamplesPerSide + x];
+        return tile.minHeight + sample * (tile.range * (1.0f / kQuantizedMax));
+    }
+    
+    // Heights of samples (x, z), (x+1, z), (x, z+1) and (x+1, z+1), which
+    // may come from up to four tiles
+    inline void GetCell(int x, int z, float* corners) const;
+    
+    // Decode the samples of region into heights, row-major
+    void Read(const HeightGridRegion& region, float* heights) const;
+    
+    int GetSamplesPerSide() const { return mSamplesPerSide; }
+    int GetTilesPerSide() const { return mTilesPerSide; }
+    size_t GetSampleCount() const { return mSamples.size(); }
+    const std::vector<uint16_t>& GetSamples() const { return mSamples; }
+    const std::vector<HeightTileRange>& GetTileRanges() const { return mTileRanges; }   // Row-major tiles
+    
+    // Range of every decoded height
+    float GetMinHeight() const { return mMinHeight; }
+    float GetMaxHeight() const { return mMaxHeight; }
+    
+    // Capacity of both arrays, what stays resident
+    size_t GetResidentBytes() const {
+        return mSamples.capacity() * sizeof(uint16_t) + mTileRanges.capacity() * sizeof(HeightTileRange);
+    }
+
+private:
+    std::vector<uint16_t> mSamples;
+    std::vector<HeightTileRange> mTileRanges;
+    int mSamplesPerSide;
+    int mTilesPerSide;
+    float mMinHeight;
+    float mMaxHeight;
+    
+    size_t TileIndex(int x, int z) const {
+        return static_cast<size_t>(z / kTileSize) * mTilesPerSide + x / kTileSize;
+    }
+    
+    // Quantize a tile's heights to a range fitting them; heights starts at
+    // the tile's first sample, rows stride floats apart
+    void EncodeTile(int tileX, int tileZ, const float* heights, int stride);
+    void UpdateHeightRange();
+};
+
+inline void HeightGrid::GetCell(int x, int z, float* corners) const {
+    const size_t row0 = static_cast<size_t>(z) * mSamplesPerSide + x;
+    const size_t row1 = row0 + mSamplesPerSide;
+    const HeightTileRange& t1 = mTileRanges[TileIndex(x, z)];
+    const HeightTileRange& t2 = mTileRanges[TileIndex(x + 1, z)];
+    const HeightTileRange& t3 = mTileRanges[TileIndex(x, z + 1)];
+    const HeightTileRange& t4 = mTileRanges[TileIndex(x + 1, z + 1)];
+    const float scale = 1.0f / kQuantizedMax;
+    
+    // The gathers are scalar; the decode is one multiply-add across lanes
+#if defined(HEIGHT_GRID_SSE2)
+    __m128 q = _mm_cvtepi32_ps(_mm_setr_epi32(mSamples[row0], mSamples[row0 + 1], mSamples[row1], mSamples[row1 + 1]));
+    __m128 low = _mm_setr_ps(t1.minHeight, t2.minHeight, t3.minHeight, t4.minHeight);
+    __m128 range = _mm_setr_ps(t1.range, t2.range, t3.range, t4.range);
+    _mm_storeu_ps(corners, _mm_add_ps(low, _mm_mul_ps(q, _mm_mul_ps(range, _mm_set1_ps(scale)))));
+#elif defined(HEIGHT_GRID_NEON)
+    const uint32_t samples[4] = { mSamples[row0], mSamples[row0 + 1], mSamples[row1], mSamples[row1 + 1] };
+    const float lows[4] = { t1.minHeight, t2.minHeight, t3.minHeight, t4.minHeight };
+    const float ranges[4] = { t1.range, t2.range, t3.range, t4.range };
+    float32x4_t q = vcvtq_f32_u32(vld1q_u32(samples));
+    float32x4_t range = vmulq_n_f32(vld1q_f32(ranges), scale);
+    vst1q_f32(corners, vaddq_f32(vld1q_f32(lows), vmulq_f32(q, range)));
+#else
+    corners[0] = t1.minHeight + mSamples[row0] * (t1.range * scale);
+    corners[1] = t2.minHeight + mSamples[row0 + 1] * (t2.range * scale);
+    corners[2] = t3.minHeight + mSamples[row1] * (t3.range * scale);
+    corners[3] = t4.minHeight + mSamples[row1 + 1] * (t4.range * scale);
+#endif
+}
@@ -0,0 +1,278 @@
+// HeightPyramid.cpp
+// Building, updating and ray casting the min/max height pyramid
+
+#include "HeightPyramid.h"
+#include "HeightGrid.h"
+#include <algorithm>
+
+// Finest stored level: blocks of 2^2 cells per side
+static const int kLeafLog2 = 2;
+static_assert((1 << kLeafLog2) == HeightPyramid::kLeafCells, "kLeafCells must be 2^kLeafLog2");
+
+// Narrow [t0, t1] to where coordinate origin + t * direction is in [low, high]
+static bool ClipSlab(float origin, float direction, float low, float high, float& t0, float& t1) {
+    if (direction == 0.0f) {
+        return origin >= low && origin <= high;
+    }
+    float enter = (low - origin) / direction;
+    float exit = (high - origin) / direction;
+    if (enter > exit) {
+        std::swap(enter, exit);
+    }
+    t0 = std::max(t0, enter);
+    t1 = std::min(t1, exit);
+    return t0 <= t1;
+}
+
+// Cells [x0, x1) x [z0, z1) in grid space
+static bool ClipToBlock(const float* origin, const float* direction, int x0, int x1, int z0, int z1,
+                        float& t0, float& t1) {
+    return ClipSlab(origin[0], direction[0], static_cast<float>(x0), static_cast<float>(x1), t0, t1) &&
+           ClipSlab(origin[2], direction[2], static_cast<float>(z0), static_cast<float>(z1), t0, t1);
+}
+
+HeightPyramid::HeightPyramid()
+    : mGridSize(0)
+{
+}
+
+void HeightPyramid::Build(const HeightGrid& heights) {
+    Clear();
+    mGridSize = heights.GetSamplesPerSide() - 1;
+    if (mGridSize <= 0) {
+        mGridSize = 0;
+        return;
+    }
+    
+    int side = (mGridSize + kLeafCells - 1) / kLeafCells;
+    size_t offset = 0;
+    while (true) {
+        mLevelOffsets.push_back(offset);
+        mLevelSides.push_back(side);
+        offset += static_cast<size_t>(side) * side;
+        if (side == 1) break;
+        side = (side + 1) / 2;
+    }
+    mBounds.resize(offset);
+    BuildBlocks(heights, 0, 0, mLevelSides[0] - 1, mLevelSides[0] - 1);
+}
+
+void HeightPyramid::Update(const HeightGrid& heights, int minCellX, int minCellZ, int maxCellX, int maxCellZ) {
+    if (mLevelSides.empty()) return;
+    
+    // Cells [min, max) change samples min..max, and a sample on a block
+    // edge belongs to the blocks on both sides
+    const int lastBlock = mLevelSides[0] - 1;
+    BuildBlocks(heights, std::max(minCellX - 1, 0) / kLeafCells, std::max(minCellZ - 1, 0) / kLeafCells,
+                std::min(maxCellX / kLeafCells, lastBlock), std::min(maxCellZ / kLeafCells, lastBlock));
+}
+
+void HeightPyramid::Clear() {
+    mBounds.clear();
+    mLevelOffsets.clear();
+    mLevelSides.clear();
+    mGridSize = 0;
+}
+
+void HeightPyramid::BuildBlocks(const HeightGrid& heights, int minBlockX, int minBlockZ, int maxBlockX,
+                                int maxBlockZ) {
+    // Finest blocks from their samples, edges included
+    for (int blockZ = minBlockZ; blockZ <= maxBlockZ; blockZ++) {
+        for (int blockX = minBlockX; blockX <= maxBlockX; blockX++) {
+            const int x0 = blockX * kLeafCells;
+            const int z0 = blockZ * kLeafCells;
+            const int x1 = std::min(x0 + kLeafCells, mGridSize);
+            const int z1 = std::min(z0 + kLeafCells, mGridSize);
+            Bounds bounds = { heights.Get(x0, z0), heights.Get(x0, z0) };
+            for (int z = z0; z <= z1; z++) {
+                for (int x = x0; x <= x1; x++) {
+                    float height = heights.Get(x, z);
+                    bounds.minHeight = std::min(bounds.minHeight, height);
+                    bounds.maxHeight = std::max(bounds.maxHeight, height);
+                }
+            }
+            At(0, blockX, blockZ) = bounds;
+        }
+    }
+    
+    // Each level above from the up to four blocks under each of its own
+    for (int level = 1; level < GetLevelCount(); level++) {
+        minBlockX /= 2;
+        minBlockZ /= 2;
+        maxBlockX /= 2;
+        maxBlockZ /= 2;
+        const int childSide = mLevelSides[level - 1];
+        for (int blockZ = minBlockZ; blockZ <= maxBlockZ; blockZ++) {
+            for (int blockX = minBlockX; blockX <= maxBlockX; blockX++) {
+                Bounds bounds = At(level - 1, 2 * blockX, 2 * blockZ);
+                for (int child = 1; child < 4; child++) {
+                    int childX = 2 * blockX + (child & 1);
+                    int childZ = 2 * blockZ + (child >> 1);
+                    if (childX >= childSide || childZ >= childSide) continue;
+                    const Bounds& childBounds = At(level - 1, childX, childZ);
+                    bounds.minHeight = std::min(bounds.minHeight, childBounds.minHeight);
+                    bounds.maxHeight = std::max(bounds.maxHeight, childBounds.maxHeight);
+                }
+                At(level, blockX, blockZ) = bounds;
+            }
+        }
+    }
+}
+
+bool HeightPyramid::RayCast(const HeightGrid& heights, const float* origin, const float* direction, float maxT,
+                           float& t) const {
+    if (mLevelSides.empty() || !(maxT >= 0.0f)) {
+        return false;
+    }
+    float t0 = 0.0f;
+    float t1 = maxT;
+    if (!ClipToBlock(origin, direction, 0, mGridSize, 0, mGridSize, t0, t1)) {
+        return false;
+    }
+    return Visit(heights, GetLevelCount() - 1 + kLeafLog2, 0, 0, origin, direction, t0, t1, t);
+}
+
+float HeightPyramid::GetMaxHeight(int minCellX, int minCellZ, int maxCellX, int maxCellZ) const {
+    // Last cells, inclusive
+    const int lastX = std::min(std::max(maxCellX - 1, minCellX), mGridSize - 1);
+    const int lastZ = std::min(std::max(maxCellZ - 1, minCellZ), mGridSize - 1);
+    minCellX = std::min(std::max(minCellX, 0), lastX);
+    minCellZ = std::min(std::max(minCellZ, 0), lastZ);
+    
+    // Climb until the range falls in at most two blocks per side
+    int level = 0;
+    int log2Cells = kLeafLog2;
+    while (level + 1 < GetLevelCount() &&
+           ((lastX >> log2Cells) - (minCellX >> log2Cells) > 1 || (lastZ >> log2Cells) - (minCellZ >> log2Cells) > 1)) {
+        level++;
+        log2Cells++;
+    }
+    
+    float height = At(level, minCellX >> log2Cells, minCellZ >> log2Cells).maxHeight;
+    for (int blockZ = minCellZ >> log2Cells; blockZ <= lastZ >> log2Cells; blockZ++) {
+        for (int blockX = minCellX >> log2Cells; blockX <= lastX >> log2Cells; blockX++) {
+            height = std::max(height, At(level, blockX, blockZ).maxHeight);
+        }
+    }
+    return height;
+}
+
+bool HeightPyramid::Visit(const HeightGrid& heights, int log2Cells, int blockX, int blockZ, const float* origin,
+                          const float* direction, float t0, float t1, float& t) const {
+    if (log2Cells == 0) {
+        return IntersectCell(heights, blockX, blockZ, origin, direction, t0, t1, t);
+    }
+    
+    const int cells = 1 << log2Cells;
+    Bounds bounds;
+    if (log2Cells >= kLeafLog2) {
+        bounds = At(log2Cells - kLeafLog2, blockX, blockZ);
+    } else {
+        // Too small to be worth storing: straight from the samples
+        const int x0 = blockX * cells;
+        const int z0 = blockZ * cells;
+        bounds.minHeight = bounds.maxHeight = heights.Get(x0, z0);
+        for (int z = z0; z <= std::min(z0 + cells, mGridSize); z++) {
+            for (int x = x0; x <= std::min(x0 + cells, mGridSize); x++) {
+                float height = heights.Get(x, z);
+                bounds.minHeight = std::min(bounds.minHeight, height);
+                bounds.maxHeight = std::max(bounds.maxHeight, height);
+            }
+        }
+    }
+    
+    // Height is linear along the ray, so its extremes are at the ends.
+    // Entirely above the block's highest sample: nothing to hit in it.
+    // Entering below its lowest: the hit is right there.
+    const float y0 = origin[1] + t0 * direction[1];
+    const float y1 = origin[1] + t1 * direction[1];
+    if (std::min(y0, y1) > bounds.maxHeight) {
+        return false;
+    }
+    if (y0 <= bounds.minHeight) {
+        t = t0;
+        return true;
+    }
+    
+    // Children the ray passes through, nearest first
+    struct Child {
+        int x, z;
+        float t0, t1;
+    };
+    Child children[4];
+    int childCount = 0;
+    const int childCells = cells / 2;
+    for (int i = 0; i < 4; i++) {
+        Child child = { 2 * blockX + (i & 1), 2 * blockZ + (i >> 1), t0, t1 };
+        const int x0 = child.x * childCells;
+        const int z0 = child.z * childCells;
+        if (x0 >= mGridSize || z0 >= mGridSize ||
+            !ClipToBlock(origin, direction, x0, std::min(x0 + childCells, mGridSize), z0,
+                         std::min(z0 + childCells, mGridSize), child.t0, child.t1)) {
+            continue;
+        }
+        int slot = childCount++;
+        while (slot > 0 && children[slot - 1].t0 > child.t0) {
+            children[slot] = children[slot - 1];
+            slot--;
+        }
+        children[slot] = child;
+    }
+    
+    for (int i = 0; i < childCount; i++) {
+        const Child& child = children[i];
+        if (Visit(heights, log2Cells - 1, child.x, child.z, origin, direction, child.t0, child.t1, t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HeightPyramid::IntersectCell(const HeightGrid& heights, int cellX, int cellZ, const float* origin,
+                                  const float* direction, float t0, float t1, float& t) const {
+    float corners[4];
+    heights.GetCell(cellX, cellZ, corners);
+    
+    // Surface minus ray height at t, on the triangle either side of the
+    // (x+1, z) - (x, z+1) diagonal: linear in t within one triangle
+    auto clearance = [&](float at, bool secondTriangle) {
+        const float u = origin[0] + at * direction[0] - cellX;
+        const float v = origin[2] + at * direction[2] - cellZ;
+        const float surface = secondTriangle
+            ? corners[3] + (1.0f - u) * (corners[2] - corners[3]) + (1.0f - v) * (corners[1] - corners[3])
+            : corners[0] + u * (corners[1] - corners[0]) + v * (corners[2] - corners[0]);
+        return origin[1] + at * direction[1] - surface;
+    };
+    
+    // Split the interval where the ray crosses the diagonal, u + v = 1
+    float splits[3] = { t0, t1, t1 };
+    int splitCount = 2;
+    const float diagonalRate = direction[0] + direction[2];
+    if (diagonalRate != 0.0f) {
+        float crossing = (1.0f - (origin[0] - cellX) - (origin[2] - cellZ)) / diagonalRate;
+        if (crossing > t0 && crossing < t1) {
+            splits[1] = crossing;
+            splits[2] = t1;
+            splitCount = 3;
+        }
+    }
+    
+    for (int i = 0; i + 1 < splitCount; i++) {
+        const float a = splits[i];
+        const float b = splits[i + 1];
+        const float middle = 0.5f * (a + b);
+        const bool second =
+            origin[0] + middle * direction[0] - cellX + origin[2] + middle * direction[2] - cellZ > 1.0f;
+        const float clearanceA = clearance(a, second);
+        if (clearanceA <= 0.0f) {
+            t = a;
+            return true;
+        }
+        const float clearanceB = clearance(b, second);
+        if (clearanceB <= 0.0f) {
+            t = a + (b - a) * clearanceA / (clearanceA - clearanceB);
+            return true;
+        }
+    }
+    return false;
+}
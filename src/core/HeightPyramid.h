@@ -0,0 +1,83 @@
+// HeightPyramid.h
+// Min/max height mip pyramid over a height grid, for hierarchical ray casts
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class HeightGrid;
+
+// Height bounds of square blocks of grid cells: the finest level holds
+// kLeafCells^2 cell blocks, each level above halves the blocks per side
+// until one covers the grid. A ray skips any block it passes over entirely
+// above the block's highest sample, so one that clears the terrain visits
+// O(log n) blocks; only the cells it actually reaches down into are
+// intersected exactly.
+//
+// Works in grid space: x and z in cells from grid sample (0, 0), y in meters.
+class HeightPyramid {
+public:
+    static constexpr int kLeafCells = 4;    // Cells per side of a finest-level block
+    
+    HeightPyramid();
+    
+    // All levels for the grid's (samplesPerSide - 1)^2 cells
+    void Build(const HeightGrid& heights);
+    
+    // Bounds of the blocks covering cells [minCell, maxCell) on both axes,
+    // after their heights changed
+    void Update(const HeightGrid& heights, int minCellX, int minCellZ, int maxCellX, int maxCellZ);
+    
+    void Clear();
+    
+    // First t in [0, maxT] at which origin + t * direction is on or below
+    // the surface of the grid's triangles (the split of Terrain::SampleHeight);
+    // false if the ray misses within maxT or stays off the grid
+    bool RayCast(const HeightGrid& heights, const float* origin, const float* direction, float maxT,
+                 float& t) const;
+    
+    // Height no sample of cells [minCell, maxCell) on both axes (clamped to
+    // the grid, and not empty) rises above, from the coarsest level whose
+    // blocks cover them two per side: O(log n), and never below the true
+    // maximum, though it can take in heights a block from the range
+    float GetMaxHeight(int minCellX, int minCellZ, int maxCellX, int maxCellZ) const;
+    
+    int GetLevelCount() const { return static_cast<int>(mLevelSides.size()); }
+    size_t GetResidentBytes() const {
+        return mBounds.capacity() * sizeof(Bounds) + mLevelOffsets.capacity() * sizeof(size_t) +
+               mLevelSides.capacity() * sizeof(int);
+    }
+
+private:
+    struct Bounds {
+        float minHeight;
+        float maxHeight;
+    };
+    
+    // Levels one after another, row-major blocks, finest first
+    std::vector<Bounds> mBounds;
+    std::vector<size_t> mLevelOffsets;
+    std::vector<int> mLevelSides;   // Blocks per side
+    int mGridSize;                  // Cells per side
+    
+    Bounds& At(int level, int blockX, int blockZ) {
+        return mBounds[mLevelOffsets[level] + static_cast<size_t>(blockZ) * mLevelSides[level] + blockX];
+    }
+    const Bounds& At(int level, int blockX, int blockZ) const {
+        return mBounds[mLevelOffsets[level] + static_cast<size_t>(blockZ) * mLevelSides[level] + blockX];
+    }
+    
+    // Recompute finest blocks [min, max] and every block above them
+    void BuildBlocks(const HeightGrid& heights, int minBlockX, int minBlockZ, int maxBlockX, int maxBlockZ);
+    
+    // Ray through the block of 2^log2Cells cells per side at (blockX,
+    // blockZ), already clipped to [t0, t1] inside it; below the finest
+    // level the bounds come from the samples
+    bool Visit(const HeightGrid& heights, int log2Cells, int blockX, int blockZ, const float* origin,
+               const float* direction, float t0, float t1, float& t) const;
+    
+    // Exact intersection with the two triangles of one cell over [t0, t1]
+    bool IntersectCell(const HeightGrid& heights, int cellX, int cellZ, const float* origin,
+                       const float* direction, float t0, float t1, float& t) const;
+};
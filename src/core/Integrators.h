@@ -0,0 +1,143 @@
+// Integrators.h
+// Fixed-step integrators for the 2D lander, chosen at compile time
+
+#pragma once
+
+// Position and velocity of one 2D point mass, or of a SIMD lane group
+template <class Value>
+struct IntegratorState2D {
+    Value posX, posY;
+    Value velX, velY;
+};
+
+// Arithmetic the integrators are written in. LanderKernels supplies SSE2
+// and NEON versions, so the scalar and SIMD kernels run the same
+// operations in the same order and round identically.
+struct ScalarOps {
+    typedef float Value;
+    static float Splat(float value) { return value; }
+    static float Add(float a, float b) { return a + b; }
+    static float Mul(float a, float b) { return a * b; }
+};
+
+// Each policy advances a state by dt. accel(state, ax, ay) gives the
+// acceleration at a state; the lander's forces (gravity, thrust at a fixed
+// attitude) don't depend on it, but the integrators don't assume that.
+// There is no virtual dispatch: callers take the policy as a template
+// argument and the steps inline into their loops.
+
+// v += a dt, then x += v dt. First order, but symplectic: orbits and
+// bounces don't gain energy. One acceleration per step.
+struct SemiImplicitEuler {
+    static const char* Name() { return "semi-implicit Euler"; }
+    
+    template <class Ops, class Accel>
+    static void Step(IntegratorState2D<typename Ops::Value>& state, typename Ops::Value dt, const Accel& accel) {
+        typename Ops::Value ax, ay;
+        accel(state, ax, ay);
+        state.velX = Ops::Add(state.velX, Ops::Mul(ax, dt));
+        state.velY = Ops::Add(state.velY, Ops::Mul(ay, dt));
+        state.posX = Ops::Add(state.posX, Ops::Mul(state.velX, dt));
+        state.posY = Ops::Add(state.posY, Ops::Mul(state.velY, dt));
+    }
+};
+
+// x += v dt + a dt^2 / 2, then v += (a + a') dt / 2 with a' taken at the
+// new position. Second order and symplectic; exact for constant
+// acceleration, so a free fall lands at the analytic time at any dt.
+struct VelocityVerlet {
+    static const char* Name() { return "velocity Verlet"; }
+    
+    template <class Ops, class Accel>
+    static void Step(IntegratorState2D<typename Ops::Value>& state, typename Ops::Value dt, const Accel& accel) {
+        typedef typename Ops::Value Value;
+        const Value halfDt = Ops::Mul(dt, Ops::Splat(0.5f));
+        Value ax, ay;
+        accel(state, ax, ay);
+    
+        // Position from the current velocity and acceleration
+        IntegratorState2D<Value> next;
+        next.posX = Ops::Add(state.posX, Ops::Mul(Ops::Add(state.velX, Ops::Mul(ax, halfDt)), dt));
+        next.posY = Ops::Add(state.posY, Ops::Mul(Ops::Add(state.velY, Ops::Mul(ay, halfDt)), dt));
+    
+        // Velocity estimate for the second evaluation (only matters for
+        // velocity-dependent forces)
+        next.velX = Ops::Add(state.velX, Ops::Mul(ax, dt));
+        next.velY = Ops::Add(state.velY, Ops::Mul(ay, dt));
+    
+        Value nextAx, nextAy;
+        accel(next, nextAx, nextAy);
+        next.velX = Ops::Add(state.velX, Ops::Mul(Ops::Add(ax, nextAx), halfDt));
+        next.velY = Ops::Add(state.velY, Ops::Mul(Ops::Add(ay, nextAy), halfDt));
+        state = next;
+    }
+};
+
+// Classic fourth-order Runge-Kutta: four accelerations per step. Not
+// symplectic, but the most accurate per step for smooth forces.
+struct RungeKutta4 {
+    static const char* Name() { return "RK4"; }
+    
+    template <class Ops, class Accel>
+    static void Step(IntegratorState2D<typename Ops::Value>& state, typename Ops::Value dt, const Accel& accel) {
+        typedef typename Ops::Value Value;
+        const Value halfDt = Ops::Mul(dt, Ops::Splat(0.5f));
+        const Value sixthDt = Ops::Mul(dt, Ops::Splat(1.0f / 6.0f));
+        const Value two = Ops::Splat(2.0f);
+    
+        // Each stage takes the derivative (velocity, acceleration) at the
+        // start, twice at the midpoint and at the end of the step
+        Value ax1, ay1;
+        accel(state, ax1, ay1);
+    
+        IntegratorState2D<Value> stage;
+        stage.posX = Ops::Add(state.posX, Ops::Mul(state.velX, halfDt));
+        stage.posY = Ops::Add(state.posY, Ops::Mul(state.velY, halfDt));
+        stage.velX = Ops::Add(state.velX, Ops::Mul(ax1, halfDt));
+        stage.velY = Ops::Add(state.velY, Ops::Mul(ay1, halfDt));
+        const Value vx2 = stage.velX, vy2 = stage.velY;
+        Value ax2, ay2;
+        accel(stage, ax2, ay2);
+    
+        stage.posX = Ops::Add(state.posX, Ops::Mul(vx2, halfDt));
+        stage.posY = Ops::Add(state.posY, Ops::Mul(vy2, halfDt));
+        stage.velX = Ops::Add(state.velX, Ops::Mul(ax2, halfDt));
+        stage.velY = Ops::Add(state.velY, Ops::Mul(ay2, halfDt));
+        const Value vx3 = stage.velX, vy3 = stage.velY;
+        Value ax3, ay3;
+        accel(stage, ax3, ay3);
+    
+        stage.posX = Ops::Add(state.posX, Ops::Mul(vx3, dt));
+        stage.posY = Ops::Add(state.posY, Ops::Mul(vy3, dt));
+        stage.velX = Ops::Add(state.velX, Ops::Mul(ax3, dt));
+        stage.velY = Ops::Add(state.velY, Ops::Mul(ay3, dt));
+        const Value vx4 = stage.velX, vy4 = stage.velY;
+        Value ax4, ay4;
+        accel(stage, ax4, ay4);
+    
+        // Weighted sum (k1 + 2 k2 + 2 k3 + k4) / 6
+        const Value sumVX = Ops::Add(Ops::Add(state.velX, Ops::Mul(two, Ops::Add(vx2, vx3))), vx4);
+        const Value sumVY = Ops::Add(Ops::Add(state.velY, Ops::Mul(two, Ops::Add(vy2, vy3))), vy4);
+        const Value sumAX = Ops::Add(Ops::Add(ax1, Ops::Mul(two, Ops::Add(ax2, ax3))), ax4);
+        const Value sumAY = Ops::Add(Ops::Add(ay1, Ops::Mul(two, Ops::Add(ay2, ay3))), ay4);
+        state.posX = Ops::Add(state.posX, Ops::Mul(sumVX, sixthDt));
+        state.posY = Ops::Add(state.posY, Ops::Mul(sumVY, sixthDt));
+        state.velX = Ops::Add(state.velX, Ops::Mul(sumAX, sixthDt));
+        state.velY = Ops::Add(state.velY, Ops::Mul(sumAY, sixthDt));
+    }
+};
+
+// The build's integrator for Physics::Update2D and LanderBatch, picked
+// with LANDER_INTEGRATOR: 0 semi-implicit Euler, 1 velocity Verlet, 2 RK4
+// (CMake cache variable of the same name)
+#ifndef LANDER_INTEGRATOR
+#define LANDER_INTEGRATOR 0
+#endif
+
+#if LANDER_INTEGRATOR == 1
+typedef VelocityVerlet LanderIntegrator;
+#elif LANDER_INTEGRATOR == 2
+typedef RungeKutta4 LanderIntegrator;
+#else
+typedef SemiImplicitEuler LanderIntegrator;
+#endif
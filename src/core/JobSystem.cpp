@@ -0,0 +1,262 @@
+// JobSystem.cpp
+// Implementation of the work-stealing job system
+
+#include "JobSystem.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <algorithm>
+
+struct Job {
+    std::function<void()> task;
+    
+    // Dependencies not yet finished (+1 while the job is being scheduled)
+    std::atomic<int> unfinishedDependencies;
+    std::atomic<bool> finished;
+    
+    // Jobs waiting on this one
+    std::mutex continuationMutex;
+    std::vector<JobHandle> continuations;
+    
+    Job() : unfinishedDependencies(1), finished(false) {}
+};
+
+// Which JobSystem worker the current thread is (-1 for other threads)
+static thread_local const JobSystem* tWorkerOwner = nullptr;
+static thread_local int tWorkerIndex = -1;
+
+JobSystem::JobSystem(int workerCount)
+    : mPendingJobs(0)
+    , mStopping(false)
+{
+    if (workerCount < 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? static_cast<int>(hardwareThreads) - 1 : 0;
+    }
+    
+    for (int i = 0; i < workerCount; ++i) {
+        mQueues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+    
+    LOG_INFO("Job system started with %d worker threads", workerCount);
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStopping = true;
+    }
+    mWakeCondition.notify_all();
+    
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+JobHandle JobSystem::Schedule(std::function<void()> task, const std::vector<JobHandle>& dependencies) {
+    JobHandle job = std::make_shared<Job>();
+    job->task = std::move(task);
+    
+    // Register with each unfinished dependency
+    for (const JobHandle& dependency : dependencies) {
+        if (!dependency) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+        if (!dependency->finished) {
+            job->unfinishedDependencies++;
+            dependency->continuations.push_back(job);
+        }
+    }
+    
+    // Drop the scheduling reference; queue now if nothing is outstanding
+    if (--job->unfinishedDependencies == 0) {
+        Enqueue(job);
+    }
+    
+    return job;
+}
+
+void JobSystem::Wait(const JobHandle& job) {
+    if (!job) {
+        return;
+    }
+    
+    int workerIndex = (tWorkerOwner == this) ? tWorkerIndex : -1;
+    while (!job->finished) {
+        // Help out instead of blocking so nested waits can't deadlock
+        if (!RunOneJob(workerIndex)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::WaitAll(const std::vector<JobHandle>& jobs) {
+    for (const JobHandle& job : jobs) {
+        Wait(job);
+    }
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grainSize,
+                            const std::function<void(size_t begin, size_t end)>& body) {
+    if (count == 0) {
+        return;
+    }
+    
+    grainSize = std::max<size_t>(1, grainSize);
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    
+    // Not worth splitting
+    if (chunkCount == 1 || mWorkers.empty()) {
+        body(0, count);
+        return;
+    }
+    
+    // Each runner claims chunks from a shared counter until none are left,
+    // so uneven chunks balance without one job per chunk
+    std::atomic<size_t> nextChunk(0);
+    auto runChunks = [&]() {
+        size_t chunk;
+        while ((chunk = nextChunk++) < chunkCount) {
+            size_t begin = chunk * grainSize;
+            size_t end = std::min(count, begin + grainSize);
+            body(begin, end);
+        }
+    };
+    
+    size_t helperCount = std::min(chunkCount - 1, mWorkers.size());
+    std::vector<JobHandle> helpers;
+    helpers.reserve(helperCount);
+    for (size_t i = 0; i < helperCount; ++i) {
+        helpers.push_back(Schedule(runChunks));
+    }
+    
+    runChunks();
+    WaitAll(helpers);
+}
+
+void JobSystem::WorkerLoop(int workerIndex) {
+    tWorkerOwner = this;
+    tWorkerIndex = workerIndex;
+    Profiler::SetThreadName("Worker");
+    
+    while (!mStopping) {
+        if (RunOneJob(workerIndex)) {
+            continue;
+        }
+        
+        // Nothing to do: sleep until new work arrives
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWakeCondition.wait(lock, [this]() { return mStopping || mPendingJobs > 0; });
+    }
+}
+
+void JobSystem::Enqueue(const JobHandle& job) {
+    // Workers push to their own queue so related work stays local;
+    // everyone else goes through the shared submit queue
+    WorkQueue& queue = (tWorkerOwner == this && tWorkerIndex >= 0)
+        ? *mQueues[tWorkerIndex] : mSubmitQueue;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mPendingJobs++;
+    }
+    mWakeCondition.notify_one();
+}
+
+bool JobSystem::RunOneJob(int workerIndex) {
+    JobHandle job = PopJob(workerIndex);
+    if (!job) {
+        return false;
+    }
+    
+    mPendingJobs--;
+    WorkQueue& own = workerIndex >= 0 ? *mQueues[workerIndex] : mSubmitQueue;
+    own.counters.jobsRun.fetch_add(1, std::memory_order_relaxed);
+    Execute(job);
+    return true;
+}
+
+JobSystemStats JobSystem::GetStats() const {
+    JobSystemStats stats = { std::max(0, mPendingJobs.load(std::memory_order_relaxed)), 0, 0 };
+    auto add = [&stats](const QueueCounters& counters) {
+        stats.jobsRun += counters.jobsRun.load(std::memory_order_relaxed);
+        stats.steals += counters.steals.load(std::memory_order_relaxed);
+    };
+    for (const auto& queue : mQueues) {
+        add(queue->counters);
+    }
+    add(mSubmitQueue.counters);
+    return stats;
+}
+
+JobHandle JobSystem::PopJob(int workerIndex) {
+    JobHandle job;
+    
+    // Own queue first (newest job, still warm in cache)
+    if (workerIndex >= 0) {
+        WorkQueue& own = *mQueues[workerIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return job;
+        }
+    }
+    
+    // Then the shared submit queue
+    {
+        std::lock_guard<std::mutex> lock(mSubmitQueue.mutex);
+        if (!mSubmitQueue.jobs.empty()) {
+            job = std::move(mSubmitQueue.jobs.front());
+            mSubmitQueue.jobs.pop_front();
+            return job;
+        }
+    }
+    
+    // Then steal the oldest job from another worker
+    size_t queueCount = mQueues.size();
+    size_t start = workerIndex >= 0 ? static_cast<size_t>(workerIndex) + 1 : 0;
+    for (size_t i = 0; i < queueCount; ++i) {
+        WorkQueue& victim = *mQueues[(start + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            WorkQueue& own = workerIndex >= 0 ? *mQueues[workerIndex] : mSubmitQueue;
+            own.counters.steals.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    
+    return job;
+}
+
+void JobSystem::Execute(const JobHandle& job) {
+    if (job->task) {
+        job->task();
+    }
+    
+    // Mark finished and release dependents
+    std::vector<JobHandle> ready;
+    {
+        std::lock_guard<std::mutex> lock(job->continuationMutex);
+        job->finished = true;
+        for (JobHandle& continuation : job->continuations) {
+            if (--continuation->unfinishedDependencies == 0) {
+                ready.push_back(continuation);
+            }
+        }
+        job->continuations.clear();
+    }
+    
+    for (const JobHandle& continuation : ready) {
+        Enqueue(continuation);
+    }
+}
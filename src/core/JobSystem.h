@@ -0,0 +1,95 @@
+// JobSystem.h
+// Work-stealing thread pool with parallel-for and job dependencies
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A scheduled unit of work. Handles keep the job alive until waited on.
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+// Totals since the job system started, summed from per-queue counters
+struct JobSystemStats {
+    int queuedJobs;         // Scheduled and not yet picked up
+    uint64_t jobsRun;
+    uint64_t steals;        // Jobs a worker or caller took from another worker's queue
+};
+
+class JobSystem {
+public:
+    // workerCount < 0 uses one worker per hardware thread minus the caller
+    JobSystem(int workerCount = -1);
+    ~JobSystem();
+    
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    
+    // Schedule a task that starts once every dependency has finished
+    JobHandle Schedule(std::function<void()> task,
+                       const std::vector<JobHandle>& dependencies = std::vector<JobHandle>());
+    
+    // Block until the job is finished, running other jobs meanwhile
+    void Wait(const JobHandle& job);
+    void WaitAll(const std::vector<JobHandle>& jobs);
+    
+    // Run body(begin, end) over [0, count) in chunks of at least grainSize.
+    // The calling thread takes part; returns once every chunk is done.
+    void ParallelFor(size_t count, size_t grainSize,
+                     const std::function<void(size_t begin, size_t end)>& body);
+    
+    // Number of worker threads (not counting callers)
+    int GetWorkerCount() const { return static_cast<int>(mWorkers.size()); }
+    
+    // Lock-free, from any thread (e.g. a metrics scrape)
+    JobSystemStats GetStats() const;
+
+private:
+    // Counted by the queue's owner (callers share the submit queue's), on
+    // a cache line of their own so thieves taking the mutex don't bounce it
+    struct alignas(64) QueueCounters {
+        std::atomic<uint64_t> jobsRun{0};
+        std::atomic<uint64_t> steals{0};
+    };
+    
+    // Per-worker deque: the owner pushes and pops at the back, thieves take
+    // from the front
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+        QueueCounters counters;
+    };
+    
+    void WorkerLoop(int workerIndex);
+    
+    // Queue a job whose dependencies are all satisfied
+    void Enqueue(const JobHandle& job);
+    
+    // Pop local work or steal; runs it and returns true if a job was found
+    bool RunOneJob(int workerIndex);
+    JobHandle PopJob(int workerIndex);
+    
+    // Run a job and release the jobs that depend on it
+    void Execute(const JobHandle& job);
+    
+    std::vector<std::thread> mWorkers;
+    
+    // One queue per worker, plus a shared queue for non-worker threads
+    std::vector<std::unique_ptr<WorkQueue>> mQueues;
+    WorkQueue mSubmitQueue;
+    
+    // Sleeping workers wait here when there is no work
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeCondition;
+    std::atomic<int> mPendingJobs;
+    std::atomic<bool> mStopping;
+};
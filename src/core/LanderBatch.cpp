@@ -0,0 +1,415 @@
+// LanderBatch.cpp
+// Implementation of the structure-of-arrays lander batch
+
+#include "LanderBatch.h"
+#include "Controller.h"
+#include "LanderKernels.h"
+#include "Integrators.h"
+#include "JobSystem.h"
+#include "MassProperties.h"
+#include "PlumeTable.h"
+#include "RcsThrusters.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+
+template <typename T>
+static size_t VectorBytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+std::shared_ptr<const LanderBatchTerrain> LanderBatchTerrain::Build(const Terrain* terrain) {
+    if (!terrain) {
+        return nullptr;
+    }
+    
+    auto table = std::make_shared<LanderBatchTerrain>();
+    table->height = static_cast<float>(terrain->GetHeight());
+    const auto& segments = terrain->GetSegments2D();
+    table->x1.reserve(segments.size());
+    table->y1.reserve(segments.size());
+    table->x2.reserve(segments.size());
+    table->y2.reserve(segments.size());
+    table->landingPad.reserve(segments.size());
+    for (const auto& segment : segments) {
+        table->x1.push_back(segment.x1);
+        table->y1.push_back(segment.y1);
+        table->x2.push_back(segment.x2);
+        table->y2.push_back(segment.y2);
+        table->landingPad.push_back(segment.isLandingPad ? 1 : 0);
+    }
+    return table;
+}
+
+size_t LanderBatchTerrain::GetMemoryUsage() const {
+    return sizeof(*this) + VectorBytes(x1) + VectorBytes(y1) + VectorBytes(x2) + VectorBytes(y2) +
+           VectorBytes(landingPad);
+}
+
+LanderBatch::LanderBatch()
+    : mGravity(1.62f)        // Lunar gravity (m/s²)
+    , mSpawnX(20.0f)
+    , mSpawnY(20.0f)
+    , mSpawnVelX(0.0f)
+    , mSpawnVelY(0.0f)
+    , mSpawnFuel(-1.0f)
+    , mLanderWidth(Units::ToMeters(20.0_px).Value())    // Lander's defaults
+    , mLanderHeight(Units::ToMeters(30.0_px).Value())
+    , mMaxFuel(1000.0f)
+    , mFuelConsumptionRate(10.0f)
+    , mRcsAngularAccel(0.0f)
+    , mUseSimd(LanderKernels::HasSimd())
+    , mJobSystem(nullptr)
+{
+    UpdateRcsAngularAccel();
+}
+
+void LanderBatch::Resize(size_t count) {
+    size_t oldCount = GetCount();
+    
+    mPosX.resize(count);
+    mPosY.resize(count);
+    mVelX.resize(count);
+    mVelY.resize(count);
+    mRotation.resize(count);
+    mSpin.resize(count);
+    mFuel.resize(count);
+    mThrustLevel.resize(count);
+    mRcsCommand.resize(count);
+    mState.resize(count);
+    mTouchdownVelX.resize(count);
+    mTouchdownVelY.resize(count);
+    mContactHit.resize(count);
+    mContactPad.resize(count);
+    mContactHeight.resize(count);
+    mEffectiveThrust.resize(count);
+    
+    for (size_t i = oldCount; i < count; ++i) {
+        ResetLander(i);
+    }
+}
+
+void LanderBatch::Reset() {
+    for (size_t i = 0; i < GetCount(); ++i) {
+        ResetLander(i);
+    }
+}
+
+void LanderBatch::ResetLander(size_t index) {
+    mPosX[index] = mSpawnX;
+    mPosY[index] = mSpawnY;
+    mVelX[index] = mSpawnVelX;
+    mVelY[index] = mSpawnVelY;
+    mRotation[index] = 0.0f;
+    mSpin[index] = 0.0f;
+    mFuel[index] = mSpawnFuel >= 0.0f ? std::min(mSpawnFuel, mMaxFuel) : mMaxFuel;
+    mThrustLevel[index] = 0.0f;
+    mRcsCommand[index] = 0.0f;
+    mState[index] = BATCH_FLYING;
+    mTouchdownVelX[index] = 0.0f;
+    mTouchdownVelY[index] = 0.0f;
+}
+
+void LanderBatch::SetInitialState(size_t index, float x, float y, float velX, float velY) {
+    ResetLander(index);
+    mPosX[index] = x;
+    mPosY[index] = y;
+    mVelX[index] = velX;
+    mVelY[index] = velY;
+}
+
+void LanderBatch::GetLander(size_t index, LanderBatchLander& lander) const {
+    lander.x = mPosX[index];
+    lander.y = mPosY[index];
+    lander.velX = mVelX[index];
+    lander.velY = mVelY[index];
+    lander.rotation = mRotation[index];
+    lander.spin = mSpin[index];
+    lander.fuel = mFuel[index];
+    lander.thrustLevel = mThrustLevel[index];
+    lander.state = mState[index];
+}
+
+void LanderBatch::SetLander(size_t index, const LanderBatchLander& lander) {
+    mPosX[index] = lander.x;
+    mPosY[index] = lander.y;
+    mVelX[index] = lander.velX;
+    mVelY[index] = lander.velY;
+    mRotation[index] = lander.rotation;
+    mSpin[index] = lander.spin;
+    mFuel[index] = lander.fuel;
+    mThrustLevel[index] = lander.thrustLevel;
+    mState[index] = lander.state;
+}
+
+void LanderBatch::SetTerrain(const Terrain* terrain) {
+    mTerrain = LanderBatchTerrain::Build(terrain);
+}
+
+void LanderBatch::SetLanderSize(Pixels width, Pixels height) {
+    mLanderWidth = Units::ToMeters(width).Value();
+    mLanderHeight = Units::ToMeters(height).Value();
+    UpdateRcsAngularAccel();
+}
+
+void LanderBatch::SetMaxFuel(float maxFuel) {
+    mMaxFuel = maxFuel;
+    UpdateRcsAngularAccel();
+}
+
+void LanderBatch::UpdateRcsAngularAccel() {
+    // A lander's dry 1000 kg (Lander's default) with a full tank; the
+    // batch has no depth, which the inertia about z doesn't need
+    const float halfExtents[3] = { mLanderWidth / 2, mLanderHeight / 2, mLanderWidth / 2 };
+    MassProperties mass;
+    mass.Configure(1000.0f, halfExtents);
+    mass.SetFuel(mMaxFuel);
+    const float inertia = mass.GetInertia()[2];
+    mRcsAngularAccel = inertia > 0.0f ?
+        RcsThrusters::GetCoupleTorque(mLanderWidth / 2) / inertia * (180.0f / 3.14159265358979323846f) : 0.0f;
+}
+
+void LanderBatch::ApplyThrust(size_t index, float amount) {
+    if (mFuel[index] <= 0) {
+        mThrustLevel[index] = 0.0f;
+        return;
+    }
+    
+    mThrustLevel[index] = std::max(0.0f, std::min(1.0f, amount));
+}
+
+void LanderBatch::FireRcs(size_t index, float command) {
+    // Positive is counter-clockwise
+    if (mFuel[index] <= 0) {
+        mRcsCommand[index] = 0.0f;
+        return;
+    }
+    
+    mRcsCommand[index] = std::max(-1.0f, std::min(1.0f, command));
+}
+
+void LanderBatch::ApplyController(BatchController& controller, float deltaTime) {
+    const size_t count = GetCount();
+    mAltitude.resize(count);
+    mCommandThrust.resize(count);
+    mCommandRotation.resize(count);
+    
+    // Landers the controller skips keep their current thrust and heading
+    for (size_t i = 0; i < count; ++i) {
+        mAltitude[i] = mState[i] == BATCH_FLYING ? mPosY[i] - mLanderHeight / 2 - SurfaceHeight(mPosX[i]) : 0.0f;
+        mCommandThrust[i] = mThrustLevel[i];
+        mCommandRotation[i] = 0.0f;
+    }
+    
+    LanderStateArrays states;
+    states.posX = mPosX.data();
+    states.posY = mPosY.data();
+    states.velX = mVelX.data();
+    states.velY = mVelY.data();
+    states.rotation = mRotation.data();
+    states.altitude = mAltitude.data();
+    states.fuel = mFuel.data();
+    states.state = mState.data();
+    states.maxFuel = mMaxFuel;
+    states.gravity = mGravity;
+    states.maxThrustAccel = 2.5f * mGravity;   // As in Integrate
+    states.deltaTime = deltaTime;
+    
+    ControlCommandArrays commands;
+    commands.thrust = mCommandThrust.data();
+    commands.rotation = mCommandRotation.data();
+    
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(count, kLandersPerJob, [&](size_t begin, size_t end) {
+            controller.Compute(states, begin, end, commands);
+        });
+    } else {
+        controller.Compute(states, 0, count, commands);
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        if (mState[i] == BATCH_FLYING) {
+            ApplyThrust(i, mCommandThrust[i]);
+            FireRcs(i, RcsThrusters::CommandForTurn(mCommandRotation[i], mSpin[i], mRcsAngularAccel, deltaTime));
+        }
+    }
+}
+
+float LanderBatch::SurfaceHeight(float x) const {
+    if (!mTerrain || mTerrain->x1.empty()) {
+        return 0.0f;
+    }
+    const LanderBatchTerrain& terrain = *mTerrain;
+    
+    // Last segment starting at or before x (segments are sorted by x)
+    float screenX = x * Units::kPixelsPerMeter;
+    size_t segment = std::upper_bound(terrain.x1.begin(), terrain.x1.end(), screenX) - terrain.x1.begin();
+    segment = segment > 0 ? segment - 1 : 0;
+    
+    float width = terrain.x2[segment] - terrain.x1[segment];
+    float t = width > 0.0f ? (screenX - terrain.x1[segment]) / width : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    float screenY = terrain.y1[segment] + t * (terrain.y2[segment] - terrain.y1[segment]);
+    return (terrain.height - screenY) * Units::kMetersPerPixel;
+}
+
+void LanderBatch::Step(float deltaTime) {
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(GetCount(), kLandersPerJob, [this, deltaTime](size_t begin, size_t end) {
+            StepRange(deltaTime, begin, end);
+        });
+    } else {
+        StepRange(deltaTime, 0, GetCount());
+    }
+}
+
+void LanderBatch::StepRange(float deltaTime, size_t begin, size_t end) {
+    // Fuel burn only depends on the thrust held during the step, so it can
+    // run before collisions and still cover landers that touch down now.
+    // The turn follows the push, which used the step's starting attitude.
+    Integrate(deltaTime, begin, end);
+    IntegrateAttitude(deltaTime, begin, end);
+    ConsumeFuel(deltaTime, begin, end);
+    ResolveCollisions(begin, end);
+}
+
+void LanderBatch::SetUseSimd(bool useSimd) {
+    mUseSimd = useSimd && LanderKernels::HasSimd();
+}
+
+size_t LanderBatch::CountInState(LanderBatchState state) const {
+    return static_cast<size_t>(std::count(mState.begin(), mState.end(), static_cast<uint8_t>(state)));
+}
+
+size_t LanderBatch::GetMemoryUsage() const {
+    return sizeof(*this) + VectorBytes(mPosX) + VectorBytes(mPosY) + VectorBytes(mVelX) + VectorBytes(mVelY) +
+           VectorBytes(mRotation) + VectorBytes(mSpin) + VectorBytes(mFuel) + VectorBytes(mThrustLevel) +
+           VectorBytes(mRcsCommand) + VectorBytes(mState) +
+           VectorBytes(mTouchdownVelX) + VectorBytes(mTouchdownVelY) + VectorBytes(mContactHit) +
+           VectorBytes(mContactPad) + VectorBytes(mContactHeight) + VectorBytes(mAltitude) +
+           VectorBytes(mEffectiveThrust) + VectorBytes(mCommandThrust) + VectorBytes(mCommandRotation);
+}
+
+void LanderBatch::Integrate(float deltaTime, size_t begin, size_t end) {
+    // Thrust acceleration at full throttle: maxThrust / mass = 2.5 g, and
+    // the build's integrator, as in Physics::Update2D
+    LanderIntegrateParams params;
+    params.deltaTime = deltaTime;
+    params.gravity = mGravity;
+    params.maxThrustAccel = 2.5f * mGravity;
+    
+    // The plume's ground gain scales each engine's throttle before the
+    // kernels, which stay as they are: one surface lookup and one table
+    // fetch per burning lander
+    const float* thrustLevel = mThrustLevel.data();
+    if (mPlumeTable) {
+        for (size_t i = begin; i < end; ++i) {
+            mEffectiveThrust[i] = mThrustLevel[i];
+            if (mState[i] != BATCH_FLYING || mThrustLevel[i] <= 0.0f) {
+                continue;
+            }
+            float sinRotation, cosRotation;
+            LanderKernels::SinCosDegrees(mRotation[i], sinRotation, cosRotation);
+            float altitude = mPosY[i] - mLanderHeight / 2 - SurfaceHeight(mPosX[i]);
+            mEffectiveThrust[i] *= 1.0f + mPlumeTable->SampleGroundGain(altitude, cosRotation);
+        }
+        thrustLevel = mEffectiveThrust.data();
+    }
+    
+    if (mUseSimd) {
+        LanderKernels::Integrate2DSimd<LanderIntegrator>(params, begin, end, mPosX.data(), mPosY.data(),
+                                                         mVelX.data(), mVelY.data(), mRotation.data(),
+                                                         thrustLevel, mState.data());
+    } else {
+        LanderKernels::Integrate2DScalar<LanderIntegrator>(params, begin, end, mPosX.data(), mPosY.data(),
+                                                           mVelX.data(), mVelY.data(), mRotation.data(),
+                                                           thrustLevel, mState.data());
+    }
+}
+
+void LanderBatch::IntegrateAttitude(float deltaTime, size_t begin, size_t end) {
+    LanderAttitudeParams params;
+    params.deltaTime = deltaTime;
+    params.angularAccel = mRcsAngularAccel;
+    
+    if (mUseSimd) {
+        LanderKernels::IntegrateAttitudeSimd(params, begin, end, mRotation.data(), mSpin.data(),
+                                             mRcsCommand.data(), mState.data());
+    } else {
+        LanderKernels::IntegrateAttitudeScalar(params, begin, end, mRotation.data(), mSpin.data(),
+                                               mRcsCommand.data(), mState.data());
+    }
+}
+
+void LanderBatch::ResolveCollisions(size_t begin, size_t end) {
+    static const LanderBatchTerrain kNoTerrain = {};
+    const LanderBatchTerrain& terrain = mTerrain ? *mTerrain : kNoTerrain;
+    LanderSegmentTable segments;
+    segments.x1 = terrain.x1.data();
+    segments.y1 = terrain.y1.data();
+    segments.x2 = terrain.x2.data();
+    segments.y2 = terrain.y2.data();
+    segments.landingPad = terrain.landingPad.data();
+    segments.count = terrain.x1.size();
+    segments.terrainHeight = terrain.height;
+    
+    LanderContactOutput contacts;
+    contacts.hit = mContactHit.data();
+    contacts.onPad = mContactPad.data();
+    contacts.collisionHeight = mContactHeight.data();
+    
+    // Find terrain contact for the whole batch
+    if (mUseSimd) {
+        LanderKernels::Collide2DSimd(segments, begin, end, mPosX.data(), mPosY.data(),
+                                     mLanderHeight / 2, contacts);
+    } else {
+        LanderKernels::Collide2DScalar(segments, begin, end, mPosX.data(), mPosY.data(),
+                                       mLanderHeight / 2, contacts);
+    }
+    
+    // Settle the (few) landers that touched down this step
+    const float safeVerticalVelocity = 2.0f;   // m/s
+    const float safeHorizontalVelocity = 1.0f; // m/s
+    for (size_t i = begin; i < end; ++i) {
+        if (mState[i] != BATCH_FLYING || !mContactHit[i]) {
+            continue;
+        }
+        
+        // Rest on the surface
+        mPosY[i] = mContactHeight[i] + mLanderHeight / 2;
+        
+        // Safe on any pad segment under the lander (Terrain::IsValidLanding2D)
+        bool safe = std::abs(mVelY[i]) <= safeVerticalVelocity &&
+                    std::abs(mVelX[i]) <= safeHorizontalVelocity;
+        
+        mState[i] = (mContactPad[i] && safe) ? BATCH_LANDED : BATCH_CRASHED;
+        mTouchdownVelX[i] = mVelX[i];
+        mTouchdownVelY[i] = mVelY[i];
+        mVelX[i] = 0.0f;
+        mVelY[i] = 0.0f;
+        mSpin[i] = 0.0f;
+    }
+}
+
+void LanderBatch::ConsumeFuel(float deltaTime, size_t begin, size_t end) {
+    float* fuel = mFuel.data();
+    float* thrustLevel = mThrustLevel.data();
+    float* rcsCommand = mRcsCommand.data();
+    const uint8_t* state = mState.data();
+    
+    // The active couple's pair both burn at |command| (RcsThrusters)
+    const float rcsFuelRate = RcsThrusters::GetCoupleFuelRate();
+    
+    for (size_t i = begin; i < end; ++i) {
+        if (state[i] == BATCH_FLYING && (thrustLevel[i] > 0.0f || rcsCommand[i] != 0.0f) && fuel[i] > 0) {
+            // Fuel consumption is proportional to thrust level
+            float remaining = fuel[i] - mFuelConsumptionRate * thrustLevel[i] * deltaTime -
+                              rcsFuelRate * std::abs(rcsCommand[i]) * deltaTime;
+            fuel[i] = std::max(0.0f, remaining);
+            if (fuel[i] <= 0) {
+                thrustLevel[i] = 0.0f;
+                rcsCommand[i] = 0.0f;
+            }
+        }
+    }
+}
@@ -0,0 +1,235 @@
+// LanderBatch.h
+// Structure-of-arrays store for simulating many independent 2D landers
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Units.h"
+
+// Forward declarations
+class Terrain;
+class JobSystem;
+class BatchController;
+class PlumeTable;
+
+// Per-lander flight state
+enum LanderBatchState : uint8_t {
+    BATCH_FLYING  = 0,
+    BATCH_LANDED  = 1,
+    BATCH_CRASHED = 2
+};
+
+// One lander's whole state, for copying landers in and out of a batch
+struct LanderBatchLander {
+    float x, y;               // Meters
+    float velX, velY;         // m/s
+    float rotation;           // Degrees, [0, 360)
+    float spin;               // deg/s, counter-clockwise
+    float fuel;               // kg
+    float thrustLevel;        // 0-1
+    uint8_t state;            // LanderBatchState
+};
+
+// A 2D terrain's segments as LanderBatch collides against them. Never
+// changed once built, so any number of batches (and sessions) can share
+// one; a batch that needs different terrain takes a new table rather than
+// editing the shared one.
+struct LanderBatchTerrain {
+    std::vector<float> x1, y1, x2, y2;    // Screen pixels, sorted by x1
+    std::vector<uint8_t> landingPad;
+    float height;                         // Terrain height in pixels (screen-space flip)
+    
+    // Copy terrain's segments (null: no terrain)
+    static std::shared_ptr<const LanderBatchTerrain> Build(const Terrain* terrain);
+    
+    // Heap bytes held by the table
+    size_t GetMemoryUsage() const;
+};
+
+// Steps N landers against one 2D terrain. Each step matches
+// Physics::Update2D + Physics::CheckCollisions2D + Lander::Update for a
+// single lander, but keeps every field in its own contiguous array so the
+// integrator runs as straight loops over the batch. Thrust direction uses
+// the polynomial sin/cos in LanderKernels rather than libm.
+class LanderBatch {
+public:
+    LanderBatch();
+    ~LanderBatch() = default;
+    
+    // Resize the batch; new landers start at the spawn point
+    void Resize(size_t count);
+    size_t GetCount() const { return mPosX.size(); }
+    
+    // Put every lander back at the spawn point with its spawn velocity and
+    // fuel
+    void Reset();
+    void ResetLander(size_t index);
+    
+    // Start one lander flying from its own position and velocity (meters,
+    // m/s) instead of the spawn point, upright with the spawn fuel
+    void SetInitialState(size_t index, float x, float y, float velX, float velY);
+    
+    // Read or overwrite one lander (touchdown velocities are kept)
+    void GetLander(size_t index, LanderBatchLander& lander) const;
+    void SetLander(size_t index, const LanderBatchLander& lander);
+    
+    // Cache the terrain's 2D segments; call again after regenerating it
+    void SetTerrain(const Terrain* terrain);
+    
+    // Collide against a segment table shared with other batches
+    void SetTerrain(std::shared_ptr<const LanderBatchTerrain> terrain) { mTerrain = std::move(terrain); }
+    const std::shared_ptr<const LanderBatchTerrain>& GetTerrain() const { return mTerrain; }
+    
+    // Shared physical parameters (defaults match Lander and Physics)
+    void SetGravity(float gravity) { mGravity = gravity; }
+    float GetGravity() const { return mGravity; }
+    void SetSpawnPosition(float x, float y) { mSpawnX = x; mSpawnY = y; }
+    void SetSpawnVelocity(float velX, float velY) { mSpawnVelX = velX; mSpawnVelY = velY; }
+    void SetSpawnFuel(float fuel) { mSpawnFuel = fuel; }    // kg, at most the max fuel; negative for a full tank
+    void SetLanderSize(Pixels width, Pixels height);
+    void SetMaxFuel(float maxFuel);
+    float GetMaxFuel() const { return mMaxFuel; }
+    void SetFuelConsumptionRate(float rate) { mFuelConsumptionRate = rate; }
+    float GetFuelConsumptionRate() const { return mFuelConsumptionRate; }
+    
+    // Angular acceleration of a full RCS command (deg/s²)
+    float GetRcsAngularAccel() const { return mRcsAngularAccel; }
+    
+    // Plume ground effect: near the surface each engine's thrust grows by
+    // the table's ground gain for its altitude and tilt. Off (null) by
+    // default, which keeps the batch step identical to Physics::Update2D.
+    // The table is only read, so batches may share one.
+    void SetPlumeTable(std::shared_ptr<const PlumeTable> table) { mPlumeTable = std::move(table); }
+    bool HasPlumeTable() const { return mPlumeTable != nullptr; }
+    
+    // Controls, equivalent to Lander::ApplyThrust / FireRcs. The RCS turns
+    // every lander with the angular acceleration of a full tank (as the
+    // engine pushes with a fixed 2.5 g), so fuel only limits how long.
+    void ApplyThrust(size_t index, float amount);
+    void FireRcs(size_t index, float command);
+    
+    // Let a controller set thrust and rotation for every flying lander in
+    // one call (split across the job system when there is one), ahead of
+    // the Step of deltaTime seconds it is for
+    void ApplyController(BatchController& controller, float deltaTime);
+    
+    // Advance every flying lander by deltaTime seconds
+    void Step(float deltaTime);
+    
+    // Use the SSE2/NEON kernels (default when available) or the scalar ones;
+    // both give bitwise identical results
+    void SetUseSimd(bool useSimd);
+    bool IsUsingSimd() const { return mUseSimd; }
+    
+    // Split Step() across a worker pool (null steps on the calling thread)
+    void SetJobSystem(JobSystem* jobSystem) { mJobSystem = jobSystem; }
+    
+    // Count landers in a given state
+    size_t CountInState(LanderBatchState state) const;
+    
+    // Bytes this batch holds, not counting its (shared) terrain
+    size_t GetMemoryUsage() const;
+    
+    // Surface height in meters under x meters (the end segments continue
+    // past the terrain's edges)
+    float SurfaceHeight(float x) const;
+    
+    // Lander body size in meters
+    float GetLanderWidth() const { return mLanderWidth; }
+    float GetLanderHeight() const { return mLanderHeight; }
+    
+    // Array accessors (meters, m/s, degrees, kg)
+    const float* GetPositionX() const { return mPosX.data(); }
+    const float* GetPositionY() const { return mPosY.data(); }
+    const float* GetVelocityX() const { return mVelX.data(); }
+    const float* GetVelocityY() const { return mVelY.data(); }
+    const float* GetRotation() const { return mRotation.data(); }
+    const float* GetSpin() const { return mSpin.data(); }
+    const float* GetFuel() const { return mFuel.data(); }
+    const float* GetThrustLevel() const { return mThrustLevel.data(); }
+    const float* GetRcsCommand() const { return mRcsCommand.data(); }
+    const uint8_t* GetState() const { return mState.data(); }
+    
+    // Velocity on the step a lander came down (m/s); zero while flying
+    const float* GetTouchdownVelocityX() const { return mTouchdownVelX.data(); }
+    const float* GetTouchdownVelocityY() const { return mTouchdownVelY.data(); }
+
+private:
+    // Landers handed to each job by Step()
+    static constexpr size_t kLandersPerJob = 4096;
+    
+    // Full step for landers [begin, end); landers are independent
+    void StepRange(float deltaTime, size_t begin, size_t end);
+    
+    // Integrate gravity, thrust and position (Physics::Update2D)
+    void Integrate(float deltaTime, size_t begin, size_t end);
+    
+    // Spin up and turn on the RCS (Physics::Update2D)
+    void IntegrateAttitude(float deltaTime, size_t begin, size_t end);
+    
+    // Resolve terrain contact (Physics::CheckCollisions2D)
+    void ResolveCollisions(size_t begin, size_t end);
+    
+    // Burn fuel for the step (Lander::Update)
+    void ConsumeFuel(float deltaTime, size_t begin, size_t end);
+    
+    // Angular acceleration of a full RCS command for the lander's size
+    // and mMaxFuel
+    void UpdateRcsAngularAccel();
+    
+    // Lander state, one entry per lander
+    std::vector<float> mPosX;
+    std::vector<float> mPosY;
+    std::vector<float> mVelX;
+    std::vector<float> mVelY;
+    std::vector<float> mRotation;     // Degrees, [0, 360)
+    std::vector<float> mSpin;         // deg/s
+    std::vector<float> mFuel;
+    std::vector<float> mThrustLevel;  // 0-1, zero when thrust is off
+    std::vector<float> mRcsCommand;   // -1 to 1, zero when the RCS is off
+    std::vector<uint8_t> mState;      // LanderBatchState
+    std::vector<float> mTouchdownVelX;
+    std::vector<float> mTouchdownVelY;
+    
+    // Collision kernel output, one entry per lander
+    std::vector<uint8_t> mContactHit;
+    std::vector<uint8_t> mContactPad;
+    std::vector<float> mContactHeight;
+    
+    // Thrust with the ground effect added, one entry per lander (only
+    // with a plume table)
+    std::vector<float> mEffectiveThrust;
+    
+    // Controller inputs and commands, one entry per lander
+    std::vector<float> mAltitude;
+    std::vector<float> mCommandThrust;
+    std::vector<float> mCommandRotation;
+    
+    // Terrain segments (null = flat ground at zero)
+    std::shared_ptr<const LanderBatchTerrain> mTerrain;
+    
+    // Plume ground effect (null = none)
+    std::shared_ptr<const PlumeTable> mPlumeTable;
+    
+    // Shared parameters
+    float mGravity;
+    float mSpawnX;
+    float mSpawnY;
+    float mSpawnVelX;        // m/s (default at rest)
+    float mSpawnVelY;
+    float mSpawnFuel;        // kg; negative for a full tank (default)
+    float mLanderWidth;      // Meters
+    float mLanderHeight;     // Meters
+    float mMaxFuel;
+    float mFuelConsumptionRate;
+    float mRcsAngularAccel;  // deg/s² at a full RCS command
+    
+    // Kernel selection
+    bool mUseSimd;
+    
+    // Worker pool (not owned, may be null)
+    JobSystem* mJobSystem;
+};
@@ -0,0 +1,283 @@
+// LanderBatchGpu.cpp
+// Shared buffers, the pipeline and the dispatch for the GPU lander batch
+
+#include "LanderBatchGpu.h"
+#include "Integrators.h"
+#include "Log.h"
+#include "RcsThrusters.h"
+#include "Units.h"
+#include <algorithm>
+#include <cstring>
+
+// metal-cpp's implementation lives here for the tools that link
+// lander_gpu; the game's renderer has its own copy and never links this
+#define NS_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+
+// Matches LanderBatchGpuParams in LanderBatchCompute.metal
+struct LanderBatchGpuParams {
+    float deltaTime;
+    float gravity;
+    float maxThrustAccel;
+    float angularAccel;
+    float landerHalfHeight;
+    float fuelConsumptionRate;
+    float rcsFuelRate;
+    float terrainHeight;
+    float pixelsPerMeter;
+    float metersPerPixel;
+    uint32_t segmentCount;
+    uint32_t landerCount;
+    uint32_t stepCount;
+    uint32_t firstStep;
+    uint32_t useController;
+};
+
+LanderBatchGpu::LanderBatchGpu()
+    : mDevice(nullptr)
+    , mQueue(nullptr)
+    , mPipeline(nullptr)
+    , mCount(0)
+    , mSegmentCount(0)
+    , mGravity(0.0f)
+    , mMaxThrustAccel(0.0f)
+    , mAngularAccel(0.0f)
+    , mLanderHalfHeight(0.0f)
+    , mFuelConsumptionRate(0.0f)
+    , mTerrainHeight(0.0f)
+    , mUseController(false)
+    , mStepCount(0) {
+    std::fill(mBuffers, mBuffers + kSlotCount, nullptr);
+}
+
+LanderBatchGpu::~LanderBatchGpu() {
+    ReleaseBuffers();
+    if (mPipeline) mPipeline->release();
+    if (mQueue) mQueue->release();
+    if (mDevice) mDevice->release();
+}
+
+bool LanderBatchGpu::Initialize(const char* libraryPath) {
+    mDevice = MTL::CreateSystemDefaultDevice();
+    if (!mDevice) {
+        LOG_ERROR("No Metal device for the GPU lander batch");
+        return false;
+    }
+    mQueue = mDevice->newCommandQueue();
+    
+    NS::Error* error = nullptr;
+    MTL::Library* library = mDevice->newLibrary(NS::String::string(libraryPath, NS::UTF8StringEncoding), &error);
+    if (!library) {
+        LOG_ERROR("Failed to load %s: %s", libraryPath,
+                  error ? error->localizedDescription()->utf8String() : "unknown error");
+        return false;
+    }
+    
+    // The build's integrator, as LanderKernels takes LanderIntegrator
+    const int integrator = LANDER_INTEGRATOR;
+    MTL::FunctionConstantValues* constants = MTL::FunctionConstantValues::alloc()->init();
+    constants->setConstantValue(&integrator, MTL::DataTypeInt, NS::UInteger(0));
+    MTL::Function* function = library->newFunction(NS::String::string("lander_batch_step", NS::UTF8StringEncoding),
+                                                   constants, &error);
+    constants->release();
+    library->release();
+    if (!function) {
+        LOG_ERROR("No lander_batch_step kernel: %s",
+                  error ? error->localizedDescription()->utf8String() : "unknown error");
+        return false;
+    }
+    
+    mPipeline = mDevice->newComputePipelineState(function, &error);
+    function->release();
+    if (!mPipeline) {
+        LOG_ERROR("Failed to build the GPU lander batch pipeline: %s",
+                  error ? error->localizedDescription()->utf8String() : "unknown error");
+        return false;
+    }
+    return true;
+}
+
+MTL::Buffer* LanderBatchGpu::NewBuffer(const void* data, size_t bytes) {
+    // Metal has no empty buffers; a lone float stands in for a table with
+    // no entries (the kernel never reads it)
+    const size_t size = std::max<size_t>(bytes, sizeof(float));
+    MTL::Buffer* buffer = mDevice->newBuffer(size, MTL::ResourceStorageModeShared);
+    if (buffer) {
+        std::memset(buffer->contents(), 0, size);
+        if (data && bytes > 0) {
+            std::memcpy(buffer->contents(), data, bytes);
+        }
+    }
+    return buffer;
+}
+
+void LanderBatchGpu::ReleaseBuffers() {
+    for (MTL::Buffer*& buffer : mBuffers) {
+        if (buffer) {
+            buffer->release();
+            buffer = nullptr;
+        }
+    }
+}
+
+bool LanderBatchGpu::Upload(const LanderBatch& batch) {
+    if (!mPipeline) {
+        LOG_ERROR("GPU lander batch used before Initialize");
+        return false;
+    }
+    if (batch.HasPlumeTable()) {
+        LOG_ERROR("The GPU lander batch has no plume ground effect");
+        return false;
+    }
+    ReleaseBuffers();
+    
+    mCount = batch.GetCount();
+    const size_t floats = mCount * sizeof(float);
+    mBuffers[kSlotPositionX] = NewBuffer(batch.GetPositionX(), floats);
+    mBuffers[kSlotPositionY] = NewBuffer(batch.GetPositionY(), floats);
+    mBuffers[kSlotVelocityX] = NewBuffer(batch.GetVelocityX(), floats);
+    mBuffers[kSlotVelocityY] = NewBuffer(batch.GetVelocityY(), floats);
+    mBuffers[kSlotRotation] = NewBuffer(batch.GetRotation(), floats);
+    mBuffers[kSlotSpin] = NewBuffer(batch.GetSpin(), floats);
+    mBuffers[kSlotFuel] = NewBuffer(batch.GetFuel(), floats);
+    mBuffers[kSlotThrustLevel] = NewBuffer(batch.GetThrustLevel(), floats);
+    mBuffers[kSlotRcsCommand] = NewBuffer(batch.GetRcsCommand(), floats);
+    mBuffers[kSlotState] = NewBuffer(batch.GetState(), mCount * sizeof(uint8_t));
+    mBuffers[kSlotTouchdownVelocityX] = NewBuffer(batch.GetTouchdownVelocityX(), floats);
+    mBuffers[kSlotTouchdownVelocityY] = NewBuffer(batch.GetTouchdownVelocityY(), floats);
+    mBuffers[kSlotEndStep] = NewBuffer(nullptr, mCount * sizeof(uint32_t));
+    mBuffers[kSlotGains] = NewBuffer(nullptr, sizeof(DescentControllerGains));
+    
+    // No terrain collides as an empty table, as LanderBatch does
+    static const LanderBatchTerrain kNoTerrain = {};
+    const LanderBatchTerrain& terrain = batch.GetTerrain() ? *batch.GetTerrain() : kNoTerrain;
+    mSegmentCount = terrain.x1.size();
+    mBuffers[kSlotSegmentX1] = NewBuffer(terrain.x1.data(), mSegmentCount * sizeof(float));
+    mBuffers[kSlotSegmentY1] = NewBuffer(terrain.y1.data(), mSegmentCount * sizeof(float));
+    mBuffers[kSlotSegmentX2] = NewBuffer(terrain.x2.data(), mSegmentCount * sizeof(float));
+    mBuffers[kSlotSegmentY2] = NewBuffer(terrain.y2.data(), mSegmentCount * sizeof(float));
+    mBuffers[kSlotSegmentPad] = NewBuffer(terrain.landingPad.data(), mSegmentCount * sizeof(uint8_t));
+    mTerrainHeight = terrain.height;
+    
+    for (int slot = 1; slot < kSlotCount; slot++) {
+        if (!mBuffers[slot]) {
+            LOG_ERROR("Failed to allocate the GPU lander batch's buffers (%zu landers)", mCount);
+            ReleaseBuffers();
+            mCount = 0;
+            return false;
+        }
+    }
+    
+    // LanderBatch's engine pushes with a fixed 2.5 g (LanderBatch::Integrate)
+    mGravity = batch.GetGravity();
+    mMaxThrustAccel = 2.5f * mGravity;
+    mAngularAccel = batch.GetRcsAngularAccel();
+    mLanderHalfHeight = batch.GetLanderHeight() / 2;
+    mFuelConsumptionRate = batch.GetFuelConsumptionRate();
+    mUseController = false;
+    mStepCount = 0;
+    return true;
+}
+
+bool LanderBatchGpu::SetLanderGains(const std::vector<DescentControllerGains>& gains) {
+    if (gains.size() != mCount || mCount == 0) {
+        LOG_ERROR("%zu autopilot gains for %zu GPU landers", gains.size(), mCount);
+        return false;
+    }
+    MTL::Buffer* buffer = NewBuffer(gains.data(), gains.size() * sizeof(DescentControllerGains));
+    if (!buffer) {
+        LOG_ERROR("Failed to allocate the GPU lander batch's gains");
+        return false;
+    }
+    mBuffers[kSlotGains]->release();
+    mBuffers[kSlotGains] = buffer;
+    mUseController = true;
+    return true;
+}
+
+bool LanderBatchGpu::Step(float deltaTime, int stepCount) {
+    if (mCount == 0 || stepCount <= 0) {
+        return true;
+    }
+    
+    LanderBatchGpuParams params;
+    params.deltaTime = deltaTime;
+    params.gravity = mGravity;
+    params.maxThrustAccel = mMaxThrustAccel;
+    params.angularAccel = mAngularAccel;
+    params.landerHalfHeight = mLanderHalfHeight;
+    params.fuelConsumptionRate = mFuelConsumptionRate;
+    params.rcsFuelRate = RcsThrusters::GetCoupleFuelRate();
+    params.terrainHeight = mTerrainHeight;
+    params.pixelsPerMeter = Units::kPixelsPerMeter;
+    params.metersPerPixel = Units::kMetersPerPixel;
+    params.segmentCount = static_cast<uint32_t>(mSegmentCount);
+    params.landerCount = static_cast<uint32_t>(mCount);
+    params.stepCount = static_cast<uint32_t>(stepCount);
+    params.firstStep = mStepCount;
+    params.useController = mUseController ? 1 : 0;
+    
+    // Every step of the stretch runs inside one thread per lander, so the
+    // whole stretch is a single dispatch
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    MTL::CommandBuffer* commands = mQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* compute = commands->computeCommandEncoder();
+    compute->setComputePipelineState(mPipeline);
+    compute->setBytes(&params, sizeof(params), 0);
+    for (int slot = 1; slot < kSlotCount; slot++) {
+        compute->setBuffer(mBuffers[slot], 0, slot);
+    }
+    compute->dispatchThreads(MTL::Size(mCount, 1, 1), MTL::Size(mPipeline->threadExecutionWidth(), 1, 1));
+    compute->endEncoding();
+    commands->commit();
+    commands->waitUntilCompleted();
+    
+    const bool completed = commands->status() == MTL::CommandBufferStatusCompleted;
+    if (!completed) {
+        NS::Error* error = commands->error();
+        LOG_ERROR("GPU lander batch step failed: %s",
+                  error ? error->localizedDescription()->utf8String() : "unknown error");
+    }
+    pool->release();
+    
+    mStepCount += static_cast<uint32_t>(stepCount);
+    return completed;
+}
+
+size_t LanderBatchGpu::CountInState(LanderBatchState state) const {
+    const uint8_t* states = GetState();
+    return states ? static_cast<size_t>(std::count(states, states + mCount, static_cast<uint8_t>(state))) : 0;
+}
+
+static const float* FloatContents(MTL::Buffer* buffer) {
+    return buffer ? static_cast<const float*>(buffer->contents()) : nullptr;
+}
+
+const float* LanderBatchGpu::GetPositionX() const { return FloatContents(mBuffers[kSlotPositionX]); }
+const float* LanderBatchGpu::GetPositionY() const { return FloatContents(mBuffers[kSlotPositionY]); }
+const float* LanderBatchGpu::GetVelocityX() const { return FloatContents(mBuffers[kSlotVelocityX]); }
+const float* LanderBatchGpu::GetVelocityY() const { return FloatContents(mBuffers[kSlotVelocityY]); }
+const float* LanderBatchGpu::GetRotation() const { return FloatContents(mBuffers[kSlotRotation]); }
+const float* LanderBatchGpu::GetFuel() const { return FloatContents(mBuffers[kSlotFuel]); }
+const float* LanderBatchGpu::GetTouchdownVelocityX() const { return FloatContents(mBuffers[kSlotTouchdownVelocityX]); }
+const float* LanderBatchGpu::GetTouchdownVelocityY() const { return FloatContents(mBuffers[kSlotTouchdownVelocityY]); }
+
+const uint8_t* LanderBatchGpu::GetState() const {
+    return mBuffers[kSlotState] ? static_cast<const uint8_t*>(mBuffers[kSlotState]->contents()) : nullptr;
+}
+
+const uint32_t* LanderBatchGpu::GetEndStep() const {
+    return mBuffers[kSlotEndStep] ? static_cast<const uint32_t*>(mBuffers[kSlotEndStep]->contents()) : nullptr;
+}
+
+size_t LanderBatchGpu::GetMemoryUsage() const {
+    size_t bytes = 0;
+    for (MTL::Buffer* buffer : mBuffers) {
+        if (buffer) {
+            bytes += buffer->length();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,129 @@
+// LanderBatchGpu.h
+// LanderBatch's 2D step and descent autopilot as a Metal compute kernel
+
+#pragma once
+
+#include "DescentController.h"
+#include "LanderBatch.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Forward declarations for Metal types (to avoid including Metal headers here)
+namespace MTL {
+    class Device;
+    class CommandQueue;
+    class ComputePipelineState;
+    class Buffer;
+}
+
+// A LanderBatch flown on the GPU by lander_batch_step
+// (LanderBatchCompute.metal), one thread per lander. Each Step() encodes
+// a number of whole batch steps, the autopilot's included, into one
+// dispatch in one command buffer, so the CPU only waits once per stretch
+// of steps. The state arrays are shared buffers: on Apple's unified
+// memory the accessors point straight at what the kernel wrote, with no
+// copy back.
+//
+// The kernel runs the same operations as the scalar kernels, but the GPU
+// compiler may fuse multiply-adds and the autopilot's cosine is Metal's,
+// so results agree with the CPU batch to float rounding, not bit for bit;
+// lander_sweep --gpu-check measures how closely. No plume ground effect
+// (LanderBatch::SetPlumeTable) and no job system: every lander of the
+// batch is one grid.
+//
+// Built into lander_gpu, which only Apple builds have; the headless core
+// stays free of Metal.
+class LanderBatchGpu {
+public:
+    LanderBatchGpu();
+    ~LanderBatchGpu();
+    
+    LanderBatchGpu(const LanderBatchGpu&) = delete;
+    LanderBatchGpu& operator=(const LanderBatchGpu&) = delete;
+    
+    // Open the default GPU and build the kernel from the metallib at
+    // libraryPath. False (logged) without a Metal device or the kernel.
+    bool Initialize(const char* libraryPath);
+    
+    // Take batch's landers, terrain and shared parameters; the GPU state
+    // starts as a copy of the batch's. False if the batch has a plume table
+    // or a buffer could not be allocated.
+    bool Upload(const LanderBatch& batch);
+    
+    // Fly the descent autopilot before every step, with one set of gains
+    // per lander (indexed like the batch), as LanderBatch::ApplyController
+    // does; without them the controls stay as they were uploaded
+    bool SetLanderGains(const std::vector<DescentControllerGains>& gains);
+    
+    // Advance every flying lander by stepCount steps of deltaTime seconds
+    // in one command buffer, and wait for it
+    bool Step(float deltaTime, int stepCount);
+    
+    size_t GetCount() const { return mCount; }
+    size_t CountInState(LanderBatchState state) const;
+    uint32_t GetStepCount() const { return mStepCount; }   // Steps taken since Upload
+    
+    // The GPU's state (meters, m/s, degrees, kg), read in place; valid
+    // between Step() calls
+    const float* GetPositionX() const;
+    const float* GetPositionY() const;
+    const float* GetVelocityX() const;
+    const float* GetVelocityY() const;
+    const float* GetRotation() const;
+    const float* GetFuel() const;
+    const uint8_t* GetState() const;
+    const float* GetTouchdownVelocityX() const;
+    const float* GetTouchdownVelocityY() const;
+    
+    // Step each lander stopped flying on, counted from 1 (0 = still flying)
+    const uint32_t* GetEndStep() const;
+    
+    // Bytes of the shared buffers
+    size_t GetMemoryUsage() const;
+
+private:
+    // Buffer slots, as bound to lander_batch_step
+    enum Slot {
+        kSlotPositionX = 1,
+        kSlotPositionY,
+        kSlotVelocityX,
+        kSlotVelocityY,
+        kSlotRotation,
+        kSlotSpin,
+        kSlotFuel,
+        kSlotThrustLevel,
+        kSlotRcsCommand,
+        kSlotState,
+        kSlotTouchdownVelocityX,
+        kSlotTouchdownVelocityY,
+        kSlotEndStep,
+        kSlotGains,
+        kSlotSegmentX1,
+        kSlotSegmentY1,
+        kSlotSegmentX2,
+        kSlotSegmentY2,
+        kSlotSegmentPad,
+        kSlotCount
+    };
+    
+    MTL::Buffer* NewBuffer(const void* data, size_t bytes);
+    void ReleaseBuffers();
+    
+    MTL::Device* mDevice;
+    MTL::CommandQueue* mQueue;
+    MTL::ComputePipelineState* mPipeline;
+    MTL::Buffer* mBuffers[kSlotCount];      // Slot 0 (the parameters) is set inline
+    
+    // Shared parameters taken from the batch
+    size_t mCount;
+    size_t mSegmentCount;
+    float mGravity;
+    float mMaxThrustAccel;
+    float mAngularAccel;
+    float mLanderHalfHeight;
+    float mFuelConsumptionRate;
+    float mTerrainHeight;
+    bool mUseController;
+    uint32_t mStepCount;
+};
@@ -0,0 +1,221 @@
+// LanderEnv.cpp
+// The training environment over LanderBatch and the job system
+
+#include "LanderEnv.h"
+#include "JobSystem.h"
+#include "LanderBatch.h"
+#include "Rules.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// Landers handed to each job for actions and observations
+static const size_t kLandersPerJob = 4096;
+
+// Start states, as lander_sweep's default grid covers them
+static const float kStartMinX = 10.0f, kStartMaxX = 30.0f;         // Meters
+static const float kStartMinY = 20.0f, kStartMaxY = 28.0f;
+static const float kStartMinVelX = -2.0f, kStartMaxVelX = 2.0f;    // m/s
+static const float kStartMinVelY = -4.0f, kStartMaxVelY = 0.0f;
+
+struct LanderEnv {
+    explicit LanderEnv(int threads)
+        : mJobSystem(threads)
+        , mSeed(1)
+        , mTimeStep(1.0f / 120.0f)
+        , mMaxSteps(120 * 120)
+        , mObservations(nullptr)
+        , mRewards(nullptr)
+        , mDones(nullptr) {}
+    
+    Terrain mTerrain;
+    LanderBatch mBatch;
+    JobSystem mJobSystem;
+    std::vector<float> mPadCenters;     // Meters, one per 2D pad
+    
+    // Per lander: steps since its reset, resets so far, flight over
+    std::vector<uint32_t> mSteps;
+    std::vector<uint32_t> mEpisodes;
+    std::vector<uint8_t> mDone;
+    
+    uint32_t mSeed;
+    float mTimeStep;
+    uint32_t mMaxSteps;
+    
+    // Caller's buffers (not owned)
+    float* mObservations;
+    float* mRewards;
+    float* mDones;
+};
+
+// Uniform in [0, 1) from a 32-bit hash of the seed, lander, episode and draw
+static float HashUnit(uint32_t seed, uint32_t lander, uint32_t episode, uint32_t draw) {
+    uint32_t h = seed * 0x9e3779b9u ^ lander * 0x85ebca6bu ^ episode * 0xc2b2ae35u ^ draw * 0x27d4eb2fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+}
+
+static float HashRange(uint32_t seed, uint32_t lander, uint32_t episode, uint32_t draw, float min, float max) {
+    return min + (max - min) * HashUnit(seed, lander, episode, draw);
+}
+
+static void WriteObservation(const LanderEnv& env, size_t i) {
+    const LanderBatch& batch = env.mBatch;
+    const float x = batch.GetPositionX()[i];
+    const float rotation = batch.GetRotation()[i] * (3.14159265358979323846f / 180.0f);
+    
+    float nearestPad = 0.0f;
+    float nearestDistance = -1.0f;
+    for (float center : env.mPadCenters) {
+        if (nearestDistance < 0.0f || std::fabs(center - x) < nearestDistance) {
+            nearestDistance = std::fabs(center - x);
+            nearestPad = center - x;
+        }
+    }
+    
+    float* observation = env.mObservations + i * LANDER_ENV_OBSERVATION_SIZE;
+    observation[0] = x;
+    observation[1] = batch.GetPositionY()[i] - batch.GetLanderHeight() / 2 - batch.SurfaceHeight(x);
+    observation[2] = batch.GetVelocityX()[i];
+    observation[3] = batch.GetVelocityY()[i];
+    observation[4] = std::sin(rotation);
+    observation[5] = std::cos(rotation);
+    observation[6] = batch.GetSpin()[i];
+    observation[7] = batch.GetMaxFuel() > 0.0f ? batch.GetFuel()[i] / batch.GetMaxFuel() : 0.0f;
+    observation[8] = nearestPad;
+}
+
+// Reward and done for a lander after a step; the reward is only paid on
+// the step the flight ends
+static void WriteOutcome(LanderEnv& env, size_t i) {
+    if (env.mDone[i]) {
+        env.mRewards[i] = 0.0f;
+        env.mDones[i] = 1.0f;
+        return;
+    }
+    
+    const uint8_t state = env.mBatch.GetState()[i];
+    float reward = 0.0f;
+    if (state == BATCH_LANDED) {
+        const LandingPad* pad = env.mTerrain.FindLandingPad2D(env.mBatch.GetPositionX()[i]);
+        reward = Rules::GetLandingScore(env.mBatch.GetFuel()[i], env.mBatch.GetMaxFuel(),
+                                        pad ? pad->difficulty : 1.0f) / 1000.0f;
+    } else if (state == BATCH_CRASHED) {
+        reward = -1.0f;
+    }
+    env.mDone[i] = state != BATCH_FLYING || env.mSteps[i] >= env.mMaxSteps;
+    env.mRewards[i] = reward;
+    env.mDones[i] = env.mDone[i] ? 1.0f : 0.0f;
+}
+
+LanderEnv* env_create(int count) {
+    return env_create_threaded(count, -1);
+}
+
+LanderEnv* env_create_threaded(int count, int threads) {
+    if (count < 1) {
+        return nullptr;
+    }
+    LanderEnv* env = new LanderEnv(threads);
+    
+    // The game's 2D terrain at its default window size, as lander_sweep
+    // flies on
+    env->mTerrain.SetSeed(1);
+    env->mTerrain.Generate2D(800, 600);
+    for (const LandingPad& pad : env->mTerrain.GetLandingPads2D()) {
+        env->mPadCenters.push_back(0.5f * (pad.minX + pad.maxX));
+    }
+    
+    env->mBatch.SetTerrain(&env->mTerrain);
+    env->mBatch.SetGravity(Rules::GetGravity(Difficulty::NORMAL));
+    env->mBatch.SetJobSystem(&env->mJobSystem);
+    env->mBatch.Resize(static_cast<size_t>(count));
+    env->mSteps.assign(count, 0);
+    env->mEpisodes.assign(count, 0);
+    env->mDone.assign(count, 1);
+    return env;
+}
+
+void env_destroy(LanderEnv* env) {
+    delete env;
+}
+
+int env_count(const LanderEnv* env) {
+    return env ? static_cast<int>(env->mBatch.GetCount()) : 0;
+}
+
+void env_seed(LanderEnv* env, uint32_t seed) {
+    env->mSeed = seed;
+}
+
+void env_set_timing(LanderEnv* env, float rate, float maxTime) {
+    rate = std::max(rate, 10.0f);
+    env->mTimeStep = 1.0f / rate;
+    env->mMaxSteps = static_cast<uint32_t>(std::ceil(std::max(maxTime, 0.1f) * rate));
+}
+
+void env_bind(LanderEnv* env, float* observations, float* rewards, float* dones) {
+    env->mObservations = observations;
+    env->mRewards = rewards;
+    env->mDones = dones;
+}
+
+int env_reset(LanderEnv* env, const uint8_t* mask) {
+    if (!env->mObservations || !env->mRewards || !env->mDones) {
+        return -1;
+    }
+    env->mJobSystem.ParallelFor(env->mBatch.GetCount(), kLandersPerJob, [env, mask](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (mask && !mask[i]) {
+                continue;
+            }
+            const uint32_t lander = static_cast<uint32_t>(i);
+            const uint32_t episode = env->mEpisodes[i]++;
+            env->mBatch.SetInitialState(i,
+                HashRange(env->mSeed, lander, episode, 0, kStartMinX, kStartMaxX),
+                HashRange(env->mSeed, lander, episode, 1, kStartMinY, kStartMaxY),
+                HashRange(env->mSeed, lander, episode, 2, kStartMinVelX, kStartMaxVelX),
+                HashRange(env->mSeed, lander, episode, 3, kStartMinVelY, kStartMaxVelY));
+            env->mSteps[i] = 0;
+            env->mDone[i] = 0;
+            env->mRewards[i] = 0.0f;
+            env->mDones[i] = 0.0f;
+            WriteObservation(*env, i);
+        }
+    });
+    return 0;
+}
+
+int env_step(LanderEnv* env, const float* actions) {
+    if (!env->mObservations || !env->mRewards || !env->mDones) {
+        return -1;
+    }
+    const size_t count = env->mBatch.GetCount();
+    
+    // Finished landers coast with their controls off until they are reset
+    env->mJobSystem.ParallelFor(count, kLandersPerJob, [env, actions](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const float* action = actions + i * LANDER_ENV_ACTION_SIZE;
+            const bool active = !env->mDone[i];
+            env->mBatch.ApplyThrust(i, active ? action[0] : 0.0f);
+            env->mBatch.FireRcs(i, active ? action[1] : 0.0f);
+            env->mSteps[i] += active;
+        }
+    });
+    
+    env->mBatch.Step(env->mTimeStep);
+    
+    env->mJobSystem.ParallelFor(count, kLandersPerJob, [env](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            WriteOutcome(*env, i);
+            WriteObservation(*env, i);
+        }
+    });
+    return 0;
+}
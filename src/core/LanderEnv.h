@@ -0,0 +1,75 @@
+// LanderEnv.h
+// C interface for stepping many 2D landers as a vectorized training environment
+
+#pragma once
+
+#include <stdint.h>
+
+// N independent 2D landers on the game's 2D terrain, stepped together by
+// the LanderBatch engine across a job system. Built as the lander_env
+// shared library, for ctypes/cffi and other C callers.
+//
+// The caller owns every buffer: env_bind() hands over contiguous float
+// arrays once, and env_reset()/env_step() write into them in place, so
+// stepping never allocates or copies. Landers are indexed the same way in
+// every array.
+//
+// One lander's observation is LANDER_ENV_OBSERVATION_SIZE floats:
+//   0  x (m)              1  altitude above the surface (m)
+//   2  velocity x (m/s)   3  velocity y (m/s)
+//   4  sin(rotation)      5  cos(rotation)
+//   6  spin (deg/s)       7  fuel left (0 - 1)
+//   8  offset from the nearest landing pad's center (m, pad minus x)
+// Its action is LANDER_ENV_ACTION_SIZE floats: throttle (0 - 1) and RCS
+// command (-1 to 1, counter-clockwise), clamped as Lander takes them.
+//
+// The reward is 0 until the lander's flight ends: a landing earns its
+// score (Rules::GetLandingScore) over 1000, so 0 - 2 with the pad's
+// difficulty; a crash -1; running out of time 0. done is 1 from the step
+// the flight ends until the lander is reset; finished landers ignore
+// their actions.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LANDER_ENV_OBSERVATION_SIZE 9
+#define LANDER_ENV_ACTION_SIZE 2
+
+typedef struct LanderEnv LanderEnv;
+
+// count landers, not yet reset; threads < 0 uses every core. Null if
+// count < 1.
+LanderEnv* env_create(int count);
+LanderEnv* env_create_threaded(int count, int threads);
+void env_destroy(LanderEnv* env);
+
+int env_count(const LanderEnv* env);
+
+// Starts come from seed, each lander's index and how often it was reset,
+// so a run repeats exactly (default seed 1)
+void env_seed(LanderEnv* env, uint32_t seed);
+
+// Physics steps per second (default 120) and the flight time limit in
+// seconds (default 120)
+void env_set_timing(LanderEnv* env, float rate, float maxTime);
+
+// Output arrays: count * LANDER_ENV_OBSERVATION_SIZE observations, count
+// rewards and count dones. They must outlive their use by env_reset() and
+// env_step().
+void env_bind(LanderEnv* env, float* observations, float* rewards, float* dones);
+
+// Start a new flight for every lander whose mask byte is nonzero (null
+// mask: all of them) from a random position and velocity, writing their
+// observations and clearing their reward and done. 0, or -1 if nothing is
+// bound.
+int env_reset(LanderEnv* env, const uint8_t* mask);
+
+// Apply count * LANDER_ENV_ACTION_SIZE actions and advance one physics
+// step, writing every lander's observation, reward and done. 0, or -1 if
+// nothing is bound.
+int env_step(LanderEnv* env, const float* actions);
+
+#ifdef __cplusplus
+}
+#endif
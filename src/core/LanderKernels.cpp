@@ -0,0 +1,503 @@
+// LanderKernels.cpp
+// SSE2/NEON and scalar kernels for the batched 2D lander simulation
+//
+// The scalar and SIMD paths perform the same IEEE operations in the same
+// order, so results match bit for bit. This file must be built without
+// floating-point contraction (see CMakeLists.txt) so the compiler cannot
+// fuse a multiply and add in one path but not the other.
+
+#include "LanderKernels.h"
+#include "Integrators.h"
+#include "Units.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LANDER_KERNELS_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define LANDER_KERNELS_NEON 1
+#endif
+
+// Polynomial constants for sin/cos on [-pi/4, pi/4]
+static const float kInv90 = 1.0f / 90.0f;
+static const float kDegToRad = 3.14159265358979323846f / 180.0f;
+static const float kSin1 = -1.0f / 6.0f;
+static const float kSin2 = 1.0f / 120.0f;
+static const float kSin3 = -1.0f / 5040.0f;
+static const float kCos1 = -1.0f / 2.0f;
+static const float kCos2 = 1.0f / 24.0f;
+static const float kCos3 = -1.0f / 720.0f;
+static const float kCos4 = 1.0f / 40320.0f;
+
+/*
+ * Scalar kernels
+ */
+
+bool LanderKernels::HasSimd() {
+#if defined(LANDER_KERNELS_SSE2) || defined(LANDER_KERNELS_NEON)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LanderKernels::SinCosDegrees(float degrees, float& sinOut, float& cosOut) {
+    // Reduce to r in [-45, 45] degrees plus a quadrant (ties round to even,
+    // matching the SIMD float-to-int conversions)
+    float quadrant = std::nearbyint(degrees * kInv90);
+    int q = static_cast<int>(quadrant);
+    float r = (degrees - quadrant * 90.0f) * kDegToRad;
+    
+    // Taylor polynomials, accurate to ~3e-7 on the reduced range
+    float r2 = r * r;
+    float s = r + r * r2 * (kSin1 + r2 * (kSin2 + r2 * kSin3));
+    float c = 1.0f + r2 * (kCos1 + r2 * (kCos2 + r2 * (kCos3 + r2 * kCos4)));
+    
+    // Rotate the result into the right quadrant
+    float sinValue = (q & 1) ? c : s;
+    float cosValue = (q & 1) ? s : c;
+    sinOut = (q & 2) ? -sinValue : sinValue;
+    cosOut = ((q + 1) & 2) ? -cosValue : cosValue;
+}
+
+// Thrust plus gravity, constant over the step: the same for every state
+template <class Value>
+struct ConstantAccel {
+    Value ax, ay;
+    
+    void operator()(const IntegratorState2D<Value>&, Value& outX, Value& outY) const {
+        outX = ax;
+        outY = ay;
+    }
+};
+
+template <class Integrator>
+void LanderKernels::Integrate2DScalar(const LanderIntegrateParams& params, size_t begin, size_t end,
+                                      float* posX, float* posY, float* velX, float* velY,
+                                      const float* rotation, const float* thrustLevel, const uint8_t* state) {
+    const float dt = params.deltaTime;
+    
+    for (size_t i = begin; i < end; ++i) {
+        float sinValue, cosValue;
+        SinCosDegrees(rotation[i], sinValue, cosValue);
+        
+        // Thrust is zero when the engine is off, so no branch is needed
+        float thrustAccel = params.maxThrustAccel * thrustLevel[i];
+        ConstantAccel<float> accel;
+        accel.ax = -sinValue * thrustAccel;
+        accel.ay = cosValue * thrustAccel - params.gravity;
+        
+        IntegratorState2D<float> next = { posX[i], posY[i], velX[i], velY[i] };
+        Integrator::template Step<ScalarOps>(next, dt, accel);
+        
+        // Only flying landers move
+        if (state[i] == 0) {
+            velX[i] = next.velX;
+            velY[i] = next.velY;
+            posX[i] = next.posX;
+            posY[i] = next.posY;
+        }
+    }
+}
+
+void LanderKernels::IntegrateAttitudeScalar(const LanderAttitudeParams& params, size_t begin, size_t end,
+                                            float* rotation, float* spin, const float* rcsCommand,
+                                            const uint8_t* state) {
+    const float dt = params.deltaTime;
+    
+    for (size_t i = begin; i < end; ++i) {
+        float nextSpin = spin[i] + rcsCommand[i] * params.angularAccel * dt;
+        float nextRotation = rotation[i] + nextSpin * dt;
+        nextRotation = nextRotation < 0.0f ? nextRotation + 360.0f : nextRotation;
+        nextRotation = nextRotation >= 360.0f ? nextRotation - 360.0f : nextRotation;
+        
+        if (state[i] == 0) {
+            spin[i] = nextSpin;
+            rotation[i] = nextRotation;
+        }
+    }
+}
+
+void LanderKernels::Collide2DScalar(const LanderSegmentTable& segments, size_t begin, size_t end,
+                                    const float* posX, const float* posY, float landerHalfHeight,
+                                    const LanderContactOutput& out) {
+    for (size_t i = begin; i < end; ++i) {
+        float bottomY = posY[i] - landerHalfHeight;
+        float screenX = posX[i] * Units::kPixelsPerMeter;
+        
+        bool found = false;
+        bool onPad = false;
+        float collisionHeight = 0.0f;
+        
+        // Visit every segment; keep the first one the lander has sunk into
+        for (size_t s = 0; s < segments.count; ++s) {
+            bool inRange = (screenX >= segments.x1[s]) & (screenX <= segments.x2[s]);
+            float segmentPct = (screenX - segments.x1[s]) / (segments.x2[s] - segments.x1[s]);
+            float segmentY = segments.y1[s] + segmentPct * (segments.y2[s] - segments.y1[s]);
+            float terrainHeightMeters = (segments.terrainHeight - segmentY) * Units::kMetersPerPixel;
+            
+            bool hit = inRange & (bottomY <= terrainHeightMeters);
+            collisionHeight = (hit & !found) ? terrainHeightMeters : collisionHeight;
+            found |= hit;
+            onPad |= inRange & (segments.landingPad[s] != 0);
+        }
+        
+        out.hit[i] = found ? 1 : 0;
+        out.onPad[i] = onPad ? 1 : 0;
+        out.collisionHeight[i] = collisionHeight;
+    }
+}
+
+/*
+ * SSE2 kernels
+ */
+
+#if defined(LANDER_KERNELS_SSE2)
+
+static inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128i LoadStates(const uint8_t* state) {
+    return _mm_setr_epi32(state[0], state[1], state[2], state[3]);
+}
+
+// Four-wide version of SinCosDegrees
+static inline void SinCosDegrees4(__m128 degrees, __m128& sinOut, __m128& cosOut) {
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(degrees, _mm_set1_ps(kInv90)));
+    __m128 quadrant = _mm_cvtepi32_ps(q);
+    __m128 r = _mm_mul_ps(_mm_sub_ps(degrees, _mm_mul_ps(quadrant, _mm_set1_ps(90.0f))), _mm_set1_ps(kDegToRad));
+    
+    __m128 r2 = _mm_mul_ps(r, r);
+    __m128 sinPoly = _mm_add_ps(_mm_set1_ps(kSin2), _mm_mul_ps(r2, _mm_set1_ps(kSin3)));
+    sinPoly = _mm_add_ps(_mm_set1_ps(kSin1), _mm_mul_ps(r2, sinPoly));
+    __m128 s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), sinPoly));
+    
+    __m128 cosPoly = _mm_add_ps(_mm_set1_ps(kCos3), _mm_mul_ps(r2, _mm_set1_ps(kCos4)));
+    cosPoly = _mm_add_ps(_mm_set1_ps(kCos2), _mm_mul_ps(r2, cosPoly));
+    cosPoly = _mm_add_ps(_mm_set1_ps(kCos1), _mm_mul_ps(r2, cosPoly));
+    __m128 c = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, cosPoly));
+    
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+    __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+    
+    sinOut = _mm_xor_ps(Select(swap, c, s), sinSign);
+    cosOut = _mm_xor_ps(Select(swap, s, c), cosSign);
+}
+
+struct SseOps {
+    typedef __m128 Value;
+    static __m128 Splat(float value) { return _mm_set1_ps(value); }
+    static __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    static __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+};
+
+template <class Integrator>
+void LanderKernels::Integrate2DSimd(const LanderIntegrateParams& params, size_t begin, size_t end,
+                                    float* posX, float* posY, float* velX, float* velY,
+                                    const float* rotation, const float* thrustLevel, const uint8_t* state) {
+    const __m128 dt = _mm_set1_ps(params.deltaTime);
+    const __m128 negGravity = _mm_set1_ps(-params.gravity);
+    const __m128 maxThrustAccel = _mm_set1_ps(params.maxThrustAccel);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 sinValue, cosValue;
+        SinCosDegrees4(_mm_loadu_ps(rotation + i), sinValue, cosValue);
+        
+        __m128 thrustAccel = _mm_mul_ps(maxThrustAccel, _mm_loadu_ps(thrustLevel + i));
+        ConstantAccel<__m128> accel;
+        accel.ax = _mm_mul_ps(_mm_xor_ps(sinValue, signBit), thrustAccel);
+        accel.ay = _mm_add_ps(_mm_mul_ps(cosValue, thrustAccel), negGravity);
+        
+        IntegratorState2D<__m128> old = {
+            _mm_loadu_ps(posX + i), _mm_loadu_ps(posY + i), _mm_loadu_ps(velX + i), _mm_loadu_ps(velY + i)
+        };
+        IntegratorState2D<__m128> next = old;
+        Integrator::template Step<SseOps>(next, dt, accel);
+        
+        __m128 flying = _mm_castsi128_ps(_mm_cmpeq_epi32(LoadStates(state + i), _mm_setzero_si128()));
+        _mm_storeu_ps(velX + i, Select(flying, next.velX, old.velX));
+        _mm_storeu_ps(velY + i, Select(flying, next.velY, old.velY));
+        _mm_storeu_ps(posX + i, Select(flying, next.posX, old.posX));
+        _mm_storeu_ps(posY + i, Select(flying, next.posY, old.posY));
+    }
+    
+    // Remainder
+    Integrate2DScalar<Integrator>(params, i, end, posX, posY, velX, velY, rotation, thrustLevel, state);
+}
+
+void LanderKernels::IntegrateAttitudeSimd(const LanderAttitudeParams& params, size_t begin, size_t end,
+                                          float* rotation, float* spin, const float* rcsCommand,
+                                          const uint8_t* state) {
+    const __m128 dt = _mm_set1_ps(params.deltaTime);
+    const __m128 angularAccel = _mm_set1_ps(params.angularAccel);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 fullTurn = _mm_set1_ps(360.0f);
+    
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 oldSpin = _mm_loadu_ps(spin + i);
+        __m128 oldRotation = _mm_loadu_ps(rotation + i);
+        __m128 nextSpin = _mm_add_ps(oldSpin, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(rcsCommand + i), angularAccel), dt));
+        __m128 nextRotation = _mm_add_ps(oldRotation, _mm_mul_ps(nextSpin, dt));
+        nextRotation = Select(_mm_cmplt_ps(nextRotation, zero), _mm_add_ps(nextRotation, fullTurn), nextRotation);
+        nextRotation = Select(_mm_cmpge_ps(nextRotation, fullTurn), _mm_sub_ps(nextRotation, fullTurn), nextRotation);
+        
+        __m128 flying = _mm_castsi128_ps(_mm_cmpeq_epi32(LoadStates(state + i), _mm_setzero_si128()));
+        _mm_storeu_ps(spin + i, Select(flying, nextSpin, oldSpin));
+        _mm_storeu_ps(rotation + i, Select(flying, nextRotation, oldRotation));
+    }
+    
+    // Remainder
+    IntegrateAttitudeScalar(params, i, end, rotation, spin, rcsCommand, state);
+}
+
+void LanderKernels::Collide2DSimd(const LanderSegmentTable& segments, size_t begin, size_t end,
+                                  const float* posX, const float* posY, float landerHalfHeight,
+                                  const LanderContactOutput& out) {
+    const __m128 halfHeight = _mm_set1_ps(landerHalfHeight);
+    const __m128 pixelsPerMeter = _mm_set1_ps(Units::kPixelsPerMeter);
+    const __m128 metersPerPixel = _mm_set1_ps(Units::kMetersPerPixel);
+    const __m128 terrainHeight = _mm_set1_ps(segments.terrainHeight);
+    
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 bottomY = _mm_sub_ps(_mm_loadu_ps(posY + i), halfHeight);
+        __m128 screenX = _mm_mul_ps(_mm_loadu_ps(posX + i), pixelsPerMeter);
+        
+        __m128 found = _mm_setzero_ps();
+        __m128 onPad = _mm_setzero_ps();
+        __m128 collisionHeight = _mm_setzero_ps();
+        
+        for (size_t s = 0; s < segments.count; ++s) {
+            __m128 x1 = _mm_set1_ps(segments.x1[s]);
+            __m128 x2 = _mm_set1_ps(segments.x2[s]);
+            __m128 y1 = _mm_set1_ps(segments.y1[s]);
+            __m128 y2 = _mm_set1_ps(segments.y2[s]);
+            __m128 pad = _mm_castsi128_ps(_mm_set1_epi32(segments.landingPad[s] ? -1 : 0));
+            
+            __m128 inRange = _mm_and_ps(_mm_cmpge_ps(screenX, x1), _mm_cmple_ps(screenX, x2));
+            __m128 segmentPct = _mm_div_ps(_mm_sub_ps(screenX, x1), _mm_sub_ps(x2, x1));
+            __m128 segmentY = _mm_add_ps(y1, _mm_mul_ps(segmentPct, _mm_sub_ps(y2, y1)));
+            __m128 terrainHeightMeters = _mm_mul_ps(_mm_sub_ps(terrainHeight, segmentY), metersPerPixel);
+            
+            __m128 hit = _mm_and_ps(inRange, _mm_cmple_ps(bottomY, terrainHeightMeters));
+            collisionHeight = Select(_mm_andnot_ps(found, hit), terrainHeightMeters, collisionHeight);
+            found = _mm_or_ps(found, hit);
+            onPad = _mm_or_ps(onPad, _mm_and_ps(inRange, pad));
+        }
+        
+        int foundBits = _mm_movemask_ps(found);
+        int padBits = _mm_movemask_ps(onPad);
+        for (int lane = 0; lane < 4; ++lane) {
+            out.hit[i + lane] = (foundBits >> lane) & 1;
+            out.onPad[i + lane] = (padBits >> lane) & 1;
+        }
+        _mm_storeu_ps(out.collisionHeight + i, collisionHeight);
+    }
+    
+    // Remainder
+    Collide2DScalar(segments, i, end, posX, posY, landerHalfHeight, out);
+}
+
+/*
+ * NEON kernels
+ */
+
+#elif defined(LANDER_KERNELS_NEON)
+
+static inline uint32x4_t LoadStates(const uint8_t* state) {
+    uint32_t lanes[4] = { state[0], state[1], state[2], state[3] };
+    return vld1q_u32(lanes);
+}
+
+// Four-wide version of SinCosDegrees
+static inline void SinCosDegrees4(float32x4_t degrees, float32x4_t& sinOut, float32x4_t& cosOut) {
+    int32x4_t q = vcvtnq_s32_f32(vmulq_f32(degrees, vdupq_n_f32(kInv90)));
+    float32x4_t quadrant = vcvtq_f32_s32(q);
+    float32x4_t r = vmulq_f32(vsubq_f32(degrees, vmulq_f32(quadrant, vdupq_n_f32(90.0f))), vdupq_n_f32(kDegToRad));
+    
+    float32x4_t r2 = vmulq_f32(r, r);
+    float32x4_t sinPoly = vaddq_f32(vdupq_n_f32(kSin2), vmulq_f32(r2, vdupq_n_f32(kSin3)));
+    sinPoly = vaddq_f32(vdupq_n_f32(kSin1), vmulq_f32(r2, sinPoly));
+    float32x4_t s = vaddq_f32(r, vmulq_f32(vmulq_f32(r, r2), sinPoly));
+    
+    float32x4_t cosPoly = vaddq_f32(vdupq_n_f32(kCos3), vmulq_f32(r2, vdupq_n_f32(kCos4)));
+    cosPoly = vaddq_f32(vdupq_n_f32(kCos2), vmulq_f32(r2, cosPoly));
+    cosPoly = vaddq_f32(vdupq_n_f32(kCos1), vmulq_f32(r2, cosPoly));
+    float32x4_t c = vaddq_f32(vdupq_n_f32(1.0f), vmulq_f32(r2, cosPoly));
+    
+    const int32x4_t one = vdupq_n_s32(1);
+    const int32x4_t two = vdupq_n_s32(2);
+    uint32x4_t swap = vceqq_s32(vandq_s32(q, one), one);
+    uint32x4_t sinSign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(q, two), 30));
+    uint32x4_t cosSign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(vaddq_s32(q, one), two), 30));
+    
+    sinOut = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, c, s)), sinSign));
+    cosOut = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, s, c)), cosSign));
+}
+
+struct NeonOps {
+    typedef float32x4_t Value;
+    static float32x4_t Splat(float value) { return vdupq_n_f32(value); }
+    static float32x4_t Add(float32x4_t a, float32x4_t b) { return vaddq_f32(a, b); }
+    static float32x4_t Mul(float32x4_t a, float32x4_t b) { return vmulq_f32(a, b); }
+};
+
+template <class Integrator>
+void LanderKernels::Integrate2DSimd(const LanderIntegrateParams& params, size_t begin, size_t end,
+                                    float* posX, float* posY, float* velX, float* velY,
+                                    const float* rotation, const float* thrustLevel, const uint8_t* state) {
+    const float32x4_t dt = vdupq_n_f32(params.deltaTime);
+    const float32x4_t negGravity = vdupq_n_f32(-params.gravity);
+    const float32x4_t maxThrustAccel = vdupq_n_f32(params.maxThrustAccel);
+    
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        float32x4_t sinValue, cosValue;
+        SinCosDegrees4(vld1q_f32(rotation + i), sinValue, cosValue);
+        
+        float32x4_t thrustAccel = vmulq_f32(maxThrustAccel, vld1q_f32(thrustLevel + i));
+        ConstantAccel<float32x4_t> accel;
+        accel.ax = vmulq_f32(vnegq_f32(sinValue), thrustAccel);
+        accel.ay = vaddq_f32(vmulq_f32(cosValue, thrustAccel), negGravity);
+        
+        IntegratorState2D<float32x4_t> old = {
+            vld1q_f32(posX + i), vld1q_f32(posY + i), vld1q_f32(velX + i), vld1q_f32(velY + i)
+        };
+        IntegratorState2D<float32x4_t> next = old;
+        Integrator::template Step<NeonOps>(next, dt, accel);
+        
+        uint32x4_t flying = vceqq_u32(LoadStates(state + i), vdupq_n_u32(0));
+        vst1q_f32(velX + i, vbslq_f32(flying, next.velX, old.velX));
+        vst1q_f32(velY + i, vbslq_f32(flying, next.velY, old.velY));
+        vst1q_f32(posX + i, vbslq_f32(flying, next.posX, old.posX));
+        vst1q_f32(posY + i, vbslq_f32(flying, next.posY, old.posY));
+    }
+    
+    // Remainder
+    Integrate2DScalar<Integrator>(params, i, end, posX, posY, velX, velY, rotation, thrustLevel, state);
+}
+
+void LanderKernels::IntegrateAttitudeSimd(const LanderAttitudeParams& params, size_t begin, size_t end,
+                                          float* rotation, float* spin, const float* rcsCommand,
+                                          const uint8_t* state) {
+    const float32x4_t dt = vdupq_n_f32(params.deltaTime);
+    const float32x4_t angularAccel = vdupq_n_f32(params.angularAccel);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t fullTurn = vdupq_n_f32(360.0f);
+    
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        float32x4_t oldSpin = vld1q_f32(spin + i);
+        float32x4_t oldRotation = vld1q_f32(rotation + i);
+        float32x4_t nextSpin = vaddq_f32(oldSpin, vmulq_f32(vmulq_f32(vld1q_f32(rcsCommand + i), angularAccel), dt));
+        float32x4_t nextRotation = vaddq_f32(oldRotation, vmulq_f32(nextSpin, dt));
+        nextRotation = vbslq_f32(vcltq_f32(nextRotation, zero), vaddq_f32(nextRotation, fullTurn), nextRotation);
+        nextRotation = vbslq_f32(vcgeq_f32(nextRotation, fullTurn), vsubq_f32(nextRotation, fullTurn), nextRotation);
+        
+        uint32x4_t flying = vceqq_u32(LoadStates(state + i), vdupq_n_u32(0));
+        vst1q_f32(spin + i, vbslq_f32(flying, nextSpin, oldSpin));
+        vst1q_f32(rotation + i, vbslq_f32(flying, nextRotation, oldRotation));
+    }
+    
+    // Remainder
+    IntegrateAttitudeScalar(params, i, end, rotation, spin, rcsCommand, state);
+}
+
+void LanderKernels::Collide2DSimd(const LanderSegmentTable& segments, size_t begin, size_t end,
+                                  const float* posX, const float* posY, float landerHalfHeight,
+                                  const LanderContactOutput& out) {
+    const float32x4_t halfHeight = vdupq_n_f32(landerHalfHeight);
+    const float32x4_t pixelsPerMeter = vdupq_n_f32(Units::kPixelsPerMeter);
+    const float32x4_t metersPerPixel = vdupq_n_f32(Units::kMetersPerPixel);
+    const float32x4_t terrainHeight = vdupq_n_f32(segments.terrainHeight);
+    
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        float32x4_t bottomY = vsubq_f32(vld1q_f32(posY + i), halfHeight);
+        float32x4_t screenX = vmulq_f32(vld1q_f32(posX + i), pixelsPerMeter);
+        
+        uint32x4_t found = vdupq_n_u32(0);
+        uint32x4_t onPad = vdupq_n_u32(0);
+        float32x4_t collisionHeight = vdupq_n_f32(0.0f);
+        
+        for (size_t s = 0; s < segments.count; ++s) {
+            float32x4_t x1 = vdupq_n_f32(segments.x1[s]);
+            float32x4_t x2 = vdupq_n_f32(segments.x2[s]);
+            float32x4_t y1 = vdupq_n_f32(segments.y1[s]);
+            float32x4_t y2 = vdupq_n_f32(segments.y2[s]);
+            uint32x4_t pad = vdupq_n_u32(segments.landingPad[s] ? 0xFFFFFFFFu : 0u);
+            
+            uint32x4_t inRange = vandq_u32(vcgeq_f32(screenX, x1), vcleq_f32(screenX, x2));
+            float32x4_t segmentPct = vdivq_f32(vsubq_f32(screenX, x1), vsubq_f32(x2, x1));
+            float32x4_t segmentY = vaddq_f32(y1, vmulq_f32(segmentPct, vsubq_f32(y2, y1)));
+            float32x4_t terrainHeightMeters = vmulq_f32(vsubq_f32(terrainHeight, segmentY), metersPerPixel);
+            
+            uint32x4_t hit = vandq_u32(inRange, vcleq_f32(bottomY, terrainHeightMeters));
+            collisionHeight = vbslq_f32(vbicq_u32(hit, found), terrainHeightMeters, collisionHeight);
+            found = vorrq_u32(found, hit);
+            onPad = vorrq_u32(onPad, vandq_u32(inRange, pad));
+        }
+        
+        uint32_t foundLanes[4];
+        uint32_t padLanes[4];
+        vst1q_u32(foundLanes, found);
+        vst1q_u32(padLanes, onPad);
+        for (int lane = 0; lane < 4; ++lane) {
+            out.hit[i + lane] = foundLanes[lane] ? 1 : 0;
+            out.onPad[i + lane] = padLanes[lane] ? 1 : 0;
+        }
+        vst1q_f32(out.collisionHeight + i, collisionHeight);
+    }
+    
+    // Remainder
+    Collide2DScalar(segments, i, end, posX, posY, landerHalfHeight, out);
+}
+
+/*
+ * No SIMD available: the SIMD entry points run the scalar kernels
+ */
+
+#else
+
+template <class Integrator>
+void LanderKernels::Integrate2DSimd(const LanderIntegrateParams& params, size_t begin, size_t end,
+                                    float* posX, float* posY, float* velX, float* velY,
+                                    const float* rotation, const float* thrustLevel, const uint8_t* state) {
+    Integrate2DScalar<Integrator>(params, begin, end, posX, posY, velX, velY, rotation, thrustLevel, state);
+}
+
+void LanderKernels::IntegrateAttitudeSimd(const LanderAttitudeParams& params, size_t begin, size_t end,
+                                          float* rotation, float* spin, const float* rcsCommand,
+                                          const uint8_t* state) {
+    IntegrateAttitudeScalar(params, begin, end, rotation, spin, rcsCommand, state);
+}
+
+void LanderKernels::Collide2DSimd(const LanderSegmentTable& segments, size_t begin, size_t end,
+                                  const float* posX, const float* posY, float landerHalfHeight,
+                                  const LanderContactOutput& out) {
+    Collide2DScalar(segments, begin, end, posX, posY, landerHalfHeight, out);
+}
+
+#endif
+
+/*
+ * Instantiations for every integrator policy
+ */
+
+#define LANDER_KERNELS_INSTANTIATE(Integrator) \
+    template void LanderKernels::Integrate2DScalar<Integrator>(const LanderIntegrateParams&, size_t, size_t, \
+        float*, float*, float*, float*, const float*, const float*, const uint8_t*); \
+    template void LanderKernels::Integrate2DSimd<Integrator>(const LanderIntegrateParams&, size_t, size_t, \
+        float*, float*, float*, float*, const float*, const float*, const uint8_t*);
+
+LANDER_KERNELS_INSTANTIATE(SemiImplicitEuler)
+LANDER_KERNELS_INSTANTIATE(VelocityVerlet)
+LANDER_KERNELS_INSTANTIATE(RungeKutta4)
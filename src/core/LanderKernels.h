@@ -0,0 +1,81 @@
+// LanderKernels.h
+// Batched 2D integration and collision kernels (SSE2/NEON with scalar fallback)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Shared inputs for one integration step
+struct LanderIntegrateParams {
+    float deltaTime;       // Seconds
+    float gravity;         // m/s²
+    float maxThrustAccel;  // m/s² at full throttle
+};
+
+// Shared inputs for one attitude step
+struct LanderAttitudeParams {
+    float deltaTime;       // Seconds
+    float angularAccel;    // deg/s² at a full RCS command
+};
+
+// Terrain segments as parallel arrays (screen pixels, as in TerrainSegment)
+struct LanderSegmentTable {
+    const float* x1;
+    const float* y1;
+    const float* x2;
+    const float* y2;
+    const uint8_t* landingPad;
+    size_t count;
+    float terrainHeight;   // Terrain height in pixels (screen-space flip); scale from Units
+};
+
+// Per-lander contact result written by the collision kernels
+struct LanderContactOutput {
+    uint8_t* hit;              // 1 if the lander is touching terrain
+    uint8_t* onPad;            // 1 if a landing pad segment is under the lander
+    float* collisionHeight;    // Surface height in meters (valid when hit)
+};
+
+// Stateless kernels over lander arrays, indices [begin, end)
+class LanderKernels {
+public:
+    // True when the SIMD kernels are compiled in (SSE2 or NEON)
+    static bool HasSimd();
+    
+    // Fast sin/cos of an angle in degrees (quadrant reduction + polynomial).
+    // Absolute error is below 1e-6 over [0, 360).
+    static void SinCosDegrees(float degrees, float& sinOut, float& cosOut);
+    
+    // Gravity + thrust step for landers whose state is 0 (flying), using
+    // one of the Integrators.h policies (instantiated for all three).
+    // The SIMD and scalar versions produce bitwise identical results.
+    template <class Integrator>
+    static void Integrate2DScalar(const LanderIntegrateParams& params, size_t begin, size_t end,
+                                  float* posX, float* posY, float* velX, float* velY,
+                                  const float* rotation, const float* thrustLevel, const uint8_t* state);
+    template <class Integrator>
+    static void Integrate2DSimd(const LanderIntegrateParams& params, size_t begin, size_t end,
+                                float* posX, float* posY, float* velX, float* velY,
+                                const float* rotation, const float* thrustLevel, const uint8_t* state);
+    
+    // RCS spin-up and turn for landers whose state is 0: the command
+    // changes the spin, the new spin the rotation, which stays in [0, 360).
+    // Bitwise identical between the SIMD and scalar versions.
+    static void IntegrateAttitudeScalar(const LanderAttitudeParams& params, size_t begin, size_t end,
+                                        float* rotation, float* spin, const float* rcsCommand,
+                                        const uint8_t* state);
+    static void IntegrateAttitudeSimd(const LanderAttitudeParams& params, size_t begin, size_t end,
+                                      float* rotation, float* spin, const float* rcsCommand,
+                                      const uint8_t* state);
+    
+    // Branchless walk of every segment for each lander bottom point.
+    // Picks the first segment the lander has sunk into, like
+    // Terrain::CheckCollision2D, and flags pad coverage for landing checks.
+    static void Collide2DScalar(const LanderSegmentTable& segments, size_t begin, size_t end,
+                                const float* posX, const float* posY, float landerHalfHeight,
+                                const LanderContactOutput& out);
+    static void Collide2DSimd(const LanderSegmentTable& segments, size_t begin, size_t end,
+                              const float* posX, const float* posY, float landerHalfHeight,
+                              const LanderContactOutput& out);
+};
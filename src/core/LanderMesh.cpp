@@ -0,0 +1,824 @@
+// LanderMesh.cpp
+// OBJ parsing, clustered LODs, vertex cache, overdraw and fetch ordering, and the mesh cache
+
+#include "LanderMesh.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+
+// Cache file layout: this header, then the LOD table, the vertices and the
+// indices at 16-byte aligned offsets, stored exactly as in memory
+static const char kLanderMeshCacheMagic[4] = { 'L', 'L', 'M', 'C' };
+static const uint32_t kLanderMeshCacheVersion = 1;
+
+struct LanderMeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;        // sizeof(LanderMeshCacheHeader)
+    uint32_t lodCount;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t lodOffset;         // LanderMeshLod per level
+    uint64_t vertexOffset;      // LanderMeshVertex per vertex
+    uint64_t indexOffset;       // uint32_t per index
+    uint64_t fileSize;
+    char source[256];           // What the mesh was built from
+};
+
+static uint64_t AlignCacheOffset(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+// Clustering grid (cells per unit cube side) of each level after the first
+static const int kLodGrids[LanderMesh::kMaxLods - 1] = { 32, 16, 8 };
+
+// A level is only kept if it has at most this share of the previous one's triangles
+static const float kMinLodReduction = 0.75f;
+
+// Unquantized mesh the build works on
+struct BuildVertex {
+    float position[3];
+    float normal[3];
+};
+
+struct BuildMesh {
+    std::vector<BuildVertex> vertices;
+    std::vector<uint32_t> indices;
+    float error;
+};
+
+static void Subtract(const float* a, const float* b, float* out) {
+    out[0] = a[0] - b[0];
+    out[1] = a[1] - b[1];
+    out[2] = a[2] - b[2];
+}
+
+static void Cross(const float* a, const float* b, float* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float Length(const float* v) {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static void Normalize(float* v) {
+    const float length = Length(v);
+    if (length > 1e-20f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    } else {
+        v[0] = 0.0f;
+        v[1] = 1.0f;
+        v[2] = 0.0f;
+    }
+}
+
+// Area-weighted (un-normalized) normal of a triangle
+static void FaceNormal(const float* a, const float* b, const float* c, float* out) {
+    float e1[3], e2[3];
+    Subtract(b, a, e1);
+    Subtract(c, a, e2);
+    Cross(e1, e2, out);
+}
+
+// An OBJ vertex reference: 1-based, negative counts back from the last
+// element read so far; 0 = absent
+static bool ResolveObjIndex(long index, size_t count, int& out) {
+    if (index > 0 && static_cast<size_t>(index) <= count) {
+        out = static_cast<int>(index - 1);
+        return true;
+    }
+    if (index < 0 && static_cast<size_t>(-index) <= count) {
+        out = static_cast<int>(count + index);
+        return true;
+    }
+    return false;
+}
+
+// Positions, normals and polygons of an OBJ file, welded into one vertex per
+// distinct position and normal pair. Texture coordinates, groups and
+// materials are skipped; vertices without a normal get the smooth normal
+// of the faces around their position.
+static bool ParseObj(const char* filename, BuildMesh& mesh) {
+    std::ifstream file(filename);
+    if (!file) {
+        LOG_ERROR("Failed to open lander model: %s", filename);
+        return false;
+    }
+    
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<int> corners;     // Position, normal pairs of every triangle corner
+    std::string line;
+    int lineNumber = 0;
+    std::vector<int> polygon;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        const char* text = line.c_str();
+        while (*text == ' ' || *text == '\t') text++;
+        
+        if (text[0] == 'v' && (text[1] == ' ' || text[1] == '\t')) {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            if (std::sscanf(text + 1, "%f %f %f", &x, &y, &z) != 3) {
+                LOG_ERROR("%s:%d: bad vertex", filename, lineNumber);
+                return false;
+            }
+            positions.insert(positions.end(), { x, y, z });
+        } else if (text[0] == 'v' && text[1] == 'n') {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            if (std::sscanf(text + 2, "%f %f %f", &x, &y, &z) != 3) {
+                LOG_ERROR("%s:%d: bad normal", filename, lineNumber);
+                return false;
+            }
+            normals.insert(normals.end(), { x, y, z });
+        } else if (text[0] == 'f' && (text[1] == ' ' || text[1] == '\t')) {
+            // Corners are v, v/vt, v//vn or v/vt/vn
+            polygon.clear();
+            char* cursor = const_cast<char*>(text + 1);
+            for (;;) {
+                while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') cursor++;
+                if (*cursor == '\0') break;
+                int position = -1;
+                int normal = -1;
+                char* end = cursor;
+                long index = std::strtol(cursor, &end, 10);
+                bool valid = end != cursor && ResolveObjIndex(index, positions.size() / 3, position);
+                cursor = end;
+                if (valid && *cursor == '/') {
+                    cursor++;
+                    std::strtol(cursor, &end, 10);      // Texture coordinate, unused
+                    cursor = end;
+                    if (*cursor == '/') {
+                        cursor++;
+                        index = std::strtol(cursor, &end, 10);
+                        valid = end != cursor && ResolveObjIndex(index, normals.size() / 3, normal);
+                        cursor = end;
+                    }
+                }
+                if (!valid || (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')) {
+                    LOG_ERROR("%s:%d: bad face", filename, lineNumber);
+                    return false;
+                }
+                polygon.push_back(position);
+                polygon.push_back(normal);
+            }
+            
+            // Fan the polygon into triangles
+            for (size_t i = 2; 2 * i < polygon.size(); i++) {
+                corners.insert(corners.end(), { polygon[0], polygon[1],
+                                                polygon[2 * i - 2], polygon[2 * i - 1],
+                                                polygon[2 * i], polygon[2 * i + 1] });
+            }
+        }
+    }
+    
+    // Smooth normals per position for corners that have none
+    const size_t positionCount = positions.size() / 3;
+    std::vector<float> smoothNormals(positions.size(), 0.0f);
+    for (size_t corner = 0; corner < corners.size(); corner += 6) {
+        float normal[3];
+        FaceNormal(&positions[3 * corners[corner]], &positions[3 * corners[corner + 2]],
+                   &positions[3 * corners[corner + 4]], normal);
+        for (int k = 0; k < 6; k += 2) {
+            float* sum = &smoothNormals[3 * corners[corner + k]];
+            sum[0] += normal[0];
+            sum[1] += normal[1];
+            sum[2] += normal[2];
+        }
+    }
+    for (size_t i = 0; i < positionCount; i++) {
+        Normalize(&smoothNormals[3 * i]);
+    }
+    
+    // Weld, dropping triangles with a repeated position
+    std::unordered_map<uint64_t, uint32_t> welded;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.error = 0.0f;
+    for (size_t corner = 0; corner < corners.size(); corner += 6) {
+        if (corners[corner] == corners[corner + 2] || corners[corner] == corners[corner + 4] ||
+            corners[corner + 2] == corners[corner + 4]) {
+            continue;
+        }
+        for (int k = 0; k < 6; k += 2) {
+            const int position = corners[corner + k];
+            const int normal = corners[corner + k + 1];
+            const uint64_t key = (static_cast<uint64_t>(position) << 32) | static_cast<uint32_t>(normal + 1);
+            auto found = welded.emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+            if (found.second) {
+                BuildVertex vertex;
+                std::memcpy(vertex.position, &positions[3 * position], sizeof(vertex.position));
+                std::memcpy(vertex.normal, normal >= 0 ? &normals[3 * normal] : &smoothNormals[3 * position],
+                            sizeof(vertex.normal));
+                Normalize(vertex.normal);
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices.push_back(found.first->second);
+        }
+    }
+    return true;
+}
+
+// Stretch the mesh's bounds onto [-0.5, 0.5]^3, taking the normals along
+// through the inverse transpose of the scale
+static void FitUnitCube(BuildMesh& mesh) {
+    float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (const BuildVertex& vertex : mesh.vertices) {
+        for (int axis = 0; axis < 3; axis++) {
+            boundsMin[axis] = std::min(boundsMin[axis], vertex.position[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], vertex.position[axis]);
+        }
+    }
+    float size[3];
+    const float largest = std::max({ boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1],
+                                     boundsMax[2] - boundsMin[2], 1e-20f });
+    for (int axis = 0; axis < 3; axis++) {
+        size[axis] = std::max(boundsMax[axis] - boundsMin[axis], 1e-6f * largest);
+    }
+    for (BuildVertex& vertex : mesh.vertices) {
+        for (int axis = 0; axis < 3; axis++) {
+            vertex.position[axis] = (vertex.position[axis] - 0.5f * (boundsMin[axis] + boundsMax[axis])) / size[axis];
+            vertex.normal[axis] *= size[axis];
+        }
+        Normalize(vertex.normal);
+    }
+}
+
+// Vertex clustering: every vertex moves to the mean of the vertices in its
+// grid cell that face the same way (the same dominant normal axis and
+// sign), and triangles left with a repeated vertex, or repeating another
+// triangle, drop out. Vertices move at most a cell diagonal.
+static void ClusterMesh(const BuildMesh& source, int grid, BuildMesh& out) {
+    struct Cluster {
+        float position[3];
+        float normal[3];
+        int count;
+    };
+    std::unordered_map<uint64_t, uint32_t> clusterIndex;
+    std::vector<Cluster> clusters;
+    std::vector<uint32_t> remap(source.vertices.size());
+    for (size_t i = 0; i < source.vertices.size(); i++) {
+        const BuildVertex& vertex = source.vertices[i];
+        uint64_t key = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            const int cell = std::min(std::max(static_cast<int>((vertex.position[axis] + 0.5f) * grid), 0), grid - 1);
+            key = key * grid + cell;
+        }
+        int dominant = 0;
+        for (int axis = 1; axis < 3; axis++) {
+            if (std::fabs(vertex.normal[axis]) > std::fabs(vertex.normal[dominant])) dominant = axis;
+        }
+        key = key * 6 + dominant * 2 + (vertex.normal[dominant] < 0.0f ? 1 : 0);
+        
+        auto found = clusterIndex.emplace(key, static_cast<uint32_t>(clusters.size()));
+        if (found.second) {
+            clusters.push_back({ { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0 });
+        }
+        Cluster& cluster = clusters[found.first->second];
+        for (int axis = 0; axis < 3; axis++) {
+            cluster.position[axis] += vertex.position[axis];
+            cluster.normal[axis] += vertex.normal[axis];
+        }
+        cluster.count++;
+        remap[i] = found.first->second;
+    }
+    
+    out.vertices.resize(clusters.size());
+    for (size_t i = 0; i < clusters.size(); i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            out.vertices[i].position[axis] = clusters[i].position[axis] / clusters[i].count;
+            out.vertices[i].normal[axis] = clusters[i].normal[axis];
+        }
+        Normalize(out.vertices[i].normal);
+    }
+    
+    std::unordered_set<uint64_t> triangles;
+    out.indices.clear();
+    for (size_t t = 0; t + 2 < source.indices.size(); t += 3) {
+        uint32_t a = remap[source.indices[t]];
+        uint32_t b = remap[source.indices[t + 1]];
+        uint32_t c = remap[source.indices[t + 2]];
+        if (a == b || b == c || a == c) continue;
+        
+        // The same three vertices in the same winding, from any first corner
+        uint32_t first = std::min({ a, b, c });
+        uint32_t rotated[3] = { a, b, c };
+        while (rotated[0] != first) {
+            std::rotate(rotated, rotated + 1, rotated + 3);
+        }
+        const uint64_t key = (static_cast<uint64_t>(rotated[0]) << 42) | (static_cast<uint64_t>(rotated[1]) << 21) |
+                             rotated[2];
+        if (!triangles.insert(key).second) continue;
+        out.indices.insert(out.indices.end(), { a, b, c });
+    }
+    out.error = std::sqrt(3.0f) / grid;
+}
+
+// Average misses per triangle in a FIFO cache of cacheSize vertices
+static float CacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize) {
+    if (indices.empty()) return 0.0f;
+    std::vector<uint32_t> insertedAt(vertexCount, 0);   // Miss count when the vertex entered, 0 = never
+    uint32_t misses = 0;
+    for (uint32_t index : indices) {
+        if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > static_cast<uint32_t>(cacheSize)) {
+            misses++;
+            insertedAt[index] = misses;
+        }
+    }
+    return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+// Forsyth's vertex scores: recently used vertices score highest (the last
+// triangle's three a fixed 0.75, so its neighbours are not favoured over
+// each other), and vertices with few triangles left score higher still,
+// so no stragglers are left behind
+static float ForsythScore(int cachePosition, uint32_t liveTriangles) {
+    if (liveTriangles == 0) return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = 0.75f;
+        } else {
+            const float scale = 1.0f / (LanderMesh::kCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+        }
+    }
+    return score + 2.0f / std::sqrt(static_cast<float>(liveTriangles));
+}
+
+// Tom Forsyth's linear-speed vertex cache optimization: greedily emit the
+// triangle with the best summed vertex score, rescoring only the triangles
+// around the modeled LRU cache
+static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+    
+    // Live triangles per vertex, packed
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (uint32_t index : indices) adjacencyStart[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    std::vector<uint32_t> adjacency(indices.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = indices[3 * t + k];
+            adjacency[adjacencyStart[v] + liveCount[v]++] = static_cast<uint32_t>(t);
+        }
+    }
+    
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScore[v] = ForsythScore(-1, liveCount[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] +
+                           vertexScore[indices[3 * t + 2]];
+    }
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    
+    uint32_t cache[LanderMesh::kCacheSize + 3];
+    int cacheCount = 0;
+    size_t scanCursor = 0;
+    int64_t best = 0;
+    for (size_t t = 1; t < triangleCount; t++) {
+        if (triangleScore[t] > triangleScore[best]) best = static_cast<int64_t>(t);
+    }
+    
+    while (best >= 0) {
+        const uint32_t* triangle = &indices[3 * best];
+        output.insert(output.end(), triangle, triangle + 3);
+        emitted[best] = 1;
+        
+        // Retire the triangle from its vertices' live lists
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = triangle[k];
+            uint32_t* list = &adjacency[adjacencyStart[v]];
+            for (uint32_t i = 0; i < liveCount[v]; i++) {
+                if (list[i] == static_cast<uint32_t>(best)) {
+                    list[i] = list[--liveCount[v]];
+                    break;
+                }
+            }
+        }
+        
+        // The triangle's vertices move to the front of the LRU cache
+        uint32_t newCache[LanderMesh::kCacheSize + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; k++) newCache[newCount++] = triangle[k];
+        for (int i = 0; i < cacheCount; i++) {
+            const uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache[newCount++] = v;
+            }
+        }
+        
+        // Rescore whatever was in either cache, then the triangles around it
+        for (int i = 0; i < newCount; i++) {
+            const uint32_t v = newCache[i];
+            cachePosition[v] = i < LanderMesh::kCacheSize ? i : -1;
+            vertexScore[v] = ForsythScore(cachePosition[v], liveCount[v]);
+        }
+        best = -1;
+        float bestScore = -INFINITY;
+        for (int i = 0; i < newCount; i++) {
+            const uint32_t v = newCache[i];
+            for (uint32_t j = 0; j < liveCount[v]; j++) {
+                const uint32_t t = adjacency[adjacencyStart[v] + j];
+                const float score = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] +
+                                    vertexScore[indices[3 * t + 2]];
+                triangleScore[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+        cacheCount = std::min(newCount, static_cast<int>(LanderMesh::kCacheSize));
+        std::copy(newCache, newCache + cacheCount, cache);
+        
+        // Nothing left around the cache: restart from the next unemitted triangle
+        if (best < 0) {
+            while (scanCursor < triangleCount && emitted[scanCursor]) scanCursor++;
+            if (scanCursor < triangleCount) best = static_cast<int64_t>(scanCursor);
+        }
+    }
+    indices.swap(output);
+}
+
+// Overdraw ordering after Sander, Nehab and Barczak: cut the cache-ordered
+// triangles into clusters wherever the modeled FIFO cache misses all three
+// corners (so each cluster starts cold anyway), then draw the clusters
+// that face outwards from the mesh's centroid first; they are the ones
+// most likely to hide the rest
+static void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<BuildVertex>& vertices) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) return;
+    
+    std::vector<size_t> clusterStart;
+    std::vector<uint32_t> insertedAt(vertices.size(), 0);
+    uint32_t misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = indices[3 * t + k];
+            if (insertedAt[v] == 0 || misses + 1 - insertedAt[v] > static_cast<uint32_t>(LanderMesh::kCacheSize)) {
+                misses++;
+                insertedAt[v] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3) {
+            clusterStart.push_back(t);
+        }
+    }
+    clusterStart.push_back(triangleCount);
+    const size_t clusterCount = clusterStart.size() - 1;
+    if (clusterCount < 2) return;
+    
+    // Area-weighted centroids and normals of the clusters and the mesh
+    std::vector<float> clusterData(6 * clusterCount, 0.0f);
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        float* centroid = &clusterData[6 * c];
+        float* normal = centroid + 3;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            const float* a = vertices[indices[3 * t]].position;
+            const float* b = vertices[indices[3 * t + 1]].position;
+            const float* p = vertices[indices[3 * t + 2]].position;
+            float faceNormal[3];
+            FaceNormal(a, b, p, faceNormal);
+            const float area = 0.5f * Length(faceNormal);
+            for (int axis = 0; axis < 3; axis++) {
+                centroid[axis] += area * (a[axis] + b[axis] + p[axis]) / 3.0f;
+                normal[axis] += faceNormal[axis];
+            }
+            clusterArea[c] += area;
+        }
+        for (int axis = 0; axis < 3; axis++) meshCentroid[axis] += centroid[axis];
+        meshArea += clusterArea[c];
+    }
+    if (meshArea <= 0.0f) return;
+    for (int axis = 0; axis < 3; axis++) meshCentroid[axis] /= meshArea;
+    
+    std::vector<float> sortKey(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        if (clusterArea[c] <= 0.0f) continue;
+        float centroid[3];
+        float* normal = &clusterData[6 * c + 3];
+        for (int axis = 0; axis < 3; axis++) centroid[axis] = clusterData[6 * c + axis] / clusterArea[c];
+        Normalize(normal);
+        float offset[3];
+        Subtract(centroid, meshCentroid, offset);
+        sortKey[c] = offset[0] * normal[0] + offset[1] * normal[1] + offset[2] * normal[2];
+    }
+    
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t c : order) {
+        output.insert(output.end(), indices.begin() + 3 * clusterStart[c], indices.begin() + 3 * clusterStart[c + 1]);
+    }
+    indices.swap(output);
+}
+
+// Renumber vertices in the order the triangles first use them, so fetches
+// walk the vertex buffer forwards; unused vertices drop out
+static void OptimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<BuildVertex>& vertices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<BuildVertex> ordered;
+    ordered.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+static int16_t QuantizeSnorm16(float value) {
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+// Same encoding as the renderer's PackVertex over the unit cube (origin 0,
+// half-extent 0.5)
+static LanderMeshVertex QuantizeVertex(const BuildVertex& vertex) {
+    LanderMeshVertex packed;
+    std::memset(&packed, 0, sizeof(packed));
+    for (int axis = 0; axis < 3; axis++) {
+        packed.position[axis] = QuantizeSnorm16(vertex.position[axis] / 0.5f);
+    }
+    const float* normal = vertex.normal;
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    float octX = length > 0.0f ? normal[0] / length : 0.0f;
+    float octY = length > 0.0f ? normal[1] / length : 0.0f;
+    if (length > 0.0f && normal[2] < 0.0f) {
+        float foldedX = (1.0f - std::fabs(octY)) * (octX >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::fabs(octX)) * (octY >= 0.0f ? 1.0f : -1.0f);
+        octX = foldedX;
+        octY = foldedY;
+    }
+    packed.normal[0] = QuantizeSnorm16(octX);
+    packed.normal[1] = QuantizeSnorm16(octY);
+    return packed;
+}
+
+LanderMesh::LanderMesh() {
+    std::memset(&mStats, 0, sizeof(mStats));
+}
+
+bool LanderMesh::Build(const char* filename) {
+    auto start = std::chrono::steady_clock::now();
+    
+    BuildMesh full;
+    if (!ParseObj(filename, full)) {
+        return false;
+    }
+    if (full.indices.empty()) {
+        LOG_ERROR("Lander model %s has no triangles", filename);
+        return false;
+    }
+    FitUnitCube(full);
+    
+    // The chain: the full mesh, then each grid that still saves enough
+    std::vector<BuildMesh> levels(1, full);
+    for (int grid : kLodGrids) {
+        if (static_cast<int>(levels.size()) >= kMaxLods) break;
+        BuildMesh coarse;
+        ClusterMesh(full, grid, coarse);
+        if (coarse.indices.empty() ||
+            coarse.indices.size() > kMinLodReduction * levels.back().indices.size()) {
+            continue;
+        }
+        levels.push_back(std::move(coarse));
+    }
+    
+    mVertices.clear();
+    mIndices.clear();
+    mLods.clear();
+    mStats.sourceTriangles = full.indices.size() / 3;
+    for (size_t level = 0; level < levels.size(); level++) {
+        BuildMesh& mesh = levels[level];
+        if (level == 0) {
+            mStats.cacheMissRatio[0] = CacheMissRatio(mesh.indices, mesh.vertices.size(), kCacheSize);
+        }
+        OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+        OptimizeOverdraw(mesh.indices, mesh.vertices);
+        OptimizeVertexFetch(mesh.indices, mesh.vertices);
+        if (level == 0) {
+            mStats.cacheMissRatio[1] = CacheMissRatio(mesh.indices, mesh.vertices.size(), kCacheSize);
+        }
+        
+        LanderMeshLod lod;
+        lod.firstIndex = static_cast<uint32_t>(mIndices.size());
+        lod.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        lod.firstVertex = static_cast<uint32_t>(mVertices.size());
+        lod.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        lod.error = mesh.error;
+        lod.padding = 0;
+        for (uint32_t index : mesh.indices) {
+            mIndices.push_back(lod.firstVertex + index);
+        }
+        for (const BuildVertex& vertex : mesh.vertices) {
+            mVertices.push_back(QuantizeVertex(vertex));
+        }
+        mLods.push_back(lod);
+    }
+    mStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    LOG_INFO("Built lander mesh %s: %zu triangles in %zu levels, %.2f -> %.2f cache misses per triangle (%.1f ms)",
+             filename, mStats.sourceTriangles, mLods.size(), mStats.cacheMissRatio[0], mStats.cacheMissRatio[1],
+             mStats.seconds * 1000.0);
+    return true;
+}
+
+bool LanderMesh::DescribeSource(const char* filename, char* source, size_t size) {
+    struct stat fileInfo;
+    if (stat(filename, &fileInfo) != 0) {
+        return false;
+    }
+    std::snprintf(source, size, "obj %s %lld %lld", filename, static_cast<long long>(fileInfo.st_size),
+                  static_cast<long long>(fileInfo.st_mtime));
+    return true;
+}
+
+bool LanderMesh::Load(const char* filename, const char* cacheFile) {
+    char source[256];
+    if (!DescribeSource(filename, source, sizeof(source))) {
+        LOG_ERROR("Failed to open lander model: %s", filename);
+        return false;
+    }
+    if (cacheFile && LoadCache(cacheFile, source)) {
+        return true;
+    }
+    if (!Build(filename)) {
+        return false;
+    }
+    if (cacheFile) {
+        SaveCache(cacheFile, source);
+    }
+    return true;
+}
+
+bool LanderMesh::SaveCache(const char* filename, const char* source) const {
+    if (mLods.empty()) {
+        return false;
+    }
+    
+    LanderMeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kLanderMeshCacheMagic, sizeof(header.magic));
+    header.version = kLanderMeshCacheVersion;
+    header.headerSize = sizeof(LanderMeshCacheHeader);
+    header.lodCount = static_cast<uint32_t>(mLods.size());
+    header.vertexCount = static_cast<uint32_t>(mVertices.size());
+    header.indexCount = static_cast<uint32_t>(mIndices.size());
+    std::snprintf(header.source, sizeof(header.source), "%s", source);
+    
+    const size_t lodBytes = mLods.size() * sizeof(LanderMeshLod);
+    const size_t vertexBytes = mVertices.size() * sizeof(LanderMeshVertex);
+    const size_t indexBytes = mIndices.size() * sizeof(uint32_t);
+    header.lodOffset = AlignCacheOffset(sizeof(header));
+    header.vertexOffset = AlignCacheOffset(header.lodOffset + lodBytes);
+    header.indexOffset = AlignCacheOffset(header.vertexOffset + vertexBytes);
+    header.fileSize = header.indexOffset + indexBytes;
+    
+    FILE* file = std::fopen(filename, "wb");
+    if (!file) {
+        LOG_ERROR("Failed to create lander mesh cache: %s", filename);
+        return false;
+    }
+    
+    static const char kZeros[16] = {};
+    auto writeAt = [&](uint64_t offset, const void* data, size_t size) {
+        long position = std::ftell(file);
+        bool ok = position >= 0 && offset >= static_cast<uint64_t>(position) &&
+                  std::fwrite(kZeros, 1, offset - position, file) == offset - position;
+        return ok && std::fwrite(data, 1, size, file) == size;
+    };
+    bool written = writeAt(0, &header, sizeof(header)) &&
+                   writeAt(header.lodOffset, mLods.data(), lodBytes) &&
+                   writeAt(header.vertexOffset, mVertices.data(), vertexBytes) &&
+                   writeAt(header.indexOffset, mIndices.data(), indexBytes);
+    written = std::fclose(file) == 0 && written;
+    if (!written) {
+        LOG_ERROR("Failed to write lander mesh cache: %s", filename);
+        std::remove(filename);
+        return false;
+    }
+    
+    LOG_INFO("Wrote lander mesh cache %s (%llu KB)", filename,
+             static_cast<unsigned long long>(header.fileSize >> 10));
+    return true;
+}
+
+bool LanderMesh::LoadCache(const char* filename, const char* source) {
+    FILE* file = std::fopen(filename, "rb");
+    if (!file) {
+        return false;
+    }
+    
+    // Everything is checked against the header before any state changes
+    LanderMeshCacheHeader header;
+    const char* problem = nullptr;
+    long fileSize = -1;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || std::fseek(file, 0, SEEK_END) != 0 ||
+        (fileSize = std::ftell(file)) < 0) {
+        problem = "truncated or corrupt";
+    } else {
+        header.source[sizeof(header.source) - 1] = '\0';
+        const uint64_t lodEnd = header.lodOffset + uint64_t(header.lodCount) * sizeof(LanderMeshLod);
+        const uint64_t vertexEnd = header.vertexOffset + uint64_t(header.vertexCount) * sizeof(LanderMeshVertex);
+        const uint64_t indexEnd = header.indexOffset + uint64_t(header.indexCount) * sizeof(uint32_t);
+        if (std::memcmp(header.magic, kLanderMeshCacheMagic, sizeof(header.magic)) != 0) {
+            problem = "not a lander mesh cache";
+        } else if (header.version != kLanderMeshCacheVersion || header.headerSize != sizeof(LanderMeshCacheHeader)) {
+            problem = "written by a different version";
+        } else if (std::strcmp(header.source, source) != 0) {
+            problem = "built from a different model";
+        } else if (header.lodCount == 0 || header.lodCount > kMaxLods ||
+                   header.fileSize != static_cast<uint64_t>(fileSize) ||
+                   lodEnd > header.fileSize || vertexEnd > header.fileSize || indexEnd > header.fileSize) {
+            problem = "truncated or corrupt";
+        }
+    }
+    
+    std::vector<LanderMeshLod> lods;
+    std::vector<LanderMeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    if (!problem) {
+        lods.resize(header.lodCount);
+        vertices.resize(header.vertexCount);
+        indices.resize(header.indexCount);
+        auto readAt = [&](uint64_t offset, void* data, size_t size) {
+            return std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0 &&
+                   std::fread(data, 1, size, file) == size;
+        };
+        if (!readAt(header.lodOffset, lods.data(), lods.size() * sizeof(LanderMeshLod)) ||
+            !readAt(header.vertexOffset, vertices.data(), vertices.size() * sizeof(LanderMeshVertex)) ||
+            !readAt(header.indexOffset, indices.data(), indices.size() * sizeof(uint32_t))) {
+            problem = "truncated or corrupt";
+        }
+    }
+    std::fclose(file);
+    
+    // Ranges must stay inside the arrays the renderer uploads
+    for (size_t i = 0; !problem && i < lods.size(); i++) {
+        const LanderMeshLod& lod = lods[i];
+        if (uint64_t(lod.firstIndex) + lod.indexCount > indices.size() ||
+            uint64_t(lod.firstVertex) + lod.vertexCount > vertices.size()) {
+            problem = "truncated or corrupt";
+        }
+        for (uint32_t j = 0; !problem && j < lod.indexCount; j++) {
+            const uint32_t index = indices[lod.firstIndex + j];
+            if (index < lod.firstVertex || index >= lod.firstVertex + lod.vertexCount) {
+                problem = "truncated or corrupt";
+            }
+        }
+    }
+    if (problem) {
+        LOG_INFO("Ignoring lander mesh cache %s (%s)", filename, problem);
+        return false;
+    }
+    
+    mLods.swap(lods);
+    mVertices.swap(vertices);
+    mIndices.swap(indices);
+    std::memset(&mStats, 0, sizeof(mStats));
+    mStats.sourceTriangles = mLods[0].indexCount / 3;
+    LOG_INFO("Loaded lander mesh cache %s: %u triangles in %zu levels", filename,
+             mLods[0].indexCount / 3, mLods.size());
+    return true;
+}
+
+int LanderMesh::SelectLod(const std::vector<LanderMeshLod>& lods, float unitPixels, float maxError) {
+    for (int level = static_cast<int>(lods.size()) - 1; level > 0; level--) {
+        if (lods[level].error * unitPixels <= maxError) {
+            return level;
+        }
+    }
+    return 0;
+}
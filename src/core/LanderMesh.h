@@ -0,0 +1,88 @@
+// LanderMesh.h
+// Lander models from OBJ files: optimized, quantized LOD chains and their binary cache
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GPU-ready vertex, laid out as the renderer's PackedVertex: position as
+// snorm16 over the unit cube [-0.5, 0.5]^3 (w unused), octahedral snorm16
+// normal, no flags
+struct LanderMeshVertex {
+    int16_t position[4];
+    int16_t normal[2];
+    uint8_t flags;
+    uint8_t padding[3];
+};
+
+static_assert(sizeof(LanderMeshVertex) == 16, "LanderMeshVertex must match PackedVertex");
+
+// One level of detail: a range of the shared vertex and index arrays.
+// Indices are absolute, so a level draws from its first index alone.
+struct LanderMeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    float error;            // Largest distance from the full mesh, in unit cube sides
+    uint32_t padding;
+};
+
+// How the last Build went, for logs and the tool's report
+struct LanderMeshStats {
+    size_t sourceTriangles;
+    float cacheMissRatio[2];    // Average misses per triangle of level 0 in a 32-entry cache, before and after
+    double seconds;
+};
+
+// A lander model as the renderer draws it. Build() reads an OBJ file
+// (positions, optional normals, polygons fanned into triangles), welds it
+// and stretches it to the unit cube the renderer scales to the lander's
+// box, so the model fills the collision box whatever its units. The full
+// model is level 0; the coarser levels come from vertex clustering on
+// ever coarser grids, which keeps creases by clustering each normal
+// direction separately. Every level then gets its triangles ordered for
+// the post-transform cache (Forsyth's linear-speed optimizer), its cache
+// clusters ordered outside-in against overdraw, and its vertices ordered
+// by first use before they are quantized.
+//
+// SaveCache writes the result as raw arrays; LoadCache reads them back if
+// the cache was built from the same source file (path, size and
+// modification time) by the same format version.
+class LanderMesh {
+public:
+    static constexpr int kMaxLods = 4;
+    static constexpr int kCacheSize = 32;           // Modeled post-transform cache entries
+    
+    LanderMesh();
+    
+    // The model at filename, from cacheFile if that is up to date (and
+    // written to it otherwise; null = no cache)
+    bool Load(const char* filename, const char* cacheFile);
+    
+    bool Build(const char* filename);
+    bool SaveCache(const char* filename, const char* source) const;
+    bool LoadCache(const char* filename, const char* source);
+    
+    // What a cache of filename must have been built from; false if the
+    // file can't be read
+    static bool DescribeSource(const char* filename, char* source, size_t size);
+    
+    // The coarsest of lods whose error stays within maxError pixels when
+    // one unit cube side covers unitPixels pixels
+    static int SelectLod(const std::vector<LanderMeshLod>& lods, float unitPixels, float maxError);
+    
+    bool IsLoaded() const { return !mLods.empty(); }
+    const std::vector<LanderMeshVertex>& GetVertices() const { return mVertices; }
+    const std::vector<uint32_t>& GetIndices() const { return mIndices; }
+    const std::vector<LanderMeshLod>& GetLods() const { return mLods; }
+    const LanderMeshStats& GetStats() const { return mStats; }
+
+private:
+    std::vector<LanderMeshVertex> mVertices;
+    std::vector<uint32_t> mIndices;
+    std::vector<LanderMeshLod> mLods;
+    LanderMeshStats mStats;
+};
@@ -0,0 +1,191 @@
+// LatencyTracker.cpp
+// Sample bookkeeping and the latency histogram
+
+#include "LatencyTracker.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Where a sample has got to
+enum class LatencyStage : uint8_t {
+    Free,
+    Taken,      // Its step is running
+    Stepped,    // Waiting for a frame
+    Submitted   // Waiting for the display
+};
+
+struct LatencySample {
+    LatencyStage stage;
+    uint64_t frame;
+    uint64_t eventNs;
+    uint64_t stepNs;
+    uint64_t submitNs;
+    uint64_t completeNs;    // 0 until the GPU finishes the frame
+};
+
+static std::atomic<bool> sEnabled{false};
+static std::mutex sMutex;
+static LatencySample sSamples[LatencyTracker::kMaxSamples];
+static uint64_t sNextFrame = 1;
+static uint64_t sNextSlot = 0;
+
+// Finished samples
+static uint64_t sHistogram[LatencyTracker::kHistogramBuckets];
+static uint64_t sFinished = 0;
+static uint64_t sNotDisplayed = 0;  // Of those, drawn in frames that never reached the display
+static uint64_t sOverwritten = 0;   // Dropped while still in flight
+static double sStepMs = 0.0;        // Summed stage times
+static double sSubmitMs = 0.0;
+static double sGpuMs = 0.0;
+static double sDisplayMs = 0.0;
+static double sTotalMs = 0.0;
+static double sMaxMs = 0.0;
+
+static double ToMs(uint64_t fromNs, uint64_t toNs) {
+    return toNs > fromNs ? (toNs - fromNs) / 1.0e6 : 0.0;
+}
+
+void LatencyTracker::SetEnabled(bool enabled) {
+    sEnabled.store(enabled);
+}
+
+bool LatencyTracker::IsEnabled() {
+    return sEnabled.load(std::memory_order_relaxed);
+}
+
+void LatencyTracker::OnInputTaken(uint64_t eventNs) {
+    if (!IsEnabled()) return;
+    std::lock_guard<std::mutex> lock(sMutex);
+    
+    // Round robin over the slots; one still in flight is dropped
+    LatencySample& sample = sSamples[sNextSlot++ % kMaxSamples];
+    if (sample.stage != LatencyStage::Free) {
+        sOverwritten++;
+    }
+    sample = {};
+    sample.stage = LatencyStage::Taken;
+    sample.eventNs = eventNs;
+}
+
+void LatencyTracker::OnStepEnd() {
+    if (!IsEnabled()) return;
+    const uint64_t now = Profiler::Now();
+    std::lock_guard<std::mutex> lock(sMutex);
+    for (LatencySample& sample : sSamples) {
+        if (sample.stage == LatencyStage::Taken) {
+            sample.stage = LatencyStage::Stepped;
+            sample.stepNs = now;
+        }
+    }
+}
+
+uint64_t LatencyTracker::OnFrameSubmitted() {
+    if (!IsEnabled()) return 0;
+    const uint64_t now = Profiler::Now();
+    std::lock_guard<std::mutex> lock(sMutex);
+    uint64_t frame = 0;
+    for (LatencySample& sample : sSamples) {
+        if (sample.stage == LatencyStage::Stepped) {
+            if (frame == 0) {
+                frame = sNextFrame++;
+            }
+            sample.stage = LatencyStage::Submitted;
+            sample.frame = frame;
+            sample.submitNs = now;
+        }
+    }
+    return frame;
+}
+
+void LatencyTracker::OnFrameCompleted(uint64_t frame) {
+    if (frame == 0) return;
+    const uint64_t now = Profiler::Now();
+    std::lock_guard<std::mutex> lock(sMutex);
+    for (LatencySample& sample : sSamples) {
+        if (sample.stage == LatencyStage::Submitted && sample.frame == frame) {
+            sample.completeNs = now;
+        }
+    }
+}
+
+void LatencyTracker::OnFramePresented(uint64_t frame, uint64_t presentNs) {
+    if (frame == 0) return;
+    const uint64_t now = Profiler::Now();
+    std::lock_guard<std::mutex> lock(sMutex);
+    for (LatencySample& sample : sSamples) {
+        if (sample.stage != LatencyStage::Submitted || sample.frame != frame) {
+            continue;
+        }
+        
+        // A frame that never showed counts up to when it was known not to
+        if (presentNs == 0) {
+            sNotDisplayed++;
+            presentNs = sample.completeNs ? sample.completeNs : now;
+        }
+        const uint64_t completeNs = sample.completeNs ? sample.completeNs : presentNs;
+        const double totalMs = ToMs(sample.eventNs, presentNs);
+        sStepMs += ToMs(sample.eventNs, sample.stepNs);
+        sSubmitMs += ToMs(sample.stepNs, sample.submitNs);
+        sGpuMs += ToMs(sample.submitNs, completeNs);
+        sDisplayMs += ToMs(completeNs, presentNs);
+        sTotalMs += totalMs;
+        sMaxMs = std::max(sMaxMs, totalMs);
+        sHistogram[std::min(static_cast<int>(totalMs), kHistogramBuckets - 1)]++;
+        sFinished++;
+        sample.stage = LatencyStage::Free;
+    }
+}
+
+uint64_t LatencyTracker::FromHostSeconds(double seconds) {
+    const double hostNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+    const double ns = static_cast<double>(Profiler::Now()) + seconds * 1.0e9 - hostNs;
+    return ns > 0.0 ? static_cast<uint64_t>(ns) : 0;
+}
+
+void LatencyTracker::LogReport() {
+    if (!IsEnabled()) return;
+    std::lock_guard<std::mutex> lock(sMutex);
+    if (sFinished == 0) {
+        LOG_INFO("Latency: no input reached the display");
+        return;
+    }
+    
+    // Upper edge of the bucket holding each percentile
+    auto percentile = [](double fraction) {
+        const uint64_t rank = static_cast<uint64_t>(fraction * (sFinished - 1));
+        uint64_t seen = 0;
+        for (int i = 0; i < kHistogramBuckets; i++) {
+            seen += sHistogram[i];
+            if (seen > rank) return i + 1;
+        }
+        return kHistogramBuckets;
+    };
+    const double count = static_cast<double>(sFinished);
+    LOG_INFO("Latency: %llu inputs, mean %.1f ms, p50 <%d ms, p90 <%d ms, p99 <%d ms, max %.1f ms",
+             static_cast<unsigned long long>(sFinished), sTotalMs / count, percentile(0.5),
+             percentile(0.9), percentile(0.99), sMaxMs);
+    LOG_INFO("Latency stages: event to step end %.1f ms, to frame commit %.1f ms, GPU %.1f ms, "
+             "to display %.1f ms (mean)", sStepMs / count, sSubmitMs / count, sGpuMs / count,
+             sDisplayMs / count);
+    if (sNotDisplayed > 0 || sOverwritten > 0) {
+        LOG_INFO("Latency: %llu inputs never displayed, %llu dropped in flight",
+                 static_cast<unsigned long long>(sNotDisplayed), static_cast<unsigned long long>(sOverwritten));
+    }
+    
+    // One bar per non-empty bucket, the fullest 40 wide
+    uint64_t fullest = 0;
+    for (uint64_t bucket : sHistogram) {
+        fullest = std::max(fullest, bucket);
+    }
+    for (int i = 0; i < kHistogramBuckets; i++) {
+        if (sHistogram[i] == 0) continue;
+        const int width = static_cast<int>((sHistogram[i] * 40 + fullest - 1) / fullest);
+        LOG_INFO("Latency %3d%s ms %6llu %s", i, i == kHistogramBuckets - 1 ? "+" : " ",
+                 static_cast<unsigned long long>(sHistogram[i]), std::string(width, '#').c_str());
+    }
+}
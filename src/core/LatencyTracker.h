@@ -0,0 +1,47 @@
+// LatencyTracker.h
+// Input-to-photon latency: key changes followed through step, frame and display
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Instrumentation mode, off unless enabled. Each thrust or rotate key change
+// is a sample timed on the Profiler::Now() clock at its SDL event, at the
+// end of the fixed step that took it, at the commit of the frame that drew
+// that step, at the GPU finishing the frame and at the frame reaching the
+// display. Renderers without a display callback report the display time
+// when their present returns. Finished samples go into a 1 ms histogram.
+//
+// Callbacks may come from any thread (Metal's handlers do); a mutex guards
+// the samples, and every call returns at once while disabled.
+class LatencyTracker {
+public:
+    static constexpr int kHistogramBuckets = 100;   // 1 ms each, the last holding anything later
+    static constexpr int kMaxSamples = 64;          // In flight; the oldest is dropped past this
+    
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled();
+    
+    // A fixed step took a key change that happened at eventNs
+    static void OnInputTaken(uint64_t eventNs);
+    
+    // The step taking the changes reported since the last call finished
+    static void OnStepEnd();
+    
+    // A frame drawing every finished step is being committed; returns its
+    // id for the two calls below, or 0 if no sample waits on it
+    static uint64_t OnFrameSubmitted();
+    
+    // The GPU finished frame, which then reached the display at presentNs
+    // (0 if it never did, e.g. a drawable dropped by the compositor)
+    static void OnFrameCompleted(uint64_t frame);
+    static void OnFramePresented(uint64_t frame, uint64_t presentNs);
+    
+    // Profiler::Now() time of a CFTimeInterval on the host clock, which
+    // std::chrono::steady_clock also counts on Apple platforms
+    static uint64_t FromHostSeconds(double seconds);
+    
+    // Percentiles, mean time per stage and the histogram
+    static void LogReport();
+};
@@ -0,0 +1,249 @@
+// Log.cpp
+// Implementation of the asynchronous logger
+
+#include "Log.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// A queued message. sequence implements the bounded MPMC queue of
+// D. Vyukov: a slot is free for the producer claiming position p when
+// sequence == p, and holds a message for the consumer when sequence == p + 1.
+struct LogSlot {
+    std::atomic<size_t> sequence;
+    LogLevel level;
+    uint32_t suppressed;
+    uint64_t timeNs;
+    char text[Log::kMaxMessageLength];
+};
+
+static_assert((Log::kQueueSize & (Log::kQueueSize - 1)) == 0, "Log queue size must be a power of two");
+
+std::atomic<int> Log::sLevel(LOG_LEVEL_INFO);
+
+static const std::chrono::steady_clock::time_point sLogEpoch = std::chrono::steady_clock::now();
+
+static LogSlot sSlots[Log::kQueueSize];
+static std::atomic<size_t> sEnqueuePos(0);
+static size_t sDequeuePos = 0;   // Writer thread only
+static std::atomic<uint64_t> sDropped(0);
+static bool sSlotsInitialized = false;
+
+// Writer thread
+static std::thread sWriterThread;
+static std::atomic<bool> sRunning(false);
+static std::atomic<bool> sStopping(false);
+static std::atomic<int> sActiveWriters(0);  // Write calls past the sRunning check
+static std::mutex sWakeMutex;
+static std::condition_variable sWakeCondition;
+
+static uint64_t LogNowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - sLogEpoch).count());
+}
+
+static const char* LevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug:   return "DEBUG";
+        case LogLevel::Info:    return "INFO";
+        case LogLevel::Warning: return "WARNING";
+        case LogLevel::Error:   return "ERROR";
+    }
+    return "?";
+}
+
+// Warnings and errors go to stderr, everything else to stdout
+static void EmitLine(LogLevel level, uint64_t timeNs, uint32_t suppressed, const char* text) {
+    FILE* stream = level >= LogLevel::Warning ? stderr : stdout;
+    if (suppressed > 0) {
+        std::fprintf(stream, "[%10.3f] %-7s %s (%u similar suppressed)\n",
+                     timeNs * 1e-9, LevelName(level), text, suppressed);
+    } else {
+        std::fprintf(stream, "[%10.3f] %-7s %s\n", timeNs * 1e-9, LevelName(level), text);
+    }
+}
+
+// Write out everything queued; returns true if anything was written
+static bool DrainQueue() {
+    bool wroteAny = false;
+
+    for (;;) {
+        LogSlot& slot = sSlots[sDequeuePos & (Log::kQueueSize - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != sDequeuePos + 1) {
+            break;
+        }
+
+        EmitLine(slot.level, slot.timeNs, slot.suppressed, slot.text);
+        slot.sequence.store(sDequeuePos + Log::kQueueSize, std::memory_order_release);
+        ++sDequeuePos;
+        wroteAny = true;
+    }
+
+    if (wroteAny) {
+        std::fflush(stdout);
+        std::fflush(stderr);
+    }
+    return wroteAny;
+}
+
+static void WriterLoop() {
+    uint64_t reportedDrops = 0;
+
+    for (;;) {
+        bool wroteAny = DrainQueue();
+
+        uint64_t dropped = sDropped.load(std::memory_order_relaxed);
+        if (dropped != reportedDrops) {
+            char text[Log::kMaxMessageLength];
+            std::snprintf(text, sizeof(text), "Log queue full, %llu messages dropped so far",
+                          static_cast<unsigned long long>(dropped));
+            EmitLine(LogLevel::Warning, LogNowNs(), 0, text);
+            std::fflush(stderr);
+            reportedDrops = dropped;
+        }
+
+        if (!wroteAny) {
+            if (sStopping.load(std::memory_order_acquire)) {
+                break;
+            }
+
+            // Producers only signal for warnings and errors, so poll as well
+            std::unique_lock<std::mutex> lock(sWakeMutex);
+            sWakeCondition.wait_for(lock, std::chrono::milliseconds(5));
+        }
+    }
+
+    // Anything queued between the last drain and the stop request
+    DrainQueue();
+}
+
+void Log::Start() {
+    if (sRunning.load()) {
+        return;
+    }
+
+    // Every slot starts out free for the producer claiming its index
+    if (!sSlotsInitialized) {
+        for (size_t i = 0; i < static_cast<size_t>(kQueueSize); ++i) {
+            sSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        sSlotsInitialized = true;
+    }
+
+    sStopping.store(false);
+    sWriterThread = std::thread(WriterLoop);
+    sRunning.store(true, std::memory_order_release);
+}
+
+void Log::Stop() {
+    if (!sRunning.load()) {
+        return;
+    }
+
+    // Later messages are written synchronously. A Write that saw sRunning
+    // before the store may still be queueing; wait for it so the writer's
+    // final drain sees its message.
+    sRunning.store(false);
+    while (sActiveWriters.load() != 0) {
+        std::this_thread::yield();
+    }
+    sStopping.store(true, std::memory_order_release);
+    sWakeCondition.notify_one();
+    sWriterThread.join();
+}
+
+bool Log::ParseLevel(const char* name, LogLevel& level) {
+    if (std::strcmp(name, "debug") == 0) {
+        level = LogLevel::Debug;
+    } else if (std::strcmp(name, "info") == 0) {
+        level = LogLevel::Info;
+    } else if (std::strcmp(name, "warning") == 0) {
+        level = LogLevel::Warning;
+    } else if (std::strcmp(name, "error") == 0) {
+        level = LogLevel::Error;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Log::Write(LogLevel level, uint32_t suppressed, const char* format, ...) {
+    uint64_t timeNs = LogNowNs();
+
+    va_list args;
+    va_start(args, format);
+
+    // Announce the write before checking sRunning (both sequentially
+    // consistent), so Stop either sees it in flight or we see it stopped
+    sActiveWriters.fetch_add(1);
+    if (!sRunning.load()) {
+        sActiveWriters.fetch_sub(1, std::memory_order_release);
+
+        // No writer thread: format and write on the calling thread
+        char text[kMaxMessageLength];
+        std::vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        EmitLine(level, timeNs, suppressed, text);
+        std::fflush(level >= LogLevel::Warning ? stderr : stdout);
+        return;
+    }
+
+    // Claim a slot
+    LogSlot* slot = nullptr;
+    size_t pos = sEnqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        slot = &sSlots[pos & (kQueueSize - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+        if (difference == 0) {
+            if (sEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // Queue full: drop rather than block the caller
+            va_end(args);
+            sDropped.fetch_add(1, std::memory_order_relaxed);
+            sActiveWriters.fetch_sub(1, std::memory_order_release);
+            return;
+        } else {
+            pos = sEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Format straight into the slot, then publish it
+    std::vsnprintf(slot->text, sizeof(slot->text), format, args);
+    va_end(args);
+    slot->level = level;
+    slot->suppressed = suppressed;
+    slot->timeNs = timeNs;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    sActiveWriters.fetch_sub(1, std::memory_order_release);
+
+    if (level >= LogLevel::Warning) {
+        sWakeCondition.notify_one();
+    }
+}
+
+uint64_t Log::GetDroppedCount() {
+    return sDropped.load(std::memory_order_relaxed);
+}
+
+bool LogRateLimiter::Allow(uint32_t& suppressed) {
+    uint64_t now = LogNowNs();
+    uint64_t next = mNextNs.load(std::memory_order_relaxed);
+
+    // Only the caller that moves the deadline forward gets to log
+    if (now < next || !mNextNs.compare_exchange_strong(next, now + mIntervalNs,
+                                                        std::memory_order_relaxed)) {
+        mSuppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    suppressed = mSuppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,141 @@
+// Log.h
+// Leveled, rate-limited logging drained by a background writer thread
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Levels as integers so the preprocessor can strip them
+#define LOG_LEVEL_DEBUG   0
+#define LOG_LEVEL_INFO    1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR   3
+
+// Calls below LOG_COMPILE_LEVEL generate no code (arguments are type-checked
+// but never evaluated). Release builds drop debug logging by default.
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_PRINTF_FORMAT(formatIndex, firstArg) __attribute__((format(printf, formatIndex, firstArg)))
+#else
+#define LOG_PRINTF_FORMAT(formatIndex, firstArg)
+#endif
+
+enum class LogLevel : int {
+    Debug = LOG_LEVEL_DEBUG,
+    Info = LOG_LEVEL_INFO,
+    Warning = LOG_LEVEL_WARNING,
+    Error = LOG_LEVEL_ERROR
+};
+
+class Log {
+public:
+    static constexpr int kQueueSize = 1024;       // Pending messages (power of two)
+    static constexpr int kMaxMessageLength = 256; // Longer messages are truncated
+
+    // Start/stop the writer thread. Without it (before Start, after Stop)
+    // messages are written synchronously by the caller.
+    static void Start();
+    static void Stop();
+
+    // Runtime threshold on top of LOG_COMPILE_LEVEL (default Info)
+    static void SetLevel(LogLevel level) { sLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+    static LogLevel GetLevel() { return static_cast<LogLevel>(sLevel.load(std::memory_order_relaxed)); }
+    static bool IsEnabled(LogLevel level) {
+        return static_cast<int>(level) >= sLevel.load(std::memory_order_relaxed);
+    }
+
+    // Parse "debug", "info", "warning" or "error"; returns false if unknown
+    static bool ParseLevel(const char* name, LogLevel& level);
+
+    // Format and queue a message. suppressed is the number of calls a rate
+    // limiter swallowed since this call site last logged.
+    static void Write(LogLevel level, uint32_t suppressed, const char* format, ...) LOG_PRINTF_FORMAT(3, 4);
+
+    // Messages lost because the queue was full
+    static uint64_t GetDroppedCount();
+
+private:
+    static std::atomic<int> sLevel;
+};
+
+// Per-call-site limiter: lets one message through per interval and counts
+// the rest. Constant-initialized, so a static instance needs no init guard.
+class LogRateLimiter {
+public:
+    constexpr explicit LogRateLimiter(uint32_t intervalMs)
+        : mIntervalNs(static_cast<uint64_t>(intervalMs) * 1000000ull), mNextNs(0), mSuppressed(0) {}
+
+    // True if this call may log; suppressed receives the calls skipped since
+    // the last one that did
+    bool Allow(uint32_t& suppressed);
+
+private:
+    const uint64_t mIntervalNs;
+    std::atomic<uint64_t> mNextNs;
+    std::atomic<uint32_t> mSuppressed;
+};
+
+#define LOG_AT(level, ...) \
+    do { \
+        if (Log::IsEnabled(level)) { \
+            Log::Write(level, 0, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_AT_EVERY(level, intervalMs, ...) \
+    do { \
+        if (Log::IsEnabled(level)) { \
+            static LogRateLimiter logRateLimiter(intervalMs); \
+            uint32_t logSuppressed = 0; \
+            if (logRateLimiter.Allow(logSuppressed)) { \
+                Log::Write(level, logSuppressed, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+// Stripped calls are still type-checked (and keep their arguments "used")
+// but the dead branch generates no code
+#define LOG_STRIPPED(level, ...) \
+    do { \
+        if (false) { \
+            Log::Write(level, 0, __VA_ARGS__); \
+        } \
+    } while (0)
+
+// LOG_<LEVEL>(format, ...) logs every call; LOG_<LEVEL>_EVERY(ms, format, ...)
+// logs at most once per ms milliseconds from that call site
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_DEBUG_EVERY(intervalMs, ...) LOG_AT_EVERY(LogLevel::Debug, intervalMs, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_STRIPPED(LogLevel::Debug, __VA_ARGS__)
+#define LOG_DEBUG_EVERY(intervalMs, ...) LOG_STRIPPED(LogLevel::Debug, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_INFO_EVERY(intervalMs, ...) LOG_AT_EVERY(LogLevel::Info, intervalMs, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_STRIPPED(LogLevel::Info, __VA_ARGS__)
+#define LOG_INFO_EVERY(intervalMs, ...) LOG_STRIPPED(LogLevel::Info, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) LOG_AT(LogLevel::Warning, __VA_ARGS__)
+#define LOG_WARNING_EVERY(intervalMs, ...) LOG_AT_EVERY(LogLevel::Warning, intervalMs, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) LOG_STRIPPED(LogLevel::Warning, __VA_ARGS__)
+#define LOG_WARNING_EVERY(intervalMs, ...) LOG_STRIPPED(LogLevel::Warning, __VA_ARGS__)
+#endif
+
+// Errors are never stripped
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+#define LOG_ERROR_EVERY(intervalMs, ...) LOG_AT_EVERY(LogLevel::Error, intervalMs, __VA_ARGS__)
@@ -0,0 +1,139 @@
+// Lz4.cpp
+// LZ4 block compressor and bounds-checked decompressor
+
+#include "Lz4.h"
+#include <cstring>
+
+// Block format limits: matches are at least 4 bytes, the last 5 bytes are
+// always literals and no match starts in the last 12
+static const size_t kMinMatch = 4;
+static const size_t kLastLiterals = 5;
+static const size_t kMatchStartLimit = 12;
+static const size_t kMaxOffset = 65535;
+static const int kHashLog = 12;
+
+static uint32_t Read32(const uint8_t* bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - kHashLog);
+}
+
+// Length past the 15 a token holds: runs of 255 and a final remainder
+static bool WriteLength(size_t length, uint8_t*& out, const uint8_t* end) {
+    for (; length >= 255; length -= 255) {
+        if (out >= end) return false;
+        *out++ = 255;
+    }
+    if (out >= end) return false;
+    *out++ = static_cast<uint8_t>(length);
+    return true;
+}
+
+static bool ReadLength(size_t& length, const uint8_t*& in, const uint8_t* end) {
+    uint8_t byte;
+    do {
+        if (in >= end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// One sequence: literals, then (unless last) a match of matchLength at offset
+static bool WriteSequence(const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength,
+                          uint8_t*& out, const uint8_t* end) {
+    if (out >= end) return false;
+    uint8_t* token = out++;
+    *token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15 && !WriteLength(literalLength - 15, out, end)) return false;
+    if (static_cast<size_t>(end - out) < literalLength) return false;
+    std::memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0) return true;
+    
+    if (end - out < 2) return false;
+    *out++ = static_cast<uint8_t>(offset & 0xFF);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    const size_t extra = matchLength - kMinMatch;
+    *token |= static_cast<uint8_t>(extra < 15 ? extra : 15);
+    return extra < 15 || WriteLength(extra - 15, out, end);
+}
+
+size_t Lz4::Compress(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity) {
+    uint8_t* out = destination;
+    const uint8_t* end = destination + capacity;
+    size_t anchor = 0;
+    
+    // Positions of the last 4-byte strings seen per hash; a stale or
+    // colliding entry just fails the compare
+    if (size > kMatchStartLimit) {
+        uint32_t table[1 << kHashLog] = {};
+        const size_t matchStartLimit = size - kMatchStartLimit;
+        const size_t matchEndLimit = size - kLastLiterals;
+        size_t position = 0;
+        while (position < matchStartLimit) {
+            const uint32_t value = Read32(source + position);
+            const uint32_t hash = Hash(value);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(position);
+            if (candidate >= position || position - candidate > kMaxOffset || Read32(source + candidate) != value) {
+                position++;
+                continue;
+            }
+            
+            // Widen the match both ways as far as the format allows
+            while (position > anchor && candidate > 0 && source[position - 1] == source[candidate - 1]) {
+                position--;
+                candidate--;
+            }
+            size_t length = kMinMatch;
+            while (position + length < matchEndLimit && source[position + length] == source[candidate + length]) {
+                length++;
+            }
+            if (!WriteSequence(source + anchor, position - anchor, position - candidate, length, out, end)) {
+                return 0;
+            }
+            position += length;
+            anchor = position;
+        }
+    }
+    if (!WriteSequence(source + anchor, size - anchor, 0, 0, out, end)) {
+        return 0;
+    }
+    return static_cast<size_t>(out - destination);
+}
+
+bool Lz4::Decompress(const uint8_t* source, size_t size, uint8_t* destination, size_t decodedSize) {
+    const uint8_t* in = source;
+    const uint8_t* inEnd = source + size;
+    size_t written = 0;
+    while (in < inEnd) {
+        const uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(literalLength, in, inEnd)) return false;
+        if (static_cast<size_t>(inEnd - in) < literalLength || decodedSize - written < literalLength) return false;
+        std::memcpy(destination + written, in, literalLength);
+        in += literalLength;
+        written += literalLength;
+        if (in == inEnd) break;
+        
+        // Matches may overlap their own output, so copy forwards bytewise
+        if (inEnd - in < 2) return false;
+        const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(matchLength, in, inEnd)) return false;
+        matchLength += kMinMatch;
+        if (offset == 0 || offset > written || decodedSize - written < matchLength) return false;
+        const uint8_t* match = destination + written - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            destination[written + i] = match[i];
+        }
+        written += matchLength;
+    }
+    return written == decodedSize;
+}
@@ -0,0 +1,24 @@
+// Lz4.h
+// LZ4 block compression for terrain packs
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The LZ4 block format (no frame header or checksums), so any LZ4 decoder
+// reads what Compress writes. The compressor is the greedy single-probe
+// one: fast rather than tight, which suits data already shaped by a
+// predictor. Decompress checks every length and offset against both
+// buffers, so a corrupt block fails instead of reading or writing past them.
+class Lz4 {
+public:
+    // Largest block Compress can produce from size bytes
+    static size_t CompressBound(size_t size) { return size + size / 255 + 16; }
+    
+    // Compressed size, or 0 if it would not fit in capacity
+    static size_t Compress(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity);
+    
+    // True if the block decodes to exactly decodedSize bytes
+    static bool Decompress(const uint8_t* source, size_t size, uint8_t* destination, size_t decodedSize);
+};
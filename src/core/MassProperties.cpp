@@ -0,0 +1,51 @@
+// MassProperties.cpp
+// Dry and propellant inertia, and their sum for the fuel on board
+
+#include "MassProperties.h"
+#include <cmath>
+
+MassProperties::MassProperties()
+    : mDryMass(0.0f)
+    , mFuel(0.0f)
+    , mMass(0.0f)
+    , mAppliedMass(0.0f)
+{
+    for (int i = 0; i < 3; i++) {
+        mDryInertia[i] = 0.0f;
+        mFuelInertia[i] = 0.0f;
+        mInertia[i] = 0.0f;
+    }
+}
+
+void MassProperties::Configure(float dryMass, const float* halfExtents) {
+    // A solid box of half extents (a, b, c) has Ixx = m (b^2 + c^2) / 3
+    const float squares[3] = { halfExtents[0] * halfExtents[0], halfExtents[1] * halfExtents[1],
+                               halfExtents[2] * halfExtents[2] };
+    const float tankScale = kTankScale * kTankScale;
+    for (int i = 0; i < 3; i++) {
+        const float sum = squares[(i + 1) % 3] + squares[(i + 2) % 3];
+        mDryInertia[i] = dryMass * sum / 3.0f;
+        mFuelInertia[i] = tankScale * sum / 3.0f;
+    }
+    mDryMass = dryMass;
+    
+    // Recompute for the fuel already on board
+    const float fuel = mFuel;
+    mFuel = -1.0f;
+    SetFuel(fuel);
+}
+
+void MassProperties::SetFuel(float fuel) {
+    if (fuel == mFuel) {
+        return;
+    }
+    mFuel = fuel;
+    mMass = mDryMass + fuel;
+    for (int i = 0; i < 3; i++) {
+        mInertia[i] = mDryInertia[i] + fuel * mFuelInertia[i];
+    }
+}
+
+bool MassProperties::IsStale() const {
+    return std::fabs(mMass - mAppliedMass) > kApplyThreshold;
+}
@@ -0,0 +1,46 @@
+// MassProperties.h
+// The lander's mass and inertia as its propellant burns off
+
+#pragma once
+
+// Mass and principal inertia of a lander made of a dry structure and the
+// propellant left in its tank. The structure is a solid box; the
+// propellant fills a box-shaped tank around the center of mass, kTankScale
+// of the hull's size on each axis, and wets it evenly however full it is.
+// Neither shifts the center of mass, and the tank's inertia per kilogram
+// is fixed, so the whole tensor is linear in the fuel mass: Configure()
+// works out the two parts once and SetFuel() is a multiply-add per axis.
+//
+// Bodies built from it only need their mass properties reset once the
+// mass has moved kApplyThreshold past what they last took (IsStale()).
+class MassProperties {
+public:
+    static constexpr float kTankScale = 0.6f;
+    static constexpr float kApplyThreshold = 1.0f;     // kg
+    
+    MassProperties();
+    
+    // Structure of dryMass kg in a box of the given half extents (meters)
+    void Configure(float dryMass, const float* halfExtents);
+    
+    void SetFuel(float fuel);
+    
+    float GetDryMass() const { return mDryMass; }
+    float GetMass() const { return mMass; }
+    const float* GetInertia() const { return mInertia; }    // kg m^2 about x, y, z
+    
+    // The mass differs from the last MarkApplied() by more than
+    // kApplyThreshold
+    bool IsStale() const;
+    void MarkApplied() { mAppliedMass = mMass; }
+
+private:
+    float mDryMass;
+    float mDryInertia[3];
+    float mFuelInertia[3];      // Per kilogram of propellant
+    
+    float mFuel;
+    float mMass;
+    float mInertia[3];
+    float mAppliedMass;
+};
@@ -0,0 +1,123 @@
+// MemoryTracker.cpp
+// Implementation of the per-subsystem memory counters
+
+#include "MemoryTracker.h"
+#include "Log.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+static const char* const kTagNames[MemoryTracker::kTagCount] = {
+    "heights",
+    "tiles",
+    "bullet",
+    "gpu-buffers",
+    "gpu-textures",
+    "particles",
+    "frame",
+};
+
+struct TagCounters {
+    std::atomic<size_t> live{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<size_t> budget{0};
+    std::atomic<bool> overBudget{false};
+};
+
+static TagCounters sTags[MemoryTracker::kTagCount];
+
+void MemoryTracker::Allocate(MemoryTag tag, size_t bytes) {
+    if (bytes == 0) return;
+    TagCounters& counters = sTags[static_cast<int>(tag)];
+    const size_t live = counters.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    
+    size_t peak = counters.peak.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    
+    const size_t budget = counters.budget.load(std::memory_order_relaxed);
+    if (budget > 0 && live > budget && !counters.overBudget.exchange(true)) {
+        LOG_WARNING("Memory budget exceeded: %s at %.1f MB of %.1f MB",
+                    kTagNames[static_cast<int>(tag)], live / 1048576.0, budget / 1048576.0);
+    }
+}
+
+void MemoryTracker::Free(MemoryTag tag, size_t bytes) {
+    if (bytes == 0) return;
+    TagCounters& counters = sTags[static_cast<int>(tag)];
+    const size_t live = counters.live.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+    if (live <= counters.budget.load(std::memory_order_relaxed)) {
+        counters.overBudget.store(false);
+    }
+}
+
+void MemoryTracker::Resize(MemoryTag tag, size_t oldBytes, size_t newBytes) {
+    if (newBytes > oldBytes) {
+        Allocate(tag, newBytes - oldBytes);
+    } else {
+        Free(tag, oldBytes - newBytes);
+    }
+}
+
+void MemoryTracker::SetBudget(MemoryTag tag, size_t bytes) {
+    TagCounters& counters = sTags[static_cast<int>(tag)];
+    counters.budget.store(bytes);
+    counters.overBudget.store(false);
+}
+
+bool MemoryTracker::ParseBudget(const char* text) {
+    const char* separator = std::strchr(text, '=');
+    if (!separator) return false;
+    
+    const size_t nameLength = static_cast<size_t>(separator - text);
+    for (int i = 0; i < kTagCount; i++) {
+        if (std::strlen(kTagNames[i]) != nameLength || std::strncmp(text, kTagNames[i], nameLength) != 0) {
+            continue;
+        }
+        char* end = nullptr;
+        double megabytes = std::strtod(separator + 1, &end);
+        if (end == separator + 1 || *end != '\0' || megabytes < 0.0) {
+            return false;
+        }
+        SetBudget(static_cast<MemoryTag>(i), static_cast<size_t>(megabytes * 1048576.0));
+        return true;
+    }
+    return false;
+}
+
+const char* MemoryTracker::GetTagName(MemoryTag tag) {
+    return kTagNames[static_cast<int>(tag)];
+}
+
+MemoryTagStats MemoryTracker::GetStats(MemoryTag tag) {
+    const TagCounters& counters = sTags[static_cast<int>(tag)];
+    MemoryTagStats stats;
+    stats.name = kTagNames[static_cast<int>(tag)];
+    stats.liveBytes = counters.live.load(std::memory_order_relaxed);
+    stats.peakBytes = counters.peak.load(std::memory_order_relaxed);
+    stats.budgetBytes = counters.budget.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t MemoryTracker::GetTotalLiveBytes() {
+    size_t total = 0;
+    for (const TagCounters& counters : sTags) {
+        total += counters.live.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void MemoryTracker::LogReport() {
+    for (int i = 0; i < kTagCount; i++) {
+        MemoryTagStats stats = GetStats(static_cast<MemoryTag>(i));
+        if (stats.peakBytes == 0) continue;
+        if (stats.budgetBytes > 0) {
+            LOG_INFO("Memory %-12s %8.1f MB live, %8.1f MB peak, %8.1f MB budget", stats.name,
+                     stats.liveBytes / 1048576.0, stats.peakBytes / 1048576.0, stats.budgetBytes / 1048576.0);
+        } else {
+            LOG_INFO("Memory %-12s %8.1f MB live, %8.1f MB peak", stats.name,
+                     stats.liveBytes / 1048576.0, stats.peakBytes / 1048576.0);
+        }
+    }
+    LOG_INFO("Memory total %8.1f MB live", GetTotalLiveBytes() / 1048576.0);
+}
@@ -0,0 +1,55 @@
+// MemoryTracker.h
+// Live and peak bytes per subsystem, with budgets that warn when exceeded
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// What the bytes are for. Subsystems report what they keep resident, not
+// every allocation: terrain its grids once built, the physics arena its
+// blocks, the Metal heap allocator each resource's allocatedSize().
+enum class MemoryTag : int {
+    TerrainHeights,     // Height, normal and pad grids, 2D segments
+    TerrainTiles,       // Decoded DEM tiles in the streaming cache
+    Physics,            // Bullet shapes, bodies and the rest of its allocations
+    GpuBuffers,
+    GpuTextures,
+    Particles,          // GPU particle rings
+    FrameArena,
+    Count
+};
+
+struct MemoryTagStats {
+    const char* name;
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t budgetBytes;   // 0 = none
+};
+
+// Counters are atomics, so any thread may report (the physics arena does
+// from Bullet's workers). A tag warns once each time it goes over its
+// budget.
+class MemoryTracker {
+public:
+    static constexpr int kTagCount = static_cast<int>(MemoryTag::Count);
+    
+    static void Allocate(MemoryTag tag, size_t bytes);
+    static void Free(MemoryTag tag, size_t bytes);
+    
+    // Replace bytes previously reported with newBytes (e.g. a grid resized)
+    static void Resize(MemoryTag tag, size_t oldBytes, size_t newBytes);
+    
+    static void SetBudget(MemoryTag tag, size_t bytes);
+    
+    // "name=MB", e.g. "tiles=64"; false if the name or size is not valid
+    static bool ParseBudget(const char* text);
+    
+    // Lower case, as ParseBudget takes them
+    static const char* GetTagName(MemoryTag tag);
+    static MemoryTagStats GetStats(MemoryTag tag);
+    static size_t GetTotalLiveBytes();
+    
+    // One line per tag that was ever used
+    static void LogReport();
+};
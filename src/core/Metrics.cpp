@@ -0,0 +1,249 @@
+// Metrics.cpp
+// Metric registry, per-thread shards and the Prometheus text writer
+
+#include "Metrics.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "MemoryTracker.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct MetricDefinition {
+    const char* name;
+    const char* help;
+    MetricType type;
+    std::string labels;
+    int firstSlot;                      // Counters and histograms: first shard slot
+    int slotCount;
+    double bounds[Metrics::kMaxBuckets];
+    std::function<double()> read;       // Callback metrics only
+};
+
+// One updating thread's values. Only that thread writes them, so updates
+// need no read-modify-write; the alignment keeps shards off each other's
+// cache lines.
+struct alignas(64) MetricShard {
+    std::atomic<int64_t> slots[Metrics::kMaxSlots];
+    std::atomic<double> sums[Metrics::kMaxMetrics];     // Histograms' sums of observed values
+};
+
+// Definitions are filled in before their count is published, so updates
+// read them without the lock
+static std::mutex sRegistryMutex;
+static MetricDefinition sMetrics[Metrics::kMaxMetrics];
+static std::atomic<int> sMetricCount(0);
+static int sSlotCount = 0;
+static std::atomic<double> sGauges[Metrics::kMaxMetrics];
+
+static std::mutex sShardMutex;
+static std::vector<std::unique_ptr<MetricShard>> sShards;
+static thread_local MetricShard* tShard = nullptr;
+
+static MetricShard* GetShard() {
+    if (!tShard) {
+        std::unique_ptr<MetricShard> shard(new MetricShard());
+        for (std::atomic<int64_t>& slot : shard->slots) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+        for (std::atomic<double>& sum : shard->sums) {
+            sum.store(0.0, std::memory_order_relaxed);
+        }
+        tShard = shard.get();
+        std::lock_guard<std::mutex> lock(sShardMutex);
+        sShards.push_back(std::move(shard));
+    }
+    return tShard;
+}
+
+static int Register(const char* name, const char* help, MetricType type, const char* labels, int slotCount,
+                    const double* bounds, int boundCount, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(sRegistryMutex);
+    const int id = sMetricCount.load(std::memory_order_relaxed);
+    if (id >= Metrics::kMaxMetrics || sSlotCount + slotCount > Metrics::kMaxSlots) {
+        LOG_ERROR("No room for metric %s", name);
+        return -1;
+    }
+    MetricDefinition& metric = sMetrics[id];
+    metric.name = name;
+    metric.help = help;
+    metric.type = type;
+    metric.labels = labels ? labels : "";
+    metric.firstSlot = sSlotCount;
+    metric.slotCount = slotCount;
+    for (int i = 0; i < boundCount; i++) {
+        metric.bounds[i] = bounds[i];
+    }
+    metric.read = std::move(read);
+    sSlotCount += slotCount;
+    sGauges[id].store(0.0, std::memory_order_relaxed);
+    sMetricCount.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+static bool IsValid(int id, MetricType type) {
+    return id >= 0 && id < sMetricCount.load(std::memory_order_acquire) && sMetrics[id].type == type &&
+           !sMetrics[id].read;
+}
+
+int Metrics::AddCounter(const char* name, const char* help, const char* labels) {
+    return Register(name, help, MetricType::Counter, labels, 1, nullptr, 0, nullptr);
+}
+
+int Metrics::AddGauge(const char* name, const char* help, const char* labels) {
+    return Register(name, help, MetricType::Gauge, labels, 0, nullptr, 0, nullptr);
+}
+
+int Metrics::AddHistogram(const char* name, const char* help, const double* bounds, int boundCount) {
+    if (boundCount < 1 || boundCount > kMaxBuckets) {
+        LOG_ERROR("Histogram %s needs 1 to %d buckets", name, kMaxBuckets);
+        return -1;
+    }
+    // One slot per bucket plus +Inf; the count is their sum
+    return Register(name, help, MetricType::Histogram, nullptr, boundCount + 1, bounds, boundCount, nullptr);
+}
+
+int Metrics::AddCallback(const char* name, const char* help, MetricType type, const char* labels,
+                         std::function<double()> read) {
+    if (type == MetricType::Histogram || !read) {
+        LOG_ERROR("Callback metric %s must be a counter or gauge", name);
+        return -1;
+    }
+    return Register(name, help, type, labels, 0, nullptr, 0, std::move(read));
+}
+
+void Metrics::AddMemoryTags() {
+    char labels[64];
+    for (int i = 0; i < MemoryTracker::kTagCount; i++) {
+        const MemoryTag tag = static_cast<MemoryTag>(i);
+        std::snprintf(labels, sizeof(labels), "tag=\"%s\"", MemoryTracker::GetTagName(tag));
+        AddCallback("lander_memory_live_bytes", "Bytes each subsystem keeps resident", MetricType::Gauge, labels,
+                    [tag]() { return static_cast<double>(MemoryTracker::GetStats(tag).liveBytes); });
+    }
+    for (int i = 0; i < MemoryTracker::kTagCount; i++) {
+        const MemoryTag tag = static_cast<MemoryTag>(i);
+        std::snprintf(labels, sizeof(labels), "tag=\"%s\"", MemoryTracker::GetTagName(tag));
+        AddCallback("lander_memory_peak_bytes", "Most bytes each subsystem has kept resident", MetricType::Gauge,
+                    labels, [tag]() { return static_cast<double>(MemoryTracker::GetStats(tag).peakBytes); });
+    }
+}
+
+void Metrics::AddJobSystem(const JobSystem& jobs) {
+    const JobSystem* system = &jobs;
+    AddCallback("lander_jobs_queued", "Jobs waiting in the job system's queues", MetricType::Gauge, nullptr,
+                [system]() { return static_cast<double>(system->GetStats().queuedJobs); });
+    AddCallback("lander_jobs_run_total", "Jobs the job system has run", MetricType::Counter, nullptr,
+                [system]() { return static_cast<double>(system->GetStats().jobsRun); });
+    AddCallback("lander_jobs_stolen_total", "Jobs taken from another worker's queue", MetricType::Counter, nullptr,
+                [system]() { return static_cast<double>(system->GetStats().steals); });
+    AddCallback("lander_job_workers", "Worker threads in the job system", MetricType::Gauge, nullptr,
+                [system]() { return static_cast<double>(system->GetWorkerCount()); });
+}
+
+void Metrics::Add(int id, int64_t delta) {
+    if (!IsValid(id, MetricType::Counter)) return;
+    std::atomic<int64_t>& slot = GetShard()->slots[sMetrics[id].firstSlot];
+    slot.store(slot.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void Metrics::Set(int id, double value) {
+    if (!IsValid(id, MetricType::Gauge)) return;
+    sGauges[id].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::Observe(int id, double value) {
+    if (!IsValid(id, MetricType::Histogram)) return;
+    const MetricDefinition& metric = sMetrics[id];
+    int bucket = 0;
+    while (bucket < metric.slotCount - 1 && value > metric.bounds[bucket]) {
+        bucket++;
+    }
+    MetricShard* shard = GetShard();
+    std::atomic<int64_t>& slot = shard->slots[metric.firstSlot + bucket];
+    slot.store(slot.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic<double>& sum = shard->sums[id];
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static void AppendSample(std::string& out, const char* name, const char* suffix, const std::string& labels,
+                         const char* extraLabel, double value) {
+    char text[64];
+    out += name;
+    out += suffix;
+    if (!labels.empty() || extraLabel) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && extraLabel) {
+            out += ',';
+        }
+        if (extraLabel) {
+            out += extraLabel;
+        }
+        out += '}';
+    }
+    std::snprintf(text, sizeof(text), " %.15g\n", value);
+    out += text;
+}
+
+std::string Metrics::Render() {
+    std::lock_guard<std::mutex> registryLock(sRegistryMutex);
+    const int metricCount = sMetricCount.load(std::memory_order_relaxed);
+    
+    // Sum the shards first, so callbacks run without the shard lock
+    std::vector<int64_t> slots(static_cast<size_t>(sSlotCount), 0);
+    std::vector<double> sums(static_cast<size_t>(metricCount), 0.0);
+    {
+        std::lock_guard<std::mutex> shardLock(sShardMutex);
+        for (const std::unique_ptr<MetricShard>& shard : sShards) {
+            for (int i = 0; i < sSlotCount; i++) {
+                slots[i] += shard->slots[i].load(std::memory_order_relaxed);
+            }
+            for (int i = 0; i < metricCount; i++) {
+                sums[i] += shard->sums[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    static const char* const kTypeNames[] = { "counter", "gauge", "histogram" };
+    std::string out;
+    for (int id = 0; id < metricCount; id++) {
+        const MetricDefinition& metric = sMetrics[id];
+        if (id == 0 || std::string(metric.name) != sMetrics[id - 1].name) {
+            out += "# HELP ";
+            out += metric.name;
+            out += ' ';
+            out += metric.help;
+            out += "\n# TYPE ";
+            out += metric.name;
+            out += ' ';
+            out += kTypeNames[static_cast<int>(metric.type)];
+            out += '\n';
+        }
+        
+        if (metric.read) {
+            AppendSample(out, metric.name, "", metric.labels, nullptr, metric.read());
+        } else if (metric.type == MetricType::Counter) {
+            AppendSample(out, metric.name, "", metric.labels, nullptr, static_cast<double>(slots[metric.firstSlot]));
+        } else if (metric.type == MetricType::Gauge) {
+            AppendSample(out, metric.name, "", metric.labels, nullptr, sGauges[id].load(std::memory_order_relaxed));
+        } else {
+            // Buckets are cumulative
+            int64_t count = 0;
+            char bound[48];
+            for (int i = 0; i < metric.slotCount; i++) {
+                count += slots[metric.firstSlot + i];
+                if (i + 1 < metric.slotCount) {
+                    std::snprintf(bound, sizeof(bound), "le=\"%g\"", metric.bounds[i]);
+                } else {
+                    std::snprintf(bound, sizeof(bound), "le=\"+Inf\"");
+                }
+                AppendSample(out, metric.name, "_bucket", metric.labels, bound, static_cast<double>(count));
+            }
+            AppendSample(out, metric.name, "_sum", metric.labels, nullptr, sums[id]);
+            AppendSample(out, metric.name, "_count", metric.labels, nullptr, static_cast<double>(count));
+        }
+    }
+    return out;
+}
@@ -0,0 +1,62 @@
+// Metrics.h
+// Process metrics in per-thread shards, aggregated into Prometheus text when scraped
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class JobSystem;
+
+enum class MetricType {
+    Counter,
+    Gauge,
+    Histogram,
+};
+
+// Metrics for a scraper (see MetricsServer). Counters and histograms live
+// in one shard per updating thread: an update is a relaxed load and store
+// on the thread's own cache lines, so the simulation never waits on a
+// scrape or on another thread. Render() sums the shards when asked, and
+// reads callback metrics (memory, job system) from their atomics then.
+// Gauges are a single atomic each, last Set() wins.
+//
+// Register every metric at startup, before the threads that update it run;
+// ids index fixed tables, so nothing is ever reallocated under an update.
+// Metrics of one name with different labels must be registered one after
+// another, so Render() writes them as one family.
+class Metrics {
+public:
+    static constexpr int kMaxMetrics = 64;
+    static constexpr int kMaxSlots = 256;      // Counter values per shard, histogram buckets included
+    static constexpr int kMaxBuckets = 16;
+    
+    // labels is Prometheus label text without the braces (e.g.
+    // "tag=\"tiles\""), or null. Each returns the metric's id, -1 if the
+    // tables are full.
+    static int AddCounter(const char* name, const char* help, const char* labels = nullptr);
+    static int AddGauge(const char* name, const char* help, const char* labels = nullptr);
+    
+    // bounds are the buckets' upper bounds, ascending; +Inf is implied
+    static int AddHistogram(const char* name, const char* help, const double* bounds, int boundCount);
+    
+    // A counter or gauge read when scraped, on the scraping thread, so read
+    // may only touch atomics (and what outlives the scraper)
+    static int AddCallback(const char* name, const char* help, MetricType type, const char* labels,
+                           std::function<double()> read);
+    
+    // Live and peak bytes of every memory tag
+    static void AddMemoryTags();
+    
+    // Queue depth, jobs run and steals of jobs; stop the scraper before it goes
+    static void AddJobSystem(const JobSystem& jobs);
+    
+    // Lock-free except for the first update on each thread; ids of -1 are ignored
+    static void Add(int id, int64_t delta = 1);
+    static void Set(int id, double value);
+    static void Observe(int id, double value);
+    
+    // Every metric in the Prometheus text exposition format (version 0.0.4)
+    static std::string Render();
+};
@@ -0,0 +1,131 @@
+// MetricsServer.cpp
+// POSIX implementation of the metrics endpoint
+
+#include "MetricsServer.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // Apple: the socket has SO_NOSIGPIPE instead
+#endif
+
+// How long the loop waits for a connection before checking for Stop(), and
+// how long a client gets to send its request
+static const int kPollMs = 250;
+static const int kRequestTimeoutMs = 1000;
+static const size_t kMaxRequestBytes = 4096;
+
+MetricsServer::MetricsServer()
+    : mSocket(-1)
+    , mStopping(false) {
+}
+
+MetricsServer::~MetricsServer() {
+    Stop();
+}
+
+bool MetricsServer::Start(uint16_t port) {
+    Stop();
+    mSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (mSocket < 0) {
+        LOG_ERROR("Failed to create metrics socket: %s", std::strerror(errno));
+        return false;
+    }
+    
+    int reuse = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(mSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(mSocket, 8) != 0) {
+        LOG_ERROR("Failed to listen for metrics on TCP port %u: %s", port, std::strerror(errno));
+        close(mSocket);
+        mSocket = -1;
+        return false;
+    }
+    
+    mStopping = false;
+    mThread = std::thread(&MetricsServer::ServeLoop, this);
+    LOG_INFO("Serving metrics on http://0.0.0.0:%u/metrics", port);
+    return true;
+}
+
+void MetricsServer::Stop() {
+    if (mSocket < 0) {
+        return;
+    }
+    mStopping = true;
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    close(mSocket);
+    mSocket = -1;
+}
+
+void MetricsServer::ServeLoop() {
+    Profiler::SetThreadName("Metrics");
+    while (!mStopping) {
+        pollfd listener = { mSocket, POLLIN, 0 };
+        if (poll(&listener, 1, kPollMs) <= 0 || !(listener.revents & POLLIN)) {
+            continue;
+        }
+        int client = accept(mSocket, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        ServeConnection(client);
+        close(client);
+    }
+}
+
+void MetricsServer::ServeConnection(int client) {
+    timeval timeout = { kRequestTimeoutMs / 1000, (kRequestTimeoutMs % 1000) * 1000 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int noSignal = 1;
+    setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+    
+    // Only the request line matters; read until the headers end
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestBytes) {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(received));
+    }
+    
+    const bool isMetrics = request.compare(0, 13, "GET /metrics ") == 0 ||
+                           request.compare(0, 13, "GET /metrics?") == 0;
+    std::string body = isMetrics ? Metrics::Render() : std::string("Not found\n");
+    std::string response = isMetrics ? "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                     : "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n";
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    response += body;
+    
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t written = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) {
+            break;
+        }
+        sent += static_cast<size_t>(written);
+    }
+}
@@ -0,0 +1,33 @@
+// MetricsServer.h
+// Minimal HTTP server answering Prometheus scrapes of Metrics
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Serves GET /metrics with Metrics::Render() from a thread of its own, one
+// connection at a time; anything else gets a 404. Scrapes read the metrics'
+// shards and atomics, so the threads updating them never wait on it.
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+    
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+    
+    // Listen on port on every interface; false if it can't be bound
+    bool Start(uint16_t port);
+    void Stop();
+    bool IsRunning() const { return mSocket >= 0; }
+
+private:
+    void ServeLoop();
+    void ServeConnection(int client);
+    
+    int mSocket;
+    std::thread mThread;
+    std::atomic<bool> mStopping;
+};
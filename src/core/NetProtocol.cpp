@@ -0,0 +1,199 @@
+// NetProtocol.cpp
+// Bit packing, quantization and delta coding of session state
+
+#include "NetProtocol.h"
+#include <cmath>
+#include <cstring>
+
+static const float kPositionScale = 64.0f;
+static const float kVelocityScale = 256.0f;
+static const float kRotationScale = 64.0f;
+static const float kFuelScale = 16.0f;
+static const float kThrustScale = 255.0f;
+
+// Bits after a field's 2-bit size class
+static const int kDeltaClassBits[4] = { 4, 8, 16, 32 };
+
+NetBitWriter::NetBitWriter(uint8_t* buffer, size_t capacity)
+    : mBuffer(buffer)
+    , mCapacity(capacity)
+    , mBitCount(0)
+    , mOverflowed(false)
+{
+}
+
+void NetBitWriter::Write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++) {
+        const size_t byte = mBitCount >> 3;
+        if (byte >= mCapacity) {
+            mOverflowed = true;
+            return;
+        }
+        const uint8_t mask = static_cast<uint8_t>(1u << (mBitCount & 7));
+        if ((value >> i) & 1u) {
+            mBuffer[byte] |= mask;
+        } else {
+            mBuffer[byte] &= static_cast<uint8_t>(~mask);
+        }
+        mBitCount++;
+    }
+}
+
+void NetBitWriter::WriteFloat(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    Write(bits, 32);
+}
+
+NetBitReader::NetBitReader(const uint8_t* buffer, size_t size)
+    : mBuffer(buffer)
+    , mSize(size)
+    , mBitCount(0)
+    , mOverflowed(false)
+{
+}
+
+uint32_t NetBitReader::Read(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++) {
+        const size_t byte = mBitCount >> 3;
+        if (byte >= mSize) {
+            mOverflowed = true;
+            return 0;
+        }
+        value |= static_cast<uint32_t>((mBuffer[byte] >> (mBitCount & 7)) & 1u) << i;
+        mBitCount++;
+    }
+    return value;
+}
+
+float NetBitReader::ReadFloat() {
+    uint32_t bits = Read(32);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int32_t QuantizeValue(float value, float scale) {
+    return static_cast<int32_t>(std::lrint(static_cast<double>(value) * scale));
+}
+
+void NetProtocol::Quantize(const LanderBatchLander& lander, NetLanderState& state) {
+    state.x = QuantizeValue(lander.x, kPositionScale);
+    state.y = QuantizeValue(lander.y, kPositionScale);
+    state.velX = QuantizeValue(lander.velX, kVelocityScale);
+    state.velY = QuantizeValue(lander.velY, kVelocityScale);
+    state.rotation = QuantizeValue(lander.rotation, kRotationScale) % static_cast<int32_t>(360.0f * kRotationScale);
+    state.spin = QuantizeValue(lander.spin, kRotationScale);
+    state.fuel = QuantizeValue(lander.fuel, kFuelScale);
+    state.thrust = static_cast<uint8_t>(QuantizeValue(std::fmin(std::fmax(lander.thrustLevel, 0.0f), 1.0f), kThrustScale));
+    state.state = lander.state;
+}
+
+void NetProtocol::Dequantize(const NetLanderState& state, LanderBatchLander& lander) {
+    // Every scale but thrust's is a power of two, so those values come back
+    // exactly; thrust (1/255) comes back to the nearest float, which is exact
+    // for none and full
+    lander.x = state.x / kPositionScale;
+    lander.y = state.y / kPositionScale;
+    lander.velX = state.velX / kVelocityScale;
+    lander.velY = state.velY / kVelocityScale;
+    lander.rotation = state.rotation / kRotationScale;
+    lander.spin = state.spin / kRotationScale;
+    lander.fuel = state.fuel / kFuelScale;
+    lander.thrustLevel = state.thrust / kThrustScale;
+    lander.state = state.state;
+}
+
+static void WriteDelta(NetBitWriter& writer, int32_t baseline, int32_t value) {
+    const uint32_t delta = static_cast<uint32_t>(value) - static_cast<uint32_t>(baseline);
+    if (delta == 0) {
+        writer.Write(0, 1);
+        return;
+    }
+    const uint32_t zigzag = (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+    int sizeClass = 0;
+    while (sizeClass < 3 && (zigzag >> kDeltaClassBits[sizeClass]) != 0) {
+        sizeClass++;
+    }
+    writer.Write(1, 1);
+    writer.Write(static_cast<uint32_t>(sizeClass), 2);
+    writer.Write(zigzag, kDeltaClassBits[sizeClass]);
+}
+
+static int32_t ReadDelta(NetBitReader& reader, int32_t baseline) {
+    if (reader.Read(1) == 0) {
+        return baseline;
+    }
+    const int sizeClass = static_cast<int>(reader.Read(2));
+    const uint32_t zigzag = reader.Read(kDeltaClassBits[sizeClass]);
+    const uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1u));
+    return static_cast<int32_t>(static_cast<uint32_t>(baseline) + delta);
+}
+
+void NetProtocol::WriteWorld(NetBitWriter& writer, const NetWorldState* baseline, const NetWorldState& world) {
+    static const NetLanderState kZero = {};
+    writer.Write(world.activeMask, kNetMaxLanders);
+    for (int i = 0; i < kNetMaxLanders; i++) {
+        if (!(world.activeMask & (1u << i))) {
+            continue;
+        }
+        
+        // A lander new since the baseline goes against zeros
+        const bool hasBase = baseline && (baseline->activeMask & (1u << i));
+        const NetLanderState& base = hasBase ? baseline->landers[i] : kZero;
+        const NetLanderState& lander = world.landers[i];
+        if (base == lander) {
+            writer.Write(0, 1);
+            continue;
+        }
+        writer.Write(1, 1);
+        WriteDelta(writer, base.x, lander.x);
+        WriteDelta(writer, base.y, lander.y);
+        WriteDelta(writer, base.velX, lander.velX);
+        WriteDelta(writer, base.velY, lander.velY);
+        WriteDelta(writer, base.rotation, lander.rotation);
+        WriteDelta(writer, base.spin, lander.spin);
+        WriteDelta(writer, base.fuel, lander.fuel);
+        writer.Write(lander.thrust != base.thrust, 1);
+        if (lander.thrust != base.thrust) {
+            writer.Write(lander.thrust, 8);
+        }
+        writer.Write(lander.state != base.state, 1);
+        if (lander.state != base.state) {
+            writer.Write(lander.state, 2);
+        }
+    }
+}
+
+bool NetProtocol::ReadWorld(NetBitReader& reader, const NetWorldState* baseline, NetWorldState& world) {
+    static const NetLanderState kZero = {};
+    std::memset(&world, 0, sizeof(world));
+    world.activeMask = static_cast<uint8_t>(reader.Read(kNetMaxLanders));
+    for (int i = 0; i < kNetMaxLanders; i++) {
+        if (!(world.activeMask & (1u << i))) {
+            continue;
+        }
+        const bool hasBase = baseline && (baseline->activeMask & (1u << i));
+        const NetLanderState& base = hasBase ? baseline->landers[i] : kZero;
+        NetLanderState& lander = world.landers[i];
+        lander = base;
+        if (reader.Read(1) == 0) {
+            continue;
+        }
+        lander.x = ReadDelta(reader, base.x);
+        lander.y = ReadDelta(reader, base.y);
+        lander.velX = ReadDelta(reader, base.velX);
+        lander.velY = ReadDelta(reader, base.velY);
+        lander.rotation = ReadDelta(reader, base.rotation);
+        lander.spin = ReadDelta(reader, base.spin);
+        lander.fuel = ReadDelta(reader, base.fuel);
+        if (reader.Read(1)) {
+            lander.thrust = static_cast<uint8_t>(reader.Read(8));
+        }
+        if (reader.Read(1)) {
+            lander.state = static_cast<uint8_t>(reader.Read(2));
+        }
+    }
+    return !reader.IsOverflowed();
+}
@@ -0,0 +1,120 @@
+// NetProtocol.h
+// Packet layouts, bit packing and delta-compressed lander state for network sessions
+
+#pragma once
+
+#include "LanderBatch.h"
+#include <cstddef>
+#include <cstdint>
+
+// Every packet starts with a NetPacketType byte. Multi-bit fields are
+// packed LSB first with NetBitWriter; floats travel as their bits.
+//   Hello     magic u32, version u16                   client -> host
+//   Welcome   lander u8, snapshot interval u8, seed u32,
+//             fixed step, gravity, max fuel, fuel rate,
+//             spawn x, spawn y, spawn velocity x, y,
+//             spawn fuel, lander w, h (f32),
+//             world w, h (u16)                         host -> client
+//   Input     ack snapshot u16, first input u32, runs u7,
+//             then per run actions u4 and length-1 u6  client -> host
+//   Snapshot  sequence u16, baseline u16, next input u32,
+//             then NetProtocol::WriteWorld              host -> client
+//   Goodbye   (leaving, or a refused Hello)            either way
+//
+// Inputs are sent redundantly: each Input repeats every action the host
+// has not acknowledged yet (up to kNetMaxInputsPerPacket), run-length
+// coded, so a lost packet costs nothing unless the next one is lost too.
+static const uint32_t kNetProtocolMagic = 0x504E4C4C;    // "LLNP"
+static const uint16_t kNetProtocolVersion = 3;
+static const int kNetMaxLanders = 8;
+static const size_t kNetMaxPacketSize = 1200;             // Below any path MTU
+static const int kNetSnapshotHistory = 32;                // Baselines kept on both ends
+static const int kNetMaxInputsPerPacket = 64;
+static const uint16_t kNetNoBaseline = 0xFFFF;
+
+enum class NetPacketType : uint8_t {
+    Hello = 1,
+    Welcome = 2,
+    Input = 3,
+    Snapshot = 4,
+    Goodbye = 5
+};
+
+// One step's controls for a lander. Without kNetActionFly the lander is
+// held at the spawn point (its player is in the ready or landed screens).
+static const uint8_t kNetActionThrust = 1 << 0;
+static const uint8_t kNetActionLeft = 1 << 1;
+static const uint8_t kNetActionRight = 1 << 2;
+static const uint8_t kNetActionFly = 1 << 3;
+static const int kNetActionBits = 4;
+
+// A lander quantized for the wire. The simulations keep full precision (a
+// slow lander moves less than a grid cell a step); a client rewinding to a
+// snapshot starts within half a cell of the host and replays from there.
+struct NetLanderState {
+    int32_t x, y;             // 1/64 m
+    int32_t velX, velY;       // 1/256 m/s
+    int32_t rotation;         // 1/64 degree
+    int32_t spin;             // 1/64 deg/s
+    int32_t fuel;             // 1/16 kg
+    uint8_t thrust;           // 1/255
+    uint8_t state;            // LanderBatchState
+    
+    bool operator==(const NetLanderState& other) const {
+        return x == other.x && y == other.y && velX == other.velX && velY == other.velY &&
+               rotation == other.rotation && spin == other.spin && fuel == other.fuel && thrust == other.thrust && state == other.state;
+    }
+};
+
+// Every lander in the session at one snapshot
+struct NetWorldState {
+    uint8_t activeMask;       // Bit i: lander i is in the session
+    NetLanderState landers[kNetMaxLanders];
+};
+
+class NetBitWriter {
+public:
+    NetBitWriter(uint8_t* buffer, size_t capacity);
+    
+    // Low `bits` bits of value (1-32)
+    void Write(uint32_t value, int bits);
+    void WriteFloat(float value);
+    
+    // Bytes used so far, rounded up
+    size_t GetSize() const { return (mBitCount + 7) / 8; }
+    bool IsOverflowed() const { return mOverflowed; }
+
+private:
+    uint8_t* mBuffer;
+    size_t mCapacity;
+    size_t mBitCount;
+    bool mOverflowed;
+};
+
+class NetBitReader {
+public:
+    NetBitReader(const uint8_t* buffer, size_t size);
+    
+    // Reads past the end return 0 and set the overflow flag
+    uint32_t Read(int bits);
+    float ReadFloat();
+    bool IsOverflowed() const { return mOverflowed; }
+
+private:
+    const uint8_t* mBuffer;
+    size_t mSize;
+    size_t mBitCount;
+    bool mOverflowed;
+};
+
+class NetProtocol {
+public:
+    static void Quantize(const LanderBatchLander& lander, NetLanderState& state);
+    static void Dequantize(const NetLanderState& state, LanderBatchLander& lander);
+    
+    // Write world against baseline (null: against all zeros). An unchanged
+    // lander costs one bit; a changed one sends each field that moved as a
+    // zigzagged difference in 4, 8, 16 or 32 bits.
+    static void WriteWorld(NetBitWriter& writer, const NetWorldState* baseline, const NetWorldState& world);
+    static bool ReadWorld(NetBitReader& reader, const NetWorldState* baseline, NetWorldState& world);
+};
@@ -0,0 +1,685 @@
+// NetSession.cpp
+// Host and client sides of a network session
+
+#include "NetSession.h"
+#include "Log.h"
+#include "Terrain.h"
+#include "Units.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+static const float kSnapshotRate = 60.0f;          // Snapshots and input packets per second
+static const float kPeerTimeout = 5.0f;            // Seconds of silence before dropping the other end
+static const float kHelloInterval = 0.1f;          // Seconds between Connect()'s Hellos
+static const size_t kMaxInputBacklog = 8;          // Queued inputs past this are skipped
+static const size_t kMaxPendingInputs = 4 * kNetMaxInputsPerPacket;
+
+// True if sequence a is after b, allowing for wraparound
+static bool IsNewer(uint16_t a, uint16_t b) {
+    return static_cast<int16_t>(static_cast<uint16_t>(a - b)) > 0;
+}
+
+static int CountLanders(uint8_t mask) {
+    int count = 0;
+    for (; mask; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+NetSession::NetSession()
+    : mSettings()
+    , mIsHost(false)
+    , mDedicated(false)
+    , mConnected(false)
+    , mSnapshotInterval(1)
+    , mStepCount(0)
+    , mActiveMask(0)
+    , mSnapshotSequence(kNetNoBaseline)
+    , mLocalIndex(0)
+    , mFirstPendingInput(0)
+    , mLatestSnapshot(kNetNoBaseline)
+    , mLastHeardStep(0)
+    , mStats()
+{
+    for (HistoryEntry& entry : mHistory) {
+        entry.valid = false;
+    }
+}
+
+NetSession::~NetSession() {
+    Close();
+}
+
+void NetSession::Configure(const NetSessionSettings& settings) {
+    mSettings = settings;
+    LanderBatch* batches[] = { &mWorld, &mPredicted, &mRemote };
+    for (LanderBatch* batch : batches) {
+        batch->SetGravity(settings.gravity);
+        batch->SetSpawnPosition(settings.spawnX, settings.spawnY);
+        batch->SetSpawnVelocity(settings.spawnVelX, settings.spawnVelY);
+        batch->SetLanderSize(Units::ToPixels(Meters(settings.landerWidth)),
+                             Units::ToPixels(Meters(settings.landerHeight)));
+        batch->SetMaxFuel(settings.maxFuel);
+        batch->SetSpawnFuel(settings.spawnFuel);
+        batch->SetFuelConsumptionRate(settings.fuelRate);
+    }
+}
+
+bool NetSession::Host(uint16_t port, const NetSessionSettings& settings) {
+    if (!mSocket.Open(port)) {
+        return false;
+    }
+    Configure(settings);
+    mIsHost = true;
+    mConnected = true;
+    mSnapshotInterval = std::max(1, static_cast<int>(std::lrint(1.0f / (kSnapshotRate * settings.fixedTimeStep))));
+    mWorld.Resize(kNetMaxLanders);
+    
+    // A dedicated server hosts many and says so once itself
+    if (mDedicated) {
+        mActiveMask = 0;
+        LOG_DEBUG("Hosting a dedicated session on port %u", port);
+    } else {
+        mActiveMask = 1;
+        LOG_INFO("Hosting a session on port %u (up to %d landers, a snapshot every %d steps)",
+                 port, kNetMaxLanders, mSnapshotInterval);
+    }
+    return true;
+}
+
+bool NetSession::Connect(const NetAddress& address, float timeoutSeconds, NetSessionSettings& settings) {
+    if (!mSocket.Open(0)) {
+        return false;
+    }
+    mHostAddress = address;
+    LOG_INFO("Connecting to %s...", address.ToString().c_str());
+    
+    uint8_t packet[kNetMaxPacketSize];
+    NetBitWriter hello(packet, sizeof(packet));
+    hello.Write(static_cast<uint32_t>(NetPacketType::Hello), 8);
+    hello.Write(kNetProtocolMagic, 32);
+    hello.Write(kNetProtocolVersion, 16);
+    const size_t helloSize = hello.GetSize();
+    
+    auto start = std::chrono::steady_clock::now();
+    auto nextHello = start;
+    for (;;) {
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<float>(now - start).count() > timeoutSeconds) {
+            LOG_ERROR("No answer from %s", address.ToString().c_str());
+            mSocket.Close();
+            return false;
+        }
+        if (now >= nextHello) {
+            Send(mHostAddress, packet, helloSize);
+            nextHello = now + std::chrono::milliseconds(static_cast<int>(kHelloInterval * 1000.0f));
+        }
+        
+        uint8_t buffer[kNetMaxPacketSize];
+        NetAddress from;
+        int size = mSocket.Receive(from, buffer, sizeof(buffer));
+        if (size <= 0 || from != mHostAddress) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        mStats.bytesReceived += size;
+        mStats.packetsReceived++;
+        
+        NetBitReader reader(buffer, static_cast<size_t>(size));
+        NetPacketType type = static_cast<NetPacketType>(reader.Read(8));
+        if (type == NetPacketType::Goodbye) {
+            LOG_ERROR("%s refused the connection (session full or a different version)",
+                      address.ToString().c_str());
+            mSocket.Close();
+            return false;
+        }
+        if (type != NetPacketType::Welcome) {
+            continue;
+        }
+        
+        NetSessionSettings welcome;
+        int lander = static_cast<int>(reader.Read(8));
+        int interval = static_cast<int>(reader.Read(8));
+        welcome.seed = reader.Read(32);
+        welcome.fixedTimeStep = reader.ReadFloat();
+        welcome.gravity = reader.ReadFloat();
+        welcome.maxFuel = reader.ReadFloat();
+        welcome.fuelRate = reader.ReadFloat();
+        welcome.spawnX = reader.ReadFloat();
+        welcome.spawnY = reader.ReadFloat();
+        welcome.spawnVelX = reader.ReadFloat();
+        welcome.spawnVelY = reader.ReadFloat();
+        welcome.spawnFuel = reader.ReadFloat();
+        welcome.landerWidth = reader.ReadFloat();
+        welcome.landerHeight = reader.ReadFloat();
+        welcome.worldWidth = static_cast<uint16_t>(reader.Read(16));
+        welcome.worldHeight = static_cast<uint16_t>(reader.Read(16));
+        if (reader.IsOverflowed() || lander >= kNetMaxLanders || interval <= 0 ||
+            !(welcome.fixedTimeStep > 0.0f) || !(welcome.landerWidth > 0.0f) || !(welcome.landerHeight > 0.0f)) {
+            LOG_ERROR("Bad welcome from %s", address.ToString().c_str());
+            mSocket.Close();
+            return false;
+        }
+        
+        Configure(welcome);
+        settings = welcome;
+        mIsHost = false;
+        mConnected = true;
+        mLocalIndex = lander;
+        mSnapshotInterval = interval;
+        mPredicted.Resize(1);
+        LOG_INFO("Joined %s as lander %d", address.ToString().c_str(), lander);
+        return true;
+    }
+}
+
+void NetSession::Close() {
+    if (!mSocket.IsOpen()) {
+        return;
+    }
+    uint8_t goodbye = static_cast<uint8_t>(NetPacketType::Goodbye);
+    if (mIsHost) {
+        for (const Peer& peer : mPeers) {
+            Send(peer.address, &goodbye, 1);
+        }
+        mPeers.clear();
+    } else if (mConnected) {
+        Send(mHostAddress, &goodbye, 1);
+    }
+    mSocket.Close();
+    mConnected = false;
+}
+
+void NetSession::SetTerrain(const Terrain* terrain) {
+    SetTerrain(LanderBatchTerrain::Build(terrain));
+}
+
+void NetSession::SetTerrain(const std::shared_ptr<const LanderBatchTerrain>& terrain) {
+    mWorld.SetTerrain(terrain);
+    mPredicted.SetTerrain(terrain);
+}
+
+int NetSession::GetLanderCount() const {
+    return mIsHost ? CountLanders(mActiveMask) : static_cast<int>(mRemote.GetCount()) + 1;
+}
+
+size_t NetSession::GetMemoryUsage() const {
+    // The batches are members, so only their heap arrays come on top. Input
+    // queues count what they hold, not the blocks std::deque rounds up to.
+    size_t bytes = sizeof(*this) + mWorld.GetMemoryUsage() + mPredicted.GetMemoryUsage() +
+                   mRemote.GetMemoryUsage() - 3 * sizeof(LanderBatch) + mPeers.capacity() * sizeof(Peer) +
+                   mPendingInputs.size();
+    for (const Peer& peer : mPeers) {
+        bytes += peer.inputs.size();
+    }
+    return bytes;
+}
+
+void NetSession::Step(uint8_t actions) {
+    if (mIsHost) {
+        HostStep(actions);
+    } else {
+        ClientStep(actions);
+    }
+    mStats.steps++;
+}
+
+void NetSession::GetLocalLander(LanderBatchLander& lander) const {
+    if (mIsHost) {
+        mWorld.GetLander(0, lander);
+    } else {
+        mPredicted.GetLander(0, lander);
+    }
+}
+
+void NetSession::ApplyActions(LanderBatch& batch, size_t index, uint8_t actions) {
+    if (!(actions & kNetActionFly) || batch.GetState()[index] != BATCH_FLYING) {
+        return;
+    }
+    batch.ApplyThrust(index, (actions & kNetActionThrust) ? 1.0f : 0.0f);
+    const float left = (actions & kNetActionLeft) ? 1.0f : 0.0f;
+    const float right = (actions & kNetActionRight) ? 1.0f : 0.0f;
+    batch.FireRcs(index, left - right);
+}
+
+void NetSession::FinishStep(LanderBatch& batch, size_t index, uint8_t actions) {
+    if (!(actions & kNetActionFly)) {
+        batch.ResetLander(index);
+    }
+}
+
+void NetSession::CaptureWorld(const LanderBatch& batch, uint8_t activeMask, NetWorldState& world) const {
+    world = NetWorldState();
+    world.activeMask = activeMask;
+    for (int i = 0; i < kNetMaxLanders && static_cast<size_t>(i) < batch.GetCount(); i++) {
+        if (activeMask & (1u << i)) {
+            LanderBatchLander lander;
+            batch.GetLander(static_cast<size_t>(i), lander);
+            NetProtocol::Quantize(lander, world.landers[i]);
+        }
+    }
+}
+
+void NetSession::UpdateRemote(const NetWorldState& world, int localIndex) {
+    const uint8_t others = world.activeMask & static_cast<uint8_t>(~(1u << localIndex));
+    mRemote.Resize(static_cast<size_t>(CountLanders(others)));
+    size_t remote = 0;
+    for (int i = 0; i < kNetMaxLanders; i++) {
+        if (others & (1u << i)) {
+            LanderBatchLander lander;
+            NetProtocol::Dequantize(world.landers[i], lander);
+            mRemote.SetLander(remote++, lander);
+        }
+    }
+}
+
+const NetSession::HistoryEntry* NetSession::FindHistory(uint16_t sequence) const {
+    const HistoryEntry& entry = mHistory[sequence % kNetSnapshotHistory];
+    return entry.valid && entry.sequence == sequence ? &entry : nullptr;
+}
+
+bool NetSession::Send(const NetAddress& to, const uint8_t* data, size_t size) {
+    if (!mSocket.Send(to, data, size)) {
+        return false;
+    }
+    mStats.bytesSent += size;
+    mStats.packetsSent++;
+    return true;
+}
+
+void NetSession::HostStep(uint8_t actions) {
+    HostReceive();
+    
+    // One input per client per step. When a client's next input hasn't
+    // arrived its lander repeats the last actions without using one up, so
+    // a late input is applied late rather than lost and the queue grows by
+    // the lateness; one that got ahead (a burst after a stall) skips its
+    // oldest so its lander doesn't lag by the backlog from then on.
+    uint8_t applied[kNetMaxLanders] = {};
+    if (!mDedicated) {
+        applied[0] = actions;
+    }
+    for (Peer& peer : mPeers) {
+        while (peer.inputs.size() > kMaxInputBacklog) {
+            peer.inputs.pop_front();
+            peer.nextInput++;
+        }
+        if (!peer.inputs.empty()) {
+            peer.lastActions = peer.inputs.front();
+            peer.inputs.pop_front();
+            peer.nextInput++;
+        }
+        applied[peer.lander] = peer.lastActions;
+    }
+    
+    for (int i = 0; i < kNetMaxLanders; i++) {
+        ApplyActions(mWorld, static_cast<size_t>(i), applied[i]);
+    }
+    mWorld.Step(mSettings.fixedTimeStep);
+    for (int i = 0; i < kNetMaxLanders; i++) {
+        FinishStep(mWorld, static_cast<size_t>(i), applied[i]);
+    }
+    mStepCount++;
+    
+    // Drop clients that went quiet
+    const uint64_t timeoutSteps = static_cast<uint64_t>(kPeerTimeout / mSettings.fixedTimeStep);
+    for (size_t i = 0; i < mPeers.size();) {
+        if (mStepCount - mPeers[i].lastHeardStep > timeoutSteps) {
+            LOG_WARNING("Lander %d (%s) timed out", mPeers[i].lander, mPeers[i].address.ToString().c_str());
+            mActiveMask &= static_cast<uint8_t>(~(1u << mPeers[i].lander));
+            mPeers.erase(mPeers.begin() + static_cast<std::ptrdiff_t>(i));
+        } else {
+            i++;
+        }
+    }
+    
+    if (mStepCount % static_cast<uint64_t>(mSnapshotInterval) == 0) {
+        HostSendSnapshots();
+    }
+    
+    // Nobody draws a dedicated session
+    if (!mDedicated) {
+        NetWorldState world;
+        CaptureWorld(mWorld, mActiveMask, world);
+        UpdateRemote(world, 0);
+    }
+}
+
+void NetSession::HostReceive() {
+    uint8_t buffer[kNetMaxPacketSize];
+    NetAddress from;
+    int size;
+    while ((size = mSocket.Receive(from, buffer, sizeof(buffer))) > 0) {
+        mStats.bytesReceived += size;
+        mStats.packetsReceived++;
+        
+        NetBitReader reader(buffer, static_cast<size_t>(size));
+        NetPacketType type = static_cast<NetPacketType>(reader.Read(8));
+        auto peer = std::find_if(mPeers.begin(), mPeers.end(),
+                                 [&](const Peer& p) { return p.address == from; });
+        switch (type) {
+            case NetPacketType::Hello: {
+                uint32_t magic = reader.Read(32);
+                uint32_t version = reader.Read(16);
+                if (magic != kNetProtocolMagic || version != kNetProtocolVersion) {
+                    LOG_WARNING("Refused %s: protocol version %u", from.ToString().c_str(), version);
+                    uint8_t goodbye = static_cast<uint8_t>(NetPacketType::Goodbye);
+                    Send(from, &goodbye, 1);
+                    break;
+                }
+                HostHandleHello(from);
+                break;
+            }
+            case NetPacketType::Input:
+                if (peer != mPeers.end()) {
+                    peer->lastHeardStep = mStepCount;
+                    HostHandleInput(*peer, reader);
+                }
+                break;
+            case NetPacketType::Goodbye:
+                if (peer != mPeers.end()) {
+                    LOG_INFO("Lander %d (%s) left", peer->lander, from.ToString().c_str());
+                    mActiveMask &= static_cast<uint8_t>(~(1u << peer->lander));
+                    mPeers.erase(peer);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void NetSession::HostHandleHello(const NetAddress& from) {
+    auto peer = std::find_if(mPeers.begin(), mPeers.end(), [&](const Peer& p) { return p.address == from; });
+    int lander = peer != mPeers.end() ? peer->lander : -1;
+    
+    // A new client takes the first free lander
+    if (lander < 0) {
+        for (int i = mDedicated ? 0 : 1; i < kNetMaxLanders && lander < 0; i++) {
+            if (!(mActiveMask & (1u << i))) {
+                lander = i;
+            }
+        }
+        if (lander < 0) {
+            LOG_WARNING("Refused %s: session full", from.ToString().c_str());
+            uint8_t goodbye = static_cast<uint8_t>(NetPacketType::Goodbye);
+            Send(from, &goodbye, 1);
+            return;
+        }
+        Peer joined;
+        joined.address = from;
+        joined.lander = lander;
+        joined.nextInput = 0;
+        joined.lastActions = 0;
+        joined.ackedSnapshot = kNetNoBaseline;
+        joined.lastHeardStep = mStepCount;
+        mPeers.push_back(joined);
+        mActiveMask |= static_cast<uint8_t>(1u << lander);
+        mWorld.ResetLander(static_cast<size_t>(lander));
+        LOG_INFO("Lander %d joined from %s", lander, from.ToString().c_str());
+    }
+    
+    // Sent again for a repeated Hello, in case the first Welcome was lost
+    uint8_t packet[kNetMaxPacketSize];
+    NetBitWriter writer(packet, sizeof(packet));
+    writer.Write(static_cast<uint32_t>(NetPacketType::Welcome), 8);
+    writer.Write(static_cast<uint32_t>(lander), 8);
+    writer.Write(static_cast<uint32_t>(mSnapshotInterval), 8);
+    writer.Write(mSettings.seed, 32);
+    writer.WriteFloat(mSettings.fixedTimeStep);
+    writer.WriteFloat(mSettings.gravity);
+    writer.WriteFloat(mSettings.maxFuel);
+    writer.WriteFloat(mSettings.fuelRate);
+    writer.WriteFloat(mSettings.spawnX);
+    writer.WriteFloat(mSettings.spawnY);
+    writer.WriteFloat(mSettings.spawnVelX);
+    writer.WriteFloat(mSettings.spawnVelY);
+    writer.WriteFloat(mSettings.spawnFuel);
+    writer.WriteFloat(mSettings.landerWidth);
+    writer.WriteFloat(mSettings.landerHeight);
+    writer.Write(mSettings.worldWidth, 16);
+    writer.Write(mSettings.worldHeight, 16);
+    Send(from, packet, writer.GetSize());
+}
+
+void NetSession::HostHandleInput(Peer& peer, NetBitReader& reader) {
+    uint16_t ack = static_cast<uint16_t>(reader.Read(16));
+    uint32_t sequence = reader.Read(32);
+    int runs = static_cast<int>(reader.Read(7));
+    uint8_t actions[kNetMaxInputsPerPacket];
+    int count = 0;
+    for (int i = 0; i < runs; i++) {
+        uint8_t value = static_cast<uint8_t>(reader.Read(kNetActionBits));
+        int length = static_cast<int>(reader.Read(6)) + 1;
+        for (int j = 0; j < length && count < kNetMaxInputsPerPacket; j++) {
+            actions[count++] = value;
+        }
+    }
+    if (reader.IsOverflowed()) {
+        return;
+    }
+    
+    if (ack != kNetNoBaseline && (peer.ackedSnapshot == kNetNoBaseline || IsNewer(ack, peer.ackedSnapshot))) {
+        peer.ackedSnapshot = ack;
+    }
+    
+    // Inputs already queued or applied are skipped; a gap (inputs the client
+    // gave up resending) is filled with the last actions known
+    uint32_t expected = peer.nextInput + static_cast<uint32_t>(peer.inputs.size());
+    int32_t gap = static_cast<int32_t>(sequence - expected);
+    if (gap > kNetMaxInputsPerPacket) {
+        peer.inputs.clear();
+        peer.nextInput = sequence;
+        expected = sequence;
+        gap = 0;
+    }
+    for (int32_t i = 0; i < gap; i++) {
+        peer.inputs.push_back(peer.inputs.empty() ? peer.lastActions : peer.inputs.back());
+        expected++;
+    }
+    for (int i = 0; i < count; i++, sequence++) {
+        if (sequence == expected) {
+            peer.inputs.push_back(actions[i]);
+            expected++;
+        }
+    }
+}
+
+void NetSession::HostSendSnapshots() {
+    mSnapshotSequence = static_cast<uint16_t>(mSnapshotSequence + 1);
+    if (mSnapshotSequence == kNetNoBaseline) {
+        mSnapshotSequence = 0;
+    }
+    HistoryEntry& entry = mHistory[mSnapshotSequence % kNetSnapshotHistory];
+    entry.sequence = mSnapshotSequence;
+    entry.valid = true;
+    CaptureWorld(mWorld, mActiveMask, entry.world);
+    
+    for (const Peer& peer : mPeers) {
+        // Against the newest snapshot this client has, if it is still kept
+        const HistoryEntry* baseline =
+            peer.ackedSnapshot != kNetNoBaseline ? FindHistory(peer.ackedSnapshot) : nullptr;
+        uint8_t packet[kNetMaxPacketSize];
+        NetBitWriter writer(packet, sizeof(packet));
+        writer.Write(static_cast<uint32_t>(NetPacketType::Snapshot), 8);
+        writer.Write(mSnapshotSequence, 16);
+        writer.Write(baseline ? baseline->sequence : kNetNoBaseline, 16);
+        writer.Write(peer.nextInput, 32);
+        NetProtocol::WriteWorld(writer, baseline ? &baseline->world : nullptr, entry.world);
+        if (!writer.IsOverflowed()) {
+            Send(peer.address, packet, writer.GetSize());
+        }
+    }
+}
+
+void NetSession::ClientStep(uint8_t actions) {
+    ClientReceive();
+    if (!mConnected) {
+        return;
+    }
+    
+    // Predict: the step the host will take once this input reaches it
+    mPendingInputs.push_back(actions);
+    while (mPendingInputs.size() > kMaxPendingInputs) {
+        mPendingInputs.pop_front();
+        mFirstPendingInput++;
+    }
+    ApplyActions(mPredicted, 0, actions);
+    mPredicted.Step(mSettings.fixedTimeStep);
+    FinishStep(mPredicted, 0, actions);
+    mStepCount++;
+    
+    if (mStepCount - mLastHeardStep > static_cast<uint64_t>(kPeerTimeout / mSettings.fixedTimeStep)) {
+        LOG_ERROR("Lost the connection to %s", mHostAddress.ToString().c_str());
+        mConnected = false;
+        return;
+    }
+    if (mStepCount % static_cast<uint64_t>(mSnapshotInterval) == 0) {
+        ClientSendInputs();
+    }
+}
+
+void NetSession::ClientReceive() {
+    uint8_t buffer[kNetMaxPacketSize];
+    NetAddress from;
+    int size;
+    while ((size = mSocket.Receive(from, buffer, sizeof(buffer))) > 0) {
+        if (from != mHostAddress) {
+            continue;
+        }
+        mStats.bytesReceived += size;
+        mStats.packetsReceived++;
+        
+        NetBitReader reader(buffer, static_cast<size_t>(size));
+        NetPacketType type = static_cast<NetPacketType>(reader.Read(8));
+        if (type == NetPacketType::Snapshot) {
+            ClientHandleSnapshot(reader);
+        } else if (type == NetPacketType::Goodbye) {
+            LOG_WARNING("%s ended the session", mHostAddress.ToString().c_str());
+            mConnected = false;
+            return;
+        }
+    }
+}
+
+void NetSession::ClientHandleSnapshot(NetBitReader& reader) {
+    uint16_t sequence = static_cast<uint16_t>(reader.Read(16));
+    uint16_t baselineSequence = static_cast<uint16_t>(reader.Read(16));
+    uint32_t nextInput = reader.Read(32);
+    if (mLatestSnapshot != kNetNoBaseline && !IsNewer(sequence, mLatestSnapshot)) {
+        return;   // Late or repeated
+    }
+    
+    // A baseline that has left the history can't be decoded; the host moves
+    // on to a newer one once this end's acks get through
+    const HistoryEntry* baseline = nullptr;
+    if (baselineSequence != kNetNoBaseline) {
+        baseline = FindHistory(baselineSequence);
+        if (!baseline) {
+            return;
+        }
+    }
+    NetWorldState world;
+    if (!NetProtocol::ReadWorld(reader, baseline ? &baseline->world : nullptr, world)) {
+        return;
+    }
+    HistoryEntry& entry = mHistory[sequence % kNetSnapshotHistory];
+    entry.sequence = sequence;
+    entry.valid = true;
+    entry.world = world;
+    mLatestSnapshot = sequence;
+    mLastHeardStep = mStepCount;
+    UpdateRemote(world, mLocalIndex);
+    if (!(world.activeMask & (1u << mLocalIndex))) {
+        return;
+    }
+    
+    // Reconcile: the host's state after the inputs before nextInput, then
+    // the inputs it hasn't applied yet on top
+    while (!mPendingInputs.empty() && static_cast<int32_t>(nextInput - mFirstPendingInput) > 0) {
+        mPendingInputs.pop_front();
+        mFirstPendingInput++;
+    }
+    if (mPendingInputs.empty()) {
+        mFirstPendingInput = nextInput;
+    }
+    LanderBatchLander before;
+    NetLanderState predicted;
+    mPredicted.GetLander(0, before);
+    NetProtocol::Quantize(before, predicted);
+    
+    LanderBatchLander lander;
+    NetProtocol::Dequantize(world.landers[mLocalIndex], lander);
+    mPredicted.SetLander(0, lander);
+    for (uint8_t actions : mPendingInputs) {
+        ApplyActions(mPredicted, 0, actions);
+        mPredicted.Step(mSettings.fixedTimeStep);
+        FinishStep(mPredicted, 0, actions);
+    }
+    
+    NetLanderState corrected;
+    mPredicted.GetLander(0, lander);
+    NetProtocol::Quantize(lander, corrected);
+    // The rewind itself moves the lander by up to half a cell; more than a
+    // cell is the host disagreeing (a late input guessed, another lander)
+    if (std::abs(corrected.x - predicted.x) > 1 || std::abs(corrected.y - predicted.y) > 1 ||
+        corrected.state != predicted.state) {
+        mStats.corrections++;
+        LOG_DEBUG_EVERY(1000, "Prediction corrected by (%g, %g) m", lander.x - before.x, lander.y - before.y);
+    }
+}
+
+void NetSession::ClientSendInputs() {
+    // Every input the host hasn't applied, newest kNetMaxInputsPerPacket
+    // if it has fallen that far behind
+    const size_t count = std::min(mPendingInputs.size(), static_cast<size_t>(kNetMaxInputsPerPacket));
+    const size_t start = mPendingInputs.size() - count;
+    
+    uint8_t packet[kNetMaxPacketSize];
+    NetBitWriter writer(packet, sizeof(packet));
+    writer.Write(static_cast<uint32_t>(NetPacketType::Input), 8);
+    writer.Write(mLatestSnapshot, 16);
+    writer.Write(mFirstPendingInput + static_cast<uint32_t>(start), 32);
+    
+    uint8_t runActions[kNetMaxInputsPerPacket];
+    uint8_t runLengths[kNetMaxInputsPerPacket];
+    int runs = 0;
+    for (size_t i = start; i < mPendingInputs.size(); i++) {
+        if (runs > 0 && runActions[runs - 1] == mPendingInputs[i]) {
+            runLengths[runs - 1]++;
+        } else {
+            runActions[runs] = mPendingInputs[i];
+            runLengths[runs] = 1;
+            runs++;
+        }
+    }
+    writer.Write(static_cast<uint32_t>(runs), 7);
+    for (int i = 0; i < runs; i++) {
+        writer.Write(runActions[i], kNetActionBits);
+        writer.Write(runLengths[i] - 1u, 6);
+    }
+    Send(mHostAddress, packet, writer.GetSize());
+}
+
+void NetSession::LogStats() const {
+    const double seconds = mStats.steps * static_cast<double>(mSettings.fixedTimeStep);
+    if (seconds <= 0.0) {
+        return;
+    }
+    const double down = mStats.bytesReceived * 8.0 / 1000.0 / seconds;
+    const double up = mStats.bytesSent * 8.0 / 1000.0 / seconds;
+    
+    // Snapshot traffic divided over the landers it carries
+    const int landers = std::max(1, GetLanderCount());
+    const double perLander = mIsHost ? up / std::max<size_t>(1, mPeers.size()) / landers : down / landers;
+    LOG_INFO("Session %s: %.2f kbit/s down, %.2f kbit/s up (%.2f kbit/s per lander), "
+             "%llu packets in, %llu out, %llu prediction corrections",
+             mIsHost ? "host" : "client", down, up, perLander,
+             static_cast<unsigned long long>(mStats.packetsReceived),
+             static_cast<unsigned long long>(mStats.packetsSent),
+             static_cast<unsigned long long>(mStats.corrections));
+}
@@ -0,0 +1,180 @@
+// NetSession.h
+// Host-authoritative multi-lander sessions over UDP, with client-side prediction
+
+#pragma once
+
+#include "LanderBatch.h"
+#include "NetProtocol.h"
+#include "NetSocket.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Forward declarations
+class Terrain;
+
+// What a client adopts from the host so both step the same world
+struct NetSessionSettings {
+    uint32_t seed;
+    float fixedTimeStep;      // Seconds
+    float gravity;            // m/s²
+    float maxFuel;            // kg
+    float fuelRate;           // kg/s at full thrust
+    float spawnX, spawnY;     // Meters
+    float spawnVelX, spawnVelY;   // m/s a lander starts (and respawns) moving at
+    float spawnFuel;          // kg a lander starts with (at most maxFuel)
+    float landerWidth;        // Meters
+    float landerHeight;
+    uint16_t worldWidth;      // 2D terrain size (pixels)
+    uint16_t worldHeight;
+};
+
+// Traffic counters for one end of a session
+struct NetSessionStats {
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    uint64_t packetsSent;
+    uint64_t packetsReceived;
+    uint64_t corrections;     // Client: snapshots that moved the predicted lander over a grid cell
+    uint64_t steps;
+};
+
+// A 2D session of up to kNetMaxLanders landers, stepped as a LanderBatch.
+//
+// The host owns the world: every fixed step it applies one queued action
+// byte per client, steps the batch and, every few steps, sends each client
+// a snapshot delta-coded against the last one that client acknowledged.
+// When a client's next input hasn't arrived the host repeats its last
+// actions without using one up, so latency delays inputs rather than
+// losing them, however long the round trip. A client steps its own lander
+// ahead of the host with the same inputs, and on each snapshot rewinds it
+// to the host's state and replays the inputs the host hasn't applied yet;
+// other landers are drawn as last received.
+//
+// Step() does all socket work and never blocks; only Connect() waits.
+class NetSession {
+public:
+    NetSession();
+    ~NetSession();
+    
+    NetSession(const NetSession&) = delete;
+    NetSession& operator=(const NetSession&) = delete;
+    
+    // Listen on port with the given world; the host flies lander 0 unless
+    // the session is dedicated, when every lander is a client's
+    bool Host(uint16_t port, const NetSessionSettings& settings);
+    void SetDedicated(bool dedicated) { mDedicated = dedicated; }
+    
+    // Join the host at address, waiting up to timeoutSeconds for it to
+    // answer; on success settings holds the host's world
+    bool Connect(const NetAddress& address, float timeoutSeconds, NetSessionSettings& settings);
+    
+    // Say goodbye and close the socket
+    void Close();
+    
+    // Collide against terrain (the host's seed and size on a client), or
+    // a segment table shared with other sessions
+    void SetTerrain(const Terrain* terrain);
+    void SetTerrain(const std::shared_ptr<const LanderBatchTerrain>& terrain);
+    
+    // One fixed step with this end's kNetAction* bits
+    void Step(uint8_t actions);
+    
+    // This end's lander after the last step (predicted on a client)
+    void GetLocalLander(LanderBatchLander& lander) const;
+    
+    // Everyone else's landers, for drawing
+    const LanderBatch* GetRemoteLanders() const { return &mRemote; }
+    
+    bool IsHost() const { return mIsHost; }
+    
+    // Landers in the session (the host's view)
+    int GetLanderCount() const;
+    
+    // False once a client hasn't heard from its host for a while
+    bool IsConnected() const { return mConnected; }
+    
+    const NetSessionStats& GetStats() const { return mStats; }
+    
+    // Bytes the session holds, not counting its (shared) terrain
+    size_t GetMemoryUsage() const;
+    
+    // Bandwidth summary at LOG_INFO
+    void LogStats() const;
+
+private:
+    // A client as the host sees it
+    struct Peer {
+        NetAddress address;
+        int lander;
+        std::deque<uint8_t> inputs;   // Received, not yet applied
+        uint32_t nextInput;           // Sequence of inputs.front()
+        uint8_t lastActions;
+        uint16_t ackedSnapshot;       // kNetNoBaseline until one arrives
+        uint64_t lastHeardStep;
+    };
+    
+    // A world state kept as a delta baseline
+    struct HistoryEntry {
+        uint16_t sequence;
+        bool valid;
+        NetWorldState world;
+    };
+    
+    void Configure(const NetSessionSettings& settings);
+    
+    // Controls for a step, and what follows it (a lander that isn't flying
+    // is held at the spawn point)
+    static void ApplyActions(LanderBatch& batch, size_t index, uint8_t actions);
+    static void FinishStep(LanderBatch& batch, size_t index, uint8_t actions);
+    
+    void HostStep(uint8_t actions);
+    void HostReceive();
+    void HostHandleHello(const NetAddress& from);
+    void HostHandleInput(Peer& peer, NetBitReader& reader);
+    void HostSendSnapshots();
+    
+    void ClientStep(uint8_t actions);
+    void ClientReceive();
+    void ClientHandleSnapshot(NetBitReader& reader);
+    void ClientSendInputs();
+    
+    // World state of a batch (landers in activeMask)
+    void CaptureWorld(const LanderBatch& batch, uint8_t activeMask, NetWorldState& world) const;
+    
+    // Copy the landers other than localIndex into mRemote
+    void UpdateRemote(const NetWorldState& world, int localIndex);
+    
+    const HistoryEntry* FindHistory(uint16_t sequence) const;
+    
+    bool Send(const NetAddress& to, const uint8_t* data, size_t size);
+    
+    NetSocket mSocket;
+    NetSessionSettings mSettings;
+    bool mIsHost;
+    bool mDedicated;
+    bool mConnected;
+    int mSnapshotInterval;            // Steps between snapshots
+    uint64_t mStepCount;
+    
+    // Host: the authoritative world and its clients
+    LanderBatch mWorld;
+    uint8_t mActiveMask;
+    std::vector<Peer> mPeers;
+    uint16_t mSnapshotSequence;
+    
+    // Client: own lander and the inputs the host hasn't applied yet
+    NetAddress mHostAddress;
+    int mLocalIndex;
+    LanderBatch mPredicted;
+    std::deque<uint8_t> mPendingInputs;
+    uint32_t mFirstPendingInput;      // Sequence of mPendingInputs.front()
+    uint16_t mLatestSnapshot;         // kNetNoBaseline until one arrives
+    uint64_t mLastHeardStep;
+    
+    // Host: sent worlds; client: received ones
+    HistoryEntry mHistory[kNetSnapshotHistory];
+    
+    LanderBatch mRemote;
+    NetSessionStats mStats;
+};
@@ -0,0 +1,118 @@
+// NetSocket.cpp
+// POSIX implementation of the UDP socket
+
+#include "NetSocket.h"
+#include "Log.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool NetAddress::Parse(const std::string& text, NetAddress& address) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos || colon + 1 == text.size()) {
+        return false;
+    }
+    std::string host = text.substr(0, colon);
+    int port = std::atoi(text.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) {
+        return false;
+    }
+    
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.empty() ? "127.0.0.1" : host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        return false;
+    }
+    const sockaddr_in* resolved = reinterpret_cast<const sockaddr_in*>(result->ai_addr);
+    address.host = ntohl(resolved->sin_addr.s_addr);
+    address.port = static_cast<uint16_t>(port);
+    freeaddrinfo(result);
+    return true;
+}
+
+std::string NetAddress::ToString() const {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%u.%u.%u.%u:%u", (host >> 24) & 0xFF, (host >> 16) & 0xFF,
+                  (host >> 8) & 0xFF, host & 0xFF, port);
+    return text;
+}
+
+NetSocket::NetSocket() : mSocket(-1) {
+}
+
+NetSocket::~NetSocket() {
+    Close();
+}
+
+bool NetSocket::Open(uint16_t port) {
+    Close();
+    mSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (mSocket < 0) {
+        LOG_ERROR("Failed to create UDP socket: %s", std::strerror(errno));
+        return false;
+    }
+    
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(mSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        LOG_ERROR("Failed to bind UDP port %u: %s", port, std::strerror(errno));
+        Close();
+        return false;
+    }
+    
+    int flags = fcntl(mSocket, F_GETFL, 0);
+    if (flags < 0 || fcntl(mSocket, F_SETFL, flags | O_NONBLOCK) != 0) {
+        LOG_ERROR("Failed to make UDP socket non-blocking: %s", std::strerror(errno));
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void NetSocket::Close() {
+    if (mSocket >= 0) {
+        close(mSocket);
+        mSocket = -1;
+    }
+}
+
+bool NetSocket::Send(const NetAddress& to, const void* data, size_t size) {
+    if (mSocket < 0) {
+        return false;
+    }
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(to.host);
+    address.sin_port = htons(to.port);
+    ssize_t sent = sendto(mSocket, data, size, 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    return sent == static_cast<ssize_t>(size);
+}
+
+int NetSocket::Receive(NetAddress& from, void* buffer, size_t capacity) {
+    if (mSocket < 0) {
+        return -1;
+    }
+    sockaddr_in address;
+    socklen_t length = sizeof(address);
+    ssize_t received = recvfrom(mSocket, buffer, capacity, 0, reinterpret_cast<sockaddr*>(&address), &length);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    from.host = ntohl(address.sin_addr.s_addr);
+    from.port = ntohs(address.sin_port);
+    return static_cast<int>(received);
+}
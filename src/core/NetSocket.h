@@ -0,0 +1,49 @@
+// NetSocket.h
+// Non-blocking UDP socket and IPv4 endpoint for network sessions
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// IPv4 address and port, in host byte order
+struct NetAddress {
+    uint32_t host;
+    uint16_t port;
+    
+    NetAddress() : host(0), port(0) {}
+    NetAddress(uint32_t h, uint16_t p) : host(h), port(p) {}
+    
+    bool operator==(const NetAddress& other) const { return host == other.host && port == other.port; }
+    bool operator!=(const NetAddress& other) const { return !(*this == other); }
+    
+    // "host:port", resolving names; false if it does not resolve
+    static bool Parse(const std::string& text, NetAddress& address);
+    std::string ToString() const;
+};
+
+class NetSocket {
+public:
+    NetSocket();
+    ~NetSocket();
+    
+    NetSocket(const NetSocket&) = delete;
+    NetSocket& operator=(const NetSocket&) = delete;
+    
+    // Bind to port on every interface (0 picks a free one); never blocks
+    // after this
+    bool Open(uint16_t port);
+    void Close();
+    bool IsOpen() const { return mSocket >= 0; }
+    
+    // False if the datagram could not be handed to the network stack
+    bool Send(const NetAddress& to, const void* data, size_t size);
+    
+    // Next waiting datagram: its size, 0 when nothing is waiting, or -1 on
+    // an error other than an empty queue
+    int Receive(NetAddress& from, void* buffer, size_t capacity);
+
+private:
+    int mSocket;
+};
@@ -3,9 +3,71 @@
 
 #include "Physics.h"
 #include "Entity.h"
+#include "Integrators.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "PhysicsArena.h"
+#include "Profiler.h"
+#include "RcsThrusters.h"
 #include <cmath>
-#include <iostream>
 #include <algorithm>
+#include <cstring>
+
+// Sweep-and-prune bounds: before any terrain, and around one (meters)
+static const float kDefaultWorldExtent = 10000.0f;
+static const float kBroadphaseMargin = 50.0f;
+static const float kBroadphaseCeiling = 1000.0f;   // Above the highest terrain point
+
+// Lander legs (meters, kilograms)
+static const float kLegSpread = 0.35f;      // Foot outboard of the hull's corner
+static const float kLegDrop = 0.45f;        // Foot center below the hull's bottom
+static const float kStrutRadius = 0.03f;
+static const float kFootRadius = 0.15f;
+static const float kFootMass = 5.0f;
+static const float kStrutTravel = 0.25f;    // Compression stroke
+static const float kStrutStatic = 0.05f;    // Compression under the lander's weight
+static const float kStrutDampingRatio = 0.7f;
+
+// Height the lander coasts above the highest ground, past the fall of the
+// step itself (meters)
+static const float kCoastClearance = 10.0f;
+
+// Crash debris: the pool's boxes (half extents in meters, kilograms) - a
+// hull panel, a tank chunk and a strut - and how they fly off and settle
+static const float kDebrisExtents[3][3] = {{0.45f, 0.08f, 0.35f}, {0.25f, 0.25f, 0.25f}, {0.05f, 0.05f, 0.5f}};
+static const float kDebrisMass[3] = {12.0f, 20.0f, 4.0f};
+static const float kDebrisBurstRatio = 0.35f;      // Outward speed per m/s of impact
+static const float kDebrisMinBurst = 1.5f;         // m/s
+static const float kDebrisMaxBurst = 8.0f;
+static const float kDebrisMaxSpin = 8.0f;          // rad/s about each axis
+static const float kDebrisLinearSleep = 1.5f;      // m/s, against the lander's 0.8
+static const float kDebrisAngularSleep = 2.0f;     // rad/s
+static const float kDebrisLinearDamping = 0.05f;
+static const float kDebrisAngularDamping = 0.3f;
+
+// -1 to 1 from a hash of a debris piece's spawn and draw, so the same
+// crash always scatters the same way
+static float DebrisScatter(uint32_t spawn, uint32_t draw) {
+    uint32_t h = spawn * 0x9e3779b9u ^ draw * 0x85ebca6bu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return static_cast<float>(h >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+// A rotation after spinning at angularVelocity (rad/s) for time seconds
+static btQuaternion SpinRotation(const btQuaternion& rotation, const btVector3& angularVelocity, float time) {
+    btQuaternion turn = btQuaternion::getIdentity();
+    const btScalar angle = angularVelocity.length() * time;
+    if (angle > 0) {
+        turn = btQuaternion(angularVelocity.normalized(), angle);
+    }
+    btQuaternion spun = turn * rotation;
+    spun.normalize();
+    return spun;
+}
 
 Physics::Physics()
     : mGravity(1.62f)      // Lunar gravity (m/s²)
@@ -14,25 +76,156 @@ Physics::Physics()
     , mLander(nullptr)
     , mTerrain(nullptr)
     , mTimeScale(1.0f)     // Normal simulation speed (1:1)
-    , mPixelsPerMeter(20.0f) // Conversion factor: 20 pixels = 1 meter
     , mCollisionConfiguration(nullptr)
     , mDispatcher(nullptr)
     , mBroadphase(nullptr)
+    , mBroadphaseType(PhysicsBroadphase::DBVT)
+    , mBroadphaseMin(-kDefaultWorldExtent, -kDefaultWorldExtent, -kDefaultWorldExtent)
+    , mBroadphaseMax(kDefaultWorldExtent, kDefaultWorldExtent, kDefaultWorldExtent)
     , mSolver(nullptr)
+    , mSolverMt(nullptr)
     , mDynamicsWorld(nullptr)
+    , mJobSystem(nullptr)
+    , mTaskScheduler(nullptr)
+    , mRequestedThreadCount(0)
+    , mCraterPending(false)
+    , mCraterX(0.0f)
+    , mCraterZ(0.0f)
+    , mCraterRadius(0.0f)
+    , mDebrisNext(0)
+    , mDebrisSpawns(0)
     , mLanderRigidBody(nullptr)
-    , mSoftBodyCollisionConfiguration(nullptr)
-    , mSoftRigidDynamicsWorld(nullptr)
+    , mLanderBodyMass(0.0f)
+    , mTerrainMesh(nullptr)
+    , mTerrainLayoutVersion(0)
+    , mBodiesTerrain(nullptr)
+    , mSleepLinearThreshold(0.8f)   // Bullet's defaults
+    , mSleepAngularThreshold(1.0f)
+    , mActiveBodyCount(0)
+    , mBallisticCoasting(false)
+    , mAdaptiveStepping(true)
+    , mStepIndex(0)
+    , mStrideSteps(1)
+    , mStridePending(0)
+    , mStrideTime(0.0f)
+    , mStrideThrust(0.0f)
+    , mStrideRcs(0.0f)
+    , mStrideVelocity(0, 0, 0)
+    , mStrideAngularVelocity(0, 0, 0)
+    , mStrideAcceleration(0, 0, 0)
 {
+    mStrideStart.setIdentity();
+    mLanderBodyExtents[0] = mLanderBodyExtents[1] = mLanderBodyExtents[2] = 0.0f;
+    for (btBoxShape*& shape : mDebrisShapes) {
+        shape = nullptr;
+    }
+    for (btRigidBody*& piece : mDebrisBodies) {
+        piece = nullptr;
+    }
+    mPlume = PlumeImpingement();
+    for (LanderLeg& part : mLegs) {
+        part.foot = nullptr;
+        part.strut = nullptr;
+        part.restFrame.setIdentity();
+    }
+    ResetLanderParts();
+    mTerrainShapeKey = TerrainShapeKey();
+    
+    // Before the first Bullet object, so everything Bullet frees came from the arena
+    PhysicsArena::Install();
+}
+
+#ifdef USE_BULLET_MT
+// Runs Bullet's parallel loops on the game's job system
+class JobSystemTaskScheduler : public btITaskScheduler {
+public:
+    JobSystemTaskScheduler(JobSystem* jobSystem)
+        : btITaskScheduler("JobSystem")
+        , mJobSystem(jobSystem)
+        , mNumThreads(jobSystem->GetWorkerCount() + 1)
+    {
+    }
+    
+    int getMaxNumThreads() const override {
+        return std::min(mJobSystem->GetWorkerCount() + 1, BT_MAX_THREAD_COUNT);
+    }
+    int getNumThreads() const override { return mNumThreads; }
+    void setNumThreads(int numThreads) override {
+        mNumThreads = std::max(1, std::min(numThreads, getMaxNumThreads()));
+    }
+    
+    void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body) override {
+        if (iEnd <= iBegin) {
+            return;
+        }
+        if (mNumThreads <= 1) {
+            body.forLoop(iBegin, iEnd);
+            return;
+        }
+        mJobSystem->ParallelFor(iEnd - iBegin, grainSize, [&](size_t begin, size_t end) {
+            body.forLoop(iBegin + static_cast<int>(begin), iBegin + static_cast<int>(end));
+        });
+    }
+    
+    btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody& body) override {
+        if (iEnd <= iBegin) {
+            return btScalar(0);
+        }
+        if (mNumThreads <= 1) {
+            return body.sumLoop(iBegin, iEnd);
+        }
+        
+        // One partial sum per chunk, added in order so the result is stable
+        int chunkSize = std::max(1, grainSize);
+        int chunkCount = (iEnd - iBegin + chunkSize - 1) / chunkSize;
+        std::vector<btScalar> partialSums(chunkCount, btScalar(0));
+        mJobSystem->ParallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; ++chunk) {
+                int begin = iBegin + static_cast<int>(chunk) * chunkSize;
+                int end = std::min(iEnd, begin + chunkSize);
+                partialSums[chunk] = body.sumLoop(begin, end);
+            }
+        });
+        
+        btScalar sum = btScalar(0);
+        for (btScalar partial : partialSums) {
+            sum += partial;
+        }
+        return sum;
+    }
+    
+private:
+    JobSystem* mJobSystem;
+    int mNumThreads;
+};
+#endif
+
+bool Physics::IsMultithreadingAvailable() {
+#ifdef USE_BULLET_MT
+    return true;
+#else
+    return false;
+#endif
+}
+
+int Physics::GetThreadCount() const {
+#ifdef USE_BULLET_MT
+    if (mTaskScheduler) {
+        return mTaskScheduler->getNumThreads();
+    }
+#endif
+    return 1;
 }
 
 Physics::~Physics() {
     CleanupBulletPhysics();
+    LOG_INFO("Bullet arena: %.1f MB reserved, %.1f KB still live",
+             PhysicsArena::GetReservedBytes() / 1048576.0, PhysicsArena::GetLiveBytes() / 1024.0);
 }
 
 void Physics::Initialize() {
     // Initialize physics system
-    std::cout << "Physics system initialized with Lunar gravity: " << mGravity << " m/s²" << std::endl;
+    LOG_INFO("Physics system initialized with Lunar gravity: %g m/s²", mGravity);
     
     // Initialize Bullet Physics if in 3D mode
     if (m3DMode) {
@@ -44,82 +237,170 @@ void Physics::InitializeBulletPhysics() {
     // Clean up previous instance if any
     CleanupBulletPhysics();
     
+    // Bullet's internal scopes show up under "Bullet Step" in an external
+    // profiler
+    ProfilerHooks::HookBullet();
+    
     // Create collision configuration
     mCollisionConfiguration = new btDefaultCollisionConfiguration();
-    mDispatcher = new btCollisionDispatcher(mCollisionConfiguration);
     
-    // Create broadphase
-    mBroadphase = new btDbvtBroadphase();
+    // Create broadphase. Sweep-and-prune starts over the bounds it last had
+    // (a generous default the first time) and is refitted to the terrain.
+    mBroadphase = CreateBroadphase(mBroadphaseType, mBroadphaseMin, mBroadphaseMax);
     
-    // Create solver
-    mSolver = new btSequentialImpulseConstraintSolver();
+#ifdef USE_BULLET_MT
+    // Pick a task scheduler: the job system if we have one, else Bullet's own
+    if (mJobSystem) {
+        mTaskScheduler = new JobSystemTaskScheduler(mJobSystem);
+    } else {
+        mTaskScheduler = btCreateDefaultTaskScheduler();
+    }
+#endif
     
-    // Create dynamics world
-    mDynamicsWorld = new btDiscreteDynamicsWorld(mDispatcher, mBroadphase, mSolver, mCollisionConfiguration);
+    if (mTaskScheduler) {
+#ifdef USE_BULLET_MT
+        int threadCount = mRequestedThreadCount > 0 ? mRequestedThreadCount : mTaskScheduler->getMaxNumThreads();
+        mTaskScheduler->setNumThreads(threadCount);
+        btSetTaskScheduler(mTaskScheduler);
+        
+        // Parallel narrowphase, one solver per thread and a parallel island solver
+        mDispatcher = new btCollisionDispatcherMt(mCollisionConfiguration, 40);
+        mSolver = new btConstraintSolverPoolMt(mTaskScheduler->getNumThreads());
+        mSolverMt = new btSequentialImpulseConstraintSolverMt();
+        mDynamicsWorld = new btDiscreteDynamicsWorldMt(mDispatcher, mBroadphase,
+            static_cast<btConstraintSolverPoolMt*>(mSolver), mSolverMt, mCollisionConfiguration);
+        
+        LOG_INFO("Bullet multithreaded world using %s scheduler with %d threads",
+                 mTaskScheduler->getName(), mTaskScheduler->getNumThreads());
+#endif
+    } else {
+        // Single-threaded world
+        mDispatcher = new btCollisionDispatcher(mCollisionConfiguration);
+        mSolver = new btSequentialImpulseConstraintSolver();
+        mDynamicsWorld = new btDiscreteDynamicsWorld(mDispatcher, mBroadphase, mSolver, mCollisionConfiguration);
+    }
     
     // Set gravity
-    mDynamicsWorld->setGravity(btVector3(0, -mGravity, 0));
+    SetGravity(mGravity);
     
-    // Initialize soft body world info for regolith simulation
-    mSoftBodyWorldInfo.air_density = mAirDensity;
-    mSoftBodyWorldInfo.water_density = 0;
-    mSoftBodyWorldInfo.water_offset = 0;
-    mSoftBodyWorldInfo.water_normal = btVector3(0, 0, 0);
-    mSoftBodyWorldInfo.m_gravity.setValue(0, -mGravity, 0);
-    mSoftBodyWorldInfo.m_broadphase = mBroadphase;
-    mSoftBodyWorldInfo.m_dispatcher = mDispatcher;
+    // The debris pool, parked until a crash
+    CreateDebrisPool();
     
-    // Create soft body physics world
-    mSoftBodyCollisionConfiguration = new btSoftBodyRigidBodyCollisionConfiguration();
-    btCollisionDispatcher* softDispatcher = new btCollisionDispatcher(mSoftBodyCollisionConfiguration);
-    mSoftRigidDynamicsWorld = new btSoftRigidDynamicsWorld(softDispatcher, mBroadphase, mSolver, mSoftBodyCollisionConfiguration);
-    mSoftRigidDynamicsWorld->setGravity(btVector3(0, -mGravity, 0));
+    // Touchdowns arrive as contact events rather than by polling manifolds
+    gContactStartedCallback = OnContactStarted;
+    gContactEndedCallback = OnContactEnded;
     
-    std::cout << "Bullet Physics initialized" << std::endl;
+    LOG_INFO("Bullet Physics initialized (%s broadphase)", GetBroadphaseName(mBroadphaseType));
 }
 
-void Physics::CleanupBulletPhysics() {
-    // Clean up rigid bodies
-    if (mLanderRigidBody) {
-        if (mDynamicsWorld) {
-            mDynamicsWorld->removeRigidBody(mLanderRigidBody);
+bool Physics::ParseBroadphase(const char* name, PhysicsBroadphase& broadphase) {
+    for (PhysicsBroadphase candidate : { PhysicsBroadphase::DBVT, PhysicsBroadphase::SAP, PhysicsBroadphase::SAP32 }) {
+        if (std::strcmp(name, GetBroadphaseName(candidate)) == 0) {
+            broadphase = candidate;
+            return true;
         }
-        delete mLanderRigidBody->getMotionState();
-        delete mLanderRigidBody->getCollisionShape();
-        delete mLanderRigidBody;
-        mLanderRigidBody = nullptr;
+    }
+    return false;
+}
+
+const char* Physics::GetBroadphaseName(PhysicsBroadphase broadphase) {
+    switch (broadphase) {
+        case PhysicsBroadphase::SAP: return "sap";
+        case PhysicsBroadphase::SAP32: return "sap32";
+        default: return "dbvt";
+    }
+}
+
+btBroadphaseInterface* Physics::CreateBroadphase(PhysicsBroadphase broadphase, const btVector3& worldMin,
+                                                 const btVector3& worldMax) {
+    switch (broadphase) {
+        case PhysicsBroadphase::SAP: return new btAxisSweep3(worldMin, worldMax);
+        case PhysicsBroadphase::SAP32: return new bt32BitAxisSweep3(worldMin, worldMax);
+        default: return new btDbvtBroadphase();
+    }
+}
+
+// Sweep-and-prune quantizes over fixed bounds: anything outside is clamped
+// to the edge cells, where every object overlaps every other. Once the
+// terrain is known, rebuild the broadphase over its box, widened by a
+// margin and raised by the flight ceiling, moving every proxy across.
+void Physics::FitBroadphaseToTerrain(const btRigidBody* terrainBody) {
+    if (mBroadphaseType == PhysicsBroadphase::DBVT) {
+        return;
     }
     
-    for (auto body : mTerrainRigidBodies) {
-        if (mDynamicsWorld) {
-            mDynamicsWorld->removeRigidBody(body);
-        }
-        delete body->getMotionState();
-        delete body->getCollisionShape();
-        delete body;
+    btVector3 terrainMin;
+    btVector3 terrainMax;
+    terrainBody->getCollisionShape()->getAabb(terrainBody->getWorldTransform(), terrainMin, terrainMax);
+    const btVector3 margin(kBroadphaseMargin, kBroadphaseMargin, kBroadphaseMargin);
+    btVector3 worldMin = terrainMin - margin;
+    btVector3 worldMax = terrainMax + margin + btVector3(0, kBroadphaseCeiling, 0);
+    if (worldMin == mBroadphaseMin && worldMax == mBroadphaseMax) {
+        return;
     }
-    mTerrainRigidBodies.clear();
+    
+    btBroadphaseInterface* broadphase = CreateBroadphase(mBroadphaseType, worldMin, worldMax);
+    btCollisionObjectArray& objects = mDynamicsWorld->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); i++) {
+        btCollisionObject* object = objects[i];
+        btBroadphaseProxy* proxy = object->getBroadphaseHandle();
+        if (!proxy) continue;
+        
+        // Destroying the proxy drops its pairs and their manifolds
+        int group = proxy->m_collisionFilterGroup;
+        int mask = proxy->m_collisionFilterMask;
+        mBroadphase->destroyProxy(proxy, mDispatcher);
+        
+        btVector3 aabbMin;
+        btVector3 aabbMax;
+        object->getCollisionShape()->getAabb(object->getWorldTransform(), aabbMin, aabbMax);
+        object->setBroadphaseHandle(broadphase->createProxy(aabbMin, aabbMax, object->getCollisionShape()->getShapeType(),
+                                                            object, group, mask, mDispatcher));
+    }
+    mDynamicsWorld->setBroadphase(broadphase);
+    delete mBroadphase;
+    mBroadphase = broadphase;
+    mBroadphaseMin = worldMin;
+    mBroadphaseMax = worldMax;
+    
+    LOG_INFO("Fitted %s broadphase to (%.0f, %.0f, %.0f)-(%.0f, %.0f, %.0f)", GetBroadphaseName(mBroadphaseType),
+             worldMin.x(), worldMin.y(), worldMin.z(), worldMax.x(), worldMax.y(), worldMax.z());
+}
+
+void Physics::CleanupBulletPhysics() {
+    // Clean up rigid bodies
+    DestroyLanderRigidBody();
+    DestroyTerrainRigidBodies();
+    DestroyDebrisPool();
     
     // Clean up Bullet Physics objects in reverse order of creation
-    delete mSoftRigidDynamicsWorld;
-    delete mSoftBodyCollisionConfiguration;
     delete mDynamicsWorld;
+    delete mSolverMt;
     delete mSolver;
     delete mBroadphase;
     delete mDispatcher;
     delete mCollisionConfiguration;
     
-    mSoftRigidDynamicsWorld = nullptr;
-    mSoftBodyCollisionConfiguration = nullptr;
     mDynamicsWorld = nullptr;
+    mSolverMt = nullptr;
     mSolver = nullptr;
     mBroadphase = nullptr;
     mDispatcher = nullptr;
     mCollisionConfiguration = nullptr;
+    
+#ifdef USE_BULLET_MT
+    // Hand Bullet back its sequential scheduler before ours goes away
+    if (mTaskScheduler) {
+        btSetTaskScheduler(btGetSequentialTaskScheduler());
+        delete mTaskScheduler;
+        mTaskScheduler = nullptr;
+    }
+#endif
 }
 
 void Physics::RegisterLander(Lander* lander) {
     mLander = lander;
+    ConfigureLanderMass(lander);
     
     // Create rigid body for lander if in 3D mode
     if (m3DMode && mDynamicsWorld) {
@@ -127,13 +408,107 @@ void Physics::RegisterLander(Lander* lander) {
     }
 }
 
+void Physics::GetLanderAngularVelocity(float* angularVelocity) const {
+    btVector3 velocity(0, 0, 0);
+    if (m3DMode && mLanderRigidBody) {
+        velocity = mLanderRigidBody->getAngularVelocity();
+    } else if (!m3DMode && mLander) {
+        velocity.setValue(0, 0, mLander->GetSpin() * static_cast<float>(M_PI / 180.0));
+    }
+    angularVelocity[0] = velocity.x();
+    angularVelocity[1] = velocity.y();
+    angularVelocity[2] = velocity.z();
+}
+
+int Physics::GetLanderContacts(float* points, int maxPoints) const {
+    if (!m3DMode || !mLanderRigidBody) {
+        return 0;
+    }
+    
+    int count = 0;
+    for (const ContactEvent& event : mContactEvents) {
+        if (count >= maxPoints) {
+            break;
+        }
+        if (!event.ground) {
+            continue;
+        }
+        points[count * 3 + 0] = event.point[0];
+        points[count * 3 + 1] = event.point[1];
+        points[count * 3 + 2] = event.point[2];
+        count++;
+    }
+    return count;
+}
+
+void Physics::ResyncLanderBody(const float* angularVelocity) {
+    if (!m3DMode && mLander) {
+        mLander->SetSpin(angularVelocity[2] * static_cast<float>(180.0 / M_PI));
+        return;
+    }
+    if (!m3DMode || !mLander || !mLanderRigidBody) {
+        return;
+    }
+    
+    const float* position = mLander->GetPosition();
+    const Quaternion& orientation = mLander->GetOrientation();
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin(btVector3(position[0], position[1], position[2]));
+    transform.setRotation(btQuaternion(orientation.x, orientation.y, orientation.z, orientation.w));
+    ResetLanderRigidBody(transform);
+    
+    const float* velocity = mLander->GetVelocity();
+    mLanderRigidBody->setLinearVelocity(btVector3(velocity[0], velocity[1], velocity[2]));
+    mLanderRigidBody->setAngularVelocity(btVector3(angularVelocity[0], angularVelocity[1], angularVelocity[2]));
+    for (LanderLeg& leg : mLegs) {
+        leg.foot->setLinearVelocity(mLanderRigidBody->getVelocityInLocalPoint(
+            leg.foot->getWorldTransform().getOrigin() - transform.getOrigin()));
+    }
+}
+
 void Physics::RegisterTerrain(Terrain* terrain) {
     mTerrain = terrain;
+    mRegolith.Reset(terrain);
+    mCraterPending = false;
     
     // Create rigid bodies for terrain if in 3D mode
     if (m3DMode && mDynamicsWorld) {
         CreateTerrainRigidBodies(terrain);
-        CreateRegolithSoftBody(terrain);
+    }
+}
+
+void Physics::SwitchMode(bool use3D, Lander* lander, Terrain* terrain) {
+    m3DMode = use3D;
+    mLander = lander;
+    mTerrain = terrain;
+    ConfigureLanderMass(lander);
+    CancelStride();
+    if (!m3DMode) {
+        return;
+    }
+    
+    if (!mDynamicsWorld) {
+        InitializeBulletPhysics();
+    }
+    
+    // Rebuild the terrain side only if it isn't the one the bodies are for
+    if (terrain && (terrain != mBodiesTerrain || terrain->GetLayoutVersion() != mTerrainLayoutVersion)) {
+        CreateTerrainRigidBodies(terrain);
+    }
+    mRegolith.Reset(terrain);
+    mCraterPending = false;
+    
+    // The lander body starts from wherever the other mode left the lander
+    if (lander) {
+        CreateLanderRigidBody(lander);
+        if (mLanderRigidBody) {
+            const float* velocity = lander->GetVelocity();
+            mLanderRigidBody->setLinearVelocity(btVector3(velocity[0], velocity[1], velocity[2]));
+            for (LanderLeg& leg : mLegs) {
+                leg.foot->setLinearVelocity(mLanderRigidBody->getLinearVelocity());
+            }
+        }
     }
 }
 
@@ -144,136 +519,857 @@ void Physics::SetGravity(float gravity) {
     if (mDynamicsWorld) {
         mDynamicsWorld->setGravity(btVector3(0, -mGravity, 0));
     }
-    
-    if (mSoftRigidDynamicsWorld) {
-        mSoftRigidDynamicsWorld->setGravity(btVector3(0, -mGravity, 0));
-    }
 }
 
 void Physics::Update(float deltaTime) {
+    PROFILE_ZONE("Physics Update");
+    
     // Scale deltaTime to adjust simulation speed
     float scaledDeltaTime = deltaTime * mTimeScale;
     
+    // Mass for the fuel the last step left
+    if (mLander) {
+        mLanderMass.SetFuel(mLander->GetFuel());
+    }
+    
     if (m3DMode) {
-        // Update Bullet physics simulation
-        if (mDynamicsWorld) {
-            mDynamicsWorld->stepSimulation(scaledDeltaTime, 10);
+        // New controls: the stride so far ends with the last step
+        if (mStridePending > 0 && mLander) {
+            const float thrust = mLander->IsThrustActive() ? mLander->GetThrustLevel() : 0.0f;
+            if (thrust != mStrideThrust || mLander->GetRcsCommand() != mStrideRcs) {
+                FinishStride();
+            }
         }
-        
-        // Update soft body physics
-        if (mSoftRigidDynamicsWorld) {
-            mSoftRigidDynamicsWorld->stepSimulation(scaledDeltaTime, 10);
+        if (mStridePending == 0) {
+            BeginStride(scaledDeltaTime);
         }
+        mStepIndex++;
+        mStridePending++;
+        mStrideTime += scaledDeltaTime;
         
-        // Sync lander position with physics
-        if (mLander && mLanderRigidBody) {
-            SyncLanderWithPhysics(mLander);
+        if (mStridePending >= mStrideSteps) {
+            FinishStride();
+        } else {
+            PreviewStride();
         }
-        
-        // Check for collisions
-        CheckCollisions3D();
     } else {
         // Use original 2D physics for backward compatibility
         Update2D(scaledDeltaTime);
     }
 }
 
-// Create a rigid body for the lander
-void Physics::CreateLanderRigidBody(Lander* lander) {
-    if (!lander) return;
+// Apply the forces for the controls now, and pick how many steps they hold
+// for before Bullet steps
+void Physics::BeginStride(float deltaTime) {
+    // Engine force for this step, on a hull as heavy as the lander now is
+    if (mLander && mLanderRigidBody) {
+        if (mLanderMass.IsStale()) {
+            ApplyLanderMass();
+        }
+        ApplyThrust(mLander, deltaTime);
+        ApplyRcs(mLander);
+    }
+    mStrideThrust = mLander && mLander->IsThrustActive() ? mLander->GetThrustLevel() : 0.0f;
+    mStrideRcs = mLander ? mLander->GetRcsCommand() : 0.0f;
+    mStrideTime = 0.0f;
     
-    // Clean up existing rigid body
     if (mLanderRigidBody) {
-        mDynamicsWorld->removeRigidBody(mLanderRigidBody);
-        delete mLanderRigidBody->getMotionState();
-        delete mLanderRigidBody->getCollisionShape();
-        delete mLanderRigidBody;
-        mLanderRigidBody = nullptr;
+        mStrideStart = mLanderRigidBody->getWorldTransform();
+        mStrideVelocity = mLanderRigidBody->getLinearVelocity();
+        mStrideAngularVelocity = mLanderRigidBody->getAngularVelocity();
+        mStrideAcceleration = btVector3(0, -mGravity, 0);
+        if (mLanderMass.GetMass() > 0.0f) {
+            mStrideAcceleration += mLanderRigidBody->getTotalForce() / mLanderMass.GetMass();
+        }
+    }
+    mStrideSteps = ChooseStrideSteps(deltaTime);
+    PROFILE_COUNTER("Physics Stride", mStrideSteps);
+}
+
+// The longest stride starting at this step after which the lander, falling
+// as fast as the stride's acceleration lets it, is still out of the
+// plume's reach of any ground it could have drifted over
+int Physics::ChooseStrideSteps(float deltaTime) const {
+    if (!mAdaptiveStepping || !mLander || !mLanderRigidBody || !mTerrain || mLander->IsLanded() ||
+        mLander->IsCrashed() || mStrideRcs != 0.0f || !mLanderRigidBody->isActive()) {
+        return 1;
+    }
+    for (int part = 0; part <= kLegCount; part++) {
+        if (mPartContacts[part] > 0) {
+            return 1;
+        }
+    }
+    
+    btVector3 aabbMin, aabbMax;
+    GetLanderBounds(aabbMin, aabbMax);
+    const float climb = mStrideVelocity.y();
+    const float accel = mStrideAcceleration.y();
+    const float drift = btVector3(mStrideVelocity.x(), 0, mStrideVelocity.z()).length();
+    for (int steps = kMaxStrideSteps; steps > 1; steps /= 2) {
+        if (mStepIndex % steps != 0) {
+            continue;
+        }
+        
+        // Deepest point of the stride's arc: its end, or the bottom of a
+        // descent the engine turns round within it
+        const float time = steps * deltaTime;
+        float fall = -(climb * time + 0.5f * accel * time * time);
+        if (climb < 0.0f && accel > 0.0f && -climb / accel < time) {
+            fall = climb * climb / (2.0f * accel);
+        }
+        const float reach = drift * time;
+        float ground = 0.0f;
+        if (!mTerrain->GetMaxHeight(aabbMin.x() - reach, aabbMin.z() - reach, aabbMax.x() + reach,
+                                    aabbMax.z() + reach, ground)) {
+            ground = mTerrain->GetMaxHeight();
+        }
+        if (aabbMin.y() - std::max(fall, 0.0f) > ground + PlumeTable::kMaxAltitude) {
+            return steps;
+        }
+    }
+    return 1;
+}
+
+// One Bullet step for every call of the stride so far
+void Physics::FinishStride() {
+    const float deltaTime = mStrideTime;
+    const int steps = mStridePending;
+    mStridePending = 0;
+    mStrideTime = 0.0f;
+        
+    // A streamed terrain window moved: the heightfield references the
+    // old grid, so rebuild it before stepping
+    if (mTerrain && mDynamicsWorld && mTerrain->GetLayoutVersion() != mTerrainLayoutVersion) {
+        CreateTerrainRigidBodies(mTerrain);
+    }
+        
+    // Update Bullet physics simulation. Game drives Update at a fixed rate, so take exactly one
+    // internal step of that size instead of letting Bullet substep at
+    // its own 60 Hz. With every body asleep or static nothing can move,
+    // so the step (pair cache walk, island build) is skipped outright.
+    if (mDynamicsWorld) {
+        if (CanCoastLander(deltaTime)) {
+            CoastLander(deltaTime);
+        } else if (CountActiveBodies() > 0) {
+            PROFILE_ZONE("Bullet Step");
+            
+            // Bullet moves a body at its velocity after the step, which
+            // over a stride lands half the acceleration's worth of
+            // deltaTime^2 past the arc Game saw; moving it at the
+            // stride's mean velocity ends it on the arc
+            const btVector3 lag = mStrideAcceleration * (0.5f * deltaTime);
+            auto shift = [this, steps](const btVector3& offset) {
+                if (steps <= 1 || !mLanderRigidBody) return;
+                mLanderRigidBody->setLinearVelocity(mLanderRigidBody->getLinearVelocity() + offset);
+                for (LanderLeg& leg : mLegs) {
+                    if (leg.foot) {
+                        leg.foot->setLinearVelocity(leg.foot->getLinearVelocity() + offset);
+                    }
+                }
+            };
+            shift(-lag);
+            mDynamicsWorld->stepSimulation(deltaTime, 1, deltaTime);
+            shift(lag);
+        }
+        mActiveBodyCount = CountActiveBodies();
+        PROFILE_COUNTER("Active Bodies", mActiveBodyCount);
+        GatherContactEvents();
+    }
+        
+    // Sync lander position with physics
+    if (mLander && mLanderRigidBody) {
+        SyncLanderWithPhysics(mLander);
+    }
+        
+    // The ground reacts to this step's plume and contacts
+    UpdateRegolith(deltaTime);
+        
+    // Check for collisions
+    CheckCollisions3D();
+}
+
+// The lander part way through a stride: the start's state carried along
+// its constant acceleration and spin
+void Physics::PreviewStride() {
+    if (!mLander || !mLanderRigidBody) {
+        return;
     }
+    const float time = mStrideTime;
+    const btVector3 position = mStrideStart.getOrigin() + mStrideVelocity * time +
+                               mStrideAcceleration * (0.5f * time * time);
+    const btVector3 velocity = mStrideVelocity + mStrideAcceleration * time;
+    const btQuaternion rotation = SpinRotation(mStrideStart.getRotation(), mStrideAngularVelocity, time);
+    
+    mLander->SetPosition(position.x(), position.y(), position.z());
+    Quaternion orientation = {
+        static_cast<float>(rotation.x()), static_cast<float>(rotation.y()),
+        static_cast<float>(rotation.z()), static_cast<float>(rotation.w())
+    };
+    mLander->SetOrientation(orientation);
+    float* landerVelocity = mLander->GetVelocity();
+    landerVelocity[0] = velocity.x();
+    landerVelocity[1] = velocity.y();
+    landerVelocity[2] = velocity.z();
+}
+
+// The body was put somewhere new: its pending forces are gone, and strides
+// count from here
+void Physics::CancelStride() {
+    mStepIndex = 0;
+    mStrideSteps = 1;
+    mStridePending = 0;
+    mStrideTime = 0.0f;
+}
+
+// Create a rigid body for the lander, or reset the existing one when the
+// lander's box and mass are unchanged (every reset after the first)
+void Physics::CreateLanderRigidBody(Lander* lander) {
+    if (!lander) return;
     
-    // Create collision shape for lander
-    // Using a box shape for simplicity
-    float width = lander->GetWidth() / (2.0f * mPixelsPerMeter);
-    float height = lander->GetHeight() / (2.0f * mPixelsPerMeter);
-    float depth = lander->GetDepth() / (2.0f * mPixelsPerMeter);
-    btCollisionShape* landerShape = new btBoxShape(btVector3(width, height, depth));
+    // Box half extents in meters
+    float width = lander->GetWidth().Value() / 2.0f;
+    float height = lander->GetHeight().Value() / 2.0f;
+    float depth = lander->GetDepth().Value() / 2.0f;
+    float mass = lander->GetLaunchMass().Value();
+    ConfigureLanderMass(lander);
     
-    // Create motion state
+    // Start transform from the lander's position and rotation
     const float* position = lander->GetPosition();
     btTransform startTransform;
     startTransform.setIdentity();
     startTransform.setOrigin(btVector3(position[0], position[1], position[2]));
     
-    // Handle rotation
-    const float* rotation = lander->GetRotation();
-    btQuaternion quat;
-    quat.setEulerZYX(
-        rotation[2] * (M_PI / 180.0f),  // Z rotation (in radians)
-        rotation[1] * (M_PI / 180.0f),  // Y rotation
-        rotation[0] * (M_PI / 180.0f)   // X rotation
-    );
-    startTransform.setRotation(quat);
+    const Quaternion& orientation = lander->GetOrientation();
+    startTransform.setRotation(btQuaternion(orientation.x, orientation.y, orientation.z, orientation.w));
+    
+    if (mLanderRigidBody && mLanderBodyExtents[0] == width && mLanderBodyExtents[1] == height &&
+        mLanderBodyExtents[2] == depth && mLanderBodyMass == mass) {
+        ResetLanderRigidBody(startTransform);
+        ApplyLanderMass();
+        return;
+    }
     
+    DestroyLanderRigidBody();
+    mLanderBodyExtents[0] = width;
+    mLanderBodyExtents[1] = height;
+    mLanderBodyExtents[2] = depth;
+    mLanderBodyMass = mass;
+    
+    // Hull: the box, and a strut from each bottom corner out and down to
+    // where its foot hangs at full extension
+    btCompoundShape* landerShape = new btCompoundShape();
+    btTransform local;
+    local.setIdentity();
+    landerShape->addChildShape(local, new btBoxShape(btVector3(width, height, depth)));
+    for (int leg = 0; leg < kLegCount; leg++) {
+        const float sideX = (leg & 1) ? 1.0f : -1.0f;
+        const float sideZ = (leg & 2) ? 1.0f : -1.0f;
+        const btVector3 corner(sideX * width, -height, sideZ * depth);
+        const btVector3 foot(sideX * (width + kLegSpread), -height - kLegDrop, sideZ * (depth + kLegSpread));
+        const btVector3 along = foot - corner;
+        const btVector3 axis = btVector3(0, 1, 0).cross(along).normalized();
+        local.setOrigin((corner + foot) * 0.5f);
+        local.setRotation(btQuaternion(axis, std::acos(along.normalized().y())));
+        landerShape->addChildShape(local, new btBoxShape(btVector3(kStrutRadius, along.length() / 2, kStrutRadius)));
+        
+        mLegs[leg].restFrame.setIdentity();
+        mLegs[leg].restFrame.setOrigin(foot);
+    }
     btDefaultMotionState* motionState = new btDefaultMotionState(startTransform);
     
-    // Calculate inertia
-    btVector3 localInertia(0, 0, 0);
-    float mass = lander->GetMass();
-    landerShape->calculateLocalInertia(mass, localInertia);
+    // The hull turns like its box and tank (MassProperties): the struts
+    // are light, and a compound's inertia would come from its bounding box.
+    // ApplyLanderMass sets the mass for the fuel on board.
+    btVector3 localInertia(1, 1, 1);
     
     // Create rigid body
     btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, landerShape, localInertia);
     mLanderRigidBody = new btRigidBody(rbInfo);
+    mLanderRigidBody->setUserPointer(this);
+    mLanderRigidBody->setUserIndex(0);
+    ApplyLanderMass();
+    
+    // The reflected plume pushes on the box's underside
+    if (mPlumeTable.GetBaseRadius() != std::min(width, depth)) {
+        mPlumeTable.Build(std::min(width, depth));
+    }
     
     // Set damping
     mLanderRigidBody->setDamping(0.1f, 0.1f);
+    mLanderRigidBody->setSleepingThresholds(mSleepLinearThreshold, mSleepAngularThreshold);
+    
+    // Continuous collision: once a step moves the body further than its
+    // smallest half extent, Bullet sweeps a sphere inside the box along the
+    // step and stops it at the first terrain hit instead of letting it
+    // tunnel through
+    float minHalfExtent = std::min(width, std::min(height, depth));
+    mLanderRigidBody->setCcdMotionThreshold(minHalfExtent);
+    mLanderRigidBody->setCcdSweptSphereRadius(0.8f * minHalfExtent);
     
     // Add to world
     mDynamicsWorld->addRigidBody(mLanderRigidBody);
+    CreateLanderLegs(mass);
+    ResetLanderParts();
+    CancelStride();
     
-    std::cout << "Created rigid body for lander with mass: " << mass << " kg" << std::endl;
+    LOG_INFO("Created rigid body for lander with mass: %g kg (%g kg at launch)", mLanderMass.GetMass(), mass);
 }
 
-// Create rigid bodies for terrain
-void Physics::CreateTerrainRigidBodies(Terrain* terrain) {
-    if (!terrain) return;
+// Mass properties for the lander's dry structure in its box, at the fuel
+// it carries now
+void Physics::ConfigureLanderMass(Lander* lander) {
+    if (!lander) return;
     
-    // Clean up existing rigid bodies
+    const float halfExtents[3] = { lander->GetWidth().Value() / 2.0f, lander->GetHeight().Value() / 2.0f,
+                                   lander->GetDepth().Value() / 2.0f };
+    mLanderMass.Configure(lander->GetDryMass().Value(), halfExtents);
+    mLanderMass.SetFuel(lander->GetFuel());
+}
+
+// Give the hull the lander's current mass and inertia. The feet keep their
+// fixed mass, so the hull carries the rest; their small share of the
+// inertia stays with it.
+void Physics::ApplyLanderMass() {
+    const float* inertia = mLanderMass.GetInertia();
+    mLanderRigidBody->setMassProps(mLanderMass.GetMass() - kLegCount * kFootMass,
+                                   btVector3(inertia[0], inertia[1], inertia[2]));
+    mLanderRigidBody->updateInertiaTensor();
+    mLanderMass.MarkApplied();
+}
+
+// A foot body under each strut, held by a spring-damper along the hull's
+// up axis and locked on every other axis. A strut compresses up to
+// kStrutTravel and never extends past its rest length.
+void Physics::CreateLanderLegs(float mass) {
+    btSphereShape* footShape = new btSphereShape(kFootRadius);
+    btVector3 footInertia(0, 0, 0);
+    footShape->calculateLocalInertia(kFootMass, footInertia);
+    
+    // Critically damped-ish struts that settle a quarter of the lander's
+    // weight each at kStrutStatic compression
+    const float cornerMass = mass / kLegCount;
+    const float stiffness = cornerMass * mGravity / kStrutStatic;
+    const float damping = 2.0f * kStrutDampingRatio * std::sqrt(stiffness * cornerMass);
+    
+    const btTransform& hullTransform = mLanderRigidBody->getWorldTransform();
+    for (int leg = 0; leg < kLegCount; leg++) {
+        LanderLeg& part = mLegs[leg];
+        btDefaultMotionState* motionState = new btDefaultMotionState(hullTransform * part.restFrame);
+        btRigidBody::btRigidBodyConstructionInfo info(kFootMass, motionState, footShape, footInertia);
+        info.m_friction = 0.9f;
+        part.foot = new btRigidBody(info);
+        part.foot->setUserPointer(this);
+        part.foot->setUserIndex(1 + leg);
+        part.foot->setSleepingThresholds(mSleepLinearThreshold, mSleepAngularThreshold);
+        part.foot->setCcdMotionThreshold(kFootRadius);
+        part.foot->setCcdSweptSphereRadius(0.8f * kFootRadius);
+        mDynamicsWorld->addRigidBody(part.foot);
+        
+        btTransform footFrame;
+        footFrame.setIdentity();
+        part.strut = new btGeneric6DofSpring2Constraint(*mLanderRigidBody, *part.foot, part.restFrame, footFrame);
+        part.strut->setLinearLowerLimit(btVector3(0, 0, 0));
+        part.strut->setLinearUpperLimit(btVector3(0, kStrutTravel, 0));
+        part.strut->setAngularLowerLimit(btVector3(0, 0, 0));
+        part.strut->setAngularUpperLimit(btVector3(0, 0, 0));
+        part.strut->enableSpring(1, true);
+        part.strut->setStiffness(1, stiffness);
+        part.strut->setDamping(1, damping);
+        part.strut->setEquilibriumPoint(1, 0.0f);
+        
+        // The foot never collides with its own hull
+        mDynamicsWorld->addConstraint(part.strut, true);
+    }
+}
+
+// Remove and free the hull, the feet and their struts
+void Physics::DestroyLanderRigidBody() {
+    if (!mDynamicsWorld) return;
+    
+    btCollisionShape* footShape = nullptr;
+    for (LanderLeg& part : mLegs) {
+        if (part.strut) {
+            mDynamicsWorld->removeConstraint(part.strut);
+            delete part.strut;
+            part.strut = nullptr;
+        }
+        if (part.foot) {
+            mDynamicsWorld->removeRigidBody(part.foot);
+            footShape = part.foot->getCollisionShape();
+            delete part.foot->getMotionState();
+            delete part.foot;
+            part.foot = nullptr;
+        }
+    }
+    delete footShape;
+    
+    if (mLanderRigidBody) {
+        mDynamicsWorld->removeRigidBody(mLanderRigidBody);
+        btCompoundShape* compound = static_cast<btCompoundShape*>(mLanderRigidBody->getCollisionShape());
+        for (int i = 0; i < compound->getNumChildShapes(); i++) {
+            delete compound->getChildShape(i);
+        }
+        delete compound;
+        delete mLanderRigidBody->getMotionState();
+        delete mLanderRigidBody;
+        mLanderRigidBody = nullptr;
+    }
+    ResetLanderParts();
+}
+
+// Put a pooled body back at transform, at rest, with no contacts from
+// wherever it was before; the feet hang at full extension under it
+void Physics::ResetLanderRigidBody(const btTransform& transform) {
+    auto place = [this](btRigidBody* body, const btTransform& bodyTransform) {
+        body->setWorldTransform(bodyTransform);
+        body->setInterpolationWorldTransform(bodyTransform);
+        body->getMotionState()->setWorldTransform(bodyTransform);
+        body->setLinearVelocity(btVector3(0, 0, 0));
+        body->setAngularVelocity(btVector3(0, 0, 0));
+        body->setInterpolationLinearVelocity(btVector3(0, 0, 0));
+        body->setInterpolationAngularVelocity(btVector3(0, 0, 0));
+        body->clearForces();
+    
+        // Drop the old position's pairs and manifolds and move the proxy
+        if (body->getBroadphaseHandle()) {
+            mBroadphase->getOverlappingPairCache()->cleanProxyFromPairs(body->getBroadphaseHandle(), mDispatcher);
+            mDynamicsWorld->updateSingleAabb(body);
+        }
+        body->activate(true);
+    };
+    place(mLanderRigidBody, transform);
+    for (LanderLeg& part : mLegs) {
+        if (part.foot) {
+            place(part.foot, transform * part.restFrame);
+        }
+    }
+    
+    // Releasing the manifolds ended their contacts; start from none
+    ResetLanderParts();
+    CancelStride();
+    
+    // A new flight starts without the last one's wreck
+    for (btRigidBody* piece : mDebrisBodies) {
+        if (piece) {
+            ParkDebris(piece);
+        }
+    }
+}
+
+void Physics::ResetLanderParts() {
+    for (int part = 0; part <= kLegCount; part++) {
+        mPartContacts[part] = 0;
+        mPartTouched[part] = false;
+        mPartTouchdownVertical[part] = 0.0f;
+        mPartTouchdownHorizontal[part] = 0.0f;
+    }
+    mContactEvents.clear();
+}
+
+// Stop the lander where it stands: still, no pending forces, and out of
+// the solver until something wakes it (Bullet wakes a sleeping body when an
+// awake one's island reaches it). The feet share the hull's island.
+void Physics::SleepLanderBody() {
+    auto sleep = [](btRigidBody* body) {
+        body->setLinearVelocity(btVector3(0, 0, 0));
+        body->setAngularVelocity(btVector3(0, 0, 0));
+        body->clearForces();
+        body->setActivationState(ISLAND_SLEEPING);
+    };
+    sleep(mLanderRigidBody);
+    for (LanderLeg& part : mLegs) {
+        if (part.foot) {
+            sleep(part.foot);
+        }
+    }
+}
+
+// Every piece joins the world once, in the debris group and parked, and
+// stays until the world goes; only its activation and filter mask change
+void Physics::CreateDebrisPool() {
+    for (int shape = 0; shape < kDebrisShapeCount; shape++) {
+        mDebrisShapes[shape] = new btBoxShape(btVector3(kDebrisExtents[shape][0], kDebrisExtents[shape][1],
+                                                        kDebrisExtents[shape][2]));
+    }
+    for (int i = 0; i < kDebrisPoolSize; i++) {
+        const int shape = i % kDebrisShapeCount;
+        btVector3 inertia(0, 0, 0);
+        mDebrisShapes[shape]->calculateLocalInertia(kDebrisMass[shape], inertia);
+        btRigidBody::btRigidBodyConstructionInfo info(kDebrisMass[shape], new btDefaultMotionState(),
+                                                      mDebrisShapes[shape], inertia);
+        btRigidBody* piece = new btRigidBody(info);
+        piece->setFriction(0.9f);
+        piece->setRestitution(0.15f);
+        piece->setDamping(kDebrisLinearDamping, kDebrisAngularDamping);
+        piece->setSleepingThresholds(kDebrisLinearSleep, kDebrisAngularSleep);
+        mDynamicsWorld->addRigidBody(piece, btBroadphaseProxy::DebrisFilter, 0);
+        ParkDebris(piece);
+        mDebrisBodies[i] = piece;
+    }
+    mDebrisNext = 0;
+}
+
+void Physics::DestroyDebrisPool() {
+    for (btRigidBody*& piece : mDebrisBodies) {
+        if (piece) {
+            mDynamicsWorld->removeRigidBody(piece);
+            delete piece->getMotionState();
+            delete piece;
+            piece = nullptr;
+        }
+    }
+    for (btBoxShape*& shape : mDebrisShapes) {
+        delete shape;
+        shape = nullptr;
+    }
+}
+
+// Out of the simulation (Bullet neither integrates nor wakes a disabled
+// body) and, with an empty mask, out of every pair
+void Physics::ParkDebris(btRigidBody* piece) {
+    piece->setLinearVelocity(btVector3(0, 0, 0));
+    piece->setAngularVelocity(btVector3(0, 0, 0));
+    piece->clearForces();
+    piece->forceActivationState(DISABLE_SIMULATION);
+    if (btBroadphaseProxy* proxy = piece->getBroadphaseHandle()) {
+        proxy->m_collisionFilterMask = 0;
+        mBroadphase->getOverlappingPairCache()->cleanProxyFromPairs(proxy, mDispatcher);
+    }
+}
+
+void Physics::SpawnDebris(const btTransform& hull, const btVector3& halfExtents, const btVector3& velocity,
+                          float impactSpeed) {
+    if (!mDynamicsWorld || !mDebrisBodies[0]) {
+        return;
+    }
+    const float burst = std::min(kDebrisMaxBurst, kDebrisMinBurst + kDebrisBurstRatio * impactSpeed);
+    for (int k = 0; k < kDebrisPerCrash; k++) {
+        btRigidBody* piece = mDebrisBodies[mDebrisNext];
+        mDebrisNext = (mDebrisNext + 1) % kDebrisPoolSize;
+        const uint32_t spawn = mDebrisSpawns++;
+        
+        // Somewhere in the hull's box, tumbled, thrown away from the
+        // hull's center and upward
+        const btVector3 offset(DebrisScatter(spawn, 0) * halfExtents.x(), DebrisScatter(spawn, 1) * halfExtents.y(),
+                               DebrisScatter(spawn, 2) * halfExtents.z());
+        const btVector3 outward = hull.getBasis() * offset;
+        const btVector3 direction = (outward + btVector3(0, outward.length() + halfExtents.y(), 0)).normalized();
+        const btQuaternion tumble(DebrisScatter(spawn, 3) * SIMD_PI, DebrisScatter(spawn, 4) * SIMD_PI,
+                                  DebrisScatter(spawn, 5) * SIMD_PI);
+        const btTransform transform(hull.getRotation() * tumble, hull.getOrigin() + outward);
+        const float speed = burst * (0.75f + 0.25f * DebrisScatter(spawn, 6));
+        
+        piece->forceActivationState(ACTIVE_TAG);
+        piece->setDeactivationTime(0.0f);
+        piece->setGravity(btVector3(0, -mGravity, 0));
+        piece->setWorldTransform(transform);
+        piece->setInterpolationWorldTransform(transform);
+        piece->getMotionState()->setWorldTransform(transform);
+        piece->setLinearVelocity(velocity + direction * speed);
+        piece->setAngularVelocity(btVector3(DebrisScatter(spawn, 7), DebrisScatter(spawn, 8),
+                                            DebrisScatter(spawn, 9)) * kDebrisMaxSpin);
+        piece->setInterpolationLinearVelocity(piece->getLinearVelocity());
+        piece->setInterpolationAngularVelocity(piece->getAngularVelocity());
+        piece->clearForces();
+        
+        // A reused piece drops the pairs from where it was
+        btBroadphaseProxy* proxy = piece->getBroadphaseHandle();
+        proxy->m_collisionFilterMask = btBroadphaseProxy::StaticFilter;
+        mBroadphase->getOverlappingPairCache()->cleanProxyFromPairs(proxy, mDispatcher);
+        mDynamicsWorld->updateSingleAabb(piece);
+    }
+}
+
+bool Physics::IsDebrisSettling() const {
+    for (const btRigidBody* piece : mDebrisBodies) {
+        if (piece && piece->isActive()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Physics::UpdateDebris(float deltaTime) {
+    if (!m3DMode || !mDynamicsWorld || !IsDebrisSettling()) {
+        return;
+    }
+    PROFILE_ZONE("Bullet Step");
+    mDynamicsWorld->stepSimulation(deltaTime, 1, deltaTime);
+    mActiveBodyCount = CountActiveBodies();
+    PROFILE_COUNTER("Active Bodies", mActiveBodyCount);
+}
+
+int Physics::GetDebris(float* pieces, int maxPieces) const {
+    if (!m3DMode) {
+        return 0;
+    }
+    int count = 0;
+    for (const btRigidBody* piece : mDebrisBodies) {
+        if (count >= maxPieces) {
+            break;
+        }
+        if (!piece || piece->getActivationState() == DISABLE_SIMULATION) {
+            continue;
+        }
+        const btTransform& transform = piece->getWorldTransform();
+        const btQuaternion rotation = transform.getRotation();
+        const btVector3 halfExtents = static_cast<const btBoxShape*>(piece->getCollisionShape())->getHalfExtentsWithMargin();
+        float* out = pieces + count++ * kDebrisPieceFloats;
+        for (int i = 0; i < 3; i++) {
+            out[i] = transform.getOrigin()[i];
+            out[7 + i] = halfExtents[i];
+        }
+        out[3] = rotation.x();
+        out[4] = rotation.y();
+        out[5] = rotation.z();
+        out[6] = rotation.w();
+    }
+    return count;
+}
+
+// First and last contact point of a manifold, from Bullet's narrowphase.
+// Only lander parts against the static terrain count.
+void Physics::OnContactStarted(btPersistentManifold* const& manifold) {
+    const btCollisionObject* a = manifold->getBody0();
+    const btCollisionObject* b = manifold->getBody1();
+    const btCollisionObject* part = b->isStaticObject() ? a : (a->isStaticObject() ? b : nullptr);
+    Physics* physics = part ? static_cast<Physics*>(part->getUserPointer()) : nullptr;
+    if (!physics) {
+        return;
+    }
+    
+    // The part's velocity as it arrives, before the solver stops it
+    const int index = part->getUserIndex();
+    const btVector3& velocity = static_cast<const btRigidBody*>(part)->getLinearVelocity();
+    physics->mPartTouchdownVertical[index] = velocity.y();
+    physics->mPartTouchdownHorizontal[index] = std::sqrt(velocity.x() * velocity.x() + velocity.z() * velocity.z());
+    physics->mPartContacts[index]++;
+    physics->mPartTouched[index] = true;
+}
+
+void Physics::OnContactEnded(btPersistentManifold* const& manifold) {
+    const btCollisionObject* a = manifold->getBody0();
+    const btCollisionObject* b = manifold->getBody1();
+    const btCollisionObject* part = b->isStaticObject() ? a : (a->isStaticObject() ? b : nullptr);
+    Physics* physics = part ? static_cast<Physics*>(part->getUserPointer()) : nullptr;
+    if (physics && physics->mPartContacts[part->getUserIndex()] > 0) {
+        physics->mPartContacts[part->getUserIndex()]--;
+    }
+}
+
+// After each 3D step: an event per manifold pairing a lander part with
+// the terrain, summed over its points, carrying the touchdowns the
+// callbacks flagged during the step
+void Physics::GatherContactEvents() {
+    mContactEvents.clear();
+    if (!mLanderRigidBody) {
+        return;
+    }
+    bool touched[kLegCount + 1];
+    for (int part = 0; part <= kLegCount; part++) {
+        touched[part] = mPartTouched[part].exchange(false);
+    }
+    
+    auto addEvent = [this, &touched](ContactEvent& event, int partIndex) {
+        event.partIndex = partIndex;
+        event.touchdown = touched[partIndex];
+        touched[partIndex] = false;
+        const LandingPad* pad = mTerrain ? mTerrain->FindLandingPad3D(event.point[0], event.point[2]) : nullptr;
+        event.padId = pad ? pad->id : -1;
+        mContactEvents.push_back(event);
+    };
+    
+    btDispatcher* dispatcher = mDynamicsWorld->getDispatcher();
+    for (int i = 0; i < dispatcher->getNumManifolds(); i++) {
+        const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+        const bool partIsA = IsLanderPart(manifold->getBody0());
+        const btCollisionObject* part = partIsA ? manifold->getBody0() : manifold->getBody1();
+        const btCollisionObject* ground = partIsA ? manifold->getBody1() : manifold->getBody0();
+        if (!IsLanderPart(part) || IsLanderPart(ground)) {
+            continue;
+        }
+        
+        btVector3 point(0, 0, 0);
+        btVector3 normal(0, 0, 0);
+        ContactEvent event;
+        event.impulse = 0.0f;
+        int points = 0;
+        for (int j = 0; j < manifold->getNumContacts(); j++) {
+            const btManifoldPoint& contact = manifold->getContactPoint(j);
+            if (contact.getDistance() > 0.0f) {
+                continue;
+            }
+            
+            // Bullet's normal is on B, pointing at A
+            point += partIsA ? contact.getPositionWorldOnB() : contact.getPositionWorldOnA();
+            normal += partIsA ? contact.m_normalWorldOnB : -contact.m_normalWorldOnB;
+            event.impulse += contact.getAppliedImpulse();
+            points++;
+        }
+        if (points == 0) {
+            continue;
+        }
+        point /= static_cast<float>(points);
+        normal = normal.length() > 0.0f ? normal.normalized() : btVector3(0, 1, 0);
+        event.part = part;
+        event.ground = ground;
+        for (int k = 0; k < 3; k++) {
+            event.point[k] = point[k];
+            event.normal[k] = normal[k];
+        }
+        addEvent(event, part->getUserIndex());
+    }
+    
+    // Contacts that began and ended within the step
+    for (int partIndex = 0; partIndex <= kLegCount; partIndex++) {
+        if (!touched[partIndex]) {
+            continue;
+        }
+        ContactEvent event;
+        event.part = partIndex == 0 ? mLanderRigidBody : mLegs[partIndex - 1].foot;
+        event.ground = nullptr;
+        event.impulse = 0.0f;
+        const btVector3& center = event.part->getWorldTransform().getOrigin();
+        for (int k = 0; k < 3; k++) {
+            event.point[k] = center[k];
+            event.normal[k] = k == 1 ? 1.0f : 0.0f;
+        }
+        addEvent(event, partIndex);
+    }
+}
+
+bool Physics::GetLegState(int leg, LegState& state) const {
+    if (!m3DMode || !mLanderRigidBody || leg < 0 || leg >= kLegCount || !mLegs[leg].foot) {
+        return false;
+    }
+    const LanderLeg& part = mLegs[leg];
+    const btTransform& footTransform = part.foot->getWorldTransform();
+    const btVector3 rest = (mLanderRigidBody->getWorldTransform() * part.restFrame).getOrigin();
+    const btVector3 up = mLanderRigidBody->getWorldTransform().getBasis().getColumn(1);
+    state.contact = mPartContacts[1 + leg] > 0;
+    state.compression = std::max(0.0f, static_cast<float>((footTransform.getOrigin() - rest).dot(up)));
+    state.touchdownSpeed = std::sqrt(mPartTouchdownVertical[1 + leg] * mPartTouchdownVertical[1 + leg] +
+                                     mPartTouchdownHorizontal[1 + leg] * mPartTouchdownHorizontal[1 + leg]);
+    for (int i = 0; i < 3; i++) {
+        state.foot[i] = footTransform.getOrigin()[i];
+    }
+    return true;
+}
+
+// Dynamic bodies Bullet will integrate on the next step
+int Physics::CountActiveBodies() const {
+    int count = 0;
+    const btCollisionObjectArray& objects = mDynamicsWorld->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); i++) {
+        if (!objects[i]->isStaticOrKinematicObject() && objects[i]->isActive()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void Physics::SetSleepingThresholds(float linear, float angular) {
+    mSleepLinearThreshold = linear;
+    mSleepAngularThreshold = angular;
+    if (mLanderRigidBody) {
+        mLanderRigidBody->setSleepingThresholds(linear, angular);
+    }
+}
+
+void Physics::SetDeactivationTime(float seconds) {
+    gDeactivationTime = seconds;
+}
+
+// Remove and free the terrain bodies and their shapes
+void Physics::DestroyTerrainRigidBodies() {
     for (auto body : mTerrainRigidBodies) {
-        mDynamicsWorld->removeRigidBody(body);
+        if (mDynamicsWorld) {
+            mDynamicsWorld->removeRigidBody(body);
+        }
         delete body->getMotionState();
         delete body->getCollisionShape();
         delete body;
     }
     mTerrainRigidBodies.clear();
+    mBodiesTerrain = nullptr;
+    mContactEvents.clear();
     
-    // Get terrain triangles
-    const std::vector<TerrainTriangle>& triangles = terrain->GetTriangles3D();
+    // The mesh interface must outlive its shape, so it goes last
+    delete mTerrainMesh;
+    mTerrainMesh = nullptr;
+}
+
+bool Physics::TerrainShapeKey::FitsShape(const TerrainShapeKey& built) const {
+    return heights == built.heights && sampleCount == built.sampleCount && gridSize == built.gridSize &&
+           cellWidth == built.cellWidth && cellLength == built.cellLength &&
+           minHeight >= built.minHeight && maxHeight <= built.maxHeight &&
+           originX == built.originX && originZ == built.originZ && triangleHash == built.triangleHash;
+}
+
+// Everything the terrain's collision shape depends on. A heightfield reads
+// the heights in place, so the same grid at the same address needs no new
+// shape even when its heights were regenerated.
+Physics::TerrainShapeKey Physics::MakeTerrainShapeKey(const Terrain* terrain) {
+    TerrainShapeKey key = TerrainShapeKey();
+    if (terrain->HasHeightGrid()) {
+        key.heights = &terrain->GetHeightGrid();
+        key.sampleCount = terrain->GetHeightGrid().GetSampleCount();
+        key.gridSize = terrain->GetGridSize();
+        key.cellWidth = terrain->GetCellWidth();
+        key.cellLength = terrain->GetCellLength();
+        key.minHeight = terrain->GetMinHeight();
+        key.maxHeight = terrain->GetMaxHeight();
+        key.originX = terrain->GetOriginX();
+        key.originZ = terrain->GetOriginZ();
+        return key;
+    }
     
-    if (triangles.empty()) {
-        std::cout << "No terrain triangles to create rigid bodies for" << std::endl;
+    TerrainTriangleView triangles = terrain->GetTriangles3D();
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto& triangle : triangles) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(triangle.vertices);
+        for (size_t i = 0; i < sizeof(triangle.vertices); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    key.sampleCount = triangles.size();
+    key.triangleHash = hash;
+    return key;
+}
+
+// Create rigid bodies for terrain. The static body is kept when the
+// terrain's shape key is unchanged, e.g. a reset to the same grid.
+void Physics::CreateTerrainRigidBodies(Terrain* terrain) {
+    if (!terrain) return;
+    
+    TerrainShapeKey key = MakeTerrainShapeKey(terrain);
+    mTerrainLayoutVersion = terrain->GetLayoutVersion();
+    if (!mTerrainRigidBodies.empty() && mBodiesTerrain == terrain && key.FitsShape(mTerrainShapeKey)) {
         return;
     }
     
-    // Create a single trimesh for all terrain
-    btTriangleMesh* terrainMesh = new btTriangleMesh();
+    // Clean up existing rigid bodies
+    DestroyTerrainRigidBodies();
+    mBodiesTerrain = terrain;
+    mTerrainShapeKey = key;
     
-    for (const auto& triangle : triangles) {
-        // Extract vertices
-        btVector3 v1(triangle.vertices[0], triangle.vertices[1], triangle.vertices[2]);
-        btVector3 v2(triangle.vertices[3], triangle.vertices[4], triangle.vertices[5]);
-        btVector3 v3(triangle.vertices[6], triangle.vertices[7], triangle.vertices[8]);
-        
-        // Add triangle to mesh
-        terrainMesh->addTriangle(v1, v2, v3);
+    // Regular grids use a heightfield that reads the terrain's heights in place;
+    // anything else falls back to a BVH triangle mesh
+    btTransform terrainTransform;
+    terrainTransform.setIdentity();
+    btCollisionShape* terrainShape = nullptr;
+    if (terrain->HasHeightGrid()) {
+        terrainShape = CreateHeightfieldShape(terrain, terrainTransform);
+    } else {
+        terrainShape = CreateTriangleMeshShape(terrain);
     }
     
-    // Create terrain shape
-    btBvhTriangleMeshShape* terrainShape = new btBvhTriangleMeshShape(terrainMesh, true);
+    if (!terrainShape) {
+        LOG_WARNING("No terrain data to create rigid bodies for");
+        return;
+    }
     
     // Create motion state (terrain is static)
-    btTransform terrainTransform;
-    terrainTransform.setIdentity();
     btDefaultMotionState* terrainMotionState = new btDefaultMotionState(terrainTransform);
     
     // Create rigid body (mass = 0 for static objects)
@@ -286,105 +1382,229 @@ void Physics::CreateTerrainRigidBodies(Terrain* terrain) {
     // Add to world
     mDynamicsWorld->addRigidBody(terrainBody);
     mTerrainRigidBodies.push_back(terrainBody);
-    
-    std::cout << "Created rigid body for terrain with " << triangles.size() << " triangles" << std::endl;
+    FitBroadphaseToTerrain(terrainBody);
 }
 
-// Create a soft body for regolith simulation
-void Physics::CreateRegolithSoftBody(Terrain* terrain) {
-    if (!terrain || !mSoftRigidDynamicsWorld) return;
-    
-    // Get terrain dimensions
-    int width = terrain->GetWidth();
-    int length = terrain->GetLength();
-    
+// Heightfield over a HeightGrid. Bullet scales 16-bit data by one factor for
+// the whole field, so every value it reads is decoded with its tile's range
+// here instead.
+class QuantizedHeightfieldShape : public btHeightfieldTerrainShape {
+public:
+    QuantizedHeightfieldShape(const HeightGrid* heights, float minHeight, float maxHeight)
+        : btHeightfieldTerrainShape(
+              heights->GetSamplesPerSide(),     // Samples along x
+              heights->GetSamplesPerSide(),     // Samples along z
+              heights->GetSamples().data(),     // Row-major z, x, matching Terrain::mHeights
+              1.0f,                             // Height scale (unused, see getRawHeightFieldValue)
+              minHeight,
+              maxHeight,
+              1,                                // Y up
+              PHY_SHORT,
+              false)                            // Same (x+1, z)-(x, z+1) diagonal as Generate3D
+        , mHeights(heights)
+    {
+    }
+
+protected:
+    btScalar getRawHeightFieldValue(int x, int z) const override {
+        return mHeights->Get(x, z);
+    }
+
+private:
+    const HeightGrid* mHeights;
+};
+
+// Heightfield collision shape reading Terrain's height grid in place (no
+// copy). The terrain must outlive the shape and keep the grid layout unchanged.
+btCollisionShape* Physics::CreateHeightfieldShape(Terrain* terrain, btTransform& transform) {
+    int samplesPerSide = terrain->GetGridSize() + 1;
+    float minHeight = terrain->GetMinHeight();
+    float maxHeight = terrain->GetMaxHeight();
+    
+    btHeightfieldTerrainShape* shape = new QuantizedHeightfieldShape(&terrain->GetHeightGrid(), minHeight, maxHeight);
+    
+    // Grid samples are one unit apart in shape space; scale to cell size
+    shape->setLocalScaling(btVector3(terrain->GetCellWidth(), 1.0f, terrain->GetCellLength()));
+    
+    // Bullet centers the heightfield on its AABB; shift it back so grid
+    // sample (0, 0) sits at the terrain origin like the render mesh
+    float halfWidth = terrain->GetGridSize() * terrain->GetCellWidth() / 2.0f;
+    float halfLength = terrain->GetGridSize() * terrain->GetCellLength() / 2.0f;
+    transform.setOrigin(btVector3(terrain->GetOriginX() + halfWidth, (minHeight + maxHeight) / 2.0f,
+                                  terrain->GetOriginZ() + halfLength));
+    
+    LOG_INFO("Created heightfield terrain collision with %dx%d samples", samplesPerSide, samplesPerSide);
+    return shape;
+}
+
+// BVH triangle mesh collision shape for terrain that is not a regular grid
+btCollisionShape* Physics::CreateTriangleMeshShape(Terrain* terrain) {
     // Get terrain triangles
-    const std::vector<TerrainTriangle>& triangles = terrain->GetTriangles3D();
+    TerrainTriangleView triangles = terrain->GetTriangles3D();
     
     if (triangles.empty()) {
-        std::cout << "No terrain triangles to create regolith simulation for" << std::endl;
-        return;
+        return nullptr;
     }
     
-    // Find landing pad boundaries
-    float minX = FLT_MAX, maxX = -FLT_MAX;
-    float minZ = FLT_MAX, maxZ = -FLT_MAX;
-    float avgY = 0.0f;
-    int landingPadTriangles = 0;
+    // Create a single trimesh for all terrain
+    mTerrainMesh = new btTriangleMesh();
     
     for (const auto& triangle : triangles) {
-        if (triangle.isLandingPad) {
-            // Extract vertices
-            float x1 = triangle.vertices[0];
-            float y1 = triangle.vertices[1];
-            float z1 = triangle.vertices[2];
-            
-            float x2 = triangle.vertices[3];
-            float y2 = triangle.vertices[4];
-            float z2 = triangle.vertices[5];
-            
-            float x3 = triangle.vertices[6];
-            float y3 = triangle.vertices[7];
-            float z3 = triangle.vertices[8];
-            
-            // Update boundaries
-            minX = std::min({minX, x1, x2, x3});
-            maxX = std::max({maxX, x1, x2, x3});
-            minZ = std::min({minZ, z1, z2, z3});
-            maxZ = std::max({maxZ, z1, z2, z3});
-            
-            // Sum up heights for average
-            avgY += (y1 + y2 + y3);
-            landingPadTriangles++;
+        // Extract vertices
+        btVector3 v1(triangle.vertices[0], triangle.vertices[1], triangle.vertices[2]);
+        btVector3 v2(triangle.vertices[3], triangle.vertices[4], triangle.vertices[5]);
+        btVector3 v3(triangle.vertices[6], triangle.vertices[7], triangle.vertices[8]);
+        
+        // Add triangle to mesh
+        mTerrainMesh->addTriangle(v1, v2, v3);
+    }
+    
+    LOG_INFO("Created triangle mesh terrain collision with %zu triangles", triangles.size());
+    
+    // Create terrain shape
+    return new btBvhTriangleMeshShape(mTerrainMesh, true);
+}
+
+// The lander's engine and contacts for the regolith. A resting lander
+// presses with its weight, shared by its contacts; a flying one with each
+// contact's impulse from the last step.
+void Physics::CommitRegolith() {
+    mRegolith.Commit();
+    if (!mCraterPending) {
+        return;
+    }
+    mCraterPending = false;
+    if (!mTerrain || !m3DMode) {
+        return;
+    }
+    
+    // Only the crater's samples change; the heightfield reads them in place
+    // and the renderer uploads them from the dirty region. The regolith
+    // window still holds the ground from before, and a body resting on it
+    // has to wake to fall in.
+    mTerrain->Deform(mCraterX, mCraterZ, mCraterRadius, mCraterRadius * kCraterDepthRatio);
+    mRegolith.Reload();
+    if (mLanderRigidBody) {
+        mLanderRigidBody->activate(true);
+    }
+    for (btRigidBody* piece : mDebrisBodies) {
+        if (piece) {
+            piece->activate(true);   // Parked pieces stay parked
         }
     }
+}
+
+void Physics::ShiftOrigin(int cellsX, int cellsZ) {
+    if (!mTerrain || !m3DMode || !mTerrain->HasHeightGrid() || (cellsX == 0 && cellsZ == 0)) {
+        return;
+    }
+    const bool bodiesCurrent = mBodiesTerrain == mTerrain && mTerrain->GetLayoutVersion() == mTerrainLayoutVersion;
+    mTerrain->ShiftOrigin(cellsX, cellsZ);
+    const btVector3 shift(cellsX * mTerrain->GetCellWidth(), 0.0f, cellsZ * mTerrain->GetCellLength());
     
-    // Create regolith soft body if landing pad found
-    if (landingPadTriangles > 0) {
-        // Calculate average height
-        avgY /= (landingPadTriangles * 3);
-        
-        // Create a cloth-like soft body for regolith
-        const int res = 20; // Resolution of regolith grid
-        
-        // Create a patch for the landing pad area
-        btSoftBody* regolithBody = btSoftBodyHelpers::CreatePatch(
-            mSoftBodyWorldInfo,
-            btVector3(minX, avgY + 0.05f, minZ),       // Corner 00 (slight offset above terrain)
-            btVector3(maxX, avgY + 0.05f, minZ),       // Corner 10
-            btVector3(minX, avgY + 0.05f, maxZ),       // Corner 01
-            btVector3(maxX, avgY + 0.05f, maxZ),       // Corner 11
-            res, res,                                   // Resolution
-            1 + 2 + 4 + 8,                             // Fix all corners
-            true                                        // Generate diagonal links
-        );
-        
-        if (regolithBody) {
-            // Configure material properties for lunar regolith
-            regolithBody->m_materials[0]->m_kLST = 0.1f;  // Linear stiffness (low for soft regolith)
-            regolithBody->m_materials[0]->m_kAST = 0.1f;  // Area stiffness
-            regolithBody->m_materials[0]->m_kVST = 0.1f;  // Volume stiffness
-            
-            // Configure soft body settings
-            regolithBody->m_cfg.kDF = 0.5f;               // Dynamic friction coefficient
-            regolithBody->m_cfg.kDP = 0.01f;              // Damping coefficient
-            regolithBody->m_cfg.kPR = 0.1f;               // Pressure coefficient
-            regolithBody->m_cfg.kVC = 0.2f;               // Volume conservation coefficient
-            
-            // Generate clusters for better deformation
-            regolithBody->generateClusters(16);
-            regolithBody->generateBendingConstraints(2);
-            
-            // Add soft body to world
-            mSoftRigidDynamicsWorld->addSoftBody(regolithBody);
-            
-            std::cout << "Created regolith soft body simulation over landing pad area" << std::endl;
-        } else {
-            std::cout << "Failed to create regolith soft body" << std::endl;
+    // Static and parked bodies too, so nothing is left behind at the old
+    // coordinates; their pairs are refreshed from local points on the next
+    // step
+    if (mDynamicsWorld) {
+        btCollisionObjectArray& objects = mDynamicsWorld->getCollisionObjectArray();
+        for (int i = 0; i < objects.size(); i++) {
+            btCollisionObject* object = objects[i];
+            btTransform transform = object->getWorldTransform();
+            transform.setOrigin(transform.getOrigin() - shift);
+            object->setWorldTransform(transform);
+            object->setInterpolationWorldTransform(transform);
+            btRigidBody* body = btRigidBody::upcast(object);
+            if (body && body->getMotionState()) {
+                body->getMotionState()->setWorldTransform(transform);
+            }
+            mDynamicsWorld->updateSingleAabb(object);
         }
-    } else {
-        std::cout << "No landing pad found for regolith simulation" << std::endl;
     }
+    mStrideStart.setOrigin(mStrideStart.getOrigin() - shift);
+    mCraterX -= shift.x();
+    mCraterZ -= shift.z();
+    for (ContactEvent& event : mContactEvents) {
+        event.point[0] -= shift.x();
+        event.point[2] -= shift.z();
+    }
+    
+    // The grid is unchanged, so moved bodies fit the new layout as they
+    // are; a window move is still waiting to rebuild them
+    if (bodiesCurrent && !mTerrainRigidBodies.empty()) {
+        mTerrainLayoutVersion = mTerrain->GetLayoutVersion();
+        mTerrainShapeKey = MakeTerrainShapeKey(mTerrain);
+        FitBroadphaseToTerrain(mTerrainRigidBodies.front());
+    }
+}
+
+int Physics::BuildRegolithLoad(float deltaTime, bool atRest, RegolithLoad& load) const {
+    std::memset(&load, 0, sizeof(load));
+    
+    // Exhaust out of the bottom of the box, along its down axis
+    const Quaternion& q = mLander->GetOrientation();
+    const btVector3 up(2.0f * (q.x * q.y - q.w * q.z), 1.0f - 2.0f * (q.x * q.x + q.z * q.z),
+                       2.0f * (q.y * q.z + q.w * q.x));
+    const btVector3 nozzle = mLanderRigidBody->getWorldTransform().getOrigin() - up * mLanderBodyExtents[1];
+    if (!atRest) {
+        load.plumePressure = mPlume.peakPressure;
+        load.plumeRadius = mPlume.radius;
+    }
+    for (int i = 0; i < 3; i++) {
+        load.nozzle[i] = nozzle[i];
+        load.exhaustDirection[i] = -up[i];
+    }
+    load.footpadRadius = kFootRadius;
+    
+    for (const ContactEvent& event : mContactEvents) {
+        if (load.footpadCount >= RegolithLoad::kMaxFootpads) {
+            break;
+        }
+        if (!event.ground) {
+            continue;
+        }
+        float* footpad = load.footpads[load.footpadCount];
+        for (int i = 0; i < 3; i++) {
+            footpad[i] = event.point[i];
+        }
+        load.footpadForces[load.footpadCount] = atRest ? 0.0f : event.impulse / deltaTime;
+        load.footpadCount++;
+    }
+    if (atRest) {
+        const float weight = mLander->GetMass().Value() * mGravity;
+        for (int i = 0; i < load.footpadCount; i++) {
+            load.footpadForces[i] = weight / load.footpadCount;
+        }
+    }
+    return load.footpadCount;
+}
+
+// Step the regolith under a flying lander
+void Physics::UpdateRegolith(float deltaTime) {
+    if (!mLander || !mLanderRigidBody || mLander->IsLanded() || mLander->IsCrashed()) {
+        return;
+    }
+    RegolithLoad load;
+    BuildRegolithLoad(deltaTime, false, load);
+    mRegolith.Step(deltaTime, mLander->GetPosition(), load);
+}
+    
+// A landed lander sinks as far as the ground under its footpads gives
+void Physics::SettleLanderInRegolith() {
+    RegolithLoad load;
+    if (BuildRegolithLoad(0.0f, true, load) == 0) {
+        return;
+    }
+    
+    float sinkage = mRegolith.Settle(mLander->GetPosition(), load);
+    if (sinkage <= 0.0f) {
+        return;
+    }
+    btTransform transform = mLanderRigidBody->getWorldTransform();
+    transform.setOrigin(transform.getOrigin() - btVector3(0, sinkage, 0));
+    ResetLanderRigidBody(transform);
+    SyncLanderWithPhysics(mLander);
+    
+    LOG_DEBUG("Lander settled %.3f m into the regolith", sinkage);
 }
 
 // Sync lander entity with Bullet Physics rigid body
@@ -399,17 +1619,13 @@ void Physics::SyncLanderWithPhysics(Lander* lander) {
     btVector3 position = transform.getOrigin();
     lander->SetPosition(position.x(), position.y(), position.z());
     
-    // Update rotation
+    // Update rotation (Euler angles are only derived if something reads them)
     btQuaternion rotation = transform.getRotation();
-    btScalar roll, pitch, yaw;
-    transform.getBasis().getEulerZYX(yaw, pitch, roll);
-    
-    // Convert to degrees
-    lander->SetRotation(
-        roll * (180.0f / M_PI),
-        pitch * (180.0f / M_PI),
-        yaw * (180.0f / M_PI)
-    );
+    Quaternion orientation = {
+        static_cast<float>(rotation.x()), static_cast<float>(rotation.y()),
+        static_cast<float>(rotation.z()), static_cast<float>(rotation.w())
+    };
+    lander->SetOrientation(orientation);
     
     // Update velocity
     btVector3 velocity = mLanderRigidBody->getLinearVelocity();
@@ -421,41 +1637,46 @@ void Physics::SyncLanderWithPhysics(Lander* lander) {
 
 // Apply thrust to lander using Bullet Physics
 void Physics::ApplyThrust(Lander* lander, float deltaTime) {
+    mPlume = PlumeImpingement();
     if (!lander || !mLanderRigidBody || !lander->IsThrustActive()) return;
     
     // Calculate thrust force based on lander properties
-    float maxThrust = lander->GetMass() * 2.5f * mGravity; // Thrust-to-weight ratio of 2.5
+    float maxThrust = lander->GetMaxThrust(mGravity);
     float thrustForce = maxThrust * lander->GetThrustLevel();
     
-    // Get lander rotation
-    const float* rotation = lander->GetRotation();
-    
     // Calculate thrust direction based on lander orientation
     btVector3 thrustDirection(0, 1, 0); // Default is upward
     
     if (m3DMode) {
-        // Convert rotation from degrees to radians
-        float rotX = rotation[0] * (M_PI / 180.0f);
-        float rotY = rotation[1] * (M_PI / 180.0f);
-        float rotZ = rotation[2] * (M_PI / 180.0f);
-        
-        // Create rotation matrix from Euler angles
-        btQuaternion quat;
-        quat.setEulerZYX(rotZ, rotY, rotX);
-        btMatrix3x3 rotMatrix(quat);
-        
-        // Transform thrust direction by rotation
-        thrustDirection = rotMatrix * btVector3(0, 1, 0);
+        // The lander's up axis: the rotation matrix's second column
+        const Quaternion& q = lander->GetOrientation();
+        thrustDirection = btVector3(2.0f * (q.x * q.y - q.w * q.z),
+                                    1.0f - 2.0f * (q.x * q.x + q.z * q.z),
+                                    2.0f * (q.y * q.z + q.w * q.x));
     } else {
         // 2D rotation around Z axis only
-        float rotZ = rotation[2] * (M_PI / 180.0f);
+        float rotZ = lander->GetRotation()[2] * (M_PI / 180.0f);
         thrustDirection = btVector3(sin(rotZ), cos(rotZ), 0);
     }
     
+    // Near the ground the plume's footprint, and the flow deflected back up
+    // onto the lander's base, which adds to the thrust along its axis
+    if (m3DMode) {
+        const btVector3 nozzle = mLanderRigidBody->getWorldTransform().getOrigin() -
+                                 thrustDirection * mLanderBodyExtents[1];
+        const btVector3 exhaust = -thrustDirection;
+        const float nozzlePosition[3] = { nozzle.x(), nozzle.y(), nozzle.z() };
+        const float exhaustDirection[3] = { exhaust.x(), exhaust.y(), exhaust.z() };
+        mPlume = SamplePlume(nozzlePosition, exhaustDirection, lander->GetThrustLevel());
+        thrustForce += mPlume.groundForce;
+    }
+    
     // Scale direction by force
     btVector3 thrustVector = thrustDirection * thrustForce;
     
-    // Apply force at center of mass
+    // Apply force at center of mass. A sleeping body ignores forces, so
+    // the engine wakes it first.
+    mLanderRigidBody->activate();
     mLanderRigidBody->applyCentralForce(thrustVector);
     
     // Track fuel consumption (in kg/s)
@@ -471,6 +1692,104 @@ void Physics::ApplyThrust(Lander* lander, float deltaTime) {
     }
 }
 
+// Box around the hull and feet
+void Physics::GetLanderBounds(btVector3& aabbMin, btVector3& aabbMax) const {
+    mLanderRigidBody->getCollisionShape()->getAabb(mLanderRigidBody->getWorldTransform(), aabbMin, aabbMax);
+    for (const LanderLeg& leg : mLegs) {
+        if (leg.foot) {
+            btVector3 footMin, footMax;
+            leg.foot->getCollisionShape()->getAabb(leg.foot->getWorldTransform(), footMin, footMax);
+            aabbMin.setMin(footMin);
+            aabbMax.setMax(footMax);
+        }
+    }
+}
+
+// Only gravity acts on the lander, and no part of it can reach the ground
+// this step
+bool Physics::CanCoastLander(float deltaTime) const {
+    if (!mBallisticCoasting || !mLander || !mLanderRigidBody || !mTerrain || !mTerrain->HasHeightGrid()) {
+        return false;
+    }
+    if (mStrideThrust != 0.0f || mStrideRcs != 0.0f || mLander->IsLanded() || mLander->IsCrashed() ||
+        !mLanderRigidBody->isActive()) {
+        return false;
+    }
+    
+    // Lowest point of the hull and feet, after the step's fall
+    btVector3 aabbMin, aabbMax;
+    GetLanderBounds(aabbMin, aabbMax);
+    const float bottom = aabbMin.y();
+    const float fall = std::max(0.0f, static_cast<float>(-mLanderRigidBody->getLinearVelocity().y())) * deltaTime +
+                       0.5f * mGravity * deltaTime * deltaTime;
+    return bottom - fall > mTerrain->GetMaxHeight() + kCoastClearance;
+}
+
+// The step's parabola for the hull, and its spin at a constant rate; the
+// feet ride along rigidly, holding the struts where they are
+void Physics::CoastLander(float deltaTime) {
+    PROFILE_ZONE("Ballistic Coast");
+    const btTransform from = mLanderRigidBody->getWorldTransform();
+    const btVector3 velocity = mLanderRigidBody->getLinearVelocity();
+    const btVector3 angularVelocity = mLanderRigidBody->getAngularVelocity();
+    const btVector3 gravity(0, -mGravity, 0);
+    
+    const btTransform to(SpinRotation(from.getRotation(), angularVelocity, deltaTime), from.getOrigin() + velocity * deltaTime + gravity * (0.5f * deltaTime * deltaTime));
+    const btVector3 nextVelocity = velocity + gravity * deltaTime;
+    
+    auto move = [this, &angularVelocity](btRigidBody* body, const btTransform& transform, const btVector3& linear) {
+        body->setWorldTransform(transform);
+        body->setInterpolationWorldTransform(transform);
+        body->getMotionState()->setWorldTransform(transform);
+        body->setLinearVelocity(linear);
+        body->setAngularVelocity(angularVelocity);
+        body->setInterpolationLinearVelocity(linear);
+        body->setInterpolationAngularVelocity(angularVelocity);
+        body->clearForces();
+        mDynamicsWorld->updateSingleAabb(body);
+    };
+    const btTransform delta = to * from.inverse();
+    for (LanderLeg& leg : mLegs) {
+        if (leg.foot) {
+            const btTransform foot = delta * leg.foot->getWorldTransform();
+            move(leg.foot, foot, nextVelocity + angularVelocity.cross(foot.getOrigin() - to.getOrigin()));
+        }
+    }
+    move(mLanderRigidBody, to, nextVelocity);
+}
+
+// Reaction control torque about the hull's z axis (the 2D view's roll)
+void Physics::ApplyRcs(Lander* lander) {
+    float levels[RcsThrusters::kCount];
+    RcsThrusters::GetLevels(lander->GetRcsCommand(), levels);
+    const float torque = RcsThrusters::GetTorque(levels, mLanderBodyExtents[0]);
+    if (torque == 0.0f) return;
+    
+    // The rotation matrix's third column
+    const Quaternion& q = lander->GetOrientation();
+    const btVector3 axis(2.0f * (q.x * q.z + q.w * q.y), 2.0f * (q.y * q.z - q.w * q.x),
+                         1.0f - 2.0f * (q.x * q.x + q.y * q.y));
+    mLanderRigidBody->activate();
+    mLanderRigidBody->applyTorque(axis * torque);
+}
+
+float Physics::GetRcsAngularAcceleration() const {
+    if (!mLander || mLanderMass.GetInertia()[2] <= 0.0f) {
+        return 0.0f;
+    }
+    const float torque = RcsThrusters::GetCoupleTorque(mLander->GetWidth().Value() / 2.0f);
+    return torque / mLanderMass.GetInertia()[2] * static_cast<float>(180.0 / M_PI);
+}
+
+PlumeImpingement Physics::SamplePlume(const float* nozzle, const float* exhaustDirection, float thrustLevel) const {
+    float groundHeight = 0.0f;
+    if (!mLander || !mTerrain || !mTerrain->SampleHeight(nozzle[0], nozzle[2], groundHeight)) {
+        return PlumeImpingement();
+    }
+    const float thrust = mLander->GetMaxThrust(mGravity) * thrustLevel;
+    return mPlumeTable.Sample(thrust, nozzle[1] - groundHeight, -exhaustDirection[1]);
+}
+
 // Legacy 2D physics methods (kept for backward compatibility)
 void Physics::Update2D(float deltaTime) {
     if (!mLander || !mTerrain) {
@@ -480,42 +1799,63 @@ void Physics::Update2D(float deltaTime) {
     // Scale deltaTime to adjust simulation speed
     float scaledDeltaTime = deltaTime * mTimeScale;
     
-    // Save current velocity for debugging
     float* velocity = mLander->GetVelocity();
-    float oldVelY = velocity[1];
-    
-    // Apply forces to update velocity
-    // Note: Using original code for 2D mode
     
     if (!mLander->IsLanded() && !mLander->IsCrashed()) {
-        // Apply gravity
-        velocity[1] -= mGravity * scaledDeltaTime;
-        
-        // Apply thrust if active
+        // Gravity plus thrust along the lander's axis; both are constant over the step
+        float accelX = 0.0f;
+        float accelY = -mGravity;
         if (mLander->IsThrustActive()) {
             const float* rotation = mLander->GetRotation();
             float rotZ = rotation[2] * (M_PI / 180.0f);
             
-            // Calculate thrust components
-            float thrustX = -sin(rotZ);
-            float thrustY = cos(rotZ);
-            
-            // Calculate thrust acceleration
-            float maxThrust = mLander->GetMass() * 2.5f * mGravity;
-            float thrustAccel = (maxThrust * mLander->GetThrustLevel()) / mLander->GetMass();
-            
-            // Apply thrust acceleration
-            velocity[0] += thrustX * thrustAccel * scaledDeltaTime;
-            velocity[1] += thrustY * thrustAccel * scaledDeltaTime;
+            // Thrust acceleration for the mass left after the burn so far
+            float maxThrust = mLander->GetMaxThrust(mGravity);
+            float thrustAccel = (maxThrust * mLander->GetThrustLevel()) / mLanderMass.GetMass();
+            accelX += -sin(rotZ) * thrustAccel;
+            accelY += cos(rotZ) * thrustAccel;
         }
         
-        // Update position based on velocity (Euler integration)
+        // Advance with the build's integrator (Integrators.h)
         const float* position = mLander->GetPosition();
-        float newX = position[0] + velocity[0] * scaledDeltaTime;
-        float newY = position[1] + velocity[1] * scaledDeltaTime;
+        IntegratorState2D<float> state = { position[0], position[1], velocity[0], velocity[1] };
+        auto accel = [accelX, accelY](const IntegratorState2D<float>&, float& ax, float& ay) {
+            ax = accelX;
+            ay = accelY;
+        };
+        const IntegratorState2D<float> start = state;
+        LanderIntegrator::Step<ScalarOps>(state, scaledDeltaTime, accel);
+        
+        velocity[0] = state.velX;
+        velocity[1] = state.velY;
+        mLander->SetPosition(state.posX, state.posY);
         
-        // Set new position
-        mLander->SetPosition(newX, newY);
+        // The RCS couple's torque over the inertia about z turns it, after
+        // the thrust has pushed along the step's starting attitude (as
+        // LanderKernels::IntegrateAttitude does)
+        const float spin = mLander->GetSpin() +
+                           mLander->GetRcsCommand() * GetRcsAngularAcceleration() * scaledDeltaTime;
+        float attitude = mLander->GetRotation()[2] + spin * scaledDeltaTime;
+        attitude = attitude < 0.0f ? attitude + 360.0f : attitude;
+        attitude = attitude >= 360.0f ? attitude - 360.0f : attitude;
+        mLander->SetSpin(spin);
+        mLander->SetRotation(0.0f, 0.0f, attitude);
+        
+        // A fast step can carry the lander's bottom clean through a
+        // segment, which the point test after it would miss. Sweep the
+        // bottom center along the step and stop it where it first crossed.
+        float halfHeight = mLander->GetHeight().Value() / 2;
+        float hitFraction = 0.0f;
+        float collisionHeight = 0.0f;
+        if (mTerrain->SweepCollision2D(start.posX, start.posY - halfHeight, state.posX, state.posY - halfHeight,
+                                       hitFraction, collisionHeight)) {
+            // Judge the landing by the velocity at impact, not at the end of the step
+            velocity[0] = start.velX + (state.velX - start.velX) * hitFraction;
+            velocity[1] = start.velY + (state.velY - start.velY) * hitFraction;
+            mLander->SetPosition(start.posX + (state.posX - start.posX) * hitFraction, state.posY);
+            ResolveContact2D(collisionHeight);
+            return;
+        }
     }
     
     // Check for collisions
@@ -536,39 +1876,43 @@ bool Physics::CheckCollisions2D() {
     // Check for collision with terrain
     float collisionHeight = 0.0f;
     if (mTerrain->CheckCollision2D(mLander, collisionHeight)) {
-        // Collision detected
+        ResolveContact2D(collisionHeight);
+        return true;
+    }
         
-        // Update lander position to be at collision point
-        const float* position = mLander->GetPosition();
-        float landerHeight = mLander->GetHeight() / mPixelsPerMeter; // Convert to meters
+    return false;
+}
+
+// Settle the lander on the surface at collisionHeight (meters) and decide
+// between landing and crash from its current velocity
+void Physics::ResolveContact2D(float collisionHeight) {
+    // Update lander position to be at collision point
+    const float* position = mLander->GetPosition();
+    float landerHeight = mLander->GetHeight().Value();
         
-        mLander->SetPosition(position[0], collisionHeight + landerHeight / 2);
+    mLander->SetPosition(position[0], collisionHeight + landerHeight / 2);
+    mLander->SetSpin(0.0f);
         
-        // Check if this is a valid landing
-        if (mTerrain->IsValidLanding2D(mLander)) {
-            // Safe landing
-            mLander->SetLanded(true);
+    // Check if this is a valid landing
+    if (mTerrain->IsValidLanding2D(mLander)) {
+        // Safe landing
+        mLander->SetLanded(true);
             
-            // Stop movement
-            float* velocity = mLander->GetVelocity();
-            velocity[0] = velocity[1] = 0.0f;
+        // Stop movement
+        float* velocity = mLander->GetVelocity();
+        velocity[0] = velocity[1] = 0.0f;
             
-            std::cout << "Successful landing!" << std::endl;
-        } else {
-            // Crash landing
-            mLander->SetCrashed(true);
+        LOG_INFO("Successful landing!");
+    } else {
+        // Crash landing
+        mLander->SetCrashed(true);
             
-            // Stop movement
-            float* velocity = mLander->GetVelocity();
-            velocity[0] = velocity[1] = 0.0f;
+        // Stop movement
+        float* velocity = mLander->GetVelocity();
+        velocity[0] = velocity[1] = 0.0f;
             
-            std::cout << "Crash landing!" << std::endl;
-        }
-        
-        return true;
+        LOG_INFO("Crash landing!");
     }
-    
-    return false;
 }
 
 // 3D physics collision checking using Bullet Physics
@@ -582,85 +1926,85 @@ bool Physics::CheckCollisions3D() {
         return false;
     }
     
-    // Check contacts with Bullet Physics
-    bool isColliding = false;
-    bool isValidLanding = false;
-    
-    // Get lander velocity
-    btVector3 velocity = mLanderRigidBody->getLinearVelocity();
-    float verticalVelocity = velocity.y();
-    float horizontalVelocity = sqrt(velocity.x() * velocity.x() + velocity.z() * velocity.z());
-    
-    // Check all contact points in the dynamics world
-    int numManifolds = mDynamicsWorld->getDispatcher()->getNumManifolds();
-    for (int i = 0; i < numManifolds; i++) {
-        btPersistentManifold* contactManifold = mDynamicsWorld->getDispatcher()->getManifoldByIndexInternal(i);
-        
-        // Check if the lander is one of the colliding objects
-        const btCollisionObject* obA = contactManifold->getBody0();
-        const btCollisionObject* obB = contactManifold->getBody1();
-        
-        if (obA == mLanderRigidBody || obB == mLanderRigidBody) {
-            int numContacts = contactManifold->getNumContacts();
-            if (numContacts > 0) {
-                isColliding = true;
-                
-                // Check if this is a landing pad
-                btCollisionObject* terrainObj = (obA == mLanderRigidBody) ? (btCollisionObject*)obB : (btCollisionObject*)obA;
-                
-                // Determine if this is the landing pad by checking against terrain bodies
-                bool isLandingPad = false;
-                for (auto terrainBody : mTerrainRigidBodies) {
-                    if (terrainObj == terrainBody) {
-                        // In a real implementation, we would check if the specific contact triangles 
-                        // are part of the landing pad. For simplicity, we'll just check velocity.
-                        isLandingPad = true;
-                        break;
-                    }
-                }
-                
-                // Check landing conditions
-                if (isLandingPad) {
-                    // Safe landing conditions:
-                    // 1. Vertical velocity must be low (downward or slightly upward)
-                    // 2. Horizontal velocity must be low
-                    const float safeVerticalVelocity = 2.0f;   // m/s
-                    const float safeHorizontalVelocity = 1.0f; // m/s
-                    
-                    bool safeVertical = verticalVelocity > -safeVerticalVelocity && verticalVelocity < safeVerticalVelocity;
-                    bool safeHorizontal = horizontalVelocity < safeHorizontalVelocity;
-                    
-                    if (safeVertical && safeHorizontal) {
-                        isValidLanding = true;
-                    }
-                }
-                
-                break; // Found a collision with the lander
+    // This step's contact events: the hull touching, or a foot arriving
+    // over the safe speeds, crashes
+    const float safeVerticalVelocity = 2.0f;   // m/s
+    const float safeHorizontalVelocity = 1.0f; // m/s
+    bool hardTouchdown = false;
+    float impactSpeed = 0.0f;
+    bool footDown[kLegCount] = {};
+    int feetDown = 0;
+    int padId = -1;
+    for (const ContactEvent& event : mContactEvents) {
+        if (event.touchdown) {
+            const float vertical = mPartTouchdownVertical[event.partIndex];
+            const float horizontal = mPartTouchdownHorizontal[event.partIndex];
+            bool safe = vertical > -safeVerticalVelocity && vertical < safeVerticalVelocity &&
+                        horizontal < safeHorizontalVelocity;
+            hardTouchdown = hardTouchdown || event.partIndex == 0 || !safe;
+            impactSpeed = std::max(impactSpeed, std::sqrt(vertical * vertical + horizontal * horizontal));
+            if (event.partIndex > 0) {
+                LOG_DEBUG("Leg %d touched down at %.2f m/s vertical, %.2f m/s horizontal (pad %d)",
+                          event.partIndex - 1, vertical, horizontal, event.padId);
+            }
+        }
+        if (event.ground && event.partIndex > 0 && !footDown[event.partIndex - 1]) {
+            footDown[event.partIndex - 1] = true;
+            feetDown++;
+            if (padId < 0) {
+                padId = event.padId;
             }
         }
     }
-    
-    // Update lander state based on collision
+                
+    // Landed once the struts have soaked up the touchdown: three feet down
+    // and the hull nearly still, or any feet down with the lander asleep
+    const float restSpeed = 0.25f;             // m/s
+    bool still = mLanderRigidBody->getLinearVelocity().length() < restSpeed;
+    bool isValidLanding = !hardTouchdown &&
+                          ((feetDown >= 3 && still) || (feetDown > 0 && !mLanderRigidBody->isActive()));
+    bool isColliding = hardTouchdown || isValidLanding;
+    if (!isColliding) {
+        return feetDown > 0;
+    }
+                
+    // Update lander state based on the touchdown
     if (isColliding) {
         if (isValidLanding) {
             // Safe landing
             mLander->SetLanded(true);
             
-            // Stop movement and fix position
-            mLanderRigidBody->setLinearVelocity(btVector3(0, 0, 0));
-            mLanderRigidBody->setAngularVelocity(btVector3(0, 0, 0));
+            // Sink into the regolith, then stop movement and fix position.
+            // Sleeping rather than zeroing the mass keeps the body as it
+            // was built, so a reset can reuse it.
+            SettleLanderInRegolith();
+            SleepLanderBody();
             
-            // Make it static
-            mLanderRigidBody->setMassProps(0, btVector3(0, 0, 0));
-            
-            std::cout << "Successful 3D landing!" << std::endl;
+            LOG_INFO("Successful 3D landing! (pad %d)", padId);
         } else {
             // Crash landing
             mLander->SetCrashed(true);
             
-            // Let physics handle the crash - don't fix position
+            // Let physics handle the crash - don't fix position. The
+            // crater waits for the next commit, where the terrain is free
+            // to change.
+            const float* position = mLander->GetPosition();
+            mCraterPending = true;
+            mCraterX = position[0];
+            mCraterZ = position[2];
+            mCraterRadius = std::min(kMaxCraterRadius,
+                                     kCraterRadius * std::cbrt(std::max(1.0f, impactSpeed * impactSpeed /
+                                                                                (safeVerticalVelocity * safeVerticalVelocity))));
+            
+            // Hard enough and the hull breaks up where it hit
+            if (impactSpeed >= kDebrisImpactSpeed) {
+                SpawnDebris(mLanderRigidBody->getWorldTransform(),
+                            btVector3(mLanderBodyExtents[0], mLanderBodyExtents[1], mLanderBodyExtents[2]),
+                            mLanderRigidBody->getLinearVelocity(), impactSpeed);
+                SleepLanderBody();
+            }
             
-            std::cout << "Crash landing in 3D!" << std::endl;
+            LOG_INFO("Crash landing in 3D! (%.1f m/s, %.1f m crater)", impactSpeed, mCraterRadius);
         }
         
         return true;
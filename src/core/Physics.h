@@ -4,15 +4,39 @@
 #pragma once
 
 #include "Entity.h"
+#include "MassProperties.h"
+#include "PlumeTable.h"
+#include "RegolithField.h"
 #include "Terrain.h"
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
-// Bullet Physics includes
 // Bullet Physics includes
 #include <bullet/btBulletDynamicsCommon.h>
-#include <bullet/BulletSoftBody/btSoftRigidDynamicsWorld.h>
-#include <bullet/BulletSoftBody/btSoftBodyHelpers.h>
-#include <bullet/BulletSoftBody/btSoftBodyRigidBodyCollisionConfiguration.h>
+#include <bullet/BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
+
+// Multithreaded world support (needs Bullet built with BT_THREADSAFE=1)
+#ifdef USE_BULLET_MT
+#include <bullet/LinearMath/btThreads.h>
+#include <bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <bullet/BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#endif
+
+// Forward declarations
+class JobSystem;
+class btITaskScheduler;
+
+// Bullet broadphase for the world. Sweep-and-prune quantizes AABBs over
+// fixed world bounds, which Physics fits to the terrain plus a ceiling;
+// Bullet has no CPU uniform grid. lander_bench's BM_Broadphase_PairUpdate
+// compares them.
+enum class PhysicsBroadphase {
+    DBVT,       // Dynamic AABB trees: unbounded, Bullet's default
+    SAP,        // 16-bit sweep-and-prune (btAxisSweep3), up to 16k objects
+    SAP32       // 32-bit sweep-and-prune, for bigger worlds or more objects
+};
 
 class Physics {
 public:
@@ -23,10 +47,73 @@ public:
     void Initialize();
     void Update(float deltaTime);
     
+    // Select 2D or Bullet 3D simulation (call before Initialize)
+    void Set3DMode(bool use3D) { m3DMode = use3D; }
+    bool Is3DMode() const { return m3DMode; }
+    
+    // Change mode after Initialize without losing the flight: the lander
+    // carries on from its current state. The Bullet world outlives a switch
+    // to 2D, so switching back to the same terrain keeps its bodies and the
+    // regolith as they were.
+    void SwitchMode(bool use3D, Lander* lander, Terrain* terrain);
+    
     // Register entities with the physics system
     void RegisterLander(Lander* lander);
     void RegisterTerrain(Terrain* terrain);
     
+    // Lander body state the lander doesn't mirror (rad/s; in 2D the
+    // lander's spin about z), and putting the body back where the lander
+    // now is, moving as it does, e.g. after a rewind
+    void GetLanderAngularVelocity(float* angularVelocity) const;
+    void ResyncLanderBody(const float* angularVelocity);
+    
+    // World positions (3 floats each) of up to maxPoints points where the
+    // lander's 3D body (hull or feet) touches something; 0 in 2D
+    int GetLanderContacts(float* points, int maxPoints) const;
+    
+    // Lander legs (3D): a foot on a sprung strut under each corner of the
+    // hull. Bullet's narrowphase reports each part's contacts with the
+    // terrain as they start and end, and touchdown is judged from those
+    // events: a foot arriving too fast or the hull touching crashes, three
+    // feet down (or feet down with the lander at rest) lands.
+    static constexpr int kLegCount = 4;
+    struct LegState {
+        bool contact;           // Foot on the terrain now
+        float compression;      // Strut travel taken up (m)
+        float touchdownSpeed;   // Foot speed (m/s) when it last touched down
+        float foot[3];          // Foot center (m)
+    };
+    bool GetLegState(int leg, LegState& state) const;    // False without a 3D body
+    
+    // The last 3D step's ground contacts, one per lander part and terrain
+    // body touching, gathered from Bullet's manifolds after the solve.
+    // Touchdown, the regolith's footpads and GetLanderContacts all read
+    // these instead of querying the terrain or walking the manifolds again.
+    // A part whose contact started and ended inside the step still reports
+    // its touchdown, with no ground body and at its own center.
+    struct ContactEvent {
+        const btCollisionObject* part;      // Hull or a foot
+        const btCollisionObject* ground;    // Terrain body, null once the contact has ended
+        int partIndex;                      // 0 = hull, 1 + leg
+        bool touchdown;                     // The part's contact started this step
+        float impulse;                      // Solver impulse through the contact this step (N s)
+        float normal[3];                    // Unit, out of the ground
+        float point[3];                     // Mean contact point on the ground (m)
+        int padId;                          // LandingPad::id under the point, -1 = off the pads
+    };
+    const std::vector<ContactEvent>& GetContactEvents() const { return mContactEvents; }
+    
+    // The engine plume on the ground in 3D, from PlumeTable: as of the last
+    // step (its ground force is already in the thrust), or for the
+    // lander's engine at thrustLevel (0 - 1) from another nozzle pose, e.g.
+    // the interpolated one drawn
+    const PlumeImpingement& GetPlume() const { return mPlume; }
+    PlumeImpingement SamplePlume(const float* nozzle, const float* exhaustDirection, float thrustLevel) const;
+    
+    // Angular acceleration (deg/s²) of a full RCS command for the lander's
+    // current inertia about its z axis
+    float GetRcsAngularAcceleration() const;
+    
     // Physics constants getters/setters
     float GetGravity() const { return mGravity; }
     void SetGravity(float gravity);
@@ -34,14 +121,104 @@ public:
     float GetAirDensity() const { return mAirDensity; }
     void SetAirDensity(float density) { mAirDensity = density; }
     
-    float GetPixelsPerMeter() const { return mPixelsPerMeter; }
-    void SetPixelsPerMeter(float ppm) { mPixelsPerMeter = ppm; }
+    // Threading for the Bullet world. Only takes effect in a USE_BULLET_MT
+    // build and must be set before Initialize(). Bullet's tasks run on the
+    // job system when one is set, otherwise on Bullet's own scheduler.
+    static bool IsMultithreadingAvailable();
+    void SetJobSystem(JobSystem* jobSystem) { mJobSystem = jobSystem; }
+    void SetThreadCount(int count) { mRequestedThreadCount = count; } // <= 0 = all available
+    int GetThreadCount() const;
+    
+    // Broadphase (set before Initialize()). Parse takes "dbvt", "sap" or
+    // "sap32". CreateBroadphase builds one over the given world bounds,
+    // which only sweep-and-prune uses.
+    void SetBroadphase(PhysicsBroadphase broadphase) { mBroadphaseType = broadphase; }
+    PhysicsBroadphase GetBroadphase() const { return mBroadphaseType; }
+    static bool ParseBroadphase(const char* name, PhysicsBroadphase& broadphase);
+    static const char* GetBroadphaseName(PhysicsBroadphase broadphase);
+    static btBroadphaseInterface* CreateBroadphase(PhysicsBroadphase broadphase, const btVector3& worldMin,
+                                                   const btVector3& worldMax);
+    
+    // Regolith: the plume and footpads reshape the height grid under the
+    // lander every 3D step. The changes reach the terrain, and through it
+    // the heightfield and the renderer, only in CommitRegolith(), which
+    // must run where nothing else reads the terrain (Game commits beside
+    // terrain streaming). A 3D crash's crater (Terrain::Deform) is dug
+    // there too, its radius growing with the impact speed as the cube root
+    // of its energy.
+    static constexpr float kCraterRadius = 2.0f;        // Meters, at the safe touchdown speed
+    static constexpr float kMaxCraterRadius = 12.0f;
+    static constexpr float kCraterDepthRatio = 0.2f;    // Depth per meter of radius
+    void CommitRegolith();
+    const RegolithField& GetRegolith() const { return mRegolith; }
+    
+    // Floating origin (3D): shift the terrain's origin by whole cells
+    // (Terrain::ShiftOrigin) and move every body, parked debris included,
+    // the other way by as much, keeping their velocities. Terrain bodies
+    // built for the grid before the shift are moved rather than rebuilt.
+    // Call where CommitRegolith() may run, after committing.
+    void ShiftOrigin(int cellsX, int cellsZ);
+    
+    // Crash debris (3D): an impact of kDebrisImpactSpeed or more breaks the
+    // hull into kDebrisPerCrash fragments, thrown out of its box and off
+    // with its velocity; the hull itself stays where it broke up. The
+    // fragments come from a pool built with the world, whose bodies never
+    // leave it (a parked piece is out of the simulation and pairs with
+    // nothing), so a crash allocates nothing; once every piece is out, the
+    // oldest are taken again. They collide with the terrain alone and
+    // sleep at higher speeds than the lander. A reset parks them all.
+    static constexpr int kDebrisPoolSize = 48;
+    static constexpr int kDebrisPerCrash = 12;
+    static constexpr float kDebrisImpactSpeed = 4.0f;  // m/s
+    static constexpr int kDebrisPieceFloats = 10;      // Per GetDebris piece
+    void SpawnDebris(const btTransform& hull, const btVector3& halfExtents, const btVector3& velocity,
+                     float impactSpeed);
+    
+    // The game stops stepping the flight once it ends; after a crash this
+    // steps the world alone while any fragment is still awake
+    void UpdateDebris(float deltaTime);
+    bool IsDebrisSettling() const;
+    
+    // Up to maxPieces fragments in play, kDebrisPieceFloats each: position
+    // (m), orientation quaternion (x, y, z, w) and box half extents (m)
+    int GetDebris(float* pieces, int maxPieces) const;
+    
+    // Sleeping: a body whose linear (m/s) and angular (rad/s) speeds stay
+    // under its thresholds for the deactivation time drops out of the
+    // solver until a thrust, a reset or an awake body touching it wakes it.
+    // A valid landing puts the lander to sleep at once. The deactivation
+    // time is Bullet's, shared by every world in the process.
+    void SetSleepingThresholds(float linear, float angular);
+    void SetDeactivationTime(float seconds);
+    int GetActiveBodyCount() const { return mActiveBodyCount; } // After the last 3D step
+    
+    // Time warp's fast path: while on, a 3D step with the engine and RCS
+    // off and the lander well above the highest ground moves it along its
+    // exact ballistic arc instead of stepping Bullet. Near the ground every
+    // step is a full one, so touchdowns are unchanged.
+    void SetBallisticCoasting(bool enabled) { mBallisticCoasting = enabled; }
+    bool IsBallisticCoasting() const { return mBallisticCoasting; }
+    
+    // Adaptive step size (3D): with the RCS quiet, nothing touching and the
+    // lander high enough over the ground it can reach that its plume can't
+    // touch it either, a stride of up to kMaxStrideSteps calls to Update
+    // shares one Bullet step; closer in, every call steps on its own, for
+    // contacts as accurate as before. Strides are powers of two starting on
+    // a multiple of their length, counted from the lander body's last
+    // reset, so the same flight always takes the same steps. Between Bullet
+    // steps the lander follows the stride's constant acceleration. A change
+    // of controls ends a stride early, at the step before it.
+    static constexpr int kMaxStrideSteps = 8;
+    void SetAdaptiveStepping(bool enabled) { mAdaptiveStepping = enabled; }
+    bool IsAdaptiveStepping() const { return mAdaptiveStepping; }
+    int GetStrideSteps() const { return mStrideSteps; }    // Steps the current stride spans
     
     // Collision detection
     bool CheckCollisions();
     
     // Physics calculations - now using Bullet Physics internally
     void ApplyThrust(Lander* lander, float deltaTime);
+    void ApplyRcs(Lander* lander);
     void UpdateLanderPhysics(Lander* lander);
     
     // 2D physics (keeping for backward compatibility)
@@ -57,7 +234,6 @@ private:
     float mGravity;         // Lunar gravity (m/s²)
     float mAirDensity;      // Atmospheric density (kg/m³)
     float mTimeScale;       // Time scaling factor for simulation speed
-    float mPixelsPerMeter;  // Conversion factor between physics and screen units
     
     // Simulation mode
     bool m3DMode;           // Whether to use 3D physics
@@ -66,27 +242,154 @@ private:
     Lander* mLander;
     Terrain* mTerrain;
     
-    // Bullet Physics objects
+    // Bullet Physics objects. One world holds the lander and the terrain,
+    // so there is a single broadphase, dispatcher and solver.
     btDefaultCollisionConfiguration* mCollisionConfiguration;
     btCollisionDispatcher* mDispatcher;
     btBroadphaseInterface* mBroadphase;
-    btSequentialImpulseConstraintSolver* mSolver;
+    PhysicsBroadphase mBroadphaseType;
+    btVector3 mBroadphaseMin;       // Bounds mBroadphase quantizes over (sweep-and-prune)
+    btVector3 mBroadphaseMax;
+    btConstraintSolver* mSolver;
+    btConstraintSolver* mSolverMt;  // Island solver for the multithreaded world
     btDiscreteDynamicsWorld* mDynamicsWorld;
     
-    // Regolith simulation (soft body dynamics)
-    btSoftBodyWorldInfo mSoftBodyWorldInfo;
-    btSoftBodyRigidBodyCollisionConfiguration* mSoftBodyCollisionConfiguration;
-    btSoftRigidDynamicsWorld* mSoftRigidDynamicsWorld;
+    // Threading
+    JobSystem* mJobSystem;           // Not owned, may be null
+    btITaskScheduler* mTaskScheduler; // Owned, null when single-threaded
+    int mRequestedThreadCount;
+    
+    // Granular regolith on the height grid under the lander
+    RegolithField mRegolith;
+    
+    // Crater of the last crash, waiting for CommitRegolith()
+    bool mCraterPending;
+    float mCraterX;
+    float mCraterZ;
+    float mCraterRadius;
+    
+    // Debris pool: a few shared boxes, and the bodies that use them in
+    // turn, taken in ring order
+    static constexpr int kDebrisShapeCount = 3;
+    btBoxShape* mDebrisShapes[kDebrisShapeCount];
+    btRigidBody* mDebrisBodies[kDebrisPoolSize];
+    int mDebrisNext;                // Next piece to take (the oldest)
+    uint32_t mDebrisSpawns;         // Pieces taken so far, seeding their scatter
     
-    // Rigid bodies
+    // Plume impingement, tabulated for the lander body's base
+    PlumeTable mPlumeTable;
+    PlumeImpingement mPlume;
+    
+    // What the pooled bodies were built from. A reset that registers an
+    // identical lander or terrain reuses the body, shape and motion state
+    // instead of rebuilding them.
+    struct TerrainShapeKey {
+        const HeightGrid* heights;  // Heightfield grid (null = triangle mesh)
+        size_t sampleCount;         // Heights, or triangles for a mesh
+        int gridSize;
+        float cellWidth;
+        float cellLength;
+        float minHeight;
+        float maxHeight;
+        float originX;
+        float originZ;
+        uint64_t triangleHash;      // FNV-1a of the mesh vertices (0 for a heightfield)
+        
+        // Whether a shape built for built can stand in for this terrain:
+        // equal apart from the height range, which only has to fit inside
+        // the built one (the shape's bounds are then just looser)
+        bool FitsShape(const TerrainShapeKey& built) const;
+    };
+    
+    // Rigid bodies. The lander's is the hull: a compound of its box and
+    // the four struts, with a foot body sprung under each strut's end.
     btRigidBody* mLanderRigidBody;
+    float mLanderBodyExtents[3];    // Box half extents (meters) of mLanderRigidBody
+    float mLanderBodyMass;          // Launch mass mLanderRigidBody was built for
+    
+    // The lander's mass and inertia for the fuel left, which the hull takes
+    // once it has drifted past MassProperties::kApplyThreshold
+    MassProperties mLanderMass;
+    struct LanderLeg {
+        btRigidBody* foot;
+        btGeneric6DofSpring2Constraint* strut;
+        btTransform restFrame;          // Foot center in the hull's frame, strut fully extended
+    };
+    LanderLeg mLegs[kLegCount];
+    
+    // Contact events from the narrowphase callbacks, by lander part (0 the
+    // hull, 1 + leg the feet). Atomic, since a multithreaded dispatcher
+    // calls back from its workers; each part has one terrain pair, so only
+    // one thread writes its entries at a time.
+    std::atomic<int> mPartContacts[kLegCount + 1];         // Manifolds touching now
+    std::atomic<bool> mPartTouched[kLegCount + 1];         // Touched since the last GatherContactEvents
+    std::atomic<float> mPartTouchdownVertical[kLegCount + 1];
+    std::atomic<float> mPartTouchdownHorizontal[kLegCount + 1];
+    std::vector<ContactEvent> mContactEvents;
     std::vector<btRigidBody*> mTerrainRigidBodies;
+    btTriangleMesh* mTerrainMesh;   // Only used by the triangle-mesh terrain path
+    uint32_t mTerrainLayoutVersion; // Terrain::GetLayoutVersion() the bodies were built for
+    Terrain* mBodiesTerrain;        // Terrain the bodies were built for (null = none)
+    TerrainShapeKey mTerrainShapeKey;      // Key the terrain shape was built for
+    
+    // Sleeping
+    float mSleepLinearThreshold;
+    float mSleepAngularThreshold;
+    int mActiveBodyCount;
+    
+    // Time warp
+    bool mBallisticCoasting;
+    
+    // Adaptive stepping: the stride under way, and the hull's state and
+    // the controls it started with
+    bool mAdaptiveStepping;
+    uint32_t mStepIndex;            // Calls to Update since the lander body was placed
+    int mStrideSteps;
+    int mStridePending;             // Calls taken, Bullet not yet stepped for them
+    float mStrideTime;              // Their total time
+    float mStrideThrust;            // Thrust level applied (0 = engine off)
+    float mStrideRcs;               // RCS command applied
+    btTransform mStrideStart;
+    btVector3 mStrideVelocity;
+    btVector3 mStrideAngularVelocity;
+    btVector3 mStrideAcceleration;  // Gravity plus the applied forces over the lander's mass
     
     // Helper methods
     void InitializeBulletPhysics();
     void CleanupBulletPhysics();
     void CreateLanderRigidBody(Lander* lander);
+    void DestroyLanderRigidBody();
+    void ConfigureLanderMass(Lander* lander);
+    void ApplyLanderMass();
+    void ResetLanderRigidBody(const btTransform& transform);
+    void CreateLanderLegs(float mass);
+    void ResetLanderParts();
+    bool IsLanderPart(const btCollisionObject* object) const { return object->getUserPointer() == this; }
+    static void OnContactStarted(btPersistentManifold* const& manifold);
+    static void OnContactEnded(btPersistentManifold* const& manifold);
+    void GatherContactEvents();
+    void SleepLanderBody();
+    void CreateDebrisPool();
+    void DestroyDebrisPool();
+    void ParkDebris(btRigidBody* piece);
+    void BeginStride(float deltaTime);
+    int ChooseStrideSteps(float deltaTime) const;
+    void FinishStride();
+    void PreviewStride();
+    void CancelStride();
+    void GetLanderBounds(btVector3& aabbMin, btVector3& aabbMax) const;
+    bool CanCoastLander(float deltaTime) const;
+    void CoastLander(float deltaTime);
+    int CountActiveBodies() const;
+    void ResolveContact2D(float collisionHeight);
+    static TerrainShapeKey MakeTerrainShapeKey(const Terrain* terrain);
     void CreateTerrainRigidBodies(Terrain* terrain);
-    void CreateRegolithSoftBody(Terrain* terrain);
+    btCollisionShape* CreateHeightfieldShape(Terrain* terrain, btTransform& transform);
+    btCollisionShape* CreateTriangleMeshShape(Terrain* terrain);
+    void DestroyTerrainRigidBodies();
+    void FitBroadphaseToTerrain(const btRigidBody* terrainBody);
+    int BuildRegolithLoad(float deltaTime, bool atRest, RegolithLoad& load) const;
+    void UpdateRegolith(float deltaTime);
+    void SettleLanderInRegolith();
     void SyncLanderWithPhysics(Lander* lander);
 };
\ No newline at end of file
@@ -0,0 +1,148 @@
+// PhysicsArena.cpp
+// Implementation of the Bullet allocation arena
+
+#include "PhysicsArena.h"
+#include "MemoryTracker.h"
+#include <bullet/LinearMath/btAlignedAllocator.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+
+// kMinBlockSize << (kClassCount - 1) == kMaxBlockSize
+static constexpr int kClassCount = 12;
+static constexpr uint32_t kLargeClass = 0xffffffffu;
+
+// Precedes every block; 16 bytes keeps the payload 16-byte aligned, which
+// Bullet's aligned allocator then rounds up to what each type needs
+struct alignas(16) BlockHeader {
+    uint32_t sizeClass;   // kLargeClass: malloc'd, size holds its size
+    uint32_t pad;
+    size_t size;
+};
+static_assert(sizeof(BlockHeader) == 16, "Block header must keep payloads 16-byte aligned");
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct ArenaState {
+    std::mutex mutex;
+    FreeBlock* freeLists[kClassCount] = {};
+    char* chunk = nullptr;        // Chunk being carved
+    size_t chunkUsed = 0;
+    size_t reservedBytes = 0;
+    size_t liveBytes = 0;
+};
+
+// Never destroyed: Bullet objects in static storage may free after main
+static ArenaState& State() {
+    static ArenaState* state = new ArenaState();
+    return *state;
+}
+
+static std::atomic<bool> sInstalled(false);
+
+// Smallest class holding size bytes, or -1
+static int ClassFor(size_t size) {
+    size_t classSize = PhysicsArena::kMinBlockSize;
+    for (int sizeClass = 0; sizeClass < kClassCount; sizeClass++, classSize <<= 1) {
+        if (size <= classSize) return sizeClass;
+    }
+    return -1;
+}
+
+void PhysicsArena::Install() {
+    bool expected = false;
+    if (!sInstalled.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    State();
+    btAlignedAllocSetCustom(Allocate, Free);
+}
+
+bool PhysicsArena::IsInstalled() {
+    return sInstalled.load();
+}
+
+size_t PhysicsArena::GetReservedBytes() {
+    ArenaState& state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.reservedBytes;
+}
+
+size_t PhysicsArena::GetLiveBytes() {
+    ArenaState& state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.liveBytes;
+}
+
+void* PhysicsArena::Allocate(size_t size) {
+    ArenaState& state = State();
+    const size_t blockSize = size + sizeof(BlockHeader);
+    const int sizeClass = ClassFor(blockSize);
+    
+    if (sizeClass < 0) {
+        BlockHeader* header = static_cast<BlockHeader*>(std::malloc(blockSize));
+        if (!header) return nullptr;
+        header->sizeClass = kLargeClass;
+        header->size = blockSize;
+    
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.reservedBytes += blockSize;
+        state.liveBytes += blockSize;
+        MemoryTracker::Allocate(MemoryTag::Physics, blockSize);
+        return header + 1;
+    }
+    
+    const size_t classSize = kMinBlockSize << sizeClass;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    BlockHeader* header = nullptr;
+    if (FreeBlock* block = state.freeLists[sizeClass]) {
+        state.freeLists[sizeClass] = block->next;
+        header = reinterpret_cast<BlockHeader*>(block);
+    } else {
+        // The tail of a chunk too short for this block is abandoned; with
+        // classes at most kChunkSize / 16 that wastes little
+        if (!state.chunk || state.chunkUsed + classSize > kChunkSize) {
+            char* chunk = static_cast<char*>(std::malloc(kChunkSize));
+            if (!chunk) return nullptr;
+            state.chunk = chunk;
+            state.chunkUsed = 0;
+            state.reservedBytes += kChunkSize;
+        }
+        header = reinterpret_cast<BlockHeader*>(state.chunk + state.chunkUsed);
+        state.chunkUsed += classSize;
+    }
+    
+    header->sizeClass = static_cast<uint32_t>(sizeClass);
+    header->size = classSize;
+    state.liveBytes += classSize;
+    MemoryTracker::Allocate(MemoryTag::Physics, classSize);
+    return header + 1;
+}
+
+void PhysicsArena::Free(void* memory) {
+    if (!memory) return;
+    
+    ArenaState& state = State();
+    BlockHeader* header = static_cast<BlockHeader*>(memory) - 1;
+    if (header->sizeClass == kLargeClass) {
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.reservedBytes -= header->size;
+            state.liveBytes -= header->size;
+        }
+        MemoryTracker::Free(MemoryTag::Physics, header->size);
+        std::free(header);
+        return;
+    }
+    
+    const uint32_t sizeClass = header->sizeClass;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.liveBytes -= header->size;
+    MemoryTracker::Free(MemoryTag::Physics, header->size);
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+    block->next = state.freeLists[sizeClass];
+    state.freeLists[sizeClass] = block;
+}
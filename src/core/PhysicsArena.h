@@ -0,0 +1,36 @@
+// PhysicsArena.h
+// Size-class arena backing every allocation Bullet makes
+
+#pragma once
+
+#include <cstddef>
+
+// Bullet allocates its shapes, bodies, broadphase proxies, manifolds and
+// array storage through btAlignedAlloc. Once installed, those requests
+// come from power-of-two size classes carved out of kChunkSize chunks and
+// freed blocks go back on their class's free list, so rebuilding bodies
+// on a reset recycles memory instead of going to the system allocator.
+// Chunks are kept until exit. Requests above kMaxBlockSize go straight to
+// malloc.
+//
+// Thread safe: multithreaded Bullet worlds allocate from their workers.
+class PhysicsArena {
+public:
+    static constexpr size_t kChunkSize = 1024 * 1024;
+    static constexpr size_t kMinBlockSize = 32;          // Including the block header
+    static constexpr size_t kMaxBlockSize = 64 * 1024;
+    
+    // Route Bullet's allocations through the arena. Must run before any
+    // Bullet object exists, since blocks can't be freed by the allocator
+    // that didn't make them; later calls do nothing.
+    static void Install();
+    static bool IsInstalled();
+    
+    // Counters for the log
+    static size_t GetReservedBytes();   // Chunks plus large blocks
+    static size_t GetLiveBytes();       // Blocks handed out and not yet freed
+    
+private:
+    static void* Allocate(size_t size);
+    static void Free(void* memory);
+};
@@ -0,0 +1,123 @@
+// PlumeTable.cpp
+// Integrating the plume footprint into the altitude/angle table and sampling it
+
+#include "PlumeTable.h"
+#include "Profiler.h"
+#include "RegolithField.h"
+#include <algorithm>
+#include <cmath>
+
+// Share of the force landing under the lander's base that the deflected
+// flow hands back to it
+static const float kFountainRecovery = 0.1f;
+
+// Polar quadrature over the base disc
+static const int kRadialSteps = 24;
+static const int kAngularSteps = 48;
+
+PlumeTable::PlumeTable()
+    : mBaseRadius(0.0f)
+{
+}
+
+void PlumeTable::Build(float baseRadius) {
+    PROFILE_ZONE("Plume Table Build");
+    mBaseRadius = std::max(baseRadius, 0.01f);
+    mEntries.resize(static_cast<size_t>(kAltitudeBins) * kAngleBins);
+    for (int a = 0; a < kAngleBins; a++) {
+        const float downward = kMinDownward + (1.0f - kMinDownward) * a / (kAngleBins - 1);
+        for (int h = 0; h < kAltitudeBins; h++) {
+            const float u = static_cast<float>(h) / (kAltitudeBins - 1);
+            mEntries[static_cast<size_t>(a) * kAltitudeBins + h] = Integrate(kMaxAltitude * u * u, downward, mBaseRadius);
+        }
+    }
+}
+
+// One newton of thrust: the footprint's force is the thrust's normal
+// component, so its peak is downward / (pi r^2). The ground gain takes the
+// footprint's share under the base disc, centred below the nozzle while
+// the footprint sits downrange of it along the exhaust's tilt.
+PlumeTable::Entry PlumeTable::Integrate(float altitude, float downward, float baseRadius) {
+    Entry entry;
+    const float slant = altitude / downward;
+    entry.radius = kNozzleRadius + kPlumeSpread * slant;
+    const float area = static_cast<float>(M_PI) * entry.radius * entry.radius;
+    entry.pressure = downward / area;
+    
+    const float offset = altitude * std::sqrt(std::max(0.0f, 1.0f - downward * downward)) / downward;
+    float share = 0.0f;
+    for (int r = 0; r < kRadialSteps; r++) {
+        const float radius = baseRadius * (r + 0.5f) / kRadialSteps;
+        const float ringArea = 2.0f * static_cast<float>(M_PI) * radius * (baseRadius / kRadialSteps) / kAngularSteps;
+        for (int t = 0; t < kAngularSteps; t++) {
+            const float angle = 2.0f * static_cast<float>(M_PI) * (t + 0.5f) / kAngularSteps;
+            const float dx = radius * std::cos(angle) - offset;
+            const float dz = radius * std::sin(angle);
+            share += std::exp(-(dx * dx + dz * dz) / (entry.radius * entry.radius)) * ringArea;
+        }
+    }
+    entry.groundGain = kFountainRecovery * downward * share / area;
+    return entry;
+}
+
+bool PlumeTable::Locate(float altitude, float downward, int& altitudeBin, int& angleBin, float& altitudeT,
+                        float& angleT) const {
+    if (mEntries.empty() || altitude > kMaxAltitude || downward < kMinDownward) {
+        return false;
+    }
+    
+    // A nozzle at or under the surface is at the table's first row
+    const float u = std::sqrt(std::max(altitude, 0.0f) / kMaxAltitude) * (kAltitudeBins - 1);
+    const float v = (std::min(downward, 1.0f) - kMinDownward) / (1.0f - kMinDownward) * (kAngleBins - 1);
+    altitudeBin = std::min(static_cast<int>(u), kAltitudeBins - 2);
+    angleBin = std::min(static_cast<int>(v), kAngleBins - 2);
+    altitudeT = u - altitudeBin;
+    angleT = v - angleBin;
+    return true;
+}
+
+PlumeImpingement PlumeTable::Sample(float thrust, float altitude, float downward) const {
+    PlumeImpingement plume = { 0.0f, 0.0f, 0.0f, 0.0f };
+    int h, a;
+    float ht, at;
+    if (thrust <= 0.0f || !Locate(altitude, downward, h, a, ht, at)) {
+        return plume;
+    }
+    
+    const Entry& e00 = mEntries[static_cast<size_t>(a) * kAltitudeBins + h];
+    const Entry& e01 = mEntries[static_cast<size_t>(a) * kAltitudeBins + h + 1];
+    const Entry& e10 = mEntries[static_cast<size_t>(a + 1) * kAltitudeBins + h];
+    const Entry& e11 = mEntries[static_cast<size_t>(a + 1) * kAltitudeBins + h + 1];
+    auto blend = [&](float Entry::*field) {
+        const float low = e00.*field + (e01.*field - e00.*field) * ht;
+        const float high = e10.*field + (e11.*field - e10.*field) * ht;
+        return low + (high - low) * at;
+    };
+    plume.peakPressure = thrust * blend(&Entry::pressure);
+    plume.radius = blend(&Entry::radius);
+    plume.groundForce = thrust * blend(&Entry::groundGain);
+    
+    // Regolith erodes where the Gaussian beats its cohesion, which
+    // integrates in closed form over the footprint; what isn't redeposited
+    // stays up as dust
+    const float critical = RegolithField::kCriticalPressure;
+    if (plume.peakPressure > critical) {
+        const float excess = plume.peakPressure - critical - critical * std::log(plume.peakPressure / critical);
+        const float volumeRate = RegolithField::kErosionRate * static_cast<float>(M_PI) * plume.radius * plume.radius * excess;
+        plume.dustRate = (1.0f - RegolithField::kRedeposit) * RegolithField::kBulkDensity * volumeRate;
+    }
+    return plume;
+}
+
+float PlumeTable::SampleGroundGain(float altitude, float downward) const {
+    int h, a;
+    float ht, at;
+    if (!Locate(altitude, downward, h, a, ht, at)) {
+        return 0.0f;
+    }
+    const Entry* low = &mEntries[static_cast<size_t>(a) * kAltitudeBins + h];
+    const Entry* high = low + kAltitudeBins;
+    const float lowGain = low[0].groundGain + (low[1].groundGain - low[0].groundGain) * ht;
+    const float highGain = high[0].groundGain + (high[1].groundGain - high[0].groundGain) * ht;
+    return lowGain + (highGain - lowGain) * at;
+}
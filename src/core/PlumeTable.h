@@ -0,0 +1,72 @@
+// PlumeTable.h
+// Rocket plume impingement on the ground, tabulated by altitude and exhaust angle
+
+#pragma once
+
+#include <vector>
+
+// What the plume does to the ground and the lander at one instant
+struct PlumeImpingement {
+    float peakPressure;     // Pa at the footprint's center; 0 = no impingement
+    float radius;           // m, where the pressure falls to 1/e of the peak
+    float groundForce;      // N pushed back up the lander's axis by the reflected flow
+    float dustRate;         // kg/s of regolith lifted and left airborne
+};
+
+// The plume as a Gaussian pressure footprint that widens along the exhaust
+// axis, spread over the ground it meets. Per unit thrust, the footprint's
+// peak pressure and radius and the share of the force the deflected flow
+// returns onto the lander's base depend only on the nozzle's altitude and
+// how steeply the exhaust points down, so Build() integrates them once
+// into a grid of those two and every lookup is a bilinear fetch: cheap
+// enough for every lander of a batch each step.
+//
+// Altitude bins are spaced by the square root of altitude, finest near the
+// ground where the footprint changes fastest. The angle axis runs over the
+// exhaust's downward component (the cosine of its angle off vertical) from
+// kMinDownward, below which the plume reaches the ground too far away to
+// matter, to 1. Outside either range the plume has no effect.
+class PlumeTable {
+public:
+    static constexpr int kAltitudeBins = 64;
+    static constexpr int kAngleBins = 16;
+    static constexpr float kMaxAltitude = 30.0f;    // Nozzle height (m) above which nothing reaches the ground
+    static constexpr float kMinDownward = 0.1f;
+    
+    // Footprint at the nozzle, and its radius growth per meter of plume
+    static constexpr float kNozzleRadius = 0.3f;
+    static constexpr float kPlumeSpread = 0.3f;
+    
+    PlumeTable();
+    
+    // Integrate the table for a lander whose base (the disc the reflected
+    // flow pushes on) has baseRadius meters
+    void Build(float baseRadius);
+    bool IsBuilt() const { return !mEntries.empty(); }
+    float GetBaseRadius() const { return mBaseRadius; }
+    
+    // Impingement of thrust newtons with the nozzle altitude meters above
+    // the ground and the exhaust's downward component downward (0 - 1)
+    PlumeImpingement Sample(float thrust, float altitude, float downward) const;
+    
+    // Ground force per newton of thrust alone, for callers that only push
+    // the lander
+    float SampleGroundGain(float altitude, float downward) const;
+
+private:
+    // Per newton of thrust
+    struct Entry {
+        float pressure;     // Peak pressure (Pa/N)
+        float radius;       // m
+        float groundGain;   // Returned force (N/N)
+    };
+    
+    float mBaseRadius;
+    std::vector<Entry> mEntries;    // kAngleBins rows of kAltitudeBins
+    
+    static Entry Integrate(float altitude, float downward, float baseRadius);
+    
+    // Bilinear weights into mEntries; false outside the table
+    bool Locate(float altitude, float downward, int& altitudeBin, int& angleBin, float& altitudeT,
+                float& angleT) const;
+};
@@ -0,0 +1,450 @@
+// Profiler.cpp
+// Implementation of the frame profiler
+
+#include "Profiler.h"
+#include "Log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// One finished timer
+struct ProfileSample {
+    const char* name;
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+// Single-producer ring owned by one thread; EndFrame() is the only consumer
+struct ProfileThreadRing {
+    ProfileSample samples[Profiler::kThreadRingSize];
+    std::atomic<uint64_t> head{0};    // Written by the owning thread
+    std::atomic<uint64_t> tail{0};    // Written by the consumer
+    int threadIndex = 0;
+    std::atomic<const char*> threadName{nullptr};
+};
+
+// Rolling per-frame totals of one stage
+struct ProfileStageHistory {
+    const char* name;
+    float historyMs[Profiler::kHistoryFrames];
+    int count;
+    int next;
+    uint64_t frameNs;     // Accumulated for the frame being drained
+    bool ranThisFrame;
+    std::vector<float> runMs;   // Every frame's total, for the stage report
+};
+
+// A sample kept for the trace dump
+struct ProfileTraceEvent {
+    const char* name;
+    int threadIndex;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// A counter change kept for the trace dump
+struct ProfileCounterEvent {
+    const char* name;
+    uint64_t timeNs;
+    int64_t value;
+};
+
+static_assert((Profiler::kThreadRingSize & (Profiler::kThreadRingSize - 1)) == 0,
+              "Profiler ring size must be a power of two");
+
+static const std::chrono::steady_clock::time_point sProfilerEpoch = std::chrono::steady_clock::now();
+
+// Rings are registered once per thread and never freed, so a worker that
+// exits leaves its last samples behind for the next drain
+static std::mutex sRingMutex;
+static std::vector<std::unique_ptr<ProfileThreadRing>> sRings;
+static thread_local ProfileThreadRing* tThreadRing = nullptr;
+static std::atomic<uint64_t> sDroppedSamples{0};
+
+// Main-thread state
+static ProfileStageHistory sStages[Profiler::kMaxStages];
+static int sStageCount = 0;
+static std::string sTraceFile;
+static std::vector<ProfileTraceEvent> sTraceEvents;
+static std::string sStageReportFile;
+static std::vector<ProfileTraceEvent> sRecentEvents;    // Ring of kRecentEvents when enabled, else empty
+static uint64_t sRecentHead = 0;
+
+// Counters are set once a step or so, from whichever thread owns the
+// system, so a lock is cheaper than it would be for the timers
+static std::mutex sCounterMutex;
+static ProfileCounterValue sCounters[Profiler::kMaxCounters];
+static int sCounterCount = 0;
+static std::vector<ProfileCounterEvent> sCounterEvents;
+
+static ProfileThreadRing* RegisterThreadRing() {
+    std::unique_ptr<ProfileThreadRing> ring(new ProfileThreadRing());
+    ProfileThreadRing* result = ring.get();
+
+    std::lock_guard<std::mutex> lock(sRingMutex);
+    result->threadIndex = static_cast<int>(sRings.size());
+    sRings.push_back(std::move(ring));
+    return result;
+}
+
+static ProfileStageHistory* FindStage(const char* name) {
+    // Names are usually the same literal, so compare pointers first
+    for (int i = 0; i < sStageCount; ++i) {
+        if (sStages[i].name == name) {
+            return &sStages[i];
+        }
+    }
+    for (int i = 0; i < sStageCount; ++i) {
+        if (std::strcmp(sStages[i].name, name) == 0) {
+            return &sStages[i];
+        }
+    }
+    if (sStageCount == Profiler::kMaxStages) {
+        return nullptr;
+    }
+
+    ProfileStageHistory* stage = &sStages[sStageCount++];
+    stage->name = name;
+    stage->count = 0;
+    stage->next = 0;
+    stage->frameNs = 0;
+    stage->ranThisFrame = false;
+    stage->runMs.clear();
+    return stage;
+}
+
+uint64_t Profiler::Now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - sProfilerEpoch).count());
+}
+
+static ProfileThreadRing* GetThreadRing() {
+    if (!tThreadRing) {
+        tThreadRing = RegisterThreadRing();
+    }
+    return tThreadRing;
+}
+
+void Profiler::SetThreadName(const char* name) {
+    GetThreadRing()->threadName.store(name, std::memory_order_relaxed);
+    ProfilerHooks::SetThreadName(name);
+}
+
+void Profiler::Record(const char* name, uint64_t startNs, uint64_t endNs) {
+    ProfileThreadRing* ring = GetThreadRing();
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= kThreadRingSize) {
+        sDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ProfileSample& sample = ring->samples[head & (kThreadRingSize - 1)];
+    sample.name = name;
+    sample.startNs = startNs;
+    sample.endNs = endNs;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::EndFrame() {
+    bool tracing = !sTraceFile.empty();
+    bool reporting = !sStageReportFile.empty();
+    bool recent = !sRecentEvents.empty();
+
+    {
+        // Only blocks against a thread registering its ring
+        std::lock_guard<std::mutex> lock(sRingMutex);
+        for (const std::unique_ptr<ProfileThreadRing>& ring : sRings) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+
+            for (; tail != head; ++tail) {
+                const ProfileSample& sample = ring->samples[tail & (kThreadRingSize - 1)];
+                uint64_t duration = sample.endNs - sample.startNs;
+
+                ProfileStageHistory* stage = FindStage(sample.name);
+                if (stage) {
+                    stage->frameNs += duration;
+                    stage->ranThisFrame = true;
+                }
+
+                if (tracing && sTraceEvents.size() < kMaxTraceEvents) {
+                    sTraceEvents.push_back({sample.name, ring->threadIndex, sample.startNs, duration});
+                }
+                if (recent) {
+                    sRecentEvents[sRecentHead++ & (kRecentEvents - 1)] =
+                        {sample.name, ring->threadIndex, sample.startNs, duration};
+                }
+            }
+
+            ring->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    // Push this frame's totals into each stage's rolling window
+    for (int i = 0; i < sStageCount; ++i) {
+        ProfileStageHistory& stage = sStages[i];
+        if (!stage.ranThisFrame) {
+            continue;
+        }
+
+        stage.historyMs[stage.next] = static_cast<float>(stage.frameNs * 1e-6);
+        if (reporting && stage.runMs.size() < kMaxReportFrames) {
+            stage.runMs.push_back(stage.historyMs[stage.next]);
+        }
+        stage.next = (stage.next + 1) % kHistoryFrames;
+        stage.count = std::min(stage.count + 1, kHistoryFrames);
+        stage.frameNs = 0;
+        stage.ranThisFrame = false;
+    }
+}
+
+int Profiler::GetStageStats(ProfileStageStats* out, int maxStages) {
+    int written = 0;
+    float sorted[kHistoryFrames];
+
+    for (int i = 0; i < sStageCount && written < maxStages; ++i) {
+        const ProfileStageHistory& stage = sStages[i];
+        if (stage.count == 0) {
+            continue;
+        }
+
+        std::copy(stage.historyMs, stage.historyMs + stage.count, sorted);
+
+        float sum = 0.0f;
+        float minMs = sorted[0];
+        for (int j = 0; j < stage.count; ++j) {
+            sum += sorted[j];
+            minMs = std::min(minMs, sorted[j]);
+        }
+
+        // Nearest-rank 99th percentile
+        int rank = (stage.count * 99 + 99) / 100 - 1;
+        std::nth_element(sorted, sorted + rank, sorted + stage.count);
+
+        ProfileStageStats& stats = out[written++];
+        stats.name = stage.name;
+        stats.minMs = minMs;
+        stats.avgMs = sum / stage.count;
+        stats.p99Ms = sorted[rank];
+        stats.frames = stage.count;
+    }
+
+    return written;
+}
+
+void Profiler::SetCounter(const char* name, int64_t value) {
+    bool tracing = !sTraceFile.empty();
+    uint64_t now = tracing ? Now() : 0;
+
+    std::lock_guard<std::mutex> lock(sCounterMutex);
+    ProfileCounterValue* counter = nullptr;
+    for (int i = 0; i < sCounterCount; ++i) {
+        if (sCounters[i].name == name || std::strcmp(sCounters[i].name, name) == 0) {
+            counter = &sCounters[i];
+            break;
+        }
+    }
+    if (!counter) {
+        if (sCounterCount == kMaxCounters) {
+            return;
+        }
+        counter = &sCounters[sCounterCount++];
+        counter->name = name;
+        counter->value = value - 1;   // Force the first trace event
+    }
+
+    // Only changes go into the trace; a counter track holds its last value
+    if (tracing && counter->value != value && sCounterEvents.size() < kMaxTraceEvents) {
+        sCounterEvents.push_back({name, now, value});
+    }
+    counter->value = value;
+}
+
+int Profiler::GetCounters(ProfileCounterValue* out, int maxCounters) {
+    std::lock_guard<std::mutex> lock(sCounterMutex);
+    int count = std::min(sCounterCount, maxCounters);
+    std::copy(sCounters, sCounters + count, out);
+    return count;
+}
+
+void Profiler::SetTraceFile(const std::string& filename) {
+#if !ENABLE_PROFILER
+    if (!filename.empty()) {
+        LOG_WARNING("Profiler was compiled out (ENABLE_PROFILER=OFF); no trace will be written");
+    }
+#else
+    sTraceFile = filename;
+    sTraceEvents.clear();
+    std::lock_guard<std::mutex> lock(sCounterMutex);
+    sCounterEvents.clear();
+#endif
+}
+
+// Thread name metadata ("M") events for the labelled threads
+static void WriteChromeThreadNames(FILE* file) {
+    std::lock_guard<std::mutex> lock(sRingMutex);
+    for (const std::unique_ptr<ProfileThreadRing>& ring : sRings) {
+        const char* threadName = ring->threadName.load(std::memory_order_relaxed);
+        if (threadName) {
+            std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                         "\"args\":{\"name\":\"%s\"}},\n", ring->threadIndex, threadName);
+        }
+    }
+}
+
+// A complete ("X") event with microsecond timestamps
+static void WriteChromeEvent(FILE* file, const ProfileTraceEvent& event, bool last) {
+    std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                 event.name, event.threadIndex, event.startNs * 1e-3, event.durationNs * 1e-3, last ? "" : ",");
+}
+
+bool Profiler::WriteTrace() {
+    if (sTraceFile.empty()) {
+        return true;
+    }
+
+    // Pick up samples recorded since the last frame ended
+    EndFrame();
+
+    FILE* file = std::fopen(sTraceFile.c_str(), "w");
+    if (!file) {
+        LOG_ERROR("Failed to open trace file: %s", sTraceFile.c_str());
+        return false;
+    }
+
+    bool chromeTrace = sTraceFile.size() >= 5 &&
+                       sTraceFile.compare(sTraceFile.size() - 5, 5, ".json") == 0;
+
+    if (chromeTrace) {
+        std::fprintf(file, "{\"traceEvents\":[\n");
+        WriteChromeThreadNames(file);
+        {
+            // Counter ("C") events, one track per counter
+            std::lock_guard<std::mutex> lock(sCounterMutex);
+            for (const ProfileCounterEvent& event : sCounterEvents) {
+                std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+                             "\"args\":{\"value\":%lld}},\n", event.name, event.timeNs * 1e-3,
+                             static_cast<long long>(event.value));
+            }
+        }
+        for (size_t i = 0; i < sTraceEvents.size(); ++i) {
+            WriteChromeEvent(file, sTraceEvents[i], i + 1 == sTraceEvents.size());
+        }
+        std::fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    } else {
+        // Counters have no column here; they only go into Chrome traces
+        std::fprintf(file, "thread,stage,start_us,duration_us\n");
+        for (const ProfileTraceEvent& event : sTraceEvents) {
+            std::fprintf(file, "%d,%s,%.3f,%.3f\n",
+                         event.threadIndex, event.name, event.startNs * 1e-3, event.durationNs * 1e-3);
+        }
+    }
+
+    std::fclose(file);
+
+    LOG_INFO("Wrote %zu profiler samples to %s%s", sTraceEvents.size(), sTraceFile.c_str(),
+             sTraceEvents.size() >= kMaxTraceEvents ? " (trace buffer full, later samples dropped)" : "");
+
+    uint64_t dropped = GetDroppedSamples();
+    if (dropped > 0) {
+        LOG_WARNING("Profiler dropped %llu samples from full thread rings",
+                    static_cast<unsigned long long>(dropped));
+    }
+
+    return true;
+}
+
+void Profiler::SetStageReportFile(const std::string& filename) {
+#if !ENABLE_PROFILER
+    if (!filename.empty()) {
+        LOG_WARNING("Profiler was compiled out (ENABLE_PROFILER=OFF); no stage report will be written");
+    }
+#else
+    sStageReportFile = filename;
+    for (int i = 0; i < sStageCount; ++i) {
+        sStages[i].runMs.clear();
+    }
+#endif
+}
+
+bool Profiler::WriteStageReport() {
+    if (sStageReportFile.empty()) {
+        return true;
+    }
+    
+    FILE* file = std::fopen(sStageReportFile.c_str(), "w");
+    if (!file) {
+        LOG_ERROR("Failed to open stage report file: %s", sStageReportFile.c_str());
+        return false;
+    }
+    
+    // Nearest-rank percentiles over every frame the stage ran in
+    std::fprintf(file, "stage,frames,avg_ms,p50_ms,p99_ms,max_ms\n");
+    std::vector<float> sorted;
+    for (int i = 0; i < sStageCount; ++i) {
+        const ProfileStageHistory& stage = sStages[i];
+        if (stage.runMs.empty()) {
+            continue;
+        }
+        
+        sorted = stage.runMs;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (float ms : sorted) {
+            sum += ms;
+        }
+        size_t count = sorted.size();
+        std::fprintf(file, "%s,%zu,%.4f,%.4f,%.4f,%.4f\n", stage.name, count, sum / count,
+                     sorted[(count * 50 + 99) / 100 - 1], sorted[(count * 99 + 99) / 100 - 1], sorted[count - 1]);
+    }
+    
+    std::fclose(file);
+    LOG_INFO("Wrote stage report to %s", sStageReportFile.c_str());
+    return true;
+}
+
+void Profiler::SetRecentHistory(bool enabled) {
+#if !ENABLE_PROFILER
+    if (enabled) {
+        LOG_WARNING("Profiler was compiled out (ENABLE_PROFILER=OFF); captures will have no CPU trace");
+    }
+#else
+    sRecentEvents.assign(enabled ? kRecentEvents : 0, ProfileTraceEvent{});
+    sRecentHead = 0;
+#endif
+}
+
+bool Profiler::WriteRecentTrace(const std::string& filename) {
+    if (sRecentEvents.empty()) {
+        return false;
+    }
+    
+    FILE* file = std::fopen(filename.c_str(), "w");
+    if (!file) {
+        LOG_ERROR("Failed to open trace file: %s", filename.c_str());
+        return false;
+    }
+    
+    // Oldest first
+    const uint64_t count = std::min<uint64_t>(sRecentHead, kRecentEvents);
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    WriteChromeThreadNames(file);
+    for (uint64_t i = sRecentHead - count; i < sRecentHead; ++i) {
+        WriteChromeEvent(file, sRecentEvents[i & (kRecentEvents - 1)], i + 1 == sRecentHead);
+    }
+    std::fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    std::fclose(file);
+    
+    LOG_INFO("Wrote the last %llu profiler samples to %s", static_cast<unsigned long long>(count), filename.c_str());
+    return true;
+}
+
+uint64_t Profiler::GetDroppedSamples() {
+    return sDroppedSamples.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,115 @@
+// Profiler.h
+// Scoped frame timers with per-thread rings, rolling stage stats and trace dumps
+
+#pragma once
+
+#include "ProfilerHooks.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ENABLE_PROFILER is set by CMake; when it is 0 the PROFILE_* macros expand
+// to nothing and no timers are taken
+#ifndef ENABLE_PROFILER
+#define ENABLE_PROFILER 0
+#endif
+
+// Rolling timings of one named stage over the last kHistoryFrames frames.
+// A stage that runs several times in a frame (e.g. fixed steps) is summed.
+struct ProfileStageStats {
+    const char* name;
+    float minMs;
+    float avgMs;
+    float p99Ms;
+    int frames;           // Frames in the window in which the stage ran
+};
+
+// Latest value of a named counter (e.g. the bodies Bullet simulated)
+struct ProfileCounterValue {
+    const char* name;
+    int64_t value;
+};
+
+class Profiler {
+public:
+    static constexpr int kHistoryFrames = 120;           // Rolling window for the overlay
+    static constexpr size_t kThreadRingSize = 4096;      // Samples buffered per thread (power of two)
+    static constexpr size_t kMaxTraceEvents = 1 << 20;   // Cap on samples kept for the trace dump
+    static constexpr int kMaxStages = 32;
+    static constexpr int kMaxCounters = 16;
+    static constexpr size_t kMaxReportFrames = 1 << 20;  // Cap on frames kept per stage for the stage report
+    static constexpr size_t kRecentEvents = 1 << 16;     // Samples in the recent window (power of two)
+
+    // Nanoseconds on the steady clock since the profiler was loaded
+    static uint64_t Now();
+
+    // Append a finished sample to the calling thread's ring. Lock-free except
+    // for the first call on each thread. name must outlive the profiler.
+    static void Record(const char* name, uint64_t startNs, uint64_t endNs);
+
+    // Label the calling thread in trace dumps (e.g. "GPU" for samples
+    // converted from GPU timestamps). name must outlive the profiler.
+    static void SetThreadName(const char* name);
+
+    // Drain every thread's ring into the stage histories (main thread only).
+    // Call once per frame, after the frame's scopes have closed.
+    static void EndFrame();
+
+    // Copy up to maxStages stage stats into out; returns the number written
+    static int GetStageStats(ProfileStageStats* out, int maxStages);
+    
+    // Set a counter from any thread. The overlay shows the latest value and
+    // a Chrome trace dump gets every change as a counter track. name must
+    // outlive the profiler.
+    static void SetCounter(const char* name, int64_t value);
+    static int GetCounters(ProfileCounterValue* out, int maxCounters);
+
+    // Keep every sample for a dump on exit. A ".json" file is written as a
+    // Chrome trace (chrome://tracing, Perfetto), anything else as CSV.
+    static void SetTraceFile(const std::string& filename);
+    static bool WriteTrace();
+
+    // Keep every frame's stage totals for the whole run and write them on
+    // exit as CSV, one row per stage (stage, frames, avg_ms, p50_ms, p99_ms,
+    // max_ms); perf_replay compares these against a baseline
+    static void SetStageReportFile(const std::string& filename);
+    static bool WriteStageReport();
+
+    // Keep the last kRecentEvents samples in a ring as they are drained, so
+    // a slow frame can be dumped after the fact (spike captures), and write
+    // them as a Chrome trace. Off costs nothing; the window holds what the
+    // last EndFrame() drained.
+    static void SetRecentHistory(bool enabled);
+    static bool WriteRecentTrace(const std::string& filename);
+
+    // Samples lost because a thread's ring was full
+    static uint64_t GetDroppedSamples();
+};
+
+// Times the enclosing scope
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : mName(name), mStart(Profiler::Now()) {}
+    ~ProfileScope() { Profiler::Record(mName, mStart, Profiler::Now()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* mName;
+    uint64_t mStart;
+};
+
+// All three also reach the external profiler, if one is built in
+// (ProfilerHooks.h). PROFILE_COUNTER evaluates value twice.
+#if ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name); PROFILE_ZONE(name)
+#define PROFILE_END_FRAME() (Profiler::EndFrame(), PROFILE_FRAME_MARK())
+#define PROFILE_COUNTER(name, value) (Profiler::SetCounter(name, value), PROFILE_PLOT(name, value))
+#else
+#define PROFILE_SCOPE(name) PROFILE_ZONE(name)
+#define PROFILE_END_FRAME() PROFILE_FRAME_MARK()
+#define PROFILE_COUNTER(name, value) PROFILE_PLOT(name, value)
+#endif
@@ -0,0 +1,106 @@
+// ProfilerHooks.cpp
+// Thread names, frame marks and Bullet's profile scopes for the external profiler
+
+#include "ProfilerHooks.h"
+
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+#include <tracy/TracyC.h>
+#endif
+#if PROFILER_HOOKS != PROFILER_HOOKS_NONE
+#include <LinearMath/btQuickprof.h>
+#include <cstring>
+#endif
+
+#if PROFILER_HOOKS != PROFILER_HOOKS_NONE
+// Bullet enters and leaves its scopes through two plain callbacks, so the
+// open ones are kept per thread (the multithreaded world profiles on its
+// workers too). Deeper nesting than this is left unmarked.
+static const int kMaxBulletDepth = 64;
+static thread_local int tBulletDepth = 0;
+
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+static thread_local TracyCZoneCtx tBulletZones[kMaxBulletDepth];
+
+static void EnterBulletZone(const char* name) {
+    if (tBulletDepth < kMaxBulletDepth) {
+        // Bullet's names are runtime strings, so each zone carries its own
+        // source location
+        uint64_t location = ___tracy_alloc_srcloc_name(__LINE__, __FILE__, std::strlen(__FILE__), "Bullet", 6,
+                                                       name, std::strlen(name), 0);
+        tBulletZones[tBulletDepth] = ___tracy_emit_zone_begin_alloc(location, 1);
+    }
+    tBulletDepth++;
+}
+
+static void LeaveBulletZone() {
+    if (tBulletDepth == 0) return;
+    tBulletDepth--;
+    if (tBulletDepth < kMaxBulletDepth) {
+        ___tracy_emit_zone_end(tBulletZones[tBulletDepth]);
+    }
+}
+#else
+static thread_local os_signpost_id_t tBulletIntervals[kMaxBulletDepth];
+
+static void EnterBulletZone(const char* name) {
+    if (tBulletDepth < kMaxBulletDepth) {
+        os_log_t log = ProfilerHooks::GetLog();
+        os_signpost_id_t id = os_signpost_id_generate(log);
+        os_signpost_interval_begin(log, id, "Bullet", "%{public}s", name);
+        tBulletIntervals[tBulletDepth] = id;
+    }
+    tBulletDepth++;
+}
+
+static void LeaveBulletZone() {
+    if (tBulletDepth == 0) return;
+    tBulletDepth--;
+    if (tBulletDepth < kMaxBulletDepth) {
+        os_signpost_interval_end(ProfilerHooks::GetLog(), tBulletIntervals[tBulletDepth], "Bullet");
+    }
+}
+#endif
+#endif
+
+void ProfilerHooks::SetThreadName(const char* name) {
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+    tracy::SetThreadName(name);
+#else
+    // Instruments names threads itself
+    (void)name;
+#endif
+}
+
+void ProfilerHooks::MarkFrame() {
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+    FrameMark;
+#elif PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+    os_signpost_event_emit(GetLog(), OS_SIGNPOST_ID_EXCLUSIVE, "Frame");
+#endif
+}
+
+void ProfilerHooks::PlotCounter(const char* name, int64_t value) {
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+    tracy::Profiler::PlotData(name, value);
+#elif PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+    os_signpost_event_emit(GetLog(), OS_SIGNPOST_ID_EXCLUSIVE, "Counter", "%{public}s %lld", name,
+                           static_cast<long long>(value));
+#else
+    (void)name;
+    (void)value;
+#endif
+}
+
+void ProfilerHooks::HookBullet() {
+#if PROFILER_HOOKS != PROFILER_HOOKS_NONE
+    btSetCustomEnterProfileZoneFunc(EnterBulletZone);
+    btSetCustomLeaveProfileZoneFunc(LeaveBulletZone);
+#endif
+}
+
+#if PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+os_log_t ProfilerHooks::GetLog() {
+    static os_log_t log = os_log_create("com.lunarlander.simulator", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    return log;
+}
+#endif
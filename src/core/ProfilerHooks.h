@@ -0,0 +1,89 @@
+// ProfilerHooks.h
+// Scopes forwarded to an external profiler: Tracy zones or os_signpost intervals
+
+#pragma once
+
+// PROFILER_HOOKS is set by CMake and picks where PROFILE_ZONE scopes go. It
+// is independent of ENABLE_PROFILER, so a release build with the in-game
+// profiler compiled out can still be opened in Tracy or Instruments.
+//   0  none: PROFILE_ZONE and PROFILE_FRAME_MARK expand to nothing
+//   1  Tracy: each scope is a zone (TracyClient linked, TRACY_ENABLE set)
+//   2  os_signpost: each scope is an interval on the Points of Interest
+//      track, which Instruments lines up with Metal System Trace
+#define PROFILER_HOOKS_NONE 0
+#define PROFILER_HOOKS_TRACY 1
+#define PROFILER_HOOKS_SIGNPOST 2
+
+#ifndef PROFILER_HOOKS
+#define PROFILER_HOOKS PROFILER_HOOKS_NONE
+#endif
+
+#include <cstdint>
+
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+#include <tracy/Tracy.hpp>
+#elif PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+#include <os/log.h>
+#include <os/signpost.h>
+#endif
+
+class ProfilerHooks {
+public:
+    // Label the calling thread. name must outlive the profiler.
+    static void SetThreadName(const char* name);
+    
+    // End of a frame: Tracy's frame mark, or a "Frame" signpost event
+    static void MarkFrame();
+    
+    // A counter's new value: a Tracy plot, or a "Counter" signpost event
+    // carrying the name and value. name must outlive the profiler.
+    static void PlotCounter(const char* name, int64_t value);
+    
+    // Send Bullet's own BT_PROFILE scopes (broadphase, narrowphase, solver
+    // islands, ...) to the external profiler. Does nothing without hooks or
+    // when Bullet was built with BT_NO_PROFILE.
+    static void HookBullet();
+
+#if PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+    static os_log_t GetLog();
+#endif
+};
+
+#if PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+// One signpost interval for the enclosing scope. Every interval shares the
+// "Scope" signpost name, which Instruments needs to be a literal at both
+// ends, and carries the scope's name as its message.
+class SignpostScope {
+public:
+    explicit SignpostScope(const char* name) : mId(os_signpost_id_generate(ProfilerHooks::GetLog())) {
+        os_signpost_interval_begin(ProfilerHooks::GetLog(), mId, "Scope", "%{public}s", name);
+    }
+    ~SignpostScope() { os_signpost_interval_end(ProfilerHooks::GetLog(), mId, "Scope"); }
+    
+    SignpostScope(const SignpostScope&) = delete;
+    SignpostScope& operator=(const SignpostScope&) = delete;
+
+private:
+    os_signpost_id_t mId;
+};
+#endif
+
+// PROFILE_ZONE(name) marks the enclosing scope for the external profiler
+// only; PROFILE_SCOPE (Profiler.h) does that and times it in-game as well.
+// name must be a string literal, and a scope holds at most one of either.
+// PROFILE_PLOT(name, value) is the same split for PROFILE_COUNTER.
+#if PROFILER_HOOKS == PROFILER_HOOKS_TRACY
+#define PROFILE_ZONE(name) ZoneScopedN(name)
+#define PROFILE_FRAME_MARK() ProfilerHooks::MarkFrame()
+#define PROFILE_PLOT(name, value) ProfilerHooks::PlotCounter(name, value)
+#elif PROFILER_HOOKS == PROFILER_HOOKS_SIGNPOST
+#define PROFILE_HOOKS_CONCAT_INNER(a, b) a##b
+#define PROFILE_HOOKS_CONCAT(a, b) PROFILE_HOOKS_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) SignpostScope PROFILE_HOOKS_CONCAT(signpostScope_, __LINE__)(name)
+#define PROFILE_FRAME_MARK() ProfilerHooks::MarkFrame()
+#define PROFILE_PLOT(name, value) ProfilerHooks::PlotCounter(name, value)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FRAME_MARK() ((void)0)
+#define PROFILE_PLOT(name, value) ((void)0)
+#endif
@@ -0,0 +1,66 @@
+// RcsThrusters.cpp
+// The thruster layout and what a command asks of it
+
+#include "RcsThrusters.h"
+#include <algorithm>
+#include <cmath>
+
+// Where each thruster sits (in half widths from the center), which way it
+// pushes along the hull's y axis, and which way its torque turns the hull
+struct RcsThrusterLayout {
+    float side;         // -1 left, 1 right
+    float push;         // -1 down, 1 up
+    float turn;         // side * push: 1 counter-clockwise
+};
+
+static const RcsThrusterLayout kLayout[RcsThrusters::kCount] = {
+    { -1.0f, -1.0f,  1.0f },    // Top left
+    {  1.0f, -1.0f, -1.0f },    // Top right
+    { -1.0f,  1.0f, -1.0f },    // Bottom left
+    {  1.0f,  1.0f,  1.0f },    // Bottom right
+};
+
+void RcsThrusters::GetLevels(float command, float* levels) {
+    const float clamped = std::min(std::max(command, -1.0f), 1.0f);
+    for (int i = 0; i < kCount; i++) {
+        levels[i] = std::max(0.0f, clamped * kLayout[i].turn);
+    }
+}
+
+float RcsThrusters::GetTorque(const float* levels, float halfWidth) {
+    // r x F about z for a thruster at (side * halfWidth, y) pushing along y
+    float torque = 0.0f;
+    for (int i = 0; i < kCount; i++) {
+        torque += kLayout[i].side * halfWidth * kLayout[i].push * kThrust * levels[i];
+    }
+    return torque;
+}
+
+float RcsThrusters::GetFuelRate(const float* levels) {
+    float rate = 0.0f;
+    for (int i = 0; i < kCount; i++) {
+        rate += kFuelRate * levels[i];
+    }
+    return rate;
+}
+
+float RcsThrusters::GetCoupleTorque(float halfWidth) {
+    float levels[kCount];
+    GetLevels(1.0f, levels);
+    return GetTorque(levels, halfWidth);
+}
+
+float RcsThrusters::GetCoupleFuelRate() {
+    float levels[kCount];
+    GetLevels(1.0f, levels);
+    return GetFuelRate(levels);
+}
+
+float RcsThrusters::CommandForTurn(float degrees, float spin, float angularAccel, float deltaTime) {
+    if (angularAccel <= 0.0f || deltaTime <= 0.0f) {
+        return 0.0f;
+    }
+    const float braking = std::sqrt(2.0f * angularAccel * std::fabs(degrees));
+    const float rate = std::copysign(std::min(std::fabs(degrees) / deltaTime, braking), degrees);
+    return std::min(std::max((rate - spin) / (angularAccel * deltaTime), -1.0f), 1.0f);
+}
@@ -0,0 +1,38 @@
+// RcsThrusters.h
+// Reaction control thrusters: which fire for a command, their torque and their fuel
+
+#pragma once
+
+// Four thrusters on the hull's corners in its x/y plane: the top pair fire
+// down, the bottom pair up. A command runs from -1 to 1, positive turning
+// the lander counter-clockwise about its z axis; it throttles the diagonal
+// couple that turns that way (top left and bottom right for positive),
+// whose forces cancel, so the RCS only ever adds torque. Each thruster
+// burns its own fuel in proportion to its throttle.
+class RcsThrusters {
+public:
+    static constexpr int kCount = 4;
+    static constexpr float kThrust = 2000.0f;       // N per thruster at full throttle
+    static constexpr float kFuelRate = 0.72f;       // kg/s per thruster at full throttle (Isp ~285 s)
+    
+    // Throttle (0 - 1) of each of the kCount thrusters for command
+    static void GetLevels(float command, float* levels);
+    
+    // Counter-clockwise torque (N m) of thrusters at levels on a hull
+    // halfWidth meters either side of its center, and the fuel they burn
+    // (kg/s)
+    static float GetTorque(const float* levels, float halfWidth);
+    static float GetFuelRate(const float* levels);
+    
+    // The command's torque and fuel burn for a whole couple, per unit of
+    // command
+    static float GetCoupleTorque(float halfWidth);
+    static float GetCoupleFuelRate();
+    
+    // Command that brings the spin (deg/s) towards the rate for turning
+    // the lander by degrees: the fastest from which the thrusters'
+    // angularAccel (deg/s^2 at full command) can still stop it at the end,
+    // and no more than the whole turn in the next deltaTime seconds. How
+    // controllers that ask for a turn fly the RCS.
+    static float CommandForTurn(float degrees, float spin, float angularAccel, float deltaTime);
+};
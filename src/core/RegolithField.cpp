@@ -0,0 +1,435 @@
+// RegolithField.cpp
+// Plume erosion, footpad sinkage and slumping on a window of the height grid
+
+#include "RegolithField.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+
+// Loose lunar regolith over a bedrock layer
+static const float kRegolithDepth = 1.0f;           // Erodible depth under the starting surface (m)
+static const float kReposeSlope = 0.7f;             // tan(35 degrees), the angle of repose
+static const float kSlumpRate = 0.5f;               // Share of a slope's excess moved per step
+static const float kSettledChange = 1e-5f;          // Steps moving less than this (m) have settled
+
+// Footpads: bearing capacity rising with depth as the soil compacts
+static const float kBearingPressure = 3000.0f;      // Surface bearing capacity (Pa)
+static const float kBearingModulus = 200000.0f;     // Capacity gained per meter of sinkage (Pa/m)
+static const float kMaxSinkage = 0.2f;              // Never deeper than this (m)
+static const float kSinkRate = 0.1f;                // Fastest a pad sinks (m/s)
+static const float kBulge = 0.5f;                   // Share of the pressed volume pushed up around the pad
+
+// The window moves once the lander is within this share of its edge
+static const float kRecenterMargin = 0.25f;
+
+RegolithField::RegolithField()
+    : mTerrain(nullptr)
+    , mWindowSamples(kDefaultWindowSamples)
+    , mLoaded(false)
+    , mLayoutVersion(0)
+    , mMinX(0)
+    , mMinZ(0)
+    , mSizeX(0)
+    , mSizeZ(0)
+    , mDirtyMinX(0)
+    , mDirtyMinZ(0)
+    , mDirtyMaxX(-1)
+    , mDirtyMaxZ(-1)
+    , mSettling(false)
+    , mRecenterPending(false)
+    , mErodedVolume(0.0f)
+    , mCompactedVolume(0.0f)
+{
+}
+
+void RegolithField::SetWindowSamples(int samples) {
+    mWindowSamples = std::max(8, samples);
+}
+
+void RegolithField::Reset(Terrain* terrain) {
+    mTerrain = terrain;
+    mLoaded = false;
+    mDirtyMaxX = mDirtyMaxZ = -1;
+    mSettling = false;
+    mRecenterPending = false;
+    mErodedVolume = 0.0f;
+    mCompactedVolume = 0.0f;
+}
+
+void RegolithField::Reload() {
+    mLoaded = false;
+    mDirtyMaxX = mDirtyMaxZ = -1;
+    mSettling = false;
+    mRecenterPending = false;
+}
+
+// The samples around the lander, clipped to the grid
+bool RegolithField::LoadWindow(const float* landerPosition) {
+    if (!mTerrain || !mTerrain->HasHeightGrid()) {
+        return false;
+    }
+    
+    const int samplesPerSide = mTerrain->GetGridSize() + 1;
+    mSizeX = mSizeZ = std::min(mWindowSamples, samplesPerSide);
+    int centerX = static_cast<int>(std::lround((landerPosition[0] - mTerrain->GetOriginX()) / mTerrain->GetCellWidth()));
+    int centerZ = static_cast<int>(std::lround((landerPosition[2] - mTerrain->GetOriginZ()) / mTerrain->GetCellLength()));
+    mMinX = std::min(std::max(centerX - mSizeX / 2, 0), samplesPerSide - mSizeX);
+    mMinZ = std::min(std::max(centerZ - mSizeZ / 2, 0), samplesPerSide - mSizeZ);
+    
+    const size_t count = static_cast<size_t>(mSizeX) * mSizeZ;
+    mHeights.resize(count);
+    mBedrock.resize(count);
+    mCompaction.assign(count, 0.0f);
+    mFlux.resize(count);
+    HeightGridRegion region = { mMinX, mMinZ, mMinX + mSizeX - 1, mMinZ + mSizeZ - 1 };
+    mTerrain->GetHeightGrid().Read(region, mHeights.data());
+    for (size_t i = 0; i < count; i++) {
+        mBedrock[i] = mHeights[i] - kRegolithDepth;
+    }
+    
+    mLayoutVersion = mTerrain->GetLayoutVersion();
+    mDirtyMaxX = mDirtyMaxZ = -1;
+    mSettling = false;
+    mRecenterPending = false;
+    mLoaded = true;
+    return true;
+}
+
+bool RegolithField::IsInMiddle(const float* landerPosition) const {
+    const float x = (landerPosition[0] - mTerrain->GetOriginX()) / mTerrain->GetCellWidth() - mMinX;
+    const float z = (landerPosition[2] - mTerrain->GetOriginZ()) / mTerrain->GetCellLength() - mMinZ;
+    const float marginX = kRecenterMargin * mSizeX;
+    const float marginZ = kRecenterMargin * mSizeZ;
+    
+    // A window clipped by the grid's edge can't get any closer to it
+    const int samplesPerSide = mTerrain->GetGridSize() + 1;
+    bool insideX = (x >= marginX || mMinX == 0) && (x <= mSizeX - marginX || mMinX + mSizeX == samplesPerSide);
+    bool insideZ = (z >= marginZ || mMinZ == 0) && (z <= mSizeZ - marginZ || mMinZ + mSizeZ == samplesPerSide);
+    return insideX && insideZ;
+}
+
+void RegolithField::MarkChanged(int x, int z) {
+    if (mDirtyMaxX < mDirtyMinX) {
+        mDirtyMinX = mDirtyMaxX = x;
+        mDirtyMinZ = mDirtyMaxZ = z;
+        return;
+    }
+    mDirtyMinX = std::min(mDirtyMinX, x);
+    mDirtyMaxX = std::max(mDirtyMaxX, x);
+    mDirtyMinZ = std::min(mDirtyMinZ, z);
+    mDirtyMaxZ = std::max(mDirtyMaxZ, z);
+}
+
+void RegolithField::Step(float deltaTime, const float* landerPosition, const RegolithLoad& load) {
+    if (!mTerrain || deltaTime <= 0.0f) return;
+    
+    // A regenerated or moved grid invalidates the window's sample indices
+    if (mLoaded && mTerrain->GetLayoutVersion() != mLayoutVersion) {
+        mLoaded = false;
+    }
+    if (!mLoaded && !LoadWindow(landerPosition)) {
+        return;
+    }
+    PROFILE_ZONE("Regolith");
+    
+    if (!IsInMiddle(landerPosition)) {
+        mRecenterPending = true;
+    }
+    
+    Erode(deltaTime, load);
+    if (Press(deltaTime, load, false) > 0.0f) {
+        mSettling = true;
+    }
+    if (mSettling) {
+        mSettling = Slump();
+    }
+}
+
+float RegolithField::Settle(const float* landerPosition, const RegolithLoad& load) {
+    if (!mTerrain) return 0.0f;
+    if (mLoaded && mTerrain->GetLayoutVersion() != mLayoutVersion) {
+        mLoaded = false;
+    }
+    if (!mLoaded && !LoadWindow(landerPosition)) {
+        return 0.0f;
+    }
+    
+    float sinkage = Press(0.0f, load, true);
+    
+    // Enough passes for a pad's rim to reach its angle of repose
+    for (int pass = 0; pass < 32 && Slump(); pass++) {
+    }
+    mSettling = false;
+    return sinkage;
+}
+
+// Plume erosion under the exhaust's ground point
+void RegolithField::Erode(float deltaTime, const RegolithLoad& load) {
+    if (load.plumePressure <= kCriticalPressure || load.plumeRadius <= 0.0f || load.exhaustDirection[1] > -0.1f) {
+        return;
+    }
+    
+    // Where the exhaust axis meets the ground, from the surface under the nozzle
+    float groundHeight = 0.0f;
+    if (!mTerrain->SampleHeight(load.nozzle[0], load.nozzle[2], groundHeight)) {
+        return;
+    }
+    const float altitude = std::max(load.nozzle[1] - groundHeight, 0.0f);
+    const float t = altitude / -load.exhaustDirection[1];
+    const float hitX = load.nozzle[0] + load.exhaustDirection[0] * t;
+    const float hitZ = load.nozzle[2] + load.exhaustDirection[2] * t;
+    
+    // Gaussian footprint carrying the engine's force normal to the ground
+    const float radius = load.plumeRadius;
+    const float peakPressure = load.plumePressure;
+    
+    const float cellWidth = mTerrain->GetCellWidth();
+    const float cellLength = mTerrain->GetCellLength();
+    const float originX = mTerrain->GetOriginX() + mMinX * cellWidth;
+    const float originZ = mTerrain->GetOriginZ() + mMinZ * cellLength;
+    const float reach = 2.0f * radius;
+    int minX = std::max(0, static_cast<int>(std::floor((hitX - reach - originX) / cellWidth)));
+    int maxX = std::min(mSizeX - 1, static_cast<int>(std::ceil((hitX + reach - originX) / cellWidth)));
+    int minZ = std::max(0, static_cast<int>(std::floor((hitZ - reach - originZ) / cellLength)));
+    int maxZ = std::min(mSizeZ - 1, static_cast<int>(std::ceil((hitZ + reach - originZ) / cellLength)));
+    
+    float eroded = 0.0f;
+    for (int z = minZ; z <= maxZ; z++) {
+        for (int x = minX; x <= maxX; x++) {
+            const float dx = originX + x * cellWidth - hitX;
+            const float dz = originZ + z * cellLength - hitZ;
+            const float pressure = peakPressure * std::exp(-(dx * dx + dz * dz) / (radius * radius));
+            if (pressure <= kCriticalPressure) {
+                continue;
+            }
+            
+            const size_t i = static_cast<size_t>(z) * mSizeX + x;
+            const float depth = std::min(kErosionRate * (pressure - kCriticalPressure) * deltaTime,
+                                         mHeights[i] - mBedrock[i]);
+            if (depth > 0.0f) {
+                mHeights[i] -= depth;
+                eroded += depth;
+                MarkChanged(x, z);
+            }
+        }
+    }
+    if (eroded <= 0.0f) {
+        return;
+    }
+    
+    const float volume = eroded * cellWidth * cellLength;
+    mErodedVolume += volume;
+    Deposit(hitX, hitZ, reach, 1.5f * reach, kRedeposit * volume);
+    mSettling = true;
+}
+
+// Footpad sinkage: each pad moves towards the depth where the compacted
+// soil bears its pressure, at most kSinkRate (toRest: all the way at once).
+// Returns the mean depth the pads sank by this call.
+float RegolithField::Press(float deltaTime, const RegolithLoad& load, bool toRest) {
+    if (load.footpadCount <= 0) {
+        return 0.0f;
+    }
+    
+    const float cellWidth = mTerrain->GetCellWidth();
+    const float cellLength = mTerrain->GetCellLength();
+    const float originX = mTerrain->GetOriginX() + mMinX * cellWidth;
+    const float originZ = mTerrain->GetOriginZ() + mMinZ * cellLength;
+    const float radius = std::max(load.footpadRadius, 0.01f);
+    const float area = static_cast<float>(M_PI) * radius * radius;
+    
+    float totalSinkage = 0.0f;
+    const int count = std::min(load.footpadCount, RegolithLoad::kMaxFootpads);
+    for (int pad = 0; pad < count; pad++) {
+        const float pressure = load.footpadForces[pad] / area;
+        const float restDepth = std::min(kMaxSinkage, (pressure - kBearingPressure) / kBearingModulus);
+        if (restDepth <= 0.0f) {
+            continue;
+        }
+        const float padX = load.footpads[pad][0];
+        const float padZ = load.footpads[pad][2];
+        
+        // The samples under the pad, or the nearest one for a pad smaller
+        // than a cell
+        int minX = std::max(0, static_cast<int>(std::ceil((padX - radius - originX) / cellWidth)));
+        int maxX = std::min(mSizeX - 1, static_cast<int>(std::floor((padX + radius - originX) / cellWidth)));
+        int minZ = std::max(0, static_cast<int>(std::ceil((padZ - radius - originZ) / cellLength)));
+        int maxZ = std::min(mSizeZ - 1, static_cast<int>(std::floor((padZ + radius - originZ) / cellLength)));
+        if (minX > maxX || minZ > maxZ) {
+            minX = maxX = static_cast<int>(std::lround((padX - originX) / cellWidth));
+            minZ = maxZ = static_cast<int>(std::lround((padZ - originZ) / cellLength));
+            if (minX < 0 || minX >= mSizeX || minZ < 0 || minZ >= mSizeZ) {
+                continue;
+            }
+        }
+        
+        float pressed = 0.0f;
+        float padSinkage = 0.0f;
+        int samples = 0;
+        for (int z = minZ; z <= maxZ; z++) {
+            for (int x = minX; x <= maxX; x++) {
+                const size_t i = static_cast<size_t>(z) * mSizeX + x;
+                float depth = restDepth - mCompaction[i];
+                if (!toRest) {
+                    depth = std::min(depth, kSinkRate * deltaTime);
+                }
+                depth = std::min(depth, mHeights[i] - mBedrock[i]);
+                samples++;
+                if (depth <= 0.0f) {
+                    continue;
+                }
+                mHeights[i] -= depth;
+                mCompaction[i] += depth;
+                pressed += depth;
+                padSinkage += depth;
+                MarkChanged(x, z);
+            }
+        }
+        if (pressed <= 0.0f) {
+            continue;
+        }
+        
+        const float volume = pressed * cellWidth * cellLength;
+        mCompactedVolume += volume;
+        totalSinkage += padSinkage / samples;
+        Deposit(padX, padZ, radius + 0.5f * std::max(cellWidth, cellLength), 2.0f * radius + std::max(cellWidth, cellLength),
+                kBulge * volume);
+    }
+    return totalSinkage / count;
+}
+
+// Spread volume evenly over the samples in the ring between the radii
+void RegolithField::Deposit(float centerX, float centerZ, float innerRadius, float outerRadius, float volume) {
+    if (volume <= 0.0f) return;
+    
+    const float cellWidth = mTerrain->GetCellWidth();
+    const float cellLength = mTerrain->GetCellLength();
+    const float originX = mTerrain->GetOriginX() + mMinX * cellWidth;
+    const float originZ = mTerrain->GetOriginZ() + mMinZ * cellLength;
+    int minX = std::max(0, static_cast<int>(std::floor((centerX - outerRadius - originX) / cellWidth)));
+    int maxX = std::min(mSizeX - 1, static_cast<int>(std::ceil((centerX + outerRadius - originX) / cellWidth)));
+    int minZ = std::max(0, static_cast<int>(std::floor((centerZ - outerRadius - originZ) / cellLength)));
+    int maxZ = std::min(mSizeZ - 1, static_cast<int>(std::ceil((centerZ + outerRadius - originZ) / cellLength)));
+    
+    // Count first, then share; a ring entirely off the window loses it
+    auto inRing = [&](int x, int z) {
+        const float dx = originX + x * cellWidth - centerX;
+        const float dz = originZ + z * cellLength - centerZ;
+        const float distance2 = dx * dx + dz * dz;
+        return distance2 >= innerRadius * innerRadius && distance2 <= outerRadius * outerRadius;
+    };
+    int samples = 0;
+    for (int z = minZ; z <= maxZ; z++) {
+        for (int x = minX; x <= maxX; x++) {
+            samples += inRing(x, z) ? 1 : 0;
+        }
+    }
+    if (samples == 0) {
+        return;
+    }
+    
+    const float height = volume / (samples * cellWidth * cellLength);
+    for (int z = minZ; z <= maxZ; z++) {
+        for (int x = minX; x <= maxX; x++) {
+            if (inRing(x, z)) {
+                mHeights[static_cast<size_t>(z) * mSizeX + x] += height;
+                MarkChanged(x, z);
+            }
+        }
+    }
+}
+
+// One slumping pass over the window: every neighbour pair steeper than
+// the angle of repose trades part of its excess downhill. Fluxes are
+// gathered first and applied after, so the pass doesn't depend on the
+// order it visits samples in. Returns false once nothing moved noticeably.
+bool RegolithField::Slump() {
+    const float cellWidth = mTerrain->GetCellWidth();
+    const float cellLength = mTerrain->GetCellLength();
+    const float maxStepX = kReposeSlope * cellWidth;
+    const float maxStepZ = kReposeSlope * cellLength;
+    std::fill(mFlux.begin(), mFlux.end(), 0.0f);
+    
+    // Material leaving a sample can't take it below bedrock
+    auto exchange = [&](size_t a, size_t b, float maxStep) {
+        const float difference = mHeights[a] - mHeights[b];
+        const float excess = std::fabs(difference) - maxStep;
+        if (excess <= 0.0f) {
+            return 0.0f;
+        }
+        const size_t high = difference > 0.0f ? a : b;
+        const size_t low = difference > 0.0f ? b : a;
+        const float moved = std::min(0.25f * kSlumpRate * excess, 0.25f * (mHeights[high] - mBedrock[high]));
+        if (moved <= 0.0f) {
+            return 0.0f;
+        }
+        mFlux[high] -= moved;
+        mFlux[low] += moved;
+        return moved;
+    };
+    
+    float largest = 0.0f;
+    for (int z = 0; z < mSizeZ; z++) {
+        for (int x = 0; x < mSizeX; x++) {
+            const size_t i = static_cast<size_t>(z) * mSizeX + x;
+            if (x + 1 < mSizeX) {
+                largest = std::max(largest, exchange(i, i + 1, maxStepX));
+            }
+            if (z + 1 < mSizeZ) {
+                largest = std::max(largest, exchange(i, i + mSizeX, maxStepZ));
+            }
+        }
+    }
+    if (largest <= 0.0f) {
+        return false;
+    }
+    
+    for (int z = 0; z < mSizeZ; z++) {
+        for (int x = 0; x < mSizeX; x++) {
+            const size_t i = static_cast<size_t>(z) * mSizeX + x;
+            if (mFlux[i] != 0.0f) {
+                mHeights[i] += mFlux[i];
+                MarkChanged(x, z);
+            }
+        }
+    }
+    return largest >= kSettledChange;
+}
+
+void RegolithField::Commit() {
+    if (!mLoaded || !mTerrain) return;
+    
+    // The grid moved under the window since the last step; its samples
+    // are gone with the old layout
+    if (mTerrain->GetLayoutVersion() != mLayoutVersion) {
+        mLoaded = false;
+        return;
+    }
+    
+    if (mDirtyMaxX >= mDirtyMinX) {
+        PROFILE_ZONE("Regolith Commit");
+        const int width = mDirtyMaxX - mDirtyMinX + 1;
+        const int length = mDirtyMaxZ - mDirtyMinZ + 1;
+        mCommitBuffer.resize(static_cast<size_t>(width) * length);
+        for (int z = 0; z < length; z++) {
+            const float* row = mHeights.data() + static_cast<size_t>(mDirtyMinZ + z) * mSizeX + mDirtyMinX;
+            std::copy(row, row + width, mCommitBuffer.data() + static_cast<size_t>(z) * width);
+        }
+        HeightGridRegion region = { mMinX + mDirtyMinX, mMinZ + mDirtyMinZ, mMinX + mDirtyMaxX, mMinZ + mDirtyMaxZ };
+        mTerrain->WriteHeights(region, mCommitBuffer.data());
+        mDirtyMaxX = mDirtyMaxZ = -1;
+        
+        // Writing re-read nothing, so the layout is still the window's
+        mLayoutVersion = mTerrain->GetLayoutVersion();
+    }
+    
+    // Read a fresh window around the lander on the next step; what this
+    // one eroded is in the terrain now
+    if (mRecenterPending) {
+        mLoaded = false;
+        mRecenterPending = false;
+        LOG_DEBUG("Regolith window moves with the lander");
+    }
+}
@@ -0,0 +1,121 @@
+// RegolithField.h
+// Granular regolith on the terrain's height grid around the lander
+
+#pragma once
+
+#include "HeightGrid.h"
+#include <cstdint>
+#include <vector>
+
+class Terrain;
+
+// What the lander does to the ground in one step (meters, newtons)
+struct RegolithLoad {
+    static constexpr int kMaxFootpads = 8;
+    
+    float plumePressure;                // Peak of the plume's footprint (PlumeTable), 0 = none
+    float plumeRadius;                  // Its 1/e radius
+    float nozzle[3];                    // Exhaust exit
+    float exhaustDirection[3];          // Unit, along the exhaust (down when upright)
+    
+    int footpadCount;
+    float footpads[kMaxFootpads][3];    // Where the lander presses on the ground
+    float footpadForces[kMaxFootpads];  // Normal force through each
+    float footpadRadius;
+};
+
+// Height-field granular model over a square window of the terrain's height
+// samples centred under the lander, kept as floats between writes so steps
+// far below the grid's quantization still add up. Each step:
+//   - the plume's pressure, spread over PlumeTable's footprint, erodes the regolith wherever it beats the surface's
+//     cohesion; a fraction lands again in a ring outside the footprint,
+//     the rest leaves as dust
+//   - footpads pressing harder than the bearing capacity sink towards the
+//     depth where the compacted soil holds them, pushing part of what they
+//     displace up around the pad
+//   - slopes steeper than the angle of repose slump downhill until they
+//     settle, so pits keep believable walls
+// Material only goes down to a bedrock layer a fixed depth under the
+// surface the window started from. The model is plain float arithmetic in
+// a fixed order, so it replays bit for bit.
+//
+// Step() only reads the terrain; Commit() writes the changed samples back
+// (normals, pyramid and dirty region with them, which the physics
+// heightfield and the renderer's height data pick up) and moves the window
+// once the lander has left its middle. Call Commit() where nothing else
+// reads the terrain, as terrain streaming is.
+class RegolithField {
+public:
+    static constexpr int kDefaultWindowSamples = 64;
+    
+    // The regolith's response to the plume, which PlumeTable's dust rate
+    // integrates
+    static constexpr float kCriticalPressure = 100.0f;  // Cohesion the plume has to beat (Pa)
+    static constexpr float kErosionRate = 3e-6f;        // Surface recession per pascal over it (m/s)
+    static constexpr float kRedeposit = 0.2f;           // Share of the eroded volume that lands nearby
+    static constexpr float kBulkDensity = 1500.0f;      // Loose regolith (kg/m^3)
+    
+    RegolithField();
+    
+    // Samples per side of the window (takes effect on the next window)
+    void SetWindowSamples(int samples);
+    
+    // Follow terrain (null = none), dropping the window unwritten
+    void Reset(Terrain* terrain);
+    
+    // One fixed step of deltaTime seconds with the lander at landerPosition
+    void Step(float deltaTime, const float* landerPosition, const RegolithLoad& load);
+    
+    // Press the footpads straight to their resting depth and let the slopes
+    // settle, for a lander that has come to rest; returns the mean depth
+    // the footpads sank by
+    float Settle(const float* landerPosition, const RegolithLoad& load);
+    
+    void Commit();
+    
+    // Drop the window, keeping the totals, after something else edited
+    // the grid under it (Commit() first); the next step reads it afresh
+    void Reload();
+    
+    // Totals since Reset (cubic meters)
+    float GetErodedVolume() const { return mErodedVolume; }
+    float GetCompactedVolume() const { return mCompactedVolume; }
+
+private:
+    Terrain* mTerrain;
+    int mWindowSamples;
+    
+    // The window: samples [mMinX, mMinX + mSizeX) x [mMinZ, mMinZ + mSizeZ)
+    // of the grid, row-major, for the grid layout it was read from
+    bool mLoaded;
+    uint32_t mLayoutVersion;
+    int mMinX;
+    int mMinZ;
+    int mSizeX;
+    int mSizeZ;
+    std::vector<float> mHeights;
+    std::vector<float> mBedrock;        // Lowest each sample can erode to
+    std::vector<float> mCompaction;     // Depth each sample was pressed down by
+    std::vector<float> mFlux;           // Slumping scratch
+    std::vector<float> mCommitBuffer;
+    
+    // Samples changed since the last commit (window space, inclusive;
+    // empty while mDirtyMaxX < mDirtyMinX)
+    int mDirtyMinX;
+    int mDirtyMinZ;
+    int mDirtyMaxX;
+    int mDirtyMaxZ;
+    
+    bool mSettling;                     // Slopes may still be over the angle of repose
+    bool mRecenterPending;              // The lander left the window's middle
+    float mErodedVolume;
+    float mCompactedVolume;
+    
+    bool LoadWindow(const float* landerPosition);
+    bool IsInMiddle(const float* landerPosition) const;
+    void MarkChanged(int x, int z);
+    void Erode(float deltaTime, const RegolithLoad& load);
+    float Press(float deltaTime, const RegolithLoad& load, bool toRest);
+    void Deposit(float centerX, float centerZ, float innerRadius, float outerRadius, float volume);
+    bool Slump();
+};
@@ -0,0 +1,49 @@
+// Rules.h
+// Game rules shared by Game and the offline tools: difficulty and score
+
+#pragma once
+
+// Game difficulty levels
+enum class Difficulty {
+    EASY,
+    NORMAL,
+    HARD
+};
+
+class Rules {
+public:
+    // Gravity (m/s²) each difficulty flies under
+    static float GetGravity(Difficulty difficulty) {
+        switch (difficulty) {
+            case Difficulty::EASY:
+                return 1.0f;   // Lower gravity
+            case Difficulty::HARD:
+                return 2.0f;   // Higher gravity
+            case Difficulty::NORMAL:
+            default:
+                return 1.62f;  // Lunar gravity
+        }
+    }
+    
+    static const char* GetName(Difficulty difficulty) {
+        return difficulty == Difficulty::EASY ? "Easy" :
+               difficulty == Difficulty::NORMAL ? "Normal" : "Hard";
+    }
+    
+    // Score for a safe landing: the fraction of fuel left, out of 1000,
+    // times the difficulty of the pad landed on. A crash scores 0.
+    static float GetLandingScore(float fuel, float maxFuel, float padDifficulty = 1.0f) {
+        return maxFuel > 0.0f ? fuel / maxFuel * 1000.0f * padDifficulty : 0.0f;
+    }
+    
+    // Score multiplier for a pad: 1 for a wide, level one, rising to 2 as
+    // its narrow side shrinks to kNarrowPadWidth and its slope (rise over
+    // run) steepens to kSteepPadSlope
+    static constexpr float kNarrowPadWidth = 10.0f;    // Meters
+    static constexpr float kSteepPadSlope = 0.2f;
+    static float GetPadDifficulty(float narrowSide, float slope) {
+        float narrow = narrowSide > kNarrowPadWidth ? kNarrowPadWidth / narrowSide : 1.0f;
+        float steep = slope < kSteepPadSlope ? slope / kSteepPadSlope : 1.0f;
+        return 1.0f + 0.5f * (narrow + steep);
+    }
+};
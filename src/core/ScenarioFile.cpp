@@ -0,0 +1,397 @@
+// ScenarioFile.cpp
+// Scenario file mapping, validation and the text compiler
+
+#include "ScenarioFile.h"
+#include "Log.h"
+#include "Rules.h"
+#include "Units.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// The game's start without a scenario file (Game::Reset): the window's 2D
+// terrain, 20 m up over its middle
+static const int kDefaultWorldWidth = 800;
+static const int kDefaultWorldHeight = 600;
+static const float kDefaultStartHeight = 20.0f;
+
+ScenarioFile::ScenarioFile()
+    : mHeader(nullptr)
+    , mRecords(nullptr)
+    , mMappingSize(0)
+    , mEmptyOffset(0) {
+}
+
+ScenarioFile::~ScenarioFile() {
+    Close();
+}
+
+bool ScenarioFile::Open(const char* filename) {
+    Close();
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        LOG_ERROR("Failed to open scenario file: %s", filename);
+        return false;
+    }
+    struct stat fileInfo;
+    void* mapping = MAP_FAILED;
+    if (fstat(file, &fileInfo) == 0 && static_cast<size_t>(fileInfo.st_size) >= sizeof(ScenarioFileHeader)) {
+        mMappingSize = static_cast<size_t>(fileInfo.st_size);
+        mapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map scenario file: %s", filename);
+        mMappingSize = 0;
+        return false;
+    }
+    
+    // The header, then every record against the string table, once; a
+    // session reads records as they are from here on
+    const char* bytes = static_cast<const char*>(mapping);
+    const ScenarioFileHeader* header = static_cast<const ScenarioFileHeader*>(mapping);
+    const uint64_t recordEnd = uint64_t(header->recordOffset) + uint64_t(header->recordCount) * header->recordSize;
+    const uint64_t stringEnd = uint64_t(header->stringOffset) + header->stringBytes;
+    const char* problem = nullptr;
+    if (std::memcmp(header->magic, kScenarioFileMagic, sizeof(kScenarioFileMagic)) != 0) {
+        problem = "not a scenario file";
+    } else if (header->version != kScenarioFileVersion || header->headerSize != sizeof(ScenarioFileHeader) ||
+               header->recordSize != sizeof(ScenarioRecord)) {
+        problem = "written by a different version";
+    } else if (header->fileSize != mMappingSize || header->recordOffset % alignof(ScenarioRecord) != 0 ||
+               recordEnd > mMappingSize || stringEnd > mMappingSize || header->stringBytes == 0 ||
+               bytes[stringEnd - 1] != '\0') {
+        problem = "truncated or corrupt";
+    }
+    const ScenarioRecord* records = reinterpret_cast<const ScenarioRecord*>(bytes + header->recordOffset);
+    const char* previous = nullptr;
+    for (uint32_t i = 0; !problem && i < header->recordCount; i++) {
+        const ScenarioRecord& record = records[i];
+        const bool named = record.nameOffset > header->stringOffset && record.nameOffset < stringEnd;
+        const bool pathed = record.terrainPathOffset == 0 ||
+                            (record.terrainPathOffset >= header->stringOffset && record.terrainPathOffset < stringEnd);
+        if (!named || !pathed || static_cast<uint32_t>(record.terrain) > static_cast<uint32_t>(ScenarioTerrain::Dem)) {
+            problem = "truncated or corrupt";
+        } else if (previous && std::strcmp(previous, bytes + record.nameOffset) >= 0) {
+            problem = "not sorted by name";
+        }
+        previous = bytes + record.nameOffset;
+    }
+    if (problem) {
+        LOG_ERROR("Ignoring scenario file %s (%s)", filename, problem);
+        munmap(mapping, mMappingSize);
+        mMappingSize = 0;
+        return false;
+    }
+    
+    mHeader = header;
+    mRecords = records;
+    mEmptyOffset = header->stringOffset;
+    LOG_INFO("Mapped %u scenarios from %s", header->recordCount, filename);
+    return true;
+}
+
+void ScenarioFile::Close() {
+    if (!mHeader) {
+        return;
+    }
+    munmap(const_cast<ScenarioFileHeader*>(mHeader), mMappingSize);
+    mHeader = nullptr;
+    mRecords = nullptr;
+    mMappingSize = 0;
+    mEmptyOffset = 0;
+}
+
+const ScenarioRecord* ScenarioFile::Find(const char* name) const {
+    uint32_t low = 0;
+    uint32_t high = GetCount();
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        const int order = std::strcmp(GetName(mRecords[middle]), name);
+        if (order == 0) {
+            return &mRecords[middle];
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return nullptr;
+}
+
+LanderConfig ScenarioFile::GetLanderConfig(const ScenarioRecord& record) {
+    LanderConfig config;
+    config.maxThrustForce = record.lander.maxThrustForce;
+    config.maxFuel = record.lander.maxFuel;
+    config.consumptionRate = record.lander.consumptionRate;
+    config.width = Meters(record.lander.width);
+    config.height = Meters(record.lander.height);
+    config.depth = Meters(record.lander.depth);
+    config.dryMass = Kilograms(record.lander.dryMass);
+    return config;
+}
+
+// A scenario as the compiler builds it up; strings become offsets when the
+// file is laid out
+struct ScenarioSource {
+    ScenarioRecord record;
+    std::string name;
+    std::string terrainPath;
+    bool fullTank;              // fuel follows max-fuel
+    int line;
+};
+
+static ScenarioSource DefaultScenario() {
+    const LanderConfig lander = LanderConfig::Default();
+    ScenarioSource source;
+    std::memset(&source.record, 0, sizeof(source.record));
+    ScenarioRecord& record = source.record;
+    record.terrain = ScenarioTerrain::Generated2D;
+    record.seed = 1;
+    record.worldWidth = kDefaultWorldWidth;
+    record.worldHeight = kDefaultWorldHeight;
+    record.gravity = Rules::GetGravity(Difficulty::NORMAL);
+    record.spawn[1] = kDefaultStartHeight;
+    record.lander.maxThrustForce = lander.maxThrustForce;
+    record.lander.maxFuel = lander.maxFuel;
+    record.lander.consumptionRate = lander.consumptionRate;
+    record.lander.width = lander.width.Value();
+    record.lander.height = lander.height.Value();
+    record.lander.depth = lander.depth.Value();
+    record.lander.dryMass = lander.dryMass.Value();
+    source.fullTank = true;
+    source.line = 0;
+    return source;
+}
+
+// minCount to maxCount numbers and nothing else
+static bool ParseFloats(const std::string& text, float* values, int minCount, int maxCount) {
+    std::istringstream stream(text);
+    int count = 0;
+    while (count < maxCount && stream >> values[count]) {
+        count++;
+    }
+    stream.clear();
+    std::string rest;
+    return count >= minCount && !(stream >> rest);
+}
+
+// One 'key = value' line into source; false for an unknown key or a bad value
+static bool ApplyKey(const std::string& key, const std::string& value, ScenarioSource& source) {
+    ScenarioRecord& record = source.record;
+    float number = 0.0f;
+    if (key == "terrain") {
+        if (value == "2d") {
+            record.terrain = ScenarioTerrain::Generated2D;
+        } else if (value == "3d") {
+            record.terrain = ScenarioTerrain::Generated3D;
+        } else {
+            return false;
+        }
+        source.terrainPath.clear();
+    } else if (key == "dem") {
+        record.terrain = ScenarioTerrain::Dem;
+        source.terrainPath = value;
+        return !value.empty();
+    } else if (key == "seed") {
+        unsigned long seed = 0;
+        char end = 0;
+        if (std::sscanf(value.c_str(), "%lu%c", &seed, &end) != 1 || seed > 0xFFFFFFFFul) {
+            return false;
+        }
+        record.seed = static_cast<uint32_t>(seed);
+    } else if (key == "world") {
+        char end = 0;
+        return std::sscanf(value.c_str(), "%dx%d%c", &record.worldWidth, &record.worldHeight, &end) == 2 &&
+               record.worldWidth > 0 && record.worldHeight > 0 && record.worldWidth <= 65535 &&
+               record.worldHeight <= 65535;
+    } else if (key == "grid") {
+        char end = 0;
+        return std::sscanf(value.c_str(), "%d%c", &record.gridSize, &end) == 1 && record.gridSize >= 0;
+    } else if (key == "difficulty") {
+        if (value == "easy") {
+            record.gravity = Rules::GetGravity(Difficulty::EASY);
+        } else if (value == "normal") {
+            record.gravity = Rules::GetGravity(Difficulty::NORMAL);
+        } else if (value == "hard") {
+            record.gravity = Rules::GetGravity(Difficulty::HARD);
+        } else {
+            return false;
+        }
+    } else if (key == "position" || key == "velocity") {
+        float vector[3] = { 0.0f, 0.0f, 0.0f };
+        if (!ParseFloats(value, vector, 2, 3)) {
+            return false;
+        }
+        std::memcpy(key == "position" ? record.spawn : record.velocity, vector, sizeof(vector));
+    } else if (key == "size") {
+        float size[3];
+        if (!ParseFloats(value, size, 3, 3) || size[0] <= 0.0f || size[1] <= 0.0f || size[2] <= 0.0f) {
+            return false;
+        }
+        record.lander.width = size[0];
+        record.lander.height = size[1];
+        record.lander.depth = size[2];
+    } else if (!ParseFloats(value, &number, 1, 1)) {
+        return false;
+    } else if (key == "gravity") {
+        record.gravity = number;
+    } else if (key == "fuel") {
+        record.fuel = number;
+        source.fullTank = false;
+        return number >= 0.0f;
+    } else if (key == "max-fuel") {
+        record.lander.maxFuel = number;
+        return number >= 0.0f;
+    } else if (key == "fuel-rate") {
+        record.lander.consumptionRate = number;
+        return number >= 0.0f;
+    } else if (key == "thrust") {
+        record.lander.maxThrustForce = number;
+        return number >= 0.0f;
+    } else if (key == "dry-mass") {
+        record.lander.dryMass = number;
+        return number > 0.0f;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static std::string Trim(const std::string& text) {
+    const size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool ScenarioFile::Compile(const char* textFilename, const char* filename, ScenarioCompileStats& stats) {
+    std::ifstream text(textFilename);
+    if (!text) {
+        LOG_ERROR("Failed to open scenario text: %s", textFilename);
+        return false;
+    }
+    
+    // Keys before the first section go to the defaults
+    ScenarioSource defaults = DefaultScenario();
+    std::vector<ScenarioSource> scenarios;
+    ScenarioSource* current = &defaults;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(text, line)) {
+        lineNumber++;
+        line = Trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        
+        if (line[0] == '[') {
+            const std::string name = Trim(line.substr(1, line.size() - 2));
+            if (line.back() != ']' || name.empty()) {
+                LOG_ERROR("%s:%d: expected '[name]'", textFilename, lineNumber);
+                return false;
+            }
+            scenarios.push_back(defaults);
+            current = &scenarios.back();
+            current->name = name;
+            current->line = lineNumber;
+            continue;
+        }
+        
+        const size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            LOG_ERROR("%s:%d: expected 'key = value'", textFilename, lineNumber);
+            return false;
+        }
+        const std::string key = Trim(line.substr(0, equals));
+        const std::string value = Trim(line.substr(equals + 1));
+        if (!ApplyKey(key, value, *current)) {
+            LOG_ERROR("%s:%d: bad '%s' value '%s' (or unknown key)", textFilename, lineNumber, key.c_str(),
+                      value.c_str());
+            return false;
+        }
+    }
+    if (scenarios.empty()) {
+        LOG_ERROR("%s has no [name] sections", textFilename);
+        return false;
+    }
+    
+    // Sorted for Find; names must be unique for it to find them
+    std::sort(scenarios.begin(), scenarios.end(),
+              [](const ScenarioSource& a, const ScenarioSource& b) { return a.name < b.name; });
+    for (size_t i = 1; i < scenarios.size(); i++) {
+        if (scenarios[i].name == scenarios[i - 1].name) {
+            LOG_ERROR("%s:%d: scenario '%s' is already defined on line %d", textFilename,
+                      std::max(scenarios[i].line, scenarios[i - 1].line), scenarios[i].name.c_str(),
+                      std::min(scenarios[i].line, scenarios[i - 1].line));
+            return false;
+        }
+    }
+    
+    // Strings after the records, the table opening with the empty one
+    ScenarioFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kScenarioFileMagic, sizeof(header.magic));
+    header.version = kScenarioFileVersion;
+    header.headerSize = sizeof(ScenarioFileHeader);
+    header.recordSize = sizeof(ScenarioRecord);
+    header.recordCount = static_cast<uint32_t>(scenarios.size());
+    header.recordOffset = sizeof(ScenarioFileHeader);
+    const uint64_t stringOffset = header.recordOffset + uint64_t(scenarios.size()) * sizeof(ScenarioRecord);
+    std::string strings(1, '\0');
+    auto addString = [&](const std::string& value) -> uint64_t {
+        if (value.empty()) {
+            return 0;
+        }
+        const uint64_t offset = stringOffset + strings.size();
+        strings.append(value.c_str(), value.size() + 1);
+        return offset;
+    };
+    std::vector<ScenarioRecord> records;
+    records.reserve(scenarios.size());
+    for (const ScenarioSource& scenario : scenarios) {
+        ScenarioRecord record = scenario.record;
+        uint64_t nameOffset = addString(scenario.name);
+        uint64_t pathOffset = addString(scenario.terrainPath);
+        if (stringOffset + strings.size() > 0xFFFFFFFFull) {
+            LOG_ERROR("%s: scenarios are over 4 GB", textFilename);
+            return false;
+        }
+        record.nameOffset = static_cast<uint32_t>(nameOffset);
+        record.terrainPathOffset = static_cast<uint32_t>(pathOffset);
+        record.fuel = scenario.fullTank ? record.lander.maxFuel : std::min(record.fuel, record.lander.maxFuel);
+        records.push_back(record);
+    }
+    header.stringOffset = static_cast<uint32_t>(stringOffset);
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+    header.fileSize = stringOffset + strings.size();
+    
+    FILE* file = std::fopen(filename, "wb");
+    if (!file) {
+        LOG_ERROR("Failed to create scenario file: %s", filename);
+        return false;
+    }
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   std::fwrite(records.data(), sizeof(ScenarioRecord), records.size(), file) == records.size() &&
+                   std::fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written) {
+        LOG_ERROR("Failed to write scenario file: %s", filename);
+        std::remove(filename);
+        return false;
+    }
+    
+    stats.scenarioCount = header.recordCount;
+    stats.fileBytes = header.fileSize;
+    return true;
+}
@@ -0,0 +1,139 @@
+// ScenarioFile.h
+// Compiled scenario table, mapped read-only and read in place
+
+#pragma once
+
+#include "EntityStore.h"
+#include <cstddef>
+#include <cstdint>
+
+// Layout, version 1 (little-endian, as the host):
+//
+//   offset 0              ScenarioFileHeader (40 bytes)
+//   recordOffset          recordCount x ScenarioRecord (128 bytes each),
+//                         sorted by name
+//   stringOffset          stringBytes of NUL-terminated strings
+//
+// Every field is 4-byte aligned at a fixed offset, so a record is used
+// straight out of the mapping: no parsing, no copies and no allocation.
+// Strings are offsets from the start of the file into the string table (0
+// = none). Open checks the header and every record's offsets once; after
+// that the accessors never need to.
+//
+// scenario_pack compiles the text variant (see ScenarioFile::Compile) to
+// this.
+static const char kScenarioFileMagic[4] = { 'L', 'S', 'C', 'N' };
+static const uint32_t kScenarioFileVersion = 1;
+
+enum class ScenarioTerrain : uint32_t {
+    Generated2D = 0,        // 2D terrain from the seed, worldWidth x worldHeight pixels
+    Generated3D = 1,        // 3D terrain from the seed, gridSize cells a side
+    Dem = 2                 // 3D terrain from the DEM or terrain pack at terrainPath
+};
+
+struct ScenarioFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;        // sizeof(ScenarioFileHeader)
+    uint32_t recordSize;        // sizeof(ScenarioRecord)
+    uint32_t recordCount;
+    uint32_t recordOffset;
+    uint32_t stringOffset;
+    uint32_t stringBytes;       // Ends in a NUL
+    uint64_t fileSize;
+};
+
+// The lander as LanderConfig has it, in plain SI floats
+struct ScenarioLander {
+    float maxThrustForce;       // Newtons
+    float maxFuel;              // kg
+    float consumptionRate;      // kg/s at full thrust
+    float width;                // Meters
+    float height;
+    float depth;
+    float dryMass;              // kg
+};
+
+// One flight's start. The spawn point is relative to where the game starts
+// a lander: x and z from the middle of the terrain (in 2D, of the window's
+// width of it) and y above the terrain's zero height.
+struct ScenarioRecord {
+    uint32_t nameOffset;
+    uint32_t terrainPathOffset; // ScenarioTerrain::Dem only
+    ScenarioTerrain terrain;
+    uint32_t seed;
+    int32_t worldWidth;         // 2D terrain size (pixels)
+    int32_t worldHeight;
+    int32_t gridSize;           // Generated 3D cells a side (0 = the game's default)
+    float gravity;              // m/s²
+    float spawn[3];             // Meters, as above
+    float velocity[3];          // m/s
+    float fuel;                 // kg at the start (at most lander.maxFuel)
+    ScenarioLander lander;
+    uint32_t reserved[10];
+};
+
+static_assert(sizeof(ScenarioFileHeader) == 40, "ScenarioFileHeader layout is part of the scenario format");
+static_assert(sizeof(ScenarioRecord) == 128, "ScenarioRecord layout is part of the scenario format");
+
+// What Compile did, for the tool's report
+struct ScenarioCompileStats {
+    uint32_t scenarioCount;
+    uint64_t fileBytes;
+};
+
+class ScenarioFile {
+public:
+    ScenarioFile();
+    ~ScenarioFile();
+    
+    ScenarioFile(const ScenarioFile&) = delete;
+    ScenarioFile& operator=(const ScenarioFile&) = delete;
+    
+    // Map a compiled file; false (and logged) if it is missing or corrupt
+    bool Open(const char* filename);
+    void Close();
+    bool IsOpen() const { return mHeader != nullptr; }
+    
+    uint32_t GetCount() const { return mHeader ? mHeader->recordCount : 0; }
+    const ScenarioRecord& Get(uint32_t index) const { return mRecords[index]; }
+    
+    // Binary search by name; null if there is none
+    const ScenarioRecord* Find(const char* name) const;
+    
+    const char* GetName(const ScenarioRecord& record) const { return GetString(record.nameOffset); }
+    const char* GetTerrainPath(const ScenarioRecord& record) const { return GetString(record.terrainPathOffset); }
+    static LanderConfig GetLanderConfig(const ScenarioRecord& record);
+    
+    // Compile the text variant at textFilename into a scenario file.
+    //
+    // One [name] section per scenario, each a list of 'key = value' lines;
+    // '#' starts a comment. Keys before the first section set the defaults
+    // every section starts from, and anything never set is the game's own
+    // start: normal gravity, generated 2D terrain of seed 1 at 800x600, 20 m
+    // up over the middle, at rest, with LanderConfig::Default() full.
+    //
+    //   terrain = 2d | 3d          Generated terrain (see ScenarioTerrain)
+    //   dem = <path>               DEM or terrain pack terrain
+    //   seed = <n>
+    //   world = <width>x<height>   2D terrain size (pixels)
+    //   grid = <cells>             Generated 3D cells a side
+    //   difficulty = easy | normal | hard    Gravity of the Rules preset
+    //   gravity = <m/s²>
+    //   position = <x> <y> [<z>]   Spawn point (meters, as ScenarioRecord)
+    //   velocity = <x> <y> [<z>]   m/s
+    //   fuel = <kg>                Starting fuel (default: a full tank)
+    //   max-fuel, fuel-rate, thrust, dry-mass = <value>   ScenarioLander
+    //   size = <width> <height> <depth>    Lander size (meters)
+    static bool Compile(const char* textFilename, const char* filename, ScenarioCompileStats& stats);
+
+private:
+    const char* GetString(uint32_t offset) const {
+        return reinterpret_cast<const char*>(mHeader) + (offset != 0 ? offset : mEmptyOffset);
+    }
+    
+    const ScenarioFileHeader* mHeader;
+    const ScenarioRecord* mRecords;
+    size_t mMappingSize;
+    uint32_t mEmptyOffset;      // The string table's leading NUL, for offset 0
+};
@@ -0,0 +1,313 @@
+// SimdMath.h
+// 4x4 matrix and quaternion math for the renderer (SSE2/NEON with scalar fallback)
+
+#pragma once
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_MATH_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD_MATH_NEON 1
+#endif
+
+// Column-major 4x4 matrix laid out like Metal's float4x4 (values[column * 4 + row]),
+// so it can be copied straight into shader uniforms
+struct alignas(16) Matrix4x4 {
+    float values[16];
+};
+
+// Unit rotation quaternion; w is the scalar part
+struct alignas(16) Quaternion {
+    float x, y, z, w;
+};
+
+// Right-handed conventions throughout; angles in radians unless the name
+// says degrees
+class SimdMath {
+public:
+    static Matrix4x4 Identity();
+    static Matrix4x4 Scale(float x, float y, float z);
+    static Matrix4x4 Rotation(const Quaternion& q);
+    
+    // a * b, so the result applies b first
+    static Matrix4x4 Multiply(const Matrix4x4& a, const Matrix4x4& b);
+    
+    // View matrix looking from eye towards target
+    static Matrix4x4 LookAt(const float* eye, const float* target, const float* up);
+    
+    // Perspective projection onto Metal's clip space (0 <= z <= w)
+    static Matrix4x4 Perspective(float fovY, float aspect, float nearZ, float farZ);
+    
+    // Orthographic projection of the view-space box [left, right] x
+    // [bottom, top] x [-nearZ, -farZ] onto Metal's clip space
+    static Matrix4x4 Orthographic(float left, float right, float bottom, float top, float nearZ, float farZ);
+    
+    // Inverse of a matrix whose last row is (0, 0, 0, 1), e.g. a model
+    // matrix (scale, rotation, translation); the identity if it is singular
+    static Matrix4x4 InverseAffine(const Matrix4x4& m);
+    
+    // Point (w = 1) through a matrix
+    static void TransformPoint(const Matrix4x4& m, const float* point, float* out);
+    
+    static Quaternion QuaternionFromAxisAngle(float axisX, float axisY, float axisZ, float angle);
+    
+    // a * b, so the result rotates by b first
+    static Quaternion QuaternionMultiply(const Quaternion& a, const Quaternion& b);
+    
+    // Rotation about z, then x, then y, matching the model matrices'
+    // Euler angle order (Ry * Rx * Rz)
+    static Quaternion QuaternionFromEulerDegrees(float x, float y, float z);
+    
+    // Inverse of QuaternionFromEulerDegrees: x in [-90, 90], y and z in
+    // (-180, 180]. At x = +-90 degrees z is folded into y.
+    static void EulerDegreesFromQuaternion(const Quaternion& q, float* degrees);
+    
+    // Normalized lerp along the shorter arc; close to slerp for the small
+    // steps between fixed updates, without its trig
+    static Quaternion QuaternionNlerp(const Quaternion& a, const Quaternion& b, float t);
+};
+
+/*
+ * Implementation (inline: these run per draw and per instance)
+ */
+
+inline Matrix4x4 SimdMath::Identity() {
+    return Scale(1.0f, 1.0f, 1.0f);
+}
+
+inline Matrix4x4 SimdMath::Scale(float x, float y, float z) {
+    Matrix4x4 result = {{
+        x,    0.0f, 0.0f, 0.0f,
+        0.0f, y,    0.0f, 0.0f,
+        0.0f, 0.0f, z,    0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    }};
+    return result;
+}
+
+inline Matrix4x4 SimdMath::Rotation(const Quaternion& q) {
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    Matrix4x4 result = {{
+        1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz),        2.0f * (xz - wy),        0.0f,
+        2.0f * (xy - wz),        1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx),        0.0f,
+        2.0f * (xz + wy),        2.0f * (yz - wx),        1.0f - 2.0f * (xx + yy), 0.0f,
+        0.0f,                    0.0f,                    0.0f,                    1.0f
+    }};
+    return result;
+}
+
+inline Matrix4x4 SimdMath::Multiply(const Matrix4x4& a, const Matrix4x4& b) {
+    // Each result column is a's columns weighted by the matching column of b
+    Matrix4x4 result;
+#if defined(SIMD_MATH_SSE2)
+    const __m128 a0 = _mm_load_ps(a.values);
+    const __m128 a1 = _mm_load_ps(a.values + 4);
+    const __m128 a2 = _mm_load_ps(a.values + 8);
+    const __m128 a3 = _mm_load_ps(a.values + 12);
+    for (int column = 0; column < 4; column++) {
+        const float* weights = b.values + column * 4;
+        __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(weights[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(weights[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(weights[2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(weights[3])));
+        _mm_store_ps(result.values + column * 4, sum);
+    }
+#elif defined(SIMD_MATH_NEON)
+    const float32x4_t a0 = vld1q_f32(a.values);
+    const float32x4_t a1 = vld1q_f32(a.values + 4);
+    const float32x4_t a2 = vld1q_f32(a.values + 8);
+    const float32x4_t a3 = vld1q_f32(a.values + 12);
+    for (int column = 0; column < 4; column++) {
+        const float32x4_t weights = vld1q_f32(b.values + column * 4);
+        float32x4_t sum = vmulq_laneq_f32(a0, weights, 0);
+        sum = vfmaq_laneq_f32(sum, a1, weights, 1);
+        sum = vfmaq_laneq_f32(sum, a2, weights, 2);
+        sum = vfmaq_laneq_f32(sum, a3, weights, 3);
+        vst1q_f32(result.values + column * 4, sum);
+    }
+#else
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a.values[k * 4 + row] * b.values[column * 4 + k];
+            }
+            result.values[column * 4 + row] = sum;
+        }
+    }
+#endif
+    return result;
+}
+
+inline Matrix4x4 SimdMath::LookAt(const float* eye, const float* target, const float* up) {
+    // Forward, right and the re-orthogonalized up direction
+    float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+    float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+    forward[0] /= length;
+    forward[1] /= length;
+    forward[2] /= length;
+    
+    float right[3] = {
+        forward[1] * up[2] - forward[2] * up[1],
+        forward[2] * up[0] - forward[0] * up[2],
+        forward[0] * up[1] - forward[1] * up[0]
+    };
+    length = std::sqrt(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+    right[0] /= length;
+    right[1] /= length;
+    right[2] /= length;
+    
+    const float cameraUp[3] = {
+        right[1] * forward[2] - right[2] * forward[1],
+        right[2] * forward[0] - right[0] * forward[2],
+        right[0] * forward[1] - right[1] * forward[0]
+    };
+    
+    // Rows are the camera axes (looking down -z), then the eye moves to the origin
+    Matrix4x4 result = {{
+        right[0], cameraUp[0], -forward[0], 0.0f,
+        right[1], cameraUp[1], -forward[1], 0.0f,
+        right[2], cameraUp[2], -forward[2], 0.0f,
+        -(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]),
+        -(cameraUp[0] * eye[0] + cameraUp[1] * eye[1] + cameraUp[2] * eye[2]),
+        forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2],
+        1.0f
+    }};
+    return result;
+}
+
+inline Matrix4x4 SimdMath::Perspective(float fovY, float aspect, float nearZ, float farZ) {
+    const float f = 1.0f / std::tan(fovY / 2.0f);
+    Matrix4x4 result = {{
+        f / aspect, 0.0f, 0.0f,                            0.0f,
+        0.0f,       f,    0.0f,                            0.0f,
+        0.0f,       0.0f, farZ / (nearZ - farZ),           -1.0f,
+        0.0f,       0.0f, (nearZ * farZ) / (nearZ - farZ), 0.0f
+    }};
+    return result;
+}
+
+inline Matrix4x4 SimdMath::Orthographic(float left, float right, float bottom, float top, float nearZ, float farZ) {
+    Matrix4x4 result = {{
+        2.0f / (right - left),            0.0f,                             0.0f,                    0.0f,
+        0.0f,                             2.0f / (top - bottom),            0.0f,                    0.0f,
+        0.0f,                             0.0f,                             1.0f / (nearZ - farZ),   0.0f,
+        (left + right) / (left - right),  (bottom + top) / (bottom - top),  nearZ / (nearZ - farZ),  1.0f
+    }};
+    return result;
+}
+
+inline Matrix4x4 SimdMath::InverseAffine(const Matrix4x4& m) {
+    const float* v = m.values;
+    
+    // Inverse of the upper 3x3: its adjugate over the determinant
+    const float c00 = v[5] * v[10] - v[9] * v[6];
+    const float c01 = v[9] * v[2] - v[1] * v[10];
+    const float c02 = v[1] * v[6] - v[5] * v[2];
+    const float determinant = v[0] * c00 + v[4] * c01 + v[8] * c02;
+    if (std::fabs(determinant) < 1e-12f) {
+        return Identity();
+    }
+    const float inverseDeterminant = 1.0f / determinant;
+    
+    Matrix4x4 result;
+    float* r = result.values;
+    r[0] = c00 * inverseDeterminant;
+    r[1] = c01 * inverseDeterminant;
+    r[2] = c02 * inverseDeterminant;
+    r[3] = 0.0f;
+    r[4] = (v[8] * v[6] - v[4] * v[10]) * inverseDeterminant;
+    r[5] = (v[0] * v[10] - v[8] * v[2]) * inverseDeterminant;
+    r[6] = (v[4] * v[2] - v[0] * v[6]) * inverseDeterminant;
+    r[7] = 0.0f;
+    r[8] = (v[4] * v[9] - v[8] * v[5]) * inverseDeterminant;
+    r[9] = (v[8] * v[1] - v[0] * v[9]) * inverseDeterminant;
+    r[10] = (v[0] * v[5] - v[4] * v[1]) * inverseDeterminant;
+    r[11] = 0.0f;
+    
+    // The translation moves back through the inverted 3x3
+    for (int row = 0; row < 3; row++) {
+        r[12 + row] = -(r[row] * v[12] + r[4 + row] * v[13] + r[8 + row] * v[14]);
+    }
+    r[15] = 1.0f;
+    return result;
+}
+
+inline void SimdMath::TransformPoint(const Matrix4x4& m, const float* point, float* out) {
+    for (int row = 0; row < 4; row++) {
+        out[row] = m.values[row] * point[0] + m.values[4 + row] * point[1] +
+                   m.values[8 + row] * point[2] + m.values[12 + row];
+    }
+}
+
+inline Quaternion SimdMath::QuaternionFromAxisAngle(float axisX, float axisY, float axisZ, float angle) {
+    const float s = std::sin(0.5f * angle);
+    Quaternion result = { axisX * s, axisY * s, axisZ * s, std::cos(0.5f * angle) };
+    return result;
+}
+
+inline Quaternion SimdMath::QuaternionMultiply(const Quaternion& a, const Quaternion& b) {
+    Quaternion result = {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+    return result;
+}
+
+inline Quaternion SimdMath::QuaternionFromEulerDegrees(float x, float y, float z) {
+    const float degreesToRadians = 3.14159265358979323846f / 180.0f;
+    const Quaternion rotationX = QuaternionFromAxisAngle(1.0f, 0.0f, 0.0f, x * degreesToRadians);
+    const Quaternion rotationY = QuaternionFromAxisAngle(0.0f, 1.0f, 0.0f, y * degreesToRadians);
+    const Quaternion rotationZ = QuaternionFromAxisAngle(0.0f, 0.0f, 1.0f, z * degreesToRadians);
+    return QuaternionMultiply(rotationY, QuaternionMultiply(rotationX, rotationZ));
+}
+
+inline void SimdMath::EulerDegreesFromQuaternion(const Quaternion& q, float* degrees) {
+    // Entries of R = Ry * Rx * Rz (row, column): sin(x) = -R12,
+    // tan(y) = R02 / R22, tan(z) = R10 / R11
+    const float radiansToDegrees = 180.0f / 3.14159265358979323846f;
+    const float r00 = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+    const float r02 = 2.0f * (q.x * q.z + q.w * q.y);
+    const float r10 = 2.0f * (q.x * q.y + q.w * q.z);
+    const float r11 = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+    const float r12 = 2.0f * (q.y * q.z - q.w * q.x);
+    const float r20 = 2.0f * (q.x * q.z - q.w * q.y);
+    const float r22 = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+    
+    const float sinX = std::fmax(-1.0f, std::fmin(1.0f, -r12));
+    degrees[0] = std::asin(sinX) * radiansToDegrees;
+    if (std::fabs(sinX) < 0.9999f) {
+        degrees[1] = std::atan2(r02, r22) * radiansToDegrees;
+        degrees[2] = std::atan2(r10, r11) * radiansToDegrees;
+    } else {
+        // Gimbal lock: only y + z (or y - z) is defined
+        degrees[1] = std::atan2(-r20, r00) * radiansToDegrees;
+        degrees[2] = 0.0f;
+    }
+}
+
+inline Quaternion SimdMath::QuaternionNlerp(const Quaternion& a, const Quaternion& b, float t) {
+    const float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    const float sign = dot < 0.0f ? -1.0f : 1.0f;
+    Quaternion result = {
+        a.x + (sign * b.x - a.x) * t,
+        a.y + (sign * b.y - a.y) * t,
+        a.z + (sign * b.z - a.z) * t,
+        a.w + (sign * b.w - a.w) * t
+    };
+    const float length = std::sqrt(result.x * result.x + result.y * result.y +
+                                   result.z * result.z + result.w * result.w);
+    const float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+    result.x *= inverse;
+    result.y *= inverse;
+    result.z *= inverse;
+    result.w *= inverse;
+    return result;
+}
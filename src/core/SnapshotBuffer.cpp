@@ -0,0 +1,172 @@
+// SnapshotBuffer.cpp
+// Implementation of the snapshot ring buffer
+
+#include "SnapshotBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(SimulationSnapshot) % 4 == 0, "SimulationSnapshot must be whole 32-bit words");
+
+// A delta starts with one nibble per word: how many low bytes of the word's
+// XOR with the keyframe follow (0-4)
+static const int kDeltaHeaderBytes = (SnapshotBuffer::kWords + 1) / 2;
+
+SnapshotBuffer::SnapshotBuffer()
+    : mStepInterval(1)
+    , mKeyframeInterval(1)
+    , mOldestGroup(0)
+    , mGroupCount(0)
+{
+}
+
+void SnapshotBuffer::Configure(uint32_t stepInterval, int keyframeInterval, size_t minSnapshots) {
+    mStepInterval = std::max(stepInterval, 1u);
+    mKeyframeInterval = std::max(keyframeInterval, 1);
+    
+    // One group more than minSnapshots needs, since the oldest group is
+    // evicted whole
+    size_t groups = (minSnapshots + mKeyframeInterval - 1) / mKeyframeInterval + 1;
+    mGroups.resize(groups);
+    for (Group& group : mGroups) {
+        group.deltas.reserve(static_cast<size_t>(mKeyframeInterval - 1) * (kDeltaHeaderBytes + kWords * 4));
+        group.offsets.reserve(mKeyframeInterval - 1);
+    }
+    Clear();
+}
+
+void SnapshotBuffer::Clear() {
+    mOldestGroup = 0;
+    mGroupCount = 0;
+}
+
+void SnapshotBuffer::Push(uint64_t step, const SimulationSnapshot& snapshot) {
+    if (mGroups.empty()) {
+        return;
+    }
+    uint32_t words[kWords];
+    std::memcpy(words, &snapshot, sizeof(words));
+    
+    if (mGroupCount > 0 && step != GetNewestStep() + mStepInterval) {
+        Clear();
+    }
+    
+    // Into the newest group's deltas while it has room
+    if (mGroupCount > 0) {
+        Group& newest = GroupAt(mGroupCount - 1);
+        if (newest.count < mKeyframeInterval) {
+            newest.offsets.push_back(static_cast<uint32_t>(newest.deltas.size()));
+            EncodeDelta(newest.keyframe, words, newest.deltas);
+            newest.count++;
+            return;
+        }
+    }
+    
+    // Otherwise a new keyframe, in place of the oldest group if all are used
+    if (mGroupCount == mGroups.size()) {
+        mOldestGroup = (mOldestGroup + 1) % mGroups.size();
+        mGroupCount--;
+    }
+    Group& group = GroupAt(mGroupCount);
+    mGroupCount++;
+    group.firstStep = step;
+    std::memcpy(group.keyframe, words, sizeof(words));
+    group.deltas.clear();
+    group.offsets.clear();
+    group.count = 1;
+}
+
+bool SnapshotBuffer::Restore(uint64_t step, SimulationSnapshot& snapshot, uint64_t& snapshotStep) const {
+    if (IsEmpty()) {
+        return false;
+    }
+    
+    // Groups are contiguous and all but the newest full, so the snapshot's
+    // position follows from the step alone
+    const uint64_t oldest = GetOldestStep();
+    step = std::min(std::max(step, oldest), GetNewestStep());
+    const uint64_t index = (step - oldest) / mStepInterval;
+    const Group& group = GroupAt(static_cast<size_t>(index / mKeyframeInterval));
+    const int slot = static_cast<int>(index % mKeyframeInterval);
+    
+    uint32_t words[kWords];
+    if (slot == 0) {
+        std::memcpy(words, group.keyframe, sizeof(words));
+    } else {
+        DecodeDelta(group.keyframe, group.deltas.data() + group.offsets[slot - 1], words);
+    }
+    std::memcpy(&snapshot, words, sizeof(words));
+    snapshotStep = group.firstStep + static_cast<uint64_t>(slot) * mStepInterval;
+    return true;
+}
+
+void SnapshotBuffer::Truncate(uint64_t step) {
+    if (IsEmpty() || step >= GetNewestStep()) {
+        return;
+    }
+    if (step < GetOldestStep()) {
+        Clear();
+        return;
+    }
+    
+    const uint64_t index = (step - GetOldestStep()) / mStepInterval;
+    mGroupCount = static_cast<size_t>(index / mKeyframeInterval) + 1;
+    Group& group = GroupAt(mGroupCount - 1);
+    const int keep = static_cast<int>(index % mKeyframeInterval) + 1;
+    if (keep < group.count) {
+        group.deltas.resize(group.offsets[keep - 1]);
+        group.offsets.resize(keep - 1);
+        group.count = keep;
+    }
+}
+
+uint64_t SnapshotBuffer::GetOldestStep() const {
+    return IsEmpty() ? 0 : GroupAt(0).firstStep;
+}
+
+uint64_t SnapshotBuffer::GetNewestStep() const {
+    if (IsEmpty()) {
+        return 0;
+    }
+    const Group& newest = GroupAt(mGroupCount - 1);
+    return newest.firstStep + static_cast<uint64_t>(newest.count - 1) * mStepInterval;
+}
+
+size_t SnapshotBuffer::GetCount() const {
+    return IsEmpty() ? 0 : (mGroupCount - 1) * mKeyframeInterval + GroupAt(mGroupCount - 1).count;
+}
+
+size_t SnapshotBuffer::GetEncodedBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < mGroupCount; i++) {
+        bytes += sizeof(Group::keyframe) + GroupAt(i).deltas.size();
+    }
+    return bytes;
+}
+
+void SnapshotBuffer::EncodeDelta(const uint32_t* keyframe, const uint32_t* words, std::vector<uint8_t>& out) {
+    const size_t header = out.size();
+    out.resize(header + kDeltaHeaderBytes, 0);
+    for (int i = 0; i < kWords; i++) {
+        uint32_t delta = words[i] ^ keyframe[i];
+        uint8_t length = 0;
+        while (length < 4 && (delta >> (8 * length)) != 0) {
+            length++;
+        }
+        out[header + i / 2] |= static_cast<uint8_t>(length << (4 * (i % 2)));
+        for (int b = 0; b < length; b++) {
+            out.push_back(static_cast<uint8_t>(delta >> (8 * b)));
+        }
+    }
+}
+
+void SnapshotBuffer::DecodeDelta(const uint32_t* keyframe, const uint8_t* in, uint32_t* words) {
+    const uint8_t* bytes = in + kDeltaHeaderBytes;
+    for (int i = 0; i < kWords; i++) {
+        int length = (in[i / 2] >> (4 * (i % 2))) & 0xF;
+        uint32_t delta = 0;
+        for (int b = 0; b < length; b++) {
+            delta |= static_cast<uint32_t>(*bytes++) << (8 * b);
+        }
+        words[i] = keyframe[i] ^ delta;
+    }
+}
@@ -0,0 +1,94 @@
+// SnapshotBuffer.h
+// Ring buffer of delta-encoded simulation snapshots for rewinding
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Everything a rewind puts back: the lander, the Bullet body state the
+// lander doesn't mirror, and the flight's game state. All fields are 32
+// bits wide so the buffer can encode it word by word.
+struct SimulationSnapshot {
+    float position[3];          // Meters
+    float velocity[3];          // m/s
+    float orientation[4];       // Quaternion x, y, z, w
+    float angularVelocity[3];   // Lander rigid body, or the 2D spin about z (rad/s)
+    float fuel;
+    float thrustLevel;
+    uint32_t flags;             // kSnapshot* bits
+    uint32_t gameState;
+    float elapsedTime;
+    float fuelUsed;
+    float score;
+    int32_t originCells[2];     // Terrain::GetOriginShiftX/Z() position is relative to
+};
+
+enum : uint32_t {
+    kSnapshotThrustActive = 1u << 0,
+    kSnapshotLanded = 1u << 1,
+    kSnapshotCrashed = 1u << 2,
+    kSnapshotActive = 1u << 3
+};
+
+// Snapshots taken every stepInterval steps, grouped behind a keyframe every
+// keyframeInterval snapshots. The rest are stored as the XOR of each word
+// with the group's keyframe, dropping the XOR's zero high bytes: a value
+// that moved a little shares its sign, exponent and high mantissa with the
+// keyframe, so most words take one or two bytes. Every delta is against
+// its keyframe rather than the previous snapshot, so restoring any
+// snapshot decodes one delta whatever its age. Full groups are evicted
+// oldest first; their storage is reused, so steady-state pushes don't
+// allocate.
+class SnapshotBuffer {
+public:
+    static constexpr int kWords = sizeof(SimulationSnapshot) / 4;
+    
+    SnapshotBuffer();
+    
+    // Keep at least minSnapshots snapshots (clears the buffer)
+    void Configure(uint32_t stepInterval, int keyframeInterval, size_t minSnapshots);
+    void Clear();
+    
+    // Add the state at step. Steps must follow the newest by exactly the
+    // interval; anything else starts the buffer over from this snapshot.
+    void Push(uint64_t step, const SimulationSnapshot& snapshot);
+    
+    // Newest snapshot at or before step (the oldest held, if step is older);
+    // false if the buffer is empty
+    bool Restore(uint64_t step, SimulationSnapshot& snapshot, uint64_t& snapshotStep) const;
+    
+    // Forget the snapshots after step, e.g. the future a rewind left
+    void Truncate(uint64_t step);
+    
+    bool IsEmpty() const { return mGroupCount == 0; }
+    uint32_t GetStepInterval() const { return mStepInterval; }
+    uint64_t GetOldestStep() const;
+    uint64_t GetNewestStep() const;
+    size_t GetCount() const;
+    
+    // Bytes the held snapshots take encoded
+    size_t GetEncodedBytes() const;
+
+private:
+    struct Group {
+        uint64_t firstStep;             // Step of the keyframe
+        uint32_t keyframe[kWords];
+        std::vector<uint8_t> deltas;    // Snapshots 1.. of the group, back to back
+        std::vector<uint32_t> offsets;  // Start of snapshot i + 1 in deltas
+        int count;                      // Snapshots including the keyframe
+    };
+    
+    Group& GroupAt(size_t index) { return mGroups[(mOldestGroup + index) % mGroups.size()]; }
+    const Group& GroupAt(size_t index) const { return mGroups[(mOldestGroup + index) % mGroups.size()]; }
+    
+    static void EncodeDelta(const uint32_t* keyframe, const uint32_t* words, std::vector<uint8_t>& out);
+    static void DecodeDelta(const uint32_t* keyframe, const uint8_t* in, uint32_t* words);
+    
+    uint32_t mStepInterval;
+    int mKeyframeInterval;
+    std::vector<Group> mGroups;     // Ring of groups
+    size_t mOldestGroup;
+    size_t mGroupCount;
+};
@@ -0,0 +1,61 @@
+// SpscQueue.h
+// Bounded single-producer, single-consumer queue without locks or allocation
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// A fixed ring of Capacity elements (a power of two) between one producer
+// thread and one consumer thread. Each side only writes its own index, so
+// neither ever waits for the other: Push fails when the ring is full, Pop
+// when it is empty. Safe for real-time threads such as an audio callback.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : mHead(0), mCachedTail(0), mTail(0), mCachedHead(0) {}
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    // Producer thread; false (and value dropped) when full
+    bool Push(const T& value) {
+        const uint64_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mCachedTail >= Capacity) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head - mCachedTail >= Capacity) {
+                return false;
+            }
+        }
+        mSlots[head & (Capacity - 1)] = value;
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer thread; false when empty
+    bool Pop(T& value) {
+        const uint64_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail == mCachedHead) {
+            mCachedHead = mHead.load(std::memory_order_acquire);
+            if (tail == mCachedHead) {
+                return false;
+            }
+        }
+        value = mSlots[tail & (Capacity - 1)];
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Each side's index and its last look at the other's share a cache
+    // line of their own, so the other side's line is only read when the
+    // cached index says the ring is full or empty
+    alignas(64) std::atomic<uint64_t> mHead;     // Next slot pushed
+    uint64_t mCachedTail;                        // Producer's view of mTail
+    alignas(64) std::atomic<uint64_t> mTail;     // Next slot popped
+    uint64_t mCachedHead;                        // Consumer's view of mHead
+    alignas(64) T mSlots[Capacity];
+};
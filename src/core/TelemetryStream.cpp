@@ -0,0 +1,191 @@
+// TelemetryStream.cpp
+// POSIX shared memory telemetry ring
+
+#include "TelemetryStream.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kTelemetryMagic[4] = { 'L', 'T', 'L', 'M' };
+
+TelemetryStream::TelemetryStream()
+    : mHeader(nullptr)
+    , mRecords(nullptr)
+    , mMappingSize(0)
+    , mNext(0) {
+}
+
+TelemetryStream::~TelemetryStream() {
+    Close();
+}
+
+bool TelemetryStream::Create(const std::string& name, uint32_t capacity, double fixedTimeStep) {
+    Close();
+    uint32_t slots = 1;
+    while (slots < capacity && slots < (1u << 24)) {
+        slots <<= 1;
+    }
+    
+    // A stale object from a run that didn't exit cleanly is replaced;
+    // readers still mapping it see no more records
+    shm_unlink(name.c_str());
+    int file = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (file < 0) {
+        LOG_ERROR("Failed to create telemetry shared memory %s: %s", name.c_str(), std::strerror(errno));
+        return false;
+    }
+    const size_t size = sizeof(TelemetryStreamHeader) + size_t(slots) * sizeof(TelemetryRecord);
+    void* mapping = MAP_FAILED;
+    if (ftruncate(file, static_cast<off_t>(size)) == 0) {
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    close(file);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map telemetry shared memory %s: %s", name.c_str(), std::strerror(errno));
+        shm_unlink(name.c_str());
+        return false;
+    }
+    
+    mName = name;
+    mMappingSize = size;
+    mHeader = static_cast<TelemetryStreamHeader*>(mapping);
+    mRecords = reinterpret_cast<TelemetryRecord*>(static_cast<char*>(mapping) + sizeof(TelemetryStreamHeader));
+    mNext = 0;
+    
+    // The object starts zeroed, so every sequence is 0; the magic goes in
+    // last, so a reader never takes a half-written header
+    mHeader->version = kVersion;
+    mHeader->headerBytes = sizeof(TelemetryStreamHeader);
+    mHeader->recordBytes = sizeof(TelemetryRecord);
+    mHeader->capacity = slots;
+    mHeader->fixedTimeStep = fixedTimeStep;
+    mHeader->published.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(mHeader->magic, kTelemetryMagic, sizeof(kTelemetryMagic));
+    
+    LOG_INFO("Publishing telemetry to shared memory %s (%u records, %.1f KB)", name.c_str(), slots, size / 1024.0);
+    return true;
+}
+
+void TelemetryStream::Close() {
+    if (!mHeader) {
+        return;
+    }
+    munmap(mHeader, mMappingSize);
+    shm_unlink(mName.c_str());
+    mHeader = nullptr;
+    mRecords = nullptr;
+    mMappingSize = 0;
+}
+
+void TelemetryStream::Publish(const TelemetrySample& sample) {
+    if (!mHeader) {
+        return;
+    }
+    TelemetryRecord& record = mRecords[mNext & (mHeader->capacity - 1)];
+    record.sequence.store(2 * mNext + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&record.sample, &sample, sizeof(sample));
+    record.sequence.store(2 * mNext + 2, std::memory_order_release);
+    mHeader->published.store(mNext + 1, std::memory_order_release);
+    mNext++;
+}
+
+TelemetryReader::TelemetryReader()
+    : mHeader(nullptr)
+    , mRecords(nullptr)
+    , mMappingSize(0)
+    , mNext(0)
+    , mDropped(0) {
+}
+
+TelemetryReader::~TelemetryReader() {
+    Close();
+}
+
+bool TelemetryReader::Open(const std::string& name, bool fromStart) {
+    Close();
+    int file = shm_open(name.c_str(), O_RDONLY, 0);
+    if (file < 0) {
+        LOG_ERROR("Failed to open telemetry shared memory %s: %s", name.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(file, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(TelemetryStreamHeader)) {
+        mMappingSize = static_cast<size_t>(info.st_size);
+        mapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_SHARED, file, 0);
+    }
+    close(file);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map telemetry shared memory %s", name.c_str());
+        mMappingSize = 0;
+        return false;
+    }
+    
+    const TelemetryStreamHeader* header = static_cast<const TelemetryStreamHeader*>(mapping);
+    const bool valid = std::memcmp(header->magic, kTelemetryMagic, sizeof(kTelemetryMagic)) == 0 &&
+                       header->version == TelemetryStream::kVersion &&
+                       header->headerBytes == sizeof(TelemetryStreamHeader) &&
+                       header->recordBytes == sizeof(TelemetryRecord) && header->capacity > 0 &&
+                       (header->capacity & (header->capacity - 1)) == 0 &&
+                       mMappingSize >= header->headerBytes + size_t(header->capacity) * header->recordBytes;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid) {
+        LOG_ERROR("%s is not a version %u telemetry stream", name.c_str(), TelemetryStream::kVersion);
+        munmap(mapping, mMappingSize);
+        mMappingSize = 0;
+        return false;
+    }
+    
+    mHeader = header;
+    mRecords = reinterpret_cast<const TelemetryRecord*>(static_cast<const char*>(mapping) + header->headerBytes);
+    const uint64_t published = mHeader->published.load(std::memory_order_acquire);
+    mNext = !fromStart ? published : published > mHeader->capacity ? published - mHeader->capacity : 0;
+    mDropped = 0;
+    return true;
+}
+
+void TelemetryReader::Close() {
+    if (!mHeader) {
+        return;
+    }
+    munmap(const_cast<TelemetryStreamHeader*>(mHeader), mMappingSize);
+    mHeader = nullptr;
+    mRecords = nullptr;
+    mMappingSize = 0;
+}
+
+bool TelemetryReader::Next(TelemetrySample& sample) {
+    if (!mHeader) {
+        return false;
+    }
+    const uint64_t capacity = mHeader->capacity;
+    for (;;) {
+        const uint64_t published = mHeader->published.load(std::memory_order_acquire);
+        if (mNext >= published) {
+            return false;
+        }
+        // Fallen a lap behind: what is left of it gets overwritten next
+        if (published - mNext > capacity) {
+            mDropped += published - capacity - mNext;
+            mNext = published - capacity;
+        }
+        
+        const TelemetryRecord& record = mRecords[mNext & (capacity - 1)];
+        const uint64_t expected = 2 * mNext + 2;
+        const uint64_t before = record.sequence.load(std::memory_order_acquire);
+        std::memcpy(&sample, &record.sample, sizeof(sample));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t after = record.sequence.load(std::memory_order_relaxed);
+        mNext++;
+        if (before == expected && after == expected) {
+            return true;
+        }
+        mDropped++;
+    }
+}
@@ -0,0 +1,129 @@
+// TelemetryStream.h
+// Lander telemetry published every fixed step to a shared memory ring for external readers
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared memory layout, version 1 (little-endian, as the host):
+//
+//   offset 0    TelemetryStreamHeader (64 bytes)
+//   offset 64   capacity x TelemetryRecord (128 bytes each)
+//
+// Record n of the stream goes to slot n % capacity. Its sequence is
+// 2n + 1 while the sim writes it and 2n + 2 once it is complete; then the
+// header's published count becomes n + 1. A reader takes record n when
+// n < published: it reads the slot's sequence, copies the sample, reads
+// the sequence again, and keeps the copy if both were 2n + 2 (otherwise
+// the sim lapped it and the record is lost). The sim never waits on, or
+// even knows about, readers.
+
+enum TelemetryFlags : uint32_t {
+    TELEMETRY_3D = 1u << 0,
+    TELEMETRY_FLYING = 1u << 1,
+    TELEMETRY_LANDED = 1u << 2,
+    TELEMETRY_CRASHED = 1u << 3,
+    TELEMETRY_THRUST = 1u << 4,         // Engine firing
+    TELEMETRY_ALTITUDE = 1u << 5,       // altitude is valid (over the terrain)
+};
+
+// One fixed step of the lander, as of the end of the step
+struct TelemetrySample {
+    uint64_t step;              // Fixed steps since the game started
+    double flightTime;          // Seconds of the current flight
+    double position[3];         // World position (m), floating origin included
+    float velocity[3];          // m/s
+    float orientation[4];       // Unit quaternion x, y, z, w
+    float angularVelocity[3];   // rad/s (2D: z only)
+    float fuel;                 // kg
+    float maxFuel;
+    float thrustLevel;          // 0 - 1
+    float rcsCommand;           // -1 - 1, counter-clockwise
+    float altitude;             // m above the ground straight below
+    uint32_t flags;             // TelemetryFlags
+    uint32_t contacts;          // Parts on the ground: bit 0 the hull, bit 1 + i leg i (3D)
+    float contactImpulse;       // Solver impulse through every ground contact this step (N s)
+    uint32_t padding[2];
+};
+
+struct TelemetryRecord {
+    std::atomic<uint64_t> sequence;
+    TelemetrySample sample;
+};
+
+struct TelemetryStreamHeader {
+    char magic[4];                      // "LTLM"
+    uint32_t version;
+    uint32_t headerBytes;               // Offset of record 0
+    uint32_t recordBytes;
+    uint32_t capacity;                  // Records, a power of two
+    uint32_t padding0;
+    double fixedTimeStep;               // Seconds per step
+    std::atomic<uint64_t> published;    // Records complete so far
+    uint64_t padding1[3];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Telemetry sequences must be lock-free across processes");
+static_assert(sizeof(TelemetrySample) == 120, "TelemetrySample layout is part of the stream format");
+static_assert(sizeof(TelemetryRecord) == 128, "TelemetryRecord layout is part of the stream format");
+static_assert(sizeof(TelemetryStreamHeader) == 64, "TelemetryStreamHeader layout is part of the stream format");
+
+// The sim's end: creates (or replaces) the shared memory object name
+// ("/lander-telemetry" by default) and publishes one sample per step.
+// Publish() is a copy and three stores into the mapping; no syscalls.
+class TelemetryStream {
+public:
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kDefaultCapacity = 8192;     // Over a minute at 120 Hz
+    
+    TelemetryStream();
+    ~TelemetryStream();
+    
+    TelemetryStream(const TelemetryStream&) = delete;
+    TelemetryStream& operator=(const TelemetryStream&) = delete;
+    
+    // capacity is rounded up to a power of two
+    bool Create(const std::string& name, uint32_t capacity, double fixedTimeStep);
+    void Close();      // Unlinks the object; mapped readers keep theirs
+    bool IsOpen() const { return mHeader != nullptr; }
+    
+    void Publish(const TelemetrySample& sample);
+
+private:
+    std::string mName;
+    TelemetryStreamHeader* mHeader;
+    TelemetryRecord* mRecords;
+    size_t mMappingSize;
+    uint64_t mNext;
+};
+
+// A reader's end, for tools: maps the stream read-only and walks it in
+// order, skipping what the sim overwrote before it was read
+class TelemetryReader {
+public:
+    TelemetryReader();
+    ~TelemetryReader();
+    
+    TelemetryReader(const TelemetryReader&) = delete;
+    TelemetryReader& operator=(const TelemetryReader&) = delete;
+    
+    // fromStart = also the records still in the ring; otherwise only new ones
+    bool Open(const std::string& name, bool fromStart);
+    void Close();
+    
+    // The next record, false if there is none yet
+    bool Next(TelemetrySample& sample);
+    
+    uint64_t GetDropped() const { return mDropped; }
+    double GetFixedTimeStep() const { return mHeader ? mHeader->fixedTimeStep : 0.0; }
+
+private:
+    const TelemetryStreamHeader* mHeader;
+    const TelemetryRecord* mRecords;
+    size_t mMappingSize;
+    uint64_t mNext;
+    uint64_t mDropped;
+};
@@ -3,20 +3,112 @@
 
 #include "Terrain.h"
 #include "../rendering/Renderer.h"
-#include "../rendering/Renderer2D.h"
+#include "DemFile.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include "Rules.h"
+#include "TerrainGenerator.h"
+#include "TerrainTileCache.h"
+#include <cfloat>
 #include <cstdlib>
 #include <cmath>
-#include <iostream>
+#include <cstdio>
+#include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-Terrain::Terrain()
-    : Entity()
+// Terrain cache file layout: this header, then the quantized height,
+// height tile range, normal, landing pad, ambient occlusion and (if baked)
+// horizon arrays at 16-byte aligned offsets. Arrays are stored exactly as in memory, so the file is only valid
+// for builds with the same layout.
+static const char kTerrainCacheMagic[4] = { 'L', 'L', 'T', 'C' };
+static const uint32_t kTerrainCacheVersion = 6;
+
+struct TerrainCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;        // sizeof(TerrainCacheHeader)
+    int32_t gridSize;
+    int32_t width, length, height;
+    float cellWidth, cellLength;
+    float minHeight, maxHeight;
+    uint64_t heightOffset;      // (gridSize + 1)^2 uint16_t samples
+    uint64_t tileRangeOffset;   // HeightTileRange per HeightGrid tile
+    uint64_t normalOffset;      // 3 * (gridSize + 1)^2 floats
+    uint64_t padOffset;         // gridSize^2 bytes
+    uint64_t occlusionOffset;   // (gridSize + 1)^2 bytes
+    uint64_t horizonOffset;     // Terrain::kHorizonDirections * (gridSize + 1)^2 bytes, 0 = not baked
+    uint64_t fileSize;
+    char source[256];           // What the grid was built from
+};
+
+static uint64_t AlignCacheOffset(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+Terrain::Terrain(EntityStore* store)
+    : Entity(store)
+    , mSegmentIndexMinX(0.0f)
+    , mSegmentIndexMaxX(0.0f)
+    , mSegmentBucketScale(0.0f)
     , mWidth(800)
     , mHeight(600)
     , mLength(800) // For 3D
-    , mPixelsPerMeter(20.0f) // Conversion factor
+    , mBakeHorizons(false)
+    , mGridSize(0)
+    , mCellWidth(0.0f)
+    , mCellLength(0.0f)
+    , mMinHeight(0.0f)
+    , mMaxHeight(0.0f)
+    , mOriginX(0.0f)
+    , mOriginZ(0.0f)
+    , mOriginShiftX(0)
+    , mOriginShiftZ(0)
+    , mJobSystem(nullptr)
+    , mSeed(1)
+    , mGeneratedGridSize(kDefaultGeneratedGridSize)
+    , mTileCacheBudget(TerrainTileCache::kDefaultBudgetBytes)
+    , mDemBaseX(0)
+    , mDemBaseY(0)
+    , mDemWindowX(0)
+    , mDemWindowY(0)
+    , mDemPadX(0)
+    , mDemPadY(0)
+    , mDemHeightOffset(0.0f)
+    , mCacheSourceVersion(0)
+    , mVersion(0)
+    , mLayoutVersion(0)
+    , mSegmentsVersion2D(0)
+    , mWorldWidth2D(0)
+    , mWorldSegments2D(0)
+    , mTrackedGridBytes(0)
 {
-    mName = "Terrain";
+}
+
+Terrain::~Terrain() {
+    MemoryTracker::Free(MemoryTag::TerrainHeights, mTrackedGridBytes);
+}
+
+void Terrain::TrackMemory() {
+    // Capacity is what stays resident, whatever the grid uses of it
+    size_t lodBytes = 0;
+    for (const std::vector<TerrainSegment>& level : mLodSegments2D) {
+        lodBytes += level.capacity() * sizeof(TerrainSegment);
+    }
+    size_t gridBytes = mHeights.GetResidentBytes() + mHeightPyramid.GetResidentBytes() +
+                       mNormalData.capacity() * sizeof(float) + mHorizonData.capacity() + mOcclusionData.capacity() +
+                       mLandingPadCells.capacity() + mSegments2D.capacity() * sizeof(TerrainSegment) +
+                       mSegmentBuckets2D.capacity() * sizeof(int) +
+                       (mLandingPads2D.capacity() + mLandingPads3D.capacity()) * sizeof(LandingPad) + lodBytes;
+    MemoryTracker::Resize(MemoryTag::TerrainHeights, mTrackedGridBytes, gridBytes);
+    mTrackedGridBytes = gridBytes;
 }
 
 void Terrain::Update(float deltaTime) {
@@ -29,11 +121,17 @@ void Terrain::Render(Renderer* renderer) {
 }
 
 void Terrain::Generate2D(int width, int height) {
+    PROFILE_ZONE("Terrain Generate 2D");
+    
     mWidth = width;
     mHeight = height;
     
     // Clear any existing terrain
     mSegments2D.clear();
+    if (mWorldWidth2D > width) {
+        GenerateWorld2D(width, height);
+        return;
+    }
     
     // Create a baseline terrain height (in screen coordinates)
     // FIXED: Set baseline at bottom of screen (larger Y value)
@@ -41,14 +139,15 @@ void Terrain::Generate2D(int width, int height) {
     
     // Create segments for the terrain with some randomness
     const int segmentCount = 10;
+    TerrainGenerator generator(mSeed);
     
     for (int i = 0; i < segmentCount; i++) {
         TerrainSegment segment;
         // Store segment coordinates in pixels for rendering
         segment.x1 = i * (width / segmentCount);
-        segment.y1 = baseHeight - (rand() % 20); // Random height variation
+        segment.y1 = baseHeight - static_cast<int>(20 * generator.UniformAt(i, 0, 0)); // Random height variation
         segment.x2 = (i + 1) * (width / segmentCount);
-        segment.y2 = baseHeight - (rand() % 20);
+        segment.y2 = baseHeight - static_cast<int>(20 * generator.UniformAt(i, 1, 0));
         segment.isLandingPad = false;
         
         mSegments2D.push_back(segment);
@@ -74,6 +173,63 @@ void Terrain::Generate2D(int width, int height) {
             mSegments2D[i].y1 = mSegments2D[i].y2 = baseHeight;
         }
     }
+    
+    BuildSegmentIndex2D();
+    TrackMemory();
+}
+
+void Terrain::GenerateWorld2D(int windowWidth, int height) {
+    mWidth = mWorldWidth2D;
+    int segmentCount = mWorldSegments2D > 0 ? mWorldSegments2D : mWidth / kDefaultSegmentPixels2D;
+    segmentCount = std::max(segmentCount, 1);
+    const float segmentWidth = static_cast<float>(mWidth) / segmentCount;
+    
+    // The generator's heights along one row, in meters at the segments'
+    // spacing, reshaped into a relief of at most a third of the window
+    // above the legacy baseline
+    std::vector<float> heights(segmentCount + 1);
+    TerrainGenerator generator(mSeed);
+    generator.GenerateRow(0, 0, segmentWidth * Units::kMetersPerPixel, 0.0f, segmentCount + 1, heights.data());
+    const auto range = std::minmax_element(heights.begin(), heights.end());
+    const float lowest = *range.first;
+    const float span = *range.second - lowest;
+    const float maxRelief = height * 0.35f;
+    const float scale = span * Units::kPixelsPerMeter > maxRelief ? maxRelief / span : Units::kPixelsPerMeter;
+    const float baseHeight = static_cast<float>(height - 50);
+    std::vector<float> vertexY(segmentCount + 1);
+    for (int i = 0; i <= segmentCount; i++) {
+        vertexY[i] = baseHeight - (heights[i] - lowest) * scale;
+    }
+    
+    // A pad under the middle of every window's width, as wide as the
+    // legacy one and flat at the height of the vertex nearest its center
+    std::vector<bool> padVertex(segmentCount + 1, false);
+    const float padHalfWidth = windowWidth / 10.0f;
+    for (float centerX = windowWidth * 0.5f; centerX + padHalfWidth <= mWidth; centerX += windowWidth) {
+        const int first = static_cast<int>(std::ceil((centerX - padHalfWidth) / segmentWidth));
+        const int last = static_cast<int>(std::floor((centerX + padHalfWidth) / segmentWidth));
+        const int center = std::min(std::max(static_cast<int>(centerX / segmentWidth + 0.5f), 0), segmentCount);
+        const float padY = vertexY[center];
+        for (int i = std::max(first, 0); i <= std::min(last, segmentCount); i++) {
+            vertexY[i] = padY;
+            padVertex[i] = true;
+        }
+    }
+    
+    mSegments2D.resize(segmentCount);
+    for (int i = 0; i < segmentCount; i++) {
+        TerrainSegment& segment = mSegments2D[i];
+        segment.x1 = i * segmentWidth;
+        segment.y1 = vertexY[i];
+        segment.x2 = i + 1 == segmentCount ? static_cast<float>(mWidth) : (i + 1) * segmentWidth;
+        segment.y2 = vertexY[i + 1];
+        segment.isLandingPad = padVertex[i] && padVertex[i + 1];
+    }
+    
+    BuildSegmentIndex2D();
+    TrackMemory();
+    LOG_INFO("Generated a %d pixel 2D world in %d segments, %d levels of detail", mWidth, segmentCount,
+             GetLodLevelCount2D());
 }
 
 void Terrain::CreateLandingPad2D(int startX, int width) {
@@ -87,6 +243,201 @@ void Terrain::CreateLandingPad2D(int startX, int width) {
             segment.y1 = segment.y2 = mHeight - 50;
         }
     }
+    
+    BuildSegmentIndex2D();
+}
+
+int Terrain::SegmentBucket2D(float x) const {
+    int bucket = static_cast<int>((x - mSegmentIndexMinX) * mSegmentBucketScale);
+    return std::min(std::max(bucket, 0), static_cast<int>(mSegmentBuckets2D.size()) - 1);
+}
+
+void Terrain::BuildSegmentIndex2D() {
+    // Every segment change ends here
+    static std::atomic<uint32_t> sNextSegmentsVersion2D(1);
+    mSegmentsVersion2D = sNextSegmentsVersion2D.fetch_add(1);
+    
+    mSegmentBuckets2D.clear();
+    mLandingPads2D.clear();
+    BuildLod2D();
+    if (mSegments2D.empty()) {
+        return;
+    }
+    
+    // About one segment per bucket. Every segment is registered in each
+    // bucket SegmentBucket2D maps its x range to, so a query's bucket always
+    // holds the first segment containing it, whatever the rounding.
+    const int segmentCount = static_cast<int>(mSegments2D.size());
+    mSegmentIndexMinX = mSegments2D.front().x1;
+    mSegmentIndexMaxX = mSegments2D.back().x2;
+    float span = mSegmentIndexMaxX - mSegmentIndexMinX;
+    mSegmentBucketScale = span > 0.0f ? segmentCount / span : 0.0f;
+    mSegmentBuckets2D.assign(segmentCount, segmentCount);
+    for (int i = segmentCount - 1; i >= 0; i--) {
+        int first = SegmentBucket2D(mSegments2D[i].x1);
+        int last = SegmentBucket2D(mSegments2D[i].x2);
+        for (int bucket = first; bucket <= last; bucket++) {
+            mSegmentBuckets2D[bucket] = i;
+        }
+    }
+    
+    // Pads are flat, so a run's segments all sit at the first one's y
+    float runY = 0.0f;
+    for (const TerrainSegment& segment : mSegments2D) {
+        if (!segment.isLandingPad) {
+            continue;
+        }
+        const float minX = segment.x1 * Units::kMetersPerPixel;
+        const float maxX = segment.x2 * Units::kMetersPerPixel;
+        if (!mLandingPads2D.empty() && mLandingPads2D.back().maxX == minX && runY == segment.y1) {
+            mLandingPads2D.back().maxX = maxX;
+            continue;
+        }
+        LandingPad pad = {};
+        pad.id = static_cast<int>(mLandingPads2D.size());
+        pad.minX = minX;
+        pad.maxX = maxX;
+        pad.height = (mHeight - segment.y1) * Units::kMetersPerPixel;
+        mLandingPads2D.push_back(pad);
+        runY = segment.y1;
+    }
+    for (LandingPad& pad : mLandingPads2D) {
+        pad.difficulty = Rules::GetPadDifficulty(pad.maxX - pad.minX, pad.slope);
+    }
+}
+
+// Distance from (x, y) to the segment from (x1, y1) to (x2, y2)
+static float DistanceToSegment(float x, float y, float x1, float y1, float x2, float y2) {
+    const float dx = x2 - x1;
+    const float dy = y2 - y1;
+    const float lengthSquared = dx * dx + dy * dy;
+    float t = lengthSquared > 0.0f ? ((x - x1) * dx + (y - y1) * dy) / lengthSquared : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return std::hypot(x - (x1 + t * dx), y - (y1 + t * dy));
+}
+
+void Terrain::BuildLod2D() {
+    mLodSegments2D.clear();
+    const size_t count = mSegments2D.size();
+    
+    // Runs of connected segments of one kind; vertex v of the run starting
+    // at segment first is that segment's start for v = 0, else the end of
+    // segment first + v - 1
+    std::vector<std::pair<size_t, size_t>> runs;    // First segment, segment count
+    for (size_t i = 0; i < count; i++) {
+        const TerrainSegment& segment = mSegments2D[i];
+        if (!runs.empty()) {
+            const TerrainSegment& previous = mSegments2D[i - 1];
+            if (previous.x2 == segment.x1 && previous.y2 == segment.y1 &&
+                previous.isLandingPad == segment.isLandingPad) {
+                runs.back().second++;
+                continue;
+            }
+        }
+        runs.emplace_back(i, 1);
+    }
+    if (runs.size() == count) {
+        return;     // Nothing to simplify
+    }
+    
+    // Douglas-Peucker once, down to no tolerance: each interior vertex gets
+    // the distance it was split off at, capped by its parent's, so a vertex
+    // is kept at a tolerance exactly when Douglas-Peucker at that tolerance
+    // keeps it and the levels nest. endImportance[i] is for segment i's end;
+    // run ends are always kept.
+    std::vector<float> endImportance(count, FLT_MAX);
+    struct Span {
+        size_t first, last;     // Run vertices
+        float importance;
+    };
+    std::vector<Span> stack;
+    for (const std::pair<size_t, size_t>& run : runs) {
+        const size_t base = run.first;
+        auto vertexX = [&](size_t v) { return v == 0 ? mSegments2D[base].x1 : mSegments2D[base + v - 1].x2; };
+        auto vertexY = [&](size_t v) { return v == 0 ? mSegments2D[base].y1 : mSegments2D[base + v - 1].y2; };
+        stack.push_back(Span{ 0, run.second, FLT_MAX });
+        while (!stack.empty()) {
+            const Span span = stack.back();
+            stack.pop_back();
+            if (span.last - span.first < 2) {
+                continue;
+            }
+            const float x1 = vertexX(span.first), y1 = vertexY(span.first);
+            const float x2 = vertexX(span.last), y2 = vertexY(span.last);
+            size_t split = span.first + 1;
+            float farthest = -1.0f;
+            for (size_t v = span.first + 1; v < span.last; v++) {
+                const float distance = DistanceToSegment(vertexX(v), vertexY(v), x1, y1, x2, y2);
+                if (distance > farthest) {
+                    farthest = distance;
+                    split = v;
+                }
+            }
+            const float importance = std::min(farthest, span.importance);
+            endImportance[base + split - 1] = importance;
+            stack.push_back(Span{ span.first, split, importance });
+            stack.push_back(Span{ split, span.last, importance });
+        }
+    }
+    
+    // Each level joins the kept vertices, until a coarser tolerance drops
+    // no more of them
+    size_t previousCount = count;
+    for (int level = 1; level < kMaxLodLevels2D; level++) {
+        const float tolerance = GetLodTolerance2D(level);
+        std::vector<TerrainSegment> segments;
+        for (const std::pair<size_t, size_t>& run : runs) {
+            TerrainSegment segment = mSegments2D[run.first];
+            for (size_t i = run.first; i < run.first + run.second; i++) {
+                if (endImportance[i] > tolerance) {
+                    segment.x2 = mSegments2D[i].x2;
+                    segment.y2 = mSegments2D[i].y2;
+                    segments.push_back(segment);
+                    segment.x1 = segment.x2;
+                    segment.y1 = segment.y2;
+                }
+            }
+        }
+        if (segments.size() >= previousCount) {
+            break;
+        }
+        previousCount = segments.size();
+        segments.shrink_to_fit();
+        mLodSegments2D.push_back(std::move(segments));
+    }
+}
+
+int Terrain::SelectLod2D(float screenScale) const {
+    int level = 0;
+    while (level + 1 < GetLodLevelCount2D() && GetLodTolerance2D(level + 1) * screenScale < 1.0f) {
+        level++;
+    }
+    return level;
+}
+
+size_t Terrain::FindLodSegment2D(int level, float x) const {
+    const std::vector<TerrainSegment>& segments = GetLodSegments2D(level);
+    return std::partition_point(segments.begin(), segments.end(),
+                                [x](const TerrainSegment& segment) { return segment.x2 < x; }) -
+           segments.begin();
+}
+
+const LandingPad* Terrain::FindLandingPad2D(float x) const {
+    // The last pad starting at or before x
+    auto pad = std::upper_bound(mLandingPads2D.begin(), mLandingPads2D.end(), x,
+                                [](float at, const LandingPad& candidate) { return at < candidate.minX; });
+    if (pad == mLandingPads2D.begin() || !(x <= (pad - 1)->maxX)) {
+        return nullptr;
+    }
+    return &*(pad - 1);
+}
+
+size_t Terrain::FirstSegment2D(float x) const {
+    // NaN fails both tests, so it lands here too
+    if (mSegmentBuckets2D.empty() || !(x >= mSegmentIndexMinX && x <= mSegmentIndexMaxX)) {
+        return mSegments2D.size();
+    }
+    return static_cast<size_t>(mSegmentBuckets2D[SegmentBucket2D(x)]);
 }
 
 bool Terrain::CheckCollision2D(Lander* lander, float& collisionHeight) {
@@ -94,27 +445,27 @@ bool Terrain::CheckCollision2D(Lander* lander, float& collisionHeight) {
     
     // Get lander properties in physics units (meters)
     const float* landerPos = lander->GetPosition();
-    float landerWidth = lander->GetWidth() / mPixelsPerMeter;
-    float landerHeight = lander->GetHeight() / mPixelsPerMeter;
+    float landerHeight = lander->GetHeight().Value();
     
     // Get lander bottom center position
     float landerBottomX = landerPos[0];
     float landerBottomY = landerPos[1] - landerHeight / 2;
     
     // Convert lander position to screen coordinates for segment comparison
-    float screenLanderX = landerBottomX * mPixelsPerMeter;
-    float screenLanderY = mHeight - (landerBottomY * mPixelsPerMeter);
+    float screenLanderX = landerBottomX * Units::kPixelsPerMeter;
     
-    // Check collision with each terrain segment
-    for (const auto& segment : mSegments2D) {
+    // Check the segments under the lander; at a shared end point both count
+    for (size_t i = FirstSegment2D(screenLanderX);
+         i < mSegments2D.size() && mSegments2D[i].x1 <= screenLanderX; i++) {
+        const TerrainSegment& segment = mSegments2D[i];
         // Simple line-point collision check in screen coordinates
-        if (screenLanderX >= segment.x1 && screenLanderX <= segment.x2) {
+        if (screenLanderX <= segment.x2) {
             // Interpolate Y position on segment
             float segmentPct = (screenLanderX - segment.x1) / (segment.x2 - segment.x1);
             float segmentY = segment.y1 + segmentPct * (segment.y2 - segment.y1);
             
             // Convert terrain height to physics units (meters)
-            float terrainHeightMeters = (mHeight - segmentY) / mPixelsPerMeter;
+            float terrainHeightMeters = (mHeight - segmentY) * Units::kMetersPerPixel;
             
             // In physics coordinates, we check if lander's bottom Y is lower than terrain Y
             if (landerBottomY <= terrainHeightMeters) {
@@ -128,6 +479,72 @@ bool Terrain::CheckCollision2D(Lander* lander, float& collisionHeight) {
     return false;
 }
 
+bool Terrain::SampleHeight2D(float x, float& height) const {
+    float screenX = x * Units::kPixelsPerMeter;
+    for (size_t i = FirstSegment2D(screenX); i < mSegments2D.size() && mSegments2D[i].x1 <= screenX; i++) {
+        const TerrainSegment& segment = mSegments2D[i];
+        if (screenX <= segment.x2) {
+            float segmentPct = (screenX - segment.x1) / (segment.x2 - segment.x1);
+            float segmentY = segment.y1 + segmentPct * (segment.y2 - segment.y1);
+            height = (mHeight - segmentY) * Units::kMetersPerPixel;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Terrain::SweepCollision2D(float fromX, float fromY, float toX, float toY,
+                               float& hitFraction, float& collisionHeight) const {
+    // Work in screen coordinates, where the segments are (y grows down)
+    float startX = fromX * Units::kPixelsPerMeter;
+    float startY = mHeight - fromY * Units::kPixelsPerMeter;
+    float moveX = toX * Units::kPixelsPerMeter - startX;
+    float moveY = (mHeight - toY * Units::kPixelsPerMeter) - startY;
+    
+    float minX = std::min(startX, startX + moveX);
+    float maxX = std::max(startX, startX + moveX);
+    if (mSegments2D.empty() || !(maxX >= mSegmentIndexMinX && minX <= mSegmentIndexMaxX)) {
+        return false;
+    }
+    
+    bool hit = false;
+    float bestFraction = 1.0f;
+    float bestY = 0.0f;
+    for (size_t i = FirstSegment2D(std::max(minX, mSegmentIndexMinX));
+         i < mSegments2D.size() && mSegments2D[i].x1 <= maxX; i++) {
+        const TerrainSegment& segment = mSegments2D[i];
+        float edgeX = segment.x2 - segment.x1;
+        float edgeY = segment.y2 - segment.y1;
+        
+        // Signed side of the segment's line: negative above the surface
+        float startSide = edgeX * (startY - segment.y1) - edgeY * (startX - segment.x1);
+        float endSide = startSide + edgeX * moveY - edgeY * moveX;
+        if (startSide > 0.0f || endSide <= 0.0f) {
+            continue;   // Not crossing from above to below
+        }
+        
+        float fraction = startSide / (startSide - endSide);
+        if (hit && fraction >= bestFraction) {
+            continue;
+        }
+        
+        // The crossing must fall within the segment, not its extension
+        float crossX = startX + fraction * moveX;
+        if (crossX < segment.x1 || crossX > segment.x2) {
+            continue;
+        }
+        hit = true;
+        bestFraction = fraction;
+        bestY = startY + fraction * moveY;
+    }
+    
+    if (hit) {
+        hitFraction = bestFraction;
+        collisionHeight = (mHeight - bestY) * Units::kMetersPerPixel;
+    }
+    return hit;
+}
+
 bool Terrain::IsValidLanding2D(Lander* lander) {
     if (!lander) return false;
     
@@ -135,54 +552,34 @@ bool Terrain::IsValidLanding2D(Lander* lander) {
     const float* landerPos = lander->GetPosition();
     const float* landerVel = lander->GetVelocity();
     
-    // Get lander bottom center position
-    float landerBottomX = landerPos[0];
+    // Debug output to help diagnose landing issues (runs on every collision check)
+    LOG_DEBUG_EVERY(500, "Landing check - Position: (%g, %g) m, Velocity: (%g, %g) m/s",
+                    landerPos[0], landerPos[1], landerVel[0], landerVel[1]);
     
-    // Convert to screen coordinates for segment comparison
-    float screenLanderX = landerBottomX * mPixelsPerMeter;
-    
-    // Debug output to help diagnose landing issues
-    std::cout << "Landing check - Position: (" << landerPos[0] << ", " << landerPos[1] 
-              << ") m, Velocity: (" << landerVel[0] << ", " << landerVel[1] 
-              << ") m/s" << std::endl;
-    
-    // Check if lander is on a landing pad
-    bool onLandingPad = false;
-    for (const auto& segment : mSegments2D) {
-        if (segment.isLandingPad && 
-            screenLanderX >= segment.x1 && 
-            screenLanderX <= segment.x2) {
-            
-            onLandingPad = true;
-            
-            // Calculate terrain height in meters
-            float terrainHeightMeters = (mHeight - segment.y1) / mPixelsPerMeter;
-            
-            std::cout << "Lander is on landing pad! Terrain height: " << terrainHeightMeters 
-                      << " m, Lander y: " << landerPos[1] << " m" << std::endl;
-            
-            // Check landing conditions:
-            // 1. Vertical velocity must be low (regardless of direction)
-            // 2. Horizontal velocity must be low
-            const float safeVerticalVelocity = 2.0f;   // m/s
-            const float safeHorizontalVelocity = 1.0f; // m/s
-            
-            bool safeVertical = std::abs(landerVel[1]) <= safeVerticalVelocity;
-            bool safeHorizontal = std::abs(landerVel[0]) <= safeHorizontalVelocity;
-            
-            std::cout << "Safe vertical: " << (safeVertical ? "YES" : "NO") 
-                      << " (" << std::abs(landerVel[1]) << " m/s), "
-                      << "Safe horizontal: " << (safeHorizontal ? "YES" : "NO") 
-                      << " (" << std::abs(landerVel[0]) << " m/s)" << std::endl;
-            
-            if (safeVertical && safeHorizontal) {
-                return true;
-            }
+    // Check if lander is on a landing pad (under its bottom center)
+    const LandingPad* pad = FindLandingPad2D(landerPos[0]);
+    if (pad) {
+        LOG_DEBUG_EVERY(500, "Lander is on landing pad %d! Terrain height: %g m, Lander y: %g m",
+                        pad->id, pad->height, landerPos[1]);
+        
+        // Check landing conditions:
+        // 1. Vertical velocity must be low (regardless of direction)
+        // 2. Horizontal velocity must be low
+        const float safeVerticalVelocity = 2.0f;   // m/s
+        const float safeHorizontalVelocity = 1.0f; // m/s
+        
+        bool safeVertical = std::abs(landerVel[1]) <= safeVerticalVelocity;
+        bool safeHorizontal = std::abs(landerVel[0]) <= safeHorizontalVelocity;
+        
+        LOG_DEBUG_EVERY(500, "Safe vertical: %s (%g m/s), Safe horizontal: %s (%g m/s)",
+                        safeVertical ? "YES" : "NO", std::abs(landerVel[1]),
+                        safeHorizontal ? "YES" : "NO", std::abs(landerVel[0]));
+        
+        if (safeVertical && safeHorizontal) {
+            return true;
         }
-    }
-    
-    if (!onLandingPad) {
-        std::cout << "Lander is NOT on a landing pad!" << std::endl;
+    } else {
+        LOG_DEBUG_EVERY(500, "Lander is NOT on a landing pad!");
     }
     
     return false;
@@ -191,196 +588,1142 @@ bool Terrain::IsValidLanding2D(Lander* lander) {
 // 3D Terrain methods (for Phase 3)
 // [3D implementation remains largely unchanged]
 
-void Terrain::Generate3D(int width, int length, int height) {
+TerrainGeneratedLayout Terrain::GetGeneratedLayout(int width, int length, int height) const {
+    TerrainGeneratedLayout layout;
+    layout.gridSize = mGeneratedGridSize;
+    layout.cellWidth = (float)width / layout.gridSize;
+    layout.cellLength = (float)length / layout.gridSize;
+    layout.padMin = layout.gridSize / 3 + 1;
+    layout.padMax = 2 * layout.gridSize / 3;
+    layout.blendCells = std::max(1.0f, layout.gridSize / 16.0f);
+    layout.baseHeight = height - 50.0f;
+    return layout;
+}
+
+void Terrain::Generate3D(int width, int length, int height, const float* heights) {
+    PROFILE_ZONE("Terrain Generate 3D");
+    
+    const TerrainGeneratedLayout layout = GetGeneratedLayout(width, length, height);
     mWidth = width;
     mLength = length;
     mHeight = height;
     
-    // Clear any existing terrain
-    mTriangles3D.clear();
-    
-    // In a real implementation, this would generate a proper 3D terrain mesh
-    // For now, just create a flat plane with some height variations
+    // Clear any existing terrain (and stop streaming a previous DEM)
+    mTileCache.reset();
+    mDem.reset();
+    mOriginX = 0.0f;
+    mOriginZ = 0.0f;
+    mOriginShiftX = 0;
+    mOriginShiftZ = 0;
     
     // Generate a grid of vertices
-    const int gridSize = 20;
-    const float cellWidth = (float)width / gridSize;
-    const float cellLength = (float)length / gridSize;
-    
-    // Generate heightmap data
-    mHeightData.resize((gridSize + 1) * (gridSize + 1));
-    for (int z = 0; z <= gridSize; z++) {
-        for (int x = 0; x <= gridSize; x++) {
-            float height = mHeight - 50;
-            
-            // Add some random height variation
-            if (!(x > gridSize / 3 && x < 2 * gridSize / 3 && 
-                  z > gridSize / 3 && z < 2 * gridSize / 3)) {
-                height += (rand() % 20) - 10;
+    const int gridSize = layout.gridSize;
+    const int padMin = layout.padMin;
+    const int padMax = layout.padMax;
+    mGridSize = gridSize;
+    mCellWidth = layout.cellWidth;
+    mCellLength = layout.cellLength;
+    mLandingPadCells.assign(gridSize * gridSize, 0);
+    
+    const int samplesPerSide = gridSize + 1;
+    if (heights) {
+        mHeights.Assign(samplesPerSide, heights);
+    } else {
+        // Noise heights depend only on the seed and world position, so the
+        // rows can be generated in parallel
+        std::vector<float> samples(static_cast<size_t>(samplesPerSide) * samplesPerSide);
+        TerrainGenerator generator(mSeed);
+        generator.GenerateGrid(mJobSystem, 0, 0, layout.cellWidth, layout.cellLength, samplesPerSide,
+                               samplesPerSide, samples.data());
+        
+        // Center area is the landing pad: flat at the base height, with the
+        // relief easing in over a few cells around it
+        for (int z = 0; z <= gridSize; z++) {
+            for (int x = 0; x <= gridSize; x++) {
+                int outsideX = std::max(0, std::max(padMin - x, x - padMax));
+                int outsideZ = std::max(0, std::max(padMin - z, z - padMax));
+                float t = std::min(1.0f, std::max(outsideX, outsideZ) / layout.blendCells);
+                float& sample = samples[z * samplesPerSide + x];
+                sample = layout.baseHeight + sample * t * t * (3.0f - 2.0f * t);
             }
-            
-            mHeightData[z * (gridSize + 1) + x] = height;
         }
+        mHeights.Assign(samplesPerSide, samples.data());
     }
     
-    // Create triangles from the grid
+    // Track the height range (used for heightfield collision bounds)
+    mMinHeight = mHeights.GetMinHeight();
+    mMaxHeight = mHeights.GetMaxHeight();
+    mHeightPyramid.Build(mHeights);
+    
+    // Landing pad status
     for (int z = 0; z < gridSize; z++) {
         for (int x = 0; x < gridSize; x++) {
-            // Get heights of the four corners
-            float h1 = mHeightData[z * (gridSize + 1) + x];
-            float h2 = mHeightData[z * (gridSize + 1) + x + 1];
-            float h3 = mHeightData[(z + 1) * (gridSize + 1) + x];
-            float h4 = mHeightData[(z + 1) * (gridSize + 1) + x + 1];
-            
-            // Create two triangles for this grid cell
-            TerrainTriangle tri1, tri2;
-            
-            // First triangle (top-left, top-right, bottom-left)
-            tri1.vertices[0] = x * cellWidth;
-            tri1.vertices[1] = h1;
-            tri1.vertices[2] = z * cellLength;
-            
-            tri1.vertices[3] = (x + 1) * cellWidth;
-            tri1.vertices[4] = h2;
-            tri1.vertices[5] = z * cellLength;
-            
-            tri1.vertices[6] = x * cellWidth;
-            tri1.vertices[7] = h3;
-            tri1.vertices[8] = (z + 1) * cellLength;
-            
-            // Calculate normal (simplified)
-            tri1.normal[0] = 0.0f;
-            tri1.normal[1] = 1.0f; // Pointing up
-            tri1.normal[2] = 0.0f;
-            
-            // Second triangle (bottom-left, top-right, bottom-right)
-            tri2.vertices[0] = x * cellWidth;
-            tri2.vertices[1] = h3;
-            tri2.vertices[2] = (z + 1) * cellLength;
-            
-            tri2.vertices[3] = (x + 1) * cellWidth;
-            tri2.vertices[4] = h2;
-            tri2.vertices[5] = z * cellLength;
-            
-            tri2.vertices[6] = (x + 1) * cellWidth;
-            tri2.vertices[7] = h4;
-            tri2.vertices[8] = (z + 1) * cellLength;
-            
-            // Calculate normal (simplified)
-            tri2.normal[0] = 0.0f;
-            tri2.normal[1] = 1.0f; // Pointing up
-            tri2.normal[2] = 0.0f;
-            
-            // Set landing pad status (center area is landing pad)
-            tri1.isLandingPad = (x > gridSize / 3 && x < 2 * gridSize / 3 && 
-                                 z > gridSize / 3 && z < 2 * gridSize / 3);
-            tri2.isLandingPad = tri1.isLandingPad;
-            
-            // Add triangles to terrain
-            mTriangles3D.push_back(tri1);
-            mTriangles3D.push_back(tri2);
+            mLandingPadCells[z * gridSize + x] = (x >= padMin && x < padMax && z >= padMin && z < padMax) ? 1 : 0;
         }
     }
+    
+    TerrainDirtyRegion allCells = {0, 0, gridSize, gridSize};
+    BuildNormals(allCells);
+    BuildHorizons(allCells);
+    BuildOcclusion(allCells);
+    BuildLandingPads3D();
+    
+    // Consumers must rebuild anything sized from the old grid
+    BeginLayout();
+    TrackMemory();
+    MarkDirty(allCells);
 }
 
-void Terrain::LoadHeightmap(const char* filename) {
-    // This would load a heightmap from an image file
-    // For now, just generate some random terrain
-    Generate3D(mWidth, mLength, mHeight);
+// Unit normal of a triangle, flipped to face up
+static void TriangleNormal(const float* vertices, float* normal) {
+    float e1[3] = { vertices[3] - vertices[0], vertices[4] - vertices[1], vertices[5] - vertices[2] };
+    float e2[3] = { vertices[6] - vertices[0], vertices[7] - vertices[1], vertices[8] - vertices[2] };
+    float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length <= 0.0f) {
+        normal[0] = 0.0f;
+        normal[1] = 1.0f;
+        normal[2] = 0.0f;
+        return;
+    }
+    float scale = (n[1] < 0.0f ? -1.0f : 1.0f) / length;
+    normal[0] = n[0] * scale;
+    normal[1] = n[1] * scale;
+    normal[2] = n[2] * scale;
 }
 
-bool Terrain::CheckCollision3D(Lander* lander, float& collisionHeight) {
-    const float* landerPos = lander->GetPosition();
-    float landerWidth = lander->GetWidth();
-    float landerHeight = lander->GetHeight();
-    float landerDepth = lander->GetDepth();
-    
-    // Simplified 3D collision detection
-    // In a real implementation, this would do proper 3D collision detection
-    
-    // For now, just project down to find height at lander position
-    float landerX = landerPos[0];
-    float landerY = landerPos[1];
-    float landerZ = landerPos[2];
-    
-    // Find which triangle the lander is above
-    for (const auto& triangle : mTriangles3D) {
-        // Simple point-in-triangle test (2D projection)
-        // This is a simplification - real collision would be more complex
-        
-        // Get the three vertices of the triangle
-        float x1 = triangle.vertices[0];
-        float y1 = triangle.vertices[1];
-        float z1 = triangle.vertices[2];
-        
-        float x2 = triangle.vertices[3];
-        float y2 = triangle.vertices[4];
-        float z2 = triangle.vertices[5];
-        
-        float x3 = triangle.vertices[6];
-        float y3 = triangle.vertices[7];
-        float z3 = triangle.vertices[8];
-        
-        // Check if lander (x,z) is within triangle (x,z) bounds
-        // This is a very simplified approach
-        if (landerX >= std::min({x1, x2, x3}) && 
-            landerX <= std::max({x1, x2, x3}) &&
-            landerZ >= std::min({z1, z2, z3}) && 
-            landerZ <= std::max({z1, z2, z3})) {
-            
-            // Approximate height at this position
-            float avgHeight = (y1 + y2 + y3) / 3.0f;
-            
-            // Check if lander has collided with terrain
-            if (landerY + landerHeight/2 >= avgHeight) {
-                collisionHeight = avgHeight;
-                return true;
+void Terrain::GetTriangle3D(size_t index, TerrainTriangle& triangle) const {
+    const int gridSize = mGridSize;
+    const size_t cell = index / 2;
+    const int x = static_cast<int>(cell % gridSize);
+    const int z = static_cast<int>(cell / gridSize);
+    const float x0 = mOriginX + x * mCellWidth;
+    const float x1 = mOriginX + (x + 1) * mCellWidth;
+    const float z0 = mOriginZ + z * mCellLength;
+    const float z1 = mOriginZ + (z + 1) * mCellLength;
+    
+    // Corner heights
+    float corners[4];
+    mHeights.GetCell(x, z, corners);
+    const float h1 = corners[0];
+    const float h2 = corners[1];
+    const float h3 = corners[2];
+    const float h4 = corners[3];
+    
+    float* v = triangle.vertices;
+    if (index % 2 == 0) {
+        // First triangle (top-left, top-right, bottom-left)
+        v[0] = x0; v[1] = h1; v[2] = z0;
+        v[3] = x1; v[4] = h2; v[5] = z0;
+        v[6] = x0; v[7] = h3; v[8] = z1;
+    } else {
+        // Second triangle (bottom-left, top-right, bottom-right)
+        v[0] = x0; v[1] = h3; v[2] = z1;
+        v[3] = x1; v[4] = h2; v[5] = z0;
+        v[6] = x1; v[7] = h4; v[8] = z1;
+    }
+    TriangleNormal(v, triangle.normal);
+    triangle.isLandingPad = mLandingPadCells[cell] != 0;
+}
+
+void Terrain::BuildNormals(const TerrainDirtyRegion& cells) {
+    PROFILE_ZONE("Terrain Normals");
+    
+    const int gridSize = mGridSize;
+    const int stride = gridSize + 1;
+    const float cellWidth = mCellWidth;
+    const float cellLength = mCellLength;
+    mNormalData.resize(3 * mHeights.GetSampleCount());
+    
+    // Central differences, one-sided at the grid edge. Only heights are
+    // read, so rows are independent.
+    auto buildRows = [&](size_t firstRow, size_t lastRow) {
+        for (int z = cells.minCellZ + static_cast<int>(firstRow); z < cells.minCellZ + static_cast<int>(lastRow); z++) {
+            int z0 = std::max(z - 1, 0);
+            int z1 = std::min(z + 1, gridSize);
+            for (int x = cells.minCellX; x <= cells.maxCellX; x++) {
+                int x0 = std::max(x - 1, 0);
+                int x1 = std::min(x + 1, gridSize);
+                float slopeX = (mHeights.Get(x1, z) - mHeights.Get(x0, z)) / ((x1 - x0) * cellWidth);
+                float slopeZ = (mHeights.Get(x, z1) - mHeights.Get(x, z0)) / ((z1 - z0) * cellLength);
+                
+                float inverseLength = 1.0f / std::sqrt(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+                float* normal = &mNormalData[3 * (z * stride + x)];
+                normal[0] = -slopeX * inverseLength;
+                normal[1] = inverseLength;
+                normal[2] = -slopeZ * inverseLength;
             }
         }
+    };
+    
+    size_t rowCount = static_cast<size_t>(cells.maxCellZ - cells.minCellZ + 1);
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(rowCount, 8, buildRows);
+    } else {
+        buildRows(0, rowCount);
+    }
+}
+
+void Terrain::SetHorizonMaps(bool enabled) {
+    if (enabled == mBakeHorizons) {
+        return;
+    }
+    mBakeHorizons = enabled;
+    if (!enabled) {
+        std::vector<uint8_t>().swap(mHorizonData);
+        TrackMemory();
+        return;
     }
     
-    return false;
+    // A grid built before now is baked here; consumers see it as a change
+    // to all of it
+    if (HasHeightGrid()) {
+        TerrainDirtyRegion allCells = {0, 0, mGridSize, mGridSize};
+        BuildHorizons(allCells);
+        TrackMemory();
+        MarkDirty(allCells);
+    }
 }
 
-bool Terrain::IsValidLanding3D(Lander* lander) {
-    const float* landerPos = lander->GetPosition();
-    const float* landerVel = lander->GetVelocity();
+void Terrain::BuildHorizons(const TerrainDirtyRegion& cells) {
+    if (!mBakeHorizons || !HasHeightGrid()) {
+        return;
+    }
+    PROFILE_ZONE("Terrain Horizons");
+    
+    const int gridSize = mGridSize;
+    const int stride = gridSize + 1;
+    const size_t sampleCount = mHeights.GetSampleCount();
+    const float topHeight = mHeights.GetMaxHeight();
+    mHorizonData.resize(kHorizonDirections * sampleCount);
     
-    // Get lander position
-    float landerX = landerPos[0];
-    float landerZ = landerPos[2];
+    // One cell's step along each azimuth, in cells and in meters
+    float stepX[kHorizonDirections];
+    float stepZ[kHorizonDirections];
+    float stepMeters[kHorizonDirections];
+    for (int d = 0; d < kHorizonDirections; d++) {
+        const float azimuth = d * (2.0f * 3.14159265358979323846f / kHorizonDirections);
+        stepX[d] = std::cos(azimuth);
+        stepZ[d] = std::sin(azimuth);
+        stepMeters[d] = std::sqrt(stepX[d] * mCellWidth * stepX[d] * mCellWidth +
+                                  stepZ[d] * mCellLength * stepZ[d] * mCellLength);
+    }
+    
+    // March each direction with steps of a cell, growing to an eighth of
+    // the distance so far, keeping the steepest rise to the nearest sample.
+    // The march ends once even the grid's highest sample at the next step
+    // could not rise more steeply. Only heights are read, so rows are
+    // independent.
+    auto bakeRows = [&](size_t firstRow, size_t lastRow) {
+        for (int z = cells.minCellZ + static_cast<int>(firstRow); z < cells.minCellZ + static_cast<int>(lastRow); z++) {
+            for (int x = cells.minCellX; x <= cells.maxCellX; x++) {
+                const float base = mHeights.Get(x, z);
+                const size_t sample = static_cast<size_t>(z) * stride + x;
+                for (int d = 0; d < kHorizonDirections; d++) {
+                    float steepest = 0.0f;
+                    float distance = 1.0f;
+                    while (distance <= kHorizonMaxCells) {
+                        const int sampleX = static_cast<int>(std::lround(x + stepX[d] * distance));
+                        const int sampleZ = static_cast<int>(std::lround(z + stepZ[d] * distance));
+                        if (sampleX < 0 || sampleZ < 0 || sampleX > gridSize || sampleZ > gridSize) {
+                            break;
+                        }
+                        const float meters = distance * stepMeters[d];
+                        steepest = std::max(steepest, (mHeights.Get(sampleX, sampleZ) - base) / meters);
+                        if ((topHeight - base) / meters <= steepest) {
+                            break;
+                        }
+                        distance += std::max(1.0f, distance * 0.125f);
+                    }
+                    const float sine = steepest / std::sqrt(1.0f + steepest * steepest);
+                    mHorizonData[(d / 4) * 4 * sampleCount + 4 * sample + d % 4] =
+                        static_cast<uint8_t>(std::lround(std::min(sine, 1.0f) * 255.0f));
+                }
+            }
+        }
+    };
+    
+    size_t rowCount = static_cast<size_t>(cells.maxCellZ - cells.minCellZ + 1);
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(rowCount, 4, bakeRows);
+    } else {
+        bakeRows(0, rowCount);
+    }
+}
+
+void Terrain::BuildOcclusion(const TerrainDirtyRegion& cells) {
+    if (!HasHeightGrid()) {
+        return;
+    }
+    PROFILE_ZONE("Terrain Occlusion");
     
-    // Check if lander is on a landing pad and moving slowly enough
-    for (const auto& triangle : mTriangles3D) {
-        if (!triangle.isLandingPad) {
+    const int gridSize = mGridSize;
+    const int stride = gridSize + 1;
+    mOcclusionData.resize(mHeights.GetSampleCount());
+    
+    // The same march as the horizons over a short radius, with steps
+    // growing to a quarter of the distance so far: a dozen samples per
+    // direction, their offsets and distances worked out once here
+    struct OcclusionStep {
+        int dx, dz;
+        float inverseMeters;
+    };
+    static constexpr int kMaxSteps = 32;
+    OcclusionStep steps[kOcclusionDirections][kMaxSteps];
+    int stepCount = 0;
+    for (int d = 0; d < kOcclusionDirections; d++) {
+        const float azimuth = d * (2.0f * 3.14159265358979323846f / kOcclusionDirections);
+        const float stepX = std::cos(azimuth);
+        const float stepZ = std::sin(azimuth);
+        const float stepMeters = std::sqrt(stepX * mCellWidth * stepX * mCellWidth +
+                                           stepZ * mCellLength * stepZ * mCellLength);
+        stepCount = 0;
+        for (float distance = 1.0f; distance <= kOcclusionMaxCells && stepCount < kMaxSteps;
+             distance += std::max(1.0f, distance * 0.25f)) {
+            OcclusionStep& step = steps[d][stepCount++];
+            step.dx = static_cast<int>(std::lround(stepX * distance));
+            step.dz = static_cast<int>(std::lround(stepZ * distance));
+            step.inverseMeters = 1.0f / (distance * stepMeters);
+        }
+    }
+    
+    // With the steepest rise s = tan h in a direction, that slice of sky
+    // loses sin^2 h = s^2 / (1 + s^2). Only heights are read, so rows are
+    // independent.
+    auto bakeRows = [&](size_t firstRow, size_t lastRow) {
+        for (int z = cells.minCellZ + static_cast<int>(firstRow); z < cells.minCellZ + static_cast<int>(lastRow); z++) {
+            for (int x = cells.minCellX; x <= cells.maxCellX; x++) {
+                const float base = mHeights.Get(x, z);
+                float hidden = 0.0f;
+                for (int d = 0; d < kOcclusionDirections; d++) {
+                    float steepest = 0.0f;
+                    for (int i = 0; i < stepCount; i++) {
+                        const OcclusionStep& step = steps[d][i];
+                        const int sampleX = x + step.dx;
+                        const int sampleZ = z + step.dz;
+                        if (sampleX < 0 || sampleZ < 0 || sampleX > gridSize || sampleZ > gridSize) {
+                            break;
+                        }
+                        steepest = std::max(steepest, (mHeights.Get(sampleX, sampleZ) - base) * step.inverseMeters);
+                    }
+                    hidden += steepest * steepest / (1.0f + steepest * steepest);
+                }
+                mOcclusionData[static_cast<size_t>(z) * stride + x] =
+                    static_cast<uint8_t>(std::lround(std::min(hidden / kOcclusionDirections, 1.0f) * 255.0f));
+            }
+        }
+    };
+    
+    size_t rowCount = static_cast<size_t>(cells.maxCellZ - cells.minCellZ + 1);
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(rowCount, 8, bakeRows);
+    } else {
+        bakeRows(0, rowCount);
+    }
+}
+
+void Terrain::BuildLandingPads3D() {
+    mLandingPads3D.clear();
+    if (!HasHeightGrid() || mLandingPadCells.size() != static_cast<size_t>(mGridSize) * mGridSize) {
+        return;
+    }
+    
+    // Flood fill each unvisited pad cell's 4-connected block, growing its
+    // bounds; pads are few and small next to the grid
+    std::vector<unsigned char> visited(mLandingPadCells.size(), 0);
+    std::vector<int> pending;
+    for (int start = 0; start < static_cast<int>(mLandingPadCells.size()); start++) {
+        if (!mLandingPadCells[start] || visited[start]) {
             continue;
         }
-        
-        // Get the three vertices of the triangle
-        float x1 = triangle.vertices[0];
-        float z1 = triangle.vertices[2];
-        
-        float x2 = triangle.vertices[3];
-        float z2 = triangle.vertices[5];
-        
-        float x3 = triangle.vertices[6];
-        float z3 = triangle.vertices[8];
-        
-        // Check if lander (x,z) is within triangle (x,z) bounds
-        if (landerX >= std::min({x1, x2, x3}) && 
-            landerX <= std::max({x1, x2, x3}) &&
-            landerZ >= std::min({z1, z2, z3}) && 
-            landerZ <= std::max({z1, z2, z3})) {
+        LandingPad pad = {};
+        pad.id = static_cast<int>(mLandingPads3D.size());
+        pad.cells = { start % mGridSize, start / mGridSize, start % mGridSize + 1, start / mGridSize + 1 };
+        visited[start] = 1;
+        pending.push_back(start);
+        while (!pending.empty()) {
+            const int cell = pending.back();
+            pending.pop_back();
+            const int cellX = cell % mGridSize;
+            const int cellZ = cell / mGridSize;
+            pad.cells.minCellX = std::min(pad.cells.minCellX, cellX);
+            pad.cells.minCellZ = std::min(pad.cells.minCellZ, cellZ);
+            pad.cells.maxCellX = std::max(pad.cells.maxCellX, cellX + 1);
+            pad.cells.maxCellZ = std::max(pad.cells.maxCellZ, cellZ + 1);
+            const int neighbours[4] = {
+                cellX > 0 ? cell - 1 : -1, cellX + 1 < mGridSize ? cell + 1 : -1,
+                cellZ > 0 ? cell - mGridSize : -1, cellZ + 1 < mGridSize ? cell + mGridSize : -1
+            };
+            for (int neighbour : neighbours) {
+                if (neighbour >= 0 && mLandingPadCells[neighbour] && !visited[neighbour]) {
+                    visited[neighbour] = 1;
+                    pending.push_back(neighbour);
+                }
+            }
+        }
+        pad.minX = mOriginX + pad.cells.minCellX * mCellWidth;
+        pad.maxX = mOriginX + pad.cells.maxCellX * mCellWidth;
+        pad.minZ = mOriginZ + pad.cells.minCellZ * mCellLength;
+        pad.maxZ = mOriginZ + pad.cells.maxCellZ * mCellLength;
+        MeasureLandingPad3D(pad);
+        mLandingPads3D.push_back(pad);
+    }
+}
+
+void Terrain::MeasureLandingPad3D(LandingPad& pad) const {
+    // Every sample on the pad's cells, edges included
+    float heightSum = 0.0f;
+    float steepest = 0.0f;
+    int samples = 0;
+    const int stride = mGridSize + 1;
+    for (int z = pad.cells.minCellZ; z <= pad.cells.maxCellZ; z++) {
+        for (int x = pad.cells.minCellX; x <= pad.cells.maxCellX; x++) {
+            heightSum += mHeights.Get(x, z);
+            samples++;
+            const float* normal = &mNormalData[3 * (static_cast<size_t>(z) * stride + x)];
+            const float run = std::sqrt(normal[0] * normal[0] + normal[2] * normal[2]);
+            steepest = std::max(steepest, normal[1] > 0.0f ? run / normal[1] : Rules::kSteepPadSlope);
+        }
+    }
+    pad.height = heightSum / samples;
+    pad.slope = steepest;
+    pad.difficulty = Rules::GetPadDifficulty(std::min(pad.maxX - pad.minX, pad.maxZ - pad.minZ), pad.slope);
+}
+
+void Terrain::MarkDirty(const TerrainDirtyRegion& cells) {
+    ++mVersion;
+    int slot = static_cast<int>(mVersion % kDirtyHistorySize);
+    mDirtyRegions[slot] = cells;
+}
+
+void Terrain::BeginLayout() {
+    // One clock for every terrain's layouts, kept past each one's version
+    // so versions never go back
+    static std::atomic<uint32_t> sLayoutClock(0);
+    uint32_t clock = sLayoutClock.load();
+    uint32_t layout;
+    do {
+        layout = std::max(clock, mVersion) + 1;
+    } while (!sLayoutClock.compare_exchange_weak(clock, layout));
+    mLayoutVersion = layout;
+    mVersion = layout - 1;
+}
+
+bool Terrain::GetDirtyRegion(uint32_t sinceVersion, TerrainDirtyRegion& region) const {
+    if (sinceVersion >= mVersion) {
+        return false;
+    }
+    
+    // Too old to reconstruct from the history (or from before a regenerate)
+    if (mVersion - sinceVersion > static_cast<uint32_t>(kDirtyHistorySize) || sinceVersion < mLayoutVersion) {
+        region = {0, 0, mGridSize, mGridSize};
+        return true;
+    }
+    
+    // Union of every change after sinceVersion
+    region = mDirtyRegions[(sinceVersion + 1) % kDirtyHistorySize];
+    for (uint32_t version = sinceVersion + 2; version <= mVersion; version++) {
+        const TerrainDirtyRegion& cells = mDirtyRegions[version % kDirtyHistorySize];
+        region.minCellX = std::min(region.minCellX, cells.minCellX);
+        region.minCellZ = std::min(region.minCellZ, cells.minCellZ);
+        region.maxCellX = std::max(region.maxCellX, cells.maxCellX);
+        region.maxCellZ = std::max(region.maxCellZ, cells.maxCellZ);
+    }
+    return true;
+}
+
+void Terrain::Deform(float x, float z, float radius, float depth) {
+    if (!HasHeightGrid() || radius <= 0.0f || depth <= 0.0f) {
+        return;
+    }
+    PROFILE_ZONE("Terrain Crater");
+    
+    // Height samples inside the rim's bounding square (grid space)
+    x -= mOriginX;
+    z -= mOriginZ;
+    const float outer = radius * kCraterRimScale;
+    int minX = std::max(0, static_cast<int>(std::floor((x - outer) / mCellWidth)));
+    int maxX = std::min(mGridSize, static_cast<int>(std::ceil((x + outer) / mCellWidth)));
+    int minZ = std::max(0, static_cast<int>(std::floor((z - outer) / mCellLength)));
+    int maxZ = std::min(mGridSize, static_cast<int>(std::ceil((z + outer) / mCellLength)));
+    if (minX > maxX || minZ > maxZ) {
+        return;
+    }
+    
+    // Smooth bowl: full depth at the center, zero at the radius. Past it the
+    // rim rises to a quarter of the depth halfway out and falls back to
+    // zero at the outer edge. The square is decoded, reshaped and written
+    // back in one go, so a tile leaving its range is re-quantized once.
+    const float rimHeight = 0.25f * depth;
+    const float rimWidth = outer - radius;
+    HeightGridRegion samples = { minX, minZ, maxX, maxZ };
+    std::vector<float> heights(static_cast<size_t>(maxX - minX + 1) * (maxZ - minZ + 1));
+    mHeights.Read(samples, heights.data());
+    bool changed = false;
+    float* height = heights.data();
+    for (int sz = minZ; sz <= maxZ; sz++) {
+        for (int sx = minX; sx <= maxX; sx++, height++) {
+            float dx = sx * mCellWidth - x;
+            float dz = sz * mCellLength - z;
+            float distance = std::sqrt(dx * dx + dz * dz);
+            float offset = 0.0f;
+            if (distance < radius) {
+                float t = 1.0f - distance * distance / (radius * radius);
+                offset = -depth * t * t;
+            } else if (distance < outer) {
+                float t = std::sin(3.14159265358979323846f * (distance - radius) / rimWidth);
+                offset = rimHeight * t * t;
+            }
+            if (offset == 0.0f) {
+                continue;
+            }
             
-            // Check velocities for safe landing
-            const float safeVelocity = 2.0f; // m/s
-            if (std::abs(landerVel[0]) <= safeVelocity && 
-                landerVel[1] >= 0 && landerVel[1] <= safeVelocity &&
-                std::abs(landerVel[2]) <= safeVelocity) {
-                return true;
+            float reshaped = std::min(mMaxHeight, std::max(mMinHeight, *height + offset));
+            if (reshaped != *height) {
+                *height = reshaped;
+                changed = true;
+            }
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    StoreHeights(samples, heights.data());
+}
+
+void Terrain::WriteHeights(const HeightGridRegion& region, const float* heights) {
+    if (!HasHeightGrid() || region.minX < 0 || region.minZ < 0 || region.maxX > mGridSize ||
+        region.maxZ > mGridSize || region.minX > region.maxX || region.minZ > region.maxZ) {
+        return;
+    }
+    PROFILE_ZONE("Terrain Write Heights");
+    
+    std::vector<float> clamped(heights, heights + static_cast<size_t>(region.maxX - region.minX + 1) *
+                                                  (region.maxZ - region.minZ + 1));
+    for (float& height : clamped) {
+        height = std::min(mMaxHeight, std::max(mMinHeight, height));
+    }
+    StoreHeights(region, clamped.data());
+}
+
+void Terrain::StoreHeights(HeightGridRegion samples, const float* heights) {
+    samples = mHeights.Write(samples, heights);
+    
+    // Every cell touching a changed sample, re-quantized tiles included
+    TerrainDirtyRegion cells = {
+        std::max(0, samples.minX - 1), std::max(0, samples.minZ - 1),
+        std::min(mGridSize, samples.maxX + 1), std::min(mGridSize, samples.maxZ + 1)
+    };
+    BuildNormals(cells);
+    BuildHorizons(cells);
+    BuildOcclusion(cells);
+    mHeightPyramid.Update(mHeights, cells.minCellX, cells.minCellZ, cells.maxCellX, cells.maxCellZ);
+    
+    // Pads the edit reached sit lower and steeper now
+    for (LandingPad& pad : mLandingPads3D) {
+        if (pad.cells.minCellX <= cells.maxCellX && cells.minCellX <= pad.cells.maxCellX &&
+            pad.cells.minCellZ <= cells.maxCellZ && cells.minCellZ <= pad.cells.maxCellZ) {
+            MeasureLandingPad3D(pad);
+        }
+    }
+    MarkDirty(cells);
+}
+
+bool Terrain::LoadHeightmap(const char* filename) {
+    PROFILE_ZONE("Terrain Load DEM");
+    
+    // Keep the mapping (and the tile cache) across resets of the same file
+    if (!mDem || mDem->GetFilename() != filename) {
+        mTileCache.reset();
+        mDem.reset(new DemFile());
+        if (!mDem->Open(filename)) {
+            mDem.reset();
+            return false;
+        }
+    }
+    
+    const int gridSize = std::min(kMaxDemGridSize, std::min(mDem->GetWidth(), mDem->GetHeight()) - 1);
+    if (gridSize < kDemLandingPadCells) {
+        LOG_ERROR("DEM is too small for a terrain grid (%dx%d samples): %s",
+                  mDem->GetWidth(), mDem->GetHeight(), filename);
+        return false;
+    }
+    
+    // Only the window's rows are paged in
+    const int stride = gridSize + 1;
+    int firstX = (mDem->GetWidth() - stride) / 2;
+    int firstY = (mDem->GetHeight() - stride) / 2;
+    std::vector<float> heights(static_cast<size_t>(stride) * stride);
+    if (!mDem->ReadRegion(firstX, firstY, stride, stride, 1, heights.data())) {
+        return false;
+    }
+    
+    mGridSize = gridSize;
+    mCellWidth = mDem->GetSampleSpacing();
+    mCellLength = mDem->GetSampleSpacing();
+    mWidth = static_cast<int>(gridSize * mCellWidth);
+    mLength = static_cast<int>(gridSize * mCellLength);
+    mOriginX = 0.0f;
+    mOriginZ = 0.0f;
+    mOriginShiftX = 0;
+    mOriginShiftZ = 0;
+    mDemBaseX = mDemWindowX = firstX;
+    mDemBaseY = mDemWindowY = firstY;
+    
+    // Landing pad: the block of cells with the least relief near the
+    // center, where the lander starts
+    const int padCells = kDemLandingPadCells;
+    const int searchRadius = std::max(gridSize / 8, 1);
+    int padX = (gridSize - padCells) / 2;
+    int padZ = padX;
+    float padRelief = -1.0f;
+    for (int z = std::max(0, padZ - searchRadius); z <= std::min(gridSize - padCells, padZ + searchRadius); z++) {
+        for (int x = std::max(0, padX - searchRadius); x <= std::min(gridSize - padCells, padX + searchRadius); x++) {
+            float low = heights[z * stride + x];
+            float high = low;
+            for (int sz = z; sz <= z + padCells; sz++) {
+                for (int sx = x; sx <= x + padCells; sx++) {
+                    low = std::min(low, heights[sz * stride + sx]);
+                    high = std::max(high, heights[sz * stride + sx]);
+                }
+            }
+            if (padRelief < 0.0f || high - low < padRelief) {
+                padRelief = high - low;
+                padX = x;
+                padZ = z;
+            }
+        }
+    }
+    mDemPadX = firstX + padX;
+    mDemPadY = firstY + padZ;
+    
+    // Heights are kept relative to the pad's mean height, so the lander
+    // starts at the same height above it as on generated terrain
+    float padHeight = 0.0f;
+    for (int sz = padZ; sz <= padZ + padCells; sz++) {
+        for (int sx = padX; sx <= padX + padCells; sx++) {
+            padHeight += heights[sz * stride + sx];
+        }
+    }
+    mDemHeightOffset = padHeight / static_cast<float>((padCells + 1) * (padCells + 1));
+    for (float& height : heights) {
+        height -= mDemHeightOffset;
+    }
+    ApplyDemLandingPad(heights);
+    
+    TerrainDirtyRegion allCells = {0, 0, gridSize, gridSize};
+    BuildNormals(allCells);
+    BuildHorizons(allCells);
+    BuildOcclusion(allCells);
+    BuildLandingPads3D();
+    
+    BeginLayout();
+    TrackMemory();
+    MarkDirty(allCells);
+    
+    // Streaming only pays off when the raster is larger than the window.
+    // The cache must at least hold every tile one window can touch.
+    if (!mTileCache && (mDem->GetWidth() > stride || mDem->GetHeight() > stride)) {
+        int windowTiles = (stride + DemFile::kTileSize - 1) / DemFile::kTileSize + 1;
+        mTileCache.reset(new TerrainTileCache(mDem.get(), mTileCacheBudget, windowTiles * windowTiles));
+    }
+    
+    LOG_INFO("Loaded %dx%d DEM cells (%d x %d m, heights %.1f to %.1f m, pad relief %.2f m) from %s",
+             gridSize, gridSize, mWidth, mLength, mMinHeight, mMaxHeight, padRelief, filename);
+    return true;
+}
+
+void Terrain::ApplyDemLandingPad(std::vector<float>& heights) {
+    const int stride = mGridSize + 1;
+    const int padX = mDemPadX - mDemWindowX;
+    const int padZ = mDemPadY - mDemWindowY;
+    
+    // The pad sits at height 0 (see mDemHeightOffset), wherever part of it
+    // is inside the window
+    mLandingPadCells.assign(static_cast<size_t>(mGridSize) * mGridSize, 0);
+    for (int z = std::max(padZ, 0); z <= std::min(padZ + kDemLandingPadCells, mGridSize); z++) {
+        for (int x = std::max(padX, 0); x <= std::min(padX + kDemLandingPadCells, mGridSize); x++) {
+            heights[z * stride + x] = 0.0f;
+            if (x < padX + kDemLandingPadCells && z < padZ + kDemLandingPadCells &&
+                x < mGridSize && z < mGridSize) {
+                mLandingPadCells[z * mGridSize + x] = 1;
+            }
+        }
+    }
+    
+    mHeights.Assign(stride, heights.data());
+    mMinHeight = mHeights.GetMinHeight();
+    mMaxHeight = mHeights.GetMaxHeight();
+    mHeightPyramid.Build(mHeights);
+}
+
+bool Terrain::MoveDemWindow(int windowX, int windowY) {
+    PROFILE_ZONE("Terrain Move Window");
+    
+    const int stride = mGridSize + 1;
+    const int tileSize = DemFile::kTileSize;
+    const int firstTileX = windowX / tileSize;
+    const int firstTileY = windowY / tileSize;
+    const int tilesX = (windowX + stride - 1) / tileSize - firstTileX + 1;
+    const int tilesY = (windowY + stride - 1) / tileSize - firstTileY + 1;
+    
+    // All or nothing: a half-updated grid would tear
+    std::vector<TerrainTileData> tiles(static_cast<size_t>(tilesX) * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            TerrainTileData& tile = tiles[ty * tilesX + tx];
+            tile = mTileCache->GetTile(firstTileX + tx, firstTileY + ty);
+            if (!tile) {
+                return false;
+            }
+        }
+    }
+    
+    // Copy tile row runs into the window's heights
+    std::vector<float> heights(static_cast<size_t>(stride) * stride);
+    for (int z = 0; z < stride; z++) {
+        int sampleY = windowY + z;
+        int ty = sampleY / tileSize - firstTileY;
+        int rowInTile = sampleY % tileSize;
+        int x = 0;
+        while (x < stride) {
+            int sampleX = windowX + x;
+            int tx = sampleX / tileSize - firstTileX;
+            int columnInTile = sampleX % tileSize;
+            int run = std::min(stride - x, tileSize - columnInTile);
+            const float* source = tiles[ty * tilesX + tx]->data() + rowInTile * tileSize + columnInTile;
+            float* destination = &heights[z * stride + x];
+            for (int i = 0; i < run; i++) {
+                destination[i] = source[i] - mDemHeightOffset;
+            }
+            x += run;
+        }
+    }
+    
+    mDemWindowX = windowX;
+    mDemWindowY = windowY;
+    mOriginX = (windowX - mDemBaseX - mOriginShiftX) * mCellWidth;
+    mOriginZ = (windowY - mDemBaseY - mOriginShiftZ) * mCellLength;
+    ApplyDemLandingPad(heights);
+    
+    // Crater edits outside the old window's overlap are not carried over
+    TerrainDirtyRegion allCells = {0, 0, mGridSize, mGridSize};
+    BuildNormals(allCells);
+    BuildHorizons(allCells);
+    BuildOcclusion(allCells);
+    BuildLandingPads3D();
+    BeginLayout();
+    MarkDirty(allCells);
+    
+    LOG_DEBUG("Moved terrain window to DEM sample %d,%d (origin %.0f, %.0f m)", windowX, windowY, mOriginX, mOriginZ);
+    return true;
+}
+
+void Terrain::ShiftOrigin(int cellsX, int cellsZ) {
+    if (!HasHeightGrid() || (cellsX == 0 && cellsZ == 0)) {
+        return;
+    }
+    mOriginShiftX += cellsX;
+    mOriginShiftZ += cellsZ;
+    
+    // Computed from whole cells each time, so shifts never accumulate rounding
+    const int gridX = mDem ? mDemWindowX - mDemBaseX : 0;
+    const int gridZ = mDem ? mDemWindowY - mDemBaseY : 0;
+    mOriginX = (gridX - mOriginShiftX) * mCellWidth;
+    mOriginZ = (gridZ - mOriginShiftZ) * mCellLength;
+    for (LandingPad& pad : mLandingPads3D) {
+        pad.minX = mOriginX + pad.cells.minCellX * mCellWidth;
+        pad.maxX = mOriginX + pad.cells.maxCellX * mCellWidth;
+        pad.minZ = mOriginZ + pad.cells.minCellZ * mCellLength;
+        pad.maxZ = mOriginZ + pad.cells.maxCellZ * mCellLength;
+    }
+    BeginLayout();
+    
+    LOG_DEBUG("Shifted terrain origin by %d,%d cells (origin %.0f, %.0f m)", cellsX, cellsZ, mOriginX, mOriginZ);
+}
+
+void Terrain::CollectStreamingTiles(const float* position, const float* velocity, float gravity, int windowX,
+                                    int windowY, std::vector<uint64_t>& keys) const {
+    const int stride = mGridSize + 1;
+    const int tileSize = DemFile::kTileSize;
+    
+    auto addWindow = [&](int x, int y) {
+        for (int ty = y / tileSize; ty <= (y + stride - 1) / tileSize; ty++) {
+            for (int tx = x / tileSize; tx <= (x + stride - 1) / tileSize; tx++) {
+                uint64_t key = TerrainTileCache::TileKey(tx, ty);
+                if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+                    keys.push_back(key);
+                }
             }
         }
+    };
+    auto windowAround = [&](float x, float z, int& wx, int& wy) {
+        int sampleX = mDemBaseX + mOriginShiftX + static_cast<int>(std::floor(x / mCellWidth));
+        int sampleY = mDemBaseY + mOriginShiftZ + static_cast<int>(std::floor(z / mCellLength));
+        wx = std::min(std::max(sampleX - mGridSize / 2, 0), mDem->GetWidth() - stride);
+        wy = std::min(std::max(sampleY - mGridSize / 2, 0), mDem->GetHeight() - stride);
+    };
+    
+    // The window about to be needed first, then the windows centered on
+    // points of the unpowered path until it drops below the terrain
+    keys.clear();
+    addWindow(windowX, windowY);
+    for (int step = 1; step <= kStreamLookaheadSteps; step++) {
+        float t = kStreamLookaheadSeconds * step / kStreamLookaheadSteps;
+        int wx, wy;
+        windowAround(position[0] + velocity[0] * t, position[2] + velocity[2] * t, wx, wy);
+        addWindow(wx, wy);
+        if (position[1] + velocity[1] * t - 0.5f * gravity * t * t < mMinHeight) {
+            break;
+        }
+    }
+}
+
+void Terrain::UpdateStreaming(const float* position, const float* velocity, float gravity) {
+    if (!mTileCache || !HasHeightGrid()) {
+        return;
+    }
+    
+    // Recenter on the lander once it is within a quarter window of an edge
+    int windowX = mDemWindowX;
+    int windowY = mDemWindowY;
+    float localX = (position[0] - mOriginX) / mCellWidth;
+    float localZ = (position[2] - mOriginZ) / mCellLength;
+    const float margin = mGridSize / 4.0f;
+    if (localX < margin || localX > mGridSize - margin || localZ < margin || localZ > mGridSize - margin) {
+        const int stride = mGridSize + 1;
+        int sampleX = mDemWindowX + static_cast<int>(std::floor(localX));
+        int sampleY = mDemWindowY + static_cast<int>(std::floor(localZ));
+        windowX = std::min(std::max(sampleX - mGridSize / 2, 0), mDem->GetWidth() - stride);
+        windowY = std::min(std::max(sampleY - mGridSize / 2, 0), mDem->GetHeight() - stride);
+    }
+    
+    std::vector<uint64_t> keys;
+    CollectStreamingTiles(position, velocity, gravity, windowX, windowY, keys);
+    mTileCache->Prefetch(keys);
+    
+    // Retried every update until the loader has caught up
+    if (windowX != mDemWindowX || windowY != mDemWindowY) {
+        MoveDemWindow(windowX, windowY);
+    }
+}
+
+bool Terrain::SaveCache(const char* filename, const char* source) const {
+    if (!HasHeightGrid() || !HasOcclusionMap() ||
+        mLandingPadCells.size() != static_cast<size_t>(mGridSize) * mGridSize) {
+        return false;
+    }
+    
+    TerrainCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kTerrainCacheMagic, sizeof(header.magic));
+    header.version = kTerrainCacheVersion;
+    header.headerSize = sizeof(TerrainCacheHeader);
+    header.gridSize = mGridSize;
+    header.width = mWidth;
+    header.length = mLength;
+    header.height = mHeight;
+    header.cellWidth = mCellWidth;
+    header.cellLength = mCellLength;
+    header.minHeight = mMinHeight;
+    header.maxHeight = mMaxHeight;
+    std::snprintf(header.source, sizeof(header.source), "%s", source);
+    
+    size_t heightBytes = mHeights.GetSampleCount() * sizeof(uint16_t);
+    size_t tileRangeBytes = mHeights.GetTileRanges().size() * sizeof(HeightTileRange);
+    size_t normalBytes = mNormalData.size() * sizeof(float);
+    size_t padBytes = mLandingPadCells.size();
+    size_t occlusionBytes = mOcclusionData.size();
+    size_t horizonBytes = HasHorizonMap() ? mHorizonData.size() : 0;
+    header.heightOffset = AlignCacheOffset(sizeof(header));
+    header.tileRangeOffset = AlignCacheOffset(header.heightOffset + heightBytes);
+    header.normalOffset = AlignCacheOffset(header.tileRangeOffset + tileRangeBytes);
+    header.padOffset = AlignCacheOffset(header.normalOffset + normalBytes);
+    header.occlusionOffset = AlignCacheOffset(header.padOffset + padBytes);
+    header.fileSize = header.occlusionOffset + occlusionBytes;
+    if (horizonBytes > 0) {
+        header.horizonOffset = AlignCacheOffset(header.fileSize);
+        header.fileSize = header.horizonOffset + horizonBytes;
+    }
+    
+    FILE* file = std::fopen(filename, "wb");
+    if (!file) {
+        LOG_ERROR("Failed to create terrain cache: %s", filename);
+        return false;
+    }
+    
+    static const char kZeros[16] = {};
+    auto writeAt = [&](uint64_t offset, const void* data, size_t size) {
+        long position = std::ftell(file);
+        bool ok = position >= 0 && offset >= static_cast<uint64_t>(position) &&
+                  std::fwrite(kZeros, 1, offset - position, file) == offset - position;
+        return ok && std::fwrite(data, 1, size, file) == size;
+    };
+    bool written = writeAt(0, &header, sizeof(header)) &&
+                   writeAt(header.heightOffset, mHeights.GetSamples().data(), heightBytes) &&
+                   writeAt(header.tileRangeOffset, mHeights.GetTileRanges().data(), tileRangeBytes) &&
+                   writeAt(header.normalOffset, mNormalData.data(), normalBytes) &&
+                   writeAt(header.padOffset, mLandingPadCells.data(), padBytes) &&
+                   writeAt(header.occlusionOffset, mOcclusionData.data(), occlusionBytes) &&
+                   (horizonBytes == 0 || writeAt(header.horizonOffset, mHorizonData.data(), horizonBytes));
+    written = std::fclose(file) == 0 && written;
+    if (!written) {
+        LOG_ERROR("Failed to write terrain cache: %s", filename);
+        std::remove(filename);
+        return false;
+    }
+    
+    LOG_INFO("Wrote terrain cache %s (%llu KB)", filename,
+             static_cast<unsigned long long>(header.fileSize >> 10));
+    return true;
+}
+
+bool Terrain::LoadCache(const char* filename, const char* source) {
+    auto start = std::chrono::steady_clock::now();
+    
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat fileInfo;
+    if (fstat(file, &fileInfo) != 0 || static_cast<size_t>(fileInfo.st_size) < sizeof(TerrainCacheHeader)) {
+        close(file);
+        return false;
+    }
+    size_t fileSize = static_cast<size_t>(fileInfo.st_size);
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map terrain cache: %s", filename);
+        return false;
+    }
+    
+    // Everything is checked against the header before any state changes
+    const unsigned char* bytes = static_cast<const unsigned char*>(mapping);
+    TerrainCacheHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    header.source[sizeof(header.source) - 1] = '\0';
+    const size_t gridSize = header.gridSize > 0 ? static_cast<size_t>(header.gridSize) : 0;
+    const size_t sampleCount = (gridSize + 1) * (gridSize + 1);
+    const size_t tilesPerSide = (gridSize + HeightGrid::kTileSize) / HeightGrid::kTileSize;
+    const size_t heightBytes = sampleCount * sizeof(uint16_t);
+    const size_t tileRangeBytes = tilesPerSide * tilesPerSide * sizeof(HeightTileRange);
+    const size_t normalBytes = 3 * sampleCount * sizeof(float);
+    const size_t padBytes = gridSize * gridSize;
+    const size_t occlusionBytes = sampleCount;
+    const size_t horizonBytes = header.horizonOffset != 0 ? kHorizonDirections * sampleCount : 0;
+    const char* problem = nullptr;
+    if (std::memcmp(header.magic, kTerrainCacheMagic, sizeof(header.magic)) != 0) {
+        problem = "not a terrain cache";
+    } else if (header.version != kTerrainCacheVersion || header.headerSize != sizeof(TerrainCacheHeader)) {
+        problem = "written by a different version";
+    } else if (std::strcmp(header.source, source) != 0) {
+        problem = "built from different terrain";
+    } else if (gridSize == 0 || header.fileSize != fileSize ||
+               header.heightOffset + heightBytes > fileSize || header.tileRangeOffset + tileRangeBytes > fileSize ||
+               header.normalOffset + normalBytes > fileSize ||
+               header.padOffset + padBytes > fileSize || header.occlusionOffset + occlusionBytes > fileSize ||
+               header.horizonOffset + horizonBytes > fileSize) {
+        problem = "truncated or corrupt";
+    }
+    if (problem) {
+        LOG_INFO("Ignoring terrain cache %s (%s)", filename, problem);
+        munmap(mapping, fileSize);
+        return false;
+    }
+    
+    // Plain copies; the arrays are stored in their in-memory layout
+    mTileCache.reset();
+    mDem.reset();
+    mGridSize = header.gridSize;
+    mWidth = header.width;
+    mLength = header.length;
+    mHeight = header.height;
+    mCellWidth = header.cellWidth;
+    mCellLength = header.cellLength;
+    mMinHeight = header.minHeight;
+    mMaxHeight = header.maxHeight;
+    mOriginX = 0.0f;
+    mOriginZ = 0.0f;
+    mOriginShiftX = 0;
+    mOriginShiftZ = 0;
+    mHeights.Restore(header.gridSize + 1, reinterpret_cast<const uint16_t*>(bytes + header.heightOffset),
+                     reinterpret_cast<const HeightTileRange*>(bytes + header.tileRangeOffset));
+    mHeightPyramid.Build(mHeights);
+    mNormalData.resize(normalBytes / sizeof(float));
+    std::memcpy(mNormalData.data(), bytes + header.normalOffset, normalBytes);
+    mLandingPadCells.resize(padBytes);
+    std::memcpy(mLandingPadCells.data(), bytes + header.padOffset, padBytes);
+    mOcclusionData.assign(bytes + header.occlusionOffset, bytes + header.occlusionOffset + occlusionBytes);
+    if (mBakeHorizons && horizonBytes > 0) {
+        mHorizonData.assign(bytes + header.horizonOffset, bytes + header.horizonOffset + horizonBytes);
+    } else {
+        mHorizonData.clear();
+        BuildHorizons({0, 0, mGridSize, mGridSize});
+    }
+    munmap(mapping, fileSize);
+    BuildLandingPads3D();
+    
+    BeginLayout();
+    TrackMemory();
+    MarkDirty({0, 0, mGridSize, mGridSize});
+    mCacheSource = { filename, header.heightOffset, header.tileRangeOffset };
+    mCacheSourceVersion = mVersion;
+    
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Loaded %dx%d terrain cells from cache %s in %.2f ms", mGridSize, mGridSize, filename, ms);
+    return true;
+}
+
+bool Terrain::GetCacheSource(TerrainCacheSource& source) const {
+    if (mCacheSourceVersion == 0 || mVersion != mCacheSourceVersion) {
+        return false;
+    }
+    source = mCacheSource;
+    return true;
+}
+
+bool Terrain::LocateCell(float x, float z, int& cellX, int& cellZ, float& u, float& v) const {
+    if (mGridSize <= 0 || mCellWidth <= 0.0f || mCellLength <= 0.0f) {
+        return false;
+    }
+    
+    // Convert to grid space
+    float gx = (x - mOriginX) / mCellWidth;
+    float gz = (z - mOriginZ) / mCellLength;
+    if (gx < 0.0f || gz < 0.0f || gx > mGridSize || gz > mGridSize) {
+        return false;
+    }
+    
+    // Integer division finds the cell; the far edge belongs to the last cell
+    cellX = std::min(static_cast<int>(gx), mGridSize - 1);
+    cellZ = std::min(static_cast<int>(gz), mGridSize - 1);
+    u = gx - cellX;
+    v = gz - cellZ;
+    return true;
+}
+
+bool Terrain::SampleHeight(float x, float z, float& height) const {
+    int cellX, cellZ;
+    float u, v;
+    if (!LocateCell(x, z, cellX, cellZ, u, v)) {
+        return false;
+    }
+    
+    // Corner heights, matching the triangulation in Generate3D, decoded
+    // together
+    float corners[4];
+    mHeights.GetCell(cellX, cellZ, corners);
+    float h1 = corners[0];  // (x,   z)
+    float h2 = corners[1];  // (x+1, z)
+    float h3 = corners[2];  // (x,   z+1)
+    float h4 = corners[3];  // (x+1, z+1)
+    
+    // Each cell is split along the (x+1, z) - (x, z+1) diagonal;
+    // barycentric interpolation inside whichever triangle contains the point
+    if (u + v <= 1.0f) {
+        height = h1 + u * (h2 - h1) + v * (h3 - h1);
+    } else {
+        height = h4 + (1.0f - u) * (h3 - h4) + (1.0f - v) * (h2 - h4);
+    }
+    return true;
+}
+
+bool Terrain::RayCast(const float* origin, const float* direction, float maxT, float& t) const {
+    if (!HasHeightGrid()) {
+        return false;
+    }
+    
+    // Grid space: x and z in cells, heights unchanged, so t carries over
+    const float gridOrigin[3] = {
+        (origin[0] - mOriginX) / mCellWidth, origin[1], (origin[2] - mOriginZ) / mCellLength
+    };
+    const float gridDirection[3] = { direction[0] / mCellWidth, direction[1], direction[2] / mCellLength };
+    return mHeightPyramid.RayCast(mHeights, gridOrigin, gridDirection, maxT, t);
+}
+
+bool Terrain::GetMaxHeight(float minX, float minZ, float maxX, float maxZ, float& height) const {
+    if (!HasHeightGrid() || mHeightPyramid.GetLevelCount() == 0) {
+        return false;
+    }
+    
+    // Cells the range touches, in grid space
+    const float gridMinX = std::floor((minX - mOriginX) / mCellWidth);
+    const float gridMinZ = std::floor((minZ - mOriginZ) / mCellLength);
+    const float gridMaxX = std::ceil((maxX - mOriginX) / mCellWidth);
+    const float gridMaxZ = std::ceil((maxZ - mOriginZ) / mCellLength);
+    const float gridSize = static_cast<float>(mGridSize);
+    if (gridMaxX <= 0.0f || gridMaxZ <= 0.0f || gridMinX >= gridSize || gridMinZ >= gridSize) {
+        return false;
+    }
+    height = mHeightPyramid.GetMaxHeight(static_cast<int>(std::max(gridMinX, 0.0f)),
+                                         static_cast<int>(std::max(gridMinZ, 0.0f)),
+                                         static_cast<int>(std::min(gridMaxX, gridSize)),
+                                         static_cast<int>(std::min(gridMaxZ, gridSize)));
+    return true;
+}
+
+bool Terrain::IsLandingPadAt(float x, float z) const {
+    int cellX, cellZ;
+    float u, v;
+    if (!LocateCell(x, z, cellX, cellZ, u, v)) {
+        return false;
+    }
+    return mLandingPadCells[cellZ * mGridSize + cellX] != 0;
+}
+
+const LandingPad* Terrain::FindLandingPad3D(float x, float z) const {
+    int cellX, cellZ;
+    float u, v;
+    if (!LocateCell(x, z, cellX, cellZ, u, v) || !mLandingPadCells[cellZ * mGridSize + cellX]) {
+        return nullptr;
+    }
+    for (const LandingPad& pad : mLandingPads3D) {
+        if (cellX >= pad.cells.minCellX && cellX < pad.cells.maxCellX &&
+            cellZ >= pad.cells.minCellZ && cellZ < pad.cells.maxCellZ) {
+            return &pad;
+        }
+    }
+    return nullptr;
+}
+
+bool Terrain::CheckCollision3D(Lander* lander, float& collisionHeight) {
+    if (!lander) return false;
+    
+    // Get lander bottom position in physics units (meters)
+    const float* landerPos = lander->GetPosition();
+    float landerHeight = lander->GetHeight().Value();
+    float landerBottomY = landerPos[1] - landerHeight / 2;
+    
+    // Exact terrain height directly below the lander
+    float terrainHeight;
+    if (!SampleHeight(landerPos[0], landerPos[2], terrainHeight)) {
+        return false;
+    }
+    
+    // Check if lander has collided with terrain
+    if (landerBottomY <= terrainHeight) {
+        collisionHeight = terrainHeight;
+        return true;
     }
     
     return false;
 }
+
+bool Terrain::IsValidLanding3D(Lander* lander) {
+    if (!lander) return false;
+    
+    const float* landerPos = lander->GetPosition();
+    const float* landerVel = lander->GetVelocity();
+    
+    // Check if lander is on a landing pad
+    if (!FindLandingPad3D(landerPos[0], landerPos[2])) {
+        return false;
+    }
+    
+    // Check velocities for safe landing
+    const float safeVelocity = 2.0f; // m/s
+    return std::abs(landerVel[0]) <= safeVelocity && 
+           landerVel[1] >= 0 && landerVel[1] <= safeVelocity &&
+           std::abs(landerVel[2]) <= safeVelocity;
+}
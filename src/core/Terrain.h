@@ -3,12 +3,23 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 #include "Entity.h"
+#include "HeightGrid.h"
+#include "HeightPyramid.h"
 
 // Forward declare classes we need
 class Renderer;
 class Lander;
+class JobSystem;
+class DemFile;
+class TerrainTileCache;
+class Terrain;
 
 // Simple 2D terrain segment (coordinates in screen pixels)
 struct TerrainSegment {
@@ -17,6 +28,15 @@ struct TerrainSegment {
     bool isLandingPad;  // Whether this segment is a valid landing zone
 };
 
+// Where the current grid's quantized heights and tile ranges sit in the
+// cache file it was loaded from, for loaders that read them straight into
+// GPU memory
+struct TerrainCacheSource {
+    std::string filename;
+    uint64_t heightOffset;      // (gridSize + 1)^2 uint16_t samples, row-major
+    uint64_t tileRangeOffset;   // HeightTileRange per HeightGrid tile, row-major
+};
+
 // 3D terrain triangle (coordinates in physics units - meters)
 struct TerrainTriangle {
     float vertices[9];  // 3 vertices x 3 coordinates (x, y, z)
@@ -24,59 +44,488 @@ struct TerrainTriangle {
     bool isLandingPad;  // Whether this triangle is a valid landing zone
 };
 
+// The 3D grid's triangles, built from the height grid as they are read:
+// two per cell in row-major cell order. Nothing is stored, so a view always
+// sees the terrain's current heights; it is valid while the terrain lives
+// and its grid keeps its size.
+class TerrainTriangleView {
+public:
+    class Iterator {
+    public:
+        Iterator(const Terrain* terrain, size_t index) : mTerrain(terrain), mIndex(index) {}
+        inline TerrainTriangle operator*() const;
+        Iterator& operator++() { ++mIndex; return *this; }
+        bool operator==(const Iterator& other) const { return mIndex == other.mIndex; }
+        bool operator!=(const Iterator& other) const { return mIndex != other.mIndex; }
+    
+    private:
+        const Terrain* mTerrain;
+        size_t mIndex;
+    };
+    
+    TerrainTriangleView(const Terrain* terrain, size_t count) : mTerrain(terrain), mCount(count) {}
+    
+    size_t size() const { return mCount; }
+    bool empty() const { return mCount == 0; }
+    inline TerrainTriangle operator[](size_t index) const;
+    Iterator begin() const { return Iterator(mTerrain, 0); }
+    Iterator end() const { return Iterator(mTerrain, mCount); }
+
+private:
+    const Terrain* mTerrain;
+    size_t mCount;
+};
+
+// Rectangle of 3D grid cells, min inclusive and max exclusive
+struct TerrainDirtyRegion {
+    int minCellX, minCellZ;
+    int maxCellX, maxCellZ;
+};
+
+// A landing pad as registered when the terrain is built: one merged run of
+// pad segments in 2D, one connected block of pad cells in 3D. Bounds and
+// heights are in meters; 2D pads have minZ = maxZ = 0.
+struct LandingPad {
+    int id;             // Index in GetLandingPads2D()/GetLandingPads3D()
+    float minX, maxX;
+    float minZ, maxZ;
+    float height;       // Mean surface height
+    float slope;        // Steepest surface slope on the pad, rise over run
+    float difficulty;   // Score multiplier, Rules::GetPadDifficulty
+    TerrainDirtyRegion cells;   // 3D grid cells the pad's bounds cover
+};
+
+// Grid Generate3D builds for given dimensions: sample (x, z) of the
+// (gridSize + 1)^2 heights is noise at (x * cellWidth, z * cellLength),
+// eased to baseHeight over blendCells around the landing pad cells
+// [padMin, padMax) on both axes
+struct TerrainGeneratedLayout {
+    int gridSize;
+    float cellWidth;
+    float cellLength;
+    int padMin;
+    int padMax;
+    float blendCells;
+    float baseHeight;
+};
+
 // Terrain class - handles generation and collision detection
 class Terrain : public Entity {
 public:
-    Terrain();
-    virtual ~Terrain() = default;
+    explicit Terrain(EntityStore* store = nullptr);
+    ~Terrain();
     
-    // Implement Entity methods
-    void Update(float deltaTime) override;
-    void Render(Renderer* renderer) override;
+    void Update(float deltaTime);
+    void Render(Renderer* renderer);
     
-    // 2D Terrain methods
+    // 2D Terrain methods. width x height is the window; the terrain spans
+    // the 2D world (SetWorld2D), so GetWidth() may be wider.
     void Generate2D(int width, int height);
+    
+    // A scrolling 2D world width pixels across in segmentCount segments
+    // (0 = one every kDefaultSegmentPixels2D pixels): one continuous
+    // polyline over the generator's noise, with a landing pad under the
+    // middle of every window's width. A width no wider than the window
+    // keeps the window's ten segments. Takes effect at the next Generate2D.
+    static constexpr int kDefaultSegmentPixels2D = 2;
+    void SetWorld2D(int width, int segmentCount) {
+        mWorldWidth2D = width;
+        mWorldSegments2D = segmentCount;
+    }
     bool CheckCollision2D(Lander* lander, float& collisionHeight);
     bool IsValidLanding2D(Lander* lander);
     
-    // 3D Terrain methods
-    void Generate3D(int width, int length, int height);
-    void LoadHeightmap(const char* filename);
+    // Pad under x meters, or null; a binary search over the 2D pads
+    const LandingPad* FindLandingPad2D(float x) const;
+    
+    // Surface height in meters under x meters; false outside the terrain
+    bool SampleHeight2D(float x, float& height) const;
+    
+    // First point where the lander's bottom center, moving in a straight
+    // line from (fromX, fromY) to (toX, toY) in meters, passes down through
+    // the surface. hitFraction is how far along the move that is [0, 1],
+    // collisionHeight the surface height there in meters. Catches the
+    // crossings CheckCollision2D misses when a step carries the lander
+    // through a segment.
+    bool SweepCollision2D(float fromX, float fromY, float toX, float toY,
+                          float& hitFraction, float& collisionHeight) const;
+    
+    // 3D Terrain methods. heights, if given, are the finished samples of
+    // GetGeneratedLayout() from another generator (e.g. the GPU); otherwise
+    // they are generated here.
+    void Generate3D(int width, int length, int height, const float* heights = nullptr);
+    TerrainGeneratedLayout GetGeneratedLayout(int width, int length, int height) const;
+    
+    // Seed for Generate2D/Generate3D; the same seed always gives the same
+    // terrain, whatever the worker count
+    void SetSeed(uint32_t seed) { mSeed = seed; }
+    uint32_t GetSeed() const { return mSeed; }
+    
+    // Cells per side of generated 3D terrain
+    void SetGeneratedGridSize(int cells) { mGeneratedGridSize = std::max(cells, 1); }
+    
+    // Build the 3D grid from a PDS elevation raster (e.g. a LOLA LDEM .IMG
+    // or its .LBL). The file stays mapped and only a window of up to
+    // kMaxDemGridSize cells around its center is read, at native
+    // resolution. The flattest spot near the center becomes the landing
+    // pad at height 0. Returns false if the file can't be used.
+    bool LoadHeightmap(const char* filename);
+    
+    // Streaming over a loaded DEM: prefetch tiles along the ballistic path
+    // from position/velocity on the tile cache's loader thread, and move
+    // the grid window once the lander nears its edge and the tiles it needs
+    // are resident. A move is a layout change (see GetLayoutVersion()).
+    // Never blocks on a load; does nothing for generated terrain.
+    void UpdateStreaming(const float* position, const float* velocity, float gravity);
+    void SetTileCacheBudget(size_t bytes) { mTileCacheBudget = bytes; }
+    
+    // Binary snapshot of the 3D grid: heights, landing pad mask, the
+    // collision triangles with their normals, the ambient occlusion and the
+    // horizon map if baked, stored as raw arrays so a load is one mmap plus
+    // copies. source identifies what the grid was built from; LoadCache
+    // fails if it differs, or if the file was written by a different format
+    // version or build. A file without a horizon map is baked on load when
+    // SetHorizonMaps(true) asks for one.
+    bool SaveCache(const char* filename, const char* source) const;
+    bool LoadCache(const char* filename, const char* source);
+    
+    // The cache file the grid came from, while the grid is unchanged since
+    // LoadCache; false otherwise
+    bool GetCacheSource(TerrainCacheSource& source) const;
     bool CheckCollision3D(Lander* lander, float& collisionHeight);
     bool IsValidLanding3D(Lander* lander);
     
+    // O(1) height query on the 3D height grid (x, z in meters). Interpolates
+    // within the grid cell's triangle; returns false outside the terrain.
+    bool SampleHeight(float x, float z, float& height) const;
+    
+    // First point where origin + t * direction (meters; direction need not
+    // be unit length) meets the 3D surface for t in [0, maxT], as
+    // SampleHeight interpolates it. Blocks of the min/max height pyramid the
+    // ray passes above are skipped whole, so a ray that clears the terrain
+    // costs O(log n). False on a miss, off the grid or without a height grid.
+    bool RayCast(const float* origin, const float* direction, float maxT, float& t) const;
+    
+    // Height nothing on the 3D surface over [minX, maxX] x [minZ, maxZ]
+    // (meters) rises above, from the same pyramid in O(log n): never under
+    // the true highest point, at most a few blocks' worth over it. False if
+    // the range is entirely off the grid or there is no height grid.
+    bool GetMaxHeight(float minX, float minZ, float maxX, float maxZ, float& height) const;
+    bool IsLandingPadAt(float x, float z) const;
+    
+    // Pad whose cells hold (x, z) in meters, or null; one pad flag read,
+    // then a scan of the pads' cell bounds
+    const LandingPad* FindLandingPad3D(float x, float z) const;
+    
+    // Dig a crater of the given radius and depth around (x, z) in meters:
+    // a bowl, and a raised rim out to kCraterRimScale radii holding part of
+    // what it threw out. Heights stay within GetMinHeight()..GetMaxHeight(),
+    // so the physics heightfield bounds stay valid. Only the samples under
+    // it are read and written, and only their tiles re-quantized; the
+    // dirty region then carries it to the heightfield (which reads the
+    // grid in place) and the renderer's height data.
+    static constexpr float kCraterRimScale = 1.5f;
+    void Deform(float x, float z, float radius, float depth);
+    
+    // Replace the heights of region's samples (row-major, the region's width
+    // per row), clamped to GetMinHeight()..GetMaxHeight() so the physics
+    // heightfield bounds stay valid; normals, pads and dirty cells follow
+    // as for a crater
+    void WriteHeights(const HeightGridRegion& region, const float* heights);
+    
+    // Change tracking for consumers that mirror the 3D grid (e.g. GPU buffers).
+    // The version increases with every change; the layout version only when
+    // the grid is regenerated, which may also change its size. Layout
+    // versions are unique across all terrains, so a consumer handed a
+    // different terrain sees a new layout.
+    uint32_t GetVersion() const { return mVersion; }
+    uint32_t GetLayoutVersion() const { return mLayoutVersion; }
+    
+    // Cells changed after sinceVersion; false if there were none. Reports
+    // the whole grid once sinceVersion is older than the kept history.
+    bool GetDirtyRegion(uint32_t sinceVersion, TerrainDirtyRegion& region) const;
+    
+    // Changes whenever the 2D segments do. Versions are unique across all
+    // terrains, so a cache can key on the version alone (0 = no segments).
+    uint32_t GetSegmentsVersion2D() const { return mSegmentsVersion2D; }
+    
     // Terrain accessors
     const std::vector<TerrainSegment>& GetSegments2D() const { return mSegments2D; }
-    const std::vector<TerrainTriangle>& GetTriangles3D() const { return mTriangles3D; }
+    
+    // Levels of detail for drawing the 2D segments, rebuilt with them.
+    // Level 0 is the segments themselves; level k >= 1 their Douglas-Peucker
+    // simplification to within GetLodTolerance2D(k) = 2^(k - 2) pixels.
+    // Every level keeps the vertices of the coarser ones, and the ends of
+    // each run of pad or connected segments, so pads and gaps stay exact.
+    // Only for drawing: collision always uses the full segments.
+    static constexpr int kMaxLodLevels2D = 12;
+    int GetLodLevelCount2D() const { return 1 + static_cast<int>(mLodSegments2D.size()); }
+    const std::vector<TerrainSegment>& GetLodSegments2D(int level) const {
+        return level <= 0 ? mSegments2D : mLodSegments2D[std::min(level, GetLodLevelCount2D() - 1) - 1];
+    }
+    static float GetLodTolerance2D(int level) { return level <= 0 ? 0.0f : std::ldexp(1.0f, level - 2); }
+    
+    // The coarsest level drawn within a pixel at screenScale screen pixels
+    // per terrain pixel
+    int SelectLod2D(float screenScale) const;
+    
+    // First segment of a level ending at or past x pixels (binary search)
+    size_t FindLodSegment2D(int level, float x) const;
+    
+    // Two triangles per cell of the height grid (none without one);
+    // GetTriangle3D builds triangle index (2 * (z * gridSize + x) + 0 or 1)
+    TerrainTriangleView GetTriangles3D() const {
+        return TerrainTriangleView(this, HasHeightGrid() ? 2 * static_cast<size_t>(mGridSize) * mGridSize : 0);
+    }
+    void GetTriangle3D(size_t index, TerrainTriangle& triangle) const;
+    
+    // Height grid accessors (for 3D)
+    bool HasHeightGrid() const {
+        return mGridSize > 0 && mHeights.GetSamplesPerSide() == mGridSize + 1 &&
+               mNormalData.size() == 3 * mHeights.GetSampleCount();
+    }
+    const HeightGrid& GetHeightGrid() const { return mHeights; }
+    const std::vector<float>& GetNormalData() const { return mNormalData; }   // 3 floats per height sample
+    
+    // Horizon map (3D): for each height sample and each of kHorizonDirections
+    // azimuths, the sine of the highest elevation angle at which the terrain
+    // around it blocks the sky, 0 - 255 for 0 - 90 degrees. Direction d
+    // points along (cos, sin) of d * 360 / kHorizonDirections degrees in x,
+    // z. Stored as two planes of four directions each, RGBA per sample in
+    // row-major order, so each plane is one texture slice. A sample is lit
+    // by a sun above its horizon in the sun's azimuth.
+    //
+    // Only baked once SetHorizonMaps(true) asks for it: in parallel over
+    // rows whenever the grid is built, moved or loaded. Edits rebake the
+    // samples they changed; shadows their new relief casts on samples
+    // outside them wait for the next full bake.
+    static constexpr int kHorizonDirections = 8;
+    void SetHorizonMaps(bool enabled);
+    bool HasHorizonMap() const {
+        return HasHeightGrid() && mHorizonData.size() == kHorizonDirections * mHeights.GetSampleCount();
+    }
+    const std::vector<uint8_t>& GetHorizonData() const { return mHorizonData; }
+    
+    // Ambient occlusion (3D): for each height sample, the share of a
+    // cosine-weighted sky the terrain within kOcclusionMaxCells hides, 0 -
+    // 255 for none - all, one byte per sample in row-major order. Taken
+    // from the horizon in kOcclusionDirections azimuths: a slice of sky
+    // whose horizon rises by angle h loses sin^2 h of its light. Always
+    // baked, in parallel over rows, whenever the normals are; edits rebake
+    // the samples they changed, as for the horizon map.
+    static constexpr int kOcclusionDirections = 8;
+    static constexpr int kOcclusionMaxCells = 32;
+    bool HasOcclusionMap() const {
+        return HasHeightGrid() && mOcclusionData.size() == mHeights.GetSampleCount();
+    }
+    const std::vector<uint8_t>& GetOcclusionData() const { return mOcclusionData; }
+    const std::vector<unsigned char>& GetLandingPadCells() const { return mLandingPadCells; }
+    const std::vector<LandingPad>& GetLandingPads3D() const { return mLandingPads3D; }
+    const std::vector<LandingPad>& GetLandingPads2D() const { return mLandingPads2D; }
+    int GetGridSize() const { return mGridSize; }
+    float GetOriginX() const { return mOriginX; }   // World position of grid sample (0, 0)
+    float GetOriginZ() const { return mOriginZ; }
+    
+    // Floating origin (3D): move world (0, 0) by whole cells, which moves
+    // the grid the other way by as much. Heights, pads and everything kept
+    // per cell stay as they are; only the origin and the pads' bounds in
+    // meters change. A layout change. The shift is counted from when the
+    // grid was built, which starts it over at 0.
+    void ShiftOrigin(int cellsX, int cellsZ);
+    int GetOriginShiftX() const { return mOriginShiftX; }
+    int GetOriginShiftZ() const { return mOriginShiftZ; }
+    float GetCellWidth() const { return mCellWidth; }
+    float GetCellLength() const { return mCellLength; }
+    float GetMinHeight() const { return mMinHeight; }
+    float GetMaxHeight() const { return mMaxHeight; }
     
     // Terrain dimensions
     int GetWidth() const { return mWidth; }
     int GetHeight() const { return mHeight; }
     int GetLength() const { return mLength; } // For 3D
     
-    // Physics to screen conversion
-    float GetPixelsPerMeter() const { return mPixelsPerMeter; }
-    void SetPixelsPerMeter(float ppm) { mPixelsPerMeter = ppm; }
+    // Worker pool used to build the 3D mesh (optional)
+    void SetJobSystem(JobSystem* jobSystem) { mJobSystem = jobSystem; }
 
 private:
-    // 2D terrain representation (in screen pixels)
+    // 2D terrain representation (in screen pixels), sorted by x and not
+    // overlapping except at shared end points
     std::vector<TerrainSegment> mSegments2D;
     
-    // 3D terrain representation (in meters)
-    std::vector<TerrainTriangle> mTriangles3D;
+    // Point lookups for the 2D queries. Uniform buckets split the segments'
+    // x range; each holds the first segment reaching into it, so a query
+    // scans one or two segments from there.
+    std::vector<int> mSegmentBuckets2D;
+    float mSegmentIndexMinX;
+    float mSegmentIndexMaxX;
+    float mSegmentBucketScale;  // Buckets per pixel
+    
+    // Landing pad runs: consecutive pad segments at one height merged,
+    // sorted by x
+    std::vector<LandingPad> mLandingPads2D;
+    uint32_t mSegmentsVersion2D;
+    
+    // GetLodSegments2D levels 1 and up
+    std::vector<std::vector<TerrainSegment>> mLodSegments2D;
+    
+    // SetWorld2D
+    int mWorldWidth2D;
+    int mWorldSegments2D;
+    
+    // Heightmap data (for 3D, in meters), (mGridSize + 1)^2 quantized
+    // samples in row-major z, x order. The 3D representation: triangles are
+    // derived from it on demand.
+    HeightGrid mHeights;
+    
+    // Min/max bounds over mHeights for RayCast, kept in step with every change
+    HeightPyramid mHeightPyramid;
     
-    // Heightmap data (for 3D)
-    std::vector<float> mHeightData;
+    // Unit vertex normals, x, y, z per height sample
+    std::vector<float> mNormalData;
+    
+    // GetHorizonData()'s planes, empty unless mBakeHorizons
+    std::vector<uint8_t> mHorizonData;
+    bool mBakeHorizons;
+    
+    // GetOcclusionData(), a byte per height sample
+    std::vector<uint8_t> mOcclusionData;
+    
+    // Landing pad flag per grid cell, mGridSize^2 entries
+    std::vector<unsigned char> mLandingPadCells;
+    
+    // Connected blocks of mLandingPadCells, rebuilt with the flags
+    std::vector<LandingPad> mLandingPads3D;
+    
+    // Height grid layout (for 3D)
+    int mGridSize;      // Cells per side
+    float mCellWidth;   // Cell size along x (meters)
+    float mCellLength;  // Cell size along z (meters)
+    float mMinHeight;   // Height range of the grid (meters)
+    float mMaxHeight;
+    float mOriginX;     // World position of sample (0, 0) (meters)
+    float mOriginZ;
+    int mOriginShiftX;  // Cells ShiftOrigin() has moved world (0, 0) by
+    int mOriginShiftZ;
     
     // Terrain dimensions (in screen pixels for 2D, meters for 3D)
     int mWidth;
     int mHeight;
     int mLength; // For 3D
     
-    // Conversion factor between physics and screen units
-    float mPixelsPerMeter;
+    // Worker pool (not owned, may be null)
+    JobSystem* mJobSystem;
+    
+    // Generated terrain
+    static constexpr int kDefaultGeneratedGridSize = 128;
+    uint32_t mSeed;
+    int mGeneratedGridSize;
+    
+    // Elevation raster behind LoadHeightmap (null for generated terrain)
+    static constexpr int kMaxDemGridSize = 512;
+    static constexpr int kDemLandingPadCells = 4;
+    std::unique_ptr<DemFile> mDem;
+    
+    // Streaming state for a loaded DEM. World (0, 0) is DEM sample
+    // mDemBaseX/Y (the first window) plus the origin shift; the grid
+    // currently starts at sample mDemWindowX/Y. Heights are stored relative
+    // to mDemHeightOffset and the pad block is re-flattened whenever the
+    // window moves.
+    static constexpr float kStreamLookaheadSeconds = 20.0f;
+    static constexpr int kStreamLookaheadSteps = 8;
+    std::unique_ptr<TerrainTileCache> mTileCache;
+    size_t mTileCacheBudget;
+    int mDemBaseX, mDemBaseY;
+    int mDemWindowX, mDemWindowY;
+    int mDemPadX, mDemPadY;     // First pad sample in DEM coordinates
+    float mDemHeightOffset;
+    
+    // Copy the window starting at DEM sample (x, y) from resident tiles into
+    // the grid; false (grid unchanged) if any tile is not loaded yet
+    bool MoveDemWindow(int windowX, int windowY);
+    
+    // Window tiles plus tiles around the projected path, most urgent first
+    void CollectStreamingTiles(const float* position, const float* velocity, float gravity, int windowX,
+                               int windowY, std::vector<uint64_t>& keys) const;
+    
+    // Flatten and mark the landing pad in the window's heights, then
+    // quantize them into the grid and refresh the height range
+    void ApplyDemLandingPad(std::vector<float>& heights);
+    
+    // What LoadCache read the grid from, valid while mVersion is
+    // mCacheSourceVersion (0 = never)
+    TerrainCacheSource mCacheSource;
+    uint32_t mCacheSourceVersion;
+    
+    // Change tracking: the cells changed by version v are kept in
+    // mDirtyRegions[v % kDirtyHistorySize] for the last few versions
+    static constexpr int kDirtyHistorySize = 16;
+    TerrainDirtyRegion mDirtyRegions[kDirtyHistorySize];
+    uint32_t mVersion;
+    uint32_t mLayoutVersion;
+    
+    // Grid bytes last reported to MemoryTracker
+    size_t mTrackedGridBytes;
+    void TrackMemory();
+    
+    // Generate2D for a world wider than the window
+    void GenerateWorld2D(int windowWidth, int height);
+    
+    // Rebuild the 2D lookups and levels of detail after mSegments2D changes
+    void BuildSegmentIndex2D();
+    void BuildLod2D();
+    int SegmentBucket2D(float x) const;
+    
+    // First segment that may contain screen x (scan on while x1 <= x), or
+    // the segment count if none can
+    size_t FirstSegment2D(float x) const;
     
     // Create a valid landing pad in the terrain
     void CreateLandingPad2D(int startX, int width);
     void CreateLandingPad3D(int startX, int startZ, int width, int length);
+    
+    // Central-difference normals of samples [min, max] of the cell range.
+    // Normals depend on the neighbouring samples too, so the cells should
+    // reach one sample past any changed height.
+    void BuildNormals(const TerrainDirtyRegion& cells);
+    
+    // Horizons of samples [min, max] of the cell range, marching each
+    // direction out to kHorizonMaxCells or the grid edge; nothing unless
+    // mBakeHorizons. Call after the heights and mMaxHeight are final.
+    static constexpr int kHorizonMaxCells = 512;
+    void BuildHorizons(const TerrainDirtyRegion& cells);
+    
+    // Ambient occlusion of samples [min, max] of the cell range, marching
+    // each direction out to kOcclusionMaxCells or the grid edge
+    void BuildOcclusion(const TerrainDirtyRegion& cells);
+    
+    // Register the connected blocks of pad cells as mLandingPads3D, after
+    // the normals are built; a pad's height, slope and difficulty come from
+    // the samples and normals of its cells
+    void BuildLandingPads3D();
+    void MeasureLandingPad3D(LandingPad& pad) const;
+    
+    // Bump the version and remember which cells it changed
+    void MarkDirty(const TerrainDirtyRegion& cells);
+    
+    // Start a new grid layout, ahead of the MarkDirty() for all of it
+    void BeginLayout();
+    
+    // Write edited heights, then rebuild what depends on them: normals, the
+    // pyramid, the pads they reach and the dirty cells
+    void StoreHeights(HeightGridRegion samples, const float* heights);
+    
+    // Map a world position to a grid cell and the local [0, 1) offsets within it
+    bool LocateCell(float x, float z, int& cellX, int& cellZ, float& u, float& v) const;
 };
+
+inline TerrainTriangle TerrainTriangleView::operator[](size_t index) const {
+    TerrainTriangle triangle;
+    mTerrain->GetTriangle3D(index, triangle);
+    return triangle;
+}
+
+inline TerrainTriangle TerrainTriangleView::Iterator::operator*() const {
+    TerrainTriangle triangle;
+    mTerrain->GetTriangle3D(mIndex, triangle);
+    return triangle;
+}
@@ -0,0 +1,271 @@
+// TerrainGenerator.cpp
+// Implementation of the seeded terrain noise
+
+#include "TerrainGenerator.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+// Crater profile in squared distance from the center, in radii: a bowl
+// from -1 at the center up to the rim, then a rim falling off to zero
+static const float kCraterRimHeight = 0.2f;
+static const float kCraterRimExtent2 = 1.6f * 1.6f;
+static const float kCraterMinRadius = 0.2f;     // Fractions of a crater cell; the
+static const float kCraterRadiusRange = 0.35f;  // widest rim stays within one cell
+static const float kCraterCenterMin = 0.2f;
+static const float kCraterCenterRange = 0.6f;
+
+// Key of the first UniformAt() stream, after the noise layers
+static const uint64_t kUniformStreamBase = 64;
+
+// 32-bit integer hash (lowbias32) of a lattice point. 32-bit multiplies
+// vectorize where 64-bit ones don't.
+static inline uint32_t HashLattice(uint32_t key, int32_t x, int32_t z) {
+    uint32_t h = key ^ (static_cast<uint32_t>(x) * 0x8da6b343u) ^ (static_cast<uint32_t>(z) * 0xd8163841u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Top 24 bits as [0, 1)
+static inline float HashToUnit(uint32_t h) {
+    return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+}
+
+// 8-bit field of a hash as [0, 1)
+static inline float HashByte(uint32_t h, int shift) {
+    return static_cast<float>((h >> shift) & 0xFFu) * (1.0f / 256.0f);
+}
+
+// floor() without a library call, so the loops stay vectorizable
+static inline int32_t FloorToInt(float value) {
+    int32_t truncated = static_cast<int32_t>(value);
+    return truncated - (value < static_cast<float>(truncated) ? 1 : 0);
+}
+
+static inline float Fade(float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// Value noise in [-1, 1] with quintic interpolation
+static inline float ValueNoise(uint32_t key, float x, float z) {
+    int32_t ix = FloorToInt(x);
+    int32_t iz = FloorToInt(z);
+    float u = Fade(x - static_cast<float>(ix));
+    float v = Fade(z - static_cast<float>(iz));
+
+    float h00 = HashToUnit(HashLattice(key, ix, iz));
+    float h10 = HashToUnit(HashLattice(key, ix + 1, iz));
+    float h01 = HashToUnit(HashLattice(key, ix, iz + 1));
+    float h11 = HashToUnit(HashLattice(key, ix + 1, iz + 1));
+
+    float nearRow = h00 + (h10 - h00) * u;
+    float farRow = h01 + (h11 - h01) * u;
+    return (nearRow + (farRow - nearRow) * v) * 2.0f - 1.0f;
+}
+
+static inline float SmoothStep(float edge0, float edge1, float value) {
+    float scaled = (value - edge0) / (edge1 - edge0);
+    float t = std::min(std::max(scaled, 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static uint32_t DeriveKey(uint64_t seed, uint64_t layer) {
+    return static_cast<uint32_t>(TerrainGenerator::Mix64(seed + TerrainGenerator::Mix64(layer)) >> 32);
+}
+
+TerrainGenerator::TerrainGenerator(uint64_t seed, const TerrainNoiseParams& params)
+    : mParams(params)
+    , mSeed(seed)
+{
+    mParams.octaves = std::min(std::max(mParams.octaves, 1), kMaxOctaves);
+
+    uint64_t layer = 0;
+    for (int i = 0; i < kMaxOctaves; ++i) {
+        mLayers.hillKeys[i] = DeriveKey(seed, layer++);
+        mLayers.ridgeKeys[i] = DeriveKey(seed, layer++);
+    }
+    mLayers.mariaKey = DeriveKey(seed, layer++);
+    mLayers.craterKey = DeriveKey(seed, layer++);
+
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float amplitudeSum = 0.0f;
+    for (int i = 0; i < mParams.octaves; ++i) {
+        mLayers.octaveFrequency[i] = frequency;
+        mLayers.octaveAmplitude[i] = amplitude;
+        amplitudeSum += amplitude;
+        frequency *= mParams.lacunarity;
+        amplitude *= mParams.gain;
+    }
+    for (int i = 0; i < mParams.octaves; ++i) {
+        mLayers.octaveAmplitude[i] /= amplitudeSum;
+    }
+}
+
+TerrainNoiseParams TerrainGenerator::DefaultParams() {
+    TerrainNoiseParams params;
+    params.hillWavelength = 24.0f;
+    params.octaves = 5;
+    params.lacunarity = 2.0f;
+    params.gain = 0.5f;
+    params.hillAmplitude = 8.0f;
+    params.ridgeWavelength = 12.0f;
+    params.ridgeAmplitude = 2.0f;
+    params.mariaWavelength = 48.0f;
+    params.mariaDepth = 3.0f;
+    params.craterCellSize = 10.0f;
+    params.craterDensity = 0.45f;
+    params.craterDepth = 3.0f;
+    return params;
+}
+
+uint64_t TerrainGenerator::Mix64(uint64_t value) {
+    uint64_t z = value + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+float TerrainGenerator::UniformAt(int32_t x, int32_t z, uint32_t stream) const {
+    return HashToUnit(HashLattice(DeriveKey(mSeed, kUniformStreamBase + stream), x, z));
+}
+
+void TerrainGenerator::GenerateBlock(const float* x, const float* z, float* out) const {
+    const TerrainNoiseParams& params = mParams;
+    const int octaves = params.octaves;
+
+    float hills[kBlockSize];
+    float ridges[kBlockSize];
+    float basin[kBlockSize];
+    float craters[kBlockSize];
+
+    // fBm hills and ridged noise, one octave at a time across the block
+    const float hillFrequency = 1.0f / params.hillWavelength;
+    const float ridgeFrequency = 1.0f / params.ridgeWavelength;
+    for (int i = 0; i < kBlockSize; ++i) {
+        hills[i] = 0.0f;
+        ridges[i] = 0.0f;
+    }
+    for (int octave = 0; octave < octaves; ++octave) {
+        const uint32_t hillKey = mLayers.hillKeys[octave];
+        const uint32_t ridgeKey = mLayers.ridgeKeys[octave];
+        const float hillScale = hillFrequency * mLayers.octaveFrequency[octave];
+        const float ridgeScale = ridgeFrequency * mLayers.octaveFrequency[octave];
+        const float amplitude = mLayers.octaveAmplitude[octave];
+        for (int i = 0; i < kBlockSize; ++i) {
+            hills[i] += amplitude * ValueNoise(hillKey, x[i] * hillScale, z[i] * hillScale);
+            float ridge = 1.0f - std::fabs(ValueNoise(ridgeKey, x[i] * ridgeScale, z[i] * ridgeScale));
+            ridges[i] += amplitude * ridge * ridge;
+        }
+    }
+
+    // Maria mask: 0 in the highlands, 1 on the basin floors
+    const float mariaFrequency = 1.0f / params.mariaWavelength;
+    for (int i = 0; i < kBlockSize; ++i) {
+        basin[i] = ValueNoise(mLayers.mariaKey, x[i] * mariaFrequency, z[i] * mariaFrequency);
+    }
+    for (int i = 0; i < kBlockSize; ++i) {
+        basin[i] = SmoothStep(0.1f, 0.6f, basin[i]);
+    }
+
+    // Craters: the sample's crater cell and its neighbours can reach it
+    const float cellSize = params.craterCellSize;
+    const float invCellSize = 1.0f / cellSize;
+    const float maxRadius = cellSize * (kCraterMinRadius + kCraterRadiusRange);
+    for (int i = 0; i < kBlockSize; ++i) {
+        craters[i] = 0.0f;
+    }
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int i = 0; i < kBlockSize; ++i) {
+                int32_t cellX = FloorToInt(x[i] * invCellSize) + dx;
+                int32_t cellZ = FloorToInt(z[i] * invCellSize) + dz;
+                uint32_t h = HashLattice(mLayers.craterKey, cellX, cellZ);
+
+                // Masks as 0/1 floats rather than float selects, which
+                // keeps the loop vectorizable
+                int hasCrater = HashByte(h, 0) < params.craterDensity;
+                float present = static_cast<float>(hasCrater);
+                float centerX = (static_cast<float>(cellX) + kCraterCenterMin + kCraterCenterRange * HashByte(h, 8)) * cellSize;
+                float centerZ = (static_cast<float>(cellZ) + kCraterCenterMin + kCraterCenterRange * HashByte(h, 16)) * cellSize;
+                float radius = (kCraterMinRadius + kCraterRadiusRange * HashByte(h, 24)) * cellSize;
+
+                float offsetX = x[i] - centerX;
+                float offsetZ = z[i] - centerZ;
+                float d2 = (offsetX * offsetX + offsetZ * offsetZ) / (radius * radius);
+
+                int inBowl = d2 < 1.0f;
+                float bowl = static_cast<float>(inBowl);
+                float rimFalloff = std::max(0.0f, 1.0f - (d2 - 1.0f) / (kCraterRimExtent2 - 1.0f));
+                float profile = bowl * (-1.0f + (1.0f + kCraterRimHeight) * d2) +
+                                (1.0f - bowl) * kCraterRimHeight * rimFalloff * rimFalloff;
+
+                // Small craters are shallower
+                craters[i] += present * params.craterDepth * (radius / maxRadius) * profile;
+            }
+        }
+    }
+
+    // Maria flood the hills and ridges; craters sit on top of both
+    for (int i = 0; i < kBlockSize; ++i) {
+        float highland = 1.0f - basin[i];
+        out[i] = params.hillAmplitude * hills[i] * (0.3f + 0.7f * highland) +
+                 params.ridgeAmplitude * (ridges[i] - 1.0f / 3.0f) * highland -
+                 params.mariaDepth * basin[i] +
+                 craters[i];
+    }
+}
+
+void TerrainGenerator::GenerateRow(int firstColumn, int row, float cellWidth, float cellLength, int count,
+                                   float* out) const {
+    float blockX[kBlockSize];
+    float blockZ[kBlockSize];
+    float blockOut[kBlockSize];
+    const float z = static_cast<float>(row) * cellLength;
+
+    for (int first = 0; first < count; first += kBlockSize) {
+        int blockCount = std::min(kBlockSize, count - first);
+        for (int i = 0; i < kBlockSize; ++i) {
+            // Lanes past the row end repeat its last sample
+            int column = firstColumn + first + std::min(i, blockCount - 1);
+            blockX[i] = static_cast<float>(column) * cellWidth;
+            blockZ[i] = z;
+        }
+
+        GenerateBlock(blockX, blockZ, blockOut);
+        std::copy(blockOut, blockOut + blockCount, out + first);
+    }
+}
+
+void TerrainGenerator::GenerateGrid(JobSystem* jobSystem, int firstColumn, int firstRow, float cellWidth,
+                                    float cellLength, int columns, int rows, float* out) const {
+    PROFILE_SCOPE("Terrain Generate");
+
+    auto generateRows = [&](size_t first, size_t last) {
+        for (size_t row = first; row < last; ++row) {
+            GenerateRow(firstColumn, firstRow + static_cast<int>(row), cellWidth, cellLength, columns,
+                        out + row * static_cast<size_t>(columns));
+        }
+    };
+
+    if (jobSystem) {
+        jobSystem->ParallelFor(static_cast<size_t>(rows), 4, generateRows);
+    } else {
+        generateRows(0, static_cast<size_t>(rows));
+    }
+}
+
+float TerrainGenerator::Sample(float x, float z) const {
+    float blockX[kBlockSize];
+    float blockZ[kBlockSize];
+    float blockOut[kBlockSize];
+    std::fill(blockX, blockX + kBlockSize, x);
+    std::fill(blockZ, blockZ + kBlockSize, z);
+    GenerateBlock(blockX, blockZ, blockOut);
+    return blockOut[0];
+}
@@ -0,0 +1,95 @@
+// TerrainGenerator.h
+// Seeded fractal-noise terrain heights with no hidden RNG state
+
+#pragma once
+
+#include <cstdint>
+
+class JobSystem;
+
+// Shape of the generated surface (all lengths in meters)
+struct TerrainNoiseParams {
+    // fBm hills
+    float hillWavelength;    // Largest feature
+    int octaves;
+    float lacunarity;        // Frequency step per octave
+    float gain;              // Amplitude step per octave
+    float hillAmplitude;
+
+    // Ridged noise (wrinkle ridges and rough highlands)
+    float ridgeWavelength;
+    float ridgeAmplitude;
+
+    // Maria: smooth low basins where the hills are damped
+    float mariaWavelength;
+    float mariaDepth;
+
+    // Craters: at most one per cell, bowl plus raised rim
+    float craterCellSize;
+    float craterDensity;     // Fraction of cells holding a crater
+    float craterDepth;       // Depth of the largest crater
+};
+
+// Seed-derived state of a generator: 32-bit lattice keys, one per noise
+// layer, and the octave steps relative to each layer's base frequency
+// (amplitudes sum to 1). Plain arrays so GPU kernels can take it as is.
+static constexpr int kTerrainNoiseMaxOctaves = 8;
+
+struct TerrainNoiseLayers {
+    uint32_t hillKeys[kTerrainNoiseMaxOctaves];
+    uint32_t ridgeKeys[kTerrainNoiseMaxOctaves];
+    float octaveFrequency[kTerrainNoiseMaxOctaves];
+    float octaveAmplitude[kTerrainNoiseMaxOctaves];
+    uint32_t mariaKey;
+    uint32_t craterKey;
+};
+
+// Every height is a pure function of (seed, x, z). Lattice points are
+// hashed rather than drawn from a sequence, so any tile, row or sample can
+// be generated on any thread, in any order, and comes out bitwise the same.
+//
+// Rows are evaluated in fixed blocks of kBlockSize samples with branchless
+// loops, which the compiler vectorizes; the per-sample arithmetic is the
+// same in every lane, so vectorized and scalar results match.
+class TerrainGenerator {
+public:
+    static constexpr int kVersion = 1;      // Bump when the output for a seed changes
+    static constexpr int kBlockSize = 8;
+    static constexpr int kMaxOctaves = kTerrainNoiseMaxOctaves;
+
+    explicit TerrainGenerator(uint64_t seed, const TerrainNoiseParams& params = DefaultParams());
+
+    static TerrainNoiseParams DefaultParams();
+
+    // SplitMix64 finalizer; used to derive independent keys from the seed
+    static uint64_t Mix64(uint64_t value);
+
+    // Uniform [0, 1) value for integer coordinates within a stream
+    float UniformAt(int32_t x, int32_t z, uint32_t stream) const;
+
+    // Heights of grid samples (firstColumn + i, row) for i in [0, count),
+    // where sample (c, r) lies at (c * cellWidth, r * cellLength). Positions
+    // come from integer indices, so a sample is bitwise the same whichever
+    // row or tile it is generated with.
+    void GenerateRow(int firstColumn, int row, float cellWidth, float cellLength, int count, float* out) const;
+
+    // columns x rows samples starting at (firstColumn, firstRow), row-major.
+    // Rows run in parallel when jobSystem is set.
+    void GenerateGrid(JobSystem* jobSystem, int firstColumn, int firstRow, float cellWidth, float cellLength,
+                      int columns, int rows, float* out) const;
+
+    float Sample(float x, float z) const;
+
+    // For GPU implementations of the same noise (see TerrainCompute.metal)
+    const TerrainNoiseParams& GetParams() const { return mParams; }
+    const TerrainNoiseLayers& GetLayers() const { return mLayers; }
+
+private:
+    // Heights for one block of kBlockSize samples. Short blocks are padded
+    // by the caller, so every sample takes the same vector path.
+    void GenerateBlock(const float* x, const float* z, float* out) const;
+
+    TerrainNoiseParams mParams;
+    uint64_t mSeed;
+    TerrainNoiseLayers mLayers;
+};
@@ -0,0 +1,185 @@
+// TerrainPack.cpp
+// Tile encoding and decoding for terrain packs
+
+#include "TerrainPack.h"
+#include "DemFile.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "Lz4.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const float kQuantizedMax = 65535.0f;
+
+// Sample (x, y) predicted from the ones already decoded before it
+static uint16_t PredictSample(const uint16_t* samples, int x, int y, int width) {
+    const uint16_t* row = samples + static_cast<size_t>(y) * width;
+    if (y == 0) {
+        return x > 0 ? row[x - 1] : 0;
+    }
+    const uint16_t* up = row - width;
+    if (x == 0) {
+        return up[0];
+    }
+    return static_cast<uint16_t>(row[x - 1] + up[x] - up[x - 1]);
+}
+
+// Zigzag: small residuals of either sign become small values
+static uint16_t ZigzagEncode(uint16_t residual) {
+    const int16_t value = static_cast<int16_t>(residual);
+    return static_cast<uint16_t>((static_cast<uint16_t>(value) << 1) ^ static_cast<uint16_t>(value >> 15));
+}
+
+static uint16_t ZigzagDecode(uint16_t value) {
+    return static_cast<uint16_t>((value >> 1) ^ (0u - (value & 1u)));
+}
+
+// Quantize, predict and compress one tile's heights into payload
+static void EncodeTile(const float* heights, int width, int height, std::vector<uint8_t>& payload,
+                       TerrainPackTile& tile, float& maxError) {
+    const size_t count = static_cast<size_t>(width) * height;
+    const auto bounds = std::minmax_element(heights, heights + count);
+    tile.minHeight = *bounds.first;
+    tile.range = *bounds.second - *bounds.first;
+    
+    // A flat tile stores zeros over a zero range
+    const float toSample = tile.range > 0.0f ? kQuantizedMax / tile.range : 0.0f;
+    const float toHeight = tile.range / kQuantizedMax;
+    std::vector<uint16_t> samples(count);
+    maxError = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = static_cast<uint16_t>(std::min((heights[i] - tile.minHeight) * toSample + 0.5f, kQuantizedMax));
+        maxError = std::max(maxError, std::fabs(tile.minHeight + samples[i] * toHeight - heights[i]));
+    }
+    
+    std::vector<uint8_t> planes(2 * count);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const uint16_t residual = ZigzagEncode(static_cast<uint16_t>(samples[i] -
+                                                                         PredictSample(samples.data(), x, y, width)));
+            planes[i] = static_cast<uint8_t>(residual & 0xFF);
+            planes[count + i] = static_cast<uint8_t>(residual >> 8);
+        }
+    }
+    
+    payload.resize(Lz4::CompressBound(planes.size()));
+    const size_t compressed = Lz4::Compress(planes.data(), planes.size(), payload.data(), payload.size());
+    if (compressed == 0 || compressed >= planes.size()) {
+        tile.encoding = TerrainPackEncoding::Raw;
+        payload.swap(planes);
+    } else {
+        tile.encoding = TerrainPackEncoding::Lz4;
+        payload.resize(compressed);
+    }
+    tile.bytes = static_cast<uint32_t>(payload.size());
+}
+
+bool TerrainPack::DecodeTile(const TerrainPackTile& tile, const uint8_t* payload, int width, int height,
+                             float* heights) {
+    const size_t count = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> planes;
+    const uint8_t* bytes = payload;
+    if (tile.encoding == TerrainPackEncoding::Lz4) {
+        planes.resize(2 * count);
+        if (!Lz4::Decompress(payload, tile.bytes, planes.data(), planes.size())) {
+            return false;
+        }
+        bytes = planes.data();
+    } else if (tile.encoding != TerrainPackEncoding::Raw || tile.bytes != 2 * count) {
+        return false;
+    }
+    
+    std::vector<uint16_t> samples(count);
+    const float toHeight = tile.range / kQuantizedMax;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const uint16_t residual = static_cast<uint16_t>(bytes[i] | (bytes[count + i] << 8));
+            samples[i] = static_cast<uint16_t>(PredictSample(samples.data(), x, y, width) + ZigzagDecode(residual));
+            heights[i] = tile.minHeight + samples[i] * toHeight;
+        }
+    }
+    return true;
+}
+
+bool TerrainPack::Write(const DemFile& dem, const char* filename, JobSystem* jobSystem, TerrainPackStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    if (!dem.IsOpen()) {
+        return false;
+    }
+    
+    TerrainPackHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kTerrainPackMagic, sizeof(header.magic));
+    header.version = kTerrainPackVersion;
+    header.headerSize = sizeof(TerrainPackHeader);
+    header.width = dem.GetWidth();
+    header.height = dem.GetHeight();
+    header.tileSize = DemFile::kTileSize;
+    header.tileCountX = dem.GetTileCountX();
+    header.tileCountY = dem.GetTileCountY();
+    header.sampleSpacing = dem.GetSampleSpacing();
+    header.indexOffset = sizeof(header);
+    std::vector<TerrainPackTile> index(static_cast<size_t>(header.tileCountX) * header.tileCountY);
+    
+    FILE* file = std::fopen(filename, "wb");
+    if (!file) {
+        LOG_ERROR("Failed to create terrain pack: %s", filename);
+        return false;
+    }
+    
+    // Header and index go in last, once every tile's offset is known
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   std::fwrite(index.data(), sizeof(TerrainPackTile), index.size(), file) == index.size();
+    uint64_t offset = header.indexOffset + index.size() * sizeof(TerrainPackTile);
+    stats = {};
+    std::vector<std::vector<uint8_t>> payloads(header.tileCountX);
+    std::vector<float> errors(header.tileCountX);
+    for (int tileY = 0; tileY < header.tileCountY && written; tileY++) {
+        auto encodeTiles = [&](size_t begin, size_t end) {
+            std::vector<float> heights;
+            for (size_t tileX = begin; tileX < end; tileX++) {
+                const int x = static_cast<int>(tileX) * DemFile::kTileSize;
+                const int y = tileY * DemFile::kTileSize;
+                const int width = std::min(DemFile::kTileSize, header.width - x);
+                const int height = std::min(DemFile::kTileSize, header.height - y);
+                heights.resize(static_cast<size_t>(width) * height);
+                dem.ReadRegion(x, y, width, height, 1, heights.data());
+                EncodeTile(heights.data(), width, height, payloads[tileX],
+                           index[static_cast<size_t>(tileY) * header.tileCountX + tileX], errors[tileX]);
+            }
+        };
+        if (jobSystem) {
+            jobSystem->ParallelFor(payloads.size(), 1, encodeTiles);
+        } else {
+            encodeTiles(0, payloads.size());
+        }
+        
+        for (int tileX = 0; tileX < header.tileCountX && written; tileX++) {
+            index[static_cast<size_t>(tileY) * header.tileCountX + tileX].offset = offset;
+            written = std::fwrite(payloads[tileX].data(), 1, payloads[tileX].size(), file) == payloads[tileX].size();
+            offset += payloads[tileX].size();
+            stats.maxError = std::max(stats.maxError, errors[tileX]);
+        }
+    }
+    header.fileSize = offset;
+    written = written && std::fseek(file, 0, SEEK_SET) == 0 &&
+              std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(index.data(), sizeof(TerrainPackTile), index.size(), file) == index.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written) {
+        LOG_ERROR("Failed to write terrain pack: %s", filename);
+        std::remove(filename);
+        return false;
+    }
+    
+    stats.sampleCount = static_cast<uint64_t>(header.width) * header.height;
+    stats.fileBytes = header.fileSize;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,71 @@
+// TerrainPack.h
+// Compressed tiled elevation format written by terrain_pack and read by DemFile
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class DemFile;
+class JobSystem;
+
+// Layout: TerrainPackHeader, then the tile index (one TerrainPackTile per
+// DemFile tile, row-major), then each tile's payload. The index makes any
+// tile one seek and one read away.
+//
+// A tile's samples are quantized to 16 bits over its own height range (error
+// at most range / 131070), predicted from their left, upper and upper-left
+// neighbours as left + up - upperLeft, and the zigzagged residuals stored as
+// a plane of low bytes then a plane of high bytes. Smooth terrain leaves
+// residuals near zero and the high plane almost empty, which LZ4 then
+// squeezes. Edge tiles store only the samples inside the raster.
+static const char kTerrainPackMagic[4] = { 'L', 'T', 'P', 'K' };
+static const uint32_t kTerrainPackVersion = 1;
+
+enum class TerrainPackEncoding : uint32_t {
+    Lz4 = 0,    // Byte planes, LZ4 block compressed
+    Raw = 1     // Byte planes as they are (LZ4 would not have shrunk them)
+};
+
+struct TerrainPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;        // sizeof(TerrainPackHeader)
+    int32_t width;              // Samples per line
+    int32_t height;             // Lines
+    int32_t tileSize;           // Samples per tile side (DemFile::kTileSize)
+    int32_t tileCountX;
+    int32_t tileCountY;
+    float sampleSpacing;        // Meters
+    uint32_t reserved;
+    uint64_t indexOffset;
+    uint64_t fileSize;
+};
+
+struct TerrainPackTile {
+    uint64_t offset;            // Payload, from the start of the file
+    uint32_t bytes;             // Payload size
+    TerrainPackEncoding encoding;
+    float minHeight;            // Quantized 0 (meters)
+    float range;                // Quantized 65535 is minHeight + range
+};
+
+// What Write did, for the tool's report
+struct TerrainPackStats {
+    uint64_t sampleCount;
+    uint64_t fileBytes;
+    float maxError;             // Largest quantization error (meters)
+    double seconds;
+};
+
+class TerrainPack {
+public:
+    // Pack a whole DEM into filename, encoding one row of tiles at a time
+    // across jobSystem's workers (or on this thread if null)
+    static bool Write(const DemFile& dem, const char* filename, JobSystem* jobSystem, TerrainPackStats& stats);
+    
+    // Decode a width x height tile payload into heights (row-major); false
+    // if it is corrupt
+    static bool DecodeTile(const TerrainPackTile& tile, const uint8_t* payload, int width, int height,
+                           float* heights);
+};
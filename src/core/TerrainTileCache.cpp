@@ -0,0 +1,130 @@
+// TerrainTileCache.cpp
+// Implementation of the streaming DEM tile cache
+
+#include "TerrainTileCache.h"
+#include "DemFile.h"
+#include "Log.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <algorithm>
+
+TerrainTileCache::TerrainTileCache(const DemFile* dem, size_t budgetBytes, int minTiles)
+    : mDem(dem)
+    , mTileBytes(static_cast<size_t>(DemFile::kTileSize) * DemFile::kTileSize * sizeof(float))
+    , mBudgetBytes(std::max(budgetBytes, mTileBytes * static_cast<size_t>(std::max(minTiles, 1))))
+    , mStopping(false)
+    , mLoads(0)
+    , mEvictions(0)
+{
+    if (mBudgetBytes > budgetBytes) {
+        LOG_WARNING("Tile cache budget raised to %zu MB to hold the terrain window", mBudgetBytes >> 20);
+    }
+    mLoader = std::thread(&TerrainTileCache::LoaderLoop, this);
+}
+
+TerrainTileCache::~TerrainTileCache() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+        mPending.clear();
+    }
+    mWake.notify_one();
+    mLoader.join();
+    MemoryTracker::Free(MemoryTag::TerrainTiles, mTiles.size() * mTileBytes);
+
+    LOG_INFO("Tile cache: %llu tiles loaded, %llu evicted",
+             static_cast<unsigned long long>(mLoads), static_cast<unsigned long long>(mEvictions));
+}
+
+void TerrainTileCache::Prefetch(const std::vector<uint64_t>& keys) {
+    size_t maxTiles = mBudgetBytes / mTileBytes;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending.clear();
+
+        // Touch in reverse so the most urgent tile ends up most recent
+        size_t count = std::min(keys.size(), maxTiles);
+        for (size_t i = count; i-- > 0;) {
+            auto found = mTiles.find(keys[i]);
+            if (found != mTiles.end()) {
+                mLru.splice(mLru.begin(), mLru, found->second.lruPosition);
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (mTiles.find(keys[i]) == mTiles.end() &&
+                std::find(mPending.begin(), mPending.end(), keys[i]) == mPending.end()) {
+                mPending.push_back(keys[i]);
+            }
+        }
+        if (mPending.empty()) {
+            return;
+        }
+    }
+    mWake.notify_one();
+}
+
+TerrainTileData TerrainTileCache::GetTile(int tileX, int tileY) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mTiles.find(TileKey(tileX, tileY));
+    if (found == mTiles.end()) {
+        return nullptr;
+    }
+    mLru.splice(mLru.begin(), mLru, found->second.lruPosition);
+    return found->second.data;
+}
+
+size_t TerrainTileCache::GetResidentBytes() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTiles.size() * mTileBytes;
+}
+
+void TerrainTileCache::LoaderLoop() {
+    Profiler::SetThreadName("Tile Loader");
+
+    for (;;) {
+        uint64_t key;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [this] { return mStopping || !mPending.empty(); });
+            if (mStopping) {
+                return;
+            }
+            key = mPending.front();
+            mPending.pop_front();
+        }
+
+        // Decode outside the lock; page faults on the mapping land here
+        // rather than on the main thread
+        int tileX = static_cast<int>(key & 0xFFFFFFFFu);
+        int tileY = static_cast<int>(key >> 32);
+        std::shared_ptr<std::vector<float>> samples =
+            std::make_shared<std::vector<float>>(static_cast<size_t>(DemFile::kTileSize) * DemFile::kTileSize);
+        {
+            PROFILE_SCOPE("Tile Load");
+            mDem->ReadRegion(tileX * DemFile::kTileSize, tileY * DemFile::kTileSize,
+                             DemFile::kTileSize, DemFile::kTileSize, 1, samples->data());
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        InsertTile(key, samples);
+    }
+}
+
+void TerrainTileCache::InsertTile(uint64_t key, TerrainTileData data) {
+    if (mTiles.find(key) != mTiles.end()) {
+        return;
+    }
+
+    mLru.push_front(key);
+    mTiles[key] = { data, mLru.begin() };
+    ++mLoads;
+    MemoryTracker::Allocate(MemoryTag::TerrainTiles, mTileBytes);
+
+    while (mTiles.size() * mTileBytes > mBudgetBytes && mLru.size() > 1) {
+        mTiles.erase(mLru.back());
+        mLru.pop_back();
+        ++mEvictions;
+        MemoryTracker::Free(MemoryTag::TerrainTiles, mTileBytes);
+    }
+}
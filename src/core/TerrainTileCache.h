@@ -0,0 +1,81 @@
+// TerrainTileCache.h
+// LRU cache of decoded DEM tiles filled by a background loader thread
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class DemFile;
+
+// Decoded heights of one DemFile tile: kTileSize^2 samples in row-major
+// order, clamped at the raster edge
+typedef std::shared_ptr<const std::vector<float>> TerrainTileData;
+
+// Tiles are decoded off the main thread and kept under a hard memory
+// budget, evicting the least recently used. Readers get shared tile data,
+// so eviction never frees a tile that is still being copied.
+class TerrainTileCache {
+public:
+    static constexpr size_t kDefaultBudgetBytes = 64 * 1024 * 1024;
+
+    // dem must stay open while the cache exists. The budget is raised to
+    // hold at least minTiles tiles.
+    TerrainTileCache(const DemFile* dem, size_t budgetBytes, int minTiles);
+    ~TerrainTileCache();
+
+    TerrainTileCache(const TerrainTileCache&) = delete;
+    TerrainTileCache& operator=(const TerrainTileCache&) = delete;
+
+    static uint64_t TileKey(int tileX, int tileY) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(tileY)) << 32) | static_cast<uint32_t>(tileX);
+    }
+
+    // Replace the pending loads with these tiles, most urgent first. Tiles
+    // already resident only count as used; anything past the budget is
+    // dropped so a long list can't evict its own head.
+    void Prefetch(const std::vector<uint64_t>& keys);
+
+    // Resident tile data, or null if the tile is not loaded (never blocks
+    // on a load)
+    TerrainTileData GetTile(int tileX, int tileY);
+
+    size_t GetBudgetBytes() const { return mBudgetBytes; }
+    size_t GetResidentBytes() const;
+
+private:
+    struct Entry {
+        TerrainTileData data;
+        std::list<uint64_t>::iterator lruPosition;
+    };
+
+    void LoaderLoop();
+
+    // Insert a loaded tile and evict down to the budget (lock held)
+    void InsertTile(uint64_t key, TerrainTileData data);
+
+    const DemFile* mDem;
+    size_t mTileBytes;
+    size_t mBudgetBytes;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+    std::unordered_map<uint64_t, Entry> mTiles;
+    std::list<uint64_t> mLru;        // Most recently used first
+    std::deque<uint64_t> mPending;   // Next loads, most urgent first
+    bool mStopping;
+
+    // Counters for the log
+    uint64_t mLoads;
+    uint64_t mEvictions;
+
+    std::thread mLoader;
+};
@@ -0,0 +1,373 @@
+// TrajectoryPredictor.cpp
+// Implementation of the touchdown prediction
+
+#include "TrajectoryPredictor.h"
+#include "Entity.h"
+#include "Integrators.h"
+#include "Terrain.h"
+#include "Units.h"
+#include <algorithm>
+#include <cmath>
+
+// Bisection steps refining a ballistic impact between two samples
+static const int kImpactRefineSteps = 16;
+
+// Seconds of the engine-off arc per chord cast against 3D terrain; the arc
+// bulges g t^2 / 8 (5 cm at lunar gravity) above its chord
+static const float kBallisticChordTime = 0.5f;
+
+TrajectoryPredictor::TrajectoryPredictor()
+    : mInput()
+    , mValid(false)
+    , mStartStep(0)
+    , mCurrentStep(0)
+    , mStepTime(0.0f)
+    , mHalfHeight(0.0f)
+    , mFuelRate(0.0f)
+    , mDryMass(0.0f)
+    , mMaxThrust(0.0f)
+    , mPathEnd()
+    , mPathDone(true)
+    , mBallisticStart()
+    , mHasImpact(false)
+    , mImpact()
+{
+}
+
+void TrajectoryPredictor::Update(const Lander& lander, const Terrain& terrain, float gravity, bool use3D,
+                                 uint64_t stepIndex, float stepTime) {
+    Input input = ReadInput(lander, terrain, gravity, use3D);
+    if (!mValid || stepTime != mStepTime || !SameInput(input, mInput) || Drifted(lander, stepIndex)) {
+        mInput = input;
+        mStepTime = stepTime;
+        Start(lander, terrain, stepIndex);
+    }
+    mCurrentStep = stepIndex;
+    
+    if (!mPathDone) {
+        ExtendThrustPath(terrain, kStepsPerUpdate);
+    }
+}
+
+void TrajectoryPredictor::Invalidate() {
+    mValid = false;
+    mHasImpact = false;
+    mPathDone = true;
+    mPathPositions.clear();
+}
+
+float TrajectoryPredictor::GetTimeToImpact() const {
+    return mImpact.time - (mCurrentStep - mStartStep) * mStepTime;
+}
+
+TrajectoryPredictor::Input TrajectoryPredictor::ReadInput(const Lander& lander, const Terrain& terrain,
+                                                          float gravity, bool use3D) {
+    Input input;
+    input.thrust = lander.IsThrustActive() && lander.GetFuel() > 0.0f;
+    input.thrustLevel = input.thrust ? lander.GetThrustLevel() : 0.0f;
+    if (use3D) {
+        // The lander's up axis, as Physics::ApplyThrust pushes along
+        const Quaternion& q = lander.GetOrientation();
+        input.direction[0] = 2.0f * (q.x * q.y - q.w * q.z);
+        input.direction[1] = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+        input.direction[2] = 2.0f * (q.y * q.z + q.w * q.x);
+    } else {
+        // Physics::Update2D
+        float rotZ = lander.GetRotation()[2] * static_cast<float>(M_PI / 180.0);
+        input.direction[0] = -std::sin(rotZ);
+        input.direction[1] = std::cos(rotZ);
+        input.direction[2] = 0.0f;
+    }
+    input.gravity = gravity;
+    input.use3D = use3D;
+    input.terrain = &terrain;
+    input.terrainVersion = use3D ? terrain.GetVersion() : terrain.GetSegmentsVersion2D();
+    return input;
+}
+
+bool TrajectoryPredictor::SameInput(const Input& a, const Input& b) {
+    if (a.thrust != b.thrust || a.gravity != b.gravity || a.use3D != b.use3D ||
+        a.terrain != b.terrain || a.terrainVersion != b.terrainVersion) {
+        return false;
+    }
+    
+    // The attitude only matters while the engine is on
+    return !a.thrust || (a.thrustLevel == b.thrustLevel && a.direction[0] == b.direction[0] &&
+                         a.direction[1] == b.direction[1] && a.direction[2] == b.direction[2]);
+}
+
+void TrajectoryPredictor::Start(const Lander& lander, const Terrain& terrain, uint64_t stepIndex) {
+    mValid = true;
+    mStartStep = stepIndex;
+    mHalfHeight = lander.GetHeight().Value() / 2;
+    mFuelRate = lander.GetFuelConsumptionRate();
+    mDryMass = lander.GetDryMass().Value();
+    mMaxThrust = lander.GetMaxThrust(mInput.gravity);
+    mHasImpact = false;
+    
+    PathState state;
+    for (int i = 0; i < 3; i++) {
+        state.position[i] = lander.GetPosition()[i];
+        state.velocity[i] = lander.GetVelocity()[i];
+    }
+    state.fuel = lander.GetFuel();
+    
+    if (mInput.thrust) {
+        // Integrated over the next Updates
+        mPathPositions.assign(state.position, state.position + 3);
+        mPathEnd = state;
+        mPathDone = false;
+    } else {
+        mPathPositions.clear();
+        mBallisticStart = state;
+        mHasImpact = SolveBallistic(terrain, state, kMaxPredictionTime, mImpact);
+        mPathDone = true;
+    }
+}
+
+void TrajectoryPredictor::ExtendThrustPath(const Terrain& terrain, int maxSteps) {
+    const float dt = mStepTime;
+    const size_t maxPathSteps = static_cast<size_t>(kMaxPredictionTime / dt);
+    
+    for (int n = 0; n < maxSteps; n++) {
+        const size_t step = mPathPositions.size() / 3 - 1;   // Step mPathEnd is at
+        if (step >= maxPathSteps) {
+            mPathDone = true;
+            return;
+        }
+        
+        // Out of fuel: the rest of the way is a free fall
+        if (mPathEnd.fuel <= 0.0f) {
+            const float elapsed = step * dt;
+            mHasImpact = SolveBallistic(terrain, mPathEnd, kMaxPredictionTime - elapsed, mImpact);
+            mImpact.time += elapsed;
+            mPathDone = true;
+            return;
+        }
+        
+        // Physics' thrust on the mass left at the start of the step
+        const float thrustAccel = mMaxThrust * mInput.thrustLevel / (mDryMass + mPathEnd.fuel);
+        const float accelX = mInput.direction[0] * thrustAccel;
+        const float accelY = mInput.direction[1] * thrustAccel - mInput.gravity;
+        const float accelZ = mInput.direction[2] * thrustAccel;
+        
+        PathState next = mPathEnd;
+        if (mInput.use3D) {
+            // Bullet's semi-implicit Euler
+            const float accel[3] = { accelX, accelY, accelZ };
+            for (int i = 0; i < 3; i++) {
+                next.velocity[i] += accel[i] * dt;
+                next.position[i] += next.velocity[i] * dt;
+            }
+        } else {
+            // The same step Physics::Update2D takes
+            IntegratorState2D<float> state = { next.position[0], next.position[1],
+                                               next.velocity[0], next.velocity[1] };
+            auto accel = [accelX, accelY](const IntegratorState2D<float>&, float& ax, float& ay) {
+                ax = accelX;
+                ay = accelY;
+            };
+            LanderIntegrator::Step<ScalarOps>(state, dt, accel);
+            next.position[0] = state.posX;
+            next.position[1] = state.posY;
+            next.velocity[0] = state.velX;
+            next.velocity[1] = state.velY;
+        }
+        next.fuel -= mFuelRate * mInput.thrustLevel * dt;
+        
+        // Down through the surface during this step: interpolate to where
+        float after = 0.0f;
+        if (Clearance(terrain, next.position, after) && after <= 0.0f) {
+            float before = 0.0f;
+            float fraction = 1.0f;
+            if (Clearance(terrain, mPathEnd.position, before) && before > 0.0f) {
+                fraction = before / (before - after);
+            }
+            for (int i = 0; i < 3; i++) {
+                mImpact.position[i] = mPathEnd.position[i] + (next.position[i] - mPathEnd.position[i]) * fraction;
+                mImpact.velocity[i] = mPathEnd.velocity[i] + (next.velocity[i] - mPathEnd.velocity[i]) * fraction;
+            }
+            mImpact.position[1] -= mHalfHeight;
+            mImpact.time = (step + fraction) * dt;
+            mHasImpact = true;
+            mPathDone = true;
+            return;
+        }
+        
+        mPathPositions.insert(mPathPositions.end(), next.position, next.position + 3);
+        mPathEnd = next;
+    }
+}
+
+bool TrajectoryPredictor::Drifted(const Lander& lander, uint64_t stepIndex) const {
+    if (stepIndex < mStartStep) {
+        return true;
+    }
+    const uint64_t elapsedSteps = stepIndex - mStartStep;
+    
+    float expected[3];
+    if (mInput.thrust) {
+        // Past the end of the path means it is stale too
+        if (elapsedSteps >= mPathPositions.size() / 3) {
+            return true;
+        }
+        std::copy(&mPathPositions[elapsedSteps * 3], &mPathPositions[elapsedSteps * 3] + 3, expected);
+    } else {
+        const float t = elapsedSteps * mStepTime;
+        for (int i = 0; i < 3; i++) {
+            expected[i] = mBallisticStart.position[i] + mBallisticStart.velocity[i] * t;
+        }
+        expected[1] -= 0.5f * mInput.gravity * t * t;
+    }
+    
+    const float* position = lander.GetPosition();
+    float distanceSquared = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        float delta = position[i] - expected[i];
+        distanceSquared += delta * delta;
+    }
+    return distanceSquared > kDriftTolerance * kDriftTolerance;
+}
+
+bool TrajectoryPredictor::Clearance(const Terrain& terrain, const float* position, float& clearance) const {
+    float surface = 0.0f;
+    bool overTerrain = mInput.use3D ? terrain.SampleHeight(position[0], position[2], surface)
+                                    : terrain.SampleHeight2D(position[0], surface);
+    clearance = position[1] - mHalfHeight - surface;
+    return overTerrain;
+}
+
+bool TrajectoryPredictor::SolveBallistic(const Terrain& terrain, const PathState& state, float maxTime,
+                                         PredictedImpact& impact) const {
+    const float g = mInput.gravity;
+    if (g <= 0.0f || maxTime <= 0.0f) {
+        return false;
+    }
+    
+    // Surface height range, and sample spacing fine enough not to step
+    // over a feature of the surface
+    float low = 0.0f;
+    float high = 0.0f;
+    float spacing = 0.0f;
+    if (mInput.use3D) {
+        low = terrain.GetMinHeight();
+        high = terrain.GetMaxHeight();
+        spacing = 0.5f * std::min(terrain.GetCellWidth(), terrain.GetCellLength());
+    } else {
+        const std::vector<TerrainSegment>& segments = terrain.GetSegments2D();
+        if (segments.empty()) {
+            return false;
+        }
+        float minScreenY = segments[0].y1;
+        float maxScreenY = segments[0].y1;
+        float minWidth = segments[0].x2 - segments[0].x1;
+        for (const TerrainSegment& segment : segments) {
+            minScreenY = std::min(minScreenY, std::min(segment.y1, segment.y2));
+            maxScreenY = std::max(maxScreenY, std::max(segment.y1, segment.y2));
+            minWidth = std::min(minWidth, segment.x2 - segment.x1);
+        }
+        const float terrainHeight = static_cast<float>(terrain.GetHeight());
+        low = (terrainHeight - maxScreenY) * Units::kMetersPerPixel;
+        high = (terrainHeight - minScreenY) * Units::kMetersPerPixel;
+        spacing = 0.5f * minWidth * Units::kMetersPerPixel;
+    }
+    if (!(spacing > 0.0f)) {
+        spacing = 0.5f;
+    }
+    
+    // The bottom follows y0 + vy t - g t^2 / 2. Only the stretch where it is
+    // between the highest and lowest surface can hit anything.
+    const float bottom0 = state.position[1] - mHalfHeight;
+    const float velY = state.velocity[1];
+    auto timeToHeight = [&](float height, float& t) {
+        float discriminant = velY * velY + 2.0f * g * (bottom0 - height);
+        if (discriminant < 0.0f) {
+            return false;
+        }
+        t = (velY + std::sqrt(discriminant)) / g;
+        return true;
+    };
+    float tStart = 0.0f;
+    float tEnd = 0.0f;
+    if ((bottom0 > high && !timeToHeight(high, tStart)) || !timeToHeight(low, tEnd)) {
+        return false;
+    }
+    tStart = std::max(tStart, 0.0f);
+    tEnd = std::min(tEnd, maxTime);
+    if (tStart > tEnd) {
+        return false;
+    }
+    
+    auto positionAt = [&](float t, float* position) {
+        for (int i = 0; i < 3; i++) {
+            position[i] = state.position[i] + state.velocity[i] * t;
+        }
+        position[1] -= 0.5f * g * t * t;
+    };
+    
+    // Off the terrain there is nothing to hit
+    auto below = [&](float t) {
+        float position[3];
+        positionAt(t, position);
+        float clearance = 0.0f;
+        return Clearance(terrain, position, clearance) && clearance <= 0.0f;
+    };
+    
+    // March along the path, then bisect the step that went below the
+    // surface. In 2D the steps are about spacing long. In 3D chords of the
+    // arc are ray cast against the terrain: the arc is concave, so it never
+    // dips below a chord, and a chord that clears the surface clears the
+    // arc between its ends too. A step then only stops short where a chord
+    // touches, and goes on from there if the arc itself is still above.
+    float previous = tStart;
+    float t = tStart;
+    bool hit = below(t);
+    while (!hit && t < tEnd) {
+        float speedX = state.velocity[0];
+        float speedY = velY - g * t;
+        float speedZ = state.velocity[2];
+        float speed = std::sqrt(speedX * speedX + speedY * speedY + speedZ * speedZ);
+        float step = spacing / std::max(speed, 0.1f);
+        previous = t;
+        if (mInput.use3D) {
+            float chordEnd = std::min(t + kBallisticChordTime, tEnd);
+            float from[3];
+            float to[3];
+            positionAt(t, from);
+            positionAt(chordEnd, to);
+            float chord[3] = { to[0] - from[0], to[1] - from[1], to[2] - from[2] };
+            from[1] -= mHalfHeight;
+            float along = 1.0f;
+            if (terrain.RayCast(from, chord, 1.0f, along)) {
+                t = std::min(std::max(t + along * (chordEnd - t), t + step), chordEnd);
+            } else {
+                t = chordEnd;
+            }
+        } else {
+            t = std::min(t + step, tEnd);
+        }
+        hit = below(t);
+    }
+    if (!hit) {
+        return false;
+    }
+    if (t > previous) {
+        float above = previous;
+        for (int i = 0; i < kImpactRefineSteps; i++) {
+            float middle = 0.5f * (above + t);
+            if (below(middle)) {
+                t = middle;
+            } else {
+                above = middle;
+            }
+        }
+    }
+    
+    positionAt(t, impact.position);
+    impact.position[1] -= mHalfHeight;
+    impact.velocity[0] = state.velocity[0];
+    impact.velocity[1] = velY - g * t;
+    impact.velocity[2] = state.velocity[2];
+    impact.time = t;
+    return true;
+}
@@ -0,0 +1,104 @@
+// TrajectoryPredictor.h
+// Predicted touchdown point of the lander under its current input
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Lander;
+class Terrain;
+
+// Where and when the lander's bottom center would meet the surface if the
+// input stayed as it is (meters, m/s); position is the point on the surface
+struct PredictedImpact {
+    float position[3];
+    float velocity[3];
+    float time;             // Seconds after the step the prediction started from
+};
+
+// Predicts the touchdown once per input change instead of every frame.
+// With the engine off the path is a parabola, so the impact is solved in
+// closed form and stays valid for the rest of the fall. With it on, the
+// path is integrated forward at the simulation's own step, a bounded
+// number of steps per Update, and extended from where it stopped until
+// it reaches the surface. Either is thrown away when the thrust, attitude,
+// gravity, mode or terrain change, or the lander leaves the cached path.
+class TrajectoryPredictor {
+public:
+    static constexpr int kStepsPerUpdate = 128;          // Thrusting path steps per Update
+    static constexpr float kMaxPredictionTime = 60.0f;   // Seconds ahead
+    static constexpr float kDriftTolerance = 0.5f;       // Meters off the path before starting over
+    
+    TrajectoryPredictor();
+    
+    // Bring the prediction up to date with the lander as it is after
+    // simulation step stepIndex (steps of stepTime seconds)
+    void Update(const Lander& lander, const Terrain& terrain, float gravity, bool use3D,
+                uint64_t stepIndex, float stepTime);
+    
+    // Drop the prediction, e.g. on reset
+    void Invalidate();
+    
+    // An impact was found within kMaxPredictionTime
+    bool HasImpact() const { return mHasImpact; }
+    const PredictedImpact& GetImpact() const { return mImpact; }
+    
+    // Seconds from the last Update's step to the impact
+    float GetTimeToImpact() const;
+
+private:
+    // What the path depends on besides the starting state
+    struct Input {
+        bool thrust;
+        float thrustLevel;
+        float direction[3];     // Thrust axis (unit)
+        float gravity;
+        bool use3D;
+        const Terrain* terrain;
+        uint32_t terrainVersion;
+    };
+    
+    struct PathState {
+        float position[3];
+        float velocity[3];
+        float fuel;
+    };
+    
+    static Input ReadInput(const Lander& lander, const Terrain& terrain, float gravity, bool use3D);
+    static bool SameInput(const Input& a, const Input& b);
+    
+    void Start(const Lander& lander, const Terrain& terrain, uint64_t stepIndex);
+    void ExtendThrustPath(const Terrain& terrain, int maxSteps);
+    bool Drifted(const Lander& lander, uint64_t stepIndex) const;
+    
+    // Height of the bottom center above the surface; false off the terrain
+    bool Clearance(const Terrain& terrain, const float* position, float& clearance) const;
+    
+    // First impact along the engine-off parabola from state, at most
+    // maxTime seconds ahead; impact time is measured from state
+    bool SolveBallistic(const Terrain& terrain, const PathState& state, float maxTime,
+                        PredictedImpact& impact) const;
+    
+    Input mInput;
+    bool mValid;
+    uint64_t mStartStep;        // Step the prediction started from
+    uint64_t mCurrentStep;      // Step of the last Update
+    float mStepTime;
+    float mHalfHeight;          // Lander bottom below its center
+    float mFuelRate;            // kg/s at full throttle
+    float mDryMass;             // kg
+    float mMaxThrust;           // N at full throttle
+    
+    // Thrusting: positions at every step from the start, and the state at
+    // the end of the path to extend from
+    std::vector<float> mPathPositions;   // 3 floats per step
+    PathState mPathEnd;
+    bool mPathDone;             // Impact found or horizon reached
+    
+    // Engine-off start, for the drift check
+    PathState mBallisticStart;
+    
+    bool mHasImpact;
+    PredictedImpact mImpact;
+};
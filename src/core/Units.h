@@ -0,0 +1,65 @@
+// Units.h
+// Typed physical quantities and the one pixel/meter scale
+
+#pragma once
+
+// A float tagged with its unit, so meters can't be passed where pixels are
+// expected. Everything is constexpr and inline; a Quantity compiles to the
+// bare float.
+template <class Unit>
+class Quantity {
+public:
+    constexpr Quantity() : mValue(0.0f) {}
+    constexpr explicit Quantity(float value) : mValue(value) {}
+    
+    constexpr float Value() const { return mValue; }
+    
+    constexpr Quantity operator+(Quantity other) const { return Quantity(mValue + other.mValue); }
+    constexpr Quantity operator-(Quantity other) const { return Quantity(mValue - other.mValue); }
+    constexpr Quantity operator-() const { return Quantity(-mValue); }
+    constexpr Quantity operator*(float scale) const { return Quantity(mValue * scale); }
+    constexpr Quantity operator/(float scale) const { return Quantity(mValue / scale); }
+    constexpr float operator/(Quantity other) const { return mValue / other.mValue; }   // Ratio
+    
+    constexpr bool operator<(Quantity other) const { return mValue < other.mValue; }
+    constexpr bool operator<=(Quantity other) const { return mValue <= other.mValue; }
+    constexpr bool operator>(Quantity other) const { return mValue > other.mValue; }
+    constexpr bool operator>=(Quantity other) const { return mValue >= other.mValue; }
+    constexpr bool operator==(Quantity other) const { return mValue == other.mValue; }
+    constexpr bool operator!=(Quantity other) const { return mValue != other.mValue; }
+    
+private:
+    float mValue;
+};
+
+template <class Unit>
+constexpr Quantity<Unit> operator*(float scale, Quantity<Unit> quantity) {
+    return quantity * scale;
+}
+
+struct MeterUnit {};
+struct PixelUnit {};
+struct SecondUnit {};
+struct KilogramUnit {};
+
+typedef Quantity<MeterUnit> Meters;
+typedef Quantity<PixelUnit> Pixels;       // 2D screen space
+typedef Quantity<SecondUnit> Seconds;
+typedef Quantity<KilogramUnit> Kilograms;
+
+constexpr Meters operator""_m(long double value) { return Meters(static_cast<float>(value)); }
+constexpr Pixels operator""_px(long double value) { return Pixels(static_cast<float>(value)); }
+constexpr Seconds operator""_s(long double value) { return Seconds(static_cast<float>(value)); }
+constexpr Kilograms operator""_kg(long double value) { return Kilograms(static_cast<float>(value)); }
+
+// The 2D view's scale, shared by the simulation, terrain and renderers.
+// Hot loops use the raw factors; both directions multiply, so no
+// conversion divides.
+class Units {
+public:
+    static constexpr float kPixelsPerMeter = 20.0f;
+    static constexpr float kMetersPerPixel = 1.0f / kPixelsPerMeter;
+    
+    static constexpr Pixels ToPixels(Meters meters) { return Pixels(meters.Value() * kPixelsPerMeter); }
+    static constexpr Meters ToMeters(Pixels pixels) { return Meters(pixels.Value() * kMetersPerPixel); }
+};
@@ -0,0 +1,194 @@
+// net_test.cpp
+// Network session checks over a delayed loopback link
+//
+// A host and a client NetSession talk through a relay socket that holds
+// every datagram for a number of session steps each way, so a round trip
+// takes several fixed steps (the relay counts steps, not wall time, which
+// keeps the runs repeatable on a loaded machine). The client flies at full
+// thrust; each link is held to the host actually applying those inputs
+// (its copy of the client's lander burns fuel and leaves the spawn point)
+// and to the client's prediction agreeing with the host once it has caught
+// up. Any failed check fails the run; ctest runs it as net_test.
+
+#include "LanderBatch.h"
+#include "Log.h"
+#include "NetSession.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <initializer_list>
+#include <thread>
+#include <vector>
+
+static const uint32_t kLoopback = 0x7F000001;
+static const uint16_t kHostPort = 47310;
+static const uint16_t kRelayPort = 47311;
+static const float kFixedStep = 1.0f / 60.0f;
+static const float kMaxFuel = 100.0f;
+static const float kStartFuel = 80.0f;         // A part-full tank, which the Welcome carries
+static const float kFuelRate = 10.0f;
+static const int kFlightSteps = 240;           // Four seconds of flight after joining
+
+static int sChecks = 0;
+static int sFailures = 0;
+
+static bool Check(bool passed, const char* what) {
+    sChecks++;
+    if (!passed) {
+        sFailures++;
+        std::printf("FAILED: %s\n", what);
+    }
+    return passed;
+}
+
+// Forwards between one client and the host with a fixed delay per
+// direction, plus an extra step on every jitterPeriod-th datagram
+class DelayRelay {
+public:
+    DelayRelay(int delaySteps, int jitterPeriod)
+        : mDelaySteps(delaySteps), mJitterPeriod(jitterPeriod), mStep(0), mForwarded(0) {}
+    
+    bool Open() { return mSocket.Open(kRelayPort); }
+    
+    // Take what arrived, then send what is due; once per session step
+    void Pump() {
+        uint8_t buffer[kNetMaxPacketSize];
+        NetAddress from;
+        int size;
+        while ((size = mSocket.Receive(from, buffer, sizeof(buffer))) > 0) {
+            const NetAddress host(kLoopback, kHostPort);
+            if (from != host) {
+                mClient = from;
+            }
+            Datagram datagram;
+            datagram.due = mStep + mDelaySteps;
+            if (mJitterPeriod > 0 && ++mForwarded % mJitterPeriod == 0) {
+                datagram.due++;
+            }
+            datagram.to = from == host ? mClient : host;
+            datagram.data.assign(buffer, buffer + size);
+            mQueue.push_back(datagram);
+        }
+        
+        // Sent in arrival order, so a jittered datagram holds up the ones behind it
+        while (!mQueue.empty() && mQueue.front().due <= mStep) {
+            mSocket.Send(mQueue.front().to, mQueue.front().data.data(), mQueue.front().data.size());
+            mQueue.pop_front();
+        }
+        mStep++;
+    }
+
+private:
+    struct Datagram {
+        uint64_t due;
+        NetAddress to;
+        std::vector<uint8_t> data;
+    };
+    
+    NetSocket mSocket;
+    int mDelaySteps;
+    int mJitterPeriod;
+    uint64_t mStep;
+    uint64_t mForwarded;
+    NetAddress mClient;
+    std::deque<Datagram> mQueue;
+};
+
+static void TestLink(int delaySteps, int jitterPeriod) {
+    char what[128];
+    std::printf("%2d step%s each way%s:\n", delaySteps, delaySteps == 1 ? "" : "s",
+                jitterPeriod > 0 ? ", with jitter" : "");
+    
+    NetSessionSettings settings;
+    settings.seed = 1;
+    settings.fixedTimeStep = kFixedStep;
+    settings.gravity = 1.62f;
+    settings.maxFuel = kMaxFuel;
+    settings.fuelRate = kFuelRate;
+    settings.spawnX = 20.0f;
+    settings.spawnY = 500.0f;    // No terrain: nothing to land on in the time flown
+    settings.spawnVelX = 2.0f;
+    settings.spawnVelY = 0.0f;
+    settings.spawnFuel = kStartFuel;
+    settings.landerWidth = 1.0f;
+    settings.landerHeight = 1.5f;
+    settings.worldWidth = 800;
+    settings.worldHeight = 600;
+    
+    NetSession host;
+    DelayRelay relay(delaySteps, jitterPeriod);
+    if (!Check(host.Host(kHostPort, settings) && relay.Open(), "host and relay sockets open")) {
+        return;
+    }
+    
+    // Connect() waits for the Welcome, so the host and relay step meanwhile
+    NetSession client;
+    NetSessionSettings joined;
+    bool connected = false;
+    std::thread joiner([&] {
+        connected = client.Connect(NetAddress(kLoopback, kRelayPort), 5.0f, joined);
+    });
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(6) && !client.IsConnected()) {
+        relay.Pump();
+        host.Step(0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    joiner.join();
+    if (!Check(connected, "client joins through the relay")) {
+        return;
+    }
+    Check(joined.spawnFuel == kStartFuel && joined.spawnVelX == settings.spawnVelX &&
+          joined.landerHeight == settings.landerHeight, "client takes the host's spawn state");
+    
+    // Lockstep from here: the relay's delay is in these steps
+    for (int step = 0; step < kFlightSteps; step++) {
+        relay.Pump();
+        host.Step(0);
+        relay.Pump();
+        client.Step(kNetActionFly | kNetActionThrust);
+    }
+    
+    LanderBatchLander applied;
+    host.GetRemoteLanders()->GetLander(0, applied);
+    LanderBatchLander predicted;
+    client.GetLocalLander(predicted);
+    const float fullBurn = kFuelRate * kFlightSteps * kFixedStep;
+    const float burned = kStartFuel - applied.fuel;
+    std::printf("    host burned %.2f of the client's %.2f kg, %.2f m up from spawn (client: %.2f m), "
+                "%llu corrections\n", burned, kStartFuel - predicted.fuel, applied.y - settings.spawnY,
+                predicted.y - settings.spawnY, static_cast<unsigned long long>(client.GetStats().corrections));
+    
+    // Everything but the last round trip and the host's jitter queue is applied
+    const float inFlight = kFuelRate * kFixedStep * (2 * delaySteps + 8);
+    std::snprintf(what, sizeof(what), "host applies the client's inputs (%d-step delay)", delaySteps);
+    Check(burned > fullBurn - inFlight && applied.y != settings.spawnY, what);
+    
+    // The client's lander is the host's state, to the snapshot's precision,
+    // run ahead by the inputs the host hasn't applied. Without jitter that
+    // matches a full burn and never needs correcting; with it, the steps the
+    // host repeated for late inputs correct it.
+    if (jitterPeriod == 0) {
+        std::snprintf(what, sizeof(what), "client predicts a full burn (%d-step delay)", delaySteps);
+        Check(std::fabs(kStartFuel - predicted.fuel - fullBurn) <= 1.0f / 16.0f, what);
+        std::snprintf(what, sizeof(what), "no prediction corrections (%d-step delay)", delaySteps);
+        Check(client.GetStats().corrections == 0, what);
+    }
+    client.Close();
+    host.Close();
+}
+
+int main() {
+    Log::SetLevel(LogLevel::Warning);
+    
+    std::printf("Lunar Lander Network Test\n");
+    std::printf("-------------------------\n\n");
+    for (int delay : { 1, 3, 6, 12 }) {
+        TestLink(delay, 0);
+    }
+    TestLink(6, 5);
+    
+    std::printf("\n%d of %d checks passed\n", sChecks - sFailures, sChecks);
+    return sFailures == 0 ? 0 : 1;
+}
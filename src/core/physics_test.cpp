@@ -1,167 +1,419 @@
 // physics_test.cpp
-// Test harness for verifying lunar lander physics accuracy
+// Accuracy and throughput suite for the 2D physics paths
+//
+// The Integrators.h policies are checked on their own, against a
+// ballistic arc and a harmonic oscillator at several step sizes. Then the
+// paths the game and the tools step landers with (Physics::Update2D, the
+// scalar and SIMD LanderBatch and, in Apple builds, LanderBatchGpu) fly
+// the same starting states along the arc, and each is held to the error
+// bound of the build's integrator. Every result is printed with its steps
+// per second, so a change that makes a path faster shows what it did to
+// its accuracy in the same table. Any check over its bound fails the run;
+// ctest runs it as physics_test.
 
-#include <iostream>
-#include <iomanip>
+#include "Entity.h"
+#include "Integrators.h"
+#include "JobSystem.h"
+#include "LanderBatch.h"
+#include "Log.h"
+#include "Physics.h"
+#include "Terrain.h"
+#if PHYSICS_TEST_GPU
+#include "LanderBatchGpu.h"
+#endif
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
 
-// Lunar gravity constant (m/s²)
-const float LUNAR_GRAVITY = 1.62f;
-
-// Test free fall calculation
-void test_free_fall(float height, float gravity) {
-    // Calculate free fall time: t = sqrt(2h/g)
-    float time = sqrt(2.0f * height / gravity);
-    
-    std::cout << "===== FREE FALL TEST =====" << std::endl;
-    std::cout << "Initial height: " << height << " m" << std::endl;
-    std::cout << "Gravity: " << gravity << " m/s²" << std::endl;
-    std::cout << "Theoretical time to impact: " << time << " s" << std::endl;
-    
-    // Simulate the fall using small time steps
-    float h = height;
-    float v = 0.0f;
-    float t = 0.0f;
-    float dt = 0.01f; // 10ms timestep
-    
-    std::cout << "\nSimulated fall:" << std::endl;
-    std::cout << "Time (s) | Height (m) | Velocity (m/s)" << std::endl;
-    std::cout << "--------------------------------------" << std::endl;
-    
-    while (h > 0) {
-        // Print state every 0.5 seconds
-        if (fabs(t - round(t * 2) / 2) < dt/2) {
-            std::cout << std::fixed << std::setprecision(2)
-                      << std::setw(8) << t << " | "
-                      << std::setw(10) << h << " | "
-                      << std::setw(14) << v << std::endl;
-        }
-        
-        // Update velocity: v = v + g*dt
-        v += gravity * dt;
-        
-        // Update height: h = h - v*dt
-        h -= v * dt;
+// Where the build puts the GPU kernel
+#ifndef LANDER_BATCH_METALLIB
+#define LANDER_BATCH_METALLIB "lander_batch.metallib"
+#endif
+
+// Lunar gravity constant (m/s²), as Physics and LanderBatch default to
+static const float kLunarGravity = 1.62f;
+    
+// The game's window, which the 2D terrain is generated for: 40 x 30 m
+static const int kWindowWidth = 800;
+static const int kWindowHeight = 600;
+    
+// Every path flies the same arcs for this long, starting high enough that
+// none of them comes down on the terrain
+static const float kFlightSeconds = 10.0f;
+static const size_t kPhysicsLanders = 256;      // Flown one after another
+static const size_t kBatchLanders = 16384;
+    
+static const float kTimeSteps[] = { 1.0f / 120.0f, 1.0f / 60.0f, 1.0f / 30.0f };
+    
+static int sChecks = 0;
+static int sFailures = 0;
+
+static bool Check(bool passed, const char* what) {
+    sChecks++;
+    if (!passed) {
+        sFailures++;
+        std::printf("FAILED: %s\n", what);
+    }
+    return passed;
+}
+    
+static double ElapsedSeconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+    
+// Double precision arithmetic for the integrators, so the convergence
+// tests measure truncation rather than float rounding
+struct DoubleOps {
+    typedef double Value;
+    static double Splat(float value) { return value; }
+    static double Add(double a, double b) { return a + b; }
+    static double Mul(double a, double b) { return a * b; }
+};
+    
+// Largest truncation error a policy may leave in position after seconds
+// of constant acceleration. Semi-implicit Euler lags the arc by exactly
+// g t dt / 2; Verlet and RK4 are exact for it.
+template <class Integrator>
+static double ArcTruncationBound(double gravity, double seconds, double dt) {
+    (void)gravity;
+    (void)seconds;
+    (void)dt;
+    return 0.0;
+}
+
+template <>
+double ArcTruncationBound<SemiImplicitEuler>(double gravity, double seconds, double dt) {
+    return 0.5 * gravity * seconds * dt;
+}
+    
+// Float rounding allowed on top: an ulp of the largest coordinate per step
+static double RoundingBound(double scale, int steps) {
+    return FLT_EPSILON * scale * steps;
+}
+    
+/*
+ * Arcs
+ */
+    
+// A lander's starting state, and where the arc puts it
+struct Arc {
+    float x, y;
+    float velX, velY;
+    
+    void At(float gravity, double t, double& posX, double& posY, double& vx, double& vy) const {
+        posX = x + velX * t;
+        posY = y + velY * t - 0.5 * gravity * t * t;
+        vx = velX;
+        vy = velY - gravity * t;
+    }
+};
+    
+// Starting states spread over the middle of the terrain: drifting at most
+// 1 m/s sideways and tossed up to 5 m/s up or 2 m/s down from 150 - 250 m,
+// they never leave it nor come down in kFlightSeconds
+static std::vector<Arc> SpreadArcs(size_t count) {
+    std::vector<Arc> arcs(count);
+    uint32_t seed = 12345;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    for (Arc& arc : arcs) {
+        arc.x = 12.0f + 16.0f * next();
+        arc.y = 150.0f + 100.0f * next();
+        arc.velX = -1.0f + 2.0f * next();
+        arc.velY = -2.0f + 7.0f * next();
+    }
+    return arcs;
+}
+
+// Worst errors of a set of landers against their arcs
+struct ArcError {
+    double position;
+    double velocity;
+    
+    ArcError() : position(0.0), velocity(0.0) {}
+    
+    void Add(const Arc& arc, float gravity, double t, double x, double y, double vx, double vy) {
+        double ax, ay, avx, avy;
+        arc.At(gravity, t, ax, ay, avx, avy);
+        position = std::max(position, std::hypot(x - ax, y - ay));
+        velocity = std::max(velocity, std::hypot(vx - avx, vy - avy));
+    }
+};
+    
+static void PrintHeader() {
+    std::printf("%-28s %8s %8s %12s %12s %12s %14s\n", "Path", "dt (s)", "Steps", "Pos err (m)", "Bound (m)",
+                "Vel err", "Steps/s");
+    std::printf("--------------------------------------------------"
+                "--------------------------------------------------\n");
+}
+
+static void PrintRow(const char* path, float dt, double steps, const ArcError& error, double bound, double seconds) {
+    std::printf("%-28s %8.5f %8.0f %12.3e %12.3e %12.3e %14.4g\n", path, dt, steps, error.position, bound,
+                error.velocity, seconds > 0.0 ? steps / seconds : 0.0);
+}
+
+// Hold a path's errors to the build integrator's bound for the arc
+static void CheckArc(const char* path, float dt, int steps, const ArcError& error, double bound) {
+    char what[160];
+    std::snprintf(what, sizeof(what), "%s at dt %.5f: position error %.3e m over the bound %.3e m", path, dt,
+                  error.position, bound);
+    Check(error.position <= bound, what);
+    
+    // Every policy gets velocity exactly right under constant acceleration
+    const double velocityBound = RoundingBound(20.0, steps);
+    std::snprintf(what, sizeof(what), "%s at dt %.5f: velocity error %.3e m/s over the bound %.3e m/s", path, dt,
+                  error.velocity, velocityBound);
+    Check(error.velocity <= velocityBound, what);
+}
+
+/*
+ * Integrators
+ */
+
+// One policy along the arc in float, as the game runs it
+template <class Integrator>
+static void TestIntegratorArc(float dt) {
+    const Arc arc = { 0.0f, 0.0f, 3.0f, 5.0f };
+    const int steps = static_cast<int>(std::lround(2.0f / dt));
+    IntegratorState2D<float> state = { arc.x, arc.y, arc.velX, arc.velY };
+    auto accel = [](const IntegratorState2D<float>&, float& ax, float& ay) {
+        ax = 0.0f;
+        ay = -kLunarGravity;
+    };
+    for (int i = 0; i < steps; i++) {
+        Integrator::template Step<ScalarOps>(state, dt, accel);
+    }
+    
+    ArcError error;
+    const double t = steps * double(dt);
+    error.Add(arc, kLunarGravity, t, state.posX, state.posY, state.velX, state.velY);
+    const double bound = ArcTruncationBound<Integrator>(kLunarGravity, t, dt) * 1.01 + RoundingBound(10.0, steps);
+    PrintRow(Integrator::Name(), dt, steps, error, bound, 0.0);
+    CheckArc(Integrator::Name(), dt, steps, error, bound);
+}
+
+// Phase space error after 1 s of x'' = -x from x = 1 at rest. Not a
+// whole period, where semi-implicit Euler's errors cancel to second order.
+template <class Integrator>
+static double OscillatorError(double dt) {
+    const int steps = static_cast<int>(std::lround(1.0 / dt));
+    IntegratorState2D<double> state = { 1.0, 0.0, 0.0, 0.0 };
+    auto accel = [](const IntegratorState2D<double>& at, double& ax, double& ay) {
+        ax = -at.posX;
+        ay = -at.posY;
+    };
+    for (int i = 0; i < steps; i++) {
+        Integrator::template Step<DoubleOps>(state, dt, accel);
+    }
+    const double t = steps * dt;
+    return std::hypot(state.posX - std::cos(t), state.velX + std::sin(t));
+}
+
+// The error must fall with the step size at the policy's order: halving
+// dt divides it by 2^order. The steps are coarse because RK4's weights
+// are float constants (Ops::Splat), which floor its error near 1e-8.
+template <class Integrator>
+static void TestIntegratorOrder(int order) {
+    const double coarse = OscillatorError<Integrator>(0.25);
+    const double fine = OscillatorError<Integrator>(0.125);
+    const double measured = std::log2(coarse / fine);
+    std::printf("%-28s order %.2f (expected %d; error %.3e at dt 0.25, %.3e at dt 0.125)\n",
+                Integrator::Name(), measured, order, coarse, fine);
+    
+    char what[160];
+    std::snprintf(what, sizeof(what), "%s converges at order %.2f, not %d", Integrator::Name(), measured, order);
+    Check(std::fabs(measured - order) < 0.3, what);
+}
+
+static void TestIntegrators() {
+    std::printf("===== INTEGRATORS (Integrators.h) =====\n\n");
+    std::printf("Ballistic arc, 2 s from the origin at (3, 5) m/s, in float:\n");
+    PrintHeader();
+    for (float dt : { 1.0f / 120.0f, 1.0f / 60.0f, 1.0f / 30.0f, 0.1f }) {
+        TestIntegratorArc<SemiImplicitEuler>(dt);
+        TestIntegratorArc<VelocityVerlet>(dt);
+        TestIntegratorArc<RungeKutta4>(dt);
+    }
+    
+    std::printf("\nHarmonic oscillator, 1 s, in double:\n");
+    TestIntegratorOrder<SemiImplicitEuler>(1);
+    TestIntegratorOrder<VelocityVerlet>(2);
+    TestIntegratorOrder<RungeKutta4>(4);
+}
+
+/*
+ * Paths
+ */
+
+// The bound every path is held to for a kFlightSeconds arc
+static double PathBound(float dt, int steps) {
+    return ArcTruncationBound<LanderIntegrator>(kLunarGravity, steps * double(dt), dt) * 1.01 +
+           RoundingBound(300.0, steps);
+}
+
+// Physics::Update2D on one lander, put back on a new arc for every flight
+static void TestPhysics2D(const Terrain& terrain, const std::vector<Arc>& arcs, float dt) {
+    const int steps = static_cast<int>(std::lround(kFlightSeconds / dt));
+    Lander lander;
+    lander.Reset();
+    Physics physics;
+    physics.Set3DMode(false);
+    physics.Initialize();
+    physics.RegisterTerrain(const_cast<Terrain*>(&terrain));
+    physics.RegisterLander(&lander);
+    
+    ArcError error;
+    bool flying = true;
+    double seconds = 0.0;
+    for (size_t i = 0; i < kPhysicsLanders; i++) {
+        const Arc& arc = arcs[i];
+        lander.Reset();
+        lander.SetPosition(arc.x, arc.y);
+        lander.GetVelocity()[0] = arc.velX;
+        lander.GetVelocity()[1] = arc.velY;
         
-        // Update time
-        t += dt;
-    }
-    
-    std::cout << std::fixed << std::setprecision(2)
-              << std::setw(8) << t << " | "
-              << std::setw(10) << 0.00 << " | "
-              << std::setw(14) << v << std::endl;
-              
-    std::cout << "\nSimulated impact time: " << t << " s" << std::endl;
-    std::cout << "Impact velocity: " << v << " m/s" << std::endl;
-    std::cout << "Theoretical impact velocity: " << (gravity * time) << " m/s" << std::endl;
-    
-    // Calculate error percentage
-    float timeError = 100.0f * fabs(t - time) / time;
-    std::cout << "Time error: " << timeError << "%" << std::endl;
-}
-
-// Test projectile motion
-void test_projectile(float initialVelocity, float angle, float gravity) {
-    // Convert angle to radians
-    float angleRad = angle * M_PI / 180.0f;
-    
-    // Initial velocity components
-    float vx = initialVelocity * cos(angleRad);
-    float vy = initialVelocity * sin(angleRad);
-    
-    // Calculate theoretical range: R = v²*sin(2θ)/g
-    float range = (initialVelocity * initialVelocity * sin(2 * angleRad)) / gravity;
-    
-    // Calculate theoretical max height: h = v²*sin²(θ)/(2g)
-    float maxHeight = (initialVelocity * initialVelocity * sin(angleRad) * sin(angleRad)) / (2 * gravity);
-    
-    // Calculate time of flight: t = 2v*sin(θ)/g
-    float timeOfFlight = (2 * initialVelocity * sin(angleRad)) / gravity;
-    
-    std::cout << "===== PROJECTILE MOTION TEST =====" << std::endl;
-    std::cout << "Initial velocity: " << initialVelocity << " m/s at " << angle << " degrees" << std::endl;
-    std::cout << "Gravity: " << gravity << " m/s²" << std::endl;
-    std::cout << "Theoretical range: " << range << " m" << std::endl;
-    std::cout << "Theoretical max height: " << maxHeight << " m" << std::endl;
-    std::cout << "Theoretical time of flight: " << timeOfFlight << " s" << std::endl;
-    
-    // Simulate the projectile using small time steps
-    float x = 0.0f;
-    float y = 0.0f;
-    float t = 0.0f;
-    float dt = 0.01f; // 10ms timestep
-    
-    std::cout << "\nSimulated trajectory:" << std::endl;
-    std::cout << "Time (s) | X (m) | Y (m) | Vx (m/s) | Vy (m/s)" << std::endl;
-    std::cout << "------------------------------------------------" << std::endl;
-    
-    float maxY = 0.0f;
-    
-    while (y >= 0 || t == 0) {
-        // Print state every 0.5 seconds
-        if (fabs(t - round(t * 2) / 2) < dt/2) {
-            std::cout << std::fixed << std::setprecision(2)
-                      << std::setw(8) << t << " | "
-                      << std::setw(5) << x << " | "
-                      << std::setw(5) << y << " | "
-                      << std::setw(8) << vx << " | "
-                      << std::setw(8) << vy << std::endl;
+        const auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; step++) {
+            physics.Update2D(dt);
         }
-        
-        // Update velocity: v = v + g*dt (only y-component)
-        vy -= gravity * dt;
-        
-        // Update position: p = p + v*dt
-        x += vx * dt;
-        y += vy * dt;
-        
-        // Track maximum height
-        if (y > maxY) maxY = y;
-        
-        // Update time
-        t += dt;
-        
-        // Prevent infinite loop if numerical errors keep y just above 0
-        if (t > timeOfFlight * 2) break;
+        seconds += ElapsedSeconds(start);
+        flying = flying && !lander.IsLanded() && !lander.IsCrashed();
+        error.Add(arc, kLunarGravity, steps * double(dt), lander.GetPosition()[0], lander.GetPosition()[1],
+                  lander.GetVelocity()[0], lander.GetVelocity()[1]);
     }
     
-    // Interpolate to find exact landing position and time
-    float tLand = t - dt - (y + vy * dt) / vy;
-    float xLand = x - vx * dt + vx * (tLand - (t - dt));
+    const double bound = PathBound(dt, steps);
+    PrintRow("Physics::Update2D", dt, double(kPhysicsLanders) * steps, error, bound, seconds);
+    Check(flying, "Physics::Update2D: a lander came down on the terrain");
+    CheckArc("Physics::Update2D", dt, steps, error, bound);
+}
+
+static void StartBatch(LanderBatch& batch, const Terrain& terrain, const std::vector<Arc>& arcs) {
+    batch.Resize(arcs.size());
+    batch.SetTerrain(&terrain);
+    batch.SetGravity(kLunarGravity);
+    for (size_t i = 0; i < arcs.size(); i++) {
+        batch.SetInitialState(i, arcs[i].x, arcs[i].y, arcs[i].velX, arcs[i].velY);
+    }
+}
+
+static ArcError MeasureBatch(const float* x, const float* y, const float* vx, const float* vy,
+                             const std::vector<Arc>& arcs, double t) {
+    ArcError error;
+    for (size_t i = 0; i < arcs.size(); i++) {
+        error.Add(arcs[i], kLunarGravity, t, x[i], y[i], vx[i], vy[i]);
+    }
+    return error;
+}
+
+// LanderBatch::Step over every lander; returns the final positions so
+// the scalar and SIMD kernels can be compared
+static std::vector<float> TestBatch(const char* path, const Terrain& terrain, const std::vector<Arc>& arcs,
+                                    float dt, bool useSimd, JobSystem* jobSystem) {
+    const int steps = static_cast<int>(std::lround(kFlightSeconds / dt));
+    LanderBatch batch;
+    StartBatch(batch, terrain, arcs);
+    batch.SetUseSimd(useSimd);
+    batch.SetJobSystem(jobSystem);
     
-    std::cout << std::fixed << std::setprecision(2)
-              << std::setw(8) << tLand << " | "
-              << std::setw(5) << xLand << " | "
-              << std::setw(5) << 0.00 << " | "
-              << std::setw(8) << vx << " | "
-              << std::setw(8) << (vy - gravity * (tLand - (t - dt))) << std::endl;
-              
-    std::cout << "\nSimulated range: " << xLand << " m" << std::endl;
-    std::cout << "Simulated max height: " << maxY << " m" << std::endl;
-    std::cout << "Simulated time of flight: " << tLand << " s" << std::endl;
+    const auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; step++) {
+        batch.Step(dt);
+    }
+    const double seconds = ElapsedSeconds(start);
     
-    // Calculate error percentages
-    float rangeError = 100.0f * fabs(xLand - range) / range;
-    float heightError = 100.0f * fabs(maxY - maxHeight) / maxHeight;
-    float timeError = 100.0f * fabs(tLand - timeOfFlight) / timeOfFlight;
+    const ArcError error = MeasureBatch(batch.GetPositionX(), batch.GetPositionY(), batch.GetVelocityX(),
+                                        batch.GetVelocityY(), arcs, steps * double(dt));
+    const double bound = PathBound(dt, steps);
+    PrintRow(path, dt, double(arcs.size()) * steps, error, bound, seconds);
+    Check(batch.CountInState(BATCH_FLYING) == arcs.size(), "LanderBatch: a lander came down on the terrain");
+    CheckArc(path, dt, steps, error, bound);
     
-    std::cout << "Range error: " << rangeError << "%" << std::endl;
-    std::cout << "Height error: " << heightError << "%" << std::endl;
-    std::cout << "Time error: " << timeError << "%" << std::endl;
+    std::vector<float> state(batch.GetPositionX(), batch.GetPositionX() + arcs.size());
+    state.insert(state.end(), batch.GetPositionY(), batch.GetPositionY() + arcs.size());
+    return state;
 }
 
-int main() {
-    std::cout << "Lunar Lander Physics Test Harness" << std::endl;
-    std::cout << "--------------------------------" << std::endl;
+#if PHYSICS_TEST_GPU
+// LanderBatchGpu flying the whole flight in one dispatch; skipped (not
+// failed) on a machine without a Metal device or the kernel
+static void TestBatchGpu(LanderBatchGpu* gpu, const Terrain& terrain, const std::vector<Arc>& arcs, float dt) {
+    if (!gpu) {
+        return;
+    }
+    const int steps = static_cast<int>(std::lround(kFlightSeconds / dt));
+    LanderBatch batch;
+    StartBatch(batch, terrain, arcs);
+    if (!Check(gpu->Upload(batch), "LanderBatchGpu: upload failed")) {
+        return;
+    }
     
-    // Test free fall with lunar gravity
-    test_free_fall(5.0f, LUNAR_GRAVITY); // 5m drop on the Moon
+    const auto start = std::chrono::steady_clock::now();
+    const bool stepped = gpu->Step(dt, steps);
+    const double seconds = ElapsedSeconds(start);
+    if (!Check(stepped, "LanderBatchGpu: step failed")) {
+        return;
+    }
     
-    std::cout << "\n\n";
+    const ArcError error = MeasureBatch(gpu->GetPositionX(), gpu->GetPositionY(), gpu->GetVelocityX(),
+                                        gpu->GetVelocityY(), arcs, steps * double(dt));
+    const double bound = PathBound(dt, steps);
+    PrintRow("LanderBatchGpu", dt, double(arcs.size()) * steps, error, bound, seconds);
+    Check(gpu->CountInState(BATCH_FLYING) == arcs.size(), "LanderBatchGpu: a lander came down on the terrain");
+    CheckArc("LanderBatchGpu", dt, steps, error, bound);
+}
+#endif
+
+static void TestPaths() {
+    std::printf("\n===== PATHS (%s, %.0f s arcs) =====\n\n", LanderIntegrator::Name(), kFlightSeconds);
+    Terrain terrain;
+    terrain.Generate2D(kWindowWidth, kWindowHeight);
+    const std::vector<Arc> arcs = SpreadArcs(kBatchLanders);
+    JobSystem jobSystem;
+
+#if PHYSICS_TEST_GPU
+    LanderBatchGpu gpuBatch;
+    LanderBatchGpu* gpu = &gpuBatch;
+    if (!gpuBatch.Initialize(LANDER_BATCH_METALLIB)) {
+        std::printf("No Metal device or kernel; skipping LanderBatchGpu\n\n");
+        gpu = nullptr;
+    }
+#endif
+    
+    PrintHeader();
+    for (float dt : kTimeSteps) {
+        TestPhysics2D(terrain, arcs, dt);
+        const std::vector<float> scalar = TestBatch("LanderBatch scalar", terrain, arcs, dt, false, nullptr);
+        LanderBatch probe;
+        probe.SetUseSimd(true);
+        if (probe.IsUsingSimd()) {
+            const std::vector<float> simd = TestBatch("LanderBatch SIMD", terrain, arcs, dt, true, nullptr);
+            Check(std::memcmp(scalar.data(), simd.data(), scalar.size() * sizeof(float)) == 0,
+                  "LanderBatch: the SIMD kernels don't match the scalar ones bit for bit");
+        }
+        TestBatch("LanderBatch jobs", terrain, arcs, dt, probe.IsUsingSimd(), &jobSystem);
+#if PHYSICS_TEST_GPU
+        TestBatchGpu(gpu, terrain, arcs, dt);
+#endif
+    }
+}
+
+int main() {
+    // Physics and the batches log every setup; keep the tables readable
+    Log::SetLevel(LogLevel::Warning);
     
-    // Test projectile motion with lunar gravity
-    test_projectile(10.0f, 45.0f, LUNAR_GRAVITY); // 10 m/s at 45 degrees
+    std::printf("Lunar Lander Physics Test\n");
+    std::printf("-------------------------\n\n");
+    TestIntegrators();
+    TestPaths();
     
-    return 0;
+    std::printf("\n%d of %d checks passed\n", sChecks - sFailures, sChecks);
+    return sFailures == 0 ? 0 : 1;
 }
@@ -4,23 +4,57 @@
 #include "../compat.h"
 #include "InputHandler.h"
 #include "../core/Game.h"
+#include "../core/LatencyTracker.h"
+#include "../core/Log.h"
+#include "../core/Profiler.h"
 #include <iostream>
 
 InputHandler::InputHandler(Game* game)
     : mGame(game)
     , mKeyboardState(SDL_GetKeyboardState(nullptr))
+    , mQueuedActions(ACTION_NONE)
+    , mHeldActions(ACTION_NONE)
+    , mActions(ACTION_NONE)
 {
     InitializeKeyBindings();
+    mQueue.reserve(64);
+}
+
+// Bit index of a single InputAction; kInputActionCount for ACTION_NONE and
+// combinations
+static int ActionIndex(InputAction action) {
+    int index = 0;
+    while (index < kInputActionCount && (1u << index) != action) {
+        index++;
+    }
+    return index;
 }
 
 void InputHandler::InitializeKeyBindings() {
     // Default key bindings
-    mKeyBindings["thrust"] = SDL_SCANCODE_UP;
-    mKeyBindings["rotateLeft"] = SDL_SCANCODE_LEFT;
-    mKeyBindings["rotateRight"] = SDL_SCANCODE_RIGHT;
-    mKeyBindings["start"] = SDL_SCANCODE_SPACE;
-    mKeyBindings["reset"] = SDL_SCANCODE_R;
-    mKeyBindings["quit"] = SDL_SCANCODE_ESCAPE;
+    mKeyBindings[ActionIndex(ACTION_THRUST)] = SDL_SCANCODE_UP;
+    mKeyBindings[ActionIndex(ACTION_ROTATE_LEFT)] = SDL_SCANCODE_LEFT;
+    mKeyBindings[ActionIndex(ACTION_ROTATE_RIGHT)] = SDL_SCANCODE_RIGHT;
+    mKeyBindings[ActionIndex(ACTION_START)] = SDL_SCANCODE_SPACE;
+    mKeyBindings[ActionIndex(ACTION_RESET)] = SDL_SCANCODE_R;
+    mKeyBindings[ActionIndex(ACTION_QUIT)] = SDL_SCANCODE_ESCAPE;
+}
+
+void InputHandler::QueueKey(SDL_Scancode key, bool pressed, uint32_t timestamp) {
+    unsigned int actions = mQueuedActions;
+    for (int i = 0; i < kInputActionCount; i++) {
+        if (mKeyBindings[i] == key) {
+            actions = pressed ? (actions | (1u << i)) : (actions & ~(1u << i));
+        }
+    }
+    if (actions != mQueuedActions) {
+        // Events are pumped some time after they happen; date them back
+        uint64_t eventNs = Profiler::Now();
+        const uint32_t age = SDL_GetTicks() - timestamp;
+        eventNs = eventNs > age * 1000000ull ? eventNs - age * 1000000ull : 0;
+        mQueue.push_back({ timestamp, actions, eventNs });
+        mQueuedActions = actions;
+    }
 }
 
 void InputHandler::ProcessInput() {
@@ -40,6 +74,9 @@ void InputHandler::ProcessInput() {
                 
             case SDL_KEYDOWN:
                 // Handle key down events
+                if (!event.key.repeat) {
+                    QueueKey(event.key.keysym.scancode, true, event.key.timestamp);
+                }
                 if (mGame) {
                     mGame->OnKeyDown(event.key.keysym.sym);
                 }
@@ -47,69 +84,59 @@ void InputHandler::ProcessInput() {
                 
             case SDL_KEYUP:
                 // Handle key up events
+                QueueKey(event.key.keysym.scancode, false, event.key.timestamp);
                 if (mGame) {
                     mGame->OnKeyUp(event.key.keysym.sym);
                 }
                 break;
+                
+            case SDL_WINDOWEVENT:
+                // Resized, or moved to a display whose scale changes the
+                // drawable size without changing the size in points
+                if (mGame && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    mGame->OnWindowResized(event.window.data1, event.window.data2);
+                }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+                if (mGame && event.window.event == SDL_WINDOWEVENT_DISPLAY_CHANGED) {
+                    int width, height;
+                    SDL_GetWindowSize(SDL_GetWindowFromID(event.window.windowID), &width, &height);
+                    mGame->OnWindowResized(width, height);
+                }
+#endif
+                break;
         }
     }
-    
-    // Game-specific input handling can be done here
-    // For example, checking if thrust is active and notifying the game
 }
 
 bool InputHandler::IsKeyPressed(SDL_Scancode key) const {
     return mKeyboardState[key] != 0;
 }
 
-bool InputHandler::IsThrustActive() const {
-    auto it = mKeyBindings.find("thrust");
-    if (it != mKeyBindings.end()) {
-        return IsKeyPressed(it->second);
-    }
-    return false;
-}
-
-bool InputHandler::IsRotateLeftActive() const {
-    auto it = mKeyBindings.find("rotateLeft");
-    if (it != mKeyBindings.end()) {
-        return IsKeyPressed(it->second);
-    }
-    return false;
-}
-
-bool InputHandler::IsRotateRightActive() const {
-    auto it = mKeyBindings.find("rotateRight");
-    if (it != mKeyBindings.end()) {
-        return IsKeyPressed(it->second);
-    }
-    return false;
-}
-
-bool InputHandler::IsStartActive() const {
-    auto it = mKeyBindings.find("start");
-    if (it != mKeyBindings.end()) {
-        return IsKeyPressed(it->second);
-    }
-    return false;
-}
-
-bool InputHandler::IsResetActive() const {
-    auto it = mKeyBindings.find("reset");
-    if (it != mKeyBindings.end()) {
-        return IsKeyPressed(it->second);
+void InputHandler::AdvanceTo(uint32_t timeMs) {
+    // The step sees what is held at its end plus anything held at some
+    // point during it, so a tap shorter than a step isn't lost
+    size_t taken = 0;
+    unsigned int during = ACTION_NONE;
+    const unsigned int flightActions = ACTION_THRUST | ACTION_ROTATE_LEFT | ACTION_ROTATE_RIGHT;
+    while (taken < mQueue.size() && mQueue[taken].timestamp <= timeMs) {
+        const QueuedActions& change = mQueue[taken];
+        if ((change.actions ^ mHeldActions) & flightActions) {
+            LatencyTracker::OnInputTaken(change.eventNs);
+        }
+        during |= change.actions;
+        mHeldActions = change.actions;
+        taken++;
     }
-    return false;
+    mQueue.erase(mQueue.begin(), mQueue.begin() + taken);
+    mActions = mHeldActions | during;
 }
 
-bool InputHandler::IsQuitActive() const {
-    auto it = mKeyBindings.find("quit");
-    if (it != mKeyBindings.end()) {
-        return IsKeyPressed(it->second);
+bool InputHandler::SetKeyBinding(InputAction action, SDL_Scancode key) {
+    const int index = ActionIndex(action);
+    if (index >= kInputActionCount) {
+        LOG_ERROR("Can't bind a key to action mask 0x%x: bindings are for one action", static_cast<unsigned>(action));
+        return false;
     }
-    return false;
-}
-
-void InputHandler::SetKeyBinding(const std::string& action, SDL_Scancode key) {
-    mKeyBindings[action] = key;
+    mKeyBindings[index] = key;
+    return true;
 }
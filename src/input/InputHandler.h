@@ -4,43 +4,67 @@
 #pragma once
 
 #include "../compat.h"
+#include "InputSource.h"
 #include <SDL2/SDL.h>
-#include <map>
+#include <vector>
 
 // Forward declarations
 class Game;
 
-class InputHandler {
+class InputHandler : public InputSource {
 public:
     InputHandler(Game* game);
     ~InputHandler() = default;
     
-    // Process input events
-    void ProcessInput();
+    // Pump SDL events: bound key changes join the action queue with their
+    // timestamps; other keys and window events go straight to the game
+    void ProcessInput() override;
+    
+    // Take the queued key changes up to timeMs into the actions the
+    // queries report
+    void AdvanceTo(uint32_t timeMs) override;
     
     // Check if a key is currently pressed
     bool IsKeyPressed(SDL_Scancode key) const;
     
     // Helper methods for common game controls
-    bool IsThrustActive() const;
-    bool IsRotateLeftActive() const;
-    bool IsRotateRightActive() const;
-    bool IsStartActive() const;
-    bool IsResetActive() const;
-    bool IsQuitActive() const;
+    bool IsThrustActive() const override { return (mActions & ACTION_THRUST) != 0; }
+    bool IsRotateLeftActive() const override { return (mActions & ACTION_ROTATE_LEFT) != 0; }
+    bool IsRotateRightActive() const override { return (mActions & ACTION_ROTATE_RIGHT) != 0; }
+    bool IsStartActive() const override { return (mActions & ACTION_START) != 0; }
+    bool IsResetActive() const override { return (mActions & ACTION_RESET) != 0; }
+    bool IsQuitActive() const override { return (mActions & ACTION_QUIT) != 0; }
     
-    // Set key bindings
-    void SetKeyBinding(const std::string& action, SDL_Scancode key);
+    // Bind key to one action; false for ACTION_NONE or a combination
+    bool SetKeyBinding(InputAction action, SDL_Scancode key);
     
 private:
+    // Actions held from timestamp (SDL ticks) on; eventNs is the same
+    // moment on the Profiler::Now() clock, for the latency samples
+    struct QueuedActions {
+        uint32_t timestamp;
+        unsigned int actions;
+        uint64_t eventNs;
+    };
+    
     // Reference to the game
     Game* mGame;
     
     // Current keyboard state
     const Uint8* mKeyboardState;
     
-    // Key bindings (action name -> key code)
-    std::map<std::string, SDL_Scancode> mKeyBindings;
+    // Key bound to each action, indexed by InputAction bit
+    SDL_Scancode mKeyBindings[kInputActionCount];
+    
+    // Key changes not yet reached by a step, oldest first; the capacity
+    // stays, so a settled frame doesn't allocate
+    std::vector<QueuedActions> mQueue;
+    unsigned int mQueuedActions;    // Held after the last queued change
+    unsigned int mHeldActions;      // Held after the last change a step took
+    unsigned int mActions;          // What the current step sees
+    
+    // Queue the actions a bound key's press or release leaves held
+    void QueueKey(SDL_Scancode key, bool pressed, uint32_t timestamp);
     
     // Initialize default key bindings
     void InitializeKeyBindings();
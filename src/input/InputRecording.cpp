@@ -0,0 +1,288 @@
+// InputRecording.cpp
+// Implementation of input recording and replay
+
+#include "InputRecording.h"
+#include "../core/Game.h"
+#include "../core/Log.h"
+#include <cstring>
+
+static const char kRecordingMagic[4] = { 'L', 'L', 'I', 'R' };
+
+/*
+ * Little-endian helpers
+ */
+
+static void WriteU16(std::ofstream& file, uint16_t value) {
+    unsigned char bytes[2] = { (unsigned char)(value & 0xFF), (unsigned char)(value >> 8) };
+    file.write(reinterpret_cast<const char*>(bytes), 2);
+}
+
+static void WriteU32(std::ofstream& file, uint32_t value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = (unsigned char)((value >> (8 * i)) & 0xFF);
+    }
+    file.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+static bool ReadU8(std::ifstream& file, uint8_t& value) {
+    char byte;
+    if (!file.get(byte)) return false;
+    value = static_cast<uint8_t>(byte);
+    return true;
+}
+
+static bool ReadU16(std::ifstream& file, uint16_t& value) {
+    unsigned char bytes[2];
+    if (!file.read(reinterpret_cast<char*>(bytes), 2)) return false;
+    value = (uint16_t)(bytes[0] | (bytes[1] << 8));
+    return true;
+}
+
+static bool ReadU32(std::ifstream& file, uint32_t& value) {
+    unsigned char bytes[4];
+    if (!file.read(reinterpret_cast<char*>(bytes), 4)) return false;
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return true;
+}
+
+static bool ReadVarint(std::ifstream& file, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if (!ReadU8(file, byte)) return false;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/*
+ * InputRecorder
+ */
+
+InputRecorder::InputRecorder()
+    : mLastStep(0)
+{
+}
+
+InputRecorder::~InputRecorder() {
+    if (IsOpen()) {
+        Close(mLastStep);
+    }
+}
+
+bool InputRecorder::Open(const std::string& filename, const InputRecordingHeader& header) {
+    mFile.open(filename, std::ios::binary | std::ios::trunc);
+    if (!mFile) {
+        LOG_ERROR("Failed to open input recording for writing: %s", filename.c_str());
+        return false;
+    }
+    
+    mHeader = header;
+    mLastStep = 0;
+    
+    uint32_t timeStepBits;
+    std::memcpy(&timeStepBits, &header.fixedTimeStep, sizeof(timeStepBits));
+    
+    mFile.write(kRecordingMagic, 4);
+    WriteU16(mFile, InputRecordingHeader::kVersion);
+    WriteU16(mFile, header.flags);
+    WriteU32(mFile, header.seed);
+    WriteU32(mFile, timeStepBits);
+    WriteU32(mFile, header.checksumInterval);
+    
+    LOG_INFO("Recording input to %s", filename.c_str());
+    return true;
+}
+
+void InputRecorder::Close(uint64_t totalSteps) {
+    if (!IsOpen()) return;
+    
+    WriteRecord('E', totalSteps);
+    mFile.close();
+    
+    LOG_INFO("Input recording closed after %llu steps", static_cast<unsigned long long>(totalSteps));
+}
+
+void InputRecorder::RecordPoll(uint64_t step, unsigned int actions) {
+    if (!IsOpen()) return;
+    WriteRecord('P', step);
+    mFile.put(static_cast<char>(actions & 0xFF));
+}
+
+void InputRecorder::RecordKey(uint64_t step, int keyCode) {
+    if (!IsOpen()) return;
+    WriteRecord('K', step);
+    WriteVarint(static_cast<uint32_t>(keyCode));
+}
+
+void InputRecorder::RecordChecksum(uint64_t step, uint32_t checksum) {
+    if (!IsOpen()) return;
+    WriteRecord('C', step);
+    WriteU32(mFile, checksum);
+}
+
+void InputRecorder::WriteRecord(uint8_t type, uint64_t step) {
+    // Steps only move forward, so store the delta (almost always one byte)
+    mFile.put(static_cast<char>(type));
+    WriteVarint(step - mLastStep);
+    mLastStep = step;
+}
+
+void InputRecorder::WriteVarint(uint64_t value) {
+    while (value >= 0x80) {
+        mFile.put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    mFile.put(static_cast<char>(value));
+}
+
+/*
+ * ReplayInput
+ */
+
+ReplayInput::ReplayInput(Game* game)
+    : mGame(game)
+    , mNextInput(0)
+    , mNextChecksum(0)
+    , mTotalSteps(0)
+    , mActions(ACTION_NONE)
+    , mChecksumMismatches(0)
+    , mChecksumsVerified(0)
+{
+}
+
+bool ReplayInput::Load(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        LOG_ERROR("Failed to open input recording: %s", filename.c_str());
+        return false;
+    }
+    
+    // Header
+    char magic[4];
+    uint16_t version = 0;
+    uint32_t timeStepBits = 0;
+    if (!file.read(magic, 4) || std::memcmp(magic, kRecordingMagic, 4) != 0 ||
+        !ReadU16(file, version) || version != InputRecordingHeader::kVersion ||
+        !ReadU16(file, mHeader.flags) || !ReadU32(file, mHeader.seed) ||
+        !ReadU32(file, timeStepBits) || !ReadU32(file, mHeader.checksumInterval)) {
+        LOG_ERROR("Not a valid input recording: %s", filename.c_str());
+        return false;
+    }
+    std::memcpy(&mHeader.fixedTimeStep, &timeStepBits, sizeof(timeStepBits));
+    
+    // Records
+    mInputRecords.clear();
+    mChecksums.clear();
+    uint64_t step = 0;
+    bool ended = false;
+    uint8_t type;
+    while (!ended && ReadU8(file, type)) {
+        uint64_t delta;
+        if (!ReadVarint(file, delta)) break;
+        step += delta;
+        
+        ReplayRecord record = { type, step, 0 };
+        bool ok = true;
+        switch (type) {
+            case 'P': {
+                uint8_t actions;
+                ok = ReadU8(file, actions);
+                record.value = actions;
+                mInputRecords.push_back(record);
+                break;
+            }
+            case 'K': {
+                uint64_t keyCode;
+                ok = ReadVarint(file, keyCode);
+                record.value = static_cast<uint32_t>(keyCode);
+                mInputRecords.push_back(record);
+                break;
+            }
+            case 'C':
+                ok = ReadU32(file, record.value);
+                mChecksums.push_back(record);
+                break;
+            case 'E':
+                mTotalSteps = step;
+                ended = true;
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        
+        if (!ok) {
+            LOG_ERROR("Corrupt input recording at step %llu: %s",
+                      static_cast<unsigned long long>(step), filename.c_str());
+            return false;
+        }
+    }
+    
+    // A recording cut short (e.g. a crash) still replays up to its last record
+    if (!ended) {
+        LOG_WARNING("Input recording has no end marker; replaying what was written");
+        mTotalSteps = step;
+    }
+    
+    mNextInput = 0;
+    mNextChecksum = 0;
+    mActions = ACTION_NONE;
+    
+    LOG_INFO("Loaded input recording: %llu steps, %zu input records, %zu checksums",
+             static_cast<unsigned long long>(mTotalSteps), mInputRecords.size(), mChecksums.size());
+    return true;
+}
+
+int ReplayInput::GetPollCount(uint64_t step) const {
+    int count = 0;
+    for (size_t i = mNextInput; i < mInputRecords.size() && mInputRecords[i].step == step; ++i) {
+        if (mInputRecords[i].type == 'P') {
+            count++;
+        }
+    }
+    return count;
+}
+
+void ReplayInput::ProcessInput() {
+    // Replay key presses that came before this poll, then the poll itself
+    while (mNextInput < mInputRecords.size()) {
+        const ReplayRecord& record = mInputRecords[mNextInput++];
+        if (record.type == 'K') {
+            if (mGame) {
+                mGame->OnKeyDown(static_cast<int>(record.value));
+            }
+        } else {
+            mActions = record.value;
+            break;
+        }
+    }
+}
+
+bool ReplayInput::VerifyChecksum(uint64_t step, uint32_t checksum) {
+    // Skip checksums for steps we have already passed
+    while (mNextChecksum < mChecksums.size() && mChecksums[mNextChecksum].step < step) {
+        mNextChecksum++;
+    }
+    
+    if (mNextChecksum >= mChecksums.size() || mChecksums[mNextChecksum].step != step) {
+        return true;
+    }
+    
+    uint32_t expected = mChecksums[mNextChecksum++].value;
+    mChecksumsVerified++;
+    if (expected != checksum) {
+        if (mChecksumMismatches == 0) {
+            LOG_ERROR("Replay diverged at step %llu: checksum %08x, recorded %08x",
+                      static_cast<unsigned long long>(step), checksum, expected);
+        }
+        mChecksumMismatches++;
+        return false;
+    }
+    return true;
+}
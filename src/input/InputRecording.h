@@ -0,0 +1,113 @@
+// InputRecording.h
+// Compact binary recording and deterministic replay of per-step input
+
+#pragma once
+
+#include "InputSource.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Forward declarations
+class Game;
+
+// Recording file layout (little-endian):
+//   header:  "LLIR" magic, u16 version, u16 flags, u32 seed,
+//            f32 fixed time step, u32 checksum interval
+//   records: u8 type, varint step delta from the previous record, payload
+//     'P' input poll       u8 action bits
+//     'K' key press        varint key code (Game::OnKeyDown)
+//     'C' state checksum   u32 checksum over the lander state
+//     'E' end of stream    (step is the total number of steps)
+struct InputRecordingHeader {
+    static const uint16_t kVersion = 3;
+    static const uint16_t kFlag3DMode = 1 << 0;
+    static const uint16_t kFlagFixedSteps = 1 << 1;     // Adaptive physics steps off
+    
+    uint16_t flags;
+    uint32_t seed;
+    float fixedTimeStep;
+    uint32_t checksumInterval;
+    
+    InputRecordingHeader() : flags(0), seed(1), fixedTimeStep(1.0f / 120.0f), checksumInterval(120) {}
+};
+
+// Writes a recording while the game runs
+class InputRecorder {
+public:
+    InputRecorder();
+    ~InputRecorder();
+    
+    bool Open(const std::string& filename, const InputRecordingHeader& header);
+    void Close(uint64_t totalSteps);
+    bool IsOpen() const { return mFile.is_open(); }
+    
+    // Record one Game::ProcessInput poll, made before simulating `step`
+    void RecordPoll(uint64_t step, unsigned int actions);
+    void RecordKey(uint64_t step, int keyCode);
+    void RecordChecksum(uint64_t step, uint32_t checksum);
+    
+    uint32_t GetChecksumInterval() const { return mHeader.checksumInterval; }
+    
+private:
+    void WriteRecord(uint8_t type, uint64_t step);
+    void WriteVarint(uint64_t value);
+    
+    std::ofstream mFile;
+    InputRecordingHeader mHeader;
+    uint64_t mLastStep;
+};
+
+// Input source that plays a recording back, poll for poll
+class ReplayInput : public InputSource {
+public:
+    ReplayInput(Game* game);
+    ~ReplayInput() = default;
+    
+    bool Load(const std::string& filename);
+    const InputRecordingHeader& GetHeader() const { return mHeader; }
+    
+    // Number of polls recorded before simulating `step`
+    int GetPollCount(uint64_t step) const override;
+    
+    // True once every recorded step has been simulated
+    bool IsFinished(uint64_t step) const { return step >= mTotalSteps; }
+    uint64_t GetTotalSteps() const { return mTotalSteps; }
+    
+    // Compare against the recorded checksum for `step` (if there is one)
+    bool VerifyChecksum(uint64_t step, uint32_t checksum);
+    int GetChecksumMismatches() const { return mChecksumMismatches; }
+    int GetChecksumsVerified() const { return mChecksumsVerified; }
+    
+    // Implement InputSource interface
+    void ProcessInput() override;
+    
+    bool IsThrustActive() const override { return (mActions & ACTION_THRUST) != 0; }
+    bool IsRotateLeftActive() const override { return (mActions & ACTION_ROTATE_LEFT) != 0; }
+    bool IsRotateRightActive() const override { return (mActions & ACTION_ROTATE_RIGHT) != 0; }
+    bool IsStartActive() const override { return (mActions & ACTION_START) != 0; }
+    bool IsResetActive() const override { return (mActions & ACTION_RESET) != 0; }
+    bool IsQuitActive() const override { return (mActions & ACTION_QUIT) != 0; }
+    
+private:
+    struct ReplayRecord {
+        uint8_t type;
+        uint64_t step;
+        uint32_t value;   // Actions, key code or checksum
+    };
+    
+    Game* mGame;
+    InputRecordingHeader mHeader;
+    
+    // Poll and key records in order, and checksum records separately
+    std::vector<ReplayRecord> mInputRecords;
+    std::vector<ReplayRecord> mChecksums;
+    size_t mNextInput;
+    size_t mNextChecksum;
+    uint64_t mTotalSteps;
+    
+    unsigned int mActions;
+    int mChecksumMismatches;
+    int mChecksumsVerified;
+};
@@ -0,0 +1,60 @@
+// InputSource.h
+// Abstract source of player actions (keyboard, script, replay)
+
+#pragma once
+
+#include <cstdint>
+
+// Player action bits, shared by every input source
+enum InputAction : unsigned int {
+    ACTION_NONE         = 0,
+    ACTION_THRUST       = 1 << 0,
+    ACTION_ROTATE_LEFT  = 1 << 1,
+    ACTION_ROTATE_RIGHT = 1 << 2,
+    ACTION_START        = 1 << 3,
+    ACTION_RESET        = 1 << 4,
+    ACTION_QUIT         = 1 << 5
+};
+
+// Number of InputAction bits; action i is bit 1 << i
+static const int kInputActionCount = 6;
+
+// Abstract input source interface
+class InputSource {
+public:
+    virtual ~InputSource() = default;
+    
+    // Called once per simulation step before the action queries, or once
+    // per frame by a windowed loop that then calls AdvanceTo before each step
+    virtual void ProcessInput() = 0;
+    
+    // Apply what happened up to timeMs (SDL ticks), the wall time the next
+    // step ends at, so an input lands on the step it happened during.
+    // Sources without timestamps have nothing to do.
+    virtual void AdvanceTo(uint32_t timeMs) {}
+    
+    // Action queries used by Game::ProcessInput
+    virtual bool IsThrustActive() const = 0;
+    virtual bool IsRotateLeftActive() const = 0;
+    virtual bool IsRotateRightActive() const = 0;
+    virtual bool IsStartActive() const = 0;
+    virtual bool IsResetActive() const = 0;
+    virtual bool IsQuitActive() const = 0;
+    
+    // Called when the game starts a new flight
+    virtual void OnReset() {}
+    
+    // Polls to make before simulating the given fixed step when running
+    // headless (replays can hold zero or several per step)
+    virtual int GetPollCount(uint64_t step) const { return 1; }
+    
+    // Current actions as InputAction bits
+    unsigned int GetActions() const {
+        return (IsThrustActive() ? ACTION_THRUST : 0) |
+               (IsRotateLeftActive() ? ACTION_ROTATE_LEFT : 0) |
+               (IsRotateRightActive() ? ACTION_ROTATE_RIGHT : 0) |
+               (IsStartActive() ? ACTION_START : 0) |
+               (IsResetActive() ? ACTION_RESET : 0) |
+               (IsQuitActive() ? ACTION_QUIT : 0);
+    }
+};
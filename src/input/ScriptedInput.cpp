@@ -0,0 +1,92 @@
+// ScriptedInput.cpp
+// Implementation of the scripted input source
+
+#include "ScriptedInput.h"
+#include "../core/Log.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+ScriptedInput::ScriptedInput(float timeStep)
+    : mNextEvent(0)
+    , mTime(0.0f)
+    , mTimeStep(timeStep)
+    , mActions(ACTION_NONE)
+{
+}
+
+bool ScriptedInput::LoadScript(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        LOG_ERROR("Failed to open input script: %s", filename.c_str());
+        return false;
+    }
+    
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        
+        // Skip blank lines and comments
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        
+        std::istringstream stream(line);
+        float time;
+        std::string actionList;
+        if (!(stream >> time >> actionList)) {
+            LOG_ERROR("%s:%d: expected '<time> <actions>'", filename.c_str(), lineNumber);
+            return false;
+        }
+        
+        // Parse '+'-separated action names
+        unsigned int actions = ACTION_NONE;
+        std::istringstream actionStream(actionList);
+        std::string action;
+        while (std::getline(actionStream, action, '+')) {
+            if (action == "none") {}
+            else if (action == "thrust") actions |= ACTION_THRUST;
+            else if (action == "left") actions |= ACTION_ROTATE_LEFT;
+            else if (action == "right") actions |= ACTION_ROTATE_RIGHT;
+            else if (action == "start") actions |= ACTION_START;
+            else if (action == "reset") actions |= ACTION_RESET;
+            else if (action == "quit") actions |= ACTION_QUIT;
+            else {
+                LOG_ERROR("%s:%d: unknown action '%s'", filename.c_str(), lineNumber, action.c_str());
+                return false;
+            }
+        }
+        
+        AddEvent(time, actions);
+    }
+    
+    LOG_INFO("Loaded input script with %zu events", mEvents.size());
+    return true;
+}
+
+void ScriptedInput::AddEvent(float time, unsigned int actions) {
+    // Keep events sorted by time (stable for equal times)
+    ScriptEvent event = { time, actions };
+    auto it = std::upper_bound(mEvents.begin(), mEvents.end(), event,
+        [](const ScriptEvent& a, const ScriptEvent& b) { return a.time < b.time; });
+    mEvents.insert(it, event);
+}
+
+void ScriptedInput::ProcessInput() {
+    // Apply every event that is due by the current flight time
+    while (mNextEvent < mEvents.size() && mEvents[mNextEvent].time <= mTime) {
+        mActions = mEvents[mNextEvent].actions;
+        mNextEvent++;
+    }
+    
+    mTime += mTimeStep;
+}
+
+void ScriptedInput::OnReset() {
+    // Restart the script for the new flight
+    mNextEvent = 0;
+    mTime = 0.0f;
+    mActions = ACTION_NONE;
+}
@@ -0,0 +1,48 @@
+// ScriptedInput.h
+// Timed action script used as the input source for headless runs
+
+#pragma once
+
+#include "InputSource.h"
+#include <string>
+#include <vector>
+
+class ScriptedInput : public InputSource {
+public:
+    ScriptedInput(float timeStep);
+    ~ScriptedInput() = default;
+    
+    // Load a script: one "<time_s> <action>[+<action>...]" entry per line,
+    // where action is none, thrust, left, right, start, reset or quit
+    bool LoadScript(const std::string& filename);
+    
+    // Set the action bits held from the given flight time onwards
+    void AddEvent(float time, unsigned int actions);
+    
+    // Implement InputSource interface
+    void ProcessInput() override;
+    
+    bool IsThrustActive() const override { return (mActions & ACTION_THRUST) != 0; }
+    bool IsRotateLeftActive() const override { return (mActions & ACTION_ROTATE_LEFT) != 0; }
+    bool IsRotateRightActive() const override { return (mActions & ACTION_ROTATE_RIGHT) != 0; }
+    bool IsStartActive() const override { return (mActions & ACTION_START) != 0; }
+    bool IsResetActive() const override { return (mActions & ACTION_RESET) != 0; }
+    bool IsQuitActive() const override { return (mActions & ACTION_QUIT) != 0; }
+    
+    void OnReset() override;
+    
+private:
+    struct ScriptEvent {
+        float time;            // Flight time in seconds
+        unsigned int actions;  // InputAction bits
+    };
+    
+    // Events sorted by time
+    std::vector<ScriptEvent> mEvents;
+    size_t mNextEvent;
+    
+    // Playback state
+    float mTime;
+    float mTimeStep;
+    unsigned int mActions;
+};
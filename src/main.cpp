@@ -2,37 +2,348 @@
 // Entry point for the lunar lander simulation
 #include "compat.h"
 #include "core/Game.h"
+#include "core/FramePacer.h"
+#include "core/DescentController.h"
+#include "core/Profiler.h"
+#include "core/LatencyTracker.h"
+#include "core/Log.h"
+#include "core/MemoryTracker.h"
+#include "core/Physics.h"
 #include <iostream>
+#include <string>
 
 int main(int argc, char* argv[]) {
-    // Check for 3D mode command line argument
+    // Check command line arguments
     bool use3DMode = false;
+    float physicsRate = 120.0f;
+    float timeWarp = 1.0f;
+    bool headless = false;
+    std::string inputScript;
+    int flightCount = 1;
+    float maxFlightTime = 120.0f;
+    bool autopilot = false;
+    int workerThreads = -1;
+    PhysicsBroadphase broadphase = PhysicsBroadphase::DBVT;
+    bool adaptiveSteps = true;
+    std::string recordFile;
+    std::string replayFile;
+    bool replayWindowed = false;
+    int hostPort = 0;
+    std::string connectAddress;
+    int checksumInterval = 120;
+    long seed = 1;
+    std::string scenarioFile;
+    std::string scenarioName;
+    std::string traceFile;
+    std::string stageReportFile;
+    std::string demFile;
+    int tileCacheMb = 0;
+    std::string terrainCacheFile;
+    int terrainGridSize = 0;
+    int worldWidth2D = 0;
+    int worldSegments2D = 0;
+    float zoom2D = 1.0f;
+    bool gpuTerrain = false;
+    bool terrainTextures = false;
+    bool terrainTessellation = false;
+    bool terrainMeshlets = false;
+    bool gpuCulling = false;
+    bool hizCulling = false;
+    bool dynamicResolution = false;
+    bool temporalUpscaling = false;
+    bool variableRate = false;
+    bool shadows = true;
+    bool rayTracedShadows = false;
+    bool horizonShadows = false;
+    bool deferredLighting = false;
+    bool parallelEncoding = false;
+    float targetFrameRate = 120.0f;
+    int drawableCount = 3;
+    FramePacingMode framePacing = FramePacingMode::DisplaySync;
+    bool pipelined = false;
+    const char* pipelineArchive = nullptr;   // Null = Game's default
+    std::string landerMesh;
+    float spikeCaptureMs = 0.0f;
+    int spikeCaptureFrames = 3;
+    std::string spikeCaptureDirectory;
+    std::string telemetryName;
+    bool audio = true;
+    std::string videoFile;
+    LogLevel logLevel = LogLevel::Info;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--3d" || arg == "-3d") {
             use3DMode = true;
-            break;
+        } else if (arg == "--physics-rate" && i + 1 < argc) {
+            physicsRate = std::stof(argv[++i]);
+        } else if (arg == "--time-warp" && i + 1 < argc) {
+            timeWarp = std::stof(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            workerThreads = std::stoi(argv[++i]);
+        } else if (arg == "--fixed-steps") {
+            adaptiveSteps = false;
+        } else if (arg == "--broadphase" && i + 1 < argc) {
+            if (!Physics::ParseBroadphase(argv[++i], broadphase)) {
+                std::cerr << "Unknown broadphase '" << argv[i] << "' (dbvt, sap, sap32)" << std::endl;
+            }
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (arg == "--replay-windowed") {
+            replayWindowed = true;
+        } else if (arg == "--host" && i + 1 < argc) {
+            hostPort = std::stoi(argv[++i]);
+        } else if (arg == "--connect" && i + 1 < argc) {
+            connectAddress = argv[++i];
+        } else if (arg == "--checksum-interval" && i + 1 < argc) {
+            checksumInterval = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stol(argv[++i]);
+        } else if (arg == "--scenario" && i + 1 < argc) {
+            scenarioFile = argv[++i];
+        } else if (arg == "--scenario-name" && i + 1 < argc) {
+            scenarioName = argv[++i];
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            if (!Log::ParseLevel(argv[++i], logLevel)) {
+                std::cerr << "Unknown log level '" << argv[i] << "' (debug, info, warning, error)" << std::endl;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (arg == "--stage-report" && i + 1 < argc) {
+            stageReportFile = argv[++i];
+        } else if (arg == "--latency") {
+            LatencyTracker::SetEnabled(true);
+        } else if (arg == "--dem" && i + 1 < argc) {
+            demFile = argv[++i];
+        } else if (arg == "--terrain-cache" && i + 1 < argc) {
+            terrainCacheFile = argv[++i];
+        } else if (arg == "--tile-cache-mb" && i + 1 < argc) {
+            tileCacheMb = std::stoi(argv[++i]);
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            if (!MemoryTracker::ParseBudget(argv[++i])) {
+                std::cerr << "Bad memory budget '" << argv[i] << "' (name=MB; heights, tiles, bullet, "
+                          << "gpu-buffers, gpu-textures, particles, frame)" << std::endl;
+            }
+        } else if (arg == "--terrain-grid" && i + 1 < argc) {
+            terrainGridSize = std::stoi(argv[++i]);
+        } else if (arg == "--world-2d" && i + 1 < argc) {
+            worldWidth2D = std::stoi(argv[++i]);
+        } else if (arg == "--segments-2d" && i + 1 < argc) {
+            worldSegments2D = std::stoi(argv[++i]);
+        } else if (arg == "--zoom-2d" && i + 1 < argc) {
+            zoom2D = std::stof(argv[++i]);
+        } else if (arg == "--gpu-terrain") {
+            gpuTerrain = true;
+        } else if (arg == "--terrain-textures") {
+            terrainTextures = true;
+        } else if (arg == "--terrain-tessellation") {
+            terrainTextures = true;       // Displaces from the height textures
+            terrainTessellation = true;
+        } else if (arg == "--terrain-meshlets") {
+            terrainTextures = true;       // Meshlets are emitted from the height textures
+            terrainMeshlets = true;
+        } else if (arg == "--lander-mesh" && i + 1 < argc) {
+            landerMesh = argv[++i];
+        } else if (arg == "--gpu-culling") {
+            gpuCulling = true;
+        } else if (arg == "--hiz-culling") {
+            gpuCulling = true;            // Tests the chunks the culling kernel draws
+            hizCulling = true;
+        } else if (arg == "--dynamic-resolution") {
+            dynamicResolution = true;
+        } else if (arg == "--temporal-upscaling") {
+            dynamicResolution = true;     // Upscales the dynamic resolution scene
+            temporalUpscaling = true;
+        } else if (arg == "--variable-rate") {
+            variableRate = true;
+        } else if (arg == "--no-shadows") {
+            shadows = false;
+        } else if (arg == "--ray-traced-shadows") {
+            rayTracedShadows = true;
+        } else if (arg == "--horizon-shadows") {
+            horizonShadows = true;
+        } else if (arg == "--deferred-lighting") {
+            deferredLighting = true;
+        } else if (arg == "--parallel-encoding") {
+            parallelEncoding = true;
+        } else if (arg == "--target-fps" && i + 1 < argc) {
+            targetFrameRate = std::stof(argv[++i]);
+        } else if (arg == "--drawables" && i + 1 < argc) {
+            drawableCount = std::stoi(argv[++i]);
+        } else if (arg == "--no-vsync") {
+            framePacing = FramePacingMode::Uncapped;
+        } else if (arg == "--frame-pacing" && i + 1 < argc) {
+            if (!FramePacer::ParseMode(argv[++i], framePacing)) {
+                std::cerr << "Unknown frame pacing '" << argv[i] << "' (uncapped, vsync, target)" << std::endl;
+            }
+        } else if (arg == "--pipelined") {
+            pipelined = true;
+        } else if (arg == "--pipeline-archive" && i + 1 < argc) {
+            pipelineArchive = argv[++i];
+        } else if (arg == "--no-pipeline-archive") {
+            pipelineArchive = "";
+        } else if (arg == "--capture-spikes" && i + 1 < argc) {
+            spikeCaptureMs = std::stof(argv[++i]);
+        } else if (arg == "--capture-frames" && i + 1 < argc) {
+            spikeCaptureFrames = std::stoi(argv[++i]);
+        } else if (arg == "--capture-dir" && i + 1 < argc) {
+            spikeCaptureDirectory = argv[++i];
+        } else if (arg == "--record-video" && i + 1 < argc) {
+            videoFile = argv[++i];
+        } else if (arg == "--telemetry-shm" && i + 1 < argc) {
+            telemetryName = argv[++i];
+        } else if (arg == "--no-audio") {
+            audio = false;
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--script" && i + 1 < argc) {
+            inputScript = argv[++i];
+        } else if (arg == "--flights" && i + 1 < argc) {
+            flightCount = std::stoi(argv[++i]);
+        } else if (arg == "--max-time" && i + 1 < argc) {
+            maxFlightTime = std::stof(argv[++i]);
+        } else if (arg == "--autopilot") {
+            autopilot = true;
         }
     }
     
+    // Logging runs on its own thread from here on
+    Log::SetLevel(logLevel);
+    Log::Start();
+    
     // Create the game instance
     Game game;
     
     // Set rendering mode
     game.SetRenderingMode(use3DMode);
     
+    // Set fixed simulation rate
+    game.SetPhysicsRate(physicsRate);
+    
+    // Worker threads for the job system
+    game.SetWorkerThreadCount(workerThreads);
+    
+    // Bullet broadphase for the 3D world
+    game.SetBroadphase(broadphase);
+    game.SetAdaptiveStepping(adaptiveSteps);
+    
+    // Headless (no window, scripted input) settings
+    game.SetHeadless(headless);
+    game.SetInputScript(inputScript);
+    game.SetFlightCount(flightCount);
+    game.SetMaxFlightTime(maxFlightTime);
+    
+    // Fly with the descent autopilot instead of the player's input
+    if (autopilot) {
+        game.SetController(std::make_unique<DescentController>());
+    }
+    
+    // Input recording / replay (a replay implies headless unless it is drawn
+    // in a window)
+    game.SetRandomSeed(static_cast<uint32_t>(seed));
+    game.SetChecksumInterval(checksumInterval);
+    game.SetRecordFile(recordFile);
+    game.SetReplayFile(replayFile);
+    game.SetReplayWindowed(replayWindowed);
+    
+    // A compiled scenario's terrain, gravity, lander and start in place of
+    // the options above and the built-in start
+    if (!scenarioFile.empty()) {
+        game.SetScenario(scenarioFile, scenarioName);
+    }
+    
+    // Network session: host one on a UDP port, or join one at host:port
+    // (2D only; a client takes the host's seed, step and world)
+    game.SetHostPort(hostPort);
+    game.SetConnectAddress(connectAddress);
+    
+    // Elevation raster for 3D terrain (PDS .IMG/.LBL, e.g. LOLA LDEM, or a terrain_pack output)
+    game.SetHeightmapFile(demFile);
+    if (tileCacheMb > 0) {
+        game.SetTileCacheBudget(static_cast<size_t>(tileCacheMb) << 20);
+    }
+    game.SetTerrainCacheFile(terrainCacheFile);
+    
+    // Scrolling 2D world
+    game.SetWorld2D(worldWidth2D, worldSegments2D, zoom2D);
+    
+    // Generated terrain resolution, generation on the GPU, height texture
+    // rendering, near-field tessellation, meshlets and GPU chunk and
+    // occlusion culling (Metal only)
+    game.SetTerrainGridSize(terrainGridSize);
+    game.SetGpuTerrainGeneration(gpuTerrain);
+    game.SetTerrainHeightTextures(terrainTextures);
+    game.SetTerrainTessellation(terrainTessellation);
+    game.SetTerrainMeshShaders(terrainMeshlets);
+    game.SetGpuTerrainCulling(gpuCulling);
+    game.SetHiZCulling(hizCulling);
+    
+    // Lander model in place of the box, cached beside it (Metal only)
+    if (!landerMesh.empty()) {
+        game.SetLanderMeshFile(landerMesh);
+    }
+    
+    // Scene resolution scaled to hold the target frame rate (Metal only)
+    game.SetDynamicResolution(dynamicResolution);
+    game.SetTargetFrameRate(targetFrameRate);
+    game.SetTemporalUpscaling(temporalUpscaling);
+    
+    // Reduced shading rate away from the lander (Metal only)
+    game.SetVariableRasterization(variableRate);
+    
+    // Terrain and lander shadow maps (Metal only)
+    game.SetShadows(shadows);
+    game.SetRayTracedShadows(rayTracedShadows);
+    game.SetHorizonShadows(horizonShadows);
+    game.SetDeferredLighting(deferredLighting);
+    game.SetParallelEncoding(parallelEncoding);
+    game.SetMaximumDrawableCount(drawableCount);
+    game.SetFramePacing(framePacing);
+    game.SetPipelinedRendering(pipelined);
+    
+    // Compiled pipeline cache (Metal only)
+    if (pipelineArchive) {
+        game.SetPipelineArchiveFile(pipelineArchive);
+    }
+    
+    // GPU and CPU traces of the frames after a slow one (Metal only)
+    game.SetSpikeCapture(spikeCaptureMs, spikeCaptureFrames, spikeCaptureDirectory);
+    
+    // Every fixed step's lander state in shared memory, for ground-station tools
+    game.SetTelemetryStream(telemetryName);
+    game.SetVideoRecording(videoFile);
+    
+    // Engine and alert sounds, unless asked for silence
+    game.SetAudio(audio);
+    
+    // Profiler trace dump on exit (.json = Chrome trace, otherwise CSV), and
+    // the whole run's per-stage timings for perf_replay
+    Profiler::SetTraceFile(traceFile);
+    Profiler::SetStageReportFile(stageReportFile);
+    
     // Initialize the game
     bool success = game.Initialize();
     if (!success) {
-        std::cerr << "Failed to initialize game!" << std::endl;
+        LOG_ERROR("Failed to initialize game!");
+        Log::Stop();
         return 1;
     }
     
+    // Time warp, once the recording or session it would conflict with is set up
+    if (timeWarp != 1.0f) {
+        game.SetTimeWarp(timeWarp);
+    }
+    
     // Run the game
     game.Run();
     
     // Clean up resources
     game.Shutdown();
+    Profiler::WriteTrace();
+    Profiler::WriteStageReport();
+    LatencyTracker::LogReport();
+    Log::Stop();
     
     return 0;
 }
@@ -0,0 +1,103 @@
+// Batch2D.cpp
+// Implementation of the 2D renderer's triangle batch
+
+#include "Batch2D.h"
+#include "../core/Log.h"
+#include <cmath>
+
+void Batch2D::AddRect(float x, float y, float width, float height, SDL_Color color) {
+    const SDL_FPoint corners[4] = {
+        { x, y },
+        { x + width, y },
+        { x + width, y + height },
+        { x, y + height }
+    };
+    AddQuad(corners, color);
+}
+
+void Batch2D::AddLine(float x1, float y1, float x2, float y2, SDL_Color color) {
+    // Between pixel centers, pushed half a pixel out at each end and to
+    // either side, so the end points are covered like SDL_RenderDrawLine's
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if (length > 0.0f) {
+        dx = 0.5f * dx / length;
+        dy = 0.5f * dy / length;
+    } else {
+        dx = 0.5f;
+        dy = 0.0f;
+    }
+    
+    const float ax = x1 + 0.5f - dx, ay = y1 + 0.5f - dy;
+    const float bx = x2 + 0.5f + dx, by = y2 + 0.5f + dy;
+    const SDL_FPoint corners[4] = {
+        { ax - dy, ay + dx },
+        { bx - dy, by + dx },
+        { bx + dy, by - dx },
+        { ax + dy, ay - dx }
+    };
+    AddQuad(corners, color);
+}
+
+void Batch2D::AddQuad(const SDL_FPoint corners[4], SDL_Color color) {
+    for (int i = 0; i < 4; i++) {
+        SDL_Vertex vertex;
+        vertex.position = corners[i];
+        vertex.color = color;
+        vertex.tex_coord = { 0.0f, 0.0f };
+        mVertices.push_back(vertex);
+    }
+}
+
+void Batch2D::AddTexturedRect(float x, float y, float width, float height,
+                              SDL_FPoint uvMin, SDL_FPoint uvMax, SDL_Color color) {
+    const SDL_FPoint corners[4] = {
+        { x, y },
+        { x + width, y },
+        { x + width, y + height },
+        { x, y + height }
+    };
+    const SDL_FPoint uvs[4] = {
+        uvMin,
+        { uvMax.x, uvMin.y },
+        uvMax,
+        { uvMin.x, uvMax.y }
+    };
+    for (int i = 0; i < 4; i++) {
+        SDL_Vertex vertex;
+        vertex.position = corners[i];
+        vertex.color = color;
+        vertex.tex_coord = uvs[i];
+        mVertices.push_back(vertex);
+    }
+}
+
+void Batch2D::EnsureIndices(size_t quadCount) {
+    size_t built = mIndices.size() / 6;
+    if (built >= quadCount) return;
+    
+    mIndices.reserve(quadCount * 6);
+    for (size_t quad = built; quad < quadCount; quad++) {
+        const int base = static_cast<int>(quad * 4);
+        const int pattern[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+        mIndices.insert(mIndices.end(), pattern, pattern + 6);
+    }
+}
+
+bool Batch2D::Flush(SDL_Renderer* renderer, SDL_Texture* texture) {
+    const size_t quadCount = GetQuadCount();
+    if (quadCount == 0) return true;
+    
+    EnsureIndices(quadCount);
+    int result = SDL_RenderGeometry(renderer, texture,
+                                    mVertices.data(), static_cast<int>(mVertices.size()),
+                                    mIndices.data(), static_cast<int>(quadCount * 6));
+    mVertices.clear();
+    
+    if (result != 0) {
+        LOG_ERROR_EVERY(1000, "SDL_RenderGeometry failed for %zu quads: %s", quadCount, SDL_GetError());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+// Batch2D.h
+// Colored triangle batch for the 2D renderer, submitted with one draw call
+
+#pragma once
+
+#include "../compat.h"
+#include <SDL2/SDL.h>
+#include <cstddef>
+#include <vector>
+
+// Rectangles, lines and quads collected over a frame as colored vertices
+// and drawn with a single SDL_RenderGeometry call (SDL 2.0.18 or later),
+// in the order they were added so translucent panels still blend over
+// what came before them. Lines become one pixel wide quads covering the
+// same pixels SDL_RenderDrawLine would. The vertex and index arrays keep
+// their capacity between frames, so after warm-up nothing is allocated.
+class Batch2D {
+public:
+    // Coordinates in screen pixels from the top-left
+    void AddRect(float x, float y, float width, float height, SDL_Color color);
+    void AddLine(float x1, float y1, float x2, float y2, SDL_Color color);
+    
+    // Corners in order around the quad, either winding
+    void AddQuad(const SDL_FPoint corners[4], SDL_Color color);
+    
+    // Rectangle sampling the flush's texture between normalized texture
+    // coordinates uvMin and uvMax, modulated by color
+    void AddTexturedRect(float x, float y, float width, float height,
+                         SDL_FPoint uvMin, SDL_FPoint uvMax, SDL_Color color);
+    
+    // Draw everything added since the last flush and start over, textured
+    // if texture is given. False if SDL failed to draw (the batch is
+    // dropped either way).
+    bool Flush(SDL_Renderer* renderer, SDL_Texture* texture = nullptr);
+    void Clear() { mVertices.clear(); }
+    
+    size_t GetQuadCount() const { return mVertices.size() / 4; }
+    
+private:
+    // Every quad uses the same two-triangle pattern, so the index array
+    // only grows when a frame has more quads than any before it
+    void EnsureIndices(size_t quadCount);
+    
+    std::vector<SDL_Vertex> mVertices;   // Four per quad
+    std::vector<int> mIndices;           // Six per quad
+};
@@ -0,0 +1,190 @@
+// DebugOverlay.h
+// Renderer-independent debug text and profiler panel built from solid rectangles
+
+#pragma once
+
+#include "../core/MemoryTracker.h"
+#include "../core/Profiler.h"
+#include <cstdio>
+
+// Both renderers draw the overlay through a rectangle callback:
+// drawRect(x, y, width, height, r, g, b, a) in pixels from the top-left,
+// with 8-bit color components.
+class DebugOverlay {
+public:
+    static constexpr int kGlyphWidth = 3;     // Font cells per glyph
+    static constexpr int kGlyphHeight = 5;
+
+    // Draw text with a 3x5 cell font (upper case, digits and a little
+    // punctuation); returns the x position after the last glyph
+    template <typename DrawRectFn>
+    static float DrawText(const char* text, float x, float y, float cellSize,
+                          unsigned char r, unsigned char g, unsigned char b,
+                          DrawRectFn&& drawRect) {
+        for (const char* c = text; *c; ++c) {
+            const char* rows = GetGlyph(*c);
+            if (rows) {
+                for (int row = 0; row < kGlyphHeight; ++row) {
+                    for (int col = 0; col < kGlyphWidth; ++col) {
+                        if (rows[row * kGlyphWidth + col] == '1') {
+                            drawRect(x + col * cellSize, y + row * cellSize,
+                                     cellSize, cellSize, r, g, b, 255);
+                        }
+                    }
+                }
+            }
+            x += (kGlyphWidth + 1) * cellSize;
+        }
+        return x;
+    }
+
+    // Profiler panel at the top-right corner: one row per stage with
+    // min/avg/p99 milliseconds and a bar against a 60 Hz frame budget, then
+    // one per counter with its latest value. Returns the y below the panel.
+    template <typename DrawRectFn>
+    static float DrawProfilerStats(int screenWidth, DrawRectFn&& drawRect) {
+        ProfileStageStats stats[Profiler::kMaxStages];
+        int count = Profiler::GetStageStats(stats, Profiler::kMaxStages);
+        ProfileCounterValue counters[Profiler::kMaxCounters];
+        int counterCount = Profiler::GetCounters(counters, Profiler::kMaxCounters);
+        if (count == 0 && counterCount == 0) {
+            return 0.0f;
+        }
+
+        const float cell = 2.0f;
+        const float rowHeight = 20.0f;
+        const float counterRowHeight = 14.0f;
+        const float panelWidth = 300.0f;
+        const float barWidth = panelWidth - 16.0f;
+        const float budgetMs = 1000.0f / 60.0f;
+        const float x = screenWidth - panelWidth - 10.0f;
+        float y = 10.0f;
+
+        drawRect(x, y, panelWidth, 18.0f + count * rowHeight + counterCount * counterRowHeight, 0, 0, 0, 160);
+
+        char line[64];
+        std::snprintf(line, sizeof(line), "%-10s %6s %6s %6s", "STAGE", "MIN", "AVG", "P99");
+        DrawText(line, x + 8.0f, y + 4.0f, cell, 160, 160, 160, drawRect);
+        y += 18.0f;
+
+        for (int i = 0; i < count; ++i) {
+            std::snprintf(line, sizeof(line), "%-10.10s %6.2f %6.2f %6.2f",
+                          stats[i].name, stats[i].minMs, stats[i].avgMs, stats[i].p99Ms);
+            DrawText(line, x + 8.0f, y, cell, 255, 255, 255, drawRect);
+
+            // Average as a filled bar, p99 as a tick; both clamp at the budget
+            float avgWidth = barWidth * (stats[i].avgMs < budgetMs ? stats[i].avgMs / budgetMs : 1.0f);
+            float p99X = barWidth * (stats[i].p99Ms < budgetMs ? stats[i].p99Ms / budgetMs : 1.0f);
+            drawRect(x + 8.0f, y + 12.0f, barWidth, 3.0f, 60, 60, 60, 255);
+            drawRect(x + 8.0f, y + 12.0f, avgWidth, 3.0f, 0, 200, 0, 255);
+            drawRect(x + 8.0f + p99X - 1.0f, y + 11.0f, 2.0f, 5.0f, 255, 60, 60, 255);
+
+            y += rowHeight;
+        }
+
+        for (int i = 0; i < counterCount; ++i) {
+            std::snprintf(line, sizeof(line), "%-10.10s %6lld", counters[i].name,
+                          static_cast<long long>(counters[i].value));
+            DrawText(line, x + 8.0f, y, cell, 160, 200, 255, drawRect);
+            y += counterRowHeight;
+        }
+        return y;
+    }
+    
+    // Memory panel under the profiler's, from y: live, peak and budget
+    // megabytes of each tag in use, red once over budget
+    template <typename DrawRectFn>
+    static void DrawMemoryStats(int screenWidth, float y, DrawRectFn&& drawRect) {
+        MemoryTagStats stats[MemoryTracker::kTagCount];
+        int count = 0;
+        for (int i = 0; i < MemoryTracker::kTagCount; ++i) {
+            MemoryTagStats tag = MemoryTracker::GetStats(static_cast<MemoryTag>(i));
+            if (tag.peakBytes > 0) {
+                stats[count++] = tag;
+            }
+        }
+        if (count == 0) {
+            return;
+        }
+        
+        const float cell = 2.0f;
+        const float rowHeight = 14.0f;
+        const float panelWidth = 300.0f;
+        const float x = screenWidth - panelWidth - 10.0f;
+        const double megabyte = 1048576.0;
+        y += 10.0f;
+        
+        drawRect(x, y, panelWidth, 18.0f + count * rowHeight, 0, 0, 0, 160);
+        
+        char line[64];
+        std::snprintf(line, sizeof(line), "%-12s %6s %6s %6s", "MEMORY MB", "LIVE", "PEAK", "BUDGET");
+        DrawText(line, x + 8.0f, y + 4.0f, cell, 160, 160, 160, drawRect);
+        y += 18.0f;
+        
+        for (int i = 0; i < count; ++i) {
+            char budget[16] = "-";
+            if (stats[i].budgetBytes > 0) {
+                std::snprintf(budget, sizeof(budget), "%6.1f", stats[i].budgetBytes / megabyte);
+            }
+            std::snprintf(line, sizeof(line), "%-12.12s %6.1f %6.1f %6s",
+                          stats[i].name, stats[i].liveBytes / megabyte, stats[i].peakBytes / megabyte, budget);
+            bool over = stats[i].budgetBytes > 0 && stats[i].liveBytes > stats[i].budgetBytes;
+            DrawText(line, x + 8.0f, y, cell, 255, over ? 60 : 255, over ? 60 : 255, drawRect);
+            y += rowHeight;
+        }
+    }
+
+    // Glyph cells row by row, '1' = lit (null for characters the font
+    // doesn't have). GlyphAtlas bakes these into its texture.
+    static const char* GetGlyph(char c) {
+        if (c >= 'a' && c <= 'z') {
+            c = static_cast<char>(c - 'a' + 'A');
+        }
+
+        switch (c) {
+            case '0': return "111101101101111";
+            case '1': return "010110010010111";
+            case '2': return "111001111100111";
+            case '3': return "111001111001111";
+            case '4': return "101101111001001";
+            case '5': return "111100111001111";
+            case '6': return "111100111101111";
+            case '7': return "111001001001001";
+            case '8': return "111101111101111";
+            case '9': return "111101111001111";
+            case 'A': return "010101111101101";
+            case 'B': return "110101110101110";
+            case 'C': return "011100100100011";
+            case 'D': return "110101101101110";
+            case 'E': return "111100110100111";
+            case 'F': return "111100110100100";
+            case 'G': return "011100101101011";
+            case 'H': return "101101111101101";
+            case 'I': return "111010010010111";
+            case 'J': return "001001001101010";
+            case 'K': return "101101110101101";
+            case 'L': return "100100100100111";
+            case 'M': return "101111111101101";
+            case 'N': return "110101101101101";
+            case 'O': return "010101101101010";
+            case 'P': return "110101110100100";
+            case 'Q': return "010101101110011";
+            case 'R': return "110101110101101";
+            case 'S': return "011100010001110";
+            case 'T': return "111010010010010";
+            case 'U': return "101101101101111";
+            case 'V': return "101101101101010";
+            case 'W': return "101101111111101";
+            case 'X': return "101101010101101";
+            case 'Y': return "101101010010010";
+            case 'Z': return "111001010100111";
+            case '.': return "000000000000010";
+            case ':': return "000010000010000";
+            case '-': return "000000111000000";
+            case '/': return "001001010100100";
+            case '%': return "101001010100101";
+            case '_': return "000000000000111";
+            default:  return nullptr;
+        }
+    }
+};
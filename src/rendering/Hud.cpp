@@ -0,0 +1,175 @@
+// Hud.cpp
+// Implementation of the dirty-tracked HUD widgets
+
+#include "Hud.h"
+#include "DebugOverlay.h"
+#include "../core/Entity.h"
+#include "../core/Game.h"
+#include <cmath>
+
+// Gauge rows: the panel background, split per row so rows never overlap
+static const float kRowTop[3] = { 10.0f, 40.0f, 70.0f };
+static const float kRowHeight[3] = { 30.0f, 30.0f, 40.0f };
+static const float kPanelX = 10.0f;
+static const float kPanelWidth = 320.0f;
+static const float kBarWidth = 180.0f;
+static const float kTextScale = 2.0f;
+
+Hud::Hud()
+    : mVersion(0)
+{
+    for (int i = 0; i < kWidgetCount; i++) {
+        WidgetState& widget = mWidgets[i];
+        widget.keys[0] = widget.keys[1] = 0;
+        widget.version = 0;
+        widget.quadCount = 0;
+        widget.bounds[0] = kPanelX;
+        widget.bounds[2] = kPanelWidth;
+        if (i < kWidgetState) {
+            widget.bounds[1] = kRowTop[i];
+            widget.bounds[3] = kRowHeight[i];
+        } else {
+            widget.bounds[1] = 114.0f;
+            widget.bounds[3] = 22.0f;
+        }
+    }
+}
+
+void Hud::GetWidgetBounds(int widget, float& x, float& y, float& width, float& height) const {
+    const float* bounds = mWidgets[widget].bounds;
+    x = bounds[0];
+    y = bounds[1];
+    width = bounds[2];
+    height = bounds[3];
+}
+
+size_t Hud::GetQuadCount() const {
+    size_t count = 0;
+    for (const WidgetState& widget : mWidgets) {
+        count += widget.quadCount;
+    }
+    return count;
+}
+
+bool Hud::Begin(int index, int64_t key0, int64_t key1) {
+    WidgetState& widget = mWidgets[index];
+    if (widget.version != 0 && widget.keys[0] == key0 && widget.keys[1] == key1) {
+        return false;
+    }
+    
+    widget.keys[0] = key0;
+    widget.keys[1] = key1;
+    widget.quadCount = 0;
+    widget.version = ++mVersion;
+    
+    // Every widget starts with its share of the panel background
+    AddRect(index, widget.bounds[0], widget.bounds[1], widget.bounds[2], widget.bounds[3], 50, 50, 50, 200);
+    return true;
+}
+
+void Hud::AddRect(int index, float x, float y, float width, float height,
+                  uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    WidgetState& widget = mWidgets[index];
+    if (widget.quadCount == kMaxQuadsPerWidget) return;
+    
+    const float u = GlyphAtlas::GetSolidX();
+    const float v = GlyphAtlas::GetSolidY();
+    widget.quads[widget.quadCount++] = { x, y, width, height, u, v, u, v, r, g, b, a };
+}
+
+void Hud::AddText(int index, const TextLine& line, float x, float y, float scale,
+                  uint8_t r, uint8_t g, uint8_t b) {
+    WidgetState& widget = mWidgets[index];
+    mScratchText.Clear();
+    mScratchText.AddText(line, x, y, scale, r, g, b);
+    for (size_t i = 0; i < mScratchText.GetCount() && widget.quadCount < kMaxQuadsPerWidget; i++) {
+        const TextBatch::Glyph& glyph = mScratchText.GetGlyphs()[i];
+        widget.quads[widget.quadCount++] = {
+            glyph.x, glyph.y, glyph.width, glyph.height,
+            static_cast<float>(glyph.atlasX), static_cast<float>(glyph.atlasY),
+            static_cast<float>(glyph.atlasX + DebugOverlay::kGlyphWidth),
+            static_cast<float>(glyph.atlasY + DebugOverlay::kGlyphHeight),
+            glyph.r, glyph.g, glyph.b, glyph.a
+        };
+    }
+}
+
+void Hud::BuildGauge(int index, const char* label, float value, const char* unit,
+                     int barPixels, uint8_t r, uint8_t g, uint8_t b) {
+    // Keys: the readout in tenths and the bar in pixels (color included)
+    const int64_t tenths = std::isfinite(value) ? std::llround(value * 10.0f) : INT64_MIN;
+    const int64_t bar = barPixels * 0x1000000LL + (r << 16) + (g << 8) + b;
+    if (!Begin(index, tenths, bar)) {
+        return;
+    }
+    
+    const float top = kRowTop[index];
+    AddRect(index, 20.0f, top + 10.0f, static_cast<float>(barPixels), 20.0f, r, g, b, 255);
+    
+    TextLine line;
+    line.Append(label).Append(value, 1).Append(unit);
+    AddText(index, line, 208.0f, top + 15.0f, kTextScale, 255, 255, 255);
+}
+
+void Hud::Update(Game* game, float maxAltitude) {
+    if (!game) return;
+    const RenderSnapshot& frame = game->GetRenderSnapshot();
+    const Lander* lander = frame.lander.get();
+    if (!lander) return;
+    
+    const float* velocity = lander->GetVelocity();
+    const float fuelPct = lander->GetFuel() / lander->GetMaxFuel();
+    
+    // Above the ground under the lander, or the datum off the terrain's edge
+    const float altitude = frame.altitude;
+    
+    // Altitude indicator (green bar)
+    float altitudePct = maxAltitude > 0.0f ? altitude / maxAltitude : 0.0f;
+    altitudePct = altitudePct < 0.0f ? 0.0f : (altitudePct > 1.0f ? 1.0f : altitudePct);
+    BuildGauge(kWidgetAltitude, "ALT ", altitude, " M",
+               static_cast<int>(altitudePct * kBarWidth), 0, 255, 0);
+    
+    // Velocity indicator (blue for upward, red for downward)
+    const float maxSafeVelocity = 2.0f; // m/s, safe landing velocity
+    float velocityPct = std::fabs(velocity[1]) / (maxSafeVelocity * 3);
+    if (velocityPct > 1.0f) velocityPct = 1.0f;
+    if (velocity[1] >= 0) {
+        BuildGauge(kWidgetVelocity, "VEL ", velocity[1], " M/S",
+                   static_cast<int>(velocityPct * kBarWidth), 0, 0, 255);
+    } else {
+        BuildGauge(kWidgetVelocity, "VEL ", velocity[1], " M/S",
+                   static_cast<int>(velocityPct * kBarWidth), 255, 0, 0);
+    }
+    
+    // Fuel indicator (yellow bar)
+    BuildGauge(kWidgetFuel, "FUEL ", fuelPct * 100.0f, "%",
+               static_cast<int>(fuelPct * kBarWidth), 255, 255, 0);
+    
+    // Flight state: elapsed time while flying, the score once down
+    const GameState state = frame.gameState;
+    const bool flying = state == GameState::FLYING || state == GameState::READY;
+    const float shown = flying ? frame.elapsedTime : frame.score;
+    const int64_t shownKey = flying ? std::llround(shown * 10.0f) : std::llround(shown);
+    if (Begin(kWidgetState, static_cast<int64_t>(state), shownKey)) {
+        TextLine line;
+        const float y = mWidgets[kWidgetState].bounds[1] + 6.0f;
+        switch (state) {
+            case GameState::READY:
+                line.Append("READY");
+                AddText(kWidgetState, line, 20.0f, y, kTextScale, 255, 255, 255);
+                break;
+            case GameState::FLYING:
+                line.Append("FLYING  T ").Append(shown, 1).Append(" S");
+                AddText(kWidgetState, line, 20.0f, y, kTextScale, 255, 255, 255);
+                break;
+            case GameState::LANDED:
+                line.Append("LANDED  SCORE ").Append(static_cast<int>(shownKey));
+                AddText(kWidgetState, line, 20.0f, y, kTextScale, 0, 255, 0);
+                break;
+            case GameState::CRASHED:
+                line.Append("CRASHED  PRESS R");
+                AddText(kWidgetState, line, 20.0f, y, kTextScale, 255, 60, 60);
+                break;
+        }
+    }
+}
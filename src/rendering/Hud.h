@@ -0,0 +1,81 @@
+// Hud.h
+// Renderer-independent HUD: telemetry widgets rebuilt only when their displayed value changes
+
+#pragma once
+
+#include "TextBatch.h"
+#include <cstddef>
+#include <cstdint>
+
+// Forward declarations
+class Game;
+
+// The HUD is a few widgets (one per gauge row plus the flight state line),
+// each laid out as atlas quads: glyphs from GlyphAtlas, plain rectangles
+// from its solid cell. Update() works out what every widget would show
+// and rebuilds only those whose display changed, i.e. whose bound value
+// moved past its display threshold (a tenth in the readout or a pixel of
+// bar). Each rebuild bumps the widget's version and the HUD's, so a
+// renderer can cache the composited HUD and redraw just the widgets whose
+// version moved. Widgets tile without overlapping, so one can be cleared
+// and redrawn on its own. Everything lies within kLayerWidth x
+// kLayerHeight pixels from the window's top-left.
+class Hud {
+public:
+    static constexpr int kLayerWidth = 340;
+    static constexpr int kLayerHeight = 144;
+    static constexpr int kMaxQuadsPerWidget = 32;
+    
+    enum Widget {
+        kWidgetAltitude,
+        kWidgetVelocity,
+        kWidgetFuel,
+        kWidgetState,
+        kWidgetCount
+    };
+    
+    // Pixels from the top-left; texels of the glyph atlas
+    struct Quad {
+        float x, y, width, height;
+        float u0, v0, u1, v1;
+        uint8_t r, g, b, a;
+    };
+    
+    Hud();
+    
+    // maxAltitude (meters) fills the altitude bar
+    void Update(Game* game, float maxAltitude);
+    
+    // Bumps whenever any widget is rebuilt (0 = never built)
+    uint32_t GetVersion() const { return mVersion; }
+    
+    uint32_t GetWidgetVersion(int widget) const { return mWidgets[widget].version; }
+    void GetWidgetBounds(int widget, float& x, float& y, float& width, float& height) const;
+    const Quad* GetWidgetQuads(int widget) const { return mWidgets[widget].quads; }
+    int GetWidgetQuadCount(int widget) const { return mWidgets[widget].quadCount; }
+    
+    // Quads across every widget
+    size_t GetQuadCount() const;
+    
+private:
+    struct WidgetState {
+        int64_t keys[2];          // What the widget shows, quantized
+        uint32_t version;         // 0 = never built
+        float bounds[4];          // x, y, width, height
+        Quad quads[kMaxQuadsPerWidget];
+        int quadCount;
+    };
+    
+    // Rebuild a widget if its keys changed; true if it was rebuilt
+    bool Begin(int widget, int64_t key0, int64_t key1);
+    void AddRect(int widget, float x, float y, float width, float height,
+                 uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+    void AddText(int widget, const TextLine& line, float x, float y, float scale,
+                 uint8_t r, uint8_t g, uint8_t b);
+    void BuildGauge(int widget, const char* label, float value, const char* unit,
+                    int barPixels, uint8_t r, uint8_t g, uint8_t b);
+    
+    WidgetState mWidgets[kWidgetCount];
+    TextBatch mScratchText;   // Glyph layout for the widget being rebuilt
+    uint32_t mVersion;
+};
@@ -2,8 +2,17 @@
 // Objective-C++ bridge for Metal integration with SDL
 
 #import <AppKit/AppKit.h>
+#import <AVFoundation/AVFoundation.h>
+#import <Metal/Metal.h>
 #import <QuartzCore/CAMetalLayer.h>
 
+// A QuickTime movie taking VideoToolbox's encoded samples as they are
+struct MovieWriter {
+    AVAssetWriter* writer;
+    AVAssetWriterInput* input;
+    bool started;
+};
+
 extern "C" {
     // Function to set Metal layer for SDL window
     void SetMetalLayerForSDLWindow(void* nsWindowPtr, void* metalLayerPtr) {
@@ -31,4 +40,81 @@ extern "C" {
             // due to the __bridge_transfer cast
         }
     }
-}
\ No newline at end of file
+    
+    // Drawable queue depth (2 or 3) and whether presents wait for vsync;
+    // metal-cpp's CA::MetalLayer doesn't wrap either property
+    void ConfigureCAMetalLayer(void* layerPtr, int maximumDrawableCount, bool displaySyncEnabled) {
+        CAMetalLayer* layer = (__bridge CAMetalLayer*)layerPtr;
+        layer.maximumDrawableCount = maximumDrawableCount;
+        layer.displaySyncEnabled = displaySyncEnabled;
+    }
+    
+    // Residency sets need macOS 15; metal-cpp would send the selector regardless
+    bool DeviceSupportsResidencySets(void* devicePtr) {
+        id<MTLDevice> device = (__bridge id<MTLDevice>)devicePtr;
+        return [device respondsToSelector:@selector(newResidencySetWithDescriptor:error:)];
+    }
+    
+    // MTLIO needs macOS 13
+    bool DeviceSupportsIOCommandQueues(void* devicePtr) {
+        id<MTLDevice> device = (__bridge id<MTLDevice>)devicePtr;
+        return [device respondsToSelector:@selector(newIOCommandQueueWithDescriptor:error:)];
+    }
+    
+    // Movie from encoded samples of formatDescription (a
+    // CMFormatDescriptionRef); the file at path is replaced
+    void* CreateMovieWriter(const char* path, void* formatDescription) {
+        NSURL* url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:path]];
+        [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+        NSError* error = nil;
+        AVAssetWriter* writer = [[AVAssetWriter alloc] initWithURL:url fileType:AVFileTypeQuickTimeMovie error:&error];
+        if (!writer) {
+            return nullptr;
+        }
+        AVAssetWriterInput* input = [[AVAssetWriterInput alloc]
+            initWithMediaType:AVMediaTypeVideo outputSettings:nil
+             sourceFormatHint:(CMFormatDescriptionRef)formatDescription];
+        input.expectsMediaDataInRealTime = YES;
+        bool ok = [writer canAddInput:input];
+        if (ok) {
+            [writer addInput:input];
+            ok = [writer startWriting];
+        }
+        if (!ok) {
+            [input release];
+            [writer release];
+            return nullptr;
+        }
+        MovieWriter* movie = new MovieWriter;
+        movie->writer = writer;
+        movie->input = input;
+        movie->started = false;
+        return movie;
+    }
+    
+    // False if the writer can't take the sample now (it is dropped)
+    bool AppendMovieSample(void* writerPtr, void* sampleBuffer) {
+        MovieWriter* movie = static_cast<MovieWriter*>(writerPtr);
+        CMSampleBufferRef sample = (CMSampleBufferRef)sampleBuffer;
+        if (!movie->started) {
+            [movie->writer startSessionAtSourceTime:CMSampleBufferGetPresentationTimeStamp(sample)];
+            movie->started = true;
+        }
+        return movie->input.readyForMoreMediaData && [movie->input appendSampleBuffer:sample];
+    }
+    
+    // Close the movie, waiting until it is written
+    void FinishMovieWriter(void* writerPtr) {
+        MovieWriter* movie = static_cast<MovieWriter*>(writerPtr);
+        [movie->input markAsFinished];
+        dispatch_semaphore_t finished = dispatch_semaphore_create(0);
+        [movie->writer finishWritingWithCompletionHandler:^{
+            dispatch_semaphore_signal(finished);
+        }];
+        dispatch_semaphore_wait(finished, DISPATCH_TIME_FOREVER);
+        dispatch_release(finished);
+        [movie->input release];
+        [movie->writer release];
+        delete movie;
+    }
+}
@@ -0,0 +1,321 @@
+// MetalHeapAllocator.cpp
+// Implementation of the placement heap sub-allocator
+
+#include "../compat.h"
+#include "MetalHeapAllocator.h"
+#include "../core/Log.h"
+#include <algorithm>
+#include <cstring>
+
+// Metal-cpp's implementation is compiled into Renderer3D_Metal.cpp
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+
+// MetalBridge.mm
+extern "C" bool DeviceSupportsResidencySets(void* devicePtr);
+
+static MTL::ResourceOptions HeapResourceOptions(MetalHeapAllocator::Memory memory) {
+    return (memory == MetalHeapAllocator::Memory::Shared ? MTL::ResourceStorageModeShared
+                                                         : MTL::ResourceStorageModePrivate) |
+           MTL::ResourceHazardTrackingModeTracked;
+}
+
+// Smallest class holding size bytes, or kDedicatedSizeClass
+static int SizeClassFor(size_t size, int classCount) {
+    size_t classSize = MetalHeapAllocator::kMinSizeClass;
+    for (int sizeClass = 0; sizeClass < classCount; sizeClass++, classSize <<= 1) {
+        if (size <= classSize) return sizeClass;
+    }
+    return -1;
+}
+
+MetalHeapAllocator::MetalHeapAllocator()
+    : mDevice(nullptr)
+    , mFrameSerial(0)
+    , mCompletedSerial(0)
+    , mResidencyQueue(nullptr)
+    , mResidencySet(nullptr)
+    , mHeapBytes(0)
+    , mAllocatedBytes(0)
+    , mPeakAllocatedBytes(0)
+    , mHeapCount(0)
+{
+}
+
+MetalHeapAllocator::~MetalHeapAllocator() {
+    Shutdown();
+}
+
+void MetalHeapAllocator::Initialize(MTL::Device* device) {
+    mDevice = device;
+    mFrameSerial = 0;
+    mCompletedSerial.store(0);
+}
+
+bool MetalHeapAllocator::AttachResidencySet(MTL::CommandQueue* queue) {
+    if (mResidencySet || !DeviceSupportsResidencySets(mDevice)) return false;
+    
+    MTL::ResidencySetDescriptor* descriptor = MTL::ResidencySetDescriptor::alloc()->init();
+    descriptor->setLabel(NS::String::string("Heap allocator", NS::UTF8StringEncoding));
+    descriptor->setInitialCapacity(16);
+    NS::Error* error = nullptr;
+    mResidencySet = mDevice->newResidencySet(descriptor, &error);
+    descriptor->release();
+    if (!mResidencySet) {
+        LOG_WARNING("Failed to create residency set: %s",
+                    error ? error->localizedDescription()->utf8String() : "unknown error");
+        return false;
+    }
+    
+    // Heaps from before, in one batch: blocks, kept dedicated heaps and
+    // dedicated heaps in use
+    std::vector<const MTL::Allocation*> heaps;
+    for (const Pool& pool : mPools) {
+        for (const Block& block : pool.blocks) {
+            heaps.push_back(block.heap);
+        }
+        heaps.insert(heaps.end(), pool.freeDedicated.begin(), pool.freeDedicated.end());
+    }
+    for (const auto& entry : mRanges) {
+        if (entry.second.sizeClass == kDedicatedSizeClass) {
+            heaps.push_back(entry.second.heap);
+        }
+    }
+    if (!heaps.empty()) {
+        mResidencySet->addAllocations(heaps.data(), heaps.size());
+    }
+    mResidencySet->commit();
+    mResidencySet->requestResidency();
+    queue->addResidencySet(mResidencySet);
+    mResidencyQueue = queue;
+    return true;
+}
+
+void MetalHeapAllocator::Shutdown() {
+    if (!mDevice) return;
+    
+    // Every frame is done, so the pending frees can all go. Whatever is
+    // left after them leaked.
+    mCompletedSerial.store(mFrameSerial + 1);
+    BeginFrame();
+    for (auto& entry : mRanges) {
+        LOG_WARNING("Heap allocator: %zu byte resource still allocated at shutdown", entry.second.size);
+        UntrackResource(entry.second);
+        Recycle(entry.second);
+        entry.first->release();
+    }
+    mRanges.clear();
+    
+    if (mResidencySet) {
+        mResidencyQueue->removeResidencySet(mResidencySet);
+        mResidencySet->endResidency();
+        mResidencySet->removeAllAllocations();
+        mResidencySet->commit();
+        mResidencySet->release();
+        mResidencySet = nullptr;
+        mResidencyQueue = nullptr;
+    }
+    
+    for (Pool& pool : mPools) {
+        for (Block& block : pool.blocks) {
+            block.heap->release();
+        }
+        for (MTL::Heap* heap : pool.freeDedicated) {
+            heap->release();
+        }
+        pool = Pool();
+    }
+    
+    LOG_INFO("Heap allocator: %d heaps, %.1f MB, peak %.1f MB allocated",
+             mHeapCount, mHeapBytes / 1048576.0, mPeakAllocatedBytes / 1048576.0);
+    mHeapBytes = 0;
+    mAllocatedBytes = 0;
+    mPeakAllocatedBytes = 0;
+    mHeapCount = 0;
+    mDevice = nullptr;
+}
+
+MTL::Heap* MetalHeapAllocator::NewHeap(Memory memory, size_t size) {
+    MTL::HeapDescriptor* descriptor = MTL::HeapDescriptor::alloc()->init();
+    descriptor->setType(MTL::HeapTypePlacement);
+    descriptor->setStorageMode(memory == Memory::Shared ? MTL::StorageModeShared : MTL::StorageModePrivate);
+    descriptor->setCpuCacheMode(MTL::CPUCacheModeDefaultCache);
+    descriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+    descriptor->setSize(size);
+    MTL::Heap* heap = mDevice->newHeap(descriptor);
+    descriptor->release();
+    if (!heap) {
+        LOG_ERROR("Failed to create %.1f MB %s heap", size / 1048576.0,
+                  memory == Memory::Shared ? "shared" : "private");
+        return nullptr;
+    }
+    
+    // A heap may be used before the next frame begins, so it joins the set
+    // at once; heaps are never released before Shutdown(), so nothing
+    // leaves it until then
+    if (mResidencySet) {
+        mResidencySet->addAllocation(heap);
+        mResidencySet->commit();
+    }
+    
+    // After warm-up this should not happen; a steady stream of these in
+    // the log means a size class is leaking or thrashing
+    mHeapBytes += size;
+    mHeapCount++;
+    LOG_INFO("Heap allocator: new %.1f MB %s heap (%.1f MB in %d heaps)", size / 1048576.0,
+             memory == Memory::Shared ? "shared" : "private", mHeapBytes / 1048576.0, mHeapCount);
+    return heap;
+}
+
+bool MetalHeapAllocator::Allocate(Memory memory, size_t size, size_t align, Range& range) {
+    Pool& pool = mPools[static_cast<int>(memory)];
+    int sizeClass = SizeClassFor(std::max(size, align), kSizeClassCount);
+    
+    // Too big for a block: the smallest kept heap that fits without
+    // wasting more than half of it, else a new one
+    if (sizeClass == kDedicatedSizeClass) {
+        auto best = pool.freeDedicated.end();
+        for (auto it = pool.freeDedicated.begin(); it != pool.freeDedicated.end(); ++it) {
+            size_t heapSize = (*it)->size();
+            if (heapSize >= size && heapSize / 2 <= size &&
+                (best == pool.freeDedicated.end() || heapSize < (*best)->size())) {
+                best = it;
+            }
+        }
+        MTL::Heap* heap = nullptr;
+        if (best != pool.freeDedicated.end()) {
+            heap = *best;
+            pool.freeDedicated.erase(best);
+        } else {
+            heap = NewHeap(memory, size);
+            if (!heap) return false;
+        }
+        range = { heap, 0, heap->size(), kDedicatedSizeClass, memory };
+        return true;
+    }
+    
+    // Recycled ranges first (newest first, still warm in the caches)
+    const size_t classSize = kMinSizeClass << sizeClass;
+    std::vector<Range>& freeRanges = pool.freeRanges[sizeClass];
+    for (size_t i = freeRanges.size(); i-- > 0;) {
+        if (freeRanges[i].offset % align == 0) {
+            range = freeRanges[i];
+            freeRanges[i] = freeRanges.back();
+            freeRanges.pop_back();
+            return true;
+        }
+    }
+    
+    // Then fresh space at the end of a block
+    const size_t rangeAlign = std::max(align, std::min(classSize, kMaxRangeAlignment));
+    for (Block& block : pool.blocks) {
+        size_t offset = (block.used + rangeAlign - 1) & ~(rangeAlign - 1);
+        if (offset + classSize <= kHeapBlockSize) {
+            block.used = offset + classSize;
+            range = { block.heap, offset, classSize, sizeClass, memory };
+            return true;
+        }
+    }
+    
+    MTL::Heap* heap = NewHeap(memory, kHeapBlockSize);
+    if (!heap) return false;
+    pool.blocks.push_back({ heap, classSize });
+    range = { heap, 0, classSize, sizeClass, memory };
+    return true;
+}
+
+void MetalHeapAllocator::Recycle(const Range& range) {
+    Pool& pool = mPools[static_cast<int>(range.memory)];
+    if (range.sizeClass == kDedicatedSizeClass) {
+        pool.freeDedicated.push_back(range.heap);
+    } else {
+        pool.freeRanges[range.sizeClass].push_back(range);
+    }
+}
+
+void MetalHeapAllocator::TrackResource(MTL::Resource* resource, Range& range, MemoryTag tag) {
+    range.tag = tag;
+    range.trackedBytes = resource->allocatedSize();
+    MemoryTracker::Allocate(tag, range.trackedBytes);
+    mRanges[resource] = range;
+    mAllocatedBytes += range.size;
+    mPeakAllocatedBytes = std::max(mPeakAllocatedBytes, mAllocatedBytes);
+}
+
+void MetalHeapAllocator::UntrackResource(const Range& range) {
+    MemoryTracker::Free(range.tag, range.trackedBytes);
+    mAllocatedBytes -= range.size;
+}
+
+MTL::Buffer* MetalHeapAllocator::NewBuffer(size_t length, Memory memory, MemoryTag tag) {
+    const MTL::ResourceOptions options = HeapResourceOptions(memory);
+    MTL::SizeAndAlign sizeAndAlign = mDevice->heapBufferSizeAndAlign(length, options);
+    Range range;
+    if (!Allocate(memory, sizeAndAlign.size, sizeAndAlign.align, range)) {
+        return nullptr;
+    }
+    MTL::Buffer* buffer = range.heap->newBuffer(length, options, range.offset);
+    if (!buffer) {
+        Recycle(range);
+        return nullptr;
+    }
+    
+    TrackResource(buffer, range, tag);
+    return buffer;
+}
+
+MTL::Buffer* MetalHeapAllocator::NewBuffer(const void* data, size_t length) {
+    MTL::Buffer* buffer = NewBuffer(length, Memory::Shared);
+    if (buffer) {
+        std::memcpy(buffer->contents(), data, length);
+    }
+    return buffer;
+}
+
+MTL::Texture* MetalHeapAllocator::NewTexture(MTL::TextureDescriptor* descriptor, MemoryTag tag) {
+    const Memory memory = descriptor->storageMode() == MTL::StorageModeShared ? Memory::Shared : Memory::Private;
+    descriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+    MTL::SizeAndAlign sizeAndAlign = mDevice->heapTextureSizeAndAlign(descriptor);
+    Range range;
+    if (!Allocate(memory, sizeAndAlign.size, sizeAndAlign.align, range)) {
+        return nullptr;
+    }
+    MTL::Texture* texture = range.heap->newTexture(descriptor, range.offset);
+    if (!texture) {
+        Recycle(range);
+        return nullptr;
+    }
+    
+    TrackResource(texture, range, tag);
+    return texture;
+}
+
+void MetalHeapAllocator::Free(MTL::Resource* resource) {
+    if (!resource) return;
+    
+    // The frame after the last one begun: frees made between frames may
+    // still be used by uploads committed ahead of that frame's command
+    // buffer, which then completes after them
+    mPendingFrees.push_back({ resource, mFrameSerial + 1 });
+}
+
+uint64_t MetalHeapAllocator::BeginFrame() {
+    const uint64_t completed = mCompletedSerial.load();
+    while (!mPendingFrees.empty() && mPendingFrees.front().serial <= completed) {
+        MTL::Resource* resource = mPendingFrees.front().resource;
+        mPendingFrees.pop_front();
+    
+        auto it = mRanges.find(resource);
+        if (it != mRanges.end()) {
+            UntrackResource(it->second);
+            Recycle(it->second);
+            mRanges.erase(it);
+        }
+        resource->release();
+    }
+    return ++mFrameSerial;
+}
+
+void MetalHeapAllocator::FrameCompleted(uint64_t serial) {
+    mCompletedSerial.store(serial);
+}
@@ -0,0 +1,151 @@
+// MetalHeapAllocator.h
+// Sub-allocates the Metal renderer's buffers and textures from placement heaps
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "../core/MemoryTracker.h"
+
+// Forward declarations for Metal types (to avoid including Metal headers here)
+namespace MTL {
+    class CommandQueue;
+    class Device;
+    class Heap;
+    class ResidencySet;
+    class Resource;
+    class Buffer;
+    class Texture;
+    class TextureDescriptor;
+}
+
+// Resources are placed at offsets in kHeapBlockSize placement heaps, their
+// sizes rounded up to a power-of-two size class. A freed range goes on its
+// class's free list once every frame that could still use it has completed
+// on the GPU, so after the first frames allocation only recycles ranges and
+// never asks the driver for memory. Requests larger than a block get a
+// heap of their own, which is kept for the next request it fits.
+//
+// Heaps are hazard tracked, as the renderer's standalone resources were;
+// Metal tracks a heap as a whole rather than per resource.
+//
+// Where the OS has residency sets, every heap is kept resident through one
+// set attached to the command queue. Resources coming and going only
+// recycle ranges of heaps already in it, so streaming terrain in and out
+// never changes the set, and encoders need not declare the heap resources
+// they reach through argument buffers or indirect commands.
+//
+// Main thread only, except FrameCompleted(), which command buffer
+// completion handlers call.
+class MetalHeapAllocator {
+public:
+    static constexpr size_t kHeapBlockSize = 64 * 1024 * 1024;
+    static constexpr size_t kMinSizeClass = 4 * 1024;
+    static constexpr size_t kMaxRangeAlignment = 64 * 1024;   // Range alignment cap (bigger is checked per request)
+    
+    enum class Memory {
+        Private,
+        Shared
+    };
+    
+    MetalHeapAllocator();
+    ~MetalHeapAllocator();
+    
+    MetalHeapAllocator(const MetalHeapAllocator&) = delete;
+    MetalHeapAllocator& operator=(const MetalHeapAllocator&) = delete;
+    
+    void Initialize(MTL::Device* device);
+    
+    // Create the residency set with the heaps made so far and attach it to
+    // queue for good; false (nothing is attached) if the OS lacks
+    // residency sets
+    bool AttachResidencySet(MTL::CommandQueue* queue);
+    bool HasResidencySet() const { return mResidencySet != nullptr; }
+    
+    // Release every heap and anything still allocated; the GPU must be idle
+    void Shutdown();
+    
+    // Null if the device is out of memory. Texture memory follows the
+    // descriptor's storage mode (private or shared). Each resource's
+    // allocatedSize() is reported to MemoryTracker under tag until it is
+    // recycled.
+    MTL::Buffer* NewBuffer(size_t length, Memory memory, MemoryTag tag = MemoryTag::GpuBuffers);
+    MTL::Buffer* NewBuffer(const void* data, size_t length);   // Shared, filled with data
+    MTL::Texture* NewTexture(MTL::TextureDescriptor* descriptor, MemoryTag tag = MemoryTag::GpuTextures);
+    
+    // Release a resource once every frame submitted so far has completed,
+    // recycling its range. Resources from elsewhere are only released.
+    void Free(MTL::Resource* resource);
+    
+    // Frame fences. BeginFrame() starts a frame, recycling what completed
+    // frames freed, and returns its serial; the frame's command buffer
+    // reports it to FrameCompleted() when done. Command buffers complete in
+    // queue order, so the serials complete in order too.
+    uint64_t BeginFrame();
+    void FrameCompleted(uint64_t serial);
+    uint64_t GetFrameSerial() const { return mFrameSerial; }
+    uint64_t GetCompletedSerial() const { return mCompletedSerial.load(); }
+    
+    size_t GetHeapBytes() const { return mHeapBytes; }
+    size_t GetAllocatedBytes() const { return mAllocatedBytes; }
+    
+private:
+    static constexpr int kSizeClassCount = 15;   // kMinSizeClass << 14 == kHeapBlockSize
+    static constexpr int kDedicatedSizeClass = -1;
+    
+    struct Range {
+        MTL::Heap* heap;
+        size_t offset;
+        size_t size;
+        int sizeClass;     // kDedicatedSizeClass: the range is the whole heap
+        Memory memory;
+        MemoryTag tag;     // Of the resource placed in it
+        size_t trackedBytes;
+    };
+    
+    struct Block {
+        MTL::Heap* heap;
+        size_t used;       // Bump pointer; ranges below it are allocated or on a free list
+    };
+    
+    struct Pool {
+        std::vector<Block> blocks;
+        std::vector<Range> freeRanges[kSizeClassCount];
+        std::vector<MTL::Heap*> freeDedicated;
+    };
+    
+    struct PendingFree {
+        MTL::Resource* resource;
+        uint64_t serial;   // Frame that must complete first
+    };
+    
+    // A range of at least size bytes aligned to align (false if the
+    // device is out of memory)
+    bool Allocate(Memory memory, size_t size, size_t align, Range& range);
+    void Recycle(const Range& range);
+    
+    // Bookkeeping for a new resource in range, and the reverse once it is
+    // released
+    void TrackResource(MTL::Resource* resource, Range& range, MemoryTag tag);
+    void UntrackResource(const Range& range);
+    MTL::Heap* NewHeap(Memory memory, size_t size);
+    
+    MTL::Device* mDevice;
+    Pool mPools[2];                                   // Indexed by Memory
+    std::unordered_map<MTL::Resource*, Range> mRanges; // Live resources placed by this allocator
+    std::deque<PendingFree> mPendingFrees;            // In serial order
+    uint64_t mFrameSerial;                            // Last frame begun
+    std::atomic<uint64_t> mCompletedSerial;
+    MTL::CommandQueue* mResidencyQueue;               // The queue mResidencySet is attached to
+    MTL::ResidencySet* mResidencySet;                 // Holds every heap; null if unsupported
+    
+    // Counters for the log
+    size_t mHeapBytes;
+    size_t mAllocatedBytes;                           // Sum of live ranges
+    size_t mPeakAllocatedBytes;
+    int mHeapCount;
+};
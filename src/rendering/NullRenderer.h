@@ -0,0 +1,44 @@
+// NullRenderer.h
+// Renderer that draws nothing, for headless simulation runs
+
+#pragma once
+
+#include "Renderer.h"
+
+// Renderer with no window, no GPU and no vsync
+class NullRenderer : public Renderer {
+public:
+    NullRenderer() : mWidth(800), mHeight(600), mInitialized(false) {}
+    virtual ~NullRenderer() = default;
+    
+    // Implement Renderer interface
+    bool Initialize(int width, int height, const std::string& title) override {
+        mWidth = width;
+        mHeight = height;
+        mInitialized = true;
+        return true;
+    }
+    void Shutdown() override { mInitialized = false; }
+    void Clear() override {}
+    void Present() override {}
+    
+    void RenderLander(Lander* lander) override {}
+    void RenderTerrain(Terrain* terrain) override {}
+    
+    void RenderTelemetry(Game* game) override {}
+    void RenderGameState(Game* game) override {}
+    
+    int GetWidth() const override { return mWidth; }
+    int GetHeight() const override { return mHeight; }
+    bool IsInitialized() const override { return mInitialized; }
+    
+    void SetCamera(const Camera& camera) override {}
+    
+    void SetLightPosition(float x, float y, float z) override {}
+    void SetAmbientLight(float r, float g, float b) override {}
+    
+private:
+    int mWidth;
+    int mHeight;
+    bool mInitialized;
+};
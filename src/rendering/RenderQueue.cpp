@@ -0,0 +1,140 @@
+// RenderQueue.cpp
+// Radix sort of the frame's draw packets and their encoding
+
+#include "RenderQueue.h"
+#include <algorithm>
+
+// Metal-cpp's implementation is compiled into Renderer3D_Metal.cpp
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+
+RenderQueue::RenderQueue()
+    : mStats{0, 0, 0} {
+}
+
+uint64_t RenderQueue::MakeKey(RenderQueuePass pass, uint32_t pipeline, uint32_t material, float depth) {
+    const uint64_t maxDepth = (uint64_t(1) << kDepthBits) - 1;
+    depth = std::min(std::max(depth, 0.0f), 1.0f);
+    uint64_t depthBits = static_cast<uint64_t>(depth * maxDepth);
+    if (pass == RenderQueuePass::Transparent) {
+        depthBits = maxDepth - depthBits;
+    }
+    uint64_t key = static_cast<uint64_t>(pass) & ((uint64_t(1) << kPassBits) - 1);
+    key = (key << kPipelineBits) | (pipeline & ((uint64_t(1) << kPipelineBits) - 1));
+    key = (key << kMaterialBits) | (material & ((uint64_t(1) << kMaterialBits) - 1));
+    key = (key << kDepthBits) | depthBits;
+    return key << kDepthShift;
+}
+
+void RenderQueue::Submit(uint64_t key, const RenderPacket& packet) {
+    mEntries.push_back({ key, static_cast<uint32_t>(mPackets.size()) });
+    mPackets.push_back(packet);
+}
+
+void RenderQueue::Reset() {
+    mPackets.clear();
+    mEntries.clear();
+}
+
+// LSD radix sort on the key, one byte per pass; a byte every key has the
+// same value in moves nothing, so its pass is skipped
+void RenderQueue::Sort() {
+    const size_t count = mEntries.size();
+    if (count < 2) return;
+    mScratch.resize(count);
+    
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (const SortEntry& entry : mEntries) {
+            histogram[(entry.key >> shift) & 0xFF]++;
+        }
+        if (histogram[(mEntries[0].key >> shift) & 0xFF] == count) continue;
+        
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            const size_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (const SortEntry& entry : mEntries) {
+            mScratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+        }
+        mEntries.swap(mScratch);
+    }
+}
+
+void RenderQueue::Flush(MTL::RenderCommandEncoder* encoder, MTL::Buffer* defaultFragmentBuffer,
+                        size_t defaultFragmentOffset) {
+    mStats = RenderQueueStats{ static_cast<uint32_t>(mPackets.size()), 0, 0 };
+    if (!encoder || mPackets.empty()) {
+        Reset();
+        return;
+    }
+    Sort();
+    
+    // What the encoder has bound; null = unknown
+    MTL::RenderPipelineState* pipeline = nullptr;
+    MTL::DepthStencilState* depthState = nullptr;
+    MTL::Buffer* vertexBuffers[RenderPacket::kVertexBuffers] = {};
+    size_t vertexOffsets[RenderPacket::kVertexBuffers] = {};
+    MTL::Buffer* fragmentBuffer = defaultFragmentBuffer;
+    size_t fragmentOffset = defaultFragmentOffset;
+    
+    for (const SortEntry& entry : mEntries) {
+        const RenderPacket& packet = mPackets[entry.packet];
+        
+        // Every packet would bind its pipeline, depth state, buffers and
+        // fragment buffer if drawn on its own
+        uint32_t wanted = 2 + (packet.fragmentBuffer ? 1 : 0);
+        uint32_t issued = 0;
+        if (packet.pipeline != pipeline) {
+            encoder->setRenderPipelineState(packet.pipeline);
+            pipeline = packet.pipeline;
+            issued++;
+        }
+        if (packet.depthState != depthState) {
+            encoder->setDepthStencilState(packet.depthState);
+            depthState = packet.depthState;
+            issued++;
+        }
+        for (int slot = 0; slot < RenderPacket::kVertexBuffers; slot++) {
+            MTL::Buffer* buffer = packet.vertexBuffers[slot];
+            if (!buffer) continue;
+            wanted++;
+            if (buffer != vertexBuffers[slot]) {
+                encoder->setVertexBuffer(buffer, packet.vertexOffsets[slot], NS::UInteger(slot));
+                issued++;
+            } else if (packet.vertexOffsets[slot] != vertexOffsets[slot]) {
+                encoder->setVertexBufferOffset(packet.vertexOffsets[slot], NS::UInteger(slot));
+                issued++;
+            }
+            vertexBuffers[slot] = buffer;
+            vertexOffsets[slot] = packet.vertexOffsets[slot];
+        }
+        MTL::Buffer* packetFragment = packet.fragmentBuffer ? packet.fragmentBuffer : defaultFragmentBuffer;
+        const size_t packetFragmentOffset = packet.fragmentBuffer ? packet.fragmentOffset : defaultFragmentOffset;
+        if (packetFragment && (packetFragment != fragmentBuffer || packetFragmentOffset != fragmentOffset)) {
+            encoder->setFragmentBuffer(packetFragment, packetFragmentOffset, 1);
+            fragmentBuffer = packetFragment;
+            fragmentOffset = packetFragmentOffset;
+            issued++;
+        }
+        mStats.binds += issued;
+        mStats.skippedBinds += wanted > issued ? wanted - issued : 0;
+        
+        const MTL::IndexType indexType = packet.wideIndices ? MTL::IndexTypeUInt32 : MTL::IndexTypeUInt16;
+        if (packet.instanceCount > 0) {
+            encoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(packet.indexCount), indexType,
+                                           packet.indexBuffer, NS::UInteger(packet.indexOffset),
+                                           NS::UInteger(packet.instanceCount));
+        } else {
+            encoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(packet.indexCount), indexType,
+                                           packet.indexBuffer, NS::UInteger(packet.indexOffset));
+        }
+    }
+    
+    if (defaultFragmentBuffer && (fragmentBuffer != defaultFragmentBuffer || fragmentOffset != defaultFragmentOffset)) {
+        encoder->setFragmentBuffer(defaultFragmentBuffer, defaultFragmentOffset, 1);
+    }
+    Reset();
+}
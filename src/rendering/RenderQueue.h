@@ -0,0 +1,98 @@
+// RenderQueue.h
+// Draw packets with 64-bit sort keys, radix sorted and encoded with redundant state skipped
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Forward declarations for Metal types (to avoid including Metal headers here)
+namespace MTL {
+    class Buffer;
+    class RenderPipelineState;
+    class DepthStencilState;
+    class RenderCommandEncoder;
+}
+
+// Passes in key order
+enum class RenderQueuePass : uint32_t {
+    Opaque = 0,         // Front to back
+    Transparent = 1,    // Back to front
+};
+
+// One indexed draw with everything it binds; buffers at the same slots as
+// the scene shaders (vertex 0 = geometry, 1 = vertex uniforms, 2 =
+// instances; fragment 1 = motion uniforms)
+struct RenderPacket {
+    static constexpr int kVertexBuffers = 3;
+    
+    MTL::RenderPipelineState* pipeline;
+    MTL::DepthStencilState* depthState;
+    MTL::Buffer* vertexBuffers[kVertexBuffers];    // Null = leave the slot as it is
+    size_t vertexOffsets[kVertexBuffers];
+    MTL::Buffer* fragmentBuffer;                  // Null = the queue's default binding
+    size_t fragmentOffset;
+    MTL::Buffer* indexBuffer;
+    size_t indexOffset;                           // Bytes
+    uint32_t indexCount;
+    uint32_t instanceCount;                       // 0 = not instanced
+    bool wideIndices;                             // 32-bit indices rather than 16-bit
+};
+
+// What the last Flush() encoded and what it could leave out
+struct RenderQueueStats {
+    uint32_t packets;
+    uint32_t binds;             // Pipeline, depth state and buffer binds issued
+    uint32_t skippedBinds;      // Binds an unsorted, unfiltered encode would have issued on top
+};
+
+// The scene's object draws for one frame. Submit() records a packet under
+// a key built by MakeKey(): pass, then pipeline, then material (the
+// geometry and what it binds), then depth, so sorting groups draws by the
+// state they share and orders each group for early depth rejection (or
+// blending, for transparent draws). Flush() sorts the keys with an LSD
+// radix sort, byte by byte and skipping bytes every key shares, then
+// encodes the packets in that order, issuing only the binds that change
+// something. Submission order breaks ties, as the sort is stable.
+class RenderQueue {
+public:
+    // Key layout, most significant first
+    static constexpr int kPassBits = 2;
+    static constexpr int kPipelineBits = 6;
+    static constexpr int kMaterialBits = 8;
+    static constexpr int kDepthBits = 24;
+    static constexpr int kDepthShift = 64 - kPassBits - kPipelineBits - kMaterialBits - kDepthBits;
+    
+    RenderQueue();
+    
+    // depth is the draw's distance over the far plane's, clamped to [0, 1]
+    static uint64_t MakeKey(RenderQueuePass pass, uint32_t pipeline, uint32_t material, float depth);
+    
+    void Submit(uint64_t key, const RenderPacket& packet);
+    void Reset();
+    bool IsEmpty() const { return mPackets.empty(); }
+    size_t GetCount() const { return mPackets.size(); }
+    
+    // Sort and encode everything submitted since the last Reset() into
+    // encoder, then reset. The encoder's fragment buffer 1 is taken to be
+    // defaultFragmentBuffer at defaultFragmentOffset and is left that way
+    // (nothing is bound for a null buffer); the pipeline, depth state and
+    // vertex buffers are left as the last packet set them.
+    void Flush(MTL::RenderCommandEncoder* encoder, MTL::Buffer* defaultFragmentBuffer, size_t defaultFragmentOffset);
+    
+    const RenderQueueStats& GetStats() const { return mStats; }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t packet;
+    };
+    
+    void Sort();
+    
+    std::vector<RenderPacket> mPackets;
+    std::vector<SortEntry> mEntries;
+    std::vector<SortEntry> mScratch;
+    RenderQueueStats mStats;
+};
@@ -6,9 +6,35 @@
 #include <string>
 
 // Forward declarations - make sure these are included before using them
+class Camera;
 class Lander;
 class Terrain;
 class Game;
+class JobSystem;
+class FrameArena;
+class LanderBatch;
+
+// What this frame's engine exhaust and regolith dust are seeded from
+// (meters, m/s)
+struct ParticleEmitters {
+    float nozzle[3];            // Engine exit
+    float exhaustDirection[3];  // Unit, out of the nozzle
+    float thrustLevel;          // 0 - 1; 0 = no exhaust
+    float velocity[3];          // Lander's, which new exhaust starts with
+    float groundHeight;         // Surface under the nozzle
+    float plumeRadius;          // Plume footprint where the engine axis meets the ground
+    float dustRate;             // kg/s the plume lifts off it (PlumeTable); 0 = none
+    const float* contacts;      // Where the lander touches the surface, 3 floats each
+    int contactCount;
+    float gravity;              // m/s², down
+};
+
+// A light that falls off to nothing at its radius (meters)
+struct PointLight {
+    float position[3];
+    float radius;
+    float color[3];             // Linear RGB, intensity included
+};
 
 // Abstract renderer interface
 class Renderer {
@@ -26,6 +52,35 @@ public:
     virtual void RenderLander(Lander* lander) = 0;
     virtual void RenderTerrain(Terrain* terrain) = 0;
     
+    // Draw every lander of a batch at its 2D position, in the z = 0 plane.
+    // Renderers that can't draw many landers at once may ignore it.
+    virtual void RenderLanderBatch(const LanderBatch* batch) {}
+    
+    // Draw count crash fragments, boxes in Physics::GetDebris's layout (10
+    // floats each: position, orientation quaternion x y z w, half extents;
+    // meters). Renderers without them may ignore it.
+    virtual void RenderDebris(const float* pieces, int count) {}
+    
+    // Mark where the lander is predicted to touch down, a point on the
+    // surface in meters. Renderers without a marker may ignore it.
+    virtual void RenderPredictedImpact(const float* position) {}
+    
+    // Emit and draw exhaust and dust particles; called every frame, with
+    // thrust 0 and no contacts while nothing emits, so older particles
+    // keep moving. Renderers without particles may ignore it.
+    virtual void RenderParticles(const ParticleEmitters& emitters) {}
+    
+    // The world's origin moved by shift (meters, 3D): everything drawn from
+    // the next frame on is given relative to the new one, so anything kept
+    // from earlier frames has to move by -shift. Renderers that keep
+    // nothing in world space may ignore it.
+    virtual void ShiftOrigin(const float* shift) {}
+    
+    // Run Terrain::Generate3D with the heights computed on the GPU, keeping
+    // the render data there too. Returns false (terrain untouched) if the
+    // renderer can't, in which case the caller generates on the CPU.
+    virtual bool GenerateTerrain(Terrain* terrain, int width, int length, int height) { return false; }
+    
     // UI rendering methods
     virtual void RenderTelemetry(Game* game) = 0;
     virtual void RenderGameState(Game* game) = 0;
@@ -35,12 +90,42 @@ public:
     virtual int GetHeight() const = 0;
     virtual bool IsInitialized() const = 0;
     
-    // Camera management (for 3D)
-    virtual void SetCameraPosition(float x, float y, float z) = 0;
-    virtual void SetCameraTarget(float x, float y, float z) = 0;
-    virtual void SetCameraUp(float x, float y, float z) = 0;
+    // View for the frames from the next Clear() on (3D), its matrices
+    // already updated; renderers take them only when its version changed
+    virtual void SetCamera(const Camera& camera) = 0;
+    
+    // View for the next 2D frames: left is the terrain x (pixels) at the
+    // window's left edge, scale screen pixels per terrain pixel, zooming
+    // about the window's bottom edge
+    virtual void SetView2D(float left, float scale) {}
     
     // Lighting (for 3D)
     virtual void SetLightPosition(float x, float y, float z) = 0;
     virtual void SetAmbientLight(float r, float g, float b) = 0;
+    
+    // Point lights for the frames from the next Clear() on. Renderers
+    // without them may ignore it.
+    virtual void SetPointLights(const PointLight* lights, int count) {}
+    
+    // Worker pool for render prep (optional; renderers may ignore it)
+    virtual void SetJobSystem(JobSystem* jobSystem) {}
+    
+    // Arena for render prep scratch, reset after Present() (optional)
+    virtual void SetFrameArena(FrameArena* arena) {}
+    
+    // The window's size in points changed, or it moved to a display with a
+    // different scale factor
+    virtual void OnWindowResized(int width, int height) {}
+    
+    // Show or hide the renderer's window. A hidden renderer keeps its
+    // resources, so showing it again costs nothing but the next frame.
+    virtual void SetVisible(bool visible) {}
+    
+    // False if resources kept while hidden would crowd out the renderer
+    // being switched to, in which case the caller shuts this one down
+    virtual bool CanStayResidentHidden() const { return true; }
+    
+    // GPU seconds of the last frame known to have completed (0 = unknown),
+    // for frame pacing; may lag the frame just presented
+    virtual double GetGpuFrameTime() const { return 0.0; }
 };
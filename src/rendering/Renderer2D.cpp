@@ -4,17 +4,30 @@
 #include "../compat.h"
 #include "Renderer2D.h"
 #include "../core/Entity.h"
+#include "../core/LanderBatch.h"
+#include "../core/LanderKernels.h"
+#include "../core/LatencyTracker.h"
+#include "../core/Profiler.h"
 #include "../core/Terrain.h"
 #include "../core/Game.h"
-#include <iostream>
+#include "../core/Log.h"
+#include "DebugOverlay.h"
+#include <vector>
 
 Renderer2D::Renderer2D()
     : mWindow(nullptr)
     , mRenderer(nullptr)
+    , mTerrainLayer(nullptr)
+    , mTerrainLayerVersion(0)
+    , mTerrainLayerFailed(false)
+    , mViewLeft(0.0f)
+    , mViewScale(1.0f)
+    , mGlyphAtlas(nullptr)
+    , mHudLayer(nullptr)
+    , mHudLayerFailed(false)
     , mWidth(800)
     , mHeight(600)
     , mInitialized(false)
-    , mPixelsPerMeter(20.0f) // Conversion factor: 20 pixels = 1 meter
 {
 }
 
@@ -29,7 +42,7 @@ bool Renderer2D::Initialize(int width, int height, const std::string& title) {
     
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
+        LOG_ERROR("SDL initialization failed: %s", SDL_GetError());
         return false;
     }
     
@@ -44,7 +57,7 @@ bool Renderer2D::Initialize(int width, int height, const std::string& title) {
     );
     
     if (!mWindow) {
-        std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Window creation failed: %s", SDL_GetError());
         return false;
     }
     
@@ -56,17 +69,41 @@ bool Renderer2D::Initialize(int width, int height, const std::string& title) {
     );
     
     if (!mRenderer) {
-        std::cerr << "Renderer creation failed: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Renderer creation failed: %s", SDL_GetError());
         return false;
     }
     
+    // Translucent panels (telemetry, profiler overlay) need alpha blending
+    SDL_SetRenderDrawBlendMode(mRenderer, SDL_BLENDMODE_BLEND);
+    
+    // Text is optional; everything else still draws without it
+    if (!CreateGlyphAtlas()) {
+        LOG_WARNING("Glyph atlas unavailable (%s), telemetry text disabled", SDL_GetError());
+    }
+    
     mInitialized = true;
-    std::cout << "Renderer2D initialized with dimensions: " << mWidth << "x" << mHeight
-              << ", pixels per meter: " << mPixelsPerMeter << std::endl;
+    LOG_INFO("Renderer2D initialized with dimensions: %dx%d, pixels per meter: %g",
+             mWidth, mHeight, Units::kPixelsPerMeter);
     return true;
 }
 
 void Renderer2D::Shutdown() {
+    if (mHudLayer) {
+        SDL_DestroyTexture(mHudLayer);
+        mHudLayer = nullptr;
+    }
+    
+    if (mGlyphAtlas) {
+        SDL_DestroyTexture(mGlyphAtlas);
+        mGlyphAtlas = nullptr;
+    }
+    
+    if (mTerrainLayer) {
+        SDL_DestroyTexture(mTerrainLayer);
+        mTerrainLayer = nullptr;
+    }
+    mTerrainLayerVersion = 0;
+    
     if (mRenderer) {
         SDL_DestroyRenderer(mRenderer);
         mRenderer = nullptr;
@@ -80,41 +117,89 @@ void Renderer2D::Shutdown() {
     mInitialized = false;
 }
 
+void Renderer2D::SetVisible(bool visible) {
+    if (!mWindow) return;
+    
+    if (visible) {
+        SDL_ShowWindow(mWindow);
+    } else {
+        SDL_HideWindow(mWindow);
+    }
+}
+
 void Renderer2D::Clear() {
     if (!mInitialized) return;
     
     // Clear screen with black background
     SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 255);
     SDL_RenderClear(mRenderer);
+    mBatch.Clear();
+    mAtlasQuads.Clear();
+}
+
+bool Renderer2D::CreateGlyphAtlas() {
+    mGlyphAtlas = SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+                                    GlyphAtlas::kWidth, GlyphAtlas::kHeight);
+    if (!mGlyphAtlas) {
+        return false;
+    }
+    
+    // White, with the coverage as alpha, so vertex colors tint the glyphs
+    const uint8_t* coverage = GlyphAtlas::GetPixels();
+    std::vector<uint8_t> pixels(GlyphAtlas::kWidth * GlyphAtlas::kHeight * 4);
+    for (size_t i = 0; i < pixels.size() / 4; i++) {
+        pixels[i * 4 + 0] = 255;
+        pixels[i * 4 + 1] = 255;
+        pixels[i * 4 + 2] = 255;
+        pixels[i * 4 + 3] = coverage[i];
+    }
+    SDL_UpdateTexture(mGlyphAtlas, nullptr, pixels.data(), GlyphAtlas::kWidth * 4);
+    SDL_SetTextureBlendMode(mGlyphAtlas, SDL_BLENDMODE_BLEND);
+    return true;
 }
 
 void Renderer2D::Present() {
     if (!mInitialized) return;
     
+    // Everything drawn this frame, in one call, then anything textured
+    // from the atlas over it in another
+    mBatch.Flush(mRenderer);
+    if (mGlyphAtlas) {
+        mAtlasQuads.Flush(mRenderer, mGlyphAtlas);
+    }
+    
+    // SDL has no display callback; with vsync the present returns once the
+    // frame is swapped in
+    uint64_t latencyFrame = LatencyTracker::OnFrameSubmitted();
     SDL_RenderPresent(mRenderer);
+    LatencyTracker::OnFrameCompleted(latencyFrame);
+    LatencyTracker::OnFramePresented(latencyFrame, Profiler::Now());
+}
+
+void Renderer2D::SetView2D(float left, float scale) {
+    mViewLeft = left;
+    mViewScale = scale > 0.0f ? scale : 1.0f;
 }
 
 // Convert physics coordinates (meters) to screen coordinates (pixels)
 void Renderer2D::PhysicsToScreen(float physX, float physY, int& screenX, int& screenY) {
-    // Convert from meters to pixels
-    screenX = static_cast<int>(physX * mPixelsPerMeter);
+    // Convert from meters to pixels, then into the view
+    screenX = static_cast<int>((physX * Units::kPixelsPerMeter - mViewLeft) * mViewScale);
     
     // Invert Y-axis: In physics, Y increases upward; in screen coords, Y increases downward
-    screenY = mHeight - static_cast<int>(physY * mPixelsPerMeter);
+    screenY = mHeight - static_cast<int>(physY * Units::kPixelsPerMeter * mViewScale);
     
 }
 
 void Renderer2D::RenderLander(Lander* lander) {
     if (!mInitialized || !lander) {
-        std::cerr << "Failed to render lander: " << 
-            (!mInitialized ? "Renderer not initialized" : "Lander is null") << std::endl;
+        LOG_ERROR_EVERY(1000, "Failed to render lander: %s",
+                        !mInitialized ? "Renderer not initialized" : "Lander is null");
         return;
     }
     
-    // Get lander properties (in physics units - meters)
-    const float* position = lander->GetPosition();
-    float width = lander->GetWidth() / mPixelsPerMeter;  // Convert to meters
-    float height = lander->GetHeight() / mPixelsPerMeter; // Convert to meters
+    // Get lander properties (in physics units - meters), interpolated for rendering
+    const float* position = lander->GetRenderPosition();
     
     // Convert lander position from physics coordinates to screen coordinates
     int screenX, screenY;
@@ -122,12 +207,14 @@ void Renderer2D::RenderLander(Lander* lander) {
     
     
     // Convert dimensions from meters to pixels for rendering
-    int screenWidth = static_cast<int>(width * mPixelsPerMeter);
-    int screenHeight = static_cast<int>(height * mPixelsPerMeter);
+    int screenWidth = static_cast<int>(Units::ToPixels(lander->GetWidth()).Value());
+    int screenHeight = static_cast<int>(Units::ToPixels(lander->GetHeight()).Value());
     
     // Ensure the lander is visible (increase size if needed)
     if (screenWidth < 40) screenWidth = 40;
     if (screenHeight < 60) screenHeight = 60;
+    screenWidth = static_cast<int>(screenWidth * mViewScale);
+    screenHeight = static_cast<int>(screenHeight * mViewScale);
     
     // Draw lander body as a rectangle centered on its position
     DrawRect(
@@ -150,76 +237,237 @@ void Renderer2D::RenderLander(Lander* lander) {
     }
 }
 
+void Renderer2D::RenderPredictedImpact(const float* position) {
+    if (!mInitialized || !position) return;
+    
+    // A cross standing on the surface
+    int screenX, screenY;
+    PhysicsToScreen(position[0], position[1], screenX, screenY);
+    const float size = 6.0f;
+    DrawLine(screenX - size, screenY - 2 * size, screenX + size, screenY, 0, 200, 255);
+    DrawLine(screenX - size, screenY, screenX + size, screenY - 2 * size, 0, 200, 255);
+}
+
 void Renderer2D::RenderTerrain(Terrain* terrain) {
     if (!mInitialized || !terrain) return;
     
-    // Get terrain segments
-    const std::vector<TerrainSegment>& segments = terrain->GetSegments2D();
+    // A scrolled, zoomed or wider world has no layer to reuse
+    if (mViewLeft != 0.0f || mViewScale != 1.0f || terrain->GetWidth() > mWidth) {
+        AddTerrainLines(terrain);
+        return;
+    }
+    
+    // Redraw the layer only when the segments changed
+    if (!mTerrainLayerFailed && terrain->GetSegmentsVersion2D() != mTerrainLayerVersion) {
+        mTerrainLayerFailed = !UpdateTerrainLayer(terrain);
+    }
+    if (mTerrainLayerFailed) {
+        AddTerrainLines(terrain);
+        return;
+    }
     
-    // Draw each terrain segment
-    for (const auto& segment : segments) {
-        // FIXED: Draw segments directly using their screen coordinates
-        // since TerrainSegment coordinates are already in screen space
+    // Whatever was batched before the terrain goes first
+    mBatch.Flush(mRenderer);
+    SDL_RenderCopy(mRenderer, mTerrainLayer, nullptr, nullptr);
+}
+
+void Renderer2D::AddTerrainLines(const Terrain* terrain) {
+    // Get terrain segments, as few as stay within a pixel of the full ones
+    // on screen
+    const int level = terrain->SelectLod2D(mViewScale);
+    const std::vector<TerrainSegment>& segments = terrain->GetLodSegments2D(level);
+    
+    // Draw each terrain segment in view
+    const float right = mViewLeft + mWidth / mViewScale;
+    for (size_t i = terrain->FindLodSegment2D(level, mViewLeft); i < segments.size(); i++) {
+        const TerrainSegment& segment = segments[i];
+        if (segment.x1 > right) {
+            break;
+        }
+        
+        // TerrainSegment coordinates are in terrain pixels, the unscrolled
+        // window's screen space
+        const float x1 = ViewToScreenX(segment.x1);
+        const float y1 = ViewToScreenY(segment.y1);
+        const float x2 = ViewToScreenX(segment.x2);
+        const float y2 = ViewToScreenY(segment.y2);
         
         // Use white for normal terrain and green for landing pads
         if (segment.isLandingPad) {
-            DrawLine(segment.x1, segment.y1, segment.x2, segment.y2, 0, 255, 0);
+            DrawLine(x1, y1, x2, y2, 0, 255, 0);
         } else {
-            DrawLine(segment.x1, segment.y1, segment.x2, segment.y2, 200, 200, 200);
+            DrawLine(x1, y1, x2, y2, 200, 200, 200);
         }
     }
 }
 
-void Renderer2D::RenderTelemetry(Game* game) {
-    if (!mInitialized || !game) return;
-    
-    Lander* lander = game->GetLander();
-    if (!lander) return;
+bool Renderer2D::UpdateTerrainLayer(const Terrain* terrain) {
+    if (!mTerrainLayer) {
+        mTerrainLayer = SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_RGBA8888,
+                                          SDL_TEXTUREACCESS_TARGET, mWidth, mHeight);
+        if (!mTerrainLayer) {
+            LOG_WARNING("No terrain layer texture (%s), drawing terrain lines every frame", SDL_GetError());
+            return false;
+        }
+        SDL_SetTextureBlendMode(mTerrainLayer, SDL_BLENDMODE_BLEND);
+    }
     
-    // Get lander properties
-    const float* position = lander->GetPosition();
-    const float* velocity = lander->GetVelocity();
-    float fuel = lander->GetFuel();
-    float maxFuel = lander->GetMaxFuel();
+    // Pending primitives belong on the screen, not in the layer
+    mBatch.Flush(mRenderer);
+    if (SDL_SetRenderTarget(mRenderer, mTerrainLayer) != 0) {
+        LOG_WARNING("Can't render to the terrain layer (%s), drawing terrain lines every frame", SDL_GetError());
+        SDL_DestroyTexture(mTerrainLayer);
+        mTerrainLayer = nullptr;
+        return false;
+    }
     
-    // Background for telemetry panel
-    DrawRect(10, 10, 200, 130, 50, 50, 50, 200);
+    SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 0);
+    SDL_RenderClear(mRenderer);
+    AddTerrainLines(terrain);
+    mBatch.Flush(mRenderer);
+    SDL_SetRenderTarget(mRenderer, nullptr);
     
-    // Altitude indicator (green bar)
-    int screenX, screenY;
-    PhysicsToScreen(position[0], position[1], screenX, screenY);
-    float altitude = position[1]; // Altitude in meters
-    float maxAltitude = mHeight / mPixelsPerMeter; // Max altitude in meters
-    float altitudePct = altitude / maxAltitude;
-    if (altitudePct > 1.0f) altitudePct = 1.0f;
+    mTerrainLayerVersion = terrain->GetSegmentsVersion2D();
+    return true;
+}
+
+void Renderer2D::RenderLanderBatch(const LanderBatch* batch) {
+    if (!mInitialized || !batch) return;
+    
+    // Each lander a rotated body rectangle, colored by its state. Screen y
+    // points down, so the physics rotation flips sign on the way.
+    const float* posX = batch->GetPositionX();
+    const float* posY = batch->GetPositionY();
+    const float* rotation = batch->GetRotation();
+    const uint8_t* state = batch->GetState();
+    const float halfWidth = 0.5f * batch->GetLanderWidth() * Units::kPixelsPerMeter * mViewScale;
+    const float halfHeight = 0.5f * batch->GetLanderHeight() * Units::kPixelsPerMeter * mViewScale;
+    const float corners[4][2] = {
+        { -halfWidth, -halfHeight },
+        {  halfWidth, -halfHeight },
+        {  halfWidth,  halfHeight },
+        { -halfWidth,  halfHeight }
+    };
     
-    DrawRect(20, 20, static_cast<int>(altitudePct * 180), 20, 0, 255, 0);
+    for (size_t i = 0; i < batch->GetCount(); i++) {
+        float sinValue, cosValue;
+        LanderKernels::SinCosDegrees(rotation[i], sinValue, cosValue);
+        const float centerX = ViewToScreenX(posX[i] * Units::kPixelsPerMeter);
+        const float centerY = mHeight - posY[i] * Units::kPixelsPerMeter * mViewScale;
+        
+        SDL_FPoint quad[4];
+        for (int c = 0; c < 4; c++) {
+            quad[c].x = centerX + corners[c][0] * cosValue - corners[c][1] * sinValue;
+            quad[c].y = centerY - (corners[c][0] * sinValue + corners[c][1] * cosValue);
+        }
+        
+        SDL_Color color = { 220, 220, 220, 255 };
+        if (state[i] == BATCH_LANDED) {
+            color = { 0, 255, 0, 255 };
+        } else if (state[i] == BATCH_CRASHED) {
+            color = { 255, 60, 60, 255 };
+        }
+        mBatch.AddQuad(quad, color);
+    }
+}
+
+void Renderer2D::RenderTelemetry(Game* game) {
+    if (!mInitialized || !game) return;
     
-    // Velocity indicator (blue for downward, red for upward)
-    float maxSafeVelocity = 2.0f; // m/s, safe landing velocity
-    float velocityPct = std::abs(velocity[1]) / (maxSafeVelocity * 3);
-    if (velocityPct > 1.0f) velocityPct = 1.0f;
+    if (!game->GetRenderSnapshot().lander) return;
     
-    if (velocity[1] >= 0) { // In physics, positive Y is upward
-        DrawRect(20, 50, static_cast<int>(velocityPct * 180), 20, 0, 0, 255); // Blue for downward
-    } else {
-        DrawRect(20, 50, static_cast<int>(velocityPct * 180), 20, 255, 0, 0); // Red for upward
+    // Rebuilds only widgets whose displayed values changed
+    mHud.Update(game, Units::ToMeters(Pixels(static_cast<float>(mHeight))).Value());
+    if (mGlyphAtlas) {
+        if (!mHudLayerFailed) {
+            mHudLayerFailed = !UpdateHudLayer();
+        }
+        if (!mHudLayerFailed) {
+            // Batched primitives so far go under the HUD
+            mBatch.Flush(mRenderer);
+            SDL_Rect destination = { 0, 0, Hud::kLayerWidth, Hud::kLayerHeight };
+            SDL_RenderCopy(mRenderer, mHudLayer, nullptr, &destination);
+        } else {
+            for (int widget = 0; widget < Hud::kWidgetCount; widget++) {
+                AddHudWidget(widget);
+            }
+        }
     }
     
-    // Fuel indicator (yellow bar)
-    float fuelPct = fuel / maxFuel;
-    DrawRect(20, 80, static_cast<int>(fuelPct * 180), 20, 255, 255, 0);
-    
-    // Numerical display of altitude and velocity
-    char buffer[100];
-    sprintf(buffer, "Alt: %.1f m", altitude);
-    // Render text would go here if SDL_ttf was integrated
+    // Frame profiler and memory stats
+    auto drawRect = [this](float x, float y, float w, float h, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+        DrawRect(x, y, w, h, r, g, b, a);
+    };
+    float panelBottom = DebugOverlay::DrawProfilerStats(mWidth, drawRect);
+    DebugOverlay::DrawMemoryStats(mWidth, panelBottom, drawRect);
+}
+
+void Renderer2D::AddHudWidget(int widget) {
+    const float invWidth = 1.0f / GlyphAtlas::kWidth;
+    const float invHeight = 1.0f / GlyphAtlas::kHeight;
+    const Hud::Quad* quads = mHud.GetWidgetQuads(widget);
+    for (int i = 0; i < mHud.GetWidgetQuadCount(widget); i++) {
+        const Hud::Quad& quad = quads[i];
+        mAtlasQuads.AddTexturedRect(quad.x, quad.y, quad.width, quad.height,
+                                    SDL_FPoint { quad.u0 * invWidth, quad.v0 * invHeight },
+                                    SDL_FPoint { quad.u1 * invWidth, quad.v1 * invHeight },
+                                    SDL_Color { quad.r, quad.g, quad.b, quad.a });
+    }
+}
+
+bool Renderer2D::UpdateHudLayer() {
+    if (!mHudLayer) {
+        mHudLayer = SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                      Hud::kLayerWidth, Hud::kLayerHeight);
+        if (!mHudLayer) {
+            LOG_WARNING("No HUD layer texture (%s), drawing the HUD every frame", SDL_GetError());
+            return false;
+        }
+        // Blending into the cleared layer leaves it premultiplied, so it
+        // composites with source factor one
+        SDL_SetTextureBlendMode(mHudLayer, SDL_ComposeCustomBlendMode(
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD));
+        for (uint32_t& version : mHudLayerVersions) {
+            version = 0;
+        }
+    }
     
-    sprintf(buffer, "Vel: %.1f m/s", velocity[1]);
-    // Render text would go here if SDL_ttf was integrated
+    bool dirty = false;
+    for (int widget = 0; widget < Hud::kWidgetCount; widget++) {
+        dirty = dirty || mHudLayerVersions[widget] != mHud.GetWidgetVersion(widget);
+    }
+    if (!dirty) return true;
+    
+    // Pending primitives belong on the screen, not in the layer
+    mBatch.Flush(mRenderer);
+    if (SDL_SetRenderTarget(mRenderer, mHudLayer) != 0) {
+        LOG_WARNING("Can't render to the HUD layer (%s), drawing the HUD every frame", SDL_GetError());
+        SDL_DestroyTexture(mHudLayer);
+        mHudLayer = nullptr;
+        return false;
+    }
     
-    sprintf(buffer, "Fuel: %.1f%%", fuelPct * 100);
-    // Render text would go here if SDL_ttf was integrated
+    // Clear each changed widget's own rectangle (widgets don't overlap)
+    // and draw it again; the rest of the layer is left as it was
+    for (int widget = 0; widget < Hud::kWidgetCount; widget++) {
+        if (mHudLayerVersions[widget] == mHud.GetWidgetVersion(widget)) continue;
+        
+        float x, y, width, height;
+        mHud.GetWidgetBounds(widget, x, y, width, height);
+        SDL_Rect bounds = { static_cast<int>(x), static_cast<int>(y),
+                            static_cast<int>(width), static_cast<int>(height) };
+        SDL_SetRenderDrawBlendMode(mRenderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 0);
+        SDL_RenderFillRect(mRenderer, &bounds);
+        SDL_SetRenderDrawBlendMode(mRenderer, SDL_BLENDMODE_BLEND);
+        
+        AddHudWidget(widget);
+        mHudLayerVersions[widget] = mHud.GetWidgetVersion(widget);
+    }
+    mAtlasQuads.Flush(mRenderer, mGlyphAtlas);
+    SDL_SetRenderTarget(mRenderer, nullptr);
+    return true;
 }
 
 void Renderer2D::RenderGameState(Game* game) {
@@ -230,29 +478,25 @@ void Renderer2D::DrawRect(float x, float y, float width, float height,
                          Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
     if (!mInitialized) return;
     
-    SDL_SetRenderDrawColor(mRenderer, r, g, b, a);
-    
-    SDL_Rect rect {
-        static_cast<int>(x),
-        static_cast<int>(y),
-        static_cast<int>(width),
-        static_cast<int>(height)
-    };
-    
-    SDL_RenderFillRect(mRenderer, &rect);
+    // Whole pixels, as SDL_RenderFillRect drew them
+    mBatch.AddRect(
+        static_cast<float>(static_cast<int>(x)),
+        static_cast<float>(static_cast<int>(y)),
+        static_cast<float>(static_cast<int>(width)),
+        static_cast<float>(static_cast<int>(height)),
+        SDL_Color { r, g, b, a }
+    );
 }
 
 void Renderer2D::DrawLine(float x1, float y1, float x2, float y2, 
                          Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
     if (!mInitialized) return;
     
-    SDL_SetRenderDrawColor(mRenderer, r, g, b, a);
-    
-    SDL_RenderDrawLine(
-        mRenderer,
-        static_cast<int>(x1),
-        static_cast<int>(y1),
-        static_cast<int>(x2),
-        static_cast<int>(y2)
+    mBatch.AddLine(
+        static_cast<float>(static_cast<int>(x1)),
+        static_cast<float>(static_cast<int>(y1)),
+        static_cast<float>(static_cast<int>(x2)),
+        static_cast<float>(static_cast<int>(y2)),
+        SDL_Color { r, g, b, a }
     );
 }
@@ -5,6 +5,8 @@
 
 #include "../compat.h"
 #include "Renderer.h"
+#include "Batch2D.h"
+#include "Hud.h"
 #include <SDL2/SDL.h>
 
 class Renderer2D : public Renderer {
@@ -20,6 +22,8 @@ public:
     
     void RenderLander(Lander* lander) override;
     void RenderTerrain(Terrain* terrain) override;
+    void RenderLanderBatch(const LanderBatch* batch) override;
+    void RenderPredictedImpact(const float* position) override;
     
     void RenderTelemetry(Game* game) override;
     void RenderGameState(Game* game) override;
@@ -28,37 +32,77 @@ public:
     int GetHeight() const override { return mHeight; }
     bool IsInitialized() const override { return mInitialized; }
     
+    // Hidden, the window and its SDL renderer are kept for the next switch
+    void SetVisible(bool visible) override;
+    
     // 3D camera methods (implemented as no-ops for 2D renderer)
-    void SetCameraPosition(float x, float y, float z) override {}
-    void SetCameraTarget(float x, float y, float z) override {}
-    void SetCameraUp(float x, float y, float z) override {}
+    void SetCamera(const Camera& camera) override {}
+    
+    void SetView2D(float left, float scale) override;
     
     // 3D lighting methods (implemented as no-ops for 2D renderer)
     void SetLightPosition(float x, float y, float z) override {}
     void SetAmbientLight(float r, float g, float b) override {}
     
-    // Helper methods for 2D rendering
+    // Helper methods for 2D rendering. Both only add to the frame's batch,
+    // which Present() draws in one call.
     void DrawRect(float x, float y, float width, float height, 
                  Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255);
     void DrawLine(float x1, float y1, float x2, float y2, 
                  Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255);
     
-    // Coordinate conversion method
+    // Upload GlyphAtlas's pixels as an RGBA texture
+    bool CreateGlyphAtlas();
+    
+    // Redraw the HUD widgets that changed into mHudLayer; false if render
+    // targets are unavailable
+    bool UpdateHudLayer();
+    void AddHudWidget(int widget);
+    
+    // Batch the terrain's segments in view as lines, at the coarsest level
+    // of detail within a pixel
+    void AddTerrainLines(const Terrain* terrain);
+    
+    // Redraw mTerrainLayer from the terrain; false if render targets are
+    // unavailable
+    bool UpdateTerrainLayer(const Terrain* terrain);
+    
+    // Coordinate conversion method (scale from Units)
     void PhysicsToScreen(float physX, float physY, int& screenX, int& screenY);
     
-    // Getter for pixels per meter
-    float GetPixelsPerMeter() const { return mPixelsPerMeter; }
+    // Terrain pixels to the view's screen pixels
+    float ViewToScreenX(float x) const { return (x - mViewLeft) * mViewScale; }
+    float ViewToScreenY(float y) const { return mHeight - (mHeight - y) * mViewScale; }
     
 private:
     // SDL rendering variables
     SDL_Window* mWindow;
     SDL_Renderer* mRenderer;
+    Batch2D mBatch;
+    
+    // Terrain rasterized once into a transparent render target and blitted
+    // every frame until the segments change (null = draw lines directly)
+    SDL_Texture* mTerrainLayer;
+    uint32_t mTerrainLayerVersion;    // Terrain::GetSegmentsVersion2D() drawn into it (0 = none)
+    bool mTerrainLayerFailed;         // Render targets unavailable, don't retry
+    
+    // SetView2D. The terrain layer holds the unscrolled window, so other
+    // views draw the terrain's lines instead.
+    float mViewLeft;
+    float mViewScale;
+    
+    // HUD: composited into mHudLayer, redrawing only the widgets whose
+    // version moved, and blitted in one copy. Without render targets its
+    // quads go through mAtlasQuads every frame instead (null atlas = no HUD).
+    SDL_Texture* mGlyphAtlas;
+    Hud mHud;
+    SDL_Texture* mHudLayer;
+    uint32_t mHudLayerVersions[Hud::kWidgetCount];   // Widget versions drawn into the layer
+    bool mHudLayerFailed;
+    Batch2D mAtlasQuads;                             // Textured from mGlyphAtlas
     
     // Renderer properties
     int mWidth;
     int mHeight;
     bool mInitialized;
-    
-    // Conversion from world coordinates to screen coordinates
-    float mPixelsPerMeter;
 };
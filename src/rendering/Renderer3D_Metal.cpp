@@ -3,19 +3,37 @@
 
 #include "../compat.h"
 #include "Renderer3D_Metal.h"
+#include "../core/Camera.h"
 #include "../core/Entity.h"
 #include "../core/Terrain.h"
+#include "../core/TerrainGenerator.h"
+#include "../core/FrameArena.h"
 #include "../core/Game.h"
-#include <iostream>
+#include "../core/JobSystem.h"
+#include "../core/LanderBatch.h"
+#include "../core/LanderKernels.h"
+#include "../core/LatencyTracker.h"
+#include "../core/Log.h"
+#include "../core/Profiler.h"
+#include "DebugOverlay.h"
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <mach/mach_time.h>
 
 // Include Metal-cpp headers
 #define NS_PRIVATE_IMPLEMENTATION
 #define CA_PRIVATE_IMPLEMENTATION
 #define MTL_PRIVATE_IMPLEMENTATION
+#define MTLFX_PRIVATE_IMPLEMENTATION
 #include <Foundation/Foundation.hpp>
 #include <Metal/Metal.hpp>
 #include <QuartzCore/QuartzCore.hpp>
+#include <MetalFX/MetalFX.hpp>
 
 // Include SDL window info for Metal layer
 #include <SDL2/SDL_syswm.h>
@@ -26,6 +44,8 @@ extern "C" {
     void SetMetalLayerForSDLWindow(void* nsWindowPtr, void* metalLayerPtr);
     void* CreateCAMetalLayer();
     void ReleaseCAMetalLayer(void* layerPtr);
+    void ConfigureCAMetalLayer(void* layerPtr, int maximumDrawableCount, bool displaySyncEnabled);
+    bool DeviceSupportsIOCommandQueues(void* devicePtr);
 }
 
 
@@ -35,43 +55,256 @@ NS::String* GetMetalLibraryPath() {
     return NS::String::string("assets/shaders/default.metallib", NS::UTF8StringEncoding);
 }
 
+// Float in [-1, 1] to snorm16 (the GPU decodes with max(c / 32767, -1))
+static int16_t PackSnorm16(float value) {
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+// Octahedral snorm16 encoding of a unit vector: project onto the
+// |x| + |y| + |z| = 1 octahedron and fold the lower half over the upper
+static void PackOctahedral(const float* normal, int16_t* out) {
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    float octX = length > 0.0f ? normal[0] / length : 0.0f;
+    float octY = length > 0.0f ? normal[1] / length : 0.0f;
+    if (length > 0.0f && normal[2] < 0.0f) {
+        float foldedX = (1.0f - std::fabs(octY)) * (octX >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::fabs(octX)) * (octY >= 0.0f ? 1.0f : -1.0f);
+        octX = foldedX;
+        octY = foldedY;
+    }
+    out[0] = PackSnorm16(octX);
+    out[1] = PackSnorm16(octY);
+}
+
+// Quantize a vertex against its mesh's position range (extent is the
+// half-size, > 0 on every axis) with an octahedral normal
+static PackedVertex PackVertex(const float* position, const float* normal, uint8_t flags,
+                               const float* origin, const float* extent) {
+    PackedVertex packed;
+    for (int i = 0; i < 3; i++) {
+        packed.position[i] = PackSnorm16((position[i] - origin[i]) / extent[i]);
+    }
+    packed.position[3] = 0;
+    PackOctahedral(normal, packed.normal);
+    packed.flags = flags;
+    packed.occlusion = 0;
+    packed.padding[0] = packed.padding[1] = 0;
+    return packed;
+}
+
+// Camera projection
+static const float kCameraFieldOfView = 45.0f * static_cast<float>(M_PI / 180.0);
+static const float kCameraNear = 0.1f;
+static const float kCameraFar = 1000.0f;
+
+// The lander cube spans [-0.5, 0.5] on every axis
+static const float kLanderPositionOrigin[3] = {0.0f, 0.0f, 0.0f};
+static const float kLanderPositionExtent[3] = {0.5f, 0.5f, 0.5f};
+
+// Variable rasterization: rate map zones across and down the screen,
+// about square on a 16:10 display
+static const int kRateMapZonesX = 16;
+static const int kRateMapZonesY = 10;
+
+// Shading rate of a zone the given number of zones from the focus
+static float RateMapQuality(int zones) {
+    return zones <= 1 ? 1.0f : zones <= 3 ? 0.5f : 0.25f;
+}
+
+// Deferred lighting G-buffer: albedo, normal and world position (w = 1
+// where something was drawn), after the color and motion attachments
+static const int kGBufferFirstAttachment = 2;
+static const int kGBufferCount = 3;
+static const MTL::PixelFormat kGBufferFormats[kGBufferCount] = {
+    MTL::PixelFormatRGBA8Unorm, MTL::PixelFormatRGBA16Float, MTL::PixelFormatRGBA32Float
+};
+
 Renderer3D_Metal::Renderer3D_Metal()
     : mWindow(nullptr)
     , mDevice(nullptr)
     , mCommandQueue(nullptr)
+    , mIOCommandQueue(nullptr)
+    , mTerrainIOEvent(nullptr)
+    , mTerrainIOCommands(nullptr)
+    , mTerrainIOHandle(nullptr)
+    , mTerrainIOValue(0)
     , mShaderLibrary(nullptr)
-    , mRenderPipelineState(nullptr)
     , mDepthStencilState(nullptr)
+    , mLanderInstancePipelineState(nullptr)
+    , mOverlayPipelineState(nullptr)
+    , mOverlayDepthState(nullptr)
+    , mTerrainTessPipelineState(nullptr)
+    , mTerrainTessFactorPipeline(nullptr)
+    , mTerrainTableArgumentEncoder(nullptr)
+    , mTerrainCullPipeline(nullptr)
+    , mTerrainCullArgumentEncoder(nullptr)
+    , mHiZDepthPipeline(nullptr)
+    , mHiZReducePipeline(nullptr)
+    , mPipelineArchive(nullptr)
+    , mPipelineArchiveHits(0)
+    , mPipelineArchiveMisses(0)
+    , mTerrainHeightPipeline(nullptr)
+    , mTerrainVertexPipeline(nullptr)
+    , mParticleEmitPipeline(nullptr)
+    , mParticleUpdatePipeline(nullptr)
+    , mParticlePipelineState(nullptr)
+    , mParticleDepthState(nullptr)
+    , mShadowCasterPipelineState(nullptr)
+    , mShadowTerrainMapPipelineState(nullptr)
+    , mLightCullPipelineState(nullptr)
+    , mDeferredLightingPipelineState(nullptr)
+    , mDeferredDepthState(nullptr)
+    , mSkyPipelineState(nullptr)
+    , mSkyDepthState(nullptr)
     , mMetalLayer(nullptr)
     , mLanderVertexBuffer(nullptr)
     , mLanderIndexBuffer(nullptr)
+    , mLanderMeshVertexBuffer(nullptr)
+    , mLanderMeshIndexBuffer(nullptr)
     , mTerrainVertexBuffer(nullptr)
     , mTerrainIndexBuffer(nullptr)
-    , mVertexUniformBuffer(nullptr)
-    , mFragmentUniformBuffer(nullptr)
+    , mTerrainMeshletBuffer(nullptr)
+    , mTerrainStagingBuffer(nullptr)
+    , mUniformRingBuffer(nullptr)
+    , mOverlayVertexBuffer(nullptr)
+    , mGlyphAtlasTexture(nullptr)
+    , mLanderInstanceBuffer(nullptr)
+    , mTerrainTessFactorBuffer(nullptr)
+    , mTerrainCullChunkBuffer(nullptr)
+    , mTerrainCullArgumentBuffer(nullptr)
+    , mTerrainTableArgumentBuffer(nullptr)
+    , mTerrainIndirectCommands(nullptr)
+    , mParticleBuffer(nullptr)
+    , mFramesInFlight(kDefaultFramesInFlight)
+    , mFrameSlot(0)
+    , mUniformWriteOffset(0)
+    , mLanderInstanceWriteCount(0)
+    , mFrameSemaphore(nullptr)
     , mDepthTexture(nullptr)
+    , mTerrainHeightTexture(nullptr)
+    , mTerrainHeightRangeTexture(nullptr)
+    , mTerrainNormalTexture(nullptr)
+    , mTerrainFlagTexture(nullptr)
+    , mTerrainHorizonTexture(nullptr)
+    , mTerrainShadowMap(nullptr)
+    , mLanderShadowMap(nullptr)
+    , mHiZTexture(nullptr)
+    , mShadowPassDescriptor(nullptr)
+    , mSpatialScaler(nullptr)
+    , mTemporalScaler(nullptr)
+    , mSceneColorTexture(nullptr)
+    , mSceneDepthTexture(nullptr)
+    , mSceneMotionTexture(nullptr)
+    , mUpscaledTexture(nullptr)
+    , mMemorylessSceneDepth(nullptr)
+    , mMemorylessOverlayDepth(nullptr)
+    , mOverlayPassDescriptor(nullptr)
+    , mRateMap(nullptr)
+    , mRateMapParameters(nullptr)
+    , mVariableRateTexture(nullptr)
+    , mVariableRateResolvePipelineState(nullptr)
+    , mRenderTargetHeap(nullptr)
+    , mUseMemorylessDepth(false)
+    , mCheckedPasses(0)
+    , mSceneTargetWidth(0)
+    , mSceneTargetHeight(0)
+    , mDrawableSizeDirty(false)
+    , mMaximumDrawableCount(3)
+    , mDisplaySync(true)
+    , mDrawableWidth(0)
+    , mDrawableHeight(0)
+    , mSceneWidth(0)
+    , mSceneHeight(0)
+    , mRenderScale(kMaxRenderScale)
+    , mMinRenderScale(kMinRenderScale)
+    , mMaxRenderScale(kMaxRenderScale)
+    , mTargetFrameRate(120.0f)
+    , mGpuFrameTime(0.0)
+    , mLastGpuFrameTime(0.0)
+    , mScenePassOpen(false)
+    , mUseDynamicResolution(false)
+    , mUseTemporalUpscaling(false)
+    , mUseVariableRasterization(false)
+    , mJitterIndex(0)
+    , mTemporalReset(true)
+    , mHasPreviousLanderModel(false)
+    , mMotionUniformOffset(0)
+    , mTerrainTableUniformOffset(0)
+    , mTerrainTableArgumentOffset(0)
+    , mSceneFragmentBufferMask(0)
+    , mFramePool(nullptr)
+    , mDrawable(nullptr)
+    , mRenderPassDescriptor(nullptr)
+    , mCommandBuffer(nullptr)
+    , mRenderEncoder(nullptr)
+    , mParallelEncoder(nullptr)
+    , mUseParallelEncoding(false)
+    , mGpuTimestampBuffer(nullptr)
+    , mGpuPassCount(0)
+    , mCalibrationCpuTime(0)
+    , mCalibrationGpuTime(0)
     , mWidth(800)
     , mHeight(600)
+    , mJobSystem(nullptr)
+    , mFrameArena(nullptr)
     , mInitialized(false)
     , mLanderVertexCount(0)
     , mLanderIndexCount(0)
-    , mTerrainIndexCount(0)
+    , mTerrainLevelCount(0)
+    , mTerrainQuadrantIndexCount(0)
+    , mTerrainPadCommand(0)
+    , mTerrainCullChunksDirty(true)
+    , mTerrainCullChunksUploadSerial(0)
+    , mTerrainUploadSerial(0)
+    , mTerrainVersion(0)
+    , mTerrainLayoutVersion(0)
+    , mUseTerrainTextures(false)
+    , mUseTerrainTessellation(false)
+    , mUseTerrainMeshShaders(false)
+    , mUseGpuTerrainCulling(false)
+    , mUseHiZCulling(false)
+    , mHiZReady(false)
+    , mViewDirty(true)
+    , mCameraVersion(0)
+    , mPipelinesPending(0)
+    , mLibraryPending(false)
+    , mPipelinesStarted(false)
+    , mInitializeStartNs(0)
+    , mFirstFramePresented(false)
+    , mSpikeCaptureMs(0.0f)
+    , mSpikeCaptureFrames(3)
+    , mSpikeFrameStartNs(0)
+    , mSpikeFramesLeft(0)
+    , mSpikeCooldown(0)
+    , mSpikeCaptureCount(0)
+    , mGpuCaptureActive(false)
+    , mParticleHead(0)
+    , mParticleSeed(0)
+    , mParticleLastNs(0)
+    , mUseShadows(true)
+    , mTerrainShadowValid(false)
+    , mTerrainShadowVersion(0)
+    , mTerrainShadowLayoutVersion(0)
+    , mUseRayTracedShadows(false)
+    , mUseHorizonShadows(false)
+    , mUseDeferredLighting(false)
+    , mLightingPending(false)
+    , mSkyPending(false)
+    , mPointLightOffset(0)
 {
     // Initialize camera position
     mCameraPosition[0] = 0.0f;
     mCameraPosition[1] = 100.0f;
     mCameraPosition[2] = 200.0f;
+    mHiZSize[0] = 0.0f;
+    mHiZSize[1] = 0.0f;
     
     // Initialize camera target
     mCameraTarget[0] = 0.0f;
     mCameraTarget[1] = 0.0f;
     mCameraTarget[2] = 0.0f;
     
-    // Initialize camera up vector
-    mCameraUp[0] = 0.0f;
-    mCameraUp[1] = 1.0f;
-    mCameraUp[2] = 0.0f;
-    
     // Initialize light position
     mLightPosition[0] = 500.0f;
     mLightPosition[1] = 1000.0f;
@@ -81,6 +314,31 @@ Renderer3D_Metal::Renderer3D_Metal()
     mAmbientLight[0] = 0.3f;
     mAmbientLight[1] = 0.3f;
     mAmbientLight[2] = 0.3f;
+    
+    // Straight down until the terrain gives the light a direction
+    mShadowLightDirection[0] = 0.0f;
+    mShadowLightDirection[1] = 1.0f;
+    mShadowLightDirection[2] = 0.0f;
+    std::fill(mTerrainShadowLight, mTerrainShadowLight + 3, 0.0f);
+    
+    mJitter[0] = mJitter[1] = 0.0f;
+    mRateMapFocus[0] = mRateMapFocus[1] = 0.5f;
+    mRateMapZone[0] = mRateMapZone[1] = -1;
+    std::memset(&mMotionUniforms, 0, sizeof(mMotionUniforms));
+    std::memset(&mFragmentUniforms, 0, sizeof(mFragmentUniforms));
+    
+    std::fill(mTerrainLevelError, mTerrainLevelError + kMaxTerrainLevels, 0.0f);
+    std::fill(mScenePipelineStates, mScenePipelineStates + kShaderVariantCount, nullptr);
+    std::fill(mTerrainMapPipelineStates, mTerrainMapPipelineStates + kShaderVariantCount, nullptr);
+    std::fill(mTerrainMeshPipelineStates, mTerrainMeshPipelineStates + kShaderVariantCount, nullptr);
+    std::fill(mTerrainTablePipelineStates, mTerrainTablePipelineStates + kShaderVariantCount, nullptr);
+    std::fill(mTerrainChunkPipelineStates, mTerrainChunkPipelineStates + kShaderVariantCount, nullptr);
+    std::fill(mParticleEmitCarry, mParticleEmitCarry + 3, 0.0f);
+    std::fill(mParticleOriginShift, mParticleOriginShift + 3, 0.0f);
+    std::fill(mGBufferTextures, mGBufferTextures + kGBufferCount, nullptr);
+    for (PipelineBuild& build : mPipelineBuilds) {
+        build = PipelineBuild();
+    }
 }
 
 Renderer3D_Metal::~Renderer3D_Metal() {
@@ -88,13 +346,20 @@ Renderer3D_Metal::~Renderer3D_Metal() {
 }
 
 bool Renderer3D_Metal::Initialize(int width, int height, const std::string& title) {
+    mInitializeStartNs = Profiler::Now();
+    
+    // Spike captures dump the samples leading up to the spike
+    if (mSpikeCaptureMs > 0.0f) {
+        Profiler::SetRecentHistory(true);
+    }
+    
     // Store dimensions
     mWidth = width;
     mHeight = height;
     
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
+        LOG_ERROR("SDL initialization failed: %s", SDL_GetError());
         return false;
     }
     
@@ -105,50 +370,67 @@ bool Renderer3D_Metal::Initialize(int width, int height, const std::string& titl
         SDL_WINDOWPOS_CENTERED,
         mWidth,
         mHeight,
-        SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI
+        SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE
     );
     
     if (!mWindow) {
-        std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Window creation failed: %s", SDL_GetError());
         return false;
     }
     
     // Initialize Metal
     if (!InitializeMetal()) {
-        std::cerr << "Metal initialization failed!" << std::endl;
+        LOG_ERROR("Metal initialization failed!");
         return false;
     }
     
     // Load shaders
     if (!LoadShaders()) {
-        std::cerr << "Shader loading failed!" << std::endl;
+        LOG_ERROR("Shader loading failed!");
         return false;
     }
     
-    // Create render pipeline
-    if (!CreateRenderPipeline()) {
-        std::cerr << "Render pipeline creation failed!" << std::endl;
+    // Every pipeline goes through the archive
+    OpenPipelineArchive();
+    
+    // Start the pipeline builds; they finish while the game sets up
+    if (!mLibraryPending && !StartPipelines()) {
         return false;
     }
     
     // Create geometry buffers
     if (!CreateGeometryBuffers()) {
-        std::cerr << "Geometry buffer creation failed!" << std::endl;
+        LOG_ERROR("Geometry buffer creation failed!");
+        return false;
+    }
+    
+    // Create the render pass descriptor shared by all frames
+    if (!CreateRenderPassDescriptor()) {
+        LOG_ERROR("Render pass descriptor creation failed!");
         return false;
     }
     
-    // Set up projection matrix
+    // GPU pass timing is optional; without it the profiler shows CPU stages only
+    if (!CreateGpuTimestampBuffer()) {
+        LOG_INFO("GPU timestamps unavailable, GPU passes will not be profiled");
+    }
+    
+    // Set up projection matrix, until SetCamera()
     float aspectRatio = (float)mWidth / (float)mHeight;
-    mProjectionMatrix = CreateProjectionMatrix(45.0f * (M_PI / 180.0f), aspectRatio, 0.1f, 1000.0f);
+    mProjectionMatrix = SimdMath::Perspective(kCameraFieldOfView, aspectRatio, kCameraNear, kCameraFar);
+    mUnjitteredProjection = mProjectionMatrix;
     
-    // Set up initial view matrix
-    mViewMatrix = CreateViewMatrix();
+    // Set up initial view matrix, until SetCamera()
+    const float up[3] = { 0.0f, 1.0f, 0.0f };
+    mViewMatrix = SimdMath::LookAt(mCameraPosition, mCameraTarget, up);
+    Camera::ExtractFrustumPlanes(mUnjitteredProjection, mViewMatrix, mFrustumPlanes);
+    mViewDirty = false;
     
     // Initialize uniform structs
     UpdateCameraUniforms();
     
     mInitialized = true;
-    std::cout << "Metal renderer initialized" << std::endl;
+    LOG_INFO("Metal renderer initialized");
     return true;
 }
 
@@ -156,22 +438,96 @@ bool Renderer3D_Metal::InitializeMetal() {
     // Create Metal device
     mDevice = MTL::CreateSystemDefaultDevice();
     if (!mDevice) {
-        std::cerr << "Failed to create Metal device" << std::endl;
+        LOG_ERROR("Failed to create Metal device");
         return false;
     }
     
+    // Buffers and textures are sub-allocated from heaps
+    mHeapAllocator.Initialize(mDevice);
+    
     // Create command queue
     mCommandQueue = mDevice->newCommandQueue();
     if (!mCommandQueue) {
-        std::cerr << "Failed to create command queue" << std::endl;
+        LOG_ERROR("Failed to create command queue");
         return false;
     }
     
+    // The heaps stay resident for every command buffer of the queue
+    if (mHeapAllocator.AttachResidencySet(mCommandQueue)) {
+        LOG_INFO("Heap allocator: heaps kept resident through a residency set");
+    }
+    
+    // Terrain files read straight into GPU memory where MTLIO exists
+    if (DeviceSupportsIOCommandQueues(mDevice)) {
+        MTL::IOCommandQueueDescriptor* ioDescriptor = MTL::IOCommandQueueDescriptor::alloc()->init();
+        ioDescriptor->setType(MTL::IOCommandQueueTypeConcurrent);
+        ioDescriptor->setPriority(MTL::IOPriorityHigh);
+        NS::Error* ioError = nullptr;
+        mIOCommandQueue = mDevice->newIOCommandQueue(ioDescriptor, &ioError);
+        ioDescriptor->release();
+        mTerrainIOEvent = mIOCommandQueue ? mDevice->newSharedEvent() : nullptr;
+        if (!mTerrainIOEvent) {
+            LOG_WARNING("Failed to create IO command queue (%s), terrain files staged through the CPU",
+                        ioError ? ioError->localizedDescription()->utf8String() : "unknown error");
+            if (mIOCommandQueue) { mIOCommandQueue->release(); mIOCommandQueue = nullptr; }
+        }
+    }
+    
+    if (mUseTemporalUpscaling && !mUseDynamicResolution) {
+        LOG_WARNING("Temporal upscaling needs dynamic resolution, temporal upscaling disabled");
+        mUseTemporalUpscaling = false;
+    }
+    if (mUseTemporalUpscaling && !MTLFX::TemporalScalerDescriptor::supportsDevice(mDevice)) {
+        LOG_WARNING("MetalFX temporal scaling unsupported on %s, using spatial scaling",
+                    mDevice->name()->utf8String());
+        mUseTemporalUpscaling = false;
+    }
+    if (mUseDynamicResolution && !MTLFX::SpatialScalerDescriptor::supportsDevice(mDevice)) {
+        LOG_WARNING("MetalFX spatial scaling unsupported on %s, rendering at full resolution",
+                    mDevice->name()->utf8String());
+        mUseDynamicResolution = false;
+        mUseTemporalUpscaling = false;
+    }
+    // Variable rasterization shades the full-resolution scene, forward lit,
+    // and its depth is in the rate map's physical pixels, which the Hi-Z
+    // reprojection doesn't know about
+    if (mUseVariableRasterization && (mUseDynamicResolution || mUseDeferredLighting || mUseHiZCulling)) {
+        LOG_WARNING("Variable rasterization gives way to dynamic resolution, deferred lighting and Hi-Z culling, "
+                    "shading at full rate");
+        mUseVariableRasterization = false;
+    }
+    if (mUseVariableRasterization && !mDevice->supportsRasterizationRateMap(1)) {
+        LOG_WARNING("Rasterization rate maps unsupported on %s, shading at full rate",
+                    mDevice->name()->utf8String());
+        mUseVariableRasterization = false;
+    }
+    // Apple GPUs keep attachments in tile memory, so depth that is neither
+    // loaded nor stored needs no memory at all
+    mUseMemorylessDepth = mDevice->supportsFamily(MTL::GPUFamilyApple1);
+    if (mUseDeferredLighting && !mDevice->supportsFamily(MTL::GPUFamilyApple4)) {
+        LOG_WARNING("Tile shaders unsupported on %s, point lights drawn forward",
+                    mDevice->name()->utf8String());
+        mUseDeferredLighting = false;
+    }
+    // Hi-Z tests the chunks the culling kernel draws
+    if (mUseHiZCulling && (!mUseGpuTerrainCulling || mUseTerrainTextures)) {
+        LOG_WARNING("Hi-Z culling needs GPU culled vertex terrain, Hi-Z culling disabled");
+        mUseHiZCulling = false;
+    }
+    // Meshlets are emitted from the height textures
+    if (mUseTerrainMeshShaders && !mUseTerrainTextures) {
+        LOG_WARNING("Terrain mesh shaders need height texture terrain, mesh shaders disabled");
+        mUseTerrainMeshShaders = false;
+    } else if (mUseTerrainMeshShaders && !mDevice->supportsFamily(MTL::GPUFamilyMetal3)) {
+        LOG_WARNING("Mesh shaders unsupported on %s, terrain drawn instanced", mDevice->name()->utf8String());
+        mUseTerrainMeshShaders = false;
+    }
+    
     // Get window info for Metal layer setup
     SDL_SysWMinfo wmInfo;
     SDL_VERSION(&wmInfo.version);
     if (!SDL_GetWindowWMInfo(mWindow, &wmInfo)) {
-        std::cerr << "Failed to get window info: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Failed to get window info: %s", SDL_GetError());
         return false;
     }
     
@@ -182,12 +538,25 @@ bool Renderer3D_Metal::InitializeMetal() {
     // Configure the Metal layer
     mMetalLayer->setDevice(mDevice);
     mMetalLayer->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-    mMetalLayer->setFramebufferOnly(true);
+    // The upscaled scene is copied into the drawable, and a recording
+    // copies out of it, which both need blit access
+    mMetalLayer->setFramebufferOnly(!mUseDynamicResolution && mVideoFile.empty());
+    
+    // Latency against throughput: fewer drawables and no display sync
+    // shorten the wait between rendering and scan-out
+    ConfigureCAMetalLayer(metalLayerPtr, mMaximumDrawableCount, mDisplaySync);
     
     // Set drawable size with high DPI support
     int drawableWidth, drawableHeight;
     SDL_GL_GetDrawableSize(mWindow, &drawableWidth, &drawableHeight);
     mMetalLayer->setDrawableSize(CGSizeMake(drawableWidth, drawableHeight));
+    mDrawableWidth = drawableWidth;
+    mDrawableHeight = drawableHeight;
+    
+    // A recording that can't start leaves the game running without one
+    if (!mVideoFile.empty()) {
+        mVideoRecorder.Start(mDevice, drawableWidth, drawableHeight, mTargetFrameRate, mVideoFile);
+    }
     
    
     // Platform-specific code to attach Metal layer to window
@@ -199,636 +568,6095 @@ bool Renderer3D_Metal::InitializeMetal() {
     SetMetalLayerForSDLWindow(nsWindow, metalLayerPtr);
     #else
     // iOS or other platform - would need different implementation
-    std::cerr << "Unsupported platform" << std::endl;
+    LOG_ERROR("Unsupported platform");
     return false;
     #endif
     
-    // Create uniform buffers
-    mVertexUniformBuffer = mDevice->newBuffer(sizeof(VertexUniforms), 
-                                             MTL::ResourceStorageModeShared);
-    mFragmentUniformBuffer = mDevice->newBuffer(sizeof(FragmentUniforms), 
-                                              MTL::ResourceStorageModeShared);
-    
-    // Create depth texture
-    MTL::TextureDescriptor* depthTextureDesc = MTL::TextureDescriptor::texture2DDescriptor(
-        MTL::PixelFormatDepth32Float,
-        drawableWidth,
-        drawableHeight,
-        false
-    );
-    depthTextureDesc->setStorageMode(MTL::StorageModePrivate);
-    depthTextureDesc->setUsage(MTL::TextureUsageRenderTarget);
-    mDepthTexture = mDevice->newTexture(depthTextureDesc);
+    // Create the uniform ring: one slot per in-flight frame, sub-allocated per draw.
+    // The semaphore keeps the CPU from writing a slot the GPU is still reading.
+    mUniformRingBuffer = mHeapAllocator.NewBuffer(kUniformSlotSize * mFramesInFlight,
+                                                  MetalHeapAllocator::Memory::Shared);
+    if (!mUniformRingBuffer) {
+        LOG_ERROR("Failed to create uniform ring buffer");
+        return false;
+    }
+    mFrameSemaphore = dispatch_semaphore_create(mFramesInFlight);
+    
+    // Terrain row updates are staged in the same per-frame slots
+    mTerrainStagingBuffer = mHeapAllocator.NewBuffer(kTerrainStagingSlotSize * mFramesInFlight,
+                                                     MetalHeapAllocator::Memory::Shared);
+    if (!mTerrainStagingBuffer) {
+        LOG_ERROR("Failed to create terrain staging buffer");
+        return false;
+    }
+    mFrameSlot = 0;
+    mUniformWriteOffset = 0;
+    mLanderInstanceWriteCount = 0;
+    
+    // Dynamic resolution is optional; without the scaler the scene renders
+    // straight into the drawable
+    bool upscalerCreated = mUseDynamicResolution && CreateUpscaler(drawableWidth, drawableHeight);
+    if (mUseDynamicResolution && !upscalerCreated && mUseTemporalUpscaling) {
+        LOG_WARNING("MetalFX temporal scaler creation failed, using spatial scaling");
+        mUseTemporalUpscaling = false;
+        upscalerCreated = CreateUpscaler(drawableWidth, drawableHeight);
+    }
+    if (mUseDynamicResolution && !upscalerCreated) {
+        LOG_WARNING("MetalFX scaler creation failed, rendering at full resolution");
+        mUseDynamicResolution = false;
+        mUseTemporalUpscaling = false;
+    }
+    
+    // Depth and upscaling targets at the drawable size
+    if (!CreateRenderTargets(drawableWidth, drawableHeight)) {
+        LOG_ERROR("Failed to create render targets");
+        return false;
+    }
+    if (mUseHiZCulling &&
+        !CreateHiZPyramid(mUseDynamicResolution ? mSceneTargetWidth : drawableWidth,
+                          mUseDynamicResolution ? mSceneTargetHeight : drawableHeight)) {
+        LOG_WARNING("Failed to create the Hi-Z pyramid, terrain chunks selected on the CPU");
+    }
     
     return true;
 }
 
-void Renderer3D_Metal::SetMetalLayerForWindow(void* nsWindowPtr, CA::MetalLayer* layer) {
-    // We now use the external bridge function directly in InitializeMetal
-    // This method is kept for backwards compatibility but is no longer needed
+void Renderer3D_Metal::SetMaximumDrawableCount(int count) {
+    if (mInitialized) {
+        LOG_WARNING("SetMaximumDrawableCount must be called before Initialize");
+        return;
+    }
+    mMaximumDrawableCount = std::max(2, std::min(3, count));
 }
 
-bool Renderer3D_Metal::LoadShaders() {
-    // In a real application, you would compile the Metal shaders during the build process
-    // For this example, we'll try to load from a pre-compiled metallib file
-    NS::Error* error = nullptr;
+void Renderer3D_Metal::OnWindowResized(int width, int height) {
+    // Rebuilt by the next Clear(), so a drag that resizes many times
+    // between frames only reallocates once
+    mWidth = width;
+    mHeight = height;
+    mDrawableSizeDirty = true;
+}
+
+void Renderer3D_Metal::SetVisible(bool visible) {
+    if (!mWindow) return;
     
-    // First try to load from a bundled metallib file
-    NS::String* path = GetMetalLibraryPath();
-    mShaderLibrary = mDevice->newLibrary(path, &error);
+    if (visible) {
+        SDL_ShowWindow(mWindow);
+        
+        // The history is from before the renderer was hidden
+        mTemporalReset = true;
+    } else {
+        SDL_HideWindow(mWindow);
+    }
+}
+
+bool Renderer3D_Metal::CanStayResidentHidden() const {
+    if (!mDevice) return false;
+    return mDevice->currentAllocatedSize() <= mDevice->recommendedMaxWorkingSetSize() / 2;
+}
+
+// Bytes a texture takes in a heap, padded so anything can follow it
+static size_t HeapTextureBytes(MTL::Device* device, MTL::PixelFormat format, int width, int height,
+                               MTL::TextureUsage usage) {
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(format, width, height, false);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    descriptor->setUsage(usage);
+    MTL::SizeAndAlign sizeAndAlign = device->heapTextureSizeAndAlign(descriptor);
+    return (sizeAndAlign.size + sizeAndAlign.align - 1) & ~(sizeAndAlign.align - 1);
+}
+
+// Render target sub-allocated from a heap (null if it is full)
+static MTL::Texture* NewRenderTarget(MTL::Heap* heap, MTL::PixelFormat format, int width, int height,
+                                     MTL::TextureUsage usage) {
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(format, width, height, false);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    descriptor->setUsage(usage);
+    return heap->newTexture(descriptor);
+}
+
+// Render target that lives only in tile memory, for attachments that are
+// neither loaded nor stored (null if it can't be created)
+static MTL::Texture* NewMemorylessTarget(MTL::Device* device, MTL::PixelFormat format, int width, int height) {
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(format, width, height, false);
+    descriptor->setStorageMode(MTL::StorageModeMemoryless);
+    descriptor->setUsage(MTL::TextureUsageRenderTarget);
+    return device->newTexture(descriptor);
+}
+
+#ifndef NDEBUG
+// One attachment's load and store actions against what the frame does with
+// it: a load is wasted unless its earlier contents are drawn over, a store
+// unless later work reads it, and memoryless textures can do neither.
+// Returns the number of problems logged.
+static int CheckAttachmentActions(MTL::RenderPassAttachmentDescriptor* attachment, const char* passName,
+                                  const char* attachmentName, bool readLater, bool preserved,
+                                  bool memorylessSupported) {
+    MTL::Texture* texture = attachment->texture();
+    if (!texture) return 0;
+    const bool memoryless = texture->storageMode() == MTL::StorageModeMemoryless;
+    const bool loads = attachment->loadAction() == MTL::LoadActionLoad;
+    const bool stores = attachment->storeAction() == MTL::StoreActionStore ||
+                        attachment->storeAction() == MTL::StoreActionStoreAndMultisampleResolve;
+    int problems = 0;
+    if (memoryless && (loads || stores)) {
+        LOG_ERROR("%s pass %s: memoryless texture is %s", passName, attachmentName, loads ? "loaded" : "stored");
+        problems++;
+    }
+    if (loads && !preserved) {
+        LOG_WARNING("%s pass %s: loads contents it draws over, clear or don't care instead", passName, attachmentName);
+        problems++;
+    }
+    if (!loads && preserved) {
+        LOG_ERROR("%s pass %s: discards the contents it should draw over", passName, attachmentName);
+        problems++;
+    }
+    if (stores && !readLater) {
+        LOG_WARNING("%s pass %s: stores contents nothing reads, don't care instead", passName, attachmentName);
+        problems++;
+    }
+    if (!stores && readLater) {
+        LOG_ERROR("%s pass %s: discards contents read after the pass", passName, attachmentName);
+        problems++;
+    }
+    if (!memoryless && !loads && !stores && memorylessSupported && texture->storageMode() == MTL::StorageModePrivate) {
+        LOG_WARNING("%s pass %s: neither loaded nor stored, could be memoryless", passName, attachmentName);
+        problems++;
+    }
+    return problems;
+}
+#endif
+
+void Renderer3D_Metal::CheckPassActions(MTL::RenderPassDescriptor* descriptor, PassCheck pass,
+                                        uint32_t readLater, uint32_t preserved) {
+#ifndef NDEBUG
+    // Once per pass while the targets stay the same
+    if (mCheckedPasses & (1u << pass)) return;
+    mCheckedPasses |= 1u << pass;
+    
+    static const char* const kPassNames[] = { "Scene", "Overlay", "Shadow" };
+    static const char* const kColorNames[] = { "color 0", "color 1", "color 2", "color 3",
+                                               "color 4", "color 5", "color 6", "color 7" };
+    int problems = 0;
+    for (int i = 0; i < 8; i++) {
+        problems += CheckAttachmentActions(descriptor->colorAttachments()->object(i), kPassNames[pass], kColorNames[i],
+                                           (readLater >> i) & 1, (preserved >> i) & 1, mUseMemorylessDepth);
+    }
+    problems += CheckAttachmentActions(descriptor->depthAttachment(), kPassNames[pass], "depth",
+                                       (readLater & kPassDepth) != 0, (preserved & kPassDepth) != 0,
+                                       mUseMemorylessDepth);
+    if (problems == 0) {
+        LOG_DEBUG("%s pass load and store actions checked", kPassNames[pass]);
+    }
+#endif
+}
+
+// Dynamic resolution scene targets and what their scaler needs of each
+enum SceneTarget {
+    kSceneTargetColor,
+    kSceneTargetDepth,
+    kSceneTargetMotion
+};
+
+static MTL::TextureUsage SceneTargetUsage(MTLFX::SpatialScaler* spatialScaler, MTLFX::TemporalScaler* temporalScaler,
+                                          SceneTarget target) {
+    MTL::TextureUsage usage = MTL::TextureUsageRenderTarget;
+    if (temporalScaler) {
+        usage |= target == kSceneTargetColor ? temporalScaler->colorTextureUsage() :
+                 target == kSceneTargetDepth ? temporalScaler->depthTextureUsage() :
+                                               temporalScaler->motionTextureUsage();
+    } else if (spatialScaler && target == kSceneTargetColor) {
+        usage |= spatialScaler->colorTextureUsage();
+    }
+    return usage;
+}
+
+bool Renderer3D_Metal::CreateRenderTargets(int drawableWidth, int drawableHeight) {
+    // Without dynamic resolution the heap holds the depth target. With it,
+    // the upscaler output is permanent and the rest is transient: the scene
+    // targets are allocated every frame and made aliasable once upscaled,
+    // and the overlay pass's depth target takes their place. The heap is
+    // hazard tracked as a whole, which orders work on aliased memory.
+    // Depth nothing reads after its pass is memoryless where the GPU
+    // allows it, outside the heap: only the temporal scaler and the Hi-Z
+    // reduction read depth.
+    const bool memorylessSceneDepth = mUseMemorylessDepth && !mTemporalScaler && !mUseHiZCulling;
+    const bool memorylessDepth = mUseMemorylessDepth && !mUseHiZCulling;
+    const MTL::TextureUsage depthReadUsage = mUseHiZCulling ? MTL::TextureUsageShaderRead : 0;
+    size_t heapBytes = 0;
+    if (mUseDynamicResolution) {
+        MTL::TextureUsage outputUsage = mTemporalScaler ? mTemporalScaler->outputTextureUsage() :
+                                                          mSpatialScaler->outputTextureUsage();
+        size_t sceneBytes =
+            HeapTextureBytes(mDevice, MTL::PixelFormatBGRA8Unorm, mSceneTargetWidth, mSceneTargetHeight,
+                             SceneTargetUsage(mSpatialScaler, mTemporalScaler, kSceneTargetColor));
+        if (!memorylessSceneDepth) {
+            sceneBytes += HeapTextureBytes(mDevice, MTL::PixelFormatDepth32Float, mSceneTargetWidth, mSceneTargetHeight,
+                                           SceneTargetUsage(mSpatialScaler, mTemporalScaler, kSceneTargetDepth) |
+                                           depthReadUsage);
+        }
+        if (mTemporalScaler) {
+            sceneBytes += HeapTextureBytes(mDevice, MTL::PixelFormatRG16Float, mSceneTargetWidth, mSceneTargetHeight,
+                                           SceneTargetUsage(mSpatialScaler, mTemporalScaler, kSceneTargetMotion));
+        }
+        size_t overlayDepthBytes = mUseMemorylessDepth ? 0 :
+            HeapTextureBytes(mDevice, MTL::PixelFormatDepth32Float, drawableWidth, drawableHeight,
+                             MTL::TextureUsageRenderTarget);
+        heapBytes = HeapTextureBytes(mDevice, MTL::PixelFormatBGRA8Unorm, drawableWidth, drawableHeight, outputUsage) +
+                    std::max(sceneBytes, overlayDepthBytes);
+    } else if (!memorylessDepth) {
+        heapBytes = HeapTextureBytes(mDevice, MTL::PixelFormatDepth32Float, drawableWidth, drawableHeight,
+                                     MTL::TextureUsageRenderTarget | depthReadUsage);
+    }
+    // A rate map's physical size never exceeds its screen size, so one
+    // drawable-sized target holds the scene wherever the map is centered
+    if (mUseVariableRasterization) {
+        heapBytes += HeapTextureBytes(mDevice, MTL::PixelFormatBGRA8Unorm, drawableWidth, drawableHeight,
+                                      MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+    }
     
-    if (!mShaderLibrary) {
-        // If that fails, try to compile from source string
-        // For simplicity, let's include a basic shader in the C++ code
-        const char* shaderSource = R"(
-            #include <metal_stdlib>
-            using namespace metal;
-            
-            struct VertexIn {
-                float3 position [[attribute(0)]];
-                float3 normal [[attribute(1)]];
-            };
-            
-            struct VertexOut {
-                float4 position [[position]];
-                float3 fragmentPosition;
-                float3 normal;
-            };
-            
-            struct VertexUniforms {
-                float4x4 modelMatrix;
-                float4x4 viewMatrix;
-                float4x4 projectionMatrix;
-            };
-            
-            struct FragmentUniforms {
-                float3 lightPosition;
-                float3 ambientLight;
-                float3 cameraPosition;
-            };
-            
-            vertex VertexOut vertex_main(const VertexIn vertices [[stage_in]],
-                                       constant VertexUniforms& uniforms [[buffer(1)]]) {
-                VertexOut out;
-                
-                float4 worldPosition = uniforms.modelMatrix * float4(vertices.position, 1.0);
-                out.fragmentPosition = worldPosition.xyz;
-                out.position = uniforms.projectionMatrix * uniforms.viewMatrix * worldPosition;
-                
-                float3x3 normalMatrix = float3x3(uniforms.modelMatrix[0].xyz,
-                                               uniforms.modelMatrix[1].xyz,
-                                               uniforms.modelMatrix[2].xyz);
-                out.normal = normalize(normalMatrix * vertices.normal);
-                
-                return out;
+    // Memoryless depth alone needs no heap
+    if (heapBytes > 0) {
+        MTL::HeapDescriptor* heapDescriptor = MTL::HeapDescriptor::alloc()->init();
+        heapDescriptor->setType(MTL::HeapTypeAutomatic);
+        heapDescriptor->setStorageMode(MTL::StorageModePrivate);
+        heapDescriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+        heapDescriptor->setSize(heapBytes);
+        mRenderTargetHeap = mDevice->newHeap(heapDescriptor);
+        heapDescriptor->release();
+        if (!mRenderTargetHeap) {
+            return false;
+        }
+    }
+    
+    if (mUseDynamicResolution) {
+        MTL::TextureUsage outputUsage = mTemporalScaler ? mTemporalScaler->outputTextureUsage() :
+                                                          mSpatialScaler->outputTextureUsage();
+        mUpscaledTexture = NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatBGRA8Unorm,
+                                           drawableWidth, drawableHeight, outputUsage);
+        if (!mUpscaledTexture) {
+            return false;
+        }
+        
+        // Taken by each frame in place of heap targets
+        if (memorylessSceneDepth) {
+            mMemorylessSceneDepth = NewMemorylessTarget(mDevice, MTL::PixelFormatDepth32Float,
+                                                        mSceneTargetWidth, mSceneTargetHeight);
+            if (!mMemorylessSceneDepth) {
+                return false;
             }
-            
-            fragment float4 fragment_main(VertexOut in [[stage_in]],
-                                        constant FragmentUniforms& uniforms [[buffer(0)]]) {
-                float3 norm = normalize(in.normal);
-                float3 lightDir = normalize(uniforms.lightPosition - in.fragmentPosition);
-                
-                float3 ambient = uniforms.ambientLight;
-                
-                float diff = max(dot(norm, lightDir), 0.0);
-                float3 diffuse = diff * float3(1.0, 1.0, 1.0);
-                
-                float3 objectColor = float3(1.0, 0.0, 0.0);
-                
-                float3 result = (ambient + diffuse) * objectColor;
-                
-                return float4(result, 1.0);
+        }
+        if (mUseMemorylessDepth) {
+            mMemorylessOverlayDepth = NewMemorylessTarget(mDevice, MTL::PixelFormatDepth32Float,
+                                                          drawableWidth, drawableHeight);
+            if (!mMemorylessOverlayDepth) {
+                return false;
             }
-        )";
-        
-        NS::String* source = NS::String::string(shaderSource, NS::UTF8StringEncoding);
-        MTL::CompileOptions* options = MTL::CompileOptions::alloc()->init();
-        mShaderLibrary = mDevice->newLibrary(source, options, &error);
-        options->release();
+        }
+    } else {
+        mDepthTexture = memorylessDepth
+            ? NewMemorylessTarget(mDevice, MTL::PixelFormatDepth32Float, drawableWidth, drawableHeight)
+            : NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatDepth32Float,
+                              drawableWidth, drawableHeight, MTL::TextureUsageRenderTarget | depthReadUsage);
+        if (!mDepthTexture) {
+            return false;
+        }
+        if (mRenderPassDescriptor) {
+            mRenderPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
+        }
+        if (mOverlayPassDescriptor) {
+            mOverlayPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
+        }
     }
     
-    if (!mShaderLibrary) {
-        if (error) {
-            std::cerr << "Failed to load Metal shaders: " 
-                     << error->localizedDescription()->utf8String() << std::endl;
-        } else {
-            std::cerr << "Failed to load Metal shaders: unknown error" << std::endl;
+    // The scene pass draws into it for good; the resolve reads it into the
+    // drawable, and the overlay pass clears the same depth again
+    if (mUseVariableRasterization) {
+        mVariableRateTexture = NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatBGRA8Unorm,
+                                               drawableWidth, drawableHeight,
+                                               MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+        if (!mVariableRateTexture) {
+            return false;
         }
+        if (mRenderPassDescriptor) {
+            mRenderPassDescriptor->colorAttachments()->object(0)->setTexture(mVariableRateTexture);
+        }
+        mRateMapZone[0] = mRateMapZone[1] = -1;
+    }
+    
+    // The G-buffer matches the scene pass's attachments
+    if (mUseDeferredLighting &&
+        !CreateGBuffer(mUseDynamicResolution ? mSceneTargetWidth : drawableWidth,
+                       mUseDynamicResolution ? mSceneTargetHeight : drawableHeight)) {
         return false;
     }
     
+    LOG_INFO("Render targets: %dx%d drawable, %.1f MB heap", drawableWidth, drawableHeight, heapBytes / 1048576.0);
     return true;
 }
 
-bool Renderer3D_Metal::CreateRenderPipeline() {
-    // Create render pipeline state
-    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-    
-    // Get shader functions
-    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
-        NS::String::string("vertex_main", NS::UTF8StringEncoding));
-    MTL::Function* fragmentFunction = mShaderLibrary->newFunction(
-        NS::String::string("fragment_main", NS::UTF8StringEncoding));
-    
-    if (!vertexFunction || !fragmentFunction) {
-        std::cerr << "Failed to find shader functions in library" << std::endl;
+bool Renderer3D_Metal::AllocateSceneTargets() {
+    mSceneColorTexture = NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatBGRA8Unorm,
+                                         mSceneTargetWidth, mSceneTargetHeight,
+                                         SceneTargetUsage(mSpatialScaler, mTemporalScaler, kSceneTargetColor));
+    mSceneDepthTexture = mMemorylessSceneDepth
+        ? mMemorylessSceneDepth->retain()
+        : NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatDepth32Float, mSceneTargetWidth, mSceneTargetHeight,
+                          SceneTargetUsage(mSpatialScaler, mTemporalScaler, kSceneTargetDepth) |
+                          (mUseHiZCulling ? MTL::TextureUsageShaderRead : 0));
+    if (mTemporalScaler) {
+        mSceneMotionTexture = NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatRG16Float,
+                                              mSceneTargetWidth, mSceneTargetHeight,
+                                              SceneTargetUsage(mSpatialScaler, mTemporalScaler, kSceneTargetMotion));
+    }
+    if (!mSceneColorTexture || !mSceneDepthTexture || (mTemporalScaler && !mSceneMotionTexture)) {
+        LOG_ERROR_EVERY(1000, "Render target heap exhausted, frame dropped");
+        ReleaseFrameTargets();
         return false;
     }
     
-    pipelineDescriptor->setVertexFunction(vertexFunction);
-    pipelineDescriptor->setFragmentFunction(fragmentFunction);
-    
-    // Set up color attachment
-    pipelineDescriptor->colorAttachments()->object(0)->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-    pipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
-    
-    // Set up vertex descriptor to match our Vertex struct
-    MTL::VertexDescriptor* vertexDescriptor = MTL::VertexDescriptor::alloc()->init();
-
-    // Position attribute
-    vertexDescriptor->attributes()->object(0)->setFormat(MTL::VertexFormatFloat3);
-    vertexDescriptor->attributes()->object(0)->setOffset(0);
-    vertexDescriptor->attributes()->object(0)->setBufferIndex(0);
-
-    // Normal attribute
-    vertexDescriptor->attributes()->object(1)->setFormat(MTL::VertexFormatFloat3);
-    vertexDescriptor->attributes()->object(1)->setOffset(sizeof(float) * 3);
-    vertexDescriptor->attributes()->object(1)->setBufferIndex(0);
-
-    // isLandingPad attribute
-    vertexDescriptor->attributes()->object(2)->setFormat(MTL::VertexFormatFloat);
-    vertexDescriptor->attributes()->object(2)->setOffset(sizeof(float) * 6);
-    vertexDescriptor->attributes()->object(2)->setBufferIndex(0);
+    mRenderPassDescriptor->colorAttachments()->object(0)->setTexture(mSceneColorTexture);
+    mRenderPassDescriptor->depthAttachment()->setTexture(mSceneDepthTexture);
+    if (mTemporalScaler) {
+        mRenderPassDescriptor->colorAttachments()->object(1)->setTexture(mSceneMotionTexture);
+    }
+    return true;
+}
 
-    // entityType attribute
-    vertexDescriptor->attributes()->object(3)->setFormat(MTL::VertexFormatFloat);
-    vertexDescriptor->attributes()->object(3)->setOffset(sizeof(float) * 7);
-    vertexDescriptor->attributes()->object(3)->setBufferIndex(0);
+void Renderer3D_Metal::ReleaseFrameTargets() {
+    // Encoded passes hold on to their attachments, so the frame's own
+    // references can go as soon as it is submitted
+    if (!mUseDynamicResolution) return;
+    if (mSceneColorTexture) { mSceneColorTexture->release(); mSceneColorTexture = nullptr; }
+    if (mSceneDepthTexture) { mSceneDepthTexture->release(); mSceneDepthTexture = nullptr; }
+    if (mSceneMotionTexture) { mSceneMotionTexture->release(); mSceneMotionTexture = nullptr; }
+    if (mDepthTexture) { mDepthTexture->release(); mDepthTexture = nullptr; }
+    if (mRenderPassDescriptor) {
+        mRenderPassDescriptor->colorAttachments()->object(0)->setTexture(nullptr);
+        mRenderPassDescriptor->colorAttachments()->object(1)->setTexture(nullptr);
+        mRenderPassDescriptor->depthAttachment()->setTexture(nullptr);
+    }
+    if (mOverlayPassDescriptor) {
+        mOverlayPassDescriptor->depthAttachment()->setTexture(nullptr);
+    }
+}
 
-    // Set layout
-    vertexDescriptor->layouts()->object(0)->setStride(sizeof(Vertex));
-    
-    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
-    
-    // Create render pipeline state
-    NS::Error* error = nullptr;
-    mRenderPipelineState = mDevice->newRenderPipelineState(pipelineDescriptor, &error);
-    
-    // Clean up
-    vertexDescriptor->release();
-    pipelineDescriptor->release();
-    vertexFunction->release();
-    fragmentFunction->release();
-    
-    if (!mRenderPipelineState) {
-        if (error) {
-            std::cerr << "Failed to create render pipeline state: " 
-                     << error->localizedDescription()->utf8String() << std::endl;
-        } else {
-            std::cerr << "Failed to create render pipeline state: unknown error" << std::endl;
+void Renderer3D_Metal::UpdateDrawableSize() {
+    int drawableWidth, drawableHeight;
+    SDL_GL_GetDrawableSize(mWindow, &drawableWidth, &drawableHeight);
+    if (drawableWidth <= 0 || drawableHeight <= 0) return;   // Minimized
+    
+    // The projection follows the window's aspect through the camera
+    if (drawableWidth == mDrawableWidth && drawableHeight == mDrawableHeight) return;
+    
+    // Build the new size's scaler and targets before dropping the old ones,
+    // so a failure keeps rendering at the old size. Frames in flight still
+    // use the old objects; they are released once those complete.
+    MTLFX::SpatialScaler* oldSpatialScaler = mSpatialScaler;
+    MTLFX::TemporalScaler* oldTemporalScaler = mTemporalScaler;
+    MTL::Heap* oldHeap = mRenderTargetHeap;
+    MTL::Texture* oldDepthTexture = mDepthTexture;
+    MTL::Texture* oldUpscaledTexture = mUpscaledTexture;
+    MTL::Texture* oldMemorylessSceneDepth = mMemorylessSceneDepth;
+    MTL::Texture* oldMemorylessOverlayDepth = mMemorylessOverlayDepth;
+    MTL::Texture* oldVariableRateTexture = mVariableRateTexture;
+    int oldSceneTargetWidth = mSceneTargetWidth;
+    int oldSceneTargetHeight = mSceneTargetHeight;
+    mSpatialScaler = nullptr;
+    mTemporalScaler = nullptr;
+    mRenderTargetHeap = nullptr;
+    mDepthTexture = nullptr;
+    mUpscaledTexture = nullptr;
+    mMemorylessSceneDepth = nullptr;
+    mMemorylessOverlayDepth = nullptr;
+    mVariableRateTexture = nullptr;
+    
+    bool created = (!mUseDynamicResolution || CreateUpscaler(drawableWidth, drawableHeight)) &&
+                   CreateRenderTargets(drawableWidth, drawableHeight);
+    if (!created) {
+        LOG_ERROR("Failed to resize render targets to %dx%d, keeping %dx%d",
+                  drawableWidth, drawableHeight, mDrawableWidth, mDrawableHeight);
+        if (mSpatialScaler) mSpatialScaler->release();
+        if (mTemporalScaler) mTemporalScaler->release();
+        if (mRenderTargetHeap) mRenderTargetHeap->release();
+        if (mDepthTexture) mDepthTexture->release();
+        if (mUpscaledTexture) mUpscaledTexture->release();
+        if (mMemorylessSceneDepth) mMemorylessSceneDepth->release();
+        if (mMemorylessOverlayDepth) mMemorylessOverlayDepth->release();
+        if (mVariableRateTexture) mVariableRateTexture->release();
+        mSpatialScaler = oldSpatialScaler;
+        mTemporalScaler = oldTemporalScaler;
+        mRenderTargetHeap = oldHeap;
+        mDepthTexture = oldDepthTexture;
+        mUpscaledTexture = oldUpscaledTexture;
+        mMemorylessSceneDepth = oldMemorylessSceneDepth;
+        mMemorylessOverlayDepth = oldMemorylessOverlayDepth;
+        mVariableRateTexture = oldVariableRateTexture;
+        mSceneTargetWidth = oldSceneTargetWidth;
+        mSceneTargetHeight = oldSceneTargetHeight;
+        if (!mUseDynamicResolution) {
+            mRenderPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
         }
-        return false;
+        if (mUseVariableRasterization) {
+            mRenderPassDescriptor->colorAttachments()->object(0)->setTexture(mVariableRateTexture);
+            mOverlayPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
+        }
+        return;
     }
+    ReleaseAfterFrame(oldSpatialScaler);
+    ReleaseAfterFrame(oldTemporalScaler);
+    ReleaseAfterFrame(oldDepthTexture);
+    ReleaseAfterFrame(oldUpscaledTexture);
+    ReleaseAfterFrame(oldMemorylessSceneDepth);
+    ReleaseAfterFrame(oldMemorylessOverlayDepth);
+    ReleaseAfterFrame(oldVariableRateTexture);
+    ReleaseAfterFrame(oldHeap);
     
-    // Create depth stencil state
-    MTL::DepthStencilDescriptor* depthDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
-    depthDescriptor->setDepthCompareFunction(MTL::CompareFunctionLess);
-    depthDescriptor->setDepthWriteEnabled(true);
-    
-    mDepthStencilState = mDevice->newDepthStencilState(depthDescriptor);
-    depthDescriptor->release();
+    mMetalLayer->setDrawableSize(CGSizeMake(drawableWidth, drawableHeight));
+    mDrawableWidth = drawableWidth;
+    mDrawableHeight = drawableHeight;
+    mSceneWidth = std::max(1, static_cast<int>(mDrawableWidth * mRenderScale));
+    mSceneHeight = std::max(1, static_cast<int>(mDrawableHeight * mRenderScale));
+    mTemporalReset = true;
+    mCheckedPasses = 0;
+    if (mUseHiZCulling && !CreateHiZPyramid(mUseDynamicResolution ? mSceneTargetWidth : drawableWidth,
+                                            mUseDynamicResolution ? mSceneTargetHeight : drawableHeight)) {
+        LOG_WARNING("Failed to resize the Hi-Z pyramid, terrain chunks selected on the CPU");
+    }
+    LOG_INFO("Drawable resized to %dx%d", drawableWidth, drawableHeight);
+}
+
+bool Renderer3D_Metal::CreateUpscaler(int drawableWidth, int drawableHeight) {
+    // Scene targets are allocated at the largest scale; each frame renders
+    // and upscales only the part the controller picked
+    mSceneTargetWidth = std::max(1, static_cast<int>(drawableWidth * kMaxRenderScale));
+    mSceneTargetHeight = std::max(1, static_cast<int>(drawableHeight * kMaxRenderScale));
+    mMinRenderScale = kMinRenderScale;
+    mMaxRenderScale = kMaxRenderScale;
+    
+    if (mUseTemporalUpscaling) {
+        if (!CreateTemporalScaler(mSceneTargetWidth, mSceneTargetHeight, drawableWidth, drawableHeight)) {
+            return false;
+        }
+    } else {
+        MTLFX::SpatialScalerDescriptor* scalerDescriptor = MTLFX::SpatialScalerDescriptor::alloc()->init();
+        scalerDescriptor->setColorTextureFormat(MTL::PixelFormatBGRA8Unorm);
+        scalerDescriptor->setOutputTextureFormat(MTL::PixelFormatBGRA8Unorm);
+        scalerDescriptor->setInputWidth(mSceneTargetWidth);
+        scalerDescriptor->setInputHeight(mSceneTargetHeight);
+        scalerDescriptor->setOutputWidth(drawableWidth);
+        scalerDescriptor->setOutputHeight(drawableHeight);
+        scalerDescriptor->setColorProcessingMode(MTLFX::SpatialScalerColorProcessingModePerceptual);
+        mSpatialScaler = scalerDescriptor->newSpatialScaler(mDevice);
+        scalerDescriptor->release();
+        if (!mSpatialScaler) {
+            return false;
+        }
+    }
     
+    mRenderScale = std::max(mMinRenderScale, std::min(mMaxRenderScale, mRenderScale));
+    mSceneWidth = std::max(1, static_cast<int>(drawableWidth * mRenderScale));
+    mSceneHeight = std::max(1, static_cast<int>(drawableHeight * mRenderScale));
+    mTemporalReset = true;
+    LOG_INFO("Dynamic resolution: %dx%d drawable, %s scene scale %.2f-%.2f, target %.0f Hz",
+             drawableWidth, drawableHeight, mTemporalScaler ? "temporal" : "spatial",
+             mMinRenderScale, mMaxRenderScale, mTargetFrameRate);
     return true;
 }
 
-bool Renderer3D_Metal::CreateGeometryBuffers() {
-    // Create a simple cube model for the lander
-    CreateCubeModel();
+bool Renderer3D_Metal::CreateTemporalScaler(int inputWidth, int inputHeight, int outputWidth, int outputHeight) {
+    // MetalFX expresses scales as output over input size, the inverse of
+    // the render scale; keep the controller within what the device supports
+    float minUpscale = std::max(1.0f / kMaxRenderScale,
+                                MTLFX::TemporalScalerDescriptor::supportedInputContentMinScale(mDevice));
+    float maxUpscale = std::min(1.0f / kMinRenderScale,
+                                MTLFX::TemporalScalerDescriptor::supportedInputContentMaxScale(mDevice));
+    if (maxUpscale < minUpscale) {
+        return false;
+    }
     
-    // Terrain buffers will be created dynamically when rendering
+    MTLFX::TemporalScalerDescriptor* scalerDescriptor = MTLFX::TemporalScalerDescriptor::alloc()->init();
+    scalerDescriptor->setColorTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    scalerDescriptor->setDepthTextureFormat(MTL::PixelFormatDepth32Float);
+    scalerDescriptor->setMotionTextureFormat(MTL::PixelFormatRG16Float);
+    scalerDescriptor->setOutputTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    scalerDescriptor->setInputWidth(inputWidth);
+    scalerDescriptor->setInputHeight(inputHeight);
+    scalerDescriptor->setOutputWidth(outputWidth);
+    scalerDescriptor->setOutputHeight(outputHeight);
+    scalerDescriptor->setInputContentPropertiesEnabled(true);
+    scalerDescriptor->setInputContentMinScale(minUpscale);
+    scalerDescriptor->setInputContentMaxScale(maxUpscale);
+    mTemporalScaler = scalerDescriptor->newTemporalScaler(mDevice);
+    scalerDescriptor->release();
+    if (!mTemporalScaler) {
+        return false;
+    }
     
+    mMinRenderScale = 1.0f / maxUpscale;
+    mMaxRenderScale = 1.0f / minUpscale;
     return true;
 }
 
-void Renderer3D_Metal::CreateCubeModel() {
-    
-    // Cube vertices (position + normal + isLandingPad + entityType)
+void Renderer3D_Metal::SetTargetFrameRate(float hz) {
+    mTargetFrameRate = std::max(1.0f, hz);
+}
+
+void Renderer3D_Metal::UpdateRenderScale() {
+    // Only frames that completed since the last update carry new information
+    double gpuTime = mGpuFrameTime.exchange(0.0);
+    if (gpuTime <= 0.0) return;
+    
+    // GPU time follows the pixel count, i.e. the square of the scale, so the
+    // scale that would just fit the budget is sqrt(budget / time) times this
+    // one. Move part of the way there so a single slow frame does not swing it.
+    double budget = kRenderScaleHeadroom / mTargetFrameRate;
+    float idealScale = mRenderScale * static_cast<float>(std::sqrt(budget / gpuTime));
+    mRenderScale += kRenderScaleGain * (idealScale - mRenderScale);
+    mRenderScale = std::max(mMinRenderScale, std::min(mMaxRenderScale, mRenderScale));
+    
+    mSceneWidth = std::max(1, static_cast<int>(mDrawableWidth * mRenderScale));
+    mSceneHeight = std::max(1, static_cast<int>(mDrawableHeight * mRenderScale));
+    LOG_DEBUG_EVERY(1000, "Render scale %.2f (%dx%d), GPU frame %.2f ms of %.2f ms",
+                    mRenderScale, mSceneWidth, mSceneHeight, gpuTime * 1000.0, 1000.0 / mTargetFrameRate);
+}
+
+// Radical inverse of index in the given base, in [0, 1)
+static float Halton(int index, int base) {
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    while (index > 0) {
+        result += fraction * (index % base);
+        index /= base;
+        fraction /= base;
+    }
+    return result;
+}
+
+void Renderer3D_Metal::UpdateJitter() {
+    // Cycle through well-spread sub-pixel offsets so successive frames
+    // sample different points of each scene pixel (index 0 of the sequence
+    // is skipped: it is the pixel corner in both bases)
+    mJitterIndex = (mJitterIndex + 1) % kJitterPhaseCount;
+    mJitter[0] = Halton(mJitterIndex + 1, 2) - 0.5f;
+    mJitter[1] = Halton(mJitterIndex + 1, 3) - 0.5f;
+    
+    // Pixels to NDC; y points up in NDC and down in pixels. Clip w is -z,
+    // so subtracting the offset from the z column shifts every projected
+    // point by the same amount after the divide.
+    mProjectionMatrix = mUnjitteredProjection;
+    mProjectionMatrix.values[8] -= 2.0f * mJitter[0] / mSceneWidth;
+    mProjectionMatrix.values[9] += 2.0f * mJitter[1] / mSceneHeight;
+    mViewDirty = true;
+    
+    // Motion vectors exclude the jitter: both frames use the unjittered
+    // projection. After a reset there is no previous frame to move from.
+    Matrix4x4 viewProjection = SimdMath::Multiply(mUnjitteredProjection, mViewMatrix);
+    if (mTemporalReset) {
+        std::memcpy(mMotionUniforms.previousViewProjection, viewProjection.values, sizeof(viewProjection.values));
+        mHasPreviousLanderModel = false;
+    } else {
+        std::memcpy(mMotionUniforms.previousViewProjection, mMotionUniforms.viewProjection,
+                    sizeof(mMotionUniforms.viewProjection));
+    }
+    std::memcpy(mMotionUniforms.viewProjection, viewProjection.values, sizeof(viewProjection.values));
+    Matrix4x4 identity = SimdMath::Identity();
+    std::memcpy(mMotionUniforms.previousFromCurrent, identity.values, sizeof(identity.values));
+}
+
+// Render and mesh pipeline descriptors share the attachment setters
+template <typename Descriptor>
+static void SetScenePassAttachments(Descriptor* descriptor, bool writesMotion, bool writesGBuffer) {
+    descriptor->colorAttachments()->object(0)->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    if (writesMotion) {
+        descriptor->colorAttachments()->object(1)->setPixelFormat(MTL::PixelFormatRG16Float);
+    }
+    if (writesGBuffer) {
+        for (int i = 0; i < kGBufferCount; i++) {
+            descriptor->colorAttachments()->object(kGBufferFirstAttachment + i)->setPixelFormat(kGBufferFormats[i]);
+        }
+    }
+    descriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+}
+
+void Renderer3D_Metal::SetScenePassFormats(MTL::RenderPipelineDescriptor* descriptor) const {
+    SetScenePassAttachments(descriptor, mTemporalScaler != nullptr, mUseDeferredLighting);
+}
+
+void Renderer3D_Metal::SetScenePassFormats(MTL::MeshRenderPipelineDescriptor* descriptor) const {
+    SetScenePassAttachments(descriptor, mTemporalScaler != nullptr, mUseDeferredLighting);
+}
+
+void Renderer3D_Metal::FinishScenePass() {
+    PROFILE_ZONE("Metal Finish Scene");
+    if (!mScenePassOpen) return;
+    mScenePassOpen = false;
+    
+    EndRenderEncoder();
+    if (mUseVariableRasterization) {
+        ResolveVariableRate();
+        return;
+    }
+    
+    // Upscale the rendered region to the full drawable size. Motion
+    // vectors are in texture coordinates, so their scale is the region's
+    // size in pixels.
+    if (mTemporalScaler) {
+        mTemporalScaler->setInputContentWidth(mSceneWidth);
+        mTemporalScaler->setInputContentHeight(mSceneHeight);
+        mTemporalScaler->setColorTexture(mSceneColorTexture);
+        mTemporalScaler->setDepthTexture(mSceneDepthTexture);
+        mTemporalScaler->setMotionTexture(mSceneMotionTexture);
+        mTemporalScaler->setOutputTexture(mUpscaledTexture);
+        mTemporalScaler->setJitterOffsetX(mJitter[0]);
+        mTemporalScaler->setJitterOffsetY(mJitter[1]);
+        mTemporalScaler->setMotionVectorScaleX(static_cast<float>(mSceneWidth));
+        mTemporalScaler->setMotionVectorScaleY(static_cast<float>(mSceneHeight));
+        mTemporalScaler->setReset(mTemporalReset);
+        mTemporalScaler->encodeToCommandBuffer(mCommandBuffer);
+        mTemporalReset = false;
+    } else {
+        mSpatialScaler->setInputContentWidth(mSceneWidth);
+        mSpatialScaler->setInputContentHeight(mSceneHeight);
+        mSpatialScaler->setColorTexture(mSceneColorTexture);
+        mSpatialScaler->setOutputTexture(mUpscaledTexture);
+        mSpatialScaler->encodeToCommandBuffer(mCommandBuffer);
+    }
+    BuildHiZPyramid(mSceneDepthTexture, mSceneWidth, mSceneHeight);
+    
+    // The scene targets are dead once upscaled; the overlay's depth target
+    // reuses their heap memory unless it is memoryless
+    mSceneColorTexture->makeAliasable();
+    if (!mMemorylessSceneDepth) {
+        mSceneDepthTexture->makeAliasable();
+    }
+    if (mSceneMotionTexture) {
+        mSceneMotionTexture->makeAliasable();
+    }
+    mDepthTexture = mMemorylessOverlayDepth
+        ? mMemorylessOverlayDepth->retain()
+        : NewRenderTarget(mRenderTargetHeap, MTL::PixelFormatDepth32Float,
+                          mDrawableWidth, mDrawableHeight, MTL::TextureUsageRenderTarget);
+    mOverlayPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
+    
+    // The scaler's output usage may not match the drawable's, so it writes
+    // its own texture and a blit moves the result over
+    MTL::Texture* drawableTexture = mDrawable->texture();
+    MTL::BlitCommandEncoder* blit = mCommandBuffer->blitCommandEncoder();
+    blit->copyFromTexture(mUpscaledTexture, 0, 0, MTL::Origin(0, 0, 0),
+                          MTL::Size(mDrawableWidth, mDrawableHeight, 1),
+                          drawableTexture, 0, 0, MTL::Origin(0, 0, 0));
+    blit->endEncoding();
+    
+    // Everything drawn from here on lands on the drawable at full resolution
+    mOverlayPassDescriptor->colorAttachments()->object(0)->setTexture(drawableTexture);
+    CheckPassActions(mOverlayPassDescriptor, kPassCheckOverlay, kPassColor0, kPassColor0);
+    mRenderEncoder = mCommandBuffer->renderCommandEncoder(mOverlayPassDescriptor);
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
+}
+
+void Renderer3D_Metal::UpdateRateMap() {
+    // Full rate in the focus zone and its neighbours, then half and a
+    // quarter. The rates are separable, so zones level with the lander keep
+    // full rate along its row and column.
+    int zone[2] = {
+        std::clamp(static_cast<int>(mRateMapFocus[0] * kRateMapZonesX), 0, kRateMapZonesX - 1),
+        std::clamp(static_cast<int>(mRateMapFocus[1] * kRateMapZonesY), 0, kRateMapZonesY - 1)
+    };
+    if (mRateMap && zone[0] == mRateMapZone[0] && zone[1] == mRateMapZone[1]) return;
+    
+    float horizontal[kRateMapZonesX];
+    float vertical[kRateMapZonesY];
+    for (int i = 0; i < kRateMapZonesX; i++) {
+        horizontal[i] = RateMapQuality(std::abs(i - zone[0]));
+    }
+    for (int i = 0; i < kRateMapZonesY; i++) {
+        vertical[i] = RateMapQuality(std::abs(i - zone[1]));
+    }
+    MTL::RasterizationRateLayerDescriptor* layer = MTL::RasterizationRateLayerDescriptor::alloc()->init(
+        MTL::Size(kRateMapZonesX, kRateMapZonesY, 0), horizontal, vertical);
+    MTL::RasterizationRateMapDescriptor* descriptor = MTL::RasterizationRateMapDescriptor::
+        rasterizationRateMapDescriptor(MTL::Size(mDrawableWidth, mDrawableHeight, 0), layer);
+    MTL::RasterizationRateMap* map = mDevice->newRasterizationRateMap(descriptor);
+    layer->release();
+    if (!map) {
+        LOG_WARNING_EVERY(1000, "Failed to create a rasterization rate map, keeping the last one");
+        return;
+    }
+    
+    // The resolve decodes the map from its parameter data
+    MTL::SizeAndAlign parameterSize = map->parameterBufferSizeAndAlign();
+    MTL::Buffer* parameters = mDevice->newBuffer(parameterSize.size, MTL::ResourceStorageModeShared);
+    if (!parameters) {
+        map->release();
+        LOG_WARNING_EVERY(1000, "Failed to create rate map parameters, keeping the last map");
+        return;
+    }
+    map->copyParameterDataToBuffer(parameters, 0);
+    
+    // Frames in flight still rasterize and resolve with the old map
+    ReleaseAfterFrame(mRateMap);
+    ReleaseAfterFrame(mRateMapParameters);
+    mRateMap = map;
+    mRateMapParameters = parameters;
+    mRateMapZone[0] = zone[0];
+    mRateMapZone[1] = zone[1];
+    mRenderPassDescriptor->setRasterizationRateMap(mRateMap);
+    
+    MTL::Size physical = mRateMap->physicalSize(0);
+    LOG_DEBUG("Rate map centered on zone %d,%d: %lux%lu physical pixels for %dx%d", zone[0], zone[1],
+              static_cast<unsigned long>(physical.width), static_cast<unsigned long>(physical.height),
+              mDrawableWidth, mDrawableHeight);
+}
+
+void Renderer3D_Metal::ResolveVariableRate() {
+    // Everything drawn from here on lands on the drawable at full rate
+    MTL::Texture* drawableTexture = mDrawable->texture();
+    mOverlayPassDescriptor->colorAttachments()->object(0)->setTexture(drawableTexture);
+    CheckPassActions(mOverlayPassDescriptor, kPassCheckOverlay, kPassColor0, 0);
+    mRenderEncoder = mCommandBuffer->renderCommandEncoder(mOverlayPassDescriptor);
+    
+    // Each drawable pixel reads where the rate map put it in the scene
+    // target. The encoder's default depth state neither tests nor writes.
+    if (mVariableRateResolvePipelineState && mRateMapParameters) {
+        mRenderEncoder->setRenderPipelineState(mVariableRateResolvePipelineState);
+        mRenderEncoder->setFragmentTexture(mVariableRateTexture, 0);
+        mRenderEncoder->setFragmentBuffer(mRateMapParameters, 0, 0);
+        mRenderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
+    }
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
+}
+
+void Renderer3D_Metal::BindSceneState(MTL::RenderCommandEncoder* encoder) const {
+    // The scene covers only the scaled corner of the offscreen target
+    if (mUseDynamicResolution) {
+        encoder->setViewport(MTL::Viewport{0.0, 0.0, static_cast<double>(mSceneWidth),
+                                           static_cast<double>(mSceneHeight), 0.0, 1.0});
+        encoder->setScissorRect(MTL::ScissorRect{0, 0, static_cast<NS::UInteger>(mSceneWidth),
+                                                 static_cast<NS::UInteger>(mSceneHeight)});
+    }
+    // Rate-mapped viewports are in screen pixels; the map takes them to the
+    // physical corner of the target
+    if (mUseVariableRasterization) {
+        encoder->setViewport(MTL::Viewport{0.0, 0.0, static_cast<double>(mDrawableWidth),
+                                           static_cast<double>(mDrawableHeight), 0.0, 1.0});
+    }
+    
+    encoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    encoder->setDepthStencilState(mDepthStencilState);
+    if (mUseShadows) {
+        encoder->setFragmentTexture(mTerrainShadowMap, 0);
+        encoder->setFragmentTexture(mLanderShadowMap, 1);
+    }
+    if (mUseRayTracedShadows) {
+        encoder->setFragmentAccelerationStructure(mTerrainRayTracer.GetAccelerationStructure(), 3);
+    }
+    if (mUseHorizonShadows) {
+        encoder->setFragmentTexture(mTerrainHorizonTexture, 2);
+    }
+    for (int i = 0; i < kSceneFragmentBuffers; i++) {
+        if (mSceneFragmentBufferMask & (1u << i)) {
+            encoder->setFragmentBuffer(mUniformRingBuffer, mSceneFragmentBufferOffsets[i], NS::UInteger(i));
+        }
+    }
+}
+
+void Renderer3D_Metal::EndRenderEncoder() {
+    mRenderEncoder->endEncoding();
+    mRenderEncoder = nullptr;
+    if (mParallelEncoder) {
+        mParallelEncoder->endEncoding();
+        mParallelEncoder = nullptr;
+    }
+}
+
+void Renderer3D_Metal::SetFramesInFlight(int count) {
+    if (mInitialized) {
+        LOG_WARNING("SetFramesInFlight must be called before Initialize");
+        return;
+    }
+    mFramesInFlight = std::max(1, std::min(kMaxFramesInFlight, count));
+}
+
+void Renderer3D_Metal::WaitForFramesInFlight() {
+    if (!mFrameSemaphore) return;
+    
+    // Acquire every slot, which only succeeds once all submitted frames completed
+    for (int i = 0; i < mFramesInFlight; i++) {
+        dispatch_semaphore_wait(mFrameSemaphore, DISPATCH_TIME_FOREVER);
+    }
+    for (int i = 0; i < mFramesInFlight; i++) {
+        dispatch_semaphore_signal(mFrameSemaphore);
+    }
+}
+
+void Renderer3D_Metal::ReleaseAfterFrame(NS::Object* object) {
+    if (!object) return;
+    
+    // Command buffers complete in queue order, so the frame being recorded
+    // finishes after every earlier one that could still use the object.
+    // Between frames the next one's command buffer takes it.
+    if (!mCommandBuffer) {
+        mPendingReleases.push_back(object);
+        return;
+    }
+    mCommandBuffer->addCompletedHandler([object](MTL::CommandBuffer*) {
+        object->release();
+    });
+}
+
+bool Renderer3D_Metal::AllocateUniforms(const void* data, size_t size, size_t& offset) {
+    // Align each sub-allocation so it can be bound directly as a buffer offset
+    size_t alignedOffset = (mUniformWriteOffset + kUniformAlignment - 1) & ~(kUniformAlignment - 1);
+    if (alignedOffset + size > kUniformSlotSize) {
+        LOG_ERROR_EVERY(1000, "Uniform ring slot exhausted (%zu bytes)", kUniformSlotSize);
+        return false;
+    }
+    
+    offset = mFrameSlot * kUniformSlotSize + alignedOffset;
+    memcpy(static_cast<char*>(mUniformRingBuffer->contents()) + offset, data, size);
+    mUniformWriteOffset = alignedOffset + size;
+    return true;
+}
+
+bool Renderer3D_Metal::AllocateFragmentUniforms(size_t& offset) {
+    if (!AllocateUniforms(&mFragmentUniforms, sizeof(FragmentUniforms), offset)) {
+        return false;
+    }
+    mFragmentUniformOffsets.push_back(offset);
+    return true;
+}
+
+void Renderer3D_Metal::RefreshFragmentUniforms() {
+    // The GPU reads this slot only once the frame is committed
+    char* ring = static_cast<char*>(mUniformRingBuffer->contents());
+    for (size_t offset : mFragmentUniformOffsets) {
+        memcpy(ring + offset, &mFragmentUniforms, sizeof(FragmentUniforms));
+    }
+}
+
+bool Renderer3D_Metal::CreateGpuTimestampBuffer() {
+#if !ENABLE_PROFILER
+    return false;
+#else
+    // Timestamps at stage boundaries need the common timestamp counter set
+    if (!mDevice->supportsCounterSampling(MTL::CounterSamplingPointAtStageBoundary)) {
+        return false;
+    }
+    
+    MTL::CounterSet* timestampSet = nullptr;
+    NS::Array* counterSets = mDevice->counterSets();
+    for (NS::UInteger i = 0; counterSets && i < counterSets->count(); i++) {
+        MTL::CounterSet* counterSet = counterSets->object<MTL::CounterSet>(i);
+        if (counterSet->name()->isEqualToString(MTL::CommonCounterSetTimestamp)) {
+            timestampSet = counterSet;
+            break;
+        }
+    }
+    if (!timestampSet) {
+        return false;
+    }
+    
+    // A start/end pair per timed pass, per ring slot, so a frame's samples are
+    // not overwritten before its completion handler has resolved them
+    MTL::CounterSampleBufferDescriptor* descriptor = MTL::CounterSampleBufferDescriptor::alloc()->init();
+    descriptor->setCounterSet(timestampSet);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+    descriptor->setSampleCount(kMaxFramesInFlight * kMaxGpuPasses * 2);
+    
+    NS::Error* error = nullptr;
+    mGpuTimestampBuffer = mDevice->newCounterSampleBuffer(descriptor, &error);
+    descriptor->release();
+    if (!mGpuTimestampBuffer) {
+        if (error) {
+            LOG_WARNING("Failed to create GPU timestamp buffer: %s",
+                        error->localizedDescription()->utf8String());
+        }
+        return false;
+    }
+    
+    // CPU/GPU reference pair for converting GPU ticks to profiler time
+    mDevice->sampleTimestamps(&mCalibrationCpuTime, &mCalibrationGpuTime);
+    return true;
+#endif
+}
+
+void Renderer3D_Metal::AttachGpuTimestamps(MTL::RenderPassDescriptor* descriptor, const char* passName) {
+    MTL::RenderPassSampleBufferAttachmentDescriptor* attachment =
+        descriptor->sampleBufferAttachments()->object(0);
+    
+    if (!mGpuTimestampBuffer || mGpuPassCount == kMaxGpuPasses) {
+        attachment->setSampleBuffer(nullptr);
+        return;
+    }
+    
+    // Sample when the pass's vertex work starts and its fragment work ends
+    NS::UInteger base = static_cast<NS::UInteger>((mFrameSlot * kMaxGpuPasses + mGpuPassCount) * 2);
+    attachment->setSampleBuffer(mGpuTimestampBuffer);
+    attachment->setStartOfVertexSampleIndex(base);
+    attachment->setEndOfVertexSampleIndex(MTL::CounterDontSample);
+    attachment->setStartOfFragmentSampleIndex(MTL::CounterDontSample);
+    attachment->setEndOfFragmentSampleIndex(base + 1);
+    
+    mGpuPassNames[mGpuPassCount++] = passName;
+}
+
+void Renderer3D_Metal::ResolveGpuTimestamps(int frameSlot, int passCount, const char* const* passNames) {
+#if ENABLE_PROFILER
+    if (!mGpuTimestampBuffer || passCount == 0) return;
+    
+    // Runs on a Metal callback thread; give its samples their own trace row
+    static thread_local bool threadNamed = false;
+    if (!threadNamed) {
+        Profiler::SetThreadName("GPU");
+        threadNamed = true;
+    }
+    
+    // Resample the clocks so GPU ticks can be mapped onto the profiler's
+    // timeline relative to "now". The CPU clock is mach_absolute_time.
+    MTL::Timestamp cpuNow = 0;
+    MTL::Timestamp gpuNow = 0;
+    mDevice->sampleTimestamps(&cpuNow, &gpuNow);
+    uint64_t profilerNow = Profiler::Now();
+    if (gpuNow <= mCalibrationGpuTime || cpuNow <= mCalibrationCpuTime) return;
+    
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double gpuTickToNs = static_cast<double>(cpuNow - mCalibrationCpuTime) /
+                         static_cast<double>(gpuNow - mCalibrationGpuTime) *
+                         timebase.numer / timebase.denom;
+    
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    
+    NS::UInteger base = static_cast<NS::UInteger>(frameSlot * kMaxGpuPasses * 2);
+    NS::Data* data = mGpuTimestampBuffer->resolveCounterRange(NS::Range(base, passCount * 2));
+    if (data && data->length() >= passCount * 2 * sizeof(MTL::CounterResultTimestamp)) {
+        const MTL::CounterResultTimestamp* results =
+            static_cast<const MTL::CounterResultTimestamp*>(data->mutableBytes());
+        
+        for (int pass = 0; pass < passCount; pass++) {
+            uint64_t start = results[pass * 2].timestamp;
+            uint64_t end = results[pass * 2 + 1].timestamp;
+            if (start == MTL::CounterErrorValue || end == MTL::CounterErrorValue ||
+                end < start || end > gpuNow) {
+                continue;
+            }
+            
+            uint64_t startAgoNs = static_cast<uint64_t>((gpuNow - start) * gpuTickToNs);
+            uint64_t endAgoNs = static_cast<uint64_t>((gpuNow - end) * gpuTickToNs);
+            if (startAgoNs > profilerNow) continue;
+            Profiler::Record(passNames[pass], profilerNow - startAgoNs, profilerNow - endAgoNs);
+        }
+    }
+    
+    pool->release();
+#endif
+}
+
+void Renderer3D_Metal::SetMetalLayerForWindow(void* nsWindowPtr, CA::MetalLayer* layer) {
+    // We now use the external bridge function directly in InitializeMetal
+    // This method is kept for backwards compatibility but is no longer needed
+}
+
+bool Renderer3D_Metal::LoadShaders() {
+    // In a real application, you would compile the Metal shaders during the build process
+    // For this example, we'll try to load from a pre-compiled metallib file
+    NS::Error* error = nullptr;
+    
+    // First try to load from a bundled metallib file
+    NS::String* path = GetMetalLibraryPath();
+    mShaderLibrary = mDevice->newLibrary(path, &error);
+    
+    if (!mShaderLibrary) {
+        // If that fails, try to compile from source string
+        // For simplicity, let's include a basic shader in the C++ code
+        const char* shaderSource = R"(
+            #include <metal_stdlib>
+            using namespace metal;
+            
+            struct VertexIn {
+                float4 position [[attribute(0)]];
+                float2 octNormal [[attribute(1)]];
+                uint flags [[attribute(2)]];
+            };
+            
+            struct VertexOut {
+                float4 position [[position]];
+                float3 fragmentPosition;
+                float3 normal;
+            };
+            
+            struct VertexUniforms {
+                float4x4 modelMatrix;
+                float4x4 viewMatrix;
+                float4x4 projectionMatrix;
+                float4 positionOrigin;
+                float4 positionExtent;
+                float4 lodMorph;
+                float4 cameraPosition;
+            };
+            
+            float3 decodeOctahedral(float2 e) {
+                float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+                float t = saturate(-n.z);
+                n.x += n.x >= 0.0 ? -t : t;
+                n.y += n.y >= 0.0 ? -t : t;
+                return normalize(n);
+            }
+            
+            struct FragmentUniforms {
+                float3 lightPosition;
+                float3 ambientLight;
+                float3 cameraPosition;
+            };
+            
+            vertex VertexOut vertex_main(const VertexIn vertices [[stage_in]],
+                                       constant VertexUniforms& uniforms [[buffer(1)]]) {
+                VertexOut out;
+                
+                float3 position = uniforms.positionOrigin.xyz + vertices.position.xyz * uniforms.positionExtent.xyz;
+                float4 worldPosition = uniforms.modelMatrix * float4(position, 1.0);
+                float morphY = uniforms.positionOrigin.y + vertices.position.w * uniforms.positionExtent.y;
+                float morph = saturate((distance(worldPosition.xyz, uniforms.cameraPosition.xyz) - uniforms.lodMorph.x) *
+                                       uniforms.lodMorph.y);
+                position.y = mix(position.y, morphY, morph);
+                worldPosition = uniforms.modelMatrix * float4(position, 1.0);
+                out.fragmentPosition = worldPosition.xyz;
+                out.position = uniforms.projectionMatrix * uniforms.viewMatrix * worldPosition;
+                
+                float3x3 normalMatrix = float3x3(uniforms.modelMatrix[0].xyz,
+                                               uniforms.modelMatrix[1].xyz,
+                                               uniforms.modelMatrix[2].xyz);
+                out.normal = normalize(normalMatrix * decodeOctahedral(vertices.octNormal));
+                
+                return out;
+            }
+            
+            fragment float4 fragment_main(VertexOut in [[stage_in]],
+                                        constant FragmentUniforms& uniforms [[buffer(0)]]) {
+                float3 norm = normalize(in.normal);
+                float3 lightDir = normalize(uniforms.lightPosition - in.fragmentPosition);
+                
+                float3 ambient = uniforms.ambientLight;
+                
+                float diff = max(dot(norm, lightDir), 0.0);
+                float3 diffuse = diff * float3(1.0, 1.0, 1.0);
+                
+                float3 objectColor = float3(1.0, 0.0, 0.0);
+                
+                float3 result = (ambient + diffuse) * objectColor;
+                
+                return float4(result, 1.0);
+            }
+            
+            struct OverlayVertex {
+                packed_float2 position;
+                packed_float4 color;
+                packed_float2 texCoord;
+            };
+            
+            struct OverlayOut {
+                float4 position [[position]];
+                float4 color;
+                float2 texCoord;
+            };
+            
+            vertex OverlayOut overlay_vertex(uint vertexId [[vertex_id]],
+                                             const device OverlayVertex* vertices [[buffer(0)]],
+                                             constant float2& viewportSize [[buffer(1)]]) {
+                OverlayOut out;
+                float2 ndc = float2(vertices[vertexId].position) / viewportSize * 2.0 - 1.0;
+                out.position = float4(ndc.x, -ndc.y, 0.0, 1.0);
+                out.color = float4(vertices[vertexId].color);
+                out.texCoord = float2(vertices[vertexId].texCoord);
+                return out;
+            }
+            
+            fragment float4 overlay_fragment(OverlayOut in [[stage_in]],
+                                             texture2d<float, access::read> atlas [[texture(0)]]) {
+                float coverage = atlas.read(uint2(in.texCoord)).r;
+                return float4(in.color.rgb, in.color.a * coverage);
+            }
+        )";
+        
+        // Compiled in the background; StartPipelines() runs once it is done
+        NS::String* source = NS::String::string(shaderSource, NS::UTF8StringEncoding);
+        MTL::CompileOptions* options = MTL::CompileOptions::alloc()->init();
+        mLibraryPending = true;
+        mDevice->newLibrary(source, options, [this](MTL::Library* library, NS::Error* compileError) {
+            if (!library) {
+                LOG_ERROR("Failed to load Metal shaders: %s",
+                          compileError ? compileError->localizedDescription()->utf8String() : "unknown error");
+            }
+            std::lock_guard<std::mutex> lock(mPipelineMutex);
+            mShaderLibrary = library ? library->retain() : nullptr;
+            mLibraryPending = false;
+            mPipelineCondition.notify_all();
+        });
+        options->release();
+        return true;
+    }
+    
+    if (!mShaderLibrary) {
+        if (error) {
+            LOG_ERROR("Failed to load Metal shaders: %s", error->localizedDescription()->utf8String());
+        } else {
+            LOG_ERROR("Failed to load Metal shaders: unknown error");
+        }
+        return false;
+    }
+    
+    return true;
+}
+
+void Renderer3D_Metal::OpenPipelineArchive() {
+    if (mPipelineArchiveFile.empty()) return;
+    
+    MTL::BinaryArchiveDescriptor* descriptor = MTL::BinaryArchiveDescriptor::alloc()->init();
+    NS::Error* error = nullptr;
+    
+    // An archive written by another OS or GPU driver fails to open, or
+    // simply misses; either way the pipelines are compiled and re-added
+    if (FILE* existing = std::fopen(mPipelineArchiveFile.c_str(), "rb")) {
+        std::fclose(existing);
+        descriptor->setUrl(NS::URL::fileURLWithPath(
+            NS::String::string(mPipelineArchiveFile.c_str(), NS::UTF8StringEncoding)));
+        mPipelineArchive = mDevice->newBinaryArchive(descriptor, &error);
+        if (!mPipelineArchive) {
+            LOG_WARNING("Ignoring pipeline archive %s: %s", mPipelineArchiveFile.c_str(),
+                        error ? error->localizedDescription()->utf8String() : "unknown error");
+            descriptor->setUrl(nullptr);
+        }
+    }
+    if (!mPipelineArchive) {
+        error = nullptr;
+        mPipelineArchive = mDevice->newBinaryArchive(descriptor, &error);
+    }
+    descriptor->release();
+    
+    if (!mPipelineArchive) {
+        LOG_WARNING("Pipeline archives unavailable, shaders will be compiled every launch");
+    }
+    mPipelineArchiveHits = 0;
+    mPipelineArchiveMisses = 0;
+}
+
+void Renderer3D_Metal::SavePipelineArchive() {
+    if (!mPipelineArchive) return;
+    
+    if (mPipelineArchiveMisses > 0) {
+        NS::Error* error = nullptr;
+        NS::URL* url = NS::URL::fileURLWithPath(
+            NS::String::string(mPipelineArchiveFile.c_str(), NS::UTF8StringEncoding));
+        if (!mPipelineArchive->serializeToURL(url, &error)) {
+            LOG_WARNING("Failed to write pipeline archive %s: %s", mPipelineArchiveFile.c_str(),
+                        error ? error->localizedDescription()->utf8String() : "unknown error");
+            return;
+        }
+    }
+    LOG_INFO("Pipeline archive %s: %d pipelines loaded, %d compiled", mPipelineArchiveFile.c_str(),
+             mPipelineArchiveHits, mPipelineArchiveMisses);
+}
+
+void Renderer3D_Metal::UpdateSpikeCapture() {
+    const uint64_t now = Profiler::Now();
+    const double intervalMs = mSpikeFrameStartNs ? (now - mSpikeFrameStartNs) / 1.0e6 : 0.0;
+    mSpikeFrameStartNs = now;
+    
+    // Startup frames wait on pipelines and uploads, and captures slow down
+    // the frames around them, so neither counts
+    if (!mFirstFramePresented || mSpikeFramesLeft > 0 || mSpikeCaptureCount >= kMaxSpikeCaptures) return;
+    if (mSpikeCooldown > 0) {
+        mSpikeCooldown--;
+        return;
+    }
+    const double frameMs = std::max(intervalMs, mLastGpuFrameTime.load(std::memory_order_relaxed) * 1000.0);
+    if (frameMs > mSpikeCaptureMs) {
+        StartSpikeCapture(frameMs);
+    }
+}
+
+void Renderer3D_Metal::StartSpikeCapture(double frameMs) {
+    mSpikeCaptureCount++;
+    char name[64];
+    std::snprintf(name, sizeof(name), "spike-%lld-%d", static_cast<long long>(std::time(nullptr)), mSpikeCaptureCount);
+    mSpikeCaptureName = mSpikeCaptureDirectory.empty() ? name : mSpikeCaptureDirectory + "/" + name;
+    mSpikeFramesLeft = mSpikeCaptureFrames;
+    
+    // Everything submitted to the frame queue, from this frame on
+    MTL::CaptureManager* manager = MTL::CaptureManager::sharedCaptureManager();
+    if (!manager->supportsDestination(MTL::CaptureDestinationGPUTraceDocument)) {
+        LOG_WARNING("GPU trace capture unavailable (run with MTL_CAPTURE_ENABLED=1); "
+                    "spike captures get the CPU trace only");
+    } else if (!manager->isCapturing()) {
+        const std::string path = mSpikeCaptureName + ".gputrace";
+        MTL::CaptureDescriptor* descriptor = MTL::CaptureDescriptor::alloc()->init();
+        descriptor->setCaptureObject(reinterpret_cast<id>(mCommandQueue));
+        descriptor->setDestination(MTL::CaptureDestinationGPUTraceDocument);
+        descriptor->setOutputURL(NS::URL::fileURLWithPath(NS::String::string(path.c_str(), NS::UTF8StringEncoding)));
+        NS::Error* error = nullptr;
+        mGpuCaptureActive = manager->startCapture(descriptor, &error);
+        if (!mGpuCaptureActive) {
+            LOG_WARNING("Failed to start GPU capture %s: %s", path.c_str(),
+                        error ? error->localizedDescription()->utf8String() : "unknown error");
+        }
+        descriptor->release();
+    }
+    LOG_WARNING("%.1f ms frame (threshold %.1f ms), capturing the next %d frames to %s", frameMs,
+                mSpikeCaptureMs, mSpikeCaptureFrames, mSpikeCaptureName.c_str());
+}
+
+void Renderer3D_Metal::FinishSpikeCapture() {
+    if (mGpuCaptureActive) {
+        MTL::CaptureManager::sharedCaptureManager()->stopCapture();
+        mGpuCaptureActive = false;
+        LOG_INFO("Wrote GPU capture %s.gputrace", mSpikeCaptureName.c_str());
+    }
+    Profiler::WriteRecentTrace(mSpikeCaptureName + ".json");
+    mSpikeCooldown = kSpikeCaptureCooldown;
+}
+
+bool Renderer3D_Metal::StartPipelines() {
+    mPipelinesStarted = true;
+    if (!mShaderLibrary) {
+        return false;
+    }
+    
+    // Deferred lighting and shadows first: whether they are in use
+    // specializes fragment_main and the scene pass formats
+    if (mUseDeferredLighting && !CreateDeferredLightingPipelines()) {
+        LOG_WARNING("Deferred lighting shaders unavailable, point lights drawn forward");
+        mUseDeferredLighting = false;
+        ReleaseGBuffer();
+    }
+    if (mUseVariableRasterization && !CreateVariableRatePipeline()) {
+        LOG_WARNING("Variable rate resolve shader unavailable, the scene will not be drawn");
+    }
+    if (mUseShadows && !CreateShadowPipelines()) {
+        LOG_WARNING("Shadow maps unavailable, shadows disabled");
+        mUseShadows = false;
+    }
+    
+    // Terrain ray queries whenever the GPU ray traces; ray-traced shadows
+    // also need the queries in fragment functions
+    if (mDevice->supportsRaytracing()) {
+        mTerrainRayTracer.Initialize(mDevice, mCommandQueue, mShaderLibrary);
+    }
+    if (mUseRayTracedShadows && (!mUseShadows || !mTerrainRayTracer.IsInitialized() ||
+                                 !mDevice->supportsRaytracingFromRender())) {
+        LOG_WARNING("Ray-traced shadows unavailable, terrain shadowed by its shadow map");
+        mUseRayTracedShadows = false;
+    }
+    if (mUseHorizonShadows && (!mUseShadows || mUseRayTracedShadows)) {
+        LOG_INFO(mUseShadows ? "Ray-traced shadows in use, horizon map not sampled"
+                             : "Horizon shadows need shadows, disabled");
+        mUseHorizonShadows = false;
+    }
+    
+    // Create render pipeline
+    if (!CreateRenderPipeline()) {
+        LOG_ERROR("Render pipeline creation failed!");
+        ReleaseShaderVariants();
+        return false;
+    }
+    
+    // The overlay is optional; the scene still renders without it
+    if (!CreateOverlayPipeline()) {
+        LOG_WARNING("Overlay pipeline unavailable, telemetry and profiler overlays disabled");
+    }
+    
+    // So are lander batches
+    if (!CreateLanderInstancePipeline()) {
+        LOG_WARNING("Lander instancing shader unavailable, lander batches will not be drawn");
+    }
+    
+    if (mUseTerrainTextures && !CreateTerrainMapPipeline()) {
+        LOG_WARNING("Height texture terrain shader unavailable, drawing terrain from vertices");
+        mUseTerrainTextures = false;
+        mUseTerrainMeshShaders = false;
+    }
+    if (mUseTerrainMeshShaders && !CreateTerrainMeshPipelines()) {
+        LOG_WARNING("Terrain meshlet shaders unavailable, terrain drawn instanced");
+        mUseTerrainMeshShaders = false;
+    }
+    
+    // The near field displaces from the height texture
+    if (mUseTerrainTessellation && !mUseTerrainTextures) {
+        LOG_WARNING("Terrain tessellation needs height texture terrain, tessellation disabled");
+        mUseTerrainTessellation = false;
+    } else if (mUseTerrainTessellation && !CreateTerrainTessellationPipelines()) {
+        LOG_WARNING("Terrain tessellation shaders unavailable, near field drawn untessellated");
+        mUseTerrainTessellation = false;
+    }
+    
+    // Without the chunk table, each terrain chunk draw binds its own uniforms
+    if (!mUseTerrainTextures && !CreateTerrainTablePipelines()) {
+        LOG_INFO("Terrain chunk table shader unavailable, chunk uniforms bound per draw");
+    }
+    
+    // GPU culling encodes draws of packed terrain vertices. The kernel is
+    // built with or without the Hi-Z test, so the reduction kernels come first.
+    if (mUseHiZCulling && !CreateHiZPipelines()) {
+        LOG_WARNING("Hi-Z reduction kernels unavailable, terrain chunks culled without occlusion");
+        mUseHiZCulling = false;
+    }
+    if (mUseGpuTerrainCulling && mUseTerrainTextures) {
+        LOG_INFO("GPU terrain culling draws terrain vertices, height texture terrain is culled on the CPU");
+        mUseGpuTerrainCulling = false;
+    } else if (mUseGpuTerrainCulling && !CreateTerrainCullPipelines()) {
+        LOG_WARNING("Terrain culling kernel unavailable, terrain chunks selected on the CPU");
+        mUseGpuTerrainCulling = false;
+    }
+    
+    // Without the terrain kernels, terrain is generated on the CPU
+    if (!CreateTerrainComputePipelines()) {
+        LOG_INFO("Terrain compute kernels unavailable, terrain will be generated on the CPU");
+    }
+    
+    if (!CreateParticlePipelines()) {
+        LOG_WARNING("Particle shaders unavailable, exhaust and dust will not be drawn");
+    }
+    
+    if (!CreateSkyPipeline()) {
+        LOG_WARNING("Sky shaders unavailable, the sky will be black");
+    }
+    
+    // The pipeline descriptors hold on to the functions they use
+    ReleaseShaderVariants();
+    return true;
+}
+
+MTL::Function* Renderer3D_Metal::GetShaderVariant(const char* name, ShaderVariant variant, bool indirect) {
+    for (const ShaderFunctionVariant& cached : mShaderVariants) {
+        if (cached.variant == variant && cached.indirect == indirect && cached.name == name) {
+            return cached.function;
+        }
+    }
+    
+    // Indices match the function_constant declarations in LanderShaders.metal;
+    // functions that don't declare a constant ignore it. Motion vectors
+    // are written by every variant when the temporal scaler is in use.
+    bool isLander = variant == kShaderVariantLander;
+    bool hasLandingPad = variant == kShaderVariantLandingPad;
+    bool writesMotion = mTemporalScaler != nullptr;
+    bool receivesShadows = !indirect && mUseShadows;
+    bool pointLights = !indirect && !mUseDeferredLighting;
+    bool writesGBuffer = mUseDeferredLighting;
+    bool occlusionCulling = mUseHiZCulling;
+    bool rayTracedShadows = receivesShadows && mUseRayTracedShadows;
+    bool horizonShadows = receivesShadows && mUseHorizonShadows;
+    MTL::FunctionConstantValues* constants = MTL::FunctionConstantValues::alloc()->init();
+    constants->setConstantValue(&isLander, MTL::DataTypeBool, NS::UInteger(0));
+    constants->setConstantValue(&hasLandingPad, MTL::DataTypeBool, NS::UInteger(1));
+    constants->setConstantValue(&writesMotion, MTL::DataTypeBool, NS::UInteger(2));
+    constants->setConstantValue(&receivesShadows, MTL::DataTypeBool, NS::UInteger(3));
+    constants->setConstantValue(&pointLights, MTL::DataTypeBool, NS::UInteger(4));
+    constants->setConstantValue(&writesGBuffer, MTL::DataTypeBool, NS::UInteger(5));
+    constants->setConstantValue(&occlusionCulling, MTL::DataTypeBool, NS::UInteger(6));
+    constants->setConstantValue(&rayTracedShadows, MTL::DataTypeBool, NS::UInteger(7));
+    constants->setConstantValue(&horizonShadows, MTL::DataTypeBool, NS::UInteger(8));
+    
+    // A missing function is not cached, so every variant reports it
+    NS::Error* error = nullptr;
+    MTL::Function* function = mShaderLibrary->newFunction(NS::String::string(name, NS::UTF8StringEncoding),
+                                                          constants, &error);
+    constants->release();
+    if (!function) {
+        LOG_DEBUG("No %s variant %d: %s", name, static_cast<int>(variant),
+                  error ? error->localizedDescription()->utf8String() : "unknown error");
+        return nullptr;
+    }
+    mShaderVariants.push_back({ name, variant, indirect, function });
+    return function;
+}
+
+void Renderer3D_Metal::ReleaseShaderVariants() {
+    for (ShaderFunctionVariant& cached : mShaderVariants) {
+        cached.function->release();
+    }
+    mShaderVariants.clear();
+}
+
+static const char* const kPipelineNames[] = {
+    "render", "landing pad render", "lander render", "lander instances", "overlay", "terrain map", "landing pad terrain map",
+    "terrain mesh", "landing pad terrain mesh", "terrain tessellation",
+    "terrain_tess_factors", "terrain table", "landing pad terrain table", "indirect terrain chunk", "landing pad indirect terrain chunk", "terrain_cull_chunks", "hiz_reduce_depth", "hiz_reduce", "terrain_generate_heights", "terrain_build_vertices",
+    "particle_emit", "particle_update", "particles",
+    "shadow caster", "terrain map shadow caster",
+    "cull_point_lights", "deferred lighting", "variable rate resolve", "sky"
+};
+
+void Renderer3D_Metal::CompileRenderPipeline(PipelineId id, MTL::RenderPipelineDescriptor* descriptor) {
+    // The build works on its own copy, so callers may reuse the descriptor
+    // for the next variant
+    descriptor = descriptor->copy();
+    {
+        std::lock_guard<std::mutex> lock(mPipelineMutex);
+        PipelineBuild& build = mPipelineBuilds[id];
+        build.renderDescriptor = descriptor;
+        build.pending = true;
+        mPipelinesPending++;
+    }
+    
+    if (!mPipelineArchive) {
+        mDevice->newRenderPipelineState(descriptor, [this, id](MTL::RenderPipelineState* state, NS::Error* error) {
+            FinishPipeline(id, state, error, false);
+        });
+        return;
+    }
+    
+    // Look the pipeline up in the archive only, so a hit never compiles; a
+    // miss compiles as usual and is added to the archive
+    descriptor->setBinaryArchives(NS::Array::array(mPipelineArchive));
+    mDevice->newRenderPipelineState(descriptor, MTL::PipelineOptionFailOnBinaryArchiveMiss,
+        [this, id, descriptor](MTL::RenderPipelineState* state, MTL::RenderPipelineReflection*, NS::Error*) {
+            if (state) {
+                FinishPipeline(id, state, nullptr, false);
+                return;
+            }
+            mDevice->newRenderPipelineState(descriptor, [this, id](MTL::RenderPipelineState* compiled, NS::Error* error) {
+                FinishPipeline(id, compiled, error, true);
+            });
+        });
+}
+
+void Renderer3D_Metal::CompileComputePipeline(PipelineId id, MTL::Function* function) {
+    // Archives take pipeline descriptors, not bare functions
+    MTL::ComputePipelineDescriptor* descriptor = MTL::ComputePipelineDescriptor::alloc()->init();
+    descriptor->setComputeFunction(function);
+    {
+        std::lock_guard<std::mutex> lock(mPipelineMutex);
+        PipelineBuild& build = mPipelineBuilds[id];
+        build.computeDescriptor = descriptor;
+        build.pending = true;
+        mPipelinesPending++;
+    }
+    
+    MTL::PipelineOption options = MTL::PipelineOptionNone;
+    if (mPipelineArchive) {
+        descriptor->setBinaryArchives(NS::Array::array(mPipelineArchive));
+        options = MTL::PipelineOptionFailOnBinaryArchiveMiss;
+    }
+    bool archived = mPipelineArchive != nullptr;
+    mDevice->newComputePipelineState(descriptor, options,
+        [this, id, descriptor, archived](MTL::ComputePipelineState* state, MTL::ComputePipelineReflection*,
+                                         NS::Error* error) {
+            if (state || !archived) {
+                FinishPipeline(id, state, error, false);
+                return;
+            }
+            mDevice->newComputePipelineState(descriptor, MTL::PipelineOptionNone,
+                [this, id](MTL::ComputePipelineState* compiled, MTL::ComputePipelineReflection*,
+                           NS::Error* compileError) {
+                    FinishPipeline(id, compiled, compileError, true);
+                });
+        });
+}
+
+void Renderer3D_Metal::CompileTilePipeline(PipelineId id, MTL::TileRenderPipelineDescriptor* descriptor) {
+    descriptor = descriptor->copy();
+    {
+        std::lock_guard<std::mutex> lock(mPipelineMutex);
+        PipelineBuild& build = mPipelineBuilds[id];
+        build.tileDescriptor = descriptor;
+        build.pending = true;
+        mPipelinesPending++;
+    }
+    
+    MTL::PipelineOption options = MTL::PipelineOptionNone;
+    if (mPipelineArchive) {
+        descriptor->setBinaryArchives(NS::Array::array(mPipelineArchive));
+        options = MTL::PipelineOptionFailOnBinaryArchiveMiss;
+    }
+    bool archived = mPipelineArchive != nullptr;
+    mDevice->newRenderPipelineState(descriptor, options,
+        [this, id, descriptor, archived](MTL::RenderPipelineState* state, MTL::RenderPipelineReflection*,
+                                         NS::Error* error) {
+            if (state || !archived) {
+                FinishPipeline(id, state, error, false);
+                return;
+            }
+            mDevice->newRenderPipelineState(descriptor, MTL::PipelineOptionNone,
+                [this, id](MTL::RenderPipelineState* compiled, MTL::RenderPipelineReflection*,
+                           NS::Error* compileError) {
+                    FinishPipeline(id, compiled, compileError, true);
+                });
+        });
+}
+
+void Renderer3D_Metal::CompileMeshPipeline(PipelineId id, MTL::MeshRenderPipelineDescriptor* descriptor) {
+    descriptor = descriptor->copy();
+    {
+        std::lock_guard<std::mutex> lock(mPipelineMutex);
+        PipelineBuild& build = mPipelineBuilds[id];
+        build.meshDescriptor = descriptor;
+        build.pending = true;
+        mPipelinesPending++;
+    }
+    
+    MTL::PipelineOption options = MTL::PipelineOptionNone;
+    if (mPipelineArchive) {
+        descriptor->setBinaryArchives(NS::Array::array(mPipelineArchive));
+        options = MTL::PipelineOptionFailOnBinaryArchiveMiss;
+    }
+    bool archived = mPipelineArchive != nullptr;
+    mDevice->newRenderPipelineState(descriptor, options,
+        [this, id, descriptor, archived](MTL::RenderPipelineState* state, MTL::RenderPipelineReflection*,
+                                         NS::Error* error) {
+            if (state || !archived) {
+                FinishPipeline(id, state, error, false);
+                return;
+            }
+            mDevice->newRenderPipelineState(descriptor, MTL::PipelineOptionNone,
+                [this, id](MTL::RenderPipelineState* compiled, MTL::RenderPipelineReflection*,
+                           NS::Error* compileError) {
+                    FinishPipeline(id, compiled, compileError, true);
+                });
+        });
+}
+
+void Renderer3D_Metal::FinishPipeline(PipelineId id, NS::Object* state, NS::Error* error, bool archiveMiss) {
+    // Runs on a Metal completion thread. The descriptor was set before the
+    // build started and stays until the build is installed.
+    PipelineBuild& build = mPipelineBuilds[id];
+    if (state && archiveMiss) {
+        std::lock_guard<std::mutex> archiveLock(mPipelineArchiveMutex);
+        NS::Error* archiveError = nullptr;
+        bool added = build.renderDescriptor
+            ? mPipelineArchive->addRenderPipelineFunctions(build.renderDescriptor, &archiveError)
+            : build.tileDescriptor
+            ? mPipelineArchive->addTileRenderPipelineFunctions(build.tileDescriptor, &archiveError)
+            : build.meshDescriptor
+            ? mPipelineArchive->addMeshRenderPipelineFunctions(build.meshDescriptor, &archiveError)
+            : mPipelineArchive->addComputePipelineFunctions(build.computeDescriptor, &archiveError);
+        if (added) {
+            mPipelineArchiveMisses++;
+        } else {
+            LOG_WARNING("Failed to archive the %s pipeline: %s", kPipelineNames[id],
+                        archiveError ? archiveError->localizedDescription()->utf8String() : "unknown error");
+        }
+    } else if (state && mPipelineArchive) {
+        std::lock_guard<std::mutex> archiveLock(mPipelineArchiveMutex);
+        mPipelineArchiveHits++;
+    }
+    
+    std::lock_guard<std::mutex> lock(mPipelineMutex);
+    build.state = state ? state->retain() : nullptr;
+    build.error = error ? error->localizedDescription()->utf8String() : "unknown error";
+    build.finished = true;
+    mPipelineCondition.notify_all();
+}
+
+uint32_t Renderer3D_Metal::RequiredPipelines() const {
+    // What a frame cannot draw without
+    uint32_t required = (1u << kPipelineScene) | (1u << kPipelineSceneLandingPad) | (1u << kPipelineSceneLander);
+    if (mUseTerrainTextures) {
+        required |= (1u << kPipelineTerrainMap) | (1u << kPipelineTerrainMapLandingPad);
+    }
+    return required;
+}
+
+void Renderer3D_Metal::PollPipelines(uint32_t waitMask) {
+    std::unique_lock<std::mutex> lock(mPipelineMutex);
+    
+    // The inline fallback library has to finish before any build can start
+    if (!mPipelinesStarted) {
+        if (mLibraryPending && !waitMask) return;
+        mPipelineCondition.wait(lock, [this] { return !mLibraryPending; });
+        lock.unlock();
+        if (!StartPipelines()) {
+            LOG_ERROR("Shader loading failed!");
+            mInitialized = false;
+            return;
+        }
+        lock.lock();
+    }
+    if (mPipelinesPending == 0) return;
+    
+    for (int id = 0; id < kPipelineCount; id++) {
+        PipelineBuild& build = mPipelineBuilds[id];
+        if (!build.pending) continue;
+        if (!build.finished) {
+            if (!(waitMask & (1u << id))) continue;
+            PROFILE_SCOPE("Wait For Pipeline");
+            mPipelineCondition.wait(lock, [&build] { return build.finished; });
+        }
+        InstallPipeline(static_cast<PipelineId>(id), build);
+        mPipelinesPending--;
+    }
+    
+    // Every build is done: keep what was compiled for the next launch
+    if (mPipelinesPending == 0) {
+        lock.unlock();
+        LOG_INFO("Pipelines ready %.1f ms after renderer start",
+                 (Profiler::Now() - mInitializeStartNs) / 1.0e6);
+        SavePipelineArchive();
+    }
+}
+
+void Renderer3D_Metal::InstallPipeline(PipelineId id, PipelineBuild& build) {
+    NS::Object* state = build.state;
+    if (!state) {
+        LOG_ERROR("Failed to create %s pipeline state: %s", kPipelineNames[id], build.error.c_str());
+    }
+    if (build.renderDescriptor) build.renderDescriptor->release();
+    if (build.computeDescriptor) build.computeDescriptor->release();
+    if (build.tileDescriptor) build.tileDescriptor->release();
+    if (build.meshDescriptor) build.meshDescriptor->release();
+    build = PipelineBuild();
+    
+    // A missing optional pipeline turns its feature off, as a missing
+    // shader function does in StartPipelines()
+    switch (id) {
+        case kPipelineScene:
+        case kPipelineSceneLandingPad:
+        case kPipelineSceneLander:
+            mScenePipelineStates[id - kPipelineScene] = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                mInitialized = false;
+            }
+            break;
+        case kPipelineLanderInstances:
+            mLanderInstancePipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Lander instancing shader unavailable, lander batches will not be drawn");
+            }
+            break;
+        case kPipelineOverlay:
+            mOverlayPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Overlay pipeline unavailable, telemetry and profiler overlays disabled");
+            }
+            break;
+        case kPipelineTerrainMap:
+        case kPipelineTerrainMapLandingPad:
+            mTerrainMapPipelineStates[id - kPipelineTerrainMap] = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Height texture terrain shader unavailable, drawing terrain from vertices");
+                mUseTerrainTextures = false;
+                mUseTerrainTessellation = false;
+                mUseTerrainMeshShaders = false;
+            }
+            break;
+        case kPipelineTerrainMesh:
+        case kPipelineTerrainMeshLandingPad:
+            mTerrainMeshPipelineStates[id - kPipelineTerrainMesh] = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Terrain meshlet shaders unavailable, terrain drawn instanced");
+                mUseTerrainMeshShaders = false;
+            }
+            break;
+        case kPipelineTerrainTess:
+        case kPipelineTessFactors:
+            if (id == kPipelineTerrainTess) {
+                mTerrainTessPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            } else {
+                mTerrainTessFactorPipeline = static_cast<MTL::ComputePipelineState*>(state);
+            }
+            if (!state) {
+                LOG_WARNING("Terrain tessellation shaders unavailable, near field drawn untessellated");
+                mUseTerrainTessellation = false;
+            }
+            break;
+        case kPipelineTerrainTable:
+        case kPipelineTerrainTableLandingPad:
+            mTerrainTablePipelineStates[id - kPipelineTerrainTable] = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Terrain chunk table shader unavailable, chunk uniforms bound per draw");
+            }
+            break;
+        case kPipelineTerrainChunks:
+        case kPipelineTerrainChunksLandingPad:
+        case kPipelineTerrainCull:
+            if (id == kPipelineTerrainCull) {
+                mTerrainCullPipeline = static_cast<MTL::ComputePipelineState*>(state);
+            } else {
+                mTerrainChunkPipelineStates[id - kPipelineTerrainChunks] = static_cast<MTL::RenderPipelineState*>(state);
+            }
+            if (!state) {
+                LOG_WARNING("Terrain culling kernel unavailable, terrain chunks selected on the CPU");
+                mUseGpuTerrainCulling = false;
+            }
+            break;
+        case kPipelineHiZDepth:
+        case kPipelineHiZReduce:
+            // The culling kernel still binds the pyramid; without a
+            // reduction it is never marked ready and nothing is occluded
+            if (id == kPipelineHiZDepth) {
+                mHiZDepthPipeline = static_cast<MTL::ComputePipelineState*>(state);
+            } else {
+                mHiZReducePipeline = static_cast<MTL::ComputePipelineState*>(state);
+            }
+            if (!state) {
+                LOG_WARNING("Hi-Z reduction kernels unavailable, terrain chunks culled without occlusion");
+            }
+            break;
+        case kPipelineTerrainHeights:
+        case kPipelineTerrainVertices:
+            if (id == kPipelineTerrainHeights) {
+                mTerrainHeightPipeline = static_cast<MTL::ComputePipelineState*>(state);
+            } else {
+                mTerrainVertexPipeline = static_cast<MTL::ComputePipelineState*>(state);
+            }
+            if (!state) {
+                LOG_INFO("Terrain compute kernels unavailable, terrain will be generated on the CPU");
+            }
+            break;
+        case kPipelineParticleEmit:
+        case kPipelineParticleUpdate:
+        case kPipelineParticles:
+            if (id == kPipelineParticleEmit) {
+                mParticleEmitPipeline = static_cast<MTL::ComputePipelineState*>(state);
+            } else if (id == kPipelineParticleUpdate) {
+                mParticleUpdatePipeline = static_cast<MTL::ComputePipelineState*>(state);
+            } else {
+                mParticlePipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            }
+            if (!state) {
+                LOG_WARNING("Particle shaders unavailable, exhaust and dust will not be drawn");
+            }
+            break;
+        case kPipelineShadowCasters:
+        case kPipelineShadowTerrainMap:
+            if (id == kPipelineShadowCasters) {
+                mShadowCasterPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            } else {
+                mShadowTerrainMapPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            }
+            if (!state) {
+                LOG_WARNING("Shadow caster pipeline unavailable, shadows will not be drawn");
+            }
+            break;
+        case kPipelineLightCulling:
+        case kPipelineDeferredLighting:
+            if (id == kPipelineLightCulling) {
+                mLightCullPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            } else {
+                mDeferredLightingPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            }
+            if (!state) {
+                LOG_WARNING("Deferred lighting pipeline unavailable, point lights will not be drawn");
+            }
+            break;
+        case kPipelineVariableRateResolve:
+            mVariableRateResolvePipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Variable rate resolve pipeline unavailable, the scene will not be drawn");
+            }
+            break;
+        case kPipelineSky:
+            mSkyPipelineState = static_cast<MTL::RenderPipelineState*>(state);
+            if (!state) {
+                LOG_WARNING("Sky pipeline unavailable, the sky will be black");
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Vertex descriptor matching PackedVertex, shared by the vertex buffer
+// pipelines (the caller releases it)
+static MTL::VertexDescriptor* NewPackedVertexDescriptor() {
+    MTL::VertexDescriptor* vertexDescriptor = MTL::VertexDescriptor::alloc()->init();
+
+    // Position attribute (snorm16, decoded against the draw's position range;
+    // w carries the terrain morph target height)
+    vertexDescriptor->attributes()->object(0)->setFormat(MTL::VertexFormatShort4Normalized);
+    vertexDescriptor->attributes()->object(0)->setOffset(offsetof(PackedVertex, position));
+    vertexDescriptor->attributes()->object(0)->setBufferIndex(0);
+
+    // Octahedral normal attribute
+    vertexDescriptor->attributes()->object(1)->setFormat(MTL::VertexFormatShort2Normalized);
+    vertexDescriptor->attributes()->object(1)->setOffset(offsetof(PackedVertex, normal));
+    vertexDescriptor->attributes()->object(1)->setBufferIndex(0);
+
+    // Flags attribute (landing pad)
+    vertexDescriptor->attributes()->object(2)->setFormat(MTL::VertexFormatUChar);
+    vertexDescriptor->attributes()->object(2)->setOffset(offsetof(PackedVertex, flags));
+    vertexDescriptor->attributes()->object(2)->setBufferIndex(0);
+
+    // Ambient occlusion attribute (unorm8, 0 for everything but terrain)
+    vertexDescriptor->attributes()->object(3)->setFormat(MTL::VertexFormatUCharNormalized);
+    vertexDescriptor->attributes()->object(3)->setOffset(offsetof(PackedVertex, occlusion));
+    vertexDescriptor->attributes()->object(3)->setBufferIndex(0);
+    
+    // Set layout
+    vertexDescriptor->layouts()->object(0)->setStride(sizeof(PackedVertex));
+    return vertexDescriptor;
+}
+
+bool Renderer3D_Metal::CreateRenderPipeline() {
+    // Create render pipeline state
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    
+    // Set up color attachment
+    SetScenePassFormats(pipelineDescriptor);
+    
+    // Set up vertex descriptor to match our PackedVertex struct
+    MTL::VertexDescriptor* vertexDescriptor = NewPackedVertexDescriptor();
+    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
+    vertexDescriptor->release();
+    
+    // One pipeline per variant, created in the background
+    for (int variant = 0; variant < kShaderVariantCount; variant++) {
+        MTL::Function* vertexFunction = GetShaderVariant("vertex_main", static_cast<ShaderVariant>(variant));
+        MTL::Function* fragmentFunction = GetShaderVariant("fragment_main", static_cast<ShaderVariant>(variant));
+        if (!vertexFunction || !fragmentFunction) {
+            LOG_ERROR("Failed to find shader functions in library");
+            pipelineDescriptor->release();
+            return false;
+        }
+        pipelineDescriptor->setVertexFunction(vertexFunction);
+        pipelineDescriptor->setFragmentFunction(fragmentFunction);
+        CompileRenderPipeline(static_cast<PipelineId>(kPipelineScene + variant), pipelineDescriptor);
+    }
+    pipelineDescriptor->release();
+    
+    // Create depth stencil state
+    MTL::DepthStencilDescriptor* depthDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    depthDescriptor->setDepthCompareFunction(MTL::CompareFunctionLess);
+    depthDescriptor->setDepthWriteEnabled(true);
+    
+    mDepthStencilState = mDevice->newDepthStencilState(depthDescriptor);
+    depthDescriptor->release();
+    
+    return true;
+}
+
+bool Renderer3D_Metal::CreateLanderInstancePipeline() {
+    MTL::Function* vertexFunction = GetShaderVariant("lander_instance_vertex", kShaderVariantLander);
+    MTL::Function* fragmentFunction = GetShaderVariant("fragment_main", kShaderVariantLander);
+    if (!vertexFunction || !fragmentFunction) {
+        return false;
+    }
+    
+    // The lander mesh as in the scene pipeline; transforms come from the
+    // instance ring
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    SetScenePassFormats(pipelineDescriptor);
+    MTL::VertexDescriptor* vertexDescriptor = NewPackedVertexDescriptor();
+    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
+    vertexDescriptor->release();
+    
+    CompileRenderPipeline(kPipelineLanderInstances, pipelineDescriptor);
+    pipelineDescriptor->release();
+    
+    mLanderInstanceBuffer = mHeapAllocator.NewBuffer(kMaxLanderInstances * sizeof(LanderInstance) * mFramesInFlight,
+                                                     MetalHeapAllocator::Memory::Shared);
+    return mLanderInstanceBuffer != nullptr;
+}
+
+bool Renderer3D_Metal::CreateOverlayPipeline() {
+    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
+        NS::String::string("overlay_vertex", NS::UTF8StringEncoding));
+    MTL::Function* fragmentFunction = mShaderLibrary->newFunction(
+        NS::String::string("overlay_fragment", NS::UTF8StringEncoding));
+    
+    if (!vertexFunction || !fragmentFunction) {
+        if (vertexFunction) vertexFunction->release();
+        if (fragmentFunction) fragmentFunction->release();
+        return false;
+    }
+    
+    // Vertices are fetched by index from the overlay ring, so no vertex descriptor
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    pipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+    
+    // Standard alpha blending over the scene
+    MTL::RenderPipelineColorAttachmentDescriptor* colorAttachment =
+        pipelineDescriptor->colorAttachments()->object(0);
+    colorAttachment->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    colorAttachment->setBlendingEnabled(true);
+    colorAttachment->setSourceRGBBlendFactor(MTL::BlendFactorSourceAlpha);
+    colorAttachment->setDestinationRGBBlendFactor(MTL::BlendFactorOneMinusSourceAlpha);
+    colorAttachment->setSourceAlphaBlendFactor(MTL::BlendFactorOne);
+    colorAttachment->setDestinationAlphaBlendFactor(MTL::BlendFactorOneMinusSourceAlpha);
+    
+    // Without dynamic resolution the overlay is drawn in the scene pass,
+    // G-buffer and all
+    if (mUseDeferredLighting && !mUseDynamicResolution) {
+        for (int i = 0; i < kGBufferCount; i++) {
+            MTL::RenderPipelineColorAttachmentDescriptor* attachment =
+                pipelineDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i);
+            attachment->setPixelFormat(kGBufferFormats[i]);
+            attachment->setWriteMask(MTL::ColorWriteMaskNone);
+        }
+    }
+    
+    CompileRenderPipeline(kPipelineOverlay, pipelineDescriptor);
+    
+    pipelineDescriptor->release();
+    vertexFunction->release();
+    fragmentFunction->release();
+    
+    // Draw on top of everything and leave depth untouched
+    MTL::DepthStencilDescriptor* depthDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    depthDescriptor->setDepthCompareFunction(MTL::CompareFunctionAlways);
+    depthDescriptor->setDepthWriteEnabled(false);
+    
+    mOverlayDepthState = mDevice->newDepthStencilState(depthDescriptor);
+    depthDescriptor->release();
+    if (!mOverlayDepthState) {
+        return false;
+    }
+    
+    // The profiler panel alone is over a thousand rectangles, far more than
+    // the uniform ring can hold, so the overlay has its own per-frame slots
+    mOverlayVertexBuffer = mHeapAllocator.NewBuffer(kOverlayVerticesPerSlot * sizeof(OverlayVertex) * mFramesInFlight,
+                                                    MetalHeapAllocator::Memory::Shared);
+    if (!mOverlayVertexBuffer) {
+        return false;
+    }
+    for (int slot = 0; slot < kMaxFramesInFlight; slot++) {
+        mHudSlotVersions[slot] = 0;
+        mHudSlotVertexCounts[slot] = 0;
+    }
+    
+    // Glyph atlas, copied in ahead of the first frame that samples it
+    MTL::TextureDescriptor* atlasDescriptor = MTL::TextureDescriptor::texture2DDescriptor(
+        MTL::PixelFormatR8Unorm, GlyphAtlas::kWidth, GlyphAtlas::kHeight, false);
+    atlasDescriptor->setStorageMode(MTL::StorageModePrivate);
+    atlasDescriptor->setUsage(MTL::TextureUsageShaderRead);
+    mGlyphAtlasTexture = mHeapAllocator.NewTexture(atlasDescriptor);
+    MTL::Buffer* atlasStaging = mHeapAllocator.NewBuffer(GlyphAtlas::GetPixels(),
+                                                         GlyphAtlas::kWidth * GlyphAtlas::kHeight);
+    if (!mGlyphAtlasTexture || !atlasStaging) {
+        mHeapAllocator.Free(atlasStaging);
+        return false;
+    }
+    TextureUpload upload = { atlasStaging, 0, GlyphAtlas::kWidth, mGlyphAtlasTexture,
+                             0, 0, GlyphAtlas::kWidth, GlyphAtlas::kHeight };
+    SubmitTextureUploads(&upload, 1);
+    mHeapAllocator.Free(atlasStaging);
+    return true;
+}
+
+bool Renderer3D_Metal::CreateTerrainMapPipeline() {
+    // Terrain and landing pad variants only
+    const ShaderVariant variants[2] = { kShaderVariantTerrain, kShaderVariantLandingPad };
+    for (ShaderVariant variant : variants) {
+        if (!GetShaderVariant("terrain_map_vertex", variant) || !GetShaderVariant("fragment_main", variant)) {
+            return false;
+        }
+    }
+    
+    // Samples come from the terrain textures, so no vertex descriptor
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    SetScenePassFormats(pipelineDescriptor);
+    
+    for (ShaderVariant variant : variants) {
+        pipelineDescriptor->setVertexFunction(GetShaderVariant("terrain_map_vertex", variant));
+        pipelineDescriptor->setFragmentFunction(GetShaderVariant("fragment_main", variant));
+        CompileRenderPipeline(static_cast<PipelineId>(kPipelineTerrainMap + variant), pipelineDescriptor);
+    }
+    
+    pipelineDescriptor->release();
+    return true;
+}
+
+// Object threadgroups cover a chunk, one thread per meshlet; mesh
+// threadgroups one meshlet, one thread per triangle (its 25 vertices fit)
+static const NS::UInteger kTerrainMeshletTriangles =
+    2 * Renderer3D_Metal::kTerrainMeshletCells * Renderer3D_Metal::kTerrainMeshletCells;
+
+// Object to mesh payload; matches TerrainMeshletPayload in LanderShaders.metal
+static const NS::UInteger kTerrainMeshletPayloadSize = sizeof(uint32_t) +
+    Renderer3D_Metal::kTerrainMeshletsPerChunk * sizeof(uint16_t);
+
+bool Renderer3D_Metal::CreateTerrainMeshPipelines() {
+    // Terrain and landing pad variants, as for terrain_map_vertex
+    const ShaderVariant variants[2] = { kShaderVariantTerrain, kShaderVariantLandingPad };
+    for (ShaderVariant variant : variants) {
+        if (!GetShaderVariant("terrain_meshlet_mesh", variant) || !GetShaderVariant("fragment_main", variant)) {
+            return false;
+        }
+    }
+    MTL::Function* objectFunction = mShaderLibrary->newFunction(
+        NS::String::string("terrain_meshlet_object", NS::UTF8StringEncoding));
+    if (!objectFunction) {
+        return false;
+    }
+    
+    MTL::MeshRenderPipelineDescriptor* pipelineDescriptor = MTL::MeshRenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setObjectFunction(objectFunction);
+    pipelineDescriptor->setMaxTotalThreadsPerObjectThreadgroup(kTerrainMeshletsPerChunk);
+    pipelineDescriptor->setMaxTotalThreadsPerMeshThreadgroup(kTerrainMeshletTriangles);
+    pipelineDescriptor->setPayloadMemoryLength(kTerrainMeshletPayloadSize);
+    SetScenePassFormats(pipelineDescriptor);
+    objectFunction->release();
+    
+    for (ShaderVariant variant : variants) {
+        pipelineDescriptor->setMeshFunction(GetShaderVariant("terrain_meshlet_mesh", variant));
+        pipelineDescriptor->setFragmentFunction(GetShaderVariant("fragment_main", variant));
+        CompileMeshPipeline(static_cast<PipelineId>(kPipelineTerrainMesh + variant), pipelineDescriptor);
+    }
+    
+    pipelineDescriptor->release();
+    return true;
+}
+
+// Triangle patches per near-field chunk (two per cell) and factor bytes per frame
+static const int kNearFieldPatchesPerChunk =
+    2 * Renderer3D_Metal::kTerrainChunkCells * Renderer3D_Metal::kTerrainChunkCells;
+static const size_t kTessFactorSlotSize =
+    Renderer3D_Metal::kMaxNearFieldChunks * kNearFieldPatchesPerChunk * sizeof(MTL::TriangleTessellationFactorsHalf);
+
+bool Renderer3D_Metal::CreateTerrainTessellationPipelines() {
+    // The near field surrounds the lander, which is usually over the pad,
+    // so it always draws with the landing pad variant
+    MTL::Function* kernelFunction = mShaderLibrary->newFunction(
+        NS::String::string("terrain_tess_factors", NS::UTF8StringEncoding));
+    MTL::Function* vertexFunction = GetShaderVariant("terrain_tess_vertex", kShaderVariantLandingPad);
+    MTL::Function* fragmentFunction = GetShaderVariant("fragment_main", kShaderVariantLandingPad);
+    
+    if (!kernelFunction || !vertexFunction || !fragmentFunction) {
+        if (kernelFunction) kernelFunction->release();
+        return false;
+    }
+    
+    CompileComputePipeline(kPipelineTessFactors, kernelFunction);
+    kernelFunction->release();
+    
+    // Patch positions come from the patch id, so there are no control
+    // points to fetch. Fractional odd partitioning keeps a factor of 1 as a
+    // single segment, which the near field's border edges rely on.
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    SetScenePassFormats(pipelineDescriptor);
+    pipelineDescriptor->setTessellationPartitionMode(MTL::TessellationPartitionModeFractionalOdd);
+    pipelineDescriptor->setTessellationFactorFormat(MTL::TessellationFactorFormatHalf);
+    pipelineDescriptor->setTessellationFactorStepFunction(MTL::TessellationFactorStepFunctionPerPatch);
+    pipelineDescriptor->setTessellationControlPointIndexType(MTL::TessellationControlPointIndexTypeNone);
+    pipelineDescriptor->setTessellationOutputWindingOrder(MTL::WindingCounterClockwise);
+    pipelineDescriptor->setMaxTessellationFactor(static_cast<NS::UInteger>(kNearFieldMaxTessFactor));
+    
+    CompileRenderPipeline(kPipelineTerrainTess, pipelineDescriptor);
+    pipelineDescriptor->release();
+    
+    mTerrainTessFactorBuffer = mHeapAllocator.NewBuffer(kTessFactorSlotSize * mFramesInFlight,
+                                                        MetalHeapAllocator::Memory::Shared);
+    return mTerrainTessFactorBuffer != nullptr;
+}
+
+bool Renderer3D_Metal::CreateTerrainTablePipelines() {
+    for (int variant = kShaderVariantTerrain; variant <= kShaderVariantLandingPad; variant++) {
+        if (!GetShaderVariant("terrain_table_vertex", static_cast<ShaderVariant>(variant)) ||
+            !GetShaderVariant("fragment_main", static_cast<ShaderVariant>(variant))) {
+            return false;
+        }
+    }
+    
+    // The variants share the table's layout; one slot per frame, as for
+    // the culling kernel's argument buffer
+    mTerrainTableArgumentEncoder = GetShaderVariant("terrain_table_vertex", kShaderVariantTerrain)->newArgumentEncoder(2);
+    if (!mTerrainTableArgumentEncoder) {
+        return false;
+    }
+    size_t argumentSlotSize = (mTerrainTableArgumentEncoder->encodedLength() + kUniformAlignment - 1) &
+                              ~(kUniformAlignment - 1);
+    mTerrainTableArgumentBuffer = mHeapAllocator.NewBuffer(argumentSlotSize * mFramesInFlight,
+                                                           MetalHeapAllocator::Memory::Shared);
+    
+    // The scene pipeline with the chunk's decode read from the table
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    SetScenePassFormats(pipelineDescriptor);
+    MTL::VertexDescriptor* vertexDescriptor = NewPackedVertexDescriptor();
+    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
+    vertexDescriptor->release();
+    
+    for (int variant = kShaderVariantTerrain; variant <= kShaderVariantLandingPad; variant++) {
+        pipelineDescriptor->setVertexFunction(GetShaderVariant("terrain_table_vertex", static_cast<ShaderVariant>(variant)));
+        pipelineDescriptor->setFragmentFunction(GetShaderVariant("fragment_main", static_cast<ShaderVariant>(variant)));
+        CompileRenderPipeline(static_cast<PipelineId>(kPipelineTerrainTable + variant), pipelineDescriptor);
+    }
+    pipelineDescriptor->release();
+    return mTerrainTableArgumentBuffer != nullptr;
+}
+
+bool Renderer3D_Metal::CreateTerrainCullPipelines() {
+    // Specialized on kOcclusionCulling; released with the other variants
+    MTL::Function* kernelFunction = GetShaderVariant("terrain_cull_chunks", kShaderVariantTerrain);
+    if (!kernelFunction) {
+        return false;
+    }
+    for (int variant = kShaderVariantTerrain; variant <= kShaderVariantLandingPad; variant++) {
+        if (!GetShaderVariant("terrain_chunk_vertex", static_cast<ShaderVariant>(variant)) ||
+            !GetShaderVariant("fragment_main", static_cast<ShaderVariant>(variant), true)) {
+            return false;
+        }
+    }
+    
+    // The kernel finds the command buffer through an argument buffer, one
+    // per frame slot so a slot can be re-encoded while others are in flight
+    mTerrainCullArgumentEncoder = kernelFunction->newArgumentEncoder(6);
+    CompileComputePipeline(kPipelineTerrainCull, kernelFunction);
+    if (!mTerrainCullArgumentEncoder) {
+        return false;
+    }
+    size_t argumentSlotSize = (mTerrainCullArgumentEncoder->encodedLength() + kUniformAlignment - 1) &
+                              ~(kUniformAlignment - 1);
+    mTerrainCullArgumentBuffer = mHeapAllocator.NewBuffer(argumentSlotSize * mFramesInFlight,
+                                                          MetalHeapAllocator::Memory::Shared);
+    
+    // The scene pipeline's state, usable from indirect command buffers
+    // (which can't bind the shadow maps or the point lights)
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    SetScenePassFormats(pipelineDescriptor);
+    pipelineDescriptor->setSupportIndirectCommandBuffers(true);
+    MTL::VertexDescriptor* vertexDescriptor = NewPackedVertexDescriptor();
+    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
+    vertexDescriptor->release();
+    
+    for (int variant = kShaderVariantTerrain; variant <= kShaderVariantLandingPad; variant++) {
+        pipelineDescriptor->setVertexFunction(GetShaderVariant("terrain_chunk_vertex", static_cast<ShaderVariant>(variant)));
+        pipelineDescriptor->setFragmentFunction(GetShaderVariant("fragment_main", static_cast<ShaderVariant>(variant), true));
+        CompileRenderPipeline(static_cast<PipelineId>(kPipelineTerrainChunks + variant), pipelineDescriptor);
+    }
+    pipelineDescriptor->release();
+    return mTerrainCullArgumentBuffer != nullptr;
+}
+
+bool Renderer3D_Metal::CreateHiZPipelines() {
+    MTL::Function* depthFunction = mShaderLibrary->newFunction(
+        NS::String::string("hiz_reduce_depth", NS::UTF8StringEncoding));
+    MTL::Function* reduceFunction = mShaderLibrary->newFunction(
+        NS::String::string("hiz_reduce", NS::UTF8StringEncoding));
+    
+    if (!depthFunction || !reduceFunction) {
+        if (depthFunction) depthFunction->release();
+        if (reduceFunction) reduceFunction->release();
+        return false;
+    }
+    
+    CompileComputePipeline(kPipelineHiZDepth, depthFunction);
+    CompileComputePipeline(kPipelineHiZReduce, reduceFunction);
+    depthFunction->release();
+    reduceFunction->release();
+    return true;
+}
+
+bool Renderer3D_Metal::CreateTerrainComputePipelines() {
+    MTL::Function* heightFunction = mShaderLibrary->newFunction(
+        NS::String::string("terrain_generate_heights", NS::UTF8StringEncoding));
+    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
+        NS::String::string("terrain_build_vertices", NS::UTF8StringEncoding));
+    
+    if (!heightFunction || !vertexFunction) {
+        if (heightFunction) heightFunction->release();
+        if (vertexFunction) vertexFunction->release();
+        return false;
+    }
+    
+    CompileComputePipeline(kPipelineTerrainHeights, heightFunction);
+    CompileComputePipeline(kPipelineTerrainVertices, vertexFunction);
+    heightFunction->release();
+    vertexFunction->release();
+    return true;
+}
+
+// Matches Particle in Particles.metal (48 bytes)
+struct GpuParticle {
+    float position[3];
+    float age;
+    float velocity[3];
+    float lifetime;
+    float size;
+    uint32_t kind;
+    float padding[2];
+};
+static_assert(sizeof(GpuParticle) == 48, "GpuParticle must match Particle in Particles.metal");
+
+// Matches ParticleUniforms in Particles.metal, shared by the emit and
+// update kernels
+struct ParticleUniforms {
+    float nozzle[4];            // xyz; w = exhaust speed (m/s)
+    float exhaustDirection[4];
+    float velocity[4];
+    float plumeCenter[4];       // Where the engine axis meets the ground; w = radius
+    float originShift[4];       // Subtracted from every live particle before aging
+    float contacts[Renderer3D_Metal::kMaxParticleContacts][4];
+    uint32_t head;              // Ring slot of the first new particle
+    uint32_t exhaustCount;      // New particles of each stream, in this order
+    uint32_t plumeDustCount;
+    uint32_t contactDustCount;
+    uint32_t contactCount;
+    uint32_t seed;
+    uint32_t ringMask;
+    float deltaTime;
+    float gravity;
+    float groundHeight;
+    float thrustLevel;
+    float contactStrength;      // 0 - 1
+};
+
+// Matches ParticleDrawUniforms in Particles.metal
+struct ParticleDrawUniforms {
+    float viewProjection[16];
+    float pointScale;           // Pixels per meter at one meter's depth
+    float maxPointSize;
+    float padding[2];
+};
+
+static_assert((Renderer3D_Metal::kMaxParticles & (Renderer3D_Metal::kMaxParticles - 1)) == 0,
+              "The particle ring wraps with a mask");
+
+bool Renderer3D_Metal::CreateParticlePipelines() {
+    MTL::Function* emitFunction = mShaderLibrary->newFunction(
+        NS::String::string("particle_emit", NS::UTF8StringEncoding));
+    MTL::Function* updateFunction = mShaderLibrary->newFunction(
+        NS::String::string("particle_update", NS::UTF8StringEncoding));
+    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
+        NS::String::string("particle_vertex", NS::UTF8StringEncoding));
+    MTL::Function* fragmentFunction = mShaderLibrary->newFunction(
+        NS::String::string("particle_fragment", NS::UTF8StringEncoding));
+    
+    if (!emitFunction || !updateFunction || !vertexFunction || !fragmentFunction) {
+        if (emitFunction) emitFunction->release();
+        if (updateFunction) updateFunction->release();
+        if (vertexFunction) vertexFunction->release();
+        if (fragmentFunction) fragmentFunction->release();
+        return false;
+    }
+    
+    CompileComputePipeline(kPipelineParticleEmit, emitFunction);
+    CompileComputePipeline(kPipelineParticleUpdate, updateFunction);
+    emitFunction->release();
+    updateFunction->release();
+    
+    // Points are fetched by vertex id from the ring, so no vertex
+    // descriptor. Premultiplied blending: dust covers what is behind it,
+    // exhaust (alpha 0) adds to it. Particles have no motion of their own
+    // for the temporal scaler, so they leave the motion target alone.
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    SetScenePassFormats(pipelineDescriptor);
+    pipelineDescriptor->setInputPrimitiveTopology(MTL::PrimitiveTopologyClassPoint);
+    
+    MTL::RenderPipelineColorAttachmentDescriptor* colorAttachment =
+        pipelineDescriptor->colorAttachments()->object(0);
+    colorAttachment->setBlendingEnabled(true);
+    colorAttachment->setSourceRGBBlendFactor(MTL::BlendFactorOne);
+    colorAttachment->setDestinationRGBBlendFactor(MTL::BlendFactorOneMinusSourceAlpha);
+    colorAttachment->setSourceAlphaBlendFactor(MTL::BlendFactorOne);
+    colorAttachment->setDestinationAlphaBlendFactor(MTL::BlendFactorOneMinusSourceAlpha);
+    if (mTemporalScaler) {
+        pipelineDescriptor->colorAttachments()->object(1)->setWriteMask(MTL::ColorWriteMaskNone);
+    }
+    if (mUseDeferredLighting) {
+        for (int i = 0; i < kGBufferCount; i++) {
+            pipelineDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i)->setWriteMask(MTL::ColorWriteMaskNone);
+        }
+    }
+    
+    CompileRenderPipeline(kPipelineParticles, pipelineDescriptor);
+    
+    pipelineDescriptor->release();
+    vertexFunction->release();
+    fragmentFunction->release();
+    
+    // Hidden by the terrain and lander, but never hiding each other
+    MTL::DepthStencilDescriptor* depthDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    depthDescriptor->setDepthCompareFunction(MTL::CompareFunctionLess);
+    depthDescriptor->setDepthWriteEnabled(false);
+    
+    mParticleDepthState = mDevice->newDepthStencilState(depthDescriptor);
+    depthDescriptor->release();
+    if (!mParticleDepthState) {
+        return false;
+    }
+    
+    // The ring lives on the GPU; zeroed, every slot is free (age == lifetime)
+    const size_t ringBytes = kMaxParticles * sizeof(GpuParticle);
+    mParticleBuffer = mHeapAllocator.NewBuffer(ringBytes, MetalHeapAllocator::Memory::Private, MemoryTag::Particles);
+    if (!mParticleBuffer) {
+        return false;
+    }
+    MTL::CommandBuffer* clearCommands = mCommandQueue->commandBuffer();
+    MTL::BlitCommandEncoder* blit = clearCommands->blitCommandEncoder();
+    blit->fillBuffer(mParticleBuffer, NS::Range::Make(0, ringBytes), 0);
+    blit->endEncoding();
+    clearCommands->commit();
+    mParticleHead = 0;
+    return true;
+}
+
+bool Renderer3D_Metal::CreateShadowPipelines() {
+    MTL::Function* casterFunction = GetShaderVariant("vertex_main", kShaderVariantTerrain);
+    if (!casterFunction) {
+        return false;
+    }
+    
+    // Depth only: no fragment function and no color attachments
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+    MTL::VertexDescriptor* vertexDescriptor = NewPackedVertexDescriptor();
+    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
+    vertexDescriptor->release();
+    pipelineDescriptor->setVertexFunction(casterFunction);
+    CompileRenderPipeline(kPipelineShadowCasters, pipelineDescriptor);
+    
+    // Height texture terrain casts through its own vertex function
+    MTL::Function* terrainMapFunction =
+        mUseTerrainTextures ? GetShaderVariant("terrain_map_vertex", kShaderVariantTerrain) : nullptr;
+    if (terrainMapFunction) {
+        pipelineDescriptor->setVertexDescriptor(nullptr);
+        pipelineDescriptor->setVertexFunction(terrainMapFunction);
+        CompileRenderPipeline(kPipelineShadowTerrainMap, pipelineDescriptor);
+    }
+    pipelineDescriptor->release();
+    
+    const int sizes[2] = { kTerrainShadowMapSize, kLanderShadowMapSize };
+    MTL::Texture** maps[2] = { &mTerrainShadowMap, &mLanderShadowMap };
+    for (int i = 0; i < 2; i++) {
+        MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            MTL::PixelFormatDepth32Float, sizes[i], sizes[i], false);
+        textureDescriptor->setStorageMode(MTL::StorageModePrivate);
+        textureDescriptor->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+        *maps[i] = mHeapAllocator.NewTexture(textureDescriptor);
+        if (!*maps[i]) {
+            return false;
+        }
+    }
+    
+    mShadowPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+    MTL::RenderPassDepthAttachmentDescriptor* depthAttachment = mShadowPassDescriptor->depthAttachment();
+    depthAttachment->setLoadAction(MTL::LoadActionClear);
+    depthAttachment->setClearDepth(1.0);
+    depthAttachment->setStoreAction(MTL::StoreActionStore);
+    return true;
+}
+
+// Point lights as fragment_main, cull_point_lights and deferred_lighting
+// read them (see PointLightUniforms in LanderShaders.metal)
+struct GpuPointLight {
+    float positionRadius[4];
+    float color[4];
+};
+
+struct PointLightUniforms {
+    uint32_t count;
+    uint32_t padding[3];
+    GpuPointLight lights[Renderer3D_Metal::kMaxPointLights];
+};
+
+// A tile's share of threadgroup memory, written by cull_point_lights and
+// read by deferred_lighting (TileLights in LanderShaders.metal)
+struct TileLights {
+    uint32_t boundsMin[3];
+    uint32_t boundsMax[3];
+    uint32_t count;
+    uint16_t indices[Renderer3D_Metal::kMaxPointLights];
+};
+
+// Threadgroup memory lengths are multiples of 16 bytes
+static const size_t kTileLightsBytes = (sizeof(TileLights) + 15) & ~static_cast<size_t>(15);
+
+bool Renderer3D_Metal::CreateDeferredLightingPipelines() {
+    MTL::Function* cullFunction = mShaderLibrary->newFunction(
+        NS::String::string("cull_point_lights", NS::UTF8StringEncoding));
+    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
+        NS::String::string("deferred_lighting_vertex", NS::UTF8StringEncoding));
+    MTL::Function* fragmentFunction = mShaderLibrary->newFunction(
+        NS::String::string("deferred_lighting", NS::UTF8StringEncoding));
+    
+    if (!cullFunction || !vertexFunction || !fragmentFunction) {
+        if (cullFunction) cullFunction->release();
+        if (vertexFunction) vertexFunction->release();
+        if (fragmentFunction) fragmentFunction->release();
+        return false;
+    }
+    
+    // The tile shader sees every attachment of the scene pass, one thread
+    // per pixel of the tile
+    MTL::TileRenderPipelineDescriptor* tileDescriptor = MTL::TileRenderPipelineDescriptor::alloc()->init();
+    tileDescriptor->setTileFunction(cullFunction);
+    tileDescriptor->colorAttachments()->object(0)->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    if (mTemporalScaler) {
+        tileDescriptor->colorAttachments()->object(1)->setPixelFormat(MTL::PixelFormatRG16Float);
+    }
+    for (int i = 0; i < kGBufferCount; i++) {
+        tileDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i)->setPixelFormat(kGBufferFormats[i]);
+    }
+    tileDescriptor->setThreadgroupSizeMatchesTileSize(true);
+    CompileTilePipeline(kPipelineLightCulling, tileDescriptor);
+    tileDescriptor->release();
+    cullFunction->release();
+    
+    // The full-screen draw adds to the lit color and leaves the rest alone
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    SetScenePassFormats(pipelineDescriptor);
+    MTL::RenderPipelineColorAttachmentDescriptor* colorAttachment =
+        pipelineDescriptor->colorAttachments()->object(0);
+    colorAttachment->setBlendingEnabled(true);
+    colorAttachment->setSourceRGBBlendFactor(MTL::BlendFactorOne);
+    colorAttachment->setDestinationRGBBlendFactor(MTL::BlendFactorOne);
+    colorAttachment->setSourceAlphaBlendFactor(MTL::BlendFactorZero);
+    colorAttachment->setDestinationAlphaBlendFactor(MTL::BlendFactorOne);
+    for (int i = 1; i < kGBufferFirstAttachment + kGBufferCount; i++) {
+        pipelineDescriptor->colorAttachments()->object(i)->setWriteMask(MTL::ColorWriteMaskNone);
+    }
+    CompileRenderPipeline(kPipelineDeferredLighting, pipelineDescriptor);
+    pipelineDescriptor->release();
+    vertexFunction->release();
+    fragmentFunction->release();
+    
+    MTL::DepthStencilDescriptor* depthDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    depthDescriptor->setDepthCompareFunction(MTL::CompareFunctionAlways);
+    depthDescriptor->setDepthWriteEnabled(false);
+    mDeferredDepthState = mDevice->newDepthStencilState(depthDescriptor);
+    depthDescriptor->release();
+    return mDeferredDepthState != nullptr;
+}
+
+bool Renderer3D_Metal::CreateVariableRatePipeline() {
+    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
+        NS::String::string("deferred_lighting_vertex", NS::UTF8StringEncoding));
+    MTL::Function* fragmentFunction = mShaderLibrary->newFunction(
+        NS::String::string("variable_rate_resolve", NS::UTF8StringEncoding));
+    
+    if (!vertexFunction || !fragmentFunction) {
+        if (vertexFunction) vertexFunction->release();
+        if (fragmentFunction) fragmentFunction->release();
+        return false;
+    }
+    
+    // The same full-screen triangle as the lighting pass, drawn first in
+    // the overlay pass
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    pipelineDescriptor->colorAttachments()->object(0)->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    pipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+    CompileRenderPipeline(kPipelineVariableRateResolve, pipelineDescriptor);
+    pipelineDescriptor->release();
+    vertexFunction->release();
+    fragmentFunction->release();
+    return true;
+}
+
+bool Renderer3D_Metal::CreateSkyPipeline() {
+    MTL::Function* vertexFunction = mShaderLibrary->newFunction(
+        NS::String::string("sky_vertex", NS::UTF8StringEncoding));
+    MTL::Function* fragmentFunction = GetShaderVariant("sky_fragment", kShaderVariantTerrain, false);
+    
+    if (!vertexFunction || !fragmentFunction) {
+        if (vertexFunction) vertexFunction->release();
+        return false;
+    }
+    
+    // Opaque over the cleared color, with its own motion for the temporal
+    // scaler; the G-buffer keeps its cleared "nothing drawn" there
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFunction);
+    pipelineDescriptor->setFragmentFunction(fragmentFunction);
+    SetScenePassFormats(pipelineDescriptor);
+    if (mUseDeferredLighting) {
+        for (int i = 0; i < kGBufferCount; i++) {
+            pipelineDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i)->setWriteMask(
+                MTL::ColorWriteMaskNone);
+        }
+    }
+    CompileRenderPipeline(kPipelineSky, pipelineDescriptor);
+    pipelineDescriptor->release();
+    vertexFunction->release();
+    
+    // The triangle lies on the far plane: it passes only where the depth
+    // is still as cleared
+    MTL::DepthStencilDescriptor* depthDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    depthDescriptor->setDepthCompareFunction(MTL::CompareFunctionLessEqual);
+    depthDescriptor->setDepthWriteEnabled(false);
+    mSkyDepthState = mDevice->newDepthStencilState(depthDescriptor);
+    depthDescriptor->release();
+    return mSkyDepthState != nullptr;
+}
+
+bool Renderer3D_Metal::CreateGBuffer(int width, int height) {
+    // Memoryless: the G-buffer only ever lives in tile memory, so it takes
+    // no device memory and no bandwidth
+    MTL::Texture* textures[kGBufferCount] = {};
+    for (int i = 0; i < kGBufferCount; i++) {
+        MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            kGBufferFormats[i], width, height, false);
+        descriptor->setStorageMode(MTL::StorageModeMemoryless);
+        descriptor->setUsage(MTL::TextureUsageRenderTarget);
+        textures[i] = mDevice->newTexture(descriptor);
+        if (!textures[i]) {
+            for (MTL::Texture* texture : textures) {
+                if (texture) texture->release();
+            }
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < kGBufferCount; i++) {
+        ReleaseAfterFrame(mGBufferTextures[i]);
+        mGBufferTextures[i] = textures[i];
+        if (mRenderPassDescriptor) {
+            mRenderPassDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i)->setTexture(textures[i]);
+        }
+    }
+    return true;
+}
+
+void Renderer3D_Metal::ReleaseGBuffer() {
+    for (int i = 0; i < kGBufferCount; i++) {
+        if (mGBufferTextures[i]) { mGBufferTextures[i]->release(); mGBufferTextures[i] = nullptr; }
+        if (mRenderPassDescriptor) {
+            mRenderPassDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i)->setTexture(nullptr);
+        }
+    }
+}
+
+bool Renderer3D_Metal::CreateGeometryBuffers() {
+    // Create a simple cube model for the lander (and debris), and the
+    // lander's own model over it if there is one
+    CreateCubeModel();
+    if (!mLanderMeshFile.empty() && !CreateLanderMesh()) {
+        LOG_WARNING("Drawing the lander as a box");
+    }
+    
+    // Terrain buffers will be created dynamically when rendering
+    
+    return true;
+}
+
+bool Renderer3D_Metal::CreateRenderPassDescriptor() {
+    // One descriptor is reused every frame; only the drawable texture changes
+    mRenderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+    if (!mRenderPassDescriptor) {
+        return false;
+    }
+    
+    // Configure color attachment
+    MTL::RenderPassColorAttachmentDescriptor* colorAttachment = mRenderPassDescriptor->colorAttachments()->object(0);
+    colorAttachment->setLoadAction(MTL::LoadActionClear);
+    colorAttachment->setClearColor(MTL::ClearColor(0.0, 0.0, 0.0, 1.0));
+    colorAttachment->setStoreAction(MTL::StoreActionStore);
+    
+    // Configure depth attachment
+    MTL::RenderPassDepthAttachmentDescriptor* depthAttachment = mRenderPassDescriptor->depthAttachment();
+    depthAttachment->setTexture(mDepthTexture);
+    depthAttachment->setLoadAction(MTL::LoadActionClear);
+    depthAttachment->setClearDepth(1.0);
+    // The Hi-Z reduction reads it after the pass
+    depthAttachment->setStoreAction(mUseHiZCulling ? MTL::StoreActionStore : MTL::StoreActionDontCare);
+    
+    // The G-buffer is cleared and dropped in tile memory, and each tile
+    // keeps its culled lights in threadgroup memory
+    if (mUseDeferredLighting) {
+        for (int i = 0; i < kGBufferCount; i++) {
+            MTL::RenderPassColorAttachmentDescriptor* attachment =
+                mRenderPassDescriptor->colorAttachments()->object(kGBufferFirstAttachment + i);
+            attachment->setTexture(mGBufferTextures[i]);
+            attachment->setLoadAction(MTL::LoadActionClear);
+            attachment->setClearColor(MTL::ClearColor(0.0, 0.0, 0.0, 0.0));
+            attachment->setStoreAction(MTL::StoreActionDontCare);
+        }
+        mRenderPassDescriptor->setTileWidth(kLightTileSize);
+        mRenderPassDescriptor->setTileHeight(kLightTileSize);
+        mRenderPassDescriptor->setThreadgroupMemoryLength(kTileLightsBytes);
+    }
+    
+    if (!mUseDynamicResolution && !mUseVariableRasterization) {
+        return true;
+    }
+    
+    // With dynamic resolution or variable rasterization the scene renders
+    // offscreen, and a second pass draws the overlay over the upscaled or
+    // resolved image in the drawable
+    if (mUseVariableRasterization) {
+        colorAttachment->setTexture(mVariableRateTexture);
+    } else {
+        colorAttachment->setTexture(mSceneColorTexture);
+        depthAttachment->setTexture(mSceneDepthTexture);
+    }
+    
+    // The temporal scaler also reads the scene's depth and motion
+    if (mTemporalScaler) {
+        depthAttachment->setStoreAction(MTL::StoreActionStore);
+        MTL::RenderPassColorAttachmentDescriptor* motionAttachment = mRenderPassDescriptor->colorAttachments()->object(1);
+        motionAttachment->setTexture(mSceneMotionTexture);
+        motionAttachment->setLoadAction(MTL::LoadActionClear);
+        motionAttachment->setClearColor(MTL::ClearColor(0.0, 0.0, 0.0, 0.0));
+        motionAttachment->setStoreAction(MTL::StoreActionStore);
+    }
+    
+    mOverlayPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+    if (!mOverlayPassDescriptor) {
+        return false;
+    }
+    MTL::RenderPassColorAttachmentDescriptor* overlayColor = mOverlayPassDescriptor->colorAttachments()->object(0);
+    // The resolve draw covers every pixel, so nothing needs loading under it
+    overlayColor->setLoadAction(mUseVariableRasterization ? MTL::LoadActionDontCare : MTL::LoadActionLoad);
+    overlayColor->setStoreAction(MTL::StoreActionStore);
+    MTL::RenderPassDepthAttachmentDescriptor* overlayDepth = mOverlayPassDescriptor->depthAttachment();
+    overlayDepth->setTexture(mDepthTexture);
+    overlayDepth->setLoadAction(MTL::LoadActionClear);
+    overlayDepth->setClearDepth(1.0);
+    overlayDepth->setStoreAction(MTL::StoreActionDontCare);
+    
+    return true;
+}
+
+void Renderer3D_Metal::CreateCubeModel() {
+    
+    // Cube vertices (position + normal)
 Vertex cubeVertices[] = {
     // Front face
-    {{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, 0.0f, 1.0f},
-    {{0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, 0.0f, 1.0f},
-    {{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, 0.0f, 1.0f},
-    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, 0.0f, 1.0f},
+    {{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+    {{0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+    {{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+    
+    // Back face
+    {{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},
+    {{-0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},
+    {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},
+    {{0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}},
+    
+    // Top face
+    {{-0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{-0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
+    
+    // Bottom face
+    {{-0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}},
+    {{0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}},
+    {{0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}},
+    {{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}},
+    
+    // Right face
+    {{0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}},
+    
+    // Left face
+    {{-0.5f, -0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}},
+    {{-0.5f, -0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}},
+    {{-0.5f, 0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}},
+    {{-0.5f, 0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}}
+    };
+    
+    // Cube indices
+    uint16_t cubeIndices[] = {
+        0, 1, 2, 2, 3, 0,       // Front face
+        4, 5, 6, 6, 7, 4,       // Back face
+        8, 9, 10, 10, 11, 8,    // Top face
+        12, 13, 14, 14, 15, 12, // Bottom face
+        16, 17, 18, 18, 19, 16, // Right face
+        20, 21, 22, 22, 23, 20  // Left face
+    };
+    
+    // Pack for the GPU
+    const int cubeVertexCount = sizeof(cubeVertices) / sizeof(Vertex);
+    PackedVertex packedVertices[cubeVertexCount];
+    for (int i = 0; i < cubeVertexCount; i++) {
+        packedVertices[i] = PackVertex(cubeVertices[i].position, cubeVertices[i].normal, 0,
+                                       kLanderPositionOrigin, kLanderPositionExtent);
+    }
+    
+    // Create vertex buffer
+    mLanderVertexBuffer = mHeapAllocator.NewBuffer(packedVertices, sizeof(packedVertices));
+    
+    // Create index buffer
+    mLanderIndexBuffer = mHeapAllocator.NewBuffer(cubeIndices, sizeof(cubeIndices));
+    
+    // Store counts
+    mLanderVertexCount = cubeVertexCount;
+    mLanderIndexCount = sizeof(cubeIndices) / sizeof(uint16_t);
+    
+    LOG_INFO("Created cube model with %d vertices and %d indices", mLanderVertexCount, mLanderIndexCount);
+}
+
+bool Renderer3D_Metal::CreateLanderMesh() {
+    LanderMesh mesh;
+    if (!mesh.Load(mLanderMeshFile.c_str(), mLanderMeshCacheFile.empty() ? nullptr : mLanderMeshCacheFile.c_str())) {
+        return false;
+    }
+    
+    // LanderMeshVertex is PackedVertex over the cube's position range
+    const std::vector<LanderMeshVertex>& vertices = mesh.GetVertices();
+    const std::vector<uint32_t>& indices = mesh.GetIndices();
+    mLanderMeshVertexBuffer = mHeapAllocator.NewBuffer(vertices.data(), vertices.size() * sizeof(LanderMeshVertex));
+    mLanderMeshIndexBuffer = mHeapAllocator.NewBuffer(indices.data(), indices.size() * sizeof(uint32_t));
+    if (!mLanderMeshVertexBuffer || !mLanderMeshIndexBuffer) {
+        LOG_ERROR("Failed to create lander mesh buffers");
+        if (mLanderMeshVertexBuffer) { mHeapAllocator.Free(mLanderMeshVertexBuffer); mLanderMeshVertexBuffer = nullptr; }
+        if (mLanderMeshIndexBuffer) { mHeapAllocator.Free(mLanderMeshIndexBuffer); mLanderMeshIndexBuffer = nullptr; }
+        return false;
+    }
+    mLanderMeshLods = mesh.GetLods();
+    
+    LOG_INFO("Created lander mesh from %s: %zu levels, %u to %u triangles", mLanderMeshFile.c_str(),
+             mLanderMeshLods.size(), mLanderMeshLods.back().indexCount / 3, mLanderMeshLods[0].indexCount / 3);
+    return true;
+}
+
+void Renderer3D_Metal::Shutdown() {
+    // Release Metal objects in reverse order of creation
+    
+    // Submit a frame that was started but never presented, then make sure the
+    // GPU no longer references anything we are about to release
+    if (mRenderEncoder) { EndRenderEncoder(); }
+    mScenePassOpen = false;
+    if (mCommandBuffer) { mCommandBuffer->commit(); mCommandBuffer = nullptr; }
+    if (mFramePool) { mFramePool->release(); mFramePool = nullptr; }
+    mDrawable = nullptr;
+    ReleaseFrameTargets();
+    if (mSpikeFramesLeft > 0) {
+        mSpikeFramesLeft = 0;
+        FinishSpikeCapture();
+    }
+    WaitForFramesInFlight();
+    mVideoRecorder.Stop();
+    for (NS::Object* object : mPendingReleases) {
+        object->release();
+    }
+    mPendingReleases.clear();
+    
+    // A terrain load still writes into the height textures
+    if (mTerrainIOCommands) {
+        mTerrainIOCommands->waitUntilCompleted();
+        mTerrainIOCommands->release();
+        mTerrainIOCommands = nullptr;
+    }
+    if (mTerrainIOHandle) { mTerrainIOHandle->release(); mTerrainIOHandle = nullptr; }
+    
+    // Background builds call back into this object, so let them finish and
+    // drop the ones never installed
+    {
+        std::unique_lock<std::mutex> lock(mPipelineMutex);
+        mPipelineCondition.wait(lock, [this] {
+            if (mLibraryPending) return false;
+            for (const PipelineBuild& build : mPipelineBuilds) {
+                if (build.pending && !build.finished) return false;
+            }
+            return true;
+        });
+        for (PipelineBuild& build : mPipelineBuilds) {
+            if (build.state) build.state->release();
+            if (build.renderDescriptor) build.renderDescriptor->release();
+            if (build.computeDescriptor) build.computeDescriptor->release();
+            if (build.tileDescriptor) build.tileDescriptor->release();
+            if (build.meshDescriptor) build.meshDescriptor->release();
+            build = PipelineBuild();
+        }
+        mPipelinesPending = 0;
+    }
+    
+    // Release buffers
+    if (mLanderVertexBuffer) { mHeapAllocator.Free(mLanderVertexBuffer); mLanderVertexBuffer = nullptr; }
+    if (mLanderIndexBuffer) { mHeapAllocator.Free(mLanderIndexBuffer); mLanderIndexBuffer = nullptr; }
+    if (mLanderMeshVertexBuffer) { mHeapAllocator.Free(mLanderMeshVertexBuffer); mLanderMeshVertexBuffer = nullptr; }
+    if (mLanderMeshIndexBuffer) { mHeapAllocator.Free(mLanderMeshIndexBuffer); mLanderMeshIndexBuffer = nullptr; }
+    mLanderMeshLods.clear();
+    if (mTerrainVertexBuffer) { mHeapAllocator.Free(mTerrainVertexBuffer); mTerrainVertexBuffer = nullptr; }
+    if (mTerrainIndexBuffer) { mHeapAllocator.Free(mTerrainIndexBuffer); mTerrainIndexBuffer = nullptr; }
+    if (mTerrainMeshletBuffer) { mHeapAllocator.Free(mTerrainMeshletBuffer); mTerrainMeshletBuffer = nullptr; }
+    if (mUniformRingBuffer) { mHeapAllocator.Free(mUniformRingBuffer); mUniformRingBuffer = nullptr; }
+    if (mTerrainStagingBuffer) { mHeapAllocator.Free(mTerrainStagingBuffer); mTerrainStagingBuffer = nullptr; }
+    if (mOverlayVertexBuffer) { mHeapAllocator.Free(mOverlayVertexBuffer); mOverlayVertexBuffer = nullptr; }
+    if (mGlyphAtlasTexture) { mHeapAllocator.Free(mGlyphAtlasTexture); mGlyphAtlasTexture = nullptr; }
+    if (mLanderInstanceBuffer) { mHeapAllocator.Free(mLanderInstanceBuffer); mLanderInstanceBuffer = nullptr; }
+    if (mTerrainTessFactorBuffer) { mHeapAllocator.Free(mTerrainTessFactorBuffer); mTerrainTessFactorBuffer = nullptr; }
+    if (mTerrainCullChunkBuffer) { mHeapAllocator.Free(mTerrainCullChunkBuffer); mTerrainCullChunkBuffer = nullptr; }
+    if (mTerrainCullArgumentBuffer) { mHeapAllocator.Free(mTerrainCullArgumentBuffer); mTerrainCullArgumentBuffer = nullptr; }
+    if (mTerrainTableArgumentBuffer) { mHeapAllocator.Free(mTerrainTableArgumentBuffer); mTerrainTableArgumentBuffer = nullptr; }
+    if (mTerrainIndirectCommands) { mTerrainIndirectCommands->release(); mTerrainIndirectCommands = nullptr; }
+    if (mParticleBuffer) { mHeapAllocator.Free(mParticleBuffer); mParticleBuffer = nullptr; }
+    if (mGpuTimestampBuffer) { mGpuTimestampBuffer->release(); mGpuTimestampBuffer = nullptr; }
+    
+    // Release frame semaphore
+    if (mFrameSemaphore) { dispatch_release(mFrameSemaphore); mFrameSemaphore = nullptr; }
+    
+    // Release textures
+    if (mDepthTexture) { mDepthTexture->release(); mDepthTexture = nullptr; }
+    if (mTerrainHeightTexture) { mHeapAllocator.Free(mTerrainHeightTexture); mTerrainHeightTexture = nullptr; }
+    if (mTerrainHeightRangeTexture) { mHeapAllocator.Free(mTerrainHeightRangeTexture); mTerrainHeightRangeTexture = nullptr; }
+    if (mTerrainNormalTexture) { mHeapAllocator.Free(mTerrainNormalTexture); mTerrainNormalTexture = nullptr; }
+    if (mTerrainFlagTexture) { mHeapAllocator.Free(mTerrainFlagTexture); mTerrainFlagTexture = nullptr; }
+    if (mTerrainHorizonTexture) { mHeapAllocator.Free(mTerrainHorizonTexture); mTerrainHorizonTexture = nullptr; }
+    if (mTerrainShadowMap) { mHeapAllocator.Free(mTerrainShadowMap); mTerrainShadowMap = nullptr; }
+    if (mLanderShadowMap) { mHeapAllocator.Free(mLanderShadowMap); mLanderShadowMap = nullptr; }
+    for (MTL::Texture* view : mHiZLevels) {
+        view->release();
+    }
+    mHiZLevels.clear();
+    if (mHiZTexture) { mHeapAllocator.Free(mHiZTexture); mHiZTexture = nullptr; }
+    ReleaseGBuffer();
+    if (mSceneColorTexture) { mSceneColorTexture->release(); mSceneColorTexture = nullptr; }
+    if (mSceneDepthTexture) { mSceneDepthTexture->release(); mSceneDepthTexture = nullptr; }
+    if (mSceneMotionTexture) { mSceneMotionTexture->release(); mSceneMotionTexture = nullptr; }
+    if (mUpscaledTexture) { mUpscaledTexture->release(); mUpscaledTexture = nullptr; }
+    if (mMemorylessSceneDepth) { mMemorylessSceneDepth->release(); mMemorylessSceneDepth = nullptr; }
+    if (mMemorylessOverlayDepth) { mMemorylessOverlayDepth->release(); mMemorylessOverlayDepth = nullptr; }
+    if (mVariableRateTexture) { mVariableRateTexture->release(); mVariableRateTexture = nullptr; }
+    if (mRateMap) { mRateMap->release(); mRateMap = nullptr; }
+    if (mRateMapParameters) { mRateMapParameters->release(); mRateMapParameters = nullptr; }
+    if (mRenderTargetHeap) { mRenderTargetHeap->release(); mRenderTargetHeap = nullptr; }
+    if (mSpatialScaler) { mSpatialScaler->release(); mSpatialScaler = nullptr; }
+    if (mTemporalScaler) { mTemporalScaler->release(); mTemporalScaler = nullptr; }
+    
+    mTerrainRayTracer.Shutdown();
+    
+    // Every heap resource has been freed above and the GPU is idle
+    mHeapAllocator.Shutdown();
+    
+    // Release render pass descriptors
+    if (mRenderPassDescriptor) { mRenderPassDescriptor->release(); mRenderPassDescriptor = nullptr; }
+    if (mOverlayPassDescriptor) { mOverlayPassDescriptor->release(); mOverlayPassDescriptor = nullptr; }
+    
+    // Release pipeline states
+    for (MTL::RenderPipelineState*& state : mScenePipelineStates) {
+        if (state) { state->release(); state = nullptr; }
+    }
+    if (mDepthStencilState) { mDepthStencilState->release(); mDepthStencilState = nullptr; }
+    if (mLanderInstancePipelineState) { mLanderInstancePipelineState->release(); mLanderInstancePipelineState = nullptr; }
+    if (mOverlayPipelineState) { mOverlayPipelineState->release(); mOverlayPipelineState = nullptr; }
+    if (mOverlayDepthState) { mOverlayDepthState->release(); mOverlayDepthState = nullptr; }
+    for (MTL::RenderPipelineState*& state : mTerrainMapPipelineStates) {
+        if (state) { state->release(); state = nullptr; }
+    }
+    for (MTL::RenderPipelineState*& state : mTerrainMeshPipelineStates) {
+        if (state) { state->release(); state = nullptr; }
+    }
+    if (mTerrainTessPipelineState) { mTerrainTessPipelineState->release(); mTerrainTessPipelineState = nullptr; }
+    if (mTerrainTessFactorPipeline) { mTerrainTessFactorPipeline->release(); mTerrainTessFactorPipeline = nullptr; }
+    for (MTL::RenderPipelineState*& state : mTerrainTablePipelineStates) {
+        if (state) { state->release(); state = nullptr; }
+    }
+    if (mTerrainTableArgumentEncoder) { mTerrainTableArgumentEncoder->release(); mTerrainTableArgumentEncoder = nullptr; }
+    for (MTL::RenderPipelineState*& state : mTerrainChunkPipelineStates) {
+        if (state) { state->release(); state = nullptr; }
+    }
+    if (mTerrainCullPipeline) { mTerrainCullPipeline->release(); mTerrainCullPipeline = nullptr; }
+    if (mTerrainCullArgumentEncoder) { mTerrainCullArgumentEncoder->release(); mTerrainCullArgumentEncoder = nullptr; }
+    if (mHiZDepthPipeline) { mHiZDepthPipeline->release(); mHiZDepthPipeline = nullptr; }
+    if (mHiZReducePipeline) { mHiZReducePipeline->release(); mHiZReducePipeline = nullptr; }
+    if (mTerrainHeightPipeline) { mTerrainHeightPipeline->release(); mTerrainHeightPipeline = nullptr; }
+    if (mTerrainVertexPipeline) { mTerrainVertexPipeline->release(); mTerrainVertexPipeline = nullptr; }
+    if (mParticleEmitPipeline) { mParticleEmitPipeline->release(); mParticleEmitPipeline = nullptr; }
+    if (mParticleUpdatePipeline) { mParticleUpdatePipeline->release(); mParticleUpdatePipeline = nullptr; }
+    if (mParticlePipelineState) { mParticlePipelineState->release(); mParticlePipelineState = nullptr; }
+    if (mParticleDepthState) { mParticleDepthState->release(); mParticleDepthState = nullptr; }
+    if (mShadowCasterPipelineState) { mShadowCasterPipelineState->release(); mShadowCasterPipelineState = nullptr; }
+    if (mShadowTerrainMapPipelineState) { mShadowTerrainMapPipelineState->release(); mShadowTerrainMapPipelineState = nullptr; }
+    if (mShadowPassDescriptor) { mShadowPassDescriptor->release(); mShadowPassDescriptor = nullptr; }
+    if (mLightCullPipelineState) { mLightCullPipelineState->release(); mLightCullPipelineState = nullptr; }
+    if (mDeferredLightingPipelineState) { mDeferredLightingPipelineState->release(); mDeferredLightingPipelineState = nullptr; }
+    if (mVariableRateResolvePipelineState) { mVariableRateResolvePipelineState->release(); mVariableRateResolvePipelineState = nullptr; }
+    if (mDeferredDepthState) { mDeferredDepthState->release(); mDeferredDepthState = nullptr; }
+    if (mSkyPipelineState) { mSkyPipelineState->release(); mSkyPipelineState = nullptr; }
+    if (mSkyDepthState) { mSkyDepthState->release(); mSkyDepthState = nullptr; }
+    if (mPipelineArchive) { mPipelineArchive->release(); mPipelineArchive = nullptr; }
+    
+    // Release shader library
+    if (mShaderLibrary) { mShaderLibrary->release(); mShaderLibrary = nullptr; }
+    
+    // Release command queues
+    if (mTerrainIOEvent) { mTerrainIOEvent->release(); mTerrainIOEvent = nullptr; }
+    if (mIOCommandQueue) { mIOCommandQueue->release(); mIOCommandQueue = nullptr; }
+    if (mCommandQueue) { mCommandQueue->release(); mCommandQueue = nullptr; }
+    
+    // Release Metal layer using the bridge
+    if (mMetalLayer) {
+    // We don't call release on mMetalLayer directly because it's managed by Objective-C
+    ReleaseCAMetalLayer(reinterpret_cast<void*>(mMetalLayer));
+    mMetalLayer = nullptr;
+    }
+    
+    // Release Metal device
+    if (mDevice) { mDevice->release(); mDevice = nullptr; }
+    
+    // Destroy SDL window
+    if (mWindow) {
+        SDL_DestroyWindow(mWindow);
+        mWindow = nullptr;
+    }
+    
+    // Only the video subsystem: the game keeps SDL running, and the other
+    // renderer may still have a window open
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    
+    mInitialized = false;
+}
+
+void Renderer3D_Metal::Clear() {
+    PROFILE_ZONE("Metal Begin Frame");
+    if (!mInitialized) return;
+    
+    // Install finished pipeline builds; the frame needs the required ones
+    PollPipelines(RequiredPipelines());
+    if (!mInitialized) return;
+    
+    // Capture the frames after a slow one, before this one encodes anything
+    if (mSpikeCaptureMs > 0.0f) {
+        UpdateSpikeCapture();
+    }
+    
+    // Follow a resize or a move to a display with a different scale before
+    // the frame is set up, so the drawable, targets and projection match
+    if (mDrawableSizeDirty) {
+        mDrawableSizeDirty = false;
+        UpdateDrawableSize();
+    }
+    
+    // Pick this frame's scene resolution from the last GPU frame time, then
+    // the jitter, which is relative to it
+    if (mUseDynamicResolution) {
+        UpdateRenderScale();
+    }
+    if (mTemporalScaler) {
+        UpdateJitter();
+    }
+    
+    // The camera may have moved since the last frame
+    UpdateCameraMatrices();
+    
+    // Drop a frame that was started but never presented
+    mRenderQueue.Reset();
+    if (mRenderEncoder) {
+        EndRenderEncoder();
+    }
+    mScenePassOpen = false;
+    ReleaseFrameTargets();
+    if (mCommandBuffer) {
+        // Commit without presenting so the completion handler frees the ring slot
+        mCommandBuffer->commit();
+    }
+    if (mFramePool) {
+        mFramePool->release();
+        mFramePool = nullptr;
+    }
+    mCommandBuffer = nullptr;
+    mDrawable = nullptr;
+    
+    // Wait for the GPU to release the oldest ring slot before overwriting it
+    dispatch_semaphore_wait(mFrameSemaphore, DISPATCH_TIME_FOREVER);
+    mFrameSlot = (mFrameSlot + 1) % mFramesInFlight;
+    mUniformWriteOffset = 0;
+    mLanderInstanceWriteCount = 0;
+    
+    // Autoreleased objects (drawable, command buffer, encoder) live until Present()
+    mFramePool = NS::AutoreleasePool::alloc()->init();
+    
+    // Take exactly one drawable for the whole frame
+    mDrawable = mMetalLayer->nextDrawable();
+    if (!mDrawable) {
+        mFramePool->release();
+        mFramePool = nullptr;
+        dispatch_semaphore_signal(mFrameSemaphore);
+        return;
+    }
+    
+    // The clear color is set in the render pass descriptor, so starting the
+    // pass is what clears the screen (or the offscreen scene target)
+    if (!mUseDynamicResolution && !mUseVariableRasterization) {
+        mRenderPassDescriptor->colorAttachments()->object(0)->setTexture(mDrawable->texture());
+    } else if (mUseDynamicResolution && !AllocateSceneTargets()) {
+        mDrawable = nullptr;
+        mFramePool->release();
+        mFramePool = nullptr;
+        dispatch_semaphore_signal(mFrameSemaphore);
+        return;
+    }
+    
+    // The scene is presented or upscaled; only the temporal scaler reads
+    // its motion and depth, and the Hi-Z reduction its depth
+    uint32_t sceneReads = kPassColor0;
+    if (mTemporalScaler) {
+        sceneReads |= kPassColor1 | kPassDepth;
+    }
+    if (mUseHiZCulling) {
+        sceneReads |= kPassDepth;
+    }
+    CheckPassActions(mRenderPassDescriptor, kPassCheckScene, sceneReads, 0);
+    
+    // Time the scene pass on the GPU
+    mGpuPassCount = 0;
+    AttachGpuTimestamps(mRenderPassDescriptor, "GPU Scene");
+    
+    // Create the single command buffer and render encoder for this frame.
+    // Its completion is the fence for heap ranges freed up to now.
+    mCommandBuffer = mCommandQueue->commandBuffer();
+    uint64_t heapSerial = mHeapAllocator.BeginFrame();
+    
+    // Objects retired between frames are released once this one completes
+    for (NS::Object* object : mPendingReleases) {
+        ReleaseAfterFrame(object);
+    }
+    mPendingReleases.clear();
+    
+    // Resolve the frame's GPU timestamps, then hand the ring slot back once
+    // the GPU has finished reading it
+    dispatch_semaphore_t frameSemaphore = mFrameSemaphore;
+    int frameSlot = mFrameSlot;
+    int passCount = mGpuPassCount;
+    std::array<const char*, kMaxGpuPasses> passNames;
+    std::copy(mGpuPassNames, mGpuPassNames + kMaxGpuPasses, passNames.begin());
+    mCommandBuffer->addCompletedHandler([this, frameSemaphore, frameSlot, passCount, passNames,
+                                         heapSerial](MTL::CommandBuffer* commandBuffer) {
+        ResolveGpuTimestamps(frameSlot, passCount, passNames.data());
+        mHeapAllocator.FrameCompleted(heapSerial);
+        double gpuTime = commandBuffer->GPUEndTime() - commandBuffer->GPUStartTime();
+        mLastGpuFrameTime.store(gpuTime, std::memory_order_relaxed);
+#if ENABLE_PROFILER
+        // The whole command buffer as a stage of its own, placed as ending now
+        uint64_t profilerNow = Profiler::Now();
+        uint64_t gpuNs = static_cast<uint64_t>(std::max(gpuTime, 0.0) * 1e9);
+        if (gpuNs > 0 && gpuNs < profilerNow) {
+            Profiler::Record("GPU Frame", profilerNow - gpuNs, profilerNow);
+        }
+#endif
+        if (mUseDynamicResolution) {
+            mGpuFrameTime.store(gpuTime);
+        }
+        dispatch_semaphore_signal(frameSemaphore);
+    });
+    
+    // Centered on where the lander was last frame
+    if (mUseVariableRasterization) {
+        UpdateRateMap();
+    }
+    
+    // One encoder for the pass, or the first sub-encoder of a parallel one
+    // that terrain chunk slices add more to
+    if (mUseParallelEncoding) {
+        mParallelEncoder = mCommandBuffer->parallelRenderCommandEncoder(mRenderPassDescriptor);
+        mRenderEncoder = mParallelEncoder->renderCommandEncoder();
+    } else {
+        mRenderEncoder = mCommandBuffer->renderCommandEncoder(mRenderPassDescriptor);
+    }
+    mScenePassOpen = mUseDynamicResolution || mUseVariableRasterization;
+    
+    // Shadow maps; the lander cascade holds nothing until this frame's
+    // lander is drawn into it
+    if (mUseShadows) {
+        mFragmentUniforms.shadowParams[3] = 0.0f;
+    }
+    
+    // Fragment uniforms are constant for the frame, but for what the shadow
+    // passes add to them
+    mSceneFragmentBufferMask = 0;
+    mFragmentUniformOffsets.clear();
+    if (AllocateFragmentUniforms(mSceneFragmentBufferOffsets[0])) {
+        mSceneFragmentBufferMask |= 1u << 0;
+    }
+    
+    // So are the motion vector matrices (indirect terrain draws bind them
+    // whether or not the fragment shader reads them)
+    if (AllocateUniforms(&mMotionUniforms, sizeof(MotionUniforms), mMotionUniformOffset)) {
+        mSceneFragmentBufferOffsets[1] = mMotionUniformOffset;
+        mSceneFragmentBufferMask |= 1u << 1;
+    }
+    
+    // And the point lights, read by fragment_main or, deferred, by the
+    // lighting pass once the opaque scene is drawn
+    PointLightUniforms pointLights;
+    std::memset(&pointLights, 0, sizeof(pointLights));
+    pointLights.count = static_cast<uint32_t>(mPointLights.size());
+    for (size_t i = 0; i < mPointLights.size(); i++) {
+        const PointLight& light = mPointLights[i];
+        for (int j = 0; j < 3; j++) {
+            pointLights.lights[i].positionRadius[j] = light.position[j];
+            pointLights.lights[i].color[j] = light.color[j];
+        }
+        pointLights.lights[i].positionRadius[3] = light.radius;
+    }
+    bool lightsUploaded = AllocateUniforms(&pointLights, sizeof(pointLights), mPointLightOffset);
+    if (lightsUploaded) {
+        mSceneFragmentBufferOffsets[2] = mPointLightOffset;
+        mSceneFragmentBufferMask |= 1u << 2;
+    }
+    
+    // State shared by every draw in the frame
+    BindSceneState(mRenderEncoder);
+    mLightingPending = mUseDeferredLighting && lightsUploaded && pointLights.count > 0 &&
+                       mLightCullPipelineState && mDeferredLightingPipelineState;
+    mSkyPending = mSkyPipelineState != nullptr;
+}
+
+void Renderer3D_Metal::Present() {
+    PROFILE_ZONE("Metal Present");
+    if (!mInitialized || !mRenderEncoder) return;
+    
+    // Light and upscale into the drawable if nothing drew over the scene
+    ResolveDeferredLighting();
+    FinishScenePass();
+    
+    // End encoding
+    EndRenderEncoder();
+    if (!mUseDynamicResolution) {
+        BuildHiZPyramid(mDepthTexture, mDrawableWidth, mDrawableHeight);
+    }
+    
+    // The finished frame into the recording, read back once it completes
+    if (mVideoRecorder.IsRecording()) {
+        mVideoRecorder.CaptureFrame(mCommandBuffer, mDrawable->texture(), Profiler::Now());
+        Profiler::SetCounter("Video Frames Dropped", static_cast<int64_t>(mVideoRecorder.GetStats().dropped));
+    }
+    
+    // Follow the frame to the display for the latency samples it carries
+    uint64_t latencyFrame = LatencyTracker::OnFrameSubmitted();
+    if (latencyFrame != 0) {
+        mCommandBuffer->addCompletedHandler([latencyFrame](MTL::CommandBuffer*) {
+            LatencyTracker::OnFrameCompleted(latencyFrame);
+        });
+        mDrawable->addPresentedHandler([latencyFrame](MTL::Drawable* drawable) {
+            CFTimeInterval presented = drawable->presentedTime();
+            LatencyTracker::OnFramePresented(latencyFrame,
+                                             presented > 0.0 ? LatencyTracker::FromHostSeconds(presented) : 0);
+        });
+    }
+    
+    // Present drawable
+    mCommandBuffer->presentDrawable(mDrawable);
+    
+    // Commit command buffer
+    mCommandBuffer->commit();
+    mCommandBuffer = nullptr;
+    mDrawable = nullptr;
+    if (mSpikeFramesLeft > 0 && --mSpikeFramesLeft == 0) {
+        FinishSpikeCapture();
+    }
+    
+    // Clean up the frame's autoreleased objects
+    if (mUseDynamicResolution) {
+        mOverlayPassDescriptor->colorAttachments()->object(0)->setTexture(nullptr);
+        if (mDepthTexture && !mMemorylessOverlayDepth) {
+            mDepthTexture->makeAliasable();
+        }
+        ReleaseFrameTargets();
+    } else if (mUseVariableRasterization) {
+        mOverlayPassDescriptor->colorAttachments()->object(0)->setTexture(nullptr);
+    } else {
+        mRenderPassDescriptor->colorAttachments()->object(0)->setTexture(nullptr);
+    }
+    mFramePool->release();
+    mFramePool = nullptr;
+    
+    if (!mFirstFramePresented) {
+        mFirstFramePresented = true;
+        uint64_t now = Profiler::Now();
+        Profiler::Record("Renderer First Frame", mInitializeStartNs, now);
+        LOG_INFO("First frame presented %.1f ms after renderer start", (now - mInitializeStartNs) / 1.0e6);
+    }
+}
+
+// Draws are only recorded into the frame's encoder; Clear() opens the pass
+// and Present() submits it
+
+void Renderer3D_Metal::RenderLander(Lander* lander) {
+    PROFILE_ZONE("Metal Lander");
+    if (!mInitialized || !lander || !mRenderEncoder) return;
+    
+    // Get lander properties (interpolated between fixed physics steps)
+    const float* position = lander->GetRenderPosition();
+    const Quaternion& orientation = lander->GetRenderOrientation();
+    const float* scale = lander->GetScale();
+    
+    // Update model uniforms
+    UpdateModelUniforms(position, orientation, scale);
+    SetPositionDecode(kLanderPositionOrigin, kLanderPositionExtent);
+    SetLodMorph(0.0f, 0.0f);
+    const LanderDraw draw = GetLanderDraw(SelectLanderLod(position, std::max({ scale[0], scale[1], scale[2] })));
+    if (mUseShadows) {
+        RenderLanderShadow(position, scale, draw);
+    }
+    
+    // The next frame's rate map centers on the lander's screen position;
+    // behind the camera it keeps the last one
+    if (mUseVariableRasterization) {
+        const Matrix4x4 viewProjection = SimdMath::Multiply(mProjectionMatrix, mViewMatrix);
+        float clip[4];
+        SimdMath::TransformPoint(viewProjection, position, clip);
+        if (clip[3] > 0.0f) {
+            mRateMapFocus[0] = std::clamp(0.5f + 0.5f * clip[0] / clip[3], 0.0f, 1.0f);
+            mRateMapFocus[1] = std::clamp(0.5f - 0.5f * clip[1] / clip[3], 0.0f, 1.0f);
+        }
+    }
+    
+    // Set uniforms (each draw gets its own ring sub-allocation)
+    size_t uniformOffset = 0;
+    if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset)) return;
+    RenderPacket packet = MakeLanderPacket(draw, mScenePipelineStates[kShaderVariantLander], uniformOffset);
+    
+    // The lander moves, so its motion vectors also map each surface point
+    // back to where the lander's last model matrix had it
+    if (mTemporalScaler) {
+        MotionUniforms motion = mMotionUniforms;
+        if (mHasPreviousLanderModel) {
+            Matrix4x4 previousFromCurrent = SimdMath::Multiply(mPreviousLanderModel,
+                                                               SimdMath::InverseAffine(mModelMatrix));
+            std::memcpy(motion.previousFromCurrent, previousFromCurrent.values, sizeof(previousFromCurrent.values));
+        }
+        mPreviousLanderModel = mModelMatrix;
+        mHasPreviousLanderModel = true;
+        
+        size_t motionOffset = 0;
+        if (AllocateUniforms(&motion, sizeof(MotionUniforms), motionOffset)) {
+            packet.fragmentBuffer = mUniformRingBuffer;
+            packet.fragmentOffset = motionOffset;
+        }
+    }
+    
+    // Queued with the lander's shading
+    mRenderQueue.Submit(RenderQueue::MakeKey(RenderQueuePass::Opaque, kQueuePipelineLander, draw.material,
+                                             QueueDepth(position)), packet);
+}
+
+void Renderer3D_Metal::RenderPredictedImpact(const float* position) {
+    PROFILE_ZONE("Metal Impact Marker");
+    if (!mInitialized || !position || !mRenderEncoder) return;
+    
+    // A thin slab of the lander's cube lying on the surface
+    const float scale[3] = { 1.5f, 0.05f, 1.5f };
+    const float center[3] = { position[0], position[1] + scale[1] / 2, position[2] };
+    const Quaternion identity = { 0.0f, 0.0f, 0.0f, 1.0f };
+    UpdateModelUniforms(center, identity, scale);
+    SetPositionDecode(kLanderPositionOrigin, kLanderPositionExtent);
+    SetLodMorph(0.0f, 0.0f);
+    
+    size_t uniformOffset = 0;
+    if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset)) return;
+    const LanderDraw draw = GetLanderDraw(-1);
+    mRenderQueue.Submit(RenderQueue::MakeKey(RenderQueuePass::Opaque, kQueuePipelineLander, draw.material,
+                                             QueueDepth(center)),
+                        MakeLanderPacket(draw, mScenePipelineStates[kShaderVariantLander], uniformOffset));
+}
+
+// Batch landers handed to each job when filling the instance ring
+static const size_t kLanderInstancesPerJob = 2048;
+
+// Render queue pipeline slots of the scene's object draws, in drawing order
+// (materials are LanderDraw::material)
+enum {
+    kQueuePipelineLander = 0,
+    kQueuePipelineLanderInstances = 1,
+};
+
+// Distance over the far plane, for render queue keys
+float Renderer3D_Metal::QueueDepth(const float* position) const {
+    const float dx = position[0] - mCameraPosition[0];
+    const float dy = position[1] - mCameraPosition[1];
+    const float dz = position[2] - mCameraPosition[2];
+    return std::sqrt(dx * dx + dy * dy + dz * dz) / kCameraFar;
+}
+
+// An uninstanced packet of the draw's geometry with vertex uniforms at
+// uniformOffset in the ring and the scene's depth test
+RenderPacket Renderer3D_Metal::MakeLanderPacket(const LanderDraw& draw, MTL::RenderPipelineState* pipeline,
+                                                size_t uniformOffset) const {
+    RenderPacket packet = {};
+    packet.pipeline = pipeline;
+    packet.depthState = mDepthStencilState;
+    packet.vertexBuffers[0] = draw.vertexBuffer;
+    packet.vertexBuffers[1] = mUniformRingBuffer;
+    packet.vertexOffsets[1] = uniformOffset;
+    packet.indexBuffer = draw.indexBuffer;
+    packet.indexOffset = draw.indexOffset;
+    packet.indexCount = draw.indexCount;
+    packet.wideIndices = draw.wideIndices;
+    return packet;
+}
+
+// Encode the queued object draws, then hand the encoder back in the
+// scene's state
+void Renderer3D_Metal::FlushRenderQueue() {
+    if (mRenderQueue.IsEmpty()) return;
+    PROFILE_SCOPE("Render Queue");
+    const bool motion = (mSceneFragmentBufferMask & (1u << 1)) != 0;
+    mRenderQueue.Flush(mRenderEncoder, motion ? mUniformRingBuffer : nullptr, mMotionUniformOffset);
+    if (!mRenderEncoder) return;
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
+    
+    const RenderQueueStats& stats = mRenderQueue.GetStats();
+    Profiler::SetCounter("Queued Draws", stats.packets);
+    Profiler::SetCounter("Queued Binds Skipped", stats.skippedBinds);
+}
+
+Renderer3D_Metal::LanderDraw Renderer3D_Metal::GetLanderDraw(int lod) const {
+    LanderDraw draw;
+    if (lod < 0 || lod >= static_cast<int>(mLanderMeshLods.size())) {
+        draw.vertexBuffer = mLanderVertexBuffer;
+        draw.indexBuffer = mLanderIndexBuffer;
+        draw.wideIndices = false;
+        draw.indexOffset = 0;
+        draw.indexCount = static_cast<uint32_t>(mLanderIndexCount);
+        draw.material = 0;
+    } else {
+        draw.vertexBuffer = mLanderMeshVertexBuffer;
+        draw.indexBuffer = mLanderMeshIndexBuffer;
+        draw.wideIndices = true;
+        draw.indexOffset = mLanderMeshLods[lod].firstIndex * sizeof(uint32_t);
+        draw.indexCount = mLanderMeshLods[lod].indexCount;
+        draw.material = static_cast<uint32_t>(1 + lod);
+    }
+    return draw;
+}
+
+// A level's error is in unit cube sides, so one side's projected size
+// scales it to pixels; -1 (the cube) without a mesh
+int Renderer3D_Metal::SelectLanderLod(const float* position, float extent) const {
+    if (mLanderMeshLods.empty()) return -1;
+    const float dx = position[0] - mCameraPosition[0];
+    const float dy = position[1] - mCameraPosition[1];
+    const float dz = position[2] - mCameraPosition[2];
+    const float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), kCameraNear);
+    const float pixelsPerRadian = 0.5f * mHeight * mProjectionMatrix.values[5];
+    return LanderMesh::SelectLod(mLanderMeshLods, extent * pixelsPerRadian / distance, kLanderMaxScreenError);
+}
+
+// Floats per crash fragment handed to RenderDebris (Physics::GetDebris)
+static const int kDebrisPieceFloats = 10;
+
+// Room for up to requested more instances in this frame's slot (the frame
+// semaphore guarantees the GPU is done with it), after whatever the frame
+// has already drawn from it; first is the index within the slot
+LanderInstance* Renderer3D_Metal::ReserveLanderInstances(size_t requested, size_t& first, size_t& count) {
+    first = mLanderInstanceWriteCount;
+    count = std::min(requested, kMaxLanderInstances - first);
+    mLanderInstanceWriteCount += count;
+    return static_cast<LanderInstance*>(mLanderInstanceBuffer->contents()) + mFrameSlot * kMaxLanderInstances + first;
+}
+
+// The draw's geometry once per instance, from first on in this frame's slot
+void Renderer3D_Metal::DrawLanderInstances(size_t first, size_t count, const LanderDraw& draw) {
+    // The rest of the uniforms are shared by every instance
+    SetPositionDecode(kLanderPositionOrigin, kLanderPositionExtent);
+    SetLodMorph(0.0f, 0.0f);
+    size_t uniformOffset = 0;
+    if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset)) return;
+    
+    // Runs of instances spread over the scene, so they sort on their
+    // geometry alone
+    RenderPacket packet = MakeLanderPacket(draw, mLanderInstancePipelineState, uniformOffset);
+    packet.vertexBuffers[2] = mLanderInstanceBuffer;
+    packet.vertexOffsets[2] = (mFrameSlot * kMaxLanderInstances + first) * sizeof(LanderInstance);
+    packet.instanceCount = static_cast<uint32_t>(count);
+    mRenderQueue.Submit(RenderQueue::MakeKey(RenderQueuePass::Opaque, kQueuePipelineLanderInstances, draw.material,
+                                             0.0f), packet);
+}
+
+void Renderer3D_Metal::RenderLanderBatch(const LanderBatch* batch) {
+    if (!mInitialized || !batch || !mRenderEncoder || !mLanderInstancePipelineState || !mLanderInstanceBuffer) return;
+    
+    size_t first = 0;
+    size_t count = 0;
+    LanderInstance* instances = ReserveLanderInstances(batch->GetCount(), first, count);
+    if (count < batch->GetCount()) {
+        LOG_WARNING_EVERY(1000, "Lander batch of %zu exceeds the instance slot, drawing the first %zu",
+                          batch->GetCount(), count);
+    }
+    if (count == 0) return;
+    PROFILE_SCOPE("Lander Instances");
+    
+    // With a lander mesh, each lander's level from its distance, and the
+    // slot split into one run per level, in batch order within each
+    const float* posX = batch->GetPositionX();
+    const float* posY = batch->GetPositionY();
+    const float* rotation = batch->GetRotation();
+    const float width = batch->GetLanderWidth();
+    const float height = batch->GetLanderHeight();
+    const int lodCount = std::max(static_cast<int>(mLanderMeshLods.size()), 1);
+    size_t lodFirst[LanderMesh::kMaxLods + 1] = {};
+    FrameVector<uint32_t> slots(lodCount > 1 ? count : 0, mFrameArena);
+    if (lodCount > 1) {
+        FrameVector<uint8_t> lods(count, mFrameArena);
+        const float extent = std::max(width, height);
+        auto selectLods = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const float position[3] = { posX[i], posY[i], 0.0f };
+                lods[i] = static_cast<uint8_t>(SelectLanderLod(position, extent));
+            }
+        };
+        if (mJobSystem && count > kLanderInstancesPerJob) {
+            mJobSystem->ParallelFor(count, kLanderInstancesPerJob, selectLods);
+        } else {
+            selectLods(0, count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            lodFirst[lods[i] + 1]++;
+        }
+        for (int lod = 0; lod < lodCount; lod++) {
+            lodFirst[lod + 1] += lodFirst[lod];
+        }
+        size_t next[LanderMesh::kMaxLods];
+        std::copy(lodFirst, lodFirst + lodCount, next);
+        for (size_t i = 0; i < count; i++) {
+            slots[i] = static_cast<uint32_t>(next[lods[i]]++);
+        }
+    } else {
+        lodFirst[1] = count;
+    }
+    
+    // Model matrices straight from the batch's arrays into the slot:
+    // translate, rotate about z as the 2D simulation does, scale the unit
+    // cube to the lander's size. Column-major, like CreateModelMatrix.
+    auto fillInstances = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            float sinValue, cosValue;
+            LanderKernels::SinCosDegrees(rotation[i], sinValue, cosValue);
+            float* m = instances[slots.empty() ? i : slots[i]].modelMatrix;
+            m[0] = cosValue * width;   m[1] = sinValue * width;  m[2] = 0.0f;   m[3] = 0.0f;
+            m[4] = -sinValue * height; m[5] = cosValue * height; m[6] = 0.0f;   m[7] = 0.0f;
+            m[8] = 0.0f;               m[9] = 0.0f;              m[10] = width; m[11] = 0.0f;
+            m[12] = posX[i];           m[13] = posY[i];          m[14] = 0.0f;  m[15] = 1.0f;
+        }
+    };
+    if (mJobSystem && count > kLanderInstancesPerJob) {
+        mJobSystem->ParallelFor(count, kLanderInstancesPerJob, fillInstances);
+    } else {
+        fillInstances(0, count);
+    }
+    
+    // One draw per level in use (the cube without a mesh)
+    for (int lod = 0; lod < lodCount; lod++) {
+        if (lodFirst[lod + 1] > lodFirst[lod]) {
+            DrawLanderInstances(first + lodFirst[lod], lodFirst[lod + 1] - lodFirst[lod],
+                                GetLanderDraw(mLanderMeshLods.empty() ? -1 : lod));
+        }
+    }
+}
+    
+// Fragments are few, so one instanced draw of the lander's cube covers all
+// of them, each scaled to its box (the cube even with a lander mesh)
+void Renderer3D_Metal::RenderDebris(const float* pieces, int count) {
+    if (!mInitialized || !pieces || count <= 0 || !mRenderEncoder || !mLanderInstancePipelineState ||
+        !mLanderInstanceBuffer) return;
+    
+    size_t first = 0;
+    size_t reserved = 0;
+    LanderInstance* instances = ReserveLanderInstances(static_cast<size_t>(count), first, reserved);
+    if (reserved == 0) return;
+    PROFILE_SCOPE("Debris Instances");
+    
+    for (size_t i = 0; i < reserved; i++) {
+        const float* piece = pieces + i * kDebrisPieceFloats;
+        const Quaternion orientation = {piece[3], piece[4], piece[5], piece[6]};
+        const float scale[3] = {2.0f * piece[7], 2.0f * piece[8], 2.0f * piece[9]};
+        Matrix4x4 model = CreateModelMatrix(piece, orientation, scale);
+        std::memcpy(instances[i].modelMatrix, model.values, sizeof(instances[i].modelMatrix));
+    }
+    
+    DrawLanderInstances(first, reserved, GetLanderDraw(-1));
+}
+
+// Particles per second at full strength, and the streams' shapes
+void Renderer3D_Metal::SetPointLights(const PointLight* lights, int count) {
+    if (count > kMaxPointLights) {
+        LOG_WARNING_EVERY(1000, "%d point lights, drawing the first %d", count, kMaxPointLights);
+        count = kMaxPointLights;
+    }
+    mPointLights.assign(lights, lights + std::max(count, 0));
+}
+
+// Matches SkyUniforms in LanderShaders.metal
+struct SkyUniforms {
+    float cameraRight[4];
+    float cameraUp[4];
+    float cameraForward[4];
+    float projection[4];        // P00, P11, P20, P21
+    float earthDirection[4];    // w = cosine of the angular radius
+    float sunDirection[4];
+    float params[4];            // x = radians per pixel; y = star brightness
+};
+
+// The Earth's place in the sky (world space, y up) and its apparent size
+// from the Moon
+static const float kEarthDirection[3] = { 0.32f, 0.55f, -0.77f };
+static const float kEarthAngularRadius = 0.95f * static_cast<float>(M_PI / 180.0);
+static const float kStarBrightness = 1.5f;
+
+void Renderer3D_Metal::DrawSky() {
+    // Once per frame, over whatever the opaque scene left uncovered
+    if (!mSkyPending || !mRenderEncoder || !mSkyPipelineState) return;
+    mSkyPending = false;
+    PROFILE_SCOPE("Sky");
+    
+    // The shader turns each pixel back into a world direction through the
+    // frame's (jittered) projection and the view's rotation, so the stars
+    // sit exactly where the scene's geometry would
+    SkyUniforms sky;
+    std::memset(&sky, 0, sizeof(sky));
+    for (int i = 0; i < 3; i++) {
+        sky.cameraRight[i] = mViewMatrix.values[i * 4 + 0];
+        sky.cameraUp[i] = mViewMatrix.values[i * 4 + 1];
+        sky.cameraForward[i] = -mViewMatrix.values[i * 4 + 2];
+    }
+    sky.projection[0] = mProjectionMatrix.values[0];
+    sky.projection[1] = mProjectionMatrix.values[5];
+    sky.projection[2] = mProjectionMatrix.values[8];
+    sky.projection[3] = mProjectionMatrix.values[9];
+    
+    // The sun as the shadows take it, from the terrain's centre
+    const float earthLength = std::sqrt(kEarthDirection[0] * kEarthDirection[0] +
+                                        kEarthDirection[1] * kEarthDirection[1] +
+                                        kEarthDirection[2] * kEarthDirection[2]);
+    for (int i = 0; i < 3; i++) {
+        sky.earthDirection[i] = kEarthDirection[i] / earthLength;
+        sky.sunDirection[i] = mShadowLightDirection[i];
+    }
+    sky.earthDirection[3] = std::cos(kEarthAngularRadius);
+    const int targetHeight = mUseDynamicResolution ? mSceneHeight : mDrawableHeight;
+    sky.params[0] = 2.0f / (mProjectionMatrix.values[5] * static_cast<float>(std::max(targetHeight, 1)));
+    sky.params[1] = kStarBrightness;
+    size_t skyOffset = 0;
+    if (!AllocateUniforms(&sky, sizeof(sky), skyOffset)) return;
+    
+    // Fragment buffer 4 is past everything the scene binds, which stays
+    // bound for the draws after this one (the sky reads its motion
+    // uniforms at 1)
+    mRenderEncoder->setRenderPipelineState(mSkyPipelineState);
+    mRenderEncoder->setDepthStencilState(mSkyDepthState);
+    mRenderEncoder->setFragmentBuffer(mUniformRingBuffer, skyOffset, 4);
+    mRenderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
+    
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
+}
+
+void Renderer3D_Metal::ResolveDeferredLighting() {
+    FlushRenderQueue();
+    DrawSky();
+    if (!mLightingPending || !mRenderEncoder) return;
+    mLightingPending = false;
+    PROFILE_SCOPE("Deferred Lighting");
+    
+    // Cull per tile into threadgroup memory, then shade every pixel with
+    // its tile's lights; both read the G-buffer straight from tile memory
+    mRenderEncoder->setRenderPipelineState(mLightCullPipelineState);
+    mRenderEncoder->setTileBuffer(mUniformRingBuffer, mPointLightOffset, 0);
+    mRenderEncoder->setThreadgroupMemoryLength(kTileLightsBytes, 0, 0);
+    mRenderEncoder->dispatchThreadsPerTile(MTL::Size(kLightTileSize, kLightTileSize, 1));
+    
+    mRenderEncoder->setRenderPipelineState(mDeferredLightingPipelineState);
+    mRenderEncoder->setDepthStencilState(mDeferredDepthState);
+    mRenderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
+    
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
+}
+
+static const float kExhaustRate = 20000.0f;
+static const float kExhaustSpeed = 40.0f;           // m/s out of the nozzle
+static const float kPlumeDustPerKg = 5000.0f;       // Particles per kilogram the plume lifts
+static const float kContactDustRate = 8000.0f;
+static const float kContactDustSpeed = 2.0f;        // Lander speed (m/s) at which contacts raise the most dust
+static const uint32_t kMaxParticleSpawnsPerFrame = Renderer3D_Metal::kMaxParticles / 4;
+
+// Whole particles of a fractional amount, carrying the rest to the next frame
+static uint32_t TakeParticles(float amount, float& carry) {
+    amount += carry;
+    uint32_t count = static_cast<uint32_t>(amount);
+    carry = amount - static_cast<float>(count);
+    return count;
+}
+
+void Renderer3D_Metal::RenderParticles(const ParticleEmitters& emitters) {
+    if (!mInitialized || !mRenderEncoder || !mParticleBuffer || !mParticleEmitPipeline ||
+        !mParticleUpdatePipeline || !mParticlePipelineState) return;
+    PROFILE_SCOPE("Particles");
+    
+    // Particles are lit by nothing and drawn over the lit scene
+    ResolveDeferredLighting();
+    
+    // Particles age in real time; a stall or a hidden window skips ahead
+    // at most a tenth of a second
+    const uint64_t now = Profiler::Now();
+    const float deltaTime = mParticleLastNs ? std::min(static_cast<float>(now - mParticleLastNs) * 1.0e-9f, 0.1f) : 0.0f;
+    mParticleLastNs = now;
+    
+    ParticleUniforms uniforms;
+    std::memset(&uniforms, 0, sizeof(uniforms));
+    for (int i = 0; i < 3; i++) {
+        uniforms.nozzle[i] = emitters.nozzle[i];
+        uniforms.exhaustDirection[i] = emitters.exhaustDirection[i];
+        uniforms.velocity[i] = emitters.velocity[i];
+        uniforms.originShift[i] = mParticleOriginShift[i];
+        mParticleOriginShift[i] = 0.0f;
+    }
+    uniforms.nozzle[3] = kExhaustSpeed;
+    const float thrust = std::min(std::max(emitters.thrustLevel, 0.0f), 1.0f);
+    
+    // Dust blown off where the engine axis meets the ground, at the rate
+    // the plume erodes the footprint
+    const float altitude = std::max(emitters.nozzle[1] - emitters.groundHeight, 0.0f);
+    float plumeDustRate = 0.0f;
+    if (thrust > 0.0f && emitters.dustRate > 0.0f && emitters.exhaustDirection[1] < -0.1f) {
+        const float reach = altitude / -emitters.exhaustDirection[1];
+        uniforms.plumeCenter[0] = emitters.nozzle[0] + emitters.exhaustDirection[0] * reach;
+        uniforms.plumeCenter[1] = emitters.groundHeight;
+        uniforms.plumeCenter[2] = emitters.nozzle[2] + emitters.exhaustDirection[2] * reach;
+        uniforms.plumeCenter[3] = emitters.plumeRadius;
+        plumeDustRate = kPlumeDustPerKg * emitters.dustRate;
+    }
+    
+    // Dust kicked up at the contacts while the lander still moves
+    const int contactCount = emitters.contacts ? std::min(emitters.contactCount, kMaxParticleContacts) : 0;
+    float contactDustRate = 0.0f;
+    if (contactCount > 0) {
+        for (int c = 0; c < contactCount; c++) {
+            for (int i = 0; i < 3; i++) {
+                uniforms.contacts[c][i] = emitters.contacts[c * 3 + i];
+            }
+        }
+        const float speed = std::sqrt(emitters.velocity[0] * emitters.velocity[0] +
+                                      emitters.velocity[1] * emitters.velocity[1] +
+                                      emitters.velocity[2] * emitters.velocity[2]);
+        uniforms.contactStrength = std::min(speed / kContactDustSpeed, 1.0f);
+        contactDustRate = kContactDustRate * uniforms.contactStrength;
+    }
+    
+    // Spawns past the frame's budget are dropped, not owed
+    uint32_t budget = kMaxParticleSpawnsPerFrame;
+    uniforms.exhaustCount = std::min(TakeParticles(kExhaustRate * thrust * deltaTime, mParticleEmitCarry[0]), budget);
+    budget -= uniforms.exhaustCount;
+    uniforms.plumeDustCount = std::min(TakeParticles(plumeDustRate * deltaTime, mParticleEmitCarry[1]), budget);
+    budget -= uniforms.plumeDustCount;
+    uniforms.contactDustCount = std::min(TakeParticles(contactDustRate * deltaTime, mParticleEmitCarry[2]), budget);
+    const uint32_t spawnCount = uniforms.exhaustCount + uniforms.plumeDustCount + uniforms.contactDustCount;
+    
+    uniforms.head = mParticleHead;
+    uniforms.contactCount = static_cast<uint32_t>(contactCount);
+    uniforms.seed = mParticleSeed++;
+    uniforms.ringMask = kMaxParticles - 1;
+    uniforms.deltaTime = deltaTime;
+    uniforms.gravity = emitters.gravity;
+    uniforms.groundHeight = emitters.groundHeight;
+    uniforms.thrustLevel = thrust;
+    mParticleHead = (mParticleHead + spawnCount) & (kMaxParticles - 1);
+    
+    // Age the ring, then write the new particles over the oldest slots. The
+    // encoder's dispatches run in order, and the work is committed ahead of
+    // the frame like the near-field factors; the ring is only touched by
+    // the GPU, so nothing waits on the CPU.
+    MTL::CommandBuffer* particleCommands = mCommandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* compute = particleCommands->computeCommandEncoder();
+    compute->setBytes(&uniforms, sizeof(uniforms), 0);
+    compute->setBuffer(mParticleBuffer, 0, 1);
+    compute->setComputePipelineState(mParticleUpdatePipeline);
+    compute->dispatchThreads(MTL::Size(kMaxParticles, 1, 1),
+                             MTL::Size(mParticleUpdatePipeline->threadExecutionWidth(), 1, 1));
+    if (spawnCount > 0) {
+        compute->setComputePipelineState(mParticleEmitPipeline);
+        compute->dispatchThreads(MTL::Size(spawnCount, 1, 1),
+                                 MTL::Size(mParticleEmitPipeline->threadExecutionWidth(), 1, 1));
+    }
+    compute->endEncoding();
+    particleCommands->commit();
+    
+    // One point per ring slot in a single draw; free slots are clipped in
+    // the vertex shader. Point sizes are in pixels of the pass's target.
+    ParticleDrawUniforms draw;
+    std::memset(&draw, 0, sizeof(draw));
+    const Matrix4x4 viewProjection = SimdMath::Multiply(mProjectionMatrix, mViewMatrix);
+    memcpy(draw.viewProjection, viewProjection.values, sizeof(draw.viewProjection));
+    const int targetHeight = mUseDynamicResolution ? mSceneHeight : mDrawableHeight;
+    draw.pointScale = 0.5f * static_cast<float>(targetHeight) * mProjectionMatrix.values[5];
+    draw.maxPointSize = 64.0f;
+    size_t drawOffset = 0;
+    if (!AllocateUniforms(&draw, sizeof(draw), drawOffset)) return;
+    
+    mRenderEncoder->setRenderPipelineState(mParticlePipelineState);
+    mRenderEncoder->setDepthStencilState(mParticleDepthState);
+    mRenderEncoder->setVertexBuffer(mParticleBuffer, 0, 0);
+    mRenderEncoder->setVertexBuffer(mUniformRingBuffer, drawOffset, 1);
+    mRenderEncoder->drawPrimitives(MTL::PrimitiveTypePoint, NS::UInteger(0), NS::UInteger(kMaxParticles));
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+}
+
+// Update camera uniform buffers
+void Renderer3D_Metal::UpdateCameraUniforms() {
+    // Update vertex uniforms
+    memcpy(mVertexUniforms.viewMatrix, mViewMatrix.values, sizeof(mViewMatrix.values));
+    memcpy(mVertexUniforms.projectionMatrix, mProjectionMatrix.values, sizeof(mProjectionMatrix.values));
+    memcpy(mVertexUniforms.cameraPosition, mCameraPosition, sizeof(mCameraPosition));
+    mVertexUniforms.cameraPosition[3] = 1.0f;
+    
+    // Update fragment uniforms
+    memcpy(mFragmentUniforms.lightPosition, mLightPosition, sizeof(mLightPosition));
+    memcpy(mFragmentUniforms.ambientLight, mAmbientLight, sizeof(mAmbientLight));
+    memcpy(mFragmentUniforms.cameraPosition, mCameraPosition, sizeof(mCameraPosition));
+}
+
+// Update model uniform buffer
+void Renderer3D_Metal::SetPositionDecode(const float* origin, const float* extent) {
+    // Range the next draw's packed positions were quantized against
+    for (int i = 0; i < 3; i++) {
+        mVertexUniforms.positionOrigin[i] = origin[i];
+        mVertexUniforms.positionExtent[i] = extent[i];
+    }
+    mVertexUniforms.positionOrigin[3] = 0.0f;
+    mVertexUniforms.positionExtent[3] = 0.0f;
+}
+
+void Renderer3D_Metal::SetLodMorph(float morphStart, float morphEnd) {
+    // Terrain LOD morph of the next draw over [morphStart, morphEnd] from the
+    // camera; an empty range disables it
+    mVertexUniforms.lodMorph[0] = morphStart;
+    mVertexUniforms.lodMorph[1] = morphEnd > morphStart ? 1.0f / (morphEnd - morphStart) : 0.0f;
+    mVertexUniforms.lodMorph[2] = 0.0f;
+    mVertexUniforms.lodMorph[3] = 0.0f;
+}
+
+void Renderer3D_Metal::UpdateModelUniforms(const float* position, const Quaternion& orientation, const float* scale) {
+    // Create model matrix
+    mModelMatrix = CreateModelMatrix(position, orientation, scale);
+    
+    // Update vertex uniforms
+    memcpy(mVertexUniforms.modelMatrix, mModelMatrix.values, sizeof(mModelMatrix.values));
+}
+
+// Additional methods omitted for brevity - they remain largely the same
+// For a full implementation, please copy over the remaining methods
+
+// A height sample shows as landing pad if any cell around it is one
+static bool IsLandingPadSample(const std::vector<unsigned char>& padCells, int gridSize, int x, int z) {
+    for (int cz = std::max(z - 1, 0); cz <= std::min(z, gridSize - 1); cz++) {
+        for (int cx = std::max(x - 1, 0); cx <= std::min(x, gridSize - 1); cx++) {
+            if (padCells[cz * gridSize + cx] != 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Height of patch sample (i, j) on the next level's surface: odd samples
+// drop out there, leaving an edge (or, for odd/odd, the quad's
+// (x+1, z) - (x, z+1) diagonal) between their even neighbours
+template <typename Sample>
+static float TerrainMorphHeight(const Sample& sample, int i, int j) {
+    if ((i & 1) && !(j & 1)) {
+        return 0.5f * (sample(i - 1, j) + sample(i + 1, j));
+    } else if (!(i & 1) && (j & 1)) {
+        return 0.5f * (sample(i, j - 1) + sample(i, j + 1));
+    } else if ((i & 1) && (j & 1)) {
+        return 0.5f * (sample(i + 1, j - 1) + sample(i - 1, j + 1));
+    }
+    return sample(i, j);
+}
+
+// Implementations for the remaining public interface methods
+void Renderer3D_Metal::BuildTerrainVertices(const Terrain* terrain, TerrainChunk& chunk, PackedVertex* out,
+                                            float& maxMorphDelta) {
+    const HeightGrid& heights = terrain->GetHeightGrid();
+    const std::vector<float>& normals = terrain->GetNormalData();
+    const std::vector<unsigned char>& padCells = terrain->GetLandingPadCells();
+    const std::vector<uint8_t>& occlusion = terrain->GetOcclusionData();
+    const bool hasOcclusion = terrain->HasOcclusionMap();
+    const int gridSize = terrain->GetGridSize();
+    const int stride = gridSize + 1;
+    const int patchStride = kTerrainChunkCells + 1;
+    const int step = 1 << chunk.level;
+    const float cellWidth = terrain->GetCellWidth();
+    const float cellLength = terrain->GetCellLength();
+    
+    // Grid coordinates of patch sample (i, j), clamped to the terrain edge
+    auto gridX = [&](int i) { return std::min(chunk.cellX + i * step, gridSize); };
+    auto gridZ = [&](int j) { return std::min(chunk.cellZ + j * step, gridSize); };
+    auto sample = [&](int i, int j) {
+        i = std::min(std::max(i, 0), kTerrainChunkCells);
+        j = std::min(std::max(j, 0), kTerrainChunkCells);
+        return heights.Get(gridX(i), gridZ(j));
+    };
+    
+    float minHeight = sample(0, 0);
+    float maxHeight = minHeight;
+    maxMorphDelta = 0.0f;
+    
+    for (int j = 0; j < patchStride; j++) {
+        for (int i = 0; i < patchStride; i++) {
+            int x = gridX(i);
+            int z = gridZ(j);
+            float position[3] = { terrain->GetOriginX() + x * cellWidth, sample(i, j),
+                                  terrain->GetOriginZ() + z * cellLength };
+            minHeight = std::min(minHeight, position[1]);
+            maxHeight = std::max(maxHeight, position[1]);
+            
+            float morphHeight = TerrainMorphHeight(sample, i, j);
+            maxMorphDelta = std::max(maxMorphDelta, std::fabs(morphHeight - position[1]));
+            
+            // Bounds and morph delta only (the vertices live in textures)
+            if (!out) {
+                continue;
+            }
+            
+            // Smooth normal baked with the heights
+            const float* normal = &normals[3 * (z * stride + x)];
+            bool isLandingPad = IsLandingPadSample(padCells, gridSize, x, z);
+            
+            PackedVertex& vertex = out[j * patchStride + i];
+            vertex = PackVertex(position, normal, isLandingPad ? kVertexFlagLandingPad : 0,
+                                chunk.origin, chunk.extent);
+            vertex.position[3] = PackSnorm16((morphHeight - chunk.origin[1]) / chunk.extent[1]);
+            vertex.occlusion = hasOcclusion ? occlusion[z * stride + x] : 0;
+        }
+    }
     
-    // Back face
-    {{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, 0.0f, 1.0f},
-    {{-0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, 0.0f, 1.0f},
-    {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, 0.0f, 1.0f},
-    {{0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, 0.0f, 1.0f},
+    chunk.boundsMin[1] = minHeight;
+    chunk.boundsMax[1] = maxHeight;
+}
+
+// Bounds and normal cone of one meshlet of a chunk; matches TerrainMeshlet
+// in LanderShaders.metal
+struct TerrainMeshlet {
+    float boundsMin[3];     // World-space AABB, morph targets included
+    float coneCutoff;       // Back-facing if dot(center - camera, axis) >= cutoff * distance + radius
+    float boundsMax[3];
+    float padding;
+    float coneAxis[3];      // Unit mean of the triangles' normals
+    float hasTriangles;     // 0 once clamping at the grid edge collapses every triangle
+};
+
+static_assert(sizeof(TerrainMeshlet) == 48, "TerrainMeshlet must match LanderShaders.metal");
+static_assert(Renderer3D_Metal::kTerrainChunkCells % (2 * Renderer3D_Metal::kTerrainMeshletCells) == 0,
+              "Terrain meshlets must tile the chunk quadrants and start on even samples");
+
+void Renderer3D_Metal::BuildTerrainMeshlets(const Terrain* terrain, const TerrainChunk& chunk,
+                                            TerrainMeshlet* out) const {
+    const HeightGrid& heights = terrain->GetHeightGrid();
+    const int gridSize = terrain->GetGridSize();
+    const int step = 1 << chunk.level;
+    const int meshletsPerSide = kTerrainChunkCells / kTerrainMeshletCells;
+    const int meshletStride = kTerrainMeshletCells + 1;
+    
+    // Same sampling as BuildTerrainVertices and terrainSample in the shader
+    auto gridX = [&](int i) { return std::min(chunk.cellX + i * step, gridSize); };
+    auto gridZ = [&](int j) { return std::min(chunk.cellZ + j * step, gridSize); };
+    auto sample = [&](int i, int j) {
+        i = std::min(std::max(i, 0), kTerrainChunkCells);
+        j = std::min(std::max(j, 0), kTerrainChunkCells);
+        return heights.Get(gridX(i), gridZ(j));
+    };
     
-    // Top face
-    {{-0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, 0.0f, 1.0f},
-    {{-0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, 0.0f, 1.0f},
+    for (int m = 0; m < kTerrainMeshletsPerChunk; m++) {
+        const int firstI = (m % meshletsPerSide) * kTerrainMeshletCells;
+        const int firstJ = (m / meshletsPerSide) * kTerrainMeshletCells;
+        TerrainMeshlet& meshlet = out[m];
+        
+        float positions[meshletStride * meshletStride][3];
+        for (int axis = 0; axis < 3; axis++) {
+            meshlet.boundsMin[axis] = std::numeric_limits<float>::max();
+            meshlet.boundsMax[axis] = -std::numeric_limits<float>::max();
+        }
+        for (int j = 0; j < meshletStride; j++) {
+            for (int i = 0; i < meshletStride; i++) {
+                float* position = positions[j * meshletStride + i];
+                position[0] = terrain->GetOriginX() + gridX(firstI + i) * terrain->GetCellWidth();
+                position[1] = sample(firstI + i, firstJ + j);
+                position[2] = terrain->GetOriginZ() + gridZ(firstJ + j) * terrain->GetCellLength();
+                const float morphHeight = TerrainMorphHeight(sample, firstI + i, firstJ + j);
+                for (int axis = 0; axis < 3; axis++) {
+                    meshlet.boundsMin[axis] = std::min(meshlet.boundsMin[axis], position[axis]);
+                    meshlet.boundsMax[axis] = std::max(meshlet.boundsMax[axis], position[axis]);
+                }
+                meshlet.boundsMin[1] = std::min(meshlet.boundsMin[1], morphHeight);
+                meshlet.boundsMax[1] = std::max(meshlet.boundsMax[1], morphHeight);
+            }
+        }
+        
+        // Unmorphed face normals, split as terrain_meshlet_mesh splits its
+        // quads; degenerate triangles (clamped at the grid edge) have none
+        float normals[2 * kTerrainMeshletCells * kTerrainMeshletCells][3];
+        int normalCount = 0;
+        float axis[3] = { 0.0f, 0.0f, 0.0f };
+        for (int j = 0; j < kTerrainMeshletCells; j++) {
+            for (int i = 0; i < kTerrainMeshletCells; i++) {
+                const float* v00 = positions[j * meshletStride + i];
+                const float* v10 = positions[j * meshletStride + i + 1];
+                const float* v01 = positions[(j + 1) * meshletStride + i];
+                const float* v11 = positions[(j + 1) * meshletStride + i + 1];
+                const float* triangles[2][3] = { { v00, v01, v10 }, { v10, v01, v11 } };
+                for (const auto& triangle : triangles) {
+                    float e1[3], e2[3];
+                    for (int k = 0; k < 3; k++) {
+                        e1[k] = triangle[1][k] - triangle[0][k];
+                        e2[k] = triangle[2][k] - triangle[0][k];
+                    }
+                    float* normal = normals[normalCount];
+                    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+                    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+                    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+                    const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                    if (length <= 1e-6f) {
+                        continue;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        normal[k] /= length;
+                        axis[k] += normal[k];
+                    }
+                    normalCount++;
+                }
+            }
+        }
+        
+        // A cone no narrower than a hemisphere (cutoff 1) never culls
+        meshlet.padding = 0.0f;
+        meshlet.hasTriangles = normalCount > 0 ? 1.0f : 0.0f;
+        meshlet.coneAxis[0] = meshlet.coneAxis[2] = 0.0f;
+        meshlet.coneAxis[1] = 1.0f;
+        meshlet.coneCutoff = 1.0f;
+        const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        if (normalCount == 0 || axisLength <= 1e-6f) {
+            continue;
+        }
+        float minDot = 1.0f;
+        for (int k = 0; k < 3; k++) {
+            meshlet.coneAxis[k] = axis[k] / axisLength;
+        }
+        for (int n = 0; n < normalCount; n++) {
+            minDot = std::min(minDot, normals[n][0] * meshlet.coneAxis[0] + normals[n][1] * meshlet.coneAxis[1] +
+                                      normals[n][2] * meshlet.coneAxis[2]);
+        }
+        if (minDot > 0.1f) {
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+    }
+}
+
+int Renderer3D_Metal::CreateTerrainChunk(const Terrain* terrain, int level, int cellX, int cellZ,
+                                         size_t& vertexCount) {
+    const int gridSize = terrain->GetGridSize();
+    if (cellX >= gridSize || cellZ >= gridSize) {
+        return -1;
+    }
     
-    // Bottom face
-    {{-0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, 0.0f, 1.0f},
-    {{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, 0.0f, 1.0f},
+    TerrainChunk chunk;
+    chunk.level = level;
+    chunk.cellX = cellX;
+    chunk.cellZ = cellZ;
+    chunk.firstVertex = vertexCount;
+    vertexCount += static_cast<size_t>(kTerrainChunkCells + 1) * (kTerrainChunkCells + 1);
+    
+    // Footprint clamped to the grid; heights are filled in with the vertices
+    int span = kTerrainChunkCells << level;
+    chunk.boundsMin[0] = terrain->GetOriginX() + cellX * terrain->GetCellWidth();
+    chunk.boundsMin[2] = terrain->GetOriginZ() + cellZ * terrain->GetCellLength();
+    chunk.boundsMax[0] = terrain->GetOriginX() + std::min(cellX + span, gridSize) * terrain->GetCellWidth();
+    chunk.boundsMax[2] = terrain->GetOriginZ() + std::min(cellZ + span, gridSize) * terrain->GetCellLength();
+    chunk.boundsMin[1] = terrain->GetMinHeight();
+    chunk.boundsMax[1] = terrain->GetMaxHeight();
+    
+    // Positions are packed relative to the footprint and the terrain's height
+    // range. Height edits stay within [GetMinHeight(), GetMaxHeight()], so
+    // dirty updates can reuse the same range.
+    for (int axis = 0; axis < 3; axis += 2) {
+        chunk.origin[axis] = 0.5f * (chunk.boundsMin[axis] + chunk.boundsMax[axis]);
+        chunk.extent[axis] = std::max(0.5f * (chunk.boundsMax[axis] - chunk.boundsMin[axis]), 1e-3f);
+    }
+    chunk.origin[1] = 0.5f * (terrain->GetMinHeight() + terrain->GetMaxHeight());
+    chunk.extent[1] = std::max(0.5f * (terrain->GetMaxHeight() - terrain->GetMinHeight()), 1e-3f);
+    
+    // Picks the shader variant: whether any of the chunk's samples is
+    // flagged landing pad (the pad doesn't move when heights are edited)
+    const std::vector<unsigned char>& padCells = terrain->GetLandingPadCells();
+    chunk.hasLandingPad = false;
+    for (int j = 0; j <= kTerrainChunkCells && !chunk.hasLandingPad && !padCells.empty(); j++) {
+        int z = std::min(cellZ + (j << level), gridSize);
+        for (int i = 0; i <= kTerrainChunkCells && !chunk.hasLandingPad; i++) {
+            chunk.hasLandingPad = IsLandingPadSample(padCells, gridSize, std::min(cellX + (i << level), gridSize), z);
+        }
+    }
     
-    // Right face
-    {{0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
-    {{0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
+    int index = static_cast<int>(mTerrainChunks.size());
+    mTerrainChunks.push_back(chunk);
     
-    // Left face
-    {{-0.5f, -0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
-    {{-0.5f, -0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
-    {{-0.5f, 0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}, 0.0f, 1.0f},
-    {{-0.5f, 0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}, 0.0f, 1.0f}
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        int child = -1;
+        if (level > 0) {
+            int half = span / 2;
+            child = CreateTerrainChunk(terrain, level - 1, cellX + (quadrant & 1) * half,
+                                       cellZ + (quadrant >> 1) * half, vertexCount);
+        }
+        mTerrainChunks[index].children[quadrant] = child;
+    }
+    return index;
+}
+
+// Strip indices for one patch, quadrant by quadrant so a draw can cover any
+// run of quadrants: per cell row, alternate (x, z) and (x, z + 1) and cut
+// with a restart index. Each strip quad splits on the (x+1, z) - (x, z+1)
+// diagonal, matching Terrain's collision triangles.
+static void BuildTerrainStripIndices(int patchCells, uint16_t* indices) {
+    const uint16_t restartIndex = 0xFFFF;
+    const int stride = patchCells + 1;
+    const int half = patchCells / 2;
+    size_t next = 0;
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        int firstX = (quadrant & 1) * half;
+        int firstZ = (quadrant >> 1) * half;
+        for (int z = firstZ; z < firstZ + half; z++) {
+            for (int x = firstX; x <= firstX + half; x++) {
+                indices[next++] = static_cast<uint16_t>(z * stride + x);
+                indices[next++] = static_cast<uint16_t>((z + 1) * stride + x);
+            }
+            indices[next++] = restartIndex;
+        }
+    }
+}
+
+// Quadrant index ranges are drawn at 2-byte * count offsets, which must stay
+// 4-byte aligned; patches must also stay within 16-bit indices
+static_assert(Renderer3D_Metal::kTerrainChunkCells % 4 == 0, "Terrain chunk size must be a multiple of 4");
+static_assert((Renderer3D_Metal::kTerrainChunkCells + 1) * (Renderer3D_Metal::kTerrainChunkCells + 1) < 0xFFFF,
+              "Terrain chunk vertices must fit 16-bit indices");
+
+bool Renderer3D_Metal::CreateTerrainChunks(const Terrain* terrain, size_t& vertexBytes, size_t& indexBytes) {
+    // The root chunk covers the whole grid at the coarsest level
+    const int gridSize = terrain->GetGridSize();
+    int rootLevel = 0;
+    while ((kTerrainChunkCells << rootLevel) < gridSize && rootLevel + 1 < kMaxTerrainLevels) {
+        rootLevel++;
+    }
+    
+    mTerrainChunks.clear();
+    size_t vertexCount = 0;
+    CreateTerrainChunk(terrain, rootLevel, 0, 0, vertexCount);
+    mTerrainLevelCount = rootLevel + 1;
+    
+    // Every patch shares one index buffer
+    const int half = kTerrainChunkCells / 2;
+    mTerrainQuadrantIndexCount = half * (2 * (half + 1) + 1);
+    vertexBytes = vertexCount * sizeof(PackedVertex);
+    indexBytes = 4 * static_cast<size_t>(mTerrainQuadrantIndexCount) * sizeof(uint16_t);
+    
+    // Keep the private buffers when a regenerated grid has the same size.
+    // Height texture terrain has the index buffer only.
+    if (mUseTerrainTextures) {
+        vertexBytes = 0;
+    }
+    bool vertexBufferValid = mUseTerrainTextures ||
+                             (mTerrainVertexBuffer && mTerrainVertexBuffer->length() == vertexBytes);
+    if (!vertexBufferValid || !mTerrainIndexBuffer || mTerrainIndexBuffer->length() != indexBytes) {
+        mHeapAllocator.Free(mTerrainVertexBuffer);
+        mHeapAllocator.Free(mTerrainIndexBuffer);
+        mTerrainVertexBuffer = mUseTerrainTextures ? nullptr :
+            mHeapAllocator.NewBuffer(vertexBytes, MetalHeapAllocator::Memory::Private);
+        mTerrainIndexBuffer = mHeapAllocator.NewBuffer(indexBytes, MetalHeapAllocator::Memory::Private);
+        if ((!mTerrainVertexBuffer && !mUseTerrainTextures) || !mTerrainIndexBuffer) {
+            LOG_ERROR("Failed to create terrain buffers");
+            if (mTerrainVertexBuffer) { mHeapAllocator.Free(mTerrainVertexBuffer); mTerrainVertexBuffer = nullptr; }
+            if (mTerrainIndexBuffer) { mHeapAllocator.Free(mTerrainIndexBuffer); mTerrainIndexBuffer = nullptr; }
+            mTerrainChunks.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void Renderer3D_Metal::SetTerrainLevelErrors(const float* morphDeltas) {
+    // Error of drawing at level l instead of full resolution: the sum of the
+    // worst morph deltas of every finer level
+    float levelDelta[kMaxTerrainLevels] = {};
+    for (size_t i = 0; i < mTerrainChunks.size(); i++) {
+        int level = mTerrainChunks[i].level;
+        levelDelta[level] = std::max(levelDelta[level], morphDeltas[i]);
+    }
+    mTerrainLevelError[0] = 0.0f;
+    for (int level = 1; level < mTerrainLevelCount; level++) {
+        mTerrainLevelError[level] = mTerrainLevelError[level - 1] + levelDelta[level - 1];
+    }
+}
+
+bool Renderer3D_Metal::CreateTerrainBuffers(Terrain* terrain) {
+    if (!terrain->HasHeightGrid()) {
+        LOG_WARNING_EVERY(1000, "Terrain has no height grid to render");
+        return false;
+    }
+    
+    size_t vertexBytes = 0;
+    size_t indexBytes = 0;
+    if (!CreateTerrainChunks(terrain, vertexBytes, indexBytes)) {
+        return false;
+    }
+    
+    // Only new textures can take a file load: frames in flight may still
+    // read reused ones, and IO is not ordered after them
+    const int samplesPerSide = terrain->GetGridSize() + 1;
+    const bool newTextures = mUseTerrainTextures &&
+        (!mTerrainHeightTexture || static_cast<int>(mTerrainHeightTexture->width()) != samplesPerSide);
+    if (mUseTerrainTextures && !CreateTerrainTextures(samplesPerSide)) {
+        mTerrainChunks.clear();
+        return false;
+    }
+    
+    // Meshlets follow the chunk tree; the buffer is kept while its size is
+    size_t meshletBytes = mUseTerrainMeshShaders ?
+        mTerrainChunks.size() * kTerrainMeshletsPerChunk * sizeof(TerrainMeshlet) : 0;
+    if (meshletBytes && (!mTerrainMeshletBuffer || mTerrainMeshletBuffer->length() != meshletBytes)) {
+        mHeapAllocator.Free(mTerrainMeshletBuffer);
+        mTerrainMeshletBuffer = mHeapAllocator.NewBuffer(meshletBytes, MetalHeapAllocator::Memory::Private);
+        if (!mTerrainMeshletBuffer) {
+            LOG_WARNING("Failed to create terrain meshlet buffer, terrain drawn instanced");
+            mUseTerrainMeshShaders = false;
+            meshletBytes = 0;
+        }
+    }
+    
+    // A full upload rarely fits the staging ring, so it gets its own buffer
+    // (the upload command buffer keeps it alive until the copy is done)
+    MTL::Buffer* staging = mHeapAllocator.NewBuffer(vertexBytes + indexBytes + meshletBytes,
+                                                    MetalHeapAllocator::Memory::Shared);
+    if (!staging) {
+        LOG_ERROR("Failed to create terrain upload buffer");
+        mTerrainChunks.clear();
+        return false;
+    }
+    
+    // Chunks are independent, so large terrains are built across the job system
+    char* contents = static_cast<char*>(staging->contents());
+    PackedVertex* vertices = reinterpret_cast<PackedVertex*>(contents);
+    TerrainMeshlet* meshlets = reinterpret_cast<TerrainMeshlet*>(contents + vertexBytes + indexBytes);
+    std::vector<float> morphDeltas(mTerrainChunks.size());
+    auto buildChunks = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            TerrainChunk& chunk = mTerrainChunks[i];
+            BuildTerrainVertices(terrain, chunk, mUseTerrainTextures ? nullptr : vertices + chunk.firstVertex,
+                                 morphDeltas[i]);
+            if (meshletBytes) {
+                BuildTerrainMeshlets(terrain, chunk, meshlets + i * kTerrainMeshletsPerChunk);
+            }
+        }
+    };
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(mTerrainChunks.size(), 16, buildChunks);
+    } else {
+        buildChunks(0, mTerrainChunks.size());
+    }
+    BuildTerrainStripIndices(kTerrainChunkCells, reinterpret_cast<uint16_t*>(contents + vertexBytes));
+    SetTerrainLevelErrors(morphDeltas.data());
+    
+    // Height texture terrain stages no vertices (vertexBytes is 0), vertex
+    // terrain no meshlets
+    BufferUpload uploads[2] = {
+        { staging, vertexBytes, mTerrainIndexBuffer, 0, indexBytes },
+        mUseTerrainTextures ? BufferUpload{ staging, vertexBytes + indexBytes, mTerrainMeshletBuffer, 0, meshletBytes }
+                            : BufferUpload{ staging, 0, mTerrainVertexBuffer, 0, vertexBytes }
     };
+    SubmitBufferUploads(uploads, mUseTerrainTextures && !meshletBytes ? 1 : 2);
+    mHeapAllocator.Free(staging);
     
-    // Cube indices
-    uint16_t cubeIndices[] = {
-        0, 1, 2, 2, 3, 0,       // Front face
-        4, 5, 6, 6, 7, 4,       // Back face
-        8, 9, 10, 10, 11, 8,    // Top face
-        12, 13, 14, 14, 15, 12, // Bottom face
-        16, 17, 18, 18, 19, 16, // Right face
-        20, 21, 22, 22, 23, 20  // Left face
+    if (mUseTerrainTextures) {
+        const bool heightsLoading = newTextures && LoadTerrainTexturesFromCache(terrain);
+        UploadTerrainTextures(terrain, 0, 0, terrain->GetGridSize(), terrain->GetGridSize(), false, !heightsLoading);
+    }
+    
+    mTerrainLayoutVersion = terrain->GetLayoutVersion();
+    mTerrainCullChunksDirty = true;
+    
+    if (mUseTerrainTextures) {
+        LOG_INFO("Created terrain textures: %zu chunks in %d LOD levels, %dx%d samples",
+                 mTerrainChunks.size(), mTerrainLevelCount, terrain->GetGridSize() + 1, terrain->GetGridSize() + 1);
+    } else {
+        LOG_INFO("Created terrain buffers: %zu chunks in %d LOD levels, %zu vertices",
+                 mTerrainChunks.size(), mTerrainLevelCount, vertexBytes / sizeof(PackedVertex));
+    }
+    return true;
+}
+
+// Inputs of the terrain kernels; matches TerrainComputeUniforms in
+// TerrainCompute.metal (4-byte scalars only, so the layouts agree)
+struct TerrainComputeUniforms {
+    TerrainNoiseLayers layers;
+    
+    int32_t octaves;
+    float hillFrequency;
+    float hillAmplitude;
+    float ridgeFrequency;
+    float ridgeAmplitude;
+    float mariaFrequency;
+    float mariaDepth;
+    float craterCellSize;
+    float craterDensity;
+    float craterDepth;
+    
+    int32_t gridSize;
+    float cellWidth;
+    float cellLength;
+    int32_t padMin;
+    int32_t padMax;
+    float blendCells;
+    float baseHeight;
+};
+
+// One chunk for terrain_build_vertices
+struct TerrainChunkRecord {
+    int32_t level;
+    int32_t cellX;
+    int32_t cellZ;
+    uint32_t firstVertex;
+    float origin[3];
+    float extent[3];
+};
+
+// terrain_build_vertices output per chunk: heights as order-preserving bits
+// so the kernel can use integer atomics; the morph delta is never negative,
+// so its plain bits already order
+struct TerrainChunkStats {
+    uint32_t minHeight;
+    uint32_t maxHeight;
+    uint32_t maxMorphDelta;
+};
+
+static float FromOrderedBits(uint32_t bits) {
+    bits = (bits & 0x80000000u) ? (bits & 0x7FFFFFFFu) : ~bits;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool Renderer3D_Metal::GenerateTerrain(Terrain* terrain, int width, int length, int height) {
+    // The kernels may still be compiling; so may the terrain map pipeline,
+    // which decides how the terrain is drawn
+    if (mInitialized) {
+        PollPipelines(RequiredPipelines() | (1u << kPipelineTerrainHeights) | (1u << kPipelineTerrainVertices));
+    }
+    if (!mInitialized || !mTerrainHeightPipeline || !mTerrainVertexPipeline) {
+        return false;
+    }
+    PROFILE_SCOPE("Terrain Generate GPU");
+    uint64_t startTime = mach_absolute_time();
+    
+    const TerrainGeneratedLayout layout = terrain->GetGeneratedLayout(width, length, height);
+    const TerrainGenerator generator(terrain->GetSeed());
+    const TerrainNoiseParams& params = generator.GetParams();
+    
+    TerrainComputeUniforms uniforms;
+    uniforms.layers = generator.GetLayers();
+    uniforms.octaves = params.octaves;
+    uniforms.hillFrequency = 1.0f / params.hillWavelength;
+    uniforms.hillAmplitude = params.hillAmplitude;
+    uniforms.ridgeFrequency = 1.0f / params.ridgeWavelength;
+    uniforms.ridgeAmplitude = params.ridgeAmplitude;
+    uniforms.mariaFrequency = 1.0f / params.mariaWavelength;
+    uniforms.mariaDepth = params.mariaDepth;
+    uniforms.craterCellSize = params.craterCellSize;
+    uniforms.craterDensity = params.craterDensity;
+    uniforms.craterDepth = params.craterDepth;
+    uniforms.gridSize = layout.gridSize;
+    uniforms.cellWidth = layout.cellWidth;
+    uniforms.cellLength = layout.cellLength;
+    uniforms.padMin = layout.padMin;
+    uniforms.padMax = layout.padMax;
+    uniforms.blendCells = layout.blendCells;
+    uniforms.baseHeight = layout.baseHeight;
+    
+    // Heights go to a shared buffer: the vertex kernel reads them in place,
+    // and the CPU copy for collision and physics is read straight out of it
+    const NS::UInteger samplesPerSide = static_cast<NS::UInteger>(layout.gridSize + 1);
+    MTL::Buffer* heightBuffer = mHeapAllocator.NewBuffer(samplesPerSide * samplesPerSide * sizeof(float),
+                                                         MetalHeapAllocator::Memory::Shared);
+    if (!heightBuffer) {
+        LOG_ERROR("Failed to create terrain height buffer");
+        return false;
+    }
+    
+    MTL::CommandBuffer* commands = mCommandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* compute = commands->computeCommandEncoder();
+    compute->setComputePipelineState(mTerrainHeightPipeline);
+    compute->setBytes(&uniforms, sizeof(uniforms), 0);
+    compute->setBuffer(heightBuffer, 0, 1);
+    NS::UInteger groupWidth = mTerrainHeightPipeline->threadExecutionWidth();
+    NS::UInteger groupHeight = mTerrainHeightPipeline->maxTotalThreadsPerThreadgroup() / groupWidth;
+    compute->dispatchThreads(MTL::Size(samplesPerSide, samplesPerSide, 1), MTL::Size(groupWidth, groupHeight, 1));
+    compute->endEncoding();
+    commands->commit();
+    commands->waitUntilCompleted();
+    
+    // The chunk tree and packed ranges need the height range, and Terrain
+    // bakes its collision data from the same heights
+    terrain->Generate3D(width, length, height, static_cast<const float*>(heightBuffer->contents()));
+    
+    // Height textures are filled from Terrain's copy, which also has the
+    // normals and pad flags
+    if (mUseTerrainTextures) {
+        mHeapAllocator.Free(heightBuffer);
+        CreateTerrainBuffers(terrain);
+        mTerrainVersion = terrain->GetVersion();
+        LOG_INFO("Generated %dx%d terrain heights on the GPU", layout.gridSize, layout.gridSize);
+        return true;
+    }
+    
+    size_t vertexBytes = 0;
+    size_t indexBytes = 0;
+    if (!CreateTerrainChunks(terrain, vertexBytes, indexBytes)) {
+        mHeapAllocator.Free(heightBuffer);
+        return true;   // Terrain is generated; RenderTerrain retries the buffers on the CPU path
+    }
+    
+    const size_t chunkCount = mTerrainChunks.size();
+    MTL::Buffer* chunkBuffer = mHeapAllocator.NewBuffer(chunkCount * sizeof(TerrainChunkRecord) + indexBytes,
+                                                        MetalHeapAllocator::Memory::Shared);
+    MTL::Buffer* statsBuffer = mHeapAllocator.NewBuffer(chunkCount * sizeof(TerrainChunkStats),
+                                                        MetalHeapAllocator::Memory::Shared);
+    const std::vector<uint8_t>& occlusion = terrain->GetOcclusionData();
+    MTL::Buffer* occlusionBuffer = mHeapAllocator.NewBuffer(samplesPerSide * samplesPerSide,
+                                                            MetalHeapAllocator::Memory::Shared);
+    if (!chunkBuffer || !statsBuffer || !occlusionBuffer) {
+        LOG_ERROR("Failed to create terrain chunk buffers");
+        mHeapAllocator.Free(chunkBuffer);
+        mHeapAllocator.Free(statsBuffer);
+        mHeapAllocator.Free(occlusionBuffer);
+        mHeapAllocator.Free(heightBuffer);
+        mTerrainChunks.clear();
+        return true;
+    }
+    
+    // The chunk table, with the shared strip indices staged after it
+    TerrainChunkRecord* records = static_cast<TerrainChunkRecord*>(chunkBuffer->contents());
+    TerrainChunkStats* stats = static_cast<TerrainChunkStats*>(statsBuffer->contents());
+    for (size_t i = 0; i < chunkCount; i++) {
+        const TerrainChunk& chunk = mTerrainChunks[i];
+        records[i].level = chunk.level;
+        records[i].cellX = chunk.cellX;
+        records[i].cellZ = chunk.cellZ;
+        records[i].firstVertex = static_cast<uint32_t>(chunk.firstVertex);
+        std::copy(chunk.origin, chunk.origin + 3, records[i].origin);
+        std::copy(chunk.extent, chunk.extent + 3, records[i].extent);
+        stats[i].minHeight = 0xFFFFFFFFu;
+        stats[i].maxHeight = 0;
+        stats[i].maxMorphDelta = 0;
+    }
+    if (terrain->HasOcclusionMap()) {
+        std::memcpy(occlusionBuffer->contents(), occlusion.data(), occlusion.size());
+    } else {
+        std::memset(occlusionBuffer->contents(), 0, samplesPerSide * samplesPerSide);
+    }
+    size_t indexOffset = chunkCount * sizeof(TerrainChunkRecord);
+    BuildTerrainStripIndices(kTerrainChunkCells,
+                             reinterpret_cast<uint16_t*>(static_cast<char*>(chunkBuffer->contents()) + indexOffset));
+    
+    const NS::UInteger patchVertices = static_cast<NS::UInteger>(kTerrainChunkCells + 1) * (kTerrainChunkCells + 1);
+    commands = mCommandQueue->commandBuffer();
+    compute = commands->computeCommandEncoder();
+    compute->setComputePipelineState(mTerrainVertexPipeline);
+    compute->setBytes(&uniforms, sizeof(uniforms), 0);
+    compute->setBuffer(heightBuffer, 0, 1);
+    compute->setBuffer(chunkBuffer, 0, 2);
+    compute->setBuffer(statsBuffer, 0, 3);
+    compute->setBuffer(mTerrainVertexBuffer, 0, 4);
+    compute->setBuffer(occlusionBuffer, 0, 5);
+    NS::UInteger groupSize = std::min(patchVertices, mTerrainVertexPipeline->maxTotalThreadsPerThreadgroup());
+    compute->dispatchThreads(MTL::Size(patchVertices, chunkCount, 1), MTL::Size(groupSize, 1, 1));
+    compute->endEncoding();
+    MTL::BlitCommandEncoder* blit = commands->blitCommandEncoder();
+    blit->copyFromBuffer(chunkBuffer, indexOffset, mTerrainIndexBuffer, 0, indexBytes);
+    blit->endEncoding();
+    commands->commit();
+    commands->waitUntilCompleted();
+    
+    // Only the per-chunk results come back: culling bounds and LOD errors
+    std::vector<float> morphDeltas(chunkCount);
+    for (size_t i = 0; i < chunkCount; i++) {
+        mTerrainChunks[i].boundsMin[1] = FromOrderedBits(stats[i].minHeight);
+        mTerrainChunks[i].boundsMax[1] = FromOrderedBits(stats[i].maxHeight);
+        std::memcpy(&morphDeltas[i], &stats[i].maxMorphDelta, sizeof(float));
+    }
+    SetTerrainLevelErrors(morphDeltas.data());
+    
+    mHeapAllocator.Free(chunkBuffer);
+    mHeapAllocator.Free(statsBuffer);
+    mHeapAllocator.Free(occlusionBuffer);
+    mHeapAllocator.Free(heightBuffer);
+    
+    mTerrainLayoutVersion = terrain->GetLayoutVersion();
+    mTerrainVersion = terrain->GetVersion();
+    mTerrainCullChunksDirty = true;
+    
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double milliseconds = static_cast<double>(mach_absolute_time() - startTime) * timebase.numer / timebase.denom * 1e-6;
+    LOG_INFO("Generated %dx%d terrain on the GPU in %.2f ms: %zu chunks in %d LOD levels",
+             layout.gridSize, layout.gridSize, milliseconds, chunkCount, mTerrainLevelCount);
+    return true;
+}
+
+bool Renderer3D_Metal::CreateTerrainTextures(int samplesPerSide) {
+    if (mTerrainHeightTexture && static_cast<int>(mTerrainHeightTexture->width()) == samplesPerSide) {
+        return true;
+    }
+    if (mTerrainHeightTexture) { mHeapAllocator.Free(mTerrainHeightTexture); mTerrainHeightTexture = nullptr; }
+    if (mTerrainHeightRangeTexture) { mHeapAllocator.Free(mTerrainHeightRangeTexture); mTerrainHeightRangeTexture = nullptr; }
+    if (mTerrainNormalTexture) { mHeapAllocator.Free(mTerrainNormalTexture); mTerrainNormalTexture = nullptr; }
+    if (mTerrainFlagTexture) { mHeapAllocator.Free(mTerrainFlagTexture); mTerrainFlagTexture = nullptr; }
+    
+    // Heights stay quantized as Terrain keeps them; the shaders decode each
+    // sample with its tile's range
+    const int tilesPerSide = (samplesPerSide + HeightGrid::kTileSize - 1) / HeightGrid::kTileSize;
+    const MTL::PixelFormat formats[4] = {
+        MTL::PixelFormatR16Unorm, MTL::PixelFormatRG32Float, MTL::PixelFormatRG16Snorm, MTL::PixelFormatRG8Uint
+    };
+    const int sizes[4] = { samplesPerSide, tilesPerSide, samplesPerSide, samplesPerSide };
+    MTL::Texture** textures[4] = {
+        &mTerrainHeightTexture, &mTerrainHeightRangeTexture, &mTerrainNormalTexture, &mTerrainFlagTexture
     };
+    for (int i = 0; i < 4; i++) {
+        MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            formats[i], sizes[i], sizes[i], false);
+        descriptor->setStorageMode(MTL::StorageModePrivate);
+        descriptor->setUsage(MTL::TextureUsageShaderRead);
+        *textures[i] = mHeapAllocator.NewTexture(descriptor);
+        if (!*textures[i]) {
+            LOG_ERROR("Failed to create %dx%d terrain textures", samplesPerSide, samplesPerSide);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Renderer3D_Metal::LoadTerrainTexturesFromCache(const Terrain* terrain) {
+    TerrainCacheSource source;
+    if (!mIOCommandQueue || mTerrainIOCommands || !terrain->GetCacheSource(source)) {
+        return false;
+    }
+    NS::Error* error = nullptr;
+    MTL::IOFileHandle* handle = mDevice->newIOHandle(
+        NS::URL::fileURLWithPath(NS::String::string(source.filename.c_str(), NS::UTF8StringEncoding)), &error);
+    if (!handle) {
+        LOG_WARNING("Failed to open %s for IO (%s), staging terrain heights", source.filename.c_str(),
+                    error ? error->localizedDescription()->utf8String() : "unknown error");
+        return false;
+    }
     
-    // Create vertex buffer
-    mLanderVertexBuffer = mDevice->newBuffer(
-        cubeVertices,
-        sizeof(cubeVertices),
-        MTL::ResourceStorageModeShared
-    );
+    // Both arrays are stored as the textures hold them, row by row
+    const HeightGrid& heights = terrain->GetHeightGrid();
+    const NS::UInteger samples = static_cast<NS::UInteger>(heights.GetSamplesPerSide());
+    const NS::UInteger tiles = static_cast<NS::UInteger>(heights.GetTilesPerSide());
+    MTL::IOCommandBuffer* commands = mIOCommandQueue->commandBuffer();
+    commands->loadTexture(mTerrainHeightTexture, 0, 0, MTL::Size(samples, samples, 1), samples * sizeof(uint16_t),
+                          samples * samples * sizeof(uint16_t), MTL::Origin(0, 0, 0), handle, source.heightOffset);
+    commands->loadTexture(mTerrainHeightRangeTexture, 0, 0, MTL::Size(tiles, tiles, 1), tiles * sizeof(HeightTileRange),
+                          tiles * tiles * sizeof(HeightTileRange), MTL::Origin(0, 0, 0), handle, source.tileRangeOffset);
+    commands->signalEvent(mTerrainIOEvent, ++mTerrainIOValue);
+    commands->commit();
+    mTerrainIOCommands = commands->retain();
+    mTerrainIOHandle = handle;
+    LOG_DEBUG("Loading %lux%lu terrain heights from %s", static_cast<unsigned long>(samples),
+              static_cast<unsigned long>(samples), source.filename.c_str());
+    return true;
+}
+
+bool Renderer3D_Metal::FinishTerrainTextureLoad(const Terrain* terrain) {
+    if (!mTerrainIOCommands) return true;
     
-    // Create index buffer
-    mLanderIndexBuffer = mDevice->newBuffer(
-        cubeIndices,
-        sizeof(cubeIndices),
-        MTL::ResourceStorageModeShared
-    );
+    // The event is signaled after the loads, the status once the buffer is done
+    const MTL::IOStatus status = mTerrainIOCommands->status();
+    const bool landed = mTerrainIOEvent->signaledValue() >= mTerrainIOValue;
+    if (status == MTL::IOStatusPending && !landed) {
+        return false;
+    }
     
-    // Store counts
-    mLanderVertexCount = sizeof(cubeVertices) / sizeof(Vertex);
-    mLanderIndexCount = sizeof(cubeIndices) / sizeof(uint16_t);
+    const bool loaded = status == MTL::IOStatusComplete || (status == MTL::IOStatusPending && landed);
+    if (!loaded) {
+        NS::Error* error = mTerrainIOCommands->error();
+        LOG_WARNING("Terrain height load failed (%s), staging them instead",
+                    error ? error->localizedDescription()->utf8String() : "cancelled");
+    }
+    mTerrainIOCommands->release();
+    mTerrainIOCommands = nullptr;
+    mTerrainIOHandle->release();
+    mTerrainIOHandle = nullptr;
+    if (!loaded && terrain->HasHeightGrid()) {
+        UploadTerrainTextures(terrain, 0, 0, terrain->GetGridSize(), terrain->GetGridSize(), false);
+    }
+    return true;
+}
+
+void Renderer3D_Metal::UploadTerrainTextures(const Terrain* terrain, int minX, int minZ, int maxX, int maxZ,
+                                             bool useStagingSlot, bool stageHeights) {
+    const HeightGrid& heights = terrain->GetHeightGrid();
+    const std::vector<float>& normals = terrain->GetNormalData();
+    const std::vector<unsigned char>& padCells = terrain->GetLandingPadCells();
+    const std::vector<uint8_t>& occlusion = terrain->GetOcclusionData();
+    const bool hasOcclusion = terrain->HasOcclusionMap();
+    const int gridSize = terrain->GetGridSize();
+    const int stride = gridSize + 1;
+    
+    // Samples [min, max] on both axes, clamped to the grid
+    minX = std::max(minX, 0);
+    minZ = std::max(minZ, 0);
+    maxX = std::min(maxX, gridSize);
+    maxZ = std::min(maxZ, gridSize);
+    if (minX > maxX || minZ > maxZ) return;
+    const int width = maxX - minX + 1;
+    const int height = maxZ - minZ + 1;
+    const size_t sampleCount = static_cast<size_t>(width) * height;
+    
+    // And the ranges of every tile they touch
+    const int tileSize = HeightGrid::kTileSize;
+    const int firstTileX = minX / tileSize;
+    const int firstTileZ = minZ / tileSize;
+    const int tileColumns = maxX / tileSize - firstTileX + 1;
+    const int tileRows = maxZ / tileSize - firstTileZ + 1;
+    
+    // Heights, tile ranges, normals and flags with the ambient occlusion one
+    // after another, 16-byte aligned (no heights or ranges if they are
+    // loaded from a file)
+    const size_t heightBytes = stageHeights ? sampleCount * sizeof(uint16_t) : 0;
+    const size_t rangeBytes = stageHeights ? static_cast<size_t>(tileColumns) * tileRows * sizeof(HeightTileRange) : 0;
+    const size_t heightOffset = 0;
+    const size_t rangeOffset = (heightOffset + heightBytes + 15) & ~size_t(15);
+    const size_t normalOffset = (rangeOffset + rangeBytes + 15) & ~size_t(15);
+    const size_t flagOffset = (normalOffset + sampleCount * 2 * sizeof(int16_t) + 15) & ~size_t(15);
+    const size_t uploadBytes = flagOffset + sampleCount * 2;
+    
+    // Edits made during a frame go through its staging slot (from the
+    // start: this replaces the vertex path's chunk uploads) when they fit.
+    // Anything else gets a one-off buffer kept alive by the upload command
+    // buffer.
+    MTL::Buffer* staging = mTerrainStagingBuffer;
+    size_t stagingOffset = mFrameSlot * kTerrainStagingSlotSize;
+    bool oneOff = !useStagingSlot || uploadBytes > kTerrainStagingSlotSize;
+    if (oneOff) {
+        staging = mHeapAllocator.NewBuffer(uploadBytes, MetalHeapAllocator::Memory::Shared);
+        stagingOffset = 0;
+        if (!staging) {
+            LOG_ERROR("Failed to create terrain upload buffer");
+            return;
+        }
+    }
+    
+    char* contents = static_cast<char*>(staging->contents()) + stagingOffset;
+    uint16_t* heightOut = reinterpret_cast<uint16_t*>(contents + heightOffset);
+    HeightTileRange* rangeOut = reinterpret_cast<HeightTileRange*>(contents + rangeOffset);
+    int16_t* normalOut = reinterpret_cast<int16_t*>(contents + normalOffset);
+    uint8_t* flagOut = reinterpret_cast<uint8_t*>(contents + flagOffset);
+    auto fillRows = [&](size_t first, size_t last) {
+        for (size_t row = first; row < last; row++) {
+            int z = minZ + static_cast<int>(row);
+            if (stageHeights) {
+                std::memcpy(heightOut + row * width, &heights.GetSamples()[z * stride + minX], width * sizeof(uint16_t));
+            }
+            for (int x = minX; x <= maxX; x++) {
+                size_t sample = row * width + (x - minX);
+                PackOctahedral(&normals[3 * (z * stride + x)], normalOut + 2 * sample);
+                flagOut[2 * sample] = IsLandingPadSample(padCells, gridSize, x, z) ? kVertexFlagLandingPad : 0;
+                flagOut[2 * sample + 1] = hasOcclusion ? occlusion[z * stride + x] : 0;
+            }
+        }
+    };
+    if (mJobSystem) {
+        mJobSystem->ParallelFor(static_cast<size_t>(height), 64, fillRows);
+    } else {
+        fillRows(0, static_cast<size_t>(height));
+    }
+    const std::vector<HeightTileRange>& tileRanges = heights.GetTileRanges();
+    for (int row = 0; row < tileRows && stageHeights; row++) {
+        std::memcpy(rangeOut + row * tileColumns,
+                    &tileRanges[(firstTileZ + row) * heights.GetTilesPerSide() + firstTileX],
+                    tileColumns * sizeof(HeightTileRange));
+    }
     
-    std::cout << "Created cube model with " << mLanderVertexCount << " vertices and " 
-              << mLanderIndexCount << " indices" << std::endl;
+    TextureUpload uploads[4] = {
+        { staging, stagingOffset + heightOffset, width * sizeof(uint16_t), mTerrainHeightTexture, minX, minZ, width, height },
+        { staging, stagingOffset + rangeOffset, tileColumns * sizeof(HeightTileRange), mTerrainHeightRangeTexture,
+          firstTileX, firstTileZ, tileColumns, tileRows },
+        { staging, stagingOffset + normalOffset, width * 2 * sizeof(int16_t), mTerrainNormalTexture, minX, minZ, width, height },
+        { staging, stagingOffset + flagOffset, static_cast<size_t>(width) * 2, mTerrainFlagTexture, minX, minZ, width, height }
+    };
+    SubmitTextureUploads(stageHeights ? uploads : uploads + 2, stageHeights ? 4 : 2);
+    if (oneOff) {
+        mHeapAllocator.Free(staging);
+    }
 }
 
-void Renderer3D_Metal::Shutdown() {
-    // Release Metal objects in reverse order of creation
+void Renderer3D_Metal::UploadHorizonMap(const Terrain* terrain, int minX, int minZ, int maxX, int maxZ) {
+    if (!terrain->HasHorizonMap()) {
+        if (mTerrainHorizonTexture) { mHeapAllocator.Free(mTerrainHorizonTexture); mTerrainHorizonTexture = nullptr; }
+        mFragmentUniforms.horizonMap[2] = mFragmentUniforms.horizonMap[3] = 0.0f;
+        RefreshFragmentUniforms();
+        return;
+    }
     
-    // Release buffers
-    if (mLanderVertexBuffer) { mLanderVertexBuffer->release(); mLanderVertexBuffer = nullptr; }
-    if (mLanderIndexBuffer) { mLanderIndexBuffer->release(); mLanderIndexBuffer = nullptr; }
-    if (mTerrainVertexBuffer) { mTerrainVertexBuffer->release(); mTerrainVertexBuffer = nullptr; }
-    if (mTerrainIndexBuffer) { mTerrainIndexBuffer->release(); mTerrainIndexBuffer = nullptr; }
-    if (mVertexUniformBuffer) { mVertexUniformBuffer->release(); mVertexUniformBuffer = nullptr; }
-    if (mFragmentUniformBuffer) { mFragmentUniformBuffer->release(); mFragmentUniformBuffer = nullptr; }
+    const int gridSize = terrain->GetGridSize();
+    const int samplesPerSide = gridSize + 1;
+    if (!mTerrainHorizonTexture || static_cast<int>(mTerrainHorizonTexture->width()) != samplesPerSide) {
+        if (mTerrainHorizonTexture) { mHeapAllocator.Free(mTerrainHorizonTexture); mTerrainHorizonTexture = nullptr; }
+        MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            MTL::PixelFormatRGBA8Unorm, samplesPerSide, samplesPerSide, false);
+        descriptor->setTextureType(MTL::TextureType2DArray);
+        descriptor->setArrayLength(Terrain::kHorizonDirections / 4);
+        descriptor->setStorageMode(MTL::StorageModePrivate);
+        descriptor->setUsage(MTL::TextureUsageShaderRead);
+        mTerrainHorizonTexture = mHeapAllocator.NewTexture(descriptor);
+        if (!mTerrainHorizonTexture) {
+            LOG_ERROR("Failed to create the %dx%d terrain horizon map", samplesPerSide, samplesPerSide);
+            return;
+        }
+        minX = minZ = 0;
+        maxX = maxZ = gridSize;
+        if (mRenderEncoder) {
+            mRenderEncoder->setFragmentTexture(mTerrainHorizonTexture, 2);
+        }
+    }
     
-    // Release textures
-    if (mDepthTexture) { mDepthTexture->release(); mDepthTexture = nullptr; }
+    // Texel centres sit on the samples, so the map starts half a cell out
+    mFragmentUniforms.horizonMap[0] = terrain->GetOriginX() - 0.5f * terrain->GetCellWidth();
+    mFragmentUniforms.horizonMap[1] = terrain->GetOriginZ() - 0.5f * terrain->GetCellLength();
+    mFragmentUniforms.horizonMap[2] = 1.0f / (samplesPerSide * terrain->GetCellWidth());
+    mFragmentUniforms.horizonMap[3] = 1.0f / (samplesPerSide * terrain->GetCellLength());
+    RefreshFragmentUniforms();
+    
+    minX = std::max(minX, 0);
+    minZ = std::max(minZ, 0);
+    maxX = std::min(maxX, gridSize);
+    maxZ = std::min(maxZ, gridSize);
+    if (minX > maxX || minZ > maxZ) return;
+    const int width = maxX - minX + 1;
+    const int height = maxZ - minZ + 1;
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    const size_t planeBytes = rowBytes * height;
+    const int planes = Terrain::kHorizonDirections / 4;
+    MTL::Buffer* staging = mHeapAllocator.NewBuffer(planes * planeBytes, MetalHeapAllocator::Memory::Shared);
+    if (!staging) {
+        LOG_ERROR("Failed to create terrain horizon upload buffer");
+        return;
+    }
     
-    // Release pipeline states
-    if (mRenderPipelineState) { mRenderPipelineState->release(); mRenderPipelineState = nullptr; }
-    if (mDepthStencilState) { mDepthStencilState->release(); mDepthStencilState = nullptr; }
+    const std::vector<uint8_t>& horizons = terrain->GetHorizonData();
+    const size_t planeSamples = 4 * static_cast<size_t>(samplesPerSide) * samplesPerSide;
+    char* contents = static_cast<char*>(staging->contents());
+    TextureUpload uploads[Terrain::kHorizonDirections / 4];
+    for (int plane = 0; plane < planes; plane++) {
+        for (int row = 0; row < height; row++) {
+            std::memcpy(contents + plane * planeBytes + row * rowBytes,
+                        &horizons[plane * planeSamples + 4 * (static_cast<size_t>(minZ + row) * samplesPerSide + minX)],
+                        rowBytes);
+        }
+        uploads[plane] = { staging, plane * planeBytes, rowBytes, mTerrainHorizonTexture, minX, minZ, width, height, plane };
+    }
+    SubmitTextureUploads(uploads, planes);
+    mHeapAllocator.Free(staging);
+}
+
+void Renderer3D_Metal::UpdateTerrainRegion(Terrain* terrain, const TerrainDirtyRegion& region) {
+    PROFILE_ZONE("Metal Terrain Region");
+    if (!terrain->HasHeightGrid()) return;
+    
+    if (mUseTerrainTextures) {
+        // Chunk bounds still follow the heights; the LOD ranges keep the
+        // errors measured when the terrain was created
+        FrameVector<size_t> rebuilt(mFrameArena);
+        for (size_t index = 0; index < mTerrainChunks.size(); index++) {
+            TerrainChunk& chunk = mTerrainChunks[index];
+            int step = 1 << chunk.level;
+            int span = kTerrainChunkCells << chunk.level;
+            if (region.maxCellX + step < chunk.cellX || region.minCellX - step > chunk.cellX + span ||
+                region.maxCellZ + step < chunk.cellZ || region.minCellZ - step > chunk.cellZ + span) {
+                continue;
+            }
+            float morphDelta = 0.0f;
+            BuildTerrainVertices(terrain, chunk, nullptr, morphDelta);
+            rebuilt.push_back(index);
+        }
+        
+        // So do their meshlets. The texture upload takes this frame's
+        // staging slot, so they are staged in a buffer of their own.
+        const size_t chunkMeshletBytes = kTerrainMeshletsPerChunk * sizeof(TerrainMeshlet);
+        MTL::Buffer* meshletStaging = mTerrainMeshletBuffer && !rebuilt.empty() ?
+            mHeapAllocator.NewBuffer(rebuilt.size() * chunkMeshletBytes, MetalHeapAllocator::Memory::Shared) : nullptr;
+        if (meshletStaging) {
+            FrameVector<BufferUpload> uploads(mFrameArena);
+            TerrainMeshlet* meshlets = static_cast<TerrainMeshlet*>(meshletStaging->contents());
+            for (size_t i = 0; i < rebuilt.size(); i++) {
+                BuildTerrainMeshlets(terrain, mTerrainChunks[rebuilt[i]], meshlets + i * kTerrainMeshletsPerChunk);
+                uploads.push_back({ meshletStaging, i * chunkMeshletBytes, mTerrainMeshletBuffer,
+                                    rebuilt[i] * chunkMeshletBytes, chunkMeshletBytes });
+            }
+            SubmitBufferUploads(uploads.data(), static_cast<int>(uploads.size()));
+            mHeapAllocator.Free(meshletStaging);
+        } else if (mTerrainMeshletBuffer && !rebuilt.empty()) {
+            LOG_ERROR("Failed to create terrain meshlet upload buffer");
+        }
+        
+        // Cells [min, max) cover samples min..max
+        UploadTerrainTextures(terrain, region.minCellX, region.minCellZ, region.maxCellX, region.maxCellZ, true);
+        LOG_DEBUG("Re-uploaded terrain texture samples %d,%d-%d,%d",
+                  region.minCellX, region.minCellZ, region.maxCellX, region.maxCellZ);
+        return;
+    }
     
-    // Release shader library
-    if (mShaderLibrary) { mShaderLibrary->release(); mShaderLibrary = nullptr; }
+    FrameVector<BufferUpload> uploads(mFrameArena);
+    FrameVector<MTL::Buffer*> oneOffBuffers(mFrameArena);
+    size_t chunkBytes = static_cast<size_t>(kTerrainChunkCells + 1) * (kTerrainChunkCells + 1) * sizeof(PackedVertex);
+    size_t stagingUsed = 0;
+    
+    for (TerrainChunk& chunk : mTerrainChunks) {
+        // Cells [min, max) change samples min..max, which feed the morph
+        // targets of samples up to one step away
+        int step = 1 << chunk.level;
+        int span = kTerrainChunkCells << chunk.level;
+        if (region.maxCellX + step < chunk.cellX || region.minCellX - step > chunk.cellX + span ||
+            region.maxCellZ + step < chunk.cellZ || region.minCellZ - step > chunk.cellZ + span) {
+            continue;
+        }
+        
+        // Stage in this frame's slot; the semaphore already guarantees the GPU
+        // finished the copy that last used it. Whatever does not fit goes
+        // through a one-off buffer.
+        MTL::Buffer* staging = mTerrainStagingBuffer;
+        size_t stagingOffset = mFrameSlot * kTerrainStagingSlotSize + stagingUsed;
+        if (stagingUsed + chunkBytes <= kTerrainStagingSlotSize) {
+            stagingUsed += chunkBytes;
+        } else {
+            staging = mHeapAllocator.NewBuffer(chunkBytes, MetalHeapAllocator::Memory::Shared);
+            stagingOffset = 0;
+            if (!staging) {
+                LOG_ERROR("Failed to create terrain upload buffer");
+                continue;
+            }
+            oneOffBuffers.push_back(staging);
+        }
+        
+        // Rebuilding also refreshes the chunk's height bounds. The LOD
+        // ranges keep the errors measured when the terrain was created.
+        float morphDelta = 0.0f;
+        BuildTerrainVertices(terrain, chunk,
+                             reinterpret_cast<PackedVertex*>(static_cast<char*>(staging->contents()) + stagingOffset),
+                             morphDelta);
+        
+        uploads.push_back({ staging, stagingOffset, mTerrainVertexBuffer,
+                            chunk.firstVertex * sizeof(PackedVertex), chunkBytes });
+    }
     
-    // Release command queue
-    if (mCommandQueue) { mCommandQueue->release(); mCommandQueue = nullptr; }
+    if (!uploads.empty()) {
+        SubmitBufferUploads(uploads.data(), static_cast<int>(uploads.size()));
+        mTerrainCullChunksDirty = true;   // Rebuilt chunks have new bounds
+    }
+    for (MTL::Buffer* buffer : oneOffBuffers) {
+        mHeapAllocator.Free(buffer);
+    }
+    
+    LOG_DEBUG("Re-uploaded %zu terrain chunks for cells %d,%d-%d,%d",
+              uploads.size(), region.minCellX, region.minCellZ, region.maxCellX, region.maxCellZ);
+}
+
+void Renderer3D_Metal::SubmitBufferUploads(const BufferUpload* uploads, int count) {
+    PROFILE_ZONE("Metal Buffer Uploads");
+    // Committed before the frame's command buffer, which is only committed
+    // in Present(), so queue order runs the copies first. Buffer hazard
+    // tracking makes the frame's draws wait for them, and the frame's slot
+    // is released only after those draws, so a staging slot is never
+    // rewritten while its copy is pending.
+    MTL::CommandBuffer* uploadCommands = mCommandQueue->commandBuffer();
+    MTL::BlitCommandEncoder* blit = uploadCommands->blitCommandEncoder();
+    for (int i = 0; i < count; i++) {
+        blit->copyFromBuffer(uploads[i].source, uploads[i].sourceOffset,
+                             uploads[i].destination, uploads[i].destinationOffset, uploads[i].size);
+    }
+    blit->endEncoding();
+    uploadCommands->commit();
+}
+
+void Renderer3D_Metal::SubmitTextureUploads(const TextureUpload* uploads, int count) {
+    PROFILE_ZONE("Metal Texture Uploads");
+    // Ordered ahead of the frame like SubmitBufferUploads; texture hazard
+    // tracking makes the frame's vertex reads wait for the copies
+    MTL::CommandBuffer* uploadCommands = mCommandQueue->commandBuffer();
+    MTL::BlitCommandEncoder* blit = uploadCommands->blitCommandEncoder();
+    for (int i = 0; i < count; i++) {
+        const TextureUpload& upload = uploads[i];
+        blit->copyFromBuffer(upload.source, upload.sourceOffset, upload.bytesPerRow,
+                             upload.bytesPerRow * upload.height, MTL::Size(upload.width, upload.height, 1),
+                             upload.destination, upload.slice, 0, MTL::Origin(upload.x, upload.y, 0));
+    }
+    blit->endEncoding();
+    uploadCommands->commit();
+}
+
+// Conservative AABB test: a box is culled only if its most positive corner
+// lies outside some plane
+static bool BoxIntersectsFrustum(const float planes[6][4], const float* boundsMin, const float* boundsMax) {
+    for (int i = 0; i < 6; i++) {
+        const float* plane = planes[i];
+        float x = plane[0] >= 0.0f ? boundsMax[0] : boundsMin[0];
+        float y = plane[1] >= 0.0f ? boundsMax[1] : boundsMin[1];
+        float z = plane[2] >= 0.0f ? boundsMax[2] : boundsMin[2];
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the box comes within radius of center
+static bool BoxIntersectsSphere(const float* boundsMin, const float* boundsMax, const float* center, float radius) {
+    float distanceSquared = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        float nearest = std::min(std::max(center[i], boundsMin[i]), boundsMax[i]);
+        distanceSquared += (center[i] - nearest) * (center[i] - nearest);
+    }
+    return distanceSquared <= radius * radius;
+}
+
+void Renderer3D_Metal::SelectTerrainChunks(int chunkIndex, const float planes[6][4], const float* lodRanges,
+                                           std::vector<TerrainDraw>& draws) {
+    const TerrainChunk& chunk = mTerrainChunks[chunkIndex];
+    if (!BoxIntersectsFrustum(planes, chunk.boundsMin, chunk.boundsMax)) {
+        return;
+    }
+    
+    // Chunks entirely beyond the next finer level's range are drawn as they are
+    if (chunk.level == 0 ||
+        !BoxIntersectsSphere(chunk.boundsMin, chunk.boundsMax, mCameraPosition, lodRanges[chunk.level - 1])) {
+        draws.push_back({ chunkIndex, 0xF });
+        return;
+    }
+    
+    // Otherwise refine the quadrants that reach into it and draw the rest of
+    // this chunk at its own level
+    int quadrantMask = 0;
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        int childIndex = chunk.children[quadrant];
+        if (childIndex < 0) {
+            continue;
+        }
+        
+        const TerrainChunk& child = mTerrainChunks[childIndex];
+        if (BoxIntersectsSphere(child.boundsMin, child.boundsMax, mCameraPosition, lodRanges[chunk.level - 1])) {
+            SelectTerrainChunks(childIndex, planes, lodRanges, draws);
+        } else if (BoxIntersectsFrustum(planes, child.boundsMin, child.boundsMax)) {
+            quadrantMask |= 1 << quadrant;
+        }
+    }
+    if (quadrantMask) {
+        draws.push_back({ chunkIndex, quadrantMask });
+    }
+}
+
+// Morph range of a chunk level: the last part of its LOD range (the
+// coarsest level never morphs)
+static void TerrainMorphRange(int level, int levelCount, const float* lodRanges, float& morphStart, float& morphEnd) {
+    if (level + 1 < levelCount) {
+        float previousRange = level > 0 ? lodRanges[level - 1] : 0.0f;
+        morphEnd = lodRanges[level];
+        morphStart = previousRange + (morphEnd - previousRange) * Renderer3D_Metal::kTerrainMorphStart;
+    } else {
+        morphStart = 0.0f;
+        morphEnd = 0.0f;
+    }
+}
+
+// GPU culling and chunk table structs; match TerrainCullChunk and
+// TerrainCullUniforms in LanderShaders.metal
+struct TerrainCullChunk {
+    float boundsMin[4];
+    float boundsMax[4];
+    float positionOrigin[4];
+    float positionExtent[4];
+    int32_t level;
+    int32_t parent;       // -1 for the root
+    int32_t children[4];
+    uint32_t firstVertex;
+    uint32_t command;     // First of the chunk's two commands in a frame's range
+};
+
+struct TerrainCullUniforms {
+    float planes[6][4];
+    float cameraPosition[4];
+    float lodRanges[Renderer3D_Metal::kMaxTerrainLevels];
+    float morphStart[Renderer3D_Metal::kMaxTerrainLevels];
+    float morphScale[Renderer3D_Metal::kMaxTerrainLevels];
+    uint32_t chunkCount;
+    uint32_t commandBase;
+    uint32_t quadrantIndexCount;
+    uint32_t padding;
+    float occlusionViewProjection[16];  // float4x4, 16-byte aligned at offset 320
+    float occlusionSize[2];
+    uint32_t occlusionLevels;           // 0 = don't test occlusion
+    uint32_t occlusionPadding;
+};
+
+static_assert(sizeof(TerrainCullChunk) == 96, "TerrainCullChunk must match LanderShaders.metal");
+static_assert(offsetof(TerrainCullUniforms, occlusionViewProjection) % 16 == 0 && sizeof(TerrainCullUniforms) == 400,
+              "TerrainCullUniforms must match LanderShaders.metal");
+
+// Morph start and 1 / length of every level, as terrain_chunk_vertex and
+// terrain_table_vertex read them
+static void SetTerrainCullMorph(int levelCount, const float* lodRanges, TerrainCullUniforms& cull) {
+    for (int level = 0; level < levelCount; level++) {
+        float morphEnd;
+        TerrainMorphRange(level, levelCount, lodRanges, cull.morphStart[level], morphEnd);
+        cull.morphScale[level] = morphEnd > cull.morphStart[level] ? 1.0f / (morphEnd - cull.morphStart[level]) : 0.0f;
+    }
+}
+
+// Fewest chunk draws worth a parallel sub-encoder of their own
+static const size_t kTerrainDrawsPerEncoder = 128;
+
+bool Renderer3D_Metal::BindTerrainTable(const float* lodRanges) {
+    if (!mTerrainTablePipelineStates[kShaderVariantTerrain] || !mTerrainTablePipelineStates[kShaderVariantLandingPad]) {
+        return false;
+    }
+    if (mTerrainCullChunksDirty && !UploadTerrainCullChunks()) return false;
+    
+    // Only the morph of the culling uniforms is read here
+    TerrainCullUniforms levels;
+    std::memset(&levels, 0, sizeof(levels));
+    SetTerrainCullMorph(mTerrainLevelCount, lodRanges, levels);
+    size_t levelsOffset = 0;
+    if (!AllocateUniforms(&levels, sizeof(levels), levelsOffset) ||
+        !AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), mTerrainTableUniformOffset)) {
+        return false;
+    }
+    
+    // Point this frame's slot at the chunk table and the levels
+    const size_t argumentSlotSize = mTerrainTableArgumentBuffer->length() / mFramesInFlight;
+    mTerrainTableArgumentOffset = mFrameSlot * argumentSlotSize;
+    mTerrainTableArgumentEncoder->setArgumentBuffer(mTerrainTableArgumentBuffer, mTerrainTableArgumentOffset);
+    mTerrainTableArgumentEncoder->setBuffer(mTerrainCullChunkBuffer, 0, 0);
+    mTerrainTableArgumentEncoder->setBuffer(mUniformRingBuffer, levelsOffset, 1);
+    return true;
+}
+
+void Renderer3D_Metal::DrawTerrainChunks(const float* lodRanges) {
+    // Each chunk decodes against its own position range and morphs over
+    // the last part of its level's range. Without the table the uniforms
+    // go into the ring here, in draw order, so only the encoding below is
+    // split up.
+    size_t drawCount = mTerrainDraws.size();
+    const bool useTable = BindTerrainTable(lodRanges);
+    FrameVector<size_t> uniformOffsets(useTable ? 0 : drawCount, mFrameArena);
+    for (size_t i = 0; i < drawCount && !useTable; i++) {
+        const TerrainChunk& chunk = mTerrainChunks[mTerrainDraws[i].chunk];
+        SetPositionDecode(chunk.origin, chunk.extent);
+        float morphStart, morphEnd;
+        TerrainMorphRange(chunk.level, mTerrainLevelCount, lodRanges, morphStart, morphEnd);
+        SetLodMorph(morphStart, morphEnd);
+        if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffsets[i])) {
+            drawCount = i;
+            break;
+        }
+    }
+    
+    // One slice per worker and the caller, as long as each has enough draws
+    size_t encoderCount = 1;
+    if (mParallelEncoder && mJobSystem) {
+        encoderCount = std::min(static_cast<size_t>(mJobSystem->GetWorkerCount() + 1),
+                                drawCount / kTerrainDrawsPerEncoder);
+    }
+    if (encoderCount <= 1) {
+        EncodeTerrainChunks(mRenderEncoder, 0, drawCount, useTable ? nullptr : uniformOffsets.data());
+        return;
+    }
+    PROFILE_SCOPE("Parallel Terrain Encoding");
+    
+    // Sub-encoders run in the order they were made: what was drawn so far,
+    // the slices in draw order, then a fresh one for the rest of the frame
+    mRenderEncoder->endEncoding();
+    FrameVector<MTL::RenderCommandEncoder*> encoders(encoderCount, mFrameArena);
+    for (size_t e = 0; e < encoderCount; e++) {
+        encoders[e] = mParallelEncoder->renderCommandEncoder();
+    }
+    mRenderEncoder = mParallelEncoder->renderCommandEncoder();
+    BindSceneState(mRenderEncoder);
+    
+    mJobSystem->ParallelFor(encoderCount, 1, [&](size_t begin, size_t end) {
+        for (size_t e = begin; e < end; e++) {
+            PROFILE_SCOPE("Terrain Encoding");
+            NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+            MTL::RenderCommandEncoder* encoder = encoders[e];
+            BindSceneState(encoder);
+            EncodeTerrainChunks(encoder, drawCount * e / encoderCount, drawCount * (e + 1) / encoderCount,
+                                useTable ? nullptr : uniformOffsets.data());
+            encoder->endEncoding();
+            pool->release();
+        }
+    });
+}
+
+void Renderer3D_Metal::EncodeTerrainChunks(MTL::RenderCommandEncoder* encoder, size_t begin, size_t end,
+                                           const size_t* uniformOffsets) const {
+    // Set vertex buffer
+    encoder->setVertexBuffer(mTerrainVertexBuffer, 0, 0);
+    
+    // The table is bound once for every chunk; the chunk buffer is only
+    // reached through it, so it is declared unless the residency set keeps
+    // it resident and its last copy has completed
+    const bool useTable = uniformOffsets == nullptr;
+    MTL::RenderPipelineState* const* pipelines = useTable ? mTerrainTablePipelineStates : mScenePipelineStates;
+    if (useTable) {
+        encoder->setRenderPipelineState(pipelines[kShaderVariantTerrain]);
+        encoder->setVertexBuffer(mUniformRingBuffer, mTerrainTableUniformOffset, 1);
+        encoder->setVertexBuffer(mTerrainTableArgumentBuffer, mTerrainTableArgumentOffset, 2);
+        if (!CanSkipUseResource(mTerrainCullChunksUploadSerial)) {
+            encoder->useResource(mTerrainCullChunkBuffer, MTL::ResourceUsageRead);
+        }
+    }
+    
+    // The encoder starts with the terrain variant bound; only chunks with
+    // landing pad samples need the pad branch
+    ShaderVariant boundVariant = kShaderVariantTerrain;
+    for (size_t i = begin; i < end; i++) {
+        const TerrainDraw& draw = mTerrainDraws[i];
+        const TerrainChunk& chunk = mTerrainChunks[draw.chunk];
+        ShaderVariant variant = chunk.hasLandingPad ? kShaderVariantLandingPad : kShaderVariantTerrain;
+        if (variant != boundVariant) {
+            encoder->setRenderPipelineState(pipelines[variant]);
+            boundVariant = variant;
+        }
+        if (!useTable) {
+            encoder->setVertexBuffer(mUniformRingBuffer, uniformOffsets[i], 1);
+        }
+        
+        // One draw per run of consecutive quadrants (the all-ones index
+        // restarts the strip); with the table the base instance is the chunk
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+            if (!(draw.quadrantMask & (1 << quadrant))) continue;
+            int runEnd = quadrant + 1;
+            while (runEnd < 4 && (draw.quadrantMask & (1 << runEnd))) runEnd++;
+            
+            encoder->drawIndexedPrimitives(
+                MTL::PrimitiveTypeTriangleStrip,
+                NS::UInteger((runEnd - quadrant) * mTerrainQuadrantIndexCount),
+                MTL::IndexTypeUInt16,
+                mTerrainIndexBuffer,
+                NS::UInteger(quadrant * mTerrainQuadrantIndexCount * sizeof(uint16_t)),
+                NS::UInteger(1),
+                NS::Integer(chunk.firstVertex),
+                NS::UInteger(useTable ? draw.chunk : 0)
+            );
+            quadrant = runEnd;
+        }
+    }
     
-    // Release Metal layer using the bridge
-    if (mMetalLayer) {
-    // We don't call release on mMetalLayer directly because it's managed by Objective-C
-    ReleaseCAMetalLayer(reinterpret_cast<void*>(mMetalLayer));
-    mMetalLayer = nullptr;
+    if (useTable || boundVariant != kShaderVariantTerrain) {
+        encoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    }
+}
+
+bool Renderer3D_Metal::UploadTerrainCullChunks() {
+    PROFILE_ZONE("Metal Cull Chunk Upload");
+    // Commands are grouped by variant so each group executes with one
+    // pipeline: terrain chunks first, landing pad chunks from
+    // mTerrainPadCommand
+    const size_t chunkCount = mTerrainChunks.size();
+    int terrainChunkCount = 0;
+    for (const TerrainChunk& chunk : mTerrainChunks) {
+        if (!chunk.hasLandingPad) terrainChunkCount++;
     }
+    mTerrainPadCommand = 2 * terrainChunkCount;
     
-    // Release Metal device
-    if (mDevice) { mDevice->release(); mDevice = nullptr; }
+    // Last frame's depth is of the old chunks, which may have covered
+    // ground the new ones don't
+    mHiZReady = false;
     
-    // Destroy SDL window
-    if (mWindow) {
-        SDL_DestroyWindow(mWindow);
-        mWindow = nullptr;
+    // A full upload rarely fits the staging ring, so it gets its own buffer
+    const size_t tableBytes = chunkCount * sizeof(TerrainCullChunk);
+    MTL::Buffer* staging = mHeapAllocator.NewBuffer(tableBytes, MetalHeapAllocator::Memory::Shared);
+    if (!staging) {
+        LOG_ERROR("Failed to create terrain culling upload buffer");
+        return false;
+    }
+    TerrainCullChunk* table = static_cast<TerrainCullChunk*>(staging->contents());
+    int terrainCommand = 0;
+    int padCommand = mTerrainPadCommand;
+    for (size_t i = 0; i < chunkCount; i++) {
+        const TerrainChunk& chunk = mTerrainChunks[i];
+        TerrainCullChunk& entry = table[i];
+        for (int axis = 0; axis < 3; axis++) {
+            entry.boundsMin[axis] = chunk.boundsMin[axis];
+            entry.boundsMax[axis] = chunk.boundsMax[axis];
+            entry.positionOrigin[axis] = chunk.origin[axis];
+            entry.positionExtent[axis] = chunk.extent[axis];
+        }
+        entry.boundsMin[3] = entry.boundsMax[3] = 0.0f;
+        entry.positionOrigin[3] = entry.positionExtent[3] = 0.0f;
+        entry.level = chunk.level;
+        entry.parent = -1;
+        std::copy(chunk.children, chunk.children + 4, entry.children);
+        entry.firstVertex = static_cast<uint32_t>(chunk.firstVertex);
+        int& nextCommand = chunk.hasLandingPad ? padCommand : terrainCommand;
+        entry.command = static_cast<uint32_t>(nextCommand);
+        nextCommand += 2;
+    }
+    for (size_t i = 0; i < chunkCount; i++) {
+        for (int child : mTerrainChunks[i].children) {
+            if (child >= 0) table[child].parent = static_cast<int32_t>(i);
+        }
     }
     
-    // Shut down SDL
-    SDL_Quit();
+    // Frames in flight may still use the old table and commands, so a new
+    // layout gets new ones and the old ones go once those frames are done.
+    // The chunk table pipelines need only the table.
+    const NS::UInteger commandCount = NS::UInteger(2 * chunkCount) * mFramesInFlight;
+    if (!mTerrainCullChunkBuffer || mTerrainCullChunkBuffer->length() != tableBytes) {
+        mHeapAllocator.Free(mTerrainCullChunkBuffer);
+        mTerrainCullChunkBuffer = mHeapAllocator.NewBuffer(tableBytes, MetalHeapAllocator::Memory::Private);
+    }
+    if (mUseGpuTerrainCulling && (!mTerrainIndirectCommands || mTerrainIndirectCommands->size() != commandCount)) {
+        ReleaseAfterFrame(mTerrainIndirectCommands);
+        
+        // Pipelines are bound per variant by the render pass; the buffers
+        // are the kernel's, set per command
+        MTL::IndirectCommandBufferDescriptor* descriptor = MTL::IndirectCommandBufferDescriptor::alloc()->init();
+        descriptor->setCommandTypes(MTL::IndirectCommandTypeDrawIndexed);
+        descriptor->setInheritPipelineState(true);
+        descriptor->setInheritBuffers(false);
+        descriptor->setMaxVertexBufferBindCount(4);
+        descriptor->setMaxFragmentBufferBindCount(2);
+        mTerrainIndirectCommands = mDevice->newIndirectCommandBuffer(descriptor, commandCount,
+                                                                     MTL::ResourceStorageModePrivate);
+        descriptor->release();
+    }
+    if (!mTerrainCullChunkBuffer || (mUseGpuTerrainCulling && !mTerrainIndirectCommands)) {
+        LOG_ERROR("Failed to create terrain culling buffers for %zu chunks", chunkCount);
+        mHeapAllocator.Free(staging);
+        return false;
+    }
     
-    mInitialized = false;
+    BufferUpload upload = { staging, 0, mTerrainCullChunkBuffer, 0, tableBytes };
+    SubmitBufferUploads(&upload, 1);
+    mHeapAllocator.Free(staging);
+    mTerrainCullChunksDirty = false;
+    mTerrainCullChunksUploadSerial = mHeapAllocator.GetFrameSerial();
+    return true;
 }
 
-void Renderer3D_Metal::Clear() {
-    // Metal doesn't have a separate clear function,
-    // instead the clear color is set in the render pass descriptor
-    // which is created in the Present method
+bool Renderer3D_Metal::CanSkipUseResource(uint64_t writeSerial) const {
+    return mHeapAllocator.HasResidencySet() && writeSerial <= mHeapAllocator.GetCompletedSerial();
 }
 
-void Renderer3D_Metal::Present() {
-    if (!mInitialized) return;
-    
-    // Get the next drawable
-    CA::MetalDrawable* drawable = mMetalLayer->nextDrawable();
-    if (!drawable) return;
-    
-    // Create a render pass descriptor
-    MTL::RenderPassDescriptor* renderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
-    
-    // Configure color attachment
-    renderPassDescriptor->colorAttachments()->object(0)->setTexture(drawable->texture());
-    renderPassDescriptor->colorAttachments()->object(0)->setLoadAction(MTL::LoadActionClear);
-    renderPassDescriptor->colorAttachments()->object(0)->setClearColor(MTL::ClearColor(0.2, 0.4, 0.6, 1.0));
-    renderPassDescriptor->colorAttachments()->object(0)->setStoreAction(MTL::StoreActionStore);
-    
-    // Configure depth attachment
-    renderPassDescriptor->setDepthAttachment(MTL::RenderPassDepthAttachmentDescriptor::alloc()->init());
-    renderPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
-    renderPassDescriptor->depthAttachment()->setLoadAction(MTL::LoadActionClear);
-    renderPassDescriptor->depthAttachment()->setClearDepth(1.0);
-    renderPassDescriptor->depthAttachment()->setStoreAction(MTL::StoreActionDontCare);
-    
-    // Create command buffer
-    MTL::CommandBuffer* commandBuffer = mCommandQueue->commandBuffer();
-    
-    // Create render command encoder
-    MTL::RenderCommandEncoder* renderEncoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
-    
-    // Set render pipeline state
-    renderEncoder->setRenderPipelineState(mRenderPipelineState);
-    
-    // Set depth stencil state
-    renderEncoder->setDepthStencilState(mDepthStencilState);
-    
-    // Set fragment uniforms
-    renderEncoder->setFragmentBuffer(mFragmentUniformBuffer, 0, 0);
+void Renderer3D_Metal::DrawTerrainIndirect(const float* lodRanges) {
+    PROFILE_ZONE("Metal Terrain Indirect");
+    if (mTerrainCullChunksDirty && !UploadTerrainCullChunks()) return;
+    
+    const uint32_t chunkCount = static_cast<uint32_t>(mTerrainChunks.size());
+    TerrainCullUniforms cull;
+    std::memset(&cull, 0, sizeof(cull));
+    std::memcpy(cull.planes, mFrustumPlanes, sizeof(cull.planes));
+    std::copy(mCameraPosition, mCameraPosition + 3, cull.cameraPosition);
+    for (int level = 0; level + 1 < mTerrainLevelCount; level++) {
+        cull.lodRanges[level] = lodRanges[level];
+    }
+    SetTerrainCullMorph(mTerrainLevelCount, lodRanges, cull);
+    cull.chunkCount = chunkCount;
+    cull.commandBase = static_cast<uint32_t>(mFrameSlot) * 2 * chunkCount;
+    cull.quadrantIndexCount = static_cast<uint32_t>(mTerrainQuadrantIndexCount);
+    if (mHiZReady) {
+        std::memcpy(cull.occlusionViewProjection, mHiZViewProjection.values, sizeof(cull.occlusionViewProjection));
+        cull.occlusionSize[0] = mHiZSize[0];
+        cull.occlusionSize[1] = mHiZSize[1];
+        cull.occlusionLevels = static_cast<uint32_t>(mHiZLevels.size());
+    }
     
-    // End encoding
-    renderEncoder->endEncoding();
+    size_t cullOffset = 0;
+    size_t uniformOffset = 0;
+    size_t fragmentOffset = 0;
+    if (!AllocateUniforms(&cull, sizeof(cull), cullOffset) ||
+        !AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset) ||
+        !AllocateUniforms(&mFragmentUniforms, sizeof(FragmentUniforms), fragmentOffset)) {
+        return;
+    }
     
-    // Present drawable
-    commandBuffer->presentDrawable(drawable);
+    // Point this frame's argument slot at the command buffer
+    const size_t argumentSlotSize = mTerrainCullArgumentBuffer->length() / mFramesInFlight;
+    const size_t argumentOffset = mFrameSlot * argumentSlotSize;
+    mTerrainCullArgumentEncoder->setArgumentBuffer(mTerrainCullArgumentBuffer, argumentOffset);
+    mTerrainCullArgumentEncoder->setIndirectCommandBuffer(mTerrainIndirectCommands, 0);
+    
+    // Commands for this frame's range, committed ahead of the frame like the
+    // terrain uploads (the frame semaphore protects the range)
+    MTL::CommandBuffer* cullCommands = mCommandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* compute = cullCommands->computeCommandEncoder();
+    compute->setComputePipelineState(mTerrainCullPipeline);
+    compute->setBuffer(mUniformRingBuffer, cullOffset, 0);
+    compute->setBuffer(mTerrainCullChunkBuffer, 0, 1);
+    compute->setBuffer(mTerrainVertexBuffer, 0, 2);
+    compute->setBuffer(mTerrainIndexBuffer, 0, 3);
+    compute->setBuffer(mUniformRingBuffer, uniformOffset, 4);
+    compute->setBuffer(mUniformRingBuffer, fragmentOffset, 5);
+    compute->setBuffer(mTerrainCullArgumentBuffer, argumentOffset, 6);
+    compute->setBuffer(mUniformRingBuffer, mMotionUniformOffset, 7);
+    if (mUseHiZCulling) {
+        compute->setTexture(mHiZTexture, 0);
+    }
+    compute->useResource(mTerrainIndirectCommands, MTL::ResourceUsageWrite);
+    compute->dispatchThreads(MTL::Size(chunkCount, 1, 1),
+                             MTL::Size(mTerrainCullPipeline->threadExecutionWidth(), 1, 1));
+    compute->endEncoding();
+    cullCommands->commit();
+    
+    // The commands reference these without binding them to the encoder.
+    // The command buffer is no heap resource and was just written; the
+    // heap buffers are declared only if they may not be resident, or for
+    // the draws to wait for copies still in flight.
+    mRenderEncoder->useResource(mTerrainIndirectCommands, MTL::ResourceUsageRead);
+    if (!CanSkipUseResource(mTerrainCullChunksUploadSerial)) {
+        mRenderEncoder->useResource(mTerrainCullChunkBuffer, MTL::ResourceUsageRead);
+    }
+    if (!CanSkipUseResource(mTerrainUploadSerial)) {
+        mRenderEncoder->useResource(mTerrainVertexBuffer, MTL::ResourceUsageRead);
+        mRenderEncoder->useResource(mTerrainIndexBuffer, MTL::ResourceUsageRead);
+    }
+    if (!mHeapAllocator.HasResidencySet()) {
+        mRenderEncoder->useResource(mUniformRingBuffer, MTL::ResourceUsageRead);
+    }
     
-    // Commit command buffer
-    commandBuffer->commit();
+    const NS::UInteger commandBase = cull.commandBase;
+    const NS::UInteger commandCount = 2 * chunkCount;
+    const NS::UInteger padCommand = static_cast<NS::UInteger>(mTerrainPadCommand);
+    if (padCommand > 0) {
+        mRenderEncoder->setRenderPipelineState(mTerrainChunkPipelineStates[kShaderVariantTerrain]);
+        mRenderEncoder->executeCommandsInBuffer(mTerrainIndirectCommands, NS::Range::Make(commandBase, padCommand));
+    }
+    if (padCommand < commandCount) {
+        mRenderEncoder->setRenderPipelineState(mTerrainChunkPipelineStates[kShaderVariantLandingPad]);
+        mRenderEncoder->executeCommandsInBuffer(mTerrainIndirectCommands,
+                                                NS::Range::Make(commandBase + padCommand, commandCount - padCommand));
+    }
     
-    // Clean up
-    renderPassDescriptor->release();
+    // Commands don't leave their buffers bound, but the pipeline stays
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setFragmentBuffer(mUniformRingBuffer, fragmentOffset, 0);
+    mRenderEncoder->setFragmentBuffer(mUniformRingBuffer, mMotionUniformOffset, 1);
+    if (mUseRayTracedShadows) {
+        mRenderEncoder->setFragmentAccelerationStructure(mTerrainRayTracer.GetAccelerationStructure(), 3);
+    }
 }
 
-// Rest of the methods remain largely the same, just fixing Metal-cpp specific issues
-// and ensuring proper reference counting
+bool Renderer3D_Metal::CreateHiZPyramid(int depthWidth, int depthHeight) {
+    ReleaseHiZPyramid();
+    
+    // Odd sizes round down; the reduction folds the last column or row into
+    // the texel before it
+    const int width = std::max(1, depthWidth / 2);
+    const int height = std::max(1, depthHeight / 2);
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+        MTL::PixelFormatR32Float, width, height, true);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    descriptor->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+    mHiZTexture = mHeapAllocator.NewTexture(descriptor);
+    if (!mHiZTexture) {
+        return false;
+    }
+    for (NS::UInteger level = 0; level < mHiZTexture->mipmapLevelCount(); level++) {
+        MTL::Texture* view = mHiZTexture->newTextureView(MTL::PixelFormatR32Float, MTL::TextureType2D,
+                                                         NS::Range::Make(level, 1), NS::Range::Make(0, 1));
+        if (!view) {
+            ReleaseHiZPyramid();
+            return false;
+        }
+        mHiZLevels.push_back(view);
+    }
+    LOG_INFO("Hi-Z pyramid: %dx%d, %zu levels", width, height, mHiZLevels.size());
+    return true;
+}
 
-void Renderer3D_Metal::RenderLander(Lander* lander) {
-    if (!mInitialized || !lander) return;
-    
-    // Get lander properties
-    const float* position = lander->GetPosition();
-    const float* rotation = lander->GetRotation();
-    const float* scale = lander->GetScale();
-    
-    // Update model uniforms
-    UpdateModelUniforms(position, rotation, scale);
-    
-    // Get the next drawable
-    CA::MetalDrawable* drawable = mMetalLayer->nextDrawable();
-    if (!drawable) return;
-    
-    // Create a render pass descriptor
-    MTL::RenderPassDescriptor* renderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
-    
-    // Configure color attachment
-    renderPassDescriptor->colorAttachments()->object(0)->setTexture(drawable->texture());
-    renderPassDescriptor->colorAttachments()->object(0)->setLoadAction(MTL::LoadActionClear);
-    renderPassDescriptor->colorAttachments()->object(0)->setClearColor(MTL::ClearColor(0.2, 0.4, 0.6, 1.0));
-    renderPassDescriptor->colorAttachments()->object(0)->setStoreAction(MTL::StoreActionStore);
-    
-    // Configure depth attachment
-    renderPassDescriptor->setDepthAttachment(MTL::RenderPassDepthAttachmentDescriptor::alloc()->init());
-    renderPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
-    renderPassDescriptor->depthAttachment()->setLoadAction(MTL::LoadActionClear);
-    renderPassDescriptor->depthAttachment()->setClearDepth(1.0);
-    renderPassDescriptor->depthAttachment()->setStoreAction(MTL::StoreActionDontCare);
-    
-    // Create command buffer
-    MTL::CommandBuffer* commandBuffer = mCommandQueue->commandBuffer();
+void Renderer3D_Metal::ReleaseHiZPyramid() {
+    for (MTL::Texture* view : mHiZLevels) {
+        ReleaseAfterFrame(view);
+    }
+    mHiZLevels.clear();
+    if (mHiZTexture) { mHeapAllocator.Free(mHiZTexture); mHiZTexture = nullptr; }
+    mHiZReady = false;
+}
+
+void Renderer3D_Metal::BuildHiZPyramid(MTL::Texture* depth, int width, int height) {
+    PROFILE_ZONE("Metal Hi-Z Pyramid");
+    if (!mUseHiZCulling || !mHiZTexture || !mHiZDepthPipeline || !mHiZReducePipeline || !depth) return;
+    
+    // The whole target is reduced: past the rendered region it holds the
+    // cleared far depth, which never occludes anything. The pyramid is
+    // tracked, so each level waits for the one before it and the next
+    // frame's culling waits for the last.
+    MTL::ComputeCommandEncoder* compute = mCommandBuffer->computeCommandEncoder();
+    for (size_t level = 0; level < mHiZLevels.size(); level++) {
+        MTL::ComputePipelineState* pipeline = level == 0 ? mHiZDepthPipeline : mHiZReducePipeline;
+        MTL::Texture* target = mHiZLevels[level];
+        compute->setComputePipelineState(pipeline);
+        compute->setTexture(level == 0 ? depth : mHiZLevels[level - 1], 0);
+        compute->setTexture(target, 1);
+        const NS::UInteger threadWidth = pipeline->threadExecutionWidth();
+        const NS::UInteger threadHeight = std::max<NS::UInteger>(1, pipeline->maxTotalThreadsPerThreadgroup() /
+                                                                       threadWidth);
+        compute->dispatchThreads(MTL::Size(target->width(), target->height(), 1),
+                                 MTL::Size(threadWidth, threadHeight, 1));
+    }
+    compute->endEncoding();
     
-    // Create render command encoder
-    MTL::RenderCommandEncoder* renderEncoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
+    // What the next frame reprojects its chunks with
+    mHiZViewProjection = SimdMath::Multiply(mProjectionMatrix, mViewMatrix);
+    mHiZSize[0] = static_cast<float>(width);
+    mHiZSize[1] = static_cast<float>(height);
+    mHiZReady = true;
+}
+
+// Per-draw constants of terrain_map_vertex; matches TerrainMapUniforms in
+// LanderShaders.metal
+struct TerrainMapUniforms {
+    float originX, originZ;
+    float cellWidth, cellLength;
+    int32_t gridSize;
+    int32_t chunkCells;
+    int32_t padding[2];
+};
+
+// One instance of the shared patch; matches TerrainInstance in LanderShaders.metal
+struct TerrainInstance {
+    int32_t cellX, cellZ;
+    int32_t level;
+    float morphStart;
+    float morphScale;   // 1 / morph length (0 = no morph)
+    float padding[3];
+};
+
+void Renderer3D_Metal::DrawTerrainInstances(const Terrain* terrain, const float* lodRanges) {
+    PROFILE_ZONE("Metal Terrain Instances");
+    if (!mTerrainHeightTexture) return;
+    
+    // Chunks that draw the same run of quadrants with the same variant share
+    // one instanced draw: at most twenty draws for the whole terrain. Runs
+    // are counted first so each one's instances sit together in one array.
+    auto forEachRun = [&](auto visit) {
+        for (const TerrainDraw& draw : mTerrainDraws) {
+            const int variant = mTerrainChunks[draw.chunk].hasLandingPad ? kShaderVariantLandingPad
+                                                                         : kShaderVariantTerrain;
+            for (int quadrant = 0; quadrant < 4; quadrant++) {
+                if (!(draw.quadrantMask & (1 << quadrant))) continue;
+                int runEnd = quadrant + 1;
+                while (runEnd < 4 && (draw.quadrantMask & (1 << runEnd))) runEnd++;
+                visit(draw, variant, quadrant, runEnd);
+                quadrant = runEnd;
+            }
+        }
+    };
     
-    // Set render pipeline state
-    renderEncoder->setRenderPipelineState(mRenderPipelineState);
+    int runCounts[2][4][5] = {};
+    forEachRun([&](const TerrainDraw&, int variant, int first, int end) { runCounts[variant][first][end]++; });
+    int runStarts[2][4][5];
+    int runFill[2][4][5];
+    int instanceCount = 0;
+    for (int variant = 0; variant < 2; variant++) {
+        for (int first = 0; first < 4; first++) {
+            for (int end = 0; end <= 4; end++) {
+                runStarts[variant][first][end] = runFill[variant][first][end] = instanceCount;
+                instanceCount += runCounts[variant][first][end];
+            }
+        }
+    }
     
-    // Set depth stencil state
-    renderEncoder->setDepthStencilState(mDepthStencilState);
+    FrameVector<TerrainInstance> instances(instanceCount, mFrameArena);
+    forEachRun([&](const TerrainDraw& draw, int variant, int first, int end) {
+        const TerrainChunk& chunk = mTerrainChunks[draw.chunk];
+        TerrainInstance& instance = instances[runFill[variant][first][end]++];
+        instance.cellX = chunk.cellX;
+        instance.cellZ = chunk.cellZ;
+        instance.level = chunk.level;
+        float morphEnd;
+        TerrainMorphRange(chunk.level, mTerrainLevelCount, lodRanges, instance.morphStart, morphEnd);
+        instance.morphScale = morphEnd > instance.morphStart ? 1.0f / (morphEnd - instance.morphStart) : 0.0f;
+        instance.padding[0] = instance.padding[1] = instance.padding[2] = 0.0f;
+    });
+    
+    TerrainMapUniforms map;
+    map.originX = terrain->GetOriginX();
+    map.originZ = terrain->GetOriginZ();
+    map.cellWidth = terrain->GetCellWidth();
+    map.cellLength = terrain->GetCellLength();
+    map.gridSize = terrain->GetGridSize();
+    map.chunkCells = kTerrainChunkCells;
+    map.padding[0] = map.padding[1] = 0;
+    
+    size_t uniformOffset = 0;
+    size_t mapOffset = 0;
+    if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset) ||
+        !AllocateUniforms(&map, sizeof(map), mapOffset)) {
+        return;
+    }
     
-    // Set vertex buffer
-    renderEncoder->setVertexBuffer(mLanderVertexBuffer, 0, 0);
-    
-    // Set uniform buffers
-    renderEncoder->setVertexBuffer(mVertexUniformBuffer, 0, 1);
-    renderEncoder->setFragmentBuffer(mFragmentUniformBuffer, 0, 0);
-    
-    // Draw indexed primitives
-    renderEncoder->drawIndexedPrimitives(
-        MTL::PrimitiveTypeTriangle,
-        mLanderIndexCount,
-        MTL::IndexTypeUInt16,
-        mLanderIndexBuffer,
-        0
-    );
+    mRenderEncoder->setVertexBuffer(mUniformRingBuffer, uniformOffset, 1);
+    mRenderEncoder->setVertexBuffer(mUniformRingBuffer, mapOffset, 2);
+    mRenderEncoder->setVertexTexture(mTerrainHeightTexture, 0);
+    mRenderEncoder->setVertexTexture(mTerrainNormalTexture, 1);
+    mRenderEncoder->setVertexTexture(mTerrainFlagTexture, 2);
+    mRenderEncoder->setVertexTexture(mTerrainHeightRangeTexture, 3);
+    
+    for (int variant = 0; variant < 2; variant++) {
+        mRenderEncoder->setRenderPipelineState(mTerrainMapPipelineStates[variant]);
+        for (int first = 0; first < 4; first++) {
+            for (int end = first + 1; end <= 4; end++) {
+                const int count = runCounts[variant][first][end];
+                if (count == 0) continue;
+                
+                size_t instanceOffset = 0;
+                if (!AllocateUniforms(instances.data() + runStarts[variant][first][end],
+                                      count * sizeof(TerrainInstance), instanceOffset)) {
+                    break;
+                }
+                mRenderEncoder->setVertexBuffer(mUniformRingBuffer, instanceOffset, 3);
+                mRenderEncoder->drawIndexedPrimitives(
+                    MTL::PrimitiveTypeTriangleStrip,
+                    NS::UInteger((end - first) * mTerrainQuadrantIndexCount),
+                    MTL::IndexTypeUInt16,
+                    mTerrainIndexBuffer,
+                    NS::UInteger(first * mTerrainQuadrantIndexCount * sizeof(uint16_t)),
+                    NS::UInteger(count)
+                );
+            }
+        }
+    }
     
-    // End encoding
-    renderEncoder->endEncoding();
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+}
+
+// Culling inputs of terrain_meshlet_object; matches TerrainMeshCull in
+// LanderShaders.metal
+struct TerrainMeshCull {
+    float planes[6][4];
+    float cameraPosition[4];
+};
+
+// One selected chunk of a meshlet draw; matches TerrainMeshChunk in
+// LanderShaders.metal
+struct TerrainMeshChunk {
+    int32_t cellX, cellZ;
+    int32_t level;
+    float morphStart;
+    float morphScale;       // 1 / morph length (0 = no morph)
+    uint32_t firstMeshlet;  // In mTerrainMeshletBuffer
+    uint32_t quadrantMask;  // TerrainDraw::quadrantMask
+    uint32_t padding;
+};
+
+void Renderer3D_Metal::DrawTerrainMeshlets(const Terrain* terrain, const float* lodRanges) {
+    PROFILE_ZONE("Metal Terrain Meshlets");
+    if (!mTerrainHeightTexture || !mTerrainMeshletBuffer) return;
+    
+    // One object threadgroup per selected chunk, grouped by variant; the
+    // object stage drops the quadrants the selection left out
+    int variantCounts[2] = {};
+    for (const TerrainDraw& draw : mTerrainDraws) {
+        variantCounts[mTerrainChunks[draw.chunk].hasLandingPad ? kShaderVariantLandingPad : kShaderVariantTerrain]++;
+    }
+    int variantFill[2] = { 0, variantCounts[0] };
+    FrameVector<TerrainMeshChunk> chunks(mTerrainDraws.size(), mFrameArena);
+    for (const TerrainDraw& draw : mTerrainDraws) {
+        const TerrainChunk& chunk = mTerrainChunks[draw.chunk];
+        TerrainMeshChunk& meshChunk = chunks[variantFill[chunk.hasLandingPad ? kShaderVariantLandingPad
+                                                                              : kShaderVariantTerrain]++];
+        meshChunk.cellX = chunk.cellX;
+        meshChunk.cellZ = chunk.cellZ;
+        meshChunk.level = chunk.level;
+        float morphEnd;
+        TerrainMorphRange(chunk.level, mTerrainLevelCount, lodRanges, meshChunk.morphStart, morphEnd);
+        meshChunk.morphScale = morphEnd > meshChunk.morphStart ? 1.0f / (morphEnd - meshChunk.morphStart) : 0.0f;
+        meshChunk.firstMeshlet = static_cast<uint32_t>(draw.chunk * kTerrainMeshletsPerChunk);
+        meshChunk.quadrantMask = static_cast<uint32_t>(draw.quadrantMask);
+        meshChunk.padding = 0;
+    }
     
-    // Present drawable
-    commandBuffer->presentDrawable(drawable);
+    TerrainMeshCull cull;
+    std::memcpy(cull.planes, mFrustumPlanes, sizeof(cull.planes));
+    std::copy(mCameraPosition, mCameraPosition + 3, cull.cameraPosition);
+    cull.cameraPosition[3] = 0.0f;
+    
+    TerrainMapUniforms map;
+    map.originX = terrain->GetOriginX();
+    map.originZ = terrain->GetOriginZ();
+    map.cellWidth = terrain->GetCellWidth();
+    map.cellLength = terrain->GetCellLength();
+    map.gridSize = terrain->GetGridSize();
+    map.chunkCells = kTerrainChunkCells;
+    map.padding[0] = map.padding[1] = 0;
+    
+    size_t uniformOffset = 0;
+    size_t mapOffset = 0;
+    size_t cullOffset = 0;
+    if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset) ||
+        !AllocateUniforms(&map, sizeof(map), mapOffset) ||
+        !AllocateUniforms(&cull, sizeof(cull), cullOffset)) {
+        return;
+    }
     
-    // Commit command buffer
-    commandBuffer->commit();
+    mRenderEncoder->setObjectBuffer(mUniformRingBuffer, cullOffset, 0);
+    mRenderEncoder->setObjectBuffer(mTerrainMeshletBuffer, 0, 2);
+    mRenderEncoder->setMeshBuffer(mUniformRingBuffer, uniformOffset, 1);
+    mRenderEncoder->setMeshBuffer(mUniformRingBuffer, mapOffset, 2);
+    mRenderEncoder->setMeshTexture(mTerrainHeightTexture, 0);
+    mRenderEncoder->setMeshTexture(mTerrainNormalTexture, 1);
+    mRenderEncoder->setMeshTexture(mTerrainFlagTexture, 2);
+    mRenderEncoder->setMeshTexture(mTerrainHeightRangeTexture, 3);
+    
+    int first = 0;
+    for (int variant = 0; variant < 2; variant++) {
+        const int count = variantCounts[variant];
+        if (count == 0) continue;
+        
+        size_t chunkOffset = 0;
+        if (!AllocateUniforms(chunks.data() + first, count * sizeof(TerrainMeshChunk), chunkOffset)) {
+            break;
+        }
+        first += count;
+        mRenderEncoder->setRenderPipelineState(mTerrainMeshPipelineStates[variant]);
+        mRenderEncoder->setObjectBuffer(mUniformRingBuffer, chunkOffset, 1);
+        mRenderEncoder->setMeshBuffer(mUniformRingBuffer, chunkOffset, 3);
+        mRenderEncoder->drawMeshThreadgroups(MTL::Size(NS::UInteger(count), 1, 1),
+                                             MTL::Size(kTerrainMeshletsPerChunk, 1, 1),
+                                             MTL::Size(kTerrainMeshletTriangles, 1, 1));
+    }
     
-    // Clean up
-    renderPassDescriptor->release();
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
 }
 
-// Update camera uniform buffers
-void Renderer3D_Metal::UpdateCameraUniforms() {
-    // Update vertex uniforms
-    VertexUniforms* vertUniforms = static_cast<VertexUniforms*>(mVertexUniformBuffer->contents());
-    memcpy(vertUniforms->viewMatrix, mViewMatrix.values, sizeof(mViewMatrix.values));
-    memcpy(vertUniforms->projectionMatrix, mProjectionMatrix.values, sizeof(mProjectionMatrix.values));
-    
-    // Update fragment uniforms
-    FragmentUniforms* fragUniforms = static_cast<FragmentUniforms*>(mFragmentUniformBuffer->contents());
-    memcpy(fragUniforms->lightPosition, mLightPosition, sizeof(mLightPosition));
-    memcpy(fragUniforms->ambientLight, mAmbientLight, sizeof(mAmbientLight));
-    memcpy(fragUniforms->cameraPosition, mCameraPosition, sizeof(mCameraPosition));
-}
+// Inputs of terrain_tess_factors and terrain_tess_vertex; matches
+// TerrainTessUniforms in LanderShaders.metal
+struct TerrainTessUniforms {
+    float originX, originZ;
+    float cellWidth, cellLength;
+    float focusX, focusZ;      // Lander position
+    float radius;              // Distance at which the factors reach 1
+    float maxFactor;
+    int32_t gridSize;
+    int32_t chunkCells;
+    int32_t chunkCount;
+    int32_t padding;
+    int32_t chunkX[Renderer3D_Metal::kMaxNearFieldChunks];   // First cell of each near-field chunk
+    int32_t chunkZ[Renderer3D_Metal::kMaxNearFieldChunks];
+};
 
-// Update model uniform buffer
-void Renderer3D_Metal::UpdateModelUniforms(const float* position, const float* rotation, const float* scale) {
-    // Create model matrix
-    mModelMatrix = CreateModelMatrix(position, rotation, scale);
-    
-    // Update vertex uniforms
-    VertexUniforms* vertUniforms = static_cast<VertexUniforms*>(mVertexUniformBuffer->contents());
-    memcpy(vertUniforms->modelMatrix, mModelMatrix.values, sizeof(mModelMatrix.values));
+// Near field radius in level-0 chunk sides
+static const float kNearFieldRadiusChunks = 1.5f;
+
+static float NearFieldRadius(const Terrain* terrain) {
+    return kNearFieldRadiusChunks * Renderer3D_Metal::kTerrainChunkCells *
+           std::max(terrain->GetCellWidth(), terrain->GetCellLength());
 }
 
-// Additional methods omitted for brevity - they remain largely the same
-// For a full implementation, please copy over the remaining methods
+void Renderer3D_Metal::SelectNearFieldChunks(const Terrain* terrain, const float* lodRanges) {
+    mNearFieldChunks.clear();
+    if (!mUseTerrainTessellation || !mTerrainTessPipelineState || !mTerrainTessFactorPipeline) return;
+    
+    // Level-0 vertices start morphing at morphStart; patches can't follow
+    // the morph, so only chunks entirely short of it are tessellated. This
+    // also keeps every neighbour at level 0.
+    float morphStart, morphEnd;
+    TerrainMorphRange(0, mTerrainLevelCount, lodRanges, morphStart, morphEnd);
+    if (morphEnd <= 0.0f) {
+        morphStart = std::numeric_limits<float>::max();
+    }
+    const float radius = NearFieldRadius(terrain);
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < mTerrainDraws.size(); i++) {
+        const TerrainDraw& draw = mTerrainDraws[i];
+        const TerrainChunk& chunk = mTerrainChunks[draw.chunk];
+        bool nearField = false;
+        if (chunk.level == 0 && static_cast<int>(mNearFieldChunks.size()) < kMaxNearFieldChunks) {
+            float dx = std::max({ chunk.boundsMin[0] - mCameraTarget[0], 0.0f, mCameraTarget[0] - chunk.boundsMax[0] });
+            float dz = std::max({ chunk.boundsMin[2] - mCameraTarget[2], 0.0f, mCameraTarget[2] - chunk.boundsMax[2] });
+            
+            float farthest2 = 0.0f;
+            for (int axis = 0; axis < 3; axis++) {
+                float d = std::max(std::fabs(mCameraPosition[axis] - chunk.boundsMin[axis]),
+                                   std::fabs(mCameraPosition[axis] - chunk.boundsMax[axis]));
+                farthest2 += d * d;
+            }
+            nearField = dx * dx + dz * dz < radius * radius && farthest2 < morphStart * morphStart;
+        }
+        
+        if (nearField) {
+            mNearFieldChunks.push_back(draw.chunk);
+        } else {
+            mTerrainDraws[kept++] = draw;
+        }
+    }
+    mTerrainDraws.resize(kept);
+}
 
-// Implementations for the remaining public interface methods
-void Renderer3D_Metal::RenderTerrain(Terrain* terrain) {
-    if (!mInitialized || !terrain) return;
-    
-    // Get terrain triangles
-    const std::vector<TerrainTriangle>& triangles = terrain->GetTriangles3D();
-    if (triangles.empty()) {
-        std::cout << "No terrain triangles to render" << std::endl;
+void Renderer3D_Metal::DrawTerrainNearField(const Terrain* terrain) {
+    PROFILE_ZONE("Metal Terrain Near Field");
+    if (mNearFieldChunks.empty() || !mTerrainHeightTexture) return;
+    
+    TerrainTessUniforms tess;
+    std::memset(&tess, 0, sizeof(tess));
+    tess.originX = terrain->GetOriginX();
+    tess.originZ = terrain->GetOriginZ();
+    tess.cellWidth = terrain->GetCellWidth();
+    tess.cellLength = terrain->GetCellLength();
+    tess.focusX = mCameraTarget[0];
+    tess.focusZ = mCameraTarget[2];
+    tess.radius = NearFieldRadius(terrain);
+    tess.maxFactor = kNearFieldMaxTessFactor;
+    tess.gridSize = terrain->GetGridSize();
+    tess.chunkCells = kTerrainChunkCells;
+    tess.chunkCount = static_cast<int32_t>(mNearFieldChunks.size());
+    for (int i = 0; i < tess.chunkCount; i++) {
+        tess.chunkX[i] = mTerrainChunks[mNearFieldChunks[i]].cellX;
+        tess.chunkZ[i] = mTerrainChunks[mNearFieldChunks[i]].cellZ;
+    }
+    const NS::UInteger patchCount = NS::UInteger(tess.chunkCount) * kNearFieldPatchesPerChunk;
+    const size_t factorOffset = mFrameSlot * kTessFactorSlotSize;
+    
+    // Factors for this frame's slot, committed ahead of the frame like the
+    // terrain uploads (the frame semaphore protects the slot)
+    MTL::CommandBuffer* factorCommands = mCommandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* compute = factorCommands->computeCommandEncoder();
+    compute->setComputePipelineState(mTerrainTessFactorPipeline);
+    compute->setBytes(&tess, sizeof(tess), 0);
+    compute->setBuffer(mTerrainTessFactorBuffer, factorOffset, 1);
+    compute->dispatchThreads(MTL::Size(patchCount, 1, 1),
+                             MTL::Size(mTerrainTessFactorPipeline->threadExecutionWidth(), 1, 1));
+    compute->endEncoding();
+    factorCommands->commit();
+    
+    size_t uniformOffset = 0;
+    size_t tessOffset = 0;
+    if (!AllocateUniforms(&mVertexUniforms, sizeof(VertexUniforms), uniformOffset) ||
+        !AllocateUniforms(&tess, sizeof(tess), tessOffset)) {
         return;
     }
     
-    // Create or update terrain buffers
-    if (!mTerrainVertexBuffer || !mTerrainIndexBuffer) {
-        // Count number of vertices and prepare data
-        int vertexCount = triangles.size() * 3; // 3 vertices per triangle
-        std::vector<Vertex> vertices(vertexCount);
-        std::vector<uint16_t> indices(vertexCount);
-        
-    // Populate vertices and indices
-    for (size_t i = 0; i < triangles.size(); i++) {
-    const TerrainTriangle& tri = triangles[i];
+    mRenderEncoder->setRenderPipelineState(mTerrainTessPipelineState);
+    mRenderEncoder->setTessellationFactorBuffer(mTerrainTessFactorBuffer, factorOffset, 0);
+    mRenderEncoder->setVertexBuffer(mUniformRingBuffer, uniformOffset, 1);
+    mRenderEncoder->setVertexBuffer(mUniformRingBuffer, tessOffset, 2);
+    mRenderEncoder->setVertexTexture(mTerrainHeightTexture, 0);
+    mRenderEncoder->setVertexTexture(mTerrainFlagTexture, 2);
+    mRenderEncoder->setVertexTexture(mTerrainHeightRangeTexture, 3);
+    mRenderEncoder->drawPatches(3, 0, patchCount, nullptr, 0, 1, 0);
     
-    // Add three vertices for each triangle
-    for (int j = 0; j < 3; j++) {
-        int vIdx = i * 3 + j;
-        
-        // Position
-        vertices[vIdx].position[0] = tri.vertices[j * 3];     // x
-        vertices[vIdx].position[1] = tri.vertices[j * 3 + 1]; // y
-        vertices[vIdx].position[2] = tri.vertices[j * 3 + 2]; // z
-        
-        // Normal
-        vertices[vIdx].normal[0] = tri.normal[0];
-        vertices[vIdx].normal[1] = tri.normal[1];
-        vertices[vIdx].normal[2] = tri.normal[2];
-        
-        // Set isLandingPad and entityType
-        vertices[vIdx].isLandingPad = tri.isLandingPad ? 1.0f : 0.0f;
-        vertices[vIdx].entityType = 0.0f; // 0.0 for terrain
-        
-        // Simple indexing
-        indices[vIdx] = vIdx;
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+}
+
+void Renderer3D_Metal::RenderTerrain(Terrain* terrain) {
+    PROFILE_ZONE("Metal Terrain");
+    if (!mInitialized || !terrain || !mRenderEncoder) return;
+    
+    // Heights still loading from a file: the terrain, and any edit to it,
+    // waits for them rather than the frame
+    if (!FinishTerrainTextureLoad(terrain)) return;
+    
+    // Bring the GPU copy up to date: a regenerated grid is uploaded whole,
+    // smaller edits only re-upload the chunks they touched
+    if (!mTerrainIndexBuffer || terrain->GetLayoutVersion() != mTerrainLayoutVersion) {
+        if (!CreateTerrainBuffers(terrain)) return;
+        mTerrainUploadSerial = mHeapAllocator.GetFrameSerial();
+        if (mUseHorizonShadows) {
+            UploadHorizonMap(terrain, 0, 0, terrain->GetGridSize(), terrain->GetGridSize());
+        }
+    } else {
+        TerrainDirtyRegion region;
+        if (terrain->GetDirtyRegion(mTerrainVersion, region)) {
+            UpdateTerrainRegion(terrain, region);
+            mTerrainUploadSerial = mHeapAllocator.GetFrameSerial();
+            if (mUseHorizonShadows) {
+                UploadHorizonMap(terrain, region.minCellX, region.minCellZ, region.maxCellX, region.maxCellZ);
+            }
         }
     }
-        
-        // Create vertex buffer
-        mTerrainVertexBuffer = mDevice->newBuffer(
-            vertices.data(),
-            vertices.size() * sizeof(Vertex),
-            MTL::ResourceStorageModeShared
-        );
-        
-        // Create index buffer
-        mTerrainIndexBuffer = mDevice->newBuffer(
-            indices.data(),
-            indices.size() * sizeof(uint16_t),
-            MTL::ResourceStorageModeShared
-        );
-        
-        // Store count for drawing
-        mTerrainIndexCount = indices.size();
-        
-        std::cout << "Created terrain buffers with " << vertexCount << " vertices" << std::endl;
+    mTerrainVersion = terrain->GetVersion();
+    if (mTerrainChunks.empty() || mTerrainIOCommands) return;
+    if (mUseShadows) {
+        UpdateTerrainShadow(terrain);
     }
     
-    // Get the next drawable
-    CA::MetalDrawable* drawable = mMetalLayer->nextDrawable();
-    if (!drawable) return;
-    
-    // Create a render pass descriptor
-    MTL::RenderPassDescriptor* renderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+    // LOD ranges: level l + 1 takes over where its error projects to less
+    // than kTerrainMaxScreenError pixels. Each range is at least twice the
+    // previous one and two chunk diagonals, which keeps neighbouring chunks
+    // within one level and lets the morph finish before the next level starts.
+    float pixelsPerRadian = 0.5f * mHeight * mProjectionMatrix.values[5];
+    float cellDiagonal = std::sqrt(terrain->GetCellWidth() * terrain->GetCellWidth() +
+                                   terrain->GetCellLength() * terrain->GetCellLength());
+    float lodRanges[kMaxTerrainLevels];
+    for (int level = 0; level + 1 < mTerrainLevelCount; level++) {
+        float chunkDiagonal = cellDiagonal * (kTerrainChunkCells << level);
+        lodRanges[level] = std::max(mTerrainLevelError[level + 1] * pixelsPerRadian / kTerrainMaxScreenError,
+                                    2.0f * chunkDiagonal);
+        if (level > 0) {
+            lodRanges[level] = std::max(lodRanges[level], 2.0f * lodRanges[level - 1]);
+        }
+    }
     
-    // Configure color attachment
-    renderPassDescriptor->colorAttachments()->object(0)->setTexture(drawable->texture());
-    renderPassDescriptor->colorAttachments()->object(0)->setLoadAction(MTL::LoadActionClear);
-    renderPassDescriptor->colorAttachments()->object(0)->setClearColor(MTL::ClearColor(0.0, 0.0, 0.1, 1.0)); // Dark blue/black sky
-    renderPassDescriptor->colorAttachments()->object(0)->setStoreAction(MTL::StoreActionStore);
+    // Create model matrix for terrain
+    float terrainPosition[3] = {0.0f, 0.0f, 0.0f}; // Center terrain at origin
+    const Quaternion terrainOrientation = {0.0f, 0.0f, 0.0f, 1.0f}; // No rotation
+    float terrainScale[3] = {1.0f, 1.0f, 1.0f};    // Default scale
     
-    // Configure depth attachment
-    renderPassDescriptor->setDepthAttachment(MTL::RenderPassDepthAttachmentDescriptor::alloc()->init());
-    renderPassDescriptor->depthAttachment()->setTexture(mDepthTexture);
-    renderPassDescriptor->depthAttachment()->setLoadAction(MTL::LoadActionClear);
-    renderPassDescriptor->depthAttachment()->setClearDepth(1.0);
-    renderPassDescriptor->depthAttachment()->setStoreAction(MTL::StoreActionDontCare);
+    // Update model uniforms
+    UpdateModelUniforms(terrainPosition, terrainOrientation, terrainScale);
+    
+    // The culling pipelines may still be compiling; until then the CPU selects
+    // The occlusion test needs its pyramid bound, even before there is a frame in it
+    if (mUseGpuTerrainCulling && mTerrainCullPipeline && (!mUseHiZCulling || mHiZTexture) &&
+        mTerrainChunkPipelineStates[kShaderVariantTerrain] && mTerrainChunkPipelineStates[kShaderVariantLandingPad]) {
+        DrawTerrainIndirect(lodRanges);
+        LOG_DEBUG_EVERY(1000, "Culled %zu terrain chunks on the GPU", mTerrainChunks.size());
+        return;
+    }
     
-    // Create command buffer
-    MTL::CommandBuffer* commandBuffer = mCommandQueue->commandBuffer();
+    // The model matrix is the identity, so chunk bounds are already in
+    // world space, where the camera's frustum is
+    mTerrainDraws.clear();
+    SelectTerrainChunks(0, mFrustumPlanes, lodRanges, mTerrainDraws);
+    SelectNearFieldChunks(terrain, lodRanges);
+    
+    if (mUseTerrainTextures) {
+        // Meshlets once both variants are built; the near field stays tessellated
+        if (mUseTerrainMeshShaders && mTerrainMeshPipelineStates[kShaderVariantTerrain] &&
+            mTerrainMeshPipelineStates[kShaderVariantLandingPad]) {
+            DrawTerrainMeshlets(terrain, lodRanges);
+        } else {
+            DrawTerrainInstances(terrain, lodRanges);
+        }
+        DrawTerrainNearField(terrain);
+    } else {
+        DrawTerrainChunks(lodRanges);
+    }
     
-    // Create render command encoder
-    MTL::RenderCommandEncoder* renderEncoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
+    LOG_DEBUG_EVERY(1000, "Drew %zu terrain chunk draws from %zu chunks", mTerrainDraws.size(), mTerrainChunks.size());
+}
+
+// Casters are pushed back by their depth slope, on top of the constant
+// bias the receivers compare with (in texels of the map)
+static const float kShadowSlopeBias = 2.0f;
+static const float kShadowBiasTexels = 1.5f;
+
+// Clip space to shadow map texture coordinates (y down); depth is kept
+static const Matrix4x4 kShadowTextureFromClip = {{
+    0.5f,  0.0f, 0.0f, 0.0f,
+    0.0f, -0.5f, 0.0f, 0.0f,
+    0.0f,  0.0f, 1.0f, 0.0f,
+    0.5f,  0.5f, 0.0f, 1.0f
+}};
+
+// View from the light, looking along -towardsLight at target
+static Matrix4x4 ShadowLightView(const float* towardsLight, const float* target) {
+    const float eye[3] = {
+        target[0] + towardsLight[0], target[1] + towardsLight[1], target[2] + towardsLight[2]
+    };
+    const bool vertical = std::fabs(towardsLight[1]) > 0.99f;
+    const float up[3] = { 0.0f, vertical ? 0.0f : 1.0f, vertical ? 1.0f : 0.0f };
+    return SimdMath::LookAt(eye, target, up);
+}
+
+void Renderer3D_Metal::UpdateTerrainShadow(const Terrain* terrain) {
+    // The light is taken as a sun, in its direction from the terrain's centre
+    const TerrainChunk& root = mTerrainChunks[0];
+    float center[3];
+    float towardsLight[3];
+    float lengthSquared = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        center[i] = 0.5f * (root.boundsMin[i] + root.boundsMax[i]);
+        towardsLight[i] = mLightPosition[i] - center[i];
+        lengthSquared += towardsLight[i] * towardsLight[i];
+    }
+    if (lengthSquared < 1.0e-6f) return;
+    const float inverseLength = 1.0f / std::sqrt(lengthSquared);
+    for (int i = 0; i < 3; i++) {
+        towardsLight[i] *= inverseLength;
+        mShadowLightDirection[i] = towardsLight[i];
+    }
     
-    // Set render pipeline state
-    renderEncoder->setRenderPipelineState(mRenderPipelineState);
+    // Ray-traced: each fragment traces towards the light, far enough to
+    // leave the terrain's bounds, against a structure kept in step with
+    // the terrain; it may be a new one, so it is bound again
+    if (mUseRayTracedShadows) {
+        float diagonalSquared = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            const float extent = root.boundsMax[i] - root.boundsMin[i];
+            diagonalSquared += extent * extent;
+        }
+        const bool traced = mTerrainRayTracer.Update(terrain);
+        std::copy(towardsLight, towardsLight + 3, mFragmentUniforms.sunDirection);
+        mFragmentUniforms.sunDirection[3] = traced ? std::sqrt(diagonalSquared) : 0.0f;
+        RefreshFragmentUniforms();
+        if (mRenderEncoder) {
+            mRenderEncoder->setFragmentAccelerationStructure(mTerrainRayTracer.GetAccelerationStructure(), 3);
+        }
+        return;
+    }
     
-    // Set depth stencil state
-    renderEncoder->setDepthStencilState(mDepthStencilState);
+    // Horizon-mapped: the map was baked with the grid, so only the
+    // lander's cascade needs the light direction
+    if (mUseHorizonShadows) {
+        return;
+    }
     
-    // Set vertex buffer
-    renderEncoder->setVertexBuffer(mTerrainVertexBuffer, 0, 0);
+    // Kept until the light or the terrain changes
+    if (mTerrainShadowValid && mTerrainShadowVersion == mTerrainVersion &&
+        mTerrainShadowLayoutVersion == mTerrainLayoutVersion &&
+        std::equal(mLightPosition, mLightPosition + 3, mTerrainShadowLight)) {
+        return;
+    }
+    MTL::RenderPipelineState* pipeline = mUseTerrainTextures ? mShadowTerrainMapPipelineState : mShadowCasterPipelineState;
+    if (!pipeline || !mTerrainShadowMap || (mUseTerrainTextures && !mTerrainHeightTexture)) return;
+    PROFILE_SCOPE("Terrain Shadow");
+    
+    // Fit the map to the terrain's bounds seen from the light
+    const Matrix4x4 view = ShadowLightView(towardsLight, center);
+    float minimum[3];
+    float maximum[3];
+    std::fill(minimum, minimum + 3, std::numeric_limits<float>::max());
+    std::fill(maximum, maximum + 3, -std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++) {
+        const float point[3] = {
+            (corner & 1) ? root.boundsMax[0] : root.boundsMin[0],
+            (corner & 2) ? root.boundsMax[1] : root.boundsMin[1],
+            (corner & 4) ? root.boundsMax[2] : root.boundsMin[2]
+        };
+        float lightSpace[3];
+        SimdMath::TransformPoint(view, point, lightSpace);
+        for (int i = 0; i < 3; i++) {
+            minimum[i] = std::min(minimum[i], lightSpace[i]);
+            maximum[i] = std::max(maximum[i], lightSpace[i]);
+        }
+    }
+    const Matrix4x4 projection = SimdMath::Orthographic(minimum[0], maximum[0], minimum[1], maximum[1],
+                                                        -maximum[2], -minimum[2]);
+    
+    // The finest level whose cells span two texels: detail finer than that
+    // would not show in the map, and a coarse level is a fraction of the
+    // triangles
+    const float texelSize = std::max(maximum[0] - minimum[0], maximum[1] - minimum[1]) / kTerrainShadowMapSize;
+    const float cellSize = std::max(terrain->GetCellWidth(), terrain->GetCellLength());
+    int level = 0;
+    while (level + 1 < mTerrainLevelCount && cellSize * static_cast<float>(1 << level) < 2.0f * texelSize) {
+        level++;
+    }
     
-    // Create model matrix for terrain
-    float terrainPosition[3] = {0.0f, 0.0f, 0.0f}; // Center terrain at origin
-    float terrainRotation[3] = {0.0f, 0.0f, 0.0f}; // No rotation
-    float terrainScale[3] = {1.0f, 1.0f, 1.0f};    // Default scale
+    VertexUniforms uniforms = mVertexUniforms;
+    const Matrix4x4 identity = SimdMath::Identity();
+    memcpy(uniforms.modelMatrix, identity.values, sizeof(identity.values));
+    memcpy(uniforms.viewMatrix, view.values, sizeof(view.values));
+    memcpy(uniforms.projectionMatrix, projection.values, sizeof(projection.values));
+    std::fill(uniforms.lodMorph, uniforms.lodMorph + 4, 0.0f);
+    
+    mShadowPassDescriptor->depthAttachment()->setTexture(mTerrainShadowMap);
+    MTL::CommandBuffer* shadowCommands = mCommandQueue->commandBuffer();
+    MTL::RenderCommandEncoder* encoder = shadowCommands->renderCommandEncoder(mShadowPassDescriptor);
+    encoder->setRenderPipelineState(pipeline);
+    encoder->setDepthStencilState(mDepthStencilState);
+    encoder->setDepthBias(0.0f, kShadowSlopeBias, 0.0f);
+    
+    // Whole chunks of the level, no morph
+    size_t chunkCount = 0;
+    const NS::UInteger indexCount = NS::UInteger(4 * mTerrainQuadrantIndexCount);
+    MTL::Buffer* instanceBuffer = nullptr;
+    if (mUseTerrainTextures) {
+        FrameVector<TerrainInstance> instances(mFrameArena);
+        for (const TerrainChunk& chunk : mTerrainChunks) {
+            if (chunk.level != level) continue;
+            TerrainInstance instance;
+            instance.cellX = chunk.cellX;
+            instance.cellZ = chunk.cellZ;
+            instance.level = chunk.level;
+            instance.morphStart = 0.0f;
+            instance.morphScale = 0.0f;
+            instance.padding[0] = instance.padding[1] = instance.padding[2] = 0.0f;
+            instances.push_back(instance);
+        }
+        
+        TerrainMapUniforms map;
+        map.originX = terrain->GetOriginX();
+        map.originZ = terrain->GetOriginZ();
+        map.cellWidth = terrain->GetCellWidth();
+        map.cellLength = terrain->GetCellLength();
+        map.gridSize = terrain->GetGridSize();
+        map.chunkCells = kTerrainChunkCells;
+        map.padding[0] = map.padding[1] = 0;
+        
+        // A one-off buffer, freed once this pass completes
+        instanceBuffer = mHeapAllocator.NewBuffer(instances.size() * sizeof(TerrainInstance),
+                                                  MetalHeapAllocator::Memory::Shared);
+        if (instanceBuffer) {
+            memcpy(instanceBuffer->contents(), instances.data(), instances.size() * sizeof(TerrainInstance));
+            encoder->setVertexBytes(&uniforms, sizeof(uniforms), 1);
+            encoder->setVertexBytes(&map, sizeof(map), 2);
+            encoder->setVertexBuffer(instanceBuffer, 0, 3);
+            encoder->setVertexTexture(mTerrainHeightTexture, 0);
+            encoder->setVertexTexture(mTerrainNormalTexture, 1);
+            encoder->setVertexTexture(mTerrainFlagTexture, 2);
+            encoder->setVertexTexture(mTerrainHeightRangeTexture, 3);
+            encoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangleStrip, indexCount, MTL::IndexTypeUInt16,
+                                           mTerrainIndexBuffer, 0, NS::UInteger(instances.size()));
+            chunkCount = instances.size();
+        }
+    } else {
+        encoder->setVertexBuffer(mTerrainVertexBuffer, 0, 0);
+        for (const TerrainChunk& chunk : mTerrainChunks) {
+            if (chunk.level != level) continue;
+            for (int i = 0; i < 3; i++) {
+                uniforms.positionOrigin[i] = chunk.origin[i];
+                uniforms.positionExtent[i] = chunk.extent[i];
+            }
+            encoder->setVertexBytes(&uniforms, sizeof(uniforms), 1);
+            encoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangleStrip, indexCount, MTL::IndexTypeUInt16,
+                                           mTerrainIndexBuffer, 0, NS::UInteger(1),
+                                           NS::Integer(chunk.firstVertex), NS::UInteger(0));
+            chunkCount++;
+        }
+    }
+    encoder->endEncoding();
+    shadowCommands->commit();
+    mShadowPassDescriptor->depthAttachment()->setTexture(nullptr);
+    if (instanceBuffer) {
+        mHeapAllocator.Free(instanceBuffer);
+    }
+    if (chunkCount == 0) return;
+    
+    const Matrix4x4 shadowMatrix = SimdMath::Multiply(kShadowTextureFromClip, SimdMath::Multiply(projection, view));
+    memcpy(mFragmentUniforms.terrainShadowMatrix, shadowMatrix.values, sizeof(shadowMatrix.values));
+    mFragmentUniforms.shadowParams[0] = kShadowBiasTexels * texelSize / std::max(maximum[2] - minimum[2], 1.0e-3f);
+    mFragmentUniforms.shadowParams[2] = 1.0f;
+    mFragmentUniforms.shadowTexelSize[0] = 1.0f / kTerrainShadowMapSize;
+    RefreshFragmentUniforms();
+    
+    mTerrainShadowValid = true;
+    std::copy(mLightPosition, mLightPosition + 3, mTerrainShadowLight);
+    mTerrainShadowVersion = mTerrainVersion;
+    mTerrainShadowLayoutVersion = mTerrainLayoutVersion;
+    LOG_DEBUG("Terrain shadow map drawn from %zu level %d chunks", chunkCount, level);
+}
+
+void Renderer3D_Metal::RenderLanderShadow(const float* position, const float* scale, const LanderDraw& draw) {
+    PROFILE_ZONE("Metal Lander Shadow");
+    if (!mShadowCasterPipelineState || !mLanderShadowMap) return;
+    
+    // A cube around the lander's bounding sphere. The light view is fixed
+    // at the origin and the cube's centre snapped to whole texels of it,
+    // so the shadow's edge doesn't crawl as the lander moves.
+    const float radius = 0.5f * std::sqrt(scale[0] * scale[0] + scale[1] * scale[1] + scale[2] * scale[2]);
+    if (radius <= 0.0f) return;
+    const float origin[3] = { 0.0f, 0.0f, 0.0f };
+    const Matrix4x4 view = ShadowLightView(mShadowLightDirection, origin);
+    float center[3];
+    SimdMath::TransformPoint(view, position, center);
+    const float texelSize = 2.0f * radius / kLanderShadowMapSize;
+    center[0] = std::floor(center[0] / texelSize) * texelSize;
+    center[1] = std::floor(center[1] / texelSize) * texelSize;
+    const Matrix4x4 projection = SimdMath::Orthographic(center[0] - radius, center[0] + radius,
+                                                        center[1] - radius, center[1] + radius,
+                                                        -(center[2] + radius), -(center[2] - radius));
+    
+    // The lander's model matrix and decode, seen from the light
+    VertexUniforms uniforms = mVertexUniforms;
+    memcpy(uniforms.viewMatrix, view.values, sizeof(view.values));
+    memcpy(uniforms.projectionMatrix, projection.values, sizeof(projection.values));
+    
+    mShadowPassDescriptor->depthAttachment()->setTexture(mLanderShadowMap);
+    CheckPassActions(mShadowPassDescriptor, kPassCheckShadow, kPassDepth, 0);
+    MTL::CommandBuffer* shadowCommands = mCommandQueue->commandBuffer();
+    MTL::RenderCommandEncoder* encoder = shadowCommands->renderCommandEncoder(mShadowPassDescriptor);
+    encoder->setRenderPipelineState(mShadowCasterPipelineState);
+    encoder->setDepthStencilState(mDepthStencilState);
+    encoder->setDepthBias(0.0f, kShadowSlopeBias, 0.0f);
+    encoder->setVertexBuffer(draw.vertexBuffer, 0, 0);
+    encoder->setVertexBytes(&uniforms, sizeof(uniforms), 1);
+    encoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, draw.indexCount,
+                                   draw.wideIndices ? MTL::IndexTypeUInt32 : MTL::IndexTypeUInt16,
+                                   draw.indexBuffer, draw.indexOffset);
+    encoder->endEncoding();
+    shadowCommands->commit();
+    mShadowPassDescriptor->depthAttachment()->setTexture(nullptr);
+    
+    const Matrix4x4 shadowMatrix = SimdMath::Multiply(kShadowTextureFromClip, SimdMath::Multiply(projection, view));
+    memcpy(mFragmentUniforms.landerShadowMatrix, shadowMatrix.values, sizeof(shadowMatrix.values));
+    mFragmentUniforms.shadowParams[1] = kShadowBiasTexels * texelSize / (2.0f * radius);
+    mFragmentUniforms.shadowParams[3] = 1.0f;
+    mFragmentUniforms.shadowTexelSize[1] = 1.0f / kLanderShadowMapSize;
+    RefreshFragmentUniforms();
+}
+
+void Renderer3D_Metal::RenderTelemetry(Game* game) {
+    PROFILE_ZONE("Metal Telemetry");
+    if (!mInitialized || !mRenderEncoder || !mOverlayPipelineState || !mOverlayVertexBuffer || !mGlyphAtlasTexture) return;
+    ResolveDeferredLighting();
+    
+    // Two triangles per overlay quad, written straight into this frame's
+    // slot (the frame semaphore guarantees the GPU is done with it). The HUD
+    // leads the slot and is only rewritten when it changed since the slot
+    // last held it; the profiler panel follows, rebuilt every frame.
+    // Rectangles sample the atlas's solid cell, so everything is one draw.
+    OverlayVertex* vertices = static_cast<OverlayVertex*>(mOverlayVertexBuffer->contents()) +
+                              mFrameSlot * kOverlayVerticesPerSlot;
+    size_t vertexCount = 0;
+    bool overflowed = false;
+    auto addQuad = [&](float x, float y, float w, float h, const float color[4],
+                       float u0, float v0, float u1, float v1) {
+        if (vertexCount + 6 > kOverlayVerticesPerSlot) {
+            overflowed = true;
+            return;
+        }
+        const float corners[6][4] = {
+            {x, y, u0, v0}, {x + w, y, u1, v0}, {x, y + h, u0, v1},
+            {x + w, y, u1, v0}, {x + w, y + h, u1, v1}, {x, y + h, u0, v1}
+        };
+        for (const auto& corner : corners) {
+            vertices[vertexCount++] = {
+                {corner[0], corner[1]},
+                {color[0], color[1], color[2], color[3]},
+                {corner[2], corner[3]}
+            };
+        }
+    };
     
-    // Update model matrix
-    mModelMatrix = CreateModelMatrix(terrainPosition, terrainRotation, terrainScale);
+    if (game) {
+        mHud.Update(game, Units::ToMeters(Pixels(static_cast<float>(mHeight))).Value());
+    }
+    if (mHudSlotVersions[mFrameSlot] != mHud.GetVersion()) {
+        for (int widget = 0; widget < Hud::kWidgetCount; widget++) {
+            const Hud::Quad* quads = mHud.GetWidgetQuads(widget);
+            for (int i = 0; i < mHud.GetWidgetQuadCount(widget); i++) {
+                const Hud::Quad& quad = quads[i];
+                const float color[4] = { quad.r / 255.0f, quad.g / 255.0f, quad.b / 255.0f, quad.a / 255.0f };
+                addQuad(quad.x, quad.y, quad.width, quad.height, color, quad.u0, quad.v0, quad.u1, quad.v1);
+            }
+        }
+        mHudSlotVersions[mFrameSlot] = mHud.GetVersion();
+        mHudSlotVertexCounts[mFrameSlot] = vertexCount;
+    }
+    vertexCount = mHudSlotVertexCounts[mFrameSlot];
+    
+    auto drawRect = [&](float x, float y, float w, float h,
+                        unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+        const float color[4] = { r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f };
+        const float u = GlyphAtlas::GetSolidX();
+        const float v = GlyphAtlas::GetSolidY();
+        addQuad(x, y, w, h, color, u, v, u, v);
+    };
+    float panelBottom = DebugOverlay::DrawProfilerStats(mWidth, drawRect);
+    DebugOverlay::DrawMemoryStats(mWidth, panelBottom, drawRect);
     
-    // Update vertex uniforms
-    VertexUniforms* vertUniforms = static_cast<VertexUniforms*>(mVertexUniformBuffer->contents());
-    memcpy(vertUniforms->modelMatrix, mModelMatrix.values, sizeof(mModelMatrix.values));
-    
-    // Set uniform buffers
-    renderEncoder->setVertexBuffer(mVertexUniformBuffer, 0, 1);
-    renderEncoder->setFragmentBuffer(mFragmentUniformBuffer, 0, 0);
-    
-    // Draw indexed primitives
-    renderEncoder->drawIndexedPrimitives(
-        MTL::PrimitiveTypeTriangle,
-        mTerrainIndexCount,
-        MTL::IndexTypeUInt16,
-        mTerrainIndexBuffer,
-        0
-    );
+    if (overflowed) {
+        LOG_WARNING_EVERY(1000, "Overlay vertex slot full (%zu vertices), some rectangles dropped",
+                          kOverlayVerticesPerSlot);
+    }
+    if (vertexCount == 0) return;
     
-    // End encoding
-    renderEncoder->endEncoding();
+    // The overlay stays sharp: it is drawn after upscaling, at full resolution
+    FinishScenePass();
     
-    // Present drawable
-    commandBuffer->presentDrawable(drawable);
+    // Overlay coordinates are window points, which map onto the full viewport
+    float viewportSize[2] = { static_cast<float>(mWidth), static_cast<float>(mHeight) };
     
-    // Commit command buffer
-    commandBuffer->commit();
+    mRenderEncoder->setRenderPipelineState(mOverlayPipelineState);
+    mRenderEncoder->setDepthStencilState(mOverlayDepthState);
+    mRenderEncoder->setVertexBuffer(mOverlayVertexBuffer,
+                                    mFrameSlot * kOverlayVerticesPerSlot * sizeof(OverlayVertex), 0);
+    mRenderEncoder->setVertexBytes(viewportSize, sizeof(viewportSize), 1);
+    mRenderEncoder->setFragmentTexture(mGlyphAtlasTexture, 0);
+    mRenderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(vertexCount));
     
-    // Clean up
-    renderPassDescriptor->release();
-}
-
-void Renderer3D_Metal::RenderTelemetry(Game* game) {
-    // Implementation omitted for brevity
-    // This would render 2D telemetry information
+    // Restore the scene state for any draws that follow
+    mRenderEncoder->setRenderPipelineState(mScenePipelineStates[kShaderVariantTerrain]);
+    mRenderEncoder->setDepthStencilState(mDepthStencilState);
 }
 
 void Renderer3D_Metal::RenderGameState(Game* game) {
@@ -836,40 +6664,46 @@ void Renderer3D_Metal::RenderGameState(Game* game) {
     // This would render 2D game state information
 }
 
-void Renderer3D_Metal::SetCameraPosition(float x, float y, float z) {
-    mCameraPosition[0] = x;
-    mCameraPosition[1] = y;
-    mCameraPosition[2] = z;
-    
-    // Update view matrix
-    mViewMatrix = CreateViewMatrix();
-    
-    // Update camera uniforms
-    UpdateCameraUniforms();
+const TerrainRayHit* Renderer3D_Metal::TraceTerrainRays(const Terrain* terrain, const TerrainRay* rays, size_t count) {
+    PROFILE_ZONE("Metal Terrain Rays");
+    if (!mTerrainRayTracer.Update(terrain)) return nullptr;
+    return mTerrainRayTracer.Trace(rays, count);
 }
 
-void Renderer3D_Metal::SetCameraTarget(float x, float y, float z) {
-    mCameraTarget[0] = x;
-    mCameraTarget[1] = y;
-    mCameraTarget[2] = z;
-    
-    // Update view matrix
-    mViewMatrix = CreateViewMatrix();
-    
-    // Update camera uniforms
-    UpdateCameraUniforms();
+const TerrainRayHit* Renderer3D_Metal::ScanTerrain(const Terrain* terrain, const TerrainLidarScan& scan) {
+    PROFILE_ZONE("Metal Terrain Scan");
+    if (!mTerrainRayTracer.Update(terrain)) return nullptr;
+    return mTerrainRayTracer.Scan(scan);
 }
 
-void Renderer3D_Metal::SetCameraUp(float x, float y, float z) {
-    mCameraUp[0] = x;
-    mCameraUp[1] = y;
-    mCameraUp[2] = z;
-    
-    // Update view matrix
-    mViewMatrix = CreateViewMatrix();
-    
-    // Update camera uniforms
+// The particle ring lives on the GPU, so its particles follow in the next
+// update; the temporal history, motion vectors' previous frame included,
+// is dropped for a frame
+void Renderer3D_Metal::ShiftOrigin(const float* shift) {
+    for (int i = 0; i < 3; i++) {
+        mParticleOriginShift[i] += shift[i];
+    }
+    mTemporalReset = true;
+}
+
+void Renderer3D_Metal::SetCamera(const Camera& camera) {
+    if (camera.GetVersion() == mCameraVersion) return;
+    mCameraVersion = camera.GetVersion();
+    std::copy(camera.GetPosition(), camera.GetPosition() + 3, mCameraPosition);
+    std::copy(camera.GetTarget(), camera.GetTarget() + 3, mCameraTarget);
+    mViewMatrix = camera.GetViewMatrix();
+    mUnjitteredProjection = camera.GetProjectionMatrix();
+    std::memcpy(mFrustumPlanes, camera.GetFrustumPlanes(), sizeof(mFrustumPlanes));
+    mViewDirty = true;
+}
+
+void Renderer3D_Metal::UpdateCameraMatrices() {
+    if (!mViewDirty) return;
+    if (!mTemporalScaler) {
+        mProjectionMatrix = mUnjitteredProjection;
+    }
     UpdateCameraUniforms();
+    mViewDirty = false;
 }
 
 void Renderer3D_Metal::SetLightPosition(float x, float y, float z) {
@@ -878,8 +6712,7 @@ void Renderer3D_Metal::SetLightPosition(float x, float y, float z) {
     mLightPosition[2] = z;
     
     // Update fragment uniforms
-    FragmentUniforms* fragUniforms = static_cast<FragmentUniforms*>(mFragmentUniformBuffer->contents());
-    memcpy(fragUniforms->lightPosition, mLightPosition, sizeof(mLightPosition));
+    memcpy(mFragmentUniforms.lightPosition, mLightPosition, sizeof(mLightPosition));
 }
 
 void Renderer3D_Metal::SetAmbientLight(float r, float g, float b) {
@@ -888,230 +6721,17 @@ void Renderer3D_Metal::SetAmbientLight(float r, float g, float b) {
     mAmbientLight[2] = b;
     
     // Update fragment uniforms
-    FragmentUniforms* fragUniforms = static_cast<FragmentUniforms*>(mFragmentUniformBuffer->contents());
-    memcpy(fragUniforms->ambientLight, mAmbientLight, sizeof(mAmbientLight));
+    memcpy(mFragmentUniforms.ambientLight, mAmbientLight, sizeof(mAmbientLight));
 }
 
 // Matrix math methods would remain the same
 
-// Create a projection matrix
-Matrix4x4 Renderer3D_Metal::CreateProjectionMatrix(float fov, float aspect, float near, float far) {
-    Matrix4x4 result;
-    
-    // Metal uses a different coordinate system than OpenGL
-    // In Metal, clip space is [-1, 1] for x and y, and [0, 1] for z
-    const float f = 1.0f / tanf(fov / 2.0f);
-    
-    result.values[0] = f / aspect;
-    result.values[1] = 0.0f;
-    result.values[2] = 0.0f;
-    result.values[3] = 0.0f;
-    
-    result.values[4] = 0.0f;
-    result.values[5] = f;
-    result.values[6] = 0.0f;
-    result.values[7] = 0.0f;
-    
-    result.values[8] = 0.0f;
-    result.values[9] = 0.0f;
-    result.values[10] = (far) / (near - far);
-    result.values[11] = -1.0f;
-    
-    result.values[12] = 0.0f;
-    result.values[13] = 0.0f;
-    result.values[14] = (near * far) / (near - far);
-    result.values[15] = 0.0f;
-    
-    return result;
-}
-
-// Create a view matrix
-Matrix4x4 Renderer3D_Metal::CreateViewMatrix() {
-    // Calculate view direction vector
-    float dir[3];
-    dir[0] = mCameraTarget[0] - mCameraPosition[0];
-    dir[1] = mCameraTarget[1] - mCameraPosition[1];
-    dir[2] = mCameraTarget[2] - mCameraPosition[2];
-    
-    // Normalize view direction
-    float len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
-    dir[0] /= len;
-    dir[1] /= len;
-    dir[2] /= len;
-    
-    // Calculate right vector
-    float right[3];
-    right[0] = dir[1] * mCameraUp[2] - dir[2] * mCameraUp[1];
-    right[1] = dir[2] * mCameraUp[0] - dir[0] * mCameraUp[2];
-    right[2] = dir[0] * mCameraUp[1] - dir[1] * mCameraUp[0];
-    
-    // Normalize right vector
-    len = sqrtf(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
-    right[0] /= len;
-    right[1] /= len;
-    right[2] /= len;
-    
-    // Calculate normalized up vector
-    float up[3];
-    up[0] = right[1] * dir[2] - right[2] * dir[1];
-    up[1] = right[2] * dir[0] - right[0] * dir[2];
-    up[2] = right[0] * dir[1] - right[1] * dir[0];
-    
-    // Create view matrix
-    Matrix4x4 result;
-    
-    result.values[0] = right[0];
-    result.values[1] = up[0];
-    result.values[2] = -dir[0];
-    result.values[3] = 0.0f;
-    
-    result.values[4] = right[1];
-    result.values[5] = up[1];
-    result.values[6] = -dir[1];
-    result.values[7] = 0.0f;
-    
-    result.values[8] = right[2];
-    result.values[9] = up[2];
-    result.values[10] = -dir[2];
-    result.values[11] = 0.0f;
-    
-    result.values[12] = -(right[0] * mCameraPosition[0] + right[1] * mCameraPosition[1] + right[2] * mCameraPosition[2]);
-    result.values[13] = -(up[0] * mCameraPosition[0] + up[1] * mCameraPosition[1] + up[2] * mCameraPosition[2]);
-    result.values[14] = dir[0] * mCameraPosition[0] + dir[1] * mCameraPosition[1] + dir[2] * mCameraPosition[2];
-    result.values[15] = 1.0f;
-    
-    return result;
-}
-
-// Create a model matrix
-Matrix4x4 Renderer3D_Metal::CreateModelMatrix(const float* position, const float* rotation, const float* scale) {
-    // Create rotation matrices
-    float radX = rotation[0] * (M_PI / 180.0f);
-    float radY = rotation[1] * (M_PI / 180.0f);
-    float radZ = rotation[2] * (M_PI / 180.0f);
-    
-    float sinX = sinf(radX);
-    float cosX = cosf(radX);
-    float sinY = sinf(radY);
-    float cosY = cosf(radY);
-    float sinZ = sinf(radZ);
-    float cosZ = cosf(radZ);
-    
-    // Create model matrix
-    Matrix4x4 result;
-    
-    // Scale
-    result.values[0] = scale[0];
-    result.values[1] = 0.0f;
-    result.values[2] = 0.0f;
-    result.values[3] = 0.0f;
-    
-    result.values[4] = 0.0f;
-    result.values[5] = scale[1];
-    result.values[6] = 0.0f;
-    result.values[7] = 0.0f;
-    
-    result.values[8] = 0.0f;
-    result.values[9] = 0.0f;
-    result.values[10] = scale[2];
-    result.values[11] = 0.0f;
-    
-    result.values[12] = 0.0f;
-    result.values[13] = 0.0f;
-    result.values[14] = 0.0f;
-    result.values[15] = 1.0f;
-    
-    // Apply rotation matrices (in order: Y, X, Z)
-    Matrix4x4 rotationMatrix;
-    
-    // Rotation around Y axis
-    rotationMatrix.values[0] = cosY;
-    rotationMatrix.values[1] = 0.0f;
-    rotationMatrix.values[2] = -sinY;
-    rotationMatrix.values[3] = 0.0f;
-    
-    rotationMatrix.values[4] = 0.0f;
-    rotationMatrix.values[5] = 1.0f;
-    rotationMatrix.values[6] = 0.0f;
-    rotationMatrix.values[7] = 0.0f;
-    
-    rotationMatrix.values[8] = sinY;
-    rotationMatrix.values[9] = 0.0f;
-    rotationMatrix.values[10] = cosY;
-    rotationMatrix.values[11] = 0.0f;
-    
-    rotationMatrix.values[12] = 0.0f;
-    rotationMatrix.values[13] = 0.0f;
-    rotationMatrix.values[14] = 0.0f;
-    rotationMatrix.values[15] = 1.0f;
-    
-    Matrix4x4 temp = result;
-    MultiplyMatrices(result, rotationMatrix, temp);
-    
-    // Rotation around X axis
-    rotationMatrix.values[0] = 1.0f;
-    rotationMatrix.values[1] = 0.0f;
-    rotationMatrix.values[2] = 0.0f;
-    rotationMatrix.values[3] = 0.0f;
-    
-    rotationMatrix.values[4] = 0.0f;
-    rotationMatrix.values[5] = cosX;
-    rotationMatrix.values[6] = sinX;
-    rotationMatrix.values[7] = 0.0f;
-    
-    rotationMatrix.values[8] = 0.0f;
-    rotationMatrix.values[9] = -sinX;
-    rotationMatrix.values[10] = cosX;
-    rotationMatrix.values[11] = 0.0f;
-    
-    rotationMatrix.values[12] = 0.0f;
-    rotationMatrix.values[13] = 0.0f;
-    rotationMatrix.values[14] = 0.0f;
-    rotationMatrix.values[15] = 1.0f;
-    
-    temp = result;
-    MultiplyMatrices(result, rotationMatrix, temp);
-    
-    // Rotation around Z axis
-    rotationMatrix.values[0] = cosZ;
-    rotationMatrix.values[1] = sinZ;
-    rotationMatrix.values[2] = 0.0f;
-    rotationMatrix.values[3] = 0.0f;
-    
-    rotationMatrix.values[4] = -sinZ;
-    rotationMatrix.values[5] = cosZ;
-    rotationMatrix.values[6] = 0.0f;
-    rotationMatrix.values[7] = 0.0f;
-    
-    rotationMatrix.values[8] = 0.0f;
-    rotationMatrix.values[9] = 0.0f;
-    rotationMatrix.values[10] = 1.0f;
-    rotationMatrix.values[11] = 0.0f;
-    
-    rotationMatrix.values[12] = 0.0f;
-    rotationMatrix.values[13] = 0.0f;
-    rotationMatrix.values[14] = 0.0f;
-    rotationMatrix.values[15] = 1.0f;
-    
-    temp = result;
-    MultiplyMatrices(result, rotationMatrix, temp);
-    
-    // Apply translation
+// Create a model matrix: rotate, scale, translate
+Matrix4x4 Renderer3D_Metal::CreateModelMatrix(const float* position, const Quaternion& orientation, const float* scale) {
+    Matrix4x4 result = SimdMath::Multiply(SimdMath::Scale(scale[0], scale[1], scale[2]),
+                                          SimdMath::Rotation(orientation));
     result.values[12] = position[0];
     result.values[13] = position[1];
     result.values[14] = position[2];
-    
     return result;
-}
-
-// Multiply two matrices
-void Renderer3D_Metal::MultiplyMatrices(Matrix4x4& result, const Matrix4x4& a, const Matrix4x4& b) {
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            result.values[i * 4 + j] = 0.0f;
-            for (int k = 0; k < 4; k++) {
-                result.values[i * 4 + j] += a.values[i * 4 + k] * b.values[k * 4 + j];
-            }
-        }
-    }
 }
\ No newline at end of file
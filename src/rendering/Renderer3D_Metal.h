@@ -5,9 +5,22 @@
 
 #include "../compat.h"
 #include "Renderer.h"
+#include "../core/LanderMesh.h"
+#include "../core/SimdMath.h"
+#include "MetalHeapAllocator.h"
+#include "RenderQueue.h"
+#include "TerrainRayTracer.h"
+#include "VideoRecorder.h"
+#include "Hud.h"
 #include <SDL2/SDL.h>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <dispatch/dispatch.h>
 
 // Forward declarations for Metal types (to avoid including Metal headers here)
 namespace MTL {
@@ -15,10 +28,40 @@ namespace MTL {
     class CommandQueue;
     class Library;
     class RenderPipelineState;
+    class ComputePipelineState;
     class Buffer;
     class Texture;
     class RenderPassDescriptor;
     class DepthStencilState;
+    class CommandBuffer;
+    class RenderCommandEncoder;
+    class ParallelRenderCommandEncoder;
+    class CounterSampleBuffer;
+    class BinaryArchive;
+    class RenderPipelineDescriptor;
+    class ComputePipelineDescriptor;
+    class TileRenderPipelineDescriptor;
+    class MeshRenderPipelineDescriptor;
+    class Function;
+    class ArgumentEncoder;
+    class IndirectCommandBuffer;
+    class Heap;
+    class IOCommandQueue;
+    class IOCommandBuffer;
+    class IOFileHandle;
+    class SharedEvent;
+    class RasterizationRateMap;
+}
+
+namespace MTLFX {
+    class SpatialScaler;
+    class TemporalScaler;
+}
+
+namespace NS {
+    class AutoreleasePool;
+    class Object;
+    class Error;
 }
 
 namespace CA {
@@ -26,35 +69,147 @@ namespace CA {
     class MetalDrawable;
 }
 
-// Vertex structure for Metal
+struct TerrainDirtyRegion;
+struct TerrainMeshlet;
+class LanderBatch;
+
+// Unpacked vertex, used to author meshes before packing
 struct Vertex {
     float position[3];
     float normal[3];
-    float isLandingPad;   // 1.0 for landing pad, 0.0 for normal terrain
-    float entityType;     // 1.0 for lander, 0.0 for terrain
 };
 
+// PackedVertex::flags bits
+enum : uint8_t {
+    kVertexFlagLandingPad = 1 << 0
+};
+
+// Specializations of the scene shaders, set through function constants in
+// LanderShaders.metal: the lander's flat color, or terrain shading with or
+// without the landing pad branch
+enum ShaderVariant {
+    kShaderVariantTerrain,
+    kShaderVariantLandingPad,
+    kShaderVariantLander,
+    kShaderVariantCount
+};
+
+// GPU vertex format (16 bytes). Positions are snorm16 relative to the mesh's
+// origin and half-extent (VertexUniforms::positionOrigin/positionExtent),
+// normals are octahedral-encoded snorm16.
+struct PackedVertex {
+    int16_t position[4];  // xyz; w is the terrain LOD morph target height (same encoding as y)
+    int16_t normal[2];
+    uint8_t flags;        // kVertexFlag* bits
+    uint8_t occlusion;    // Terrain's baked ambient occlusion, 0 = open sky (unorm8)
+    uint8_t padding[2];
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must match the shader's vertex descriptor");
+
 // Vertex shader uniforms
 struct VertexUniforms {
     float modelMatrix[16];
     float viewMatrix[16];
     float projectionMatrix[16];
+    float positionOrigin[4];   // Decode: position = origin + snorm * extent
+    float positionExtent[4];
+    float lodMorph[4];         // x = morph start distance, y = 1 / morph length (0 = no morph)
+    float cameraPosition[4];
+};
+
+// Per-instance data of lander_instance_vertex; the other vertex uniforms
+// are shared by the whole draw
+struct LanderInstance {
+    float modelMatrix[16];
 };
 
-// Fragment shader uniforms
+// Fragment shader uniforms. The vectors are float3 in the shader, so each
+// takes 16 bytes. Shadow matrices map world positions to a shadow map's
+// texture coordinates (x right, y down) and depth.
 struct FragmentUniforms {
-    float lightPosition[3];
-    float ambientLight[3];
-    float cameraPosition[3];
+    float lightPosition[4];
+    float ambientLight[4];
+    float cameraPosition[4];
+    float terrainShadowMatrix[16];  // Cached terrain shadow map
+    float landerShadowMatrix[16];   // This frame's lander cascade
+    float shadowParams[4];          // x, y = depth bias of each map; z, w = 1 if each map holds casters
+    float shadowTexelSize[4];       // x, y = one texel of each map in texture coordinates
+    float sunDirection[4];          // Ray-traced shadows: xyz towards the light; w = ray length, 0 = unshadowed
+    float horizonMap[4];            // Horizon shadows: xy = world x, z of texel (0, 0)'s corner; zw = map per meter, 0 = no map
 };
 
-// Simple Matrix4x4 struct
-struct Matrix4x4 {
-    float values[16];
+// Motion vector uniforms of fragment_main (fragment buffer 1, read only when
+// writing motion for the temporal upscaler): unjittered view-projections of
+// this frame and the last, and the map from a drawn surface's world position
+// now to where it was last frame (identity for static geometry)
+struct MotionUniforms {
+    float viewProjection[16];
+    float previousViewProjection[16];
+    float previousFromCurrent[16];
+};
+
+// Screen-space overlay vertex (pixels from the top-left, RGBA 0-1, glyph
+// atlas texels)
+struct OverlayVertex {
+    float position[2];
+    float color[4];
+    float texCoord[2];
+};
+static_assert(sizeof(OverlayVertex) == 32, "OverlayVertex must match LanderShaders.metal");
+
+// Node of the terrain LOD quadtree. Every chunk is a patch of
+// kTerrainChunkCells^2 quads sampling the height grid every 2^level cells,
+// so level-0 chunks are full resolution and each level up covers four
+// times the area with the same vertex count. Samples past the grid edge
+// are clamped and collapse into degenerate quads.
+struct TerrainChunk {
+    int level;
+    int cellX, cellZ;         // First full-resolution cell covered
+    int children[4];          // Quadrants (x, z) = 00, 10, 01, 11; -1 if absent
+    size_t firstVertex;       // Base vertex in the terrain vertex buffer
+    float boundsMin[3];       // World-space AABB for culling and LOD selection
+    float boundsMax[3];
+    float origin[3];          // Packed position range
+    float extent[3];
+    bool hasLandingPad;       // Some sample is landing pad (kShaderVariantLandingPad)
 };
 
 class Renderer3D_Metal : public Renderer {
 public:
+    // Uniform ring configuration
+    static constexpr int kDefaultFramesInFlight = 3;       // Frames the CPU may run ahead of the GPU
+    static constexpr int kMaxFramesInFlight = 8;
+    static constexpr size_t kUniformSlotSize = 64 * 1024;  // Bytes of uniforms per in-flight frame
+    static constexpr size_t kUniformAlignment = 256;       // Buffer offset alignment for uniform bindings
+    static constexpr int kMaxGpuPasses = 4;                // GPU-timed passes per frame
+    static constexpr size_t kTerrainStagingSlotSize = 256 * 1024;  // Terrain upload bytes per in-flight frame
+    static constexpr size_t kOverlayVerticesPerSlot = 32768;       // Overlay vertices per in-flight frame
+    static constexpr size_t kMaxLanderInstances = 16384;           // Batch landers and debris per in-flight frame
+    static constexpr int kTerrainChunkCells = 16;          // Quads per terrain chunk side (multiple of 4)
+    static constexpr int kMaxTerrainLevels = 16;
+    static constexpr int kTerrainMeshletCells = 4;         // Quads per meshlet side (divides kTerrainChunkCells)
+    static constexpr int kTerrainMeshletsPerChunk =
+        (kTerrainChunkCells / kTerrainMeshletCells) * (kTerrainChunkCells / kTerrainMeshletCells);
+    static constexpr float kTerrainMaxScreenError = 2.0f;  // Pixels of height error allowed per LOD
+    static constexpr float kTerrainMorphStart = 0.7f;      // Fraction of a LOD range before morphing
+    static constexpr float kLanderMaxScreenError = 1.0f;   // Pixels of lander mesh LOD error allowed
+    static constexpr int kMaxNearFieldChunks = 16;         // Tessellated level-0 chunks around the lander
+    static constexpr int kMaxSpikeCaptures = 4;            // Per run
+    static constexpr int kSpikeCaptureCooldown = 120;      // Frames after a capture before the next spike counts
+    static constexpr float kNearFieldMaxTessFactor = 16.0f;
+    static constexpr float kMinRenderScale = 0.5f;         // Dynamic resolution scale range (per axis)
+    static constexpr float kMaxRenderScale = 1.0f;
+    static constexpr float kRenderScaleHeadroom = 0.85f;   // Fraction of the frame budget the GPU may use
+    static constexpr float kRenderScaleGain = 0.25f;       // Share of the correction applied per frame
+    static constexpr int kJitterPhaseCount = 32;           // Halton(2, 3) sub-pixel offsets cycled by the temporal upscaler
+    static constexpr uint32_t kMaxParticles = 131072;      // Exhaust and dust particle ring (power of two)
+    static constexpr int kMaxParticleContacts = 8;         // Contact points seeding dust per frame
+    static constexpr int kTerrainShadowMapSize = 2048;     // Texels per side of the cached terrain shadow
+    static constexpr int kLanderShadowMapSize = 512;       // Texels per side of the lander cascade
+    static constexpr int kMaxPointLights = 64;             // SetPointLights() lights drawn per frame
+    static constexpr int kLightTileSize = 16;              // Pixels per side of a deferred lighting tile
+    
     Renderer3D_Metal();
     virtual ~Renderer3D_Metal();
     
@@ -65,7 +220,14 @@ public:
     void Present() override;
     
     void RenderLander(Lander* lander) override;
+    void RenderLanderBatch(const LanderBatch* batch) override;
+    void RenderDebris(const float* pieces, int count) override;
+    void RenderPredictedImpact(const float* position) override;
+    void SetPointLights(const PointLight* lights, int count) override;
+    void RenderParticles(const ParticleEmitters& emitters) override;
+    void ShiftOrigin(const float* shift) override;
     void RenderTerrain(Terrain* terrain) override;
+    bool GenerateTerrain(Terrain* terrain, int width, int length, int height) override;
     
     void RenderTelemetry(Game* game) override;
     void RenderGameState(Game* game) override;
@@ -74,15 +236,202 @@ public:
     int GetHeight() const override { return mHeight; }
     bool IsInitialized() const override { return mInitialized; }
     
-    // 3D camera methods
-    void SetCameraPosition(float x, float y, float z) override;
-    void SetCameraTarget(float x, float y, float z) override;
-    void SetCameraUp(float x, float y, float z) override;
+    // 3D camera: its view, projection and frustum, taken when they changed
+    void SetCamera(const Camera& camera) override;
     
     // 3D lighting methods
     void SetLightPosition(float x, float y, float z) override;
     void SetAmbientLight(float r, float g, float b) override;
     
+    // Parallelize vertex buffer construction
+    void SetJobSystem(JobSystem* jobSystem) override { mJobSystem = jobSystem; }
+    
+    // Per-frame terrain instance and upload lists come from it
+    void SetFrameArena(FrameArena* arena) override { mFrameArena = arena; }
+    
+    // Number of frames that may be in flight at once (1 = lowest latency,
+    // 3 = best CPU/GPU overlap). Must be set before Initialize().
+    void SetFramesInFlight(int count);
+    int GetFramesInFlight() const { return mFramesInFlight; }
+    
+    // Draw terrain from height, normal and flag textures with one shared
+    // patch instanced per chunk, instead of packed per-chunk vertices. Must
+    // be set before Initialize(); falls back to vertices if the shader is
+    // missing.
+    void SetTerrainHeightTextures(bool enabled) { mUseTerrainTextures = enabled; }
+    bool IsUsingTerrainHeightTextures() const { return mUseTerrainTextures; }
+    
+    // Hardware-tessellate the full-resolution chunks around the lander
+    // (the camera target), displacing from the height texture. Needs height
+    // texture terrain; must be set before Initialize().
+    void SetTerrainTessellation(bool enabled) { mUseTerrainTessellation = enabled; }
+    bool IsUsingTerrainTessellation() const { return mUseTerrainTessellation; }
+    
+    // Draw height texture terrain with object and mesh shaders: every chunk
+    // is split into meshlets of kTerrainMeshletCells^2 cells with bounds and
+    // a cone of their triangles' normals, the object stage drops the
+    // meshlets outside the frustum or facing away from the camera, and the
+    // mesh stage emits the rest straight from the height textures, with no
+    // index buffer. Needs height texture terrain and a Metal 3 GPU; must be
+    // set before Initialize().
+    void SetTerrainMeshShaders(bool enabled) { mUseTerrainMeshShaders = enabled; }
+    bool IsUsingTerrainMeshShaders() const { return mUseTerrainMeshShaders; }
+    
+    // Draw the lander from an OBJ model instead of the unit cube, stretched
+    // to the lander's box: LanderMesh builds its LOD chain, cache and
+    // overdraw ordered and quantized, and keeps it in cacheFile (empty =
+    // no cache) for the next start. Every lander draw then picks the
+    // coarsest level within kLanderMaxScreenError pixels of the full
+    // model. Debris and the impact marker stay cubes, and so does the
+    // lander if the model fails to load. Must be set before Initialize().
+    void SetLanderMeshFile(const std::string& filename, const std::string& cacheFile) {
+        mLanderMeshFile = filename;
+        mLanderMeshCacheFile = cacheFile;
+    }
+    
+    // Select and cull vertex buffer terrain chunks in a compute pass that
+    // encodes their draws into an indirect command buffer, so the CPU cost
+    // of drawing the terrain no longer grows with the chunk count. Must be
+    // set before Initialize(); ignored with height textures, and falls back
+    // to CPU selection if the kernel is missing.
+    void SetGpuTerrainCulling(bool enabled) { mUseGpuTerrainCulling = enabled; }
+    bool IsUsingGpuTerrainCulling() const { return mUseGpuTerrainCulling; }
+    
+    // Also cull GPU-culled chunks hidden behind the previous frame's depth:
+    // a compute pass reduces the scene depth into a mip chain of farthest
+    // depths, and the culling kernel tests each chunk's bounds, reprojected
+    // with that frame's matrices, against the level that covers them. Keeps
+    // the scene depth in memory. Must be set before Initialize(); ignored
+    // without GPU terrain culling.
+    void SetHiZCulling(bool enabled) { mUseHiZCulling = enabled; }
+    bool IsUsingHiZCulling() const { return mUseHiZCulling; }
+    
+    // Shadows from the SetLightPosition() light, taken as a sun in its
+    // direction from the terrain's centre. The terrain is rasterized into a
+    // shadow map that is kept until the light or the terrain changes; every
+    // frame only the lander is rendered, into a small cascade around it.
+    // Must be set before Initialize(); GPU-culled terrain chunks are not
+    // shadowed (indirect commands can't bind the maps).
+    void SetShadows(bool enabled) { mUseShadows = enabled; }
+    bool IsUsingShadows() const { return mUseShadows; }
+    
+    // Shadow the terrain by tracing a ray towards the light from every
+    // fragment, against the terrain's acceleration structure, instead of
+    // the terrain map: hard, exact edges at any distance and no map to
+    // redraw when the terrain changes. The lander is still shadowed by its
+    // cascade. Must be set before Initialize(); needs shadows and a GPU
+    // that ray traces from render pipelines.
+    void SetRayTracedShadows(bool enabled) { mUseRayTracedShadows = enabled; }
+    bool IsUsingRayTracedShadows() const { return mUseRayTracedShadows; }
+    
+    // Shadow the terrain from its baked horizon map (Terrain::
+    // SetHorizonMaps) instead of the terrain map: each terrain fragment
+    // compares the light's elevation with the horizon in the light's
+    // azimuth, one texture array lookup and no shadow pass. The lander is
+    // still shadowed by its cascade, and is not shadowed by the terrain.
+    // Must be set before Initialize(); needs shadows, and gives way to
+    // ray-traced shadows.
+    void SetHorizonShadows(bool enabled) { mUseHorizonShadows = enabled; }
+    bool IsUsingHorizonShadows() const { return mUseHorizonShadows; }
+    
+    // Ray queries against terrain on the GPU (hazard maps, lidar), after
+    // bringing its acceleration structure up to date. Hits stay valid until
+    // the next query; null without ray tracing or on failure.
+    const TerrainRayHit* TraceTerrainRays(const Terrain* terrain, const TerrainRay* rays, size_t count);
+    const TerrainRayHit* ScanTerrain(const Terrain* terrain, const TerrainLidarScan& scan);
+    
+    // Light the SetPointLights() lights in a deferred pass that never
+    // leaves tile memory: opaque draws also write albedo, normal and
+    // position to memoryless attachments, a tile shader culls the lights
+    // against each tile's bounds into threadgroup memory, and a full-screen
+    // draw in the same render pass adds the tile's lights. Without it,
+    // fragment_main loops over every light. Must be set before
+    // Initialize(); needs an Apple GPU (tile shaders).
+    void SetDeferredLighting(bool enabled) { mUseDeferredLighting = enabled; }
+    bool IsUsingDeferredLighting() const { return mUseDeferredLighting; }
+    
+    // Record the scene pass through a parallel render command encoder, so
+    // a large set of per-chunk terrain draws is split into slices that job
+    // system workers encode at once. The slices' sub-encoders are created
+    // in draw order, which is the order the GPU runs them in, so the frame
+    // is the same as with one encoder. Only vertex buffer terrain draws
+    // per chunk; the instanced paths are one draw each already.
+    void SetParallelEncoding(bool enabled) { mUseParallelEncoding = enabled; }
+    bool IsUsingParallelEncoding() const { return mUseParallelEncoding; }
+    
+    // Draw the scene into an offscreen target scaled to keep GPU frame time
+    // within the target frame rate's budget, then upscale it to the drawable
+    // with MetalFX. The overlay is drawn at full resolution afterwards. Must
+    // be set before Initialize(); ignored where MetalFX is unsupported.
+    void SetDynamicResolution(bool enabled) { mUseDynamicResolution = enabled; }
+    bool IsUsingDynamicResolution() const { return mUseDynamicResolution; }
+    void SetTargetFrameRate(float hz);
+    float GetRenderScale() const { return mRenderScale; }
+    
+    // Upscale dynamic resolution frames with MetalFX's temporal scaler:
+    // the projection is jittered by a sub-pixel offset every frame and
+    // fragment_main writes motion vectors, which the scaler uses to
+    // accumulate detail from previous frames. Needs dynamic resolution;
+    // falls back to spatial scaling where unsupported.
+    void SetTemporalUpscaling(bool enabled) { mUseTemporalUpscaling = enabled; }
+    bool IsUsingTemporalUpscaling() const { return mUseTemporalUpscaling; }
+    
+    // Shade the scene at full rate only around the lander, where the pilot
+    // looks, and at half and then a quarter of the rate towards the screen
+    // edges: the scene pass rasterizes through a rate map into the physical
+    // corner of an offscreen target, and a resolve draw stretches that back
+    // over the drawable ahead of the overlay, which stays at full rate. The
+    // map follows the lander's screen position from the frame before. Must
+    // be set before Initialize(); ignored with dynamic resolution (which
+    // scales the whole scene instead), deferred lighting or Hi-Z culling,
+    // and where the GPU has no rate maps.
+    void SetVariableRasterization(bool enabled) { mUseVariableRasterization = enabled; }
+    bool IsUsingVariableRasterization() const { return mUseVariableRasterization; }
+    
+    // Binary archive of compiled pipelines (empty = none). Pipelines found
+    // in it skip shader compilation; new ones are added and the file is
+    // rewritten once Initialize() has built them all. Must be set before
+    // Initialize().
+    void SetPipelineArchiveFile(const std::string& filename) { mPipelineArchiveFile = filename; }
+    
+    // Spike captures: once a frame (its CPU interval or its GPU time) takes
+    // longer than thresholdMs, the next frames are captured with
+    // MTL::CaptureManager into directory/spike-<time>-<n>.gputrace, and
+    // the profiler's recent samples, which cover the spike and the
+    // captured frames, go beside it as a .json Chrome trace. At most
+    // kMaxSpikeCaptures per run. GPU traces need MTL_CAPTURE_ENABLED=1 (or
+    // MetalCaptureEnabled in the app's Info.plist); without it only the CPU
+    // trace is written. thresholdMs <= 0 = off, at no cost. Must be set
+    // before Initialize().
+    void SetSpikeCapture(float thresholdMs, int frames, const std::string& directory) {
+        mSpikeCaptureMs = thresholdMs;
+        mSpikeCaptureFrames = frames > 1 ? frames : 1;
+        mSpikeCaptureDirectory = directory;
+    }
+    
+    // Record every presented frame to filename (a QuickTime movie, H.264)
+    // through VideoRecorder, at the drawable's size when recording starts;
+    // frames after a resize to another size are skipped. Empty = off. Must
+    // be set before Initialize().
+    void SetVideoRecording(const std::string& filename) { mVideoFile = filename; }
+    
+    // CAMetalLayer presentation: drawables in the swap queue (2 = lower
+    // latency, 3 = better throughput) and whether presents wait for the
+    // display's refresh. Must be set before Initialize().
+    void SetMaximumDrawableCount(int count);
+    void SetDisplaySync(bool enabled) { mDisplaySync = enabled; }
+    
+    // Size in points; the drawable and render targets follow at the start
+    // of the next frame
+    void OnWindowResized(int width, int height) override;
+    
+    // Hidden, the renderer keeps its pipelines, buffers and terrain so a
+    // mode switch back is one frame. It only stays resident while the
+    // device has at least half its recommended working set to spare.
+    void SetVisible(bool visible) override;
+    bool CanStayResidentHidden() const override;
+    double GetGpuFrameTime() const override { return mLastGpuFrameTime.load(std::memory_order_relaxed); }
+    
 private:
     // Initialize Metal
     bool InitializeMetal();
@@ -90,27 +439,413 @@ private:
     // Bridge function to connect Metal-cpp with Cocoa APIs
     void SetMetalLayerForWindow(void* nsWindowPtr, CA::MetalLayer* layer);
     
-    // Load Metal shader library
+    // Load Metal shader library (the inline fallback source compiles in
+    // the background)
     bool LoadShaders();
     
-    // Create render pipeline
+    // Pipelines compile on Metal's threads while the game builds its
+    // terrain and physics. Completion handlers only record the results;
+    // PollPipelines() installs them on the render thread, waiting for those
+    // in waitMask (PipelineId bits). Clear() waits for the pipelines a frame
+    // cannot draw without; the others take effect when they finish. Scene
+    // and terrain map pipelines have one build per ShaderVariant.
+    enum PipelineId {
+        kPipelineScene,
+        kPipelineSceneLandingPad,
+        kPipelineSceneLander,
+        kPipelineLanderInstances,
+        kPipelineOverlay,
+        kPipelineTerrainMap,
+        kPipelineTerrainMapLandingPad,
+        kPipelineTerrainMesh,
+        kPipelineTerrainMeshLandingPad,
+        kPipelineTerrainTess,
+        kPipelineTessFactors,
+        kPipelineTerrainTable,
+        kPipelineTerrainTableLandingPad,
+        kPipelineTerrainChunks,
+        kPipelineTerrainChunksLandingPad,
+        kPipelineTerrainCull,
+        kPipelineHiZDepth,
+        kPipelineHiZReduce,
+        kPipelineTerrainHeights,
+        kPipelineTerrainVertices,
+        kPipelineParticleEmit,
+        kPipelineParticleUpdate,
+        kPipelineParticles,
+        kPipelineShadowCasters,
+        kPipelineShadowTerrainMap,
+        kPipelineLightCulling,
+        kPipelineDeferredLighting,
+        kPipelineVariableRateResolve,
+        kPipelineSky,
+        kPipelineCount
+    };
+    struct PipelineBuild {
+        MTL::RenderPipelineDescriptor* renderDescriptor;    // One is set while the build is pending
+        MTL::ComputePipelineDescriptor* computeDescriptor;
+        MTL::TileRenderPipelineDescriptor* tileDescriptor;
+        MTL::MeshRenderPipelineDescriptor* meshDescriptor;
+        bool pending;
+        bool finished;
+        NS::Object* state;      // Retained pipeline state, null if the build failed
+        std::string error;
+    };
+    bool StartPipelines();
+    void CompileRenderPipeline(PipelineId id, MTL::RenderPipelineDescriptor* descriptor);
+    void CompileComputePipeline(PipelineId id, MTL::Function* function);
+    void CompileTilePipeline(PipelineId id, MTL::TileRenderPipelineDescriptor* descriptor);
+    void CompileMeshPipeline(PipelineId id, MTL::MeshRenderPipelineDescriptor* descriptor);
+    void FinishPipeline(PipelineId id, NS::Object* state, NS::Error* error, bool archiveMiss);
+    void PollPipelines(uint32_t waitMask);
+    void InstallPipeline(PipelineId id, PipelineBuild& build);
+    uint32_t RequiredPipelines() const;
+    
+    // Shader functions specialized for a variant, cached by name and
+    // variant while StartPipelines() builds the pipelines (fragment_main is
+    // shared by all of them). The cache owns the functions. Indirect
+    // command buffers can't bind the shadow maps or the point lights, so
+    // the indirect variant of fragment_main reads neither.
+    struct ShaderFunctionVariant {
+        std::string name;
+        ShaderVariant variant;
+        bool indirect;
+        MTL::Function* function;
+    };
+    MTL::Function* GetShaderVariant(const char* name, ShaderVariant variant, bool indirect = false);
+    void ReleaseShaderVariants();
+    
+    // Pipeline archive: open (or start) it before the first build and write
+    // it back once every build has finished, if anything was added
+    void OpenPipelineArchive();
+    void SavePipelineArchive();
+    
+    // Spike capture: Clear() checks the last frame against the threshold
+    // and starts a capture, Present() counts captured frames down and
+    // stops it
+    void UpdateSpikeCapture();
+    void StartSpikeCapture(double frameMs);
+    void FinishSpikeCapture();
+    
+    // Create the scene pipeline of every variant
     bool CreateRenderPipeline();
     
+    // Create the instanced lander pipeline and its transform ring
+    bool CreateLanderInstancePipeline();
+    
+    // Create the alpha-blended pipeline for the 2D debug overlay
+    bool CreateOverlayPipeline();
+    
+    // Create the pipeline for terrain_map_vertex (height texture terrain)
+    bool CreateTerrainMapPipeline();
+    
+    // Tessellation factor kernel, patch pipeline and factor buffer for the
+    // near-field terrain
+    bool CreateTerrainTessellationPipelines();
+    
+    // Pipelines for terrain_table_vertex and the argument buffers that point
+    // it at the chunk table
+    bool CreateTerrainTablePipelines();
+    
+    // Culling kernel, indirect chunk pipelines and argument buffers for GPU
+    // terrain culling
+    bool CreateTerrainCullPipelines();
+    
+    // Reduction kernels for the Hi-Z pyramid
+    bool CreateHiZPipelines();
+    
+    // Compute pipelines for GenerateTerrain (TerrainCompute.metal)
+    bool CreateTerrainComputePipelines();
+    
+    // Particle kernels, point sprite pipeline and the particle ring
+    // (Particles.metal)
+    bool CreateParticlePipelines();
+    
+    // Depth-only caster pipelines and the two shadow maps
+    bool CreateShadowPipelines();
+    
+    // Light culling tile pipeline and the full-screen lighting pipeline
+    bool CreateDeferredLightingPipelines();
+    
+    // Full-screen star and Earth pipeline, drawn behind the opaque scene
+    bool CreateSkyPipeline();
+    void DrawSky();
+    
+    // Memoryless G-buffer attachments at the scene target size
+    bool CreateGBuffer(int width, int height);
+    void ReleaseGBuffer();
+    
+    // Fill the sky and cull and add the point lights over the opaque scene;
+    // runs once per frame, before the first transparent or overlay draw,
+    // after encoding the render queue
+    void ResolveDeferredLighting();
+
+    
+    // Lander geometry for a draw (see GetLanderDraw)
+    struct LanderDraw {
+        MTL::Buffer* vertexBuffer;
+        MTL::Buffer* indexBuffer;
+        bool wideIndices;          // 32-bit indices (the mesh) rather than 16-bit (the cube)
+        size_t indexOffset;        // Bytes
+        uint32_t indexCount;
+        uint32_t material;         // Render queue material: 0 = the cube, 1 + the mesh level
+    };
+    
+    // Object draws (landers, debris, the impact marker) go into
+    // mRenderQueue as they are submitted and are encoded together, sorted
+    // by state and depth, when the opaque scene is finished; the terrain
+    // keeps its own culling and encoding paths and is drawn first
+    float QueueDepth(const float* position) const;
+    RenderPacket MakeLanderPacket(const LanderDraw& draw, MTL::RenderPipelineState* pipeline,
+                                  size_t uniformOffset) const;
+    void FlushRenderQueue();
+    
+    // Shadows: a pass into the terrain map when the light or the terrain
+    // has changed since it was drawn, and one into the lander cascade
+    // every frame. Each runs in a command buffer committed ahead of the
+    // frame, then updates the frame's fragment uniforms.
+    void UpdateTerrainShadow(const Terrain* terrain);
+    void RenderLanderShadow(const float* position, const float* scale, const LanderDraw& draw);
+    
+    // The geometry of one lander draw: a level of the lander mesh, or the
+    // cube for lod < 0 or without a mesh. SelectLanderLod picks the level
+    // for a lander of the given extent (m) from its distance to the camera.
+    LanderDraw GetLanderDraw(int lod) const;
+    int SelectLanderLod(const float* position, float extent) const;
+    
+    // Instanced lander geometry (batch landers, crash debris), drawn from
+    // one slot of mLanderInstanceBuffer per frame that they fill in turn
+    LanderInstance* ReserveLanderInstances(size_t requested, size_t& first, size_t& count);
+    void DrawLanderInstances(size_t first, size_t count, const LanderDraw& draw);
+    
+    // Fragment uniforms into the ring; every copy made this frame is
+    // rewritten by RefreshFragmentUniforms(), so a shadow pass that runs
+    // after some draws were encoded still reaches them
+    bool AllocateFragmentUniforms(size_t& offset);
+    void RefreshFragmentUniforms();
+    
     // Create buffers for models
     bool CreateGeometryBuffers();
     
     // Create a cube model for the lander
     void CreateCubeModel();
     
+    // Load mLanderMeshFile into the lander mesh buffers; false (logged)
+    // leaves the cube
+    bool CreateLanderMesh();
+    
+    // Create the persistent render pass descriptor used by every frame
+    bool CreateRenderPassDescriptor();
+    
+    // Dynamic resolution: the scene pass renders the top-left
+    // mSceneWidth x mSceneHeight of mSceneColorTexture, and FinishScenePass()
+    // upscales it into mUpscaledTexture, copies that into the drawable and
+    // opens the overlay pass. RenderTelemetry() and Present() finish the
+    // scene pass if it is still open.
+    //
+    // The temporal scaler also takes the scene depth and the motion vectors
+    // fragment_main writes to a second color attachment. UpdateJitter()
+    // moves the projection to the frame's jitter phase and the matrices the
+    // motion vectors are computed from to this frame.
+    bool CreateUpscaler(int drawableWidth, int drawableHeight);
+    bool CreateTemporalScaler(int inputWidth, int inputHeight, int outputWidth, int outputHeight);
+    void UpdateRenderScale();
+    void UpdateJitter();
+    void FinishScenePass();
+    
+    // Variable rasterization: UpdateRateMap() rebuilds the rate map (they
+    // are immutable) when the focus enters another zone, and
+    // ResolveVariableRate() opens the overlay pass with the resolve draw
+    bool CreateVariableRatePipeline();
+    void UpdateRateMap();
+    void ResolveVariableRate();
+    
+    // State every scene pass encoder starts with: the viewport, the terrain
+    // pipeline, depth state, shadow maps and the fragment buffers Clear()
+    // uploaded. Sub-encoders of a parallel pass each start without any.
+    void BindSceneState(MTL::RenderCommandEncoder* encoder) const;
+    
+    // End mRenderEncoder, and the parallel pass it belongs to if any
+    void EndRenderEncoder();
+    
+    // Color, motion and depth formats of the scene pass
+    void SetScenePassFormats(MTL::RenderPipelineDescriptor* descriptor) const;
+    void SetScenePassFormats(MTL::MeshRenderPipelineDescriptor* descriptor) const;
+    
+    // Depth and offscreen targets live in mRenderTargetHeap, sized for the
+    // drawable. Without dynamic resolution it only holds mDepthTexture. With
+    // it, AllocateSceneTargets() takes the scene targets every frame,
+    // FinishScenePass() makes them aliasable once upscaled and allocates
+    // the overlay depth target over them, and ReleaseFrameTargets() drops
+    // them all when the frame is submitted. On Apple GPUs depth that no
+    // later work reads is memoryless instead, and takes no heap space.
+    bool CreateRenderTargets(int drawableWidth, int drawableHeight);
+    bool AllocateSceneTargets();
+    void ReleaseFrameTargets();
+    
+    // Rebuild the drawable, scaler and targets after a resize; keeps the
+    // old ones if the new ones can't be created
+    void UpdateDrawableSize();
+    
+    // Debug builds: log attachments of a pass whose load or store action
+    // moves memory the frame doesn't need (or drops memory it does), once
+    // per pass until the targets are rebuilt. readLater and preserved are
+    // kPassColor*/kPassDepth bits; release builds skip the check.
+    enum PassCheck {
+        kPassCheckScene,
+        kPassCheckOverlay,
+        kPassCheckShadow
+    };
+    static constexpr uint32_t kPassColor0 = 1u << 0;
+    static constexpr uint32_t kPassColor1 = 1u << 1;
+    static constexpr uint32_t kPassDepth = 1u << 8;
+    void CheckPassActions(MTL::RenderPassDescriptor* descriptor, PassCheck pass, uint32_t readLater, uint32_t preserved);
+    
+    // Terrain lives in private GPU buffers as a quadtree of chunks (CDLOD):
+    // each frame picks chunks by distance against per-level ranges derived
+    // from screen-space error, and vertex_main morphs odd vertices toward the
+    // next level so transitions neither pop nor crack. A regenerated terrain
+    // is uploaded whole; after that only the chunks Terrain reports dirty are
+    // rebuilt in the frame's staging slot and blitted over the old ones.
+    //
+    // With height textures there are no terrain vertices: every chunk draws
+    // the index buffer's patch, and terrain_map_vertex reads its samples
+    // from the textures, so vertex memory no longer grows with the grid
+    // and edits are texture sub-region copies.
+    bool CreateTerrainBuffers(Terrain* terrain);
+    bool CreateTerrainChunks(const Terrain* terrain, size_t& vertexBytes, size_t& indexBytes);
+    void SetTerrainLevelErrors(const float* morphDeltas);
+    int CreateTerrainChunk(const Terrain* terrain, int level, int cellX, int cellZ, size_t& vertexCount);
+    void UpdateTerrainRegion(Terrain* terrain, const TerrainDirtyRegion& region);
+    void BuildTerrainVertices(const Terrain* terrain, TerrainChunk& chunk, PackedVertex* out, float& maxMorphDelta);
+    
+    // Mesh shader terrain: kTerrainMeshletsPerChunk meshlets per chunk, in
+    // chunk order in mTerrainMeshletBuffer, rebuilt with the chunk's bounds
+    bool CreateTerrainMeshPipelines();
+    void BuildTerrainMeshlets(const Terrain* terrain, const TerrainChunk& chunk, TerrainMeshlet* out) const;
+    bool CreateTerrainTextures(int samplesPerSide);
+    void UploadTerrainTextures(const Terrain* terrain, int minX, int minZ, int maxX, int maxZ, bool useStagingSlot,
+                               bool stageHeights = true);
+    
+    // Fast resource loading: a grid fresh from a cache file has its heights
+    // and tile ranges read from the file into the new height textures on
+    // mIOCommandQueue, with no CPU copy or staging buffer. Metal doesn't
+    // order IO against the render queue, so the terrain stays out of frames
+    // until mTerrainIOEvent shows the load landed. False (stage them
+    // instead) without MTLIO, a cache source or a readable file.
+    bool LoadTerrainTexturesFromCache(const Terrain* terrain);
+    
+    // True once no load is in flight; a failed one is staged from terrain
+    bool FinishTerrainTextureLoad(const Terrain* terrain);
+    // With the table pipelines ready, chunks read their position range and
+    // morph from mTerrainCullChunkBuffer through a per-frame argument
+    // buffer, so a draw binds nothing and picks its chunk by base instance;
+    // otherwise each draw binds its own uniforms (uniformOffsets)
+    void DrawTerrainChunks(const float* lodRanges);
+    bool BindTerrainTable(const float* lodRanges);
+    void EncodeTerrainChunks(MTL::RenderCommandEncoder* encoder, size_t begin, size_t end,
+                             const size_t* uniformOffsets) const;
+    void DrawTerrainInstances(const Terrain* terrain, const float* lodRanges);
+    void DrawTerrainMeshlets(const Terrain* terrain, const float* lodRanges);
+    
+    // GPU culling: the chunk tree is mirrored into mTerrainCullChunkBuffer
+    // (rebuilt whenever chunk bounds change; the table pipelines read it
+    // too), and each frame
+    // terrain_cull_chunks writes two commands per chunk into the frame's
+    // range of mTerrainIndirectCommands, which the render pass executes with
+    // one call per variant
+    bool UploadTerrainCullChunks();
+    void DrawTerrainIndirect(const float* lodRanges);
+    
+    // Hi-Z: mHiZTexture's level 0 is half the depth target, each texel the
+    // farthest depth under it, and every further level halves the last.
+    // BuildHiZPyramid() reduces the depth the frame just rendered (width x
+    // height of it) and records the matrices it was rendered with; the next
+    // frame's culling pass reads it.
+    bool CreateHiZPyramid(int depthWidth, int depthHeight);
+    void ReleaseHiZPyramid();
+    void BuildHiZPyramid(MTL::Texture* depth, int width, int height);
+    
+    // True if a heap resource last written ahead of frame writeSerial needs
+    // no useResource: the residency set keeps it resident, and that frame
+    // (so the copy queued before it) has completed. Until then the draws
+    // declare it to wait for the copy.
+    bool CanSkipUseResource(uint64_t writeSerial) const;
+    
+    // Near field: level-0 draws close to the lander and short of the
+    // level's morph range are taken out of mTerrainDraws and drawn as
+    // triangle patches, two per cell. A kernel writes each patch's factors
+    // from its edges' distance to the lander; edges on the near field's
+    // border stay at 1, so they match the neighbouring chunks' grid edges.
+    void SelectNearFieldChunks(const Terrain* terrain, const float* lodRanges);
+    void DrawTerrainNearField(const Terrain* terrain);
+    
+    // LOD selection. A draw covers the quadrants of a chunk in quadrantMask.
+    struct TerrainDraw {
+        int chunk;
+        int quadrantMask;
+    };
+    void SelectTerrainChunks(int chunkIndex, const float planes[6][4], const float* lodRanges,
+                             std::vector<TerrainDraw>& draws);
+    
+    // Copy staged bytes into private buffers in a command buffer committed
+    // ahead of the frame's, so the GPU applies them before this frame draws
+    struct BufferUpload {
+        MTL::Buffer* source;
+        size_t sourceOffset;
+        MTL::Buffer* destination;
+        size_t destinationOffset;
+        size_t size;
+    };
+    void SubmitBufferUploads(const BufferUpload* uploads, int count);
+    
+    // Same, into a 2D texture region (tightly packed rows)
+    struct TextureUpload {
+        MTL::Buffer* source;
+        size_t sourceOffset;
+        size_t bytesPerRow;
+        MTL::Texture* destination;
+        int x, y;
+        int width, height;
+        int slice;
+    };
+    void SubmitTextureUploads(const TextureUpload* uploads, int count);
+    
+    // The terrain's horizon map samples [min, max] on both axes, into
+    // mTerrainHorizonTexture (created at the grid's size) through a
+    // one-off staging buffer; releases the texture if there is no map
+    void UploadHorizonMap(const Terrain* terrain, int minX, int minZ, int maxX, int maxZ);
+    
     // Update uniform buffers
     void UpdateCameraUniforms();
-    void UpdateModelUniforms(const float* position, const float* rotation, const float* scale);
+    void UpdateModelUniforms(const float* position, const Quaternion& orientation, const float* scale);
+    void SetPositionDecode(const float* origin, const float* extent);
+    void SetLodMorph(float morphStart, float morphEnd);
+    
+    // Copy uniform data into the current frame's ring slot and return its offset
+    // in mUniformRingBuffer (returns false if the slot is full)
+    bool AllocateUniforms(const void* data, size_t size, size_t& offset);
+    
+    // Block until the GPU has finished with every in-flight frame
+    void WaitForFramesInFlight();
     
-    // Helper methods for 3D math
-    Matrix4x4 CreateProjectionMatrix(float fov, float aspect, float near, float far);
-    Matrix4x4 CreateViewMatrix();
-    Matrix4x4 CreateModelMatrix(const float* position, const float* rotation, const float* scale);
-    void MultiplyMatrices(Matrix4x4& result, const Matrix4x4& a, const Matrix4x4& b);
+    // Release an object once every frame submitted so far has completed
+    // (between frames, once the next one has)
+    void ReleaseAfterFrame(NS::Object* object);
+    
+    // GPU pass timing: timestamps are sampled at the start of each timed pass's
+    // vertex stage and the end of its fragment stage, resolved when the
+    // command buffer completes and recorded into the frame profiler
+    bool CreateGpuTimestampBuffer();
+    void AttachGpuTimestamps(MTL::RenderPassDescriptor* descriptor, const char* passName);
+    void ResolveGpuTimestamps(int frameSlot, int passCount, const char* const* passNames);
+    
+    // Helper methods for 3D math (SimdMath)
+    Matrix4x4 CreateModelMatrix(const float* position, const Quaternion& orientation, const float* scale);
+    
+    // SetCamera() and the jitter only mark the view dirty; Clear() updates
+    // the camera uniforms once per frame
+    void UpdateCameraMatrices();
     
     // SDL window
     SDL_Window* mWindow;
@@ -118,21 +853,211 @@ private:
     // Metal objects
     MTL::Device* mDevice;
     MTL::CommandQueue* mCommandQueue;
+    MTL::IOCommandQueue* mIOCommandQueue;      // Null where MTLIO is unsupported
+    MTL::SharedEvent* mTerrainIOEvent;         // Signaled by each terrain load as it lands
+    MTL::IOCommandBuffer* mTerrainIOCommands;  // Retained while a load is in flight
+    MTL::IOFileHandle* mTerrainIOHandle;
+    uint64_t mTerrainIOValue;                  // Event value of the latest load
     MTL::Library* mShaderLibrary;
-    MTL::RenderPipelineState* mRenderPipelineState;
+    MTL::RenderPipelineState* mScenePipelineStates[kShaderVariantCount];
     MTL::DepthStencilState* mDepthStencilState;
+    MTL::RenderPipelineState* mLanderInstancePipelineState;   // Null if the instancing shader is missing
+    MTL::RenderPipelineState* mOverlayPipelineState;   // Null if the overlay shaders are missing
+    MTL::DepthStencilState* mOverlayDepthState;
+    // Terrain variants of terrain_map_vertex; null unless drawing from height textures
+    MTL::RenderPipelineState* mTerrainMapPipelineStates[kShaderVariantCount];
+    MTL::RenderPipelineState* mTerrainTessPipelineState; // Landing pad variant; null unless tessellating
+    MTL::ComputePipelineState* mTerrainTessFactorPipeline;
+    // Terrain variants of terrain_meshlet_mesh; null unless drawing with mesh shaders
+    MTL::RenderPipelineState* mTerrainMeshPipelineStates[kShaderVariantCount];
+    // Terrain variants of terrain_table_vertex; null if the shader is missing
+    MTL::RenderPipelineState* mTerrainTablePipelineStates[kShaderVariantCount];
+    MTL::ArgumentEncoder* mTerrainTableArgumentEncoder;  // Encodes TerrainChunkTable
+    // Indirect terrain variants of terrain_chunk_vertex; null unless culling on the GPU
+    MTL::RenderPipelineState* mTerrainChunkPipelineStates[kShaderVariantCount];
+    MTL::ComputePipelineState* mTerrainCullPipeline;
+    MTL::ArgumentEncoder* mTerrainCullArgumentEncoder;   // Encodes TerrainCommands
+    MTL::ComputePipelineState* mHiZDepthPipeline;        // Null without Hi-Z culling
+    MTL::ComputePipelineState* mHiZReducePipeline;
+    MTL::ComputePipelineState* mTerrainHeightPipeline;   // Null if the terrain kernels are missing
+    MTL::ComputePipelineState* mTerrainVertexPipeline;
+    MTL::ComputePipelineState* mParticleEmitPipeline;    // Null if the particle shaders are missing
+    MTL::ComputePipelineState* mParticleUpdatePipeline;
+    MTL::RenderPipelineState* mParticlePipelineState;
+    MTL::DepthStencilState* mParticleDepthState;         // Tested, not written
+    MTL::RenderPipelineState* mShadowCasterPipelineState;     // vertex_main, depth only; null without shadows
+    MTL::RenderPipelineState* mShadowTerrainMapPipelineState; // terrain_map_vertex, depth only
+    MTL::RenderPipelineState* mLightCullPipelineState;        // Tile shader; null without deferred lighting
+    MTL::RenderPipelineState* mDeferredLightingPipelineState;
+    MTL::DepthStencilState* mDeferredDepthState;              // Always passes, not written
+    MTL::RenderPipelineState* mSkyPipelineState;              // Null if the sky shaders are missing
+    MTL::DepthStencilState* mSkyDepthState;                   // Far plane only, not written
     CA::MetalLayer* mMetalLayer;
     
+    // Pipeline archive (null if disabled or unsupported)
+    MTL::BinaryArchive* mPipelineArchive;
+    std::string mPipelineArchiveFile;
+    int mPipelineArchiveHits;     // Pipelines loaded from the archive
+    int mPipelineArchiveMisses;   // Pipelines compiled and added to it
+    std::mutex mPipelineArchiveMutex;
+    
+    // Background pipeline builds (mPipelineMutex guards the builds and
+    // mLibraryPending; handlers notify mPipelineCondition)
+    std::mutex mPipelineMutex;
+    std::condition_variable mPipelineCondition;
+    PipelineBuild mPipelineBuilds[kPipelineCount];
+    std::vector<ShaderFunctionVariant> mShaderVariants;   // Empty outside StartPipelines()
+    int mPipelinesPending;        // Builds not yet installed
+    bool mLibraryPending;         // Inline shader source still compiling
+    bool mPipelinesStarted;
+    
+    // Startup timing (Profiler::Now() nanoseconds)
+    uint64_t mInitializeStartNs;
+    bool mFirstFramePresented;
+    
+    // Spike capture (see SetSpikeCapture)
+    float mSpikeCaptureMs;            // <= 0 = off
+    int mSpikeCaptureFrames;
+    std::string mSpikeCaptureDirectory;
+    uint64_t mSpikeFrameStartNs;      // Last Clear(), 0 = none yet
+    int mSpikeFramesLeft;             // Frames still to capture, 0 = not capturing
+    int mSpikeCooldown;               // Frames before another spike counts
+    int mSpikeCaptureCount;
+    bool mGpuCaptureActive;
+    std::string mSpikeCaptureName;    // Current capture's path, without extension
+    
+    // Video recording (see SetVideoRecording)
+    std::string mVideoFile;
+    VideoRecorder mVideoRecorder;
+    
     // Buffers
     MTL::Buffer* mLanderVertexBuffer;
     MTL::Buffer* mLanderIndexBuffer;
-    MTL::Buffer* mTerrainVertexBuffer;
-    MTL::Buffer* mTerrainIndexBuffer;
-    MTL::Buffer* mVertexUniformBuffer;
-    MTL::Buffer* mFragmentUniformBuffer;
+    MTL::Buffer* mLanderMeshVertexBuffer;  // Every level's LanderMeshVertex, null = the cube
+    MTL::Buffer* mLanderMeshIndexBuffer;   // 32-bit, absolute
+    MTL::Buffer* mTerrainVertexBuffer;     // StorageModePrivate
+    MTL::Buffer* mTerrainIndexBuffer;      // StorageModePrivate
+    MTL::Buffer* mTerrainMeshletBuffer;    // StorageModePrivate, TerrainMeshlet per meshlet (mesh shaders only)
+    MTL::Buffer* mTerrainStagingBuffer;    // One kTerrainStagingSlotSize slot per in-flight frame
+    MTL::Buffer* mUniformRingBuffer;
+    MTL::Buffer* mOverlayVertexBuffer;     // One kOverlayVerticesPerSlot slot per in-flight frame
+    MTL::Texture* mGlyphAtlasTexture;      // GlyphAtlas, R8
+    Hud mHud;
+    uint32_t mHudSlotVersions[kMaxFramesInFlight];     // Hud version whose quads lead each overlay slot
+    size_t mHudSlotVertexCounts[kMaxFramesInFlight];
+    MTL::Buffer* mLanderInstanceBuffer;    // One kMaxLanderInstances slot per in-flight frame
+    RenderQueue mRenderQueue;              // This frame's object draws, not yet encoded
+    MTL::Buffer* mTerrainTessFactorBuffer; // Near-field patch factors, one slot per in-flight frame
+    MTL::Buffer* mTerrainCullChunkBuffer;  // TerrainCullChunk per chunk (StorageModePrivate)
+    MTL::Buffer* mTerrainCullArgumentBuffer;   // TerrainCommands, one slot per in-flight frame
+    MTL::Buffer* mTerrainTableArgumentBuffer;  // TerrainChunkTable, one slot per in-flight frame
+    MTL::IndirectCommandBuffer* mTerrainIndirectCommands;   // Two commands per chunk per in-flight frame
+    MTL::Buffer* mParticleBuffer;          // kMaxParticles ring, GPU only (StorageModePrivate)
+    
+    // Buffer and texture memory (all but the render targets, ICB and counters)
+    MetalHeapAllocator mHeapAllocator;
+    
+    // Uniform ring state
+    int mFramesInFlight;
+    int mFrameSlot;               // Ring slot used by the current frame
+    size_t mUniformWriteOffset;   // Next free byte within the current slot
+    size_t mLanderInstanceWriteCount;  // Instances used so far of the current lander instance slot
+    dispatch_semaphore_t mFrameSemaphore;
     
     // Textures
     MTL::Texture* mDepthTexture;
+    MTL::Texture* mTerrainHeightTexture;   // R16Unorm HeightGrid sample (StorageModePrivate)
+    MTL::Texture* mTerrainHeightRangeTexture;  // RG32Float HeightTileRange per HeightGrid tile
+    MTL::Texture* mTerrainNormalTexture;   // RG16Snorm octahedral normal per sample
+    MTL::Texture* mTerrainFlagTexture;     // RG8Uint kVertexFlag* bits and ambient occlusion per sample
+    MTL::Texture* mTerrainHorizonTexture;  // RGBA8Unorm, two slices of four horizon directions per sample
+    MTL::Texture* mTerrainShadowMap;       // Depth32Float, kTerrainShadowMapSize (null without shadows)
+    MTL::Texture* mLanderShadowMap;        // Depth32Float, kLanderShadowMapSize
+    MTL::Texture* mHiZTexture;             // R32Float farthest-depth mip chain (null without Hi-Z culling)
+    std::vector<MTL::Texture*> mHiZLevels; // One view per mip, for the reduction to write
+    MTL::RenderPassDescriptor* mShadowPassDescriptor;   // Depth only, cleared; texture set per pass
+    MTL::Texture* mGBufferTextures[3];     // Memoryless albedo, normal, position (kGBuffer* attachments)
+    
+    // Dynamic resolution (null unless enabled)
+    MTLFX::SpatialScaler* mSpatialScaler;
+    MTLFX::TemporalScaler* mTemporalScaler;  // Used instead of mSpatialScaler when temporal upscaling
+    MTL::Texture* mSceneColorTexture;      // Scene target at kMaxRenderScale of the drawable (this frame's)
+    MTL::Texture* mSceneDepthTexture;
+    MTL::Texture* mSceneMotionTexture;     // RG16Float motion vectors (temporal upscaling only)
+    MTL::Texture* mUpscaledTexture;        // Scaler output at drawable size
+    MTL::Texture* mMemorylessSceneDepth;   // Scene depth each frame takes, without temporal upscaling (null = heap)
+    MTL::Texture* mMemorylessOverlayDepth; // Overlay depth each frame takes (null = heap)
+    MTL::RenderPassDescriptor* mOverlayPassDescriptor;   // Drawable, loaded (not loaded with variable rasterization)
+    
+    // Variable rasterization (null unless enabled)
+    MTL::RasterizationRateMap* mRateMap;   // Screen-sized, centered on mRateMapZone
+    MTL::Buffer* mRateMapParameters;       // The map's parameter data, read by the resolve
+    MTL::Texture* mVariableRateTexture;    // Scene color at drawable size, of which the physical corner is drawn
+    MTL::RenderPipelineState* mVariableRateResolvePipelineState;
+    float mRateMapFocus[2];                // Lander's last screen position, 0 to 1 (y down)
+    int mRateMapZone[2];                   // Zone the map is centered on (-1 = rebuild)
+    
+    // Render target memory and drawable configuration
+    MTL::Heap* mRenderTargetHeap;          // Private, hazard tracked (null if nothing needs it)
+    bool mUseMemorylessDepth;              // Depth attachments nothing reads are memoryless
+    uint32_t mCheckedPasses;               // PassCheck bits whose actions were checked
+    int mSceneTargetWidth;                 // Size of the scene targets
+    int mSceneTargetHeight;
+    bool mDrawableSizeDirty;               // Window resized since the last frame
+    int mMaximumDrawableCount;
+    bool mDisplaySync;
+    std::vector<NS::Object*> mPendingReleases;   // ReleaseAfterFrame() with no frame open
+    int mDrawableWidth;
+    int mDrawableHeight;
+    int mSceneWidth;                       // Scene pass viewport this frame
+    int mSceneHeight;
+    float mRenderScale;
+    float mMinRenderScale;                 // kMin/kMaxRenderScale narrowed to what the scaler supports
+    float mMaxRenderScale;
+    float mTargetFrameRate;
+    std::atomic<double> mGpuFrameTime;     // Seconds, written by the last completed frame (0 = none since read)
+    std::atomic<double> mLastGpuFrameTime; // Seconds, the last completed frame's, kept for frame pacing
+    bool mScenePassOpen;                   // mRenderEncoder is the scene pass
+    bool mUseDynamicResolution;
+    bool mUseTemporalUpscaling;
+    bool mUseVariableRasterization;
+    
+    // Temporal upscaling state
+    float mJitter[2];                      // This frame's sample offset in scene pixels (x right, y down)
+    int mJitterIndex;
+    bool mTemporalReset;                   // Next upscale must not reuse history
+    Matrix4x4 mPreviousLanderModel;
+    bool mHasPreviousLanderModel;
+    MotionUniforms mMotionUniforms;        // This frame's, with previousFromCurrent = identity
+    size_t mMotionUniformOffset;           // In mUniformRingBuffer, bound to fragment buffer 1
+    size_t mTerrainTableUniformOffset;     // This frame's terrain VertexUniforms with the chunk table
+    size_t mTerrainTableArgumentOffset;    // This frame's slot of mTerrainTableArgumentBuffer
+    
+    // Fragment buffers of the scene pass: a bit per index Clear() bound
+    // and the ring offsets, for BindSceneState()
+    static constexpr int kSceneFragmentBuffers = 3;
+    uint32_t mSceneFragmentBufferMask;
+    size_t mSceneFragmentBufferOffsets[kSceneFragmentBuffers];
+    
+    // Per-frame state (valid between Clear() and Present())
+    NS::AutoreleasePool* mFramePool;
+    CA::MetalDrawable* mDrawable;
+    MTL::RenderPassDescriptor* mRenderPassDescriptor;
+    MTL::CommandBuffer* mCommandBuffer;
+    MTL::RenderCommandEncoder* mRenderEncoder;
+    MTL::ParallelRenderCommandEncoder* mParallelEncoder;   // mRenderEncoder's pass when parallel (null = none)
+    bool mUseParallelEncoding;
+    
+    // GPU timestamps: kMaxGpuPasses start/end pairs per in-flight frame
+    MTL::CounterSampleBuffer* mGpuTimestampBuffer;   // Null if unsupported or profiler disabled
+    int mGpuPassCount;                               // Passes timed in the current frame
+    const char* mGpuPassNames[kMaxGpuPasses];
+    uint64_t mCalibrationCpuTime;                    // CPU/GPU timestamp pair taken at startup
+    uint64_t mCalibrationGpuTime;
+    
+    // Worker pool (not owned, may be null)
+    JobSystem* mJobSystem;
+    FrameArena* mFrameArena;     // Not owned, may be null
     
     // Renderer properties
     int mWidth;
@@ -142,19 +1067,72 @@ private:
     // Model properties
     int mLanderVertexCount;
     int mLanderIndexCount;
-    int mTerrainIndexCount;
+    std::string mLanderMeshFile;
+    std::string mLanderMeshCacheFile;
+    std::vector<LanderMeshLod> mLanderMeshLods;
+    std::vector<TerrainChunk> mTerrainChunks;     // Root first
+    std::vector<TerrainDraw> mTerrainDraws;       // Chunks selected this frame
+    std::vector<int> mNearFieldChunks;            // Level-0 chunks tessellated this frame
+    int mTerrainLevelCount;
+    float mTerrainLevelError[kMaxTerrainLevels];  // Worst height error (m) drawing at each level
+    int mTerrainQuadrantIndexCount;    // Strip indices per chunk quadrant (16-bit)
+    int mTerrainPadCommand;            // Landing pad chunks' commands start here in each frame's range
+    bool mTerrainCullChunksDirty;      // mTerrainCullChunkBuffer is behind mTerrainChunks
+    uint64_t mTerrainCullChunksUploadSerial;   // Heap allocator frame that last copied the table
+    uint64_t mTerrainUploadSerial;     // Heap allocator frame that last wrote terrain vertices or indices
+    uint32_t mTerrainVersion;          // Terrain::GetVersion() the GPU copy matches
+    uint32_t mTerrainLayoutVersion;
+    bool mUseTerrainTextures;
+    bool mUseTerrainTessellation;
+    bool mUseTerrainMeshShaders;
+    bool mUseGpuTerrainCulling;
+    bool mUseHiZCulling;
+    bool mHiZReady;                    // mHiZTexture holds a reduced frame
+    Matrix4x4 mHiZViewProjection;      // That frame's, as rendered
+    float mHiZSize[2];                 // Depth pixels level 0 was reduced from
     
     // Camera properties
     float mCameraPosition[3];
     float mCameraTarget[3];
-    float mCameraUp[3];
+    float mFrustumPlanes[6][4];        // World space, of the unjittered projection
+    bool mViewDirty;
+    uint32_t mCameraVersion;           // Camera::GetVersion() of the matrices taken
+    
+    // Particles: the GPU emits into the ring at mParticleHead and ages every
+    // slot each frame; the CPU only works out how many to emit
+    uint32_t mParticleHead;
+    uint32_t mParticleSeed;           // Per-frame random stream
+    uint64_t mParticleLastNs;         // Profiler::Now() of the last update, 0 = none yet
+    float mParticleEmitCarry[3];      // Fractional particles owed per stream
+    float mParticleOriginShift[3];    // Origin moves the ring hasn't followed yet (meters)
     
     // Light properties
     float mLightPosition[3];
     float mAmbientLight[3];
     
+    // Shadow state. The terrain map is valid while the light, the terrain
+    // version and the terrain layout match what it was drawn with.
+    bool mUseShadows;
+    bool mTerrainShadowValid;
+    float mTerrainShadowLight[3];
+    uint32_t mTerrainShadowVersion;
+    uint32_t mTerrainShadowLayoutVersion;
+    float mShadowLightDirection[3];        // Towards the light, from the terrain's centre
+    bool mUseRayTracedShadows;
+    bool mUseHorizonShadows;
+    TerrainRayTracer mTerrainRayTracer;    // Initialized when the GPU ray traces
+    std::vector<size_t> mFragmentUniformOffsets;   // This frame's copies in mUniformRingBuffer
+    
+    // Point lights, uploaded by Clear()
+    bool mUseDeferredLighting;
+    bool mLightingPending;                 // This frame's deferred lighting not yet drawn
+    bool mSkyPending;                      // This frame's sky not yet drawn
+    std::vector<PointLight> mPointLights;
+    size_t mPointLightOffset;              // This frame's PointLightUniforms in mUniformRingBuffer
+    
     // Matrices
-    Matrix4x4 mProjectionMatrix;
+    Matrix4x4 mProjectionMatrix;           // Jittered when temporal upscaling
+    Matrix4x4 mUnjitteredProjection;
     Matrix4x4 mViewMatrix;
     Matrix4x4 mModelMatrix;
     
@@ -0,0 +1,421 @@
+// TerrainRayTracer.cpp
+// Acceleration structure builds and refits, and the terrain ray query dispatches
+
+#include "TerrainRayTracer.h"
+#include "../core/Log.h"
+#include "../core/Terrain.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Metal-cpp's implementation is compiled into Renderer3D_Metal.cpp
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+
+// Matches TerrainQueryParams in TerrainRayQuery.metal
+struct TerrainQueryParams {
+    float origin[4];        // Scan origin; w = max distance
+    float forward[4];
+    float right[4];         // w = tan(half the horizontal field of view)
+    float up[4];            // w = tan(half the vertical field of view)
+    uint32_t width;
+    uint32_t height;
+    uint32_t rayCount;
+    uint32_t padding;
+};
+
+// Buffer slots shared by both kernels
+enum {
+    kSlotParams = 0,
+    kSlotRays = 1,
+    kSlotHits = 2,
+    kSlotStructure = 3,
+    kSlotVertices = 4,
+    kSlotIndices = 5,
+    kSlotTiles = 6
+};
+
+static const char* ErrorText(NS::Error* error) {
+    return error ? error->localizedDescription()->utf8String() : "unknown error";
+}
+
+static MTL::ComputePipelineState* NewPipeline(MTL::Device* device, MTL::Library* library, const char* name) {
+    MTL::Function* function = library->newFunction(NS::String::string(name, NS::UTF8StringEncoding));
+    if (!function) {
+        LOG_ERROR("No %s kernel", name);
+        return nullptr;
+    }
+    NS::Error* error = nullptr;
+    MTL::ComputePipelineState* pipeline = device->newComputePipelineState(function, &error);
+    function->release();
+    if (!pipeline) {
+        LOG_ERROR("Failed to build the %s pipeline: %s", name, ErrorText(error));
+    }
+    return pipeline;
+}
+
+static void ReleaseBuffer(MTL::Buffer*& buffer) {
+    if (buffer) {
+        buffer->release();
+        buffer = nullptr;
+    }
+}
+
+TerrainRayTracer::TerrainRayTracer()
+    : mDevice(nullptr)
+    , mQueue(nullptr)
+    , mRayPipeline(nullptr)
+    , mScanPipeline(nullptr)
+    , mVertexBuffer(nullptr)
+    , mIndexBuffer(nullptr)
+    , mTileBuffer(nullptr)
+    , mDescriptor(nullptr)
+    , mStructure(nullptr)
+    , mScratchBuffer(nullptr)
+    , mBuildCommands(nullptr)
+    , mStride(1)
+    , mCells(0)
+    , mTriangleCount(0)
+    , mTerrain(nullptr)
+    , mLayoutVersion(0)
+    , mVersion(0)
+    , mRayBuffer(nullptr)
+    , mHitBuffer(nullptr) {}
+
+TerrainRayTracer::~TerrainRayTracer() {
+    Shutdown();
+}
+
+bool TerrainRayTracer::Initialize(MTL::Device* device, MTL::CommandQueue* queue, MTL::Library* library) {
+    if (!device || !queue || !library) {
+        LOG_ERROR("Terrain ray tracer initialized without a device, queue or library");
+        return false;
+    }
+    if (!device->supportsRaytracing()) {
+        LOG_INFO("GPU has no ray tracing; terrain ray queries are off");
+        return false;
+    }
+    
+    mRayPipeline = NewPipeline(device, library, "terrain_ray_query");
+    mScanPipeline = NewPipeline(device, library, "terrain_lidar_scan");
+    if (!mRayPipeline || !mScanPipeline) {
+        Shutdown();
+        return false;
+    }
+    mDevice = device->retain();
+    mQueue = queue->retain();
+    return true;
+}
+
+void TerrainRayTracer::Shutdown() {
+    Release();
+    ReleaseBuffer(mRayBuffer);
+    ReleaseBuffer(mHitBuffer);
+    if (mRayPipeline) {
+        mRayPipeline->release();
+        mRayPipeline = nullptr;
+    }
+    if (mScanPipeline) {
+        mScanPipeline->release();
+        mScanPipeline = nullptr;
+    }
+    if (mQueue) {
+        mQueue->release();
+        mQueue = nullptr;
+    }
+    if (mDevice) {
+        mDevice->release();
+        mDevice = nullptr;
+    }
+}
+
+void TerrainRayTracer::Release() {
+    WaitForBuild();
+    ReleaseBuffer(mVertexBuffer);
+    ReleaseBuffer(mIndexBuffer);
+    ReleaseBuffer(mTileBuffer);
+    ReleaseBuffer(mScratchBuffer);
+    if (mDescriptor) {
+        mDescriptor->release();
+        mDescriptor = nullptr;
+    }
+    if (mStructure) {
+        mStructure->release();
+        mStructure = nullptr;
+    }
+    mCells = 0;
+    mTriangleCount = 0;
+    mTerrain = nullptr;
+}
+
+void TerrainRayTracer::WaitForBuild() {
+    if (mBuildCommands) {
+        mBuildCommands->waitUntilCompleted();
+        if (mBuildCommands->status() != MTL::CommandBufferStatusCompleted) {
+            LOG_ERROR("Terrain acceleration structure build failed: %s", ErrorText(mBuildCommands->error()));
+        }
+        mBuildCommands->release();
+        mBuildCommands = nullptr;
+    }
+}
+
+bool TerrainRayTracer::Update(const Terrain* terrain) {
+    if (!mDevice || !terrain || !terrain->HasHeightGrid()) {
+        Release();
+        return false;
+    }
+    
+    if (!mStructure || terrain != mTerrain || terrain->GetLayoutVersion() != mLayoutVersion) {
+        Release();
+        if (!Build(terrain)) {
+            Release();
+            return false;
+        }
+    } else if (terrain->GetVersion() != mVersion) {
+        // Heights edited: rewrite the structure vertices sampling the dirty
+        // cells' corners, then refit. The CPU writes the shared vertex
+        // buffer, so the last build or refit has to be done reading it.
+        TerrainDirtyRegion region;
+        if (terrain->GetDirtyRegion(mVersion, region)) {
+            WaitForBuild();
+            WriteVertices(terrain, region.minCellX / mStride, region.minCellZ / mStride,
+                          std::min((region.maxCellX + mStride - 1) / mStride, mCells),
+                          std::min((region.maxCellZ + mStride - 1) / mStride, mCells));
+            Refit();
+        }
+    }
+    mVersion = terrain->GetVersion();
+    return true;
+}
+
+void TerrainRayTracer::WriteVertices(const Terrain* terrain, int minX, int minZ, int maxX, int maxZ) {
+    const HeightGrid& heights = terrain->GetHeightGrid();
+    const int gridSize = terrain->GetGridSize();
+    float* vertices = static_cast<float*>(mVertexBuffer->contents());
+    for (int z = minZ; z <= maxZ; z++) {
+        const int sampleZ = std::min(z * mStride, gridSize);
+        for (int x = minX; x <= maxX; x++) {
+            const int sampleX = std::min(x * mStride, gridSize);
+            float* vertex = vertices + 3 * (static_cast<size_t>(z) * (mCells + 1) + x);
+            vertex[0] = terrain->GetOriginX() + sampleX * terrain->GetCellWidth();
+            vertex[1] = heights.Get(sampleX, sampleZ);
+            vertex[2] = terrain->GetOriginZ() + sampleZ * terrain->GetCellLength();
+        }
+    }
+}
+
+bool TerrainRayTracer::Build(const Terrain* terrain) {
+    // Coarsen until the triangles fit
+    const int gridSize = terrain->GetGridSize();
+    mStride = 1;
+    mCells = gridSize;
+    while (2 * static_cast<size_t>(mCells) * mCells > kMaxTriangles) {
+        mStride *= 2;
+        mCells = (gridSize + mStride - 1) / mStride;
+    }
+    if (mStride > 1) {
+        LOG_INFO("Terrain acceleration structure built from one in %d samples (%d cells per side)",
+                 mStride, mCells);
+    }
+    mTriangleCount = 2 * static_cast<size_t>(mCells) * mCells;
+    
+    const size_t vertexCount = static_cast<size_t>(mCells + 1) * (mCells + 1);
+    const int tilesPerSide = (mCells + kTileCells - 1) / kTileCells;
+    const size_t tileCount = static_cast<size_t>(tilesPerSide) * tilesPerSide;
+    mVertexBuffer = mDevice->newBuffer(vertexCount * 3 * sizeof(float), MTL::ResourceStorageModeShared);
+    mIndexBuffer = mDevice->newBuffer(mTriangleCount * 3 * sizeof(uint32_t), MTL::ResourceStorageModeShared);
+    mTileBuffer = mDevice->newBuffer(tileCount * sizeof(uint32_t), MTL::ResourceStorageModeShared);
+    if (!mVertexBuffer || !mIndexBuffer || !mTileBuffer) {
+        LOG_ERROR("Failed to allocate the terrain acceleration structure's geometry (%zu triangles)",
+                  mTriangleCount);
+        return false;
+    }
+    WriteVertices(terrain, 0, 0, mCells, mCells);
+    
+    // Triangles tile by tile, each cell split as Terrain::SampleHeight
+    // splits it
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    uint32_t* indices = static_cast<uint32_t*>(mIndexBuffer->contents());
+    uint32_t* tileFirst = static_cast<uint32_t*>(mTileBuffer->contents());
+    std::vector<MTL::AccelerationStructureTriangleGeometryDescriptor*> geometries;
+    geometries.reserve(tileCount);
+    const uint32_t row = static_cast<uint32_t>(mCells + 1);
+    size_t triangle = 0;
+    for (int tileZ = 0; tileZ < tilesPerSide; tileZ++) {
+        for (int tileX = 0; tileX < tilesPerSide; tileX++) {
+            const size_t first = triangle;
+            const int maxZ = std::min((tileZ + 1) * kTileCells, mCells);
+            const int maxX = std::min((tileX + 1) * kTileCells, mCells);
+            for (int z = tileZ * kTileCells; z < maxZ; z++) {
+                for (int x = tileX * kTileCells; x < maxX; x++) {
+                    const uint32_t corner = static_cast<uint32_t>(z) * row + x;
+                    uint32_t* cell = indices + 3 * triangle;
+                    cell[0] = corner;
+                    cell[1] = corner + row;
+                    cell[2] = corner + 1;
+                    cell[3] = corner + 1;
+                    cell[4] = corner + row;
+                    cell[5] = corner + row + 1;
+                    triangle += 2;
+                }
+            }
+            tileFirst[geometries.size()] = static_cast<uint32_t>(first);
+            
+            MTL::AccelerationStructureTriangleGeometryDescriptor* geometry =
+                MTL::AccelerationStructureTriangleGeometryDescriptor::alloc()->init();
+            geometry->setVertexBuffer(mVertexBuffer);
+            geometry->setVertexBufferOffset(0);
+            geometry->setVertexStride(3 * sizeof(float));
+            geometry->setVertexFormat(MTL::AttributeFormatFloat3);
+            geometry->setIndexBuffer(mIndexBuffer);
+            geometry->setIndexBufferOffset(first * 3 * sizeof(uint32_t));
+            geometry->setIndexType(MTL::IndexTypeUInt32);
+            geometry->setTriangleCount(triangle - first);
+            geometry->setOpaque(true);
+            geometries.push_back(geometry);
+        }
+    }
+    
+    NS::Array* geometryArray = NS::Array::alloc()->init(
+        reinterpret_cast<const NS::Object* const*>(geometries.data()), geometries.size());
+    for (MTL::AccelerationStructureTriangleGeometryDescriptor* geometry : geometries) {
+        geometry->release();
+    }
+    mDescriptor = MTL::PrimitiveAccelerationStructureDescriptor::alloc()->init();
+    mDescriptor->setGeometryDescriptors(geometryArray);
+    mDescriptor->setUsage(MTL::AccelerationStructureUsageRefit);
+    geometryArray->release();
+    
+    const MTL::AccelerationStructureSizes sizes = mDevice->accelerationStructureSizes(mDescriptor);
+    mStructure = mDevice->newAccelerationStructure(sizes.accelerationStructureSize);
+    mScratchBuffer = mDevice->newBuffer(std::max(sizes.buildScratchBufferSize, sizes.refitScratchBufferSize),
+                                        MTL::ResourceStorageModePrivate);
+    if (!mStructure || !mScratchBuffer) {
+        LOG_ERROR("Failed to allocate the terrain acceleration structure (%zu bytes)",
+                  static_cast<size_t>(sizes.accelerationStructureSize));
+        pool->release();
+        return false;
+    }
+    
+    MTL::CommandBuffer* commands = mQueue->commandBuffer();
+    MTL::AccelerationStructureCommandEncoder* encoder = commands->accelerationStructureCommandEncoder();
+    encoder->buildAccelerationStructure(mStructure, mDescriptor, mScratchBuffer, 0);
+    encoder->endEncoding();
+    commands->commit();
+    mBuildCommands = commands->retain();
+    pool->release();
+    
+    mTerrain = terrain;
+    mLayoutVersion = terrain->GetLayoutVersion();
+    return true;
+}
+
+void TerrainRayTracer::Refit() {
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    MTL::CommandBuffer* commands = mQueue->commandBuffer();
+    MTL::AccelerationStructureCommandEncoder* encoder = commands->accelerationStructureCommandEncoder();
+    encoder->refitAccelerationStructure(mStructure, mDescriptor, mStructure, mScratchBuffer, 0);
+    encoder->endEncoding();
+    commands->commit();
+    mBuildCommands = commands->retain();
+    pool->release();
+}
+
+bool TerrainRayTracer::ReserveQueries(size_t rays, size_t hits) {
+    // Metal has no empty buffers; the scan binds a one-ray buffer it never reads
+    rays = std::max<size_t>(rays, 1);
+    if (!mRayBuffer || mRayBuffer->length() < rays * sizeof(TerrainRay)) {
+        ReleaseBuffer(mRayBuffer);
+        mRayBuffer = mDevice->newBuffer(rays * sizeof(TerrainRay), MTL::ResourceStorageModeShared);
+    }
+    if (!mHitBuffer || mHitBuffer->length() < hits * sizeof(TerrainRayHit)) {
+        ReleaseBuffer(mHitBuffer);
+        mHitBuffer = mDevice->newBuffer(hits * sizeof(TerrainRayHit), MTL::ResourceStorageModeShared);
+    }
+    if (!mRayBuffer || !mHitBuffer) {
+        LOG_ERROR("Failed to allocate buffers for %zu terrain rays", hits);
+        ReleaseBuffer(mRayBuffer);
+        ReleaseBuffer(mHitBuffer);
+        return false;
+    }
+    return true;
+}
+
+const TerrainRayHit* TerrainRayTracer::Trace(const TerrainRay* rays, size_t count) {
+    if (!mStructure || !rays || count == 0 || !ReserveQueries(count, count)) {
+        return nullptr;
+    }
+    std::memcpy(mRayBuffer->contents(), rays, count * sizeof(TerrainRay));
+    
+    TerrainQueryParams params = {};
+    params.width = static_cast<uint32_t>(count);
+    params.height = 1;
+    params.rayCount = static_cast<uint32_t>(count);
+    return Dispatch(mRayPipeline, &params, sizeof(params), count, 1);
+}
+
+const TerrainRayHit* TerrainRayTracer::Scan(const TerrainLidarScan& scan) {
+    if (!mStructure || scan.width < 1 || scan.height < 1) {
+        return nullptr;
+    }
+    const size_t count = static_cast<size_t>(scan.width) * scan.height;
+    if (!ReserveQueries(1, count)) {
+        return nullptr;
+    }
+    
+    TerrainQueryParams params = {};
+    for (int i = 0; i < 3; i++) {
+        params.origin[i] = scan.origin[i];
+        params.forward[i] = scan.forward[i];
+        params.right[i] = scan.right[i];
+        params.up[i] = scan.up[i];
+    }
+    params.origin[3] = scan.maxDistance;
+    params.right[3] = std::tan(0.5f * scan.fieldOfViewX);
+    params.up[3] = std::tan(0.5f * scan.fieldOfViewY);
+    params.width = static_cast<uint32_t>(scan.width);
+    params.height = static_cast<uint32_t>(scan.height);
+    params.rayCount = static_cast<uint32_t>(count);
+    return Dispatch(mScanPipeline, &params, sizeof(params), scan.width, scan.height);
+}
+
+const TerrainRayHit* TerrainRayTracer::Dispatch(MTL::ComputePipelineState* pipeline, const void* params,
+                                                size_t paramsSize, size_t width, size_t height) {
+    // Behind the build or refit on the same queue, so no wait for it here
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    MTL::CommandBuffer* commands = mQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* compute = commands->computeCommandEncoder();
+    compute->setComputePipelineState(pipeline);
+    compute->setBytes(params, paramsSize, kSlotParams);
+    compute->setBuffer(mRayBuffer, 0, kSlotRays);
+    compute->setBuffer(mHitBuffer, 0, kSlotHits);
+    compute->setAccelerationStructure(mStructure, kSlotStructure);
+    compute->setBuffer(mVertexBuffer, 0, kSlotVertices);
+    compute->setBuffer(mIndexBuffer, 0, kSlotIndices);
+    compute->setBuffer(mTileBuffer, 0, kSlotTiles);
+    
+    const NS::UInteger threadWidth = pipeline->threadExecutionWidth();
+    const MTL::Size group = height > 1
+        ? MTL::Size(threadWidth, pipeline->maxTotalThreadsPerThreadgroup() / threadWidth, 1)
+        : MTL::Size(threadWidth, 1, 1);
+    compute->dispatchThreads(MTL::Size(width, height, 1), group);
+    compute->endEncoding();
+    commands->commit();
+    commands->waitUntilCompleted();
+    
+    const bool completed = commands->status() == MTL::CommandBufferStatusCompleted;
+    if (!completed) {
+        LOG_ERROR("Terrain ray query failed: %s", ErrorText(commands->error()));
+    }
+    pool->release();
+    return completed ? static_cast<const TerrainRayHit*>(mHitBuffer->contents()) : nullptr;
+}
+
+size_t TerrainRayTracer::GetMemoryUsage() const {
+    size_t bytes = mStructure ? mStructure->size() : 0;
+    for (const MTL::Buffer* buffer : {mVertexBuffer, mIndexBuffer, mTileBuffer, mScratchBuffer, mRayBuffer, mHitBuffer}) {
+        bytes += buffer ? buffer->length() : 0;
+    }
+    return bytes;
+}
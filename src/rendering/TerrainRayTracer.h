@@ -0,0 +1,137 @@
+// TerrainRayTracer.h
+// The 3D terrain in a Metal acceleration structure, for GPU ray queries and ray-traced shadows
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Terrain;
+
+// Forward declarations for Metal types (to avoid including Metal headers here)
+namespace MTL {
+    class Device;
+    class CommandQueue;
+    class CommandBuffer;
+    class Library;
+    class ComputePipelineState;
+    class Buffer;
+    class AccelerationStructure;
+    class PrimitiveAccelerationStructureDescriptor;
+}
+
+// A ray in world meters; matches TerrainRay in TerrainRayQuery.metal
+struct TerrainRay {
+    float origin[3];
+    float maxDistance;
+    float direction[3];     // Unit
+    float padding;
+};
+
+// Matches TerrainRayHit in TerrainRayQuery.metal
+struct TerrainRayHit {
+    float distance;         // Along the ray (m), < 0 = no hit within its length
+    float normal[3];        // Unit, up out of the triangle hit
+};
+
+// A lidar sweep: width x height rays from origin, spread evenly over the
+// field of view about forward (rows top to bottom, right-handed basis)
+struct TerrainLidarScan {
+    float origin[3];
+    float forward[3];       // Unit
+    float right[3];         // Unit, perpendicular to forward
+    float up[3];            // Unit, perpendicular to both
+    float fieldOfViewX;     // Radians
+    float fieldOfViewY;
+    float maxDistance;      // Meters
+    int width;
+    int height;
+};
+
+static_assert(sizeof(TerrainRay) == 32 && sizeof(TerrainRayHit) == 16, "Ray layouts must match TerrainRayQuery.metal");
+
+// One primitive acceleration structure over the height grid's triangles,
+// split the way Terrain::SampleHeight splits each cell, with one triangle
+// geometry per kTileCells x kTileCells tile. Grids of more than
+// kMaxTriangles triangles are built from every second (fourth, ...) sample,
+// as a coarser level of the same surface. Edits (regolith, craters) rewrite
+// the vertices under their dirty region and refit the structure in place;
+// a new layout (a regenerated grid, a streamed window move, a floating
+// origin move) builds it again.
+//
+// The builds go on the queue as command buffers of their own, so anything
+// committed after Update() sees the new structure. Queries dispatch
+// terrain_ray_query or terrain_lidar_scan (TerrainRayQuery.metal) and wait
+// for them; their hits stay in a shared buffer, read in place on unified
+// memory, until the next query. Needs a GPU with ray tracing.
+class TerrainRayTracer {
+public:
+    static constexpr int kTileCells = 64;
+    static constexpr size_t kMaxTriangles = size_t(1) << 22;
+    
+    TerrainRayTracer();
+    ~TerrainRayTracer();
+    
+    TerrainRayTracer(const TerrainRayTracer&) = delete;
+    TerrainRayTracer& operator=(const TerrainRayTracer&) = delete;
+    
+    // Take the device and queue (retained) and build the query kernels from
+    // library. False (logged) without ray tracing or without the kernels.
+    bool Initialize(MTL::Device* device, MTL::CommandQueue* queue, MTL::Library* library);
+    void Shutdown();
+    bool IsInitialized() const { return mDevice != nullptr; }
+    
+    // Bring the structure in step with terrain's height grid. False, with
+    // no structure, if the terrain has no grid or a build failed.
+    bool Update(const Terrain* terrain);
+    MTL::AccelerationStructure* GetAccelerationStructure() const { return mStructure; }
+    
+    // Trace count rays against the structure as of the last Update(); the
+    // hits, one per ray, or null on failure
+    const TerrainRayHit* Trace(const TerrainRay* rays, size_t count);
+    
+    // Trace a lidar sweep, generating its rays on the GPU; width * height
+    // hits, row by row, or null on failure
+    const TerrainRayHit* Scan(const TerrainLidarScan& scan);
+    
+    size_t GetTriangleCount() const { return mTriangleCount; }
+    int GetSampleStride() const { return mStride; }
+    size_t GetMemoryUsage() const;
+
+private:
+    bool Build(const Terrain* terrain);
+    void WriteVertices(const Terrain* terrain, int minX, int minZ, int maxX, int maxZ);
+    void Refit();
+    void Release();
+    void WaitForBuild();
+    bool ReserveQueries(size_t rays, size_t hits);
+    const TerrainRayHit* Dispatch(MTL::ComputePipelineState* pipeline, const void* params, size_t paramsSize,
+                                  size_t width, size_t height);
+    
+    MTL::Device* mDevice;
+    MTL::CommandQueue* mQueue;
+    MTL::ComputePipelineState* mRayPipeline;
+    MTL::ComputePipelineState* mScanPipeline;
+    
+    // Geometry: (mCells + 1)^2 vertices (packed float3), triangles ordered
+    // tile by tile, and each tile's first triangle for the kernels' normals
+    MTL::Buffer* mVertexBuffer;
+    MTL::Buffer* mIndexBuffer;
+    MTL::Buffer* mTileBuffer;
+    MTL::PrimitiveAccelerationStructureDescriptor* mDescriptor;
+    MTL::AccelerationStructure* mStructure;
+    MTL::Buffer* mScratchBuffer;    // Sized for a build, which covers a refit
+    MTL::CommandBuffer* mBuildCommands;     // Last build or refit (retained), null once waited for
+    int mStride;                    // Grid samples per structure vertex
+    int mCells;                     // Structure cells per side
+    size_t mTriangleCount;
+    
+    // What the structure was built for
+    const Terrain* mTerrain;
+    uint32_t mLayoutVersion;
+    uint32_t mVersion;
+    
+    // Query buffers, grown as needed
+    MTL::Buffer* mRayBuffer;
+    MTL::Buffer* mHitBuffer;
+};
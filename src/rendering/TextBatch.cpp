@@ -0,0 +1,131 @@
+// TextBatch.cpp
+// Implementation of the glyph atlas, text formatting and glyph batching
+
+#include "TextBatch.h"
+#include "DebugOverlay.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+const uint8_t* GlyphAtlas::GetPixels() {
+    // Baked on first use, then shared by every renderer
+    static uint8_t pixels[kWidth * kHeight];
+    static bool baked = false;
+    if (baked) {
+        return pixels;
+    }
+    
+    std::memset(pixels, 0, sizeof(pixels));
+    for (int code = 32; code < 127; code++) {
+        int cellX, cellY;
+        if (!GetCell(static_cast<char>(code), cellX, cellY)) {
+            continue;
+        }
+        const char* rows = DebugOverlay::GetGlyph(static_cast<char>(code));
+        for (int row = 0; row < DebugOverlay::kGlyphHeight; row++) {
+            for (int col = 0; col < DebugOverlay::kGlyphWidth; col++) {
+                if (rows[row * DebugOverlay::kGlyphWidth + col] == '1') {
+                    pixels[(cellY + row) * kWidth + cellX + col] = 255;
+                }
+            }
+        }
+    }
+    
+    // Solid cell for untextured rectangles
+    const int solidX = (kColumns - 1) * kCellWidth;
+    const int solidY = (kRows - 1) * kCellHeight;
+    for (int row = 0; row < kCellHeight; row++) {
+        std::memset(pixels + (solidY + row) * kWidth + solidX, 255, kCellWidth);
+    }
+    
+    baked = true;
+    return pixels;
+}
+
+bool GlyphAtlas::GetCell(char c, int& x, int& y) {
+    if (c >= 'a' && c <= 'z') {
+        c = static_cast<char>(c - 'a' + 'A');
+    }
+    if (c < 32 || c >= 127 || !DebugOverlay::GetGlyph(c)) {
+        return false;
+    }
+    
+    const int index = c - 32;
+    x = (index % kColumns) * kCellWidth;
+    y = (index / kColumns) * kCellHeight;
+    return true;
+}
+
+TextLine& TextLine::Append(const char* text) {
+    while (*text && mLength < kCapacity) {
+        mText[mLength++] = *text++;
+    }
+    mText[mLength] = '\0';
+    return *this;
+}
+
+TextLine& TextLine::Append(int value) {
+    char digits[16];
+    std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    *result.ptr = '\0';
+    return Append(digits);
+}
+
+TextLine& TextLine::Append(float value, int decimals) {
+    // Fixed point: the value scaled by 10^decimals, rounded to an integer,
+    // with the decimal point put back in. Anything that won't fit is "---".
+    static const long long kScales[] = { 1, 10, 100, 1000, 10000 };
+    decimals = decimals < 0 ? 0 : (decimals > 4 ? 4 : decimals);
+    const double scaled = std::fabs(static_cast<double>(value)) * kScales[decimals];
+    if (!std::isfinite(scaled) || scaled >= 1e15) {
+        return Append("---");
+    }
+    
+    const long long fixed = std::llround(scaled);
+    char buffer[32];
+    char* out = buffer;
+    if (value < 0.0f && fixed != 0) {
+        *out++ = '-';
+    }
+    std::to_chars_result result = std::to_chars(out, buffer + sizeof(buffer), fixed / kScales[decimals]);
+    out = result.ptr;
+    if (decimals > 0) {
+        *out++ = '.';
+        
+        // Fraction digits, zero padded
+        long long fraction = fixed % kScales[decimals];
+        for (int i = decimals - 1; i >= 0; i--) {
+            out[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        out += decimals;
+    }
+    *out = '\0';
+    return Append(buffer);
+}
+
+float TextBatch::AddText(const char* text, size_t length, float x, float y, float scale,
+                         uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    for (size_t i = 0; i < length; i++) {
+        int cellX, cellY;
+        if (GlyphAtlas::GetCell(text[i], cellX, cellY)) {
+            if (mCount < kMaxGlyphs) {
+                Glyph& glyph = mGlyphs[mCount++];
+                glyph.x = x;
+                glyph.y = y;
+                glyph.width = DebugOverlay::kGlyphWidth * scale;
+                glyph.height = DebugOverlay::kGlyphHeight * scale;
+                glyph.atlasX = static_cast<uint16_t>(cellX);
+                glyph.atlasY = static_cast<uint16_t>(cellY);
+                glyph.r = r;
+                glyph.g = g;
+                glyph.b = b;
+                glyph.a = a;
+            } else {
+                mDropped = true;
+            }
+        }
+        x += (DebugOverlay::kGlyphWidth + 1) * scale;
+    }
+    return x;
+}
@@ -0,0 +1,90 @@
+// TextBatch.h
+// Glyph atlas, allocation-free number formatting and glyph quad batching for HUD text
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// DebugOverlay's 3x5 font baked once into an 8-bit coverage image: printable
+// ASCII in a kColumns-wide grid of kCellWidth x kCellHeight cells, with the
+// DEL cell solid so untextured rectangles can share the atlas and draw in
+// the same batch. Renderers upload GetPixels() as their glyph texture.
+class GlyphAtlas {
+public:
+    static constexpr int kCellWidth = 4;      // Glyph plus a texel of padding
+    static constexpr int kCellHeight = 6;
+    static constexpr int kColumns = 16;
+    static constexpr int kRows = 6;           // Characters 32 to 127
+    static constexpr int kWidth = kCellWidth * kColumns;
+    static constexpr int kHeight = kCellHeight * kRows;
+    
+    // kWidth * kHeight bytes, 255 = lit
+    static const uint8_t* GetPixels();
+    
+    // Top-left texel of a character's cell (false if the font lacks it)
+    static bool GetCell(char c, int& x, int& y);
+    
+    // Texel center inside the solid cell
+    static float GetSolidX() { return (kColumns - 1) * kCellWidth + kCellWidth * 0.5f; }
+    static float GetSolidY() { return (kRows - 1) * kCellHeight + kCellHeight * 0.5f; }
+};
+
+// One line of text in a fixed buffer. Numbers go through std::to_chars on
+// integers (fixed point), so formatting neither allocates nor depends on
+// the locale. Text past kCapacity is dropped.
+class TextLine {
+public:
+    static constexpr size_t kCapacity = 64;
+    
+    TextLine() : mLength(0) { mText[0] = '\0'; }
+    
+    TextLine& Append(const char* text);
+    TextLine& Append(float value, int decimals);   // "-12.30"; "---" if not finite
+    TextLine& Append(int value);
+    void Clear() { mLength = 0; mText[0] = '\0'; }
+    
+    const char* GetText() const { return mText; }
+    size_t GetLength() const { return mLength; }
+    
+private:
+    char mText[kCapacity + 1];
+    size_t mLength;
+};
+
+// Glyph quads for a frame, in pixels from the top-left, with their atlas
+// texels. Fixed capacity, so adding text never allocates; glyphs past
+// kMaxGlyphs are dropped.
+class TextBatch {
+public:
+    static constexpr size_t kMaxGlyphs = 1024;
+    
+    struct Glyph {
+        float x, y;              // Top-left in pixels
+        float width, height;
+        uint16_t atlasX, atlasY; // Top-left texel of the glyph
+        uint8_t r, g, b, a;
+    };
+    
+    TextBatch() : mCount(0), mDropped(false) {}
+    
+    void Clear() { mCount = 0; mDropped = false; }
+    
+    // Each font cell becomes scale x scale pixels; returns the x position
+    // after the last glyph, like DebugOverlay::DrawText
+    float AddText(const char* text, size_t length, float x, float y, float scale,
+                  uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255);
+    float AddText(const TextLine& line, float x, float y, float scale,
+                  uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+        return AddText(line.GetText(), line.GetLength(), x, y, scale, r, g, b, a);
+    }
+    
+    const Glyph* GetGlyphs() const { return mGlyphs; }
+    size_t GetCount() const { return mCount; }
+    bool HasDropped() const { return mDropped; }
+    
+private:
+    Glyph mGlyphs[kMaxGlyphs];
+    size_t mCount;
+    bool mDropped;
+};
@@ -0,0 +1,293 @@
+// VideoRecorder.cpp
+// IOSurface frame pool, VideoToolbox encoding and the encoder thread
+
+#include "VideoRecorder.h"
+#include "../core/Log.h"
+#include <chrono>
+
+// Metal-cpp's implementation is compiled into Renderer3D_Metal.cpp
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+
+#include <CoreMedia/CoreMedia.h>
+#include <CoreVideo/CoreVideo.h>
+#include <VideoToolbox/VideoToolbox.h>
+
+// The movie container (AVAssetWriter, passing the encoded samples
+// through), in MetalBridge.mm
+extern "C" {
+    void* CreateMovieWriter(const char* path, void* formatDescription);
+    bool AppendMovieSample(void* writer, void* sampleBuffer);
+    void FinishMovieWriter(void* writer);
+}
+
+// How long Stop() gives the GPU to finish the frames it was handed
+static const int kStopTimeoutMs = 2000;
+
+static void SetSessionProperty(VTCompressionSessionRef session, CFStringRef key, int32_t value) {
+    CFNumberRef number = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &value);
+    VTSessionSetProperty(session, key, number);
+    CFRelease(number);
+}
+
+static void OnCompressionOutput(void* recorder, void* slot, OSStatus status, VTEncodeInfoFlags flags,
+                                CMSampleBufferRef sampleBuffer) {
+    const bool encoded = status == noErr && sampleBuffer && !(flags & kVTEncodeInfo_FrameDropped);
+    static_cast<VideoRecorder*>(recorder)->OnFrameEncoded(static_cast<int>(reinterpret_cast<intptr_t>(slot)),
+                                                          encoded ? sampleBuffer : nullptr);
+}
+
+VideoRecorder::VideoRecorder()
+    : mDevice(nullptr)
+    , mSession(nullptr)
+    , mWriter(nullptr)
+    , mWidth(0)
+    , mHeight(0)
+    , mManagedTextures(false)
+    , mNextSlot(0)
+    , mStartNs(0)
+    , mStopping(false)
+    , mInFlight(0)
+    , mCaptured(0)
+    , mDropped(0)
+    , mEncoded(0) {
+    for (Slot& slot : mSlots) {
+        slot.pixelBuffer = nullptr;
+        slot.texture = nullptr;
+        slot.busy = false;
+        slot.timeNs = 0;
+    }
+}
+
+VideoRecorder::~VideoRecorder() {
+    Stop();
+}
+
+bool VideoRecorder::Start(MTL::Device* device, int width, int height, float frameRate, const std::string& filename) {
+    Stop();
+    if (!device || width <= 0 || height <= 0) {
+        return false;
+    }
+    mDevice = device;
+    mWidth = width;
+    mHeight = height;
+    mFilename = filename;
+    mManagedTextures = !device->hasUnifiedMemory();
+    
+    // The pool: pixel buffers the encoder takes as they are, over
+    // IOSurfaces the GPU writes through textures of its own
+    CFMutableDictionaryRef surfaceProperties = CFDictionaryCreateMutable(
+        kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFMutableDictionaryRef attributes = CFDictionaryCreateMutable(
+        kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(attributes, kCVPixelBufferIOSurfacePropertiesKey, surfaceProperties);
+    CFDictionarySetValue(attributes, kCVPixelBufferMetalCompatibilityKey, kCFBooleanTrue);
+    bool ok = true;
+    for (Slot& slot : mSlots) {
+        CVPixelBufferRef pixelBuffer = nullptr;
+        if (CVPixelBufferCreate(kCFAllocatorDefault, static_cast<size_t>(width), static_cast<size_t>(height),
+                                kCVPixelFormatType_32BGRA, attributes, &pixelBuffer) != kCVReturnSuccess) {
+            ok = false;
+            break;
+        }
+        slot.pixelBuffer = pixelBuffer;
+        
+        MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            MTL::PixelFormatBGRA8Unorm, NS::UInteger(width), NS::UInteger(height), false);
+        descriptor->setUsage(MTL::TextureUsageShaderRead);
+        descriptor->setStorageMode(mManagedTextures ? MTL::StorageModeManaged : MTL::StorageModeShared);
+        slot.texture = device->newTexture(descriptor, CVPixelBufferGetIOSurface(pixelBuffer), 0);
+        if (!slot.texture) {
+            ok = false;
+            break;
+        }
+        slot.busy = false;
+    }
+    CFRelease(attributes);
+    CFRelease(surfaceProperties);
+    
+    // Real-time H.264 without frame reordering, so samples come out in
+    // order and each buffer is released as soon as its frame is encoded
+    VTCompressionSessionRef session = nullptr;
+    if (ok && VTCompressionSessionCreate(kCFAllocatorDefault, width, height, kCMVideoCodecType_H264, nullptr,
+                                         nullptr, nullptr, OnCompressionOutput, this, &session) != noErr) {
+        ok = false;
+    }
+    if (!ok) {
+        LOG_ERROR("Failed to set up %dx%d video recording", width, height);
+        mSession = session;
+        Stop();
+        return false;
+    }
+    const int32_t fps = static_cast<int32_t>(frameRate > 0.0f ? frameRate : 60.0f);
+    VTSessionSetProperty(session, kVTCompressionPropertyKey_RealTime, kCFBooleanTrue);
+    VTSessionSetProperty(session, kVTCompressionPropertyKey_AllowFrameReordering, kCFBooleanFalse);
+    VTSessionSetProperty(session, kVTCompressionPropertyKey_ProfileLevel, kVTProfileLevel_H264_High_AutoLevel);
+    SetSessionProperty(session, kVTCompressionPropertyKey_ExpectedFrameRate, fps);
+    SetSessionProperty(session, kVTCompressionPropertyKey_MaxKeyFrameInterval, fps * 2);
+    SetSessionProperty(session, kVTCompressionPropertyKey_AverageBitRate, width * height * 4);     // ~8 Mbit/s at 1080p
+    VTCompressionSessionPrepareToEncodeFrames(session);
+    mSession = session;
+    
+    mStartNs = 0;
+    mNextSlot = 0;
+    mCaptured = 0;
+    mDropped = 0;
+    mEncoded = 0;
+    mStopping = false;
+    mEncoderThread = std::thread(&VideoRecorder::EncoderLoop, this);
+    LOG_INFO("Recording %dx%d video to %s", width, height, filename.c_str());
+    return true;
+}
+
+void VideoRecorder::Stop() {
+    // Frames the GPU still has come back through their handlers
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kStopTimeoutMs);
+    while (mInFlight > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    if (mEncoderThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            mStopping = true;
+        }
+        mQueueCondition.notify_all();
+        mEncoderThread.join();
+    }
+    
+    VTCompressionSessionRef session = static_cast<VTCompressionSessionRef>(mSession);
+    if (session) {
+        VTCompressionSessionCompleteFrames(session, kCMTimeInvalid);
+        VTCompressionSessionInvalidate(session);
+        CFRelease(session);
+        mSession = nullptr;
+    }
+    if (mWriter) {
+        FinishMovieWriter(mWriter);
+        mWriter = nullptr;
+        LOG_INFO("Recorded %llu frames to %s (%llu dropped)", static_cast<unsigned long long>(mEncoded.load()),
+                 mFilename.c_str(), static_cast<unsigned long long>(mDropped.load()));
+    }
+    
+    // Buffers the GPU never gave back leak rather than free under it
+    if (mInFlight == 0) {
+        for (Slot& slot : mSlots) {
+            if (slot.texture) {
+                slot.texture->release();
+                slot.texture = nullptr;
+            }
+            if (slot.pixelBuffer) {
+                CVPixelBufferRelease(static_cast<CVPixelBufferRef>(slot.pixelBuffer));
+                slot.pixelBuffer = nullptr;
+            }
+            slot.busy = false;
+        }
+    }
+}
+
+void VideoRecorder::CaptureFrame(MTL::CommandBuffer* commandBuffer, MTL::Texture* source, uint64_t timeNs) {
+    if (!mSession || !commandBuffer || !source) {
+        return;
+    }
+    if (static_cast<int>(source->width()) != mWidth || static_cast<int>(source->height()) != mHeight) {
+        LOG_WARNING_EVERY(5000, "Video frames are %lux%lu, the recording %dx%d; skipping them",
+                          static_cast<unsigned long>(source->width()), static_cast<unsigned long>(source->height()),
+                          mWidth, mHeight);
+        mDropped++;
+        return;
+    }
+    
+    // The next buffer in turn, if the encoder is done with it; frames are
+    // encoded in order, so if it isn't none of the others is either
+    Slot& slot = mSlots[mNextSlot];
+    bool expected = false;
+    if (!slot.busy.compare_exchange_strong(expected, true)) {
+        mDropped++;
+        return;
+    }
+    const int index = mNextSlot;
+    mNextSlot = (mNextSlot + 1) % kPoolSize;
+    if (mStartNs == 0) {
+        mStartNs = timeNs;
+    }
+    slot.timeNs = timeNs - mStartNs;
+    
+    MTL::BlitCommandEncoder* blit = commandBuffer->blitCommandEncoder();
+    blit->copyFromTexture(source, 0, 0, MTL::Origin(0, 0, 0),
+                          MTL::Size(NS::UInteger(mWidth), NS::UInteger(mHeight), 1), slot.texture, 0, 0,
+                          MTL::Origin(0, 0, 0));
+    if (mManagedTextures) {
+        blit->synchronizeResource(slot.texture);
+    }
+    blit->endEncoding();
+    
+    mInFlight++;
+    mCaptured++;
+    commandBuffer->addCompletedHandler([this, index](MTL::CommandBuffer* buffer) {
+        if (buffer->status() == MTL::CommandBufferStatusCompleted) {
+            {
+                std::lock_guard<std::mutex> lock(mQueueMutex);
+                mReady.push_back(index);
+            }
+            mQueueCondition.notify_one();
+        } else {
+            mSlots[index].busy = false;
+            mDropped++;
+        }
+        mInFlight--;
+    });
+}
+
+void VideoRecorder::EncoderLoop() {
+    VTCompressionSessionRef session = static_cast<VTCompressionSessionRef>(mSession);
+    for (;;) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(mQueueMutex);
+            mQueueCondition.wait(lock, [this]() { return mStopping || !mReady.empty(); });
+            if (mReady.empty()) {
+                return;
+            }
+            index = mReady.front();
+            mReady.pop_front();
+        }
+        
+        Slot& slot = mSlots[index];
+        const CMTime time = CMTimeMake(static_cast<int64_t>(slot.timeNs), 1000000000);
+        void* frameRef = reinterpret_cast<void*>(static_cast<intptr_t>(index));
+        if (VTCompressionSessionEncodeFrame(session, static_cast<CVPixelBufferRef>(slot.pixelBuffer), time,
+                                            kCMTimeInvalid, nullptr, frameRef, nullptr) != noErr) {
+            slot.busy = false;
+            mDropped++;
+        }
+    }
+}
+
+void VideoRecorder::OnFrameEncoded(int slot, void* sampleBuffer) {
+    if (sampleBuffer) {
+        // The movie takes its format from the first sample
+        if (!mWriter) {
+            CMFormatDescriptionRef format =
+                CMSampleBufferGetFormatDescription(static_cast<CMSampleBufferRef>(sampleBuffer));
+            mWriter = CreateMovieWriter(mFilename.c_str(), const_cast<void*>(static_cast<const void*>(format)));
+            if (!mWriter) {
+                LOG_ERROR("Failed to create the movie %s", mFilename.c_str());
+            }
+        }
+        if (mWriter && AppendMovieSample(mWriter, sampleBuffer)) {
+            mEncoded++;
+        } else {
+            mDropped++;
+        }
+    } else {
+        mDropped++;
+    }
+    if (slot >= 0 && slot < kPoolSize) {
+        mSlots[slot].busy = false;
+    }
+}
+
+VideoRecorderStats VideoRecorder::GetStats() const {
+    return VideoRecorderStats{ mCaptured.load(), mDropped.load(), mEncoded.load() };
+}
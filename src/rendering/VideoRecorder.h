@@ -0,0 +1,96 @@
+// VideoRecorder.h
+// Flight video: frames blitted into IOSurface buffers and encoded with VideoToolbox off the render thread
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Forward declarations for Metal types (to avoid including Metal headers here)
+namespace MTL {
+    class Device;
+    class CommandBuffer;
+    class Texture;
+}
+
+struct VideoRecorderStats {
+    uint64_t captured;      // Frames blitted into a buffer
+    uint64_t dropped;       // Frames skipped: no free buffer, a resized drawable or a busy writer
+    uint64_t encoded;       // Frames written to the movie
+};
+
+// Records the frames it is given into an H.264 QuickTime movie. Each
+// CaptureFrame() encodes a blit of the frame into one of kPoolSize
+// IOSurface-backed pixel buffers, shared with the GPU as textures; the
+// command buffer's completion handler queues the buffer for the encoder
+// thread, which hands it to a VideoToolbox compression session, and the
+// session's output goes into the movie as it arrives. The buffer returns
+// to the pool once VideoToolbox has encoded it. Nothing waits on the GPU:
+// a frame that finds every buffer still in flight is dropped instead, so
+// recording costs the render thread one blit encoder per frame.
+class VideoRecorder {
+public:
+    static constexpr int kPoolSize = 4;
+    
+    VideoRecorder();
+    ~VideoRecorder();
+    
+    VideoRecorder(const VideoRecorder&) = delete;
+    VideoRecorder& operator=(const VideoRecorder&) = delete;
+    
+    // width x height BGRA8 frames at about frameRate into filename (.mov)
+    bool Start(MTL::Device* device, int width, int height, float frameRate, const std::string& filename);
+    
+    // Waits for the frames in flight, then closes the movie
+    void Stop();
+    bool IsRecording() const { return mSession != nullptr; }
+    
+    // Render thread, before commandBuffer is committed. source must be
+    // BGRA8, the recording's size and not framebuffer-only; timeNs is the
+    // frame's time (Profiler::Now()).
+    void CaptureFrame(MTL::CommandBuffer* commandBuffer, MTL::Texture* source, uint64_t timeNs);
+    
+    VideoRecorderStats GetStats() const;
+    
+    // VideoToolbox's output for the frame in slot (null sample = failed);
+    // called on the session's thread
+    void OnFrameEncoded(int slot, void* sampleBuffer);
+
+private:
+    struct Slot {
+        void* pixelBuffer;          // CVPixelBufferRef over an IOSurface
+        MTL::Texture* texture;      // The same IOSurface
+        std::atomic<bool> busy;     // Between the blit and the encoder's release
+        uint64_t timeNs;
+    };
+    
+    void EncoderLoop();
+    
+    MTL::Device* mDevice;
+    void* mSession;                 // VTCompressionSessionRef
+    void* mWriter;                  // Movie writer, created from the first sample's format
+    std::string mFilename;
+    int mWidth;
+    int mHeight;
+    bool mManagedTextures;          // Discrete GPUs: blit, then synchronize for the CPU side
+    Slot mSlots[kPoolSize];
+    int mNextSlot;
+    uint64_t mStartNs;
+    
+    // Completed blits waiting for the encoder thread
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueCondition;
+    std::deque<int> mReady;
+    std::thread mEncoderThread;
+    bool mStopping;
+    std::atomic<int> mInFlight;     // Captured and not yet queued by the completion handler
+    
+    std::atomic<uint64_t> mCaptured;
+    std::atomic<uint64_t> mDropped;
+    std::atomic<uint64_t> mEncoded;
+};
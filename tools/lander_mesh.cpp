@@ -0,0 +1,80 @@
+// lander_mesh.cpp
+// Builds a lander mesh cache from an OBJ model ahead of time
+//
+// The cache (see core/LanderMesh.h) holds the model's LOD chain, cache and
+// overdraw ordered and quantized. The game builds it on first use of
+// --lander-mesh too; this tool does it offline and reports what it did.
+
+#include "core/LanderMesh.h"
+#include "core/Log.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintUsage() {
+    std::cerr << "Usage: lander_mesh <input .obj> [output cache] [options]\n"
+                 "  (the cache defaults to <input>.lmesh, where the game looks for it)\n"
+                 "  --verify      Read the cache back and compare it with the build\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    bool verify = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (paths.empty() || paths.size() > 2) {
+        PrintUsage();
+        return 1;
+    }
+    if (paths.size() == 1) {
+        paths.push_back(paths[0] + ".lmesh");
+    }
+    Log::SetLevel(LogLevel::Warning);
+    
+    char source[256];
+    LanderMesh mesh;
+    if (!LanderMesh::DescribeSource(paths[0].c_str(), source, sizeof(source)) || !mesh.Build(paths[0].c_str())) {
+        std::cerr << "Could not build " << paths[0] << std::endl;
+        return 1;
+    }
+    if (!mesh.SaveCache(paths[1].c_str(), source)) {
+        std::cerr << "Could not write " << paths[1] << std::endl;
+        return 1;
+    }
+    
+    const LanderMeshStats& stats = mesh.GetStats();
+    std::printf("%zu triangles in %.1f ms, %.3f -> %.3f cache misses per triangle (%d-entry cache)\n",
+                stats.sourceTriangles, stats.seconds * 1000.0, stats.cacheMissRatio[0], stats.cacheMissRatio[1],
+                LanderMesh::kCacheSize);
+    for (size_t i = 0; i < mesh.GetLods().size(); i++) {
+        const LanderMeshLod& lod = mesh.GetLods()[i];
+        std::printf("  LOD %zu: %u triangles, %u vertices, error %.4f of the box\n", i, lod.indexCount / 3,
+                    lod.vertexCount, lod.error);
+    }
+    
+    if (verify) {
+        LanderMesh cached;
+        if (!cached.LoadCache(paths[1].c_str(), source) ||
+            cached.GetVertices().size() != mesh.GetVertices().size() ||
+            cached.GetIndices() != mesh.GetIndices() || cached.GetLods().size() != mesh.GetLods().size()) {
+            std::cerr << "Could not read back " << paths[1] << std::endl;
+            return 1;
+        }
+        std::printf("Read back %s\n", paths[1].c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,360 @@
+// lander_server.cpp
+// Dedicated server: hosts many independent network sessions in one process
+//
+// Session i listens on base port + i and flies up to kNetMaxLanders
+// clients' landers on a 2D terrain chosen by its seed. Terrains are
+// generated once per distinct seed and world size, and their segment tables
+// shared by every session on them, so a session costs its world, its
+// snapshot history and its clients' input queues. Every fixed step, the sessions are stepped
+// as a parallel-for on the job system; each owns its socket, so they never
+// touch each other.
+//
+// With --scenarios, session i flies scenario i % N of a compiled scenario
+// file instead (scenario_pack): its terrain, world, gravity, spawn point and
+// velocity, starting fuel, tank and lander size, read straight out of the
+// file's mapping. Session landers push a fixed 2.5 g, so a scenario's
+// thrust and dry mass are not flown; one that sets them is warned about.
+//
+// With --metrics, a Prometheus endpoint serves the step times, sessions,
+// landers, traffic, memory and job system. Workers count into their own
+// metric shards and the main loop sets gauges, so a scrape never holds up
+// a step.
+
+#include "core/JobSystem.h"
+#include "core/LanderBatch.h"
+#include "core/Log.h"
+#include "core/Metrics.h"
+#include "core/MetricsServer.h"
+#include "core/NetSession.h"
+#include "core/Rules.h"
+#include "core/ScenarioFile.h"
+#include "core/Terrain.h"
+#include "core/Units.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sessions handed to each job; stepping one is a few microseconds, so
+// batching them keeps the scheduling from costing more than the work
+static const size_t kSessionsPerJob = 16;
+
+static std::atomic<bool> sStopping(false);
+
+static void OnSignal(int) {
+    sStopping = true;
+}
+
+static void PrintUsage() {
+    std::cerr <<
+        "Usage: lander_server [options]\n"
+        "  --sessions N         Sessions to host (default 64)\n"
+        "  --port P             Port of session 0; session i listens on P + i (default 40000)\n"
+        "  --seed N             Terrain seed of session 0 (default 1)\n"
+        "  --terrains N         Distinct terrains: session i uses seed + i % N (default 1)\n"
+        "  --world WxH          2D world size in pixels (default 800x600)\n"
+        "  --difficulty NAME    easy, normal or hard (default normal)\n"
+        "  --scenarios FILE     Session i flies scenario i % N of a compiled scenario file, in\n"
+        "                       place of --seed, --terrains, --world and --difficulty\n"
+        "  --rate HZ            Physics rate (default 120)\n"
+        "  --threads N          Worker threads (default: every core)\n"
+        "  --duration SECONDS   Stop after this long (default: until interrupted)\n"
+        "  --stats SECONDS      Seconds between status lines (default 10)\n"
+        "  --metrics PORT       Serve Prometheus metrics on http://*:PORT/metrics\n";
+}
+
+int main(int argc, char* argv[]) {
+    int sessionCount = 64;
+    int basePort = 40000;
+    long seed = 1;
+    int terrainCount = 1;
+    int worldWidth = 800;
+    int worldHeight = 600;
+    Difficulty difficulty = Difficulty::NORMAL;
+    float physicsRate = 120.0f;
+    int threads = -1;
+    float duration = 0.0f;
+    float statsInterval = 10.0f;
+    int metricsPort = 0;
+    std::string scenarioFile;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (arg == "--sessions" && hasValue) {
+            sessionCount = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--port" && hasValue) {
+            basePort = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            seed = std::stol(argv[++i]);
+        } else if (arg == "--terrains" && hasValue) {
+            terrainCount = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--world" && hasValue) {
+            ok = std::sscanf(argv[++i], "%dx%d", &worldWidth, &worldHeight) == 2 &&
+                 worldWidth > 0 && worldWidth <= 65535 && worldHeight > 0 && worldHeight <= 65535;
+        } else if (arg == "--difficulty" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "easy") {
+                difficulty = Difficulty::EASY;
+            } else if (name == "normal") {
+                difficulty = Difficulty::NORMAL;
+            } else if (name == "hard") {
+                difficulty = Difficulty::HARD;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "--scenarios" && hasValue) {
+            scenarioFile = argv[++i];
+        } else if (arg == "--rate" && hasValue) {
+            physicsRate = std::max(10.0f, std::stof(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            threads = std::stoi(argv[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            duration = std::stof(argv[++i]);
+        } else if (arg == "--stats" && hasValue) {
+            statsInterval = std::max(0.1f, std::stof(argv[++i]));
+        } else if (arg == "--metrics" && hasValue) {
+            metricsPort = std::stoi(argv[++i]);
+            ok = metricsPort > 0 && metricsPort <= 65535;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (basePort <= 0 || basePort + sessionCount - 1 > 65535) {
+        std::cerr << "Ports " << basePort << "-" << basePort + sessionCount - 1 << " are out of range" << std::endl;
+        return 1;
+    }
+    
+    Log::Start();
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+    
+    // Sessions are 2D, so every scenario they fly must be
+    ScenarioFile scenarios;
+    if (!scenarioFile.empty()) {
+        if (!scenarios.Open(scenarioFile.c_str()) || scenarios.GetCount() == 0) {
+            LOG_ERROR("No scenarios to host in %s", scenarioFile.c_str());
+            Log::Stop();
+            return 1;
+        }
+        const LanderConfig defaults = LanderConfig::Default();
+        for (uint32_t i = 0; i < scenarios.GetCount(); i++) {
+            const ScenarioRecord& scenario = scenarios.Get(i);
+            if (scenario.terrain != ScenarioTerrain::Generated2D) {
+                LOG_ERROR("Scenario %s is not on 2D terrain", scenarios.GetName(scenario));
+                Log::Stop();
+                return 1;
+            }
+            if (scenario.lander.maxThrustForce != defaults.maxThrustForce ||
+                scenario.lander.dryMass != defaults.dryMass.Value()) {
+                LOG_WARNING("Scenario %s sets thrust or dry mass; sessions fly the default engine",
+                            scenarios.GetName(scenario));
+            }
+        }
+    }
+    
+    // The game's start (the middle of the world, 20 m up, a full tank) on
+    // seed + i % terrains, or scenario i's
+    NetSessionSettings settings;
+    settings.fixedTimeStep = 1.0f / physicsRate;
+    settings.gravity = Rules::GetGravity(difficulty);
+    settings.maxFuel = 1000.0f;
+    settings.fuelRate = 10.0f;
+    settings.spawnX = Units::ToMeters(Pixels(worldWidth / 2.0f)).Value();
+    settings.spawnY = 20.0f;
+    settings.spawnVelX = 0.0f;
+    settings.spawnVelY = 0.0f;
+    settings.spawnFuel = settings.maxFuel;
+    settings.landerWidth = LanderConfig::Default().width.Value();
+    settings.landerHeight = LanderConfig::Default().height.Value();
+    settings.worldWidth = static_cast<uint16_t>(worldWidth);
+    settings.worldHeight = static_cast<uint16_t>(worldHeight);
+    
+    // One segment table per distinct terrain, shared by its sessions
+    std::map<uint64_t, std::shared_ptr<const LanderBatchTerrain>> terrains;
+    size_t terrainBytes = 0;
+    std::vector<std::unique_ptr<NetSession>> sessions;
+    sessions.reserve(static_cast<size_t>(sessionCount));
+    for (int i = 0; i < sessionCount; i++) {
+        if (scenarios.IsOpen()) {
+            const ScenarioRecord& scenario = scenarios.Get(static_cast<uint32_t>(i) % scenarios.GetCount());
+            settings.seed = scenario.seed;
+            settings.gravity = scenario.gravity;
+            settings.maxFuel = scenario.lander.maxFuel;
+            settings.fuelRate = scenario.lander.consumptionRate;
+            settings.spawnX = Units::ToMeters(Pixels(scenario.worldWidth / 2.0f)).Value() + scenario.spawn[0];
+            settings.spawnY = scenario.spawn[1];
+            settings.spawnVelX = scenario.velocity[0];
+            settings.spawnVelY = scenario.velocity[1];
+            settings.spawnFuel = scenario.fuel;
+            settings.landerWidth = scenario.lander.width;
+            settings.landerHeight = scenario.lander.height;
+            settings.worldWidth = static_cast<uint16_t>(scenario.worldWidth);
+            settings.worldHeight = static_cast<uint16_t>(scenario.worldHeight);
+        } else {
+            settings.seed = static_cast<uint32_t>(seed + i % terrainCount);
+        }
+        const uint64_t terrainKey = settings.seed | uint64_t(settings.worldWidth) << 32 |
+                                    uint64_t(settings.worldHeight) << 48;
+        if (terrains.find(terrainKey) == terrains.end()) {
+            Terrain terrain;
+            terrain.SetSeed(settings.seed);
+            terrain.Generate2D(settings.worldWidth, settings.worldHeight);
+            terrains[terrainKey] = LanderBatchTerrain::Build(&terrain);
+            terrainBytes += terrains[terrainKey]->GetMemoryUsage();
+        }
+        
+        auto session = std::make_unique<NetSession>();
+        session->SetDedicated(true);
+        if (!session->Host(static_cast<uint16_t>(basePort + i), settings)) {
+            LOG_ERROR("Could not host session %d on port %d", i, basePort + i);
+            Log::Stop();
+            return 1;
+        }
+        session->SetTerrain(terrains[terrainKey]);
+        sessions.push_back(std::move(session));
+    }
+    
+    size_t sessionBytes = 0;
+    for (const auto& session : sessions) {
+        sessionBytes += session->GetMemoryUsage();
+    }
+    LOG_INFO("Hosting %d sessions on ports %d-%d at %g Hz: %.1f KB per session, %zu terrain%s (%.1f KB) shared",
+             sessionCount, basePort, basePort + sessionCount - 1, physicsRate,
+             sessionBytes / 1024.0 / sessionCount, terrains.size(), terrains.size() == 1 ? "" : "s",
+             terrainBytes / 1024.0);
+    
+    JobSystem jobSystem(threads);
+    
+    // Step buckets from a tenth of a millisecond to past a whole step at 10 Hz
+    static const double kStepBounds[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.1 };
+    const int stepTimeMetric = Metrics::AddHistogram("lander_server_step_seconds",
+                                                     "Wall time of one fixed step of every session", kStepBounds,
+                                                     static_cast<int>(sizeof(kStepBounds) / sizeof(kStepBounds[0])));
+    const int stepsMetric = Metrics::AddCounter("lander_server_steps_total", "Fixed steps taken");
+    const int overrunsMetric = Metrics::AddCounter("lander_server_step_overruns_total",
+                                                   "Steps that took longer than the step period");
+    const int sessionStepsMetric = Metrics::AddCounter("lander_session_steps_total",
+                                                       "Session steps, summed over sessions");
+    const int bytesInMetric = Metrics::AddCounter("lander_network_received_bytes_total",
+                                                  "Bytes received by every session");
+    const int bytesOutMetric = Metrics::AddCounter("lander_network_sent_bytes_total", "Bytes sent by every session");
+    const int sessionsMetric = Metrics::AddGauge("lander_sessions", "Sessions hosted");
+    const int occupiedMetric = Metrics::AddGauge("lander_sessions_occupied", "Sessions with at least one lander");
+    const int landersMetric = Metrics::AddGauge("lander_landers", "Landers flying in every session");
+    Metrics::AddMemoryTags();
+    Metrics::AddJobSystem(jobSystem);
+    Metrics::Set(sessionsMetric, sessionCount);
+    
+    // Declared after the job system, so it stops scraping before that goes
+    MetricsServer metricsServer;
+    if (metricsPort > 0 && !metricsServer.Start(static_cast<uint16_t>(metricsPort))) {
+        Log::Stop();
+        return 1;
+    }
+    
+    // Fixed steps on the wall clock. A step that overran is caught up at
+    // once, up to a quarter of a second; past that the clock is let go so
+    // a stall doesn't turn into a burst.
+    using Clock = std::chrono::steady_clock;
+    const auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / physicsRate));
+    const int maxCatchUp = std::max(1, static_cast<int>(physicsRate / 4.0f));
+    const auto start = Clock::now();
+    auto nextStep = start;
+    auto nextStats = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(statsInterval));
+    uint64_t steps = 0;
+    double busySeconds = 0.0;
+    while (!sStopping) {
+        auto now = Clock::now();
+        if (duration > 0.0f && std::chrono::duration<float>(now - start).count() >= duration) {
+            break;
+        }
+        if (now < nextStep) {
+            std::this_thread::sleep_until(nextStep);
+            continue;
+        }
+        if (now - nextStep > step * maxCatchUp) {
+            nextStep = now;
+        }
+        
+        jobSystem.ParallelFor(sessions.size(), kSessionsPerJob, [&](size_t begin, size_t end) {
+            uint64_t bytesIn = 0;
+            uint64_t bytesOut = 0;
+            for (size_t i = begin; i < end; i++) {
+                const NetSessionStats& stats = sessions[i]->GetStats();
+                const uint64_t received = stats.bytesReceived;
+                const uint64_t sent = stats.bytesSent;
+                sessions[i]->Step(0);
+                bytesIn += stats.bytesReceived - received;
+                bytesOut += stats.bytesSent - sent;
+            }
+            Metrics::Add(sessionStepsMetric, static_cast<int64_t>(end - begin));
+            Metrics::Add(bytesInMetric, static_cast<int64_t>(bytesIn));
+            Metrics::Add(bytesOutMetric, static_cast<int64_t>(bytesOut));
+        });
+        nextStep += step;
+        steps++;
+        const double stepSeconds = std::chrono::duration<double>(Clock::now() - now).count();
+        busySeconds += stepSeconds;
+        Metrics::Observe(stepTimeMetric, stepSeconds);
+        Metrics::Add(stepsMetric);
+        if (stepSeconds > 1.0 / physicsRate) {
+            Metrics::Add(overrunsMetric);
+        }
+        if (metricsServer.IsRunning()) {
+            int landers = 0;
+            int occupied = 0;
+            for (const auto& session : sessions) {
+                const int count = session->GetLanderCount();
+                landers += count;
+                occupied += count > 0 ? 1 : 0;
+            }
+            Metrics::Set(landersMetric, landers);
+            Metrics::Set(occupiedMetric, occupied);
+        }
+        
+        if (Clock::now() >= nextStats) {
+            int landers = 0;
+            int occupied = 0;
+            uint64_t bytesIn = 0;
+            uint64_t bytesOut = 0;
+            for (const auto& session : sessions) {
+                int count = session->GetLanderCount();
+                landers += count;
+                occupied += count > 0 ? 1 : 0;
+                bytesIn += session->GetStats().bytesReceived;
+                bytesOut += session->GetStats().bytesSent;
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            LOG_INFO("%d landers in %d sessions, %.1f kbit/s in, %.1f kbit/s out, steps %.0f%% busy",
+                     landers, occupied, bytesIn * 8.0 / 1000.0 / seconds, bytesOut * 8.0 / 1000.0 / seconds,
+                     busySeconds / (steps * (1.0 / physicsRate)) * 100.0);
+            nextStats += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(statsInterval));
+        }
+    }
+    
+    LOG_INFO("Shutting down after %llu steps", static_cast<unsigned long long>(steps));
+    for (auto& session : sessions) {
+        session->Close();
+    }
+    sessions.clear();
+    Log::Stop();
+    return 0;
+}
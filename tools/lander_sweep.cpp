@@ -0,0 +1,739 @@
+// lander_sweep.cpp
+// Monte Carlo landing evaluation: flies a grid of scenarios on every core
+//
+// Each scenario is one start state (position, velocity), one difficulty and
+// one set of controller gains, flown headless on the 2D terrain by the
+// LanderBatch engine until it lands, crashes or runs out of time. Results
+// go to a columnar file: a header naming each column, then every column's
+// values stored contiguously (see WriteColumns).
+//
+// With --metrics, a Prometheus endpoint serves its progress while it runs:
+// the workers count scenarios and time batch steps in their own metric
+// shards, so long sweeps can be watched without slowing them.
+
+#include "core/DescentController.h"
+#include "core/Integrators.h"
+#if LANDER_SWEEP_GPU
+#include "core/LanderBatchGpu.h"
+#endif
+#include "core/JobSystem.h"
+#include "core/LanderBatch.h"
+#include "core/Log.h"
+#include "core/Metrics.h"
+#include "core/MetricsServer.h"
+#include "core/PlumeTable.h"
+#include "core/Rules.h"
+#include "core/Terrain.h"
+#include "core/Units.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where the build puts the GPU kernel (CMake passes it with --gpu)
+#ifndef LANDER_BATCH_METALLIB
+#define LANDER_BATCH_METALLIB "lander_batch.metallib"
+#endif
+
+// count values evenly spaced over [min, max] (just min when count is 1)
+struct SweepRange {
+    float min;
+    float max;
+    int count;
+    
+    float At(int i) const {
+        return count > 1 ? min + (max - min) * i / (count - 1) : min;
+    }
+};
+
+// One row of the sweep
+struct Scenario {
+    float x, y;
+    float velX, velY;
+    Difficulty difficulty;
+    DescentControllerGains controller;
+};
+
+// What a scenario ended with
+struct Outcome {
+    uint8_t state;           // LanderBatchState; BATCH_FLYING = timed out
+    float touchdownVelX;
+    float touchdownVelY;
+    float fuelUsed;          // kg
+    float score;             // As in Game::Update
+    float flightTime;        // Seconds
+};
+
+// Metric ids; -1 (no --metrics) makes every update a no-op
+struct SweepMetrics {
+    int batchStep = -1;
+    int scenarios = -1;
+    int landed = -1;
+    int crashed = -1;
+    std::atomic<int64_t> flying{0};     // Landers in batches being flown
+};
+
+static SweepMetrics sMetrics;
+
+static bool ParseRange(const char* text, SweepRange& range) {
+    float min = 0.0f, max = 0.0f;
+    int count = 1;
+    int fields = std::sscanf(text, "%f:%f:%d", &min, &max, &count);
+    if (fields == 1) {
+        max = min;
+        count = 1;
+    } else if (fields != 3 || count < 1) {
+        return false;
+    }
+    range = { min, max, count };
+    return true;
+}
+
+static bool ParseDifficulties(const std::string& text, std::vector<Difficulty>& difficulties) {
+    difficulties.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        std::string name = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (name == "easy") {
+            difficulties.push_back(Difficulty::EASY);
+        } else if (name == "normal") {
+            difficulties.push_back(Difficulty::NORMAL);
+        } else if (name == "hard") {
+            difficulties.push_back(Difficulty::HARD);
+        } else {
+            return false;
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return !difficulties.empty();
+}
+
+// A batch holding scenarios [begin, end), all of one difficulty, and
+// their controller gains
+static void PrepareBatch(const Terrain& terrain, const std::shared_ptr<const PlumeTable>& plume,
+                         const std::vector<Scenario>& scenarios, size_t begin, size_t end,
+                         LanderBatch& batch, std::vector<DescentControllerGains>& gains) {
+    const size_t count = end - begin;
+    batch.SetTerrain(&terrain);
+    batch.SetPlumeTable(plume);
+    batch.SetGravity(Rules::GetGravity(scenarios[begin].difficulty));
+    batch.Resize(count);
+    gains.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const Scenario& scenario = scenarios[begin + i];
+        batch.SetInitialState(i, scenario.x, scenario.y, scenario.velX, scenario.velY);
+        gains[i] = scenario.controller;
+    }
+}
+
+static void RecordOutcome(uint8_t state, float touchdownVelX, float touchdownVelY, float fuel, float maxFuel,
+                          int endStep, float timeStep, Outcome& outcome) {
+    outcome.state = state;
+    outcome.touchdownVelX = touchdownVelX;
+    outcome.touchdownVelY = touchdownVelY;
+    outcome.fuelUsed = maxFuel - fuel;
+    outcome.score = state == BATCH_LANDED ? Rules::GetLandingScore(fuel, maxFuel) : 0.0f;
+    outcome.flightTime = endStep * timeStep;
+}
+
+// Fly scenarios [begin, end), all of one difficulty, on the calling thread
+static void FlyScenarios(const Terrain& terrain, const std::shared_ptr<const PlumeTable>& plume,
+                         const std::vector<Scenario>& scenarios, size_t begin, size_t end, float timeStep,
+                         int maxSteps, std::vector<Outcome>& outcomes) {
+    const size_t count = end - begin;
+    
+    LanderBatch batch;
+    std::vector<DescentControllerGains> gains;
+    PrepareBatch(terrain, plume, scenarios, begin, end, batch, gains);
+    
+    DescentController controller;
+    controller.SetLanderGains(std::move(gains));
+    
+    std::vector<int> endStep(count, maxSteps);
+    size_t flying = count;
+    const bool timed = sMetrics.batchStep >= 0;
+    sMetrics.flying.fetch_add(static_cast<int64_t>(count), std::memory_order_relaxed);
+    for (int step = 0; step < maxSteps && flying > 0; step++) {
+        const auto stepStart = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        batch.ApplyController(controller, timeStep);
+        batch.Step(timeStep);
+        if (timed) {
+            Metrics::Observe(sMetrics.batchStep,
+                             std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count());
+        }
+        
+        const uint8_t* state = batch.GetState();
+        for (size_t i = 0; i < count; i++) {
+            if (endStep[i] == maxSteps && state[i] != BATCH_FLYING) {
+                endStep[i] = step + 1;
+                flying--;
+            }
+        }
+    }
+    
+    const uint8_t* state = batch.GetState();
+    const float* fuel = batch.GetFuel();
+    int64_t landed = 0, crashed = 0;
+    for (size_t i = 0; i < count; i++) {
+        RecordOutcome(state[i], batch.GetTouchdownVelocityX()[i], batch.GetTouchdownVelocityY()[i], fuel[i],
+                      batch.GetMaxFuel(), endStep[i], timeStep, outcomes[begin + i]);
+        landed += state[i] == BATCH_LANDED;
+        crashed += state[i] == BATCH_CRASHED;
+    }
+    sMetrics.flying.fetch_sub(static_cast<int64_t>(count), std::memory_order_relaxed);
+    Metrics::Add(sMetrics.scenarios, static_cast<int64_t>(count));
+    Metrics::Add(sMetrics.landed, landed);
+    Metrics::Add(sMetrics.crashed, crashed);
+}
+
+#if LANDER_SWEEP_GPU
+// Fly scenarios [begin, end), all of one difficulty, on the GPU:
+// stepsPerDispatch steps per command buffer until none is flying
+static bool FlyScenariosGpu(LanderBatchGpu& gpu, const Terrain& terrain, const std::vector<Scenario>& scenarios,
+                            size_t begin, size_t end, float timeStep, int maxSteps, int stepsPerDispatch,
+                            std::vector<Outcome>& outcomes) {
+    LanderBatch batch;
+    std::vector<DescentControllerGains> gains;
+    PrepareBatch(terrain, nullptr, scenarios, begin, end, batch, gains);
+    if (!gpu.Upload(batch) || !gpu.SetLanderGains(gains)) {
+        return false;
+    }
+    
+    for (int step = 0; step < maxSteps && gpu.CountInState(BATCH_FLYING) > 0; step += stepsPerDispatch) {
+        if (!gpu.Step(timeStep, std::min(stepsPerDispatch, maxSteps - step))) {
+            return false;
+        }
+    }
+    
+    // Read in place from the shared buffers
+    const uint8_t* state = gpu.GetState();
+    const float* fuel = gpu.GetFuel();
+    const uint32_t* endStep = gpu.GetEndStep();
+    for (size_t i = 0; i < gpu.GetCount(); i++) {
+        const int steps = endStep[i] > 0 ? static_cast<int>(endStep[i]) : maxSteps;
+        RecordOutcome(state[i], gpu.GetTouchdownVelocityX()[i], gpu.GetTouchdownVelocityY()[i], fuel[i],
+                      batch.GetMaxFuel(), steps, timeStep, outcomes[begin + i]);
+    }
+    return true;
+}
+
+// Scenarios whose GPU outcome strays from the CPU's: a different ending, or
+// touchdown velocities or flight times apart by more than the GPU's
+// rounding can explain
+static size_t CountMismatches(const std::vector<Outcome>& cpu, const std::vector<Outcome>& gpu, float timeStep) {
+    const float kVelocityTolerance = 0.05f;    // m/s
+    const float timeTolerance = std::max(0.1f, 2.0f * timeStep);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < cpu.size(); i++) {
+        const bool same = cpu[i].state == gpu[i].state &&
+                          std::fabs(cpu[i].touchdownVelX - gpu[i].touchdownVelX) <= kVelocityTolerance &&
+                          std::fabs(cpu[i].touchdownVelY - gpu[i].touchdownVelY) <= kVelocityTolerance &&
+                          std::fabs(cpu[i].flightTime - gpu[i].flightTime) <= timeTolerance;
+        mismatches += !same;
+    }
+    return mismatches;
+}
+#endif
+
+// Columnar file: "LSWEEP01", uint32 row count, uint32 column count, then per
+// column a 32-byte name (NUL padded) and a 1-byte type ('f' float32, 'u'
+// uint8), then each column's rows back to back in the same order.
+// Little-endian, as written by the host.
+struct Column {
+    const char* name;
+    char type;
+    std::vector<float> floats;
+    std::vector<uint8_t> bytes;
+};
+
+static bool WriteColumns(const char* filename, const std::vector<Column>& columns, uint32_t rows) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    
+    const char magic[8] = { 'L', 'S', 'W', 'E', 'E', 'P', '0', '1' };
+    uint32_t columnCount = static_cast<uint32_t>(columns.size());
+    out.write(magic, sizeof(magic));
+    out.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    out.write(reinterpret_cast<const char*>(&columnCount), sizeof(columnCount));
+    for (const Column& column : columns) {
+        char name[32] = {};
+        std::strncpy(name, column.name, sizeof(name) - 1);
+        out.write(name, sizeof(name));
+        out.write(&column.type, 1);
+    }
+    for (const Column& column : columns) {
+        if (column.type == 'f') {
+            out.write(reinterpret_cast<const char*>(column.floats.data()), column.floats.size() * sizeof(float));
+        } else {
+            out.write(reinterpret_cast<const char*>(column.bytes.data()), column.bytes.size());
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+static bool WriteCsv(const char* filename, const std::vector<Column>& columns, uint32_t rows) {
+    FILE* file = std::fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+    for (size_t c = 0; c < columns.size(); c++) {
+        std::fprintf(file, "%s%s", c ? "," : "", columns[c].name);
+    }
+    std::fprintf(file, "\n");
+    for (uint32_t row = 0; row < rows; row++) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            if (columns[c].type == 'f') {
+                std::fprintf(file, "%s%g", c ? "," : "", columns[c].floats[row]);
+            } else {
+                std::fprintf(file, "%s%u", c ? "," : "", static_cast<unsigned>(columns[c].bytes[row]));
+            }
+        }
+        std::fprintf(file, "\n");
+    }
+    return std::fclose(file) == 0;
+}
+
+// Checkpoint manifest: "LSWCKP01", a fingerprint of the sweep's scenarios
+// and settings, the scenario count, how many of them are done and the size
+// of the results file holding their outcomes. Scenarios finish in order,
+// a block at a time, so the done ones are always a prefix. The manifest is
+// replaced whole by renaming a new one over it, so it only ever names
+// results that were completely appended.
+struct CheckpointManifest {
+    char magic[8];
+    uint64_t fingerprint;
+    uint64_t scenarioCount;
+    uint64_t completed;
+    uint64_t resultBytes;
+};
+
+static const char kCheckpointMagic[8] = { 'L', 'S', 'W', 'C', 'K', 'P', '0', '1' };
+
+// FNV-1a over everything that decides the sweep's outcomes and its blocks
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t SweepFingerprint(const std::vector<Scenario>& scenarios, float timeStep, int maxSteps, long seed,
+                                 bool groundEffect, size_t blockSize) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const Scenario& scenario : scenarios) {
+        const float values[] = { scenario.x, scenario.y, scenario.velX, scenario.velY,
+                                 scenario.controller.thrustGain, scenario.controller.descentGain,
+                                 scenario.controller.tiltGain };
+        const int32_t difficulty = static_cast<int32_t>(scenario.difficulty);
+        hash = HashBytes(hash, values, sizeof(values));
+        hash = HashBytes(hash, &difficulty, sizeof(difficulty));
+    }
+    const int64_t settings[] = { maxSteps, seed, groundEffect, static_cast<int64_t>(blockSize), LANDER_INTEGRATOR };
+    hash = HashBytes(hash, &timeStep, sizeof(timeStep));
+    return HashBytes(hash, settings, sizeof(settings));
+}
+
+static bool ReadManifest(const std::string& path, CheckpointManifest& manifest) {
+    std::ifstream in(path, std::ios::binary);
+    return in.read(reinterpret_cast<char*>(&manifest), sizeof(manifest)) &&
+           std::memcmp(manifest.magic, kCheckpointMagic, sizeof(kCheckpointMagic)) == 0;
+}
+
+static bool WriteManifest(const std::string& path, const CheckpointManifest& manifest) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.write(reinterpret_cast<const char*>(&manifest), sizeof(manifest)).flush()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+// Resume from the manifest at path, or start it: fill the done prefix of
+// outcomes from the results file, dropping anything appended after the
+// manifest was last written
+static bool OpenCheckpoint(const std::string& path, uint64_t fingerprint, std::vector<Outcome>& outcomes,
+                           CheckpointManifest& manifest) {
+    const std::string resultsPath = path + ".results";
+    if (!ReadManifest(path, manifest)) {
+        std::memcpy(manifest.magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+        manifest.fingerprint = fingerprint;
+        manifest.scenarioCount = outcomes.size();
+        manifest.completed = 0;
+        manifest.resultBytes = 0;
+        std::ofstream results(resultsPath, std::ios::binary | std::ios::trunc);
+        return results && WriteManifest(path, manifest);
+    }
+    if (manifest.fingerprint != fingerprint || manifest.scenarioCount != outcomes.size() ||
+        manifest.completed > outcomes.size() || manifest.resultBytes != manifest.completed * sizeof(Outcome)) {
+        std::cerr << path << " is a checkpoint of a different sweep" << std::endl;
+        return false;
+    }
+    
+    std::error_code error;
+    std::filesystem::resize_file(resultsPath, manifest.resultBytes, error);
+    std::ifstream results(resultsPath, std::ios::binary);
+    if (error || !results.read(reinterpret_cast<char*>(outcomes.data()), manifest.resultBytes)) {
+        std::cerr << "Could not read " << resultsPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Append outcomes [begin, end), the scenarios right after the done ones,
+// then record them in the manifest
+static bool CommitCheckpoint(const std::string& path, const std::vector<Outcome>& outcomes, size_t begin,
+                             size_t end, CheckpointManifest& manifest) {
+    {
+        std::ofstream results(path + ".results", std::ios::binary | std::ios::app);
+        const size_t bytes = (end - begin) * sizeof(Outcome);
+        if (!results.write(reinterpret_cast<const char*>(outcomes.data() + begin), bytes).flush()) {
+            return false;
+        }
+    }
+    manifest.completed = end;
+    manifest.resultBytes = end * sizeof(Outcome);
+    return WriteManifest(path, manifest);
+}
+
+static void PrintUsage() {
+    std::cerr <<
+        "Usage: lander_sweep [options]\n"
+        "Ranges are min:max:count or a single value.\n"
+        "  --x RANGE            Start x, meters (default 10:30:5)\n"
+        "  --y RANGE            Start height, meters (default 20:28:3)\n"
+        "  --vx RANGE           Start horizontal velocity, m/s (default -2:2:5)\n"
+        "  --vy RANGE           Start vertical velocity, m/s (default -4:0:3)\n"
+        "  --difficulty LIST    Comma separated easy,normal,hard (default all)\n"
+        "  --thrust-gain RANGE  Throttle per m/s of sink error (default 0.2:0.6:3)\n"
+        "  --descent-gain RANGE Target sink rate per meter of altitude (default 0.1:0.3:3)\n"
+        "  --tilt-gain RANGE    Tilt degrees per m/s of drift (default 10)\n"
+        "  --rate HZ            Physics rate (default 120)\n"
+        "  --max-time SECONDS   Flight time limit (default 120)\n"
+        "  --seed N             Terrain seed (default 1)\n"
+        "  --ground-effect      Add the plume's ground effect to the thrust near the surface\n"
+        "  --threads N          Worker threads (default: every core)\n"
+        "  --gpu                Fly the sweep on the GPU (Apple builds; no --ground-effect)\n"
+        "  --gpu-steps N        Steps per GPU dispatch (default 240)\n"
+        "  --gpu-check          Also fly it on the CPU and compare the outcomes\n"
+        "  --gpu-library FILE   Compiled lander_batch kernel (default: the build's)\n"
+        "  --checkpoint FILE    Record finished scenarios in FILE (and FILE.results) and\n"
+        "                       resume from it when it exists\n"
+        "  --checkpoint-every N Scenarios per checkpoint (default 65536)\n"
+        "  --metrics PORT       Serve Prometheus metrics on http://*:PORT/metrics (CPU sweeps)\n"
+        "  --out FILE           Columnar output (default sweep.lsw)\n"
+        "  --csv FILE           Also write the results as CSV\n";
+}
+
+int main(int argc, char* argv[]) {
+    SweepRange rangeX = { 10.0f, 30.0f, 5 };
+    SweepRange rangeY = { 20.0f, 28.0f, 3 };
+    SweepRange rangeVelX = { -2.0f, 2.0f, 5 };
+    SweepRange rangeVelY = { -4.0f, 0.0f, 3 };
+    SweepRange rangeThrustGain = { 0.2f, 0.6f, 3 };
+    SweepRange rangeDescentGain = { 0.1f, 0.3f, 3 };
+    SweepRange rangeTiltGain = { 10.0f, 10.0f, 1 };
+    std::vector<Difficulty> difficulties = { Difficulty::EASY, Difficulty::NORMAL, Difficulty::HARD };
+    float physicsRate = 120.0f;
+    float maxTime = 120.0f;
+    long seed = 1;
+    int threads = -1;
+    std::string outFile = "sweep.lsw";
+    std::string csvFile;
+    bool groundEffect = false;
+    bool useGpu = false;
+    bool gpuCheck = false;
+    int gpuSteps = 240;
+    std::string gpuLibrary = LANDER_BATCH_METALLIB;
+    std::string checkpointFile;
+    size_t checkpointEvery = 65536;
+    int metricsPort = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (arg == "--x" && hasValue) {
+            ok = ParseRange(argv[++i], rangeX);
+        } else if (arg == "--y" && hasValue) {
+            ok = ParseRange(argv[++i], rangeY);
+        } else if (arg == "--vx" && hasValue) {
+            ok = ParseRange(argv[++i], rangeVelX);
+        } else if (arg == "--vy" && hasValue) {
+            ok = ParseRange(argv[++i], rangeVelY);
+        } else if (arg == "--thrust-gain" && hasValue) {
+            ok = ParseRange(argv[++i], rangeThrustGain);
+        } else if (arg == "--descent-gain" && hasValue) {
+            ok = ParseRange(argv[++i], rangeDescentGain);
+        } else if (arg == "--tilt-gain" && hasValue) {
+            ok = ParseRange(argv[++i], rangeTiltGain);
+        } else if (arg == "--difficulty" && hasValue) {
+            ok = ParseDifficulties(argv[++i], difficulties);
+        } else if (arg == "--rate" && hasValue) {
+            physicsRate = std::max(10.0f, std::stof(argv[++i]));
+        } else if (arg == "--max-time" && hasValue) {
+            maxTime = std::max(0.1f, std::stof(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            seed = std::stol(argv[++i]);
+        } else if (arg == "--ground-effect") {
+            groundEffect = true;
+        } else if (arg == "--gpu") {
+            useGpu = true;
+        } else if (arg == "--gpu-check") {
+            useGpu = true;
+            gpuCheck = true;
+        } else if (arg == "--gpu-steps" && hasValue) {
+            gpuSteps = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--gpu-library" && hasValue) {
+            gpuLibrary = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            threads = std::stoi(argv[++i]);
+        } else if (arg == "--checkpoint" && hasValue) {
+            checkpointFile = argv[++i];
+        } else if (arg == "--checkpoint-every" && hasValue) {
+            checkpointEvery = static_cast<size_t>(std::max(1L, std::stol(argv[++i])));
+        } else if (arg == "--metrics" && hasValue) {
+            metricsPort = std::stoi(argv[++i]);
+            ok = metricsPort > 0 && metricsPort <= 65535;
+        } else if (arg == "--out" && hasValue) {
+            outFile = argv[++i];
+        } else if (arg == "--csv" && hasValue) {
+            csvFile = argv[++i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+#if !LANDER_SWEEP_GPU
+    (void)gpuSteps;
+    if (useGpu) {
+        std::cerr << "This build has no GPU lander batch" << std::endl;
+        return 1;
+    }
+#endif
+    if (useGpu && groundEffect) {
+        std::cerr << "The GPU lander batch has no ground effect" << std::endl;
+        return 1;
+    }
+    if (useGpu && !checkpointFile.empty()) {
+        std::cerr << "GPU sweeps have no checkpoints" << std::endl;
+        return 1;
+    }
+    Log::SetLevel(LogLevel::Warning);
+    
+    // The game's 2D terrain at its default window size
+    Terrain terrain;
+    terrain.SetSeed(static_cast<uint32_t>(seed));
+    terrain.Generate2D(800, 600);
+    
+    // One table for every batch, for the batch lander's base
+    std::shared_ptr<const PlumeTable> plume;
+    if (groundEffect) {
+        auto table = std::make_shared<PlumeTable>();
+        table->Build(LanderBatch().GetLanderWidth() / 2);
+        plume = table;
+    }
+    
+    // Difficulty outermost, so each one is a contiguous run sharing gravity
+    std::vector<Scenario> scenarios;
+    std::vector<size_t> difficultyStart;
+    for (Difficulty difficulty : difficulties) {
+        difficultyStart.push_back(scenarios.size());
+        for (int ix = 0; ix < rangeX.count; ix++)
+        for (int iy = 0; iy < rangeY.count; iy++)
+        for (int ivx = 0; ivx < rangeVelX.count; ivx++)
+        for (int ivy = 0; ivy < rangeVelY.count; ivy++)
+        for (int it = 0; it < rangeThrustGain.count; it++)
+        for (int id = 0; id < rangeDescentGain.count; id++)
+        for (int ig = 0; ig < rangeTiltGain.count; ig++) {
+            Scenario scenario;
+            scenario.x = rangeX.At(ix);
+            scenario.y = rangeY.At(iy);
+            scenario.velX = rangeVelX.At(ivx);
+            scenario.velY = rangeVelY.At(ivy);
+            scenario.difficulty = difficulty;
+            scenario.controller = { rangeThrustGain.At(it), rangeDescentGain.At(id), rangeTiltGain.At(ig) };
+            scenarios.push_back(scenario);
+        }
+    }
+    difficultyStart.push_back(scenarios.size());
+    
+    // Scenarios are independent: split each difficulty's run across the
+    // pool, one LanderBatch per chunk
+    const float timeStep = 1.0f / physicsRate;
+    const int maxSteps = static_cast<int>(std::ceil(maxTime * physicsRate));
+    const size_t kScenariosPerJob = 1024;
+    std::vector<Outcome> outcomes(scenarios.size());
+    JobSystem jobSystem(threads);
+    
+    // Declared after the job system, so it stops scraping before that goes
+    MetricsServer metricsServer;
+    if (metricsPort > 0) {
+        static const double kStepBounds[] = { 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.01 };
+        sMetrics.batchStep = Metrics::AddHistogram("lander_sweep_batch_step_seconds",
+                                                   "Wall time of one step of one worker's batch", kStepBounds,
+                                                   static_cast<int>(sizeof(kStepBounds) / sizeof(kStepBounds[0])));
+        sMetrics.scenarios = Metrics::AddCounter("lander_sweep_scenarios_flown_total", "Scenarios flown to the end");
+        sMetrics.landed = Metrics::AddCounter("lander_sweep_landed_total", "Scenarios that landed");
+        sMetrics.crashed = Metrics::AddCounter("lander_sweep_crashed_total", "Scenarios that crashed");
+        const double total = static_cast<double>(scenarios.size());
+        Metrics::AddCallback("lander_sweep_scenarios", "Scenarios in the sweep", MetricType::Gauge, nullptr,
+                             [total]() { return total; });
+        Metrics::AddCallback("lander_landers", "Landers in the batches being flown", MetricType::Gauge, nullptr,
+                             []() { return static_cast<double>(sMetrics.flying.load(std::memory_order_relaxed)); });
+        Metrics::AddMemoryTags();
+        Metrics::AddJobSystem(jobSystem);
+        if (!metricsServer.Start(static_cast<uint16_t>(metricsPort))) {
+            return 1;
+        }
+    }
+    
+    // With a checkpoint each difficulty's run is flown in blocks, every
+    // block appended and recorded before the next; a resumed sweep skips
+    // the blocks its manifest has
+    CheckpointManifest manifest = {};
+    if (!checkpointFile.empty()) {
+        const uint64_t fingerprint = SweepFingerprint(scenarios, timeStep, maxSteps, seed, groundEffect,
+                                                      checkpointEvery);
+        if (!OpenCheckpoint(checkpointFile, fingerprint, outcomes, manifest)) {
+            return 1;
+        }
+        if (manifest.completed > 0) {
+            std::printf("Resuming after %llu of %zu scenarios\n",
+                        static_cast<unsigned long long>(manifest.completed), scenarios.size());
+        }
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    if (!useGpu || gpuCheck) {
+        for (size_t d = 0; d + 1 < difficultyStart.size(); d++) {
+            const size_t runEnd = difficultyStart[d + 1];
+            for (size_t first = difficultyStart[d]; first < runEnd;) {
+                const size_t last = checkpointFile.empty() ? runEnd : std::min(first + checkpointEvery, runEnd);
+                if (last > manifest.completed) {
+                    jobSystem.ParallelFor(last - first, kScenariosPerJob, [&](size_t begin, size_t end) {
+                        FlyScenarios(terrain, plume, scenarios, first + begin, first + end, timeStep, maxSteps,
+                                     outcomes);
+                    });
+                    if (!checkpointFile.empty() && !CommitCheckpoint(checkpointFile, outcomes, first, last, manifest)) {
+                        std::cerr << "Could not write the checkpoint " << checkpointFile << std::endl;
+                        return 1;
+                    }
+                }
+                first = last;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+#if LANDER_SWEEP_GPU
+    // One dispatch stretch per difficulty: its whole run is one batch. The
+    // GPU's outcomes are the ones written out.
+    if (useGpu) {
+        LanderBatchGpu gpu;
+        if (!gpu.Initialize(gpuLibrary.c_str())) {
+            return 1;
+        }
+        std::vector<Outcome> cpuOutcomes;
+        cpuOutcomes.swap(outcomes);
+        outcomes.resize(scenarios.size());
+        
+        const double cpuSeconds = seconds;
+        start = std::chrono::steady_clock::now();
+        for (size_t d = 0; d + 1 < difficultyStart.size(); d++) {
+            if (difficultyStart[d + 1] > difficultyStart[d] &&
+                !FlyScenariosGpu(gpu, terrain, scenarios, difficultyStart[d], difficultyStart[d + 1], timeStep,
+                                 maxSteps, gpuSteps, outcomes)) {
+                std::cerr << "GPU sweep failed" << std::endl;
+                return 1;
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        if (gpuCheck) {
+            const size_t mismatches = CountMismatches(cpuOutcomes, outcomes, timeStep);
+            std::printf("GPU check: %zu of %zu scenarios differ from the CPU (CPU %.2f s, GPU %.2f s)\n",
+                        mismatches, outcomes.size(), cpuSeconds, seconds);
+            // Landers right at a landing limit may end differently after
+            // rounding; more than a few is a kernel bug
+            if (mismatches * 100 > outcomes.size()) {
+                return 1;
+            }
+        }
+    }
+#endif
+    
+    // Columns: inputs, then outcomes
+    const uint32_t rows = static_cast<uint32_t>(scenarios.size());
+    std::vector<Column> columns = {
+        { "x", 'f' }, { "y", 'f' }, { "vel_x", 'f' }, { "vel_y", 'f' }, { "gravity", 'f' },
+        { "thrust_gain", 'f' }, { "descent_gain", 'f' }, { "tilt_gain", 'f' },
+        { "state", 'u' }, { "landed", 'u' }, { "touchdown_vel_x", 'f' }, { "touchdown_vel_y", 'f' },
+        { "fuel_used", 'f' }, { "score", 'f' }, { "flight_time", 'f' }
+    };
+    size_t landed = 0, crashed = 0;
+    for (uint32_t row = 0; row < rows; row++) {
+        const Scenario& scenario = scenarios[row];
+        const Outcome& outcome = outcomes[row];
+        const float values[] = {
+            scenario.x, scenario.y, scenario.velX, scenario.velY, Rules::GetGravity(scenario.difficulty),
+            scenario.controller.thrustGain, scenario.controller.descentGain, scenario.controller.tiltGain
+        };
+        for (size_t c = 0; c < sizeof(values) / sizeof(values[0]); c++) {
+            columns[c].floats.push_back(values[c]);
+        }
+        columns[8].bytes.push_back(outcome.state);
+        columns[9].bytes.push_back(outcome.state == BATCH_LANDED ? 1 : 0);
+        columns[10].floats.push_back(outcome.touchdownVelX);
+        columns[11].floats.push_back(outcome.touchdownVelY);
+        columns[12].floats.push_back(outcome.fuelUsed);
+        columns[13].floats.push_back(outcome.score);
+        columns[14].floats.push_back(outcome.flightTime);
+        landed += outcome.state == BATCH_LANDED;
+        crashed += outcome.state == BATCH_CRASHED;
+    }
+    
+    if (!WriteColumns(outFile.c_str(), columns, rows)) {
+        std::cerr << "Could not write " << outFile << std::endl;
+        return 1;
+    }
+    if (!csvFile.empty() && !WriteCsv(csvFile.c_str(), columns, rows)) {
+        std::cerr << "Could not write " << csvFile << std::endl;
+        return 1;
+    }
+    
+    if (useGpu) {
+        std::printf("%u scenarios in %.2f s on the GPU: %zu landed, %zu crashed, %zu timed out\n",
+                    rows, seconds, landed, crashed, rows - landed - crashed);
+    } else {
+        std::printf("%u scenarios in %.2f s on %d threads: %zu landed, %zu crashed, %zu timed out\n",
+                    rows, seconds, jobSystem.GetWorkerCount() + 1, landed, crashed, rows - landed - crashed);
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+// perf_replay.cpp
+// Performance regression gate: replays recorded flights and compares their stage timings with a baseline
+//
+// Each recording is played by the game headless (simulation stages only) and
+// in a window (the frame's CPU stages and the GPU passes), several times. A
+// run writes its stage report (Profiler::WriteStageReport); per stage the
+// fastest run's average and 99th percentile are kept, which is the run the
+// rest of the machine disturbed least. The gate fails when a stage is
+// slower than the baseline by more than both the percentage threshold and
+// the absolute floor, the floor keeping sub-millisecond stages from
+// tripping it on noise.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Stages that ran in fewer frames (one-offs like the first frame's
+// pipeline creation) are reported but never compared
+static const int kMinFrames = 10;
+
+// Exit codes
+static const int kExitPassed = 0;
+static const int kExitRegressed = 1;
+static const int kExitError = 2;
+
+struct StageTiming {
+    int frames;
+    double avgMs;
+    double p99Ms;
+};
+
+// Timings by case ("<recording>:headless" or ":windowed"), then stage
+typedef std::map<std::string, std::map<std::string, StageTiming>> TimingTable;
+
+struct PerfOptions {
+    std::string game = "./LunarLander";
+    std::string baseline;
+    std::string gameArgs;
+    std::vector<std::string> recordings;
+    int runs = 3;
+    double avgThreshold = 10.0;     // Percent
+    double p99Threshold = 25.0;     // Percent
+    double minDeltaMs = 0.05;
+    bool headless = true;
+    bool windowed = true;
+    bool update = false;
+};
+
+static void PrintUsage() {
+    std::cerr << "Usage: perf_replay --baseline <file> [options] <recording>...\n"
+                 "  --game PATH           LunarLander executable (default ./LunarLander)\n"
+                 "  --update              Write the baseline from this run instead of comparing\n"
+                 "  --runs N              Runs per recording and mode, fastest kept (default 3)\n"
+                 "  --avg-threshold PCT   Allowed rise of a stage's average (default 10)\n"
+                 "  --p99-threshold PCT   Allowed rise of a stage's 99th percentile (default 25)\n"
+                 "  --min-delta MS        Rises smaller than this always pass (default 0.05)\n"
+                 "  --headless-only       Skip the windowed runs\n"
+                 "  --windowed-only       Skip the headless runs\n"
+                 "  --game-args \"ARGS\"    Extra arguments for every run (e.g. \"--gpu-culling\")\n"
+                 "Exits 0 when every stage is within its thresholds, 1 on a regression and 2 on an error.\n";
+}
+
+// Single-quoted for /bin/sh
+static std::string ShellQuote(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "'";
+}
+
+// Read a stage report: stage,frames,avg_ms,p50_ms,p99_ms,max_ms
+static bool ReadStageReport(const std::string& filename, std::map<std::string, StageTiming>& stages) {
+    std::ifstream file(filename);
+    std::string line;
+    if (!file || !std::getline(file, line)) {
+        return false;
+    }
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string stage, frames, avg, p50, p99;
+        if (!std::getline(stream, stage, ',') || !std::getline(stream, frames, ',') ||
+            !std::getline(stream, avg, ',') || !std::getline(stream, p50, ',') ||
+            !std::getline(stream, p99, ',')) {
+            return false;
+        }
+        stages[stage] = { std::atoi(frames.c_str()), std::atof(avg.c_str()), std::atof(p99.c_str()) };
+    }
+    return true;
+}
+
+// Baseline: case,stage,frames,avg_ms,p99_ms
+static bool ReadBaseline(const std::string& filename, TimingTable& table) {
+    std::ifstream file(filename);
+    std::string line;
+    if (!file || !std::getline(file, line)) {
+        return false;
+    }
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string name, stage, frames, avg, p99;
+        if (!std::getline(stream, name, ',') || !std::getline(stream, stage, ',') ||
+            !std::getline(stream, frames, ',') || !std::getline(stream, avg, ',') ||
+            !std::getline(stream, p99, ',')) {
+            return false;
+        }
+        table[name][stage] = { std::atoi(frames.c_str()), std::atof(avg.c_str()), std::atof(p99.c_str()) };
+    }
+    return true;
+}
+
+static bool WriteBaseline(const std::string& filename, const TimingTable& table) {
+    FILE* file = std::fopen(filename.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    std::fprintf(file, "case,stage,frames,avg_ms,p99_ms\n");
+    for (const auto& entry : table) {
+        for (const auto& stage : entry.second) {
+            std::fprintf(file, "%s,%s,%d,%.4f,%.4f\n", entry.first.c_str(), stage.first.c_str(),
+                         stage.second.frames, stage.second.avgMs, stage.second.p99Ms);
+        }
+    }
+    return std::fclose(file) == 0;
+}
+
+// Play one recording options.runs times and keep each stage's fastest run
+static bool RunCase(const PerfOptions& options, const std::string& recording, bool windowed,
+                    const std::string& reportFile, std::map<std::string, StageTiming>& best) {
+    std::string command = ShellQuote(options.game) + " --replay " + ShellQuote(recording) +
+                          " --stage-report " + ShellQuote(reportFile) + " --log-level warning";
+    if (windowed) {
+        // Uncapped, so the frame costs what the work does rather than the display
+        command += " --replay-windowed --no-vsync";
+    }
+    if (!options.gameArgs.empty()) {
+        command += " " + options.gameArgs;
+    }
+    
+    for (int run = 0; run < options.runs; run++) {
+        std::remove(reportFile.c_str());
+        int status = std::system(command.c_str());
+        std::map<std::string, StageTiming> stages;
+        if (status != 0 || !ReadStageReport(reportFile, stages)) {
+            std::cerr << "Run failed (status " << status << "): " << command << std::endl;
+            return false;
+        }
+        for (const auto& stage : stages) {
+            auto found = best.find(stage.first);
+            if (found == best.end()) {
+                best.insert(stage);
+            } else {
+                found->second.frames = std::max(found->second.frames, stage.second.frames);
+                found->second.avgMs = std::min(found->second.avgMs, stage.second.avgMs);
+                found->second.p99Ms = std::min(found->second.p99Ms, stage.second.p99Ms);
+            }
+        }
+    }
+    std::remove(reportFile.c_str());
+    return true;
+}
+
+// Percent change from baseline to current; zero baselines count as unchanged
+static double PercentChange(double baseline, double current) {
+    return baseline > 0.0 ? (current - baseline) / baseline * 100.0 : 0.0;
+}
+
+static bool IsRegression(double baseline, double current, double thresholdPercent, double minDeltaMs) {
+    return current - baseline > minDeltaMs && PercentChange(baseline, current) > thresholdPercent;
+}
+
+// Print every compared stage; returns the number that regressed
+static int Compare(const PerfOptions& options, const TimingTable& baseline, const TimingTable& current) {
+    int regressions = 0;
+    std::printf("%-32s %-28s %9s %9s %8s %9s %9s %8s\n", "case", "stage", "base avg", "avg", "change",
+                "base p99", "p99", "change");
+    for (const auto& entry : current) {
+        auto baseCase = baseline.find(entry.first);
+        for (const auto& stage : entry.second) {
+            const StageTiming& timing = stage.second;
+            if (baseCase == baseline.end() || baseCase->second.count(stage.first) == 0) {
+                std::printf("%-32s %-28s %9s %9.3f %8s %9s %9.3f %8s  new\n", entry.first.c_str(),
+                            stage.first.c_str(), "-", timing.avgMs, "", "-", timing.p99Ms, "");
+                continue;
+            }
+            const StageTiming& base = baseCase->second.at(stage.first);
+            const char* status = "ok";
+            if (timing.frames < kMinFrames || base.frames < kMinFrames) {
+                status = "skipped";
+            } else if (IsRegression(base.avgMs, timing.avgMs, options.avgThreshold, options.minDeltaMs) ||
+                       IsRegression(base.p99Ms, timing.p99Ms, options.p99Threshold, options.minDeltaMs)) {
+                status = "REGRESSED";
+                regressions++;
+            }
+            std::printf("%-32s %-28s %9.3f %9.3f %+7.1f%% %9.3f %9.3f %+7.1f%%  %s\n", entry.first.c_str(),
+                        stage.first.c_str(), base.avgMs, timing.avgMs, PercentChange(base.avgMs, timing.avgMs),
+                        base.p99Ms, timing.p99Ms, PercentChange(base.p99Ms, timing.p99Ms), status);
+        }
+        
+        // A stage that stopped running may have been renamed; say so, but
+        // it is not slower
+        if (baseCase != baseline.end()) {
+            for (const auto& stage : baseCase->second) {
+                if (entry.second.count(stage.first) == 0) {
+                    std::printf("%-32s %-28s  missing from this run\n", entry.first.c_str(), stage.first.c_str());
+                }
+            }
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    PerfOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--game" && i + 1 < argc) {
+            options.game = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baseline = argv[++i];
+        } else if (arg == "--update") {
+            options.update = true;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--avg-threshold" && i + 1 < argc) {
+            options.avgThreshold = std::atof(argv[++i]);
+        } else if (arg == "--p99-threshold" && i + 1 < argc) {
+            options.p99Threshold = std::atof(argv[++i]);
+        } else if (arg == "--min-delta" && i + 1 < argc) {
+            options.minDeltaMs = std::atof(argv[++i]);
+        } else if (arg == "--headless-only") {
+            options.windowed = false;
+        } else if (arg == "--windowed-only") {
+            options.headless = false;
+        } else if (arg == "--game-args" && i + 1 < argc) {
+            options.gameArgs = argv[++i];
+        } else if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return kExitPassed;
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.recordings.push_back(arg);
+        } else {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return kExitError;
+        }
+    }
+    if (options.baseline.empty() || options.recordings.empty() || (!options.headless && !options.windowed)) {
+        PrintUsage();
+        return kExitError;
+    }
+    
+    TimingTable baseline;
+    if (!options.update && !ReadBaseline(options.baseline, baseline)) {
+        std::cerr << "Could not read baseline " << options.baseline << " (make one with --update)" << std::endl;
+        return kExitError;
+    }
+    
+    std::error_code error;
+    const std::string reportFile = (std::filesystem::temp_directory_path(error) / "perf_replay_stages.csv").string();
+    TimingTable current;
+    for (const std::string& recording : options.recordings) {
+        const std::string name = std::filesystem::path(recording).stem().string();
+        for (int mode = 0; mode < 2; mode++) {
+            const bool windowed = mode == 1;
+            if (windowed ? !options.windowed : !options.headless) {
+                continue;
+            }
+            const std::string caseName = name + (windowed ? ":windowed" : ":headless");
+            std::cerr << "Replaying " << caseName << std::endl;
+            if (!RunCase(options, recording, windowed, reportFile, current[caseName])) {
+                return kExitError;
+            }
+        }
+    }
+    
+    if (options.update) {
+        if (!WriteBaseline(options.baseline, current)) {
+            std::cerr << "Could not write baseline " << options.baseline << std::endl;
+            return kExitError;
+        }
+        std::printf("Wrote baseline for %zu cases to %s\n", current.size(), options.baseline.c_str());
+        return kExitPassed;
+    }
+    
+    int regressions = Compare(options, baseline, current);
+    if (regressions > 0) {
+        std::printf("%d stage%s regressed\n", regressions, regressions == 1 ? "" : "s");
+        return kExitRegressed;
+    }
+    std::printf("No regressions\n");
+    return kExitPassed;
+}
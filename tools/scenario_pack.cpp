@@ -0,0 +1,81 @@
+// scenario_pack.cpp
+// Compiles scenario text into the binary table sessions map in place
+//
+// The text (see ScenarioFile::Compile) is one [name] section per scenario;
+// the output (core/ScenarioFile.h) is those scenarios as fixed records
+// sorted by name, which the game's --scenario and lander_server's
+// --scenarios read straight out of the mapping. --list prints a compiled
+// file back.
+
+#include "core/Log.h"
+#include "core/ScenarioFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintUsage() {
+    std::cerr << "Usage: scenario_pack <input text> <output file>\n"
+                 "       scenario_pack --list <scenario file>\n";
+}
+
+static const char* TerrainName(ScenarioTerrain terrain) {
+    return terrain == ScenarioTerrain::Generated2D ? "2d" : terrain == ScenarioTerrain::Generated3D ? "3d" : "dem";
+}
+
+static int List(const char* filename) {
+    ScenarioFile scenarios;
+    if (!scenarios.Open(filename)) {
+        std::cerr << "Could not open " << filename << std::endl;
+        return 1;
+    }
+    for (uint32_t i = 0; i < scenarios.GetCount(); i++) {
+        const ScenarioRecord& record = scenarios.Get(i);
+        std::printf("%-24s %-3s seed %-10u world %dx%d grid %d %s gravity %g position (%g, %g, %g) "
+                    "velocity (%g, %g, %g) fuel %g/%g kg\n",
+                    scenarios.GetName(record), TerrainName(record.terrain), record.seed, record.worldWidth,
+                    record.worldHeight, record.gridSize, scenarios.GetTerrainPath(record), record.gravity,
+                    record.spawn[0], record.spawn[1], record.spawn[2], record.velocity[0], record.velocity[1],
+                    record.velocity[2], record.fuel, record.lander.maxFuel);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    bool list = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            list = true;
+        } else if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (paths.size() != (list ? 1u : 2u)) {
+        PrintUsage();
+        return 1;
+    }
+    
+    // Errors go to the log, on this thread
+    Log::SetLevel(LogLevel::Warning);
+    if (list) {
+        return List(paths[0].c_str());
+    }
+    
+    ScenarioCompileStats stats;
+    if (!ScenarioFile::Compile(paths[0].c_str(), paths[1].c_str(), stats)) {
+        std::cerr << "Could not compile " << paths[0] << std::endl;
+        return 1;
+    }
+    std::printf("%u scenarios, %llu bytes\n", stats.scenarioCount, static_cast<unsigned long long>(stats.fileBytes));
+    return 0;
+}
@@ -0,0 +1,96 @@
+// telemetry_reader.cpp
+// Follows the game's shared memory telemetry stream and prints it as CSV
+//
+// A reference reader for ground-station tools (see core/TelemetryStream.h
+// for the layout): it maps the stream the game publishes with
+// --telemetry-shm and takes every record as it lands, so the game itself
+// never writes telemetry to stdout.
+
+#include "core/Log.h"
+#include "core/TelemetryStream.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static std::atomic<bool> sStopping(false);
+
+static void OnSignal(int) {
+    sStopping = true;
+}
+
+static void PrintUsage() {
+    std::cerr << "Usage: telemetry_reader [options]\n"
+                 "  --name NAME    Shared memory stream (default /lander-telemetry)\n"
+                 "  --from-start   Also print the records still in the ring\n"
+                 "  --every N      Print every Nth record (default 1)\n"
+                 "  --count N      Stop after N records (default: until interrupted)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = "/lander-telemetry";
+    bool fromStart = false;
+    long every = 1;
+    long count = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--name" && hasValue) {
+            name = argv[++i];
+        } else if (arg == "--from-start") {
+            fromStart = true;
+        } else if (arg == "--every" && hasValue) {
+            every = std::max(1L, std::stol(argv[++i]));
+        } else if (arg == "--count" && hasValue) {
+            count = std::max(0L, std::stol(argv[++i]));
+        } else if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    Log::SetLevel(LogLevel::Warning);
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+    
+    TelemetryReader reader;
+    if (!reader.Open(name, fromStart)) {
+        return 1;
+    }
+    
+    std::printf("step,flight_time,x,y,z,vel_x,vel_y,vel_z,qx,qy,qz,qw,spin_x,spin_y,spin_z,fuel,thrust,rcs,"
+                "altitude,flags,contacts,contact_impulse\n");
+    TelemetrySample sample;
+    long read = 0;
+    while (!sStopping && (count == 0 || read < count)) {
+        if (!reader.Next(sample)) {
+            // Records come every step; a millisecond's nap loses none
+            std::fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (read++ % every != 0) {
+            continue;
+        }
+        std::printf("%llu,%.4f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.5f,%.5f,%.5f,%.5f,%.4f,%.4f,%.4f,%.2f,%.3f,%.2f,"
+                    "%.3f,%u,%u,%.3f\n",
+                    static_cast<unsigned long long>(sample.step), sample.flightTime, sample.position[0],
+                    sample.position[1], sample.position[2], sample.velocity[0], sample.velocity[1],
+                    sample.velocity[2], sample.orientation[0], sample.orientation[1], sample.orientation[2],
+                    sample.orientation[3], sample.angularVelocity[0], sample.angularVelocity[1],
+                    sample.angularVelocity[2], sample.fuel, sample.thrustLevel, sample.rcsCommand,
+                    sample.altitude, sample.flags, sample.contacts, sample.contactImpulse);
+    }
+    std::fflush(stdout);
+    if (reader.GetDropped() > 0) {
+        std::cerr << reader.GetDropped() << " records were overwritten before they were read" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+// terrain_pack.cpp
+// Converts an elevation raster into a compressed terrain pack
+//
+// The pack (see core/TerrainPack.h) holds each 256x256 tile quantized,
+// delta coded and LZ4 compressed behind a seekable tile index. DemFile opens
+// it in place of the raster, so --dem takes either.
+
+#include "core/DemFile.h"
+#include "core/JobSystem.h"
+#include "core/Log.h"
+#include "core/TerrainPack.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintUsage() {
+    std::cerr << "Usage: terrain_pack <input .IMG/.LBL> <output pack> [options]\n"
+                 "  --threads N   Encoding threads (default: one per core)\n"
+                 "  --verify      Read the pack back and compare it with the input\n";
+}
+
+// Largest difference between the pack and the raster, one row of tiles at a
+// time
+static bool Verify(const DemFile& source, const char* filename, float& maxError, double& seconds) {
+    DemFile pack;
+    if (!pack.Open(filename) || pack.GetWidth() != source.GetWidth() || pack.GetHeight() != source.GetHeight()) {
+        return false;
+    }
+    const int width = source.GetWidth();
+    std::vector<float> expected(static_cast<size_t>(width) * DemFile::kTileSize);
+    std::vector<float> actual(expected.size());
+    maxError = 0.0f;
+    seconds = 0.0;
+    for (int y = 0; y < source.GetHeight(); y += DemFile::kTileSize) {
+        const int rows = std::min(DemFile::kTileSize, source.GetHeight() - y);
+        source.ReadRegion(0, y, width, rows, 1, expected.data());
+        auto start = std::chrono::steady_clock::now();
+        if (!pack.ReadRegion(0, y, width, rows, 1, actual.data())) {
+            return false;
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < static_cast<size_t>(width) * rows; i++) {
+            maxError = std::max(maxError, std::fabs(actual[i] - expected[i]));
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    int threads = -1;
+    bool verify = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            std::cerr << "Bad argument '" << arg << "'" << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (paths.size() != 2) {
+        PrintUsage();
+        return 1;
+    }
+    Log::SetLevel(LogLevel::Warning);
+    
+    DemFile dem;
+    if (!dem.Open(paths[0].c_str())) {
+        std::cerr << "Could not open " << paths[0] << std::endl;
+        return 1;
+    }
+    JobSystem jobSystem(threads);
+    TerrainPackStats stats;
+    if (!TerrainPack::Write(dem, paths[1].c_str(), &jobSystem, stats)) {
+        std::cerr << "Could not write " << paths[1] << std::endl;
+        return 1;
+    }
+    
+    // Against the same samples stored as 32-bit floats
+    const double floatBytes = static_cast<double>(stats.sampleCount) * sizeof(float);
+    std::printf("%dx%d samples in %.2f s: %.1f MB, %.2f bits/sample, %.1fx smaller than floats, "
+                "max quantization error %.4f m\n",
+                dem.GetWidth(), dem.GetHeight(), stats.seconds, stats.fileBytes / (1024.0 * 1024.0),
+                8.0 * stats.fileBytes / stats.sampleCount, floatBytes / stats.fileBytes, stats.maxError);
+    
+    if (verify) {
+        float maxError = 0.0f;
+        double seconds = 0.0;
+        if (!Verify(dem, paths[1].c_str(), maxError, seconds)) {
+            std::cerr << "Could not read back " << paths[1] << std::endl;
+            return 1;
+        }
+        std::printf("Read back in %.2f s (%.0f MB/s of floats), max error %.4f m\n", seconds,
+                    floatBytes / (1024.0 * 1024.0) / std::max(seconds, 1e-9), maxError);
+    }
+    return 0;
+}